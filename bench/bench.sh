@@ -0,0 +1,212 @@
+#!/bin/sh
+
+# End-to-end benchmark suite, normally started with "make bench".
+#
+# Every map in BENCH_MAPS is run three times on the dedicated server:
+#  record - a short bot match with cm_record, only when the trace file is missing
+#  micro  - map load profile, cm_replay, cm_bench, vmbench, deltabench,
+#           cmdbench, aasbench and botscriptbench
+#  frame  - com_benchmark with BENCH_BOTS bots
+# every demo in BENCH_DEMOS is played with timedemo 2 on the client.
+#
+# Results are written one metric per line as "name value lower|higher"
+# to $BENCH_DIR/results.txt and compared with BENCH_BASELINE, metrics
+# that got worse by more than BENCH_THRESHOLD percent are regressions.
+
+set -u
+
+BENCH_SERVER=${BENCH_SERVER:-}
+BENCH_CLIENT=${BENCH_CLIENT:-}
+BENCH_BASEPATH=${BENCH_BASEPATH:-}
+BENCH_MAPS=${BENCH_MAPS-oa_dm1 oa_rpg3dm2 oasago2}
+BENCH_DEMOS=${BENCH_DEMOS:-}
+BENCH_BOTS=${BENCH_BOTS:-8}
+BENCH_FRAMES=${BENCH_FRAMES:-2000}
+BENCH_THRESHOLD=${BENCH_THRESHOLD:-5}
+BENCH_DIR=${BENCH_DIR:-build/bench}
+BENCH_BASELINE=${BENCH_BASELINE:-bench/baseline.txt}
+BENCH_UPDATE=${BENCH_UPDATE:-0}
+BENCH_ARGS=${BENCH_ARGS:-}
+
+if [ -z "$BENCH_SERVER" ] || [ ! -x "$BENCH_SERVER" ]; then
+	echo "bench: dedicated server binary not found: '$BENCH_SERVER'" >&2
+	exit 2
+fi
+
+if [ -z "$BENCH_BASEPATH" ] || [ ! -d "$BENCH_BASEPATH" ]; then
+	echo "bench: set BENCH_BASEPATH to the directory with game data" >&2
+	exit 2
+fi
+
+mkdir -p "$BENCH_DIR/home"
+BENCH_DIR=$(cd "$BENCH_DIR" && pwd)
+HOMEPATH=$BENCH_DIR/home	# kept between runs for recorded traces
+LOGS=$BENCH_DIR/logs
+RESULTS=$BENCH_DIR/results.txt
+
+rm -rf "$LOGS"
+mkdir -p "$LOGS"
+
+{
+	echo "# name value better"
+	echo "# $(date '+%Y-%m-%d %H:%M:%S') $(uname -sm)"
+	if command -v git >/dev/null 2>&1; then
+		echo "# $(git describe --always --dirty 2>/dev/null)"
+	fi
+} > "$RESULTS"
+
+
+# run_server <log name> <command line...>
+run_server() {
+	log=$LOGS/$1.log
+	shift
+	echo "  $(basename "$log" .log)"
+	"$BENCH_SERVER" +set fs_basepath "$BENCH_BASEPATH" +set fs_homepath "$HOMEPATH" \
+		+set ttycon 0 +set developer 1 +set sv_pure 0 +set sv_maxclients 16 \
+		$BENCH_ARGS "$@" < /dev/null > "$log" 2>&1
+}
+
+
+# run_client <log name> <command line...>
+run_client() {
+	log=$LOGS/$1.log
+	shift
+	echo "  $(basename "$log" .log)"
+	SDL_AUDIODRIVER=${SDL_AUDIODRIVER:-dummy} $WRAPPER "$BENCH_CLIENT" \
+		+set fs_basepath "$BENCH_BASEPATH" +set fs_homepath "$HOMEPATH" \
+		+set r_fullscreen 0 +set in_nograb 1 \
+		$BENCH_ARGS "$@" < /dev/null > "$log" 2>&1
+}
+
+
+# parse <metric prefix> <log name>
+parse() {
+	sed 's/\^[0-9]//g' "$LOGS/$2.log" | awk -v p="$1" '
+	function m( name, value, better ) {
+		printf "%s.%s %s %s\n", p, name, value, better
+	}
+	/^------ File load profile/ { load = 1; next }
+	load && / KB read, / {
+		m( "load.fs_msec", $4, "lower" )
+		m( "load.inflate_msec", $8, "lower" )
+		m( "load.total_msec", $11, "lower" )
+		load = 0
+	}
+	/^ *total [0-9.]+ msec, mean [0-9]+ ns\/trace/ { m( "cm_replay.mean_ns", $5, "lower" ) }
+	/^ *p(50|99) +[0-9]+ ns/ { m( "cm_replay." $1 "_ns", $2, "lower" ) }
+	/^original tree: [0-9]+ usec/ { m( "cm_bench.original_usec", $3, "lower" ) }
+	/^flat tree: [0-9]+ usec/ { m( "cm_bench.flat_usec", $3, "lower" ) }
+	/^(interpreted|compiled) +[0-9]+ usec, / { m( "vmbench." $1 "_ns", $4, "lower" ) }
+	/ entity deltas: field walk [0-9]+ usec, / {
+		m( "deltabench.fieldwalk_usec", $6, "lower" )
+		m( "deltabench.changemask_usec", $10, "lower" )
+	}
+	/^executed [0-9]+ lines in [0-9]+ usec/ { m( "cmdbench.line_ns", $7, "lower" ) }
+	/ points: grid [0-9]+ usec, tree / {
+		m( "aasbench.grid_usec", $4, "lower" )
+		m( "aasbench.tree_usec", $7, "lower" )
+	}
+	/^preprocessed: +[0-9.]+ msec/ { m( "botscriptbench.preprocessed_msec", $2, "lower" ) }
+	/^cached: +[0-9.]+ msec/ { m( "botscriptbench.cached_msec", $2, "lower" ) }
+	/^benchmark: [0-9]+ frames in / { m( "server.fps", $7, "higher" ) }
+	/^phase +total ms +usec\/frm/ { phase = 1; next }
+	phase && NF == 4 && $3 ~ /^[0-9.]+$/ { m( "server." $1 "_usec", $3, "lower" ); next }
+	phase { phase = 0 }
+	/^[0-9]+ frames, [0-9.]+ seconds: / { m( "timedemo.fps", $5, "higher" ) }
+	/^1% low [0-9.]+ fps, 0.1% low / {
+		m( "timedemo.low1_fps", $3, "higher" )
+		m( "timedemo.low01_fps", $7, "higher" )
+		m( "timedemo.slowest_msec", $11, "lower" )
+	}
+	' >> "$RESULTS"
+}
+
+
+for map in $BENCH_MAPS; do
+	echo "bench: $map"
+
+	if [ -z "$(find "$HOMEPATH" -name "$map.ctr" 2>/dev/null)" ]; then
+		run_server "$map-record" +set dedicated 1 +set com_benchmark 500 \
+			+set com_benchmarkBots "$BENCH_BOTS" +map "$map" +cm_record "bench/$map" \
+			+wait 400 +cm_record
+	fi
+
+	run_server "$map-micro" +set dedicated 1 +set fs_profile 1 +map "$map" \
+		+cm_replay "bench/$map.ctr" 5 +cm_bench 100000 +vmbench +deltabench 2000 \
+		+cmdbench 100000 +wait 50 +aasbench 100000 +botscriptbench +quit
+	parse "$map" "$map-micro"
+
+	run_server "$map-frame" +set dedicated 1 +set com_benchmark "$BENCH_FRAMES" \
+		+set com_benchmarkBots "$BENCH_BOTS" +map "$map"
+	parse "$map" "$map-frame"
+done
+
+
+if [ -n "$BENCH_DEMOS" ]; then
+	WRAPPER=
+	if [ -z "$BENCH_CLIENT" ] || [ ! -x "$BENCH_CLIENT" ]; then
+		echo "bench: client binary not found, skipping demos" >&2
+		BENCH_DEMOS=
+	elif [ -z "${DISPLAY:-}" ] && [ -z "${WAYLAND_DISPLAY:-}" ]; then
+		if command -v xvfb-run >/dev/null 2>&1; then
+			WRAPPER="xvfb-run -a"
+		else
+			echo "bench: no display and no xvfb-run, skipping demos" >&2
+			BENCH_DEMOS=
+		fi
+	fi
+
+	for demo in $BENCH_DEMOS; do
+		name=$(echo "$demo" | tr '/.' '__')
+		echo "bench: demo $demo"
+		run_client "demo-$name" +set fs_profile 1 +set timedemo 2 +set nextdemo quit \
+			+demo "$demo"
+		parse "demo.$name" "demo-$name"
+	done
+fi
+
+
+if [ ! -f "$BENCH_BASELINE" ] || [ "$BENCH_UPDATE" != "0" ]; then
+	mkdir -p "$(dirname "$BENCH_BASELINE")"
+	cp "$RESULTS" "$BENCH_BASELINE"
+	echo "bench: results written to $RESULTS and stored as baseline $BENCH_BASELINE"
+	exit 0
+fi
+
+echo "bench: results written to $RESULTS, comparing with $BENCH_BASELINE"
+
+awk -v threshold="$BENCH_THRESHOLD" '
+	/^#/ { next }
+	FNR == NR { base[ $1 ] = $2; next }
+	{
+		if ( !( $1 in base ) ) {
+			printf "%-48s %12s %12s %8s  new\n", $1, "-", $2, ""
+			next
+		}
+		old = base[ $1 ]
+		delete base[ $1 ]
+		if ( old <= 0 ) {
+			next
+		}
+		change = ( $2 - old ) * 100.0 / old
+		worse = ( $3 == "higher" ) ? -change : change
+		status = "ok"
+		if ( worse > threshold ) {
+			status = "REGRESSION"
+			regressions++
+		} else if ( worse < -threshold ) {
+			status = "improved"
+		}
+		printf "%-48s %12s %12s %+7.1f%%  %s\n", $1, old, $2, change, status
+	}
+	END {
+		for ( name in base ) {
+			printf "%-48s %12s %12s %8s  missing\n", name, base[ name ], "-", ""
+		}
+		if ( regressions ) {
+			printf "bench: %i metrics regressed by more than %s%%\n", regressions, threshold
+			exit 1
+		}
+		printf "bench: no regressions beyond %s%%\n", threshold
+	}
+' "$BENCH_BASELINE" "$RESULTS"
@@ -188,6 +188,24 @@ typedef struct aas_clientmove_s
 	int frames;				//number of frames predicted ahead
 } aas_clientmove_t;
 
+//one of a set of movement predictions, see AAS_PredictClientMovements
+typedef struct aas_clientpredict_s
+{
+	int entnum;				//entity to ignore
+	vec3_t origin;			//origin to start with
+	int presencetype;		//presence type to start with
+	int onground;			//start on the ground
+	vec3_t velocity;		//velocity to start with
+	vec3_t cmdmove;			//client command movement
+	int cmdframes;			//number of frames cmdmove is valid
+	int maxframes;			//maximum number of predicted frames
+	float frametime;		//duration of one predicted frame
+	int stopevent;			//events that stop the prediction
+	int stopareanum;		//stop as soon as entered this area
+	aas_clientmove_t move;	//result of the prediction
+	int result;				//return value of AAS_PredictClientMovement
+} aas_clientpredict_t;
+
 // alternate route goals
 #define ALTROUTEGOAL_ALL				1
 #define ALTROUTEGOAL_CLUSTERPORTALS		2
@@ -66,6 +66,8 @@ bsp_trace_t AAS_Trace(	vec3_t start,
 								int contentmask);
 //returns the contents at the given point
 int AAS_PointContents(vec3_t point);
+//serialize world queries with the given mutex, NULL when single threaded
+void AAS_SetWorldLock(void *lock);
 #if 0
 //returns true when p2 is in the PVS of p1
 qboolean AAS_inPVS(vec3_t p1, vec3_t p2);
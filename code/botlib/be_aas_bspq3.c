@@ -86,6 +86,7 @@ typedef struct bsp_s
 
 //global bsp
 static bsp_t bspworld;
+static void *bspworldlock;	//serializes world queries, see AAS_SetWorldLock
 
 
 #ifdef BSP_DEBUG
@@ -139,6 +140,18 @@ void PrintContents(int contents)
 #endif
 #endif // BSP_DEBUG
 //===========================================================================
+// world queries go through the server which keeps shared scratch state,
+// while a lock is set they are serialized so they can be made from job threads
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_SetWorldLock(void *lock)
+{
+	bspworldlock = lock;
+} //end of the function AAS_SetWorldLock
+//===========================================================================
 // traces axial boxes of any size through the world
 //
 // Parameter:				-
@@ -148,7 +161,9 @@ void PrintContents(int contents)
 bsp_trace_t AAS_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int passent, int contentmask)
 {
 	bsp_trace_t bsptrace;
+	if (bspworldlock) Sys_LockMutex(bspworldlock);
 	botimport.Trace(&bsptrace, start, mins, maxs, end, passent, contentmask);
+	if (bspworldlock) Sys_UnlockMutex(bspworldlock);
 	return bsptrace;
 } //end of the function AAS_Trace
 //===========================================================================
@@ -160,7 +175,12 @@ bsp_trace_t AAS_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int pa
 //===========================================================================
 int AAS_PointContents(vec3_t point)
 {
-	return botimport.PointContents(point);
+	int contents;
+
+	if (bspworldlock) Sys_LockMutex(bspworldlock);
+	contents = botimport.PointContents(point);
+	if (bspworldlock) Sys_UnlockMutex(bspworldlock);
+	return contents;
 } //end of the function AAS_PointContents
 //===========================================================================
 //
@@ -174,7 +194,9 @@ qboolean AAS_EntityCollision(int entnum,
 {
 	bsp_trace_t enttrace;
 
+	if (bspworldlock) Sys_LockMutex(bspworldlock);
 	botimport.EntityTrace(&enttrace, start, boxmins, boxmaxs, end, entnum, contentmask);
+	if (bspworldlock) Sys_UnlockMutex(bspworldlock);
 	if (enttrace.fraction < trace->fraction)
 	{
 		Com_Memcpy(trace, &enttrace, sizeof(bsp_trace_t));
@@ -80,6 +80,10 @@ typedef struct aas_entity_s
 	aas_link_t *areas;
 	//links into the BSP leaves
 	bsp_link_t *leaves;
+	//origin the entity was linked at and the distance it can
+	//move from there without changing the linked areas
+	vec3_t linkorigin;
+	float linkrange;
 } aas_entity_t;
 
 typedef struct aas_settings_s
@@ -231,6 +235,14 @@ typedef struct aas_s
 	//clusters
 	int numclusters;
 	aas_cluster_t *clusters;
+	//mapped AAS file the lumps may point into
+	void *aasfile;
+	int aasfilelength;
+	//uniform grid with the bsp node to start point area queries at per cell
+	int *pointareagrid;							//node number, or minus the leaf if the cell is in one leaf
+	int pointareagridsize[3];
+	vec3_t pointareagridmins;
+	float pointareagridscale;					//one over the cell size
 	//
 	int numreachabilityareas;
 	float reachabilitytime;
@@ -264,6 +276,12 @@ typedef struct aas_s
 	aas_routingcache_t *newestcache;		// end of cache list sorted on time
 	//maximum travel time through portal areas
 	int *portalmaxtraveltimes;
+	//precomputed routing table for one set of travel flags
+	int routingtableflags;
+	int routingtablechanges;				//areas enabled or disabled since the table was built
+	byte *routingtabledisabled;				//disabled state of every area the table was built with
+	aas_routingcache_t ***clusterareatable;
+	aas_routingcache_t **portaltable;
 	//areas the reachabilities go through
 	int *reachabilityareaindex;
 	aas_reachabilityareas_t *reachabilityareas;
@@ -83,6 +83,7 @@ int AAS_UpdateEntity(int entnum, bot_entitystate_t *state)
 		ent->areas = NULL;
 		//
 		ent->leaves = NULL;
+		ent->linkrange = 0;
 		return BLERR_NOERROR;
 	}
 
@@ -139,7 +140,10 @@ int AAS_UpdateEntity(int entnum, bot_entitystate_t *state)
 	if (!VectorCompare(state->origin, ent->i.origin))
 	{
 		VectorCopy(state->origin, ent->i.origin);
-		relink = qtrue;
+		//the linked areas stay the same while the box stays on the
+		//same sides of all the planes it was tested against, with a
+		//margin for rounding errors of the plane tests
+		if (Distance(ent->i.origin, ent->linkorigin) + 0.125f >= ent->linkrange) relink = qtrue;
 	} //end if
 	//if the entity should be relinked
 	if (relink)
@@ -153,7 +157,8 @@ int AAS_UpdateEntity(int entnum, bot_entitystate_t *state)
 			//unlink the entity
 			AAS_UnlinkFromAreas(ent->areas);
 			//relink the entity to the AAS areas (use the larges bbox)
-			ent->areas = AAS_LinkEntityClientBBox(absmins, absmaxs, entnum, PRESENCE_NORMAL);
+			ent->areas = AAS_LinkEntityClientBBoxRange(absmins, absmaxs, entnum, PRESENCE_NORMAL, &ent->linkrange);
+			VectorCopy(ent->i.origin, ent->linkorigin);
 			//unlink the entity from the BSP leaves
 			AAS_UnlinkFromBSPLeaves(ent->leaves);
 			//link the entity to the world BSP tree
@@ -334,6 +339,7 @@ void AAS_ResetEntityLinks(void)
 	{
 		aasworld.entities[i].areas = NULL;
 		aasworld.entities[i].leaves = NULL;
+		aasworld.entities[i].linkrange = 0;
 	} //end for
 } //end of the function AAS_ResetEntityLinks
 //===========================================================================
@@ -371,6 +377,7 @@ void AAS_UnlinkInvalidEntities(void)
 			ent->areas = NULL;
 			AAS_UnlinkFromBSPLeaves( ent->leaves );
 			ent->leaves = NULL;
+			ent->linkrange = 0;
 		} //end for
 	} //end for
 } //end of the function AAS_UnlinkInvalidEntities
@@ -174,6 +174,22 @@ static void AAS_SwapAASData(void)
 	} //end for
 } //end of the function AAS_SwapAASData
 //===========================================================================
+// frees a lump unless it points into the mapped AAS file
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeAASLump(void *ptr)
+{
+	if ((char *) ptr >= (char *) aasworld.aasfile &&
+			(char *) ptr < (char *) aasworld.aasfile + aasworld.aasfilelength)
+	{
+		return;
+	} //end if
+	FreeMemory(ptr);
+} //end of the function AAS_FreeAASLump
+//===========================================================================
 // dump the current loaded aas file
 //
 // Parameter:				-
@@ -183,49 +199,54 @@ static void AAS_SwapAASData(void)
 void AAS_DumpAASData(void)
 {
 	aasworld.numbboxes = 0;
-	if (aasworld.bboxes) FreeMemory(aasworld.bboxes);
+	if (aasworld.bboxes) AAS_FreeAASLump(aasworld.bboxes);
 	aasworld.bboxes = NULL;
 	aasworld.numvertexes = 0;
-	if (aasworld.vertexes) FreeMemory(aasworld.vertexes);
+	if (aasworld.vertexes) AAS_FreeAASLump(aasworld.vertexes);
 	aasworld.vertexes = NULL;
 	aasworld.numplanes = 0;
-	if (aasworld.planes) FreeMemory(aasworld.planes);
+	if (aasworld.planes) AAS_FreeAASLump(aasworld.planes);
 	aasworld.planes = NULL;
 	aasworld.numedges = 0;
-	if (aasworld.edges) FreeMemory(aasworld.edges);
+	if (aasworld.edges) AAS_FreeAASLump(aasworld.edges);
 	aasworld.edges = NULL;
 	aasworld.edgeindexsize = 0;
-	if (aasworld.edgeindex) FreeMemory(aasworld.edgeindex);
+	if (aasworld.edgeindex) AAS_FreeAASLump(aasworld.edgeindex);
 	aasworld.edgeindex = NULL;
 	aasworld.numfaces = 0;
-	if (aasworld.faces) FreeMemory(aasworld.faces);
+	if (aasworld.faces) AAS_FreeAASLump(aasworld.faces);
 	aasworld.faces = NULL;
 	aasworld.faceindexsize = 0;
-	if (aasworld.faceindex) FreeMemory(aasworld.faceindex);
+	if (aasworld.faceindex) AAS_FreeAASLump(aasworld.faceindex);
 	aasworld.faceindex = NULL;
 	aasworld.numareas = 0;
-	if (aasworld.areas) FreeMemory(aasworld.areas);
+	if (aasworld.areas) AAS_FreeAASLump(aasworld.areas);
 	aasworld.areas = NULL;
 	aasworld.numareasettings = 0;
-	if (aasworld.areasettings) FreeMemory(aasworld.areasettings);
+	if (aasworld.areasettings) AAS_FreeAASLump(aasworld.areasettings);
 	aasworld.areasettings = NULL;
 	aasworld.reachabilitysize = 0;
-	if (aasworld.reachability) FreeMemory(aasworld.reachability);
+	if (aasworld.reachability) AAS_FreeAASLump(aasworld.reachability);
 	aasworld.reachability = NULL;
 	aasworld.numnodes = 0;
-	if (aasworld.nodes) FreeMemory(aasworld.nodes);
+	if (aasworld.nodes) AAS_FreeAASLump(aasworld.nodes);
 	aasworld.nodes = NULL;
 	aasworld.numportals = 0;
-	if (aasworld.portals) FreeMemory(aasworld.portals);
+	if (aasworld.portals) AAS_FreeAASLump(aasworld.portals);
 	aasworld.portals = NULL;
 	aasworld.numportals = 0;
-	if (aasworld.portalindex) FreeMemory(aasworld.portalindex);
+	if (aasworld.portalindex) AAS_FreeAASLump(aasworld.portalindex);
 	aasworld.portalindex = NULL;
 	aasworld.portalindexsize = 0;
-	if (aasworld.clusters) FreeMemory(aasworld.clusters);
+	if (aasworld.clusters) AAS_FreeAASLump(aasworld.clusters);
 	aasworld.clusters = NULL;
 	aasworld.numclusters = 0;
 	//
+	//release the mapped file after all lumps pointing into it
+	if (aasworld.aasfile) botimport.FS_FreeMappedFile(aasworld.aasfile);
+	aasworld.aasfile = NULL;
+	aasworld.aasfilelength = 0;
+	//
 	aasworld.loaded = qfalse;
 	aasworld.initialized = qfalse;
 	aasworld.savefile = qfalse;
@@ -296,6 +317,22 @@ static char *AAS_LoadAASLump(fileHandle_t fp, int offset, int length, int *lasto
 		//just alloc a dummy
 		return (char *) GetClearedHunkMemory(size+1);
 	} //end if
+	//lumps of a mapped file are used in place when aligned
+	if (aasworld.aasfile)
+	{
+		if (offset < 0 || length < 0 || offset > aasworld.aasfilelength - length)
+		{
+			AAS_Error("aas lump out of file\n");
+			AAS_DumpAASData();
+			return NULL;
+		} //end if
+		buf = (char *) aasworld.aasfile + offset;
+		if (!((intptr_t) buf & 3)) return buf;
+		//copy stored pk3 entries that aren't aligned
+		buf = (char *) GetClearedHunkMemory(length+1);
+		Com_Memcpy(buf, (char *) aasworld.aasfile + offset, length);
+		return buf;
+	} //end if
 	//seek to the data
 	if (offset != *lastoffset)
 	{
@@ -349,22 +386,39 @@ int AAS_LoadAASFile(char *filename)
 	botimport.Print(PRT_MESSAGE, "trying to load %s\n", filename);
 	//dump current loaded aas file
 	AAS_DumpAASData();
-	//open the file
-	botimport.FS_FOpenFile( filename, &fp, FS_READ );
-	if (!fp)
+	fp = 0;
+#ifdef Q3_LITTLE_ENDIAN
+	//the file data is native, map it so lumps are shared with other processes
+	aasworld.aasfilelength = botimport.FS_MapFile(filename, &aasworld.aasfile);
+	if (aasworld.aasfile && aasworld.aasfilelength < (int) sizeof(aas_header_t))
+	{
+		AAS_DumpAASData();
+	} //end if
+#endif //Q3_LITTLE_ENDIAN
+	if (aasworld.aasfile)
 	{
-		AAS_Error("can't open %s\n", filename);
-		return BLERR_CANNOTOPENAASFILE;
+		Com_Memcpy(&header, aasworld.aasfile, sizeof(aas_header_t));
 	} //end if
-	//read the header
-	botimport.FS_Read(&header, sizeof(aas_header_t), fp );
+	else
+	{
+		//open the file
+		botimport.FS_FOpenFile( filename, &fp, FS_READ );
+		if (!fp)
+		{
+			AAS_Error("can't open %s\n", filename);
+			return BLERR_CANNOTOPENAASFILE;
+		} //end if
+		//read the header
+		botimport.FS_Read(&header, sizeof(aas_header_t), fp );
+	} //end else
 	lastoffset = sizeof(aas_header_t);
 	//check header identification
 	header.ident = LittleLong(header.ident);
 	if (header.ident != AASID)
 	{
 		AAS_Error("%s is not an AAS file\n", filename);
-		botimport.FS_FCloseFile(fp);
+		if (fp) botimport.FS_FCloseFile(fp);
+		AAS_DumpAASData();
 		return BLERR_WRONGAASFILEID;
 	} //end if
 	//check the version
@@ -373,7 +427,8 @@ int AAS_LoadAASFile(char *filename)
 	if (header.version != AASVERSION_OLD && header.version != AASVERSION)
 	{
 		AAS_Error("aas file %s is version %i, not %i\n", filename, header.version, AASVERSION);
-		botimport.FS_FCloseFile(fp);
+		if (fp) botimport.FS_FCloseFile(fp);
+		AAS_DumpAASData();
 		return BLERR_WRONGAASFILEVERSION;
 	} //end if
 	//
@@ -386,7 +441,8 @@ int AAS_LoadAASFile(char *filename)
 	if (LittleLong(header.bspchecksum) != aasworld.bspchecksum)
 	{
 		AAS_Error("aas file %s is out of date\n", filename);
-		botimport.FS_FCloseFile(fp);
+		if (fp) botimport.FS_FCloseFile(fp);
+		AAS_DumpAASData();
 		return BLERR_WRONGAASFILEVERSION;
 	} //end if
 	//load the lumps:
@@ -474,12 +530,12 @@ int AAS_LoadAASFile(char *filename)
 	aasworld.clusters = (aas_cluster_t *) AAS_LoadAASLump(fp, offset, length, &lastoffset, sizeof(aas_cluster_t));
 	aasworld.numclusters = length / sizeof(aas_cluster_t);
 	if (aasworld.numclusters && !aasworld.clusters) return BLERR_CANNOTREADAASLUMP;
-	//swap everything
-	AAS_SwapAASData();
+	//swap everything, mapped files are native already
+	if (!aasworld.aasfile) AAS_SwapAASData();
 	//aas file is loaded
 	aasworld.loaded = qtrue;
 	//close the file
-	botimport.FS_FCloseFile(fp);
+	if (fp) botimport.FS_FCloseFile(fp);
 	//
 #ifdef AASFILEDEBUG
 	AAS_FileInfo();
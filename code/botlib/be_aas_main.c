@@ -276,6 +276,8 @@ int AAS_LoadMap(const char *mapname)
 	AAS_InitAASLinkHeap();
 	//initialize the AAS linked entities for the new map
 	AAS_InitAASLinkedEntities();
+	//initialize the point area grid for the new map
+	AAS_InitPointAreaGrid();
 	//initialize reachability for the new map
 	AAS_InitReachability();
 	//initialize the alternative routing
@@ -324,6 +326,8 @@ void AAS_Shutdown(void)
 	AAS_FreeAASLinkHeap();
 	//free aas linked entities
 	AAS_FreeAASLinkedEntities();
+	//free the point area grid
+	AAS_FreePointAreaGrid();
 	//free the aas data
 	AAS_DumpAASData();
 	//free the entities
@@ -30,6 +30,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  *****************************************************************************/
 
 #include "../qcommon/q_shared.h"
+#ifndef BSPC
+#include "../qcommon/qcommon.h"
+#endif
 #include "l_memory.h"
 #include "l_script.h"
 #include "l_precomp.h"
@@ -40,6 +43,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "be_aas.h"
 #include "be_aas_funcs.h"
 #include "be_aas_def.h"
+#include "be_interface.h"
 
 extern botlib_import_t botimport;
 
@@ -992,10 +996,20 @@ int AAS_PredictClientMovement(struct aas_clientmove_s *move,
 {
 	const vec3_t mins = { -4, -4, -4 };
 	const vec3_t maxs = { 4, 4, 4 };
-	return AAS_ClientMovementPrediction(move, entnum, origin, presencetype, onground,
+	int64_t start;
+	int result, prevclient;
+
+	//predictions of a client are accounted to that client
+	prevclient = -1;
+	if (entnum >= 0 && entnum < MAX_CLIENTS) prevclient = BotProfileClient(entnum);
+	start = BotProfileBegin(BOTPROFILE_PREDICT);
+	result = AAS_ClientMovementPrediction(move, entnum, origin, presencetype, onground,
 										velocity, cmdmove, cmdframes, maxframes,
 										frametime, stopevent, stopareanum,
 										mins, maxs, visualize);
+	BotProfileEnd(BOTPROFILE_PREDICT, start);
+	if (entnum >= 0 && entnum < MAX_CLIENTS) BotProfileClient(prevclient);
+	return result;
 } //end of the function AAS_PredictClientMovement
 //===========================================================================
 //
@@ -1003,6 +1017,73 @@ int AAS_PredictClientMovement(struct aas_clientmove_s *move,
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
+static void AAS_PredictClientMovementJob(void *data, int index)
+{
+	const vec3_t mins = { -4, -4, -4 };
+	const vec3_t maxs = { 4, 4, 4 };
+	aas_clientpredict_t *p;
+
+	p = (aas_clientpredict_t *) data + index;
+	//never visualize, debug lines are shared
+	//the batch is profiled as a whole, profiles are not thread safe
+	p->result = AAS_ClientMovementPrediction(&p->move, p->entnum, p->origin, p->presencetype, p->onground,
+										p->velocity, p->cmdmove, p->cmdframes, p->maxframes,
+										p->frametime, p->stopevent, p->stopareanum, mins, maxs, qfalse);
+} //end of the function AAS_PredictClientMovementJob
+//===========================================================================
+// the predictions only read AAS data and keep their state on the stack,
+// world queries that go through the server are serialized with a lock
+// while they run on job threads
+//
+// Parameter:			-
+// Returns:				number of predictions that succeeded
+// Changes Globals:		-
+//===========================================================================
+int AAS_PredictClientMovements(struct aas_clientpredict_s *predictions, int numpredictions)
+{
+	int i, n;
+	int64_t start;
+#ifndef BSPC
+	void *lock;
+#endif //BSPC
+
+	if (numpredictions <= 0) return 0;
+	start = BotProfileBegin(BOTPROFILE_PREDICT);
+#ifndef BSPC
+	lock = NULL;
+	if (numpredictions > 1 && Com_JobWorkers() > 0)
+	{
+		lock = Sys_CreateMutex();
+	} //end if
+	if (lock)
+	{
+		AAS_SetWorldLock(lock);
+		Com_ParallelFor(AAS_PredictClientMovementJob, predictions, numpredictions);
+		AAS_SetWorldLock(NULL);
+		Sys_DestroyMutex(lock);
+	} //end if
+	else
+#endif //BSPC
+	{
+		for (i = 0; i < numpredictions; i++)
+		{
+			AAS_PredictClientMovementJob(predictions, i);
+		} //end for
+	} //end else
+	BotProfileEnd(BOTPROFILE_PREDICT, start);
+	n = 0;
+	for (i = 0; i < numpredictions; i++)
+	{
+		if (predictions[i].result) n++;
+	} //end for
+	return n;
+} //end of the function AAS_PredictClientMovements
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 int AAS_ClientMovementHitBBox(struct aas_clientmove_s *move,
 								int entnum, const vec3_t origin,
 								int presencetype, int onground,
@@ -41,6 +41,8 @@ int AAS_PredictClientMovement(struct aas_clientmove_s *move,
 							int cmdframes,
 							int maxframes, float frametime,
 							int stopevent, int stopareanum, int visualize);
+//runs a set of independent movement predictions, on job threads when available
+int AAS_PredictClientMovements(struct aas_clientpredict_s *predictions, int numpredictions);
 //predict movement until bounding box is hit
 int AAS_ClientMovementHitBBox(struct aas_clientmove_s *move,
 								int entnum, const vec3_t origin,
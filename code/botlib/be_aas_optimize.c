@@ -243,27 +243,27 @@ static void AAS_OptimizeAlloc(optimized_t *optimized)
 static void AAS_OptimizeStore(optimized_t *optimized)
 {
 	//store the optimized vertexes
-	if (aasworld.vertexes) FreeMemory(aasworld.vertexes);
+	if (aasworld.vertexes) AAS_FreeAASLump(aasworld.vertexes);
 	aasworld.vertexes = optimized->vertexes;
 	aasworld.numvertexes = optimized->numvertexes;
 	//store the optimized edges
-	if (aasworld.edges) FreeMemory(aasworld.edges);
+	if (aasworld.edges) AAS_FreeAASLump(aasworld.edges);
 	aasworld.edges = optimized->edges;
 	aasworld.numedges = optimized->numedges;
 	//store the optimized edge index
-	if (aasworld.edgeindex) FreeMemory(aasworld.edgeindex);
+	if (aasworld.edgeindex) AAS_FreeAASLump(aasworld.edgeindex);
 	aasworld.edgeindex = optimized->edgeindex;
 	aasworld.edgeindexsize = optimized->edgeindexsize;
 	//store the optimized faces
-	if (aasworld.faces) FreeMemory(aasworld.faces);
+	if (aasworld.faces) AAS_FreeAASLump(aasworld.faces);
 	aasworld.faces = optimized->faces;
 	aasworld.numfaces = optimized->numfaces;
 	//store the optimized face index
-	if (aasworld.faceindex) FreeMemory(aasworld.faceindex);
+	if (aasworld.faceindex) AAS_FreeAASLump(aasworld.faceindex);
 	aasworld.faceindex = optimized->faceindex;
 	aasworld.faceindexsize = optimized->faceindexsize;
 	//store the optimized areas
-	if (aasworld.areas) FreeMemory(aasworld.areas);
+	if (aasworld.areas) AAS_FreeAASLump(aasworld.areas);
 	aasworld.areas = optimized->areas;
 	aasworld.numareas = optimized->numareas;
 	//free optimize indexes
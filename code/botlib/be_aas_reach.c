@@ -30,6 +30,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  *****************************************************************************/
 
 #include "../qcommon/q_shared.h"
+#ifndef BSPC
+#include "../qcommon/qcommon.h"
+#endif
 #include "l_log.h"
 #include "l_memory.h"
 #include "l_script.h"
@@ -101,8 +104,18 @@ typedef struct aas_lreachability_s
 //temporary reachabilities
 static aas_lreachability_t *reachabilityheap;	//heap with reachabilities
 static aas_lreachability_t *nextreachability;	//next free reachability from the heap
-static aas_lreachability_t **areareachability;	//reachability links for every area
+static THREAD_LOCAL aas_lreachability_t **areareachability;	//reachability links for every area
 static int numlreachabilities;
+#ifndef BSPC
+//areas calculated on job threads, every job links into a private areareachability
+static void *reachlock;							//protects the heap and the next area
+static int reachnextarea;						//next area to calculate
+static int *reachlinkpair;						//area pair that created each heap link
+static int *reachlinkowner;						//area whose links had each heap link
+static aas_lreachability_t **reacharealinks;	//links created while calculating each area
+static qboolean reachoverflow;
+static THREAD_LOCAL int reachpair;				//area pair being checked
+#endif //BSPC
 
 //===========================================================================
 // returns the surface area of the given face
@@ -490,6 +503,23 @@ static aas_lreachability_t *AAS_AllocReachability(void)
 {
 	aas_lreachability_t *r;
 
+#ifndef BSPC
+	if (reachlock)
+	{
+		Sys_LockMutex(reachlock);
+		r = nextreachability;
+		if (r)
+		{
+			//job threads can't print, the error shows up after the batch
+			if (!r->next) reachoverflow = qtrue;
+			nextreachability = r->next;
+			numlreachabilities++;
+			reachlinkpair[r - reachabilityheap] = reachpair;
+		} //end if
+		Sys_UnlockMutex(reachlock);
+		return r;
+	} //end if
+#endif //BSPC
 	if (!nextreachability) return NULL;
 	//make sure the error message only shows up once
 	if (!nextreachability->next) AAS_Error("AAS_MAX_REACHABILITYSIZE\n");
@@ -4319,7 +4349,7 @@ static void AAS_StoreReachability(void)
 	aas_lreachability_t *lreach;
 	aas_reachability_t *reach;
 
-	if (aasworld.reachability) FreeMemory(aasworld.reachability);
+	if (aasworld.reachability) AAS_FreeAASLump(aasworld.reachability);
 	aasworld.reachability = (aas_reachability_t *) GetClearedMemory((numlreachabilities + 10) * sizeof(aas_reachability_t));
 	aasworld.reachabilitysize = 1;
 	for (i = 0; i < aasworld.numareas; i++)
@@ -4345,6 +4375,210 @@ static void AAS_StoreReachability(void)
 	} //end for
 } //end of the function AAS_StoreReachability
 //===========================================================================
+// creates the reachabilities from the given area to all other areas
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_AreaReachabilities(int i)
+{
+	int j;
+
+	//only create jumppad reachabilities from jumppad areas
+	if (aasworld.areasettings[i].contents & AREACONTENTS_JUMPPAD)
+	{
+		return;
+	} //end if
+	//loop over the areas
+	for (j = 1; j < aasworld.numareas; j++)
+	{
+		if (i == j) continue;
+		//never create reachabilities from teleporter or jumppad areas to regular areas
+		if (aasworld.areasettings[i].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
+		{
+			if (!(aasworld.areasettings[j].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD)))
+			{
+				continue;
+			} //end if
+		} //end if
+#ifndef BSPC
+		reachpair = j;
+#endif //BSPC
+		//if there already is a reachability link from area i to j
+		if (AAS_ReachabilityExists(i, j)) continue;
+		//check for a swim reachability
+		if (AAS_Reachability_Swim(i, j)) continue;
+		//check for a simple walk on equal floor height reachability
+		if (AAS_Reachability_EqualFloorHeight(i, j)) continue;
+		//check for step, barrier, waterjump and walk off ledge reachabilities
+		if (AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(i, j)) continue;
+		//check for ladder reachabilities
+		if (AAS_Reachability_Ladder(i, j)) continue;
+		//check for a jump reachability
+		if (AAS_Reachability_Jump(i, j)) continue;
+	} //end for
+	//never create these reachabilities from teleporter or jumppad areas
+	if (aasworld.areasettings[i].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
+	{
+		return;
+	} //end if
+	//loop over the areas
+	for (j = 1; j < aasworld.numareas; j++)
+	{
+		if (i == j) continue;
+#ifndef BSPC
+		reachpair = j;
+#endif //BSPC
+		//
+		if (AAS_ReachabilityExists(i, j)) continue;
+		//check for a grapple hook reachability
+		if (calcgrapplereach) AAS_Reachability_Grapple(i, j);
+		//check for a weapon jump reachability
+		AAS_Reachability_WeaponJump(i, j);
+	} //end for
+} //end of the function AAS_AreaReachabilities
+#ifndef BSPC
+//===========================================================================
+// calculates areas on a job thread, the links of every area are moved
+// from the private lists to reacharealinks with the oldest link of
+// every owner area first
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_AreaReachabilitiesJob(void *data, int index)
+{
+	aas_lreachability_t **saved, *lreach, *next, *links;
+	int i, x;
+
+	saved = areareachability;
+	areareachability = ((aas_lreachability_t ***) data)[index];
+	for (;;)
+	{
+		Sys_LockMutex(reachlock);
+		i = reachnextarea++;
+		Sys_UnlockMutex(reachlock);
+		if (i >= aasworld.numareas) break;
+		//
+		AAS_AreaReachabilities(i);
+		//
+		links = NULL;
+		for (x = 1; x < aasworld.numareas; x++)
+		{
+			for (lreach = areareachability[x]; lreach; lreach = next)
+			{
+				next = lreach->next;
+				reachlinkowner[lreach - reachabilityheap] = x;
+				lreach->next = links;
+				links = lreach;
+			} //end for
+			areareachability[x] = NULL;
+		} //end for
+		reacharealinks[i] = links;
+	} //end for
+	areareachability = saved;
+} //end of the function AAS_AreaReachabilitiesJob
+//===========================================================================
+// calculates the reachabilities of all areas on job threads
+//
+// Every area is calculated against its own links only, the results are
+// merged in area order afterwards. The serial loop skips an area pair when
+// a link between them already exists, such links can only come from
+// ladders of lower areas, so links of pairs that already have one are
+// dropped while merging. The resulting lists are the same as the serial
+// calculation creates.
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_ParallelAreaReachabilities(void)
+{
+	aas_lreachability_t ***jobareas, *lreach, *next, *own, *owntail;
+	int numjobs, i, j, owner, pair, start_time;
+
+	start_time = Sys_MilliSeconds();
+	reachlock = Sys_CreateMutex();
+	if (!reachlock) return;
+	//
+	numjobs = Com_JobWorkers() + 1;
+	if (numjobs > aasworld.numareas - 1) numjobs = aasworld.numareas - 1;
+	if (numjobs < 1) numjobs = 1;
+	jobareas = (aas_lreachability_t ***) GetClearedMemory(numjobs * sizeof(aas_lreachability_t **));
+	for (i = 0; i < numjobs; i++)
+	{
+		jobareas[i] = (aas_lreachability_t **) GetClearedMemory(aasworld.numareas * sizeof(aas_lreachability_t *));
+	} //end for
+	reachlinkpair = (int *) GetMemory(AAS_MAX_REACHABILITYSIZE * sizeof(int));
+	reachlinkowner = (int *) GetMemory(AAS_MAX_REACHABILITYSIZE * sizeof(int));
+	reacharealinks = (aas_lreachability_t **) GetClearedMemory(aasworld.numareas * sizeof(aas_lreachability_t *));
+	reachnextarea = aasworld.numreachabilityareas;
+	reachoverflow = qfalse;
+	//
+	AAS_SetWorldLock(reachlock);
+	Com_ParallelFor(AAS_AreaReachabilitiesJob, jobareas, numjobs);
+	AAS_SetWorldLock(NULL);
+	//
+	for (i = aasworld.numreachabilityareas; i < aasworld.numareas; i++)
+	{
+		own = owntail = NULL;
+		for (lreach = reacharealinks[i]; lreach; lreach = next)
+		{
+			next = lreach->next;
+			j = lreach - reachabilityheap;
+			owner = reachlinkowner[j];
+			pair = reachlinkpair[j];
+			//links of lower areas decide, the list of this area has nothing else yet
+			if (AAS_ReachabilityExists(i, pair))
+			{
+				AAS_FreeReachability(lreach);
+				continue;
+			} //end if
+			if (owner == i)
+			{
+				//keep aside until all pairs are checked
+				lreach->next = own;
+				own = lreach;
+				if (!owntail) owntail = lreach;
+			} //end if
+			else
+			{
+				lreach->next = areareachability[owner];
+				areareachability[owner] = lreach;
+			} //end else
+		} //end for
+		if (own)
+		{
+			owntail->next = areareachability[i];
+			areareachability[i] = own;
+		} //end if
+	} //end for
+	//
+	if (reachoverflow) AAS_Error("AAS_MAX_REACHABILITYSIZE\n");
+	//
+	for (i = 0; i < numjobs; i++)
+	{
+		FreeMemory(jobareas[i]);
+	} //end for
+	FreeMemory(jobareas);
+	FreeMemory(reacharealinks);
+	FreeMemory(reachlinkowner);
+	FreeMemory(reachlinkpair);
+	reacharealinks = NULL;
+	reachlinkowner = NULL;
+	reachlinkpair = NULL;
+	Sys_DestroyMutex(reachlock);
+	reachlock = NULL;
+	//
+	aasworld.numreachabilityareas = aasworld.numareas;
+	//
+	botimport.Print(PRT_MESSAGE, "%d areas in %d msec on %d threads\n", aasworld.numareas - 1,
+						Sys_MilliSeconds() - start_time, numjobs);
+} //end of the function AAS_ParallelAreaReachabilities
+#endif //BSPC
+//===========================================================================
 //
 // TRAVEL_WALK					100%	equal floor height + steps
 // TRAVEL_CROUCH				100%
@@ -4371,7 +4605,7 @@ static void AAS_StoreReachability(void)
 //===========================================================================
 int AAS_ContinueInitReachability(float time)
 {
-	int i, j, todo, start_time;
+	int i, todo, start_time;
 	static float framereachability, reachability_delay;
 	static int lastpercentage;
 
@@ -4385,6 +4619,9 @@ int AAS_ContinueInitReachability(float time)
 		lastpercentage = 0;
 		framereachability = 2000;
 		reachability_delay = 1000;
+#ifndef BSPC
+		AAS_ParallelAreaReachabilities();
+#endif //BSPC
 	} //end if
 	//number of areas to calculate reachability for this cycle
 	todo = aasworld.numreachabilityareas + (int) framereachability;
@@ -4393,52 +4630,7 @@ int AAS_ContinueInitReachability(float time)
 	for (i = aasworld.numreachabilityareas; i < aasworld.numareas && i < todo; i++)
 	{
 		aasworld.numreachabilityareas++;
-		//only create jumppad reachabilities from jumppad areas
-		if (aasworld.areasettings[i].contents & AREACONTENTS_JUMPPAD)
-		{
-			continue;
-		} //end if
-		//loop over the areas
-		for (j = 1; j < aasworld.numareas; j++)
-		{
-			if (i == j) continue;
-			//never create reachabilities from teleporter or jumppad areas to regular areas
-			if (aasworld.areasettings[i].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
-			{
-				if (!(aasworld.areasettings[j].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD)))
-				{
-					continue;
-				} //end if
-			} //end if
-			//if there already is a reachability link from area i to j
-			if (AAS_ReachabilityExists(i, j)) continue;
-			//check for a swim reachability
-			if (AAS_Reachability_Swim(i, j)) continue;
-			//check for a simple walk on equal floor height reachability
-			if (AAS_Reachability_EqualFloorHeight(i, j)) continue;
-			//check for step, barrier, waterjump and walk off ledge reachabilities
-			if (AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(i, j)) continue;
-			//check for ladder reachabilities
-			if (AAS_Reachability_Ladder(i, j)) continue;
-			//check for a jump reachability
-			if (AAS_Reachability_Jump(i, j)) continue;
-		} //end for
-		//never create these reachabilities from teleporter or jumppad areas
-		if (aasworld.areasettings[i].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
-		{
-			continue;
-		} //end if
-		//loop over the areas
-		for (j = 1; j < aasworld.numareas; j++)
-		{
-			if (i == j) continue;
-			//
-			if (AAS_ReachabilityExists(i, j)) continue;
-			//check for a grapple hook reachability
-			if (calcgrapplereach) AAS_Reachability_Grapple(i, j);
-			//check for a weapon jump reachability
-			AAS_Reachability_WeaponJump(i, j);
-		} //end for
+		AAS_AreaReachabilities(i);
 		//if the calculation took more time than the max reachability delay
 		if (Sys_MilliSeconds() - start_time > (int) reachability_delay) break;
 		//
@@ -4547,4 +4739,8 @@ void AAS_InitReachability(void)
 									aasworld.numareas * sizeof(aas_lreachability_t *));
 	//
 	AAS_SetWeaponJumpAreaFlags();
+#ifndef BSPC
+	//areas are calculated on job threads, finish while the map is loading
+	while (AAS_ContinueInitReachability(0)) ;
+#endif //BSPC
 } //end of the function AAS_InitReachable
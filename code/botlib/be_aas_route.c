@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  *****************************************************************************/
 
 #include "../qcommon/q_shared.h"
+#include "../qcommon/qcommon.h"
 #include "l_utils.h"
 #include "l_memory.h"
 #include "l_log.h"
@@ -58,6 +59,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //maximum number of routing updates each frame
 #define MAX_FRAMEROUTINGUPDATES		10
 
+//routing cache blocks are carved from chunks of this size
+#define ROUTINGCACHE_CHUNKSIZE		(256 * 1024)
+//block size classes, four per power of two starting at 64 bytes
+#define ROUTINGCACHE_NUMCLASSES		80
+#define ROUTINGCACHE_CLASSSIZE(c)	((4 + ((c) & 3)) << (((c) >> 2) + 4))
+
 
 /*
 
@@ -84,6 +91,30 @@ int numportalcacheupdates;
 int routingcachesize;
 int max_routingcachesize;
 
+//routing cache memory statistics, index 0 is used for the portal cache
+typedef struct aas_routingcachestats_s
+{
+	int hits;
+	int misses;
+	int evictions;
+	int size;
+} aas_routingcachestats_t;
+
+static aas_routingcachestats_t *routingcachestats;
+
+//routing cache arena
+static void *routingcachechunks;				//list of all chunks
+static char *routingcachechunkptr;				//free space in the newest chunk
+static int routingcachechunkleft;
+static int routingcachearenasize;				//size of all chunks
+static aas_routingcache_t *routingcachefree[ROUTINGCACHE_NUMCLASSES];
+
+//travel times from the start area of a batched query towards the portals of its
+//cluster, one set without and one with TFL_DONOTENTER
+#define BATCHTIME_UNKNOWN		-1
+#define BATCHTIME_UNREACHABLE	-2
+static int *batchportaltimes;
+
 //===========================================================================
 //
 // Parameter:			-
@@ -93,9 +124,21 @@ int max_routingcachesize;
 #ifdef ROUTING_DEBUG
 void AAS_RoutingInfo(void)
 {
+	aas_routingcachestats_t *stats;
+	int i;
+
 	botimport.Print(PRT_MESSAGE, "%d area cache updates\n", numareacacheupdates);
 	botimport.Print(PRT_MESSAGE, "%d portal cache updates\n", numportalcacheupdates);
 	botimport.Print(PRT_MESSAGE, "%d bytes routing cache\n", routingcachesize);
+	botimport.Print(PRT_MESSAGE, "%d of %d KB routing cache arena\n", routingcachearenasize >> 10, max_routingcachesize >> 10);
+	if (!routingcachestats) return;
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		stats = &routingcachestats[i];
+		if (!stats->hits && !stats->misses) continue;
+		botimport.Print(PRT_MESSAGE, "%s %4d: %8d hits %6d misses %6d evictions %6d KB\n",
+							i ? "cluster" : "portals", i, stats->hits, stats->misses, stats->evictions, stats->size >> 10);
+	} //end for
 } //end of the function AAS_RoutingInfo
 #endif //ROUTING_DEBUG
 //===========================================================================
@@ -199,6 +242,9 @@ int AAS_TravelFlagForType(int traveltype)
 //===========================================================================
 static void AAS_UnlinkCache(aas_routingcache_t *cache)
 {
+	//caches that are never freed aren't linked
+	if (!cache->time_prev && aasworld.oldestcache != cache) return;
+	//
 	if (cache->time_next) cache->time_next->time_prev = cache->time_prev;
 	else aasworld.newestcache = cache->time_prev;
 	if (cache->time_prev) cache->time_prev->time_next = cache->time_next;
@@ -214,6 +260,14 @@ static void AAS_UnlinkCache(aas_routingcache_t *cache)
 //===========================================================================
 static void AAS_LinkCache(aas_routingcache_t *cache)
 {
+	//never free area cache leading towards a portal
+	if (cache->type == CACHETYPE_AREA && aasworld.areasettings[cache->areanum].cluster < 0)
+	{
+		cache->time_prev = NULL;
+		cache->time_next = NULL;
+		return;
+	} //end if
+	//
 	if (aasworld.newestcache)
 	{
 		aasworld.newestcache->time_next = cache;
@@ -233,11 +287,43 @@ static void AAS_LinkCache(aas_routingcache_t *cache)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
+static ID_INLINE aas_routingcachestats_t *AAS_RoutingCacheStats(aas_routingcache_t *cache)
+{
+	return &routingcachestats[cache->type == CACHETYPE_PORTAL ? 0 : cache->cluster];
+} //end of the function AAS_RoutingCacheStats
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_RoutingCacheClass(int size)
+{
+	int c;
+
+	for (c = 0; c < ROUTINGCACHE_NUMCLASSES - 1; c++)
+	{
+		if (ROUTINGCACHE_CLASSSIZE(c) >= size) break;
+	} //end for
+	return c;
+} //end of the function AAS_RoutingCacheClass
+//===========================================================================
+// returns the block of the routing cache to the free list of its size class
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 void AAS_FreeRoutingCache(aas_routingcache_t *cache)
 {
+	int c;
+
 	AAS_UnlinkCache(cache);
 	routingcachesize -= cache->size;
-	FreeMemory(cache);
+	AAS_RoutingCacheStats(cache)->size -= cache->size;
+	c = AAS_RoutingCacheClass(cache->size);
+	cache->next = routingcachefree[c];
+	routingcachefree[c] = cache;
 } //end of the function AAS_FreeRoutingCache
 //===========================================================================
 //
@@ -330,6 +416,14 @@ int AAS_EnableRoutingArea(int areanum, int enable)
 	{
 		//remove all routing cache involving this area
 		AAS_RemoveRoutingCacheUsingArea( areanum );
+		//the routing table is only valid with the areas it was built with
+		if (aasworld.routingtabledisabled)
+		{
+			if ((aasworld.areasettings[areanum].areaflags & AREA_DISABLED) != aasworld.routingtabledisabled[areanum])
+				aasworld.routingtablechanges++;
+			else
+				aasworld.routingtablechanges--;
+		} //end if
 	} //end if
 	return !flags;
 } //end of the function AAS_EnableRoutingArea
@@ -700,12 +794,11 @@ static int AAS_FreeOldestCache(void)
 	int clusterareanum;
 	aas_routingcache_t *cache;
 
-	for (cache = aasworld.oldestcache; cache; cache = cache->time_next) {
-		// never free area cache leading towards a portal
-		if (cache->type == CACHETYPE_AREA && aasworld.areasettings[cache->areanum].cluster < 0) {
-			continue;
-		}
-		break;
+	// area cache leading towards a portal is never linked
+	cache = aasworld.oldestcache;
+	// routing cache used this frame may still be referenced
+	if (cache && cache->time >= AAS_RoutingTime()) {
+		cache = NULL;
 	}
 	if (cache) {
 		// unlink the cache
@@ -723,6 +816,7 @@ static int AAS_FreeOldestCache(void)
 			else aasworld.portalcache[cache->areanum] = cache->next;
 			if (cache->next) cache->next->prev = cache->prev;
 		}
+		AAS_RoutingCacheStats(cache)->evictions++;
 		AAS_FreeRoutingCache(cache);
 		return qtrue;
 	}
@@ -734,6 +828,77 @@ static int AAS_FreeOldestCache(void)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
+static aas_routingcache_t *AAS_AllocRoutingCacheBlock(int size)
+{
+	aas_routingcache_t *cache;
+	void *chunk;
+	int c, blocksize, chunksize;
+
+	c = AAS_RoutingCacheClass(size);
+	blocksize = ROUTINGCACHE_CLASSSIZE(c);
+	if (blocksize < size) blocksize = PAD(size, 16);
+	for (;;)
+	{
+		//reuse a free block of the same size class
+		cache = routingcachefree[c];
+		if (cache)
+		{
+			routingcachefree[c] = cache->next;
+			break;
+		} //end if
+		//evict the least recently used cache when the arena is full
+		if (routingcachearenasize < max_routingcachesize || !AAS_FreeOldestCache())
+		{
+			if (blocksize > routingcachechunkleft)
+			{
+				chunksize = blocksize + 16 > ROUTINGCACHE_CHUNKSIZE ? blocksize + 16 : ROUTINGCACHE_CHUNKSIZE;
+				chunk = GetMemory(chunksize);
+				*(void **) chunk = routingcachechunks;
+				routingcachechunks = chunk;
+				routingcachechunkptr = (char *) chunk + 16;
+				routingcachechunkleft = chunksize - 16;
+				routingcachearenasize += chunksize;
+			} //end if
+			cache = (aas_routingcache_t *) routingcachechunkptr;
+			routingcachechunkptr += blocksize;
+			routingcachechunkleft -= blocksize;
+			break;
+		} //end if
+	} //end for
+	Com_Memset(cache, 0, size);
+	cache->size = size;
+	routingcachesize += size;
+	return cache;
+} //end of the function AAS_AllocRoutingCacheBlock
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeRoutingCacheArena(void)
+{
+	void *chunk;
+
+	while (routingcachechunks)
+	{
+		chunk = routingcachechunks;
+		routingcachechunks = *(void **) chunk;
+		FreeMemory(chunk);
+	} //end while
+	routingcachechunkptr = NULL;
+	routingcachechunkleft = 0;
+	routingcachearenasize = 0;
+	Com_Memset(routingcachefree, 0, sizeof(routingcachefree));
+	if (routingcachestats) FreeMemory(routingcachestats);
+	routingcachestats = NULL;
+} //end of the function AAS_FreeRoutingCacheArena
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 static aas_routingcache_t *AAS_AllocRoutingCache(int numtraveltimes)
 {
 	aas_routingcache_t *cache;
@@ -744,9 +909,7 @@ static aas_routingcache_t *AAS_AllocRoutingCache(int numtraveltimes)
 						+ numtraveltimes * sizeof(unsigned short int)
 						+ numtraveltimes * sizeof(unsigned char);
 	//
-	routingcachesize += size;
-	//
-	cache = (aas_routingcache_t *) GetClearedMemory(size);
+	cache = AAS_AllocRoutingCacheBlock(size);
 	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t)
 								+ numtraveltimes * sizeof(unsigned short int);
 	cache->size = size;
@@ -841,6 +1004,24 @@ static void AAS_FreeAllPortalCache(void)
 } //end of the function AAS_FreeAllPortalCache
 //===========================================================================
 //
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeRoutingTable(void)
+{
+	//the caches are allocated together with the pointer arrays
+	if (aasworld.clusterareatable) FreeMemory(aasworld.clusterareatable);
+	aasworld.clusterareatable = NULL;
+	if (aasworld.portaltable) FreeMemory(aasworld.portaltable);
+	aasworld.portaltable = NULL;
+	if (aasworld.routingtabledisabled) FreeMemory(aasworld.routingtabledisabled);
+	aasworld.routingtabledisabled = NULL;
+	aasworld.routingtableflags = 0;
+	aasworld.routingtablechanges = 0;
+} //end of the function AAS_FreeRoutingTable
+//===========================================================================
+//
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
@@ -1039,11 +1220,17 @@ static aas_routingcache_t *AAS_ReadCache(fileHandle_t fp)
 	aas_routingcache_t *cache;
 
 	botimport.FS_Read(&size, sizeof(size), fp);
-	cache = (aas_routingcache_t *) GetMemory(size);
-	cache->size = size;
+	cache = AAS_AllocRoutingCacheBlock(size);
 	botimport.FS_Read((unsigned char *)cache + sizeof(size), size - sizeof(size), fp);
+	cache->size = size;
 	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t) - sizeof(unsigned short) +
 		(size - sizeof(aas_routingcache_t) + sizeof(unsigned short)) / 3 * 2;
+	//the time list links of the dump are meaningless
+	cache->time = AAS_RoutingTime();
+	cache->time_prev = NULL;
+	cache->time_next = NULL;
+	AAS_LinkCache(cache);
+	AAS_RoutingCacheStats(cache)->size += size;
 	return cache;
 } //end of the function AAS_ReadCache
 //===========================================================================
@@ -1211,6 +1398,7 @@ static void AAS_InitReachabilityAreas(void)
 		} //end for
 	} //end for
 } //end of the function AAS_InitReachabilityAreas
+static void AAS_InitRoutingTable(void);
 //===========================================================================
 //
 // Parameter:			-
@@ -1243,9 +1431,16 @@ void AAS_InitRouting(void)
 #endif //ROUTING_DEBUG
 	//
 	routingcachesize = 0;
-	max_routingcachesize = 1024 * (int) LibVarValue("max_routingcache", "4096");
+	max_routingcachesize = 1024 * (int) LibVarValue("max_routingcache", "12288");
+	if (routingcachestats) FreeMemory(routingcachestats);
+	routingcachestats = (aas_routingcachestats_t *) GetClearedMemory(
+								aasworld.numclusters * sizeof(aas_routingcachestats_t));
+	if (batchportaltimes) FreeMemory(batchportaltimes);
+	batchportaltimes = (int *) GetMemory(2 * aasworld.numportals * sizeof(int));
 	// read any routing cache if available
 	AAS_ReadRouteCache();
+	// precompute the routing table for small maps
+	AAS_InitRoutingTable();
 } //end of the function AAS_InitRouting
 //===========================================================================
 //
@@ -1255,10 +1450,17 @@ void AAS_InitRouting(void)
 //===========================================================================
 void AAS_FreeRoutingCaches(void)
 {
+	// free the precomputed routing table
+	AAS_FreeRoutingTable();
 	// free all the existing cluster area cache
 	AAS_FreeAllClusterAreaCache();
 	// free all the existing portal cache
 	AAS_FreeAllPortalCache();
+	// free the memory of all routing cache
+	AAS_FreeRoutingCacheArena();
+	// free the batched query portal travel times
+	if (batchportaltimes) FreeMemory(batchportaltimes);
+	batchportaltimes = NULL;
 	// free cached travel times within areas
 	if (aasworld.areatraveltimes) FreeMemory(aasworld.areatraveltimes);
 	aasworld.areatraveltimes = NULL;
@@ -1284,13 +1486,14 @@ void AAS_FreeRoutingCaches(void)
 	aasworld.areacontentstravelflags = NULL;
 } //end of the function AAS_FreeRoutingCaches
 //===========================================================================
-// update the given routing cache
+// calculates the given routing cache using the given routing update fields
 //
 // Parameter:			areacache		: routing cache to update
+//						areaupdate		: routing update fields
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-static void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
+static void AAS_CalculateAreaRoutingCache(aas_routingcache_t *areacache, aas_routingupdate_t *areaupdate)
 {
 	int i, nextareanum, cluster, badtravelflags, clusterareanum, linknum;
 	int numreachabilityareas;
@@ -1300,15 +1503,10 @@ static void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	const aas_reversedreachability_t *revreach;
 	const aas_reversedlink_t *revlink;
 
-#ifdef ROUTING_DEBUG
-	numareacacheupdates++;
-#endif //ROUTING_DEBUG
 	//number of reachability areas within this cluster
 	numreachabilityareas = aasworld.clusters[areacache->cluster].numreachabilityareas;
-	//
-	aasworld.frameroutingupdates++;
 	//clear the routing update fields
-//	Com_Memset(aasworld.areaupdate, 0, aasworld.numareas * sizeof(aas_routingupdate_t));
+//	Com_Memset(areaupdate, 0, aasworld.numareas * sizeof(aas_routingupdate_t));
 	//
 	badtravelflags = ~areacache->travelflags;
 	//
@@ -1317,7 +1515,7 @@ static void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	//
 	Com_Memset(startareatraveltimes, 0, sizeof(startareatraveltimes));
 	//
-	curupdate = &aasworld.areaupdate[clusterareanum];
+	curupdate = &areaupdate[clusterareanum];
 	curupdate->areanum = areacache->areanum;
 	//VectorCopy(areacache->origin, curupdate->start);
 	curupdate->areatraveltimes = startareatraveltimes;
@@ -1373,7 +1571,7 @@ static void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			{
 				areacache->traveltimes[clusterareanum] = t;
 				areacache->reachabilities[clusterareanum] = linknum - aasworld.areasettings[nextareanum].firstreachablearea;
-				nextupdate = &aasworld.areaupdate[clusterareanum];
+				nextupdate = &areaupdate[clusterareanum];
 				nextupdate->areanum = nextareanum;
 				nextupdate->tmptraveltime = t;
 				//VectorCopy(reach->start, nextupdate->start);
@@ -1394,6 +1592,25 @@ static void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			} //end if
 		} //end for
 	} //end while
+} //end of the function AAS_CalculateAreaRoutingCache
+//===========================================================================
+// update the given routing cache
+//
+// Parameter:			areacache		: routing cache to update
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
+{
+	int64_t start;
+
+#ifdef ROUTING_DEBUG
+	numareacacheupdates++;
+#endif //ROUTING_DEBUG
+	aasworld.frameroutingupdates++;
+	start = BotProfileBegin(BOTPROFILE_ROUTEAREA);
+	AAS_CalculateAreaRoutingCache(areacache, aasworld.areaupdate);
+	BotProfileEnd(BOTPROFILE_ROUTEAREA, start);
 } //end of the function AAS_UpdateAreaRoutingCache
 //===========================================================================
 //
@@ -1408,6 +1625,11 @@ static aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum,
 
 	//number of the area in the cluster
 	clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
+	//use the precomputed routing table when available
+	if (aasworld.clusterareatable && !aasworld.routingtablechanges && travelflags == aasworld.routingtableflags)
+	{
+		return aasworld.clusterareatable[clusternum][clusterareanum];
+	} //end if
 	//pointer to the cache for the area in the cluster
 	clustercache = aasworld.clusterareacache[clusternum][clusterareanum];
 	//find the cache without undesired travel flags
@@ -1419,7 +1641,12 @@ static aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum,
 	//if there was no cache
 	if (!cache)
 	{
+		routingcachestats[clusternum].misses++;
+		BotProfileCacheAccess(qfalse);
 		cache = AAS_AllocRoutingCache(aasworld.clusters[clusternum].numreachabilityareas);
+		routingcachestats[clusternum].size += cache->size;
+		//the allocation may have evicted the old list head
+		clustercache = aasworld.clusterareacache[clusternum][clusterareanum];
 		cache->cluster = clusternum;
 		cache->areanum = areanum;
 		VectorCopy(aasworld.areas[areanum].center, cache->origin);
@@ -1433,6 +1660,8 @@ static aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum,
 	} //end if
 	else
 	{
+		routingcachestats[clusternum].hits++;
+		BotProfileCacheAccess(qtrue);
 		AAS_UnlinkCache(cache);
 	} //end else
 	//the cache has been accessed
@@ -1442,12 +1671,14 @@ static aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum,
 	return cache;
 } //end of the function AAS_GetAreaRoutingCache
 //===========================================================================
+// calculates the given portal cache using the given routing update fields
 //
-// Parameter:			-
+// Parameter:			portalcache		: portal cache to update
+//						portalupdate	: routing update fields
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-static void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+static void AAS_CalculatePortalRoutingCache(aas_routingcache_t *portalcache, aas_routingupdate_t *portalupdate)
 {
 	int i, portalnum, clusterareanum, clusternum;
 	unsigned short int t;
@@ -1456,13 +1687,10 @@ static void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 	aas_routingcache_t *cache;
 	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
 
-#ifdef ROUTING_DEBUG
-	numportalcacheupdates++;
-#endif //ROUTING_DEBUG
 	//clear the routing update fields
-//	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
+//	Com_Memset(portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
 	//
-	curupdate = &aasworld.portalupdate[aasworld.numportals];
+	curupdate = &portalupdate[aasworld.numportals];
 	curupdate->cluster = portalcache->cluster;
 	curupdate->areanum = portalcache->areanum;
 	curupdate->tmptraveltime = portalcache->starttraveltime;
@@ -1511,7 +1739,7 @@ static void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 					portalcache->traveltimes[portalnum] > t)
 			{
 				portalcache->traveltimes[portalnum] = t;
-				nextupdate = &aasworld.portalupdate[portalnum];
+				nextupdate = &portalupdate[portalnum];
 				if (portal->frontcluster == curupdate->cluster)
 				{
 					nextupdate->cluster = portal->backcluster;
@@ -1538,6 +1766,23 @@ static void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 			} //end if
 		} //end for
 	} //end while
+} //end of the function AAS_CalculatePortalRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+{
+	int64_t start;
+
+#ifdef ROUTING_DEBUG
+	numportalcacheupdates++;
+#endif //ROUTING_DEBUG
+	start = BotProfileBegin(BOTPROFILE_ROUTEPORTAL);
+	AAS_CalculatePortalRoutingCache(portalcache, aasworld.portalupdate);
+	BotProfileEnd(BOTPROFILE_ROUTEPORTAL, start);
 } //end of the function AAS_UpdatePortalRoutingCache
 //===========================================================================
 //
@@ -1549,6 +1794,11 @@ static aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum
 {
 	aas_routingcache_t *cache;
 
+	//use the precomputed routing table when available
+	if (aasworld.portaltable && !aasworld.routingtablechanges && travelflags == aasworld.routingtableflags)
+	{
+		return aasworld.portaltable[areanum];
+	} //end if
 	//find the cached portal routing if existing
 	for (cache = aasworld.portalcache[areanum]; cache; cache = cache->next)
 	{
@@ -1557,7 +1807,10 @@ static aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum
 	//if the portal routing isn't cached
 	if (!cache)
 	{
+		routingcachestats[0].misses++;
+		BotProfileCacheAccess(qfalse);
 		cache = AAS_AllocRoutingCache(aasworld.numportals);
+		routingcachestats[0].size += cache->size;
 		cache->cluster = clusternum;
 		cache->areanum = areanum;
 		VectorCopy(aasworld.areas[areanum].center, cache->origin);
@@ -1573,6 +1826,8 @@ static aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum
 	} //end if
 	else
 	{
+		routingcachestats[0].hits++;
+		BotProfileCacheAccess(qtrue);
 		AAS_UnlinkCache(cache);
 	} //end else
 	//the cache has been accessed
@@ -1582,6 +1837,217 @@ static aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum
 	return cache;
 } //end of the function AAS_GetPortalRoutingCache
 //===========================================================================
+// routing table calculation on job threads
+//===========================================================================
+typedef struct aas_routingtablejob_s
+{
+	aas_routingupdate_t *areaupdate;
+	aas_routingupdate_t *portalupdate;
+} aas_routingtablejob_t;
+
+static void *routingtablelock;
+static aas_routingcache_t **routingtablecaches;
+static int routingtablecount;
+static int routingtablenext;
+//===========================================================================
+// size of a routing table cache, caches are packed into one allocation
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_RoutingTableCacheSize(int numtraveltimes)
+{
+	return PAD(sizeof(aas_routingcache_t)
+						+ numtraveltimes * sizeof(unsigned short int)
+						+ numtraveltimes * sizeof(unsigned char), sizeof(void *));
+} //end of the function AAS_RoutingTableCacheSize
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_routingcache_t *AAS_RoutingTableCache(char **ptr, int type, int clusternum, int areanum, int numtraveltimes)
+{
+	aas_routingcache_t *cache;
+
+	cache = (aas_routingcache_t *) *ptr;
+	cache->size = AAS_RoutingTableCacheSize(numtraveltimes);
+	*ptr += cache->size;
+	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t)
+								+ numtraveltimes * sizeof(unsigned short int);
+	cache->type = type;
+	cache->cluster = clusternum;
+	cache->areanum = areanum;
+	VectorCopy(aasworld.areas[areanum].center, cache->origin);
+	cache->starttraveltime = 1;
+	cache->travelflags = aasworld.routingtableflags;
+	//
+	routingtablecaches[routingtablecount++] = cache;
+	return cache;
+} //end of the function AAS_RoutingTableCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_RoutingTableJob(void *data, int index)
+{
+	aas_routingtablejob_t *job;
+	aas_routingcache_t *cache;
+	int i;
+
+	job = (aas_routingtablejob_t *) data + index;
+	for (;;)
+	{
+		Sys_LockMutex(routingtablelock);
+		i = routingtablenext++;
+		Sys_UnlockMutex(routingtablelock);
+		if (i >= routingtablecount) break;
+		//
+		cache = routingtablecaches[i];
+		if (cache->type == CACHETYPE_PORTAL) AAS_CalculatePortalRoutingCache(cache, job->portalupdate);
+		else AAS_CalculateAreaRoutingCache(cache, job->areaupdate);
+	} //end for
+} //end of the function AAS_RoutingTableJob
+//===========================================================================
+// precomputes the routing caches of all areas for the default travel flags
+//
+// The area caches are calculated first and installed, the portal caches
+// read the installed area caches while they are calculated. The table is
+// never freed or refreshed, lookups with other travel flags or while areas
+// are enabled or disabled differently use the regular routing cache.
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_InitRoutingTable(void)
+{
+	aas_routingtablejob_t *jobs;
+	aas_cluster_t *cluster;
+	aas_portal_t *portal;
+	int i, j, size, numcaches, numareacaches, numjobs, maxreachabilityareas, maxareas, start_time;
+	char *ptr;
+
+	AAS_FreeRoutingTable();
+	//
+	maxareas = (int) LibVarValue("routingtableareas", "0");
+	if (aasworld.numareas - 1 > maxareas) return;
+	//every cluster area gets exactly one cache
+	numareacaches = 0;
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		j = aasworld.areasettings[i].cluster;
+		if (j > 0) numareacaches++;
+		else if (aasworld.portals[-j].frontcluster == aasworld.portals[-j].backcluster) numareacaches++;
+		else numareacaches += 2;
+	} //end for
+	numcaches = 0;
+	maxreachabilityareas = 0;
+	size = aasworld.numclusters * sizeof(aas_routingcache_t **);
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		cluster = &aasworld.clusters[i];
+		size += cluster->numareas * (sizeof(aas_routingcache_t *) +
+					AAS_RoutingTableCacheSize(cluster->numreachabilityareas));
+		numcaches += cluster->numareas;
+		if (cluster->numreachabilityareas > maxreachabilityareas)
+		{
+			maxreachabilityareas = cluster->numreachabilityareas;
+		} //end if
+	} //end for
+	if (numcaches != numareacaches)
+	{
+		botimport.Print(PRT_WARNING, "AAS_InitRoutingTable: cluster areas don't match\n");
+		return;
+	} //end if
+	if (numcaches < aasworld.numareas) numcaches = aasworld.numareas;
+	//
+	routingtablelock = Sys_CreateMutex();
+	if (!routingtablelock) return;
+	start_time = Sys_MilliSeconds();
+	aasworld.routingtableflags = TFL_DEFAULT;
+	routingtablecaches = (aas_routingcache_t **) GetMemory(numcaches * sizeof(aas_routingcache_t *));
+	//
+	numjobs = Com_JobWorkers() + 1;
+	jobs = (aas_routingtablejob_t *) GetClearedMemory(numjobs * sizeof(aas_routingtablejob_t));
+	for (i = 0; i < numjobs; i++)
+	{
+		jobs[i].areaupdate = (aas_routingupdate_t *) GetClearedMemory(
+									maxreachabilityareas * sizeof(aas_routingupdate_t));
+		jobs[i].portalupdate = (aas_routingupdate_t *) GetClearedMemory(
+									(aasworld.numportals+1) * sizeof(aas_routingupdate_t));
+	} //end for
+	//the area caches of all clusters
+	ptr = (char *) GetClearedMemory(size);
+	aasworld.clusterareatable = (aas_routingcache_t ***) ptr;
+	ptr += aasworld.numclusters * sizeof(aas_routingcache_t **);
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		aasworld.clusterareatable[i] = (aas_routingcache_t **) ptr;
+		ptr += aasworld.clusters[i].numareas * sizeof(aas_routingcache_t *);
+	} //end for
+	routingtablecount = 0;
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		j = aasworld.areasettings[i].cluster;
+		if (j > 0)
+		{
+			aasworld.clusterareatable[j][AAS_ClusterAreaNum(j, i)] = AAS_RoutingTableCache(&ptr,
+							CACHETYPE_AREA, j, i, aasworld.clusters[j].numreachabilityareas);
+			continue;
+		} //end if
+		//portals are part of both the front and the back cluster
+		portal = &aasworld.portals[-j];
+		aasworld.clusterareatable[portal->frontcluster][portal->clusterareanum[0]] = AAS_RoutingTableCache(&ptr,
+							CACHETYPE_AREA, portal->frontcluster, i, aasworld.clusters[portal->frontcluster].numreachabilityareas);
+		if (portal->backcluster == portal->frontcluster) continue;
+		aasworld.clusterareatable[portal->backcluster][portal->clusterareanum[1]] = AAS_RoutingTableCache(&ptr,
+							CACHETYPE_AREA, portal->backcluster, i, aasworld.clusters[portal->backcluster].numreachabilityareas);
+	} //end for
+	routingtablenext = 0;
+	Com_ParallelFor(AAS_RoutingTableJob, jobs, numjobs);
+	//the portal caches of all areas, calculated from the area caches
+	size += aasworld.numareas * (sizeof(aas_routingcache_t *) +
+					AAS_RoutingTableCacheSize(aasworld.numportals));
+	ptr = (char *) GetClearedMemory(aasworld.numareas * (sizeof(aas_routingcache_t *) +
+					AAS_RoutingTableCacheSize(aasworld.numportals)));
+	aasworld.portaltable = (aas_routingcache_t **) ptr;
+	ptr += aasworld.numareas * sizeof(aas_routingcache_t *);
+	routingtablecount = 0;
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		j = aasworld.areasettings[i].cluster;
+		if (j < 0) j = aasworld.portals[-j].frontcluster;
+		aasworld.portaltable[i] = AAS_RoutingTableCache(&ptr, CACHETYPE_PORTAL, j, i, aasworld.numportals);
+	} //end for
+	routingtablenext = 0;
+	Com_ParallelFor(AAS_RoutingTableJob, jobs, numjobs);
+	//remember the areas the table was built with
+	aasworld.routingtabledisabled = (byte *) GetClearedMemory(aasworld.numareas * sizeof(byte));
+	for (i = 0; i < aasworld.numareas; i++)
+	{
+		aasworld.routingtabledisabled[i] = aasworld.areasettings[i].areaflags & AREA_DISABLED;
+	} //end for
+	//
+	botimport.Print(PRT_MESSAGE, "%d KB routing table for %d areas in %d msec on %d threads\n",
+						size >> 10, aasworld.numareas - 1, Sys_MilliSeconds() - start_time, numjobs);
+	//
+	for (i = 0; i < numjobs; i++)
+	{
+		FreeMemory(jobs[i].areaupdate);
+		FreeMemory(jobs[i].portalupdate);
+	} //end for
+	FreeMemory(jobs);
+	FreeMemory(routingtablecaches);
+	routingtablecaches = NULL;
+	Sys_DestroyMutex(routingtablelock);
+	routingtablelock = NULL;
+} //end of the function AAS_InitRoutingTable
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -1626,13 +2092,6 @@ static int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum,
 		return qfalse;
 	} //end if
 
-	// make sure the routing cache doesn't grow to large
-	while ( routingcachesize > 12 * 1024 * 1024 ) {
-		if ( !AAS_FreeOldestCache() ) {
-			break;
-		}
-	}
-
 	//
 	if (AAS_AreaDoNotEnter(areanum) || AAS_AreaDoNotEnter(goalareanum))
 	{
@@ -1788,6 +2247,137 @@ int AAS_AreaTravelTimeToGoalArea(int areanum, vec3_t origin, int goalareanum, in
 	return 0;
 } //end of the function AAS_AreaTravelTimeToGoalArea
 //===========================================================================
+// travel times from one area towards many goal areas, gives the same times as
+// AAS_AreaTravelTimeToGoalArea but the routes from the area towards the portals
+// of its cluster are only looked up once for all goals in other clusters
+//
+// Parameter:			traveltimes		: travel time towards each goal, 0 if unreachable
+// Returns:				number of reachable goals
+// Changes Globals:		-
+//===========================================================================
+int AAS_AreaTravelTimesToGoalAreas(int areanum, vec3_t origin, int *goalareanums, int numgoals,
+										int travelflags, int *traveltimes)
+{
+	int i, j, n, goalareanum, clusternum, goalclusternum, clusterareanum, portalnum, flags;
+	int *portaltimes;
+	unsigned short int t, besttime;
+	aas_portal_t *portal;
+	aas_cluster_t *cluster;
+	aas_routingcache_t *areacache, *portalcache;
+	aas_reachability_t *reach;
+
+	if (numgoals <= 0) return 0;
+	Com_Memset(traveltimes, 0, numgoals * sizeof(int));
+	if (!aasworld.initialized) return 0;
+	//
+	cluster = NULL;
+	clusternum = 0;
+	clusterareanum = 0;
+	if (areanum > 0 && areanum < aasworld.numareas &&
+			aasworld.areasettings[areanum].numreachableareas &&
+			aasworld.areasettings[areanum].cluster > 0)
+	{
+		clusternum = aasworld.areasettings[areanum].cluster;
+		cluster = &aasworld.clusters[clusternum];
+		clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
+		//routes from areas without reachabilities don't leave the cluster
+		if (clusterareanum >= cluster->numreachabilityareas) cluster = NULL;
+	} //end if
+	if (cluster)
+	{
+		for (i = 0; i < cluster->numportals; i++)
+		{
+			portalnum = aasworld.portalindex[cluster->firstportal + i];
+			batchportaltimes[portalnum] = BATCHTIME_UNKNOWN;
+			batchportaltimes[aasworld.numportals + portalnum] = BATCHTIME_UNKNOWN;
+		} //end for
+	} //end if
+	//
+	n = 0;
+	for (j = 0; j < numgoals; j++)
+	{
+		goalareanum = goalareanums[j];
+		goalclusternum = 0;
+		if (cluster && goalareanum != areanum && goalareanum > 0 && goalareanum < aasworld.numareas &&
+				aasworld.areasettings[goalareanum].numreachableareas)
+		{
+			goalclusternum = aasworld.areasettings[goalareanum].cluster;
+			if (goalclusternum < 0)
+			{
+				portal = &aasworld.portals[-goalclusternum];
+				//portals of the start cluster are routed through the cluster
+				if (portal->frontcluster == clusternum || portal->backcluster == clusternum)
+					goalclusternum = 0;
+				else
+					goalclusternum = portal->frontcluster;
+			} //end if
+			else if (goalclusternum == clusternum)
+			{
+				goalclusternum = 0;
+			} //end else if
+		} //end if
+		//everything but a route towards another cluster is left to the single query
+		if (!goalclusternum)
+		{
+			traveltimes[j] = AAS_AreaTravelTimeToGoalArea(areanum, origin, goalareanum, travelflags);
+			if (traveltimes[j]) n++;
+			continue;
+		} //end if
+		//
+		flags = travelflags;
+		portaltimes = batchportaltimes;
+		if (AAS_AreaDoNotEnter(areanum) || AAS_AreaDoNotEnter(goalareanum))
+		{
+			flags |= TFL_DONOTENTER;
+			portaltimes += aasworld.numportals;
+		} //end if
+		//get the portal routing cache
+		portalcache = AAS_GetPortalRoutingCache(goalclusternum, goalareanum, flags);
+		//
+		besttime = 0;
+		for (i = 0; i < cluster->numportals; i++)
+		{
+			portalnum = aasworld.portalindex[cluster->firstportal + i];
+			//if the goal area isn't reachable from the portal
+			if (!portalcache->traveltimes[portalnum]) continue;
+			//travel time from the area towards and through the portal area
+			if (portaltimes[portalnum] == BATCHTIME_UNKNOWN)
+			{
+				portal = &aasworld.portals[portalnum];
+				areacache = AAS_GetAreaRoutingCache(clusternum, portal->areanum, flags);
+				if (!areacache->traveltimes[clusterareanum])
+				{
+					portaltimes[portalnum] = BATCHTIME_UNREACHABLE;
+				} //end if
+				else
+				{
+					portaltimes[portalnum] = areacache->traveltimes[clusterareanum] +
+												aasworld.portalmaxtraveltimes[portalnum];
+					if (origin)
+					{
+						reach = &aasworld.reachability[aasworld.areasettings[areanum].firstreachablearea +
+															areacache->reachabilities[clusterareanum]];
+						portaltimes[portalnum] += AAS_AreaTravelTime(areanum, origin, reach->start);
+					} //end if
+				} //end else
+			} //end if
+			if (portaltimes[portalnum] == BATCHTIME_UNREACHABLE) continue;
+			//same unsigned short sum as AAS_AreaRouteToGoalArea
+			t = portalcache->traveltimes[portalnum] + portaltimes[portalnum];
+			if (!besttime || t < besttime)
+			{
+				besttime = t;
+			} //end if
+		} //end for
+		if (besttime)
+		{
+			traveltimes[j] = besttime;
+			n++;
+		} //end if
+	} //end for
+	return n;
+} //end of the function AAS_AreaTravelTimesToGoalAreas
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
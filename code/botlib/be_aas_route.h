@@ -59,6 +59,9 @@ int AAS_EnableRoutingArea(int areanum, int enable);
 unsigned short int AAS_AreaTravelTime(int areanum, vec3_t start, vec3_t end);
 //returns the travel time from the area to the goal area using the given travel flags
 int AAS_AreaTravelTimeToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags);
+//travel times from the area towards each of the goal areas, returns the number of reachable goals
+int AAS_AreaTravelTimesToGoalAreas(int areanum, vec3_t origin, int *goalareanums, int numgoals,
+										int travelflags, int *traveltimes);
 //predict a route up to a stop event
 int AAS_PredictRoute(struct aas_predictroute_s *route, int areanum, vec3_t origin,
 							int goalareanum, int travelflags, int maxareas, int maxtime,
@@ -36,6 +36,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "l_struct.h"
 #ifndef BSPC
 #include "l_libvar.h"
+#include "../qcommon/qcommon.h"
 #endif
 #include "aasfile.h"
 #include "botlib.h"
@@ -44,6 +45,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "be_aas_funcs.h"
 #include "be_aas_def.h"
 
+#define POINTAREAGRID_MINCELLSIZE	64
+#define POINTAREAGRID_MAXCELLS		(1<<18)
+#define POINTAREAGRID_EPSILON		0.1
+
 
 //#define AAS_SAMPLE_DEBUG
 
@@ -203,27 +208,130 @@ void AAS_FreeAASLinkedEntities(void)
 	aasworld.arealinkedentities = NULL;
 } //end of the function AAS_InitAASLinkedEntities
 //===========================================================================
-// returns the AAS area the point is in
+// returns the deepest node of which the box is on both sides,
+// or minus the leaf the box is completely in
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int AAS_PointAreaNum(vec3_t point)
+static int AAS_BoxStartNode(vec3_t mins, vec3_t maxs)
 {
-	int nodenum;
-	vec_t	dist;
+	int nodenum, i;
+	vec_t front, back;
 	aas_node_t *node;
 	aas_plane_t *plane;
 
-	if (!aasworld.loaded)
+	nodenum = 1;
+	while (nodenum > 0)
 	{
-		botimport.Print(PRT_ERROR, "AAS_PointAreaNum: aas not loaded\n");
-		return 0;
-	} //end if
+		node = &aasworld.nodes[nodenum];
+		plane = &aasworld.planes[node->planenum];
+		//distance range of the box corners to the plane
+		front = back = -plane->dist;
+		for (i = 0; i < 3; i++)
+		{
+			if (plane->normal[i] > 0)
+			{
+				front += plane->normal[i] * maxs[i];
+				back += plane->normal[i] * mins[i];
+			} //end if
+			else
+			{
+				front += plane->normal[i] * mins[i];
+				back += plane->normal[i] * maxs[i];
+			} //end else
+		} //end for
+		//the same side for all points in the box, with some room for rounding
+		if (back > POINTAREAGRID_EPSILON) nodenum = node->children[0];
+		else if (front < -POINTAREAGRID_EPSILON) nodenum = node->children[1];
+		else return nodenum;
+	} //end while
+	return nodenum;
+} //end of the function AAS_BoxStartNode
+//===========================================================================
+// most points resolve within their grid cell without descending the
+// top of the tree, cells completely inside a leaf need no descent at all
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InitPointAreaGrid(void)
+{
+	int i, x, y, z, numcells, *cell;
+	float cellsize;
+	vec3_t mins, maxs, cellmins, cellmaxs;
+
+	AAS_FreePointAreaGrid();
+	if (!aasworld.loaded || aasworld.numareas <= 1 || aasworld.numnodes <= 1) return;
+	//bounds of all areas
+	VectorCopy(aasworld.areas[1].mins, mins);
+	VectorCopy(aasworld.areas[1].maxs, maxs);
+	for (i = 2; i < aasworld.numareas; i++)
+	{
+		AddPointToBounds(aasworld.areas[i].mins, mins, maxs);
+		AddPointToBounds(aasworld.areas[i].maxs, mins, maxs);
+	} //end for
+	//smallest cell size that keeps the grid within the maximum number of cells
+	for (cellsize = POINTAREAGRID_MINCELLSIZE; ; cellsize *= 2)
+	{
+		numcells = 1;
+		for (i = 0; i < 3; i++)
+		{
+			aasworld.pointareagridsize[i] = (int) ceil((maxs[i] - mins[i]) / cellsize);
+			if (aasworld.pointareagridsize[i] < 1) aasworld.pointareagridsize[i] = 1;
+			numcells *= aasworld.pointareagridsize[i];
+		} //end for
+		if (numcells <= POINTAREAGRID_MAXCELLS) break;
+	} //end for
+	VectorCopy(mins, aasworld.pointareagridmins);
+	aasworld.pointareagridscale = 1.0f / cellsize;
+	aasworld.pointareagrid = (int *) GetMemory(numcells * sizeof(int));
+	//
+	cell = aasworld.pointareagrid;
+	for (z = 0; z < aasworld.pointareagridsize[2]; z++)
+	{
+		for (y = 0; y < aasworld.pointareagridsize[1]; y++)
+		{
+			for (x = 0; x < aasworld.pointareagridsize[0]; x++)
+			{
+				//grow the cell a little so rounding of the cell index doesn't matter
+				cellmins[0] = mins[0] + x * cellsize - 1;
+				cellmins[1] = mins[1] + y * cellsize - 1;
+				cellmins[2] = mins[2] + z * cellsize - 1;
+				cellmaxs[0] = cellmins[0] + cellsize + 2;
+				cellmaxs[1] = cellmins[1] + cellsize + 2;
+				cellmaxs[2] = cellmins[2] + cellsize + 2;
+				*cell++ = AAS_BoxStartNode(cellmins, cellmaxs);
+			} //end for
+		} //end for
+	} //end for
+} //end of the function AAS_InitPointAreaGrid
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreePointAreaGrid(void)
+{
+	if (aasworld.pointareagrid) FreeMemory(aasworld.pointareagrid);
+	aasworld.pointareagrid = NULL;
+} //end of the function AAS_FreePointAreaGrid
+//===========================================================================
+// returns the AAS area the point is in
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_PointAreaNumFromNode(vec3_t point, int nodenum)
+{
+	vec_t	dist;
+	aas_node_t *node;
+	aas_plane_t *plane;
 
-	//start with node 1 because node zero is a dummy used for solid leafs
-	nodenum = 1;
 	while (nodenum > 0)
 	{
 //		botimport.Print(PRT_MESSAGE, "[%d]", nodenum);
@@ -255,10 +363,142 @@ int AAS_PointAreaNum(vec3_t point)
 		return 0;
 	} //end if
 	return -nodenum;
+} //end of the function AAS_PointAreaNumFromNode
+//===========================================================================
+// returns the AAS area the point is in
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_PointAreaNum(vec3_t point)
+{
+	int nodenum, i, cell[3];
+	float f;
+
+	if (!aasworld.loaded)
+	{
+		botimport.Print(PRT_ERROR, "AAS_PointAreaNum: aas not loaded\n");
+		return 0;
+	} //end if
+
+	//start with node 1 because node zero is a dummy used for solid leafs
+	nodenum = 1;
+	//skip the part of the tree above the grid cell the point is in
+	if (aasworld.pointareagrid)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			f = (point[i] - aasworld.pointareagridmins[i]) * aasworld.pointareagridscale;
+			if (!(f >= 0 && f < aasworld.pointareagridsize[i])) break;
+			cell[i] = (int) f;
+		} //end for
+		if (i == 3)
+		{
+			nodenum = aasworld.pointareagrid[(cell[2] * aasworld.pointareagridsize[1] + cell[1]) *
+												aasworld.pointareagridsize[0] + cell[0]];
+			//the whole cell is inside one leaf
+			if (nodenum <= 0) return -nodenum;
+		} //end if
+	} //end if
+	return AAS_PointAreaNumFromNode(point, nodenum);
 } //end of the function AAS_PointAreaNum
 //===========================================================================
 //
 // Parameter:			-
+// Returns:				number of points inside an area
+// Changes Globals:		-
+//===========================================================================
+int AAS_PointAreaNums(vec3_t *points, int numpoints, int *areanums)
+{
+	int i, n;
+
+	n = 0;
+	for (i = 0; i < numpoints; i++)
+	{
+		areanums[i] = AAS_PointAreaNum(points[i]);
+		if (areanums[i]) n++;
+	} //end for
+	return n;
+} //end of the function AAS_PointAreaNums
+#ifndef BSPC
+//===========================================================================
+// times point area queries at random points within the area bounds with
+// and without the point area grid and checks they give the same areas
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_PointAreaNumBench(int numpoints)
+{
+	int i, j, numcells, hits, mismatches, *gridareas, *treeareas, *grid;
+	int64_t gridtime, treetime;
+	vec3_t *points, maxs;
+	float cellsize;
+
+	if (!aasworld.loaded || !aasworld.pointareagrid)
+	{
+		botimport.Print(PRT_MESSAGE, "no point area grid\n");
+		return;
+	} //end if
+	if (numpoints <= 0) return;
+	//
+	points = (vec3_t *) GetMemory(numpoints * (sizeof(vec3_t) + 2 * sizeof(int)));
+	gridareas = (int *) (points + numpoints);
+	treeareas = gridareas + numpoints;
+	cellsize = 1.0f / aasworld.pointareagridscale;
+	for (j = 0; j < 3; j++)
+	{
+		maxs[j] = aasworld.pointareagridmins[j] + aasworld.pointareagridsize[j] * cellsize;
+	} //end for
+	for (i = 0; i < numpoints; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			points[i][j] = aasworld.pointareagridmins[j] + random() * (maxs[j] - aasworld.pointareagridmins[j]);
+		} //end for
+	} //end for
+	//
+	gridtime = Sys_Microseconds();
+	for (i = 0; i < numpoints; i++)
+	{
+		gridareas[i] = AAS_PointAreaNum(points[i]);
+	} //end for
+	gridtime = Sys_Microseconds() - gridtime;
+	//the same queries from the root of the tree
+	grid = aasworld.pointareagrid;
+	aasworld.pointareagrid = NULL;
+	treetime = Sys_Microseconds();
+	for (i = 0; i < numpoints; i++)
+	{
+		treeareas[i] = AAS_PointAreaNum(points[i]);
+	} //end for
+	treetime = Sys_Microseconds() - treetime;
+	aasworld.pointareagrid = grid;
+	//
+	numcells = aasworld.pointareagridsize[0] * aasworld.pointareagridsize[1] * aasworld.pointareagridsize[2];
+	hits = 0;
+	for (i = 0; i < numcells; i++)
+	{
+		if (grid[i] <= 0) hits++;
+	} //end for
+	mismatches = 0;
+	for (i = 0; i < numpoints; i++)
+	{
+		if (gridareas[i] != treeareas[i]) mismatches++;
+	} //end for
+	botimport.Print(PRT_MESSAGE, "%d points: grid %d usec, tree %d usec, %d mismatches\n",
+						numpoints, (int) gridtime, (int) treetime, mismatches);
+	botimport.Print(PRT_MESSAGE, "%dx%dx%d cells of %.0f units, %d%% inside one leaf\n",
+						aasworld.pointareagridsize[0], aasworld.pointareagridsize[1], aasworld.pointareagridsize[2],
+						cellsize, hits * 100 / numcells);
+	FreeMemory(points);
+} //end of the function AAS_PointAreaNumBench
+#endif //BSPC
+//===========================================================================
+//
+// Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
@@ -1223,7 +1463,45 @@ typedef struct
 	int nodenum;		//node found after splitting
 } aas_linkstack_t;
 
-aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
+//===========================================================================
+// distances of the box to the plane, the box crosses the plane side
+// when it moves further than the smaller one
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static float AAS_BoxPlaneSideRange(vec3_t absmins, vec3_t absmaxs, aas_plane_t *p)
+{
+	int i;
+	float dist1, dist2;
+
+	dist1 = dist2 = -p->dist;
+	for (i = 0; i < 3; i++)
+	{
+		if (p->normal[i] < 0)
+		{
+			dist1 += p->normal[i] * absmins[i];
+			dist2 += p->normal[i] * absmaxs[i];
+		} //end if
+		else
+		{
+			dist1 += p->normal[i] * absmaxs[i];
+			dist2 += p->normal[i] * absmins[i];
+		} //end else
+	} //end for
+	return fabs(dist1) < fabs(dist2) ? fabs(dist1) : fabs(dist2);
+} //end of the function AAS_BoxPlaneSideRange
+//===========================================================================
+// same as AAS_AASLinkEntity, range is set to the distance the box can be
+// moved without changing the sides of the planes it was tested against
+// and thus without changing the areas the box is linked to
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+aas_link_t *AAS_AASLinkEntityRange(vec3_t absmins, vec3_t absmaxs, int entnum, float *range)
 {
 	int side, nodenum;
 	aas_linkstack_t linkstack[128];
@@ -1231,6 +1509,7 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 	aas_node_t *aasnode;
 	aas_plane_t *plane;
 	aas_link_t *link, *areas;
+	float dist;
 
 	if (!aasworld.loaded)
 	{
@@ -1239,6 +1518,7 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 	} //end if
 
 	areas = NULL;
+	if (range) *range = 99999;
 	//
 	lstack_p = linkstack;
 	//we start with the whole line on the stack
@@ -1267,7 +1547,12 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 			if (link) continue;
 			//
 			link = AAS_AllocAASLink();
-			if (!link) return areas;
+			if (!link)
+			{
+				//not linked to all areas, relink on any movement
+				if (range) *range = 0;
+				return areas;
+			} //end if
 			link->entnum = entnum;
 			link->areanum = -nodenum;
 			//put the link into the double linked area list of the entity
@@ -1292,6 +1577,11 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 		plane = &aasworld.planes[aasnode->planenum];
 		//get the side(s) the box is situated relative to the plane
 		side = AAS_BoxOnPlaneSide2(absmins, absmaxs, plane);
+		if (range)
+		{
+			dist = AAS_BoxPlaneSideRange(absmins, absmaxs, plane);
+			if (dist < *range) *range = dist;
+		} //end if
 		//if on the front side of the node
 		if (side & 1)
 		{
@@ -1301,6 +1591,7 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 		if (lstack_p >= &linkstack[127])
 		{
 			botimport.Print(PRT_ERROR, "AAS_LinkEntity: stack overflow\n");
+			if (range) *range = 0;
 			break;
 		} //end if
 		//if on the back side of the node
@@ -1312,10 +1603,21 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 		if (lstack_p >= &linkstack[127])
 		{
 			botimport.Print(PRT_ERROR, "AAS_LinkEntity: stack overflow\n");
+			if (range) *range = 0;
 			break;
 		} //end if
 	} //end while
 	return areas;
+} //end of the function AAS_AASLinkEntityRange
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
+{
+	return AAS_AASLinkEntityRange(absmins, absmaxs, entnum, NULL);
 } //end of the function AAS_AASLinkEntity
 //===========================================================================
 //
@@ -1323,7 +1625,7 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-aas_link_t *AAS_LinkEntityClientBBox(vec3_t absmins, vec3_t absmaxs, int entnum, int presencetype)
+aas_link_t *AAS_LinkEntityClientBBoxRange(vec3_t absmins, vec3_t absmaxs, int entnum, int presencetype, float *range)
 {
 	vec3_t mins, maxs;
 	vec3_t newabsmins, newabsmaxs;
@@ -1332,7 +1634,17 @@ aas_link_t *AAS_LinkEntityClientBBox(vec3_t absmins, vec3_t absmaxs, int entnum,
 	VectorSubtract(absmins, maxs, newabsmins);
 	VectorSubtract(absmaxs, mins, newabsmaxs);
 	//relink the entity
-	return AAS_AASLinkEntity(newabsmins, newabsmaxs, entnum);
+	return AAS_AASLinkEntityRange(newabsmins, newabsmaxs, entnum, range);
+} //end of the function AAS_LinkEntityClientBBoxRange
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+aas_link_t *AAS_LinkEntityClientBBox(vec3_t absmins, vec3_t absmaxs, int entnum, int presencetype)
+{
+	return AAS_LinkEntityClientBBoxRange(absmins, absmaxs, entnum, presencetype, NULL);
 } //end of the function AAS_LinkEntityClientBBox
 //===========================================================================
 //
@@ -34,6 +34,8 @@ void AAS_InitAASLinkHeap(void);
 void AAS_InitAASLinkedEntities(void);
 void AAS_FreeAASLinkHeap(void);
 void AAS_FreeAASLinkedEntities(void);
+void AAS_InitPointAreaGrid(void);
+void AAS_FreePointAreaGrid(void);
 #if 0
 aas_face_t *AAS_AreaGroundFace(int areanum, vec3_t point);
 #endif
@@ -41,6 +43,8 @@ aas_face_t *AAS_TraceEndFace(aas_trace_t *trace);
 aas_plane_t *AAS_PlaneFromNum(int planenum);
 aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum);
 aas_link_t *AAS_LinkEntityClientBBox(vec3_t absmins, vec3_t absmaxs, int entnum, int presencetype);
+//also returns the distance the box can move without changing the linked areas
+aas_link_t *AAS_LinkEntityClientBBoxRange(vec3_t absmins, vec3_t absmaxs, int entnum, int presencetype, float *range);
 qboolean AAS_PointInsideFace(int facenum, vec3_t point, float epsilon);
 void AAS_UnlinkFromAreas(aas_link_t *areas);
 #endif //AASINTERN
@@ -63,6 +67,10 @@ int AAS_BBoxAreas(vec3_t absmins, vec3_t absmaxs, int *areas, int maxareas);
 int AAS_AreaInfo( int areanum, aas_areainfo_t *info );
 //returns the area the point is in
 int AAS_PointAreaNum(vec3_t point);
+//areas of a set of points, returns the number of points that are not in solid
+int AAS_PointAreaNums(vec3_t *points, int numpoints, int *areanums);
+//compares point area queries with and without the point area grid
+void AAS_PointAreaNumBench(int numpoints);
 //
 int AAS_PointReachabilityAreaIndex( vec3_t point );
 #if 0
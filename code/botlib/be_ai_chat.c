@@ -127,6 +127,7 @@ typedef struct bot_synonymlist_s
 typedef struct bot_matchstring_s
 {
 	char *string;
+	int id;								//string number in the match automaton, -1 if none
 	struct bot_matchstring_s *next;
 } bot_matchstring_t;
 
@@ -148,6 +149,33 @@ typedef struct bot_matchtemplate_s
 	struct bot_matchtemplate_s *next;
 } bot_matchtemplate_t;
 
+//the match strings of all match templates compiled into one case insensitive
+//Aho-Corasick automaton, a message is scanned once to find the first
+//occurrence of every string instead of once for every template piece
+typedef struct bot_matchautomaton_s
+{
+	int numstrings;						//distinct match strings
+	int numstates;
+	int numclasses;						//character classes, 0 is any character not in a string
+	unsigned char charclass[256];
+	int *transitions;					//numstates * numclasses next states
+	int *output;						//string ending in the state, -1 if none
+	int *outputlink;					//next state on the suffix chain with output, 0 if none
+	int *stringlength;
+	int *firstindex;					//first occurrence of the strings in the last scanned message
+} bot_matchautomaton_t;
+
+//results of the last matched messages, every bot matches the same console messages
+#define MATCHCACHE_SIZE			16
+
+typedef struct bot_matchcache_s
+{
+	char string[MAX_MESSAGE_SIZE];
+	unsigned long int context;
+	int found;
+	bot_match_t match;
+} bot_matchcache_t;
+
 //reply chat key
 typedef struct bot_replychatkey_s
 {
@@ -204,6 +232,10 @@ static bot_consolemessage_t *consolemessageheap = NULL;
 static bot_consolemessage_t *freeconsolemessages = NULL;
 //list with match strings
 static bot_matchtemplate_t *matchtemplates = NULL;
+//compiled match strings of the match templates
+static bot_matchautomaton_t *matchautomaton = NULL;
+static bot_matchcache_t matchcache[MATCHCACHE_SIZE];
+static int matchcachenext;
 //list with synonyms
 static bot_synonymlist_t *synonyms = NULL;
 //list with random strings
@@ -1287,6 +1319,7 @@ static bot_matchpiece_t *BotLoadMatchPieces(source_t *source, char *endtoken)
 				matchstring = (bot_matchstring_t *) GetClearedHunkMemory(sizeof(bot_matchstring_t) + strlen(token.string) + 1);
 				matchstring->string = (char *) matchstring + sizeof(bot_matchstring_t);
 				strcpy(matchstring->string, token.string);
+				matchstring->id = -1;
 				if (!strlen(token.string)) emptystring = qtrue;
 				matchstring->next = NULL;
 				if (lastmatchstring) lastmatchstring->next = matchstring;
@@ -1435,7 +1468,199 @@ static bot_matchtemplate_t *BotLoadMatchTemplates( const char *matchfile )
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-static int StringsMatch(bot_matchpiece_t *pieces, bot_match_t *match)
+static void BotFreeMatchAutomaton(void)
+{
+	if (matchautomaton) FreeMemory(matchautomaton);
+	matchautomaton = NULL;
+	//cached results refer to the old templates
+	Com_Memset(matchcache, 0, sizeof(matchcache));
+	matchcachenext = 0;
+} //end of the function BotFreeMatchAutomaton
+//===========================================================================
+// compiles the match strings of the templates into one automaton
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		matchautomaton
+//===========================================================================
+static void BotCompileMatchTemplates(bot_matchtemplate_t *matches)
+{
+	bot_matchtemplate_t *mt;
+	bot_matchpiece_t *mp;
+	bot_matchstring_t *ms;
+	bot_matchautomaton_t *ma;
+	unsigned char classes[256];
+	int maxstates, numstrings, numclasses, i, c, s, state, next, *fail, *queue, head, tail;
+	char *ptr;
+
+	BotFreeMatchAutomaton();
+	//character classes and an upper bound of the number of states
+	Com_Memset(classes, 0, sizeof(classes));
+	numclasses = 1;
+	maxstates = 1;
+	numstrings = 0;
+	for (mt = matches; mt; mt = mt->next)
+	{
+		for (mp = mt->first; mp; mp = mp->next)
+		{
+			if (mp->type != MT_STRING) continue;
+			for (ms = mp->firststring; ms; ms = ms->next)
+			{
+				for (i = 0; ms->string[i]; i++)
+				{
+					c = locase[(byte) ms->string[i]];
+					if (!classes[c]) classes[c] = numclasses++;
+				} //end for
+				maxstates += i;
+				if (i) numstrings++;
+			} //end for
+		} //end for
+	} //end for
+	if (!numstrings) return;
+	//
+	ptr = (char *) GetClearedMemory(sizeof(bot_matchautomaton_t) +
+				maxstates * numclasses * sizeof(int) + maxstates * 2 * sizeof(int) +
+				numstrings * 2 * sizeof(int) + maxstates * 2 * sizeof(int));
+	ma = (bot_matchautomaton_t *) ptr;
+	ptr += sizeof(bot_matchautomaton_t);
+	ma->transitions = (int *) ptr;
+	ptr += maxstates * numclasses * sizeof(int);
+	ma->output = (int *) ptr;
+	ptr += maxstates * sizeof(int);
+	ma->outputlink = (int *) ptr;
+	ptr += maxstates * sizeof(int);
+	ma->stringlength = (int *) ptr;
+	ptr += numstrings * sizeof(int);
+	ma->firstindex = (int *) ptr;
+	ptr += numstrings * sizeof(int);
+	//temporary fail links and breadth first queue
+	fail = (int *) ptr;
+	ptr += maxstates * sizeof(int);
+	queue = (int *) ptr;
+	//
+	ma->numclasses = numclasses;
+	for (c = 0; c < 256; c++) ma->charclass[c] = classes[locase[c]];
+	for (i = 0; i < maxstates * numclasses; i++) ma->transitions[i] = -1;
+	for (i = 0; i < maxstates; i++) ma->output[i] = -1;
+	ma->numstates = 1;
+	//add all strings to the trie, equal strings share their end state
+	for (mt = matches; mt; mt = mt->next)
+	{
+		for (mp = mt->first; mp; mp = mp->next)
+		{
+			if (mp->type != MT_STRING) continue;
+			for (ms = mp->firststring; ms; ms = ms->next)
+			{
+				if (!ms->string[0]) continue;
+				state = 0;
+				for (i = 0; ms->string[i]; i++)
+				{
+					c = ma->charclass[(byte) ms->string[i]];
+					next = ma->transitions[state * numclasses + c];
+					if (next < 0)
+					{
+						next = ma->numstates++;
+						ma->transitions[state * numclasses + c] = next;
+					} //end if
+					state = next;
+				} //end for
+				if (ma->output[state] < 0)
+				{
+					ma->stringlength[ma->numstrings] = i;
+					ma->output[state] = ma->numstrings++;
+				} //end if
+				ms->id = ma->output[state];
+			} //end for
+		} //end for
+	} //end for
+	//turn the trie into a complete state machine in breadth first order
+	head = tail = 0;
+	for (c = 0; c < numclasses; c++)
+	{
+		next = ma->transitions[c];
+		if (next < 0) ma->transitions[c] = 0;
+		else
+		{
+			fail[next] = 0;
+			queue[tail++] = next;
+		} //end else
+	} //end for
+	while(head < tail)
+	{
+		s = queue[head++];
+		//the longest suffix state that ends a string
+		state = fail[s];
+		ma->outputlink[s] = ma->output[state] >= 0 ? state : ma->outputlink[state];
+		for (c = 0; c < numclasses; c++)
+		{
+			next = ma->transitions[s * numclasses + c];
+			if (next < 0)
+			{
+				ma->transitions[s * numclasses + c] = ma->transitions[fail[s] * numclasses + c];
+			} //end if
+			else
+			{
+				fail[next] = ma->transitions[fail[s] * numclasses + c];
+				queue[tail++] = next;
+			} //end else
+		} //end for
+	} //end while
+	matchautomaton = ma;
+} //end of the function BotCompileMatchTemplates
+//===========================================================================
+// finds the first occurrence of every match string in the message
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotScanMatchStrings(bot_matchautomaton_t *ma, const char *str)
+{
+	int i, state, s, id;
+
+	for (i = 0; i < ma->numstrings; i++) ma->firstindex[i] = -1;
+	state = 0;
+	for (i = 0; str[i]; i++)
+	{
+		state = ma->transitions[state * ma->numclasses + ma->charclass[(byte) str[i]]];
+		s = ma->output[state] >= 0 ? state : ma->outputlink[state];
+		for (; s; s = ma->outputlink[s])
+		{
+			id = ma->output[s];
+			if (ma->firstindex[id] < 0) ma->firstindex[id] = i + 1 - ma->stringlength[id];
+		} //end for
+	} //end for
+} //end of the function BotScanMatchStrings
+//===========================================================================
+// same as StringContains(strptr, ms->string, qfalse) with the strings
+// of the last scanned message
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int BotMatchStringIndex(const char *string, const char *strptr, bot_matchstring_t *ms)
+{
+	int index;
+
+	if (!matchautomaton || ms->id < 0)
+	{
+		return StringContains(strptr, ms->string, qfalse);
+	} //end if
+	index = matchautomaton->firstindex[ms->id];
+	//the string isn't in the message at all
+	if (index < 0) return -1;
+	//the first occurrence is at or after the string pointer
+	if (index >= strptr - string) return index - (strptr - string);
+	return StringContains(strptr, ms->string, qfalse);
+} //end of the function BotMatchStringIndex
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int StringsMatch(bot_matchpiece_t *pieces, bot_match_t *match, int scanned)
 {
 	int lastvariable, index;
 	const char *strptr, *newstrptr;
@@ -1462,7 +1687,9 @@ static int StringsMatch(bot_matchpiece_t *pieces, bot_match_t *match)
 					break;
 				} //end if
 				//Log_Write("MT_STRING: %s", mp->string);
-				index = StringContains(strptr, ms->string, qfalse);
+				//templates use the strings found by BotScanMatchStrings
+				if (scanned) index = BotMatchStringIndex(match->string, strptr, ms);
+				else index = StringContains(strptr, ms->string, qfalse);
 				if (index >= 0)
 				{
 					newstrptr = strptr + index;
@@ -1512,11 +1739,23 @@ static int StringsMatch(bot_matchpiece_t *pieces, bot_match_t *match)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int BotFindMatch(const char *str, bot_match_t *match, unsigned long int context)
+static int BotMatchTemplates(const char *str, bot_match_t *match, unsigned long int context)
 {
-	int i;
+	int i, found;
 	bot_matchtemplate_t *ms;
+	bot_matchcache_t *mc;
 
+	//every bot matches the same console messages
+	for (i = 0; i < MATCHCACHE_SIZE; i++)
+	{
+		mc = &matchcache[i];
+		if (mc->context == context && context && !strncmp(mc->string, str, sizeof(mc->string)))
+		{
+			Com_Memcpy(match, &mc->match, sizeof(bot_match_t));
+			return mc->found;
+		} //end if
+	} //end for
+	//
 	Q_strncpyz( match->string, str, sizeof( match->string ) );
 	//remove any trailing enters
 	while(strlen(match->string) &&
@@ -1524,6 +1763,8 @@ int BotFindMatch(const char *str, bot_match_t *match, unsigned long int context)
 	{
 		match->string[strlen(match->string)-1] = '\0';
 	} //end while
+	if (matchautomaton) BotScanMatchStrings(matchautomaton, match->string);
+	found = qfalse;
 	//compare the string with all the match strings
 	for (ms = matchtemplates; ms; ms = ms->next)
 	{
@@ -1531,14 +1772,41 @@ int BotFindMatch(const char *str, bot_match_t *match, unsigned long int context)
 		//reset the match variable offsets
 		for (i = 0; i < MAX_MATCHVARIABLES; i++) match->variables[i].offset = -1;
 		//
-		if (StringsMatch(ms->first, match))
+		if (StringsMatch(ms->first, match, qtrue))
 		{
 			match->type = ms->type;
 			match->subtype = ms->subtype;
-			return qtrue;
+			found = qtrue;
+			break;
 		} //end if
 	} //end for
-	return qfalse;
+	//only messages that fit are cached, longer ones could differ after the cut
+	if (strlen(str) < sizeof(mc->string))
+	{
+		mc = &matchcache[matchcachenext];
+		matchcachenext = (matchcachenext + 1) % MATCHCACHE_SIZE;
+		Q_strncpyz(mc->string, str, sizeof(mc->string));
+		mc->context = context;
+		mc->found = found;
+		Com_Memcpy(&mc->match, match, sizeof(bot_match_t));
+	} //end if
+	return found;
+} //end of the function BotMatchTemplates
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int BotFindMatch(const char *str, bot_match_t *match, unsigned long int context)
+{
+	int64_t start;
+	int found;
+
+	start = BotProfileBegin(BOTPROFILE_CHAT);
+	found = BotMatchTemplates(str, match, context);
+	BotProfileEnd(BOTPROFILE_CHAT, start);
+	return found;
 } //end of the function BotFindMatch
 //===========================================================================
 //
@@ -2736,17 +3004,14 @@ static void BotPrintReplyChatKeys(bot_replychat_t *replychat)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int BotReplyChat(int chatstate, const char *message, int mcontext, int vcontext, const char *var0, const char *var1, const char *var2, const char *var3, const char *var4, const char *var5, const char *var6, const char *var7)
+static int BotReplyChatState(bot_chatstate_t *cs, const char *message, int mcontext, int vcontext, const char *var0, const char *var1, const char *var2, const char *var3, const char *var4, const char *var5, const char *var6, const char *var7)
 {
 	bot_replychat_t *rchat, *bestrchat;
 	bot_replychatkey_t *key;
 	bot_chatmessage_t *m, *bestchatmessage;
 	bot_match_t match, bestmatch;
 	int bestpriority, num, found, res, numchatmessages, index;
-	bot_chatstate_t *cs;
 
-	cs = BotChatStateFromHandle(chatstate);
-	if (!cs) return qfalse;
 	Com_Memset( &match, 0, sizeof( match ) );
 	Q_strncpyz( match.string, message, sizeof( match.string ) );
 	bestpriority = -1;
@@ -2765,7 +3030,7 @@ int BotReplyChat(int chatstate, const char *message, int mcontext, int vcontext,
 			else if (key->flags & RCKFL_GENDERFEMALE) res = (cs->gender == CHAT_GENDERFEMALE);
 			else if (key->flags & RCKFL_GENDERMALE) res = (cs->gender == CHAT_GENDERMALE);
 			else if (key->flags & RCKFL_GENDERLESS) res = (cs->gender == CHAT_GENDERLESS);
-			else if (key->flags & RCKFL_VARIABLES) res = StringsMatch(key->match, &match);
+			else if (key->flags & RCKFL_VARIABLES) res = StringsMatch(key->match, &match, qfalse);
 			else if (key->flags & RCKFL_STRING) res = (StringContainsWord(message, key->string) != NULL);
 			//if the key must be present
 			if (key->flags & RCKFL_AND)
@@ -2911,6 +3176,27 @@ int BotReplyChat(int chatstate, const char *message, int mcontext, int vcontext,
 		return qtrue;
 	}
 	return qfalse;
+} //end of the function BotReplyChatState
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int BotReplyChat(int chatstate, const char *message, int mcontext, int vcontext, const char *var0, const char *var1, const char *var2, const char *var3, const char *var4, const char *var5, const char *var6, const char *var7)
+{
+	bot_chatstate_t *cs;
+	int64_t start;
+	int res, prevclient;
+
+	cs = BotChatStateFromHandle(chatstate);
+	if (!cs) return qfalse;
+	prevclient = BotProfileClient(cs->client);
+	start = BotProfileBegin(BOTPROFILE_CHAT);
+	res = BotReplyChatState(cs, message, mcontext, vcontext, var0, var1, var2, var3, var4, var5, var6, var7);
+	BotProfileEnd(BOTPROFILE_CHAT, start);
+	BotProfileClient(prevclient);
+	return res;
 } //end of the function BotReplyChat
 //===========================================================================
 //
@@ -3107,6 +3393,7 @@ int BotSetupChatAI(void)
 	randomstrings = BotLoadRandomStrings(file);
 	file = LibVarString("matchfile", "match.c");
 	matchtemplates = BotLoadMatchTemplates(file);
+	BotCompileMatchTemplates(matchtemplates);
 	//
 	if (!LibVarValue("nochat", "0"))
 	{
@@ -3153,6 +3440,7 @@ void BotShutdownChatAI(void)
 	consolemessageheap = NULL;
 	if (matchtemplates) BotFreeMatchTemplates(matchtemplates);
 	matchtemplates = NULL;
+	BotFreeMatchAutomaton();
 	if (randomstrings) FreeMemory(randomstrings);
 	randomstrings = NULL;
 	if (synonyms) FreeMemory(synonyms);
@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  *****************************************************************************/
 
 #include "../qcommon/q_shared.h"
+#include "../qcommon/qcommon.h"
 #include "l_utils.h"
 #include "l_libvar.h"
 #include "l_memory.h"
@@ -184,6 +185,11 @@ static levelitem_t *levelitemheap = NULL;
 static levelitem_t *freelevelitems = NULL;
 static levelitem_t *levelitems = NULL;
 static int numlevelitems = 0;
+//level items considered as goal by a bot, their goal areas and travel times
+static levelitem_t **candidateitems = NULL;
+static float *candidateweights = NULL;
+static int *candidateareas = NULL;
+static int *candidatetimes = NULL;
 //map locations
 static maplocation_t *maplocations = NULL;
 //camp spots
@@ -378,9 +384,16 @@ static void InitLevelItemHeap(void)
 	int i, max_levelitems;
 
 	if (levelitemheap) FreeMemory(levelitemheap);
+	if (candidateitems) FreeMemory(candidateitems);
 
 	max_levelitems = (int) LibVarValue("max_levelitems", "256");
 	levelitemheap = (levelitem_t *) GetClearedMemory(max_levelitems * sizeof(levelitem_t));
+	//one block for all the goal candidate arrays
+	candidateitems = (levelitem_t **) GetMemory(max_levelitems * (sizeof(levelitem_t *) +
+											sizeof(float) + 2 * sizeof(int)));
+	candidateweights = (float *) (candidateitems + max_levelitems);
+	candidateareas = (int *) (candidateweights + max_levelitems);
+	candidatetimes = candidateareas + max_levelitems;
 
 	for (i = 0; i < max_levelitems-1; i++)
 	{
@@ -1185,6 +1198,61 @@ void BotUpdateEntityItems(void)
 	} //end for*/
 } //end of the function BotUpdateEntityItems
 //===========================================================================
+// computes the routing caches towards the level items from the areas the
+// bots are in, so the bots don't stall on cold caches during the frame,
+// continues where the previous call stopped
+//
+// Parameter:			maxusec		: time budget in microseconds
+// Returns:				qtrue when there is more work to do
+// Changes Globals:		-
+//===========================================================================
+int BotWarmGoalRoutes(int maxusec)
+{
+	static int warmclient, warmitem;
+	static int warmedareas[MAX_CLIENTS + 1];
+	bot_goalstate_t *gs;
+	levelitem_t *li;
+	aas_entityinfo_t entinfo;
+	int64_t start;
+	int n, i, areanum;
+
+	if (!AAS_Loaded()) return qfalse;
+	start = Sys_Microseconds();
+	for (n = 0; n < MAX_CLIENTS; n++)
+	{
+		gs = botgoalstates[warmclient + 1];
+		if (gs)
+		{
+			areanum = gs->lastreachabilityarea;
+			if (areanum > 0 && areanum != warmedareas[warmclient + 1])
+			{
+				AAS_EntityInfo(gs->client, &entinfo);
+				//skip the items warmed in the previous slice
+				for (i = 0, li = levelitems; li && i < warmitem; li = li->next, i++) ;
+				for (; li; li = li->next, warmitem++)
+				{
+					if (!li->goalareanum) continue;
+					AAS_AreaTravelTimeToGoalArea(areanum, entinfo.origin, li->goalareanum, TFL_DEFAULT);
+					if (Sys_Microseconds() - start >= maxusec)
+					{
+						warmitem++;
+						return qtrue;
+					} //end if
+				} //end for
+				warmedareas[warmclient + 1] = areanum;
+			} //end if
+		} //end if
+		else
+		{
+			//warm again when a new bot uses the goal state
+			warmedareas[warmclient + 1] = 0;
+		} //end else
+		warmitem = 0;
+		warmclient = (warmclient + 1) % MAX_CLIENTS;
+	} //end for
+	return qfalse;
+} //end of the function BotWarmGoalRoutes
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -1286,48 +1354,20 @@ int BotGetSecondGoal(int goalstate, bot_goal_t *goal)
 	return qtrue;
 } //end of the function BotGetSecondGoal
 //===========================================================================
-// pops a new long term goal on the goal stack in the goalstate
+// collects the level items with a positive weight for the bot
 //
 // Parameter:				-
-// Returns:					-
-// Changes Globals:		-
+// Returns:					number of candidate items
+// Changes Globals:		candidateitems, candidateweights, candidateareas
 //===========================================================================
-int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelflags)
+static int BotItemGoalCandidates(bot_goalstate_t *gs, itemconfig_t *ic, int *inventory)
 {
-	int areanum, t, weightnum;
-	float weight, bestweight, avoidtime;
+	int weightnum, numcandidates;
+	float weight;
 	iteminfo_t *iteminfo;
-	itemconfig_t *ic;
-	levelitem_t *li, *bestitem;
-	bot_goal_t goal;
-	bot_goalstate_t *gs;
+	levelitem_t *li;
 
-	gs = BotGoalStateFromHandle(goalstate);
-	if (!gs)
-		return qfalse;
-	if (!gs->itemweightconfig)
-		return qfalse;
-	//get the area the bot is in
-	areanum = BotReachabilityArea(origin, gs->client);
-	//if the bot is in solid or if the area the bot is in has no reachability links
-	if (!areanum || !AAS_AreaReachability(areanum))
-	{
-		//use the last valid area the bot was in
-		areanum = gs->lastreachabilityarea;
-	} //end if
-	//remember the last area with reachabilities the bot was in
-	gs->lastreachabilityarea = areanum;
-	//if still in solid
-	if (!areanum)
-		return qfalse;
-	//the item configuration
-	ic = itemconfig;
-	if (!itemconfig)
-		return qfalse;
-	//best weight and item so far
-	bestweight = 0;
-	bestitem = NULL;
-	Com_Memset(&goal, 0, sizeof(bot_goal_t));
+	numcandidates = 0;
 	//go through the items in the level
 	for (li = levelitems; li; li = li->next)
 	{
@@ -1372,23 +1412,77 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 		//
 		if (weight > 0)
 		{
-			//get the travel time towards the goal area
-			t = AAS_AreaTravelTimeToGoalArea(areanum, origin, li->goalareanum, travelflags);
-			//if the goal is reachable
-			if (t > 0)
+			candidateitems[numcandidates] = li;
+			candidateweights[numcandidates] = weight;
+			candidateareas[numcandidates] = li->goalareanum;
+			numcandidates++;
+		} //end if
+	} //end for
+	return numcandidates;
+} //end of the function BotItemGoalCandidates
+//===========================================================================
+// pops a new long term goal on the goal stack in the goalstate
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int BotFindLTGItem(int goalstate, bot_goalstate_t *gs, vec3_t origin, int *inventory, int travelflags)
+{
+	int areanum, t, i, numcandidates;
+	float weight, bestweight, avoidtime;
+	iteminfo_t *iteminfo;
+	itemconfig_t *ic;
+	levelitem_t *li, *bestitem;
+	bot_goal_t goal;
+
+	if (!gs->itemweightconfig)
+		return qfalse;
+	//get the area the bot is in
+	areanum = BotReachabilityArea(origin, gs->client);
+	//if the bot is in solid or if the area the bot is in has no reachability links
+	if (!areanum || !AAS_AreaReachability(areanum))
+	{
+		//use the last valid area the bot was in
+		areanum = gs->lastreachabilityarea;
+	} //end if
+	//remember the last area with reachabilities the bot was in
+	gs->lastreachabilityarea = areanum;
+	//if still in solid
+	if (!areanum)
+		return qfalse;
+	//the item configuration
+	ic = itemconfig;
+	if (!itemconfig)
+		return qfalse;
+	//best weight and item so far
+	bestweight = 0;
+	bestitem = NULL;
+	Com_Memset(&goal, 0, sizeof(bot_goal_t));
+	//get the travel times towards all items worth going for at once
+	numcandidates = BotItemGoalCandidates(gs, ic, inventory);
+	AAS_AreaTravelTimesToGoalAreas(areanum, origin, candidateareas, numcandidates, travelflags, candidatetimes);
+	//go through the candidate items
+	for (i = 0; i < numcandidates; i++)
+	{
+		li = candidateitems[i];
+		weight = candidateweights[i];
+		//get the travel time towards the goal area
+		t = candidatetimes[i];
+		//if the goal is reachable
+		if (t > 0)
+		{
+			//if this item won't respawn before we get there
+			avoidtime = BotAvoidGoalTime(goalstate, li->number);
+			if (avoidtime - t * 0.009 > 0)
+				continue;
+			//
+			weight /= (float) t * TRAVELTIME_SCALE;
+			//
+			if (weight > bestweight)
 			{
-				//if this item won't respawn before we get there
-				avoidtime = BotAvoidGoalTime(goalstate, li->number);
-				if (avoidtime - t * 0.009 > 0)
-					continue;
-				//
-				weight /= (float) t * TRAVELTIME_SCALE;
-				//
-				if (weight > bestweight)
-				{
-					bestweight = weight;
-					bestitem = li;
-				} //end if
+				bestweight = weight;
+				bestitem = li;
 			} //end if
 		} //end if
 	} //end for
@@ -1452,6 +1546,28 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 	BotPushGoal(goalstate, &goal);
 	//
 	return qtrue;
+} //end of the function BotFindLTGItem
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelflags)
+{
+	bot_goalstate_t *gs;
+	int64_t start;
+	int result, prevclient;
+
+	gs = BotGoalStateFromHandle(goalstate);
+	if (!gs)
+		return qfalse;
+	prevclient = BotProfileClient(gs->client);
+	start = BotProfileBegin(BOTPROFILE_GOAL);
+	result = BotFindLTGItem(goalstate, gs, origin, inventory, travelflags);
+	BotProfileEnd(BOTPROFILE_GOAL, start);
+	BotProfileClient(prevclient);
+	return result;
 } //end of the function BotChooseLTGItem
 //===========================================================================
 //
@@ -1459,20 +1575,16 @@ int BotChooseLTGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelflags,
+static int BotFindNBGItem(int goalstate, bot_goalstate_t *gs, vec3_t origin, int *inventory, int travelflags,
 														bot_goal_t *ltg, float maxtime)
 {
-	int areanum, t, weightnum, ltg_time;
+	int areanum, t, i, numcandidates, ltg_time;
 	float weight, bestweight, avoidtime;
 	iteminfo_t *iteminfo;
 	itemconfig_t *ic;
 	levelitem_t *li, *bestitem;
 	bot_goal_t goal;
-	bot_goalstate_t *gs;
 
-	gs = BotGoalStateFromHandle(goalstate);
-	if (!gs)
-		return qfalse;
 	if (!gs->itemweightconfig)
 		return qfalse;
 	//get the area the bot is in
@@ -1499,76 +1611,39 @@ int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 	bestweight = 0;
 	bestitem = NULL;
 	Com_Memset(&goal, 0, sizeof(bot_goal_t));
-	//go through the items in the level
-	for (li = levelitems; li; li = li->next)
+	//get the travel times towards all items worth going for at once
+	numcandidates = BotItemGoalCandidates(gs, ic, inventory);
+	AAS_AreaTravelTimesToGoalAreas(areanum, origin, candidateareas, numcandidates, travelflags, candidatetimes);
+	//go through the candidate items
+	for (i = 0; i < numcandidates; i++)
 	{
-		if (g_gametype == GT_SINGLE_PLAYER) {
-			if (li->flags & IFL_NOTSINGLE)
-				continue;
-		}
-		else if (g_gametype >= GT_TEAM) {
-			if (li->flags & IFL_NOTTEAM)
-				continue;
-		}
-		else {
-			if (li->flags & IFL_NOTFREE)
-				continue;
-		}
-		if (li->flags & IFL_NOTBOT)
-			continue;
-		//if the item is in a possible goal area
-		if (!li->goalareanum)
-			continue;
-		//FIXME: is this a good thing? added this for items that never spawned into the game (f.i. CTF flags in obelisk)
-		if (!li->entitynum && !(li->flags & IFL_ROAM))
-			continue;
-		//get the fuzzy weight function for this item
-		iteminfo = &ic->iteminfo[li->iteminfo];
-		weightnum = gs->itemweightindex[iteminfo->number];
-		if (weightnum < 0)
-			continue;
-		//
-#ifdef UNDECIDEDFUZZY
-		weight = FuzzyWeightUndecided(inventory, gs->itemweightconfig, weightnum);
-#else
-		weight = FuzzyWeight(inventory, gs->itemweightconfig, weightnum);
-#endif //UNDECIDEDFUZZY
-#ifdef DROPPEDWEIGHT
-		//HACK: to make dropped items more attractive
-		if (li->timeout)
-			weight += droppedweight->value;
-#endif //DROPPEDWEIGHT
-		//use weight scale for item_botroam
-		if (li->flags & IFL_ROAM) weight *= li->weight;
-		//
-		if (weight > 0)
+		li = candidateitems[i];
+		weight = candidateweights[i];
+		//get the travel time towards the goal area
+		t = candidatetimes[i];
+		//if the goal is reachable
+		if (t > 0 && t < maxtime)
 		{
-			//get the travel time towards the goal area
-			t = AAS_AreaTravelTimeToGoalArea(areanum, origin, li->goalareanum, travelflags);
-			//if the goal is reachable
-			if (t > 0 && t < maxtime)
+			//if this item won't respawn before we get there
+			avoidtime = BotAvoidGoalTime(goalstate, li->number);
+			if (avoidtime - t * 0.009 > 0)
+				continue;
+			//
+			weight /= (float) t * TRAVELTIME_SCALE;
+			//
+			if (weight > bestweight)
 			{
-				//if this item won't respawn before we get there
-				avoidtime = BotAvoidGoalTime(goalstate, li->number);
-				if (avoidtime - t * 0.009 > 0)
-					continue;
-				//
-				weight /= (float) t * TRAVELTIME_SCALE;
-				//
-				if (weight > bestweight)
+				t = 0;
+				if (ltg && !li->timeout)
 				{
-					t = 0;
-					if (ltg && !li->timeout)
-					{
-						//get the travel time from the goal to the long term goal
-						t = AAS_AreaTravelTimeToGoalArea(li->goalareanum, li->goalorigin, ltg->areanum, travelflags);
-					} //end if
-					//if the travel back is possible and doesn't take too long
-					if (t <= ltg_time)
-					{
-						bestweight = weight;
-						bestitem = li;
-					} //end if
+					//get the travel time from the goal to the long term goal
+					t = AAS_AreaTravelTimeToGoalArea(li->goalareanum, li->goalorigin, ltg->areanum, travelflags);
+				} //end if
+				//if the travel back is possible and doesn't take too long
+				if (t <= ltg_time)
+				{
+					bestweight = weight;
+					bestitem = li;
 				} //end if
 			} //end if
 		} //end if
@@ -1609,6 +1684,29 @@ int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelfla
 	BotPushGoal(goalstate, &goal);
 	//
 	return qtrue;
+} //end of the function BotFindNBGItem
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int BotChooseNBGItem(int goalstate, vec3_t origin, int *inventory, int travelflags,
+														bot_goal_t *ltg, float maxtime)
+{
+	bot_goalstate_t *gs;
+	int64_t start;
+	int result, prevclient;
+
+	gs = BotGoalStateFromHandle(goalstate);
+	if (!gs)
+		return qfalse;
+	prevclient = BotProfileClient(gs->client);
+	start = BotProfileBegin(BOTPROFILE_GOAL);
+	result = BotFindNBGItem(goalstate, gs, origin, inventory, travelflags, ltg, maxtime);
+	BotProfileEnd(BOTPROFILE_GOAL, start);
+	BotProfileClient(prevclient);
+	return result;
 } //end of the function BotChooseNBGItem
 //===========================================================================
 //
@@ -1816,6 +1914,11 @@ void BotShutdownGoalAI(void)
 	itemconfig = NULL;
 	if (levelitemheap) FreeMemory(levelitemheap);
 	levelitemheap = NULL;
+	if (candidateitems) FreeMemory(candidateitems);
+	candidateitems = NULL;
+	candidateweights = NULL;
+	candidateareas = NULL;
+	candidatetimes = NULL;
 	freelevelitems = NULL;
 	levelitems = NULL;
 	numlevelitems = 0;
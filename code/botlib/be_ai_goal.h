@@ -98,6 +98,8 @@ void BotSetAvoidGoalTime(int goalstate, int number, float avoidtime);
 void BotInitLevelItems(void);
 //regularly update dynamic entity items (dropped weapons, flags etc.)
 void BotUpdateEntityItems(void);
+//computes routing caches towards the level items from the bot areas
+int BotWarmGoalRoutes(int maxusec);
 //interbreed the goal fuzzy logic
 void BotInterbreedGoalFuzzyLogic(int parent1, int parent2, int child);
 //save the goal fuzzy logic to disk
@@ -3004,25 +3004,14 @@ static bot_moveresult_t BotMoveInGoalArea(bot_movestate_t *ms, bot_goal_t *goal)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-void BotMoveToGoal(bot_moveresult_t *result, int movestate, bot_goal_t *goal, int travelflags)
+static void BotMoveStateToGoal(bot_moveresult_t *result, bot_movestate_t *ms, bot_goal_t *goal, int travelflags)
 {
 	int reachnum, lastreachnum, foundjumppad, ent, resultflags;
 	aas_reachability_t reach, lastreach;
-	bot_movestate_t *ms;
 	//vec3_t mins, maxs, up = {0, 0, 1};
 	//bsp_trace_t trace;
 	//static int debugline;
 
-	result->failure = qfalse;
-	result->type = 0;
-	result->blocked = qfalse;
-	result->blockentity = 0;
-	result->traveltype = 0;
-	result->flags = 0;
-
-	//
-	ms = BotMoveStateFromHandle(movestate);
-	if (!ms) return;
 	//reset the grapple before testing if the bot has a valid goal
 	//because the bot could lose all its goals when stuck to a wall
 	BotResetGrapple(ms);
@@ -3459,6 +3448,34 @@ void BotMoveToGoal(bot_moveresult_t *result, int movestate, bot_goal_t *goal, in
 	if (result->blocked) ms->reachability_time -= 10 * ms->thinktime;
 	//copy the last origin
 	VectorCopy(ms->origin, ms->lastorigin);
+} //end of the function BotMoveStateToGoal
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotMoveToGoal(bot_moveresult_t *result, int movestate, bot_goal_t *goal, int travelflags)
+{
+	bot_movestate_t *ms;
+	int64_t start;
+	int prevclient;
+
+	result->failure = qfalse;
+	result->type = 0;
+	result->blocked = qfalse;
+	result->blockentity = 0;
+	result->traveltype = 0;
+	result->flags = 0;
+
+	//
+	ms = BotMoveStateFromHandle(movestate);
+	if (!ms) return;
+	prevclient = BotProfileClient(ms->client);
+	start = BotProfileBegin(BOTPROFILE_MOVE);
+	BotMoveStateToGoal(result, ms, goal, travelflags);
+	BotProfileEnd(BOTPROFILE_MOVE, start);
+	BotProfileClient(prevclient);
 } //end of the function BotMoveToGoal
 //===========================================================================
 //
@@ -30,6 +30,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  *****************************************************************************/
 
 #include "../qcommon/q_shared.h"
+#include "../qcommon/qcommon.h"
 #include "l_memory.h"
 #include "l_log.h"
 #include "l_libvar.h"
@@ -62,6 +63,19 @@ int botDeveloper;
 //qtrue if the library is setup
 int botlibsetup = qfalse;
 
+//profiles of all clients, the last one is for work not done on behalf of a bot
+static bot_profile_t botprofiles[MAX_CLIENTS + 1];
+static int botprofileclient = MAX_CLIENTS;
+//frame phase profiler scope names
+static const char *botprofilenames[BOTPROFILE_SECTIONS] = {
+	"AAS_UpdateAreaRoutingCache",
+	"AAS_UpdatePortalRoutingCache",
+	"AAS_PredictClientMovement",
+	"BotChooseGoal",
+	"BotMoveToGoal",
+	"BotChat"
+};
+
 //===========================================================================
 //
 // several functions used by the exported functions
@@ -79,6 +93,92 @@ int Sys_MilliSeconds(void)
 	return clock() * 1000 / CLOCKS_PER_SEC;
 } //end of the function Sys_MilliSeconds
 //===========================================================================
+// all bot library calls are serialized, the client stays valid until
+// the export that set it restores the previous one
+//
+// Parameter:				client		: client number or -1
+// Returns:					previous client number or -1
+// Changes Globals:		botprofileclient
+//===========================================================================
+int BotProfileClient(int client)
+{
+	int prev;
+
+	prev = botprofileclient < MAX_CLIENTS ? botprofileclient : -1;
+	if (client < 0 || client >= MAX_CLIENTS) botprofileclient = MAX_CLIENTS;
+	else botprofileclient = client;
+	return prev;
+} //end of the function BotProfileClient
+//===========================================================================
+// must only be used on the main thread or with the bot library locked,
+// job threads are not profiled
+//
+// Parameter:				section		: BOTPROFILE_
+// Returns:					start time of the section
+// Changes Globals:		-
+//===========================================================================
+int64_t BotProfileBegin(int section)
+{
+	Com_TraceBegin(botprofilenames[section]);
+	return Sys_Microseconds();
+} //end of the function BotProfileBegin
+//===========================================================================
+//
+// Parameter:				section		: BOTPROFILE_
+//							start		: value returned by BotProfileBegin
+// Returns:					-
+// Changes Globals:		botprofiles
+//===========================================================================
+void BotProfileEnd(int section, int64_t start)
+{
+	bot_profile_t *profile;
+
+	profile = &botprofiles[botprofileclient];
+	profile->count[section]++;
+	profile->usec[section] += Sys_Microseconds() - start;
+	Com_TraceEnd();
+} //end of the function BotProfileEnd
+//===========================================================================
+//
+// Parameter:				hit		: qtrue if the cache was found
+// Returns:					-
+// Changes Globals:		botprofiles
+//===========================================================================
+void BotProfileCacheAccess(qboolean hit)
+{
+	if (hit) botprofiles[botprofileclient].cachehits++;
+	else botprofiles[botprofileclient].cachemisses++;
+} //end of the function BotProfileCacheAccess
+//===========================================================================
+//
+// Parameter:				client		: client number or -1
+//							profile		: receives the profile
+// Returns:					qfalse if nothing was profiled for the client
+// Changes Globals:		-
+//===========================================================================
+static int Export_BotLibProfile(int client, bot_profile_t *profile)
+{
+	int i;
+
+	if (client < 0 || client >= MAX_CLIENTS) client = MAX_CLIENTS;
+	*profile = botprofiles[client];
+	for (i = 0; i < BOTPROFILE_SECTIONS; i++)
+	{
+		if (profile->count[i]) return qtrue;
+	} //end for
+	return profile->cachehits || profile->cachemisses;
+} //end of the function Export_BotLibProfile
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		botprofiles
+//===========================================================================
+static void Export_BotLibProfileReset(void)
+{
+	Com_Memset(botprofiles, 0, sizeof(botprofiles));
+} //end of the function Export_BotLibProfileReset
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -133,6 +233,10 @@ static int Export_BotLibSetup( void )
 
 	botimport.Print( PRT_MESSAGE, "------- BotLib Initialization -------\n" );
 
+	// profiles are kept per map
+	Export_BotLibProfileReset();
+	BotProfileClient( -1 );
+
 	botlibglobals.maxclients = (int) LibVarValue( "maxclients", "64" );
 	botlibglobals.maxentities = (int) LibVarValue( "maxentities", "1024" );
 
@@ -182,6 +286,8 @@ static int Export_BotLibShutdown(void)
 	LibVarDeAllocAll();
 	//remove all global defines from the pre compiler
 	PC_RemoveAllGlobalDefines();
+	//everything is freed, the next level starts with an empty pool
+	ResetMemoryPool();
 
 	//dump all allocated memory
 //	DumpMemory();
@@ -657,6 +763,8 @@ static void Init_AAS_Export( aas_export_t *aas ) {
 	// be_aas_sample.c
 	//--------------------------------------------
 	aas->AAS_PointAreaNum = AAS_PointAreaNum;
+	aas->AAS_PointAreaNums = AAS_PointAreaNums;
+	aas->AAS_PointAreaNumBench = AAS_PointAreaNumBench;
 	aas->AAS_PointReachabilityAreaIndex = AAS_PointReachabilityAreaIndex;
 	aas->AAS_TraceAreas = AAS_TraceAreas;
 	aas->AAS_BBoxAreas = AAS_BBoxAreas;
@@ -678,6 +786,7 @@ static void Init_AAS_Export( aas_export_t *aas ) {
 	// be_aas_route.c
 	//--------------------------------------------
 	aas->AAS_AreaTravelTimeToGoalArea = AAS_AreaTravelTimeToGoalArea;
+	aas->AAS_AreaTravelTimesToGoalAreas = AAS_AreaTravelTimesToGoalAreas;
 	aas->AAS_EnableRoutingArea = AAS_EnableRoutingArea;
 	aas->AAS_PredictRoute = AAS_PredictRoute;
 	//--------------------------------------------
@@ -689,6 +798,7 @@ static void Init_AAS_Export( aas_export_t *aas ) {
 	//--------------------------------------------
 	aas->AAS_Swimming = AAS_Swimming;
 	aas->AAS_PredictClientMovement = AAS_PredictClientMovement;
+	aas->AAS_PredictClientMovements = AAS_PredictClientMovements;
 }
 
   
@@ -792,6 +902,7 @@ static void Init_AI_Export( ai_export_t *ai ) {
 	ai->BotSetAvoidGoalTime = BotSetAvoidGoalTime;
 	ai->BotInitLevelItems = BotInitLevelItems;
 	ai->BotUpdateEntityItems = BotUpdateEntityItems;
+	ai->BotWarmGoalRoutes = BotWarmGoalRoutes;
 	ai->BotLoadItemWeights = BotLoadItemWeights;
 	ai->BotFreeItemWeights = BotFreeItemWeights;
 	ai->BotInterbreedGoalFuzzyLogic = BotInterbreedGoalFuzzyLogic;
@@ -855,6 +966,9 @@ botlib_export_t *GetBotLibAPI(int apiVersion, botlib_import_t *import) {
 	be_botlib_export.BotLibShutdown = Export_BotLibShutdown;
 	be_botlib_export.BotLibVarSet = Export_BotLibVarSet;
 	be_botlib_export.BotLibVarGet = Export_BotLibVarGet;
+	be_botlib_export.BotLibMemoryStats = MemoryPoolStats;
+	be_botlib_export.BotLibProfile = Export_BotLibProfile;
+	be_botlib_export.BotLibProfileReset = Export_BotLibProfileReset;
 
 	be_botlib_export.PC_AddGlobalDefine = PC_AddGlobalDefine;
 	be_botlib_export.PC_LoadSourceHandle = PC_LoadSourceHandle;
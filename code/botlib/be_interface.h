@@ -54,4 +54,12 @@ extern int botDeveloper;					//true if developer is on
 
 //
 int Sys_MilliSeconds(void);
+//sets the bot work is accounted to, -1 for none, returns the previous one
+int BotProfileClient(int client);
+//opens a profile section, also shown by the frame phase profiler
+int64_t BotProfileBegin(int section);
+//closes a profile section
+void BotProfileEnd(int section, int64_t start);
+//counts a routing cache lookup
+void BotProfileCacheAccess(qboolean hit);
 
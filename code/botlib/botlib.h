@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	BOTLIB_API_VERSION		2
 
 struct aas_clientmove_s;
+struct aas_clientpredict_s;
 struct aas_entityinfo_s;
 struct aas_areainfo_s;
 struct aas_altroutegoal_s;
@@ -166,6 +167,24 @@ typedef struct bot_entitystate_s
 	int		torsoAnim;		// mask off ANIM_TOGGLEBIT
 } bot_entitystate_t;
 
+//bot profile sections
+#define BOTPROFILE_ROUTEAREA	0		// area routing cache updates
+#define BOTPROFILE_ROUTEPORTAL	1		// portal routing cache updates
+#define BOTPROFILE_PREDICT		2		// client movement predictions
+#define BOTPROFILE_GOAL			3		// long term and nearby goal evaluation
+#define BOTPROFILE_MOVE			4		// movement towards a goal
+#define BOTPROFILE_CHAT			5		// chat matching and replies
+#define BOTPROFILE_SECTIONS		6
+
+//work done by the bot library for one bot since the map was loaded
+typedef struct bot_profile_s
+{
+	int		count[BOTPROFILE_SECTIONS];	// number of calls
+	int64_t	usec[BOTPROFILE_SECTIONS];	// time spent, includes nested sections
+	int		cachehits;					// routing cache hits
+	int		cachemisses;				// routing cache misses
+} bot_profile_t;
+
 //bot AI library exported functions
 typedef struct botlib_import_s
 {
@@ -196,6 +215,8 @@ typedef struct botlib_import_s
 	int			(*FS_Write)( const void *buffer, int len, fileHandle_t f );
 	void		(*FS_FCloseFile)( fileHandle_t f );
 	int			(*FS_Seek)( fileHandle_t f, long offset, fsOrigin_t origin );
+	int			(*FS_MapFile)( const char *qpath, void **buffer );
+	void		(*FS_FreeMappedFile)( void *buffer );
 	//debug visualisation stuff
 	int			(*DebugLineCreate)(void);
 	void		(*DebugLineDelete)(int line);
@@ -223,6 +244,8 @@ typedef struct aas_export_s
 	// be_aas_sample.c
 	//--------------------------------------------
 	int			(*AAS_PointAreaNum)(vec3_t point);
+	int			(*AAS_PointAreaNums)(vec3_t *points, int numpoints, int *areanums);
+	void		(*AAS_PointAreaNumBench)(int numpoints);
 	int			(*AAS_PointReachabilityAreaIndex)( vec3_t point );
 	int			(*AAS_TraceAreas)(vec3_t start, vec3_t end, int *areas, vec3_t *points, int maxareas);
 	int			(*AAS_BBoxAreas)(vec3_t absmins, vec3_t absmaxs, int *areas, int maxareas);
@@ -244,6 +267,8 @@ typedef struct aas_export_s
 	// be_aas_route.c
 	//--------------------------------------------
 	int			(*AAS_AreaTravelTimeToGoalArea)(int areanum, vec3_t origin, int goalareanum, int travelflags);
+	int			(*AAS_AreaTravelTimesToGoalAreas)(int areanum, vec3_t origin, int *goalareanums, int numgoals,
+										int travelflags, int *traveltimes);
 	int			(*AAS_EnableRoutingArea)(int areanum, int enable);
 	int			(*AAS_PredictRoute)(struct aas_predictroute_s *route, int areanum, vec3_t origin,
 							int goalareanum, int travelflags, int maxareas, int maxtime,
@@ -258,6 +283,7 @@ typedef struct aas_export_s
 	// be_aas_move.c
 	//--------------------------------------------
 	int			(*AAS_Swimming)(vec3_t origin);
+	int			(*AAS_PredictClientMovements)(struct aas_clientpredict_s *predictions, int numpredictions);
 	int			(*AAS_PredictClientMovement)(struct aas_clientmove_s *move,
 											int entnum, const vec3_t origin,
 											int presencetype, int onground,
@@ -360,6 +386,7 @@ typedef struct ai_export_s
 	void	(*BotSetAvoidGoalTime)(int goalstate, int number, float avoidtime);
 	void	(*BotInitLevelItems)(void);
 	void	(*BotUpdateEntityItems)(void);
+	int		(*BotWarmGoalRoutes)(int maxusec);
 	int		(*BotLoadItemWeights)(int goalstate, const char *filename);
 	void	(*BotFreeItemWeights)(int goalstate);
 	void	(*BotInterbreedGoalFuzzyLogic)(int parent1, int parent2, int child);
@@ -414,6 +441,12 @@ typedef struct botlib_export_s
 	int (*BotLibVarSet)( const char *var_name, const char *value );
 	//gets a library variable returns BLERR_
 	int (*BotLibVarGet)( const char *var_name, char *value, int size );
+	//memory pool statistics
+	void (*BotLibMemoryStats)( int *chunkBytes, int *usedBytes, int *usedBlocks, int *largeBlocks );
+	//profile of a client, -1 for work not done on behalf of a bot, returns qfalse if there is none
+	int (*BotLibProfile)( int client, bot_profile_t *profile );
+	//clears all profiles
+	void (*BotLibProfileReset)( void );
 
 	//sets a C-like define returns BLERR_
 	int (*PC_AddGlobalDefine)(const char *string);
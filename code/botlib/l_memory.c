@@ -37,6 +37,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 //#define MEMDEBUG
 //#define MEMORYMANAGER
+#define MEMORYPOOL
 
 #define MEM_ID		0x12345678l
 #define HUNK_ID		0x87654321l
@@ -331,6 +332,153 @@ void DumpMemory(void)
 
 #else
 
+#ifdef MEMORYPOOL
+//small blocks come from pool chunks split into slots of one size class,
+//freed slots go on the free list of their class instead of back to the zone
+#define POOL_ID				0x5a5a5a00l		//low byte is the size class
+#define POOLFREE_ID			0xa5a5a500l
+#define POOL_CLASS_MASK		0xffl
+#define POOL_CHUNK_SIZE		65536
+#define POOL_CLASSES		16
+
+typedef struct memorychunk_s
+{
+	struct memorychunk_s *next;
+	int cls;
+} memorychunk_t;
+
+static const int poolclasssize[POOL_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+static memorychunk_t *poolchunks;
+static unsigned long int *poolfree[POOL_CLASSES];	//slot headers, linked through the payload
+static int poolchunkbytes;
+static int poolusedbytes;
+static int poolusedslots;
+static int numlargeblocks;
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int PoolSlotSize(int cls)
+{
+	return sizeof(unsigned long int) + poolclasssize[cls];
+} //end of the function PoolSlotSize
+//===========================================================================
+// splits a new chunk into free slots of the given class
+//
+// Parameter:			-
+// Returns:				qfalse when out of memory
+// Changes Globals:		-
+//===========================================================================
+static qboolean PoolAddChunk(int cls)
+{
+	memorychunk_t *chunk;
+	unsigned long int *slot;
+	int slotsize, i, numslots;
+	char *ptr;
+
+	chunk = (memorychunk_t *) botimport.GetMemory(POOL_CHUNK_SIZE);
+	if (!chunk) return qfalse;
+	chunk->cls = cls;
+	chunk->next = poolchunks;
+	poolchunks = chunk;
+	poolchunkbytes += POOL_CHUNK_SIZE;
+	//slots start behind the pointer aligned chunk header
+	slotsize = PoolSlotSize(cls);
+	ptr = (char *) chunk + ((sizeof(memorychunk_t) + 15) & ~15);
+	numslots = (POOL_CHUNK_SIZE - (ptr - (char *) chunk)) / slotsize;
+	for (i = 0; i < numslots; i++, ptr += slotsize)
+	{
+		slot = (unsigned long int *) ptr;
+		*slot = POOLFREE_ID | cls;
+		*(unsigned long int **) (slot + 1) = poolfree[cls];
+		poolfree[cls] = slot;
+	} //end for
+	return qtrue;
+} //end of the function PoolAddChunk
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				NULL if the size is too large for the pool
+// Changes Globals:		-
+//===========================================================================
+static void *PoolAlloc(unsigned long size)
+{
+	unsigned long int *slot;
+	int cls;
+
+	for (cls = 0; cls < POOL_CLASSES; cls++)
+	{
+		if (size <= (unsigned long) poolclasssize[cls]) break;
+	} //end for
+	if (cls >= POOL_CLASSES) return NULL;
+	if (!poolfree[cls] && !PoolAddChunk(cls)) return NULL;
+	slot = poolfree[cls];
+	poolfree[cls] = *(unsigned long int **) (slot + 1);
+	*slot = POOL_ID | cls;
+	poolusedbytes += PoolSlotSize(cls);
+	poolusedslots++;
+	return slot + 1;
+} //end of the function PoolAlloc
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void PoolFree(unsigned long int *slot)
+{
+	int cls;
+
+	cls = *slot & POOL_CLASS_MASK;
+	*slot = POOLFREE_ID | cls;
+	*(unsigned long int **) (slot + 1) = poolfree[cls];
+	poolfree[cls] = slot;
+	poolusedbytes -= PoolSlotSize(cls);
+	poolusedslots--;
+} //end of the function PoolFree
+//===========================================================================
+// releases all pool chunks, called when the bot library shuts down at
+// every level change, leaked blocks keep the chunks alive
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void ResetMemoryPool(void)
+{
+	memorychunk_t *chunk;
+
+	if (poolusedslots) return;
+	while(poolchunks)
+	{
+		chunk = poolchunks;
+		poolchunks = poolchunks->next;
+		botimport.FreeMemory(chunk);
+	} //end while
+	Com_Memset(poolfree, 0, sizeof(poolfree));
+	poolchunkbytes = 0;
+	poolusedbytes = 0;
+} //end of the function ResetMemoryPool
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void MemoryPoolStats(int *chunkbytes, int *usedbytes, int *usedblocks, int *largeblocks)
+{
+	*chunkbytes = poolchunkbytes;
+	*usedbytes = poolusedbytes;
+	*usedblocks = poolusedslots;
+	*largeblocks = numlargeblocks;
+} //end of the function MemoryPoolStats
+#endif //MEMORYPOOL
+
 //===========================================================================
 //
 // Parameter:			-
@@ -346,10 +494,17 @@ void *GetMemory(unsigned long size)
 	void *ptr;
 	unsigned long int *memid;
 
+#ifdef MEMORYPOOL
+	ptr = PoolAlloc(size);
+	if (ptr) return ptr;
+#endif //MEMORYPOOL
 	ptr = botimport.GetMemory(size + sizeof(unsigned long int));
 	if (!ptr) return NULL;
 	memid = (unsigned long int *) ptr;
 	*memid = MEM_ID;
+#ifdef MEMORYPOOL
+	numlargeblocks++;
+#endif //MEMORYPOOL
 	return (unsigned long int *) ((char *) ptr + sizeof(unsigned long int));
 } //end of the function GetMemory
 //===========================================================================
@@ -436,7 +591,20 @@ void FreeMemory(void *ptr)
 	if (*memid == MEM_ID)
 	{
 		botimport.FreeMemory(memid);
+#ifdef MEMORYPOOL
+		numlargeblocks--;
+#endif //MEMORYPOOL
 	} //end if
+#ifdef MEMORYPOOL
+	else if ((*memid & ~POOL_CLASS_MASK) == POOL_ID)
+	{
+		PoolFree(memid);
+	} //end else if
+	else if ((*memid & ~POOL_CLASS_MASK) == POOLFREE_ID)
+	{
+		botimport.Print(PRT_ERROR, "FreeMemory: memory block freed twice\n");
+	} //end else if
+#endif //MEMORYPOOL
 } //end of the function FreeMemory
 //===========================================================================
 //
@@ -468,3 +636,25 @@ void PrintMemoryLabels(void)
 } //end of the function PrintMemoryLabels
 
 #endif
+
+#if defined(MEMORYMANAGER) || !defined(MEMORYPOOL)
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void ResetMemoryPool(void)
+{
+} //end of the function ResetMemoryPool
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void MemoryPoolStats(int *chunkbytes, int *usedbytes, int *usedblocks, int *largeblocks)
+{
+	*chunkbytes = *usedbytes = *usedblocks = *largeblocks = 0;
+} //end of the function MemoryPoolStats
+#endif
@@ -74,3 +74,7 @@ void PrintMemoryLabels(void);
 int MemoryByteSize(void *ptr);
 //free all allocated memory
 void DumpMemory(void);
+//release the memory pool when no pool blocks are in use
+void ResetMemoryPool(void);
+//bytes held by pool chunks, bytes and blocks in use and blocks outside of the pool
+void MemoryPoolStats(int *chunkbytes, int *usedbytes, int *usedblocks, int *largeblocks);
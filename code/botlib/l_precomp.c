@@ -59,6 +59,7 @@ typedef enum {qfalse, qtrue}	qboolean;
 #include "l_memory.h"
 #include "l_script.h"
 #include "l_precomp.h"
+#include "l_libvar.h"
 #include "l_log.h"
 #endif //BOTLIB
 
@@ -108,8 +109,12 @@ typedef struct directive_s
 #define DEFINEHASHSIZE		1024
 
 #define TOKEN_HEAP_SIZE		4096
+//freed tokens kept for reuse, every token holds a MAX_TOKEN string
+#define MAX_FREETOKENS		512
 
 static int numtokens;
+static token_t *freetokens;					//freed tokens for reuse
+static int numfreetokens;
 /*
 int tokenheapinitialized;				//true when the token heap is initialized
 token_t token_heap[TOKEN_HEAP_SIZE];	//heap with tokens
@@ -119,6 +124,40 @@ token_t *freetokens;					//free tokens from the heap
 //list with global defines added to every source loaded
 static define_t *globaldefines;
 
+#ifdef BOTLIB
+//preprocessed tokens of a source file, sources loaded again from the same
+//file read these instead of tokenizing and preprocessing the scripts again
+typedef struct pc_cachedtoken_s
+{
+	int string;								//offset in the string pool
+	int type;
+	int subtype;
+	unsigned long int intvalue;
+	float floatvalue;
+	int line;
+	int linescrossed;
+} pc_cachedtoken_t;
+
+typedef struct pc_cachedsource_s
+{
+	char filename[MAX_QPATH*2];				//base folder and file name
+	pc_cachedtoken_t *tokens;
+	int numtokens;
+	char *strings;							//string pool
+	int stringsize;
+	int size;								//memory used by tokens and strings
+	int refs;								//sources reading the tokens
+	qboolean cached;						//in the cache list
+	struct pc_cachedsource_s *next;
+} pc_cachedsource_t;
+
+static pc_cachedsource_t *sourcecache;		//most recently loaded first
+static int sourcecachesize;
+static char sourcebasefolder[MAX_QPATH];
+
+static void PC_FreeSourceCache(void);
+#endif //BOTLIB
+
 //============================================================================
 //
 // Parameter:				-
@@ -263,9 +302,17 @@ static token_t *PC_CopyToken(token_t *token)
 {
 	token_t *t;
 
-//	t = (token_t *) malloc(sizeof(token_t));
-	t = (token_t *) GetMemory(sizeof(token_t));
-//	t = freetokens;
+	//reuse a freed token before allocating a new one
+	if (freetokens)
+	{
+		t = freetokens;
+		freetokens = freetokens->next;
+		numfreetokens--;
+	} //end if
+	else
+	{
+		t = (token_t *) GetMemory(sizeof(token_t));
+	} //end else
 	if (!t)
 	{
 #ifdef BSPC
@@ -275,8 +322,7 @@ static token_t *PC_CopyToken(token_t *token)
 #endif
 		return NULL;
 	} //end if
-//	freetokens = freetokens->next;
-	Com_Memcpy(t, token, sizeof(token_t));
+	PS_CopyToken(t, token);
 	t->next = NULL;
 	numtokens++;
 	return t;
@@ -289,10 +335,16 @@ static token_t *PC_CopyToken(token_t *token)
 //============================================================================
 static void PC_FreeToken(token_t *token)
 {
-	//free(token);
-	FreeMemory(token);
-//	token->next = freetokens;
-//	freetokens = token;
+	if (numfreetokens < MAX_FREETOKENS)
+	{
+		token->next = freetokens;
+		freetokens = token;
+		numfreetokens++;
+	} //end if
+	else
+	{
+		FreeMemory(token);
+	} //end else
 	numtokens--;
 } //end of the function PC_FreeToken
 //============================================================================
@@ -301,6 +353,24 @@ static void PC_FreeToken(token_t *token)
 // Returns:					-
 // Changes Globals:		-
 //============================================================================
+static void PC_FreeTokenPool(void)
+{
+	token_t *t;
+
+	while(freetokens)
+	{
+		t = freetokens;
+		freetokens = freetokens->next;
+		FreeMemory(t);
+	} //end while
+	numfreetokens = 0;
+} //end of the function PC_FreeTokenPool
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
 static int PC_ReadSourceToken(source_t *source, token_t *token)
 {
 	token_t *t;
@@ -331,7 +401,7 @@ static int PC_ReadSourceToken(source_t *source, token_t *token)
 		FreeScript(script);
 	} //end while
 	//copy the already available token
-	Com_Memcpy(token, source->tokens, sizeof(token_t));
+	PS_CopyToken(token, source->tokens);
 	//free the read token
 	t = source->tokens;
 	source->tokens = source->tokens->next;
@@ -1414,6 +1484,10 @@ int PC_AddGlobalDefine(const char *string)
 	if (!define) return qfalse;
 	define->next = globaldefines;
 	globaldefines = define;
+#ifdef BOTLIB
+	//the global defines are part of every cached source
+	PC_FreeSourceCache();
+#endif //BOTLIB
 	return qtrue;
 } //end of the function PC_AddGlobalDefine
 #if 0
@@ -1453,6 +1527,10 @@ void PC_RemoveAllGlobalDefines(void)
 		globaldefines = globaldefines->next;
 		PC_FreeDefine(define);
 	} //end for
+#ifdef BOTLIB
+	PC_FreeSourceCache();
+#endif //BOTLIB
+	PC_FreeTokenPool();
 } //end of the function PC_RemoveAllGlobalDefines
 //============================================================================
 //
@@ -2714,6 +2792,36 @@ static int QuakeCMacro(source_t *source)
 	return qtrue;
 } //end of the function QuakeCMacro
 #endif //QUAKEC
+#ifdef BOTLIB
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static int PC_ReadCachedToken(source_t *source, token_t *token)
+{
+	const pc_cachedtoken_t *t;
+
+	if (source->cachetoken >= source->cache->numtokens) return qfalse;
+	t = &source->cache->tokens[source->cachetoken++];
+	strcpy(token->string, source->cache->strings + t->string);
+	token->type = t->type;
+	token->subtype = t->subtype;
+	token->intvalue = t->intvalue;
+	token->floatvalue = t->floatvalue;
+	token->whitespace_p = NULL;
+	token->endwhitespace_p = NULL;
+	token->line = t->line;
+	token->linescrossed = t->linescrossed;
+	token->next = NULL;
+	//keep the line up to date for error messages
+	source->scriptstack->line = t->line;
+	//copy token for unreading
+	PS_CopyToken(&source->token, token);
+	return qtrue;
+} //end of the function PC_ReadCachedToken
+#endif //BOTLIB
 //============================================================================
 //
 // Parameter:				-
@@ -2724,6 +2832,13 @@ int PC_ReadToken(source_t *source, token_t *token)
 {
 	define_t *define;
 
+#ifdef BOTLIB
+	//tokens from the cache are already preprocessed
+	if (source->cache && !source->tokens)
+	{
+		return PC_ReadCachedToken(source, token);
+	} //end if
+#endif //BOTLIB
 	while(1)
 	{
 		if (!PC_ReadSourceToken(source, token)) return qfalse;
@@ -2792,7 +2907,7 @@ int PC_ReadToken(source_t *source, token_t *token)
 			} //end if
 		} //end if
 		//copy token for unreading
-		Com_Memcpy(&source->token, token, sizeof(token_t));
+		PS_CopyToken(&source->token, token);
 		//found a token
 		return qtrue;
 	} //end while
@@ -3007,15 +3122,9 @@ void PC_SetPunctuations(source_t *source, punctuation_t *p)
 // Returns:				-
 // Changes Globals:		-
 //============================================================================
-source_t *LoadSourceFile(const char *filename)
+static source_t *PC_LoadSourceScript(const char *filename, script_t *script)
 {
 	source_t *source;
-	script_t *script;
-
-	PC_InitTokenHeap();
-
-	script = LoadScriptFile(filename);
-	if (!script) return NULL;
 
 	script->next = NULL;
 
@@ -3034,6 +3143,196 @@ source_t *LoadSourceFile(const char *filename)
 #endif //DEFINEHASHING
 	PC_AddGlobalDefinesToSource(source);
 	return source;
+} //end of the function PC_LoadSourceScript
+#ifdef BOTLIB
+//============================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//============================================================================
+static void PC_FreeCachedSource(pc_cachedsource_t *cache)
+{
+	FreeMemory(cache->tokens);
+	FreeMemory(cache->strings);
+	FreeMemory(cache);
+} //end of the function PC_FreeCachedSource
+//============================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//============================================================================
+static void PC_ReleaseCachedSource(pc_cachedsource_t *cache)
+{
+	cache->refs--;
+	if (!cache->refs && !cache->cached) PC_FreeCachedSource(cache);
+} //end of the function PC_ReleaseCachedSource
+//============================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//============================================================================
+static void PC_FreeSourceCache(void)
+{
+	pc_cachedsource_t *cache;
+
+	while(sourcecache)
+	{
+		cache = sourcecache;
+		sourcecache = sourcecache->next;
+		cache->cached = qfalse;
+		cache->refs++;
+		PC_ReleaseCachedSource(cache);
+	} //end while
+	sourcecachesize = 0;
+} //end of the function PC_FreeSourceCache
+//============================================================================
+// reads all the preprocessed tokens of the source
+//
+// Parameter:			-
+// Returns:				the tokens, complete is set when the end of the source was reached
+// Changes Globals:		-
+//============================================================================
+static pc_cachedsource_t *PC_ReadSourceTokens(source_t *source, const char *path, qboolean *complete)
+{
+	pc_cachedsource_t *cache;
+	pc_cachedtoken_t *tokens, *t;
+	char *strings;
+	int maxtokens, maxstrings, len;
+	token_t token;
+
+	cache = (pc_cachedsource_t *) GetClearedMemory(sizeof(pc_cachedsource_t));
+	Q_strncpyz(cache->filename, path, sizeof(cache->filename));
+	maxtokens = 1024;
+	cache->tokens = (pc_cachedtoken_t *) GetMemory(maxtokens * sizeof(pc_cachedtoken_t));
+	maxstrings = 8192;
+	cache->strings = (char *) GetMemory(maxstrings);
+	//
+	while(PC_ReadToken(source, &token))
+	{
+		len = strlen(token.string) + 1;
+		if (cache->numtokens >= maxtokens)
+		{
+			tokens = (pc_cachedtoken_t *) GetMemory(maxtokens * 2 * sizeof(pc_cachedtoken_t));
+			Com_Memcpy(tokens, cache->tokens, maxtokens * sizeof(pc_cachedtoken_t));
+			FreeMemory(cache->tokens);
+			cache->tokens = tokens;
+			maxtokens *= 2;
+		} //end if
+		if (cache->stringsize + len > maxstrings)
+		{
+			strings = (char *) GetMemory(maxstrings * 2 + len);
+			Com_Memcpy(strings, cache->strings, cache->stringsize);
+			FreeMemory(cache->strings);
+			cache->strings = strings;
+			maxstrings = maxstrings * 2 + len;
+		} //end if
+		t = &cache->tokens[cache->numtokens++];
+		t->string = cache->stringsize;
+		t->type = token.type;
+		t->subtype = token.subtype;
+		t->intvalue = token.intvalue;
+		t->floatvalue = token.floatvalue;
+		t->line = token.line;
+		t->linescrossed = token.linescrossed;
+		Com_Memcpy(cache->strings + cache->stringsize, token.string, len);
+		cache->stringsize += len;
+	} //end while
+	//an error stops reading before the end of the initial script
+	*complete = !source->tokens && !source->scriptstack->next && EndOfScript(source->scriptstack);
+	cache->size = maxtokens * sizeof(pc_cachedtoken_t) + maxstrings;
+	return cache;
+} //end of the function PC_ReadSourceTokens
+//============================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//============================================================================
+static void PC_AddCachedSource(pc_cachedsource_t *cache)
+{
+	pc_cachedsource_t **prev, *c;
+	int maxsize;
+
+	maxsize = 1024 * (int) LibVarValue("max_sourcecache", "4096");
+	if (cache->size > maxsize) return;
+	//drop the least recently loaded sources until the new one fits
+	while(sourcecachesize + cache->size > maxsize)
+	{
+		for (prev = &sourcecache; (*prev)->next; prev = &(*prev)->next) ;
+		c = *prev;
+		*prev = NULL;
+		sourcecachesize -= c->size;
+		c->cached = qfalse;
+		c->refs++;
+		PC_ReleaseCachedSource(c);
+	} //end while
+	cache->cached = qtrue;
+	cache->next = sourcecache;
+	sourcecache = cache;
+	sourcecachesize += cache->size;
+} //end of the function PC_AddCachedSource
+#endif //BOTLIB
+//============================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//============================================================================
+source_t *LoadSourceFile(const char *filename)
+{
+	script_t *script;
+#ifdef BOTLIB
+	source_t *source;
+	pc_cachedsource_t *cache, **prev;
+	char path[MAX_QPATH*2];
+	qboolean complete;
+#endif //BOTLIB
+
+	PC_InitTokenHeap();
+
+#ifdef BOTLIB
+	//bot_reloadcharacters is set when editing bot files
+	if (LibVarValue("max_sourcecache", "4096") > 0 && !LibVarGetValue("bot_reloadcharacters"))
+	{
+		Com_sprintf(path, sizeof(path), "%s/%s", sourcebasefolder, filename);
+		for (prev = &sourcecache; *prev; prev = &(*prev)->next)
+		{
+			if (!strcmp((*prev)->filename, path)) break;
+		} //end for
+		cache = *prev;
+		if (cache)
+		{
+			//move to the front of the cache
+			*prev = cache->next;
+			cache->next = sourcecache;
+			sourcecache = cache;
+		} //end if
+		else
+		{
+			script = LoadScriptFile(filename);
+			if (!script) return NULL;
+			source = PC_LoadSourceScript(filename, script);
+			cache = PC_ReadSourceTokens(source, path, &complete);
+			FreeSource(source);
+			//a source with errors stops at the same token when read again but isn't kept
+			if (complete) PC_AddCachedSource(cache);
+		} //end else
+		//an empty script only holds the file name and line for messages
+		script = LoadScriptMemory("", 0, filename);
+		source = PC_LoadSourceScript(filename, script);
+		source->cache = cache;
+		source->cachetoken = 0;
+		cache->refs++;
+		return source;
+	} //end if
+#endif //BOTLIB
+
+	script = LoadScriptFile(filename);
+	if (!script) return NULL;
+	return PC_LoadSourceScript(filename, script);
 } //end of the function LoadSourceFile
 #if 0
 //============================================================================
@@ -3129,6 +3428,9 @@ void FreeSource(source_t *source)
 	//
 	if (source->definehash) FreeMemory(source->definehash);
 #endif //DEFINEHASHING
+#ifdef BOTLIB
+	if (source->cache) PC_ReleaseCachedSource(source->cache);
+#endif //BOTLIB
 	//free the source itself
 	FreeMemory(source);
 } //end of the function FreeSource
@@ -3155,7 +3457,7 @@ int PC_LoadSourceHandle(const char *filename)
 	} //end for
 	if (i >= MAX_SOURCEFILES)
 		return 0;
-	PS_SetBaseFolder("");
+	PC_SetBaseFolder("");
 	source = LoadSourceFile(filename);
 	if (!source)
 		return 0;
@@ -3234,6 +3536,9 @@ int PC_SourceFileAndLine(int handle, char *filename, int *line)
 void PC_SetBaseFolder( const char *path )
 {
 	PS_SetBaseFolder( path );
+#ifdef BOTLIB
+	Q_strncpyz( sourcebasefolder, path, sizeof( sourcebasefolder ) );
+#endif //BOTLIB
 } //end of the function PC_SetBaseFolder
 //============================================================================
 //
@@ -104,6 +104,8 @@ typedef struct source_s
 	indent_t *indentstack;					//stack with indents
 	int skip;								// > 0 if skipping conditional code
 	token_t token;							//last read token
+	struct pc_cachedsource_s *cache;		//preprocessed tokens read instead of the scripts
+	int cachetoken;							//next token to read from the cache
 } source_t;
 
 
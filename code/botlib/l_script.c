@@ -166,34 +166,46 @@ static char basefolder[MAX_PATH];
 static char basefolder[MAX_QPATH];
 #endif
 
+//character classes of the lexer
+#define CC_NAMESTART			1		//letters and underscore
+#define CC_DIGIT				2
+#define CC_HEXDIGIT				4
+
+#define CC_NAME					(CC_NAMESTART|CC_DIGIT)
+#define PS_CharClass(c)			(charclasses[(unsigned char) (c)])
+
+static unsigned char charclasses[256];
+#ifdef PUNCTABLE
+//punctuation table shared by all scripts with the default punctuations
+static punctuation_t *default_punctuationtable[256];
+#endif //PUNCTABLE
+static int lexertablesinitialized;
+
 //===========================================================================
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-static void PS_CreatePunctuationTable(script_t *script, punctuation_t *punctuations)
+static void PS_CreatePunctuationTable(punctuation_t **table, punctuation_t *punctuations)
 {
 	int i;
 	punctuation_t *p, *lastp, *newp;
 
-	//get memory for the table
-	if (!script->punctuationtable) script->punctuationtable = (punctuation_t **)
-												GetMemory(256 * sizeof(punctuation_t *));
-	Com_Memset(script->punctuationtable, 0, 256 * sizeof(punctuation_t *));
+	Com_Memset(table, 0, 256 * sizeof(punctuation_t *));
 	//add the punctuations in the list to the punctuation table
 	for (i = 0; punctuations[i].p; i++)
 	{
 		newp = &punctuations[i];
 		lastp = NULL;
 		//sort the punctuations in this table entry on length (longer punctuations first)
-		for (p = script->punctuationtable[(unsigned int) newp->p[0]]; p; p = p->next)
+		for (p = table[(unsigned char) newp->p[0]]; p; p = p->next)
 		{
 			if (strlen(p->p) < strlen(newp->p))
 			{
 				newp->next = p;
 				if (lastp) lastp->next = newp;
-				else script->punctuationtable[(unsigned int) newp->p[0]] = newp;
+				else table[(unsigned char) newp->p[0]] = newp;
 				break;
 			} //end if
 			lastp = p;
@@ -202,11 +214,39 @@ static void PS_CreatePunctuationTable(script_t *script, punctuation_t *punctuati
 		{
 			newp->next = NULL;
 			if (lastp) lastp->next = newp;
-			else script->punctuationtable[(unsigned int) newp->p[0]] = newp;
+			else table[(unsigned char) newp->p[0]] = newp;
 		} //end if
 	} //end for
 } //end of the function PS_CreatePunctuationTable
 //===========================================================================
+// builds the character classes and the default punctuation table once
+// instead of sorting the default punctuations for every loaded script
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void PS_InitLexerTables(void)
+{
+	int c;
+
+	if (lexertablesinitialized) return;
+	for (c = 0; c < 256; c++)
+	{
+		charclasses[c] = 0;
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+			charclasses[c] |= CC_NAMESTART;
+		if (c >= '0' && c <= '9')
+			charclasses[c] |= CC_DIGIT | CC_HEXDIGIT;
+		if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))
+			charclasses[c] |= CC_HEXDIGIT;
+	} //end for
+#ifdef PUNCTABLE
+	PS_CreatePunctuationTable(default_punctuationtable, default_punctuations);
+#endif //PUNCTABLE
+	lexertablesinitialized = qtrue;
+} //end of the function PS_InitLexerTables
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -282,9 +322,21 @@ static void QDECL ScriptWarning(script_t *script, const char *fmt, ...)
 //===========================================================================
 static void SetScriptPunctuations(script_t *script, punctuation_t *p)
 {
+	PS_InitLexerTables();
 #ifdef PUNCTABLE
-	if (p) PS_CreatePunctuationTable(script, p);
-	else  PS_CreatePunctuationTable(script, default_punctuations);
+	if (p)
+	{
+		//get memory for the table
+		if (!script->punctuationtable || script->punctuationtable == default_punctuationtable)
+			script->punctuationtable = (punctuation_t **) GetMemory(256 * sizeof(punctuation_t *));
+		PS_CreatePunctuationTable(script->punctuationtable, p);
+	} //end if
+	else
+	{
+		if (script->punctuationtable && script->punctuationtable != default_punctuationtable)
+			FreeMemory(script->punctuationtable);
+		script->punctuationtable = default_punctuationtable;
+	} //end else
 #endif //PUNCTABLE
 	if (p) script->punctuations = p;
 	else script->punctuations = default_punctuations;
@@ -544,10 +596,7 @@ static int PS_ReadName(script_t *script, token_t *token)
 			return 0;
 		} //end if
 		c = *script->script_p;
-   } while ((c >= 'a' && c <= 'z') ||
-				(c >= 'A' && c <= 'Z') ||
-				(c >= '0' && c <= '9') ||
-				c == '_');
+	} while (PS_CharClass(c) & CC_NAME);
 	token->string[len] = '\0';
 	//the sub type is the length of the name
 	token->subtype = len;
@@ -649,9 +698,7 @@ static int PS_ReadNumber(script_t *script, token_t *token)
 		token->string[len++] = *script->script_p++;
 		c = *script->script_p;
 		//hexadecimal
-		while((c >= '0' && c <= '9') ||
-					(c >= 'a' && c <= 'f') ||
-					(c >= 'A' && c <= 'F'))
+		while(PS_CharClass(c) & CC_HEXDIGIT)
 		{
 			token->string[len++] = *script->script_p++;
 			if (len >= MAX_TOKEN)
@@ -795,7 +842,7 @@ static int PS_ReadPunctuation(script_t *script, token_t *token)
 	punctuation_t *punc;
 
 #ifdef PUNCTABLE
-	for (punc = script->punctuationtable[(unsigned int)*script->script_p]; punc; punc = punc->next)
+	for (punc = script->punctuationtable[(unsigned char)*script->script_p]; punc; punc = punc->next)
 	{
 #else
 	int i;
@@ -805,20 +852,20 @@ static int PS_ReadPunctuation(script_t *script, token_t *token)
 		punc = &script->punctuations[i];
 #endif //PUNCTABLE
 		p = punc->p;
-		len = strlen(p);
-		//if the script contains at least as much characters as the punctuation
-		if (script->script_p + len <= script->end_p)
+		//compare up to the first mismatch instead of measuring every punctuation
+		for (len = 0; p[len] && script->script_p + len < script->end_p; len++)
 		{
-			//if the script contains the punctuation
-			if (!strncmp(script->script_p, p, len))
-			{
-				Q_strncpyz( token->string, p, sizeof( token->string ) );
-				script->script_p += len;
-				token->type = TT_PUNCTUATION;
-				//sub type is the number of the punctuation
-				token->subtype = punc->n;
-				return 1;
-			} //end if
+			if (script->script_p[len] != p[len]) break;
+		} //end for
+		//if the script contains the punctuation
+		if (!p[len])
+		{
+			Com_Memcpy(token->string, p, len + 1);
+			script->script_p += len;
+			token->type = TT_PUNCTUATION;
+			//sub type is the number of the punctuation
+			token->subtype = punc->n;
+			return 1;
 		} //end if
 	} //end for
 	return 0;
@@ -845,11 +892,23 @@ static int PS_ReadPrimitive(script_t *script, token_t *token)
 	} //end while
 	token->string[len] = 0;
 	//copy the token into the script structure
-	Com_Memcpy(&script->token, token, sizeof(token_t));
+	PS_CopyToken(&script->token, token);
 	//primitive reading successful
 	return 1;
 } //end of the function PS_ReadPrimitive
 //============================================================================
+// copies a token without the unused part of the string buffer
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+void PS_CopyToken(token_t *dest, const token_t *src)
+{
+	Com_Memcpy(dest->string, src->string, strlen(src->string) + 1);
+	Com_Memcpy(&dest->type, &src->type, (const char *) (src + 1) - (const char *) &src->type);
+} //end of the function PS_CopyToken
+//============================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -861,15 +920,16 @@ int PS_ReadToken(script_t *script, token_t *token)
 	if (script->tokenavailable)
 	{
 		script->tokenavailable = 0;
-		Com_Memcpy(token, &script->token, sizeof(token_t));
+		PS_CopyToken(token, &script->token);
 		return 1;
 	} //end if
 	//save script pointer
 	script->lastscript_p = script->script_p;
 	//save line counter
 	script->lastline = script->line;
-	//clear the token stuff
-	Com_Memset(token, 0, sizeof(token_t));
+	//clear the token stuff, every reader terminates the string
+	Com_Memset(&token->type, 0, (char *) (token + 1) - (char *) &token->type);
+	token->string[0] = '\0';
 	//start of the white space
 	script->whitespace_p = script->script_p;
 	token->whitespace_p = script->script_p;
@@ -894,9 +954,9 @@ int PS_ReadToken(script_t *script, token_t *token)
 		if (!PS_ReadString(script, token, '\'')) return 0;
 	} //end if
 	//if there is a number
-	else if ((*script->script_p >= '0' && *script->script_p <= '9') ||
+	else if ((PS_CharClass(*script->script_p) & CC_DIGIT) ||
 				(*script->script_p == '.' &&
-				(*(script->script_p + 1) >= '0' && *(script->script_p + 1) <= '9')))
+				(PS_CharClass(*(script->script_p + 1)) & CC_DIGIT)))
 	{
 		if (!PS_ReadNumber(script, token)) return 0;
 	} //end if
@@ -906,9 +966,7 @@ int PS_ReadToken(script_t *script, token_t *token)
 		return PS_ReadPrimitive(script, token);
 	} //end else if
 	//if there is a name
-	else if ((*script->script_p >= 'a' && *script->script_p <= 'z') ||
-		(*script->script_p >= 'A' && *script->script_p <= 'Z') ||
-		*script->script_p == '_')
+	else if (PS_CharClass(*script->script_p) & CC_NAMESTART)
 	{
 		if (!PS_ReadName(script, token)) return 0;
 	} //end if
@@ -919,7 +977,7 @@ int PS_ReadToken(script_t *script, token_t *token)
 		return 0;
 	} //end if
 	//copy the token into the script structure
-	Com_Memcpy(&script->token, token, sizeof(token_t));
+	PS_CopyToken(&script->token, token);
 	//successfully read a token
 	return 1;
 } //end of the function PS_ReadToken
@@ -1450,7 +1508,8 @@ script_t *LoadScriptMemory(const char *ptr, int length, const char *name)
 void FreeScript(script_t *script)
 {
 #ifdef PUNCTABLE
-	if (script->punctuationtable) FreeMemory(script->punctuationtable);
+	if (script->punctuationtable && script->punctuationtable != default_punctuationtable)
+		FreeMemory(script->punctuationtable);
 #endif //PUNCTABLE
 	FreeMemory(script);
 } //end of the function FreeScript
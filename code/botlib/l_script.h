@@ -193,6 +193,8 @@ typedef struct script_s
 
 //read a token from the script
 int PS_ReadToken(script_t *script, token_t *token);
+//copy a token, faster than copying the whole structure
+void PS_CopyToken(token_t *dest, const token_t *src);
 //expect a certain token type
 int PS_ExpectTokenType(script_t *script, int type, int subtype, token_t *token);
 //expect a token
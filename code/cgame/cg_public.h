@@ -182,6 +182,7 @@ typedef enum {
 	CG_R_FORCEFIXEDDLIGHTS,
 	CG_R_ADDLINEARLIGHTTOSCENE,
 	CG_IS_RECORDING_DEMO,
+	CG_R_MARKFRAGMENTSBATCH,
 	CG_TRAP_GETVALUE = COM_TRAP_GETVALUE,
 
 } cgameImport_t;
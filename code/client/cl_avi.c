@@ -71,6 +71,12 @@ typedef struct aviFileData_s
 
 static aviFileData_t afd;
 
+static void CL_StartAVIEncoders( void );
+static void CL_StopAVIEncoders( void );
+static void CL_FinishAVIChunks( void );
+static void CL_QueueAVIChunk( const byte *data, int size, qboolean audio );
+static qboolean CL_AVIEncoding( void );
+
 #define MAX_AVI_BUFFER 2048
 
 static byte buffer[ MAX_AVI_BUFFER ];
@@ -387,6 +393,8 @@ qboolean CL_OpenAVIForWriting( const char *fileName, qboolean pipe, qboolean reo
 		Com_sprintf( cmd, sizeof( cmd ), cmd_fmt, cl_aviPipeFormat->string, ospath, ospath );
 		if ( (afd.f = FS_PipeOpenWrite( cmd, fileName )) == FS_INVALID_HANDLE )
 			return qfalse;
+
+		FS_BufferWrites( afd.f );
 	}
 	else
 	{
@@ -398,6 +406,10 @@ qboolean CL_OpenAVIForWriting( const char *fileName, qboolean pipe, qboolean reo
 			FS_FCloseFile( afd.f );
 			return qfalse;
 		}
+
+		// index records are tiny and interleave with every chunk, buffering
+		// both files would flush the write ring on each switch
+		FS_BufferWrites( afd.f );
 	}
 
 	Q_strncpyz( afd.fileName, fileName, sizeof( afd.fileName ) );
@@ -478,6 +490,11 @@ qboolean CL_OpenAVIForWriting( const char *fileName, qboolean pipe, qboolean reo
 
 	afd.fileOpen = qtrue;
 
+	if ( afd.motionJpeg && !reopen )
+	{
+		CL_StartAVIEncoders();
+	}
+
 	return qtrue;
 }
 
@@ -524,10 +541,10 @@ static qboolean CL_CheckFileSize( int bytesToAdd )
 
 /*
 ===============
-CL_WriteAVIVideoFrame
+CL_WriteAVIVideoChunk
 ===============
 */
-void CL_WriteAVIVideoFrame( const byte *imageBuffer, int size )
+static void CL_WriteAVIVideoChunk( const byte *imageBuffer, int size )
 {
 	unsigned int chunkOffset;
 	int		chunkSize = 8 + size;
@@ -540,6 +557,9 @@ void CL_WriteAVIVideoFrame( const byte *imageBuffer, int size )
 	// Chunk header + contents + padding
 	CL_CheckFileSize( chunkSize + paddingSize );
 
+	if ( !afd.fileOpen )
+		return;
+
 	chunkOffset = afd.fileSize - afd.moviOffset - 8;
 
 	bufIndex = 0;
@@ -573,6 +593,37 @@ void CL_WriteAVIVideoFrame( const byte *imageBuffer, int size )
 }
 
 
+/*
+===============
+CL_WriteAVIVideoFrame
+
+Motion JPEG frames come uncompressed, as bottom-up RGB rows without padding
+===============
+*/
+void CL_WriteAVIVideoFrame( const byte *imageBuffer, int size )
+{
+	if ( !afd.fileOpen )
+		return;
+
+	if ( !afd.motionJpeg )
+	{
+		CL_WriteAVIVideoChunk( imageBuffer, size );
+		return;
+	}
+
+	if ( CL_AVIEncoding() )
+	{
+		CL_QueueAVIChunk( imageBuffer, size, qfalse );
+		return;
+	}
+
+	// the renderer is done with the capture buffer
+	size = CL_SaveJPGToBuffer( afd.cBuffer, afd.width * 3 * afd.height, cl_aviMotionJpegQuality->integer,
+		afd.width, afd.height, (byte *)imageBuffer, 0 );
+	CL_WriteAVIVideoChunk( afd.cBuffer, size );
+}
+
+
 #define PCM_BUFFER_SIZE 44100
 
 static byte pcmCaptureBuffer[ PCM_BUFFER_SIZE ];
@@ -580,25 +631,25 @@ static int  bytesInBuffer = 0;
 
 /*
 ===============
-CL_FlushAudioBuffer
+CL_WriteAVIAudioChunk
 ===============
 */
-static void CL_FlushCaptureBuffer( void ) 
+static void CL_WriteAVIAudioChunk( const byte *pcmBuffer, int size )
 {
 	unsigned int chunkOffset = afd.fileSize - afd.moviOffset - 8;
-	int   chunkSize = 8 + bytesInBuffer;
-	int   paddingSize = PADLEN( bytesInBuffer, 2 );
+	int   chunkSize = 8 + size;
+	int   paddingSize = PADLEN( size, 2 );
 	byte  padding[ 4 ] = { 0 };
 
-	if ( !bytesInBuffer )
+	if ( !afd.fileOpen )
 		return;
 
 	bufIndex = 0;
 	WRITE_STRING( "01wb" );
-	WRITE_4BYTES( bytesInBuffer );
+	WRITE_4BYTES( size );
 
 	SafeFS_Write( buffer, 8, afd.f );
-	SafeFS_Write( pcmCaptureBuffer, bytesInBuffer, afd.f );
+	SafeFS_Write( pcmBuffer, size, afd.f );
 	SafeFS_Write( padding, paddingSize, afd.f );
 
 	afd.numAudioFrames++;
@@ -607,21 +658,366 @@ static void CL_FlushCaptureBuffer( void )
 	{
 		afd.fileSize += ( chunkSize + paddingSize );
 		afd.moviSize += ( chunkSize + paddingSize );
-		afd.a.totalBytes += bytesInBuffer;
+		afd.a.totalBytes += size;
 		// Index
 		bufIndex = 0;
 		WRITE_STRING( "01wb" );           //dwIdentifier
 		WRITE_4BYTES( 0 );                //dwFlags
 		WRITE_4BYTES( chunkOffset );      //dwOffset
-		WRITE_4BYTES( bytesInBuffer );    //dwLength
+		WRITE_4BYTES( size );             //dwLength
 		SafeFS_Write( buffer, 16, afd.idxF );
 		afd.numIndices++;
 	}
+}
+
+
+/*
+===============
+CL_FlushAudioBuffer
+===============
+*/
+static void CL_FlushCaptureBuffer( void ) 
+{
+	if ( !bytesInBuffer )
+		return;
+
+	// keep audio behind the frames that are still being compressed
+	if ( CL_AVIEncoding() )
+		CL_QueueAVIChunk( pcmCaptureBuffer, bytesInBuffer, qtrue );
+	else
+		CL_WriteAVIAudioChunk( pcmCaptureBuffer, bytesInBuffer );
 
 	bytesInBuffer = 0;
 }
 
 
+/*
+==============================================================================
+
+ENCODING THREADS
+
+With cl_aviEncoders set, motion JPEG frames are queued uncompressed and
+compressed by a pool of threads. Chunks are written in capture order
+whenever a new one is queued, and audio goes through the same queue so
+the interleaving stays the same. A full queue blocks the caller until
+its oldest frame is written. The file writes themselves are done by
+the filesystem write thread.
+
+==============================================================================
+*/
+
+#define AVI_MAX_ENCODERS	8
+
+typedef enum {
+	CHUNK_FREE,
+	CHUNK_QUEUED,		// waiting for an encoder
+	CHUNK_ENCODING,
+	CHUNK_DONE			// ready to be written
+} aviChunkState_t;
+
+typedef struct {
+	aviChunkState_t	state;		// protected by aviEnc.lock
+	qboolean	audio;
+	byte		*data;			// uncompressed frame or pcm
+	byte		*encoded;
+	int			size;
+	int			encodedSize;
+} aviChunk_t;
+
+typedef struct {
+	void		*threads[ AVI_MAX_ENCODERS ];
+	int			numThreads;
+	void		*lock;			// protects chunk states, tail and quit
+	void		*queueLock;		// frames may be queued from the render thread
+	void		*wake;			// posted once per queued frame
+	void		*done;			// posted once per compressed frame
+	qboolean	quit;
+
+	aviChunk_t	chunks[ AVI_MAX_ENCODERS + 2 ];
+	int			numChunks;
+	int			head;			// next chunk to fill
+	int			tail;			// next chunk to write
+	int			queued;
+
+	int			width, height;
+	int			quality;
+	int			frameSize;		// bytes of an uncompressed frame
+	int			dataSize;
+} aviEncoder_t;
+
+static aviEncoder_t aviEnc;
+
+
+/*
+===============
+CL_AVIEncoderThread
+===============
+*/
+static void CL_AVIEncoderThread( void *arg )
+{
+	aviChunk_t *c;
+	int i;
+
+	for ( ;; )
+	{
+		Sys_WaitSemaphore( aviEnc.wake );
+
+		Sys_LockMutex( aviEnc.lock );
+		if ( aviEnc.quit )
+		{
+			Sys_UnlockMutex( aviEnc.lock );
+			break;
+		}
+		// oldest frames first
+		c = NULL;
+		for ( i = 0; i < aviEnc.numChunks; i++ )
+		{
+			c = &aviEnc.chunks[ ( aviEnc.tail + i ) % aviEnc.numChunks ];
+			if ( c->state == CHUNK_QUEUED )
+			{
+				c->state = CHUNK_ENCODING;
+				break;
+			}
+			c = NULL;
+		}
+		Sys_UnlockMutex( aviEnc.lock );
+
+		if ( !c )
+			continue;
+
+		c->encodedSize = CL_SaveJPGToBuffer( c->encoded, aviEnc.frameSize, aviEnc.quality,
+			aviEnc.width, aviEnc.height, c->data, 0 );
+
+		Sys_LockMutex( aviEnc.lock );
+		c->state = CHUNK_DONE;
+		Sys_UnlockMutex( aviEnc.lock );
+
+		Sys_PostSemaphore( aviEnc.done, 1 );
+	}
+}
+
+
+/*
+===============
+CL_AVIEncoding
+===============
+*/
+static qboolean CL_AVIEncoding( void )
+{
+	return aviEnc.numThreads ? qtrue : qfalse;
+}
+
+
+/*
+===============
+CL_WriteAVIChunks
+
+Writes finished chunks in order, waits for all of them if wait is set
+===============
+*/
+static void CL_WriteAVIChunks( qboolean wait )
+{
+	aviChunkState_t state;
+	aviChunk_t *c;
+
+	while ( aviEnc.queued )
+	{
+		c = &aviEnc.chunks[ aviEnc.tail ];
+
+		Sys_LockMutex( aviEnc.lock );
+		state = c->state;
+		Sys_UnlockMutex( aviEnc.lock );
+
+		if ( state != CHUNK_DONE )
+		{
+			if ( !wait )
+				break;
+			Sys_WaitSemaphore( aviEnc.done );
+			continue;
+		}
+
+		if ( c->audio )
+		{
+			CL_CheckFileSize( 8 + c->size + 2 );
+			CL_WriteAVIAudioChunk( c->data, c->size );
+		}
+		else
+		{
+			CL_WriteAVIVideoChunk( c->encoded, c->encodedSize );
+		}
+
+		Sys_LockMutex( aviEnc.lock );
+		c->state = CHUNK_FREE;
+		aviEnc.tail = ( aviEnc.tail + 1 ) % aviEnc.numChunks;
+		Sys_UnlockMutex( aviEnc.lock );
+
+		aviEnc.queued--;
+	}
+}
+
+
+/*
+===============
+CL_QueueAVIChunk
+===============
+*/
+static void CL_QueueAVIChunk( const byte *data, int size, qboolean audio )
+{
+	aviChunk_t *c;
+
+	if ( size > ( audio ? aviEnc.dataSize : aviEnc.frameSize ) )
+		return;
+
+	Sys_LockMutex( aviEnc.queueLock );
+
+	CL_WriteAVIChunks( qfalse );
+
+	// the oldest chunk is still being compressed
+	while ( aviEnc.queued == aviEnc.numChunks )
+	{
+		Sys_WaitSemaphore( aviEnc.done );
+		CL_WriteAVIChunks( qfalse );
+	}
+
+	c = &aviEnc.chunks[ aviEnc.head ];
+	Com_Memcpy( c->data, data, size );
+	c->size = size;
+	c->audio = audio;
+	aviEnc.head = ( aviEnc.head + 1 ) % aviEnc.numChunks;
+	aviEnc.queued++;
+
+	Sys_LockMutex( aviEnc.lock );
+	c->state = audio ? CHUNK_DONE : CHUNK_QUEUED;
+	Sys_UnlockMutex( aviEnc.lock );
+
+	if ( !audio )
+		Sys_PostSemaphore( aviEnc.wake, 1 );
+
+	Sys_UnlockMutex( aviEnc.queueLock );
+}
+
+
+/*
+===============
+CL_FinishAVIChunks
+===============
+*/
+static void CL_FinishAVIChunks( void )
+{
+	if ( !CL_AVIEncoding() )
+		return;
+
+	Sys_LockMutex( aviEnc.queueLock );
+	CL_WriteAVIChunks( qtrue );
+	Sys_UnlockMutex( aviEnc.queueLock );
+}
+
+
+/*
+===============
+CL_StopAVIEncoders
+
+Queued chunks are dropped, see CL_FinishAVIChunks
+===============
+*/
+static void CL_StopAVIEncoders( void )
+{
+	int i;
+
+	if ( aviEnc.numThreads )
+	{
+		Sys_LockMutex( aviEnc.lock );
+		aviEnc.quit = qtrue;
+		Sys_UnlockMutex( aviEnc.lock );
+		Sys_PostSemaphore( aviEnc.wake, aviEnc.numThreads );
+		for ( i = 0; i < aviEnc.numThreads; i++ )
+			Com_JoinThread( aviEnc.threads[ i ] );
+	}
+
+	// too large for the zone at high resolutions
+	for ( i = 0; i < ARRAY_LEN( aviEnc.chunks ); i++ )
+	{
+		free( aviEnc.chunks[ i ].data );
+		free( aviEnc.chunks[ i ].encoded );
+	}
+
+	Sys_DestroySemaphore( aviEnc.done );
+	Sys_DestroySemaphore( aviEnc.wake );
+	Sys_DestroyMutex( aviEnc.queueLock );
+	Sys_DestroyMutex( aviEnc.lock );
+
+	Com_Memset( &aviEnc, 0, sizeof( aviEnc ) );
+}
+
+
+/*
+===============
+CL_StartAVIEncoders
+
+Frames are compressed synchronously if threads can't be started
+===============
+*/
+static void CL_StartAVIEncoders( void )
+{
+	aviChunk_t *c;
+	int i, count;
+
+	// left over from a capture that failed to switch files
+	CL_StopAVIEncoders();
+
+	count = cl_aviEncoders->integer;
+	if ( count <= 0 )
+		return;
+	if ( count > AVI_MAX_ENCODERS )
+		count = AVI_MAX_ENCODERS;
+
+	aviEnc.width = afd.width;
+	aviEnc.height = afd.height;
+	aviEnc.quality = cl_aviMotionJpegQuality->integer;
+	aviEnc.frameSize = afd.width * 3 * afd.height;
+	aviEnc.dataSize = MAX( aviEnc.frameSize, PCM_BUFFER_SIZE );
+	aviEnc.numChunks = count + 2;
+
+	aviEnc.lock = Sys_CreateMutex();
+	aviEnc.queueLock = Sys_CreateMutex();
+	aviEnc.wake = Sys_CreateSemaphore();
+	aviEnc.done = Sys_CreateSemaphore();
+	if ( !aviEnc.lock || !aviEnc.queueLock || !aviEnc.wake || !aviEnc.done )
+	{
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create video encoder synchronization objects\n" );
+		CL_StopAVIEncoders();
+		return;
+	}
+
+	for ( i = 0; i < aviEnc.numChunks; i++ )
+	{
+		c = &aviEnc.chunks[ i ];
+		c->data = malloc( aviEnc.dataSize );
+		c->encoded = malloc( aviEnc.frameSize );
+		if ( !c->data || !c->encoded )
+		{
+			Com_Printf( S_COLOR_YELLOW "WARNING: not enough memory for video encoder threads\n" );
+			CL_StopAVIEncoders();
+			return;
+		}
+	}
+
+	while ( aviEnc.numThreads < count )
+	{
+		aviEnc.threads[ aviEnc.numThreads ] = Com_CreateThread( JOB_POOL_IO, "avi encoder", CL_AVIEncoderThread, NULL );
+		if ( !aviEnc.threads[ aviEnc.numThreads ] )
+			break;
+		aviEnc.numThreads++;
+	}
+
+	if ( !aviEnc.numThreads )
+	{
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create video encoder threads\n" );
+		CL_StopAVIEncoders();
+	}
+}
+
+
 /*
 ===============
 CL_WriteAVIAudioFrame
@@ -635,8 +1031,9 @@ void CL_WriteAVIAudioFrame( const byte *pcmBuffer, int size )
 	if ( !afd.fileOpen )
 		return;
 
-	// Chunk header + contents + padding
-	CL_CheckFileSize( 8 + bytesInBuffer + size + 2 );
+	// Chunk header + contents + padding, checked when queued chunks are written
+	if ( !CL_AVIEncoding() )
+		CL_CheckFileSize( 8 + bytesInBuffer + size + 2 );
 
 	if ( bytesInBuffer + size > PCM_BUFFER_SIZE )
 	{
@@ -693,13 +1090,19 @@ qboolean CL_CloseAVI( qboolean reopen )
 		return qfalse;
 	}
 
-	CL_FlushCaptureBuffer();
-
+	// queued chunks continue in the next file when reopening
 	if ( !reopen )
 	{
+		CL_FlushCaptureBuffer();
+		CL_FinishAVIChunks();
+		CL_StopAVIEncoders();
 		Z_Free( afd.cBuffer );
 		Z_Free( afd.eBuffer );
 	}
+	else if ( !CL_AVIEncoding() )
+	{
+		CL_FlushCaptureBuffer();
+	}
 
 	if ( afd.pipe )
 	{
@@ -357,6 +357,27 @@ rescan:
 }
 
 
+/*
+====================
+CL_SkipServerCommands
+
+Runs the client side of the commands the cgame did not get to yet,
+so configstrings stay current while demo seeking skips frames.
+A disconnect is left for the cgame to end the demo with.
+====================
+*/
+void CL_SkipServerCommands( void ) {
+	int i;
+
+	for ( i = clc.lastExecutedServerCommand + 1; clc.serverCommandSequence - i >= 0; i++ ) {
+		if ( !Q_strncmp( clc.serverCommands[ i & ( MAX_RELIABLE_COMMANDS - 1 ) ], "disconnect", 10 ) ) {
+			break;
+		}
+		CL_GetServerCommand( i );
+	}
+}
+
+
 /*
 ====================
 CL_CM_LoadMap
@@ -367,10 +388,178 @@ Just adds default parameters that cgame doesn't need to know about
 static void CL_CM_LoadMap( const char *mapname ) {
 	int		checksum;
 
+	CL_ClearTraceCache();
+
 	CM_LoadMap( mapname, qtrue, &checksum );
 }
 
 
+/*
+=============================================================================
+
+PREDICTION TRACE CACHE
+
+Prediction replays every unacknowledged usercmd each frame, so the same
+traces reach the collision code over and over. Results are remembered by
+their complete input, including bounds of the temporary box model when
+one is traced against, so a hit always returns what CM would compute.
+
+=============================================================================
+*/
+
+#define TRACE_CACHE_SIZE	1024	// power of 2
+
+#define TRACE_CAPSULE		1
+#define TRACE_TRANSFORMED	2
+
+typedef struct {
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	vec3_t	origin, angles;
+	vec3_t	boxMins, boxMaxs;		// last temp box or capsule
+	vec3_t	planeMins, planeMaxs;	// last temp box, its planes stay for capsules
+	int		model;
+	int		brushmask;
+	int		flags;
+} traceKey_t;
+
+typedef struct {
+	traceKey_t	key;
+	trace_t		trace;
+	qboolean	valid;
+} cachedTrace_t;
+
+static cachedTrace_t	traceCache[ TRACE_CACHE_SIZE ];
+
+static struct {
+	vec3_t	mins, maxs;
+	vec3_t	planeMins, planeMaxs;
+} traceBox;
+
+static int traceCacheHits;
+static int traceCacheMisses;
+
+
+/*
+====================
+CL_ClearTraceCache
+====================
+*/
+void CL_ClearTraceCache( void ) {
+	Com_Memset( traceCache, 0, sizeof( traceCache ) );
+	Com_Memset( &traceBox, 0, sizeof( traceBox ) );
+}
+
+
+/*
+====================
+CL_TraceCacheStats_f
+====================
+*/
+void CL_TraceCacheStats_f( void ) {
+	int total;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		traceCacheHits = traceCacheMisses = 0;
+		return;
+	}
+
+	total = traceCacheHits + traceCacheMisses;
+	Com_Printf( "trace cache: %s\n", cl_traceCache->integer ? "enabled" : "disabled" );
+	Com_Printf( "%i cgame traces, %i answered from cache (%.1f%%)\n", total, traceCacheHits,
+		total ? traceCacheHits * 100.0 / total : 0.0 );
+}
+
+
+/*
+====================
+CL_TempBoxModel
+====================
+*/
+static clipHandle_t CL_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	VectorCopy( mins, traceBox.mins );
+	VectorCopy( maxs, traceBox.maxs );
+	if ( !capsule ) {
+		VectorCopy( mins, traceBox.planeMins );
+		VectorCopy( maxs, traceBox.planeMaxs );
+	}
+
+	return CM_TempBoxModel( mins, maxs, capsule );
+}
+
+
+/*
+====================
+CL_CM_Trace
+====================
+*/
+static void CL_CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+	clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles, int flags ) {
+	cachedTrace_t *ct;
+	traceKey_t key;
+	unsigned hash;
+	const int *w;
+	int i;
+
+	if ( !cl_traceCache->integer ) {
+		if ( flags & TRACE_TRANSFORMED ) {
+			CM_TransformedBoxTrace( results, start, end, mins, maxs, model, brushmask, origin, angles, flags & TRACE_CAPSULE );
+		} else {
+			CM_BoxTrace( results, start, end, mins, maxs, model, brushmask, flags & TRACE_CAPSULE );
+		}
+		return;
+	}
+
+	Com_Memset( &key, 0, sizeof( key ) );
+	VectorCopy( start, key.start );
+	VectorCopy( end, key.end );
+	if ( mins ) {
+		VectorCopy( mins, key.mins );
+	}
+	if ( maxs ) {
+		VectorCopy( maxs, key.maxs );
+	}
+	if ( flags & TRACE_TRANSFORMED ) {
+		VectorCopy( origin, key.origin );
+		VectorCopy( angles, key.angles );
+	}
+	if ( model >= CM_NumInlineModels() ) {
+		VectorCopy( traceBox.mins, key.boxMins );
+		VectorCopy( traceBox.maxs, key.boxMaxs );
+		VectorCopy( traceBox.planeMins, key.planeMins );
+		VectorCopy( traceBox.planeMaxs, key.planeMaxs );
+	}
+	key.model = model;
+	key.brushmask = brushmask;
+	key.flags = flags;
+
+	// FNV-1a over the key words
+	hash = 2166136261U;
+	w = (const int *)&key;
+	for ( i = 0; i < (int)( sizeof( key ) / sizeof( int ) ); i++ ) {
+		hash = ( hash ^ (unsigned)w[i] ) * 16777619U;
+	}
+
+	ct = &traceCache[ hash & ( TRACE_CACHE_SIZE - 1 ) ];
+	if ( ct->valid && !memcmp( &ct->key, &key, sizeof( key ) ) ) {
+		*results = ct->trace;
+		traceCacheHits++;
+		return;
+	}
+
+	if ( flags & TRACE_TRANSFORMED ) {
+		CM_TransformedBoxTrace( results, start, end, mins, maxs, model, brushmask, origin, angles, flags & TRACE_CAPSULE );
+	} else {
+		CM_BoxTrace( results, start, end, mins, maxs, model, brushmask, flags & TRACE_CAPSULE );
+	}
+
+	ct->key = key;
+	ct->trace = *results;
+	ct->valid = qtrue;
+	traceCacheMisses++;
+}
+
+
 /*
 ====================
 CL_ShutdonwCGame
@@ -382,6 +571,8 @@ void CL_ShutdownCGame( void ) {
 	Key_SetCatcher( Key_GetCatcher( ) & ~KEYCATCH_CGAME );
 	cls.cgameStarted = qfalse;
 
+	CL_ClearTraceCache();
+
 	if ( !cgvm ) {
 		return;
 	}
@@ -436,6 +627,11 @@ static qboolean CL_GetValue( char* value, int valueSize, const char* key ) {
 		return qtrue;
 	}
 
+	if ( !Q_stricmp( key, "trap_R_MarkFragmentsBatch" ) ) {
+		Com_sprintf( value, valueSize, "%i", CG_R_MARKFRAGMENTSBATCH );
+		return qtrue;
+	}
+
 	return qfalse;
 }
 
@@ -537,24 +733,24 @@ static intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 	case CG_CM_INLINEMODEL:
 		return CM_InlineModel( args[1] );
 	case CG_CM_TEMPBOXMODEL:
-		return CM_TempBoxModel( VMA(1), VMA(2), /*int capsule*/ qfalse );
+		return CL_TempBoxModel( VMA(1), VMA(2), /*int capsule*/ qfalse );
 	case CG_CM_TEMPCAPSULEMODEL:
-		return CM_TempBoxModel( VMA(1), VMA(2), /*int capsule*/ qtrue );
+		return CL_TempBoxModel( VMA(1), VMA(2), /*int capsule*/ qtrue );
 	case CG_CM_POINTCONTENTS:
 		return CM_PointContents( VMA(1), args[2] );
 	case CG_CM_TRANSFORMEDPOINTCONTENTS:
 		return CM_TransformedPointContents( VMA(1), args[2], VMA(3), VMA(4) );
 	case CG_CM_BOXTRACE:
-		CM_BoxTrace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qfalse );
+		CL_CM_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], NULL, NULL, 0 );
 		return 0;
 	case CG_CM_CAPSULETRACE:
-		CM_BoxTrace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
+		CL_CM_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], NULL, NULL, TRACE_CAPSULE );
 		return 0;
 	case CG_CM_TRANSFORMEDBOXTRACE:
-		CM_TransformedBoxTrace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], VMA(8), VMA(9), /*int capsule*/ qfalse );
+		CL_CM_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], VMA(8), VMA(9), TRACE_TRANSFORMED );
 		return 0;
 	case CG_CM_TRANSFORMEDCAPSULETRACE:
-		CM_TransformedBoxTrace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], VMA(8), VMA(9), /*int capsule*/ qtrue );
+		CL_CM_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], VMA(8), VMA(9), TRACE_TRANSFORMED | TRACE_CAPSULE );
 		return 0;
 	case CG_CM_MARKFRAGMENTS:
 		return re.MarkFragments( args[1], VMA(2), VMA(3), args[4], VMA(5), args[6], VMA(7) );
@@ -779,6 +975,12 @@ static intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 	case CG_IS_RECORDING_DEMO:
 		return clc.demorecording;
 
+	case CG_R_MARKFRAGMENTSBATCH:
+		VM_CHECKBOUNDS( cgvm, args[2], args[1] * sizeof( markRequest_t ) );
+		VM_CHECKBOUNDS( cgvm, args[4], args[3] * sizeof( vec3_t ) );
+		VM_CHECKBOUNDS( cgvm, args[6], args[5] * sizeof( markFragment_t ) );
+		return re.MarkFragmentsBatch( args[1], VMA(2), args[3], VMA(4), args[5], VMA(6) );
+
 	case CG_TRAP_GETVALUE:
 		VM_CHECKBOUNDS( cgvm, args[1], args[2] );
 		return CL_GetValue( VMA(1), args[2], VMA(3) );
@@ -839,6 +1041,8 @@ void CL_InitCGame( void ) {
 	mapname = Info_ValueForKey( info, "mapname" );
 	Com_sprintf( cl.mapname, sizeof( cl.mapname ), "maps/%s.bsp", mapname );
 
+	FS_ProfileBegin( mapname );
+
 	// allow vertex lighting for in-game elements
 	re.VertexLighting( qtrue );
 
@@ -878,6 +1082,8 @@ void CL_InitCGame( void ) {
 	// on the card even if the driver does deferred loading
 	re.EndRegistration();
 
+	FS_ProfileEnd();
+
 	// make sure everything is paged in
 	if (!Sys_LowPhysicalMemory()) {
 		Com_TouchMemory();
@@ -920,7 +1126,9 @@ CL_CGameRendering
 =====================
 */
 void CL_CGameRendering( stereoFrame_t stereo ) {
+	Com_TraceBegin( "CL_CGameRendering" );
 	VM_Call( cgvm, 3, CG_DRAW_ACTIVE_FRAME, cl.serverTime, stereo, clc.demoplaying );
+	Com_TraceEnd();
 #ifdef DEBUG
 	VM_Debug( 0 );
 #endif
@@ -949,6 +1157,92 @@ or bursted delayed packets.
 
 #define	RESET_TIME	500
 
+/*
+=================
+CL_MeasureSnapshot
+
+Updates the snapshot arrival statistics of the jitter buffer,
+called for every valid snapshot right before it replaces cl.snap.
+
+Jitter is the smoothed difference between the wall clock and the server
+time that passed between two snapshots. Dropped snapshots don't show up
+there, they widen the server time step instead and are kept as a peak
+that decays slowly so the buffer stays deep for a while after a burst.
+=================
+*/
+void CL_MeasureSnapshot( const clSnapshot_t *newSnap ) {
+	int		step, arrival;
+	float	d, gap;
+
+	if ( clc.demoplaying ) {
+		return;
+	}
+
+	arrival = cl.snapArrivalTime;
+	cl.snapArrivalTime = cls.realtime;
+
+	if ( !cl.snap.valid || !arrival ) {
+		return;
+	}
+
+	step = newSnap->serverTime - cl.snap.serverTime;
+	if ( step <= 0 || step > RESET_TIME ) {
+		// map_restart or a hitch, not network conditions
+		return;
+	}
+
+	d = (float)abs( ( cls.realtime - arrival ) - step );
+	if ( d > RESET_TIME ) {
+		return;
+	}
+	cl.snapJitter += ( d - cl.snapJitter ) * ( 1.0f / 16.0f );
+
+	if ( cl.snapInterval == 0 || step < cl.snapInterval ) {
+		cl.snapInterval = step;
+	}
+
+	gap = (float)( step - cl.snapInterval );
+	if ( gap > cl.snapLossGap ) {
+		cl.snapLossGap = gap;
+	} else {
+		cl.snapLossGap += ( gap - cl.snapLossGap ) * ( 1.0f / 64.0f );
+	}
+}
+
+
+/*
+=================
+CL_AdjustJitterDelay
+
+Moves the interpolation delay towards cl_jitterBuffer times the measured
+variation, at most one msec per snapshot so the change stays invisible
+=================
+*/
+#define	MAX_JITTER_DELAY	200
+
+static void CL_AdjustJitterDelay( void ) {
+	float	target;
+
+	target = cl_jitterBuffer->value * ( cl.snapJitter + cl.snapLossGap );
+	if ( target > MAX_JITTER_DELAY ) {
+		target = MAX_JITTER_DELAY;
+	}
+
+	if ( target > cl.jitterDelay + 1.0f ) {
+		cl.jitterDelay += 1.0f;
+	} else if ( target < cl.jitterDelay - 1.0f ) {
+		cl.jitterDelay -= 1.0f;
+	} else {
+		cl.jitterDelay = target;
+	}
+
+	Cvar_SetIntegerValue( cl_snapJitter->name, (int)( cl.snapJitter + cl.snapLossGap + 0.5f ) );
+	if ( cl.snapInterval > 0 ) {
+		Cvar_SetValue( cl_snapBufferDepth->name, (int)( cl.jitterDelay * 10.0f / cl.snapInterval + 0.5f ) / 10.0f );
+	}
+}
+
+
 static void CL_AdjustTimeDelta( void ) {
 	int		newDelta;
 	int		deltaDelta;
@@ -960,6 +1254,8 @@ static void CL_AdjustTimeDelta( void ) {
 		return;
 	}
 
+	CL_AdjustJitterDelay();
+
 	newDelta = cl.snap.serverTime - cls.realtime;
 	deltaDelta = abs( newDelta - cl.serverTimeDelta );
 
@@ -1150,8 +1446,9 @@ void CL_SetCGameTime( void ) {
 	} else {
 		// cl_timeNudge is a user adjustable cvar that allows more
 		// or less latency to be added in the interest of better
-		// smoothness or better responsiveness.
-		cl.serverTime = cls.realtime + cl.serverTimeDelta - CL_TimeNudge();
+		// smoothness or better responsiveness, cl_jitterBuffer
+		// does the same following the measured network conditions
+		cl.serverTime = cls.realtime + cl.serverTimeDelta - CL_TimeNudge() - (int)cl.jitterDelay;
 
 		// guarantee that time will never flow backwards, even if
 		// serverTimeDelta made an adjustment or cl_timeNudge was changed
@@ -33,6 +33,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "client.h"
 #include "snd_local.h"
+#if idx64
+#include <emmintrin.h>
+#endif
 
 #define MAXSIZE				8
 #define MINSIZE				4
@@ -622,6 +625,37 @@ static unsigned int yuv_to_rgb24( long y, long u, long v )
 }
 
 
+#if idx64
+/******************************************************************************
+*
+* Function:		yuv_to_rgb24x4
+*
+* Description:	four yuv_to_rgb24 calls sharing u and v, packs saturate
+*				exactly like the scalar clamps
+*
+******************************************************************************/
+static void yuv_to_rgb24x4( unsigned int *out, long y0, long y1, long y2, long y3, long u, long v )
+{
+	__m128i yy, r, g, b;
+
+	yy = _mm_setr_epi32( ROQ_YY_tab[y0], ROQ_YY_tab[y1], ROQ_YY_tab[y2], ROQ_YY_tab[y3] );
+
+	r = _mm_srai_epi32( _mm_add_epi32( yy, _mm_set1_epi32( ROQ_VR_tab[v] ) ), 6 );
+	g = _mm_srai_epi32( _mm_add_epi32( yy, _mm_set1_epi32( ROQ_UG_tab[u] + ROQ_VG_tab[v] ) ), 6 );
+	b = _mm_srai_epi32( _mm_add_epi32( yy, _mm_set1_epi32( ROQ_UB_tab[u] ) ), 6 );
+
+	// r0..r3 b0..b3 g0..g3 a0..a3
+	r = _mm_packus_epi16( _mm_packs_epi32( r, b ), _mm_packs_epi32( g, _mm_set1_epi32( 255 ) ) );
+
+	// r0 g0 r1 g1 .. b0 a0 b1 a1 .. then r0 g0 b0 a0 ..
+	r = _mm_unpacklo_epi8( r, _mm_srli_si128( r, 8 ) );
+	r = _mm_unpacklo_epi16( r, _mm_srli_si128( r, 8 ) );
+
+	_mm_storeu_si128( (__m128i *)out, r );
+}
+#endif
+
+
 /******************************************************************************
 *
 * Function:		
@@ -690,10 +724,15 @@ static void decodeCodeBook( byte *input, unsigned short roq_flags )
 					y3 = (long)*input++;
 					cr = (long)*input++;
 					cb = (long)*input++;
+#if idx64
+					yuv_to_rgb24x4( ibptr.i, y0, y1, y2, y3, cr, cb );
+					ibptr.i += 4;
+#else
 					*ibptr.i++ = yuv_to_rgb24( y0, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( y1, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( y2, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( y3, cr, cb );
+#endif
 				}
 
 				icptr.s = vq4;
@@ -768,6 +807,11 @@ static void decodeCodeBook( byte *input, unsigned short roq_flags )
 					y3 = (long)*input++;
 					cr = (long)*input++;
 					cb = (long)*input++;
+#if idx64
+					yuv_to_rgb24x4( ibptr.i, y0, y1, ((y0*3)+y2)/4, ((y1*3)+y3)/4, cr, cb );
+					yuv_to_rgb24x4( ibptr.i + 4, (y0+(y2*3))/4, (y1+(y3*3))/4, y2, y3, cr, cb );
+					ibptr.i += 8;
+#else
 					*ibptr.i++ = yuv_to_rgb24( y0, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( y1, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( ((y0*3)+y2)/4, cr, cb );
@@ -776,6 +820,7 @@ static void decodeCodeBook( byte *input, unsigned short roq_flags )
 					*ibptr.i++ = yuv_to_rgb24( (y1+(y3*3))/4, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( y2, cr, cb );
 					*ibptr.i++ = yuv_to_rgb24( y3, cr, cb );
+#endif
 				}
 
 				icptr.s = vq4;
@@ -36,6 +36,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define  MAX_CONSOLES 5
 
 #define  CON_TEXTSIZE   65536
+#define  CON_MAXLINES   ( CON_TEXTSIZE / 16 )
 
 int bigchar_width;
 int bigchar_height;
@@ -44,10 +45,16 @@ int mediumchar_height;
 int smallchar_width;
 int smallchar_height;
 
+typedef struct {
+	byte	len;			// characters written, drawing stops here
+	byte	wrapped;		// text continues on the next row
+} conRow_t;
+
 typedef struct {
 	qboolean	initialized;
 
 	short	text[CON_TEXTSIZE];
+	conRow_t	rows[CON_MAXLINES];
 	int		current;		// line where next message will be printed
 	int		x;				// offset in current line for next print
 	int		display;		// bottom of console displays this line
@@ -276,6 +283,8 @@ static void Con_Clear_f( void ) {
 	for ( i = 0 ; i < activeCon->linewidth ; i++ ) {
 		activeCon->text[i] = ( ColorIndex( COLOR_WHITE ) << 8 ) | ' ';
 	}
+	activeCon->rows[0].len = 0;
+	activeCon->rows[0].wrapped = 0;
 
 	activeCon->x = 0;
 	activeCon->current = 0;
@@ -376,6 +385,66 @@ void Con_ClearNotify( void ) {
 }
 
 
+static void Con_NewLine( console_t *con );
+
+
+/*
+================
+Con_ReflowLinefeed
+================
+*/
+static void Con_ReflowLinefeed( console_t *con, qboolean wrapped )
+{
+	if ( con->newline ) {
+		Con_NewLine( con );
+	} else {
+		con->rows[ con->current % con->totallines ].wrapped = wrapped;
+		con->newline = qtrue;
+		con->x = 0;
+	}
+}
+
+
+/*
+================
+Con_ReflowText
+
+Lays out one logical line at the current width,
+with the same word wrapping as CL_OutputToConsole
+================
+*/
+static void Con_ReflowText( console_t *con, const short *text, int len )
+{
+	int i, l, y;
+
+	for ( i = 0; i < len; i++ ) {
+		for ( l = 0; l < con->linewidth && i + l < len; l++ ) {
+			if ( ( text[ i + l ] & 0xff ) <= ' ' ) {
+				break;
+			}
+		}
+
+		if ( l != con->linewidth && ( con->x + l >= con->linewidth ) ) {
+			Con_ReflowLinefeed( con, qtrue );
+		}
+
+		if ( con->newline ) {
+			Con_NewLine( con );
+			con->newline = qfalse;
+		}
+
+		y = con->current % con->totallines;
+		con->text[ y * con->linewidth + con->x ] = text[ i ];
+		con->x++;
+		con->rows[ y ].len = con->x;
+
+		if ( con->x >= con->linewidth ) {
+			Con_ReflowLinefeed( con, qtrue );
+		}
+	}
+}
+
+
 /*
 ================
 Con_CheckResize
@@ -385,9 +454,12 @@ If the line width has changed, reformat the buffer.
 */
 void Con_CheckResize( console_t *con )
 {
-	int		i, j, width, oldwidth, oldtotallines, oldcurrent, numlines, numchars;
-	short	tbuf[CON_TEXTSIZE], *src, *dst;
-	static int old_width, old_vispage;
+	static short	tbuf[CON_TEXTSIZE];
+	static conRow_t	trows[CON_MAXLINES];
+	static short	line[CON_TEXTSIZE];
+	int		i, width, oldwidth, oldtotallines, oldcurrent, numlines, len;
+	qboolean	oldnewline;
+	const conRow_t	*src;
 	int		vispage;
 	float	scale;
 
@@ -416,7 +488,7 @@ void Con_CheckResize( console_t *con )
 		g_console_field_width = DEFAULT_CONSOLE_WIDTH;
 		width = DEFAULT_CONSOLE_WIDTH * scale;
 		con->linewidth = width;
-		con->totallines = CON_TEXTSIZE / con->linewidth;
+		con->totallines = MIN( CON_TEXTSIZE / con->linewidth, CON_MAXLINES );
 		con->vispage = 4;
 
 		Con_Clear_f();
@@ -430,51 +502,55 @@ void Con_CheckResize( console_t *con )
 
 		if ( width > MAX_CONSOLE_WIDTH )
 			width = MAX_CONSOLE_WIDTH;
+		else if ( width < 1 )
+			width = 1;
 
 		vispage = cls.glconfig.vidHeight / ( smallchar_height * 2 ) - 1;
 
-		if ( old_vispage == vispage && old_width == width )
+		if ( con->vispage == vispage && con->linewidth == width )
 			return;
 
 		oldwidth = con->linewidth;
 		oldtotallines = con->totallines;
 		oldcurrent = con->current;
+		oldnewline = con->newline;
 
 		con->linewidth = width;
-		con->totallines = CON_TEXTSIZE / con->linewidth;
+		con->totallines = MIN( CON_TEXTSIZE / con->linewidth, CON_MAXLINES );
 		con->vispage = vispage;
 
-		old_vispage = vispage;
-		old_width = width;
-
-		numchars = oldwidth;
-		if ( numchars > con->linewidth )
-			numchars = con->linewidth;
-
-		if ( oldcurrent > oldtotallines )
-			numlines = oldtotallines;	
-		else
-			numlines = oldcurrent + 1;	
-
-		if ( numlines > con->totallines )
-			numlines = con->totallines;
+		numlines = MIN( oldcurrent + 1, oldtotallines );
 
 		Com_Memcpy( tbuf, con->text, CON_TEXTSIZE * sizeof( short ) );
+		Com_Memcpy( trows, con->rows, oldtotallines * sizeof( conRow_t ) );
 
-		for ( i = 0; i < CON_TEXTSIZE; i++ ) 
+		for ( i = 0; i < con->linewidth; i++ )
 			con->text[i] = (ColorIndex(COLOR_WHITE)<<8) | ' ';
+		con->rows[0].len = 0;
+		con->rows[0].wrapped = 0;
+
+		con->current = 0;
+		con->display = 0;
+		con->x = 0;
+		con->newline = qfalse;
 
-		for ( i = 0; i < numlines; i++ )
+		// join wrapped rows back into logical lines and wrap them again,
+		// oldest first so that the newest text survives a smaller buffer
+		len = 0;
+		for ( i = oldcurrent - numlines + 1; i <= oldcurrent; i++ )
 		{
-			src = &tbuf[ ((oldcurrent - i + oldtotallines) % oldtotallines) * oldwidth ];
-			dst = &con->text[ (numlines - 1 - i) * con->linewidth ];
-			for ( j = 0; j < numchars; j++ )
-				*dst++ = *src++;
+			src = &trows[ i % oldtotallines ];
+			Com_Memcpy( line + len, tbuf + ( i % oldtotallines ) * oldwidth, src->len * sizeof( short ) );
+			len += src->len;
+			if ( src->wrapped && i != oldcurrent )
+				continue;
+			Con_ReflowText( con, line, len );
+			len = 0;
+			if ( i != oldcurrent || ( oldnewline && !src->wrapped ) )
+				Con_ReflowLinefeed( con, qfalse );
 		}
 
 		Con_ClearNotify();
-
-		con->current = numlines - 1;
 	}
 
 	con->display = con->current;
@@ -653,6 +729,8 @@ static void Con_NewLine( console_t *con )
 	s = &con->text[ ( con->current % con->totallines ) * con->linewidth ];
 	for ( i = 0; i < con->linewidth ; i++ ) 
 		*s++ = (ColorIndex(COLOR_WHITE)<<8) | ' ';
+	con->rows[ con->current % con->totallines ].len = 0;
+	con->rows[ con->current % con->totallines ].wrapped = 0;
 
 	con->x = 0;
 }
@@ -733,6 +811,7 @@ void CL_OutputToConsole( console_t *con, const char *txt, qboolean skipnotify )
 
 		// word wrap
 		if ( l != con->linewidth && ( con->x + l >= con->linewidth ) ) {
+			con->rows[ con->current % con->totallines ].wrapped = 1;
 			Con_Linefeed( con, skipnotify );
 		}
 
@@ -759,7 +838,11 @@ void CL_OutputToConsole( console_t *con, const char *txt, qboolean skipnotify )
 			y = con->current % con->totallines;
 			con->text[y * con->linewidth + con->x ] = (colorIndex << 8) | (c & 255);
 			con->x++;
+			if ( con->rows[y].len < con->x ) {
+				con->rows[y].len = con->x;
+			}
 			if ( con->x >= con->linewidth ) {
+				con->rows[y].wrapped = 1;
 				Con_Linefeed( con, skipnotify );
 			}
 			break;
@@ -872,6 +955,42 @@ DRAWING
 */
 
 
+/*
+================
+Con_DrawRow
+
+Draws the written part of a row, blanks are skipped and
+color is only changed between runs of the same color
+================
+*/
+static void Con_DrawRow( const console_t *con, int row, float x, int y, int *currentColorIndex )
+{
+	const short *text;
+	int		i, len, ch, colorIndex;
+	float	s, t;
+
+	row %= con->totallines;
+	text = con->text + row * con->linewidth;
+	len = con->rows[ row ].len;
+
+	for ( i = 0; i < len; i++ ) {
+		ch = text[i] & 0xff;
+		if ( ch == ' ' ) {
+			continue;
+		}
+		colorIndex = ( text[i] >> 8 ) & 63;
+		if ( *currentColorIndex != colorIndex ) {
+			*currentColorIndex = colorIndex;
+			re.SetColor( g_color_table[ colorIndex ] );
+		}
+		s = ( ch & 15 ) * 0.0625f;
+		t = ( ch >> 4 ) * 0.0625f;
+		re.DrawStretchPic( (int)( x + i * smallchar_width ), y, smallchar_width, smallchar_height,
+			s, t, s + 0.0625f, t + 0.0625f, cls.charSetShader );
+	}
+}
+
+
 /*
 ================
 Con_DrawInput
@@ -906,13 +1025,11 @@ Draws the last few lines of output transparently over the game top
 */
 static void Con_DrawNotify( void )
 {
-	int		x, v;
-	short	*text;
+	int		v;
 	int		i;
 	int		time;
 	int		skip;
 	int		currentColorIndex;
-	int		colorIndex;
 	int notifytime = con_notifytime->value * 1000 + 2 * (int)NOTIFY_FADE_TIME;
 
 	currentColorIndex = ColorIndex( COLOR_WHITE );
@@ -950,23 +1067,11 @@ static void Con_DrawNotify( void )
 			v += fade * smallchar_height;
 		}
 
-		text = activeCon->text + (i % activeCon->totallines)*activeCon->linewidth;
-
 		if (cl.snap.ps.pm_type != PM_INTERMISSION && Key_GetCatcher( ) & (KEYCATCH_UI | KEYCATCH_CGAME) ) {
 			continue;
 		}
 
-		for (x = 0 ; x < activeCon->linewidth ; x++) {
-			if ( ( text[x] & 0xff ) == ' ' ) {
-				continue;
-			}
-			colorIndex = ( text[x] >> 8 ) & 63;
-			if ( currentColorIndex != colorIndex ) {
-				currentColorIndex = colorIndex;
-				re.SetColor( g_color_table[ colorIndex ] );
-			}
-			SCR_DrawSmallChar( cl_conXOffset->integer + activeCon->xadjust + (x+1)*smallchar_width, v, text[x] & 0xff );
-		}
+		Con_DrawRow( activeCon, i, cl_conXOffset->integer + activeCon->xadjust + smallchar_width, v, &currentColorIndex );
 	}
 
 	if (v < 0) {
@@ -1019,11 +1124,9 @@ static void Con_DrawSolidConsole( float frac ) {
 
 	int				i, x, y;
 	int				rows;
-	short			*text;
 	int				row;
 	int				lines;
 	int				currentColorIndex;
-	int				colorIndex;
 	float			yf, wf;
 	char			buf[ MAX_CVAR_VALUE_STRING ], *v[4];
 	qtime_t			qt;
@@ -1178,21 +1281,7 @@ static void Con_DrawSolidConsole( float frac ) {
 			continue;
 		}
 
-		text = activeCon->text + (row % activeCon->totallines) * activeCon->linewidth;
-
-		for ( x = 0 ; x < activeCon->linewidth ; x++ ) {
-			// skip rendering whitespace
-			if ( ( text[x] & 0xff ) == ' ' ) {
-				continue;
-			}
-			// track color changes
-			colorIndex = ( text[ x ] >> 8 ) & 63;
-			if ( currentColorIndex != colorIndex ) {
-				currentColorIndex = colorIndex;
-				re.SetColor( g_color_table[ colorIndex ] );
-			}
-			SCR_DrawSmallChar( activeCon->xadjust + (x + 1) * smallchar_width, y, text[x] & 0xff );
-		}
+		Con_DrawRow( activeCon, row, activeCon->xadjust + smallchar_width, y, &currentColorIndex );
 	}
 
 	// draw the input prompt, user text, and cursor if desired
@@ -54,6 +54,7 @@ CURLMcode (*qcurl_multi_fdset)(CURLM *multi_handle,
 CURLMcode (*qcurl_multi_perform)(CURLM *multi_handle,
                                                 int *running_handles);
 CURLMcode (*qcurl_multi_cleanup)(CURLM *multi_handle);
+CURLMcode (*qcurl_multi_setopt)(CURLM *multi_handle, CURLMoption option, ...);
 CURLMsg *(*qcurl_multi_info_read)(CURLM *multi_handle,
                                                 int *msgs_in_queue);
 const char *(*qcurl_multi_strerror)(CURLMcode);
@@ -142,6 +143,7 @@ qboolean CL_cURL_Init( void )
 	qcurl_multi_fdset = GPA("curl_multi_fdset");
 	qcurl_multi_perform = GPA("curl_multi_perform");
 	qcurl_multi_cleanup = GPA("curl_multi_cleanup");
+	qcurl_multi_setopt = GPA("curl_multi_setopt");
 	qcurl_multi_info_read = GPA("curl_multi_info_read");
 	qcurl_multi_strerror = GPA("curl_multi_strerror");
 
@@ -190,71 +192,157 @@ void CL_cURL_Shutdown( void )
 	qcurl_multi_fdset = NULL;
 	qcurl_multi_perform = NULL;
 	qcurl_multi_cleanup = NULL;
+	qcurl_multi_setopt = NULL;
 	qcurl_multi_info_read = NULL;
 	qcurl_multi_strerror = NULL;
 #endif /* USE_CURL_DLOPEN */
 }
 
-void CL_cURL_Cleanup(void)
+/*
+==================================
+
+Client downloads
+
+Missing paks are fetched over clc.downloadCURLM, up to cl_dlParallel of
+them at once. Each transfer writes to <name>.tmp, a .tmp left over from
+an interrupted attempt is resumed with a range request.
+
+==================================
+*/
+
+typedef struct {
+	CURL		*curl;
+	fileHandle_t file;
+	char		name[MAX_OSPATH];
+	char		tempName[MAX_OSPATH + 4];	// name + ".tmp"
+	char		URL[MAX_OSPATH];
+	const char	*error;
+	int			resumeFrom;		// bytes kept from an earlier attempt
+	int			size;
+	int			count;
+	qboolean	http;
+	qboolean	started;		// first block has been checked
+} cURLTransfer_t;
+
+static cURLTransfer_t	cl_transfers[ MAX_CURL_TRANSFERS ];
+static int				cl_numTransfers;
+
+
+/*
+=================
+CL_cURL_FreeTransfer
+=================
+*/
+static void CL_cURL_FreeTransfer( cURLTransfer_t *tr )
 {
-	if(clc.downloadCURLM) {
-		CURLMcode result;
-
-		if(clc.downloadCURL) {
-			result = qcurl_multi_remove_handle(clc.downloadCURLM,
-				clc.downloadCURL);
-			if(result != CURLM_OK) {
-				Com_DPrintf("qcurl_multi_remove_handle failed: %s\n", qcurl_multi_strerror(result));
+	CURLMcode result;
+
+	if ( tr->curl ) {
+		if ( clc.downloadCURLM ) {
+			result = qcurl_multi_remove_handle( clc.downloadCURLM, tr->curl );
+			if ( result != CURLM_OK ) {
+				Com_DPrintf( "qcurl_multi_remove_handle failed: %s\n", qcurl_multi_strerror( result ) );
 			}
-			qcurl_easy_cleanup(clc.downloadCURL);
 		}
-		result = qcurl_multi_cleanup(clc.downloadCURLM);
-		if(result != CURLM_OK) {
-			Com_DPrintf("CL_cURL_Cleanup: qcurl_multi_cleanup failed: %s\n", qcurl_multi_strerror(result));
+		qcurl_easy_cleanup( tr->curl );
+	}
+
+	if ( tr->file != FS_INVALID_HANDLE ) {
+		FS_FCloseFile( tr->file );
+	}
+
+	// keep active transfers packed
+	cl_numTransfers--;
+	if ( tr != &cl_transfers[ cl_numTransfers ] ) {
+		*tr = cl_transfers[ cl_numTransfers ];
+	}
+	Com_Memset( &cl_transfers[ cl_numTransfers ], 0, sizeof( cl_transfers[0] ) );
+}
+
+
+/*
+=================
+CL_cURL_Cleanup
+=================
+*/
+void CL_cURL_Cleanup( void )
+{
+	CURLMcode result;
+
+	while ( cl_numTransfers > 0 ) {
+		CL_cURL_FreeTransfer( &cl_transfers[ cl_numTransfers - 1 ] );
+	}
+
+	if ( clc.downloadCURLM ) {
+		result = qcurl_multi_cleanup( clc.downloadCURLM );
+		if ( result != CURLM_OK ) {
+			Com_DPrintf( "CL_cURL_Cleanup: qcurl_multi_cleanup failed: %s\n", qcurl_multi_strerror( result ) );
 		}
 		clc.downloadCURLM = NULL;
-		clc.downloadCURL = NULL;
-	}
-	else if(clc.downloadCURL) {
-		qcurl_easy_cleanup(clc.downloadCURL);
-		clc.downloadCURL = NULL;
 	}
 }
 
+
+/*
+=================
+CL_cURL_ActiveDownloads
+=================
+*/
+int CL_cURL_ActiveDownloads( void )
+{
+	return cl_numTransfers;
+}
+
+
 #if CURL_AT_LEAST_VERSION(7, 32, 0)
-static int CL_cURL_CallbackProgress( void *dummy, curl_off_t dltotal, curl_off_t dlnow,
+static int CL_cURL_CallbackProgress( void *data, curl_off_t dltotal, curl_off_t dlnow,
 	curl_off_t ultotal, curl_off_t ulnow )
 #else
-static int CL_cURL_CallbackProgress( void *dummy, double dltotal, double dlnow,
+static int CL_cURL_CallbackProgress( void *data, double dltotal, double dlnow,
 	double ultotal, double ulnow )
 #endif
 {
-	clc.downloadSize = (int)dltotal;
-	Cvar_SetIntegerValue( "cl_downloadSize", clc.downloadSize );
-	clc.downloadCount = (int)dlnow;
-	Cvar_SetIntegerValue( "cl_downloadCount", clc.downloadCount );
+	cURLTransfer_t *tr = (cURLTransfer_t *)data;
+
+	// totals only cover the requested range
+	if ( dltotal > 0 ) {
+		tr->size = tr->resumeFrom + (int)dltotal;
+	}
+	tr->count = tr->resumeFrom + (int)dlnow;
 	return 0;
 }
 
 
 static size_t CL_cURL_CallbackWrite( void *buffer, size_t size, size_t nmemb, void *stream )
 {
-	if ( clc.download == FS_INVALID_HANDLE ) {
-		if ( !CL_ValidPakSignature( buffer, size*nmemb ) ) {
-			Com_Error( ERR_DROP, "CL_cURL_CallbackWrite: invalid pak signature for %s", 
-				clc.downloadName );
-			return (size_t)-1;
+	cURLTransfer_t *tr = (cURLTransfer_t *)stream;
+	const size_t len = size * nmemb;
+	long code;
+
+	if ( !tr->started ) {
+		if ( tr->resumeFrom > 0 && tr->http ) {
+			code = 0;
+			qcurl_easy_getinfo( tr->curl, CURLINFO_RESPONSE_CODE, &code );
+			if ( code != 206 ) {
+				// server ignored the range and sends the whole file
+				FS_FCloseFile( tr->file );
+				tr->file = FS_SV_FOpenFileWrite( tr->tempName );
+				tr->resumeFrom = 0;
+			}
 		}
-		clc.download = FS_SV_FOpenFileWrite( clc.downloadTempName );
-		if ( clc.download == FS_INVALID_HANDLE ) {
-			Com_Error( ERR_DROP, "CL_cURL_CallbackWrite: failed to open %s for writing", 
-				clc.downloadTempName );
-			return (size_t)-1;
+		if ( tr->file == FS_INVALID_HANDLE ) {
+			tr->error = "failed to open file for writing";
+			return 0;
+		}
+		if ( tr->resumeFrom == 0 && !CL_ValidPakSignature( buffer, len ) ) {
+			tr->error = "invalid pak signature";
+			return 0;
 		}
+		tr->started = qtrue;
 	}
 
-	FS_Write( buffer, size*nmemb, ((fileHandle_t*)stream)[0] );
-	return size*nmemb;
+	FS_Write( buffer, len, tr->file );
+	return len;
 }
 
 
@@ -284,97 +372,145 @@ CURLcode qcurl_easy_setopt_warn(CURL *curl, CURLoption option, ...)
 	return result;
 }
 
-static void CL_cURL_CloseDownload( void ) 
-{
-	if ( clc.download != FS_INVALID_HANDLE )
-		FS_FCloseFile( clc.download );
-	clc.download = FS_INVALID_HANDLE;
-}
 
-void CL_cURL_BeginDownload( const char *localName, const char *remoteURL )
+/*
+=================
+CL_cURL_StartTransfer
+
+Adds a transfer to clc.downloadCURLM, continues an existing
+temporary file when resume is set
+=================
+*/
+static void CL_cURL_StartTransfer( const char *localName, const char *remoteURL, qboolean resume )
 {
+	cURLTransfer_t *tr;
 	CURLMcode result;
 
-	clc.cURLUsed = qtrue;
-	Com_Printf("URL: %s\n", remoteURL);
-	Com_DPrintf("***** CL_cURL_BeginDownload *****\n"
-		"Localname: %s\n"
-		"RemoteURL: %s\n"
-		"****************************\n", localName, remoteURL);
-	CL_cURL_Cleanup();
-	Q_strncpyz(clc.downloadURL, remoteURL, sizeof(clc.downloadURL));
-	Q_strncpyz(clc.downloadName, localName, sizeof(clc.downloadName));
-	Com_sprintf(clc.downloadTempName, sizeof(clc.downloadTempName),
-		"%s.tmp", localName);
+	if ( cl_numTransfers >= MAX_CURL_TRANSFERS ) {
+		Com_Error( ERR_DROP, "CL_cURL_BeginDownload: too many downloads" );
+		return;
+	}
 
-	// Set so UI gets access to it
-	Cvar_Set( "cl_downloadName", localName );
-	Cvar_Set( "cl_downloadSize", "0" );
-	Cvar_Set( "cl_downloadCount", "0" );
-	Cvar_SetIntegerValue( "cl_downloadTime", cls.realtime );
+	tr = &cl_transfers[ cl_numTransfers ];
+	Com_Memset( tr, 0, sizeof( *tr ) );
+	tr->file = FS_INVALID_HANDLE;
+
+	Q_strncpyz( tr->URL, remoteURL, sizeof( tr->URL ) );
+	Q_strncpyz( tr->name, localName, sizeof( tr->name ) );
+	Com_sprintf( tr->tempName, sizeof( tr->tempName ), "%s.tmp", localName );
+	tr->http = !Q_stricmpn( remoteURL, "http", 4 );
 
-	CL_cURL_CloseDownload();
+	if ( resume ) {
+		tr->file = FS_SV_FOpenFileAppend( tr->tempName, &tr->resumeFrom );
+	} else {
+		tr->file = FS_SV_FOpenFileWrite( tr->tempName );
+	}
+	if ( tr->file == FS_INVALID_HANDLE ) {
+		Com_Error( ERR_DROP, "CL_cURL_BeginDownload: failed to open %s for writing", tr->tempName );
+		return;
+	}
 
-	clc.downloadBlock = 0; // Starting new file
-	clc.downloadCount = 0;
+	if ( tr->resumeFrom > 0 ) {
+		Com_Printf( "Resuming %s at %i bytes\n", localName, tr->resumeFrom );
+	}
 
-	clc.downloadCURL = qcurl_easy_init();
-	if(!clc.downloadCURL) {
-		Com_Error(ERR_DROP, "CL_cURL_BeginDownload: qcurl_easy_init() "
-			"failed");
+	tr->curl = qcurl_easy_init();
+	if ( !tr->curl ) {
+		FS_FCloseFile( tr->file );
+		Com_Error( ERR_DROP, "CL_cURL_BeginDownload: qcurl_easy_init() failed" );
 		return;
 	}
 
+	cl_numTransfers++;
+
 	if ( com_developer->integer )
-		qcurl_easy_setopt_warn( clc.downloadCURL, CURLOPT_VERBOSE, 1 );
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_URL, clc.downloadURL);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_TRANSFERTEXT, 0);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_REFERER, va("ioQ3://%s",
+		qcurl_easy_setopt_warn( tr->curl, CURLOPT_VERBOSE, 1 );
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_URL, tr->URL);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_TRANSFERTEXT, 0);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_REFERER, va("ioQ3://%s",
 		NET_AdrToString(&clc.serverAddress)));
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_USERAGENT, Q3_VERSION);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_WRITEFUNCTION,
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_USERAGENT, Q3_VERSION);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_WRITEFUNCTION,
 		CL_cURL_CallbackWrite);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_WRITEDATA, &clc.download);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_NOPROGRESS, 0);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_WRITEDATA, tr);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_NOPROGRESS, 0);
 #if CURL_AT_LEAST_VERSION(7, 32, 0)
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_XFERINFOFUNCTION,
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_XFERINFOFUNCTION,
 		CL_cURL_CallbackProgress);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_XFERINFODATA, NULL);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_XFERINFODATA, tr);
 #else
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_PROGRESSFUNCTION,
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_PROGRESSFUNCTION,
 		CL_cURL_CallbackProgress);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_PROGRESSDATA, NULL);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_PROGRESSDATA, tr);
 #endif
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_FAILONERROR, 1);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_FOLLOWLOCATION, 1);
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_MAXREDIRS, 5);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_FAILONERROR, 1);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_FOLLOWLOCATION, 1);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_MAXREDIRS, 5);
 #if CURL_AT_LEAST_VERSION(7, 85, 0)
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_PROTOCOLS_STR, ALLOWED_PROTOCOLS_STR);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_PROTOCOLS_STR, ALLOWED_PROTOCOLS_STR);
 #else
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_PROTOCOLS, ALLOWED_PROTOCOLS);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_PROTOCOLS, ALLOWED_PROTOCOLS);
+#endif
+	if ( tr->resumeFrom > 0 ) {
+		qcurl_easy_setopt_warn(tr->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)tr->resumeFrom);
+	}
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+	// rather wait for a connection to multiplex on than open another one
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_PIPEWAIT, 1);
 #endif
 
 #ifdef CURL_MAX_READ_SIZE
-	qcurl_easy_setopt_warn(clc.downloadCURL, CURLOPT_BUFFERSIZE, CURL_MAX_READ_SIZE);
+	qcurl_easy_setopt_warn(tr->curl, CURLOPT_BUFFERSIZE, CURL_MAX_READ_SIZE);
 #endif
 
-	clc.downloadCURLM = qcurl_multi_init();	
-	if( !clc.downloadCURLM ) {
-		qcurl_easy_cleanup( clc.downloadCURL );
-		clc.downloadCURL = NULL;
-		Com_Error( ERR_DROP, "CL_cURL_BeginDownload: qcurl_multi_init() "
-			"failed");
-		return;
-	}
-
-	result = qcurl_multi_add_handle( clc.downloadCURLM, clc.downloadCURL );
+	result = qcurl_multi_add_handle( clc.downloadCURLM, tr->curl );
 	if ( result != CURLM_OK ) {
-		qcurl_easy_cleanup( clc.downloadCURL );
-		clc.downloadCURL = NULL;
-		Com_Error( ERR_DROP, "CL_cURL_BeginDownload: qcurl_multi_add_handle() failed: %s",	
+		qcurl_easy_cleanup( tr->curl );
+		tr->curl = NULL;
+		CL_cURL_FreeTransfer( tr );
+		Com_Error( ERR_DROP, "CL_cURL_BeginDownload: qcurl_multi_add_handle() failed: %s",
 			qcurl_multi_strerror( result ) );
 		return;
 	}
+}
+
+
+/*
+=================
+CL_cURL_BeginDownload
+=================
+*/
+void CL_cURL_BeginDownload( const char *localName, const char *remoteURL )
+{
+	clc.cURLUsed = qtrue;
+	Com_Printf("URL: %s\n", remoteURL);
+	Com_DPrintf("***** CL_cURL_BeginDownload *****\n"
+		"Localname: %s\n"
+		"RemoteURL: %s\n"
+		"****************************\n", localName, remoteURL);
+
+	if ( !clc.downloadCURLM ) {
+		clc.downloadCURLM = qcurl_multi_init();
+		if ( !clc.downloadCURLM ) {
+			Com_Error( ERR_DROP, "CL_cURL_BeginDownload: qcurl_multi_init() "
+				"failed");
+			return;
+		}
+#ifdef CURLPIPE_MULTIPLEX
+		// several paks from the same HTTP/2 host share one connection
+		qcurl_multi_setopt( clc.downloadCURLM, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX );
+#endif
+	}
+
+	if ( cl_numTransfers == 0 ) {
+		// Set so UI gets access to it
+		Cvar_Set( "cl_downloadSize", "0" );
+		Cvar_Set( "cl_downloadCount", "0" );
+		Cvar_SetIntegerValue( "cl_downloadTime", cls.realtime );
+	}
+	Cvar_Set( "cl_downloadName", localName );
+
+	CL_cURL_StartTransfer( localName, remoteURL, qtrue );
 
 	if(!(clc.sv_allowDownload & DLF_NO_DISCONNECT) &&
 		!clc.cURLDisconnected) {
@@ -388,10 +524,21 @@ void CL_cURL_BeginDownload( const char *localName, const char *remoteURL )
 }
 
 
+/*
+=================
+CL_cURL_PerformDownload
+=================
+*/
 void CL_cURL_PerformDownload( void )
 {
+	char name[MAX_OSPATH], URL[MAX_OSPATH];
+	cURLTransfer_t *tr;
+	const char *zippath;
+	qboolean finished;
 	CURLMcode res;
 	CURLMsg *msg;
+	int size, count;
+	long code;
 	int c;
 	int i = 0;
 
@@ -402,26 +549,74 @@ void CL_cURL_PerformDownload( void )
 	}
 	if(res == CURLM_CALL_MULTI_PERFORM)
 		return;
-	msg = qcurl_multi_info_read(clc.downloadCURLM, &c);
-	if(msg == NULL) {
-		return;
+
+	finished = qfalse;
+	while ( ( msg = qcurl_multi_info_read( clc.downloadCURLM, &c ) ) != NULL ) {
+		if ( msg->msg != CURLMSG_DONE ) {
+			continue;
+		}
+
+		for ( i = 0, tr = cl_transfers; i < cl_numTransfers; i++, tr++ ) {
+			if ( tr->curl == msg->easy_handle ) {
+				break;
+			}
+		}
+		if ( i == cl_numTransfers ) {
+			continue;
+		}
+
+		if ( msg->data.result == CURLE_OK ) {
+			FS_FCloseFile( tr->file );
+			tr->file = FS_INVALID_HANDLE;
+			FS_SV_Rename( tr->tempName, tr->name );
+
+			// the checksum only needs the central directory so it is cheap
+			// enough to verify each pak as soon as it arrives
+			zippath = FS_BuildOSPath( Cvar_VariableString( "fs_homepath" ), tr->name, NULL );
+			if ( !FS_CompareZipChecksum( zippath ) ) {
+				Com_Error( ERR_DROP, "Incorrect checksum for file: %s", tr->name );
+				return;
+			}
+
+			CL_cURL_FreeTransfer( tr );
+			clc.downloadRestart = qtrue;
+			finished = qtrue;
+		} else if ( tr->resumeFrom > 0 && !tr->started ) {
+			// the partial file may be stale or already complete
+			Com_Printf( "Could not resume %s, starting over\n", tr->name );
+			Q_strncpyz( name, tr->name, sizeof( name ) );
+			Q_strncpyz( URL, tr->URL, sizeof( URL ) );
+			CL_cURL_FreeTransfer( tr );
+			CL_cURL_StartTransfer( name, URL, qfalse );
+		} else {
+			code = 0;
+			qcurl_easy_getinfo( msg->easy_handle, CURLINFO_RESPONSE_CODE, &code );
+			Com_Error( ERR_DROP, "Download Error: %s Code: %ld URL: %s",
+				tr->error ? tr->error : qcurl_easy_strerror( msg->data.result ),
+				code, tr->URL );
+			return;
+		}
 	}
-	CL_cURL_CloseDownload();
-	if ( msg->msg == CURLMSG_DONE && msg->data.result == CURLE_OK ) {
-		FS_SV_Rename( clc.downloadTempName, clc.downloadName );
-		clc.downloadRestart = qtrue;
+
+	if ( finished ) {
+		CL_NextDownload();
 	}
-	else {
-		long code;
 
-		qcurl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
-			&code);	
-		Com_Error(ERR_DROP, "Download Error: %s Code: %ld URL: %s",
-			qcurl_easy_strerror(msg->data.result),
-			code, clc.downloadURL);
+	if ( cl_numTransfers == 0 ) {
+		return;
 	}
 
-	CL_NextDownload();
+	// report all running transfers as one download
+	size = count = 0;
+	for ( i = 0, tr = cl_transfers; i < cl_numTransfers; i++, tr++ ) {
+		size += tr->size;
+		count += tr->count;
+	}
+	clc.downloadSize = size;
+	Cvar_SetIntegerValue( "cl_downloadSize", size );
+	clc.downloadCount = count;
+	Cvar_SetIntegerValue( "cl_downloadCount", count );
+	Cvar_Set( "cl_downloadName", cl_transfers[0].name );
 }
 
 
@@ -68,6 +68,8 @@ extern CURLMcode (*qcurl_multi_fdset)(CURLM *multi_handle,
 extern CURLMcode (*qcurl_multi_perform)(CURLM *multi_handle,
 						int *running_handles);
 extern CURLMcode (*qcurl_multi_cleanup)(CURLM *multi_handle);
+extern CURLMcode (*qcurl_multi_setopt)(CURLM *multi_handle,
+						CURLMoption option, ...);
 extern CURLMsg *(*qcurl_multi_info_read)(CURLM *multi_handle,
 						int *msgs_in_queue);
 extern const char *(*qcurl_multi_strerror)(CURLMcode);
@@ -89,15 +91,19 @@ extern const char *(*qcurl_multi_strerror)(CURLMcode);
 #define qcurl_multi_fdset curl_multi_fdset
 #define qcurl_multi_perform curl_multi_perform
 #define qcurl_multi_cleanup curl_multi_cleanup
+#define qcurl_multi_setopt curl_multi_setopt
 #define qcurl_multi_info_read curl_multi_info_read
 #define qcurl_multi_strerror curl_multi_strerror
 #endif
 
+#define MAX_CURL_TRANSFERS 8	// upper bound of cl_dlParallel
+
 qboolean CL_cURL_Init( void );
 void CL_cURL_Shutdown( void );
 void CL_cURL_BeginDownload( const char *localName, const char *remoteURL );
 void CL_cURL_PerformDownload( void );
 void CL_cURL_Cleanup( void );
+int CL_cURL_ActiveDownloads( void );
 
 typedef struct download_s {
 	char		URL[MAX_OSPATH];
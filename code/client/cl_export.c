@@ -0,0 +1,540 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// cl_export.c -- demo_export batch processing
+
+#include "client.h"
+
+/*
+
+demo_export parses demos through CL_ParseServerMessage as fast as the
+files can be read, without the cgame, renderer or sound, and writes one
+NDJSON file per demo to exports/<demo>.ndjson:
+
+  {"type":"gamestate",...}  client number, server command sequence, configstrings
+  {"type":"cmd",...}        every server command (chat, prints, configstring changes, scores)
+  {"type":"snap",...}       snapshot time and flags, the playerstate when it changed,
+                            every entity that changed and the numbers of removed ones
+  {"type":"event",...}      entity events and playerstate events
+
+Entities are written with all entityState_t fields whenever any of them
+changed, so the stream keeps everything the demo had. Event numbers are
+masked with the toggle bits of the game modules, temporary event entities
+show up as new entities and are left to the reader since the entity type
+numbers belong to the mod.
+
+All client state is global so a process exports one demo at a time,
+demo_export <dir> <n>/<count> exports every count-th demo so several
+processes can share a directory, for example with +set cl_headless 1.
+
+*/
+
+#define EXPORT_EVENT_BITS	0x300		// EV_EVENT_BITS of the game modules
+
+typedef struct {
+	fileHandle_t	file;
+	int				lastSnapshot;	// messageNum
+	int				lastCommand;
+	qboolean		havePlayerstate;
+	playerState_t	ps;
+	byte			present[ MAX_GENTITIES ];
+	entityState_t	ents[ MAX_GENTITIES ];
+	int				numSnapshots;
+	int				numEvents;
+} demoExport_t;
+
+static demoExport_t dx;
+
+
+/*
+=================
+CL_ExportString
+
+Writes s as a JSON string, bytes above 127 are taken as Latin-1
+=================
+*/
+static void CL_ExportString( const char *s ) {
+	char	buf[ 1024 ];
+	int		n, c;
+
+	n = 0;
+	buf[ n++ ] = '"';
+	for ( ; *s; s++ ) {
+		if ( n > (int)sizeof( buf ) - 8 ) {
+			FS_Write( buf, n, dx.file );
+			n = 0;
+		}
+		c = *(const byte *)s;
+		if ( c == '"' || c == '\\' ) {
+			buf[ n++ ] = '\\';
+			buf[ n++ ] = c;
+		} else if ( c < ' ' || c > '~' ) {
+			n += Com_sprintf( buf + n, sizeof( buf ) - n, "\\u%04x", c );
+		} else {
+			buf[ n++ ] = c;
+		}
+	}
+	buf[ n++ ] = '"';
+
+	FS_Write( buf, n, dx.file );
+}
+
+
+static void CL_ExportTrajectory( const char *key, const trajectory_t *tr ) {
+	FS_Printf( dx.file, ",\"%s\":{\"type\":%i,\"time\":%i,\"duration\":%i,\"base\":[%g,%g,%g],\"delta\":[%g,%g,%g]}",
+		key, tr->trType, tr->trTime, tr->trDuration,
+		tr->trBase[0], tr->trBase[1], tr->trBase[2],
+		tr->trDelta[0], tr->trDelta[1], tr->trDelta[2] );
+}
+
+
+static void CL_ExportVector( const char *key, const vec3_t v ) {
+	FS_Printf( dx.file, ",\"%s\":[%g,%g,%g]", key, v[0], v[1], v[2] );
+}
+
+
+static void CL_ExportInts( const char *key, const int *v, int count ) {
+	int i;
+
+	FS_Printf( dx.file, ",\"%s\":[", key );
+	for ( i = 0; i < count; i++ ) {
+		FS_Printf( dx.file, i ? ",%i" : "%i", v[i] );
+	}
+	FS_Write( "]", 1, dx.file );
+}
+
+
+/*
+=================
+CL_ExportEntity
+=================
+*/
+static void CL_ExportEntity( const entityState_t *es, qboolean isNew ) {
+	FS_Printf( dx.file, "{\"n\":%i,\"new\":%i,\"eType\":%i,\"eFlags\":%i", es->number, isNew, es->eType, es->eFlags );
+	CL_ExportTrajectory( "pos", &es->pos );
+	CL_ExportTrajectory( "apos", &es->apos );
+	FS_Printf( dx.file, ",\"time\":%i,\"time2\":%i", es->time, es->time2 );
+	CL_ExportVector( "origin", es->origin );
+	CL_ExportVector( "origin2", es->origin2 );
+	CL_ExportVector( "angles", es->angles );
+	CL_ExportVector( "angles2", es->angles2 );
+	FS_Printf( dx.file, ",\"otherEntityNum\":%i,\"otherEntityNum2\":%i,\"groundEntityNum\":%i"
+		",\"constantLight\":%i,\"loopSound\":%i,\"modelindex\":%i,\"modelindex2\":%i"
+		",\"clientNum\":%i,\"frame\":%i,\"solid\":%i,\"event\":%i,\"eventParm\":%i"
+		",\"powerups\":%i,\"weapon\":%i,\"legsAnim\":%i,\"torsoAnim\":%i,\"generic1\":%i}",
+		es->otherEntityNum, es->otherEntityNum2, es->groundEntityNum,
+		es->constantLight, es->loopSound, es->modelindex, es->modelindex2,
+		es->clientNum, es->frame, es->solid, es->event, es->eventParm,
+		es->powerups, es->weapon, es->legsAnim, es->torsoAnim, es->generic1 );
+}
+
+
+/*
+=================
+CL_ExportPlayerstate
+=================
+*/
+static void CL_ExportPlayerstate( const playerState_t *ps ) {
+	FS_Printf( dx.file, ",\"ps\":{\"commandTime\":%i,\"pm_type\":%i,\"pm_flags\":%i,\"pm_time\":%i,\"bobCycle\":%i",
+		ps->commandTime, ps->pm_type, ps->pm_flags, ps->pm_time, ps->bobCycle );
+	CL_ExportVector( "origin", ps->origin );
+	CL_ExportVector( "velocity", ps->velocity );
+	CL_ExportVector( "viewangles", ps->viewangles );
+	CL_ExportInts( "delta_angles", ps->delta_angles, 3 );
+	CL_ExportVector( "grapplePoint", ps->grapplePoint );
+	FS_Printf( dx.file, ",\"weaponTime\":%i,\"gravity\":%i,\"speed\":%i,\"groundEntityNum\":%i"
+		",\"legsTimer\":%i,\"legsAnim\":%i,\"torsoTimer\":%i,\"torsoAnim\":%i,\"movementDir\":%i"
+		",\"eFlags\":%i,\"eventSequence\":%i,\"externalEvent\":%i,\"externalEventParm\":%i,\"externalEventTime\":%i"
+		",\"clientNum\":%i,\"weapon\":%i,\"weaponstate\":%i,\"viewheight\":%i"
+		",\"damageEvent\":%i,\"damageYaw\":%i,\"damagePitch\":%i,\"damageCount\":%i"
+		",\"generic1\":%i,\"loopSound\":%i,\"jumppad_ent\":%i,\"ping\":%i",
+		ps->weaponTime, ps->gravity, ps->speed, ps->groundEntityNum,
+		ps->legsTimer, ps->legsAnim, ps->torsoTimer, ps->torsoAnim, ps->movementDir,
+		ps->eFlags, ps->eventSequence, ps->externalEvent, ps->externalEventParm, ps->externalEventTime,
+		ps->clientNum, ps->weapon, ps->weaponstate, ps->viewheight,
+		ps->damageEvent, ps->damageYaw, ps->damagePitch, ps->damageCount,
+		ps->generic1, ps->loopSound, ps->jumppad_ent, ps->ping );
+	CL_ExportInts( "events", ps->events, MAX_PS_EVENTS );
+	CL_ExportInts( "eventParms", ps->eventParms, MAX_PS_EVENTS );
+	CL_ExportInts( "stats", ps->stats, MAX_STATS );
+	CL_ExportInts( "persistant", ps->persistant, MAX_PERSISTANT );
+	CL_ExportInts( "powerups", ps->powerups, MAX_POWERUPS );
+	CL_ExportInts( "ammo", ps->ammo, MAX_WEAPONS );
+	FS_Write( "}", 1, dx.file );
+}
+
+
+static void CL_ExportEvent( int serverTime, int entityNum, int event, int eventParm ) {
+	FS_Printf( dx.file, "{\"type\":\"event\",\"t\":%i,\"n\":%i,\"event\":%i,\"parm\":%i}\n",
+		serverTime, entityNum, event & ~EXPORT_EVENT_BITS, eventParm );
+	dx.numEvents++;
+}
+
+
+/*
+=================
+CL_ExportGamestate
+=================
+*/
+static void CL_ExportGamestate( void ) {
+	int i, n;
+
+	FS_Printf( dx.file, "{\"type\":\"gamestate\",\"seq\":%i,\"clientNum\":%i,\"cs\":{",
+		clc.serverMessageSequence, clc.clientNum );
+
+	for ( i = 0, n = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		if ( !cl.gameState.stringOffsets[i] ) {
+			continue;
+		}
+		FS_Printf( dx.file, n++ ? ",\"%i\":" : "\"%i\":", i );
+		CL_ExportString( cl.gameState.stringData + cl.gameState.stringOffsets[i] );
+	}
+
+	FS_Write( "}}\n", 3, dx.file );
+
+	// baselines aren't exported, entities always come with every field
+	Com_Memset( dx.present, 0, sizeof( dx.present ) );
+	dx.havePlayerstate = qfalse;
+	dx.lastCommand = clc.serverCommandSequence;
+}
+
+
+/*
+=================
+CL_ExportCommands
+
+Writes the commands that arrived since the last call and runs their
+client side so configstrings stay current without a cgame
+=================
+*/
+static void CL_ExportCommands( void ) {
+	int i;
+
+	if ( clc.serverCommandSequence - dx.lastCommand > MAX_RELIABLE_COMMANDS ) {
+		dx.lastCommand = clc.serverCommandSequence - MAX_RELIABLE_COMMANDS;
+	}
+
+	for ( i = dx.lastCommand + 1; clc.serverCommandSequence - i >= 0; i++ ) {
+		FS_Printf( dx.file, "{\"type\":\"cmd\",\"t\":%i,\"seq\":%i,\"text\":", cl.snap.serverTime, i );
+		CL_ExportString( clc.serverCommands[ i & ( MAX_RELIABLE_COMMANDS - 1 ) ] );
+		FS_Write( "}\n", 2, dx.file );
+	}
+
+	dx.lastCommand = clc.serverCommandSequence;
+
+	CL_SkipServerCommands();
+}
+
+
+/*
+=================
+CL_ExportSnapshot
+=================
+*/
+static void CL_ExportSnapshot( void ) {
+	const clSnapshot_t *snap = &cl.snap;
+	const entityState_t *es;
+	byte	present[ MAX_GENTITIES ];
+	int		i, n, seq;
+
+	// events first, so readers can attach them to the snapshot that follows
+	if ( dx.havePlayerstate ) {
+		seq = dx.ps.eventSequence;
+		if ( snap->ps.eventSequence - seq > MAX_PS_EVENTS ) {
+			seq = snap->ps.eventSequence - MAX_PS_EVENTS;
+		}
+		for ( ; seq - snap->ps.eventSequence < 0; seq++ ) {
+			i = seq & ( MAX_PS_EVENTS - 1 );
+			CL_ExportEvent( snap->serverTime, snap->ps.clientNum, snap->ps.events[i], snap->ps.eventParms[i] );
+		}
+		if ( snap->ps.externalEvent && snap->ps.externalEvent != dx.ps.externalEvent ) {
+			CL_ExportEvent( snap->serverTime, snap->ps.clientNum, snap->ps.externalEvent, snap->ps.externalEventParm );
+		}
+	}
+
+	Com_Memset( present, 0, sizeof( present ) );
+	for ( i = 0; i < snap->numEntities; i++ ) {
+		es = &cl.parseEntities[ ( snap->parseEntitiesNum + i ) & ( MAX_PARSE_ENTITIES - 1 ) ];
+		present[ es->number ] = 1;
+		if ( !( es->event & ~EXPORT_EVENT_BITS ) ) {
+			continue;
+		}
+		// same rule as the cgame, a changed toggle bit is a new event
+		if ( !dx.present[ es->number ] || es->event != dx.ents[ es->number ].event ) {
+			CL_ExportEvent( snap->serverTime, es->number, es->event, es->eventParm );
+		}
+	}
+
+	FS_Printf( dx.file, "{\"type\":\"snap\",\"t\":%i,\"seq\":%i,\"flags\":%i,\"ping\":%i",
+		snap->serverTime, snap->messageNum, snap->snapFlags, snap->ping );
+
+	if ( !dx.havePlayerstate || memcmp( &dx.ps, &snap->ps, sizeof( dx.ps ) ) ) {
+		CL_ExportPlayerstate( &snap->ps );
+		dx.ps = snap->ps;
+		dx.havePlayerstate = qtrue;
+	}
+
+	FS_Write( ",\"ents\":[", 9, dx.file );
+	for ( i = 0, n = 0; i < snap->numEntities; i++ ) {
+		es = &cl.parseEntities[ ( snap->parseEntitiesNum + i ) & ( MAX_PARSE_ENTITIES - 1 ) ];
+		if ( dx.present[ es->number ] && !memcmp( &dx.ents[ es->number ], es, sizeof( *es ) ) ) {
+			continue;
+		}
+		if ( n++ ) {
+			FS_Write( ",", 1, dx.file );
+		}
+		CL_ExportEntity( es, dx.present[ es->number ] ? qfalse : qtrue );
+		dx.ents[ es->number ] = *es;
+	}
+
+	FS_Write( "],\"removed\":[", 13, dx.file );
+	for ( i = 0, n = 0; i < MAX_GENTITIES; i++ ) {
+		if ( dx.present[i] && !present[i] ) {
+			FS_Printf( dx.file, n++ ? ",%i" : "%i", i );
+		}
+	}
+	FS_Write( "]}\n", 3, dx.file );
+
+	Com_Memcpy( dx.present, present, sizeof( dx.present ) );
+	dx.lastSnapshot = snap->messageNum;
+	dx.numSnapshots++;
+}
+
+
+/*
+=================
+CL_ExportReadMessage
+
+Reads and parses the next demo message, qfalse at the end of the demo
+=================
+*/
+static qboolean CL_ExportReadMessage( void ) {
+	byte	bufData[ MAX_MSGLEN_BUF ];
+	msg_t	buf;
+	int		s;
+
+	if ( FS_Read( &s, 4, clc.demofile ) != 4 ) {
+		return qfalse;
+	}
+	clc.serverMessageSequence = LittleLong( s );
+
+	MSG_Init( &buf, bufData, MAX_MSGLEN );
+
+	if ( FS_Read( &buf.cursize, 4, clc.demofile ) != 4 ) {
+		return qfalse;
+	}
+	buf.cursize = LittleLong( buf.cursize );
+	if ( buf.cursize == -1 ) {
+		return qfalse;
+	}
+	if ( buf.cursize < 0 || buf.cursize > buf.maxsize ) {
+		Com_Printf( S_COLOR_YELLOW "%s: bad message length\n", clc.demoName );
+		return qfalse;
+	}
+	if ( FS_Read( buf.data, buf.cursize, clc.demofile ) != buf.cursize ) {
+		Com_Printf( S_COLOR_YELLOW "%s: demo file was truncated\n", clc.demoName );
+		return qfalse;
+	}
+
+	CL_ParseServerMessage( &buf );
+
+	return qtrue;
+}
+
+
+/*
+=================
+CL_ExportDemo
+=================
+*/
+static void CL_ExportDemo( const char *name ) {
+	char	outName[ MAX_OSPATH ];
+	const char *ext, *s;
+	fileHandle_t f;
+	int		t0;
+
+	FS_BypassPure();
+	FS_FOpenFileRead( name, &f, qtrue );
+	FS_RestorePure();
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "couldn't open %s\n", name );
+		return;
+	}
+
+	s = name;
+	if ( !Q_stricmpn( s, "demos/", 6 ) ) {
+		s += 6;
+	}
+	Com_sprintf( outName, sizeof( outName ), "exports/%s.ndjson", s );
+
+	dx.file = FS_FOpenFileWrite( outName );
+	if ( dx.file == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "couldn't write %s\n", outName );
+		FS_FCloseFile( f );
+		return;
+	}
+
+	t0 = Sys_Milliseconds();
+
+	// parse-only connection, CL_ParseGamestate doesn't load anything for it
+	CL_ClearState();
+	Com_Memset( &clc, 0, sizeof( clc ) );
+	clc.demofile = f;
+	clc.demoplaying = qtrue;
+	clc.demoexport = qtrue;
+	Q_strncpyz( clc.demoName, name, sizeof( clc.demoName ) );
+
+	ext = strrchr( name, '.' );
+	if ( ext && !Q_stricmpn( ext + 1, DEMOEXT, ARRAY_LEN( DEMOEXT ) - 1 ) && atoi( ext + ARRAY_LEN( DEMOEXT ) ) <= OLD_PROTOCOL_VERSION ) {
+		clc.compat = qtrue;
+	}
+
+	dx.lastSnapshot = 0;
+	dx.numSnapshots = 0;
+	dx.numEvents = 0;
+	dx.havePlayerstate = qfalse;
+	Com_Memset( dx.present, 0, sizeof( dx.present ) );
+
+	while ( CL_ExportReadMessage() ) {
+		if ( clc.eventMask & EM_GAMESTATE ) {
+			CL_ExportGamestate();
+		}
+		if ( clc.eventMask & EM_COMMAND ) {
+			CL_ExportCommands();
+		}
+		if ( ( clc.eventMask & EM_SNAPSHOT ) && cl.snap.valid && cl.snap.messageNum != dx.lastSnapshot ) {
+			CL_ExportSnapshot();
+		}
+	}
+
+	FS_FCloseFile( dx.file );
+	dx.file = FS_INVALID_HANDLE;
+
+	Com_Printf( "%s: %i snapshots, %i events, %i msec\n", outName, dx.numSnapshots, dx.numEvents, Sys_Milliseconds() - t0 );
+
+	FS_FCloseFile( clc.demofile );
+	CL_ClearState();
+	Com_Memset( &clc, 0, sizeof( clc ) );
+}
+
+
+static int QDECL CL_ExportCompare( const void *a, const void *b ) {
+	return Q_stricmp( *(const char **)a, *(const char **)b );
+}
+
+
+/*
+=================
+CL_IsDemoName
+=================
+*/
+static qboolean CL_IsDemoName( const char *name ) {
+	const char *ext;
+
+	ext = strrchr( name, '.' );
+	if ( !ext || Q_stricmpn( ext + 1, DEMOEXT, ARRAY_LEN( DEMOEXT ) - 1 ) ) {
+		return qfalse;
+	}
+
+	ext += ARRAY_LEN( DEMOEXT );
+	return ( ext[0] >= '0' && ext[0] <= '9' && ext[1] >= '0' && ext[1] <= '9' && !ext[2] ) ? qtrue : qfalse;
+}
+
+
+/*
+=================
+CL_DemoExport_f
+
+demo_export <demo | directory> [<shard>/<shards>]
+=================
+*/
+void CL_DemoExport_f( void ) {
+	char	path[ MAX_OSPATH ];
+	char	**list;
+	const char *arg, *slash;
+	int		i, num, shard, shards, done;
+
+	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 ) {
+		Com_Printf( "usage: demo_export <demo | directory> [<shard>/<shards>]\n" );
+		return;
+	}
+
+	shard = 0;
+	shards = 1;
+	if ( Cmd_Argc() == 3 ) {
+		arg = Cmd_Argv( 2 );
+		slash = strchr( arg, '/' );
+		if ( slash ) {
+			shard = atoi( arg );
+			shards = atoi( slash + 1 );
+		}
+		if ( !slash || shards < 1 || shard < 0 || shard >= shards ) {
+			Com_Printf( "demo_export: shard must be <n>/<count> with 0 <= n < count\n" );
+			return;
+		}
+	}
+
+	if ( dx.file != FS_INVALID_HANDLE ) {
+		// left open by an error in the last run
+		FS_FCloseFile( dx.file );
+		dx.file = FS_INVALID_HANDLE;
+	}
+
+	// the connection state is shared with playback
+	CL_Disconnect( qfalse );
+
+	arg = Cmd_Argv( 1 );
+	if ( Q_stricmpn( arg, "demos/", 6 ) ) {
+		Com_sprintf( path, sizeof( path ), "demos/%s", arg );
+	} else {
+		Q_strncpyz( path, arg, sizeof( path ) );
+	}
+
+	if ( CL_IsDemoName( path ) ) {
+		CL_ExportDemo( path );
+		return;
+	}
+
+	list = FS_ListFiles( path, "", &num );
+	if ( list && num > 1 ) {
+		qsort( list, num, sizeof( list[0] ), CL_ExportCompare );
+	}
+
+	done = 0;
+	for ( i = 0; i < num; i++ ) {
+		if ( !CL_IsDemoName( list[i] ) ) {
+			continue;
+		}
+		// the same ordering in every process makes the shards disjoint
+		if ( done++ % shards != shard ) {
+			continue;
+		}
+		CL_ExportDemo( va( "%s/%s", path, list[i] ) );
+	}
+
+	if ( list ) {
+		FS_FreeFileList( list );
+	}
+
+	if ( !done ) {
+		Com_Printf( "demo_export: no demos in %s\n", path );
+	}
+}
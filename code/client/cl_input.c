@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static unsigned frame_msec;
 static int old_com_frameTime;
+static int cmd_frameTime;		// time the command being built samples up to
 
 /*
 ===============================================================================
@@ -79,6 +80,7 @@ static cvar_t *cl_anglespeedkey;
 
 static cvar_t *cl_maxpackets;
 static cvar_t *cl_packetdup;
+static cvar_t *cl_asyncInput;
 
 static cvar_t *m_pitch;
 static cvar_t *m_yaw;
@@ -200,11 +202,11 @@ static float CL_KeyState( kbutton_t *key ) {
 	if ( key->active ) {
 		// still down
 		if ( !key->downtime ) {
-			msec = com_frameTime;
+			msec = cmd_frameTime;
 		} else {
-			msec += com_frameTime - key->downtime;
+			msec += cmd_frameTime - key->downtime;
 		}
-		key->downtime = com_frameTime;
+		key->downtime = cmd_frameTime;
 	}
 
 #if 0
@@ -636,10 +638,11 @@ static usercmd_t CL_CreateCmd( void ) {
 =================
 CL_CreateNewCommands
 
-Create a new usercmd_t structure for this frame
+Create a new usercmd_t structure for this frame,
+input is sampled up to frameTime
 =================
 */
-static void CL_CreateNewCommands( void ) {
+static void CL_CreateNewCommands( int frameTime ) {
 	int			cmdNum;
 
 	// no need to create usercmds until we have a gamestate
@@ -647,7 +650,8 @@ static void CL_CreateNewCommands( void ) {
 		return;
 	}
 
-	frame_msec = com_frameTime - old_com_frameTime;
+	cmd_frameTime = frameTime;
+	frame_msec = frameTime - old_com_frameTime;
 
 	// if running over 1000fps, act as if each frame is 1ms
 	// prevents divisions by zero
@@ -660,7 +664,7 @@ static void CL_CreateNewCommands( void ) {
 	if ( frame_msec > 200 ) {
 		frame_msec = 200;
 	}
-	old_com_frameTime = com_frameTime;
+	old_com_frameTime = frameTime;
 
 
 	// generate a command for this frame
@@ -866,7 +870,7 @@ void CL_SendCmd( void ) {
 	}
 
 	// we create commands even if a demo is playing,
-	CL_CreateNewCommands();
+	CL_CreateNewCommands( com_frameTime );
 
 	// don't send a packet if the last packet was sent too recently
 	if ( !CL_ReadyToSendPacket() ) {
@@ -880,6 +884,71 @@ void CL_SendCmd( void ) {
 }
 
 
+/*
+=================
+CL_SendAsyncCmd
+
+Called while Com_Frame waits for the next frame, with \cl_asyncInput
+a packet that becomes due between rendered frames is sent right away
+with a usercmd that includes all input received so far
+=================
+*/
+void CL_SendAsyncCmd( void ) {
+	static int	framecount;
+	static int	added;		// msec already added to cl.serverTime this frame
+	int		oldPacketNum;
+	int		elapsed, realtime;
+
+	if ( !com_cl_running || !com_cl_running->integer || !cl_asyncInput->integer ) {
+		return;
+	}
+
+	if ( cls.state != CA_ACTIVE || clc.demoplaying ) {
+		return;
+	}
+
+	if ( com_sv_running->integer && sv_paused->integer && cl_paused->integer ) {
+		return;
+	}
+
+	// these send every frame anyway
+	if ( clc.netchan.remoteAddress.type == NA_LOOPBACK || ( cl_lanForcePackets->integer && clc.netchan.isLANAddress ) ) {
+		return;
+	}
+
+	if ( framecount != cls.framecount ) {
+		framecount = cls.framecount;
+		added = 0;
+	}
+
+	elapsed = Sys_Milliseconds() - com_frameTime;
+	if ( elapsed <= added ) {
+		return;
+	}
+
+	oldPacketNum = (clc.netchan.outgoingSequence - 1) & PACKET_MASK;
+	if ( cls.realtime + elapsed - cl.outPackets[ oldPacketNum ].p_realtime < 1000 / cl_maxpackets->integer ) {
+		return;
+	}
+
+	// time has moved on since the frame started or the last async packet,
+	// the next frame continues from here so it never goes backwards
+	cl.serverTime += elapsed - added;
+	added = elapsed;
+	if ( cl.oldServerTime - cl.serverTime < 0 ) {
+		cl.oldServerTime = cl.serverTime;
+	}
+
+	CL_CreateNewCommands( com_frameTime + elapsed );
+
+	// stamp the packet with the time it actually leaves
+	realtime = cls.realtime;
+	cls.realtime += elapsed;
+	CL_WritePacket();
+	cls.realtime = realtime;
+}
+
+
 /*
 ============
 CL_InitInput
@@ -971,6 +1040,9 @@ void CL_InitInput( void ) {
 	cl_packetdup = Cvar_Get( "cl_packetdup", "1", CVAR_ARCHIVE_ND );
 	Cvar_CheckRange( cl_packetdup, "0", "5", CV_INTEGER );
 	Cvar_SetDescription( cl_packetdup, "Limits the number of previous client commands added in packet, helps in packet loss mitigation, increases client command packets size a bit." );
+	cl_asyncInput = Cvar_Get( "cl_asyncInput", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_asyncInput, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cl_asyncInput, "Send packets at the \\cl_maxpackets rate between rendered frames, each with a usercmd sampled right before it goes out. Lowers input latency when \\com_maxfps is below \\cl_maxpackets." );
 
 	cl_run = Cvar_Get( "cl_run", "1", CVAR_ARCHIVE_ND );
 	Cvar_SetDescription( cl_run, "Persistent player running movement." );
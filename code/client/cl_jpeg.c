@@ -37,11 +37,17 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #	if JPEG_LIB_VERSION < 80 && !defined(MEM_SRCDST_SUPPORTED)
 #		error Need system libjpeg >= 80 or jpeg_mem_ support
 #	endif
+#	ifdef JCS_ALPHA_EXTENSIONS
+		// libjpeg-turbo, its SIMD color converter writes RGBA directly
+#		define JPEG_OUTPUT_RGBA
+#	endif
 #else
 #	define JPEG_INTERNALS
 #	include "../libjpeg/jpeglib.h"
 #endif
 
+#define JPEG_MAX_LINES 16 // scanlines passed per jpeg_read/write_scanlines call
+
 /* Catching errors, as done in libjpeg's example.c */
 typedef struct q_jpeg_error_mgr_s
 {
@@ -99,10 +105,13 @@ void CL_LoadJPG( const char *filename, unsigned char **pic, int *width, int *hei
 	*/
 	q_jpeg_error_mgr_t jerr;
 	/* More stuff */
-	JSAMPARRAY buffer;		/* Output row buffer */
+	JSAMPROW rows[JPEG_MAX_LINES];	/* Output row pointers */
+	unsigned int i, lines;
 	unsigned int row_stride;	/* physical row width in output buffer */
 	unsigned int pixelcount, memcount;
+#ifndef JPEG_OUTPUT_RGBA
 	unsigned int sindex, dindex;
+#endif
 	byte *out;
 	int len;
 	union {
@@ -169,7 +178,11 @@ void CL_LoadJPG( const char *filename, unsigned char **pic, int *width, int *hei
    * Make sure it always converts images to RGB color space. This will
    * automatically convert 8-bit greyscale images to RGB as well.
    */
+#ifdef JPEG_OUTPUT_RGBA
+  cinfo.out_color_space = JCS_EXT_RGBA;
+#else
   cinfo.out_color_space = JCS_RGB;
+#endif
 
   /* Step 5: Start decompressor */
 
@@ -190,7 +203,11 @@ void CL_LoadJPG( const char *filename, unsigned char **pic, int *width, int *hei
 
   if(!cinfo.output_width || !cinfo.output_height
       || ((pixelcount * 4) / cinfo.output_width) / 4 != cinfo.output_height
+#ifdef JPEG_OUTPUT_RGBA
+      || pixelcount > 0x1FFFFFFF || cinfo.output_components != 4
+#else
       || pixelcount > 0x1FFFFFFF || cinfo.output_components != 3
+#endif
     )
   {
     // Free the memory to make sure we don't leak memory
@@ -217,14 +234,18 @@ void CL_LoadJPG( const char *filename, unsigned char **pic, int *width, int *hei
    */
   while (cinfo.output_scanline < cinfo.output_height) {
     /* jpeg_read_scanlines expects an array of pointers to scanlines.
-     * Here the array is only one element long, but you could ask for
-     * more than one scanline at a time if that's more convenient.
+     * Asking for several rows at once lets the library hand out a whole
+     * iMCU row of upsampled and color converted data per call.
      */
-	buf = ((out+(row_stride*cinfo.output_scanline)));
-	buffer = &buf;
-    (void) jpeg_read_scanlines(&cinfo, buffer, 1);
+    lines = cinfo.output_height - cinfo.output_scanline;
+    if ( lines > JPEG_MAX_LINES )
+      lines = JPEG_MAX_LINES;
+    for ( i = 0; i < lines; i++ )
+      rows[i] = out + row_stride * ( cinfo.output_scanline + i );
+    (void) jpeg_read_scanlines(&cinfo, rows, lines);
   }
-  
+
+#ifndef JPEG_OUTPUT_RGBA
   buf = out;
 
   // Expand from RGB to RGBA
@@ -238,6 +259,7 @@ void CL_LoadJPG( const char *filename, unsigned char **pic, int *width, int *hei
     buf[--dindex] = buf[--sindex];
     buf[--dindex] = buf[--sindex];
   } while(sindex);
+#endif
 
   *pic = out;
 
@@ -388,7 +410,8 @@ size_t CL_SaveJPGToBuffer(byte *buffer, size_t bufSize, int quality,
 {
   struct jpeg_compress_struct cinfo;
   q_jpeg_error_mgr_t jerr;
-  JSAMPROW row_pointer[1];	/* pointer to JSAMPLE row[s] */
+  JSAMPROW row_pointer[JPEG_MAX_LINES];	/* pointer to JSAMPLE row[s] */
+  unsigned int i, lines;
   my_dest_ptr dest;
   int row_stride;		/* physical row width in image buffer */
   size_t outcount;
@@ -440,12 +463,15 @@ size_t CL_SaveJPGToBuffer(byte *buffer, size_t bufSize, int quality,
   row_stride = image_width * cinfo.input_components + padding; /* JSAMPLEs per row in image_buffer */
   
   while (cinfo.next_scanline < cinfo.image_height) {
-    /* jpeg_write_scanlines expects an array of pointers to scanlines.
-     * Here the array is only one element long, but you could pass
-     * more than one scanline at a time if that's more convenient.
+    /* jpeg_write_scanlines expects an array of pointers to scanlines,
+     * source image is bottom-up so rows are passed in reverse order.
      */
-    row_pointer[0] = &image_buffer[((cinfo.image_height-1)*row_stride)-cinfo.next_scanline * row_stride];
-    (void) jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    lines = cinfo.image_height - cinfo.next_scanline;
+    if ( lines > JPEG_MAX_LINES )
+      lines = JPEG_MAX_LINES;
+    for ( i = 0; i < lines; i++ )
+      row_pointer[i] = &image_buffer[(cinfo.image_height-1-cinfo.next_scanline-i) * row_stride];
+    (void) jpeg_write_scanlines(&cinfo, row_pointer, lines);
   }
 
   /* Step 6: Finish compression */
@@ -38,14 +38,22 @@ cvar_t	*rconAddress;
 cvar_t	*cl_timeout;
 cvar_t	*cl_autoNudge;
 cvar_t	*cl_timeNudge;
+cvar_t	*cl_jitterBuffer;
+cvar_t	*cl_snapJitter;
+cvar_t	*cl_snapBufferDepth;
+cvar_t	*cl_traceCache;
 cvar_t	*cl_showTimeDelta;
 
 cvar_t	*cl_shownet;
 cvar_t	*cl_autoRecordDemo;
 cvar_t	*cl_drawRecording;
+static cvar_t	*cl_demoKeyframes;
+static cvar_t	*cl_headless;
 
 cvar_t	*cl_aviFrameRate;
 cvar_t	*cl_aviMotionJpeg;
+cvar_t	*cl_aviMotionJpegQuality;
+cvar_t	*cl_aviEncoders;
 cvar_t	*cl_forceavidemo;
 cvar_t	*cl_aviPipeFormat;
 
@@ -62,6 +70,7 @@ cvar_t	*cl_conColor;
 cvar_t	*cl_inGameVideo;
 
 cvar_t	*cl_serverStatusResendTime;
+cvar_t	*cl_serverCache;
 
 cvar_t	*cl_lanForcePackets;
 
@@ -69,6 +78,7 @@ cvar_t	*cl_guidServerUniq;
 
 cvar_t	*cl_dlURL;
 cvar_t	*cl_dlDirectory;
+cvar_t	*cl_dlParallel;
 
 cvar_t	*cl_reconnectArgs;
 
@@ -330,37 +340,20 @@ static void CL_WriteServerCommands( msg_t *msg ) {
 
 /*
 ====================
-CL_WriteGamestate
+CL_EmitGamestate
+
+Writes the current configstrings and baselines as svc_gamestate
 ====================
 */
-static void CL_WriteGamestate( qboolean initial )
+static void CL_EmitGamestate( msg_t *msg, int commandSequence )
 {
-	byte		bufData[ MAX_MSGLEN_BUF ];
 	char		*s;
-	msg_t		msg;
 	int			i;
-	int			len;
 	entityState_t	*ent;
 	entityState_t	nullstate;
 
-	// write out the gamestate message
-	MSG_Init( &msg, bufData, MAX_MSGLEN );
-	MSG_Bitstream( &msg );
-
-	// NOTE, MRE: all server->client messages now acknowledge
-	MSG_WriteLong( &msg, clc.reliableSequence );
-
-	if ( initial ) {
-		clc.demoMessageSequence = 1;
-		clc.demoCommandSequence = clc.serverCommandSequence;
-	} else {
-		CL_WriteServerCommands( &msg );
-	}
-
-	clc.demoDeltaNum = 0; // reset delta for next snapshot
-
-	MSG_WriteByte( &msg, svc_gamestate );
-	MSG_WriteLong( &msg, clc.serverCommandSequence );
+	MSG_WriteByte( msg, svc_gamestate );
+	MSG_WriteLong( msg, commandSequence );
 
 	// configstrings
 	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
@@ -368,9 +361,9 @@ static void CL_WriteGamestate( qboolean initial )
 			continue;
 		}
 		s = cl.gameState.stringData + cl.gameState.stringOffsets[i];
-		MSG_WriteByte( &msg, svc_configstring );
-		MSG_WriteShort( &msg, i );
-		MSG_WriteBigString( &msg, s );
+		MSG_WriteByte( msg, svc_configstring );
+		MSG_WriteShort( msg, i );
+		MSG_WriteBigString( msg, s );
 	}
 
 	// baselines
@@ -379,20 +372,51 @@ static void CL_WriteGamestate( qboolean initial )
 		if ( !cl.baselineUsed[ i ] )
 			continue;
 		ent = &cl.entityBaselines[ i ];
-		MSG_WriteByte( &msg, svc_baseline );
-		MSG_WriteDeltaEntity( &msg, &nullstate, ent, qtrue );
+		MSG_WriteByte( msg, svc_baseline );
+		MSG_WriteDeltaEntity( msg, &nullstate, ent, qtrue );
 	}
 
 	// finalize message
-	MSG_WriteByte( &msg, svc_EOF );
+	MSG_WriteByte( msg, svc_EOF );
 
 	// finished writing the gamestate stuff
 
 	// write the client num
-	MSG_WriteLong( &msg, clc.clientNum );
+	MSG_WriteLong( msg, clc.clientNum );
 
 	// write the checksum feed
-	MSG_WriteLong( &msg, clc.checksumFeed );
+	MSG_WriteLong( msg, clc.checksumFeed );
+}
+
+
+/*
+====================
+CL_WriteGamestate
+====================
+*/
+static void CL_WriteGamestate( qboolean initial )
+{
+	byte		bufData[ MAX_MSGLEN_BUF ];
+	msg_t		msg;
+	int			len;
+
+	// write out the gamestate message
+	MSG_Init( &msg, bufData, MAX_MSGLEN );
+	MSG_Bitstream( &msg );
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	MSG_WriteLong( &msg, clc.reliableSequence );
+
+	if ( initial ) {
+		clc.demoMessageSequence = 1;
+		clc.demoCommandSequence = clc.serverCommandSequence;
+	} else {
+		CL_WriteServerCommands( &msg );
+	}
+
+	clc.demoDeltaNum = 0; // reset delta for next snapshot
+
+	CL_EmitGamestate( &msg, clc.serverCommandSequence );
 
 	// finished writing the client packet
 	MSG_WriteByte( &msg, svc_EOF );
@@ -478,6 +502,29 @@ static void CL_EmitPacketEntities( clSnapshot_t *from, clSnapshot_t *to, msg_t *
 }
 
 
+/*
+=============
+CL_EmitSnapshot
+
+Writes snap as svc_snapshot, delta compressed against oldSnap if there is one
+=============
+*/
+static void CL_EmitSnapshot( msg_t *msg, clSnapshot_t *snap, clSnapshot_t *oldSnap, entityState_t *oldents ) {
+	MSG_WriteByte( msg, svc_snapshot );
+	MSG_WriteLong( msg, snap->serverTime ); // sv.time
+	MSG_WriteByte( msg, oldSnap ? 1 : 0 );  // deltaNum
+	MSG_WriteByte( msg, snap->snapFlags );  // snapFlags
+	MSG_WriteByte( msg, snap->areabytes );  // areabytes
+	MSG_WriteData( msg, snap->areamask, snap->areabytes );
+	if ( oldSnap )
+		MSG_WriteDeltaPlayerstate( msg, &oldSnap->ps, &snap->ps );
+	else
+		MSG_WriteDeltaPlayerstate( msg, NULL, &snap->ps );
+
+	CL_EmitPacketEntities( oldSnap, snap, msg, oldents );
+}
+
+
 /*
 ====================
 CL_WriteSnapshot
@@ -512,18 +559,7 @@ static void CL_WriteSnapshot( void ) {
 	// Write all pending server commands
 	CL_WriteServerCommands( &msg );
 
-	MSG_WriteByte( &msg, svc_snapshot );
-	MSG_WriteLong( &msg, snap->serverTime ); // sv.time
-	MSG_WriteByte( &msg, clc.demoDeltaNum ); // 0 or 1
-	MSG_WriteByte( &msg, snap->snapFlags );  // snapFlags
-	MSG_WriteByte( &msg, snap->areabytes );  // areabytes
-	MSG_WriteData( &msg, snap->areamask, snap->areabytes );
-	if ( oldSnap )
-		MSG_WriteDeltaPlayerstate( &msg, &oldSnap->ps, &snap->ps );
-	else
-		MSG_WriteDeltaPlayerstate( &msg, NULL, &snap->ps );
-
-	CL_EmitPacketEntities( oldSnap, snap, &msg, saved_ents );
+	CL_EmitSnapshot( &msg, snap, oldSnap, saved_ents );
 
 	// finished writing the client packet
 	MSG_WriteByte( &msg, svc_EOF );
@@ -634,6 +670,9 @@ static void CL_Record_f( void ) {
 		return;
 	}
 
+	// messages are written every frame, keep the disk out of it
+	FS_BufferWrites( clc.recordfile );
+
 	clc.demorecording = qtrue;
 
 	Com_TruncateLongString( clc.recordNameShort, clc.recordName );
@@ -682,6 +721,471 @@ CLIENT SIDE DEMO PLAYBACK
 =======================================================================
 */
 
+/*
+=================
+Timedemo benchmark
+
+With timedemo 2 every frame is logged to benchmarks/<demo>.csv
+and the slowest frames are reported when the demo completes
+=================
+*/
+#define MAX_BENCHMARK_FRAMES 131072	// frames kept for the report, CSV has all of them
+
+typedef struct {
+	fileHandle_t	file;
+	float		*frameMsec;
+	int			numFrames;
+	int64_t		lastTime;
+	char		name[ MAX_QPATH ];
+} benchmark_t;
+
+static benchmark_t bench;
+
+
+static void CL_BenchmarkStart( void ) {
+	char name[ MAX_QPATH ];
+
+	COM_StripExtension( clc.demoName, name, sizeof( name ) );
+	Com_sprintf( bench.name, sizeof( bench.name ), "benchmarks/%s.csv", name );
+
+	bench.file = FS_FOpenFileWrite( bench.name );
+	if ( bench.file == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "couldn't open %s\n", bench.name );
+		return;
+	}
+
+	FS_Printf( bench.file, "frame,frame_ms,frontend_ms,backend_ms,gpu_ms,surfaces,shaders,pipelines\n" );
+
+	bench.frameMsec = Z_Malloc( MAX_BENCHMARK_FRAMES * sizeof( bench.frameMsec[0] ) );
+	bench.numFrames = 0;
+	bench.lastTime = 0;
+}
+
+
+static void CL_BenchmarkStop( void ) {
+	if ( bench.file != FS_INVALID_HANDLE ) {
+		FS_FCloseFile( bench.file );
+		bench.file = FS_INVALID_HANDLE;
+	}
+	if ( bench.frameMsec ) {
+		Z_Free( bench.frameMsec );
+		bench.frameMsec = NULL;
+	}
+	if ( re.GetFrameStats ) {
+		re.GetFrameStats( NULL );
+	}
+}
+
+
+/*
+=================
+CL_BenchmarkFrame
+
+Called after the screen has been updated
+=================
+*/
+static void CL_BenchmarkFrame( void ) {
+	frameStats_t stats;
+	int64_t now;
+	float msec;
+
+	if ( bench.file == FS_INVALID_HANDLE || !clc.timeDemoStart ) {
+		return;
+	}
+
+	Com_Memset( &stats, 0, sizeof( stats ) );
+	if ( re.GetFrameStats ) {
+		re.GetFrameStats( &stats );
+	}
+
+	now = Sys_Microseconds();
+	if ( !bench.lastTime ) {
+		// first timed frame is only a starting point
+		bench.lastTime = now;
+		return;
+	}
+
+	msec = ( now - bench.lastTime ) * 0.001f;
+	bench.lastTime = now;
+
+	if ( bench.numFrames < MAX_BENCHMARK_FRAMES ) {
+		bench.frameMsec[ bench.numFrames ] = msec;
+	}
+	bench.numFrames++;
+
+	FS_Printf( bench.file, "%i,%.3f,%.3f,%.3f,%.3f,%i,%i,%i\n", bench.numFrames, msec,
+		stats.frontEndUsec * 0.001f, stats.backEndUsec * 0.001f, stats.gpuMsec,
+		stats.surfaces, stats.shaders, stats.pipelines );
+}
+
+
+static int QDECL CL_BenchmarkCompare( const void *a, const void *b ) {
+	const float fa = *(const float *)a;
+	const float fb = *(const float *)b;
+
+	// slowest first
+	return ( fa < fb ) - ( fa > fb );
+}
+
+
+/*
+=================
+CL_BenchmarkLow
+
+Average fps of the slowest 1/divisor of sorted frames
+=================
+*/
+static double CL_BenchmarkLow( int numFrames, int divisor ) {
+	double sum;
+	int i, n;
+
+	n = MAX( numFrames / divisor, 1 );
+
+	sum = 0.0;
+	for ( i = 0; i < n; i++ ) {
+		sum += bench.frameMsec[i];
+	}
+
+	return sum > 0.0 ? n * 1000.0 / sum : 0.0;
+}
+
+
+static void CL_BenchmarkReport( void ) {
+	int numFrames;
+
+	if ( bench.file == FS_INVALID_HANDLE || !bench.frameMsec ) {
+		return;
+	}
+
+	numFrames = MIN( bench.numFrames, MAX_BENCHMARK_FRAMES );
+	if ( numFrames > 0 ) {
+		qsort( bench.frameMsec, numFrames, sizeof( bench.frameMsec[0] ), CL_BenchmarkCompare );
+		Com_Printf( "1%% low %3.1f fps, 0.1%% low %3.1f fps, slowest frame %.2f msec\n",
+			CL_BenchmarkLow( numFrames, 100 ), CL_BenchmarkLow( numFrames, 1000 ), bench.frameMsec[0] );
+	}
+
+	Com_Printf( "Frame log written to %s\n", bench.name );
+}
+
+
+/*
+=======================================================================
+
+DEMO KEYFRAME INDEX
+
+While a demo plays, every cl_demoKeyframes seconds the client state is
+saved as a gamestate message followed by a non-delta snapshot message,
+together with the demo file position that comes after the snapshot.
+demo_seek restores the closest keyframe in front of the target and reads
+forward from there. The index is kept next to the demo as <demo>.idx so
+the next playback can seek right away.
+
+=======================================================================
+*/
+
+#define MAX_DEMO_KEYFRAMES	512		// every other one is dropped when full
+
+#define DEMO_INDEX_IDENT	(('X'<<24)+('D'<<16)+('M'<<8)+'D')	// "DMDX"
+#define DEMO_INDEX_VERSION	1
+#define DEMO_INDEX_HEADER	6		// ints: ident, version, demoLength, indexedOffset, spacing, numKeyframes
+#define DEMO_KEYFRAME_HEADER	6	// ints: serverTime, sequence, commandSequence, offset, gamestateSize, snapshotSize
+
+typedef struct {
+	int		serverTime;
+	int		sequence;			// message number of the snapshot
+	int		commandSequence;	// last server command in the configstrings
+	int		offset;				// demo file position after the snapshot
+	int		gamestateSize;
+	int		snapshotSize;
+	byte	*data;				// gamestate message followed by the snapshot message
+} demoKeyframe_t;
+
+typedef struct {
+	char		name[ MAX_OSPATH ];
+	int			demoLength;
+	int			indexedOffset;	// demo messages up to here were looked at
+	int			spacing;		// msec between keyframes
+	qboolean	modified;
+	qboolean	seeking;		// end of file does not complete the demo
+	qboolean	reachedEnd;
+	int			numKeyframes;
+	demoKeyframe_t	keyframes[ MAX_DEMO_KEYFRAMES ];
+} demoIndex_t;
+
+static demoIndex_t demoIndex;
+
+
+static void CL_DemoIndexFree( void ) {
+	int i;
+
+	for ( i = 0; i < demoIndex.numKeyframes; i++ ) {
+		Z_Free( demoIndex.keyframes[i].data );
+	}
+
+	demoIndex.numKeyframes = 0;
+	demoIndex.indexedOffset = 0;
+	demoIndex.modified = qfalse;
+}
+
+
+static int CL_DemoIndexInt( const byte *p ) {
+	int value;
+
+	Com_Memcpy( &value, p, sizeof( value ) );
+	return LittleLong( value );
+}
+
+
+static void CL_DemoIndexWriteInt( fileHandle_t f, int value ) {
+	value = LittleLong( value );
+	FS_Write( &value, sizeof( value ), f );
+}
+
+
+/*
+=================
+CL_DemoIndexOpen
+
+Loads the index of demoName if it was made for this very file
+=================
+*/
+static void CL_DemoIndexOpen( const char *demoName, int demoLength ) {
+	union {
+		byte *b;
+		void *v;
+	} buf;
+	demoKeyframe_t *kf;
+	const byte *p, *end;
+	int len, i, count;
+
+	CL_DemoIndexFree();
+
+	Com_sprintf( demoIndex.name, sizeof( demoIndex.name ), "%s.idx", demoName );
+	demoIndex.demoLength = demoLength;
+	demoIndex.spacing = cl_demoKeyframes->integer * 1000;
+
+	FS_BypassPure();
+	len = FS_ReadFile( demoIndex.name, &buf.v );
+	FS_RestorePure();
+
+	if ( !buf.v ) {
+		return;
+	}
+
+	p = buf.b;
+	end = buf.b + len;
+
+	if ( len < DEMO_INDEX_HEADER * 4 || CL_DemoIndexInt( p ) != DEMO_INDEX_IDENT
+		|| CL_DemoIndexInt( p + 4 ) != DEMO_INDEX_VERSION || CL_DemoIndexInt( p + 8 ) != demoLength ) {
+		Com_Printf( "Ignoring outdated %s\n", demoIndex.name );
+		FS_FreeFile( buf.v );
+		return;
+	}
+
+	demoIndex.indexedOffset = CL_DemoIndexInt( p + 12 );
+	demoIndex.spacing = MAX( CL_DemoIndexInt( p + 16 ), 1000 );
+	count = CL_DemoIndexInt( p + 20 );
+	p += DEMO_INDEX_HEADER * 4;
+
+	for ( i = 0; i < count && i < MAX_DEMO_KEYFRAMES; i++ ) {
+		if ( end - p < DEMO_KEYFRAME_HEADER * 4 ) {
+			break;
+		}
+
+		kf = &demoIndex.keyframes[ i ];
+		kf->serverTime = CL_DemoIndexInt( p );
+		kf->sequence = CL_DemoIndexInt( p + 4 );
+		kf->commandSequence = CL_DemoIndexInt( p + 8 );
+		kf->offset = CL_DemoIndexInt( p + 12 );
+		kf->gamestateSize = CL_DemoIndexInt( p + 16 );
+		kf->snapshotSize = CL_DemoIndexInt( p + 20 );
+		p += DEMO_KEYFRAME_HEADER * 4;
+
+		if ( kf->gamestateSize <= 0 || kf->gamestateSize > MAX_MSGLEN || kf->snapshotSize <= 0 || kf->snapshotSize > MAX_MSGLEN
+			|| kf->offset <= 0 || kf->offset > demoLength || end - p < kf->gamestateSize + kf->snapshotSize ) {
+			break;
+		}
+
+		kf->data = Z_Malloc( kf->gamestateSize + kf->snapshotSize );
+		Com_Memcpy( kf->data, p, kf->gamestateSize + kf->snapshotSize );
+		p += kf->gamestateSize + kf->snapshotSize;
+		demoIndex.numKeyframes++;
+	}
+
+	FS_FreeFile( buf.v );
+
+	if ( demoIndex.numKeyframes != count ) {
+		Com_Printf( S_COLOR_YELLOW "%s is damaged, rebuilding it\n", demoIndex.name );
+		CL_DemoIndexFree();
+		return;
+	}
+
+	Com_DPrintf( "Demo index: %i keyframes\n", demoIndex.numKeyframes );
+}
+
+
+/*
+=================
+CL_DemoIndexClose
+
+Saves what playback added to the index
+=================
+*/
+static void CL_DemoIndexClose( void ) {
+	const demoKeyframe_t *kf;
+	fileHandle_t f;
+	int i;
+
+	if ( demoIndex.modified && demoIndex.numKeyframes ) {
+		f = FS_FOpenFileWrite( demoIndex.name );
+		if ( f == FS_INVALID_HANDLE ) {
+			Com_Printf( S_COLOR_YELLOW "couldn't write %s\n", demoIndex.name );
+		} else {
+			CL_DemoIndexWriteInt( f, DEMO_INDEX_IDENT );
+			CL_DemoIndexWriteInt( f, DEMO_INDEX_VERSION );
+			CL_DemoIndexWriteInt( f, demoIndex.demoLength );
+			CL_DemoIndexWriteInt( f, demoIndex.indexedOffset );
+			CL_DemoIndexWriteInt( f, demoIndex.spacing );
+			CL_DemoIndexWriteInt( f, demoIndex.numKeyframes );
+			for ( i = 0; i < demoIndex.numKeyframes; i++ ) {
+				kf = &demoIndex.keyframes[ i ];
+				CL_DemoIndexWriteInt( f, kf->serverTime );
+				CL_DemoIndexWriteInt( f, kf->sequence );
+				CL_DemoIndexWriteInt( f, kf->commandSequence );
+				CL_DemoIndexWriteInt( f, kf->offset );
+				CL_DemoIndexWriteInt( f, kf->gamestateSize );
+				CL_DemoIndexWriteInt( f, kf->snapshotSize );
+				FS_Write( kf->data, kf->gamestateSize + kf->snapshotSize, f );
+			}
+			FS_FCloseFile( f );
+		}
+	}
+
+	CL_DemoIndexFree();
+}
+
+
+/*
+=================
+CL_DemoThinKeyframes
+
+Drops every other keyframe so long demos stay within MAX_DEMO_KEYFRAMES
+=================
+*/
+static void CL_DemoThinKeyframes( void ) {
+	int i, n;
+
+	for ( i = 1, n = 1; i < demoIndex.numKeyframes; i++ ) {
+		if ( i & 1 ) {
+			Z_Free( demoIndex.keyframes[i].data );
+			continue;
+		}
+		demoIndex.keyframes[ n++ ] = demoIndex.keyframes[i];
+	}
+
+	demoIndex.numKeyframes = n;
+	demoIndex.spacing *= 2;
+}
+
+
+/*
+=================
+CL_DemoCaptureKeyframe
+
+Called after each demo message, saves a keyframe once the last
+one is older than the spacing or half of the reliable commands
+ago, so restoring never skips more commands than the cgame can
+still fetch
+=================
+*/
+static void CL_DemoCaptureKeyframe( void ) {
+	byte		gamestateData[ MAX_MSGLEN_BUF ];
+	byte		snapshotData[ MAX_MSGLEN_BUF ];
+	demoKeyframe_t *kf, *last;
+	msg_t		gamestate, snapshot;
+	int			offset, cmd, i;
+
+	if ( !cl_demoKeyframes->integer || clc.demofile == FS_INVALID_HANDLE ) {
+		return;
+	}
+
+	offset = FS_FTell( clc.demofile );
+	if ( offset <= demoIndex.indexedOffset ) {
+		return; // replaying an indexed part
+	}
+	demoIndex.indexedOffset = offset;
+	demoIndex.modified = qtrue;
+
+	if ( demoIndex.spacing < 1000 ) {
+		demoIndex.spacing = cl_demoKeyframes->integer * 1000;
+	}
+
+	if ( !( clc.eventMask & EM_SNAPSHOT ) || !cl.snap.valid || cl.snap.messageNum != clc.serverMessageSequence ) {
+		return;
+	}
+
+	if ( cl.snap.snapFlags & SNAPFLAG_NOT_ACTIVE ) {
+		return;
+	}
+
+	if ( demoIndex.numKeyframes ) {
+		last = &demoIndex.keyframes[ demoIndex.numKeyframes - 1 ];
+		if ( cl.snap.serverTime - last->serverTime < 0 ) {
+			return; // next map, seeking stays on the first one
+		}
+		if ( cl.snap.serverTime - last->serverTime < demoIndex.spacing
+			&& clc.serverCommandSequence - last->commandSequence < MAX_RELIABLE_COMMANDS / 2 ) {
+			return;
+		}
+	}
+
+	if ( demoIndex.numKeyframes == MAX_DEMO_KEYFRAMES ) {
+		CL_DemoThinKeyframes();
+	}
+
+	// configstrings don't have the commands the cgame did not execute yet,
+	// they are sent again with the snapshot
+	cmd = clc.lastExecutedServerCommand;
+	if ( clc.serverCommandSequence - cmd > MAX_RELIABLE_COMMANDS ) {
+		cmd = clc.serverCommandSequence - MAX_RELIABLE_COMMANDS;
+	} else if ( clc.serverCommandSequence - cmd < 0 ) {
+		cmd = clc.serverCommandSequence;
+	}
+
+	MSG_Init( &gamestate, gamestateData, MAX_MSGLEN );
+	MSG_Bitstream( &gamestate );
+	MSG_WriteLong( &gamestate, clc.reliableSequence );
+	CL_EmitGamestate( &gamestate, cmd );
+	MSG_WriteByte( &gamestate, svc_EOF );
+
+	MSG_Init( &snapshot, snapshotData, MAX_MSGLEN );
+	MSG_Bitstream( &snapshot );
+	MSG_WriteLong( &snapshot, clc.reliableSequence );
+	for ( i = cmd + 1; clc.serverCommandSequence - i >= 0; i++ ) {
+		MSG_WriteByte( &snapshot, svc_serverCommand );
+		MSG_WriteLong( &snapshot, i );
+		MSG_WriteString( &snapshot, clc.serverCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+	}
+	CL_EmitSnapshot( &snapshot, &cl.snap, NULL, NULL );
+	MSG_WriteByte( &snapshot, svc_EOF );
+
+	if ( gamestate.overflowed || snapshot.overflowed ) {
+		return;
+	}
+
+	kf = &demoIndex.keyframes[ demoIndex.numKeyframes++ ];
+	kf->serverTime = cl.snap.serverTime;
+	kf->sequence = clc.serverMessageSequence;
+	kf->commandSequence = cmd;
+	kf->offset = offset;
+	kf->gamestateSize = gamestate.cursize;
+	kf->snapshotSize = snapshot.cursize;
+	kf->data = Z_Malloc( gamestate.cursize + snapshot.cursize );
+	Com_Memcpy( kf->data, gamestate.data, gamestate.cursize );
+	Com_Memcpy( kf->data + gamestate.cursize, snapshot.data, snapshot.cursize );
+}
+
+
 /*
 =================
 CL_DemoCompleted
@@ -696,6 +1200,8 @@ static void CL_DemoCompleted( void ) {
 			Com_Printf( "%i frames, %3.*f seconds: %3.1f fps\n", clc.timeDemoFrames,
 			time > 10000 ? 1 : 2, time/1000.0, clc.timeDemoFrames*1000.0 / time );
 		}
+
+		CL_BenchmarkReport();
 	}
 
 	CL_Disconnect( qtrue );
@@ -703,6 +1209,24 @@ static void CL_DemoCompleted( void ) {
 }
 
 
+/*
+=================
+CL_DemoEndOfFile
+
+A seek stops in front of the end, the demo completes when playback gets there
+=================
+*/
+static void CL_DemoEndOfFile( int offset ) {
+	if ( demoIndex.seeking ) {
+		FS_Seek( clc.demofile, offset, FS_SEEK_SET );
+		demoIndex.reachedEnd = qtrue;
+		return;
+	}
+
+	CL_DemoCompleted();
+}
+
+
 /*
 =================
 CL_ReadDemoMessage
@@ -713,16 +1237,19 @@ void CL_ReadDemoMessage( void ) {
 	msg_t		buf;
 	byte		bufData[ MAX_MSGLEN_BUF ];
 	int			s;
+	int			offset;
 
 	if ( clc.demofile == FS_INVALID_HANDLE ) {
 		CL_DemoCompleted();
 		return;
 	}
 
+	offset = FS_FTell( clc.demofile );
+
 	// get the sequence number
 	r = FS_Read( &s, 4, clc.demofile );
 	if ( r != 4 ) {
-		CL_DemoCompleted();
+		CL_DemoEndOfFile( offset );
 		return;
 	}
 	clc.serverMessageSequence = LittleLong( s );
@@ -733,39 +1260,212 @@ void CL_ReadDemoMessage( void ) {
 	// get the length
 	r = FS_Read( &buf.cursize, 4, clc.demofile );
 	if ( r != 4 ) {
-		CL_DemoCompleted();
+		CL_DemoEndOfFile( offset );
+		return;
+	}
+	buf.cursize = LittleLong( buf.cursize );
+	if ( buf.cursize == -1 ) {
+		CL_DemoEndOfFile( offset );
+		return;
+	}
+	if ( buf.cursize > buf.maxsize ) {
+		Com_Error (ERR_DROP, "CL_ReadDemoMessage: demoMsglen > MAX_MSGLEN");
+	}
+	r = FS_Read( buf.data, buf.cursize, clc.demofile );
+	if ( r != buf.cursize ) {
+		Com_Printf( "Demo file was truncated.\n");
+		CL_DemoEndOfFile( offset );
+		return;
+	}
+
+	clc.lastPacketTime = cls.realtime;
+	buf.readcount = 0;
+
+	clc.demoCommandSequence = clc.serverCommandSequence;
+
+	CL_ParseServerMessage( &buf );
+
+	CL_DemoCaptureKeyframe();
+
+	if ( clc.demorecording ) {
+		// track changes and write new message
+		if ( clc.eventMask & EM_GAMESTATE ) {
+			CL_WriteGamestate( qfalse );
+			// nothing should came after gamestate in current message
+		} else if ( clc.eventMask & (EM_SNAPSHOT|EM_COMMAND) ) {
+			CL_WriteSnapshot();
+		}
+	}
+}
+
+
+/*
+=================
+CL_DemoReadUntil
+
+Reads demo messages without presenting them until serverTime is reached
+=================
+*/
+static void CL_DemoReadUntil( int serverTime ) {
+	while ( clc.demoplaying && !demoIndex.reachedEnd ) {
+		if ( cls.state >= CA_PRIMED && cl.snap.valid && cl.snap.serverTime - serverTime >= 0 ) {
+			break;
+		}
+		CL_ReadDemoMessage();
+		CL_SkipServerCommands();
+	}
+}
+
+
+/*
+=================
+CL_DemoRestoreKeyframe
+
+Feeds the saved gamestate, which restarts the cgame, and the snapshot
+=================
+*/
+static void CL_DemoRestoreKeyframe( const demoKeyframe_t *kf ) {
+	byte		bufData[ MAX_MSGLEN_BUF ];
+	msg_t		msg;
+
+	FS_Seek( clc.demofile, kf->offset, FS_SEEK_SET );
+
+	// the cgame starts with the commands of the gamestate
+	clc.lastExecutedServerCommand = kf->commandSequence;
+
+	clc.serverMessageSequence = kf->sequence - 1;
+	clc.lastPacketTime = cls.realtime;
+	MSG_Init( &msg, bufData, MAX_MSGLEN );
+	Com_Memcpy( msg.data, kf->data, kf->gamestateSize );
+	msg.cursize = kf->gamestateSize;
+	CL_ParseServerMessage( &msg );
+
+	clc.serverMessageSequence = kf->sequence;
+	MSG_Init( &msg, bufData, MAX_MSGLEN );
+	Com_Memcpy( msg.data, kf->data + kf->gamestateSize, kf->snapshotSize );
+	msg.cursize = kf->snapshotSize;
+	CL_ParseServerMessage( &msg );
+
+	// same as the start of playback
+	clc.firstDemoFrameSkipped = qfalse;
+}
+
+
+/*
+=================
+CL_DemoSeek
+
+Forward seeks read on while the cgame keeps running, as long as it can
+fetch the skipped commands. Anything else restarts from a keyframe.
+=================
+*/
+static void CL_DemoSeek( int serverTime ) {
+	const demoKeyframe_t *kf;
+	int commandSequence;
+	int i;
+
+	demoIndex.seeking = qtrue;
+	demoIndex.reachedEnd = qfalse;
+
+	if ( serverTime - cl.serverTime >= 0 ) {
+		commandSequence = clc.lastExecutedServerCommand;
+
+		CL_DemoReadUntil( serverTime );
+
+		if ( !clc.demoplaying || cls.state != CA_ACTIVE ) {
+			demoIndex.seeking = qfalse;
+			return; // next map or end of a damaged demo
+		}
+
+		if ( clc.serverCommandSequence - commandSequence < MAX_RELIABLE_COMMANDS ) {
+			if ( demoIndex.reachedEnd ) {
+				serverTime = cl.snap.serverTime;
+			}
+			cl.serverTimeDelta += serverTime - cl.serverTime;
+			demoIndex.seeking = qfalse;
+			return;
+		}
+	}
+
+	// last keyframe in front of the target
+	kf = &demoIndex.keyframes[ 0 ];
+	for ( i = 1; i < demoIndex.numKeyframes; i++ ) {
+		if ( demoIndex.keyframes[i].serverTime - serverTime > 0 ) {
+			break;
+		}
+		kf = &demoIndex.keyframes[i];
+	}
+
+	CL_DemoRestoreKeyframe( kf );
+	CL_DemoReadUntil( serverTime );
+
+	demoIndex.seeking = qfalse;
+}
+
+
+/*
+=================
+CL_DemoSeek_f
+
+demo_seek <[+|-]seconds | [+|-]minutes:seconds>
+=================
+*/
+static void CL_DemoSeek_f( void ) {
+	const char *s, *colon;
+	int msec, start, serverTime, t0;
+	qboolean relative;
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "usage: demo_seek <[+|-]seconds | [+|-]minutes:seconds>\n" );
+		return;
+	}
+
+	if ( !clc.demoplaying || clc.demofile == FS_INVALID_HANDLE ) {
+		Com_Printf( "Not playing a demo.\n" );
+		return;
+	}
+
+	if ( cls.state != CA_ACTIVE || !demoIndex.numKeyframes ) {
+		Com_Printf( "The demo has not started yet.\n" );
+		return;
+	}
+
+	if ( clc.demorecording || com_timedemo->integer || CL_VideoRecording() ) {
+		Com_Printf( "Can't seek while recording or in a timedemo.\n" );
 		return;
 	}
-	buf.cursize = LittleLong( buf.cursize );
-	if ( buf.cursize == -1 ) {
-		CL_DemoCompleted();
-		return;
+
+	s = Cmd_Argv( 1 );
+	relative = ( *s == '+' || *s == '-' ) ? qtrue : qfalse;
+
+	colon = strchr( s, ':' );
+	if ( colon ) {
+		msec = abs( atoi( s ) ) * 60000 + (int)( atof( colon + 1 ) * 1000.0 );
+	} else {
+		msec = (int)( fabs( atof( s ) ) * 1000.0 );
 	}
-	if ( buf.cursize > buf.maxsize ) {
-		Com_Error (ERR_DROP, "CL_ReadDemoMessage: demoMsglen > MAX_MSGLEN");
+	if ( *s == '-' ) {
+		msec = -msec;
 	}
-	r = FS_Read( buf.data, buf.cursize, clc.demofile );
-	if ( r != buf.cursize ) {
-		Com_Printf( "Demo file was truncated.\n");
-		CL_DemoCompleted();
-		return;
+
+	start = demoIndex.keyframes[ 0 ].serverTime;
+	if ( relative ) {
+		serverTime = cl.serverTime + msec;
+	} else {
+		serverTime = start + msec;
 	}
 
-	clc.lastPacketTime = cls.realtime;
-	buf.readcount = 0;
+	if ( serverTime - start < 0 ) {
+		serverTime = start;
+	}
 
-	clc.demoCommandSequence = clc.serverCommandSequence;
+	t0 = Sys_Milliseconds();
 
-	CL_ParseServerMessage( &buf );
+	CL_DemoSeek( serverTime );
 
-	if ( clc.demorecording ) {
-		// track changes and write new message
-		if ( clc.eventMask & EM_GAMESTATE ) {
-			CL_WriteGamestate( qfalse );
-			// nothing should came after gamestate in current message
-		} else if ( clc.eventMask & (EM_SNAPSHOT|EM_COMMAND) ) {
-			CL_WriteSnapshot();
-		}
+	if ( clc.demoplaying ) {
+		msec = cl.snap.serverTime - start;
+		Com_Printf( "Demo at %i:%02i (%i msec)\n", msec / 60000, ( msec / 1000 ) % 60, Sys_Milliseconds() - t0 );
 	}
 }
 
@@ -854,7 +1554,7 @@ static void CL_PlayDemo_f( void ) {
 	char		name[MAX_OSPATH];
 	const char		*arg;
 	char		*ext_test;
-	int			protocol, i;
+	int			protocol, i, length;
 	char		retry[MAX_OSPATH];
 	const char	*shortname, *slash;
 	fileHandle_t hFile;
@@ -920,13 +1620,16 @@ static void CL_PlayDemo_f( void ) {
 	CL_Disconnect( qtrue );
 
 	// clc.demofile will be closed during CL_Disconnect so reopen it
-	if ( FS_FOpenFileRead( name, &clc.demofile, qtrue ) == -1 )
+	length = FS_FOpenFileRead( name, &clc.demofile, qtrue );
+	if ( length == -1 )
 	{
 		// drop this time
 		Com_Error( ERR_DROP, "couldn't open %s\n", name );
 		return;
 	}
 
+	CL_DemoIndexOpen( name, length );
+
 	if ( (slash = strrchr( name, '/' )) != NULL )
 		shortname = slash + 1;
 	else
@@ -934,6 +1637,10 @@ static void CL_PlayDemo_f( void ) {
 
 	Q_strncpyz( clc.demoName, shortname, sizeof( clc.demoName ) );
 
+	if ( com_timedemo->integer == 2 ) {
+		CL_BenchmarkStart();
+	}
+
 	Con_Close();
 
 	cls.state = CA_CONNECTED;
@@ -1071,6 +1778,44 @@ void CL_FlushMemory( void ) {
 }
 
 
+/*
+=================
+CL_WaitFrame
+
+Called before events are read for a new frame
+=================
+*/
+void CL_WaitFrame( void ) {
+	if ( !cls.rendererStarted || !re.WaitFrame ) {
+		return;
+	}
+
+	re.WaitFrame();
+}
+
+
+/*
+=================
+CL_RendererMemoryStats
+=================
+*/
+qboolean CL_RendererMemoryStats( int *numImages, int *imageBytes, int *vboBytes ) {
+	refMemoryStats_t stats;
+
+	if ( !cls.rendererStarted || !re.MemoryStats ) {
+		return qfalse;
+	}
+
+	re.MemoryStats( &stats );
+
+	*numImages = stats.numImages;
+	*imageBytes = stats.imageBytes;
+	*vboBytes = stats.vboBytes;
+
+	return qtrue;
+}
+
+
 /*
 =====================
 CL_MapLoading
@@ -1224,9 +1969,14 @@ qboolean CL_Disconnect( qboolean showMainMenu ) {
 	if ( clc.demofile != FS_INVALID_HANDLE ) {
 		FS_FCloseFile( clc.demofile );
 		clc.demofile = FS_INVALID_HANDLE;
+		CL_DemoIndexClose();
 	}
+	CL_BenchmarkStop();
 
 	// Finish downloads
+#ifdef USE_CURL
+	CL_cURL_Cleanup();
+#endif
 	if ( clc.download != FS_INVALID_HANDLE ) {
 		FS_FCloseFile( clc.download );
 		clc.download = FS_INVALID_HANDLE;
@@ -1850,6 +2600,36 @@ static void CL_Vid_Restart( refShutdownCode_t shutdownCode ) {
 }
 
 
+/*
+=================
+CL_Vid_SoftRestart
+
+Lets the renderer apply latched cvars in place when they don't
+need reloading, VMs and every registered handle stay valid
+=================
+*/
+static qboolean CL_Vid_SoftRestart( void ) {
+
+	if ( !cls.rendererStarted || !re.SoftRestart ) {
+		return qfalse;
+	}
+
+#ifdef USE_RENDERER_DLOPEN
+	if ( cl_renderer->latchedString ) {
+		return qfalse;
+	}
+#endif
+
+	if ( !re.SoftRestart() ) {
+		return qfalse;
+	}
+
+	Com_Printf( "Applied video settings without reloading, use \vid_restart full to reload everything.\n" );
+
+	return qtrue;
+}
+
+
 /*
 =================
 CL_Vid_Restart_f
@@ -1859,6 +2639,10 @@ Wrapper for CL_Vid_Restart
 */
 static void CL_Vid_Restart_f( void ) {
 
+	if ( Q_stricmp( Cmd_Argv( 1 ), "full" ) != 0 && CL_Vid_SoftRestart() ) {
+		return;
+	}
+
 	if ( Q_stricmp( Cmd_Argv( 1 ), "keep_window" ) == 0 || Q_stricmp( Cmd_Argv( 1 ), "fast" ) == 0 ) {
 		// fast path: keep window
 		CL_Vid_Restart( REF_KEEP_WINDOW );
@@ -2104,8 +2888,14 @@ static void CL_BeginDownload( const char *localName, const char *remoteName ) {
 
 	clc.downloadBlock = 0; // Starting new file
 	clc.downloadCount = 0;
+	clc.downloadLost = -1;
+	clc.downloadExt = qfalse;
 
-	CL_AddReliableCommand( va("download %s", remoteName), qfalse );
+	// ask for large blocks and cumulative acks, older servers ignore the argument
+	if ( clc.compat )
+		CL_AddReliableCommand( va("download %s", remoteName), qfalse );
+	else
+		CL_AddReliableCommand( va("download %s %i", remoteName, DL_EXT_VERSION), qfalse );
 }
 
 
@@ -2113,16 +2903,17 @@ static void CL_BeginDownload( const char *localName, const char *remoteName ) {
 =================
 CL_NextDownload
 
-A download completed or failed
+A download completed or failed, HTTP/FTP downloads run
+several at once and call this each time one of them is done
 =================
 */
 void CL_NextDownload( void )
 {
 	char *s;
 	char *remoteName, *localName;
-	qboolean useCURL = qfalse;
+	qboolean useCURL;
 
-	// A download has finished, check whether this matches a referenced checksum
+	// A UDP download has finished, check whether this matches a referenced checksum
 	if(*clc.downloadName)
 	{
 		const char *zippath = FS_BuildOSPath(Cvar_VariableString("fs_homepath"), clc.downloadName, NULL );
@@ -2135,7 +2926,13 @@ void CL_NextDownload( void )
 	Cvar_Set("cl_downloadName", "");
 
 	// We are looking to start a download here
-	if (*clc.downloadList) {
+	while (*clc.downloadList) {
+#ifdef USE_CURL
+		if ( CL_cURL_ActiveDownloads() >= cl_dlParallel->integer ) {
+			return;
+		}
+#endif
+		useCURL = qfalse;
 		s = clc.downloadList;
 
 		// format is:
@@ -2146,8 +2943,8 @@ void CL_NextDownload( void )
 		remoteName = s;
 
 		if ( (s = strchr(s, '@')) == NULL ) {
-			CL_DownloadsComplete();
-			return;
+			*clc.downloadList = '\0';
+			break;
 		}
 
 		*s++ = '\0';
@@ -2205,8 +3002,18 @@ void CL_NextDownload( void )
 		// move over the rest
 		memmove( clc.downloadList, s, strlen(s) + 1 );
 
+		// UDP downloads go one by one
+		if ( !useCURL ) {
+			return;
+		}
+	}
+
+#ifdef USE_CURL
+	// wait for the remaining transfers
+	if ( CL_cURL_ActiveDownloads() > 0 ) {
 		return;
 	}
+#endif
 
 	clc.fwdreconnect = qfalse;
 
@@ -2361,6 +3168,9 @@ static void CL_CheckForResend( void ) {
 		// this is optional key so will not trigger oversize warning
 		Info_SetValueForKey_s( info, MAX_USERINFO_LENGTH, "client", Q3_VERSION );
 
+		// optional too, allows compressed configstrings in gamestate
+		Info_SetValueForKey_s( info, MAX_USERINFO_LENGTH, "gsext", XSTRING( GS_EXT_VERSION ) );
+
 		if ( !notOverflowed ) {
 			Com_WPrintf( "WARNING: oversize userinfo, you might be not able to join remote server!\n" );
 		}
@@ -2433,18 +3243,27 @@ static void CL_InitServerInfo( serverInfo_t *server, const netadr_t *address ) {
 	server->punkbuster = 0;
 	server->g_humanplayers = 0;
 	server->g_needpass = 0;
+	server->cached = qfalse;
 }
 
 #define MAX_SERVERSPERPACKET	256
 
-typedef struct hash_chain_s {
-	netadr_t             addr;
-	struct hash_chain_s *next;
-} hash_chain_t;
+/*
+Server addresses are looked up in open addressed tables keyed by ip and port,
+entries are never removed one by one, a table is emptied by bumping its
+generation so it can be reset for every master query at no cost
+*/
+#define ADR_HASH_SIZE	( MAX_GLOBAL_SERVERS * 2 )
+
+typedef struct {
+	netadr_t		adr[MAX_GLOBAL_SERVERS];
+	unsigned short	slot[ADR_HASH_SIZE];	// entry + 1, 0 is empty
+	unsigned short	stamp[ADR_HASH_SIZE];	// generation of slot
+	unsigned short	generation;
+	int				count;
+} adrHash_t;
 
-static hash_chain_t *hash_table[1024];
-static hash_chain_t hash_list[MAX_GLOBAL_SERVERS];
-static unsigned int hash_count = 0;
+static adrHash_t cl_serverHash;		// dedupe of master server replies
 
 static unsigned int hash_func( const netadr_t *addr ) {
 
@@ -2464,45 +3283,266 @@ static unsigned int hash_func( const netadr_t *addr ) {
 	for ( i = 0; i < size; i++ )
 		hash = hash * 101 + (int)( *ip++ );
 
-	hash = hash ^ ( hash >> 16 );
+	// many servers share an ip so the port must be mixed in as well
+	hash = hash * 101 + addr->port;
 
-	return (hash & 1023);
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
+
+	return (hash & (ADR_HASH_SIZE-1));
 }
 
-static void hash_insert( const netadr_t *addr )
+static void hash_reset( adrHash_t *h )
 {
-	hash_chain_t **tab, *cur;
-	unsigned int hash;
-	if ( hash_count >= MAX_GLOBAL_SERVERS )
-		return;
-	hash = hash_func( addr );
-	tab = &hash_table[ hash ];
-	cur = &hash_list[ hash_count++ ];
-	cur->addr = *addr;
-	if ( cur != *tab )
-		cur->next = *tab;
-	else
-		cur->next = NULL;
-	*tab = cur;
+	h->count = 0;
+	h->generation++;
+	if ( h->generation == 0 ) {
+		Com_Memset( h->stamp, 0, sizeof( h->stamp ) );
+		h->generation = 1;
+	}
 }
 
-static void hash_reset( void )
+static int hash_find( const adrHash_t *h, const netadr_t *addr )
 {
-	hash_count = 0;
-	memset( hash_list, 0, sizeof( hash_list ) );
-	memset( hash_table, 0, sizeof( hash_table ) );
+	unsigned int i;
+
+	for ( i = hash_func( addr ); h->stamp[ i ] == h->generation && h->slot[ i ]; i = ( i + 1 ) & (ADR_HASH_SIZE-1) ) {
+		if ( NET_CompareAdr( addr, &h->adr[ h->slot[ i ] - 1 ] ) )
+			return h->slot[ i ] - 1;
+	}
+
+	return -1;
 }
 
-static hash_chain_t *hash_find( const netadr_t *addr )
+// returns entry index, caller must check that addr is not on the list yet
+static int hash_insert( adrHash_t *h, const netadr_t *addr )
 {
-	hash_chain_t *cur;
-	cur = hash_table[ hash_func( addr ) ];
-	while ( cur != NULL ) {
-		if ( NET_CompareAdr( addr, &cur->addr ) )
-			return cur;
-		cur = cur->next;
+	unsigned int i;
+
+	if ( h->count >= MAX_GLOBAL_SERVERS )
+		return -1;
+
+	if ( h->generation == 0 )
+		hash_reset( h );
+
+	// table has twice as many slots as entries so there always is a free one
+	for ( i = hash_func( addr ); h->stamp[ i ] == h->generation && h->slot[ i ]; i = ( i + 1 ) & (ADR_HASH_SIZE-1) )
+		;
+
+	h->adr[ h->count ] = *addr;
+	h->slot[ i ] = h->count + 1;
+	h->stamp[ i ] = h->generation;
+
+	return h->count++;
+}
+
+
+/*
+Server browser query engine, getinfo requests for any number of servers
+are queued in the order they were asked for and sent at cl_queryRate
+per second, replies are matched by address hash instead of being limited
+to MAX_PINGREQUESTS slots
+*/
+typedef struct {
+	int			source;		// AS_LOCAL, AS_GLOBAL or AS_FAVORITES
+	int			index;		// server in that list
+	int			start;		// time getinfo was sent
+	qboolean	done;		// replied or timed out
+} serverQuery_t;
+
+static adrHash_t		cl_queryHash;
+static serverQuery_t	cl_queries[MAX_GLOBAL_SERVERS];
+static int				cl_querySent;		// queries below this were sent
+static int				cl_queryPending;	// oldest query which may still get a reply
+static int				cl_queryTime;
+static float			cl_queryBudget;
+
+static cvar_t *cl_queryRate;
+
+static void CL_SetServerInfo( serverInfo_t *server, const char *info, int ping );
+
+
+/*
+===================
+CL_ResetServerQueries
+===================
+*/
+static void CL_ResetServerQueries( void ) {
+	hash_reset( &cl_queryHash );
+	cl_querySent = 0;
+	cl_queryPending = 0;
+}
+
+
+/*
+===================
+CL_QueryServerInfo
+
+Returns server the query was made for, NULL if its list changed meanwhile
+===================
+*/
+static serverInfo_t *CL_QueryServerInfo( int n ) {
+	const serverQuery_t *q = &cl_queries[ n ];
+	serverInfo_t *server;
+
+	switch ( q->source ) {
+		case AS_LOCAL:
+			if ( q->index >= MAX_OTHER_SERVERS )
+				return NULL;
+			server = &cls.localServers[ q->index ];
+			break;
+		case AS_GLOBAL:
+			if ( q->index >= MAX_GLOBAL_SERVERS )
+				return NULL;
+			server = &cls.globalServers[ q->index ];
+			break;
+		case AS_FAVORITES:
+			if ( q->index >= MAX_OTHER_SERVERS )
+				return NULL;
+			server = &cls.favoriteServers[ q->index ];
+			break;
+		default:
+			return NULL;
+	}
+
+	if ( !NET_CompareAdr( &server->adr, &cl_queryHash.adr[ n ] ) )
+		return NULL;
+
+	return server;
+}
+
+
+/*
+===================
+CL_QueueServerQuery
+
+Returns qfalse if server already is on the queue or the queue is full
+===================
+*/
+static qboolean CL_QueueServerQuery( int source, int index, const netadr_t *adr ) {
+	serverQuery_t *q;
+	int n;
+
+	if ( hash_find( &cl_queryHash, adr ) >= 0 )
+		return qfalse;
+
+	n = hash_insert( &cl_queryHash, adr );
+	if ( n < 0 )
+		return qfalse;
+
+	q = &cl_queries[ n ];
+	q->source = source;
+	q->index = index;
+	q->start = 0;
+	q->done = qfalse;
+
+	return qtrue;
+}
+
+
+/*
+===================
+CL_ServerQueriesActive
+===================
+*/
+static qboolean CL_ServerQueriesActive( void ) {
+	return cl_queryPending < cl_queryHash.count;
+}
+
+
+/*
+===================
+CL_ServerQueryReply
+
+Returns qtrue if from had a query in flight
+===================
+*/
+static qboolean CL_ServerQueryReply( const netadr_t *from, const char *info ) {
+	serverQuery_t *q;
+	serverInfo_t *server;
+	int n, time;
+
+	n = hash_find( &cl_queryHash, from );
+	if ( n < 0 || n >= cl_querySent || cl_queries[ n ].done )
+		return qfalse;
+
+	q = &cl_queries[ n ];
+	q->done = qtrue;
+
+	time = Sys_Milliseconds() - q->start;
+	if ( time < 1 )
+		time = 1;
+
+	if ( com_developer->integer )
+		Com_Printf( "ping time %dms from %s\n", time, NET_AdrToString( from ) );
+
+	server = CL_QueryServerInfo( n );
+	if ( server )
+		CL_SetServerInfo( server, info, time );
+
+	return qtrue;
+}
+
+
+/*
+===================
+CL_ServerQueryFrame
+
+Sends queued queries within the rate budget and times out lost ones
+===================
+*/
+static void CL_ServerQueryFrame( void ) {
+	serverQuery_t *q;
+	serverInfo_t *server;
+	int msec, maxPing;
+	float burst;
+
+	if ( !CL_ServerQueriesActive() ) {
+		if ( cl_queryHash.count )
+			CL_ResetServerQueries();
+		cl_queryBudget = 0.0f;
+		cl_queryTime = Sys_Milliseconds();
+		return;
+	}
+
+	msec = Sys_Milliseconds();
+	cl_queryBudget += (float)( msec - cl_queryTime ) * cl_queryRate->integer * 0.001f;
+	cl_queryTime = msec;
+
+	// don't let a long frame turn into a burst of queries
+	burst = cl_queryRate->integer * 0.05f + 1.0f;
+	if ( cl_queryBudget > burst )
+		cl_queryBudget = burst;
+
+	while ( cl_querySent < cl_queryHash.count && cl_queryBudget >= 1.0f ) {
+		q = &cl_queries[ cl_querySent ];
+		server = CL_QueryServerInfo( cl_querySent );
+		cl_querySent++;
+		if ( !server ) {
+			q->done = qtrue;
+			continue;
+		}
+		q->start = msec;
+		NET_OutOfBandPrint( NS_CLIENT, &server->adr, "getinfo xxx" );
+		cl_queryBudget -= 1.0f;
+	}
+
+	// queries are sent in order so they also time out in order
+	maxPing = Cvar_VariableIntegerValue( "cl_maxPing" );
+	while ( cl_queryPending < cl_querySent ) {
+		q = &cl_queries[ cl_queryPending ];
+		if ( !q->done ) {
+			if ( msec - q->start < maxPing )
+				break;
+			// lost, same as an expired ping slot
+			q->done = qtrue;
+			server = CL_QueryServerInfo( cl_queryPending );
+			if ( server )
+				server->ping = 0;
+		}
+		cl_queryPending++;
 	}
-	return NULL;
 }
 
 
@@ -2525,7 +3565,9 @@ static void CL_ServersResponsePacket( const netadr_t* from, msg_t *msg, qboolean
 		// state to detect lack of servers or lack of response
 		cls.numglobalservers = 0;
 		cls.numGlobalServerAddresses = 0;
-		hash_reset();
+		hash_reset( &cl_serverHash );
+		// pending queries refer to the old list
+		CL_ResetServerQueries();
 	}
 
 	// parse through server response string
@@ -2598,10 +3640,10 @@ static void CL_ServersResponsePacket( const netadr_t* from, msg_t *msg, qboolean
 		// Tequila: It's possible to have sent many master server requests. Then
 		// we may receive many times the same addresses from the master server.
 		// We just avoid to add a server if it is still in the global servers list.
-		if ( hash_find( &addresses[i] ) )
+		if ( hash_find( &cl_serverHash, &addresses[i] ) >= 0 )
 			continue;
 
-		hash_insert( &addresses[i] );
+		hash_insert( &cl_serverHash, &addresses[i] );
 
 		// build net address
 		server = &cls.globalServers[count];
@@ -2907,7 +3949,12 @@ void CL_PacketEvent( const netadr_t *from, msg_t *msg ) {
 	// after we have parsed the frame
 	//
 	if ( clc.demorecording && !clc.demowaiting && !clc.demoplaying ) {
-		CL_WriteDemoMessage( msg, headerBytes );
+		if ( clc.eventMask & EM_CSBLOCK ) {
+			// demos keep plain configstrings so that any client can play them
+			CL_WriteGamestate( qtrue );
+		} else {
+			CL_WriteDemoMessage( msg, headerBytes );
+		}
 	}
 }
 
@@ -3019,7 +4066,7 @@ void CL_Frame( int msec, int realMsec ) {
 	}
 #endif
 
-	if ( !com_cl_running->integer ) {
+	if ( !com_cl_running->integer || cl_headless->integer ) {
 		return;
 	}
 
@@ -3137,6 +4184,9 @@ void CL_Frame( int msec, int realMsec ) {
 	// resend a connection request if necessary
 	CL_CheckForResend();
 
+	// pace server browser queries
+	CL_ServerQueryFrame();
+
 	// decide on the serverTime to render
 	CL_SetCGameTime();
 
@@ -3144,8 +4194,12 @@ void CL_Frame( int msec, int realMsec ) {
 	cls.framecount++;
 	SCR_UpdateScreen();
 
+	CL_BenchmarkFrame();
+
 	// update audio
+	Com_TraceBegin( "S_Update" );
 	S_Update( realMsec );
+	Com_TraceEnd();
 
 	// advance local effects for next frame
 	SCR_RunCinematic();
@@ -3273,6 +4327,10 @@ void CL_StartHunkUsers( void ) {
 		return;
 	}
 
+	if ( cl_headless && cl_headless->integer ) {
+		return;
+	}
+
 	if ( cls.state >= CA_LOADING ) {
 		// try to apply map-depending configuration from cvar cl_mapConfig_<mapname> cvars
 		const char *info = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_SERVERINFO ];
@@ -3326,6 +4384,16 @@ static void *CL_RefMalloc( int size ) {
 }
 
 
+/*
+============
+CL_RefMallocPersistent
+============
+*/
+static void *CL_RefMallocPersistent( int size ) {
+	return Z_TagMalloc( size, TAG_GENERAL );
+}
+
+
 /*
 ============
 CL_RefFreeAll
@@ -3378,6 +4446,26 @@ static void CL_SetScaling( float factor, int captureWidth, int captureHeight ) {
 }
 
 
+/*
+============
+CL_RefParallelFor
+============
+*/
+static void CL_RefParallelFor( jobFunc_t func, void *data, int count ) {
+	Com_ParallelForPool( JOB_POOL_RENDERER, func, data, count );
+}
+
+
+/*
+============
+CL_RefCreateThread
+============
+*/
+static void *CL_RefCreateThread( void (*func)( void *arg ), void *arg ) {
+	return Com_CreateThread( JOB_POOL_RENDERER, "renderer", func, arg );
+}
+
+
 /*
 ============
 CL_InitRef
@@ -3440,6 +4528,7 @@ static void CL_InitRef( void ) {
 	rimp.Malloc = CL_RefMalloc;
 	rimp.FreeAll = CL_RefFreeAll;
 	rimp.Free = Z_Free;
+	rimp.MallocPersistent = CL_RefMallocPersistent;
 #ifdef HUNK_DEBUG
 	rimp.Hunk_AllocDebug = Hunk_AllocDebug;
 #else
@@ -3458,6 +4547,10 @@ static void CL_InitRef( void ) {
 	rimp.FS_ListFiles = FS_ListFiles;
 	//rimp.FS_FileIsInPAK = FS_FileIsInPAK;
 	rimp.FS_FileExists = FS_FileExists;
+	rimp.FS_ReadFileAsync = FS_ReadFileAsync;
+	rimp.FS_WaitFile = FS_WaitFile;
+	rimp.FS_InflateBuffer = FS_InflateBuffer;
+	rimp.FS_LoadStamp = FS_LoadStamp;
 
 	rimp.Cvar_Get = Cvar_Get;
 	rimp.Cvar_Set = Cvar_Set;
@@ -3471,6 +4564,7 @@ static void CL_InitRef( void ) {
 	rimp.Cvar_SetGroup = Cvar_SetGroup;
 	rimp.Cvar_CheckGroup = Cvar_CheckGroup;
 	rimp.Cvar_ResetGroup = Cvar_ResetGroup;
+	rimp.Cvar_ListLatched = Cvar_ListLatched;
 
 	// cinematic stuff
 
@@ -3489,6 +4583,15 @@ static void CL_InitRef( void ) {
 	rimp.Sys_SetClipboardBitmap = Sys_SetClipboardBitmap;
 	rimp.Sys_LowPhysicalMemory = Sys_LowPhysicalMemory;
 	rimp.Com_RealTime = Com_RealTime;
+	rimp.ParallelFor = CL_RefParallelFor;
+	rimp.Sys_CreateThread = CL_RefCreateThread;
+	rimp.Sys_JoinThread = Com_JoinThread;
+	rimp.Sys_CreateSemaphore = Sys_CreateSemaphore;
+	rimp.Sys_DestroySemaphore = Sys_DestroySemaphore;
+	rimp.Sys_WaitSemaphore = Sys_WaitSemaphore;
+	rimp.Sys_PostSemaphore = Sys_PostSemaphore;
+	rimp.Sys_AtomicLoad = Sys_AtomicLoad;
+	rimp.Sys_AtomicStore = Sys_AtomicStore;
 
 	rimp.GLimp_InitGamma = GLimp_InitGamma;
 	rimp.GLimp_SetGamma = GLimp_SetGamma;
@@ -3499,6 +4602,7 @@ static void CL_InitRef( void ) {
 	rimp.GLimp_Shutdown = GLimp_Shutdown;
 	rimp.GL_GetProcAddress = GL_GetProcAddress;
 	rimp.GLimp_EndFrame = GLimp_EndFrame;
+	rimp.GLimp_MakeCurrent = GLimp_MakeCurrent;
 #endif
 
 	// Vulkan API
@@ -3919,6 +5023,16 @@ void CL_Init( void ) {
 	cl_timeNudge = Cvar_Get( "cl_timeNudge", "0", CVAR_TEMP );
 	Cvar_CheckRange( cl_timeNudge, "-30", "30", CV_INTEGER );
 	Cvar_SetDescription( cl_timeNudge, "Allows more or less latency to be added in the interest of better smoothness or better responsiveness." );
+	cl_jitterBuffer = Cvar_Get( "cl_jitterBuffer", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_jitterBuffer, "0", "4", CV_FLOAT );
+	Cvar_SetDescription( cl_jitterBuffer, "Delays interpolation by this factor of the measured snapshot jitter and loss bursts, trading latency for smoother motion on unstable connections:\n  0 - disabled\n  1 - cover typical variation\n  2..4 - more smoothness, more latency\nMeasured values are shown in \\cl_snapJitter and \\cl_snapBufferDepth." );
+	cl_snapJitter = Cvar_Get( "cl_snapJitter", "0", CVAR_ROM );
+	Cvar_SetDescription( cl_snapJitter, "Measured snapshot jitter in msec, including loss bursts." );
+	cl_snapBufferDepth = Cvar_Get( "cl_snapBufferDepth", "0", CVAR_ROM );
+	Cvar_SetDescription( cl_snapBufferDepth, "Interpolation delay added by \\cl_jitterBuffer, in snapshots." );
+	cl_traceCache = Cvar_Get( "cl_traceCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_traceCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cl_traceCache, "Reuse results of identical cgame collision traces, mostly issued by prediction replaying unacknowledged commands. Statistics are shown by \\cl_tracestats." );
 
 	cl_shownet = Cvar_Get ("cl_shownet", "0", CVAR_TEMP );
 	Cvar_SetDescription( cl_shownet, "Toggle the display of current network status." );
@@ -3933,12 +5047,25 @@ void CL_Init( void ) {
 	Cvar_SetDescription( cl_autoRecordDemo, "Auto-record demos when starting or joining a game." );
 	cl_drawRecording = Cvar_Get("cl_drawRecording", "1", CVAR_ARCHIVE);
 	Cvar_SetDescription( cl_drawRecording, "Hide (0) or shorten (1) \"RECORDING\" HUD message when recording demo." );
+	cl_demoKeyframes = Cvar_Get( "cl_demoKeyframes", "10", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_demoKeyframes, "0", "60", CV_INTEGER );
+	Cvar_SetDescription( cl_demoKeyframes, "Seconds between the keyframes that demo playback saves for \\demo_seek into <demo>.idx, 0 disables them." );
+	cl_headless = Cvar_Get( "cl_headless", "0", CVAR_INIT );
+	Cvar_CheckRange( cl_headless, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cl_headless, "Don't start the renderer, sound and UI and don't run client frames, for batch jobs like \\demo_export from the command line." );
 
 	cl_aviFrameRate = Cvar_Get ("cl_aviFrameRate", "25", CVAR_ARCHIVE);
 	Cvar_CheckRange( cl_aviFrameRate, "1", "1000", CV_INTEGER );
 	Cvar_SetDescription( cl_aviFrameRate, "The framerate used for capturing video." );
 	cl_aviMotionJpeg = Cvar_Get ("cl_aviMotionJpeg", "1", CVAR_ARCHIVE);
 	Cvar_SetDescription( cl_aviMotionJpeg, "Enable/disable the MJPEG codec for avi output." );
+	// kept under the name it had when the renderer compressed frames
+	cl_aviMotionJpegQuality = Cvar_Get( "r_aviMotionJpegQuality", "90", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_aviMotionJpegQuality, "1", "100", CV_INTEGER );
+	Cvar_SetDescription( cl_aviMotionJpegQuality, "Controls quality of Jpeg video capture when \\cl_aviMotionJpeg 1." );
+	cl_aviEncoders = Cvar_Get( "cl_aviEncoders", "4", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_aviEncoders, "0", "8", CV_INTEGER );
+	Cvar_SetDescription( cl_aviEncoders, "Number of threads compressing MJPEG video frames, 0 compresses each frame before the next one is rendered. Takes effect with the next capture." );
 	cl_forceavidemo = Cvar_Get ("cl_forceavidemo", "0", 0);
 	Cvar_SetDescription( cl_forceavidemo, "Forces all demo recording into a sequence of screenshots in TGA format." );
 
@@ -3956,6 +5083,9 @@ void CL_Init( void ) {
 #ifdef USE_CURL
 	cl_mapAutoDownload = Cvar_Get( "cl_mapAutoDownload", "1", CVAR_ARCHIVE_ND );
 	Cvar_SetDescription( cl_mapAutoDownload, "Automatic map download for play and demo playback (via automatic \\dlmap call)." );
+	cl_dlParallel = Cvar_Get( "cl_dlParallel", "4", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_dlParallel, "1", XSTRING( MAX_CURL_TRANSFERS ), CV_INTEGER );
+	Cvar_SetDescription( cl_dlParallel, "Number of missing paks fetched at once from a server's HTTP/FTP download location." );
 #ifdef USE_CURL_DLOPEN
 	cl_cURLLib = Cvar_Get( "cl_cURLLib", DEFAULT_CURL_LIB, 0 );
 	Cvar_SetDescription( cl_cURLLib, "Filename of cURL library to load." );
@@ -3989,6 +5119,13 @@ void CL_Init( void ) {
 	Cvar_CheckRange( cv, "100", "999", CV_INTEGER );
 	Cvar_SetDescription( cv, "Specify the maximum allowed ping to a server." );
 
+	cl_queryRate = Cvar_Get( "cl_queryRate", "250", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cl_queryRate, "10", "2000", CV_INTEGER );
+	Cvar_SetDescription( cl_queryRate, "Maximum number of server browser queries sent per second." );
+
+	cl_serverCache = Cvar_Get( "cl_serverCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( cl_serverCache, "Keep the last known server browser lists in servercache.dat so they are shown at startup and refreshed gradually." );
+
 	cl_lanForcePackets = Cvar_Get( "cl_lanForcePackets", "1", CVAR_ARCHIVE_ND );
 	Cvar_SetDescription( cl_lanForcePackets, "Bypass \\cl_maxpackets for LAN games, send packets every frame." );
 
@@ -4051,6 +5188,7 @@ void CL_Init( void ) {
 	Cmd_AddCommand ("cmd", CL_ForwardToServer_f);
 	Cmd_AddCommand ("configstrings", CL_Configstrings_f);
 	Cmd_AddCommand ("clientinfo", CL_Clientinfo_f);
+	Cmd_AddCommand ("cl_tracestats", CL_TraceCacheStats_f);
 	Cmd_AddCommand ("snd_restart", CL_Snd_Restart_f);
 	Cmd_AddCommand ("vid_restart", CL_Vid_Restart_f);
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
@@ -4058,6 +5196,9 @@ void CL_Init( void ) {
 	Cmd_SetCommandCompletionFunc( "record", CL_CompleteRecordName );
 	Cmd_AddCommand ("demo", CL_PlayDemo_f);
 	Cmd_SetCommandCompletionFunc( "demo", CL_CompleteDemoName );
+	Cmd_AddCommand ("demo_seek", CL_DemoSeek_f);
+	Cmd_AddCommand ("demo_export", CL_DemoExport_f);
+	Cmd_SetCommandCompletionFunc( "demo_export", CL_CompleteDemoName );
 	Cmd_AddCommand ("cinematic", CL_PlayCinematic_f);
 	Cmd_AddCommand ("stoprecord", CL_StopRecord_f);
 	Cmd_AddCommand ("connect", CL_Connect_f);
@@ -4137,11 +5278,14 @@ void CL_Shutdown( const char *finalmsg, qboolean quit ) {
 	Cmd_RemoveCommand ("configstrings");
 	Cmd_RemoveCommand ("userinfo");
 	Cmd_RemoveCommand ("clientinfo");
+	Cmd_RemoveCommand ("cl_tracestats");
 	Cmd_RemoveCommand ("snd_restart");
 	Cmd_RemoveCommand ("vid_restart");
 	Cmd_RemoveCommand ("disconnect");
 	Cmd_RemoveCommand ("record");
 	Cmd_RemoveCommand ("demo");
+	Cmd_RemoveCommand ("demo_seek");
+	Cmd_RemoveCommand ("demo_export");
 	Cmd_RemoveCommand ("cinematic");
 	Cmd_RemoveCommand ("stoprecord");
 	Cmd_RemoveCommand ("connect");
@@ -4183,20 +5327,23 @@ void CL_Shutdown( const char *finalmsg, qboolean quit ) {
 
 
 static void CL_SetServerInfo(serverInfo_t *server, const char *info, int ping) {
+	static infoDict_t dict;
+
 	if (server) {
 		if (info) {
-			server->clients = atoi(Info_ValueForKey(info, "clients"));
-			Q_strncpyz(server->hostName,Info_ValueForKey(info, "hostname"), MAX_NAME_LENGTH);
-			Q_strncpyz(server->mapName, Info_ValueForKey(info, "mapname"), MAX_NAME_LENGTH);
-			server->maxClients = atoi(Info_ValueForKey(info, "sv_maxclients"));
-			Q_strncpyz(server->game,Info_ValueForKey(info, "game"), MAX_NAME_LENGTH);
-			server->gameType = atoi(Info_ValueForKey(info, "gametype"));
-			server->netType = atoi(Info_ValueForKey(info, "nettype"));
-			server->minPing = atoi(Info_ValueForKey(info, "minping"));
-			server->maxPing = atoi(Info_ValueForKey(info, "maxping"));
-			server->punkbuster = atoi(Info_ValueForKey(info, "punkbuster"));
-			server->g_humanplayers = atoi(Info_ValueForKey(info, "g_humanplayers"));
-			server->g_needpass = atoi(Info_ValueForKey(info, "g_needpass"));
+			Info_DictParse( &dict, info );
+			server->clients = atoi(Info_DictValue(&dict, "clients"));
+			Q_strncpyz(server->hostName,Info_DictValue(&dict, "hostname"), MAX_NAME_LENGTH);
+			Q_strncpyz(server->mapName, Info_DictValue(&dict, "mapname"), MAX_NAME_LENGTH);
+			server->maxClients = atoi(Info_DictValue(&dict, "sv_maxclients"));
+			Q_strncpyz(server->game,Info_DictValue(&dict, "game"), MAX_NAME_LENGTH);
+			server->gameType = atoi(Info_DictValue(&dict, "gametype"));
+			server->netType = atoi(Info_DictValue(&dict, "nettype"));
+			server->minPing = atoi(Info_DictValue(&dict, "minping"));
+			server->maxPing = atoi(Info_DictValue(&dict, "maxping"));
+			server->punkbuster = atoi(Info_DictValue(&dict, "punkbuster"));
+			server->g_humanplayers = atoi(Info_DictValue(&dict, "g_humanplayers"));
+			server->g_needpass = atoi(Info_DictValue(&dict, "g_needpass"));
 		}
 		server->ping = ping;
 	}
@@ -4246,6 +5393,8 @@ static void CL_ServerInfoPacket( const netadr_t *from, msg_t *msg ) {
 		return;
 	}
 
+	CL_ServerQueryReply( from, infoString );
+
 	// iterate servers waiting for ping response
 	for (i=0; i<MAX_PINGREQUESTS; i++)
 	{
@@ -4889,9 +6038,8 @@ CL_UpdateVisiblePings_f
 ==================
 */
 qboolean CL_UpdateVisiblePings_f(int source) {
-	int			slots, i;
-	char		buff[MAX_STRING_CHARS];
-	int			pingTime;
+	serverInfo_t *server;
+	int			i;
 	int			max;
 	qboolean status = qfalse;
 
@@ -4901,88 +6049,53 @@ qboolean CL_UpdateVisiblePings_f(int source) {
 
 	cls.pingUpdateSource = source;
 
-	slots = CL_GetPingQueueCount();
-	if (slots < MAX_PINGREQUESTS) {
-		serverInfo_t *server = NULL;
+	switch (source) {
+		case AS_LOCAL :
+			server = &cls.localServers[0];
+			max = cls.numlocalservers;
+		break;
+		case AS_GLOBAL :
+			server = &cls.globalServers[0];
+			max = cls.numglobalservers;
+		break;
+		case AS_FAVORITES :
+			server = &cls.favoriteServers[0];
+			max = cls.numfavoriteservers;
+		break;
+		default:
+			return qfalse;
+	}
 
-		switch (source) {
-			case AS_LOCAL :
-				server = &cls.localServers[0];
-				max = cls.numlocalservers;
-			break;
-			case AS_GLOBAL :
-				server = &cls.globalServers[0];
-				max = cls.numglobalservers;
-			break;
-			case AS_FAVORITES :
-				server = &cls.favoriteServers[0];
-				max = cls.numfavoriteservers;
-			break;
-			default:
-				return qfalse;
+	for (i = 0; i < max; i++) {
+		if (!server[i].visible) {
+			continue;
 		}
-		for (i = 0; i < max; i++) {
-			if (server[i].visible) {
-				if (server[i].ping == -1) {
-					int j;
-
-					if (slots >= MAX_PINGREQUESTS) {
-						break;
-					}
-					for (j = 0; j < MAX_PINGREQUESTS; j++) {
-						if (!cl_pinglist[j].adr.port) {
-							continue;
-						}
-						if (NET_CompareAdr( &cl_pinglist[j].adr, &server[i].adr)) {
-							// already on the list
-							break;
-						}
-					}
-					if (j >= MAX_PINGREQUESTS) {
-						status = qtrue;
-						for (j = 0; j < MAX_PINGREQUESTS; j++) {
-							if (!cl_pinglist[j].adr.port) {
-								memcpy(&cl_pinglist[j].adr, &server[i].adr, sizeof(netadr_t));
-								cl_pinglist[j].start = Sys_Milliseconds();
-								cl_pinglist[j].time = 0;
-								NET_OutOfBandPrint(NS_CLIENT, &cl_pinglist[j].adr, "getinfo xxx");
-								slots++;
-								break;
-							}
-						}
-					}
-				}
-				// if the server has a ping higher than cl_maxPing or
-				// the ping packet got lost
-				else if (server[i].ping == 0) {
-					// if we are updating global servers
-					if (source == AS_GLOBAL) {
-						//
-						if ( cls.numGlobalServerAddresses > 0 ) {
-							// overwrite this server with one from the additional global servers
-							cls.numGlobalServerAddresses--;
-							CL_InitServerInfo(&server[i], &cls.globalServerAddresses[cls.numGlobalServerAddresses]);
-							// NOTE: the server[i].visible flag stays untouched
-						}
-					}
+		// not pinged yet or only known from servercache.dat
+		if (server[i].ping == -1 || server[i].cached) {
+			if (CL_QueueServerQuery(source, i, &server[i].adr)) {
+				server[i].cached = qfalse;
+				status = qtrue;
+			}
+		}
+		// if the server has a ping higher than cl_maxPing or
+		// the ping packet got lost
+		else if (server[i].ping == 0) {
+			// if we are updating global servers
+			if (source == AS_GLOBAL) {
+				//
+				if ( cls.numGlobalServerAddresses > 0 ) {
+					// overwrite this server with one from the additional global servers
+					cls.numGlobalServerAddresses--;
+					CL_InitServerInfo(&server[i], &cls.globalServerAddresses[cls.numGlobalServerAddresses]);
+					// NOTE: the server[i].visible flag stays untouched
 				}
 			}
 		}
 	}
 
-	if (slots) {
+	if (CL_ServerQueriesActive()) {
 		status = qtrue;
 	}
-	for (i = 0; i < MAX_PINGREQUESTS; i++) {
-		if (!cl_pinglist[i].adr.port) {
-			continue;
-		}
-		CL_GetPing( i, buff, MAX_STRING_CHARS, &pingTime );
-		if (pingTime != 0) {
-			CL_ClearPing(i);
-			status = qtrue;
-		}
-	}
 
 	return status;
 }
@@ -36,6 +36,7 @@ static const char *svc_strings[256] = {
 	"svc_EOF",
 	"svc_voipSpeex", // ioq3 extension
 	"svc_voipOpus",  // ioq3 extension
+	"svc_configstringBlock",
 };
 
 static void SHOWNET( msg_t *msg, const char *s ) {
@@ -301,6 +302,8 @@ static void CL_ParseSnapshot( msg_t *msg ) {
 		cl.snapshots[ ( oldMessageNum + i ) & PACKET_MASK ].valid = qfalse;
 	}
 
+	CL_MeasureSnapshot( &newSnap );
+
 	// copy to the current good spot
 	cl.snap = newSnap;
 	cl.snap.ping = 999;
@@ -493,6 +496,77 @@ static void CL_ParseServerInfo( void )
 }
 
 
+/*
+==================
+CL_AddGamestateString
+==================
+*/
+static void CL_AddGamestateString( int index, const char *s, int len ) {
+
+	if ( index < 0 || index >= MAX_CONFIGSTRINGS ) {
+		Com_Error( ERR_DROP, "%s: configstring > MAX_CONFIGSTRINGS", __func__ );
+	}
+
+	if ( len + 1 + cl.gameState.dataCount > MAX_GAMESTATE_CHARS ) {
+		Com_Error( ERR_DROP, "%s: MAX_GAMESTATE_CHARS exceeded: %i", __func__,
+			len + 1 + cl.gameState.dataCount );
+	}
+
+	// append it to the gameState string buffer
+	cl.gameState.stringOffsets[ index ] = cl.gameState.dataCount;
+	Com_Memcpy( cl.gameState.stringData + cl.gameState.dataCount, s, len );
+	cl.gameState.stringData[ cl.gameState.dataCount + len ] = '\0';
+	cl.gameState.dataCount += len + 1;
+}
+
+
+/*
+==================
+CL_ParseConfigstringBlock
+
+LZ compressed [short] index [string] entries of the gamestate extension
+==================
+*/
+static void CL_ParseConfigstringBlock( msg_t *msg ) {
+	static byte	data[ MAX_MSGLEN ];
+	static byte	block[ GS_EXT_MAX_BLOCK ];
+	int		size, compressedSize;
+	int		pos, index, len;
+
+	clc.dm68compat = qfalse;
+	clc.eventMask |= EM_CSBLOCK;
+
+	size = MSG_ReadLong( msg );
+	compressedSize = MSG_ReadLong( msg );
+	if ( size <= 0 || size > (int)sizeof( block ) || compressedSize <= 0 || compressedSize > (int)sizeof( data ) ) {
+		Com_Error( ERR_DROP, "%s: bad block size %i/%i", __func__, compressedSize, size );
+	}
+
+	MSG_ReadData( msg, data, compressedSize );
+	if ( msg->readcount > msg->cursize ) {
+		Com_Error( ERR_DROP, "%s: end of message", __func__ );
+	}
+
+	if ( MSG_LZDecompress( block, size, data, compressedSize ) != size ) {
+		Com_Error( ERR_DROP, "%s: corrupted block", __func__ );
+	}
+
+	for ( pos = 0; pos < size; pos += len + 1 ) {
+		if ( pos + 2 >= size ) {
+			Com_Error( ERR_DROP, "%s: truncated block", __func__ );
+		}
+		index = block[ pos ] | ( block[ pos + 1 ] << 8 );
+		pos += 2;
+		for ( len = 0; pos + len < size && block[ pos + len ] != '\0'; len++ )
+			;
+		if ( pos + len >= size ) {
+			Com_Error( ERR_DROP, "%s: unterminated string", __func__ );
+		}
+		CL_AddGamestateString( index, (const char *)block + pos, len );
+	}
+}
+
+
 /*
 ==================
 CL_ParseGamestate
@@ -543,25 +617,11 @@ static void CL_ParseGamestate( msg_t *msg ) {
 		}
 
 		if ( cmd == svc_configstring ) {
-			int		len;
-
 			i = MSG_ReadShort( msg );
-			if ( i < 0 || i >= MAX_CONFIGSTRINGS ) {
-				Com_Error( ERR_DROP, "%s: configstring > MAX_CONFIGSTRINGS", __func__ );
-			}
-
 			s = MSG_ReadBigString( msg );
-			len = strlen( s );
-
-			if ( len + 1 + cl.gameState.dataCount > MAX_GAMESTATE_CHARS ) {
-				Com_Error( ERR_DROP, "%s: MAX_GAMESTATE_CHARS exceeded: %i", __func__,
-					len + 1 + cl.gameState.dataCount );
-			}
-
-			// append it to the gameState string buffer
-			cl.gameState.stringOffsets[ i ] = cl.gameState.dataCount;
-			Com_Memcpy( cl.gameState.stringData + cl.gameState.dataCount, s, len + 1 );
-			cl.gameState.dataCount += len + 1;
+			CL_AddGamestateString( i, s, strlen( s ) );
+		} else if ( cmd == svc_configstringBlock ) {
+			CL_ParseConfigstringBlock( msg );
 		} else if ( cmd == svc_baseline ) {
 			newnum = MSG_ReadEntitynum( msg );
 
@@ -587,6 +647,11 @@ static void CL_ParseGamestate( msg_t *msg ) {
 	// read the checksum feed
 	clc.checksumFeed = MSG_ReadLong( msg );
 
+	if ( clc.demoexport ) {
+		// demo_export only needs the parsed state
+		return;
+	}
+
 	// save old gamedir
 	Cvar_VariableStringBuffer( "fs_game", oldGame, sizeof( oldGame ) );
 
@@ -695,21 +760,32 @@ static void CL_ParseDownload( msg_t *msg ) {
 	// read the data
 	block = MSG_ReadShort ( msg );
 
-	if(!block && !clc.downloadBlock)
+	// block zero is special, contains file size, it may be
+	// resent after a lost ack so check before the block number
+	if ( !block && clc.downloadBlock <= 0xFFFF )
 	{
-		// block zero is special, contains file size
-		clc.downloadSize = MSG_ReadLong ( msg );
+		size = MSG_ReadLong ( msg );
 
-		Cvar_SetIntegerValue( "cl_downloadSize", clc.downloadSize );
-
-		if (clc.downloadSize < 0)
+		if ( size < 0 && !clc.downloadBlock )
 		{
 			Com_Error( ERR_DROP, "%s", MSG_ReadString( msg ) );
 			return;
 		}
+
+		clc.downloadSize = size;
+		Cvar_SetIntegerValue( "cl_downloadSize", clc.downloadSize );
+
+		size = MSG_ReadShort ( msg );
+		if ( size == DL_EXT_MARKER ) {
+			clc.downloadExt = qtrue;
+			size = MSG_ReadShort ( msg );
+		}
+	}
+	else
+	{
+		size = MSG_ReadShort ( msg );
 	}
 
-	size = MSG_ReadShort ( msg );
 	if (size < 0 || size > sizeof(data))
 	{
 		Com_Error(ERR_DROP, "CL_ParseDownload: Invalid size %d for download chunk", size);
@@ -721,6 +797,11 @@ static void CL_ParseDownload( msg_t *msg ) {
 	if((clc.downloadBlock & 0xFFFF) != block)
 	{
 		Com_DPrintf( "CL_ParseDownload: Expected block %d, got %d\n", (clc.downloadBlock & 0xFFFF), block);
+		// report the hole once so the server resends from it
+		if ( clc.downloadExt && clc.downloadLost != clc.downloadBlock ) {
+			clc.downloadLost = clc.downloadBlock;
+			CL_AddReliableCommand( va("nextdl %d lost", clc.downloadBlock - 1), qfalse );
+		}
 		return;
 	}
 
@@ -749,7 +830,9 @@ static void CL_ParseDownload( msg_t *msg ) {
 	if (size)
 		FS_Write( data, size, clc.download );
 
-	CL_AddReliableCommand( va("nextdl %d", clc.downloadBlock), qfalse );
+	// the extension takes cumulative acks, send one every few blocks and at EOF
+	if ( !clc.downloadExt || !size || ( clc.downloadBlock + 1 ) % DL_EXT_ACK_BLOCKS == 0 )
+		CL_AddReliableCommand( va("nextdl %d", clc.downloadBlock), qfalse );
 	clc.downloadBlock++;
 
 	clc.downloadCount += size;
@@ -654,11 +654,13 @@ void SCR_UpdateScreen( void ) {
 			SCR_DrawScreenField( STEREO_CENTER );
 		}
 
+		Com_TraceBegin( "RE_EndFrame" );
 		if ( com_speeds->integer ) {
 			re.EndFrame( &time_frontend, &time_backend );
 		} else {
 			re.EndFrame( NULL, NULL );
 		}
+		Com_TraceEnd();
 	}
 
 	recursive = 0;
@@ -50,7 +50,7 @@ LAN_LoadCachedServers
 */
 static void LAN_LoadCachedServers( void ) {
 	fileHandle_t fileIn;
-	int size, file_size;
+	int size, file_size, i;
 
 	cls.numglobalservers = cls.numfavoriteservers = 0;
 	cls.numGlobalServerAddresses = 0;
@@ -70,6 +70,13 @@ static void LAN_LoadCachedServers( void ) {
 	if ( size == sizeof(cls.globalServers) + sizeof(cls.favoriteServers) ) {
 		FS_Read( &cls.globalServers, sizeof(cls.globalServers), fileIn );
 		FS_Read( &cls.favoriteServers, sizeof(cls.favoriteServers), fileIn );
+		// shown as they are and queried again once visible
+		for ( i = 0; i < MAX_GLOBAL_SERVERS; i++ ) {
+			cls.globalServers[i].cached = qtrue;
+		}
+		for ( i = 0; i < MAX_OTHER_SERVERS; i++ ) {
+			cls.favoriteServers[i].cached = qtrue;
+		}
 	} else {
 		cls.numglobalservers = cls.numfavoriteservers = 0;
 		cls.numGlobalServerAddresses = 0;
@@ -1220,6 +1227,11 @@ void CL_ShutdownUI( void ) {
 	VM_Free( uivm );
 	uivm = NULL;
 	FS_VM_CloseFiles( H_Q3UI );
+
+	// keep lists for the next start even if the ui doesn't cache them itself
+	if ( cl_serverCache->integer && ( cls.numglobalservers > 0 || cls.numfavoriteservers > 0 ) ) {
+		LAN_SaveServersToCache();
+	}
 }
 
 
@@ -1231,12 +1243,19 @@ CL_InitUI
 #define UI_OLD_API_VERSION	4
 
 void CL_InitUI( void ) {
+	static qboolean cacheLoaded = qfalse;
 	int		v;
 	vmInterpret_t		interpret;
 
 	// disallow vl.collapse for UI elements
 	re.VertexLighting( qfalse );
 
+	// fill server browser with last known lists once per session
+	if ( cl_serverCache->integer && !cacheLoaded ) {
+		LAN_LoadCachedServers();
+		cacheLoaded = qtrue;
+	}
+
 	// load the dll or bytecode
 	interpret = Cvar_VariableIntegerValue( "vm_ui" );
 	if ( cl_connectedToPureServer )
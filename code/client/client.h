@@ -103,6 +103,13 @@ typedef struct {
 									// cleared when CL_AdjustTimeDelta looks at it
 	qboolean	newSnapshots;		// set on parse of any valid packet
 
+	// snapshot arrival statistics for the jitter buffer
+	int			snapArrivalTime;	// cls.realtime when cl.snap arrived
+	int			snapInterval;		// smallest serverTime step seen between snapshots
+	float		snapJitter;			// smoothed arrival time variation, msec
+	float		snapLossGap;		// decaying peak of serverTime lost to dropped snapshots, msec
+	float		jitterDelay;		// extra interpolation delay in effect, msec
+
 	gameState_t	gameState;			// configstrings
 	char		mapname[MAX_QPATH];	// extracted from CS_SERVERINFO
 
@@ -148,6 +155,7 @@ extern	clientActive_t		cl;
 #define EM_GAMESTATE 1
 #define EM_SNAPSHOT  2
 #define EM_COMMAND   4
+#define EM_CSBLOCK   8	// gamestate came with svc_configstringBlock
 
 /*
 =============================================================================
@@ -202,6 +210,8 @@ typedef struct {
 	char		sv_dlURL[MAX_CVAR_VALUE_STRING];
 	int			downloadNumber;
 	int			downloadBlock;	// block we are waiting for
+	int			downloadLost;	// block last reported missing to the server
+	qboolean	downloadExt;	// server confirmed the download extension
 	int			downloadCount;	// how many bytes we got
 	int			downloadSize;	// how many bytes we got
 	char		downloadList[BIG_INFO_STRING]; // list of paks we need to download
@@ -211,9 +221,7 @@ typedef struct {
 	qboolean	cURLEnabled;
 	qboolean	cURLUsed;
 	qboolean	cURLDisconnected;
-	char		downloadURL[MAX_OSPATH];
-	CURL		*downloadCURL;
-	CURLM		*downloadCURLM;
+	CURLM		*downloadCURLM;	// all transfers started by CL_NextDownload
 #endif /* USE_CURL */
 
 	// demo information
@@ -257,6 +265,8 @@ typedef struct {
 	int		demoDeltaNum;
 	int		demoMessageSequence;
 
+	qboolean	demoexport;	// demo_export parses messages without loading anything
+
 } clientConnection_t;
 
 extern	clientConnection_t clc;
@@ -293,6 +303,7 @@ typedef struct {
 	int			punkbuster;
 	int			g_humanplayers;
 	int			g_needpass;
+	qboolean	cached;		// info came from servercache.dat and was not queried again yet
 } serverInfo_t;
 
 typedef struct {
@@ -401,11 +412,17 @@ extern	cvar_t	*cl_timegraph;
 extern	cvar_t	*cl_shownet;
 extern	cvar_t	*cl_autoNudge;
 extern	cvar_t	*cl_timeNudge;
+extern	cvar_t	*cl_jitterBuffer;
+extern	cvar_t	*cl_snapJitter;
+extern	cvar_t	*cl_snapBufferDepth;
+extern	cvar_t	*cl_traceCache;
 extern	cvar_t	*cl_showTimeDelta;
 
 extern	cvar_t	*com_timedemo;
 extern	cvar_t	*cl_aviFrameRate;
 extern	cvar_t	*cl_aviMotionJpeg;
+extern	cvar_t	*cl_aviMotionJpegQuality;
+extern	cvar_t	*cl_aviEncoders;
 extern	cvar_t	*cl_aviPipeFormat;
 
 extern	cvar_t	*cl_activeAction;
@@ -414,12 +431,14 @@ extern	cvar_t	*cl_allowDownload;
 #ifdef USE_CURL
 extern	cvar_t	*cl_mapAutoDownload;
 extern	cvar_t	*cl_dlDirectory;
+extern	cvar_t	*cl_dlParallel;
 #endif
 extern	cvar_t	*cl_conXOffset;
 extern	cvar_t	*cl_conColor;
 extern	cvar_t	*cl_inGameVideo;
 
 extern	cvar_t	*cl_lanForcePackets;
+extern	cvar_t	*cl_serverCache;
 extern	cvar_t	*cl_autoRecordDemo;
 extern	cvar_t	*cl_drawRecording;
 
@@ -585,9 +604,13 @@ void CIN_CloseAllVideos(void);
 //
 void CL_InitCGame( void );
 void CL_ShutdownCGame( void );
+void CL_ClearTraceCache( void );
+void CL_TraceCacheStats_f( void );
 qboolean CL_GameCommand( void );
 void CL_CGameRendering( stereoFrame_t stereo );
 void CL_SetCGameTime( void );
+void CL_MeasureSnapshot( const clSnapshot_t *newSnap );
+void CL_SkipServerCommands( void );
 
 //
 // cl_ui.c
@@ -614,6 +637,11 @@ void CL_WriteAVIAudioFrame( const byte *pcmBuffer, int size );
 qboolean CL_CloseAVI( qboolean reopen );
 qboolean CL_VideoRecording( void );
 
+//
+// cl_export.c
+//
+void CL_DemoExport_f( void );
+
 //
 // cl_jpeg.c
 //
@@ -635,6 +663,7 @@ void	GLimp_Init( glconfig_t *config );
 void	GLimp_Shutdown( qboolean unloadDLL );
 void	GLimp_EndFrame( void );
 void	*GL_GetProcAddress( const char *name );
+qboolean GLimp_MakeCurrent( qboolean current );
 #endif
 
 // Vulkan
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "client.h"
 #include "snd_codec.h"
+#include "snd_local.h"
 
 static snd_codec_t *codecs;
 
@@ -181,6 +182,245 @@ snd_stream_t *S_CodecOpenStream( const char *filename )
 }
 
 
+/*
+=================
+S_CodecFindSound
+
+Finds the file S_CodecLoad would try first, in the same order,
+returns its codec or NULL if there is no such file
+=================
+*/
+snd_codec_t *S_CodecFindSound( const char *filename, char *path, int size )
+{
+	snd_codec_t *codec;
+	snd_codec_t *orgCodec = NULL;
+	char		localName[ MAX_QPATH ];
+	const char	*ext;
+
+	Q_strncpyz( localName, filename, sizeof( localName ) );
+
+	ext = COM_GetExtension( localName );
+
+	if ( *ext )
+	{
+		for ( codec = codecs; codec; codec = codec->next )
+		{
+			if ( !Q_stricmp( ext, codec->ext ) )
+			{
+				if ( FS_FOpenFileRead( localName, NULL, qfalse ) != -1 )
+				{
+					Q_strncpyz( path, localName, size );
+					return codec;
+				}
+				orgCodec = codec;
+				COM_StripExtension( filename, localName, MAX_QPATH );
+				break;
+			}
+		}
+	}
+
+	for ( codec = codecs; codec; codec = codec->next )
+	{
+		if ( codec == orgCodec )
+			continue;
+
+		Com_sprintf( path, size, "%s.%s", localName, codec->ext );
+
+		if ( FS_FOpenFileRead( path, NULL, qfalse ) != -1 )
+			return codec;
+	}
+
+	return NULL;
+}
+
+
+//=======================================================================
+// Background decoding
+//
+// A decoder thread owns the stream after S_CodecStartDecoder and keeps a
+// ring of decoded bytes filled, the only consumer is the thread calling
+// S_CodecReadStream. Head and tail are published with atomics so the ring
+// needs no lock. Reads block only if the decoder falls behind, so results
+// are the same as reading the stream directly.
+
+#define DECODER_RING_SIZE	0x40000		// must be power of two
+#define DECODER_READ_SIZE	0x4000		// largest single read of the thread
+
+struct snd_decoder_s
+{
+	snd_stream_t	*stream;
+	void			*thread;
+	volatile int	quit;
+	volatile int	eof;
+	volatile int	head;		// bytes written by the decoder thread
+	volatile int	tail;		// bytes consumed
+	byte			ring[ DECODER_RING_SIZE ];
+};
+
+
+/*
+=================
+S_CodecTimedRead
+
+Decodes from the codec and adds the time to the sound counters
+=================
+*/
+static int S_CodecTimedRead( snd_stream_t *stream, int bytes, void *buffer )
+{
+	int64_t start;
+	int r;
+
+	start = Sys_Microseconds();
+	r = stream->codec->read( stream, bytes, buffer );
+	Sys_AtomicAdd( &s_counters.decodeUsec, (int)( Sys_Microseconds() - start ) );
+
+	return r;
+}
+
+
+/*
+=================
+S_CodecDecoderThread
+=================
+*/
+static void S_CodecDecoderThread( void *arg )
+{
+	snd_decoder_t *d = arg;
+	int head, space, n, r;
+
+	head = d->head;
+
+	while ( !Sys_AtomicLoad( &d->quit ) )
+	{
+		space = DECODER_RING_SIZE - ( head - Sys_AtomicLoad( &d->tail ) );
+		if ( space < DECODER_READ_SIZE )
+		{
+			Sys_Sleep( 5 );
+			continue;
+		}
+
+		// contiguous part of the free space
+		n = DECODER_RING_SIZE - ( head & ( DECODER_RING_SIZE - 1 ) );
+		if ( n > DECODER_READ_SIZE )
+			n = DECODER_READ_SIZE;
+
+		r = S_CodecTimedRead( d->stream, n, d->ring + ( head & ( DECODER_RING_SIZE - 1 ) ) );
+		if ( r > 0 )
+		{
+			head += r;
+			Sys_AtomicStore( &d->head, head );
+		}
+
+		// codecs return short reads only at the end of the stream
+		if ( r < n )
+		{
+			Sys_AtomicStore( &d->eof, 1 );
+			break;
+		}
+	}
+}
+
+
+/*
+=================
+S_CodecReadDecoder
+=================
+*/
+static int S_CodecReadDecoder( snd_decoder_t *d, int bytes, void *buffer )
+{
+	byte *out = buffer;
+	int tail, avail, n, ofs, eof;
+	qboolean waited = qfalse;
+
+	tail = d->tail;
+
+	while ( bytes > 0 )
+	{
+		// head is final once eof is set
+		eof = Sys_AtomicLoad( &d->eof );
+		avail = Sys_AtomicLoad( &d->head ) - tail;
+		if ( avail == 0 )
+		{
+			if ( eof )
+				break;
+			if ( !waited )
+				Sys_AtomicAdd( &s_counters.underruns, 1 );
+			waited = qtrue;
+			Sys_Sleep( 1 );
+			continue;
+		}
+
+		if ( avail > bytes )
+			avail = bytes;
+
+		ofs = tail & ( DECODER_RING_SIZE - 1 );
+		n = DECODER_RING_SIZE - ofs;
+		if ( n > avail )
+			n = avail;
+
+		Com_Memcpy( out, d->ring + ofs, n );
+		Com_Memcpy( out + n, d->ring, avail - n );
+
+		out += avail;
+		bytes -= avail;
+		tail += avail;
+		Sys_AtomicStore( &d->tail, tail );
+	}
+
+	return out - (byte *)buffer;
+}
+
+
+/*
+=================
+S_CodecStopDecoder
+=================
+*/
+static void S_CodecStopDecoder( snd_stream_t *stream )
+{
+	snd_decoder_t *d = stream->decoder;
+
+	if ( !d )
+		return;
+
+	Sys_AtomicStore( &d->quit, 1 );
+	Com_JoinThread( d->thread );
+
+	Z_Free( d );
+	stream->decoder = NULL;
+}
+
+
+/*
+=================
+S_CodecStartDecoder
+
+Decodes the stream on a thread from now on, the stream
+is read directly if the thread can't be created
+=================
+*/
+void S_CodecStartDecoder( snd_stream_t *stream )
+{
+	snd_decoder_t *d;
+
+	if ( stream->decoder )
+		return;
+
+	d = Z_Malloc( sizeof( *d ) );
+	d->stream = stream;
+
+	d->thread = Com_CreateThread( JOB_POOL_AUDIO, "sound decoder", S_CodecDecoderThread, d );
+	if ( !d->thread )
+	{
+		Com_DPrintf( S_COLOR_YELLOW "WARNING: couldn't start stream decoder thread\n" );
+		Z_Free( d );
+		return;
+	}
+
+	stream->decoder = d;
+}
+
+
 /*
 =================
 S_CodecCloseStream
@@ -188,6 +428,7 @@ S_CodecCloseStream
 */
 void S_CodecCloseStream( snd_stream_t *stream )
 {
+	S_CodecStopDecoder( stream );
 	stream->codec->close( stream );
 }
 
@@ -199,7 +440,10 @@ S_CodecReadStream
 */
 int S_CodecReadStream( snd_stream_t *stream, int bytes, void *buffer )
 {
-	return stream->codec->read( stream, bytes, buffer );
+	if ( stream->decoder )
+		return S_CodecReadDecoder( stream->decoder, bytes, buffer );
+
+	return S_CodecTimedRead( stream, bytes, buffer );
 }
 
 
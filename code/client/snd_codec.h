@@ -38,6 +38,7 @@ typedef struct snd_info_s
 } snd_info_t;
 
 typedef struct snd_codec_s snd_codec_t;
+typedef struct snd_decoder_s snd_decoder_t;
 
 typedef struct snd_stream_s
 {
@@ -47,6 +48,7 @@ typedef struct snd_stream_s
 	int length;
 	int pos;
 	void *ptr;
+	snd_decoder_t *decoder;		// reads ahead on a thread if set
 } snd_stream_t;
 
 // Codec functions
@@ -54,6 +56,7 @@ typedef void *(*CODEC_LOAD)(const char *filename, snd_info_t *info);
 typedef snd_stream_t *(*CODEC_OPEN)(const char *filename);
 typedef int (*CODEC_READ)(snd_stream_t *stream, int bytes, void *buffer);
 typedef void (*CODEC_CLOSE)(snd_stream_t *stream);
+typedef void *(*CODEC_PARSE)(byte *buffer, int length, snd_info_t *info);
 
 // Codec data structure
 struct snd_codec_s
@@ -63,6 +66,7 @@ struct snd_codec_s
 	CODEC_OPEN open;
 	CODEC_READ read;
 	CODEC_CLOSE close;
+	CODEC_PARSE parse;		// optional, decodes a file already in memory
 	snd_codec_t *next;
 };
 
@@ -71,8 +75,10 @@ void S_CodecInit( void );
 void S_CodecShutdown( void );
 void *S_CodecLoad(const char *filename, snd_info_t *info);
 snd_stream_t *S_CodecOpenStream(const char *filename);
+snd_codec_t *S_CodecFindSound(const char *filename, char *path, int size);
 void S_CodecCloseStream(snd_stream_t *stream);
 int S_CodecReadStream(snd_stream_t *stream, int bytes, void *buffer);
+void S_CodecStartDecoder(snd_stream_t *stream);
 
 // Util functions (used by codecs)
 snd_stream_t *S_CodecUtilOpen(const char *filename, snd_codec_t *codec);
@@ -84,6 +90,7 @@ void *S_WAV_CodecLoad(const char *filename, snd_info_t *info);
 snd_stream_t *S_WAV_CodecOpenStream(const char *filename);
 void S_WAV_CodecCloseStream(snd_stream_t *stream);
 int S_WAV_CodecReadStream(snd_stream_t *stream, int bytes, void *buffer);
+void *S_WAV_CodecParse(byte *buffer, int length, snd_info_t *info);
 
 // Ogg Vorbis codec
 #ifdef USE_CODEC_VORBIS
@@ -46,6 +46,7 @@ snd_codec_t ogg_codec =
 	S_OGG_CodecOpenStream,
 	S_OGG_CodecReadStream,
 	S_OGG_CodecCloseStream,
+	NULL,
 	NULL
 };
 
@@ -192,6 +192,7 @@ snd_codec_t wav_codec =
 	S_WAV_CodecOpenStream,
 	S_WAV_CodecReadStream,
 	S_WAV_CodecCloseStream,
+	S_WAV_CodecParse,
 	NULL
 };
 
@@ -240,6 +241,130 @@ void *S_WAV_CodecLoad(const char *filename, snd_info_t *info)
 	return buffer;
 }
 
+/*
+=================
+GetLittleLong
+=================
+*/
+static int GetLittleLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( p[3] << 24 );
+}
+
+/*
+=================
+GetLittleShort
+=================
+*/
+static short GetLittleShort( const byte *p ) {
+	return p[0] | ( p[1] << 8 );
+}
+
+/*
+=================
+S_FindRIFFChunkBuffer
+
+Same as S_FindRIFFChunk for a file in memory, advances *p
+to the chunk data or returns -1 if not found
+=================
+*/
+static int S_FindRIFFChunkBuffer( byte **p, const byte *end, const char *chunk ) {
+	int		len;
+
+	while ( end - *p >= 8 )
+	{
+		len = GetLittleLong( *p + 4 );
+		if( len < 0 ) {
+			Com_WPrintf( "WARNING: Negative chunk length\n" );
+			return -1;
+		}
+
+		// If this is the right chunk, return
+		if( !Q_strncmp( (const char *)*p, chunk, 4 ) ) {
+			*p += 8;
+			return len;
+		}
+
+		// Not the right chunk - skip it
+		if ( PAD( len, 2 ) > end - *p - 8 )
+			break;
+
+		*p += 8 + PAD( len, 2 );
+	}
+
+	return -1;
+}
+
+/*
+=================
+S_WAV_CodecParse
+
+Same as S_WAV_CodecLoad for a file already in memory, returns
+a pointer to the samples inside the buffer, swapped in place
+=================
+*/
+void *S_WAV_CodecParse( byte *buffer, int length, snd_info_t *info )
+{
+	const byte *end = buffer + length;
+	byte	*p;
+	int		bits;
+	int		fmtlen;
+
+	if ( length < 12 )
+		return NULL;
+
+	// skip the riff wav header
+	p = buffer + 12;
+
+	// Scan for the format chunk
+	if( (fmtlen = S_FindRIFFChunkBuffer(&p, end, "fmt ")) < 16 || end - p < 16 )
+	{
+		Com_Printf( S_COLOR_RED "ERROR: Couldn't find \"fmt\" chunk\n");
+		return NULL;
+	}
+
+	// Save the parameters
+	info->channels = GetLittleShort( p + 2 );
+	info->rate = GetLittleLong( p + 4 );
+	bits = GetLittleShort( p + 14 );
+
+	if( bits < 8 )
+	{
+		Com_Printf( S_COLOR_RED "ERROR: Less than 8 bit sound is not supported\n");
+		return NULL;
+	}
+
+	if( info->channels < 1 )
+	{
+		Com_Printf( S_COLOR_RED "ERROR: No channels\n");
+		return NULL;
+	}
+
+	info->width = bits / 8;
+	info->dataofs = 0;
+
+	// Skip the rest of the format chunk
+	if ( fmtlen > end - p )
+		return NULL;
+	p += fmtlen;
+
+	// Scan for the data chunk
+	if( (info->size = S_FindRIFFChunkBuffer(&p, end, "data")) < 0)
+	{
+		Com_Printf( S_COLOR_RED "ERROR: Couldn't find \"data\" chunk\n");
+		return NULL;
+	}
+
+	// truncated files load what is there
+	if ( info->size > end - p )
+		info->size = end - p;
+
+	info->samples = (info->size / info->width) / info->channels;
+
+	S_ByteSwapRawSamples(info->samples, info->width, info->channels, p);
+
+	return p;
+}
+
 /*
 =================
 S_WAV_CodecOpenStream
@@ -38,6 +38,11 @@ static void S_UpdateBackgroundTrack( void );
 static void S_Base_StopAllSounds( void );
 static void S_Base_StopBackgroundTrack( void );
 static void S_memoryLoad( sfx_t *sfx );
+static qboolean S_QueueLoad( sfx_t *sfx );
+static void S_FinishLoads( qboolean wait );
+static void S_MixerStop( void );
+static float S_OcclusionForOrigin( const vec3_t origin, int entityNum );
+void S_Base_UpdateEntityPosition( int entityNum, const vec3_t origin );
 
 static snd_stream_t *s_backgroundStream = NULL;
 static char s_backgroundLoop[MAX_QPATH];
@@ -68,12 +73,20 @@ static		qboolean	s_soundMuted;
 
 dma_t		dma;
 
-static int			listener_number;
-static vec3_t		listener_origin;
-static vec3_t		listener_axis[3];
+typedef struct {
+	int			number;
+	vec3_t		origin;
+	vec3_t		axis[3];
+} listener_t;
+
+static listener_t	s_listener;			// last respatialize of the client
+static listener_t	s_mixListener;		// listener of the mixed channels
+static vec3_t		s_entityOrigins[MAX_GENTITIES];	// origins of the mixed channels
+static float		s_entityOcclusion[MAX_GENTITIES];	// occlusion of the mixed channels
 
 int			s_soundtime;		// sample PAIRS
 int   		s_paintedtime; 		// sample PAIRS
+static int	s_mixEnd;			// end of the last mix, 0 if none
 
 // MAX_SFX may be larger than MAX_SOUNDS because
 // of custom player sounds
@@ -89,6 +102,11 @@ cvar_t		*s_khz;
 cvar_t		*s_show;
 static cvar_t *s_mixahead;
 static cvar_t *s_mixOffset;
+static cvar_t *s_mixThread;
+static cvar_t *s_asyncLoad;
+static cvar_t *s_occlusion;
+static cvar_t *s_occlusionSources;
+static cvar_t *s_soundMemory;
 #if defined(__linux__) && !defined(USE_SDL)
 cvar_t		*s_device;
 #endif
@@ -96,6 +114,188 @@ cvar_t		*s_device;
 static loopSound_t	loopSounds[MAX_GENTITIES];
 static	channel_t	*freelist = NULL;
 
+// =======================================================================
+// Mixer thread
+//
+// With s_mixThread the channels are owned by a thread that paints them,
+// the main thread validates and loads sounds and sends everything that
+// changes the channels through a single producer single consumer queue.
+// The queue is published once per frame so the mixer never sees half of
+// the loop sounds of a frame. The queue needs no lock, the mixer lock is
+// only taken by the main thread while sound data is loaded or freed.
+// =======================================================================
+
+#define MIXER_COMMANDS		2048	// must be power of two
+
+typedef enum {
+	MIXCMD_START,
+	MIXCMD_ENTITY,
+	MIXCMD_LISTENER,
+	MIXCMD_CLEARLOOPS,
+	MIXCMD_LOOP,
+	MIXCMD_OCCLUSION,
+	MIXCMD_CLEAR
+} mixerCmdType_t;
+
+typedef struct {
+	mixerCmdType_t	type;
+	union {
+		struct {
+			vec3_t		origin;
+			qboolean	fixed_origin;
+			int			entnum;
+			int			entchannel;
+			sfx_t		*sfx;
+			float		blocked;
+		} start;
+		struct {
+			vec3_t		origin;
+			int			entnum;
+		} entity;
+		struct {
+			int			entnum;
+			float		blocked;
+		} occlusion;
+		listener_t	listener;
+		channel_t	loop;
+	} u;
+} mixerCmd_t;
+
+typedef struct {
+	void			*thread;
+	void			*lock;
+	qboolean		active;			// channels are mixed on the thread
+	volatile int	quit;
+	volatile int	head;			// published by the main thread
+	volatile int	tail;			// published by the mixer thread
+	int				write;			// next command of the main thread
+	mixerCmd_t		immediate;		// executed right away without the thread
+	mixerCmd_t		cmds[ MIXER_COMMANDS ];
+} mixer_t;
+
+static mixer_t s_mixer;
+
+static void S_MixerExecute( const mixerCmd_t *cmd );
+static void S_EnforceSoundBudget( void );
+
+
+/*
+=================
+S_MixerDPrintf
+
+Developer messages of the channel code, the mixer thread must not print
+=================
+*/
+static void FORMAT_PRINTF(1, 2) QDECL S_MixerDPrintf( const char *fmt, ... ) {
+	va_list		argptr;
+	char		msg[ MAXPRINTMSG ];
+
+	if ( s_mixer.active ) {
+		return;
+	}
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+	va_end( argptr );
+
+	Com_DPrintf( "%s", msg );
+}
+
+
+/*
+=================
+S_MixerFlush
+
+Makes all queued commands visible to the mixer thread
+=================
+*/
+static void S_MixerFlush( void ) {
+	if ( s_mixer.active ) {
+		Sys_AtomicStore( &s_mixer.head, s_mixer.write );
+	}
+}
+
+
+/*
+=================
+S_MixerAlloc
+
+Returns a command to fill in and pass to S_MixerPush
+=================
+*/
+static mixerCmd_t *S_MixerAlloc( mixerCmdType_t type ) {
+	mixerCmd_t *cmd;
+
+	if ( !s_mixer.active ) {
+		cmd = &s_mixer.immediate;
+	} else {
+		// a frame that does not fit is published in parts
+		while ( s_mixer.write - Sys_AtomicLoad( &s_mixer.tail ) >= MIXER_COMMANDS ) {
+			S_MixerFlush();
+			Sys_Sleep( 0 );
+		}
+		cmd = &s_mixer.cmds[ s_mixer.write & ( MIXER_COMMANDS - 1 ) ];
+	}
+
+	cmd->type = type;
+	return cmd;
+}
+
+
+/*
+=================
+S_MixerPush
+=================
+*/
+static void S_MixerPush( const mixerCmd_t *cmd ) {
+	if ( !s_mixer.active ) {
+		S_MixerExecute( cmd );
+	} else {
+		s_mixer.write++;
+	}
+}
+
+
+/*
+=================
+S_MixerExecuteQueue
+
+Runs all published commands, on the mixer thread or after it was stopped
+=================
+*/
+static void S_MixerExecuteQueue( void ) {
+	int head, tail;
+
+	head = Sys_AtomicLoad( &s_mixer.head );
+	tail = s_mixer.tail;
+	while ( tail != head ) {
+		S_MixerExecute( &s_mixer.cmds[ tail & ( MIXER_COMMANDS - 1 ) ] );
+		tail++;
+	}
+	Sys_AtomicStore( &s_mixer.tail, tail );
+}
+
+
+/*
+=================
+S_MixerLock
+
+Keeps the mixer thread from painting while sound data changes
+=================
+*/
+static void S_MixerLock( void ) {
+	if ( s_mixer.active ) {
+		Sys_LockMutex( s_mixer.lock );
+	}
+}
+
+
+static void S_MixerUnlock( void ) {
+	if ( s_mixer.active ) {
+		Sys_UnlockMutex( s_mixer.lock );
+	}
+}
+
 int			s_rawend[MAX_RAW_STREAMS];
 portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 
@@ -119,6 +319,7 @@ static void S_Base_SoundInfo( void ) {
 		if ( dma.driver ) {
 			Com_Printf( "Using %s subsystem\n", dma.driver );
 		}
+		Com_Printf( "Using %s mixing kernels\n", s_kernels.name );
 		if ( s_backgroundStream ) {
 			Com_Printf("Background file: %s\n", s_backgroundLoop );
 		} else {
@@ -188,7 +389,7 @@ static void S_ChannelSetup( void ) {
 
 	*(channel_t **)q = NULL;
 	freelist = p + MAX_CHANNELS - 1;
-	Com_DPrintf("Channel memory manager started\n");
+	S_MixerDPrintf("Channel memory manager started\n");
 }
 
 
@@ -299,6 +500,8 @@ are no longer valid.
 ===================
 */
 static void S_Base_DisableSounds( void ) {
+	// file buffers are on the hunk
+	S_FinishLoads( qtrue );
 	S_Base_StopAllSounds();
 	s_soundMuted = qtrue;
 }
@@ -340,6 +543,11 @@ static sfxHandle_t S_Base_RegisterSound( const char *name, qboolean compressed )
 	sfx->inMemory = qfalse;
 	sfx->soundCompressed = compressed;
 
+	// found files are read in background, in parallel with other registrations
+	if ( S_QueueLoad( sfx ) ) {
+		return sfx - s_knownSfx;
+	}
+
 	S_memoryLoad( sfx );
 
 	if ( sfx->defaultSound ) {
@@ -373,6 +581,9 @@ static void S_Base_BeginRegistration( void ) {
 
 static void S_memoryLoad( sfx_t *sfx ) {
 
+	// loading may free the oldest sounds
+	S_MixerLock();
+
 	// load the sound file
 	if ( !S_LoadSound ( sfx ) ) {
 		Com_DPrintf( S_COLOR_YELLOW "WARNING: couldn't load sound: %s\n", sfx->soundName );
@@ -380,6 +591,245 @@ static void S_memoryLoad( sfx_t *sfx ) {
 	}
 
 	sfx->inMemory = qtrue;
+
+	S_MixerUnlock();
+}
+
+
+/*
+===============================================================================
+
+BACKGROUND LOADING
+
+With s_asyncLoad sounds that are not in memory yet are read on filesystem
+I/O threads instead of stalling the frame, sounds started meanwhile are
+started late or dropped if their files took too long. File buffers are temp
+hunk memory so a batch of reads completes as a whole, in reverse order.
+
+===============================================================================
+*/
+
+#define MAX_SOUND_LOADS		16		// reads in flight
+#define MAX_PENDING_STARTS	64
+#define PENDING_START_MSEC	250		// later than this is not worth playing
+
+typedef struct {
+	sfx_t		*sfx;
+	snd_codec_t	*codec;
+	int			handle;
+} soundLoad_t;
+
+typedef struct {
+	vec3_t		origin;
+	qboolean	fixed_origin;
+	int			entnum;
+	int			entchannel;
+	sfx_t		*sfx;
+	int			time;
+} pendingStart_t;
+
+static soundLoad_t		s_loads[ MAX_SOUND_LOADS ];
+static int				s_numLoads;
+
+static pendingStart_t	s_pendingStarts[ MAX_PENDING_STARTS ];
+static int				s_numPendingStarts;
+
+
+/*
+=================
+S_QueueLoad
+
+Starts reading the sound file in background, returns qfalse
+if the sound has to be loaded right away
+=================
+*/
+static qboolean S_QueueLoad( sfx_t *sfx ) {
+	char		path[ MAX_QPATH ];
+	snd_codec_t	*codec;
+	soundLoad_t	*load;
+
+	if ( sfx->loading ) {
+		return qtrue;
+	}
+
+	if ( !s_asyncLoad->integer ) {
+		return qfalse;
+	}
+
+	// missing files take the usual warnings and fallbacks
+	codec = S_CodecFindSound( sfx->soundName, path, sizeof( path ) );
+	if ( !codec || !codec->parse ) {
+		return qfalse;
+	}
+
+	if ( s_numLoads == MAX_SOUND_LOADS ) {
+		S_FinishLoads( qtrue );
+	}
+
+	load = &s_loads[ s_numLoads++ ];
+	load->sfx = sfx;
+	load->codec = codec;
+	load->handle = FS_ReadFileAsync( path );
+
+	sfx->loading = qtrue;
+
+	return qtrue;
+}
+
+
+/*
+=================
+S_FinishLoads
+
+Converts the sounds of a completed batch of reads,
+returns early unless all of them are ready or wait is set
+=================
+*/
+static void S_FinishLoads( qboolean wait ) {
+	soundLoad_t	*load;
+	snd_info_t	info;
+	sfx_t		*sfx;
+	void		*buffer;
+	byte		*data;
+	int			i, length;
+
+	if ( !wait ) {
+		for ( i = 0; i < s_numLoads; i++ ) {
+			if ( !FS_AsyncFileReady( s_loads[i].handle ) ) {
+				return;
+			}
+		}
+	}
+
+	for ( i = s_numLoads - 1; i >= 0; i-- ) {
+		load = &s_loads[i];
+		sfx = load->sfx;
+
+		length = FS_WaitFile( load->handle, &buffer );
+
+		// loading may free the oldest sounds
+		S_MixerLock();
+
+		data = NULL;
+		if ( buffer ) {
+			data = load->codec->parse( buffer, length, &info );
+			if ( data ) {
+				S_LoadSoundData( sfx, data, &info );
+			} else {
+				Com_Printf( S_COLOR_RED "ERROR: Incorrect/unsupported format in \"%s\"\n", sfx->soundName );
+			}
+		}
+
+		if ( !data ) {
+			Com_DPrintf( S_COLOR_YELLOW "WARNING: couldn't load sound: %s\n", sfx->soundName );
+			sfx->defaultSound = qtrue;
+		}
+
+		sfx->loading = qfalse;
+		sfx->inMemory = qtrue;
+
+		S_MixerUnlock();
+
+		if ( buffer ) {
+			FS_FreeFile( buffer );
+		}
+	}
+
+	s_numLoads = 0;
+}
+
+
+/*
+=================
+S_PushStart
+=================
+*/
+static void S_PushStart( const vec3_t origin, int entityNum, int entchannel, sfx_t *sfx ) {
+	mixerCmd_t	*cmd;
+
+	cmd = S_MixerAlloc( MIXCMD_START );
+	if ( origin ) {
+		VectorCopy( origin, cmd->u.start.origin );
+		cmd->u.start.blocked = S_OcclusionForOrigin( origin, entityNum );
+	} else {
+		cmd->u.start.blocked = 0.0f;
+	}
+	cmd->u.start.fixed_origin = ( origin != NULL );
+	cmd->u.start.entnum = entityNum;
+	cmd->u.start.entchannel = entchannel;
+	cmd->u.start.sfx = sfx;
+	S_MixerPush( cmd );
+}
+
+
+/*
+=================
+S_DeferStart
+
+Keeps a start of a sound that is being loaded, qfalse if there is no room
+=================
+*/
+static qboolean S_DeferStart( const vec3_t origin, int entityNum, int entchannel, sfx_t *sfx ) {
+	pendingStart_t *p;
+
+	if ( s_numPendingStarts == MAX_PENDING_STARTS ) {
+		return qfalse;
+	}
+
+	p = &s_pendingStarts[ s_numPendingStarts++ ];
+	if ( origin ) {
+		VectorCopy( origin, p->origin );
+	}
+	p->fixed_origin = ( origin != NULL );
+	p->entnum = entityNum;
+	p->entchannel = entchannel;
+	p->sfx = sfx;
+	p->time = Sys_Milliseconds();
+
+	return qtrue;
+}
+
+
+/*
+=================
+S_UpdateLoads
+
+Completes background loads and starts sounds that were waiting for them
+=================
+*/
+static void S_UpdateLoads( void ) {
+	pendingStart_t *p;
+	int i, n, now;
+
+	S_FinishLoads( qfalse );
+
+	if ( !s_numPendingStarts ) {
+		return;
+	}
+
+	now = Sys_Milliseconds();
+
+	for ( i = 0, n = 0; i < s_numPendingStarts; i++ ) {
+		p = &s_pendingStarts[i];
+		if ( p->sfx->loading ) {
+			s_pendingStarts[ n++ ] = *p;
+			continue;
+		}
+		if ( now - p->time > PENDING_START_MSEC ) {
+			Com_DPrintf( "S_UpdateLoads: dropped late sound %s\n", p->sfx->soundName );
+			continue;
+		}
+		// may have been freed by a later load of the batch
+		if ( !p->sfx->inMemory ) {
+			S_memoryLoad( p->sfx );
+		}
+		if ( s_show->integer == 1 ) {
+			Com_Printf( "%i : %s (%i msec late)\n", s_paintedtime, p->sfx->soundName, now - p->time );
+		}
+		S_PushStart( p->fixed_origin ? p->origin : NULL, p->entnum, p->entchannel, p->sfx );
+	}
+
+	s_numPendingStarts = n;
 }
 
 //=============================================================================
@@ -391,7 +841,7 @@ S_SpatializeOrigin
 Used for spatializing s_channels
 =================
 */
-static void S_SpatializeOrigin( const vec3_t origin, int master_vol, int *left_vol, int *right_vol )
+static void S_SpatializeOrigin( const listener_t *listener, const vec3_t origin, int master_vol, int *left_vol, int *right_vol )
 {
 	vec_t	dot;
 	vec_t	dist;
@@ -402,7 +852,7 @@ static void S_SpatializeOrigin( const vec3_t origin, int master_vol, int *left_v
 	const float dist_mult = SOUND_ATTENUATE;
 	
 	// calculate stereo separation and distance attenuation
-	VectorSubtract(origin, listener_origin, source_vec);
+	VectorSubtract(origin, listener->origin, source_vec);
 
 	dist = VectorNormalize(source_vec);
 	dist -= SOUND_FULLVOLUME;
@@ -410,7 +860,7 @@ static void S_SpatializeOrigin( const vec3_t origin, int master_vol, int *left_v
 		dist = 0;			// close enough to be at full volume
 	dist *= dist_mult;		// different attenuation levels
 	
-	VectorRotate( source_vec, listener_axis, vec );
+	VectorRotate( source_vec, listener->axis, vec );
 
 	dot = -vec[1];
 
@@ -445,46 +895,289 @@ static void S_SpatializeOrigin( const vec3_t origin, int master_vol, int *left_v
 
 
 // =======================================================================
-// Start a sound effect
+// Occlusion
+//
+// With s_occlusion sounds with no line of sight to the listener are
+// quieter and muffled. Only the s_occlusionSources loudest entities are
+// traced, each result is kept for OCCLUSION_MSEC so a frame costs at most
+// s_occlusionSources traces plus OCCLUSION_START_TRACES for sounds that
+// start at a fixed origin. Entity results fade in and out over
+// OCCLUSION_FADE_MSEC and are sent to the mixer when they change.
 // =======================================================================
 
+#define MAX_OCCLUSION_SOURCES	32
+#define OCCLUSION_MSEC			100
+#define OCCLUSION_FADE_MSEC		150
+#define OCCLUSION_HOLD_MSEC		3000	// entity sounds are considered this long after a start
+#define OCCLUSION_START_TRACES	4
+#define OCCLUSION_ATTENUATION	0.5f	// volume lost behind a wall
+#define OCCLUSION_CUTOFF		1000.0f	// low-pass cutoff behind a wall, Hz
+
+typedef struct {
+	int			lastStart;		// cls.realtime of the last sound started by the entity
+	int			traceTime;		// cls.realtime of the last trace, 0 to trace when selected
+	int			frame;			// last frame the entity was among the loudest
+	float		target;			// 0 = line of sight, 1 = blocked
+	float		blocked;		// fades towards target, sent to the mixer on change
+} occlusion_t;
+
+static occlusion_t	s_occlusionState[MAX_GENTITIES];
+static int			s_occlusionFrame;
+static int			s_occlusionTime;
+static int			s_occlusionStarts;	// fixed origin traces this frame
+static float		s_occlusionAlpha;	// filter coefficient at OCCLUSION_CUTOFF
+
+
 /*
-====================
-S_Base_StartSound
+=================
+S_OcclusionInit
+=================
+*/
+static void S_OcclusionInit( void ) {
+	s_occlusionAlpha = 1.0f - exp( -2.0 * M_PI * OCCLUSION_CUTOFF / dma.speed );
+	if ( s_occlusionAlpha > 1.0f )
+		s_occlusionAlpha = 1.0f;
+	Com_Memset( s_occlusionState, 0, sizeof( s_occlusionState ) );
+}
 
-Validates the parms and ques the sound up
-if origin is NULL, the sound will be dynamically sourced from the entity
-Entchannel 0 will never override a playing sound
-====================
+
+/*
+=================
+S_OcclusionLowpass
+
+Filter coefficient of channel_t for an occlusion amount, 0 = off
+=================
 */
-static void S_Base_StartSound( const vec3_t origin, int entityNum, int entchannel, sfxHandle_t sfxHandle ) {
-	channel_t	*ch;
-	sfx_t		*sfx;
-	int i, oldest, chosen, startTime;
-	int	inplay, allowed;
+static float S_OcclusionLowpass( float blocked ) {
+	float a;
 
-	if ( !s_soundStarted || s_soundMuted ) {
-		return;
-	}
+	if ( blocked <= 0.0f )
+		return 0.0f;
 
-	if ( !origin && ( entityNum < 0 || entityNum >= MAX_GENTITIES ) ) {
-		Com_Error( ERR_DROP, "S_StartSound: bad entitynum %i", entityNum );
+	a = 1.0f - blocked * ( 1.0f - s_occlusionAlpha );
+	if ( a >= 1.0f )
+		return 0.0f;
+
+	return a;
+}
+
+
+/*
+=================
+S_OcclusionAttenuate
+=================
+*/
+static void S_OcclusionAttenuate( float blocked, int *left_vol, int *right_vol ) {
+	float scale;
+
+	if ( blocked > 0.0f ) {
+		scale = 1.0f - blocked * OCCLUSION_ATTENUATION;
+		*left_vol = *left_vol * scale;
+		*right_vol = *right_vol * scale;
 	}
+}
 
-	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
-		Com_Printf( S_COLOR_YELLOW "S_StartSound: handle %i out of range\n", sfxHandle );
-		return;
+
+/*
+=================
+S_OcclusionScale
+
+Attenuates the volumes of a loop sound of an entity
+=================
+*/
+static void S_OcclusionScale( int entityNum, int *left_vol, int *right_vol ) {
+	S_OcclusionAttenuate( s_occlusionState[ entityNum ].blocked, left_vol, right_vol );
+}
+
+
+/*
+=================
+S_OccludeVolumes
+
+Applies an occlusion amount to spatialized volumes
+and sets the low-pass filter of the mixed channel
+=================
+*/
+static void S_OccludeVolumes( channel_t *ch, float blocked, int *left_vol, int *right_vol ) {
+	S_OcclusionAttenuate( blocked, left_vol, right_vol );
+
+	ch->lowpass = S_OcclusionLowpass( blocked );
+	if ( ch->lowpass == 0.0f ) {
+		ch->lpPrimed = qfalse;
 	}
+}
 
-	sfx = &s_knownSfx[ sfxHandle ];
 
-	if ( sfx->inMemory == qfalse ) {
-		S_memoryLoad(sfx);
+/*
+=================
+S_OcclusionTrace
+
+Returns 1 if the map blocks the line from the listener to origin
+=================
+*/
+static float S_OcclusionTrace( const vec3_t origin ) {
+	trace_t tr;
+
+	CM_BoxTrace( &tr, s_listener.origin, origin, NULL, NULL, 0, CONTENTS_SOLID, qfalse );
+
+	// a noclipping listener hears everything
+	if ( tr.startsolid || tr.fraction >= 1.0f )
+		return 0.0f;
+
+	return 1.0f;
+}
+
+
+/*
+=================
+S_OcclusionVolume
+
+Distance attenuation of S_SpatializeOrigin, 0 when out of hearing range
+=================
+*/
+static float S_OcclusionVolume( const vec3_t origin ) {
+	float dist;
+
+	dist = Distance( origin, s_listener.origin ) - SOUND_FULLVOLUME;
+	if ( dist < 0 )
+		dist = 0;
+
+	return 1.0f - dist * SOUND_ATTENUATE;
+}
+
+
+/*
+=================
+S_OcclusionForOrigin
+
+Occlusion of a sound started at a fixed origin, it is traced once
+=================
+*/
+static float S_OcclusionForOrigin( const vec3_t origin, int entityNum ) {
+
+	if ( !s_occlusion->integer || cls.state != CA_ACTIVE || entityNum == s_listener.number )
+		return 0.0f;
+
+	if ( s_occlusionStarts >= OCCLUSION_START_TRACES || S_OcclusionVolume( origin ) <= 0.0f )
+		return 0.0f;
+
+	s_occlusionStarts++;
+
+	return S_OcclusionTrace( origin );
+}
+
+
+/*
+=================
+S_UpdateOcclusion
+
+Traces the loudest entity sounds whose results expired
+and fades every entity towards its result
+=================
+*/
+static void S_UpdateOcclusion( void ) {
+	int			best[ MAX_OCCLUSION_SOURCES ];
+	float		bestVol[ MAX_OCCLUSION_SOURCES ];
+	int			i, j, n, num, msec;
+	float		vol, step;
+	occlusion_t	*occ;
+	mixerCmd_t	*cmd;
+
+	msec = cls.realtime - s_occlusionTime;
+	if ( msec < 0 || msec > OCCLUSION_FADE_MSEC )
+		msec = OCCLUSION_FADE_MSEC;
+	s_occlusionTime = cls.realtime;
+	s_occlusionStarts = 0;
+	s_occlusionFrame++;
+
+	if ( s_occlusion->integer && cls.state == CA_ACTIVE )
+		n = s_occlusionSources->integer;
+	else
+		n = 0;
+
+	// pick the loudest entities that have a sound
+	num = 0;
+	for ( i = 0; i < MAX_GENTITIES && n > 0; i++ ) {
+		if ( i == s_listener.number )
+			continue;
+		if ( !loopSounds[i].active && cls.realtime - s_occlusionState[i].lastStart > OCCLUSION_HOLD_MSEC )
+			continue;
+
+		vol = S_OcclusionVolume( loopSounds[i].origin );
+		if ( vol <= 0.0f )
+			continue;
+
+		if ( num < n )
+			j = num++;
+		else if ( vol > bestVol[ num - 1 ] )
+			j = num - 1;
+		else
+			continue;
+
+		for ( ; j > 0 && bestVol[ j - 1 ] < vol; j-- ) {
+			best[ j ] = best[ j - 1 ];
+			bestVol[ j ] = bestVol[ j - 1 ];
+		}
+		best[ j ] = i;
+		bestVol[ j ] = vol;
 	}
 
-	if ( s_show->integer == 1 ) {
-		Com_Printf( "%i : %s\n", s_paintedtime, sfx->soundName );
+	for ( i = 0; i < num; i++ ) {
+		occ = &s_occlusionState[ best[i] ];
+		if ( !occ->traceTime || cls.realtime - occ->traceTime >= OCCLUSION_MSEC ) {
+			occ->target = S_OcclusionTrace( loopSounds[ best[i] ].origin );
+			occ->traceTime = cls.realtime;
+		}
+		occ->frame = s_occlusionFrame;
+	}
+
+	step = (float)msec / OCCLUSION_FADE_MSEC;
+
+	for ( i = 0, occ = s_occlusionState; i < MAX_GENTITIES; i++, occ++ ) {
+		if ( occ->frame != s_occlusionFrame ) {
+			occ->target = 0.0f;
+			occ->traceTime = 0;
+		}
+
+		if ( occ->blocked == occ->target )
+			continue;
+
+		if ( occ->blocked < occ->target ) {
+			occ->blocked += step;
+			if ( occ->blocked > occ->target )
+				occ->blocked = occ->target;
+		} else if ( occ->blocked > occ->target ) {
+			occ->blocked -= step;
+			if ( occ->blocked < occ->target )
+				occ->blocked = occ->target;
+		}
+
+		cmd = S_MixerAlloc( MIXCMD_OCCLUSION );
+		cmd->u.occlusion.entnum = i;
+		cmd->u.occlusion.blocked = occ->blocked;
+		S_MixerPush( cmd );
 	}
+}
+
+
+// =======================================================================
+// Start a sound effect
+// =======================================================================
+
+/*
+====================
+S_StartChannel
+
+Picks a channel for a sound started by S_Base_StartSound
+====================
+*/
+static void S_StartChannel( const vec3_t origin, int entityNum, int entchannel, sfx_t *sfx, float blocked ) {
+	channel_t	*ch;
+	int i, oldest, chosen, startTime;
+	int	inplay, allowed;
+	int listener_number;
+
+	listener_number = s_mixListener.number;
 
 	startTime = s_soundtime; // Com_Milliseconds();
 
@@ -524,7 +1217,7 @@ static void S_Base_StartSound( const vec3_t origin, int entityNum, int entchanne
 	for ( i = 0; i < MAX_CHANNELS; i++, ch++ ) {
 		if ( ch->entnum == entityNum && ch->thesfx == sfx ) {
 			if ( startTime - ch->allocTime < 20 ) {
-				Com_DPrintf(S_COLOR_YELLOW "S_StartSound: Double start (%d ms < 20 ms) for %s\n", startTime - ch->allocTime, sfx->soundName);
+				S_MixerDPrintf(S_COLOR_YELLOW "S_StartSound: Double start (%d ms < 20 ms) for %s\n", startTime - ch->allocTime, sfx->soundName);
 				return;
 			}
 			inplay++;
@@ -533,7 +1226,7 @@ static void S_Base_StartSound( const vec3_t origin, int entityNum, int entchanne
 
 	// too much duplicated sounds, ignore
 	if ( inplay > allowed ) {
-		Com_DPrintf(S_COLOR_YELLOW "S_StartSound: %s hit the concurrent channels limit (%d)\n", sfx->soundName, allowed);
+		S_MixerDPrintf(S_COLOR_YELLOW "S_StartSound: %s hit the concurrent channels limit (%d)\n", sfx->soundName, allowed);
 		return;
 	}
 
@@ -570,31 +1263,85 @@ static void S_Base_StartSound( const vec3_t origin, int entityNum, int entchanne
 					}
 				}
 				if (chosen == -1) {
-					Com_DPrintf(S_COLOR_YELLOW "S_StartSound: No more channels free for %s\n", sfx->soundName);
+					S_MixerDPrintf(S_COLOR_YELLOW "S_StartSound: No more channels free for %s\n", sfx->soundName);
 					return;
 				}
 			}
 		}
-		ch = &s_channels[chosen];
-		ch->allocTime = sfx->lastTimeUsed;
-		Com_DPrintf(S_COLOR_YELLOW "S_StartSound: No more channels free for %s, dropping earliest sound: %s\n", sfx->soundName, ch->thesfx->soundName);
+		ch = &s_channels[chosen];
+		ch->allocTime = sfx->lastTimeUsed;
+		S_MixerDPrintf(S_COLOR_YELLOW "S_StartSound: No more channels free for %s, dropping earliest sound: %s\n", sfx->soundName, ch->thesfx->soundName);
+	}
+
+	if ( origin ) {
+		VectorCopy( origin, ch->origin );
+		ch->fixed_origin = qtrue;
+	} else {
+		ch->fixed_origin = qfalse;
+	}
+
+	ch->master_vol = MASTER_VOL;
+	ch->entnum = entityNum;
+	ch->thesfx = sfx;
+	ch->startSample = START_SAMPLE_IMMEDIATE;
+	ch->entchannel = entchannel;
+	ch->leftvol = ch->master_vol;		// these will get calced at next spatialize
+	ch->rightvol = ch->master_vol;		// unless the game isn't running
+	ch->doppler = qfalse;
+	ch->blocked = blocked;
+	ch->lowpass = 0.0f;
+	ch->lpPrimed = qfalse;
+}
+
+
+/*
+====================
+S_Base_StartSound
+
+Validates the parms and ques the sound up
+if origin is NULL, the sound will be dynamically sourced from the entity
+Entchannel 0 will never override a playing sound
+====================
+*/
+static void S_Base_StartSound( const vec3_t origin, int entityNum, int entchannel, sfxHandle_t sfxHandle ) {
+	sfx_t		*sfx;
+
+	if ( !s_soundStarted || s_soundMuted ) {
+		return;
+	}
+
+	if ( !origin && ( entityNum < 0 || entityNum >= MAX_GENTITIES ) ) {
+		Com_Error( ERR_DROP, "S_StartSound: bad entitynum %i", entityNum );
+	}
+
+	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
+		Com_Printf( S_COLOR_YELLOW "S_StartSound: handle %i out of range\n", sfxHandle );
+		return;
+	}
+
+	sfx = &s_knownSfx[ sfxHandle ];
+
+	if ( sfx->inMemory == qfalse ) {
+		Sys_AtomicAdd( &s_counters.cacheMisses, 1 );
+		if ( S_QueueLoad( sfx ) && S_DeferStart( origin, entityNum, entchannel, sfx ) ) {
+			return;
+		}
+		if ( sfx->loading ) {
+			S_FinishLoads( qtrue );
+		} else {
+			S_memoryLoad( sfx );
+		}
 	}
 
-	if ( origin ) {
-		VectorCopy( origin, ch->origin );
-		ch->fixed_origin = qtrue;
-	} else {
-		ch->fixed_origin = qfalse;
+	if ( s_show->integer == 1 ) {
+		Com_Printf( "%i : %s\n", s_paintedtime, sfx->soundName );
 	}
 
-	ch->master_vol = MASTER_VOL;
-	ch->entnum = entityNum;
-	ch->thesfx = sfx;
-	ch->startSample = START_SAMPLE_IMMEDIATE;
-	ch->entchannel = entchannel;
-	ch->leftvol = ch->master_vol;		// these will get calced at next spatialize
-	ch->rightvol = ch->master_vol;		// unless the game isn't running
-	ch->doppler = qfalse;
+	if ( !origin ) {
+		s_occlusionState[ entityNum ].lastStart = cls.realtime;
+	}
+
+	S_PushStart( origin, entityNum, entchannel, sfx );
 }
 
 
@@ -613,32 +1360,27 @@ static void S_Base_StartLocalSound( sfxHandle_t sfxHandle, int channelNum ) {
 		return;
 	}
 
-	S_Base_StartSound (NULL, listener_number, channelNum, sfxHandle );
+	S_Base_StartSound (NULL, s_listener.number, channelNum, sfxHandle );
 }
 
 
 /*
 ==================
-S_ClearSoundBuffer
+S_ClearChannels
 
-If we are about to perform file access, clear the buffer
-so sound doesn't stutter.
+Stops all channels and silences the output
 ==================
 */
-static void S_Base_ClearSoundBuffer( void ) {
+static void S_ClearChannels( void ) {
 	int		clear;
-		
-	if (!s_soundStarted)
-		return;
 
-	// stop looping sounds
-	Com_Memset(loopSounds, 0, sizeof(loopSounds));
 	Com_Memset(loop_channels, 0, sizeof(loop_channels));
 	numLoopChannels = 0;
 
-	S_ChannelSetup();
+	Com_Memset(s_entityOrigins, 0, sizeof(s_entityOrigins));
+	Com_Memset(s_entityOcclusion, 0, sizeof(s_entityOcclusion));
 
-	s_rawend[0] = 0;
+	S_ChannelSetup();
 
 	if (dma.samplebits == 8)
 		clear = 0x80;
@@ -654,6 +1396,29 @@ static void S_Base_ClearSoundBuffer( void ) {
 }
 
 
+/*
+==================
+S_ClearSoundBuffer
+
+If we are about to perform file access, clear the buffer
+so sound doesn't stutter.
+==================
+*/
+static void S_Base_ClearSoundBuffer( void ) {
+	if (!s_soundStarted)
+		return;
+
+	// stop looping sounds
+	Com_Memset(loopSounds, 0, sizeof(loopSounds));
+	Com_Memset(s_occlusionState, 0, sizeof(s_occlusionState));
+
+	s_rawend[0] = 0;
+
+	S_MixerPush( S_MixerAlloc( MIXCMD_CLEAR ) );
+	S_MixerFlush();
+}
+
+
 /*
 ==================
 S_StopAllSounds
@@ -664,6 +1429,8 @@ static void S_Base_StopAllSounds( void ) {
 		return;
 	}
 
+	s_numPendingStarts = 0;
+
 	// stop the background music
 	S_Base_StopBackgroundTrack();
 
@@ -698,7 +1465,7 @@ void S_Base_ClearLoopingSounds( qboolean killall ) {
 			S_Base_StopLoopingSound(i);
 		}
 	}
-	numLoopChannels = 0;
+	S_MixerPush( S_MixerAlloc( MIXCMD_CLEARLOOPS ) );
 }
 
 
@@ -725,6 +1492,10 @@ void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t ve
 	sfx = &s_knownSfx[ sfxHandle ];
 
 	if (sfx->inMemory == qfalse) {
+		// added again every frame, starts once loaded
+		if ( S_QueueLoad( sfx ) ) {
+			return;
+		}
 		S_memoryLoad(sfx);
 	}
 
@@ -746,9 +1517,9 @@ void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t ve
 		float	lena, lenb;
 
 		loopSounds[entityNum].doppler = qtrue;
-		lena = DistanceSquared(loopSounds[listener_number].origin, loopSounds[entityNum].origin);
+		lena = DistanceSquared(loopSounds[s_listener.number].origin, loopSounds[entityNum].origin);
 		VectorAdd(loopSounds[entityNum].origin, loopSounds[entityNum].velocity, out);
-		lenb = DistanceSquared(loopSounds[listener_number].origin, out);
+		lenb = DistanceSquared(loopSounds[s_listener.number].origin, out);
 		if ((loopSounds[entityNum].framenum+1) != cls.framecount) {
 			loopSounds[entityNum].oldDopplerScale = 1.0;
 		} else {
@@ -763,6 +1534,8 @@ void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t ve
 	}
 
 	loopSounds[entityNum].framenum = cls.framecount;
+
+	S_Base_UpdateEntityPosition( entityNum, origin );
 }
 
 
@@ -789,6 +1562,10 @@ void S_Base_AddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_
 	sfx = &s_knownSfx[ sfxHandle ];
 
 	if (sfx->inMemory == qfalse) {
+		// added again every frame, starts once loaded
+		if ( S_QueueLoad( sfx ) ) {
+			return;
+		}
 		S_memoryLoad(sfx);
 	}
 
@@ -801,6 +1578,8 @@ void S_Base_AddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_
 	loopSounds[entityNum].active = qtrue;
 	loopSounds[entityNum].kill = qfalse;
 	loopSounds[entityNum].doppler = qfalse;
+
+	S_Base_UpdateEntityPosition( entityNum, origin );
 }
 
 
@@ -814,14 +1593,17 @@ sum up the channel multipliers.
 ==================
 */
 void S_AddLoopSounds( void ) {
-	int			i, j, startTime;
+	int			i, j, startTime, numChannels;
 	int			left_total, right_total, left, right;
+	float		blocked;
+	mixerCmd_t	*cmd;
 	channel_t	*ch;
 	loopSound_t	*loop, *loop2;
 	static int	loopFrame;
 
 
-	numLoopChannels = 0;
+	S_MixerPush( S_MixerAlloc( MIXCMD_CLEARLOOPS ) );
+	numChannels = 0;
 
 	startTime = s_soundtime; // Com_Milliseconds();
 
@@ -833,10 +1615,12 @@ void S_AddLoopSounds( void ) {
 		}
 
 		if (loop->kill) {
-			S_SpatializeOrigin( loop->origin, MASTER_VOL, &left_total, &right_total);	// 3d
+			S_SpatializeOrigin( &s_listener, loop->origin, MASTER_VOL, &left_total, &right_total);	// 3d
 		} else {
-			S_SpatializeOrigin( loop->origin, SPHERE_VOL,  &left_total, &right_total);	// sphere
+			S_SpatializeOrigin( &s_listener, loop->origin, SPHERE_VOL,  &left_total, &right_total);	// sphere
 		}
+		S_OcclusionScale( i, &left_total, &right_total );
+		blocked = s_occlusionState[i].blocked * ( left_total + right_total );
 
 		loop->sfx->lastTimeUsed = startTime;
 
@@ -848,10 +1632,12 @@ void S_AddLoopSounds( void ) {
 			loop2->mergeFrame = loopFrame;
 
 			if (loop2->kill) {
-				S_SpatializeOrigin( loop2->origin, MASTER_VOL, &left, &right);		// 3d
+				S_SpatializeOrigin( &s_listener, loop2->origin, MASTER_VOL, &left, &right);		// 3d
 			} else {
-				S_SpatializeOrigin( loop2->origin, SPHERE_VOL,  &left, &right);		// sphere
+				S_SpatializeOrigin( &s_listener, loop2->origin, SPHERE_VOL,  &left, &right);		// sphere
 			}
+			S_OcclusionScale( j, &left, &right );
+			blocked += s_occlusionState[j].blocked * ( left + right );
 
 			loop2->sfx->lastTimeUsed = startTime;
 			left_total += left;
@@ -860,9 +1646,12 @@ void S_AddLoopSounds( void ) {
 		if (left_total == 0 && right_total == 0) {
 			continue;		// not audible
 		}
+		blocked /= left_total + right_total;
 
 		// allocate a channel
-		ch = &loop_channels[numLoopChannels];
+		cmd = S_MixerAlloc( MIXCMD_LOOP );
+		ch = &cmd->u.loop;
+		Com_Memset( ch, 0, sizeof( *ch ) );
 		
 		if (left_total > 255) {
 			left_total = 255;
@@ -878,8 +1667,10 @@ void S_AddLoopSounds( void ) {
 		ch->doppler = loop->doppler;
 		ch->dopplerScale = loop->dopplerScale;
 		ch->oldDopplerScale = loop->oldDopplerScale;
-		numLoopChannels++;
-		if ( numLoopChannels >= MAX_CHANNELS ) {
+		// merged loops are filtered by their loudness weighted occlusion
+		ch->lowpass = S_OcclusionLowpass( blocked );
+		S_MixerPush( cmd );
+		if ( ++numChannels >= MAX_CHANNELS ) {
 			return;
 		}
 	}
@@ -922,7 +1713,7 @@ static void S_Base_RawSamples( int stream, int samples, int rate, int width, int
 		int leftvol, rightvol;
 
 		if ( entityNum >= 0 && entityNum < MAX_GENTITIES ) {
-			S_SpatializeOrigin( loopSounds[ entityNum ].origin, 256, &leftvol, &rightvol );
+			S_SpatializeOrigin( &s_listener, loopSounds[ entityNum ].origin, 256, &leftvol, &rightvol );
 		} else {
 			leftvol = rightvol = 256;
 		}
@@ -1023,34 +1814,34 @@ let the sound system know where an entity currently is
 ======================
 */
 void S_Base_UpdateEntityPosition( int entityNum, const vec3_t origin ) {
+	mixerCmd_t *cmd;
+
 	if ( entityNum < 0 || entityNum >= MAX_GENTITIES ) {
 		Com_Error( ERR_DROP, "S_UpdateEntityPosition: bad entitynum %i", entityNum );
 	}
 	VectorCopy( origin, loopSounds[entityNum].origin );
+
+	cmd = S_MixerAlloc( MIXCMD_ENTITY );
+	VectorCopy( origin, cmd->u.entity.origin );
+	cmd->u.entity.entnum = entityNum;
+	S_MixerPush( cmd );
 }
 
 
 /*
 ============
-S_Respatialize
+S_SpatializeChannels
 
 Change the volumes of all the playing sounds for changes in their positions
 ============
 */
-void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int inwater ) {
+static void S_SpatializeChannels( const listener_t *listener ) {
 	int			i;
 	channel_t	*ch;
 	vec3_t		origin;
+	float		blocked;
 
-	if ( !s_soundStarted || s_soundMuted ) {
-		return;
-	}
-
-	listener_number = entityNum;
-	VectorCopy(head, listener_origin);
-	VectorCopy(axis[0], listener_axis[0]);
-	VectorCopy(axis[1], listener_axis[1]);
-	VectorCopy(axis[2], listener_axis[2]);
+	s_mixListener = *listener;
 
 	// update spatialization for dynamic sounds	
 	ch = s_channels;
@@ -1059,19 +1850,51 @@ void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int
 			continue;
 		}
 		// anything coming from the view entity will always be full volume
-		if (ch->entnum == listener_number) {
+		if (ch->entnum == listener->number) {
 			ch->leftvol = ch->master_vol;
 			ch->rightvol = ch->master_vol;
+			S_OccludeVolumes( ch, 0.0f, &ch->leftvol, &ch->rightvol );
 		} else {
 			if (ch->fixed_origin) {
 				VectorCopy( ch->origin, origin );
+				blocked = ch->blocked;
 			} else {
-				VectorCopy( loopSounds[ ch->entnum ].origin, origin );
+				VectorCopy( s_entityOrigins[ ch->entnum ], origin );
+				blocked = s_entityOcclusion[ ch->entnum ];
 			}
 
-			S_SpatializeOrigin (origin, ch->master_vol, &ch->leftvol, &ch->rightvol);
+			S_SpatializeOrigin (listener, origin, ch->master_vol, &ch->leftvol, &ch->rightvol);
+			S_OccludeVolumes( ch, blocked, &ch->leftvol, &ch->rightvol );
 		}
 	}
+}
+
+
+/*
+============
+S_Respatialize
+
+Moves the listener, loop sounds are added for the new position
+============
+*/
+void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int inwater ) {
+	mixerCmd_t	*cmd;
+
+	if ( !s_soundStarted || s_soundMuted ) {
+		return;
+	}
+
+	s_listener.number = entityNum;
+	VectorCopy(head, s_listener.origin);
+	VectorCopy(axis[0], s_listener.axis[0]);
+	VectorCopy(axis[1], s_listener.axis[1]);
+	VectorCopy(axis[2], s_listener.axis[2]);
+
+	cmd = S_MixerAlloc( MIXCMD_LISTENER );
+	cmd->u.listener = s_listener;
+	S_MixerPush( cmd );
+
+	S_UpdateOcclusion();
 
 	// add loopsounds
 	S_AddLoopSounds ();
@@ -1116,6 +1939,123 @@ static qboolean S_ScanChannelStarts( void ) {
 }
 
 
+/*
+=================
+S_MixerExecute
+=================
+*/
+static void S_MixerExecute( const mixerCmd_t *cmd ) {
+	switch ( cmd->type ) {
+	case MIXCMD_START:
+		S_StartChannel( cmd->u.start.fixed_origin ? cmd->u.start.origin : NULL,
+			cmd->u.start.entnum, cmd->u.start.entchannel, cmd->u.start.sfx, cmd->u.start.blocked );
+		break;
+	case MIXCMD_ENTITY:
+		VectorCopy( cmd->u.entity.origin, s_entityOrigins[ cmd->u.entity.entnum ] );
+		break;
+	case MIXCMD_LISTENER:
+		S_SpatializeChannels( &cmd->u.listener );
+		break;
+	case MIXCMD_CLEARLOOPS:
+		numLoopChannels = 0;
+		break;
+	case MIXCMD_LOOP:
+		if ( numLoopChannels < MAX_CHANNELS ) {
+			loop_channels[ numLoopChannels++ ] = cmd->u.loop;
+		}
+		break;
+	case MIXCMD_OCCLUSION:
+		s_entityOcclusion[ cmd->u.occlusion.entnum ] = cmd->u.occlusion.blocked;
+		break;
+	case MIXCMD_CLEAR:
+		S_ClearChannels();
+		break;
+	}
+}
+
+
+/*
+=================
+S_MixerThread
+
+Paints the channels as soon as the device consumed some samples
+=================
+*/
+static void S_MixerThread( void *arg ) {
+	while ( !Sys_AtomicLoad( &s_mixer.quit ) ) {
+		Sys_LockMutex( s_mixer.lock );
+		S_MixerExecuteQueue();
+		// video recording mixes in lockstep with the rendered frames
+		if ( !CL_VideoRecording() ) {
+			S_Update_();
+		}
+		Sys_UnlockMutex( s_mixer.lock );
+		Sys_Sleep( 1 );
+	}
+}
+
+
+/*
+=================
+S_MixerStart
+=================
+*/
+static void S_MixerStart( void ) {
+	s_mixer.lock = Sys_CreateMutex();
+	if ( !s_mixer.lock ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't create the sound mixer lock\n" );
+		Cvar_Set( "s_mixThread", "0" );
+		return;
+	}
+
+	s_mixer.quit = 0;
+	s_mixer.head = 0;
+	s_mixer.tail = 0;
+	s_mixer.write = 0;
+	s_mixer.active = qtrue;
+
+	s_mixer.thread = Com_CreateThread( JOB_POOL_AUDIO, "sound mixer", S_MixerThread, NULL );
+	if ( !s_mixer.thread ) {
+		s_mixer.active = qfalse;
+		Sys_DestroyMutex( s_mixer.lock );
+		s_mixer.lock = NULL;
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start the sound mixer thread\n" );
+		Cvar_Set( "s_mixThread", "0" );
+		return;
+	}
+
+	Com_DPrintf( "Sound mixer thread started\n" );
+}
+
+
+/*
+=================
+S_MixerStop
+
+Hands the channels back to the main thread
+=================
+*/
+static void S_MixerStop( void ) {
+	if ( !s_mixer.active ) {
+		return;
+	}
+
+	S_MixerFlush();
+	Sys_AtomicStore( &s_mixer.quit, 1 );
+	Com_JoinThread( s_mixer.thread );
+	s_mixer.thread = NULL;
+	s_mixer.active = qfalse;
+
+	// whatever the thread did not get to
+	S_MixerExecuteQueue();
+
+	Sys_DestroyMutex( s_mixer.lock );
+	s_mixer.lock = NULL;
+
+	Com_DPrintf( "Sound mixer thread stopped\n" );
+}
+
+
 /*
 ============
 S_Update
@@ -1133,10 +2073,19 @@ static void S_Base_Update( void ) {
 		return;
 	}
 
+	// audio frames of a video follow the rendered frames
+	if ( s_mixThread->integer && !CL_VideoRecording() ) {
+		if ( !s_mixer.active ) {
+			S_MixerStart();
+		}
+	} else {
+		S_MixerStop();
+	}
+
 	//
 	// debugging output
 	//
-	if ( s_show->integer == 2 ) {
+	if ( s_show->integer == 2 && !s_mixer.active ) {
 		total = 0;
 		ch = s_channels;
 		for (i=0 ; i<MAX_CHANNELS; i++, ch++) {
@@ -1149,8 +2098,21 @@ static void S_Base_Update( void ) {
 		Com_Printf ("----(%i)---- painted: %i\n", total, s_paintedtime);
 	}
 
-	// mix some sound
-	S_Update_();
+	// complete background loads
+	S_UpdateLoads();
+
+	// give back sounds nobody played for a while
+	S_EnforceSoundBudget();
+
+	// add raw data from streamed samples
+	S_UpdateBackgroundTrack();
+
+	if ( s_mixer.active ) {
+		S_MixerFlush();
+	} else {
+		// mix some sound
+		S_Update_();
+	}
 }
 
 
@@ -1188,7 +2150,14 @@ static void S_GetSoundtime( void )
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			s_paintedtime = dma.fullsamples;
-			S_Base_StopAllSounds ();
+			s_mixEnd = 0;
+			if ( s_mixer.active ) {
+				// streams are restarted by the main thread
+				S_ClearChannels();
+				Com_Memset( s_rawend, 0, sizeof( s_rawend ) );
+			} else {
+				S_Base_StopAllSounds ();
+			}
 		}
 	}
 	oldsamplepos = samplepos;
@@ -1214,7 +2183,8 @@ static void S_Update_( void ) {
 		return;
 	}
 
-	thisTime = Com_Milliseconds();
+	// Com_Milliseconds pumps events and belongs to the main thread
+	thisTime = s_mixer.active ? Sys_Milliseconds() : Com_Milliseconds();
 
 	// Updates s_soundtime
 	S_GetSoundtime();
@@ -1225,13 +2195,24 @@ static void S_Update_( void ) {
 
 	ot = s_soundtime;
 
+	// the device caught up with the last mix if there is nothing ahead
+	if ( s_mixEnd && !CL_VideoRecording() ) {
+		int ahead = s_mixEnd - s_soundtime;
+		if ( ahead <= 0 ) {
+			Sys_AtomicAdd( &s_counters.underruns, 1 );
+			ahead = 0;
+		}
+		S_CountMin( &s_counters.mixAhead, ahead * 1000 / dma.speed );
+	}
+
 	// clear any sound effects that end before the current time,
 	// and start any new sounds
 	S_ScanChannelStarts();
 
+	// the thread wakes up every msec, frames take longer
 	sane = thisTime - lastTime;
-	if ( sane < 11 ) {
-		sane = 11;
+	if ( sane < ( s_mixer.active ? 2 : 11 ) ) {
+		sane = s_mixer.active ? 2 : 11;
 	}
 
 	mixAhead[0] = s_mixahead->value * (float)dma.speed;
@@ -1253,15 +2234,13 @@ static void S_Update_( void ) {
 		endtime = s_paintedtime + dma.fullsamples;
 	}
 
-	// add raw data from streamed samples
-	S_UpdateBackgroundTrack();
-
 	SNDDMA_BeginPainting();
 
 	S_PaintChannels( endtime );
 
 	SNDDMA_Submit();
 
+	s_mixEnd = endtime;
 	lastTime = thisTime;
 }
 
@@ -1312,6 +2291,10 @@ static void S_OpenBackgroundStream( const char *filename ) {
 	if( s_backgroundStream->info.channels != 2 || s_backgroundStream->info.rate != 22050 ) {
 		Com_Printf(S_COLOR_YELLOW "WARNING: music file %s is not 22k stereo\n", filename );
 	}
+
+	if ( s_streamThread->integer ) {
+		S_CodecStartDecoder( s_backgroundStream );
+	}
 }
 
 
@@ -1364,6 +2347,9 @@ static void S_UpdateBackgroundTrack( void ) {
 
 	// see how many samples should be copied into the raw buffer
 	if ( s_rawend[0] - s_soundtime < 0 ) {
+		if ( s_rawend[0] ) {
+			Sys_AtomicAdd( &s_counters.underruns, 1 );
+		}
 		s_rawend[0] = s_soundtime;
 	}
 
@@ -1417,15 +2403,81 @@ static void S_UpdateBackgroundTrack( void ) {
 }
 
 
+/*
+===============================================================================
+
+SOUND MEMORY EVICTION
+
+Chunks of the least recently played sounds are given back when SND_malloc
+runs dry or when the resident sounds grow above s_soundMemory. Sounds that
+a channel, a loop or a queued start still refers to are never freed, the
+mixer lock must be held since the channels may belong to the mixer thread.
+
+===============================================================================
+*/
+
+static int s_useStamp;
+
+
 /*
 ======================
-S_FreeOldestSound
+S_MarkUsedSounds
+
+Stamps every sound that is playing or about to be played
 ======================
 */
-void S_FreeOldestSound( void ) {
-	int	i, oldest, used;
-	sfx_t	*sfx;
-	sndBuffer	*buffer, *nbuffer;
+static void S_MarkUsedSounds( void ) {
+	const mixerCmd_t *cmd;
+	int		i;
+
+	s_useStamp++;
+
+	for ( i = 0; i < MAX_CHANNELS; i++ ) {
+		if ( s_channels[i].thesfx ) {
+			s_channels[i].thesfx->useStamp = s_useStamp;
+		}
+	}
+
+	for ( i = 0; i < numLoopChannels; i++ ) {
+		if ( loop_channels[i].thesfx ) {
+			loop_channels[i].thesfx->useStamp = s_useStamp;
+		}
+	}
+
+	for ( i = 0; i < MAX_GENTITIES; i++ ) {
+		if ( loopSounds[i].active && loopSounds[i].sfx ) {
+			loopSounds[i].sfx->useStamp = s_useStamp;
+		}
+	}
+
+	for ( i = 0; i < s_numPendingStarts; i++ ) {
+		s_pendingStarts[i].sfx->useStamp = s_useStamp;
+	}
+
+	// commands the mixer thread did not get to
+	if ( s_mixer.active ) {
+		for ( i = Sys_AtomicLoad( &s_mixer.tail ); i != s_mixer.write; i++ ) {
+			cmd = &s_mixer.cmds[ i & ( MIXER_COMMANDS - 1 ) ];
+			if ( cmd->type == MIXCMD_START ) {
+				cmd->u.start.sfx->useStamp = s_useStamp;
+			} else if ( cmd->type == MIXCMD_LOOP ) {
+				cmd->u.loop.thesfx->useStamp = s_useStamp;
+			}
+		}
+	}
+}
+
+
+/*
+======================
+S_OldestIdleSound
+
+Least recently played resident sound which is not in use, 0 if there is none
+======================
+*/
+static int S_OldestIdleSound( void ) {
+	const sfx_t *sfx;
+	int		i, oldest, used;
 
 	// all sounds may be loaded with (s_soundtime + 1) at this moment
 	// so we need to trigger match condition at least once
@@ -1435,15 +2487,26 @@ void S_FreeOldestSound( void ) {
 
 	for ( i = 1 ; i < s_numSfx ; i++ ) {
 		sfx = &s_knownSfx[i];
-		if ( sfx->inMemory && sfx->lastTimeUsed - oldest < 0 ) {
+		if ( !sfx->inMemory || !sfx->soundData || sfx->useStamp == s_useStamp ) {
+			continue;
+		}
+		if ( sfx->lastTimeUsed - oldest < 0 ) {
 			used = i;
 			oldest = sfx->lastTimeUsed;
 		}
 	}
 
-	sfx = &s_knownSfx[used];
+	return used;
+}
 
-	Com_DPrintf("S_FreeOldestSound: freeing sound %s\n", sfx->soundName);
+
+/*
+======================
+S_FreeSound
+======================
+*/
+static void S_FreeSound( sfx_t *sfx ) {
+	sndBuffer	*buffer, *nbuffer;
 
 	buffer = sfx->soundData;
 	while(buffer != NULL) {
@@ -1456,6 +2519,75 @@ void S_FreeOldestSound( void ) {
 }
 
 
+/*
+======================
+S_FreeOldestSound
+
+Called by SND_malloc when the sound buffer is full
+======================
+*/
+void S_FreeOldestSound( void ) {
+	sfx_t	*sfx;
+	int		used;
+
+	S_MarkUsedSounds();
+
+	used = S_OldestIdleSound();
+	if ( !used ) {
+		// everything resident is playing, the pool can't hold this sound
+		S_MixerUnlock();
+		Com_Error( ERR_FATAL, "S_FreeOldestSound: out of sound memory, raise com_soundMegs" );
+	}
+
+	sfx = &s_knownSfx[used];
+
+	Com_DPrintf("S_FreeOldestSound: freeing sound %s\n", sfx->soundName);
+
+	S_FreeSound( sfx );
+}
+
+
+/*
+======================
+S_EnforceSoundBudget
+
+Frees idle sounds until the resident ones fit into s_soundMemory
+======================
+*/
+static void S_EnforceSoundBudget( void ) {
+	int		budget, used, freed;
+
+	if ( !s_soundMemory->integer ) {
+		return;
+	}
+
+	budget = s_soundMemory->integer * 1024 * 1024;
+	if ( SND_MemoryInUse() <= budget ) {
+		return;
+	}
+
+	S_MixerLock();
+
+	S_MarkUsedSounds();
+
+	freed = 0;
+	while ( SND_MemoryInUse() > budget ) {
+		used = S_OldestIdleSound();
+		if ( !used ) {
+			break;	// the rest is playing
+		}
+		S_FreeSound( &s_knownSfx[used] );
+		freed++;
+	}
+
+	S_MixerUnlock();
+
+	if ( freed ) {
+		Com_DPrintf( "S_EnforceSoundBudget: freed %i sounds, %i bytes resident\n", freed, SND_MemoryInUse() );
+	}
+}
+
+
 // =======================================================================
 // Shutdown sound engine
 // =======================================================================
@@ -1466,6 +2598,11 @@ static void S_Base_Shutdown( void ) {
 		return;
 	}
 
+	S_MixerStop();
+
+	S_FinishLoads( qtrue );
+	s_numPendingStarts = 0;
+
 	SNDDMA_Shutdown();
 
 	// release sound buffers only when switching to dedicated 
@@ -1525,6 +2662,26 @@ qboolean S_Base_Init( soundInterface_t *si ) {
 	s_mixOffset = Cvar_Get( "s_mixOffset", "0", CVAR_ARCHIVE_ND | CVAR_DEVELOPER );
 	Cvar_CheckRange( s_mixOffset, "0", "0.5", CV_FLOAT );
 
+	s_asyncLoad = Cvar_Get( "s_asyncLoad", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( s_asyncLoad, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( s_asyncLoad, "Read sound files in background so sounds played for the first time don't cause hitches, they may start a few milliseconds late." );
+
+	s_occlusion = Cvar_Get( "s_occlusion", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( s_occlusion, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( s_occlusion, "Muffle sounds that have no line of sight to the listener, the loudest " S_COLOR_CYAN "s_occlusionSources " S_COLOR_WHITE "sounds are traced against the map." );
+
+	s_occlusionSources = Cvar_Get( "s_occlusionSources", "8", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( s_occlusionSources, "1", XSTRING( MAX_OCCLUSION_SOURCES ), CV_INTEGER );
+	Cvar_SetDescription( s_occlusionSources, "Number of the loudest entity sounds that " S_COLOR_CYAN "s_occlusion " S_COLOR_WHITE "checks, each costs a trace every 100 msec." );
+
+	s_soundMemory = Cvar_Get( "s_soundMemory", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( s_soundMemory, "0", "512", CV_INTEGER );
+	Cvar_SetDescription( s_soundMemory, "Amount of sound buffer memory (in MB) that resident sounds may keep, the least recently played ones are freed above it. 0 keeps them until " S_COLOR_CYAN "com_soundMegs " S_COLOR_WHITE "runs out." );
+
+	s_mixThread = Cvar_Get( "s_mixThread", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( s_mixThread, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( s_mixThread, "Mix sound on a separate thread so frame hitches can't cause dropouts, allows a low " S_COLOR_CYAN "s_mixAhead " S_COLOR_WHITE "such as 0.02 for less latency." );
+
 	s_show = Cvar_Get( "s_show", "0", CVAR_CHEAT );
 	Cvar_SetDescription( s_show, "Debugging output (used sound files)." );
 	s_testsound = Cvar_Get( "s_testsound", "0", CVAR_CHEAT );
@@ -1537,6 +2694,8 @@ qboolean S_Base_Init( soundInterface_t *si ) {
 		S_COLOR_YELLOW " Please note that only mono/stereo devices are acceptable.\n" );
 #endif
 
+	S_InitKernels();
+
 	r = SNDDMA_Init();
 
 	if ( r ) {
@@ -1548,6 +2707,9 @@ qboolean S_Base_Init( soundInterface_t *si ) {
 
 		s_soundtime = 0;
 		s_paintedtime = 0;
+		s_mixEnd = 0;
+
+		S_OcclusionInit();
 
 		S_Base_StopAllSounds();
 
@@ -54,11 +54,13 @@ typedef struct sfx_s {
 	qboolean		defaultSound;			// couldn't be loaded, so use buzz
 	qboolean		inMemory;				// not in Memory
 	qboolean		soundCompressed;		// not in Memory
+	qboolean		loading;				// file is being read in background
 	int				soundCompressionMethod;
 	int 			soundLength;
 	int				soundChannels;
 	char 			soundName[MAX_QPATH];
 	int				lastTimeUsed;
+	int				useStamp;				// S_MarkUsedSounds pass that found it in use
 	struct sfx_s	*next;
 } sfx_t;
 
@@ -110,6 +112,10 @@ typedef struct
 	qboolean	fixed_origin;	// use origin instead of fetching entnum's origin
 	sfx_t		*thesfx;		// sfx structure
 	qboolean	doppler;
+	float		blocked;		// occlusion of a fixed origin sound, 0 = clear
+	float		lowpass;		// one pole filter coefficient, 0 = off
+	float		lpState[2];		// filtered left and right samples
+	qboolean	lpPrimed;		// lpState holds samples of this channel
 } channel_t;
 
 
@@ -196,21 +202,61 @@ extern cvar_t *s_volume;
 extern cvar_t *s_muted;
 extern cvar_t *s_musicVolume;
 extern cvar_t *s_doppler;
+extern cvar_t *s_streamThread;
 extern cvar_t *s_muteWhenUnfocused;
 extern cvar_t *s_muteWhenMinimized;
 extern cvar_t * s_worldVolume;
 
 extern cvar_t *s_testsound;
 
+// profiling counters, the backends and their threads add to them
+// and S_Update takes them once per frame for s_info and com_trace
+typedef struct {
+	volatile int	channels;		// most channels mixed at once
+	volatile int	paintUsec;		// time spent mixing or updating sources
+	volatile int	decodeUsec;		// time spent decoding chunks and streams
+	volatile int	cacheMisses;	// sounds started before they were in memory
+	volatile int	underruns;		// the device or a stream ran dry
+	volatile int	mixAhead;		// least msec queued ahead of the device
+} sndCounters_t;
+
+#define SND_COUNT_UNSET		0x7fffffff	// mixAhead without a sample
+
+extern sndCounters_t s_counters;
+
+void S_CountMax( volatile int *counter, int value );
+void S_CountMin( volatile int *counter, int value );
+
 qboolean S_LoadSound( sfx_t *sfx );
+struct snd_info_s;
+void S_LoadSoundData( sfx_t *sfx, const byte *data, const struct snd_info_s *info );
 
 void		SND_free(sndBuffer *v);
 sndBuffer*	SND_malloc( void );
 void		SND_setup( void );
+int			SND_MemoryInUse( void );
 void		SND_shutdown( void );
 
 void S_PaintChannels(int endtime);
 
+// load time resampling filter
+#define RESAMPLE_TAPS			16						// taps per output sample, multiple of 4
+#define RESAMPLE_PHASES			256						// fractional positions between two input samples
+
+// mixing and transfer kernels, every variant is bit-exact with the C code
+typedef struct {
+	const char *name;
+	void	(*PaintMono16)( int *samp, const short *in, int count, int leftvol, int rightvol );
+	void	(*PaintStereo16)( int *samp, const short *in, int count, int leftvol, int rightvol );
+	void	(*TransferFloat)( float *out, const int *in, int count );
+	void	(*ResampleChannel)( short *out, int stride, int outcount, const float *src, const float *coeffs, int inrate, int outrate );
+} sndKernels_t;
+
+extern sndKernels_t s_kernels;
+
+// picks the best kernels for Com_SIMDFlags
+void S_InitKernels( void );
+
 // spatializes a channel
 void S_Spatialize(channel_t *ch);
 
@@ -234,9 +280,10 @@ void decodeWavelet( sndBuffer *stream, short *packets);
 void encodeMuLaw( sfx_t *sfx, short *packets);
 extern short mulawToShort[256];
 
-extern short *sfxScratchBuffer;
-extern sfx_t *sfxScratchPointer;
-extern int	   sfxScratchIndex;
+void decodeMuLaw( sndBuffer *chunk, short *to );
+
+// decoded chunk cache of snd_mix.c, NULL flushes all
+void S_FlushDecodedChunk( const sndBuffer *chunk );
 
 qboolean S_Base_Init( soundInterface_t *si );
 
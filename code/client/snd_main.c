@@ -30,6 +30,7 @@ cvar_t *s_volume;
 cvar_t *s_muted;
 cvar_t *s_musicVolume;
 cvar_t *s_doppler;
+cvar_t *s_streamThread;
 cvar_t *s_backend;
 cvar_t *s_muteWhenMinimized;
 cvar_t *s_muteWhenUnfocused;
@@ -37,6 +38,21 @@ cvar_t *s_worldVolume;
 
 static soundInterface_t si;
 
+sndCounters_t	s_counters;
+
+typedef struct {
+	int		channels;
+	int		paintUsec;
+	int		decodeUsec;
+	int		mixAhead;		// -1 if no sample
+	int		cacheMisses;	// totals
+	int		underruns;
+	int		worstPaintUsec;	// since the last s_info
+	int		worstMixAhead;
+} sndStats_t;
+
+static sndStats_t s_stats;
+
 /*
 =================
 S_ValidateInterface
@@ -229,6 +245,117 @@ void S_UpdateEntityPosition( int entityNum, const vec3_t origin )
 }
 
 
+/*
+=================
+S_CountMax
+=================
+*/
+void S_CountMax( volatile int *counter, int value )
+{
+	int old;
+
+	do {
+		old = Sys_AtomicLoad( counter );
+		if( old >= value ) {
+			return;
+		}
+	} while( !Sys_AtomicCompareSwap( counter, old, value ) );
+}
+
+
+/*
+=================
+S_CountMin
+=================
+*/
+void S_CountMin( volatile int *counter, int value )
+{
+	int old;
+
+	do {
+		old = Sys_AtomicLoad( counter );
+		if( old <= value ) {
+			return;
+		}
+	} while( !Sys_AtomicCompareSwap( counter, old, value ) );
+}
+
+
+/*
+=================
+S_TakeCounter
+
+Returns the value of a counter that may be updated
+by another thread and restarts it from reset
+=================
+*/
+static int S_TakeCounter( volatile int *counter, int reset )
+{
+	int old;
+
+	do {
+		old = Sys_AtomicLoad( counter );
+	} while( !Sys_AtomicCompareSwap( counter, old, reset ) );
+
+	return old;
+}
+
+
+/*
+=================
+S_ResetStats
+=================
+*/
+static void S_ResetStats( void )
+{
+	Com_Memset( &s_stats, 0, sizeof( s_stats ) );
+	s_stats.mixAhead = -1;
+	s_stats.worstMixAhead = -1;
+
+	Com_Memset( (void *)&s_counters, 0, sizeof( s_counters ) );
+	s_counters.mixAhead = SND_COUNT_UNSET;
+}
+
+
+/*
+=================
+S_UpdateStats
+
+Takes the counters of the last frame
+=================
+*/
+static void S_UpdateStats( void )
+{
+	int ahead;
+
+	s_stats.channels = S_TakeCounter( &s_counters.channels, 0 );
+	s_stats.paintUsec = S_TakeCounter( &s_counters.paintUsec, 0 );
+	s_stats.decodeUsec = S_TakeCounter( &s_counters.decodeUsec, 0 );
+	s_stats.cacheMisses += S_TakeCounter( &s_counters.cacheMisses, 0 );
+	s_stats.underruns += S_TakeCounter( &s_counters.underruns, 0 );
+
+	// keep the last sample if nothing was mixed this frame
+	ahead = S_TakeCounter( &s_counters.mixAhead, SND_COUNT_UNSET );
+	if( ahead != SND_COUNT_UNSET ) {
+		s_stats.mixAhead = ahead;
+		if( s_stats.worstMixAhead < 0 || ahead < s_stats.worstMixAhead ) {
+			s_stats.worstMixAhead = ahead;
+		}
+	}
+
+	if( s_stats.paintUsec > s_stats.worstPaintUsec ) {
+		s_stats.worstPaintUsec = s_stats.paintUsec;
+	}
+
+	Com_TraceCounter( "snd_channels", s_stats.channels );
+	Com_TraceCounter( "snd_paintUsec", s_stats.paintUsec );
+	Com_TraceCounter( "snd_decodeUsec", s_stats.decodeUsec );
+	Com_TraceCounter( "snd_cacheMisses", s_stats.cacheMisses );
+	Com_TraceCounter( "snd_underruns", s_stats.underruns );
+	Com_TraceCounter( "snd_mixAheadMsec", s_stats.mixAhead );
+}
+
+
 /*
 =================
 S_Update
@@ -257,6 +384,7 @@ void S_Update( int msec )
 	
 	if( si.Update ) {
 		si.Update();
+		S_UpdateStats();
 	}
 }
 
@@ -329,6 +457,23 @@ static void S_SoundInfo( void )
 {
 	if( si.SoundInfo ) {
 		si.SoundInfo();
+
+		Com_Printf( "Last frame: %i channels, %i usec mixing, %i usec decoding, ",
+			s_stats.channels, s_stats.paintUsec, s_stats.decodeUsec );
+		if( s_stats.mixAhead >= 0 ) {
+			Com_Printf( "%i msec ahead\n", s_stats.mixAhead );
+		} else {
+			Com_Printf( "nothing queued\n" );
+		}
+		Com_Printf( "Worst since last s_info: %i usec mixing", s_stats.worstPaintUsec );
+		if( s_stats.worstMixAhead >= 0 ) {
+			Com_Printf( ", %i msec ahead", s_stats.worstMixAhead );
+		}
+		Com_Printf( "\n%i sounds started before they were loaded, %i underruns\n",
+			s_stats.cacheMisses, s_stats.underruns );
+
+		s_stats.worstPaintUsec = 0;
+		s_stats.worstMixAhead = -1;
 	}
 }
 
@@ -442,6 +587,9 @@ void S_Init( void )
 	s_doppler = Cvar_Get( "s_doppler", "1", CVAR_ARCHIVE_ND );
 	Cvar_CheckRange( s_doppler, "0", "1", CV_INTEGER );
 	Cvar_SetDescription( s_doppler, "Enables doppler effect on moving projectiles." );
+	s_streamThread = Cvar_Get( "s_streamThread", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( s_streamThread, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( s_streamThread, "Decode music on a separate thread, applies to tracks started afterwards." );
 	s_backend = Cvar_Get( "s_backend", "", CVAR_ROM );
 	Cvar_SetDescription( s_backend, "Read only, indicates the current sound backend" );
 	s_muteWhenUnfocused = Cvar_Get( "s_muteWhenUnfocused", "1", CVAR_ARCHIVE );
@@ -469,6 +617,8 @@ void S_Init( void )
 		Cmd_AddCommand( "s_stop", S_StopAllSounds );
 		Cmd_AddCommand( "s_info", S_SoundInfo );
 
+		S_ResetStats();
+
 		cv = Cvar_Get( "s_useOpenAL", "1", CVAR_ARCHIVE | CVAR_LATCH );
 		if( cv->integer ) {
 			//OpenAL
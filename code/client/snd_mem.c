@@ -47,13 +47,9 @@ static	sndBuffer	*freelist = NULL;
 static	int inUse = 0;
 static	int totalInUse = 0;
 
-short *sfxScratchBuffer = NULL;
-sfx_t *sfxScratchPointer = NULL;
-int	   sfxScratchIndex = 0;
-
-
 void SND_free( sndBuffer *v )
 {
+	S_FlushDecodedChunk( v );
 	*(sndBuffer **)v = freelist;
 	freelist = (sndBuffer*)v;
 	inUse += sizeof(sndBuffer);
@@ -113,22 +109,7 @@ void SND_setup( void )
 		Com_Memset( buffer, 0, sz );
 	}
 
-	sz = SND_CHUNK_SIZE * sizeof(short) * 4;
-
-	// allocate the stack based hunk allocator
-	// -EC-
-	if ( sfxScratchBuffer == NULL ) {
-		sfxScratchBuffer = malloc( sz );	//Hunk_Alloc(SND_CHUNK_SIZE * sizeof(short) * 4);
-	}
-
-	// clear scratch buffer -EC-
-	if ( sfxScratchBuffer == NULL ) {
-		Com_Error( ERR_FATAL, "Error allocating %i bytes for sfxScratchBuffer",	sz );
-	} else {
-		Com_Memset( sfxScratchBuffer, 0, sz );
-	}
-
-	sfxScratchPointer = NULL;
+	S_FlushDecodedChunk( NULL );
 
 	inUse = scs * sizeof( sndBuffer );
 	totalInUse = 0; // -EC-
@@ -147,11 +128,6 @@ void SND_setup( void )
 
 void SND_shutdown( void )
 {
-	if ( sfxScratchBuffer ) 
-	{
-		free( sfxScratchBuffer );
-		sfxScratchBuffer = NULL;
-	}
 	if ( buffer ) 
 	{
 		free( buffer );
@@ -159,99 +135,184 @@ void SND_shutdown( void )
 	}
 }
 
+/*
+===============================================================================
+
+resampling
+
+Sounds are converted to the output rate once at load time with a
+windowed-sinc filter, RESAMPLE_PHASES + 1 fractional positions of the
+kernel are precomputed for every rate pair in use.
+
+===============================================================================
+*/
+
+#define MAX_RESAMPLE_FILTERS	4
+
+typedef struct {
+	int		inrate;
+	int		outrate;
+	float	coeffs[ RESAMPLE_PHASES + 1 ][ RESAMPLE_TAPS ];
+} resampleFilter_t;
+
+static resampleFilter_t	resampleFilters[ MAX_RESAMPLE_FILTERS ];
+static int				numResampleFilters;
+
+
 /*
 ================
-ResampleSfx
+S_GetResampleFilter
 
-resample / decimate to the current source rate
+Returns the filter bank for the rate pair, building it on first use
+================
+*/
+static const float *S_GetResampleFilter( int inrate, int outrate ) {
+	resampleFilter_t *filter;
+	double cutoff, x, h, t, sum;
+	int i, p, k;
+
+	for ( i = 0; i < numResampleFilters && i < MAX_RESAMPLE_FILTERS; i++ ) {
+		if ( resampleFilters[i].inrate == inrate && resampleFilters[i].outrate == outrate ) {
+			return resampleFilters[i].coeffs[0];
+		}
+	}
+
+	// replace the oldest one when all slots are taken
+	filter = &resampleFilters[ numResampleFilters % MAX_RESAMPLE_FILTERS ];
+	numResampleFilters++;
+
+	filter->inrate = inrate;
+	filter->outrate = outrate;
+
+	// lowpass below the lower of both Nyquist rates, in input samples
+	cutoff = 0.9 * MIN( 1.0, (double)outrate / inrate );
+
+	for ( p = 0; p <= RESAMPLE_PHASES; p++ ) {
+		sum = 0.0;
+		for ( k = 0; k < RESAMPLE_TAPS; k++ ) {
+			// distance from the output position to the tap
+			x = k - ( RESAMPLE_TAPS / 2 - 1 ) - (double)p / RESAMPLE_PHASES;
+			t = M_PI * cutoff * x;
+			h = ( t == 0.0 ) ? cutoff : cutoff * sin( t ) / t;
+			// Blackman window over the filter length
+			t = M_PI * x / ( RESAMPLE_TAPS / 2 );
+			h *= 0.42 + 0.5 * cos( t ) + 0.08 * cos( 2.0 * t );
+			filter->coeffs[p][k] = h;
+			sum += h;
+		}
+		// unity gain at every phase
+		for ( k = 0; k < RESAMPLE_TAPS; k++ ) {
+			filter->coeffs[p][k] /= sum;
+		}
+	}
+
+	return filter->coeffs[0];
+}
+
+
+/*
+================
+ResampleCount
+
+Number of output samples for a sound of the given rate
 ================
 */
-static int ResampleSfx( sfx_t *sfx, int channels, int inrate, int inwidth, int samples, byte *data, qboolean compressed ) {
-	int		outcount;
-	int		srcsample;
+static int ResampleCount( int inrate, int samples ) {
 	float	stepscale;
-	int		i, j;
-	int		sample, samplefrac, fracstep;
-	int			part;
-	sndBuffer	*chunk;
-	
+
 	stepscale = (float)inrate / dma.speed;	// this is usually 0.5, 1, or 2
 
-	outcount = samples / stepscale;
+	return samples / stepscale;
+}
 
-	srcsample = 0;
-	samplefrac = 0;
-	fracstep = stepscale * 256 * channels;
-	chunk = sfx->soundData;
 
-	for (i=0 ; i<outcount ; i++)
-	{
-		srcsample += samplefrac >> 8;
-		samplefrac &= 255;
-		samplefrac += fracstep;
-		for (j=0 ; j<channels ; j++)
-		{
-			if( inwidth == 2 ) {
-				sample = ( ((short *)data)[srcsample+j] );
+/*
+================
+ResampleSfxRaw
+
+resample / decimate to the current source rate
+================
+*/
+static int ResampleSfxRaw( short *sfx, int channels, int inrate, int inwidth, int samples, const byte *data ) {
+	const float	*coeffs;
+	float		*src;
+	int			outcount;
+	int			i, j, pad;
+
+	outcount = ResampleCount( inrate, samples );
+
+	if ( inrate == dma.speed ) {
+		for ( i = 0; i < outcount * channels; i++ ) {
+			if ( inwidth == 2 ) {
+				sfx[i] = LittleShort( ((const short *)data)[i] );
 			} else {
-				sample = (unsigned int)( (unsigned char)(data[srcsample+j]) - 128) << 8;
-			}
-			part = (i*channels+j)&(SND_CHUNK_SIZE-1);
-			if (part == 0) {
-				sndBuffer	*newchunk;
-				newchunk = SND_malloc();
-				if (chunk == NULL) {
-					sfx->soundData = newchunk;
-				} else {
-					chunk->next = newchunk;
-				}
-				chunk = newchunk;
+				sfx[i] = (int)( (unsigned char)(data[i]) - 128) << 8;
 			}
+		}
+		return outcount;
+	}
+
+	coeffs = S_GetResampleFilter( inrate, dma.speed );
 
-			chunk->sndChunk[part] = sample;
+	// one zero padded float row per channel
+	pad = samples + RESAMPLE_TAPS;
+	src = Hunk_AllocateTempMemory( pad * channels * sizeof( float ) );
+	Com_Memset( src, 0, pad * channels * sizeof( float ) );
+
+	for ( i = 0; i < samples; i++ ) {
+		for ( j = 0; j < channels; j++ ) {
+			if ( inwidth == 2 ) {
+				src[ j * pad + RESAMPLE_TAPS / 2 - 1 + i ] = LittleShort( ((const short *)data)[i*channels+j] );
+			} else {
+				src[ j * pad + RESAMPLE_TAPS / 2 - 1 + i ] = (int)( (unsigned char)(data[i*channels+j]) - 128) << 8;
+			}
 		}
 	}
 
+	for ( j = 0; j < channels; j++ ) {
+		s_kernels.ResampleChannel( sfx + j, channels, outcount, src + j * pad, coeffs, inrate, dma.speed );
+	}
+
+	Hunk_FreeTempMemory( src );
+
 	return outcount;
 }
 
+
 /*
 ================
 ResampleSfx
 
-resample / decimate to the current source rate
+resample / decimate to the current source rate,
+samples are kept in sound chunks
 ================
 */
-static int ResampleSfxRaw( short *sfx, int channels, int inrate, int inwidth, int samples, byte *data ) {
+static int ResampleSfx( sfx_t *sfx, short *buffer, int channels, int inrate, int inwidth, int samples, const byte *data ) {
 	int			outcount;
-	int			srcsample;
-	float		stepscale;
-	int			i, j;
-	int			sample, samplefrac, fracstep;
-	
-	stepscale = (float)inrate / dma.speed;	// this is usually 0.5, 1, or 2
+	int			i;
+	int			part;
+	sndBuffer	*chunk;
 
-	outcount = samples / stepscale;
+	outcount = ResampleSfxRaw( buffer, channels, inrate, inwidth, samples, data );
 
-	srcsample = 0;
-	samplefrac = 0;
-	fracstep = stepscale * 256 * channels;
+	chunk = sfx->soundData;
 
-	for (i=0 ; i<outcount ; i++)
-	{
-		srcsample += samplefrac >> 8;
-		samplefrac &= 255;
-		samplefrac += fracstep;
-		for (j=0 ; j<channels ; j++)
-		{
-			if( inwidth == 2 ) {
-				sample = LittleShort ( ((short *)data)[srcsample+j] );
+	for ( i = 0; i < outcount * channels; i++ ) {
+		part = i & (SND_CHUNK_SIZE-1);
+		if (part == 0) {
+			sndBuffer	*newchunk;
+			newchunk = SND_malloc();
+			if (chunk == NULL) {
+				sfx->soundData = newchunk;
 			} else {
-				sample = (int)( (unsigned char)(data[srcsample+j]) - 128) << 8;
+				chunk->next = newchunk;
 			}
-			sfx[i*channels+j] = sample;
+			chunk = newchunk;
 		}
+
+		chunk->sndChunk[part] = buffer[i];
 	}
+
 	return outcount;
 }
 
@@ -268,15 +329,33 @@ of a forced fallback of a player specific sound
 qboolean S_LoadSound( sfx_t *sfx )
 {
 	byte	*data;
-	short	*samples;
 	snd_info_t	info;
-//	int		size;
 
 	// load it in
 	data = S_CodecLoad(sfx->soundName, &info);
 	if(!data)
 		return qfalse;
 
+	S_LoadSoundData( sfx, data, &info );
+
+	Hunk_FreeTempMemory(data);
+
+	return qtrue;
+}
+
+
+/*
+==============
+S_LoadSoundData
+
+Converts decoded samples to sound chunks, data is not released
+==============
+*/
+void S_LoadSoundData( sfx_t *sfx, const byte *data, const snd_info_t *infoPtr )
+{
+	short	*samples;
+	snd_info_t	info = *infoPtr;
+
 	if ( info.width == 1 ) {
 		Com_DPrintf(S_COLOR_YELLOW "WARNING: %s is a 8 bit audio file\n", sfx->soundName);
 	}
@@ -285,7 +364,7 @@ qboolean S_LoadSound( sfx_t *sfx )
 		Com_DPrintf(S_COLOR_YELLOW "WARNING: %s is not a 22kHz audio file\n", sfx->soundName);
 	}
 
-	samples = Hunk_AllocateTempMemory(info.samples * sizeof(short) * 2);
+	samples = Hunk_AllocateTempMemory( ( ResampleCount( info.rate, info.samples ) + 1 ) * info.channels * sizeof(short) );
 
 	sfx->lastTimeUsed = s_soundtime + 1; // Com_Milliseconds()+1
 
@@ -315,15 +394,16 @@ qboolean S_LoadSound( sfx_t *sfx )
 	} else {
 		sfx->soundCompressionMethod = 0;
 		sfx->soundData = NULL;
-		sfx->soundLength = ResampleSfx( sfx, info.channels, info.rate, info.width, info.samples, data + info.dataofs, qfalse );
+		sfx->soundLength = ResampleSfx( sfx, samples, info.channels, info.rate, info.width, info.samples, data + info.dataofs );
 	}
 
 	sfx->soundChannels = info.channels;
 	
 	Hunk_FreeTempMemory(samples);
-	Hunk_FreeTempMemory(data);
+}
 
-	return qtrue;
+int SND_MemoryInUse( void ) {
+	return totalInUse;
 }
 
 void S_DisplayFreeMemory(void) {
@@ -351,6 +351,18 @@ static void S_TransferPaintBuffer( int endtime, byte *buffer )
 		{
 			const float rdiv = 1.0f / (32768.0f * 256.0f - 128.0f); // 8388480.0f
 			float *out = (float *) pbuf;
+			if ( step == 1 ) {
+				// contiguous runs up to the end of the dma buffer
+				while ( count > 0 ) {
+					i = dma.samples - out_idx;
+					if ( i > count )
+						i = count;
+					s_kernels.TransferFloat( out + out_idx, p, i );
+					p += i;
+					out_idx = (out_idx + i) & out_mask;
+					count -= i;
+				}
+			}
 			while ( count-- > 0 )
 			{
 				val = *p;
@@ -515,103 +527,338 @@ static void S_PaintChannelFrom16_scalar( channel_t *ch, const sfx_t *sc, int cou
 }
 
 
-static void S_PaintChannelFrom16( channel_t *ch, const sfx_t *sc, int count, int sampleOffset, int bufferOffset ) 
-{
-	S_PaintChannelFrom16_scalar( ch, sc, count, sampleOffset, bufferOffset );
-}
-
+/*
+===================
+S_PaintChannelFrom16_runs
 
-static void S_PaintChannelFromWavelet( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
-	int						data;
+Same as the non-doppler path of S_PaintChannelFrom16_scalar,
+mixes whole runs of a chunk at once
+===================
+*/
+static void S_PaintChannelFrom16_runs( channel_t *ch, const sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
 	int						leftvol, rightvol;
-	int						i;
+	int						n;
 	portable_samplepair_t	*samp;
 	sndBuffer				*chunk;
-	short					*samples;
 
-	leftvol = ch->leftvol*snd_vol;
-	rightvol = ch->rightvol*snd_vol;
+	if (sc->soundChannels <= 0) {
+		return;
+	}
 
-	i = 0;
 	samp = &paintbuffer[ bufferOffset ];
+
+	if (ch->doppler) {
+		sampleOffset = sampleOffset*ch->oldDopplerScale;
+	}
+
+	if ( sc->soundChannels == 2 ) {
+		sampleOffset *= sc->soundChannels;
+
+		if ( sampleOffset & 1 ) {
+			sampleOffset &= ~1;
+		}
+	}
+
 	chunk = sc->soundData;
-	while (sampleOffset>=(SND_CHUNK_SIZE_FLOAT*4)) {
+	while (sampleOffset>=SND_CHUNK_SIZE) {
 		chunk = chunk->next;
-		sampleOffset -= (SND_CHUNK_SIZE_FLOAT*4);
-		i++;
+		sampleOffset -= SND_CHUNK_SIZE;
+		if (!chunk) {
+			chunk = sc->soundData;
+		}
 	}
 
-	if (i!=sfxScratchIndex || sfxScratchPointer != sc) {
-		decodeWavelet(chunk, sfxScratchBuffer);
-		sfxScratchIndex = i;
-		sfxScratchPointer = sc;
-	}
+	leftvol = ch->leftvol*snd_vol;
+	rightvol = ch->rightvol*snd_vol;
 
-	samples = sfxScratchBuffer;
+	while ( count > 0 ) {
+		n = ( SND_CHUNK_SIZE - sampleOffset ) / sc->soundChannels;
+		if ( n > count ) {
+			n = count;
+		}
 
-	for ( i=0 ; i<count ; i++ ) {
-		data  = samples[sampleOffset++];
-		samp[i].left += (data * leftvol)>>8;
-		samp[i].right += (data * rightvol)>>8;
+		if ( sc->soundChannels == 2 ) {
+			s_kernels.PaintStereo16( &samp->left, chunk->sndChunk + sampleOffset, n, leftvol, rightvol );
+		} else {
+			s_kernels.PaintMono16( &samp->left, chunk->sndChunk + sampleOffset, n, leftvol, rightvol );
+		}
+
+		samp += n;
+		count -= n;
+		sampleOffset += n * sc->soundChannels;
 
-		if (sampleOffset == SND_CHUNK_SIZE*2) {
+		if (sampleOffset == SND_CHUNK_SIZE) {
 			chunk = chunk->next;
-			decodeWavelet(chunk, sfxScratchBuffer);
-			sfxScratchIndex++;
+			if (!chunk) {
+				chunk = sc->soundData;
+			}
 			sampleOffset = 0;
 		}
 	}
 }
 
 
-static void S_PaintChannelFromADPCM( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
-	int						data;
+/*
+===================
+S_PaintChannelFrom16_lowpass
+
+Non-doppler path for occluded channels, the samples go through a one
+pole low-pass filter whose state is kept in the channel
+===================
+*/
+static void S_PaintChannelFrom16_lowpass( channel_t *ch, const sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
 	int						leftvol, rightvol;
 	int						i;
 	portable_samplepair_t	*samp;
 	sndBuffer				*chunk;
 	short					*samples;
+	float					a, l, r;
 
-	leftvol = ch->leftvol*snd_vol;
-	rightvol = ch->rightvol*snd_vol;
+	if (sc->soundChannels <= 0) {
+		return;
+	}
 
-	i = 0;
 	samp = &paintbuffer[ bufferOffset ];
-	chunk = sc->soundData;
 
 	if (ch->doppler) {
 		sampleOffset = sampleOffset*ch->oldDopplerScale;
 	}
 
-	while (sampleOffset>=(SND_CHUNK_SIZE*4)) {
+	if ( sc->soundChannels == 2 ) {
+		sampleOffset *= sc->soundChannels;
+
+		if ( sampleOffset & 1 ) {
+			sampleOffset &= ~1;
+		}
+	}
+
+	chunk = sc->soundData;
+	while (sampleOffset>=SND_CHUNK_SIZE) {
 		chunk = chunk->next;
-		sampleOffset -= (SND_CHUNK_SIZE*4);
-		i++;
+		sampleOffset -= SND_CHUNK_SIZE;
+		if (!chunk) {
+			chunk = sc->soundData;
+		}
 	}
 
-	if (i!=sfxScratchIndex || sfxScratchPointer != sc) {
-		S_AdpcmGetSamples( chunk, sfxScratchBuffer );
-		sfxScratchIndex = i;
-		sfxScratchPointer = sc;
+	leftvol = ch->leftvol*snd_vol;
+	rightvol = ch->rightvol*snd_vol;
+	samples = chunk->sndChunk;
+
+	// start from the current sample so there is no click
+	if ( !ch->lpPrimed ) {
+		ch->lpState[0] = samples[sampleOffset];
+		ch->lpState[1] = samples[sampleOffset + sc->soundChannels - 1];
+		ch->lpPrimed = qtrue;
 	}
 
-	samples = sfxScratchBuffer;
+	a = ch->lowpass;
+	l = ch->lpState[0];
+	r = ch->lpState[1];
 
 	for ( i=0 ; i<count ; i++ ) {
-		data  = samples[sampleOffset++];
-		samp[i].left += (data * leftvol)>>8;
-		samp[i].right += (data * rightvol)>>8;
+		l += ( samples[sampleOffset] - l ) * a;
+		if ( sc->soundChannels == 2 ) {
+			sampleOffset++;
+		}
+		r += ( samples[sampleOffset++] - r ) * a;
+
+		samp[i].left += (int)( l * leftvol )>>8;
+		samp[i].right += (int)( r * rightvol )>>8;
 
-		if (sampleOffset == SND_CHUNK_SIZE*4) {
+		if (sampleOffset == SND_CHUNK_SIZE) {
 			chunk = chunk->next;
-			S_AdpcmGetSamples( chunk, sfxScratchBuffer);
+			if (!chunk) {
+				chunk = sc->soundData;
+			}
+			samples = chunk->sndChunk;
 			sampleOffset = 0;
-			sfxScratchIndex++;
+		}
+	}
+
+	ch->lpState[0] = l;
+	ch->lpState[1] = r;
+}
+
+
+static void S_PaintChannelFrom16( channel_t *ch, const sfx_t *sc, int count, int sampleOffset, int bufferOffset ) 
+{
+	if ( ch->lowpass != 0.0f && ( !ch->doppler || ch->dopplerScale == 1.0f ) ) {
+		S_PaintChannelFrom16_lowpass( ch, sc, count, sampleOffset, bufferOffset );
+		return;
+	}
+	if ( !ch->doppler || ch->dopplerScale == 1.0f ) {
+		S_PaintChannelFrom16_runs( ch, sc, count, sampleOffset, bufferOffset );
+		return;
+	}
+	S_PaintChannelFrom16_scalar( ch, sc, count, sampleOffset, bufferOffset );
+}
+
+
+/*
+===============================================================================
+
+DECODED CHUNK CACHE
+
+Compressed sounds are decoded a chunk at a time into a small cache so
+channels playing the same sounds, and the several paints per chunk,
+don't decode the same chunk again. Chunks are flushed when they are
+freed, which only happens with the mixer locked.
+
+===============================================================================
+*/
+
+#define DECODE_CACHE_CHUNKS		8
+#define DECODE_CHUNK_SAMPLES	(SND_CHUNK_SIZE*4)	// ADPCM expands the most
+
+typedef struct {
+	const sndBuffer	*chunk;
+	int				lastUsed;
+	short			samples[DECODE_CHUNK_SAMPLES];
+} decodedChunk_t;
+
+static decodedChunk_t	decodeCache[DECODE_CACHE_CHUNKS];
+static int				decodeCounter;
+
+
+/*
+===================
+S_FlushDecodedChunk
+===================
+*/
+void S_FlushDecodedChunk( const sndBuffer *chunk ) {
+	int i;
+
+	for ( i = 0; i < DECODE_CACHE_CHUNKS; i++ ) {
+		if ( !chunk || decodeCache[i].chunk == chunk ) {
+			decodeCache[i].chunk = NULL;
+		}
+	}
+}
+
+
+/*
+===================
+S_DecodeChunk
+
+Returns the samples of a chunk compressed with the given method
+===================
+*/
+static const short *S_DecodeChunk( sndBuffer *chunk, int method ) {
+	decodedChunk_t *dc, *oldest;
+	int64_t start;
+	int i;
+
+	oldest = decodeCache;
+	for ( i = 0, dc = decodeCache; i < DECODE_CACHE_CHUNKS; i++, dc++ ) {
+		if ( dc->chunk == chunk ) {
+			dc->lastUsed = ++decodeCounter;
+			return dc->samples;
+		}
+		if ( !dc->chunk || ( oldest->chunk && dc->lastUsed - oldest->lastUsed < 0 ) ) {
+			oldest = dc;
+		}
+	}
+
+	start = Sys_Microseconds();
+
+	switch ( method ) {
+	case 1:
+		S_AdpcmGetSamples( chunk, oldest->samples );
+		break;
+	case 2:
+		decodeWavelet( chunk, oldest->samples );
+		break;
+	default:
+		decodeMuLaw( chunk, oldest->samples );
+		break;
+	}
+
+	Sys_AtomicAdd( &s_counters.decodeUsec, (int)( Sys_Microseconds() - start ) );
+
+	oldest->chunk = chunk;
+	oldest->lastUsed = ++decodeCounter;
+
+	return oldest->samples;
+}
+
+
+/*
+===================
+S_PaintMono16
+
+Adds count mono samples to the paint buffer
+===================
+*/
+static void S_PaintMono16( portable_samplepair_t *samp, const short *in, int count, int leftvol, int rightvol ) {
+	s_kernels.PaintMono16( &samp->left, in, count, leftvol, rightvol );
+}
+
+
+/*
+===================
+S_PaintChannelFromDecoded
+
+Mixes a sound whose chunks decode to chunkSamples mono samples,
+chunks past the end wrap to the beginning like the 16 bit sounds
+===================
+*/
+static void S_PaintChannelFromDecoded( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset, int chunkSamples ) {
+	int						leftvol, rightvol;
+	int						n;
+	portable_samplepair_t	*samp;
+	sndBuffer				*chunk;
+	const short				*samples;
+
+	leftvol = ch->leftvol*snd_vol;
+	rightvol = ch->rightvol*snd_vol;
+
+	samp = &paintbuffer[ bufferOffset ];
+	chunk = sc->soundData;
+	while (sampleOffset>=chunkSamples) {
+		chunk = chunk->next;
+		sampleOffset -= chunkSamples;
+		if (!chunk) {
+			chunk = sc->soundData;
+		}
+	}
+
+	while ( count > 0 ) {
+		samples = S_DecodeChunk( chunk, sc->soundCompressionMethod );
+
+		n = chunkSamples - sampleOffset;
+		if ( n > count ) {
+			n = count;
+		}
+
+		S_PaintMono16( samp, samples + sampleOffset, n, leftvol, rightvol );
+
+		samp += n;
+		count -= n;
+		sampleOffset = 0;
+
+		chunk = chunk->next;
+		if (!chunk) {
+			chunk = sc->soundData;
 		}
 	}
 }
 
 
+static void S_PaintChannelFromWavelet( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
+	S_PaintChannelFromDecoded( ch, sc, count, sampleOffset, bufferOffset, SND_CHUNK_SIZE_FLOAT*4 );
+}
+
+
+static void S_PaintChannelFromADPCM( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
+	if (ch->doppler) {
+		sampleOffset = sampleOffset*ch->oldDopplerScale;
+	}
+
+	S_PaintChannelFromDecoded( ch, sc, count, sampleOffset, bufferOffset, SND_CHUNK_SIZE*4 );
+}
+
+
 static void S_PaintChannelFromMuLaw( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
 	int						data;
 	int						leftvol, rightvol;
@@ -621,6 +868,11 @@ static void S_PaintChannelFromMuLaw( channel_t *ch, sfx_t *sc, int count, int sa
 	byte					*samples;
 	float					ooff;
 
+	if (!ch->doppler) {
+		S_PaintChannelFromDecoded( ch, sc, count, sampleOffset, bufferOffset, SND_CHUNK_SIZE*2 );
+		return;
+	}
+
 	leftvol = ch->leftvol*snd_vol;
 	rightvol = ch->rightvol*snd_vol;
 
@@ -634,34 +886,20 @@ static void S_PaintChannelFromMuLaw( channel_t *ch, sfx_t *sc, int count, int sa
 		}
 	}
 
-	if (!ch->doppler) {
-		samples = (byte *)chunk->sndChunk + sampleOffset;
-		for ( i=0 ; i<count ; i++ ) {
-			data  = mulawToShort[*samples];
-			samp[i].left += (data * leftvol)>>8;
-			samp[i].right += (data * rightvol)>>8;
-			samples++;
-			if ( chunk != NULL && samples == (byte *)chunk->sndChunk+(SND_CHUNK_SIZE*2)) {
-				chunk = chunk->next;
-				samples = (byte *)chunk->sndChunk;
-			}
-		}
-	} else {
-		ooff = sampleOffset;
-		samples = (byte *)chunk->sndChunk;
-		for ( i=0 ; i<count ; i++ ) {
-			data  = mulawToShort[samples[(int)(ooff)]];
-			ooff = ooff + ch->dopplerScale;
-			samp[i].left += (data * leftvol)>>8;
-			samp[i].right += (data * rightvol)>>8;
-			if (ooff >= SND_CHUNK_SIZE*2) {
-				chunk = chunk->next;
-				if (!chunk) {
-					chunk = sc->soundData;
-				}
-				samples = (byte *)chunk->sndChunk;
-				ooff = 0.0;
+	ooff = sampleOffset;
+	samples = (byte *)chunk->sndChunk;
+	for ( i=0 ; i<count ; i++ ) {
+		data  = mulawToShort[samples[(int)(ooff)]];
+		ooff = ooff + ch->dopplerScale;
+		samp[i].left += (data * leftvol)>>8;
+		samp[i].right += (data * rightvol)>>8;
+		if (ooff >= SND_CHUNK_SIZE*2) {
+			chunk = chunk->next;
+			if (!chunk) {
+				chunk = sc->soundData;
 			}
+			samples = (byte *)chunk->sndChunk;
+			ooff = 0.0;
 		}
 	}
 }
@@ -681,8 +919,12 @@ void S_PaintChannels( int endtime ) {
 	sfx_t	*sc;
 	int		ltime, count;
 	int		sampleOffset;
+	int		mixed;
+	int64_t	start;
 	byte	*buffer;
 
+	start = Sys_Microseconds();
+
 	snd_vol = s_volume->value * 255;
 
 	if ( (!gw_active && !gw_minimized && s_muteWhenUnfocused->integer) || (gw_minimized && s_muteWhenMinimized->integer) ) {
@@ -726,6 +968,7 @@ void S_PaintChannels( int endtime ) {
 		}
 
 		// paint in the channels.
+		mixed = 0;
 		ch = s_channels;
 		for ( i = 0; i < MAX_CHANNELS ; i++, ch++ ) {
 			if ( !ch->thesfx || (!ch->leftvol && !ch->rightvol) ) {
@@ -755,6 +998,7 @@ void S_PaintChannels( int endtime ) {
 				} else {
 					S_PaintChannelFrom16		(ch, sc, count, sampleOffset, ltime - s_paintedtime);
 				}
+				mixed++;
 			}
 		}
 
@@ -771,6 +1015,7 @@ void S_PaintChannels( int endtime ) {
 			if (sc->soundData==NULL || sc->soundLength==0) {
 				continue;
 			}
+			mixed++;
 			// we might have to make two passes if it
 			// is a looping sound effect and the end of
 			// the sample is hit
@@ -797,8 +1042,12 @@ void S_PaintChannels( int endtime ) {
 			} while ( ltime - end < 0 );
 		}
 
+		S_CountMax( &s_counters.channels, mixed );
+
 		// transfer out according to DMA format
 		S_TransferPaintBuffer( end, buffer );
 		s_paintedtime = end;
 	}
+
+	Sys_AtomicAdd( &s_counters.paintUsec, (int)( Sys_Microseconds() - start ) );
 }
@@ -0,0 +1,472 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// snd_mix_simd.c -- inner loops of snd_mix.c and snd_mem.c, picked at init by CPU features
+
+#include "snd_local.h"
+
+/*
+
+SSE2 is always available on x86_64, AVX2 kernels are compiled for the
+target with function attributes and only used when the CPU has it.
+
+SSE2 has no 32-bit multiply so volumes are split as vol = hi * 256 + lo
+and (data * vol) >> 8 is computed as data * hi + ( ( data * lo ) >> 8 ),
+both products come from 16-bit multiplies and the sum is exactly what
+the scalar loop produces for any volume below 32768 * 256.
+
+*/
+
+/*
+=================
+S_PaintMono16C
+
+Adds count mono samples to interleaved left/right paint buffer pairs
+=================
+*/
+static void S_PaintMono16C( int *samp, const short *in, int count, int leftvol, int rightvol )
+{
+	int i, data;
+
+	for ( i = 0; i < count; i++, samp += 2 ) {
+		data = in[i];
+		samp[0] += (data * leftvol)>>8;
+		samp[1] += (data * rightvol)>>8;
+	}
+}
+
+
+/*
+=================
+S_PaintStereo16C
+
+Adds count interleaved stereo samples to the paint buffer
+=================
+*/
+static void S_PaintStereo16C( int *samp, const short *in, int count, int leftvol, int rightvol )
+{
+	int i;
+
+	for ( i = 0; i < count; i++, in += 2, samp += 2 ) {
+		samp[0] += (in[0] * leftvol)>>8;
+		samp[1] += (in[1] * rightvol)>>8;
+	}
+}
+
+
+/*
+=================
+S_TransferFloatC
+
+Clamps count paint buffer values and converts them to float output
+=================
+*/
+static void S_TransferFloatC( float *out, const int *in, int count )
+{
+	const float rdiv = 1.0f / (32768.0f * 256.0f - 128.0f); // 8388480.0f
+	int i, val;
+
+	for ( i = 0; i < count; i++ ) {
+		val = in[i];
+		if ( val > 0x7fff00 ) {
+			val = 0x7fff00;
+		} else if ( val < -32768 * 256 ) {
+			val = -32768 * 256;
+		}
+		out[i] = (float)(val + 128) * rdiv;
+	}
+}
+
+
+/*
+================
+S_ResampleChannelC
+
+Filters one channel, src holds RESAMPLE_TAPS/2 - 1 samples of padding
+in front of the first input sample, out advances stride samples at a time
+================
+*/
+static void S_ResampleChannelC( short *out, int stride, int outcount, const float *src, const float *coeffs, int inrate, int outrate )
+{
+	const float *c;
+	float	acc[4], sum;
+	int64_t	pos;
+	int		i, k, idx, phase, val;
+
+	for ( i = 0; i < outcount; i++, out += stride ) {
+		pos = (int64_t)i * inrate;
+		idx = pos / outrate;
+		phase = ( ( pos - (int64_t)idx * outrate ) * RESAMPLE_PHASES + outrate / 2 ) / outrate;
+		c = coeffs + phase * RESAMPLE_TAPS;
+
+		acc[0] = acc[1] = acc[2] = acc[3] = 0.0f;
+		for ( k = 0; k < RESAMPLE_TAPS; k++ ) {
+			acc[k&3] += src[idx+k] * c[k];
+		}
+		sum = ( acc[0] + acc[2] ) + ( acc[1] + acc[3] );
+
+		val = (int)floorf( sum + 0.5f );
+		if ( val > 32767 ) {
+			val = 32767;
+		} else if ( val < -32768 ) {
+			val = -32768;
+		}
+		*out = val;
+	}
+}
+
+
+#if idx64
+
+#include <emmintrin.h>
+
+/*
+=================
+S_MulVol
+
+32-bit products of eight samples and eight volume halves
+=================
+*/
+static ID_INLINE void S_MulVol( __m128i data, __m128i hi, __m128i lo, __m128i *out0, __m128i *out1 )
+{
+	__m128i ph, pl, a, b;
+
+	ph = _mm_mullo_epi16( data, hi );
+	pl = _mm_mulhi_epi16( data, hi );
+	a = _mm_unpacklo_epi16( ph, pl );
+	b = _mm_unpackhi_epi16( ph, pl );
+
+	ph = _mm_mullo_epi16( data, lo );
+	pl = _mm_mulhi_epi16( data, lo );
+	*out0 = _mm_add_epi32( a, _mm_srai_epi32( _mm_unpacklo_epi16( ph, pl ), 8 ) );
+	*out1 = _mm_add_epi32( b, _mm_srai_epi32( _mm_unpackhi_epi16( ph, pl ), 8 ) );
+}
+
+
+/*
+=================
+S_PaintMono16SSE2
+
+Adds count mono samples to interleaved left/right paint buffer pairs
+=================
+*/
+static void S_PaintMono16SSE2( int *samp, const short *in, int count, int leftvol, int rightvol )
+{
+	const __m128i hi = _mm_setr_epi16( leftvol >> 8, rightvol >> 8, leftvol >> 8, rightvol >> 8,
+		leftvol >> 8, rightvol >> 8, leftvol >> 8, rightvol >> 8 );
+	const __m128i lo = _mm_setr_epi16( leftvol & 255, rightvol & 255, leftvol & 255, rightvol & 255,
+		leftvol & 255, rightvol & 255, leftvol & 255, rightvol & 255 );
+	__m128i d, p0, p1, p2, p3;
+	int i, data;
+
+	for ( i = 0; i + 8 <= count; i += 8, in += 8, samp += 16 ) {
+		d = _mm_loadu_si128( (const __m128i *)in );
+
+		// every sample goes to both sides
+		S_MulVol( _mm_unpacklo_epi16( d, d ), hi, lo, &p0, &p1 );
+		S_MulVol( _mm_unpackhi_epi16( d, d ), hi, lo, &p2, &p3 );
+
+		_mm_storeu_si128( (__m128i *)( samp + 0 ), _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( samp + 0 ) ), p0 ) );
+		_mm_storeu_si128( (__m128i *)( samp + 4 ), _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( samp + 4 ) ), p1 ) );
+		_mm_storeu_si128( (__m128i *)( samp + 8 ), _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( samp + 8 ) ), p2 ) );
+		_mm_storeu_si128( (__m128i *)( samp + 12 ), _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( samp + 12 ) ), p3 ) );
+	}
+
+	for ( ; i < count; i++, in++, samp += 2 ) {
+		data = *in;
+		samp[0] += (data * leftvol)>>8;
+		samp[1] += (data * rightvol)>>8;
+	}
+}
+
+
+/*
+=================
+S_PaintStereo16SSE2
+
+Adds count interleaved stereo samples to the paint buffer
+=================
+*/
+static void S_PaintStereo16SSE2( int *samp, const short *in, int count, int leftvol, int rightvol )
+{
+	const __m128i hi = _mm_setr_epi16( leftvol >> 8, rightvol >> 8, leftvol >> 8, rightvol >> 8,
+		leftvol >> 8, rightvol >> 8, leftvol >> 8, rightvol >> 8 );
+	const __m128i lo = _mm_setr_epi16( leftvol & 255, rightvol & 255, leftvol & 255, rightvol & 255,
+		leftvol & 255, rightvol & 255, leftvol & 255, rightvol & 255 );
+	__m128i p0, p1;
+	int i;
+
+	for ( i = 0; i + 4 <= count; i += 4, in += 8, samp += 8 ) {
+		S_MulVol( _mm_loadu_si128( (const __m128i *)in ), hi, lo, &p0, &p1 );
+
+		_mm_storeu_si128( (__m128i *)( samp + 0 ), _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( samp + 0 ) ), p0 ) );
+		_mm_storeu_si128( (__m128i *)( samp + 4 ), _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( samp + 4 ) ), p1 ) );
+	}
+
+	for ( ; i < count; i++, in += 2, samp += 2 ) {
+		samp[0] += (in[0] * leftvol)>>8;
+		samp[1] += (in[1] * rightvol)>>8;
+	}
+}
+
+
+/*
+=================
+S_TransferFloatSSE2
+
+Clamps count paint buffer values and converts them to float output,
+the clamped range is exact in single precision
+=================
+*/
+static void S_TransferFloatSSE2( float *out, const int *in, int count )
+{
+	const float rdiv = 1.0f / (32768.0f * 256.0f - 128.0f); // 8388480.0f
+	const __m128i vmax = _mm_set1_epi32( 0x7fff00 );
+	const __m128i vmin = _mm_set1_epi32( -32768 * 256 );
+	const __m128i bias = _mm_set1_epi32( 128 );
+	const __m128 scale = _mm_set1_ps( rdiv );
+	__m128i v, m;
+	int i, val;
+
+	for ( i = 0; i + 4 <= count; i += 4 ) {
+		v = _mm_loadu_si128( (const __m128i *)( in + i ) );
+		m = _mm_cmpgt_epi32( v, vmax );
+		v = _mm_or_si128( _mm_andnot_si128( m, v ), _mm_and_si128( m, vmax ) );
+		m = _mm_cmplt_epi32( v, vmin );
+		v = _mm_or_si128( _mm_andnot_si128( m, v ), _mm_and_si128( m, vmin ) );
+		_mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( _mm_add_epi32( v, bias ) ), scale ) );
+	}
+
+	for ( ; i < count; i++ ) {
+		val = in[i];
+		if ( val > 0x7fff00 ) {
+			val = 0x7fff00;
+		} else if ( val < -32768 * 256 ) {
+			val = -32768 * 256;
+		}
+		out[i] = (float)(val + 128) * rdiv;
+	}
+}
+
+
+/*
+=================
+S_ResampleChannelSSE2
+
+Same as S_ResampleChannel, lanes accumulate every fourth tap
+and are summed in the order of the scalar loop
+=================
+*/
+static void S_ResampleChannelSSE2( short *out, int stride, int outcount, const float *src, const float *coeffs, int inrate, int outrate )
+{
+	const float *c;
+	__m128 acc;
+	float sum;
+	int64_t pos;
+	int i, k, idx, phase, val;
+
+	for ( i = 0; i < outcount; i++, out += stride ) {
+		pos = (int64_t)i * inrate;
+		idx = pos / outrate;
+		phase = ( ( pos - (int64_t)idx * outrate ) * RESAMPLE_PHASES + outrate / 2 ) / outrate;
+		c = coeffs + phase * RESAMPLE_TAPS;
+
+		acc = _mm_setzero_ps();
+		for ( k = 0; k < RESAMPLE_TAPS; k += 4 ) {
+			acc = _mm_add_ps( acc, _mm_mul_ps( _mm_loadu_ps( src + idx + k ), _mm_loadu_ps( c + k ) ) );
+		}
+		acc = _mm_add_ps( acc, _mm_movehl_ps( acc, acc ) );
+		sum = _mm_cvtss_f32( _mm_add_ss( acc, _mm_shuffle_ps( acc, acc, 1 ) ) );
+
+		val = (int)floorf( sum + 0.5f );
+		if ( val > 32767 ) {
+			val = 32767;
+		} else if ( val < -32768 ) {
+			val = -32768;
+		}
+		*out = val;
+	}
+}
+
+#if !defined (_MSC_VER) || _MSC_VER >= 1700
+#define USE_AVX2_MIX
+#endif
+
+#endif // idx64
+
+
+#ifdef USE_AVX2_MIX
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+=================
+S_MulVolAVX2
+
+Same as S_MulVol for sixteen samples, products come back in sample order
+=================
+*/
+static ID_INLINE TARGET_AVX2 void S_MulVolAVX2( __m256i data, __m256i hi, __m256i lo, __m256i *out0, __m256i *out1 )
+{
+	__m256i ph, pl, a, b;
+
+	ph = _mm256_mullo_epi16( data, hi );
+	pl = _mm256_mulhi_epi16( data, hi );
+	a = _mm256_unpacklo_epi16( ph, pl );
+	b = _mm256_unpackhi_epi16( ph, pl );
+
+	ph = _mm256_mullo_epi16( data, lo );
+	pl = _mm256_mulhi_epi16( data, lo );
+	a = _mm256_add_epi32( a, _mm256_srai_epi32( _mm256_unpacklo_epi16( ph, pl ), 8 ) );
+	b = _mm256_add_epi32( b, _mm256_srai_epi32( _mm256_unpackhi_epi16( ph, pl ), 8 ) );
+
+	// unpack works within 128-bit lanes
+	*out0 = _mm256_permute2x128_si256( a, b, 0x20 );
+	*out1 = _mm256_permute2x128_si256( a, b, 0x31 );
+}
+
+
+/*
+=================
+S_PaintMono16AVX2
+=================
+*/
+static TARGET_AVX2 void S_PaintMono16AVX2( int *samp, const short *in, int count, int leftvol, int rightvol )
+{
+	const __m256i hi = _mm256_set1_epi32( ( ( rightvol >> 8 ) << 16 ) | ( ( leftvol >> 8 ) & 0xFFFF ) );
+	const __m256i lo = _mm256_set1_epi32( ( ( rightvol & 255 ) << 16 ) | ( leftvol & 255 ) );
+	__m128i d;
+	__m256i dd, p0, p1;
+	int i;
+
+	for ( i = 0; i + 8 <= count; i += 8, in += 8, samp += 16 ) {
+		d = _mm_loadu_si128( (const __m128i *)in );
+
+		// every sample goes to both sides
+		dd = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( d, d ) ), _mm_unpackhi_epi16( d, d ), 1 );
+		S_MulVolAVX2( dd, hi, lo, &p0, &p1 );
+
+		_mm256_storeu_si256( (__m256i *)( samp + 0 ), _mm256_add_epi32( _mm256_loadu_si256( (const __m256i *)( samp + 0 ) ), p0 ) );
+		_mm256_storeu_si256( (__m256i *)( samp + 8 ), _mm256_add_epi32( _mm256_loadu_si256( (const __m256i *)( samp + 8 ) ), p1 ) );
+	}
+
+	S_PaintMono16C( samp, in, count - i, leftvol, rightvol );
+}
+
+
+/*
+=================
+S_PaintStereo16AVX2
+=================
+*/
+static TARGET_AVX2 void S_PaintStereo16AVX2( int *samp, const short *in, int count, int leftvol, int rightvol )
+{
+	const __m256i hi = _mm256_set1_epi32( ( ( rightvol >> 8 ) << 16 ) | ( ( leftvol >> 8 ) & 0xFFFF ) );
+	const __m256i lo = _mm256_set1_epi32( ( ( rightvol & 255 ) << 16 ) | ( leftvol & 255 ) );
+	__m256i p0, p1;
+	int i;
+
+	for ( i = 0; i + 8 <= count; i += 8, in += 16, samp += 16 ) {
+		S_MulVolAVX2( _mm256_loadu_si256( (const __m256i *)in ), hi, lo, &p0, &p1 );
+
+		_mm256_storeu_si256( (__m256i *)( samp + 0 ), _mm256_add_epi32( _mm256_loadu_si256( (const __m256i *)( samp + 0 ) ), p0 ) );
+		_mm256_storeu_si256( (__m256i *)( samp + 8 ), _mm256_add_epi32( _mm256_loadu_si256( (const __m256i *)( samp + 8 ) ), p1 ) );
+	}
+
+	S_PaintStereo16C( samp, in, count - i, leftvol, rightvol );
+}
+
+
+/*
+=================
+S_TransferFloatAVX2
+=================
+*/
+static TARGET_AVX2 void S_TransferFloatAVX2( float *out, const int *in, int count )
+{
+	const float rdiv = 1.0f / (32768.0f * 256.0f - 128.0f); // 8388480.0f
+	const __m256i vmax = _mm256_set1_epi32( 0x7fff00 );
+	const __m256i vmin = _mm256_set1_epi32( -32768 * 256 );
+	const __m256i bias = _mm256_set1_epi32( 128 );
+	const __m256 scale = _mm256_set1_ps( rdiv );
+	__m256i v;
+	int i;
+
+	for ( i = 0; i + 8 <= count; i += 8 ) {
+		v = _mm256_loadu_si256( (const __m256i *)( in + i ) );
+		v = _mm256_max_epi32( _mm256_min_epi32( v, vmax ), vmin );
+		_mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_add_epi32( v, bias ) ), scale ) );
+	}
+
+	S_TransferFloatC( out + i, in + i, count - i );
+}
+
+#endif // USE_AVX2_MIX
+
+
+sndKernels_t s_kernels = {
+	"C", S_PaintMono16C, S_PaintStereo16C, S_TransferFloatC, S_ResampleChannelC
+};
+
+
+/*
+=================
+S_InitKernels
+=================
+*/
+void S_InitKernels( void )
+{
+#if idx64
+	const int flags = Com_SIMDFlags();
+#endif
+
+	s_kernels.name = "C";
+	s_kernels.PaintMono16 = S_PaintMono16C;
+	s_kernels.PaintStereo16 = S_PaintStereo16C;
+	s_kernels.TransferFloat = S_TransferFloatC;
+	s_kernels.ResampleChannel = S_ResampleChannelC;
+
+#if idx64
+	if ( flags & CPU_SSE2 ) {
+		s_kernels.name = "SSE2";
+		s_kernels.PaintMono16 = S_PaintMono16SSE2;
+		s_kernels.PaintStereo16 = S_PaintStereo16SSE2;
+		s_kernels.TransferFloat = S_TransferFloatSSE2;
+		s_kernels.ResampleChannel = S_ResampleChannelSSE2;
+	}
+
+#ifdef USE_AVX2_MIX
+	// resampling stays SSE2, wider lanes would change the summation order
+	if ( flags & CPU_AVX2 ) {
+		s_kernels.name = "AVX2";
+		s_kernels.PaintMono16 = S_PaintMono16AVX2;
+		s_kernels.PaintStereo16 = S_PaintStereo16AVX2;
+		s_kernels.TransferFloat = S_TransferFloatAVX2;
+	}
+#endif
+#endif // idx64
+}
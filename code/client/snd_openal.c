@@ -454,7 +454,10 @@ void S_AL_BufferUse(sfxHandle_t sfx)
 		return;
 
 	if((!knownSfx[sfx].inMemory) && (!knownSfx[sfx].isDefault))
+	{
+		Sys_AtomicAdd( &s_counters.cacheMisses, 1 );
 		S_AL_BufferLoad(sfx, qtrue);
+	}
 	knownSfx[sfx].lastUsedTime = Sys_Milliseconds();
 }
 
@@ -573,6 +576,13 @@ typedef struct src_s
 	vec3_t		loopSpeakerPos;		// Origin of the loop speaker
 	
 	qboolean	local;			// Is this local (relative to the cam)
+
+	// last values sent to OpenAL, see S_AL_SrcSetPosition
+	vec3_t		alPosition;
+	vec3_t		alVelocity;
+	float		alRolloff;
+	float		alRefDistance;
+	qboolean	alRelative;
 } src_t;
 
 #ifdef __APPLE__
@@ -583,6 +593,8 @@ typedef struct src_s
 static src_t srcList[MAX_SRC];
 static int srcCount = 0;
 static int srcActiveCnt = 0;
+static srcHandle_t srcFreeList[MAX_SRC];	// inactive sources, see S_AL_SrcAlloc
+static int srcFreeCount = 0;
 static qboolean alSourcesInitialised = qfalse;
 static int lastListenerNumber = -1;
 static vec3_t lastListenerOrigin = { 0.0f, 0.0f, 0.0f };
@@ -673,6 +685,76 @@ static void S_AL_ScaleGain(src_t *chksrc, vec3_t origin)
 	}
 }
 
+/*
+=================
+S_AL_SrcSetPosition
+
+Source parameters are cached in src_t and only sent to OpenAL when they
+change, most sources are refreshed with the same values every frame.
+Locked sources are set up directly and must not use these.
+=================
+*/
+static void S_AL_SrcSetPosition(src_t *src, const vec3_t origin)
+{
+	if(!VectorCompare(src->alPosition, origin))
+	{
+		VectorCopy(origin, src->alPosition);
+		qalSourcefv(src->alSource, AL_POSITION, src->alPosition);
+	}
+}
+
+/*
+=================
+S_AL_SrcSetVelocity
+=================
+*/
+static void S_AL_SrcSetVelocity(src_t *src, const vec3_t velocity)
+{
+	if(!VectorCompare(src->alVelocity, velocity))
+	{
+		VectorCopy(velocity, src->alVelocity);
+		qalSourcefv(src->alSource, AL_VELOCITY, src->alVelocity);
+	}
+}
+
+/*
+=================
+S_AL_SrcSetLocal
+
+Relative sources are not attenuated, the others follow s_alRolloff
+=================
+*/
+static void S_AL_SrcSetLocal(src_t *src, qboolean local)
+{
+	float rolloff = local ? 0.0f : s_alRolloff->value;
+
+	if(src->alRelative != local)
+	{
+		src->alRelative = local;
+		qalSourcei(src->alSource, AL_SOURCE_RELATIVE, local ? AL_TRUE : AL_FALSE);
+	}
+
+	if(src->alRolloff != rolloff)
+	{
+		src->alRolloff = rolloff;
+		qalSourcef(src->alSource, AL_ROLLOFF_FACTOR, rolloff);
+	}
+}
+
+/*
+=================
+S_AL_SrcSetRefDistance
+=================
+*/
+static void S_AL_SrcSetRefDistance(src_t *src)
+{
+	if(src->alRefDistance != s_alMinDistance->value)
+	{
+		src->alRefDistance = s_alMinDistance->value;
+		qalSourcef(src->alSource, AL_REFERENCE_DISTANCE, src->alRefDistance);
+	}
+}
+
 /*
 =================
 S_AL_HearingThroughEntity
@@ -720,6 +802,7 @@ qboolean S_AL_SrcInit( void )
 	memset(srcList, 0, sizeof(srcList));
 	srcCount = 0;
 	srcActiveCnt = 0;
+	srcFreeCount = 0;
 
 	// Cap s_alSources to MAX_SRC
 	limit = s_alSources->integer;
@@ -738,6 +821,10 @@ qboolean S_AL_SrcInit( void )
 		srcCount++;
 	}
 
+	// Lowest sources are handed out first
+	for(i = srcCount - 1; i >= 0; i--)
+		srcFreeList[srcFreeCount++] = i;
+
 	// All done. Print this for informational purposes
 	Com_Printf( "Allocated %d sources.\n", srcCount);
 	alSourcesInitialised = qtrue;
@@ -774,6 +861,7 @@ void S_AL_SrcShutdown( void )
 	}
 
 	memset(srcList, 0, sizeof(srcList));
+	srcFreeCount = 0;
 
 	alSourcesInitialised = qfalse;
 }
@@ -815,21 +903,21 @@ static void S_AL_SrcSetup(srcHandle_t src, sfxHandle_t sfx, alSrcPriority_t prio
 
 	qalSourcef(curSource->alSource, AL_PITCH, 1.0f);
 	S_AL_Gain(curSource->alSource, curSource->curGain);
-	qalSourcefv(curSource->alSource, AL_POSITION, vec3_origin);
-	qalSourcefv(curSource->alSource, AL_VELOCITY, vec3_origin);
 	qalSourcei(curSource->alSource, AL_LOOPING, AL_FALSE);
-	qalSourcef(curSource->alSource, AL_REFERENCE_DISTANCE, s_alMinDistance->value);
 
-	if(local)
-	{
-		qalSourcei(curSource->alSource, AL_SOURCE_RELATIVE, AL_TRUE);
-		qalSourcef(curSource->alSource, AL_ROLLOFF_FACTOR, 0.0f);
-	}
-	else
-	{
-		qalSourcei(curSource->alSource, AL_SOURCE_RELATIVE, AL_FALSE);
-		qalSourcef(curSource->alSource, AL_ROLLOFF_FACTOR, s_alRolloff->value);
-	}
+	// The source may have been set up directly while it was locked,
+	// so send everything once and restart the cache from these values
+	VectorClear(curSource->alPosition);
+	VectorClear(curSource->alVelocity);
+	curSource->alRefDistance = s_alMinDistance->value;
+	curSource->alRelative = local;
+	curSource->alRolloff = local ? 0.0f : s_alRolloff->value;
+
+	qalSourcefv(curSource->alSource, AL_POSITION, curSource->alPosition);
+	qalSourcefv(curSource->alSource, AL_VELOCITY, curSource->alVelocity);
+	qalSourcef(curSource->alSource, AL_REFERENCE_DISTANCE, curSource->alRefDistance);
+	qalSourcei(curSource->alSource, AL_SOURCE_RELATIVE, local ? AL_TRUE : AL_FALSE);
+	qalSourcef(curSource->alSource, AL_ROLLOFF_FACTOR, curSource->alRolloff);
 }
 
 /*
@@ -1006,6 +1094,7 @@ static void S_AL_SrcKill(srcHandle_t src)
 	{
 		curSource->isActive = qfalse;
 		srcActiveCnt--;
+		srcFreeList[srcFreeCount++] = src;
 	}
 	curSource->isLocked = qfalse;
 	curSource->isTracking = qfalse;
@@ -1015,13 +1104,16 @@ static void S_AL_SrcKill(srcHandle_t src)
 /*
 =================
 S_AL_SrcAlloc
+
+Inactive sources are kept on srcFreeList, only when it runs empty
+are the active ones searched for the weakest to take over
 =================
 */
 static
 srcHandle_t S_AL_SrcAlloc( alSrcPriority_t priority, int entnum, int channel )
 {
 	int i;
-	int empty = -1;
+	srcHandle_t empty;
 	int weakest = -1;
 	int weakest_time = Sys_Milliseconds();
 	int weakest_pri = 999;
@@ -1030,7 +1122,7 @@ srcHandle_t S_AL_SrcAlloc( alSrcPriority_t priority, int entnum, int channel )
 	int weakest_numloops = 0;
 	src_t *curSource;
 
-	for(i = 0; i < srcCount; i++)
+	for(i = 0; i < srcCount && !srcFreeCount; i++)
 	{
 		curSource = &srcList[i];
 		
@@ -1038,13 +1130,6 @@ srcHandle_t S_AL_SrcAlloc( alSrcPriority_t priority, int entnum, int channel )
 		if(curSource->isLocked)
 			continue;
 
-		// Is it empty or not?
-		if(!curSource->isActive)
-		{
-			empty = i;
-			break;
-		}
-
 		if(curSource->isPlaying)
 		{
 			if(weakest_isplaying && curSource->priority < priority &&
@@ -1091,15 +1176,18 @@ srcHandle_t S_AL_SrcAlloc( alSrcPriority_t priority, int entnum, int channel )
 #endif
 	}
 
-	if(empty == -1)
-		empty = weakest;
-	
-	if(empty >= 0)
-	{
-		S_AL_SrcKill(empty);
-		srcList[empty].isActive = qtrue;
-		srcActiveCnt++;
-	}
+	// Killing the weakest source puts it on the free list
+	if(!srcFreeCount && weakest >= 0)
+		S_AL_SrcKill(weakest);
+
+	if(!srcFreeCount)
+		return -1;
+
+	empty = srcFreeList[--srcFreeCount];
+
+	S_AL_SrcKill(empty);
+	srcList[empty].isActive = qtrue;
+	srcActiveCnt++;
 
 	return empty;
 }
@@ -1277,7 +1365,7 @@ static void S_AL_StartSound( const vec3_t origin, int entnum, int entchannel, sf
 	if(!origin)
 		curSource->isTracking = qtrue;
 		
-	qalSourcefv(curSource->alSource, AL_POSITION, sorigin );
+	S_AL_SrcSetPosition(curSource, sorigin);
 	S_AL_ScaleGain(curSource, sorigin);
 
 	// Start it playing
@@ -1366,8 +1454,8 @@ static void S_AL_SrcLoop( alSrcPriority_t priority, sfxHandle_t sfx,
 
 		VectorClear(sorigin);
 
-		qalSourcefv(curSource->alSource, AL_POSITION, sorigin);
-		qalSourcefv(curSource->alSource, AL_VELOCITY, vec3_origin);
+		S_AL_SrcSetPosition(curSource, sorigin);
+		S_AL_SrcSetVelocity(curSource, vec3_origin);
 	}
 	else
 	{
@@ -1390,8 +1478,8 @@ static void S_AL_SrcLoop( alSrcPriority_t priority, sfxHandle_t sfx,
 		else
 			VectorClear(svelocity);
 
-		qalSourcefv(curSource->alSource, AL_POSITION, (ALfloat *) sorigin);
-		qalSourcefv(curSource->alSource, AL_VELOCITY, (ALfloat *) svelocity);
+		S_AL_SrcSetPosition(curSource, sorigin);
+		S_AL_SrcSetVelocity(curSource, svelocity);
 	}
 }
 
@@ -1457,9 +1545,9 @@ void S_AL_SrcUpdate( void )
 		if((s_alGain->modified) || (s_volume->modified))
 			curSource->curGain = s_alGain->value * s_volume->value;
 		if((s_alRolloff->modified) && (!curSource->local))
-			qalSourcef(curSource->alSource, AL_ROLLOFF_FACTOR, s_alRolloff->value);
+			S_AL_SrcSetLocal(curSource, qfalse);
 		if(s_alMinDistance->modified)
-			qalSourcef(curSource->alSource, AL_REFERENCE_DISTANCE, s_alMinDistance->value);
+			S_AL_SrcSetRefDistance(curSource);
 
 		if(curSource->isLooping)
 		{
@@ -1577,16 +1665,7 @@ void S_AL_SrcUpdate( void )
 				}
 
 				// Update locality
-				if(curSource->local)
-				{
-					qalSourcei(curSource->alSource, AL_SOURCE_RELATIVE, AL_TRUE);
-					qalSourcef(curSource->alSource, AL_ROLLOFF_FACTOR, 0.0f);
-				}
-				else
-				{
-					qalSourcei(curSource->alSource, AL_SOURCE_RELATIVE, AL_FALSE);
-					qalSourcef(curSource->alSource, AL_ROLLOFF_FACTOR, s_alRolloff->value);
-				}
+				S_AL_SrcSetLocal(curSource, curSource->local);
 				
 			}
 			else if(curSource->priority == SRCPRI_AMBIENT)
@@ -1616,13 +1695,10 @@ void S_AL_SrcUpdate( void )
         		}
                 }
 
-		// Query relativity of source, don't move if it's true
-		qalGetSourcei(curSource->alSource, AL_SOURCE_RELATIVE, &state);
-
-		// See if it needs to be moved
-		if(curSource->isTracking && !state)
+		// See if it needs to be moved, relative sources stay put
+		if(curSource->isTracking && !curSource->alRelative)
 		{
-			qalSourcefv(curSource->alSource, AL_POSITION, entityList[entityNum].origin);
+			S_AL_SrcSetPosition(curSource, entityList[entityNum].origin);
  			S_AL_ScaleGain(curSource, entityList[entityNum].origin);
 		}
 	}
@@ -1866,6 +1942,10 @@ void S_AL_StreamUpdate( int stream )
 	qalGetSourcei(streamSources[stream], AL_SOURCE_STATE, &state);
 	if(state == AL_STOPPED)
 	{
+		// stopped with queued data means the queue ran dry in between
+		if( streamPlaying[stream] && numBuffers )
+			Sys_AtomicAdd( &s_counters.underruns, 1 );
+
 		streamPlaying[stream] = qfalse;
 
 		// If there are no buffers queued up, release the streamSource
@@ -1960,6 +2040,22 @@ static void S_AL_MusicSourceFree( void )
 	musicSourceHandle = -1;
 }
 
+/*
+=================
+S_AL_OpenMusicStream
+=================
+*/
+static snd_stream_t *S_AL_OpenMusicStream( const char *filename )
+{
+	snd_stream_t *stream;
+
+	stream = S_CodecOpenStream( filename );
+	if ( stream && s_streamThread->integer )
+		S_CodecStartDecoder( stream );
+
+	return stream;
+}
+
 /*
 =================
 S_AL_CloseMusicFiles
@@ -2044,7 +2140,7 @@ void S_AL_MusicProcess(ALuint b)
 		if(intro_stream)
 			intro_stream = NULL;
 		else
-			mus_stream = S_CodecOpenStream(s_backgroundLoop);
+			mus_stream = S_AL_OpenMusicStream(s_backgroundLoop);
 		
 		curstream = mus_stream;
 
@@ -2117,12 +2213,12 @@ void S_AL_StartBackgroundTrack( const char *intro, const char *loop )
 	{
 		// Open the intro and don't mind whether it succeeds.
 		// The important part is the loop.
-		intro_stream = S_CodecOpenStream(intro);
+		intro_stream = S_AL_OpenMusicStream(intro);
 	}
 	else
 		intro_stream = NULL;
 
-	mus_stream = S_CodecOpenStream(s_backgroundLoop);
+	mus_stream = S_AL_OpenMusicStream(s_backgroundLoop);
 	if(!mus_stream)
 	{
 		S_AL_CloseMusicFiles();
@@ -2161,11 +2257,21 @@ void S_AL_MusicUpdate( void )
 {
 	int		numBuffers;
 	ALint	state;
+	snd_stream_t *curstream;
 
 	if(!musicPlaying)
 		return;
 
 	qalGetSourcei( musicSource, AL_BUFFERS_PROCESSED, &numBuffers );
+
+	// queued music that was not played yet
+	curstream = intro_stream ? intro_stream : mus_stream;
+	if(curstream && curstream->info.rate > 0)
+	{
+		S_CountMin(&s_counters.mixAhead, (NUM_MUSIC_BUFFERS - numBuffers) * MUSIC_BUFFER_SIZE * 1000 /
+			(curstream->info.rate * curstream->info.width * curstream->info.channels));
+	}
+
 	while( numBuffers-- )
 	{
 		ALuint b;
@@ -2182,6 +2288,7 @@ void S_AL_MusicUpdate( void )
 	if( state == AL_STOPPED && numBuffers )
 	{
 		Com_DPrintf( S_COLOR_YELLOW "Restarted OpenAL music\n" );
+		Sys_AtomicAdd( &s_counters.underruns, 1 );
 		qalSourcePlay(musicSource);
 	}
 
@@ -2202,6 +2309,11 @@ static ALCdevice *alCaptureDevice;
 static cvar_t *s_alCapture;
 #endif
 
+// AL_SOFT_deferred_updates
+typedef void (AL_APIENTRY *alDeferUpdatesProc_t)( void );
+static alDeferUpdatesProc_t qalDeferUpdatesSOFT;
+static alDeferUpdatesProc_t qalProcessUpdatesSOFT;
+
 #if defined(_WIN64)
 #define ALDRIVER_DEFAULT "OpenAL64.dll"
 #elif defined(_WIN32)
@@ -2259,6 +2371,35 @@ void S_AL_Respatialize( int entityNum, const vec3_t origin, vec3_t axis[3], int
 	qalListenerfv(AL_ORIENTATION, orientation);
 }
 
+/*
+=================
+S_AL_BeginUpdates
+
+Source changes made by S_AL_Update are applied together at
+S_AL_EndUpdates instead of one by one as they are made
+=================
+*/
+static void S_AL_BeginUpdates( void )
+{
+	if(qalDeferUpdatesSOFT)
+		qalDeferUpdatesSOFT();
+	else
+		qalcSuspendContext(alContext);
+}
+
+/*
+=================
+S_AL_EndUpdates
+=================
+*/
+static void S_AL_EndUpdates( void )
+{
+	if(qalProcessUpdatesSOFT)
+		qalProcessUpdatesSOFT();
+	else
+		qalcProcessContext(alContext);
+}
+
 /*
 =================
 S_AL_Update
@@ -2268,6 +2409,11 @@ static
 void S_AL_Update( void )
 {
 	int i;
+	int64_t start;
+
+	start = Sys_Microseconds();
+
+	S_AL_BeginUpdates();
 
 	if(s_muted->modified)
 	{
@@ -2317,6 +2463,11 @@ void S_AL_Update( void )
 	s_musicVolume->modified = qfalse;
 	s_alMinDistance->modified = qfalse;
 	s_alRolloff->modified = qfalse;
+
+	S_AL_EndUpdates();
+
+	S_CountMax( &s_counters.channels, srcActiveCnt );
+	Sys_AtomicAdd( &s_counters.paintUsec, (int)( Sys_Microseconds() - start ) );
 }
 
 /*
@@ -2455,6 +2606,9 @@ void S_AL_Shutdown( void )
 	qalcDestroyContext(alContext);
 	qalcCloseDevice(alDevice);
 
+	qalDeferUpdatesSOFT = NULL;
+	qalProcessUpdatesSOFT = NULL;
+
 #ifdef USE_VOIP
 	if (alCaptureDevice != NULL) {
 		qalcCaptureStop(alCaptureDevice);
@@ -2614,6 +2768,14 @@ qboolean S_AL_Init( soundInterface_t *si )
 	}
 	qalcMakeContextCurrent( alContext );
 
+	if(qalIsExtensionPresent("AL_SOFT_deferred_updates"))
+	{
+		qalDeferUpdatesSOFT = (alDeferUpdatesProc_t)qalGetProcAddress("alDeferUpdatesSOFT");
+		qalProcessUpdatesSOFT = (alDeferUpdatesProc_t)qalGetProcAddress("alProcessUpdatesSOFT");
+		if(!qalDeferUpdatesSOFT || !qalProcessUpdatesSOFT)
+			qalDeferUpdatesSOFT = qalProcessUpdatesSOFT = NULL;
+	}
+
 	// Initialize sources, buffers, music
 	S_AL_BufferInit( );
 	S_AL_SrcInit( );
@@ -52,6 +52,25 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 //===============================================================
 
+// single trace for G_TRACE_BATCH, results are written in request order
+typedef struct {
+	vec3_t		start;
+	vec3_t		mins;
+	vec3_t		maxs;
+	vec3_t		end;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;		// qtrue for G_TRACECAPSULE behavior
+} traceRequest_t;
+
+#define	MAX_TRACE_BATCH		1024
+
+// maximum number of goals, points or predictions in G_AAS_AREA_TRAVEL_TIMES,
+// G_AAS_POINT_AREA_NUMS and G_AAS_PREDICT_CLIENT_MOVEMENTS
+#define	MAX_AAS_BATCH		1024
+
+//===============================================================
+
 
 typedef struct {
 	entityState_t	s;				// communicated by server to clients
@@ -397,6 +416,27 @@ typedef enum {
 	BOTLIB_PC_SOURCE_FILE_AND_LINE,
 
 	// engine extensions
+	G_TRACE_BATCH,		// ( const traceRequest_t *requests, trace_t *results, int count );
+	// same as calling G_TRACE/G_TRACECAPSULE for each request, query with trap_GetValue( "trap_TraceBatch_Q3E" )
+
+	G_BOT_THINK_PARALLEL,	// ( const int *clientNums, int count, int time );
+	// calls vmMain( BOTAI_THINK_PARALLEL, clientNum, time ) for each client on worker threads and
+	// returns when all of them finished, returns qfalse if nothing was called so the caller should
+	// run the same code serially, query with trap_GetValue( "trap_BotThinkParallel_Q3E" )
+
+	G_AAS_AREA_TRAVEL_TIMES,	// ( int areanum, vec3_t origin, int *goalareanums, int numgoals, int travelflags, int *traveltimes );
+	// same as calling BOTLIB_AAS_AREA_TRAVEL_TIME_TO_GOAL_AREA for each goal area, returns the number
+	// of reachable goals, query with trap_GetValue( "trap_AAS_AreaTravelTimes_Q3E" )
+
+	G_AAS_POINT_AREA_NUMS,		// ( vec3_t *points, int numpoints, int *areanums );
+	// same as calling BOTLIB_AAS_POINT_AREA_NUM for each point, returns the number of points that
+	// are not in solid, query with trap_GetValue( "trap_AAS_PointAreaNums_Q3E" )
+
+	G_AAS_PREDICT_CLIENT_MOVEMENTS,	// ( aas_clientpredict_t *predictions, int count );
+	// same as calling BOTLIB_AAS_PREDICT_CLIENT_MOVEMENT for each prediction without visualization,
+	// spread over job threads, returns the number of predictions that succeeded,
+	// query with trap_GetValue( "trap_AAS_PredictClientMovements_Q3E" )
+
 	G_TRAP_GETVALUE = COM_TRAP_GETVALUE
 
 } gameImport_t;
@@ -437,6 +477,13 @@ typedef enum {
 
 	BOTAI_START_FRAME,				// ( int time );
 
+	BOTAI_THINK_PARALLEL,			// ( int clientNum, int time );
+	// called by G_BOT_THINK_PARALLEL on a worker thread with its own vm stack, other clients are
+	// thinking at the same time with the same data segment so it may only read shared game state
+	// and write to data of this client; only traces, point contents, pvs checks, botlib calls which
+	// don't execute commands or load files, and math calls are allowed, anything else drops the
+	// game; changes to the world must be applied after G_BOT_THINK_PARALLEL returns
+
 	GAME_EXPORT_LAST
 } gameExport_t;
 
@@ -60,6 +60,13 @@ static byte *cmod_base;
 
 #ifndef BSPC
 cvar_t		*cm_noAreas;
+cvar_t		*cm_flatTree;
+cvar_t		*cm_incrementalFlood;
+cvar_t		*cm_patchCache;
+cvar_t		*cm_residentMaps;
+#ifdef CM_SIMD_PLANES
+cvar_t		*cm_simd;
+#endif
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
 #endif
@@ -74,6 +81,238 @@ static void	CM_InitBoxHull (void);
 void	CM_FloodAreaConnections (void);
 
 
+#ifndef BSPC
+/*
+===============================================================================
+
+					RESIDENT MAPS
+
+Collision data of the last cm_residentMaps loaded maps is kept in memory
+blocks outside of the hunk, so Hunk_Clear() on map change doesn't wipe it.
+A map that is loaded again with the same checksum and load options is
+restored from there instead of parsing the bsp.
+
+===============================================================================
+*/
+
+#define	MAX_RESIDENT_MAPS		8
+#define	RESIDENT_BLOCK_SIZE		( 4 * 1024 * 1024 )
+
+typedef struct residentBlock_s {
+	struct residentBlock_s *next;
+	byte		*data;
+	int			size;
+	int			used;
+} residentBlock_t;
+
+typedef struct {
+	char		name[MAX_QPATH];
+	unsigned int checksum;
+	int			flags;			// load options the data was built with
+	int			lastUsed;
+	qboolean	complete;
+	int			totalSize;
+	residentBlock_t	*blocks;
+	clipMap_t	cm;
+} residentMap_t;
+
+static residentMap_t	residentMaps[ MAX_RESIDENT_MAPS ];
+static residentMap_t	*residentLoad;		// receives CM_Alloc() while loading
+static residentMap_t	*residentActive;	// owns the data referenced by cm
+static int				residentSequence;
+
+
+/*
+=================
+CM_ResidentFlags
+=================
+*/
+static int CM_ResidentFlags( void ) {
+	int flags;
+
+	flags = cm_flatTree->integer ? 1 : 0;
+#ifdef CM_SIMD_PLANES
+	if ( cm_simd->integer ) {
+		flags |= 2;
+	}
+#endif
+	return flags;
+}
+
+
+/*
+=================
+CM_ResidentAlloc
+=================
+*/
+static void *CM_ResidentAlloc( residentMap_t *rm, int size ) {
+	residentBlock_t *block;
+	byte *buf;
+	int blockSize;
+
+	// round to cacheline, same as hunk
+	size = PAD( size, 64 );
+
+	block = rm->blocks;
+	if ( !block || block->used + size > block->size ) {
+		blockSize = MAX( size, RESIDENT_BLOCK_SIZE );
+		block = malloc( sizeof( *block ) + 64 + blockSize );
+		if ( !block ) {
+			Com_Error( ERR_DROP, "%s: failed on %i", __func__, size );
+		}
+		block->data = PADP( block + 1, 64 );
+		block->size = blockSize;
+		block->used = 0;
+		if ( rm->blocks && size >= RESIDENT_BLOCK_SIZE / 4 ) {
+			// keep filling the current block with small allocations
+			block->next = rm->blocks->next;
+			rm->blocks->next = block;
+		} else {
+			block->next = rm->blocks;
+			rm->blocks = block;
+		}
+	}
+
+	buf = block->data + block->used;
+	block->used += size;
+	rm->totalSize += size;
+
+	Com_Memset( buf, 0, size );
+
+	return buf;
+}
+
+
+/*
+=================
+CM_FreeResidentMap
+=================
+*/
+static void CM_FreeResidentMap( residentMap_t *rm ) {
+	residentBlock_t *block, *next;
+
+	for ( block = rm->blocks; block; block = next ) {
+		next = block->next;
+		free( block );
+	}
+
+	Com_Memset( rm, 0, sizeof( *rm ) );
+}
+
+
+/*
+=================
+CM_NewResidentMap
+
+Evicts least recently used maps to stay within cm_residentMaps,
+returns NULL if resident maps are disabled
+=================
+*/
+static residentMap_t *CM_NewResidentMap( const char *name, unsigned int checksum, int flags ) {
+	residentMap_t *rm, *oldest;
+	int i, count;
+
+	for ( ;; ) {
+		count = 0;
+		oldest = NULL;
+		for ( i = 0, rm = residentMaps; i < MAX_RESIDENT_MAPS; i++, rm++ ) {
+			if ( !rm->complete ) {
+				continue;
+			}
+			// same map with other contents or options won't be found again
+			if ( !strcmp( rm->name, name ) ) {
+				CM_FreeResidentMap( rm );
+				continue;
+			}
+			if ( !oldest || rm->lastUsed < oldest->lastUsed ) {
+				oldest = rm;
+			}
+			count++;
+		}
+		if ( count < cm_residentMaps->integer ) {
+			break;
+		}
+		if ( !oldest ) {
+			return NULL;
+		}
+		Com_DPrintf( "%s: releasing %s\n", __func__, oldest->name );
+		CM_FreeResidentMap( oldest );
+	}
+
+	for ( i = 0, rm = residentMaps; i < MAX_RESIDENT_MAPS; i++, rm++ ) {
+		if ( !rm->complete ) {
+			break;
+		}
+	}
+
+	Q_strncpyz( rm->name, name, sizeof( rm->name ) );
+	rm->checksum = checksum;
+	rm->flags = flags;
+
+	return rm;
+}
+
+
+/*
+=================
+CM_RestoreResidentMap
+=================
+*/
+static qboolean CM_RestoreResidentMap( const char *name, unsigned int checksum, int flags ) {
+	residentMap_t *rm;
+	int i;
+
+	if ( !cm_residentMaps->integer ) {
+		return qfalse;
+	}
+
+	for ( i = 0, rm = residentMaps; i < MAX_RESIDENT_MAPS; i++, rm++ ) {
+		if ( rm->complete && rm->checksum == checksum && rm->flags == flags && !strcmp( rm->name, name ) ) {
+			break;
+		}
+	}
+
+	if ( i == MAX_RESIDENT_MAPS ) {
+		return qfalse;
+	}
+
+	Com_DPrintf( "%s: %s, %i KB\n", __func__, name, rm->totalSize / 1024 );
+
+	cm = rm->cm;
+	cm.name[0] = '\0';
+
+	rm->lastUsed = ++residentSequence;
+	residentActive = rm;
+
+	// portal states are left from the previous visit, start like a fresh load
+	Com_Memset( cm.areaPortals, 0, cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ) );
+
+	CM_InitBoxHull();
+
+	CM_FloodAreaConnections();
+
+	return qtrue;
+}
+#endif
+
+
+/*
+=================
+CM_Alloc
+
+Allocations for collision data go to the resident map being loaded, if any
+=================
+*/
+void *CM_Alloc( int size ) {
+#ifndef BSPC
+	if ( residentLoad ) {
+		return CM_ResidentAlloc( residentLoad, size );
+	}
+#endif
+	return Hunk_Alloc( size, h_high );
+}
+
+
 /*
 ===============================================================================
 
@@ -100,7 +339,7 @@ static void CMod_LoadShaders( const lump_t *l ) {
 	if ( count < 1 )
 		Com_Error (ERR_DROP, "%s: map with no shaders", __func__ );
 
-	cm.shaders = Hunk_Alloc( count * sizeof( *cm.shaders ), h_high );
+	cm.shaders = CM_Alloc( count * sizeof( *cm.shaders ) );
 	cm.numShaders = count;
 
 	Com_Memcpy( cm.shaders, in, count * sizeof( *cm.shaders ) );
@@ -132,7 +371,7 @@ static void CMod_LoadSubmodels( const lump_t *l ) {
 	if ( count < 1 )
 		Com_Error( ERR_DROP, "%s: map with no models", __func__ );
 
-	cm.cmodels = Hunk_Alloc( count * sizeof( *cm.cmodels ), h_high );
+	cm.cmodels = CM_Alloc( count * sizeof( *cm.cmodels ) );
 	cm.numSubModels = count;
 
 	if ( count > MAX_SUBMODELS )
@@ -154,14 +393,14 @@ static void CMod_LoadSubmodels( const lump_t *l ) {
 
 		// make a "leaf" just to hold the model's brushes and surfaces
 		out->leaf.numLeafBrushes = LittleLong( in->numBrushes );
-		indexes = Hunk_Alloc( out->leaf.numLeafBrushes * 4, h_high );
+		indexes = CM_Alloc( out->leaf.numLeafBrushes * 4 );
 		out->leaf.firstLeafBrush = indexes - cm.leafbrushes;
 		for ( j = 0 ; j < out->leaf.numLeafBrushes ; j++ ) {
 			indexes[j] = LittleLong( in->firstBrush ) + j;
 		}
 
 		out->leaf.numLeafSurfaces = LittleLong( in->numSurfaces );
-		indexes = Hunk_Alloc( out->leaf.numLeafSurfaces * 4, h_high );
+		indexes = CM_Alloc( out->leaf.numLeafSurfaces * 4 );
 		out->leaf.firstLeafSurface = indexes - cm.leafsurfaces;
 		for ( j = 0 ; j < out->leaf.numLeafSurfaces ; j++ ) {
 			indexes[j] = LittleLong( in->firstSurface ) + j;
@@ -190,7 +429,7 @@ static void CMod_LoadNodes( const lump_t *l ) {
 	if ( count < 1 )
 		Com_Error( ERR_DROP, "%s: map has no nodes", __func__ );
 
-	cm.nodes = Hunk_Alloc( count * sizeof( *cm.nodes ), h_high );
+	cm.nodes = CM_Alloc( count * sizeof( *cm.nodes ) );
 	cm.numNodes = count;
 
 	out = cm.nodes;
@@ -207,6 +446,82 @@ static void CMod_LoadNodes( const lump_t *l ) {
 
 }
 
+#ifndef BSPC
+#define MAX_FLAT_DEPTH 1024
+
+/*
+=================
+CMod_FlattenNode_r
+=================
+*/
+static int CMod_FlattenNode_r( int num, int depth, int *remap, int *count ) {
+	const cNode_t *node;
+	cFlatNode_t *out;
+	int i, index;
+
+	if ( num < 0 ) {
+		return num;		// leaf
+	}
+
+	if ( num >= cm.numNodes || depth > MAX_FLAT_DEPTH ) {
+		return INT_MIN;
+	}
+
+	if ( remap[ num ] != -1 ) {
+		return remap[ num ];
+	}
+
+	node = &cm.nodes[ num ];
+	index = (*count)++;
+	remap[ num ] = index;
+
+	out = &cm.flatNodes[ index ];
+	VectorCopy( node->plane->normal, out->normal );
+	out->dist = node->plane->dist;
+	out->type = node->plane->type;
+
+	for ( i = 0; i < 2; i++ ) {
+		out->children[i] = CMod_FlattenNode_r( node->children[i], depth + 1, remap, count );
+		if ( out->children[i] == INT_MIN ) {
+			return INT_MIN;
+		}
+	}
+
+	return index;
+}
+
+
+/*
+=================
+CMod_BuildFlatNodes
+
+Makes a copy of the node tree in depth-first order so both children
+subtrees of the node are stored next to it, with planes packed in
+to avoid extra pointer chasing during traces
+=================
+*/
+static void CMod_BuildFlatNodes( void ) {
+	int *remap;
+	int i, count;
+
+	remap = Z_Malloc( cm.numNodes * sizeof( remap[0] ) );
+	for ( i = 0; i < cm.numNodes; i++ ) {
+		remap[i] = -1;
+	}
+
+	cm.flatNodes = CM_Alloc( cm.numNodes * sizeof( cm.flatNodes[0] ) );
+
+	count = 0;
+	if ( CMod_FlattenNode_r( 0, 0, remap, &count ) == INT_MIN ) {
+		Com_DPrintf( S_COLOR_YELLOW "%s: bad node tree, using original layout\n", __func__ );
+		cm.flatNodes = NULL;
+	}
+
+	Z_Free( remap );
+}
+#endif
+
+
 /*
 =================
 CM_BoundBrush
@@ -225,6 +540,47 @@ static void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#ifdef CM_SIMD_PLANES
+/*
+=================
+CMod_BuildBrushPlanes
+
+Makes structure-of-arrays copy of brush planes for SIMD tests,
+box brushes are left without it as their planes are changed on each use
+=================
+*/
+static void CMod_BuildBrushPlanes( void ) {
+	cbrush_t	*brush;
+	float		*out;
+	int			i, j, total;
+
+	total = 0;
+	for ( i = 0, brush = cm.brushes; i < cm.numBrushes; i++, brush++ ) {
+		total += ( brush->numsides + 3 ) & ~3;
+	}
+
+	if ( !total ) {
+		return;
+	}
+
+	out = CM_Alloc( total * 4 * sizeof( float ) );
+
+	for ( i = 0, brush = cm.brushes; i < cm.numBrushes; i++, brush++ ) {
+		brush->planes = out;
+		for ( j = 0; j < brush->numsides; j++ ) {
+			const cplane_t *plane = brush->sides[j].plane;
+			float *block = out + ( j & ~3 ) * 4 + ( j & 3 );
+			block[0] = plane->normal[0];
+			block[4] = plane->normal[1];
+			block[8] = plane->normal[2];
+			block[12] = plane->dist;
+		}
+		out += ( ( brush->numsides + 3 ) & ~3 ) * 4;
+	}
+}
+#endif
+
+
 /*
 =================
 CMod_LoadBrushes
@@ -242,7 +598,7 @@ static void CMod_LoadBrushes( const lump_t *l ) {
 
 	count = l->filelen / sizeof(*in);
 
-	cm.brushes = Hunk_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ), h_high );
+	cm.brushes = CM_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ) );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -260,6 +616,11 @@ static void CMod_LoadBrushes( const lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#ifdef CM_SIMD_PLANES
+	if ( cm_simd->integer ) {
+		CMod_BuildBrushPlanes();
+	}
+#endif
 }
 
 
@@ -283,7 +644,7 @@ static void CMod_LoadLeafs( const lump_t *l )
 	if ( count < 1 )
 		Com_Error( ERR_DROP, "%s: map with no leafs", __func__ );
 
-	cm.leafs = Hunk_Alloc( ( BOX_LEAFS + count ) * sizeof( *cm.leafs ), h_high );
+	cm.leafs = CM_Alloc( ( BOX_LEAFS + count ) * sizeof( *cm.leafs ) );
 	cm.numLeafs = count;
 
 	out = cm.leafs;
@@ -302,8 +663,8 @@ static void CMod_LoadLeafs( const lump_t *l )
 			cm.numAreas = out->area + 1;
 	}
 
-	cm.areas = Hunk_Alloc( cm.numAreas * sizeof( *cm.areas ), h_high );
-	cm.areaPortals = Hunk_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ), h_high );
+	cm.areas = CM_Alloc( cm.numAreas * sizeof( *cm.areas ) );
+	cm.areaPortals = CM_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ) );
 }
 
 
@@ -328,7 +689,7 @@ static void CMod_LoadPlanes( const lump_t *l )
 	if ( count < 1 )
 		Com_Error( ERR_DROP, "%s: map with no planes", __func__ );
 
-	cm.planes = Hunk_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ), h_high );
+	cm.planes = CM_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ) );
 	cm.numPlanes = count;
 
 	out = cm.planes;
@@ -368,7 +729,7 @@ static void CMod_LoadLeafBrushes( const lump_t *l )
 
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafbrushes = CM_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ) );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -397,7 +758,7 @@ static void CMod_LoadLeafSurfaces( const lump_t *l )
 
 	count = l->filelen / sizeof(*in);
 
-	cm.leafsurfaces = Hunk_Alloc( count * sizeof( *cm.leafsurfaces ), h_high );
+	cm.leafsurfaces = CM_Alloc( count * sizeof( *cm.leafsurfaces ) );
 	cm.numLeafSurfaces = count;
 
 	out = cm.leafsurfaces;
@@ -445,7 +806,7 @@ static void CMod_LoadBrushSides( const lump_t *l )
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushsides = Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
+	cm.brushsides = CM_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ) );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;
@@ -468,7 +829,7 @@ CMod_LoadEntityString
 =================
 */
 static void CMod_LoadEntityString( const lump_t *l ) {
-	cm.entityString = Hunk_Alloc( l->filelen, h_high );
+	cm.entityString = CM_Alloc( l->filelen );
 	cm.numEntityChars = l->filelen;
 	Com_Memcpy( cm.entityString, cmod_base + l->fileofs, l->filelen );
 }
@@ -483,54 +844,241 @@ CMod_LoadVisibility
 static void CMod_LoadVisibility( const lump_t *l ) {
 	int		len;
 	byte	*buf;
+	int		fileBytes, numRows, i;
 
 	len = l->filelen;
 	if ( !len ) {
 		cm.clusterBytes = ( cm.numClusters + 31 ) & ~31;
-		cm.visibility = Hunk_Alloc( cm.clusterBytes, h_high );
+		cm.clusterWords = cm.clusterBytes / sizeof( uint64_t );
+		cm.visibility = CM_Alloc( cm.clusterBytes );
 		Com_Memset( cm.visibility, 255, cm.clusterBytes );
 		return;
 	}
 	buf = cmod_base + l->fileofs;
 
 	cm.vised = qtrue;
-	cm.visibility = Hunk_Alloc( len, h_high );
 	cm.numClusters = LittleLong( ((int *)buf)[0] );
-	cm.clusterBytes = LittleLong( ((int *)buf)[1] );
-	Com_Memcpy (cm.visibility, buf + VIS_HEADER, len - VIS_HEADER );
+	fileBytes = LittleLong( ((int *)buf)[1] );
+	if ( cm.numClusters < 0 || fileBytes < 0 || ( fileBytes == 0 && cm.numClusters ) ) {
+		Com_Error( ERR_DROP, "%s: bad visibility header", __func__ );
+	}
+
+	// pad rows to 64-bit words so they can be used with CM_ClusterPVSWords(),
+	// rows that are missing in the lump stay empty
+	cm.clusterBytes = PAD( fileBytes, sizeof( uint64_t ) );
+	cm.clusterWords = cm.clusterBytes / sizeof( uint64_t );
+	cm.visibility = CM_Alloc( MAX( cm.numClusters, 1 ) * cm.clusterBytes );
+
+	numRows = fileBytes ? ( len - VIS_HEADER ) / fileBytes : 0;
+	if ( numRows > cm.numClusters ) {
+		numRows = cm.numClusters;
+	}
+
+	if ( fileBytes == cm.clusterBytes ) {
+		Com_Memcpy( cm.visibility, buf + VIS_HEADER, numRows * fileBytes );
+	} else {
+		for ( i = 0; i < numRows; i++ ) {
+			Com_Memcpy( cm.visibility + i * cm.clusterBytes, buf + VIS_HEADER + i * fileBytes, fileBytes );
+		}
+	}
 }
 
 //==================================================================
 
 
+#ifndef BSPC
+/*
+=================
+Patch collide cache
+
+Generated patch collide data is stored in the home directory keyed by the
+map checksum and reused on next loads of the same map, see cm_patchCache
+=================
+*/
+#define PATCH_CACHE_IDENT	(('C'<<24)+('C'<<16)+('P'<<8)+'Q')
+#define PATCH_CACHE_VERSION	1	// bump on any change in patch collide generation or layout
+
+typedef struct {
+	int		ident;
+	int		version;
+	int		checksum;		// of the map file
+	int		numSurfaces;
+} patchCacheHeader_t;
+
+
+/*
+=================
+CMod_PatchCacheName
+=================
+*/
+static const char *CMod_PatchCacheName( const char *mapname ) {
+	char base[MAX_QPATH];
+
+	COM_StripExtension( COM_SkipPath( (char *)mapname ), base, sizeof( base ) );
+
+	return va( "cache/%s-%08x.pcc", base, cm.checksum );
+}
+
+
+/*
+=================
+CMod_ReadPatchCache
+
+Returns file contents if it matches the loaded map
+=================
+*/
+static void *CMod_ReadPatchCache( const char *filename, int *length ) {
+	patchCacheHeader_t header;
+	fileHandle_t f;
+	void *buf;
+	int len;
+
+	// not affected by pure server restrictions
+	len = FS_SV_FOpenFileRead( filename, &f );
+	if ( f == FS_INVALID_HANDLE ) {
+		return NULL;
+	}
+
+	if ( len < (int)sizeof( header ) ) {
+		FS_FCloseFile( f );
+		return NULL;
+	}
+
+	buf = Hunk_AllocateTempMemory( len );
+	if ( FS_Read( buf, len, f ) == len ) {
+		Com_Memcpy( &header, buf, sizeof( header ) );
+		if ( header.ident == PATCH_CACHE_IDENT && header.version == PATCH_CACHE_VERSION
+			&& header.checksum == cm.checksum && header.numSurfaces == cm.numSurfaces ) {
+			FS_FCloseFile( f );
+			*length = len;
+			return buf;
+		}
+	}
+
+	FS_FCloseFile( f );
+	Hunk_FreeTempMemory( buf );
+
+	Com_DPrintf( "%s is outdated\n", filename );
+	return NULL;
+}
+
+
+/*
+=================
+CMod_WritePatchCache
+=================
+*/
+static void CMod_WritePatchCache( const char *filename ) {
+	patchCacheHeader_t header;
+	fileHandle_t f;
+	int i;
+
+	f = FS_SV_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		return;
+	}
+
+	header.ident = PATCH_CACHE_IDENT;
+	header.version = PATCH_CACHE_VERSION;
+	header.checksum = cm.checksum;
+	header.numSurfaces = cm.numSurfaces;
+	FS_Write( &header, sizeof( header ), f );
+
+	for ( i = 0; i < cm.numSurfaces; i++ ) {
+		if ( cm.surfaces[i] && cm.surfaces[i]->pc ) {
+			FS_Write( &i, sizeof( i ), f );
+			CM_SavePatchCollide( cm.surfaces[i]->pc, f );
+		}
+	}
+
+	FS_FCloseFile( f );
+
+	Com_DPrintf( "wrote %s\n", filename );
+}
+#endif // !BSPC
+
+
 /*
 =================
 CMod_LoadPatches
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-static void CMod_LoadPatches( const lump_t *surfs, const lump_t *verts ) {
+static void CMod_LoadPatches( const lump_t *surfs, const lump_t *verts, const char *mapname ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
 	int			i, j;
 	int			c;
 	cPatch_t	*patch;
+#ifndef BSPC
+	vec3_t		*points;
+#else
 	vec3_t		points[MAX_PATCH_VERTS];
+#endif
 	int			width, height;
 	int			shaderNum;
+	int			generated;
+#ifndef BSPC
+	const char	*cacheName;
+	const byte	*cache, *cacheEnd;
+	void		*cacheBuf;
+	int			cacheLen, surfaceNum;
+	patchSource_t	*sources;
+	cPatch_t	**pending;
+	struct patchCollide_s **results;
+	vec3_t		*pendingPoints;
+	void		*pendingBuf;
+	int			numPatches, numPoints;
+#endif
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
 		Com_Error( ERR_DROP, "%s: funny lump size", __func__ );
 
 	cm.numSurfaces = count = surfs->filelen / sizeof(*in);
-	cm.surfaces = Hunk_Alloc( cm.numSurfaces * sizeof( cm.surfaces[0] ), h_high );
+	cm.surfaces = CM_Alloc( cm.numSurfaces * sizeof( cm.surfaces[0] ) );
 
 	dv = (void *)(cmod_base + verts->fileofs);
 	if (verts->filelen % sizeof(*dv))
 		Com_Error( ERR_DROP, "%s: funny lump size", __func__ );
 
+	generated = 0;
+
+#ifndef BSPC
+	cacheName = NULL;
+	cacheBuf = NULL;
+	cache = cacheEnd = NULL;
+	if ( cm_patchCache->integer ) {
+		cacheName = CMod_PatchCacheName( mapname );
+		cacheBuf = CMod_ReadPatchCache( cacheName, &cacheLen );
+		if ( cacheBuf ) {
+			cache = (const byte *)cacheBuf + sizeof( patchCacheHeader_t );
+			cacheEnd = (const byte *)cacheBuf + cacheLen;
+		}
+	}
+
+	// patches that are not cached get generated in one batch after the scan,
+	// so keep their points around until then
+	numPatches = numPoints = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) == MST_PATCH ) {
+			c = LittleLong( in[i].patchWidth ) * LittleLong( in[i].patchHeight );
+			if ( c > 0 && c <= MAX_PATCH_VERTS ) {
+				numPoints += c;
+			}
+			numPatches++;
+		}
+	}
+	pendingBuf = Hunk_AllocateTempMemory( numPatches * ( sizeof( *sources ) + sizeof( *pending ) + sizeof( *results ) )
+		+ numPoints * sizeof( vec3_t ) );
+	pendingPoints = (vec3_t *)pendingBuf;
+	sources = (patchSource_t *)( pendingPoints + numPoints );
+	pending = (cPatch_t **)( sources + numPatches );
+	results = (struct patchCollide_s **)( pending + numPatches );
+	numPatches = numPoints = 0;
+#endif
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
 	for ( i = 0 ; i < count ; i++, in++ ) {
@@ -539,7 +1087,7 @@ static void CMod_LoadPatches( const lump_t *surfs, const lump_t *verts ) {
 		}
 		// FIXME: check for non-colliding patches
 
-		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
+		cm.surfaces[ i ] = patch = CM_Alloc( sizeof( *patch ) );
 
 		// load the full drawverts onto the stack
 		width = LittleLong( in->patchWidth );
@@ -549,6 +1097,9 @@ static void CMod_LoadPatches( const lump_t *surfs, const lump_t *verts ) {
 			Com_Error( ERR_DROP, "%s: MAX_PATCH_VERTS", __func__ );
 		}
 
+#ifndef BSPC
+		points = pendingPoints + numPoints;
+#endif
 		dv_p = dv + LittleLong( in->firstVert );
 		for ( j = 0 ; j < c ; j++, dv_p++ ) {
 			points[j][0] = LittleFloat( dv_p->xyz[0] );
@@ -560,9 +1111,58 @@ static void CMod_LoadPatches( const lump_t *surfs, const lump_t *verts ) {
 		patch->contents = cm.shaders[shaderNum].contentFlags;
 		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
 
+#ifndef BSPC
+		// take it from cache if possible, stop using cache from the first mismatch
+		if ( cache ) {
+			if ( cacheEnd - cache >= sizeof( surfaceNum ) ) {
+				Com_Memcpy( &surfaceNum, cache, sizeof( surfaceNum ) );
+				cache += sizeof( surfaceNum );
+				if ( surfaceNum == i ) {
+					cache = CM_LoadPatchCollide( cache, cacheEnd, &patch->pc );
+				} else {
+					cache = NULL;
+				}
+			} else {
+				cache = NULL;
+			}
+			if ( patch->pc ) {
+				continue;
+			}
+		}
+#endif
+
+#ifndef BSPC
+		sources[ numPatches ].width = width;
+		sources[ numPatches ].height = height;
+		sources[ numPatches ].points = points;
+		pending[ numPatches ] = patch;
+		numPatches++;
+		numPoints += c;
+#else
 		// create the internal facet structure
 		patch->pc = CM_GeneratePatchCollide( width, height, points );
+		generated++;
+#endif
+	}
+
+#ifndef BSPC
+	// create the internal facet structures
+	CM_GeneratePatchCollides( numPatches, sources, results );
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		pending[i]->pc = results[i];
+	}
+	generated = numPatches;
+
+	Hunk_FreeTempMemory( pendingBuf );
+
+	if ( cacheBuf ) {
+		Hunk_FreeTempMemory( cacheBuf );
 	}
+
+	if ( generated && cacheName ) {
+		CMod_WritePatchCache( cacheName );
+	}
+#endif
 }
 
 //==================================================================
@@ -618,6 +1218,23 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	Cvar_SetDescription( cm_noCurves, "Do not collide against curves." );
 	cm_playerCurveClip = Cvar_Get( "cm_playerCurveClip", "1", CVAR_ARCHIVE_ND | CVAR_CHEAT );
 	Cvar_SetDescription( cm_playerCurveClip, "Collide player against curves." );
+	cm_patchCache = Cvar_Get( "cm_patchCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cm_patchCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cm_patchCache, "Store generated curve collision data in the home directory and reuse it on later loads of the same map." );
+	cm_residentMaps = Cvar_Get( "cm_residentMaps", "2", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cm_residentMaps, "0", "8", CV_INTEGER );
+	Cvar_SetDescription( cm_residentMaps, "Number of recently loaded maps whose collision data is kept in memory between map changes, a map loaded again with the same checksum is restored without parsing." );
+	cm_flatTree = Cvar_Get( "cm_flatTree", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cm_flatTree, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cm_flatTree, "Trace through a copy of collision tree stored in depth-first order with packed planes. Applied on map load, see \\cm_bench." );
+	cm_incrementalFlood = Cvar_Get( "cm_incrementalFlood", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cm_incrementalFlood, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cm_incrementalFlood, "Update area connections only for areas affected by door state change instead of reflooding all areas, see \\cm_floodstats." );
+#ifdef CM_SIMD_PLANES
+	cm_simd = Cvar_Get( "cm_simd", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( cm_simd, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( cm_simd, "Use SSE2 for brush plane tests, gives the same results as scalar code. Applied on map load." );
+#endif
 #endif
 
 	Com_DPrintf( "%s( '%s', %i )\n", __func__, name, clientload );
@@ -635,7 +1252,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 		cm.numLeafs = 1;
 		cm.numClusters = 1;
 		cm.numAreas = 1;
-		cm.cmodels = Hunk_Alloc( sizeof( *cm.cmodels ), h_high );
+		cm.cmodels = CM_Alloc( sizeof( *cm.cmodels ) );
 		*checksum = 0;
 		return;
 	}
@@ -659,6 +1276,18 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	*checksum = cm.checksum = LittleLong( Com_BlockChecksum( buf, length ) );
 
+#ifndef BSPC
+	if ( CM_RestoreResidentMap( name, cm.checksum, CM_ResidentFlags() ) ) {
+		FS_FreeFile( buf );
+		if ( !clientload ) {
+			Q_strncpyz( cm.name, name, sizeof( cm.name ) );
+		}
+		return;
+	}
+
+	residentLoad = CM_NewResidentMap( name, cm.checksum, CM_ResidentFlags() );
+#endif
+
 	header = *(dheader_t *)buf;
 	for ( i = 0; i < sizeof( dheader_t ) / sizeof( int32_t ); i++ ) {
 		( (int32_t *)&header )[i] = LittleLong( ( (int32_t *)&header )[i] );
@@ -688,9 +1317,14 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
 	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
+#ifndef BSPC
+	if ( cm_flatTree->integer ) {
+		CMod_BuildFlatNodes();
+	}
+#endif
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], name );
 
 	CMod_CheckLeafBrushes();
 
@@ -701,6 +1335,16 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	CM_FloodAreaConnections();
 
+#ifndef BSPC
+	if ( residentLoad ) {
+		residentLoad->cm = cm;
+		residentLoad->complete = qtrue;
+		residentLoad->lastUsed = ++residentSequence;
+		residentActive = residentLoad;
+		residentLoad = NULL;
+	}
+#endif
+
 	// allow this to be cached if it is loaded by the server
 	if ( !clientload ) {
 		Q_strncpyz( cm.name, name, sizeof( cm.name ) );
@@ -714,7 +1358,22 @@ CM_ClearMap
 ==================
 */
 void CM_ClearMap( void ) {
+	CM_StopTraceRecord();
+#ifndef BSPC
+	// keep check counts and flood numbers increasing across visits
+	if ( residentActive ) {
+		residentActive->cm = cm;
+		residentActive = NULL;
+	}
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
+#ifndef BSPC
+	// drop data of an interrupted load
+	if ( residentLoad ) {
+		CM_FreeResidentMap( residentLoad );
+		residentLoad = NULL;
+	}
+#endif
 	CM_ClearLevelPatches();
 }
 
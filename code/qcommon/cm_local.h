@@ -28,6 +28,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
 
+#if idx64 && !defined(BSPC)
+#define CM_SIMD_PLANES			// SSE2 brush plane tests, see cm_simd
+#endif
+
 
 // forced double-precison functions
 #define DotProductDP(x,y)		((double)(x)[0]*(y)[0]+(double)(x)[1]*(y)[1]+(double)(x)[2]*(y)[2])
@@ -78,6 +82,15 @@ typedef struct {
 	int			children[2];		// negative numbers are leafs
 } cNode_t;
 
+// node with plane data packed in, stored in depth-first order, see cm_flatTree
+typedef struct {
+	vec3_t		normal;
+	float		dist;
+	int			type;
+	int			children[2];		// indexes in flatNodes, negative numbers are leafs
+	int			pad;
+} cFlatNode_t;
+
 typedef struct {
 	int			cluster;
 	int			area;
@@ -107,6 +120,9 @@ typedef struct {
 	int			numsides;
 	cbrushside_t	*sides;
 	int			checkcount;		// to avoid repeated testings
+#ifdef CM_SIMD_PLANES
+	float		*planes;		// blocks of 4 sides: normal[0] x4, normal[1] x4, normal[2] x4, dist x4
+#endif
 } cbrush_t;
 
 
@@ -137,6 +153,7 @@ typedef struct {
 
 	int			numNodes;
 	cNode_t		*nodes;
+	cFlatNode_t	*flatNodes;		// NULL if disabled, root is always at 0
 
 	int			numLeafs;
 	cLeaf_t		*leafs;
@@ -154,8 +171,9 @@ typedef struct {
 	cbrush_t	*brushes;
 
 	int			numClusters;
-	int			clusterBytes;
-	byte		*visibility;
+	int			clusterBytes;		// multiple of 8
+	int			clusterWords;
+	byte		*visibility;		// rows are 64-bit aligned
 	qboolean	vised;			// if false, visibility is just a single cluster of ffs
 
 	int			numEntityChars;
@@ -169,6 +187,7 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
+	int			lastFloodnum;				// highest area flood number in use
 	int			checkcount;					// incremented on each trace
 
 	unsigned int checksum;
@@ -183,9 +202,20 @@ extern	clipMap_t	cm;
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
+extern	cvar_t		*cm_flatTree;
+extern	cvar_t		*cm_incrementalFlood;
+extern	cvar_t		*cm_patchCache;
+extern	cvar_t		*cm_residentMaps;
+#ifdef CM_SIMD_PLANES
+extern	cvar_t		*cm_simd;
+#endif
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
 
+// cm_load.c
+
+void *CM_Alloc( int size );
+
 // cm_test.c
 
 // Used for oriented capsule collision detection
@@ -234,9 +264,24 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
 qboolean CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
 
+// cm_trace.c
+
+void CM_StopTraceRecord( void );
+
 // cm_patch.c
 
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
+struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, const vec3_t *points );
+#ifndef BSPC
+typedef struct {
+	int				width;
+	int				height;
+	const vec3_t	*points;
+} patchSource_t;
+
+void CM_GeneratePatchCollides( int count, const patchSource_t *sources, struct patchCollide_s **out );
+#endif
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
+void CM_SavePatchCollide( const struct patchCollide_s *pc, fileHandle_t f );
+const byte *CM_LoadPatchCollide( const byte *in, const byte *end, struct patchCollide_s **out );
 void CM_ClearLevelPatches( void );
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "cm_local.h"
 #include "cm_patch.h"
+#include <setjmp.h>
 
 /*
 
@@ -419,15 +420,85 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static	int				numPlanes;
-static	patchPlane_t	planes[MAX_PATCH_PLANES];
+// generation state, one per thread when patches are generated in parallel
+typedef struct {
+	int				numPlanes;
+	patchPlane_t	planes[MAX_PATCH_PLANES];
+
+	int				numFacets;
+	facet_t			facets[MAX_FACETS];
+	vec3_t			facetBounds[MAX_FACETS][2];
+
+	int				numFacetNodes;
+	facetNode_t		facetNodes[MAX_FACET_NODES];
+
+	cGrid_t			grid;
+	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+	vec3_t			bounds[2];
 
-static	int				numFacets;
-static	facet_t			facets[MAX_FACETS];
+	// job threads can't report anything, so errors abort current patch
+	// and warnings are counted until the main thread picks them up
+	qboolean		deferred;
+	jmp_buf			abortMark;
+	int				errorCode;
+	char			error[MAX_STRING_CHARS];
+	int				numWarnings;
+} patchWork_t;
+
+static patchWork_t	mainPatchWork;
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
 
+
+/*
+==================
+CM_PatchError
+==================
+*/
+static void QDECL CM_PatchError( patchWork_t *pw, int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( pw->error, sizeof( pw->error ), fmt, argptr );
+	va_end( argptr );
+
+	if ( pw->deferred ) {
+		pw->errorCode = code;
+		Q_longjmp( pw->abortMark, 1 );
+	}
+
+	Com_Error( code, "%s", pw->error );
+}
+
+
+/*
+==================
+CM_PatchWindingError
+
+Polylib errors inside a winding scope abort the patch like CM_PatchError
+==================
+*/
+static void CM_PatchWindingError( void *arg, int code, const char *msg ) {
+	CM_PatchError( (patchWork_t *)arg, code, "%s", msg );
+}
+
+
+/*
+==================
+CM_PatchWarning
+==================
+*/
+static void CM_PatchWarning( patchWork_t *pw, qboolean developer, const char *msg ) {
+	if ( pw->deferred ) {
+		pw->numWarnings++;
+	} else if ( developer ) {
+		Com_DPrintf( "%s", msg );
+	} else {
+		Com_Printf( "%s", msg );
+	}
+}
+
 /*
 ==================
 CM_PlaneEqual
@@ -494,27 +565,27 @@ static void CM_SnapVector( vec3_t normal ) {
 CM_FindPlane2
 ==================
 */
-static int CM_FindPlane2( const float plane[4], int *flipped ) {
+static int CM_FindPlane2( patchWork_t *pw, const float plane[4], int *flipped ) {
 	int i;
 
 	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if (CM_PlaneEqual(&planes[i], plane, flipped)) return i;
+	for ( i = 0 ; i < pw->numPlanes ; i++ ) {
+		if (CM_PlaneEqual(&pw->planes[i], plane, flipped)) return i;
 	}
 
 	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+	if ( pw->numPlanes == MAX_PATCH_PLANES ) {
+		CM_PatchError( pw, ERR_DROP, "MAX_PATCH_PLANES" );
 	}
 
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
+	Vector4Copy( plane, pw->planes[pw->numPlanes].plane );
+	pw->planes[pw->numPlanes].signbits = CM_SignbitsForNormal( plane );
 
-	numPlanes++;
+	pw->numPlanes++;
 
 	*flipped = qfalse;
 
-	return numPlanes-1;
+	return pw->numPlanes-1;
 }
 
 
@@ -523,7 +594,7 @@ static int CM_FindPlane2( const float plane[4], int *flipped ) {
 CM_FindPlane
 ==================
 */
-static int CM_FindPlane( const float *p1, const float *p2, const float *p3 ) {
+static int CM_FindPlane( patchWork_t *pw, const float *p1, const float *p2, const float *p3 ) {
 	float	plane[4];
 	int		i;
 	float	d;
@@ -533,22 +604,22 @@ static int CM_FindPlane( const float *p1, const float *p2, const float *p3 ) {
 	}
 
 	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if ( DotProduct( plane, planes[i].plane ) < 0 ) {
+	for ( i = 0 ; i < pw->numPlanes ; i++ ) {
+		if ( DotProduct( plane, pw->planes[i].plane ) < 0 ) {
 			continue;	// allow backwards planes?
 		}
 
-		d = DotProduct( p1, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p1, pw->planes[i].plane ) - pw->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
 
-		d = DotProduct( p2, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p2, pw->planes[i].plane ) - pw->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
 
-		d = DotProduct( p3, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p3, pw->planes[i].plane ) - pw->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
@@ -558,16 +629,16 @@ static int CM_FindPlane( const float *p1, const float *p2, const float *p3 ) {
 	}
 
 	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+	if ( pw->numPlanes == MAX_PATCH_PLANES ) {
+		CM_PatchError( pw, ERR_DROP, "MAX_PATCH_PLANES" );
 	}
 
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
+	Vector4Copy( plane, pw->planes[pw->numPlanes].plane );
+	pw->planes[pw->numPlanes].signbits = CM_SignbitsForNormal( plane );
 
-	numPlanes++;
+	pw->numPlanes++;
 
-	return numPlanes-1;
+	return pw->numPlanes-1;
 }
 
 
@@ -576,14 +647,14 @@ static int CM_FindPlane( const float *p1, const float *p2, const float *p3 ) {
 CM_PointOnPlaneSide
 ==================
 */
-static int CM_PointOnPlaneSide( const float *p, int planeNum ) {
+static int CM_PointOnPlaneSide( patchWork_t *pw, const float *p, int planeNum ) {
 	const float *plane;
 	double	d;
 
 	if ( planeNum == -1 ) {
 		return SIDE_ON;
 	}
-	plane = planes[ planeNum ].plane;
+	plane = pw->planes[ planeNum ].plane;
 
 	d = DotProductDPf( p, plane ) - plane[3];
 
@@ -604,7 +675,7 @@ static int CM_PointOnPlaneSide( const float *p, int planeNum ) {
 CM_GridPlane
 ==================
 */
-static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int tri ) {
+static int	CM_GridPlane( patchWork_t *pw, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int tri ) {
 	int		p;
 
 	p = gridPlanes[i][j][tri];
@@ -617,7 +688,7 @@ static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 	}
 
 	// should never happen
-	Com_Printf( "WARNING: CM_GridPlane unresolvable\n" );
+	CM_PatchWarning( pw, qfalse, "WARNING: CM_GridPlane unresolvable\n" );
 	return -1;
 }
 
@@ -627,7 +698,7 @@ static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 CM_EdgePlaneNum
 ==================
 */
-static int CM_EdgePlaneNum( const cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int k ) {
+static int CM_EdgePlaneNum( patchWork_t *pw, const cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int k ) {
 	const float *p1, *p2;
 	vec3_t		up;
 	int			p;
@@ -636,66 +707,66 @@ static int CM_EdgePlaneNum( const cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][M
 	case 0:	// top border
 		p1 = grid->points[i][j];
 		p2 = grid->points[i+1][j];
-		p = CM_GridPlane( gridPlanes, i, j, 0 );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 0 );
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	case 2:	// bottom border
 		p1 = grid->points[i][j+1];
 		p2 = grid->points[i+1][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 1 );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 1 );
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p2, p1, up );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p2, p1, up );
 
 	case 3: // left border
 		p1 = grid->points[i][j];
 		p2 = grid->points[i][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 1 );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 1 );
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p2, p1, up );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p2, p1, up );
 
 	case 1:	// right border
 		p1 = grid->points[i+1][j];
 		p2 = grid->points[i+1][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 0 );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 0 );
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	case 4:	// diagonal out of triangle 0
 		p1 = grid->points[i+1][j+1];
 		p2 = grid->points[i][j];
-		p = CM_GridPlane( gridPlanes, i, j, 0 );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 0 );
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	case 5:	// diagonal out of triangle 1
 		p1 = grid->points[i][j];
 		p2 = grid->points[i+1][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 1 );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 1 );
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	}
 
-	Com_Error( ERR_DROP, "CM_EdgePlaneNum: bad k" );
+	CM_PatchError( pw, ERR_DROP, "CM_EdgePlaneNum: bad k" );
 	return -1;
 }
 
@@ -705,7 +776,7 @@ static int CM_EdgePlaneNum( const cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][M
 CM_SetBorderInward
 ===================
 */
-static void CM_SetBorderInward( facet_t *facet, const cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2],
+static void CM_SetBorderInward( patchWork_t *pw, facet_t *facet, const cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2],
 						  int i, int j, int which ) {
 	int		k, l;
 	const float *points[4];
@@ -732,7 +803,7 @@ static void CM_SetBorderInward( facet_t *facet, const cGrid_t *grid, int gridPla
 		numPoints = 3;
 		break;
 	default:
-		Com_Error( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
+		CM_PatchError( pw, ERR_FATAL, "CM_SetBorderInward: bad parameter" );
 		numPoints = 0;
 		break;
 	}
@@ -746,7 +817,7 @@ static void CM_SetBorderInward( facet_t *facet, const cGrid_t *grid, int gridPla
 		for ( l = 0 ; l < numPoints ; l++ ) {
 			int		side;
 
-			side = CM_PointOnPlaneSide( points[l], facet->borderPlanes[k] );
+			side = CM_PointOnPlaneSide( pw, points[l], facet->borderPlanes[k] );
 			if ( side == SIDE_FRONT ) {
 				front++;
 			} else if ( side == SIDE_BACK ) {
@@ -763,9 +834,9 @@ static void CM_SetBorderInward( facet_t *facet, const cGrid_t *grid, int gridPla
 			facet->borderPlanes[k] = -1;
 		} else {
 			// bisecting side border
-			Com_DPrintf( "WARNING: CM_SetBorderInward: mixed plane sides\n" );
+			CM_PatchWarning( pw, qtrue, "WARNING: CM_SetBorderInward: mixed plane sides\n" );
 			facet->borderInward[k] = qfalse;
-			if ( !debugBlock ) {
+			if ( !debugBlock && !pw->deferred ) {
 				debugBlock = qtrue;
 				VectorCopy( grid->points[i][j], debugBlockPoints[0] );
 				VectorCopy( grid->points[i+1][j], debugBlockPoints[1] );
@@ -784,7 +855,7 @@ CM_ValidateFacet
 If the facet isn't bounded by its borders, we screwed up.
 ==================
 */
-static qboolean CM_ValidateFacet( const facet_t *facet ) {
+static qboolean CM_ValidateFacet( patchWork_t *pw, const facet_t *facet ) {
 	float		plane[4];
 	int			j;
 	winding_t	*w;
@@ -794,14 +865,14 @@ static qboolean CM_ValidateFacet( const facet_t *facet ) {
 		return qfalse;
 	}
 
-	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	Vector4Copy( pw->planes[ facet->surfacePlane ].plane, plane );
 	w = BaseWindingForPlane( plane,  plane[3] );
 	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
 		if ( facet->borderPlanes[j] == -1 ) {
 			FreeWinding( w );
 			return qfalse;
 		}
-		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+		Vector4Copy( pw->planes[ facet->borderPlanes[j] ].plane, plane );
 		if ( !facet->borderInward[j] ) {
 			VectorSubtract( vec3_origin, plane, plane );
 			plane[3] = -plane[3];
@@ -837,7 +908,7 @@ static qboolean CM_ValidateFacet( const facet_t *facet ) {
 CM_AddFacetBevels
 ==================
 */
-static void CM_AddFacetBevels( facet_t *facet ) {
+static void CM_AddFacetBevels( patchWork_t *pw, facet_t *facet ) {
 
 	int i, j, k, l;
 	int axis, dir, order, flipped;
@@ -845,13 +916,19 @@ static void CM_AddFacetBevels( facet_t *facet ) {
 	winding_t *w, *w2;
 	vec3_t mins, maxs, vec, vec2;
 	double d, d1[3], d2[3];
+	float *bounds;
+
+	// facet volume is unknown until axial planes are added
+	bounds = pw->facetBounds[ facet - pw->facets ][0];
+	VectorSet( bounds + 0, -MAX_WORLD_COORD, -MAX_WORLD_COORD, -MAX_WORLD_COORD );
+	VectorSet( bounds + 3, MAX_WORLD_COORD, MAX_WORLD_COORD, MAX_WORLD_COORD );
 
-	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	Vector4Copy( pw->planes[ facet->surfacePlane ].plane, plane );
 
 	w = BaseWindingForPlane( plane,  plane[3] );
 	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
 		if (facet->borderPlanes[j] == facet->surfacePlane) continue;
-		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+		Vector4Copy( pw->planes[ facet->borderPlanes[j] ].plane, plane );
 
 		if ( !facet->borderInward[j] ) {
 			VectorSubtract( vec3_origin, plane, plane );
@@ -866,6 +943,10 @@ static void CM_AddFacetBevels( facet_t *facet ) {
 
 	WindingBounds(w, mins, maxs);
 
+	// expand by one unit for epsilon purposes, same as for the whole patch
+	VectorSet( bounds + 0, mins[0] - 1, mins[1] - 1, mins[2] - 1 );
+	VectorSet( bounds + 3, maxs[0] + 1, maxs[1] + 1, maxs[2] + 1 );
+
 	// add the axial planes
 	order = 0;
 	for ( axis = 0 ; axis < 3 ; axis++ )
@@ -881,21 +962,24 @@ static void CM_AddFacetBevels( facet_t *facet ) {
 				plane[3] = -mins[axis];
 			}
 			//if it's the surface plane
-			if (CM_PlaneEqual(&planes[facet->surfacePlane], plane, &flipped)) {
+			if (CM_PlaneEqual(&pw->planes[facet->surfacePlane], plane, &flipped)) {
 				continue;
 			}
 			// see if the plane is already present
 			for ( i = 0 ; i < facet->numBorders ; i++ ) {
-				if (CM_PlaneEqual(&planes[facet->borderPlanes[i]], plane, &flipped))
+				if (CM_PlaneEqual(&pw->planes[facet->borderPlanes[i]], plane, &flipped))
 					break;
 			}
 
 			if ( i == facet->numBorders ) {
 				if ( facet->numBorders >= 4 + 6 + 16 ) {
-					Com_Printf( "ERROR: too many bevels\n" );
+					CM_PatchWarning( pw, qfalse, "ERROR: too many bevels\n" );
+					// not bounded along this axis
+					bounds[ axis ] = -MAX_WORLD_COORD;
+					bounds[ axis + 3 ] = MAX_WORLD_COORD;
 					continue;
 				}
-				facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
+				facet->borderPlanes[facet->numBorders] = CM_FindPlane2( pw, plane, &flipped );
 				facet->borderNoAdjust[facet->numBorders] = 0;
 				facet->borderInward[facet->numBorders] = flipped;
 				facet->numBorders++;
@@ -947,33 +1031,33 @@ static void CM_AddFacetBevels( facet_t *facet ) {
 					continue;
 
 				//if it's the surface plane
-				if (CM_PlaneEqual(&planes[facet->surfacePlane], plane, &flipped)) {
+				if (CM_PlaneEqual(&pw->planes[facet->surfacePlane], plane, &flipped)) {
 					continue;
 				}
 				// see if the plane is already present
 				for ( i = 0 ; i < facet->numBorders ; i++ ) {
-					if (CM_PlaneEqual(&planes[facet->borderPlanes[i]], plane, &flipped)) {
+					if (CM_PlaneEqual(&pw->planes[facet->borderPlanes[i]], plane, &flipped)) {
 							break;
 					}
 				}
 
 				if ( i == facet->numBorders ) {
 					if ( facet->numBorders >= 4 + 6 + 16 ) {
-						Com_Printf( "ERROR: too many bevels\n" );
+						CM_PatchWarning( pw, qfalse, "ERROR: too many bevels\n" );
 						continue;
 					}
-					facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
+					facet->borderPlanes[facet->numBorders] = CM_FindPlane2( pw, plane, &flipped );
 
 					for ( k = 0 ; k < facet->numBorders ; k++ ) {
 						if (facet->borderPlanes[facet->numBorders] ==
-							facet->borderPlanes[k]) Com_Printf("WARNING: bevel plane already used\n");
+							facet->borderPlanes[k]) CM_PatchWarning( pw, qfalse, "WARNING: bevel plane already used\n" );
 					}
 
 					facet->borderNoAdjust[facet->numBorders] = 0;
 					facet->borderInward[facet->numBorders] = flipped;
 					//
 					w2 = CopyWinding(w);
-					Vector4Copy(planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
+					Vector4Copy(pw->planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
 					if (!facet->borderInward[facet->numBorders])
 					{
 						VectorNegate(newplane, newplane);
@@ -981,7 +1065,7 @@ static void CM_AddFacetBevels( facet_t *facet ) {
 					} //end if
 					ChopWindingInPlace( &w2, newplane, newplane[3], 0.1f );
 					if (!w2) {
-						Com_DPrintf("WARNING: CM_AddFacetBevels... invalid bevel\n");
+						CM_PatchWarning( pw, qtrue, "WARNING: CM_AddFacetBevels... invalid bevel\n" );
 						continue;
 					}
 					else {
@@ -1000,7 +1084,7 @@ static void CM_AddFacetBevels( facet_t *facet ) {
 #ifndef BSPC
 	//add opposite plane
 	if ( facet->numBorders >= 4 + 6 + 16 ) {
-		Com_Printf( "ERROR: too many bevels\n" );
+		CM_PatchWarning( pw, qfalse, "ERROR: too many bevels\n" );
 		return;
 	}
 	facet->borderPlanes[facet->numBorders] = facet->surfacePlane;
@@ -1018,21 +1102,60 @@ typedef enum {
 	EN_LEFT
 } edgeName_t;
 
+/*
+==================
+CM_BuildFacetNodes_r
+
+Splits consecutive facets in halves, so in-order traversal visits
+facets in their original order and gives the same results as linear tests
+==================
+*/
+static int CM_BuildFacetNodes_r( patchWork_t *pw, int first, int count ) {
+	facetNode_t *node;
+	int i, index;
+
+	index = pw->numFacetNodes++;
+	node = &pw->facetNodes[ index ];
+
+	ClearBounds( node->bounds[0], node->bounds[1] );
+	for ( i = first; i < first + count; i++ ) {
+		AddPointToBounds( pw->facetBounds[i][0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( pw->facetBounds[i][1], node->bounds[0], node->bounds[1] );
+	}
+
+	if ( count <= FACET_LEAF_SIZE ) {
+		node->firstFacet = first;
+		node->numFacets = count;
+		node->secondChild = 0;
+		return index;
+	}
+
+	node->firstFacet = first;
+	node->numFacets = 0;
+
+	CM_BuildFacetNodes_r( pw, first, count / 2 );
+	pw->facetNodes[ index ].secondChild = CM_BuildFacetNodes_r( pw, first + count / 2, count - count / 2 );
+
+	return index;
+}
+
+
 /*
 ==================
 CM_PatchCollideFromGrid
 ==================
 */
-static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
+static void CM_PatchCollideFromGrid( patchWork_t *pw ) {
+	const cGrid_t	*grid = &pw->grid;
+	int				(*gridPlanes)[MAX_GRID_SIZE][2] = pw->gridPlanes;
 	int				i, j;
 	const float		*p1, *p2, *p3;
-	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
 	facet_t			*facet;
 	int				borders[4];
 	qboolean		noAdjust[4];
 
-	numPlanes = 0;
-	numFacets = 0;
+	pw->numPlanes = 0;
+	pw->numFacets = 0;
 
 	// find the planes for each triangle of the grid
 	for ( i = 0 ; i < grid->width - 1 ; i++ ) {
@@ -1040,12 +1163,12 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 			p1 = grid->points[i][j];
 			p2 = grid->points[i+1][j];
 			p3 = grid->points[i+1][j+1];
-			gridPlanes[i][j][0] = CM_FindPlane( p1, p2, p3 );
+			gridPlanes[i][j][0] = CM_FindPlane( pw, p1, p2, p3 );
 
 			p1 = grid->points[i+1][j+1];
 			p2 = grid->points[i][j+1];
 			p3 = grid->points[i][j];
-			gridPlanes[i][j][1] = CM_FindPlane( p1, p2, p3 );
+			gridPlanes[i][j][1] = CM_FindPlane( pw, p1, p2, p3 );
 		}
 	}
 
@@ -1061,7 +1184,7 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_TOP] = ( borders[EN_TOP] == gridPlanes[i][j][0] );
 			if ( borders[EN_TOP] == -1 || noAdjust[EN_TOP] ) {
-				borders[EN_TOP] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 0 );
+				borders[EN_TOP] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 0 );
 			}
 
 			borders[EN_BOTTOM] = -1;
@@ -1072,7 +1195,7 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_BOTTOM] = ( borders[EN_BOTTOM] == gridPlanes[i][j][1] );
 			if ( borders[EN_BOTTOM] == -1 || noAdjust[EN_BOTTOM] ) {
-				borders[EN_BOTTOM] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 2 );
+				borders[EN_BOTTOM] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 2 );
 			}
 
 			borders[EN_LEFT] = -1;
@@ -1083,7 +1206,7 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_LEFT] = ( borders[EN_LEFT] == gridPlanes[i][j][1] );
 			if ( borders[EN_LEFT] == -1 || noAdjust[EN_LEFT] ) {
-				borders[EN_LEFT] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 3 );
+				borders[EN_LEFT] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 3 );
 			}
 
 			borders[EN_RIGHT] = -1;
@@ -1094,13 +1217,13 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_RIGHT] = ( borders[EN_RIGHT] == gridPlanes[i][j][0] );
 			if ( borders[EN_RIGHT] == -1 || noAdjust[EN_RIGHT] ) {
-				borders[EN_RIGHT] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 1 );
+				borders[EN_RIGHT] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 1 );
 			}
 
-			if ( numFacets == MAX_FACETS ) {
-				Com_Error( ERR_DROP, "MAX_FACETS" );
+			if ( pw->numFacets == MAX_FACETS ) {
+				CM_PatchError( pw, ERR_DROP, "MAX_FACETS" );
 			}
-			facet = &facets[numFacets];
+			facet = &pw->facets[pw->numFacets];
 			Com_Memset( facet, 0, sizeof( *facet ) );
 
 			if ( gridPlanes[i][j][0] == gridPlanes[i][j][1] ) {
@@ -1117,10 +1240,10 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 				facet->borderNoAdjust[2] = noAdjust[EN_BOTTOM];
 				facet->borderPlanes[3] = borders[EN_LEFT];
 				facet->borderNoAdjust[3] = noAdjust[EN_LEFT];
-				CM_SetBorderInward( facet, grid, gridPlanes, i, j, -1 );
-				if ( CM_ValidateFacet( facet ) ) {
-					CM_AddFacetBevels( facet );
-					numFacets++;
+				CM_SetBorderInward( pw, facet, grid, gridPlanes, i, j, -1 );
+				if ( CM_ValidateFacet( pw, facet ) ) {
+					CM_AddFacetBevels( pw, facet );
+					pw->numFacets++;
 				}
 			} else {
 				// two separate triangles
@@ -1134,19 +1257,19 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 				if ( facet->borderPlanes[2] == -1 ) {
 					facet->borderPlanes[2] = borders[EN_BOTTOM];
 					if ( facet->borderPlanes[2] == -1 ) {
-						facet->borderPlanes[2] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 4 );
+						facet->borderPlanes[2] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 4 );
 					}
 				}
- 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 0 );
-				if ( CM_ValidateFacet( facet ) ) {
-					CM_AddFacetBevels( facet );
-					numFacets++;
+ 				CM_SetBorderInward( pw, facet, grid, gridPlanes, i, j, 0 );
+				if ( CM_ValidateFacet( pw, facet ) ) {
+					CM_AddFacetBevels( pw, facet );
+					pw->numFacets++;
 				}
 
-				if ( numFacets == MAX_FACETS ) {
-					Com_Error( ERR_DROP, "MAX_FACETS" );
+				if ( pw->numFacets == MAX_FACETS ) {
+					CM_PatchError( pw, ERR_DROP, "MAX_FACETS" );
 				}
-				facet = &facets[numFacets];
+				facet = &pw->facets[pw->numFacets];
 				Com_Memset( facet, 0, sizeof( *facet ) );
 
 				facet->surfacePlane = gridPlanes[i][j][1];
@@ -1159,106 +1282,465 @@ static void CM_PatchCollideFromGrid( const cGrid_t *grid, patchCollide_t *pf ) {
 				if ( facet->borderPlanes[2] == -1 ) {
 					facet->borderPlanes[2] = borders[EN_TOP];
 					if ( facet->borderPlanes[2] == -1 ) {
-						facet->borderPlanes[2] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 5 );
+						facet->borderPlanes[2] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 5 );
 					}
 				}
-				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 1 );
-				if ( CM_ValidateFacet( facet ) ) {
-					CM_AddFacetBevels( facet );
-					numFacets++;
+				CM_SetBorderInward( pw, facet, grid, gridPlanes, i, j, 1 );
+				if ( CM_ValidateFacet( pw, facet ) ) {
+					CM_AddFacetBevels( pw, facet );
+					pw->numFacets++;
 				}
 			}
 		}
 	}
 
-	// copy the results out
-	pf->numPlanes = numPlanes;
-	pf->numFacets = numFacets;
-	pf->facets = Hunk_Alloc( numFacets * sizeof( *pf->facets ), h_high );
-	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
-	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
-	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+	// build facet hierarchy
+	pw->numFacetNodes = 0;
+	if ( pw->numFacets > FACET_LEAF_SIZE ) {
+		CM_BuildFacetNodes_r( pw, 0, pw->numFacets );
+	}
 }
 
 
 /*
 ===================
-CM_GeneratePatchCollide
-
-Creates an internal structure that will be used to perform
-collision detection with a patch mesh.
+CM_GeneratePatchWork
 
-Points are packed as concatenated rows.
+Runs the whole generation into work buffers without any allocations,
+returns number of patch blocks
 ===================
 */
-struct patchCollide_s *CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
-	patchCollide_t	*pf;
-	cGrid_t			grid;
+static int CM_GeneratePatchWork( patchWork_t *pw, int width, int height, const vec3_t *points ) {
+	cGrid_t			*grid = &pw->grid;
 	int				i, j;
 
 	if ( width <= 2 || height <= 2 || !points ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
+		CM_PatchError( pw, ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
 			width, height, (void *)points );
 	}
 
 	if ( !(width & 1) || !(height & 1) ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
+		CM_PatchError( pw, ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
 	}
 
 	if ( width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
+		CM_PatchError( pw, ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
 	}
 
 	// build a grid
-	grid.width = width;
-	grid.height = height;
-	grid.wrapWidth = qfalse;
-	grid.wrapHeight = qfalse;
+	grid->width = width;
+	grid->height = height;
+	grid->wrapWidth = qfalse;
+	grid->wrapHeight = qfalse;
 	for ( i = 0 ; i < width ; i++ ) {
 		for ( j = 0 ; j < height ; j++ ) {
-			VectorCopy( points[j*width + i], grid.points[i][j] );
+			VectorCopy( points[j*width + i], grid->points[i][j] );
 		}
 	}
 
 	// subdivide the grid
-	CM_SetGridWrapWidth( &grid );
-	CM_SubdivideGridColumns( &grid );
-	CM_RemoveDegenerateColumns( &grid );
+	CM_SetGridWrapWidth( grid );
+	CM_SubdivideGridColumns( grid );
+	CM_RemoveDegenerateColumns( grid );
 
-	CM_TransposeGrid( &grid );
+	CM_TransposeGrid( grid );
 
-	CM_SetGridWrapWidth( &grid );
-	CM_SubdivideGridColumns( &grid );
-	CM_RemoveDegenerateColumns( &grid );
+	CM_SetGridWrapWidth( grid );
+	CM_SubdivideGridColumns( grid );
+	CM_RemoveDegenerateColumns( grid );
 
 	// we now have a grid of points exactly on the curve
 	// the approximate surface defined by these points will be
 	// collided against
-	pf = Hunk_Alloc( sizeof( *pf ), h_high );
-	ClearBounds( pf->bounds[0], pf->bounds[1] );
-	for ( i = 0 ; i < grid.width ; i++ ) {
-		for ( j = 0 ; j < grid.height ; j++ ) {
-			AddPointToBounds( grid.points[i][j], pf->bounds[0], pf->bounds[1] );
+	ClearBounds( pw->bounds[0], pw->bounds[1] );
+	for ( i = 0 ; i < grid->width ; i++ ) {
+		for ( j = 0 ; j < grid->height ; j++ ) {
+			AddPointToBounds( grid->points[i][j], pw->bounds[0], pw->bounds[1] );
 		}
 	}
 
-	c_totalPatchBlocks += ( grid.width - 1 ) * ( grid.height - 1 );
-
 	// generate a bsp tree for the surface
-	CM_PatchCollideFromGrid( &grid, pf );
+	CM_PatchCollideFromGrid( pw );
 
 	// expand by one unit for epsilon purposes
-	pf->bounds[0][0] -= 1;
-	pf->bounds[0][1] -= 1;
-	pf->bounds[0][2] -= 1;
+	pw->bounds[0][0] -= 1;
+	pw->bounds[0][1] -= 1;
+	pw->bounds[0][2] -= 1;
+
+	pw->bounds[1][0] += 1;
+	pw->bounds[1][1] += 1;
+	pw->bounds[1][2] += 1;
 
-	pf->bounds[1][0] += 1;
-	pf->bounds[1][1] += 1;
-	pf->bounds[1][2] += 1;
+	return ( grid->width - 1 ) * ( grid->height - 1 );
+}
+
+
+/*
+===================
+CM_GeneratePatchCollide
+
+Creates an internal structure that will be used to perform
+collision detection with a patch mesh.
+
+Points are packed as concatenated rows.
+===================
+*/
+struct patchCollide_s *CM_GeneratePatchCollide( int width, int height, const vec3_t *points ) {
+	patchWork_t		*pw = &mainPatchWork;
+	patchCollide_t	*pf;
+
+	pw->deferred = qfalse;
+	c_totalPatchBlocks += CM_GeneratePatchWork( pw, width, height, points );
+
+	// copy the results out
+	pf = CM_Alloc( sizeof( *pf ) );
+	VectorCopy( pw->bounds[0], pf->bounds[0] );
+	VectorCopy( pw->bounds[1], pf->bounds[1] );
+	pf->numPlanes = pw->numPlanes;
+	pf->numFacets = pw->numFacets;
+	pf->facets = CM_Alloc( pw->numFacets * sizeof( *pf->facets ) );
+	Com_Memcpy( pf->facets, pw->facets, pw->numFacets * sizeof( *pf->facets ) );
+	pf->planes = CM_Alloc( pw->numPlanes * sizeof( *pf->planes ) );
+	Com_Memcpy( pf->planes, pw->planes, pw->numPlanes * sizeof( *pf->planes ) );
+	pf->numNodes = pw->numFacetNodes;
+	if ( pf->numNodes ) {
+		pf->nodes = CM_Alloc( pw->numFacetNodes * sizeof( *pf->nodes ) );
+		Com_Memcpy( pf->nodes, pw->facetNodes, pw->numFacetNodes * sizeof( *pf->nodes ) );
+	}
 
 	return pf;
 }
 
+
+#ifndef BSPC
+/*
+================================================================================
+
+PATCH COLLIDE CACHE SERIALIZATION
+
+================================================================================
+*/
+
+typedef struct {
+	vec3_t	bounds[2];
+	int		numPlanes;
+	int		numFacets;
+	int		numNodes;
+} patchCollideHeader_t;
+
+
+/*
+===================
+CM_SavePatchCollide
+===================
+*/
+void CM_SavePatchCollide( const struct patchCollide_s *pc, fileHandle_t f ) {
+	patchCollideHeader_t header;
+
+	VectorCopy( pc->bounds[0], header.bounds[0] );
+	VectorCopy( pc->bounds[1], header.bounds[1] );
+	header.numPlanes = pc->numPlanes;
+	header.numFacets = pc->numFacets;
+	header.numNodes = pc->numNodes;
+
+	FS_Write( &header, sizeof( header ), f );
+	FS_Write( pc->planes, pc->numPlanes * sizeof( patchPlane_t ), f );
+	FS_Write( pc->facets, pc->numFacets * sizeof( facet_t ), f );
+	if ( pc->numNodes ) {
+		FS_Write( pc->nodes, pc->numNodes * sizeof( facetNode_t ), f );
+	}
+}
+
+
+/*
+===================
+CM_ValidatePatchCollide
+
+Checks plane, facet and node references of the loaded data
+===================
+*/
+static qboolean CM_ValidatePatchCollide( const patchCollide_t *pc ) {
+	const facet_t *facet;
+	const facetNode_t *node;
+	int i, j;
+
+	for ( i = 0, facet = pc->facets; i < pc->numFacets; i++, facet++ ) {
+		if ( (unsigned)facet->surfacePlane >= pc->numPlanes || (unsigned)facet->numBorders > ARRAY_LEN( facet->borderPlanes ) ) {
+			return qfalse;
+		}
+		for ( j = 0; j < facet->numBorders; j++ ) {
+			if ( (unsigned)facet->borderPlanes[j] >= pc->numPlanes ) {
+				return qfalse;
+			}
+		}
+	}
+
+	for ( i = 0, node = pc->nodes; i < pc->numNodes; i++, node++ ) {
+		if ( node->firstFacet < 0 || node->numFacets < 0 || node->firstFacet + node->numFacets > pc->numFacets ) {
+			return qfalse;
+		}
+		// children always go after their parent
+		if ( !node->numFacets && ( i + 1 >= pc->numNodes || node->secondChild <= i || node->secondChild >= pc->numNodes ) ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+===================
+CM_LoadPatchCollide
+
+Allocates collide data stored by CM_SavePatchCollide,
+returns NULL if data is truncated or invalid
+===================
+*/
+const byte *CM_LoadPatchCollide( const byte *in, const byte *end, struct patchCollide_s **out ) {
+	patchCollideHeader_t header;
+	patchCollide_t view, *pc;
+
+	*out = NULL;
+
+	if ( end - in < sizeof( header ) ) {
+		return NULL;
+	}
+
+	Com_Memcpy( &header, in, sizeof( header ) );
+	in += sizeof( header );
+
+	if ( header.numPlanes < 0 || header.numPlanes > MAX_PATCH_PLANES || header.numFacets < 0 || header.numFacets > MAX_FACETS
+		|| header.numNodes < 0 || header.numNodes > MAX_FACET_NODES ) {
+		return NULL;
+	}
+
+	if ( end - in < header.numPlanes * sizeof( patchPlane_t ) + header.numFacets * sizeof( facet_t ) + header.numNodes * sizeof( facetNode_t ) ) {
+		return NULL;
+	}
+
+	// validate in place before allocating anything, all records are 4-byte aligned
+	Com_Memset( &view, 0, sizeof( view ) );
+	view.numPlanes = header.numPlanes;
+	view.planes = (patchPlane_t *)in;
+	view.numFacets = header.numFacets;
+	view.facets = (facet_t *)( in + view.numPlanes * sizeof( patchPlane_t ) );
+	view.numNodes = header.numNodes;
+	view.nodes = (facetNode_t *)( in + view.numPlanes * sizeof( patchPlane_t ) + view.numFacets * sizeof( facet_t ) );
+
+	if ( !CM_ValidatePatchCollide( &view ) ) {
+		return NULL;
+	}
+
+	pc = CM_Alloc( sizeof( *pc ) );
+	VectorCopy( header.bounds[0], pc->bounds[0] );
+	VectorCopy( header.bounds[1], pc->bounds[1] );
+
+	pc->numPlanes = view.numPlanes;
+	pc->planes = CM_Alloc( pc->numPlanes * sizeof( patchPlane_t ) );
+	Com_Memcpy( pc->planes, view.planes, pc->numPlanes * sizeof( patchPlane_t ) );
+
+	pc->numFacets = view.numFacets;
+	pc->facets = CM_Alloc( pc->numFacets * sizeof( facet_t ) );
+	Com_Memcpy( pc->facets, view.facets, pc->numFacets * sizeof( facet_t ) );
+
+	pc->numNodes = view.numNodes;
+	if ( pc->numNodes ) {
+		pc->nodes = CM_Alloc( pc->numNodes * sizeof( facetNode_t ) );
+		Com_Memcpy( pc->nodes, view.nodes, pc->numNodes * sizeof( facetNode_t ) );
+	}
+
+	*out = pc;
+	return (const byte *)( view.nodes + view.numNodes );
+}
+
+
+/*
+================================================================================
+
+PARALLEL PATCH COLLIDE GENERATION
+
+================================================================================
+*/
+
+typedef struct {
+	byte		*data;			// malloc'ed CM_SavePatchCollide-style record
+	int			size;
+} patchResult_t;
+
+typedef struct {
+	const patchSource_t	*sources;
+	patchResult_t	*results;
+	int				count;
+	int				numChunks;
+	patchWork_t		*works;			// one per chunk
+	int				errorIndex[MAX_JOB_WORKERS+1];
+	int				blocks[MAX_JOB_WORKERS+1];
+} patchBatch_t;
+
+
+/*
+===================
+CM_PackPatchWork
+
+Stores generated data in the same layout as used by the patch cache
+===================
+*/
+static qboolean CM_PackPatchWork( const patchWork_t *pw, patchResult_t *result ) {
+	patchCollideHeader_t header;
+	int planesSize, facetsSize, nodesSize;
+	byte *out;
+
+	VectorCopy( pw->bounds[0], header.bounds[0] );
+	VectorCopy( pw->bounds[1], header.bounds[1] );
+	header.numPlanes = pw->numPlanes;
+	header.numFacets = pw->numFacets;
+	header.numNodes = pw->numFacetNodes;
+
+	planesSize = header.numPlanes * sizeof( patchPlane_t );
+	facetsSize = header.numFacets * sizeof( facet_t );
+	nodesSize = header.numNodes * sizeof( facetNode_t );
+
+	result->size = sizeof( header ) + planesSize + facetsSize + nodesSize;
+	result->data = out = malloc( result->size );
+	if ( !out ) {
+		return qfalse;
+	}
+
+	Com_Memcpy( out, &header, sizeof( header ) );
+	out += sizeof( header );
+	Com_Memcpy( out, pw->planes, planesSize );
+	out += planesSize;
+	Com_Memcpy( out, pw->facets, facetsSize );
+	out += facetsSize;
+	Com_Memcpy( out, pw->facetNodes, nodesSize );
+
+	return qtrue;
+}
+
+
+/*
+===================
+CM_PatchChunkJob
+
+Generates every numChunks-th patch starting from chunk index,
+stops at the first error. Windings of each patch come from the
+scratch arena of the thread and are released even on errors
+===================
+*/
+static void CM_PatchChunkJob( void *data, int chunk ) {
+	patchBatch_t *batch = (patchBatch_t *)data;
+	patchWork_t *pw = &batch->works[ chunk ];
+	const patchSource_t *src;
+	windingScope_t scope;
+	volatile int index;
+
+	pw->deferred = qtrue;
+	pw->numWarnings = 0;
+	batch->errorIndex[ chunk ] = -1;
+	batch->blocks[ chunk ] = 0;
+
+	scope.error = CM_PatchWindingError;
+	scope.arg = pw;
+
+	for ( index = chunk; index < batch->count; index += batch->numChunks ) {
+		BeginWindingScope( &scope );
+		if ( Q_setjmp( pw->abortMark ) ) {
+			EndWindingScope();
+			batch->errorIndex[ chunk ] = index;
+			return;
+		}
+		src = &batch->sources[ index ];
+		batch->blocks[ chunk ] += CM_GeneratePatchWork( pw, src->width, src->height, src->points );
+		EndWindingScope();
+		if ( !CM_PackPatchWork( pw, &batch->results[ index ] ) ) {
+			pw->errorCode = ERR_FATAL;
+			Q_strncpyz( pw->error, "CM_GeneratePatchCollides: out of memory", sizeof( pw->error ) );
+			batch->errorIndex[ chunk ] = index;
+			return;
+		}
+	}
+}
+
+
+/*
+===================
+CM_GeneratePatchCollides
+
+Generates collision data for a set of patches using job threads,
+results are identical to calling CM_GeneratePatchCollide() in order
+===================
+*/
+void CM_GeneratePatchCollides( int count, const patchSource_t *sources, struct patchCollide_s **out ) {
+	patchBatch_t batch;
+	const patchResult_t *result;
+	int i, errorChunk, numWarnings;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	Com_Memset( &batch, 0, sizeof( batch ) );
+	batch.numChunks = Com_JobWorkers() + 1;
+	if ( batch.numChunks > count ) {
+		batch.numChunks = count;
+	}
+
+	if ( batch.numChunks <= 1 ) {
+		for ( i = 0; i < count; i++ ) {
+			out[i] = CM_GeneratePatchCollide( sources[i].width, sources[i].height, sources[i].points );
+		}
+		return;
+	}
+
+	batch.sources = sources;
+	batch.count = count;
+	batch.results = Z_Malloc( count * sizeof( batch.results[0] ) );
+	batch.works = Hunk_AllocateTempMemory( batch.numChunks * sizeof( batch.works[0] ) );
+
+	Com_ParallelFor( CM_PatchChunkJob, &batch, batch.numChunks );
+
+	// report the error that serial generation would hit first
+	errorChunk = -1;
+	numWarnings = 0;
+	for ( i = 0; i < batch.numChunks; i++ ) {
+		if ( batch.errorIndex[i] >= 0 && ( errorChunk < 0 || batch.errorIndex[i] < batch.errorIndex[ errorChunk ] ) ) {
+			errorChunk = i;
+		}
+		numWarnings += batch.works[i].numWarnings;
+		c_totalPatchBlocks += batch.blocks[i];
+	}
+
+	if ( errorChunk >= 0 ) {
+		for ( i = 0; i < count; i++ ) {
+			free( batch.results[i].data );
+		}
+		Z_Free( batch.results );
+		Com_Memcpy( &mainPatchWork.error, batch.works[ errorChunk ].error, sizeof( mainPatchWork.error ) );
+		i = batch.works[ errorChunk ].errorCode;
+		Hunk_FreeTempMemory( batch.works );
+		Com_Error( i, "%s", mainPatchWork.error );
+	}
+
+	Hunk_FreeTempMemory( batch.works );
+
+	for ( i = 0, result = batch.results; i < count; i++, result++ ) {
+		CM_LoadPatchCollide( result->data, result->data + result->size, &out[i] );
+		free( result->data );
+		if ( !out[i] ) {
+			Z_Free( batch.results );
+			Com_Error( ERR_DROP, "CM_GeneratePatchCollides: bad data for patch %i", i );
+		}
+	}
+
+	Z_Free( batch.results );
+
+	if ( numWarnings ) {
+		Com_DPrintf( "WARNING: %i patch collision warnings\n", numWarnings );
+	}
+}
+#endif // !BSPC
+
 /*
 ================================================================================
 
@@ -1419,41 +1901,67 @@ static int CM_CheckFacetPlane( const float *plane, const vec3_t start, const vec
 
 /*
 ====================
-CM_TraceThroughPatchCollide
+CM_TraceThroughFacet
 ====================
 */
-void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
-	int i, j, hit, hitnum;
+static void CM_TraceThroughFacet( traceWork_t *tw, const patchCollide_t *pc, const facet_t *facet ) {
+	int j, hit, hitnum;
 	float offset, enterFrac, leaveFrac, t;
-	patchPlane_t *pp;
-	facet_t	*facet;
+	const patchPlane_t *pp;
 	float plane[4], bestplane[4];
 	vec3_t startp, endp;
 #ifndef BSPC
 	static cvar_t *cv;
 #endif //BSPC
 
-	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
-				pc->bounds[0], pc->bounds[1] ) ) {
-		return;
+	Vector4Set(bestplane, 0, 0, 0, 0);
+
+	enterFrac = -1.0;
+	leaveFrac = 1.0;
+	hitnum = -1;
+	//
+	pp = &pc->planes[ facet->surfacePlane ];
+	VectorCopy(pp->plane, plane);
+	plane[3] = pp->plane[3];
+	if ( tw->sphere.use ) {
+		// adjust the plane distance appropriately for radius
+		plane[3] += tw->sphere.radius;
+
+		// find the closest point on the capsule to the plane
+		t = DotProduct( plane, tw->sphere.offset );
+		if ( t > 0.0f ) {
+			VectorSubtract( tw->start, tw->sphere.offset, startp );
+			VectorSubtract( tw->end, tw->sphere.offset, endp );
+		}
+		else {
+			VectorAdd( tw->start, tw->sphere.offset, startp );
+			VectorAdd( tw->end, tw->sphere.offset, endp );
+		}
+	}
+	else {
+		offset = DotProduct( tw->offsets[ pp->signbits ], plane );
+		plane[3] -= offset;
+		VectorCopy( tw->start, startp );
+		VectorCopy( tw->end, endp );
 	}
 
-	if (tw->isPoint) {
-		CM_TracePointThroughPatchCollide( tw, pc );
+	if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
 		return;
 	}
+	if (hit) {
+		Vector4Copy(plane, bestplane);
+	}
 
-	Vector4Set(bestplane, 0, 0, 0, 0);
-
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		enterFrac = -1.0;
-		leaveFrac = 1.0;
-		hitnum = -1;
-		//
-		pp = &pc->planes[ facet->surfacePlane ];
-		VectorCopy(pp->plane, plane);
-		plane[3] = pp->plane[3];
+	for ( j = 0; j < facet->numBorders; j++ ) {
+		pp = &pc->planes[ facet->borderPlanes[j] ];
+		if (facet->borderInward[j]) {
+			VectorNegate(pp->plane, plane);
+			plane[3] = -pp->plane[3];
+		}
+		else {
+			VectorCopy(pp->plane, plane);
+			plane[3] = pp->plane[3];
+		}
 		if ( tw->sphere.use ) {
 			// adjust the plane distance appropriately for radius
 			plane[3] += tw->sphere.radius;
@@ -1470,84 +1978,92 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 			}
 		}
 		else {
+			// NOTE: this works even though the plane might be flipped because the bbox is centered
 			offset = DotProduct( tw->offsets[ pp->signbits ], plane );
-			plane[3] -= offset;
+			plane[3] += fabs(offset);
 			VectorCopy( tw->start, startp );
 			VectorCopy( tw->end, endp );
 		}
 
 		if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
-			continue;
+			return;
 		}
 		if (hit) {
+			hitnum = j;
 			Vector4Copy(plane, bestplane);
 		}
-
-		for ( j = 0; j < facet->numBorders; j++ ) {
-			pp = &pc->planes[ facet->borderPlanes[j] ];
-			if (facet->borderInward[j]) {
-				VectorNegate(pp->plane, plane);
-				plane[3] = -pp->plane[3];
-			}
-			else {
-				VectorCopy(pp->plane, plane);
-				plane[3] = pp->plane[3];
-			}
-			if ( tw->sphere.use ) {
-				// adjust the plane distance appropriately for radius
-				plane[3] += tw->sphere.radius;
-
-				// find the closest point on the capsule to the plane
-				t = DotProduct( plane, tw->sphere.offset );
-				if ( t > 0.0f ) {
-					VectorSubtract( tw->start, tw->sphere.offset, startp );
-					VectorSubtract( tw->end, tw->sphere.offset, endp );
-				}
-				else {
-					VectorAdd( tw->start, tw->sphere.offset, startp );
-					VectorAdd( tw->end, tw->sphere.offset, endp );
-				}
+	}
+	//never clip against the back side
+	if (hitnum == facet->numBorders - 1) return;
+
+	if (enterFrac < leaveFrac && enterFrac >= 0) {
+		if (enterFrac < tw->trace.fraction) {
+			//if (enterFrac < 0) {
+			//	enterFrac = 0;
+			//}
+#ifndef BSPC
+			if (!cv) {
+				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 			}
-			else {
-				// NOTE: this works even though the plane might be flipped because the bbox is centered
-				offset = DotProduct( tw->offsets[ pp->signbits ], plane );
-				plane[3] += fabs(offset);
-				VectorCopy( tw->start, startp );
-				VectorCopy( tw->end, endp );
+			if (cv && cv->integer) {
+				debugPatchCollide = pc;
+				debugFacet = facet;
 			}
+#endif //BSPC
 
-			if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
-				break;
-			}
-			if (hit) {
-				hitnum = j;
-				Vector4Copy(plane, bestplane);
-			}
+			tw->trace.fraction = enterFrac;
+			VectorCopy( bestplane, tw->trace.plane.normal );
+			tw->trace.plane.dist = bestplane[3];
 		}
-		if (j < facet->numBorders) continue;
-		//never clip against the back side
-		if (hitnum == facet->numBorders - 1) continue;
+	}
+}
 
-		if (enterFrac < leaveFrac && enterFrac >= 0) {
-			if (enterFrac < tw->trace.fraction) {
-				//if (enterFrac < 0) {
-				//	enterFrac = 0;
-				//}
-#ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
-					debugPatchCollide = pc;
-					debugFacet = facet;
-				}
-#endif //BSPC
 
-				tw->trace.fraction = enterFrac;
-				VectorCopy( bestplane, tw->trace.plane.normal );
-				tw->trace.plane.dist = bestplane[3];
+/*
+====================
+CM_TraceThroughPatchCollide
+====================
+*/
+void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
+	int stack[ MAX_FACET_DEPTH ];
+	const facetNode_t *node;
+	int i, depth;
+
+	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+				pc->bounds[0], pc->bounds[1] ) ) {
+		return;
+	}
+
+	if (tw->isPoint) {
+		CM_TracePointThroughPatchCollide( tw, pc );
+		return;
+	}
+
+	if ( !pc->numNodes ) {
+		for ( i = 0 ; i < pc->numFacets ; i++ ) {
+			CM_TraceThroughFacet( tw, pc, &pc->facets[i] );
+		}
+		return;
+	}
+
+	// walk facet hierarchy in order
+	depth = 0;
+	node = pc->nodes;
+	for ( ;; ) {
+		if ( CM_BoundsIntersect( tw->bounds[0], tw->bounds[1], node->bounds[0], node->bounds[1] ) ) {
+			if ( !node->numFacets ) {
+				stack[ depth++ ] = node->secondChild;
+				node++;
+				continue;
+			}
+			for ( i = node->firstFacet ; i < node->firstFacet + node->numFacets ; i++ ) {
+				CM_TraceThroughFacet( tw, pc, &pc->facets[i] );
 			}
 		}
+		if ( !depth ) {
+			break;
+		}
+		node = pc->nodes + stack[ --depth ];
 	}
 }
 
@@ -1562,33 +2078,59 @@ POSITION TEST
 
 /*
 ====================
-CM_PositionTestInPatchCollide
+CM_PositionTestInFacet
 ====================
 */
-qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
-	int i, j;
+static qboolean CM_PositionTestInFacet( const traceWork_t *tw, const patchCollide_t *pc, const facet_t *facet ) {
+	int j;
 	float offset, t;
-	patchPlane_t *pp;
-	facet_t	*facet;
+	const patchPlane_t *pp;
 	float plane[4];
 	vec3_t startp;
 
-	if (tw->isPoint) {
+	pp = &pc->planes[ facet->surfacePlane ];
+	VectorCopy(pp->plane, plane);
+	plane[3] = pp->plane[3];
+	if ( tw->sphere.use ) {
+		// adjust the plane distance appropriately for radius
+		plane[3] += tw->sphere.radius;
+
+		// find the closest point on the capsule to the plane
+		t = DotProduct( plane, tw->sphere.offset );
+		if ( t > 0 ) {
+			VectorSubtract( tw->start, tw->sphere.offset, startp );
+		}
+		else {
+			VectorAdd( tw->start, tw->sphere.offset, startp );
+		}
+	}
+	else {
+		offset = DotProduct( tw->offsets[ pp->signbits ], plane);
+		plane[3] -= offset;
+		VectorCopy( tw->start, startp );
+	}
+
+	if ( DotProduct( plane, startp ) - plane[3] > 0.0f ) {
 		return qfalse;
 	}
-	//
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		pp = &pc->planes[ facet->surfacePlane ];
-		VectorCopy(pp->plane, plane);
-		plane[3] = pp->plane[3];
+
+	for ( j = 0; j < facet->numBorders; j++ ) {
+		pp = &pc->planes[ facet->borderPlanes[j] ];
+		if (facet->borderInward[j]) {
+			VectorNegate(pp->plane, plane);
+			plane[3] = -pp->plane[3];
+		}
+		else {
+			VectorCopy(pp->plane, plane);
+			plane[3] = pp->plane[3];
+		}
 		if ( tw->sphere.use ) {
 			// adjust the plane distance appropriately for radius
 			plane[3] += tw->sphere.radius;
 
 			// find the closest point on the capsule to the plane
 			t = DotProduct( plane, tw->sphere.offset );
-			if ( t > 0 ) {
+			if ( t > 0.0f ) {
 				VectorSubtract( tw->start, tw->sphere.offset, startp );
 			}
 			else {
@@ -1596,55 +2138,66 @@ qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchColli
 			}
 		}
 		else {
+			// NOTE: this works even though the plane might be flipped because the bbox is centered
 			offset = DotProduct( tw->offsets[ pp->signbits ], plane);
-			plane[3] -= offset;
+			plane[3] += fabs(offset);
 			VectorCopy( tw->start, startp );
 		}
 
 		if ( DotProduct( plane, startp ) - plane[3] > 0.0f ) {
-			continue;
+			return qfalse;
 		}
+	}
 
-		for ( j = 0; j < facet->numBorders; j++ ) {
-			pp = &pc->planes[ facet->borderPlanes[j] ];
-			if (facet->borderInward[j]) {
-				VectorNegate(pp->plane, plane);
-				plane[3] = -pp->plane[3];
+	// inside this patch facet
+	return qtrue;
+}
+
+
+/*
+====================
+CM_PositionTestInPatchCollide
+====================
+*/
+qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
+	int stack[ MAX_FACET_DEPTH ];
+	const facetNode_t *node;
+	int i, depth;
+
+	if (tw->isPoint) {
+		return qfalse;
+	}
+
+	if ( !pc->numNodes ) {
+		for ( i = 0 ; i < pc->numFacets ; i++ ) {
+			if ( CM_PositionTestInFacet( tw, pc, &pc->facets[i] ) ) {
+				return qtrue;
 			}
-			else {
-				VectorCopy(pp->plane, plane);
-				plane[3] = pp->plane[3];
+		}
+		return qfalse;
+	}
+
+	depth = 0;
+	node = pc->nodes;
+	for ( ;; ) {
+		if ( CM_BoundsIntersect( tw->bounds[0], tw->bounds[1], node->bounds[0], node->bounds[1] ) ) {
+			if ( !node->numFacets ) {
+				stack[ depth++ ] = node->secondChild;
+				node++;
+				continue;
 			}
-			if ( tw->sphere.use ) {
-				// adjust the plane distance appropriately for radius
-				plane[3] += tw->sphere.radius;
-
-				// find the closest point on the capsule to the plane
-				t = DotProduct( plane, tw->sphere.offset );
-				if ( t > 0.0f ) {
-					VectorSubtract( tw->start, tw->sphere.offset, startp );
+			for ( i = node->firstFacet ; i < node->firstFacet + node->numFacets ; i++ ) {
+				if ( CM_PositionTestInFacet( tw, pc, &pc->facets[i] ) ) {
+					return qtrue;
 				}
-				else {
-					VectorAdd( tw->start, tw->sphere.offset, startp );
-				}
-			}
-			else {
-				// NOTE: this works even though the plane might be flipped because the bbox is centered
-				offset = DotProduct( tw->offsets[ pp->signbits ], plane);
-				plane[3] += fabs(offset);
-				VectorCopy( tw->start, startp );
-			}
-
-			if ( DotProduct( plane, startp ) - plane[3] > 0.0f ) {
-				break;
 			}
 		}
-		if (j < facet->numBorders) {
-			continue;
+		if ( !depth ) {
+			break;
 		}
-		// inside this patch facet
-		return qtrue;
+		node = pc->nodes + stack[ --depth ];
 	}
+
 	return qfalse;
 }
 
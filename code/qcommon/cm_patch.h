@@ -76,12 +76,27 @@ typedef struct {
 	qboolean	borderNoAdjust[4+6+16];
 } facet_t;
 
+// bounding volume hierarchy node over consecutive facets,
+// the first child always follows its parent
+typedef struct {
+	vec3_t	bounds[2];
+	int		firstFacet;
+	int		numFacets;			// 0 for inner nodes
+	int		secondChild;
+} facetNode_t;
+
+#define	FACET_LEAF_SIZE		4
+#define	MAX_FACET_NODES		(MAX_FACETS*2)
+#define	MAX_FACET_DEPTH		32
+
 typedef struct patchCollide_s {
 	vec3_t	bounds[2];
 	int		numPlanes;			// surface planes plus edge planes
 	patchPlane_t	*planes;
 	int		numFacets;
 	facet_t	*facets;
+	int		numNodes;
+	facetNode_t	*nodes;
 } patchCollide_t;
 
 
@@ -100,4 +115,4 @@ typedef struct {
 #define	WRAP_POINT_EPSILON	0.1
 
 
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
+struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, const vec3_t *points );
@@ -26,13 +26,80 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "cm_local.h"
 
 
-// counters are only bumped when running single threaded,
+// counters are only bumped outside of winding scopes,
 // because they are an awful coherence problem
 static int c_active_windings;
 static int c_peak_windings;
 static int c_winding_allocs;
 static int c_winding_points;
 
+// every winding of a scope fits the largest clip result
+#define	SCOPE_WINDING_POINTS	( MAX_POINTS_ON_WINDING + 4 )
+
+typedef union scopeBlock_u {
+	union scopeBlock_u *next;
+	double		align;
+} scopeBlock_t;
+
+#define	SCOPE_BLOCK_SIZE	( sizeof( scopeBlock_t ) + sizeof( winding_t ) - sizeof( vec3_t[4] ) + sizeof( vec3_t ) * SCOPE_WINDING_POINTS )
+
+static THREAD_LOCAL windingScope_t *windingScope;
+
+
+/*
+=============
+BeginWindingScope
+
+Windings allocated by the calling thread until EndWindingScope come from
+its scratch arena and errors go to scope->error instead of Com_Error,
+so polylib can be used from job callbacks
+=============
+*/
+void BeginWindingScope( windingScope_t *scope )
+{
+	scope->freeList = NULL;
+	scope->mark = Com_ScratchMark();
+	windingScope = scope;
+}
+
+
+/*
+=============
+EndWindingScope
+
+Releases all windings of the scope, including ones left by an error
+=============
+*/
+void EndWindingScope( void )
+{
+	if ( windingScope ) {
+		Com_ScratchRelease( windingScope->mark );
+		windingScope = NULL;
+	}
+}
+
+
+/*
+=============
+WindingError
+=============
+*/
+static void QDECL WindingError( int code, const char *fmt, ... )
+{
+	char		msg[ MAX_STRING_CHARS ];
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+	va_end( argptr );
+
+	if ( windingScope ) {
+		windingScope->error( windingScope->arg, code, msg );
+	}
+
+	Com_Error( code, "%s", msg );
+}
+
 #if 0
 static void pw(winding_t *w)
 {
@@ -51,15 +118,32 @@ AllocWinding
 static winding_t *AllocWinding( int points )
 {
 	winding_t	*w;
+	scopeBlock_t	*block;
 	size_t		s;
 
+	s = sizeof( *w ) - sizeof( w->p ) + sizeof( w->p[0] ) * points;
+
+	if ( windingScope ) {
+		if ( points > SCOPE_WINDING_POINTS ) {
+			WindingError( ERR_DROP, "AllocWinding: %i points", points );
+		}
+		block = windingScope->freeList;
+		if ( block ) {
+			windingScope->freeList = block->next;
+		} else {
+			block = Com_ScratchAlloc( SCOPE_BLOCK_SIZE );
+		}
+		w = (winding_t *)( block + 1 );
+		Com_Memset( w, 0, s );
+		return w;
+	}
+
 	c_winding_allocs++;
 	c_winding_points += points;
 	c_active_windings++;
 	if ( c_active_windings > c_peak_windings )
 		c_peak_windings = c_active_windings;
 
-	s = sizeof( *w ) - sizeof( w->p ) + sizeof( w->p[0] ) * points;
 	w = Z_Malloc( s );
 	Com_Memset( w, 0, s );
 	return w;
@@ -68,10 +152,19 @@ static winding_t *AllocWinding( int points )
 
 void FreeWinding (winding_t *w)
 {
+	scopeBlock_t *block;
+
 	if (*(unsigned *)w == 0xdeaddead)
-		Com_Error (ERR_FATAL, "FreeWinding: freed a freed winding");
+		WindingError (ERR_FATAL, "FreeWinding: freed a freed winding");
 	*(unsigned *)w = 0xdeaddead;
 
+	if ( windingScope ) {
+		block = (scopeBlock_t *)w - 1;
+		block->next = windingScope->freeList;
+		windingScope->freeList = block;
+		return;
+	}
+
 	c_active_windings--;
 	Z_Free (w);
 }
@@ -225,7 +318,7 @@ winding_t *BaseWindingForPlane (vec3_t normal, vec_t dist)
 		}
 	}
 	if (x==-1)
-		Com_Error (ERR_DROP, "BaseWindingForPlane: no axis found");
+		WindingError (ERR_DROP, "BaseWindingForPlane: no axis found");
 		
 	VectorCopy (vec3_origin, vup);
 	switch (x)
@@ -417,9 +510,9 @@ static void ClipWindingEpsilon( winding_t *in, vec3_t normal, vec_t dist, vec_t
 	}
 	
 	if (f->numpoints > maxpts || b->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING || b->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 }
 
 
@@ -523,9 +616,9 @@ void ChopWindingInPlace( winding_t **inout, const vec3_t normal, vec_t dist, vec
 	}
 	
 	if (f->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 
 	FreeWinding (in);
 	*inout = f;
@@ -568,11 +661,11 @@ void CheckWinding (winding_t *w)
 	vec_t	facedist;
 
 	if (w->numpoints < 3)
-		Com_Error (ERR_DROP, "CheckWinding: %i points",w->numpoints);
+		WindingError (ERR_DROP, "CheckWinding: %i points",w->numpoints);
 	
 	area = WindingArea(w);
 	if (area < 1)
-		Com_Error (ERR_DROP, "CheckWinding: %f area", area);
+		WindingError (ERR_DROP, "CheckWinding: %f area", area);
 
 	WindingPlane (w, facenormal, &facedist);
 	
@@ -582,21 +675,21 @@ void CheckWinding (winding_t *w)
 
 		for (j=0 ; j<3 ; j++)
 			if (p1[j] > MAX_MAP_BOUNDS || p1[j] < -MAX_MAP_BOUNDS)
-				Com_Error (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
+				WindingError (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
 
 		j = i+1 == w->numpoints ? 0 : i+1;
 		
 	// check the point is on the face plane
 		d = DotProduct (p1, facenormal) - facedist;
 		if (d < -ON_EPSILON || d > ON_EPSILON)
-			Com_Error (ERR_DROP, "CheckWinding: point off plane");
+			WindingError (ERR_DROP, "CheckWinding: point off plane");
 	
 	// check the edge is not degenerate
 		p2 = w->p[j];
 		VectorSubtract (p2, p1, dir);
 		
 		if (VectorLength (dir) < ON_EPSILON)
-			Com_Error (ERR_DROP, "CheckWinding: degenerate edge");
+			WindingError (ERR_DROP, "CheckWinding: degenerate edge");
 			
 		CrossProduct (facenormal, dir, edgenormal);
 		VectorNormalize2 (edgenormal, edgenormal);
@@ -610,7 +703,7 @@ void CheckWinding (winding_t *w)
 				continue;
 			d = DotProduct (w->p[j], edgenormal);
 			if (d > edgedist)
-				Com_Error (ERR_DROP, "CheckWinding: non-convex");
+				WindingError (ERR_DROP, "CheckWinding: non-convex");
 		}
 	}
 }
@@ -44,6 +44,16 @@ typedef struct
 #define	ON_EPSILON	0.1f
 #endif
 
+typedef struct {
+	void	(*error)( void *arg, int code, const char *msg );	// must not return
+	void	*arg;
+	void	*freeList;
+	int		mark;
+} windingScope_t;
+
+void	BeginWindingScope( windingScope_t *scope );
+void	EndWindingScope( void );
+
 void	WindingCenter (winding_t *w, vec3_t center);
 winding_t	*ChopWinding (winding_t *in, vec3_t normal, vec_t dist);
 winding_t	*CopyWinding (const winding_t *w);
@@ -25,6 +25,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 void		CM_LoadMap( const char *name, qboolean clientload, int *checksum);
 void		CM_ClearMap( void );
+void		CM_Bench_f( void );
+void		CM_Record_f( void );
+void		CM_Replay_f( void );
+void		CM_FloodStats_f( void );
+void		CM_FloodStatsFrame( void );
 clipHandle_t CM_InlineModel( int index );		// 0 = world, 1 + are bmodels
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule );
 
@@ -47,6 +52,7 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						const vec3_t origin, const vec3_t angles, qboolean capsule );
 
 byte		*CM_ClusterPVS (int cluster);
+const uint64_t *CM_ClusterPVSWords( int cluster, int *numWords );
 
 int			CM_PointLeafnum( const vec3_t p );
 
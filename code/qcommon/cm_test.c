@@ -322,6 +322,22 @@ byte	*CM_ClusterPVS (int cluster) {
 }
 
 
+/*
+=================
+CM_ClusterPVSWords
+
+Same row as CM_ClusterPVS() accessed as 64-bit words, see Com_NextBit()
+=================
+*/
+const uint64_t *CM_ClusterPVSWords( int cluster, int *numWords ) {
+	if ( numWords ) {
+		*numWords = cm.clusterWords;
+	}
+
+	return (const uint64_t *)CM_ClusterPVS( cluster );
+}
+
+
 
 /*
 ===============================================================================
@@ -331,6 +347,16 @@ AREAPORTALS
 ===============================================================================
 */
 
+// flood cost statistics, counted in visited areas
+static int	floodCost;			// since last CM_FloodStatsFrame()
+static int	floodFrames;
+static int	floodFramePeak;
+static int64_t	floodTotalCost;
+static int	floodPortalChanges;
+static int	floodFullFloods;
+static int	floodPartialFloods;
+
+
 static void CM_FloodArea_r( int areaNum, int floodnum) {
 	int		i;
 	cArea_t *area;
@@ -346,6 +372,7 @@ static void CM_FloodArea_r( int areaNum, int floodnum) {
 
 	area->floodnum = floodnum;
 	area->floodvalid = cm.floodvalid;
+	floodCost++;
 	con = cm.areaPortals + areaNum * cm.numAreas;
 	for ( i=0 ; i < cm.numAreas  ; i++ ) {
 		if ( con[i] > 0 ) {
@@ -378,8 +405,51 @@ void	CM_FloodAreaConnections( void ) {
 		CM_FloodArea_r (i, floodnum);
 	}
 
+	cm.lastFloodnum = floodnum;
+	floodFullFloods++;
 }
 
+
+/*
+====================
+CM_UpdateAreaConnections
+
+Updates flood numbers after connection between two areas appeared or
+disappeared, only areas of the affected component are visited
+====================
+*/
+static void CM_UpdateAreaConnections( int area1, int area2, qboolean open ) {
+	int		i, oldnum, newnum;
+
+	if ( cm.lastFloodnum >= MAX_QINT - 1 ) {
+		CM_FloodAreaConnections();
+		return;
+	}
+
+	if ( open ) {
+		// merge two components by renumbering one of them
+		oldnum = cm.areas[ area2 ].floodnum;
+		newnum = cm.areas[ area1 ].floodnum;
+		if ( oldnum == newnum ) {
+			return;
+		}
+		for ( i = 0 ; i < cm.numAreas ; i++ ) {
+			if ( cm.areas[ i ].floodnum == oldnum ) {
+				cm.areas[ i ].floodnum = newnum;
+				floodCost++;
+			}
+		}
+	} else {
+		// component may split, give everything still reachable
+		// from area1 a new number, the rest keeps the old one
+		cm.floodvalid++;
+		CM_FloodArea_r( area1, ++cm.lastFloodnum );
+	}
+
+	floodPartialFloods++;
+}
+
+
 /*
 ====================
 CM_AdjustAreaPortalState
@@ -387,6 +457,8 @@ CM_AdjustAreaPortalState
 ====================
 */
 void	CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
+	int		count;
+
 	if ( area1 < 0 || area2 < 0 ) {
 		return;
 	}
@@ -397,18 +469,71 @@ void	CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
 
 	if ( open ) {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]++;
-		cm.areaPortals[ area2 * cm.numAreas + area1 ]++;
+		count = ++cm.areaPortals[ area2 * cm.numAreas + area1 ];
 	} else {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]--;
-		cm.areaPortals[ area2 * cm.numAreas + area1 ]--;
-		if ( cm.areaPortals[ area2 * cm.numAreas + area1 ] < 0 ) {
+		count = --cm.areaPortals[ area2 * cm.numAreas + area1 ];
+		if ( count < 0 ) {
 			Com_Error (ERR_DROP, "CM_AdjustAreaPortalState: negative reference count");
 		}
 	}
 
-	CM_FloodAreaConnections ();
+	floodPortalChanges++;
+
+	// connectivity changes only when reference count goes from or to zero
+	if ( ( open && count == 1 ) || ( !open && count == 0 ) ) {
+		if ( area1 == area2 ) {
+			return;
+		}
+#ifndef BSPC
+		if ( !cm_incrementalFlood->integer ) {
+			CM_FloodAreaConnections();
+			return;
+		}
+#endif
+		CM_UpdateAreaConnections( area1, area2, open );
+	}
 }
 
+
+/*
+====================
+CM_FloodStatsFrame
+
+Accumulates flood cost of the finished server frame
+====================
+*/
+void CM_FloodStatsFrame( void ) {
+	floodFrames++;
+	floodTotalCost += floodCost;
+	if ( floodCost > floodFramePeak ) {
+		floodFramePeak = floodCost;
+	}
+	floodCost = 0;
+}
+
+
+#ifndef BSPC
+/*
+====================
+CM_FloodStats_f
+====================
+*/
+void CM_FloodStats_f( void ) {
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		floodFrames = floodFramePeak = 0;
+		floodTotalCost = 0;
+		floodPortalChanges = floodFullFloods = floodPartialFloods = 0;
+		return;
+	}
+
+	Com_Printf( "area flood: %s, %i areas\n", cm_incrementalFlood && cm_incrementalFlood->integer ? "incremental" : "full", cm.numAreas );
+	Com_Printf( "%i portal changes, %i full floods, %i partial updates\n", floodPortalChanges, floodFullFloods, floodPartialFloods );
+	Com_Printf( "%i frames, %.2f area visits per frame, %i peak\n", floodFrames,
+		floodFrames ? (double)floodTotalCost / floodFrames : 0.0, floodFramePeak );
+}
+#endif
+
 /*
 ====================
 CM_AreasConnected
@@ -20,6 +20,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 #include "cm_local.h"
+#ifdef CM_SIMD_PLANES
+#include <emmintrin.h>
+#endif
 
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
@@ -138,6 +141,165 @@ static float SquareRootFloat(float number) {
 }
 
 
+#ifdef CM_SIMD_PLANES
+/*
+===============================================================================
+
+SIMD PLANE TESTS
+
+Both functions process one block of four brush planes and repeat
+operations of the scalar code exactly, including float/double
+conversions, so results are bit-identical
+
+===============================================================================
+*/
+
+/*
+================
+CM_SelectOffset
+
+Per-lane tw->offsets[ signbits ] component
+================
+*/
+static ID_INLINE __m128d CM_SelectOffset( __m128d normal, const float *size, int axis ) {
+	const __m128d neg = _mm_cmplt_pd( normal, _mm_setzero_pd() );
+	return _mm_or_pd( _mm_and_pd( neg, _mm_set1_pd( size[3 + axis] ) ), _mm_andnot_pd( neg, _mm_set1_pd( size[axis] ) ) );
+}
+
+
+/*
+================
+CM_DotProduct2
+================
+*/
+static ID_INLINE __m128d CM_DotProduct2( const vec3_t v, __m128d nx, __m128d ny, __m128d nz ) {
+	__m128d d;
+	d = _mm_mul_pd( _mm_set1_pd( v[0] ), nx );
+	d = _mm_add_pd( d, _mm_mul_pd( _mm_set1_pd( v[1] ), ny ) );
+	d = _mm_add_pd( d, _mm_mul_pd( _mm_set1_pd( v[2] ), nz ) );
+	return d;
+}
+
+
+/*
+================
+CM_TracePlanes4
+
+Start and end distances for CM_TraceThroughBrush box traces
+================
+*/
+static void CM_TracePlanes4( const traceWork_t *tw, const float *block, double *d1, double *d2 ) {
+	const float *size = tw->size[0];
+	__m128 nx4, ny4, nz4, dist4;
+	__m128d nx, ny, nz, dist, offs;
+	int i;
+
+	nx4 = _mm_loadu_ps( block + 0 );
+	ny4 = _mm_loadu_ps( block + 4 );
+	nz4 = _mm_loadu_ps( block + 8 );
+	dist4 = _mm_loadu_ps( block + 12 );
+
+	for ( i = 0; i < 4; i += 2 ) {
+		nx = _mm_cvtps_pd( nx4 );
+		ny = _mm_cvtps_pd( ny4 );
+		nz = _mm_cvtps_pd( nz4 );
+		dist = _mm_cvtps_pd( dist4 );
+
+		// dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal )
+		offs = _mm_mul_pd( CM_SelectOffset( nx, size, 0 ), nx );
+		offs = _mm_add_pd( offs, _mm_mul_pd( CM_SelectOffset( ny, size, 1 ), ny ) );
+		offs = _mm_add_pd( offs, _mm_mul_pd( CM_SelectOffset( nz, size, 2 ), nz ) );
+		dist = _mm_sub_pd( dist, offs );
+
+		_mm_storeu_pd( d1 + i, _mm_sub_pd( CM_DotProduct2( tw->start, nx, ny, nz ), dist ) );
+		_mm_storeu_pd( d2 + i, _mm_sub_pd( CM_DotProduct2( tw->end, nx, ny, nz ), dist ) );
+
+		nx4 = _mm_movehl_ps( nx4, nx4 );
+		ny4 = _mm_movehl_ps( ny4, ny4 );
+		nz4 = _mm_movehl_ps( nz4, nz4 );
+		dist4 = _mm_movehl_ps( dist4, dist4 );
+	}
+}
+
+
+/*
+================
+CM_TracePointPlanes4
+
+CM_TracePlanes4 for traces with zero extents, plane distances need no adjustment
+================
+*/
+static void CM_TracePointPlanes4( const traceWork_t *tw, const float *block, double *d1, double *d2 ) {
+	__m128 nx4, ny4, nz4, dist4;
+	__m128d nx, ny, nz, dist;
+	int i;
+
+	nx4 = _mm_loadu_ps( block + 0 );
+	ny4 = _mm_loadu_ps( block + 4 );
+	nz4 = _mm_loadu_ps( block + 8 );
+	dist4 = _mm_loadu_ps( block + 12 );
+
+	for ( i = 0; i < 4; i += 2 ) {
+		nx = _mm_cvtps_pd( nx4 );
+		ny = _mm_cvtps_pd( ny4 );
+		nz = _mm_cvtps_pd( nz4 );
+		dist = _mm_cvtps_pd( dist4 );
+
+		_mm_storeu_pd( d1 + i, _mm_sub_pd( CM_DotProduct2( tw->start, nx, ny, nz ), dist ) );
+		_mm_storeu_pd( d2 + i, _mm_sub_pd( CM_DotProduct2( tw->end, nx, ny, nz ), dist ) );
+
+		nx4 = _mm_movehl_ps( nx4, nx4 );
+		ny4 = _mm_movehl_ps( ny4, ny4 );
+		nz4 = _mm_movehl_ps( nz4, nz4 );
+		dist4 = _mm_movehl_ps( dist4, dist4 );
+	}
+}
+
+
+/*
+================
+CM_TestPlanes4
+
+Start distances for CM_TestBoxInBrush box tests, plane distance is
+adjusted in single precision there
+================
+*/
+static void CM_TestPlanes4( const traceWork_t *tw, const float *block, double *d1 ) {
+	const float *size = tw->size[0];
+	__m128 nx4, ny4, nz4, dist4, neg, offs;
+	__m128d nx, ny, nz;
+	int i;
+
+	nx4 = _mm_loadu_ps( block + 0 );
+	ny4 = _mm_loadu_ps( block + 4 );
+	nz4 = _mm_loadu_ps( block + 8 );
+	dist4 = _mm_loadu_ps( block + 12 );
+
+	// dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal )
+	neg = _mm_cmplt_ps( nx4, _mm_setzero_ps() );
+	offs = _mm_mul_ps( _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( size[3] ) ), _mm_andnot_ps( neg, _mm_set1_ps( size[0] ) ) ), nx4 );
+	neg = _mm_cmplt_ps( ny4, _mm_setzero_ps() );
+	offs = _mm_add_ps( offs, _mm_mul_ps( _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( size[4] ) ), _mm_andnot_ps( neg, _mm_set1_ps( size[1] ) ) ), ny4 ) );
+	neg = _mm_cmplt_ps( nz4, _mm_setzero_ps() );
+	offs = _mm_add_ps( offs, _mm_mul_ps( _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( size[5] ) ), _mm_andnot_ps( neg, _mm_set1_ps( size[2] ) ) ), nz4 ) );
+	dist4 = _mm_sub_ps( dist4, offs );
+
+	for ( i = 0; i < 4; i += 2 ) {
+		nx = _mm_cvtps_pd( nx4 );
+		ny = _mm_cvtps_pd( ny4 );
+		nz = _mm_cvtps_pd( nz4 );
+
+		_mm_storeu_pd( d1 + i, _mm_sub_pd( CM_DotProduct2( tw->start, nx, ny, nz ), _mm_cvtps_pd( dist4 ) ) );
+
+		nx4 = _mm_movehl_ps( nx4, nx4 );
+		ny4 = _mm_movehl_ps( ny4, ny4 );
+		nz4 = _mm_movehl_ps( nz4, nz4 );
+		dist4 = _mm_movehl_ps( dist4, dist4 );
+	}
+}
+#endif // CM_SIMD_PLANES
+
+
 /*
 ===============================================================================
 
@@ -200,6 +362,19 @@ static void CM_TestBoxInBrush( traceWork_t *tw, const cbrush_t *brush ) {
 				return;
 			}
 		}
+#ifdef CM_SIMD_PLANES
+	} else if ( brush->planes ) {
+		double	dd[4];
+		for ( i = 6 ; i < brush->numsides ; i++ ) {
+			if ( i == 6 || ( i & 3 ) == 0 ) {
+				CM_TestPlanes4( tw, brush->planes + ( i & ~3 ) * 4, dd );
+			}
+			// if completely in front of face, no intersection
+			if ( dd[ i & 3 ] > 0 ) {
+				return;
+			}
+		}
+#endif
 	} else {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -486,6 +661,9 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 	double		t;
 	vec3_t		startp;
 	vec3_t		endp;
+#ifdef CM_SIMD_PLANES
+	double		dd1[4], dd2[4];
+#endif
 
 	enterFrac = -1.0;
 	leaveFrac = 1.0;
@@ -579,11 +757,29 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 			side = brush->sides + i;
 			plane = side->plane;
 
-			// adjust the plane distance appropriately for mins/maxs
-			dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal );
+#ifdef CM_SIMD_PLANES
+			if ( brush->planes ) {
+				if ( ( i & 3 ) == 0 ) {
+					if ( tw->isPoint ) {
+						CM_TracePointPlanes4( tw, brush->planes + i * 4, dd1, dd2 );
+					} else {
+						CM_TracePlanes4( tw, brush->planes + i * 4, dd1, dd2 );
+					}
+				}
+				d1 = dd1[ i & 3 ];
+				d2 = dd2[ i & 3 ];
+			} else
+#endif
+			if ( tw->isPoint ) {
+				d1 = DotProductDP( tw->start, plane->normal ) - plane->dist;
+				d2 = DotProductDP( tw->end, plane->normal ) - plane->dist;
+			} else {
+				// adjust the plane distance appropriately for mins/maxs
+				dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal );
 
-			d1 = DotProductDP( tw->start, plane->normal ) - dist;
-			d2 = DotProductDP( tw->end, plane->normal ) - dist;
+				d1 = DotProductDP( tw->start, plane->normal ) - dist;
+				d2 = DotProductDP( tw->end, plane->normal ) - dist;
+			}
 
 			if (d2 > 0) {
 				getout = qtrue;	// endpoint is not in solid
@@ -1032,8 +1228,10 @@ a smaller intercept fraction.
 ==================
 */
 static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 ) {
-	cNode_t		*node;
-	cplane_t	*plane;
+	const int	*children;
+	const float	*normal;
+	float		dist;
+	int			type;
 	double		t1, t2, offset;
 	float		frac, frac2;
 	float		idist;
@@ -1055,17 +1253,28 @@ static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f,
 	// find the point distances to the separating plane
 	// and the offset for the size of the box
 	//
-	node = cm.nodes + num;
-	plane = node->plane;
+	if ( cm.flatNodes ) {
+		const cFlatNode_t *node = cm.flatNodes + num;
+		normal = node->normal;
+		dist = node->dist;
+		type = node->type;
+		children = node->children;
+	} else {
+		const cNode_t *node = cm.nodes + num;
+		normal = node->plane->normal;
+		dist = node->plane->dist;
+		type = node->plane->type;
+		children = node->children;
+	}
 
 	// adjust the plane distance appropriately for mins/maxs
-	if ( plane->type < 3 ) {
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-		offset = tw->extents[plane->type];
+	if ( type < 3 ) {
+		t1 = p1[type] - dist;
+		t2 = p2[type] - dist;
+		offset = tw->extents[type];
 	} else {
-		t1 = DotProductDP( plane->normal, p1 ) - plane->dist;
-		t2 = DotProductDP( plane->normal, p2 ) - plane->dist;
+		t1 = DotProductDP( normal, p1 ) - dist;
+		t2 = DotProductDP( normal, p2 ) - dist;
 		if ( tw->isPoint ) {
 			offset = 0;
 		} else {
@@ -1076,11 +1285,11 @@ static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f,
 
 	// see which sides we need to consider
 	if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
-		CM_TraceThroughTree( tw, node->children[0], p1f, p2f, p1, p2 );
+		CM_TraceThroughTree( tw, children[0], p1f, p2f, p1, p2 );
 		return;
 	}
 	if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
-		CM_TraceThroughTree( tw, node->children[1], p1f, p2f, p1, p2 );
+		CM_TraceThroughTree( tw, children[1], p1f, p2f, p1, p2 );
 		return;
 	}
 
@@ -1114,7 +1323,7 @@ static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f,
 	mid[1] = p1[1] + frac*(p2[1] - p1[1]);
 	mid[2] = p1[2] + frac*(p2[2] - p1[2]);
 
-	CM_TraceThroughTree( tw, node->children[side], p1f, midf, p1, mid );
+	CM_TraceThroughTree( tw, children[side], p1f, midf, p1, mid );
 
 	// go past the node
 	if ( frac2 < 0 ) {
@@ -1129,7 +1338,7 @@ static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f,
 	mid[1] = p1[1] + frac2*(p2[1] - p1[1]);
 	mid[2] = p1[2] + frac2*(p2[2] - p1[2]);
 
-	CM_TraceThroughTree( tw, node->children[side^1], midf, p2f, mid, p2 );
+	CM_TraceThroughTree( tw, children[side^1], midf, p2f, mid, p2 );
 }
 
 
@@ -1176,85 +1385,101 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 	// set basic parms
 	tw.contents = brushmask;
 
-	// adjust so that mins and maxs are always symmetric, which
-	// avoids some complications with plane expanding of rotated
-	// bmodels
-	for ( i = 0 ; i < 3 ; i++ ) {
-		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
-	}
+	if ( !sphere && !capsule && VectorCompare( mins, vec3_origin ) && VectorCompare( maxs, vec3_origin ) ) {
+		// zero extents, most of projectile and hitscan traces, skip
+		// box and sphere setup since all of it would be zero
+		for ( i = 0 ; i < 3 ; i++ ) {
+			tw.start[i] = start[i];
+			tw.end[i] = end[i];
+			if ( start[i] < end[i] ) {
+				tw.bounds[0][i] = start[i];
+				tw.bounds[1][i] = end[i];
+			} else {
+				tw.bounds[0][i] = end[i];
+				tw.bounds[1][i] = start[i];
+			}
+		}
+	} else {
+		// adjust so that mins and maxs are always symmetric, which
+		// avoids some complications with plane expanding of rotated
+		// bmodels
+		for ( i = 0 ; i < 3 ; i++ ) {
+			offset[i] = ( mins[i] + maxs[i] ) * 0.5;
+			tw.size[0][i] = mins[i] - offset[i];
+			tw.size[1][i] = maxs[i] - offset[i];
+			tw.start[i] = start[i] + offset[i];
+			tw.end[i] = end[i] + offset[i];
+		}
 
-	// if a sphere is already specified
-	if ( sphere ) {
-		tw.sphere = *sphere;
-	}
-	else {
-		tw.sphere.use = capsule;
-		tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
-	}
+		// if a sphere is already specified
+		if ( sphere ) {
+			tw.sphere = *sphere;
+		}
+		else {
+			tw.sphere.use = capsule;
+			tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
+			tw.sphere.halfheight = tw.size[1][2];
+			VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
+		}
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
+		tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
 
-	// tw.offsets[signbits] = vector to appropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
+		// tw.offsets[signbits] = vector to appropriate corner from origin
+		tw.offsets[0][0] = tw.size[0][0];
+		tw.offsets[0][1] = tw.size[0][1];
+		tw.offsets[0][2] = tw.size[0][2];
 
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+		tw.offsets[1][0] = tw.size[1][0];
+		tw.offsets[1][1] = tw.size[0][1];
+		tw.offsets[1][2] = tw.size[0][2];
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+		tw.offsets[2][0] = tw.size[0][0];
+		tw.offsets[2][1] = tw.size[1][1];
+		tw.offsets[2][2] = tw.size[0][2];
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+		tw.offsets[3][0] = tw.size[1][0];
+		tw.offsets[3][1] = tw.size[1][1];
+		tw.offsets[3][2] = tw.size[0][2];
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
+		tw.offsets[4][0] = tw.size[0][0];
+		tw.offsets[4][1] = tw.size[0][1];
+		tw.offsets[4][2] = tw.size[1][2];
 
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
+		tw.offsets[5][0] = tw.size[1][0];
+		tw.offsets[5][1] = tw.size[0][1];
+		tw.offsets[5][2] = tw.size[1][2];
 
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+		tw.offsets[6][0] = tw.size[0][0];
+		tw.offsets[6][1] = tw.size[1][1];
+		tw.offsets[6][2] = tw.size[1][2];
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+		tw.offsets[7][0] = tw.size[1][0];
+		tw.offsets[7][1] = tw.size[1][1];
+		tw.offsets[7][2] = tw.size[1][2];
 
-	//
-	// calculate bounds
-	//
-	if ( tw.sphere.use ) {
-		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
-			} else {
-				tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+		//
+		// calculate bounds
+		//
+		if ( tw.sphere.use ) {
+			for ( i = 0 ; i < 3 ; i++ ) {
+				if ( tw.start[i] < tw.end[i] ) {
+					tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
+					tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+				} else {
+					tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
+					tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+				}
 			}
 		}
-	}
-	else {
-		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
-			} else {
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+		else {
+			for ( i = 0 ; i < 3 ; i++ ) {
+				if ( tw.start[i] < tw.end[i] ) {
+					tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
+					tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
+				} else {
+					tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
+					tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+				}
 			}
 		}
 	}
@@ -1355,6 +1580,138 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 }
 
 
+/*
+===============================================================================
+
+TRACE RECORDING
+
+Queries passed to CM_BoxTrace and CM_TransformedBoxTrace can be written
+to a file during play and replayed later on the same map by cm_replay
+
+===============================================================================
+*/
+
+#define TRACE_FILE_IDENT	(('R'<<24)+('T'<<16)+('M'<<8)+'C')	// "CMTR"
+#define TRACE_FILE_VERSION	1
+
+#define TRACE_RECORD_BATCH	256
+
+#define TRF_CAPSULE			1
+#define TRF_TRANSFORMED		2
+
+typedef struct {
+	int		ident;
+	int		version;
+	char	mapName[MAX_QPATH];
+	int		checksum;
+} traceFileHeader_t;
+
+// all fields are 32-bit so byte swapping can be done per word
+typedef struct {
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	vec3_t	origin, angles;
+	vec3_t	boxMins, boxMaxs;	// bounds of the temporary box model
+	int		model;
+	int		brushmask;
+	int		flags;
+} traceFileRecord_t;
+
+static fileHandle_t			traceFile;
+static traceFileRecord_t	traceBuffer[ TRACE_RECORD_BATCH ];
+static int					traceBufferCount;
+static int					traceRecordCount;
+
+
+/*
+==================
+CM_SwapTraceRecord
+==================
+*/
+static void CM_SwapTraceRecord( traceFileRecord_t *rec ) {
+	int *words;
+	int i;
+
+	words = (int *)rec;
+	for ( i = 0; i < sizeof( *rec ) / sizeof( int ); i++ ) {
+		words[i] = LittleLong( words[i] );
+	}
+}
+
+
+/*
+==================
+CM_FlushTraceRecord
+==================
+*/
+static void CM_FlushTraceRecord( void ) {
+	int i;
+
+	if ( !traceBufferCount ) {
+		return;
+	}
+
+	for ( i = 0; i < traceBufferCount; i++ ) {
+		CM_SwapTraceRecord( &traceBuffer[i] );
+	}
+
+	FS_Write( traceBuffer, traceBufferCount * sizeof( traceBuffer[0] ), traceFile );
+	traceBufferCount = 0;
+}
+
+
+/*
+==================
+CM_RecordTrace
+==================
+*/
+static void CM_RecordTrace( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles, int flags ) {
+	traceFileRecord_t *rec;
+
+	rec = &traceBuffer[ traceBufferCount++ ];
+	VectorCopy( start, rec->start );
+	VectorCopy( end, rec->end );
+	VectorCopy( mins ? mins : vec3_origin, rec->mins );
+	VectorCopy( maxs ? maxs : vec3_origin, rec->maxs );
+	VectorCopy( origin, rec->origin );
+	VectorCopy( angles, rec->angles );
+	if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE ) {
+		CM_ModelBounds( BOX_MODEL_HANDLE, rec->boxMins, rec->boxMaxs );
+	} else {
+		VectorClear( rec->boxMins );
+		VectorClear( rec->boxMaxs );
+	}
+	rec->model = model;
+	rec->brushmask = brushmask;
+	rec->flags = flags;
+
+	traceRecordCount++;
+
+	if ( traceBufferCount == TRACE_RECORD_BATCH ) {
+		CM_FlushTraceRecord();
+	}
+}
+
+
+/*
+==================
+CM_StopTraceRecord
+==================
+*/
+void CM_StopTraceRecord( void ) {
+	if ( !traceFile ) {
+		return;
+	}
+
+	CM_FlushTraceRecord();
+	FS_FCloseFile( traceFile );
+	traceFile = FS_INVALID_HANDLE;
+
+	Com_Printf( "Stopped trace recording, %i traces written.\n", traceRecordCount );
+}
+
+
 /*
 ==================
 CM_BoxTrace
@@ -1363,6 +1720,10 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask, qboolean capsule ) {
+	if ( traceFile ) {
+		CM_RecordTrace( start, end, mins, maxs, model, brushmask, vec3_origin, vec3_origin, capsule ? TRF_CAPSULE : 0 );
+	}
+
 	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
@@ -1391,6 +1752,10 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	float		t;
 	sphere_t	sphere;
 
+	if ( traceFile ) {
+		CM_RecordTrace( start, end, mins, maxs, model, brushmask, origin, angles, TRF_TRANSFORMED | ( capsule ? TRF_CAPSULE : 0 ) );
+	}
+
 	if ( !mins ) {
 		mins = vec3_origin;
 	}
@@ -1466,3 +1831,328 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+
+/*
+==================
+CM_BenchTraces
+==================
+*/
+static int CM_BenchTraces( const vec3_t mins, const vec3_t maxs, int count, float *fractions ) {
+	static const vec3_t boxMins = { -15, -15, -24 };
+	static const vec3_t boxMaxs = { 15, 15, 32 };
+	trace_t	trace;
+	vec3_t	start, end;
+	int64_t	usec;
+	int		i, j, seed;
+
+	seed = 0x1234;
+	usec = Sys_Microseconds();
+
+	for ( i = 0; i < count; i++ ) {
+		for ( j = 0; j < 3; j++ ) {
+			start[j] = mins[j] + Q_random( &seed ) * ( maxs[j] - mins[j] );
+			end[j] = start[j] + Q_crandom( &seed ) * 1024;
+		}
+		// mix of point and player-sized box traces
+		if ( i & 1 ) {
+			CM_BoxTrace( &trace, start, end, boxMins, boxMaxs, 0, CONTENTS_SOLID | CONTENTS_PLAYERCLIP, qfalse );
+		} else {
+			CM_BoxTrace( &trace, start, end, vec3_origin, vec3_origin, 0, CONTENTS_SOLID, qfalse );
+		}
+		fractions[i] = trace.fraction;
+	}
+
+	return (int)( Sys_Microseconds() - usec );
+}
+
+
+/*
+==================
+CM_Bench_f
+
+Runs the same set of random traces through the loaded map with
+the original and flattened node layouts
+==================
+*/
+void CM_Bench_f( void ) {
+	cFlatNode_t	*flatNodes;
+	float		*fractions[2];
+	vec3_t		mins, maxs;
+	int			usec[2];
+	int			i, count, mismatches;
+
+	if ( !cm.name[0] ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	count = 100000;
+	if ( Cmd_Argc() > 1 ) {
+		count = atoi( Cmd_Argv( 1 ) );
+		if ( count < 1 || count > 10000000 ) {
+			Com_Printf( "usage: %s [trace count]\n", Cmd_Argv( 0 ) );
+			return;
+		}
+	}
+
+	CM_ModelBounds( 0, mins, maxs );
+
+	fractions[0] = Z_Malloc( count * sizeof( float ) );
+	fractions[1] = Z_Malloc( count * sizeof( float ) );
+
+	flatNodes = cm.flatNodes;
+
+	cm.flatNodes = NULL;
+	usec[0] = CM_BenchTraces( mins, maxs, count, fractions[0] );
+
+	if ( flatNodes ) {
+		cm.flatNodes = flatNodes;
+		usec[1] = CM_BenchTraces( mins, maxs, count, fractions[1] );
+	}
+
+	if ( usec[0] <= 0 ) {
+		usec[0] = 1;
+	}
+
+	Com_Printf( "%i traces on %s\n", count, cm.name );
+	Com_Printf( "original tree: %i usec, %.0f traces/sec\n", usec[0], count * 1000000.0 / usec[0] );
+
+	if ( flatNodes ) {
+		if ( usec[1] <= 0 ) {
+			usec[1] = 1;
+		}
+		mismatches = 0;
+		for ( i = 0; i < count; i++ ) {
+			if ( fractions[0][i] != fractions[1][i] ) {
+				mismatches++;
+			}
+		}
+		Com_Printf( "flat tree: %i usec, %.0f traces/sec, %i mismatches\n", usec[1], count * 1000000.0 / usec[1], mismatches );
+	} else {
+		Com_Printf( "flat tree is not built, set cm_flatTree 1 and reload the map\n" );
+	}
+
+	Z_Free( fractions[1] );
+	Z_Free( fractions[0] );
+}
+
+
+/*
+==================
+CM_Record_f
+
+Starts writing all collision queries to a file, without arguments stops
+==================
+*/
+void CM_Record_f( void ) {
+	traceFileHeader_t header;
+	char name[MAX_OSPATH];
+
+	if ( Cmd_Argc() < 2 ) {
+		if ( traceFile ) {
+			CM_StopTraceRecord();
+		} else {
+			Com_Printf( "usage: %s <filename>, without arguments stops recording\n", Cmd_Argv( 0 ) );
+		}
+		return;
+	}
+
+	if ( !cm.name[0] ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	CM_StopTraceRecord();
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".ctr" );
+
+	traceFile = FS_FOpenFileWrite( name );
+	if ( traceFile == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't open %s for writing.\n", name );
+		return;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = LittleLong( TRACE_FILE_IDENT );
+	header.version = LittleLong( TRACE_FILE_VERSION );
+	Q_strncpyz( header.mapName, cm.name, sizeof( header.mapName ) );
+	header.checksum = LittleLong( cm.checksum );
+	FS_Write( &header, sizeof( header ), traceFile );
+
+	traceBufferCount = 0;
+	traceRecordCount = 0;
+
+	Com_Printf( "Recording traces to %s.\n", name );
+}
+
+
+/*
+==================
+CM_ReplayTrace
+==================
+*/
+static void CM_ReplayTrace( trace_t *trace, const traceFileRecord_t *rec ) {
+	clipHandle_t model;
+
+	model = rec->model;
+	if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE ) {
+		model = CM_TempBoxModel( rec->boxMins, rec->boxMaxs, model == CAPSULE_MODEL_HANDLE );
+	}
+
+	if ( rec->flags & TRF_TRANSFORMED ) {
+		CM_TransformedBoxTrace( trace, rec->start, rec->end, rec->mins, rec->maxs, model, rec->brushmask,
+			rec->origin, rec->angles, ( rec->flags & TRF_CAPSULE ) ? qtrue : qfalse );
+	} else {
+		CM_BoxTrace( trace, rec->start, rec->end, rec->mins, rec->maxs, model, rec->brushmask,
+			( rec->flags & TRF_CAPSULE ) ? qtrue : qfalse );
+	}
+}
+
+
+/*
+==================
+CM_SortTimes
+==================
+*/
+static int CM_SortTimes( const void *a, const void *b ) {
+	int64_t ta = *(const int64_t *)a;
+	int64_t tb = *(const int64_t *)b;
+
+	if ( ta < tb ) {
+		return -1;
+	}
+	return ta > tb;
+}
+
+
+/*
+==================
+CM_Replay_f
+
+Replays recorded traces and reports per-trace timing, each trace is
+timed on every pass and the fastest pass is used to filter out noise.
+Loads the map if none is running so it works on an idle dedicated server
+==================
+*/
+void CM_Replay_f( void ) {
+	static const float percentiles[] = { 50.0f, 90.0f, 99.0f, 99.9f };
+	traceFileHeader_t *header;
+	traceFileRecord_t *records;
+	trace_t		trace;
+	int64_t		*times, t, total;
+	qboolean	mapLoaded;
+	char		name[MAX_OSPATH];
+	void		*buffer;
+	int			i, pass, passes, count, valid, len, checksum;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: %s <filename> [passes]\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	passes = 3;
+	if ( Cmd_Argc() > 2 ) {
+		passes = atoi( Cmd_Argv( 2 ) );
+		if ( passes < 1 || passes > 100 ) {
+			Com_Printf( "pass count should be in range 1..100\n" );
+			return;
+		}
+	}
+
+	if ( traceFile ) {
+		Com_Printf( "Can't replay while recording traces.\n" );
+		return;
+	}
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".ctr" );
+
+	len = FS_ReadFile( name, &buffer );
+	if ( !buffer ) {
+		Com_Printf( "Couldn't load %s.\n", name );
+		return;
+	}
+
+	header = (traceFileHeader_t *)buffer;
+	if ( len < sizeof( *header ) || LittleLong( header->ident ) != TRACE_FILE_IDENT
+		|| LittleLong( header->version ) != TRACE_FILE_VERSION
+		|| ( len - sizeof( *header ) ) % sizeof( traceFileRecord_t ) ) {
+		Com_Printf( "%s is not a valid trace file.\n", name );
+		FS_FreeFile( buffer );
+		return;
+	}
+	header->mapName[ sizeof( header->mapName ) - 1 ] = '\0';
+
+	count = ( len - sizeof( *header ) ) / sizeof( traceFileRecord_t );
+	records = (traceFileRecord_t *)( header + 1 );
+
+	mapLoaded = qfalse;
+	if ( !cm.name[0] ) {
+		CM_LoadMap( header->mapName, qfalse, &checksum );
+		mapLoaded = qtrue;
+	} else if ( Q_stricmp( cm.name, header->mapName ) ) {
+		Com_Printf( "%s was recorded on %s but %s is loaded.\n", name, header->mapName, cm.name );
+		FS_FreeFile( buffer );
+		return;
+	}
+
+	if ( cm.checksum != LittleLong( header->checksum ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s checksum differs from recorded one, results may be meaningless.\n", cm.name );
+	}
+
+	// drop anything that would error out on this map
+	valid = 0;
+	for ( i = 0; i < count; i++ ) {
+		CM_SwapTraceRecord( &records[i] );
+		if ( records[i].model != BOX_MODEL_HANDLE && records[i].model != CAPSULE_MODEL_HANDLE
+			&& ( records[i].model < 0 || records[i].model >= cm.numSubModels ) ) {
+			continue;
+		}
+		records[valid++] = records[i];
+	}
+
+	if ( valid < count ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: skipped %i traces with invalid models.\n", count - valid );
+	}
+
+	if ( !valid ) {
+		Com_Printf( "No traces to replay.\n" );
+	} else {
+		times = Z_Malloc( valid * sizeof( times[0] ) );
+
+		for ( pass = 0; pass < passes; pass++ ) {
+			for ( i = 0; i < valid; i++ ) {
+				t = Sys_Nanoseconds();
+				CM_ReplayTrace( &trace, &records[i] );
+				t = Sys_Nanoseconds() - t;
+				if ( pass == 0 || t < times[i] ) {
+					times[i] = t;
+				}
+			}
+		}
+
+		total = 0;
+		for ( i = 0; i < valid; i++ ) {
+			total += times[i];
+		}
+
+		qsort( times, valid, sizeof( times[0] ), CM_SortTimes );
+
+		Com_Printf( "%i traces on %s, best of %i passes:\n", valid, cm.name, passes );
+		Com_Printf( "  total %.3f msec, mean %.0f ns/trace\n", total / 1000000.0, (double)total / valid );
+		for ( i = 0; i < ARRAY_LEN( percentiles ); i++ ) {
+			Com_Printf( "  p%-4g %8i ns\n", percentiles[i], (int)times[ (int)( ( valid - 1 ) * percentiles[i] / 100.0f ) ] );
+		}
+		Com_Printf( "  max   %8i ns\n", (int)times[ valid - 1 ] );
+
+		Z_Free( times );
+	}
+
+	FS_FreeFile( buffer );
+
+	if ( mapLoaded ) {
+		CM_ClearMap();
+	}
+}
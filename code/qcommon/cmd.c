@@ -25,17 +25,31 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 #define MAX_CMD_BUFFER  65536
+#define MAX_CMD_BUFFER_GROW	(4*1024*1024)	// limit for exec of huge configs
 
+// pending text lives at data[start...start+cursize), executed lines are
+// consumed by advancing start and inserted text reuses the space before
+// it, so neither has to move the rest of the buffer; when an end runs
+// out of room the text is moved to the middle of the free space
 typedef struct {
 	byte *data;
 	int maxsize;
 	int cursize;
+	int start;
 } cmd_t;
 
 static int   cmd_wait;
 static cmd_t cmd_text;
 static byte  cmd_text_buf[MAX_CMD_BUFFER];
 
+static	int			cmd_argc;
+static	char		*cmd_argv[MAX_STRING_TOKENS];		// points into cmd_tokenized
+static	char		cmd_tokenized[BIG_INFO_STRING+MAX_STRING_TOKENS];	// will have 0 bytes inserted
+static	char		cmd_cmd[BIG_INFO_STRING]; // the original command we received (no token processing)
+
+static void Cmd_TokenizeCommand( qboolean ignoreQuotes );
+static void Cmd_ExecuteTokenized( const char *text );
+
 
 //=============================================================================
 
@@ -74,9 +88,108 @@ Cbuf_Init
 */
 void Cbuf_Init( void )
 {
-	cmd_text.data = cmd_text_buf;
-	cmd_text.maxsize = MAX_CMD_BUFFER;
+	if ( !cmd_text.data ) {
+		cmd_text.data = cmd_text_buf;
+		cmd_text.maxsize = MAX_CMD_BUFFER;
+	}
+	// keep grown buffer, it will be likely needed again
 	cmd_text.cursize = 0;
+	cmd_text.start = 0;
+}
+
+
+/*
+============
+Cbuf_Reserve
+
+Makes sure that len more bytes will fit in the buffer,
+grows it for exec of large config files
+============
+*/
+static qboolean Cbuf_Reserve( int len )
+{
+	byte *data;
+	int size;
+
+	if ( cmd_text.cursize + len < cmd_text.maxsize ) {
+		return qtrue;
+	}
+
+	size = cmd_text.maxsize;
+	while ( size <= cmd_text.cursize + len ) {
+		size *= 2;
+	}
+
+	if ( size > MAX_CMD_BUFFER_GROW ) {
+		return qfalse;
+	}
+
+	data = Z_Malloc( size );
+	Com_Memcpy( data, cmd_text.data + cmd_text.start, cmd_text.cursize );
+
+	if ( cmd_text.data != cmd_text_buf ) {
+		Z_Free( cmd_text.data );
+	}
+
+	cmd_text.data = data;
+	cmd_text.maxsize = size;
+	cmd_text.start = 0;
+
+	return qtrue;
+}
+
+
+/*
+============
+Cbuf_Move
+
+Relocates pending text to start at the given offset
+============
+*/
+static void Cbuf_Move( int start )
+{
+	memmove( cmd_text.data + start, cmd_text.data + cmd_text.start, cmd_text.cursize );
+	cmd_text.start = start;
+}
+
+
+/*
+============
+Cbuf_Gap
+
+Opens len bytes at pos of the pending text and returns pointer to them,
+space must be already reserved. Moves the shorter part of the text
+============
+*/
+static byte *Cbuf_Gap( int pos, int len )
+{
+	byte *text;
+	int free;
+
+	free = cmd_text.maxsize - cmd_text.cursize;
+
+	if ( pos <= cmd_text.cursize - pos ) {
+		if ( cmd_text.start < len ) {
+			// leave room on both ends so that repeated inserts
+			// and appends don't move the whole text each time
+			Cbuf_Move( MAX( free / 2, len ) );
+		}
+		// move the head down into consumed space
+		text = cmd_text.data + cmd_text.start;
+		memmove( text - len, text, pos );
+		cmd_text.start -= len;
+	} else {
+		if ( cmd_text.start + cmd_text.cursize + len > cmd_text.maxsize ) {
+			Cbuf_Move( MIN( free / 2, free - len ) );
+		}
+		// move the tail up
+		text = cmd_text.data + cmd_text.start;
+		memmove( text + pos + len, text + pos, cmd_text.cursize - pos );
+	}
+
+	cmd_text.cursize += len;
+
+	return cmd_text.data + cmd_text.start + pos;
 }
 
 
@@ -91,14 +204,13 @@ void Cbuf_AddText( const char *text ) {
 
 	const int l = (int)strlen( text );
 
-	if (cmd_text.cursize + l >= cmd_text.maxsize)
+	if ( !Cbuf_Reserve( l ) )
 	{
 		Com_Printf ("Cbuf_AddText: overflow\n");
 		return;
 	}
 
-	Com_Memcpy(&cmd_text.data[cmd_text.cursize], text, l);
-	cmd_text.cursize += l;
+	Com_Memcpy( Cbuf_Gap( cmd_text.cursize, l ), text, l );
 }
 
 
@@ -120,7 +232,7 @@ void Cbuf_NestedAdd( const char *text ) {
 	int len = (int)strlen( text );
 	int pos = nestedCmdOffset;
 	qboolean separate = qfalse;
-	int i;
+	byte *gap;
 
 	if ( len <= 0 ) {
 		nestedCmdOffset = cmd_text.cursize;
@@ -155,28 +267,24 @@ void Cbuf_NestedAdd( const char *text ) {
 		len += 1;
 	}
 
-	if ( len + cmd_text.cursize > cmd_text.maxsize ) {
+	if ( !Cbuf_Reserve( len ) ) {
 		Com_Printf( S_COLOR_YELLOW "%s(%i) overflowed\n", __func__, pos );
 		nestedCmdOffset = cmd_text.cursize;
 		return;
 	}
 
-	// move the existing command text
-	for ( i = cmd_text.cursize - 1; i >= pos; i-- ) {
-		cmd_text.data[i + len] = cmd_text.data[i];
-	}
+	// make room in the existing command text
+	gap = Cbuf_Gap( pos, len );
 
 	if ( separate ) {
 		// copy the new text in + add a \n
-		Com_Memcpy( cmd_text.data + pos, text, len - 1 );
-		cmd_text.data[pos + len - 1] = '\n';
+		Com_Memcpy( gap, text, len - 1 );
+		gap[len - 1] = '\n';
 	} else {
 		// copy the new text in
-		Com_Memcpy( cmd_text.data + pos, text, len );
+		Com_Memcpy( gap, text, len );
 	}
 
-	cmd_text.cursize += len;
-
 	nestedCmdOffset = cmd_text.cursize;
 }
 
@@ -191,27 +299,21 @@ Adds a \n to the text
 */
 void Cbuf_InsertText( const char *text ) {
 	int		len;
-	int		i;
+	byte	*gap;
 
 	len = strlen( text ) + 1;
 
-	if ( len + cmd_text.cursize > cmd_text.maxsize ) {
+	if ( !Cbuf_Reserve( len ) ) {
 		Com_Printf( "Cbuf_InsertText overflowed\n" );
 		return;
 	}
 
-	// move the existing command text
-	for ( i = cmd_text.cursize - 1 ; i >= 0 ; i-- ) {
-		cmd_text.data[ i + len ] = cmd_text.data[ i ];
-	}
-
 	// copy the new text in
-	Com_Memcpy( cmd_text.data, text, len - 1 );
+	gap = Cbuf_Gap( 0, len );
+	Com_Memcpy( gap, text, len - 1 );
 
 	// add a \n
-	cmd_text.data[ len - 1 ] = '\n';
-
-	cmd_text.cursize += len;
+	gap[ len - 1 ] = '\n';
 }
 
 
@@ -253,7 +355,7 @@ Cbuf_Execute
 */
 void Cbuf_Execute( void )
 {
-	char line[MAX_CMD_LINE], *text;
+	char *text;
 	int i, n, quotes;
 	qboolean in_star_comment;
 	qboolean in_slash_comment;
@@ -273,7 +375,7 @@ void Cbuf_Execute( void )
 	while ( cmd_text.cursize > 0 )
 	{
 		// find a \n or ; line break or comment: // or /* */
-		text = (char *)cmd_text.data;
+		text = (char *)cmd_text.data + cmd_text.start;
 
 		quotes = 0;
 		for ( i = 0 ; i< cmd_text.cursize ; i++ )
@@ -305,18 +407,18 @@ void Cbuf_Execute( void )
 			}
 		}
 
-		// copy up to (MAX_CMD_LINE - 1) chars but keep buffer position intact to prevent parsing truncated leftover
+		// copy up to (MAX_CMD_LINE - 1) chars but keep buffer position intact to prevent parsing truncated leftover,
+		// the line goes straight to the tokenizer buffer
 		if ( i > (MAX_CMD_LINE - 1) )
 			n = MAX_CMD_LINE - 1;
 		else
 			n = i;
 
-		Com_Memcpy( line, text, n );
-		line[n] = '\0';
+		Com_Memcpy( cmd_cmd, text, n );
+		cmd_cmd[n] = '\0';
 
-		// delete the text from the command buffer and move remaining commands down
-		// this is necessary because commands (exec) can insert data at the
-		// beginning of the text buffer
+		// delete the text from the command buffer, commands (exec) can
+		// insert data at the beginning of the remaining text
 
 		if ( i == cmd_text.cursize ) {
 			//cmd_text.cursize = 0;
@@ -331,7 +433,9 @@ void Cbuf_Execute( void )
 		cmd_text.cursize -= i;
 
 		if ( cmd_text.cursize ) {
-			memmove( text, text + i, cmd_text.cursize );
+			cmd_text.start += i;
+		} else {
+			cmd_text.start = 0;
 		}
 
 		if ( nestedCmdOffset > 0 ) {
@@ -342,7 +446,8 @@ void Cbuf_Execute( void )
 		}
 
 		// execute the command line
-		Cmd_ExecuteString( line );
+		Cmd_TokenizeCommand( qfalse );
+		Cmd_ExecuteTokenized( cmd_cmd );
 
 		// break on wait command
 		if ( cmd_wait > 0 ) {
@@ -461,19 +566,24 @@ static void Cmd_Echo_f( void )
 typedef struct cmd_function_s
 {
 	struct cmd_function_s	*next;
+	struct cmd_function_s	*hashNext;
 	char					*name;
+	unsigned int			hashValue;
 	xcommand_t				function;
 	completionFunc_t	complete;
 } cmd_function_t;
 
 
-static	int			cmd_argc;
-static	char		*cmd_argv[MAX_STRING_TOKENS];		// points into cmd_tokenized
-static	char		cmd_tokenized[BIG_INFO_STRING+MAX_STRING_TOKENS];	// will have 0 bytes inserted
-static	char		cmd_cmd[BIG_INFO_STRING]; // the original command we received (no token processing)
-
 static	cmd_function_t	*cmd_functions;		// possible commands to execute
 
+// name lookup table, grows with the number of commands, starts with
+// a static one because commands are added before the main zone is up
+#define MIN_CMD_HASH	256
+static	cmd_function_t	*cmd_hashTableBase[MIN_CMD_HASH];
+static	cmd_function_t	**cmd_hashTable = cmd_hashTableBase;
+static	unsigned int	cmd_hashSize = MIN_CMD_HASH;
+static	unsigned int	cmd_count;
+
 /*
 ============
 Cmd_Argc
@@ -610,24 +720,39 @@ will point into this temporary buffer.
 // NOTE TTimo define that to track tokenization issues
 //#define TKN_DBG
 static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
-	const char *text;
-	char *textOut;
 
 #ifdef TKN_DBG
 	// FIXME TTimo blunt hook to try to find the tokenization of userinfo
 	Com_DPrintf("Cmd_TokenizeString: %s\n", text_in);
 #endif
 
-	// clear previous args
-	cmd_argc = 0;
-	cmd_cmd[0] = '\0';
-
 	if ( !text_in ) {
+		// clear previous args
+		cmd_argc = 0;
+		cmd_cmd[0] = '\0';
 		return;
 	}
 
 	Q_strncpyz( cmd_cmd, text_in, sizeof( cmd_cmd ) );
 
+	Cmd_TokenizeCommand( ignoreQuotes );
+}
+
+
+/*
+============
+Cmd_TokenizeCommand
+
+Tokenizes the line already stored in cmd_cmd
+============
+*/
+static void Cmd_TokenizeCommand( qboolean ignoreQuotes ) {
+	const char *text;
+	char *textOut;
+
+	// clear previous args
+	cmd_argc = 0;
+
 	text = cmd_cmd; // read from safe-length buffer
 	textOut = cmd_tokenized;
 
@@ -738,6 +863,27 @@ void Cmd_TokenizeStringIgnoreQuotes( const char *text_in ) {
 }
 
 
+/*
+============
+Cmd_HashValue
+
+Case-insensitive name hash, callers mask it with (cmd_hashSize-1)
+============
+*/
+static unsigned int Cmd_HashValue( const char *name )
+{
+	unsigned int hash;
+	int c;
+
+	hash = 0;
+	while ( (c = locase[(byte)*name++]) != '\0' ) {
+		hash = hash * 101 + c;
+	}
+	hash = (hash ^ (hash >> 10) ^ (hash >> 20));
+	return hash;
+}
+
+
 /*
 ============
 Cmd_FindCommand
@@ -746,13 +892,44 @@ Cmd_FindCommand
 static cmd_function_t *Cmd_FindCommand( const char *cmd_name )
 {
 	cmd_function_t *cmd;
-	for( cmd = cmd_functions; cmd; cmd = cmd->next )
-		if( !Q_stricmp( cmd_name, cmd->name ) )
+	unsigned int hash;
+
+	hash = Cmd_HashValue( cmd_name );
+	for( cmd = cmd_hashTable[ hash & ( cmd_hashSize - 1 ) ]; cmd; cmd = cmd->hashNext )
+		if( cmd->hashValue == hash && !Q_stricmp( cmd_name, cmd->name ) )
 			return cmd;
 	return NULL;
 }
 
 
+/*
+============
+Cmd_GrowHashTable
+============
+*/
+static void Cmd_GrowHashTable( void )
+{
+	cmd_function_t **table, *cmd;
+	unsigned int size, bucket;
+
+	size = cmd_hashSize * 2;
+	table = S_Malloc( size * sizeof( table[0] ) );
+	Com_Memset( table, 0, size * sizeof( table[0] ) );
+
+	for ( cmd = cmd_functions; cmd; cmd = cmd->next ) {
+		bucket = cmd->hashValue & ( size - 1 );
+		cmd->hashNext = table[ bucket ];
+		table[ bucket ] = cmd;
+	}
+
+	if ( cmd_hashTable != cmd_hashTableBase )
+		Z_Free( cmd_hashTable );
+
+	cmd_hashTable = table;
+	cmd_hashSize = size;
+}
+
+
 /*
 ============
 Cmd_AddCommand
@@ -760,6 +937,7 @@ Cmd_AddCommand
 */
 void Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
 	cmd_function_t *cmd;
+	unsigned int bucket;
 
 	// fail if the command already exists
 	if ( Cmd_FindCommand( cmd_name ) )
@@ -777,6 +955,15 @@ void Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
 	cmd->complete = NULL;
 	cmd->next = cmd_functions;
 	cmd_functions = cmd;
+
+	if ( ++cmd_count > cmd_hashSize ) {
+		Cmd_GrowHashTable();
+	}
+
+	cmd->hashValue = Cmd_HashValue( cmd_name );
+	bucket = cmd->hashValue & ( cmd_hashSize - 1 );
+	cmd->hashNext = cmd_hashTable[ bucket ];
+	cmd_hashTable[ bucket ] = cmd;
 }
 
 
@@ -788,11 +975,9 @@ Cmd_SetCommandCompletionFunc
 void Cmd_SetCommandCompletionFunc( const char *command, completionFunc_t complete ) {
 	cmd_function_t *cmd;
 
-	for( cmd = cmd_functions; cmd; cmd = cmd->next ) {
-		if( !Q_stricmp( command, cmd->name ) ) {
-			cmd->complete = complete;
-			return;
-		}
+	cmd = Cmd_FindCommand( command );
+	if ( cmd ) {
+		cmd->complete = complete;
 	}
 }
 
@@ -805,23 +990,27 @@ Cmd_RemoveCommand
 void Cmd_RemoveCommand( const char *cmd_name ) {
 	cmd_function_t *cmd, **back;
 
-	back = &cmd_functions;
-	while( 1 ) {
-		cmd = *back;
-		if ( !cmd ) {
-			// command wasn't active
-			return;
-		}
-		if ( !Q_stricmp( cmd_name, cmd->name ) ) {
-			*back = cmd->next;
-			if (cmd->name) {
-				Z_Free(cmd->name);
-			}
-			Z_Free (cmd);
-			return;
-		}
-		back = &cmd->next;
+	cmd = Cmd_FindCommand( cmd_name );
+	if ( !cmd ) {
+		// command wasn't active
+		return;
+	}
+
+	back = &cmd_hashTable[ cmd->hashValue & ( cmd_hashSize - 1 ) ];
+	while ( *back != cmd ) {
+		back = &(*back)->hashNext;
 	}
+	*back = cmd->hashNext;
+	cmd_count--;
+
+	for ( back = &cmd_functions; *back != cmd; back = &(*back)->next )
+		;
+	*back = cmd->next;
+
+	if (cmd->name) {
+		Z_Free(cmd->name);
+	}
+	Z_Free (cmd);
 }
 
 
@@ -896,16 +1085,16 @@ Cmd_CompleteArgument
 qboolean Cmd_CompleteArgument( const char *command, const char *args, int argNum ) {
 	const cmd_function_t *cmd;
 
-	for( cmd = cmd_functions; cmd; cmd = cmd->next ) {
-		if ( !Q_stricmp( command, cmd->name ) ) {
-			if ( cmd->complete ) {
-				cmd->complete( args, argNum );
-			}
-			return qtrue;
-		}
+	cmd = Cmd_FindCommand( command );
+	if ( !cmd ) {
+		return qfalse;
+	}
+
+	if ( cmd->complete ) {
+		cmd->complete( args, argNum );
 	}
 
-	return qfalse;
+	return qtrue;
 }
 
 
@@ -917,34 +1106,35 @@ A complete command line has been parsed, so try to execute it
 ============
 */
 void Cmd_ExecuteString( const char *text ) {
-	cmd_function_t *cmd, **prev;
 
 	// execute the command line
 	Cmd_TokenizeString( text );
+	Cmd_ExecuteTokenized( text );
+}
+
+
+/*
+============
+Cmd_ExecuteTokenized
+
+Runs the command that was just tokenized, text is the whole line
+============
+*/
+static void Cmd_ExecuteTokenized( const char *text ) {
+	const cmd_function_t *cmd;
+
 	if ( !Cmd_Argc() ) {
 		return;		// no tokens
 	}
 
 	// check registered command functions
-	for ( prev = &cmd_functions ; *prev ; prev = &cmd->next ) {
-		cmd = *prev;
-		if ( !Q_stricmp( cmd_argv[0], cmd->name ) ) {
-			// rearrange the links so that the command will be
-			// near the head of the list next time it is used
-			*prev = cmd->next;
-			cmd->next = cmd_functions;
-			cmd_functions = cmd;
-
-			// perform the action
-			if ( !cmd->function ) {
-				// let the cgame or game handle it
-				break;
-			} else {
-				cmd->function();
-			}
-			return;
-		}
+	cmd = Cmd_FindCommand( cmd_argv[0] );
+	if ( cmd && cmd->function ) {
+		// perform the action
+		cmd->function();
+		return;
 	}
+	// otherwise let the cgame or game handle it
 
 	// check cvars
 	if ( Cvar_Command() ) {
@@ -1028,6 +1218,65 @@ void Cmd_CompleteWriteCfgName( const char *args, int argNum ) {
 }
 
 
+/*
+============
+Cmd_Bench_f
+
+Executes a generated config of set/toggle lines to
+measure command buffer, command and cvar lookup speed
+============
+*/
+#define BENCH_CVARS 512
+void Cmd_Bench_f( void )
+{
+	char *script, *s, *pending;
+	int64_t start, usec;
+	int i, lines, size, pendingSize;
+
+	lines = atoi( Cmd_Argv( 1 ) );
+	if ( lines <= 0 ) {
+		lines = 10000;
+	}
+
+	size = ( lines + BENCH_CVARS ) * 32 + 1;
+	script = s = Z_Malloc( size );
+
+	for ( i = 0; i < lines; i++ ) {
+		if ( i & 1 )
+			s += sprintf( s, "toggle cmdbench%i\n", i % BENCH_CVARS );
+		else
+			s += sprintf( s, "set cmdbench%i %i\n", i % BENCH_CVARS, i );
+	}
+
+	// remove created cvars
+	for ( i = 0; i < BENCH_CVARS && i < lines; i++ ) {
+		s += sprintf( s, "unset cmdbench%i\n", i );
+	}
+
+	// set aside commands that follow us
+	pendingSize = cmd_text.cursize;
+	pending = Z_Malloc( pendingSize + 1 );
+	Com_Memcpy( pending, cmd_text.data + cmd_text.start, pendingSize );
+	cmd_text.cursize = 0;
+	cmd_text.start = 0;
+
+	start = Sys_Microseconds();
+	Cbuf_InsertText( script );
+	Cbuf_Execute();
+	usec = Sys_Microseconds() - start;
+
+	if ( pendingSize && Cbuf_Reserve( pendingSize ) ) {
+		Com_Memcpy( Cbuf_Gap( cmd_text.cursize, pendingSize ), pending, pendingSize );
+	}
+
+	Z_Free( pending );
+	Z_Free( script );
+
+	Com_Printf( "executed %i lines in %i usec, %i nsec per line\n",
+		lines + i, (int)usec, (int)( usec * 1000 / ( lines + i ) ) );
+}
+
+
 /*
 ============
 Cmd_Init
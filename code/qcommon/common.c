@@ -28,15 +28,20 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <netinet/in.h>
 #include <sys/stat.h> // umask
 #include <sys/time.h>
+#include <time.h>
 #else
 #include <winsock.h>
 #endif
 
 #include "../client/keys.h"
 
+#define JSON_IMPLEMENTATION
+#include "json.h"
+
 const int demo_protocols[] = { 66, 67, OLD_PROTOCOL_VERSION, NEW_PROTOCOL_VERSION, 0 };
 
 #define USE_MULTI_SEGMENT // allocate additional zone segments on demand
+#define USE_ZONE_SLABS // serve small allocations from per-size slabs
 
 #ifdef DEDICATED
 #define MIN_COMHUNKMEGS		48
@@ -57,6 +62,9 @@ static jmp_buf abortframe;	// an ERR_DROP occurred, exit the entire frame
 int		CPU_Flags = 0;
 
 static fileHandle_t logfile = FS_INVALID_HANDLE;
+#ifdef DEDICATED
+static int com_instance;	// 0 in the original process, see Com_StartInstances()
+#endif
 static fileHandle_t com_journalFile = FS_INVALID_HANDLE ; // events are written here
 fileHandle_t com_journalDataFile = FS_INVALID_HANDLE; // config files are written here
 
@@ -67,6 +75,8 @@ cvar_t	*com_warnings;
 cvar_t	*com_dedicated;
 cvar_t	*com_timescale;
 static cvar_t *com_fixedtime;
+cvar_t	*com_benchmark;
+static cvar_t *com_spinSlack;
 cvar_t	*com_journal;
 cvar_t	*com_protocol;
 qboolean com_protocolCompat;
@@ -79,6 +89,7 @@ cvar_t	*com_timedemo;
 #ifdef USE_AFFINITY_MASK
 cvar_t	*com_affinityMask;
 #endif
+static cvar_t *com_simd;
 static cvar_t *com_logfile;		// 1 = buffer log, 2 = flush after each print
 static cvar_t *com_showtrace;
 cvar_t	*com_version;
@@ -109,11 +120,17 @@ int		time_backend;		// renderer backend time
 
 static int	lastTime;
 int			com_frameTime;
+static int64_t	com_frameTimeUsec;	// when waiting for the frame ended
+static int64_t	lastTimeUsec;
 static int	com_frameNumber;
 
 qboolean	com_errorEntered = qfalse;
 qboolean	com_fullyInitialized = qfalse;
 
+// lets code on job threads leave with its own longjmp instead of the main thread abortframe
+static THREAD_LOCAL void	(*com_threadError)( void *arg, int code, const char *msg );
+static THREAD_LOCAL void	*com_threadErrorArg;
+
 // renderer window states
 qboolean	gw_minimized = qfalse; // this will be always true for dedicated servers
 #ifndef DEDICATED
@@ -213,6 +230,12 @@ void FORMAT_PRINTF(1, 2) QDECL Com_Printf( const char *fmt, ... ) {
 
 			opening_qconsole = qtrue;
 
+#ifdef DEDICATED
+			if ( com_instance ) {
+				logName = va( "qconsole%i.log", com_instance );
+			}
+#endif
+
 			mode = com_logfile->integer - 1;
 
 			if ( mode & 2 )
@@ -296,6 +319,20 @@ void QDECL Com_WPrintf( const char *fmt, ...) {
 }
 
 
+/*
+=============
+Com_SetThreadErrorHandler
+
+Routes Com_Error calls made by the current thread to handler, which must not
+return. Pass NULL to restore the default handling.
+=============
+*/
+void Com_SetThreadErrorHandler( void (*handler)( void *arg, int code, const char *msg ), void *arg ) {
+	com_threadError = handler;
+	com_threadErrorArg = arg;
+}
+
+
 /*
 =============
 Com_Error
@@ -311,6 +348,16 @@ void NORETURN FORMAT_PRINTF(2, 3) QDECL Com_Error( errorParm_t code, const char
 	static qboolean	calledSysError = qfalse;
 	int			currentTime;
 
+	if ( com_threadError ) {
+		char msg[ MAXPRINTMSG ];
+
+		va_start( argptr, fmt );
+		Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+		va_end( argptr );
+
+		com_threadError( com_threadErrorArg, code, msg );
+	}
+
 #if defined(_WIN32) && defined(_DEBUG)
 	if ( code != ERR_DISCONNECT && code != ERR_NEED_CD ) {
 		if ( !com_noErrorInterrupt->integer ) {
@@ -961,6 +1008,45 @@ int64_t Sys_Microseconds( void )
 }
 
 
+/*
+================
+Sys_Nanoseconds
+
+Monotonic high resolution clock for timing very short operations
+================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER curr;
+
+	if ( !freq.QuadPart )
+	{
+		QueryPerformanceFrequency( &freq );
+		if ( !freq.QuadPart )
+		{
+			return Sys_Microseconds() * 1000LL; // fallback
+		}
+	}
+
+	QueryPerformanceCounter( &curr );
+
+	// split to avoid overflow on long uptimes
+	return ( curr.QuadPart / freq.QuadPart ) * 1000000000LL + ( ( curr.QuadPart % freq.QuadPart ) * 1000000000LL ) / freq.QuadPart;
+#else
+	struct timespec curr;
+
+	if ( clock_gettime( CLOCK_MONOTONIC, &curr ) != 0 )
+	{
+		return Sys_Microseconds() * 1000LL; // fallback
+	}
+
+	return (int64_t)curr.tv_sec * 1000000000LL + (int64_t)curr.tv_nsec;
+#endif
+}
+
+
 /*
 ==============================================================================
 
@@ -997,6 +1083,14 @@ all big things are allocated on the hunk.
 #define USE_STATIC_TAGS
 #define USE_TRASH_TEST
 
+#ifdef USE_ZONE_SLABS
+#define SLABID		0x1d4a12	// slots inside of slab pages
+#define SLABPAGEID	0x1d4a13	// zone blocks holding slab pages
+#define SLAB_PAGE_SIZE	8192
+#define SLAB_MAX_SIZE	512
+#define SLAB_CLASSES	10
+#endif
+
 #ifdef ZONE_DEBUG
 typedef struct zonedebug_s {
 	const char *label;
@@ -1021,10 +1115,24 @@ typedef struct freeblock_s {
 	struct freeblock_s *next;
 } freeblock_t;
 
+#ifdef USE_ZONE_SLABS
+typedef struct slabPage_s {
+	struct slabPage_s *next;
+	int			slotSize;	// including the header and trash tester
+	int			numSlots;
+	int			cls;
+} slabPage_t;
+#endif
+
 typedef struct memzone_s {
 	int		size;			// total bytes malloced, including header
 	int		used;			// total bytes used
+	int		highwater;		// most bytes used at once
 	memblock_t	blocklist;	// start / end cap for linked list
+#ifdef USE_ZONE_SLABS
+	slabPage_t	*slabPages;
+	memblock_t	*slabFree[ SLAB_CLASSES ];	// linked through next
+#endif
 #ifdef USE_MULTI_SEGMENT
 	memblock_t	dummy0;		// just to allocate some space before freelist
 	freeblock_t	freelist_tiny;
@@ -1041,6 +1149,20 @@ typedef struct memzone_s {
 
 static int minfragment = MINFRAGMENT; // may be adjusted at runtime
 
+#ifdef USE_ZONE_SLABS
+static qboolean useSlabs = qtrue; // toggled by zonebench only
+
+static const int slabSize[ SLAB_CLASSES ] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+// slab class for ( size + 15 ) / 16
+static const byte slabClass[ SLAB_MAX_SIZE / 16 + 1 ] = {
+	0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+	8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9
+};
+#endif
+
 // main zone for all "dynamic" memory allocation
 static memzone_t *mainzone;
 
@@ -1170,6 +1292,9 @@ static freeblock_t *NewBlock( memzone_t *zone, int size )
 	// update zone statistics
 	zone->size += alloc_size;
 	zone->used += sizeof( *sep );
+	if ( zone->used > zone->highwater ) {
+		zone->highwater = zone->used;
+	}
 
 	InsertFree( zone, block );
 
@@ -1233,6 +1358,136 @@ static memblock_t *SearchFree( memzone_t *zone, int size )
 }
 #endif // USE_MULTI_SEGMENT
 
+#ifdef USE_ZONE_SLABS
+/*
+================
+Z_NewSlabPage
+
+Carves a zone block into free slots of one size class,
+pages are kept for the lifetime of the zone
+================
+*/
+static void Z_NewSlabPage( memzone_t *zone, int cls )
+{
+	slabPage_t *page;
+	memblock_t *block, *slot;
+	int slotSize, i;
+
+	page = Z_TagMalloc( SLAB_PAGE_SIZE, zone == smallzone ? TAG_SMALL : TAG_GENERAL );
+
+	// keep it away from Z_FreeTags
+	block = (memblock_t *)page - 1;
+	block->id = SLABPAGEID;
+
+	slotSize = PAD( sizeof( memblock_t ) + slabSize[ cls ], sizeof( intptr_t ) );
+#ifdef USE_TRASH_TEST
+	slotSize = PAD( slotSize + 4, sizeof( intptr_t ) );
+#endif
+
+	page->slotSize = slotSize;
+	page->numSlots = ( SLAB_PAGE_SIZE - PAD( sizeof( *page ), sizeof( intptr_t ) ) ) / slotSize;
+	page->cls = cls;
+	page->next = zone->slabPages;
+	zone->slabPages = page;
+
+	// push in reverse order so that slots are handed out by ascending address
+	for ( i = page->numSlots - 1; i >= 0; i-- ) {
+		slot = (memblock_t *)( (byte *)page + PAD( sizeof( *page ), sizeof( intptr_t ) ) + i * slotSize );
+		slot->prev = (memblock_t *)page;
+		slot->size = slotSize;
+		slot->tag = TAG_FREE;
+		slot->id = SLABID;
+		slot->next = zone->slabFree[ cls ];
+		zone->slabFree[ cls ] = slot;
+	}
+}
+
+
+/*
+================
+Z_SlabAlloc
+================
+*/
+static memblock_t *Z_SlabAlloc( memzone_t *zone, int size )
+{
+	memblock_t *slot;
+	int cls;
+
+	cls = slabClass[ ( size + 15 ) >> 4 ];
+	if ( zone->slabFree[ cls ] == NULL ) {
+		Z_NewSlabPage( zone, cls );
+	}
+
+	slot = zone->slabFree[ cls ];
+	zone->slabFree[ cls ] = slot->next;
+
+	return slot;
+}
+
+
+/*
+================
+Z_SlabFree
+================
+*/
+static void Z_SlabFree( memblock_t *slot )
+{
+	const slabPage_t *page;
+	memzone_t *zone;
+
+	if ( slot->tag == TAG_FREE ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
+	}
+
+#ifdef USE_TRASH_TEST
+	if ( *(int *)((byte *)slot + slot->size - 4 ) != ZONEID ) {
+		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
+	}
+#endif
+
+	if ( slot->tag == TAG_SMALL ) {
+		zone = smallzone;
+	} else {
+		zone = mainzone;
+	}
+
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( slot + 1, 0xaa, slot->size - sizeof( *slot ) );
+
+	page = (const slabPage_t *)slot->prev;
+	slot->tag = TAG_FREE;
+	slot->next = zone->slabFree[ page->cls ];
+	zone->slabFree[ page->cls ] = slot;
+}
+
+
+/*
+================
+Z_SlabFreeTags
+================
+*/
+static int Z_SlabFreeTags( memzone_t *zone, memtag_t tag )
+{
+	const slabPage_t *page;
+	memblock_t *slot;
+	int i, count;
+
+	count = 0;
+	for ( page = zone->slabPages; page; page = page->next ) {
+		for ( i = 0; i < page->numSlots; i++ ) {
+			slot = (memblock_t *)( (byte *)page + PAD( sizeof( *page ), sizeof( intptr_t ) ) + i * page->slotSize );
+			if ( slot->tag == tag ) {
+				Z_SlabFree( slot );
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+#endif // USE_ZONE_SLABS
+
 
 /*
 ========================
@@ -1265,6 +1520,11 @@ static void Z_ClearZone( memzone_t *zone, memzone_t *head, int size, int segnum
 #endif
 	zone->size = size;
 	zone->used = 0;
+	zone->highwater = 0;
+#ifdef USE_ZONE_SLABS
+	zone->slabPages = NULL;
+	Com_Memset( zone->slabFree, 0, sizeof( zone->slabFree ) );
+#endif
 
 	block->prev = block->next = &zone->blocklist;
 	block->tag = TAG_FREE;	// free block
@@ -1337,6 +1597,12 @@ void Z_Free( void *ptr ) {
 
 	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
 	if (block->id != ZONEID) {
+#ifdef USE_ZONE_SLABS
+		if ( block->id == SLABID ) {
+			Z_SlabFree( block );
+			return;
+		}
+#endif
 		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
 	}
 
@@ -1443,6 +1709,10 @@ int Z_FreeTags( memtag_t tag ) {
 		block = block->next;
 	}
 
+#ifdef USE_ZONE_SLABS
+	count += Z_SlabFreeTags( zone, tag );
+#endif
+
 	return count;
 }
 
@@ -1479,6 +1749,23 @@ void *Z_TagMalloc( int size, memtag_t tag ) {
 	allocSize = size;
 #endif
 
+#ifdef USE_ZONE_SLABS
+	if ( size <= SLAB_MAX_SIZE && useSlabs ) {
+		base = Z_SlabAlloc( zone, size );
+		base->tag = tag;
+#ifdef ZONE_DEBUG
+		base->d.label = label;
+		base->d.file = file;
+		base->d.line = line;
+		base->d.allocSize = allocSize;
+#endif
+#ifdef USE_TRASH_TEST
+		*(int *)((byte *)base + base->size - 4) = ZONEID;
+#endif
+		return (void *) ( base + 1 );
+	}
+#endif
+
 #ifdef USE_MULTI_SEGMENT
 	if ( size < (sizeof( freeblock_t ) ) ) {
 		size = (sizeof( freeblock_t ) );
@@ -1551,6 +1838,9 @@ void *Z_TagMalloc( int size, memtag_t tag ) {
 	zone->rover = base->next;	// next allocation will start looking here
 #endif
 	zone->used += base->size;
+	if ( zone->used > zone->highwater ) {
+		zone->highwater = zone->used;
+	}
 
 	base->tag = tag;			// no longer a free block
 	base->id = ZONEID;
@@ -1856,15 +2146,51 @@ typedef struct zone_stats_s {
 	int	zoneSegments;
 	int zoneBlocks;
 	int	zoneBytes;
-	int	botlibBytes;
-	int	rendererBytes;
+	int	tagBytes[ TAG_COUNT ];
 	int freeBytes;
 	int freeBlocks;
 	int freeSmallest;
 	int freeLargest;
+#ifdef USE_ZONE_SLABS
+	int slabPages;
+	int slabFreeBytes;
+	int slabFreeSlots;
+#endif
 } zone_stats_t;
 
 
+#ifdef USE_ZONE_SLABS
+static void Zone_SlabStats( const slabPage_t *page, qboolean printDetails, zone_stats_t *st )
+{
+	const memblock_t *slot;
+	int i, used;
+
+	st->slabPages++;
+
+	used = 0;
+	for ( i = 0; i < page->numSlots; i++ ) {
+		slot = (const memblock_t *)( (const byte *)page + PAD( sizeof( *page ), sizeof( intptr_t ) ) + i * page->slotSize );
+		if ( slot->tag != TAG_FREE ) {
+			st->zoneBytes += slot->size;
+			st->zoneBlocks++;
+			if ( (unsigned)slot->tag < TAG_COUNT ) {
+				st->tagBytes[ slot->tag ] += slot->size;
+			}
+			used++;
+		} else {
+			st->slabFreeBytes += slot->size;
+			st->slabFreeSlots++;
+		}
+	}
+
+	if ( printDetails ) {
+		Com_Printf( "slab:%p  size:%8i  class: %i  used: %i/%i\n", (const void *)page, SLAB_PAGE_SIZE,
+			slabSize[ page->cls ], used, page->numSlots );
+	}
+}
+#endif
+
+
 static void Zone_Stats( const char *name, const memzone_t *z, qboolean printDetails, zone_stats_t *stats )
 {
 	const memblock_t *block;
@@ -1881,26 +2207,32 @@ static void Zone_Stats( const char *name, const memzone_t *z, qboolean printDeta
 	//}
 
 	for ( block = zone->blocklist.next ; ; ) {
-		if ( printDetails ) {
-			int tag = block->tag;
-			Com_Printf( "block:%p  size:%8i  tag: %s\n", (void *)block, block->size,
-				(unsigned)tag < TAG_COUNT ? tagName[ tag ] : va( "%i", tag ) );
-		}
-		if ( block->tag != TAG_FREE ) {
-			st.zoneBytes += block->size;
-			st.zoneBlocks++;
-			if ( block->tag == TAG_BOTLIB ) {
-				st.botlibBytes += block->size;
-			} else if ( block->tag == TAG_RENDERER ) {
-				st.rendererBytes += block->size;
+#ifdef USE_ZONE_SLABS
+		if ( block->id == SLABPAGEID ) {
+			// counted by slots instead of the page
+			Zone_SlabStats( (const slabPage_t *)( block + 1 ), printDetails, &st );
+		} else
+#endif
+		{
+			if ( printDetails ) {
+				int tag = block->tag;
+				Com_Printf( "block:%p  size:%8i  tag: %s\n", (void *)block, block->size,
+					(unsigned)tag < TAG_COUNT ? tagName[ tag ] : va( "%i", tag ) );
+			}
+			if ( block->tag != TAG_FREE ) {
+				st.zoneBytes += block->size;
+				st.zoneBlocks++;
+				if ( (unsigned)block->tag < TAG_COUNT ) {
+					st.tagBytes[ block->tag ] += block->size;
+				}
+			} else {
+				st.freeBytes += block->size;
+				st.freeBlocks++;
+				if ( block->size > st.freeLargest )
+					st.freeLargest = block->size;
+				if ( block->size < st.freeSmallest )
+					st.freeSmallest = block->size;
 			}
-		} else {
-			st.freeBytes += block->size;
-			st.freeBlocks++;
-			if ( block->size > st.freeLargest )
-				st.freeLargest = block->size;
-			if ( block->size < st.freeSmallest )
-				st.freeSmallest = block->size;
 		}
 		if ( block->next == &zone->blocklist ) {
 			break; // all blocks have been hit
@@ -1935,6 +2267,9 @@ static void Zone_Stats( const char *name, const memzone_t *z, qboolean printDeta
 }
 
 
+static void Com_ScratchInfo( void );
+static void Com_ScratchReport( jsonWriter_t *w );
+
 /*
 =================
 Com_Meminfo_f
@@ -1943,6 +2278,7 @@ Com_Meminfo_f
 static void Com_Meminfo_f( void ) {
 	zone_stats_t st;
 	int		unused;
+	int		chunkBytes, usedBytes, usedBlocks, largeBlocks;
 
 	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
 	Com_Printf( "\n" );
@@ -1972,26 +2308,249 @@ static void Com_Meminfo_f( void ) {
 	Com_Printf( "\n" );
 
 	Zone_Stats( "main", mainzone, !Q_stricmp( Cmd_Argv(1), "main" ) || !Q_stricmp( Cmd_Argv(1), "all" ), &st );
-	Com_Printf( "%8i bytes total main zone\n\n", mainzone->size );
+	Com_Printf( "%8i bytes total main zone, %i highwater\n\n", mainzone->size, mainzone->highwater );
 	Com_Printf( "%8i bytes in %i main zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
 		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
-	Com_Printf( "        %8i bytes in botlib\n", st.botlibBytes );
-	Com_Printf( "        %8i bytes in renderer\n", st.rendererBytes );
-	Com_Printf( "        %8i bytes in other\n", st.zoneBytes - ( st.botlibBytes + st.rendererBytes ) );
+	Com_Printf( "        %8i bytes in botlib\n", st.tagBytes[ TAG_BOTLIB ] );
+	if ( SV_BotLibMemoryStats( &chunkBytes, &usedBytes, &usedBlocks, &largeBlocks ) ) {
+		Com_Printf( "            %8i bytes in botlib pool, %i bytes in %i pool blocks, %i large blocks\n",
+			chunkBytes, usedBytes, usedBlocks, largeBlocks );
+	}
+	Com_Printf( "        %8i bytes in renderer\n", st.tagBytes[ TAG_RENDERER ] );
+	Com_Printf( "        %8i bytes in other\n", st.zoneBytes - ( st.tagBytes[ TAG_BOTLIB ] + st.tagBytes[ TAG_RENDERER ] ) );
 	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
 	if ( st.freeBlocks > 1 ) {
 		Com_Printf( "        (largest: %i bytes, smallest: %i bytes)\n\n", st.freeLargest, st.freeSmallest );
 	}
+#ifdef USE_ZONE_SLABS
+	Com_Printf( "        %8i bytes in %i free slots of %i slab pages\n", st.slabFreeBytes, st.slabFreeSlots, st.slabPages );
+#endif
 
 	Zone_Stats( "small", smallzone, !Q_stricmp( Cmd_Argv(1), "small" ) || !Q_stricmp( Cmd_Argv(1), "all" ), &st );
-	Com_Printf( "%8i bytes total small zone\n\n", smallzone->size );
+	Com_Printf( "%8i bytes total small zone, %i highwater\n\n", smallzone->size, smallzone->highwater );
 	Com_Printf( "%8i bytes in %i small zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
 		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
 	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
 	if ( st.freeBlocks > 1 ) {
 		Com_Printf( "        (largest: %i bytes, smallest: %i bytes)\n\n", st.freeLargest, st.freeSmallest );
 	}
+#ifdef USE_ZONE_SLABS
+	Com_Printf( "        %8i bytes in %i free slots of %i slab pages\n", st.slabFreeBytes, st.slabFreeSlots, st.slabPages );
+#endif
+
+	Com_Printf( "\n" );
+	Com_ScratchInfo();
+}
+
+
+/*
+=================
+Com_ReportZone
+=================
+*/
+static void Com_ReportZone( jsonWriter_t *w, const char *name, const memzone_t *zone ) {
+	zone_stats_t st;
+	int i;
+
+	Zone_Stats( name, zone, qfalse, &st );
+
+	JSON_WriteObjectBegin( w, name );
+	JSON_WriteInt( w, "size", zone->size );
+	JSON_WriteInt( w, "used", zone->used );
+	JSON_WriteInt( w, "highwater", zone->highwater );
+	JSON_WriteInt( w, "segments", st.zoneSegments );
+	JSON_WriteInt( w, "blocks", st.zoneBlocks );
+	JSON_WriteInt( w, "freeBytes", st.freeBytes );
+	JSON_WriteInt( w, "freeBlocks", st.freeBlocks );
+	JSON_WriteInt( w, "freeLargest", st.freeLargest );
+	JSON_WriteObjectBegin( w, "tags" );
+	for ( i = TAG_FREE + 1; i < TAG_COUNT; i++ ) {
+		if ( st.tagBytes[ i ] ) {
+			JSON_WriteInt( w, tagName[ i ], st.tagBytes[ i ] );
+		}
+	}
+	JSON_WriteObjectEnd( w );
+	JSON_WriteObjectEnd( w );
+}
+
+
+/*
+=================
+Com_ReportHunk
+=================
+*/
+static void Com_ReportHunk( jsonWriter_t *w, const char *name, const hunkUsed_t *hunk ) {
+	JSON_WriteObjectBegin( w, name );
+	JSON_WriteInt( w, "mark", hunk->mark );
+	JSON_WriteInt( w, "permanent", hunk->permanent );
+	JSON_WriteInt( w, "temp", hunk->temp );
+	JSON_WriteInt( w, "tempHighwater", hunk->tempHighwater );
+	JSON_WriteObjectEnd( w );
+}
+
+
+/*
+=================
+Com_MemReport_f
+
+Prints usage of all memory pools as a single line of JSON, it holds
+no addresses so is safe to send over rcon. With a file name the report
+is written to the home directory instead, not allowed from rcon
+=================
+*/
+static void Com_MemReport_f( void ) {
+	static char buf[ 16384 ];
+	char filename[ MAX_QPATH ];
+	jsonWriter_t w;
+	const char *name;
+	int i, size, used, highwater;
+	int blocks, largeBlocks;
+#ifndef DEDICATED
+	int images;
+#endif
+
+	if ( Cmd_Argc() > 2 ) {
+		Com_Printf( "usage: memreport [filename]\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() == 2 && rd_buffer ) {
+		Com_Printf( "memreport: can't write files from redirected command\n" );
+		return;
+	}
+
+	JSON_WriterInit( &w, buf, sizeof( buf ) );
+	JSON_WriteObjectBegin( &w, NULL );
+	JSON_WriteInt( &w, "frame", com_frameNumber );
+
+	JSON_WriteObjectBegin( &w, "hunk" );
+	JSON_WriteInt( &w, "size", s_hunkTotal );
+	Com_ReportHunk( &w, "low", &hunk_low );
+	Com_ReportHunk( &w, "high", &hunk_high );
+	JSON_WriteObjectEnd( &w );
+
+	JSON_WriteObjectBegin( &w, "zone" );
+	Com_ReportZone( &w, "main", mainzone );
+	Com_ReportZone( &w, "small", smallzone );
+	JSON_WriteObjectEnd( &w );
+
+	Com_ScratchReport( &w );
+
+	JSON_WriteArrayBegin( &w, "vm" );
+	for ( i = 0; i < VM_COUNT; i++ ) {
+		if ( VM_MemoryStats( i, &name, &size, &used ) ) {
+			JSON_WriteObjectBegin( &w, NULL );
+			JSON_WriteString( &w, "name", name );
+			JSON_WriteInt( &w, "code", size );
+			JSON_WriteInt( &w, "data", used );
+			JSON_WriteObjectEnd( &w );
+		}
+	}
+	JSON_WriteArrayEnd( &w );
+
+	if ( com_sv_running && com_sv_running->integer ) {
+		SV_SnapshotStorageStats( &size, &used, &highwater );
+		JSON_WriteObjectBegin( &w, "snapshots" );
+		JSON_WriteInt( &w, "size", size );
+		JSON_WriteInt( &w, "used", used );
+		JSON_WriteInt( &w, "highwater", highwater );
+		JSON_WriteObjectEnd( &w );
+	}
+
+	if ( SV_BotLibMemoryStats( &size, &used, &blocks, &largeBlocks ) ) {
+		JSON_WriteObjectBegin( &w, "botlib" );
+		JSON_WriteInt( &w, "poolBytes", size );
+		JSON_WriteInt( &w, "usedBytes", used );
+		JSON_WriteInt( &w, "usedBlocks", blocks );
+		JSON_WriteInt( &w, "largeBlocks", largeBlocks );
+		JSON_WriteObjectEnd( &w );
+	}
+
+#ifndef DEDICATED
+	if ( CL_RendererMemoryStats( &images, &size, &used ) ) {
+		JSON_WriteObjectBegin( &w, "renderer" );
+		JSON_WriteInt( &w, "images", images );
+		JSON_WriteInt( &w, "imageBytes", size );
+		JSON_WriteInt( &w, "vboBytes", used );
+		JSON_WriteObjectEnd( &w );
+	}
+#endif
+
+	JSON_WriteObjectEnd( &w );
+
+	if ( w.overflowed ) {
+		Com_Printf( S_COLOR_YELLOW "memreport: report truncated at %i bytes\n", w.len );
+		return;
+	}
+
+	if ( Cmd_Argc() == 2 ) {
+		Q_strncpyz( filename, Cmd_Argv( 1 ), sizeof( filename ) );
+		COM_DefaultExtension( filename, sizeof( filename ), ".json" );
+		FS_WriteFile( filename, buf, w.len );
+		Com_Printf( "Wrote %s\n", filename );
+		return;
+	}
+
+	// redirect buffers are small, don't let a single print get truncated
+	for ( i = 0; i < w.len; i += 512 ) {
+		Com_Printf( "%.*s", MIN( 512, (int)w.len - i ), buf + i );
+	}
+	Com_Printf( "\n" );
+}
+
+
+#ifdef USE_ZONE_SLABS
+/*
+=================
+Com_ZoneBench_f
+
+Churns a working set of small allocations through a zone,
+first with free lists only, then with slabs in front
+=================
+*/
+static void Com_ZoneBench_f( void ) {
+	static void *ptrs[ 1024 ];
+	int64_t start, times[ 2 ];
+	unsigned int seed;
+	int i, n, size, ops, pass;
+	memtag_t tag;
+
+	ops = atoi( Cmd_Argv( 1 ) );
+	if ( ops <= 0 ) {
+		ops = 1000000;
+	}
+
+	tag = !Q_stricmp( Cmd_Argv( 2 ), "small" ) ? TAG_SMALL : TAG_GENERAL;
+
+	for ( pass = 0; pass < 2; pass++ ) {
+		useSlabs = ( pass == 1 ) ? qtrue : qfalse;
+		seed = 0x5eed;
+		start = Sys_Microseconds();
+		for ( i = 0; i < ops; i++ ) {
+			seed = seed * 1103515245 + 12345;
+			n = ( seed >> 8 ) & ( ARRAY_LEN( ptrs ) - 1 );
+			// mostly small sizes, like strings
+			size = ( 1 + ( seed >> 18 ) % SLAB_MAX_SIZE ) >> ( seed >> 30 );
+			if ( ptrs[ n ] ) {
+				Z_Free( ptrs[ n ] );
+			}
+			ptrs[ n ] = Z_TagMalloc( size, tag );
+		}
+		for ( n = 0; n < ARRAY_LEN( ptrs ); n++ ) {
+			if ( ptrs[ n ] ) {
+				Z_Free( ptrs[ n ] );
+				ptrs[ n ] = NULL;
+			}
+		}
+		times[ pass ] = Sys_Microseconds() - start;
+	}
+
+	useSlabs = qtrue;
+
+	Com_Printf( "%i %s zone alloc/free pairs: free lists %i usec, slabs %i usec\n",
+		ops, tag == TAG_SMALL ? "small" : "main", (int)times[ 0 ], (int)times[ 1 ] );
 }
+#endif
 
 
 /*
@@ -2064,16 +2623,67 @@ static void Com_InitSmallZoneMemory( void ) {
 
 /*
 =================
-Com_InitZoneMemory
+Com_AllocLargeBlock
+
+Zero filled memory for the main zone and hunk, optionally backed by
+large pages and touched up front so that the first map load doesn't
+take page faults across all of it
 =================
 */
-static void Com_InitZoneMemory( void ) {
-	int		mainZoneSize;
-	cvar_t	*cv;
+static void *Com_AllocLargeBlock( int size, const char *name ) {
+	cvar_t *largePages, *prefault;
+	qboolean large;
+	void *ptr;
+	int i, start;
+
+	// same as com_zoneMegs these are only seen by the zone if set on the command line
+	largePages = Cvar_Get( "com_largePages", "0", CVAR_LATCH | CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( largePages, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( largePages, "Back hunk and main zone memory with large (huge) pages to reduce TLB misses.\n"
+		"On Linux reserved huge pages are used if available, transparent huge pages otherwise,\n"
+		"on Windows the \"Lock pages in memory\" user right is required." );
+	prefault = Cvar_Get( "com_prefault", "0", CVAR_LATCH | CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( prefault, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( prefault, "Touch all hunk and main zone memory at startup instead of on first use." );
+
+	if ( largePages->integer ) {
+		large = qtrue;
+		ptr = Sys_AllocPages( size, &large );
+		if ( ptr ) {
+			Com_Printf( "%s: %i MB %s\n", name, size / (1024*1024), large ? "with large pages" : "without large pages, not available" );
+		}
+	} else {
+		ptr = calloc( size, 1 );
+	}
 
-	// Please note: com_zoneMegs can only be set on the command line, and
-	// not in q3config.cfg or Com_StartupVariable, as they haven't been
-	// executed by this point. It's a chicken and egg problem. We need the
+	if ( !ptr ) {
+		return NULL;
+	}
+
+	if ( prefault->integer ) {
+		start = Sys_Milliseconds();
+		for ( i = 0; i < size; i += 4096 ) {
+			((volatile byte *)ptr)[ i ] = 0;
+		}
+		Com_Printf( "%s: prefaulted %i MB in %i msec\n", name, size / (1024*1024), Sys_Milliseconds() - start );
+	}
+
+	return ptr;
+}
+
+
+/*
+=================
+Com_InitZoneMemory
+=================
+*/
+static void Com_InitZoneMemory( void ) {
+	int		mainZoneSize;
+	cvar_t	*cv;
+
+	// Please note: com_zoneMegs can only be set on the command line, and
+	// not in q3config.cfg or Com_StartupVariable, as they haven't been
+	// executed by this point. It's a chicken and egg problem. We need the
 	// memory manager configured to handle those places where you would
 	// configure the memory manager.
 
@@ -2089,7 +2699,7 @@ static void Com_InitZoneMemory( void ) {
 #endif
 		mainZoneSize = cv->integer * 1024 * 1024;
 
-	mainzone = calloc( mainZoneSize, 1 );
+	mainzone = Com_AllocLargeBlock( mainZoneSize, "main zone" );
 	if ( !mainzone ) {
 		Com_Error( ERR_FATAL, "Zone data failed to allocate %i megs", mainZoneSize / (1024*1024) );
 	}
@@ -2202,7 +2812,7 @@ static void Com_InitHunkMemory( void ) {
 
 	s_hunkTotal = cv->integer * 1024 * 1024;
 
-	s_hunkData = calloc( s_hunkTotal + 63, 1 );
+	s_hunkData = Com_AllocLargeBlock( s_hunkTotal + 63, "hunk" );
 	if ( !s_hunkData ) {
 		Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
 	}
@@ -2212,6 +2822,7 @@ static void Com_InitHunkMemory( void ) {
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "memreport", Com_MemReport_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -2528,6 +3139,386 @@ void Hunk_ClearTempMemory( void ) {
 /*
 ===================================================================
 
+SCRATCH MEMORY
+
+Each thread gets its own bump allocator for temporary data of parallel
+work, so no locking or stack order between threads is needed like for
+hunk temp memory.  Allocations live until the thread allocates again in
+a later frame, or until Com_ScratchRelease for a mark taken earlier.
+Frame resets are skipped while the thread has an open scope.
+An arena that runs out of space chains additional blocks from malloc,
+these are released with the scope or frame they were made in.
+
+With com_scratchDebug released memory is filled with a pattern that
+is verified when handed out again, so writes through stale pointers
+are reported at the start of next frame
+===================================================================
+*/
+
+#define MAX_SCRATCH_ARENAS	32	// main, job and I/O threads
+#define SCRATCH_ALIGN		16
+#define SCRATCH_POISON		0xdd
+
+typedef struct scratchBlock_s {
+	struct scratchBlock_s *prev;
+	int			base;			// arena offset of the first byte
+	int			size;
+	int			used;
+} scratchBlock_t;
+
+typedef struct {
+	scratchBlock_t *block;		// current block, chained to the first one
+	int			frame;			// com_frameNumber of the last reset
+	int			scopes;			// open marks
+	int			highwater;
+	int			overflows;		// blocks chained since last report
+	int			stale;			// debug: offset of stale write + 1
+	qboolean	claimed;
+} scratchArena_t;
+
+#define SCRATCH_BLOCK_HEADER PAD( sizeof( scratchBlock_t ), SCRATCH_ALIGN )
+
+static scratchArena_t	scratchArenas[ MAX_SCRATCH_ARENAS ];
+static THREAD_LOCAL scratchArena_t *scratchArena;
+static void				*scratchLock;
+static int				scratchSize;
+static qboolean			scratchDebug;
+
+static cvar_t			*com_scratchMegs;
+static cvar_t			*com_scratchDebug;
+
+
+/*
+=================
+Com_ScratchNewBlock
+=================
+*/
+static scratchBlock_t *Com_ScratchNewBlock( scratchBlock_t *prev, int size )
+{
+	scratchBlock_t *block;
+
+	block = malloc( SCRATCH_BLOCK_HEADER + size );
+	if ( block == NULL ) {
+		Sys_Error( "Scratch memory failed to allocate %i bytes", size );
+	}
+
+	block->prev = prev;
+	block->base = prev ? prev->base + prev->size : 0;
+	block->size = size;
+	block->used = 0;
+
+	if ( scratchDebug ) {
+		Com_Memset( (byte *)block + SCRATCH_BLOCK_HEADER, SCRATCH_POISON, size );
+	}
+
+	return block;
+}
+
+
+/*
+=================
+Com_ScratchRewind
+
+Releases everything above arena offset mark
+=================
+*/
+static void Com_ScratchRewind( scratchArena_t *arena, int mark )
+{
+	scratchBlock_t *block;
+
+	while ( ( block = arena->block )->base > mark ) {
+		arena->block = block->prev;
+		free( block );
+	}
+
+	mark -= block->base;
+	if ( mark > block->used ) {
+		return;
+	}
+
+	if ( scratchDebug ) {
+		Com_Memset( (byte *)block + SCRATCH_BLOCK_HEADER + mark, SCRATCH_POISON, block->used - mark );
+	}
+
+	block->used = mark;
+}
+
+
+/*
+=================
+Com_ScratchArena
+
+Returns arena of the calling thread, claims one on first use
+=================
+*/
+static scratchArena_t *Com_ScratchArena( void )
+{
+	scratchArena_t *arena;
+	int i;
+
+	if ( scratchArena ) {
+		return scratchArena;
+	}
+
+	if ( scratchLock ) {
+		Sys_LockMutex( scratchLock );
+	}
+
+	for ( i = 0, arena = scratchArenas; i < MAX_SCRATCH_ARENAS; i++, arena++ ) {
+		if ( !arena->claimed ) {
+			arena->claimed = qtrue;
+			break;
+		}
+	}
+
+	if ( scratchLock ) {
+		Sys_UnlockMutex( scratchLock );
+	}
+
+	if ( i == MAX_SCRATCH_ARENAS ) {
+		Sys_Error( "Com_ScratchArena: too many threads" );
+	}
+
+	// memory of released arenas is kept for the next thread
+	if ( arena->block == NULL ) {
+		arena->block = Com_ScratchNewBlock( NULL, scratchSize );
+	}
+	arena->frame = com_frameNumber;
+	arena->scopes = 0;
+
+	scratchArena = arena;
+
+	return arena;
+}
+
+
+/*
+=================
+Com_ScratchAlloc
+
+Returns SCRATCH_ALIGN aligned memory from the arena of the calling thread,
+not zero filled. Safe to call from job callbacks
+=================
+*/
+void *Com_ScratchAlloc( int size )
+{
+	scratchArena_t *arena;
+	scratchBlock_t *block;
+	byte *buf;
+	int i;
+
+	arena = Com_ScratchArena();
+
+	if ( arena->frame != com_frameNumber && arena->scopes == 0 ) {
+		Com_ScratchRewind( arena, 0 );
+		arena->frame = com_frameNumber;
+	}
+
+	size = PAD( size, SCRATCH_ALIGN );
+
+	block = arena->block;
+	if ( block->used + size > block->size ) {
+		block = Com_ScratchNewBlock( block, MAX( size, scratchSize ) );
+		arena->block = block;
+		arena->overflows++;
+	}
+
+	buf = (byte *)block + SCRATCH_BLOCK_HEADER + block->used;
+
+	if ( scratchDebug && !arena->stale ) {
+		for ( i = 0; i < size; i++ ) {
+			if ( buf[ i ] != SCRATCH_POISON ) {
+				arena->stale = block->base + block->used + i + 1;
+				break;
+			}
+		}
+	}
+
+	block->used += size;
+
+	if ( block->base + block->used > arena->highwater ) {
+		arena->highwater = block->base + block->used;
+	}
+
+	return buf;
+}
+
+
+/*
+=================
+Com_ScratchMark
+
+Opens a scope, memory allocated after this is released by
+Com_ScratchRelease with the returned mark
+=================
+*/
+int Com_ScratchMark( void )
+{
+	scratchArena_t *arena;
+
+	arena = Com_ScratchArena();
+	arena->scopes++;
+
+	return arena->block->base + arena->block->used;
+}
+
+
+/*
+=================
+Com_ScratchRelease
+=================
+*/
+void Com_ScratchRelease( int mark )
+{
+	scratchArena_t *arena;
+
+	arena = Com_ScratchArena();
+	if ( arena->scopes <= 0 ) {
+		Sys_Error( "Com_ScratchRelease without Com_ScratchMark" );
+	}
+
+	arena->scopes--;
+	Com_ScratchRewind( arena, mark );
+}
+
+
+/*
+=================
+Com_ScratchThreadExit
+
+Returns arena of the calling thread to the pool, must be
+called by threads using scratch memory before they exit
+=================
+*/
+void Com_ScratchThreadExit( void )
+{
+	scratchArena_t *arena;
+
+	arena = scratchArena;
+	if ( arena == NULL ) {
+		return;
+	}
+
+	Com_ScratchRewind( arena, 0 );
+	arena->scopes = 0;
+	scratchArena = NULL;
+
+	if ( scratchLock ) {
+		Sys_LockMutex( scratchLock );
+	}
+	arena->claimed = qfalse;
+	if ( scratchLock ) {
+		Sys_UnlockMutex( scratchLock );
+	}
+}
+
+
+/*
+=================
+Com_ScratchFrame
+
+Resets arena of the main thread, scopes left open by an ERR_DROP are
+discarded too. Reports sizing problems and stale writes of other threads
+=================
+*/
+static void Com_ScratchFrame( void )
+{
+	scratchArena_t *arena;
+	int i;
+
+	arena = Com_ScratchArena();
+	arena->scopes = 0;
+	Com_ScratchRewind( arena, 0 );
+	arena->frame = com_frameNumber;
+
+	for ( i = 0, arena = scratchArenas; i < MAX_SCRATCH_ARENAS; i++, arena++ ) {
+		if ( !arena->claimed ) {
+			continue;
+		}
+		if ( arena->stale ) {
+			Com_Error( ERR_FATAL, "Scratch arena %i: memory written after release at offset %i", i, arena->stale - 1 );
+		}
+		if ( arena->overflows ) {
+			Com_DPrintf( S_COLOR_YELLOW "Scratch arena %i overflowed %i times, highwater %i KB, consider raising com_scratchMegs\n",
+				i, arena->overflows, arena->highwater / 1024 );
+			arena->overflows = 0;
+		}
+	}
+}
+
+
+/*
+=================
+Com_ScratchInfo
+=================
+*/
+static void Com_ScratchInfo( void )
+{
+	const scratchArena_t *arena;
+	int i;
+
+	for ( i = 0, arena = scratchArenas; i < MAX_SCRATCH_ARENAS; i++, arena++ ) {
+		if ( arena->block ) {
+			Com_Printf( "%8i scratch arena %i highwater%s\n", arena->highwater, i, arena->claimed ? "" : " (free)" );
+		}
+	}
+}
+
+
+/*
+=================
+Com_ScratchReport
+=================
+*/
+static void Com_ScratchReport( jsonWriter_t *w )
+{
+	const scratchArena_t *arena;
+	int i;
+
+	JSON_WriteObjectBegin( w, "scratch" );
+	JSON_WriteInt( w, "blockSize", scratchSize );
+	JSON_WriteArrayBegin( w, "arenas" );
+	for ( i = 0, arena = scratchArenas; i < MAX_SCRATCH_ARENAS; i++, arena++ ) {
+		if ( arena->block ) {
+			JSON_WriteObjectBegin( w, NULL );
+			JSON_WriteInt( w, "index", i );
+			JSON_WriteInt( w, "highwater", arena->highwater );
+			JSON_WriteInt( w, "claimed", arena->claimed );
+			JSON_WriteObjectEnd( w );
+		}
+	}
+	JSON_WriteArrayEnd( w );
+	JSON_WriteObjectEnd( w );
+}
+
+
+/*
+=================
+Com_InitScratchMemory
+=================
+*/
+static void Com_InitScratchMemory( void )
+{
+	com_scratchMegs = Cvar_Get( "com_scratchMegs", "4", CVAR_LATCH | CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( com_scratchMegs, "1", "256", CV_INTEGER );
+	Cvar_SetDescription( com_scratchMegs, "Size of per-thread scratch memory used by parallel tasks (in MB), more is taken from the system on demand." );
+
+	com_scratchDebug = Cvar_Get( "com_scratchDebug", "0", CVAR_LATCH );
+	Cvar_CheckRange( com_scratchDebug, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( com_scratchDebug, "Fill released scratch memory with a pattern and report writes through stale pointers." );
+
+	scratchSize = com_scratchMegs->integer * 1024 * 1024;
+	scratchDebug = com_scratchDebug->integer ? qtrue : qfalse;
+
+	scratchLock = Sys_CreateMutex();
+
+	// main thread
+	Com_ScratchArena();
+}
+
+/*
+===================================================================
+
 EVENTS AND JOURNALING
 
 In addition to these events, .cfg files are also copied to the
@@ -2584,13 +3575,32 @@ EVENT LOOP
 ========================================================================
 */
 
-#define MAX_QUED_EVENTS		128
-#define MASK_QUED_EVENTS	( MAX_QUED_EVENTS - 1 )
+/*
+System events are kept in a bounded multi-producer single-consumer ring,
+input and sound threads may queue events while the main thread reads them.
+Each slot carries a sequence number telling whether it is free for the
+position a producer claimed or filled for the consumer, so neither side
+takes a lock. A full queue drops the new event and counts it, the count
+is reported on the main thread.
+*/
 
-static sysEvent_t			eventQue[ MAX_QUED_EVENTS ];
-static sysEvent_t			*lastEvent = eventQue + MAX_QUED_EVENTS - 1;
-static unsigned int			eventHead = 0;
-static unsigned int			eventTail = 0;
+#define MAX_QUED_EVENTS		8192	// upper limit of com_eventQueueSize
+#define DEF_QUED_EVENTS		1024
+
+typedef struct {
+	volatile int	seq;		// position when free, position + 1 when filled
+	sysEvent_t		ev;
+} quedEvent_t;
+
+static quedEvent_t			eventQue[ MAX_QUED_EVENTS ];
+static int					eventMask;		// capacity - 1, zero until initialized
+static volatile int			eventHead;		// next position for producers
+static int					eventTail;		// next position for the main thread
+static volatile int			eventDropped;
+static volatile int			eventDroppedType;	// of last dropped, for the report
+static int					eventDroppedReported;
+
+static cvar_t				*com_eventQueueSize;
 
 static const char *Sys_EventName( sysEventType_t evType ) {
 
@@ -2611,6 +3621,35 @@ static const char *Sys_EventName( sysEventType_t evType ) {
 }
 
 
+/*
+================
+Com_InitEventQueue
+
+Sets capacity, rounded down to a power of two. Only
+resized while empty since producers may already be running
+================
+*/
+static void Com_InitEventQueue( int size )
+{
+	int i;
+
+	if ( eventMask && Sys_AtomicLoad( &eventHead ) != eventTail ) {
+		return;
+	}
+
+	size = MAX( 2, MIN( size, MAX_QUED_EVENTS ) );
+	while ( size & ( size - 1 ) ) {
+		size &= size - 1;
+	}
+
+	for ( i = 0; i < size; i++ ) {
+		eventQue[ i ].seq = eventTail + i;
+	}
+
+	Sys_AtomicStore( &eventMask, size - 1 );
+}
+
+
 /*
 ================
 Sys_QueEvent
@@ -2618,10 +3657,12 @@ Sys_QueEvent
 A time of 0 will get the current time
 Ptr should either be null, or point to a block of data that can
 be freed by the game later.
+Safe to call from any thread.
 ================
 */
 void Sys_QueEvent( int evTime, sysEventType_t evType, int value, int value2, int ptrLength, void *ptr ) {
-	sysEvent_t	*ev;
+	quedEvent_t	*slot;
+	int			pos, dif;
 
 #if 0
 	Com_Printf( "%-10s: evTime=%i, evTail=%i, evHead=%i\n",
@@ -2632,35 +3673,122 @@ void Sys_QueEvent( int evTime, sysEventType_t evType, int value, int value2, int
 		evTime = Sys_Milliseconds();
 	}
 
-	// try to combine all sequential mouse moves in one event
-	if ( evType == SE_MOUSE && lastEvent->evType == SE_MOUSE && eventHead != eventTail ) {
-		lastEvent->evValue += value;
-		lastEvent->evValue2 += value2;
-		lastEvent->evTime = evTime;
-		return;
+	if ( !eventMask ) {
+		// events before Com_Init
+		Com_InitEventQueue( DEF_QUED_EVENTS );
 	}
 
-	ev = &eventQue[ eventHead & MASK_QUED_EVENTS ];
-
-	if ( eventHead - eventTail >= MAX_QUED_EVENTS ) {
-		Com_Printf( "%s(type=%s,keys=(%i,%i),time=%i): overflow\n", __func__, Sys_EventName( evType ), value, value2, evTime );
-		// we are discarding an event, but don't leak memory
-		if ( ev->evPtr ) {
-			Z_Free( ev->evPtr );
+	pos = Sys_AtomicLoad( &eventHead );
+	for ( ;; ) {
+		slot = &eventQue[ pos & eventMask ];
+		dif = (int)( (unsigned)Sys_AtomicLoad( &slot->seq ) - (unsigned)pos );
+		if ( dif == 0 ) {
+			// slot is free for this position, try to claim it
+			if ( Sys_AtomicCompareSwap( &eventHead, pos, (int)( (unsigned)pos + 1 ) ) ) {
+				break;
+			}
+			pos = Sys_AtomicLoad( &eventHead );
+		} else if ( dif < 0 ) {
+			// not consumed yet since last lap, queue is full
+			Sys_AtomicStore( &eventDroppedType, evType );
+			Sys_AtomicAdd( &eventDropped, 1 );
+			// we are discarding an event, but don't leak memory
+			if ( ptr ) {
+				Z_Free( ptr );
+			}
+			return;
+		} else {
+			// claimed by another producer meanwhile
+			pos = Sys_AtomicLoad( &eventHead );
 		}
-		eventTail++;
 	}
 
-	eventHead++;
+	slot->ev.evTime = evTime;
+	slot->ev.evType = evType;
+	slot->ev.evValue = value;
+	slot->ev.evValue2 = value2;
+	slot->ev.evPtrLength = ptrLength;
+	slot->ev.evPtr = ptr;
+
+	// publish to the consumer
+	Sys_AtomicStore( &slot->seq, (int)( (unsigned)pos + 1 ) );
+}
+
+
+/*
+================
+Com_PeekEvent
+
+Returns next filled slot or NULL, main thread only
+================
+*/
+static quedEvent_t *Com_PeekEvent( void )
+{
+	quedEvent_t *slot;
+
+	if ( !eventMask ) {
+		return NULL;
+	}
+
+	slot = &eventQue[ eventTail & eventMask ];
+	if ( Sys_AtomicLoad( &slot->seq ) != (int)( (unsigned)eventTail + 1 ) ) {
+		return NULL;
+	}
+
+	return slot;
+}
+
+
+/*
+================
+Com_ReleaseEvent
+
+Hands slot back to producers for the next lap
+================
+*/
+static void Com_ReleaseEvent( quedEvent_t *slot )
+{
+	Sys_AtomicStore( &slot->seq, (int)( (unsigned)eventTail + eventMask + 1 ) );
+	eventTail = (int)( (unsigned)eventTail + 1 );
+}
+
+
+/*
+================
+Com_PopEvent
+================
+*/
+static qboolean Com_PopEvent( sysEvent_t *ev )
+{
+	quedEvent_t *slot;
+	int dropped;
+
+	dropped = Sys_AtomicLoad( &eventDropped );
+	if ( dropped != eventDroppedReported ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i system events dropped (last %s), consider raising com_eventQueueSize\n",
+			dropped - eventDroppedReported, Sys_EventName( Sys_AtomicLoad( &eventDroppedType ) ) );
+		eventDroppedReported = dropped;
+	}
+
+	slot = Com_PeekEvent();
+	if ( !slot ) {
+		return qfalse;
+	}
 
-	ev->evTime = evTime;
-	ev->evType = evType;
-	ev->evValue = value;
-	ev->evValue2 = value2;
-	ev->evPtrLength = ptrLength;
-	ev->evPtr = ptr;
+	*ev = slot->ev;
+	Com_ReleaseEvent( slot );
 
-	lastEvent = ev;
+	// combine all sequential mouse moves in one event
+	if ( ev->evType == SE_MOUSE ) {
+		while ( ( slot = Com_PeekEvent() ) != NULL && slot->ev.evType == SE_MOUSE ) {
+			ev->evValue += slot->ev.evValue;
+			ev->evValue2 += slot->ev.evValue2;
+			ev->evTime = slot->ev.evTime;
+			Com_ReleaseEvent( slot );
+		}
+	}
+
+	return qtrue;
 }
 
 
@@ -2676,8 +3804,8 @@ static sysEvent_t Com_GetSystemEvent( void )
 	int			evTime;
 
 	// return if we have data
-	if ( eventHead - eventTail > 0 )
-		return eventQue[ ( eventTail++ ) & MASK_QUED_EVENTS ];
+	if ( Com_PopEvent( &ev ) )
+		return ev;
 
 	Sys_SendKeyEvents();
 
@@ -2697,8 +3825,8 @@ static sysEvent_t Com_GetSystemEvent( void )
 	}
 
 	// return if we have data
-	if ( eventHead - eventTail > 0 )
-		return eventQue[ ( eventTail++ ) & MASK_QUED_EVENTS ];
+	if ( Com_PopEvent( &ev ) )
+		return ev;
 
 	// create an empty event to return
 	memset( &ev, 0, sizeof( ev ) );
@@ -3301,12 +4429,23 @@ static uint64_t affinityMask; // saved at startup
 
 #if defined _MSC_VER
 #include <intrin.h>
+#if _MSC_VER >= 1600
+#include <immintrin.h>
+#endif
 static void CPUID( int func, unsigned int *regs )
 {
 	__cpuid( (int*)regs, func );
 }
 
-#ifdef USE_AFFINITY_MASK
+static uint64_t XGETBV( void )
+{
+#if _MSC_VER >= 1600
+	return _xgetbv( 0 );
+#else
+	return 0; // no AVX state support in compiler
+#endif
+}
+
 #if idx64
 extern void CPUID_EX( int func, int param, unsigned int *regs );
 #else
@@ -3326,7 +4465,6 @@ void CPUID_EX( int func, int param, unsigned int *regs )
 	}
 }
 #endif // !idx64
-#endif // USE_AFFINITY_MASK
 
 #else // clang/gcc/mingw
 
@@ -3340,7 +4478,6 @@ static void CPUID( int func, unsigned int *regs )
 		"a"(func) );
 }
 
-#ifdef USE_AFFINITY_MASK
 static void CPUID_EX( int func, int param, unsigned int *regs )
 {
 	__asm__ __volatile__( "cpuid" :
@@ -3351,14 +4488,20 @@ static void CPUID_EX( int func, int param, unsigned int *regs )
 		"a"(func),
 		"c"(param) );
 }
-#endif // USE_AFFINITY_MASK
+
+static uint64_t XGETBV( void )
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__( ".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0) ); // xgetbv
+	return ( (uint64_t)hi << 32 ) | lo;
+}
 
 #endif  // clang/gcc/mingw
 
 static void Sys_GetProcessorId( char *vendor )
 {
 	uint32_t regs[4]; // EAX, EBX, ECX, EDX
-	uint32_t cpuid_level_ex;
+	uint32_t cpuid_level, cpuid_level_ex;
 	char vendor_str[12 + 1]; // short CPU vendor string
 
 	// setup initial features
@@ -3374,6 +4517,7 @@ static void Sys_GetProcessorId( char *vendor )
 
 	// get CPUID level & short CPU vendor string
 	CPUID( 0x0, regs );
+	cpuid_level = regs[0];
 	memcpy(vendor_str + 0, (char*)&regs[1], 4);
 	memcpy(vendor_str + 4, (char*)&regs[3], 4);
 	memcpy(vendor_str + 8, (char*)&regs[2], 4);
@@ -3406,6 +4550,19 @@ static void Sys_GetProcessorId( char *vendor )
 	if ( regs[ 2 ] & ( 1 << 19 ) )
 		CPU_Flags |= CPU_SSE41;
 
+	// bit 28 of ECX denotes AVX existence, bit 27 that OS uses XSAVE,
+	// XCR0 tells whether the OS preserves upper halves of YMM registers
+	if ( ( regs[ 2 ] & ( 1 << 27 ) ) && ( regs[ 2 ] & ( 1 << 28 ) ) && ( XGETBV() & 6 ) == 6 ) {
+		CPU_Flags |= CPU_AVX;
+
+		// bit 5 of EBX from leaf 7 denotes AVX2 existence
+		if ( cpuid_level >= 7 ) {
+			CPUID_EX( 0x7, 0x0, regs );
+			if ( regs[ 1 ] & ( 1 << 5 ) )
+				CPU_Flags |= CPU_AVX2;
+		}
+	}
+
 	if ( vendor ) {
 		if ( cpuid_level_ex >= 0x80000004 ) {
 			// read CPU Brand string
@@ -3437,6 +4594,10 @@ static void Sys_GetProcessorId( char *vendor )
 				//	strcat( vendor, " SSE3" );
 				if (print_flags & CPU_SSE41)
 					strcat(vendor, " SSE4.1");
+				if (print_flags & CPU_AVX2)
+					strcat(vendor, " AVX2");
+				else if (print_flags & CPU_AVX)
+					strcat(vendor, " AVX");
 			}
 		}
 	}
@@ -3553,6 +4714,32 @@ static void Sys_GetProcessorId( char *vendor )
 
 #endif // non-x86
 
+
+/*
+================
+Com_SIMDFlags
+================
+*/
+int Com_SIMDFlags( void )
+{
+	int flags = CPU_Flags;
+
+#if (idx64 || id386)
+	if ( !com_simd ) {
+		return flags;
+	}
+	if ( com_simd->integer < 2 ) {
+		flags &= ~( CPU_AVX | CPU_AVX2 );
+	}
+	if ( com_simd->integer < 1 ) {
+		flags &= ~( CPU_MMX | CPU_SSE | CPU_SSE2 | CPU_SSE3 | CPU_SSE41 );
+	}
+#endif
+
+	return flags;
+}
+
+
 /*
 ================
 Sys_SnapVector
@@ -3757,9 +4944,120 @@ static void Com_SetAffinityMask( const char *str )
 		Sys_SetAffinityMask( mask );
 	}
 }
+
+
+static void Com_AffinityMaskChanged( cvar_t *var )
+{
+	Com_SetAffinityMask( var->string );
+}
+
+
+/*
+=================
+Com_ParseAffinityMask
+
+Mask in com_affinityMask syntax limited to the process mask,
+whole process mask if empty or nothing is left
+=================
+*/
+uint64_t Com_ParseAffinityMask( const char *str )
+{
+	uint64_t mask = 0;
+
+	parseAffinityMask( str, &mask, 0 );
+
+	mask &= affinityMask;
+	if ( mask == 0 ) {
+		mask = affinityMask;
+	}
+
+	return mask;
+}
 #endif // USE_AFFINITY_MASK
 
 
+// show or hide the log console
+static void Com_ViewlogChanged( cvar_t *var )
+{
+	if ( !com_dedicated->integer ) {
+		Sys_ShowConsole( var->integer, qfalse );
+	}
+}
+
+
+#ifdef DEDICATED
+/*
+=================
+Com_StartInstances
+
+Forks copies of the dedicated server once the filesystem is initialized,
+they share pak index and config pages with this process until written.
+Each instance listens on net_port + instance number, logs to its own
+qconsole<N>.log and executes instance<N>.cfg before startup commands
+=================
+*/
+static void Com_StartInstances( void ) {
+	cvar_t *instances, *instance;
+	const char *cfg;
+	int port;
+#ifdef USE_IPV6
+	int port6;
+#endif
+
+	instances = Cvar_Get( "com_instances", "1", CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( instances, "1", "32", CV_INTEGER );
+	Cvar_SetDescription( instances, "Number of dedicated server instances started by one process. "
+		"Each instance is a forked copy with its own server, game VM and net_port + instance number, see \\com_instance." );
+
+	if ( instances->integer <= 1 ) {
+		return;
+	}
+
+	if ( com_journal->integer ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: com_instances is ignored when journaling\n" );
+		return;
+	}
+
+	port = Cvar_VariableIntegerValue( "net_port" );
+	if ( port <= 0 ) {
+		port = PORT_SERVER;
+	}
+#ifdef USE_IPV6
+	port6 = Cvar_VariableIntegerValue( "net_port6" );
+	if ( port6 <= 0 ) {
+		port6 = PORT_SERVER;
+	}
+#endif
+
+	FS_PrepareFork();
+	com_instance = Sys_ForkInstances( instances->integer );
+	FS_ForkDone();
+
+	if ( com_instance ) {
+		// reopened under instance name on next print
+		if ( logfile != FS_INVALID_HANDLE ) {
+			FS_FCloseFile( logfile );
+			logfile = FS_INVALID_HANDLE;
+		}
+		Cvar_SetIntegerValue( "net_port", port + com_instance );
+#ifdef USE_IPV6
+		Cvar_SetIntegerValue( "net_port6", port6 + com_instance );
+#endif
+	}
+
+	instance = Cvar_Get( "com_instance", va( "%i", com_instance ), CVAR_ROM );
+	Cvar_SetDescription( instance, "Read-only number of this dedicated server instance, 0 for the first one, see \\com_instances." );
+
+	cfg = va( "instance%i.cfg", com_instance );
+	if ( FS_ReadFile( cfg, NULL ) > 0 ) {
+		Cbuf_AddText( va( "exec %s\n", cfg ) );
+	}
+
+	Com_Printf( "Started dedicated server instance %i of %i\n", com_instance, instances->integer );
+}
+#endif
+
+
 /*
 =================
 Com_Init
@@ -3822,6 +5120,11 @@ void Com_Init( char *commandLine ) {
 	Cvar_CheckRange( com_journal, "0", "2", CV_INTEGER );
 	Cvar_SetDescription( com_journal, "When enabled, writes events and its data to 'journal.dat' and 'journaldata.dat'.");
 
+	com_eventQueueSize = Cvar_Get( "com_eventQueueSize", XSTRING( DEF_QUED_EVENTS ), CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( com_eventQueueSize, "64", XSTRING( MAX_QUED_EVENTS ), CV_INTEGER );
+	Cvar_SetDescription( com_eventQueueSize, "Capacity of system event queue, rounded down to a power of two. Raise it if events are reported dropped with high polling rate devices." );
+	Com_InitEventQueue( com_eventQueueSize->integer );
+
 	Com_StartupVariable( "sv_master1" );
 	Com_StartupVariable( "sv_master2" );
 	Com_StartupVariable( "sv_master3" );
@@ -3877,6 +5180,8 @@ void Com_Init( char *commandLine ) {
 	// allocate the stack based hunk allocator
 	Com_InitHunkMemory();
 
+	Com_InitScratchMemory();
+
 	// if any archived cvars are modified after this, we will trigger a writing
 	// of the config file
 	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
@@ -3884,6 +5189,10 @@ void Com_Init( char *commandLine ) {
 	//
 	// init commands and vars
 	//
+	com_spinSlack = Cvar_Get( "com_spinSlack", "500", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( com_spinSlack, "0", "5000", CV_INTEGER );
+	Cvar_SetDescription( com_spinSlack, "Microseconds before the end of frame wait spent polling instead of sleeping, makes frame pacing precise at the cost of some CPU load." );
+
 #ifndef DEDICATED
 	com_maxfps = Cvar_Get( "com_maxfps", "125", 0 ); // try to force that in some light way
 	Cvar_CheckRange( com_maxfps, "0", "1000", CV_INTEGER );
@@ -3902,12 +5211,23 @@ void Com_Init( char *commandLine ) {
 	com_affinityMask->modified = qfalse;
 #endif
 
+	com_simd = Cvar_Get( "com_simd", "2", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( com_simd, "0", "2", CV_INTEGER );
+	Cvar_SetDescription( com_simd, "Highest instruction set used by SIMD kernels, only limits what the CPU supports, applied on " S_COLOR_CYAN "snd_restart" S_COLOR_WHITE ":\n"
+		" 0 - plain C code\n"
+		" 1 - up to SSE2\n"
+		" 2 - up to AVX2" );
+
 	// com_blood = Cvar_Get( "com_blood", "1", CVAR_ARCHIVE_ND );
 
 	com_timescale = Cvar_Get( "timescale", "1", CVAR_CHEAT | CVAR_SYSTEMINFO );
 	Cvar_CheckRange( com_timescale, "0", NULL, CV_FLOAT );
 	Cvar_SetDescription( com_timescale, "System timing factor:\n < 1: Slows the game down\n = 1: Regular speed\n > 1: Speeds the game up" );
 	com_fixedtime = Cvar_Get( "fixedtime", "0", CVAR_CHEAT );
+	com_benchmark = Cvar_Get( "com_benchmark", "0", CVAR_INIT );
+	Cvar_CheckRange( com_benchmark, "0", NULL, CV_INTEGER );
+	Cvar_SetDescription( com_benchmark, "Dedicated server benchmark, runs the given number of server frames without sleeping "
+		"once a map is loaded, prints frames/s with per-phase times and quits, see \\com_benchmarkBots." );
 	Cvar_SetDescription( com_fixedtime, "Toggle the rendering of every frame the game will wait until each frame is completely rendered before sending the next frame." );
 	com_showtrace = Cvar_Get( "com_showtrace", "0", CVAR_CHEAT );
 	Cvar_SetDescription( com_showtrace, "Debugging tool that prints out trace information." );
@@ -3919,8 +5239,9 @@ void Com_Init( char *commandLine ) {
 
 #ifndef DEDICATED
 	com_timedemo = Cvar_Get( "timedemo", "0", 0 );
-	Cvar_CheckRange( com_timedemo, "0", "1", CV_INTEGER );
-	Cvar_SetDescription( com_timedemo, "When set to '1' times a demo and returns frames per second like a benchmark." );
+	Cvar_CheckRange( com_timedemo, "0", "2", CV_INTEGER );
+	Cvar_SetDescription( com_timedemo, "When set to '1' times a demo and returns frames per second like a benchmark.\n"
+		" 2 - also log per-frame timings to benchmarks/<demo>.csv and report 1%/0.1% lows" );
 	cl_paused = Cvar_Get( "cl_paused", "0", CVAR_ROM );
 	Cvar_SetDescription( cl_paused, "Read-only CVAR to toggle functionality of paused games (the variable holds the status of the paused flag on the client side)." );
 	cl_packetdelay = Cvar_Get( "cl_packetdelay", "0", CVAR_CHEAT );
@@ -3960,6 +5281,16 @@ void Com_Init( char *commandLine ) {
 		Cmd_AddCommand( "error", Com_Error_f );
 		Cmd_AddCommand( "crash", Com_Crash_f );
 		Cmd_AddCommand( "freeze", Com_Freeze_f );
+		Cmd_AddCommand( "deltabench", MSG_DeltaEntityBench_f );
+		Cmd_AddCommand( "bitscheck", MSG_BitsCheck_f );
+		Cmd_AddCommand( "cm_bench", CM_Bench_f );
+		Cmd_AddCommand( "cmdbench", Cmd_Bench_f );
+		Cmd_AddCommand( "cm_record", CM_Record_f );
+		Cmd_AddCommand( "cm_replay", CM_Replay_f );
+		Cmd_AddCommand( "cm_floodstats", CM_FloodStats_f );
+#ifdef USE_ZONE_SLABS
+		Cmd_AddCommand( "zonebench", Com_ZoneBench_f );
+#endif
 	}
 
 	Cmd_AddCommand( "quit", Com_Quit_f );
@@ -3987,6 +5318,11 @@ void Com_Init( char *commandLine ) {
 	}
 	Com_Printf( "%s\n", Cvar_VariableString( "sys_cpustring" ) );
 
+#ifdef DEDICATED
+	// before any threads are started
+	Com_StartInstances();
+#endif
+
 #ifdef USE_AFFINITY_MASK
 	// get initial process affinity - we will respect it when setting custom affinity masks
 	eCoreMask = pCoreMask = affinityMask = Sys_GetAffinityMask();
@@ -3999,6 +5335,14 @@ void Com_Init( char *commandLine ) {
 	}
 #endif
 
+	Com_InitTrace();
+
+	// read by snapshot jobs, so it is built before any job thread exists
+	MSG_InitEntityWordFields();
+
+	// after affinity masks are known so com_jobs can use them
+	Com_InitJobs();
+
 	// Pick a random port value
 	Com_RandomBytes( (byte*)&qport, sizeof( qport ) );
 	Netchan_Init( qport & 0xffff );
@@ -4036,10 +5380,17 @@ void Com_Init( char *commandLine ) {
 	// command line it will still be able to count on com_frameTime
 	// being random enough for a serverid
 	lastTime = com_frameTime = Com_Milliseconds();
+	lastTimeUsec = com_frameTimeUsec = Sys_Microseconds();
 
 	if ( !com_errorEntered )
 		Sys_ShowConsole( com_viewlog->integer, qfalse );
 
+	// apply further changes as they come instead of checking them each frame
+	Cvar_SetChangeCallback( com_viewlog, Com_ViewlogChanged );
+#ifdef USE_AFFINITY_MASK
+	Cvar_SetChangeCallback( com_affinityMask, Com_AffinityMaskChanged );
+#endif
+
 #ifndef DEDICATED
 	// make sure single player is off by default
 	Cvar_Set( "ui_singlePlayerActive", "0" );
@@ -4194,18 +5545,28 @@ static int Com_ModifyMsec( int msec ) {
 /*
 =================
 Com_TimeVal
+
+Returns microseconds left to wait until frame should run
 =================
 */
-static int Com_TimeVal( int minMsec )
+static int Com_TimeVal( int minUsec )
 {
 	int timeVal;
+	int msec;
 
-	timeVal = Com_Milliseconds() - com_frameTime;
+	// also polls events, these are journaled
+	msec = Com_Milliseconds();
 
-	if ( timeVal >= minMsec )
+	// journal playback has only millisecond times
+	if ( com_journalFile != FS_INVALID_HANDLE && com_journal->integer == 2 )
+		timeVal = ( msec - com_frameTime ) * 1000;
+	else
+		timeVal = (int)MIN( Sys_Microseconds() - com_frameTimeUsec, 1000000 );
+
+	if ( timeVal >= minUsec )
 		timeVal = 0;
 	else
-		timeVal = minMsec - timeVal;
+		timeVal = minUsec - timeVal;
 
 	return timeVal;
 }
@@ -4221,10 +5582,12 @@ void Com_Frame( qboolean noDelay ) {
 #ifndef DEDICATED
 	static int bias = 0;
 #endif
-	int	msec, realMsec, minMsec;
-	int	sleepMsec;
+	int	msec, realMsec, minUsec;
+	int	sleepUsec;
 	int	timeVal;
 	int	timeValSV;
+	qboolean benchmark;
+	qboolean idleWork;
 
 	int	timeBeforeFirstEvents;
 	int	timeBeforeServer;
@@ -4236,7 +5599,11 @@ void Com_Frame( qboolean noDelay ) {
 		return;			// an ERR_DROP was thrown
 	}
 
-	minMsec = 0; // silent compiler warning
+	Com_ScratchFrame();
+	Com_TraceFrame();
+	Com_TraceBegin( "Com_Frame" );
+
+	minUsec = 0; // silent compiler warning
 
 	// bk001204 - init to zero.
 	//  also:  might be clobbered by `longjmp' or `vfork'
@@ -4251,21 +5618,6 @@ void Com_Frame( qboolean noDelay ) {
 	Com_WriteConfiguration();
 #endif
 
-	// if "viewlog" has been modified, show or hide the log console
-	if ( com_viewlog->modified ) {
-		if ( !com_dedicated->integer ) {
-			Sys_ShowConsole( com_viewlog->integer, qfalse );
-		}
-		com_viewlog->modified = qfalse;
-	}
-
-#ifdef USE_AFFINITY_MASK
-	if ( com_affinityMask->modified ) {
-		Com_SetAffinityMask( com_affinityMask->string );
-		com_affinityMask->modified = qfalse;
-	}
-#endif
-
 	//
 	// main event loop
 	//
@@ -4273,62 +5625,97 @@ void Com_Frame( qboolean noDelay ) {
 		timeBeforeFirstEvents = Sys_Milliseconds();
 	}
 
+	// benchmark runs server frames back to back
+	benchmark = com_benchmark->integer && com_dedicated->integer && com_sv_running->integer;
+	if ( benchmark ) {
+		noDelay = qtrue;
+	}
+
 	// we may want to spin here if things are going too fast
 	if ( com_dedicated->integer ) {
-		minMsec = SV_FrameMsec();
+		minUsec = SV_FrameMsec() * 1000;
 #ifndef DEDICATED
 		bias = 0;
 #endif
 	} else {
 #ifndef DEDICATED
 		if ( noDelay ) {
-			minMsec = 0;
+			minUsec = 0;
 			bias = 0;
 		} else {
 			if ( !gw_active && com_maxfpsUnfocused->integer > 0 )
-				minMsec = 1000 / com_maxfpsUnfocused->integer;
+				minUsec = 1000000 / com_maxfpsUnfocused->integer;
 			else
 			if ( com_maxfps->integer > 0 )
-				minMsec = 1000 / com_maxfps->integer;
+				minUsec = 1000000 / com_maxfps->integer;
 			else
-				minMsec = 1;
+				minUsec = 1000;
 
-			timeVal = com_frameTime - lastTime;
-			bias += timeVal - minMsec;
+			timeVal = (int)MIN( com_frameTimeUsec - lastTimeUsec, 1000000 );
+			bias += timeVal - minUsec;
 
-			if ( bias > minMsec )
-				bias = minMsec;
+			if ( bias > minUsec )
+				bias = minUsec;
 
-			// Adjust minMsec if previous frame took too long to render so
+			// Adjust minUsec if previous frame took too long to render so
 			// that framerate is stable at the requested value.
-			minMsec -= bias;
+			minUsec -= bias;
 		}
 #endif
 	}
 
-	// waiting for incoming packets
+	// waiting for incoming packets, sleep most of the time
+	// and poll through the last com_spinSlack microseconds,
+	// traced as a single scope to not flood the ring while spinning
+	Com_TraceBegin( "NET_Sleep" );
+	idleWork = qtrue;
 	if ( noDelay == qfalse )
 	do {
 		if ( com_sv_running->integer ) {
 			timeValSV = SV_SendQueuedPackets();
-			timeVal = Com_TimeVal( minMsec );
-			if ( timeValSV < timeVal )
-				timeVal = timeValSV;
+			timeVal = Com_TimeVal( minUsec );
+			if ( timeValSV * 1000 < timeVal )
+				timeVal = timeValSV * 1000;
+			// once per frame, leave a millisecond of slack for the next frame
+			if ( idleWork && timeVal > 2000 ) {
+				idleWork = qfalse;
+				Com_TraceBegin( "SV_BotIdleFrame" );
+				SV_BotIdleFrame( timeVal - 1000 );
+				Com_TraceEnd();
+				continue;
+			}
 		} else {
-			timeVal = Com_TimeVal( minMsec );
+			timeVal = Com_TimeVal( minUsec );
 		}
-		sleepMsec = timeVal;
+		sleepUsec = timeVal;
 #ifndef DEDICATED
-		if ( !gw_minimized && timeVal > com_yieldCPU->integer )
-			sleepMsec = com_yieldCPU->integer;
-		if ( timeVal > sleepMsec )
+		if ( !gw_minimized && timeVal > com_yieldCPU->integer * 1000 )
+			sleepUsec = com_yieldCPU->integer * 1000;
+		if ( timeVal > sleepUsec ) {
 			Com_EventLoop();
+			CL_SendAsyncCmd();
+		}
+#endif
+		if ( sleepUsec > com_spinSlack->integer )
+			NET_Sleep( sleepUsec - com_spinSlack->integer );
+		else
+			NET_Sleep( 0 );
+	} while( Com_TimeVal( minUsec ) );
+	Com_TraceEnd();
+
+#ifndef DEDICATED
+	Com_TraceBegin( "CL_WaitFrame" );
+	CL_WaitFrame();
+	Com_TraceEnd();
 #endif
-		NET_Sleep( sleepMsec * 1000 - 500 );
-	} while( Com_TimeVal( minMsec ) );
+
+	lastTimeUsec = com_frameTimeUsec;
+	com_frameTimeUsec = Sys_Microseconds();
 
 	lastTime = com_frameTime;
+	Com_TraceBegin( "Com_EventLoop" );
 	com_frameTime = Com_EventLoop();
+	Com_TraceEnd();
 	realMsec = com_frameTime - lastTime;
 
 	Cbuf_Execute();
@@ -4336,6 +5723,11 @@ void Com_Frame( qboolean noDelay ) {
 	// mess with msec if needed
 	msec = Com_ModifyMsec( realMsec );
 
+	if ( benchmark ) {
+		// fixed step, exactly one server frame each time
+		msec = SV_FrameMsec();
+	}
+
 	//
 	// server side
 	//
@@ -4343,7 +5735,9 @@ void Com_Frame( qboolean noDelay ) {
 		timeBeforeServer = Sys_Milliseconds();
 	}
 
+	Com_TraceBegin( "SV_Frame" );
 	SV_Frame( msec );
+	Com_TraceEnd();
 
 	// if "dedicated" has been modified, start up
 	// or shut down the client system.
@@ -4393,7 +5787,9 @@ void Com_Frame( qboolean noDelay ) {
 		if ( com_speeds->integer ) {
 			timeBeforeEvents = Sys_Milliseconds();
 		}
+		Com_TraceBegin( "Com_EventLoop" );
 		Com_EventLoop();
+		Com_TraceEnd();
 
 		if ( !Cbuf_Wait() ) {
 			Cbuf_Execute();
@@ -4406,7 +5802,9 @@ void Com_Frame( qboolean noDelay ) {
 			timeBeforeClient = Sys_Milliseconds();
 		}
 
+		Com_TraceBegin( "CL_Frame" );
 		CL_Frame( msec, realMsec );
+		Com_TraceEnd();
 
 		if ( com_speeds->integer ) {
 			timeAfter = Sys_Milliseconds();
@@ -4449,6 +5847,8 @@ void Com_Frame( qboolean noDelay ) {
 		c_pointcontents = 0;
 	}
 
+	Com_TraceEnd();
+
 	com_frameNumber++;
 }
 
@@ -4459,6 +5859,9 @@ Com_Shutdown
 =================
 */
 static void Com_Shutdown( void ) {
+
+	Com_ShutdownJobs();
+
 	if ( logfile != FS_INVALID_HANDLE ) {
 		FS_FCloseFile( logfile );
 		logfile = FS_INVALID_HANDLE;
@@ -29,38 +29,74 @@ static cvar_t	*cvar_cheats;
 static cvar_t	*cvar_developer;
 int			cvar_modifiedFlags;
 
-#define	MAX_CVARS	2048
+#define	MAX_CVARS	4096
 static cvar_t	cvar_indexes[MAX_CVARS];
 static int		cvar_numIndexes;
+static int		cvar_firstFree;		// no free slots below this index
+static int		cvar_count;
 
 static int	cvar_group[ CVG_MAX ];
 
-#define FILE_HASH_SIZE		256
-static	cvar_t	*hashTable[FILE_HASH_SIZE];
+// hash table grows with the number of cvars, starts with a static one
+// because cvars are registered before the main zone is initialized
+#define MIN_CVAR_HASH		256
+static	cvar_t	*hashTableBase[MIN_CVAR_HASH];
+static	cvar_t	**hashTable = hashTableBase;
+static	unsigned int hashSize = MIN_CVAR_HASH;
 static	qboolean cvar_sort = qfalse;
 
 /*
 ================
-return a hash value for the filename
+return a case-insensitive hash value for the cvar name,
+callers mask it with (hashSize-1)
 ================
 */
-static long generateHashValue( const char *fname ) {
-	int		i;
-	long	hash;
-	char	letter;
+static unsigned int generateHashValue( const char *fname ) {
+	unsigned int hash;
+	int c;
 
 	hash = 0;
-	i = 0;
-	while (fname[i] != '\0') {
-		letter = locase[(byte)fname[i]];
-		hash+=(long)(letter)*(i+119);
-		i++;
+	while ( (c = locase[(byte)*fname++]) != '\0' ) {
+		hash = hash * 101 + c;
 	}
-	hash &= (FILE_HASH_SIZE-1);
+	hash = (hash ^ (hash >> 10) ^ (hash >> 20));
 	return hash;
 }
 
 
+/*
+================
+Cvar_GrowHashTable
+
+Doubles hash table size and relinks all cvars,
+keeps chains short when mods register thousands of cvars
+================
+*/
+static void Cvar_GrowHashTable( void ) {
+	cvar_t **table, *var;
+	unsigned int size, bucket;
+
+	size = hashSize * 2;
+	table = S_Malloc( size * sizeof( table[0] ) );
+	Com_Memset( table, 0, size * sizeof( table[0] ) );
+
+	for ( var = cvar_vars; var; var = var->next ) {
+		bucket = var->hashValue & ( size - 1 );
+		var->hashPrev = NULL;
+		var->hashNext = table[ bucket ];
+		if ( table[ bucket ] )
+			table[ bucket ]->hashPrev = var;
+		table[ bucket ] = var;
+	}
+
+	if ( hashTable != hashTableBase )
+		Z_Free( hashTable );
+
+	hashTable = table;
+	hashSize = size;
+}
+
+
 /*
 ============
 Cvar_ValidateName
@@ -95,15 +131,15 @@ Cvar_FindVar
 */
 static cvar_t *Cvar_FindVar( const char *var_name ) {
 	cvar_t	*var;
-	long hash;
+	unsigned int hash;
 
 	if ( !var_name )
 		return NULL;
 
 	hash = generateHashValue( var_name );
 	
-	for ( var = hashTable[ hash ] ; var ; var = var->hashNext ) {
-		if ( !Q_stricmp( var_name, var->name ) ) {
+	for ( var = hashTable[ hash & ( hashSize - 1 ) ] ; var ; var = var->hashNext ) {
+		if ( var->hashValue == hash && !Q_stricmp( var_name, var->name ) ) {
 			return var;
 		}
 	}
@@ -347,7 +383,7 @@ The flags will be or'ed in if the variable exists.
 */
 cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags ) {
 	cvar_t	*var;
-	long	hash;
+	unsigned int hash;
 	int	index;
 
 	if ( !var_name || !var_value ) {
@@ -462,7 +498,7 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags ) {
 	//
 
 	// find a free cvar
-	for(index = 0; index < MAX_CVARS; index++)
+	for(index = cvar_firstFree; index < MAX_CVARS; index++)
 	{
 		if(!cvar_indexes[index].name)
 			break;
@@ -477,6 +513,7 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags ) {
 	}
 	
 	var = &cvar_indexes[index];
+	cvar_firstFree = index + 1;
 	
 	if(index >= cvar_numIndexes)
 		cvar_numIndexes = index + 1;
@@ -505,8 +542,13 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags ) {
 	// note what types of cvars have been modified (userinfo, archive, serverinfo, systeminfo)
 	cvar_modifiedFlags |= var->flags;
 
+	if ( ++cvar_count > hashSize ) {
+		Cvar_GrowHashTable();
+	}
+
 	hash = generateHashValue(var_name);
-	var->hashIndex = hash;
+	var->hashValue = hash;
+	hash &= ( hashSize - 1 );
 
 	var->hashNext = hashTable[hash];
 	if ( hashTable[hash] )
@@ -746,6 +788,10 @@ cvar_t *Cvar_Set2( const char *var_name, const char *value, qboolean force ) {
 	var->value = Q_atof( var->string );
 	var->integer = atoi( var->string );
 
+	if ( var->onChange ) {
+		var->onChange( var );
+	}
+
 	return var;
 }
 
@@ -1450,7 +1496,7 @@ static void Cvar_List_f( void ) {
 	}
 
 	Com_Printf ("\n%i total cvars\n", i);
-	Com_Printf ("%i cvar indexes\n", cvar_numIndexes);
+	Com_Printf ("%i cvar indexes, %i hash buckets\n", cvar_numIndexes, hashSize);
 }
 
 
@@ -1578,11 +1624,15 @@ static cvar_t *Cvar_Unset( cvar_t *cv )
 	if ( cv->hashPrev )
 		cv->hashPrev->hashNext = cv->hashNext;
 	else
-		hashTable[cv->hashIndex] = cv->hashNext;
+		hashTable[cv->hashValue & ( hashSize - 1 )] = cv->hashNext;
 	if ( cv->hashNext )
 		cv->hashNext->hashPrev = cv->hashPrev;
 
 	Com_Memset( cv, '\0', sizeof( *cv ) );
+
+	cvar_count--;
+	if ( cvar_firstFree > cv - cvar_indexes )
+		cvar_firstFree = cv - cvar_indexes;
 	
 	return next;
 }
@@ -1917,6 +1967,23 @@ void Cvar_SetGroup( cvar_t *var, cvarGroup_t group ) {
 }
 
 
+/*
+=====================
+Cvar_SetChangeCallback
+
+Registers function to run each time the value of var changes,
+so it doesn't need to be polled for modification every frame.
+Latched values notify when they are applied
+=====================
+*/
+void Cvar_SetChangeCallback( cvar_t *var, void (*func)( cvar_t *var ) ) {
+	if ( var->onChange && func && var->onChange != func ) {
+		Com_Error( ERR_FATAL, "Cvar_SetChangeCallback: %s already has a change callback", var->name );
+	}
+	var->onChange = func;
+}
+
+
 /*
 =====================
 Cvar_CheckGroup
@@ -1951,6 +2018,37 @@ void Cvar_ResetGroup( cvarGroup_t group, qboolean resetModifiedFlags ) {
 }
 
 
+/*
+=====================
+Cvar_ListLatched
+
+Fills names with up to maxNames cvars starting with prefix that have
+a latched value waiting for a restart, returns their total count
+=====================
+*/
+int Cvar_ListLatched( const char *prefix, const char **names, int maxNames ) {
+	int i, count, len;
+
+	len = (int)strlen( prefix );
+	count = 0;
+
+	for ( i = 0; i < cvar_numIndexes; i++ ) {
+		if ( !cvar_indexes[ i ].name || !cvar_indexes[ i ].latchedString ) {
+			continue;
+		}
+		if ( Q_stricmpn( cvar_indexes[ i ].name, prefix, len ) != 0 ) {
+			continue;
+		}
+		if ( count < maxNames ) {
+			names[ count ] = cvar_indexes[ i ].name;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+
 /*
 =====================
 Cvar_Register
@@ -2076,7 +2174,7 @@ Reads in all archived cvars
 void Cvar_Init (void)
 {
 	Com_Memset(cvar_indexes, '\0', sizeof(cvar_indexes));
-	Com_Memset(hashTable, '\0', sizeof(hashTable));
+	Com_Memset(hashTableBase, '\0', sizeof(hashTableBase));
 
 	cvar_cheats = Cvar_Get( "sv_cheats", "1", CVAR_ROM | CVAR_SYSTEMINFO );
 	Cvar_SetDescription( cvar_cheats, "Enable cheating commands (server side only)." );
@@ -210,6 +210,36 @@ or configs will never get loaded from disk!
 #define USE_HANDLE_CACHE
 #define MAX_CACHED_HANDLES 384
 
+#define USE_ASYNC_READS
+#define MAX_ASYNC_READS 256
+#define MAX_IO_THREADS 8
+
+#define USE_ASYNC_WRITES
+#define MAX_WRITE_BUFFERS 16
+#define WRITE_BUFFER_SIZE 0x10000
+
+#define USE_FILE_INDEX
+
+#define USE_MISS_CACHE
+#define MAX_MISSED_FILES 4096
+#define MISS_HASH_SIZE 1024		// power of 2
+
+#define USE_DIR_CACHE
+#define MAX_CACHED_DIRS 32
+
+#define USE_PK3_MAPPING
+#define MAX_MAPPED_FILES 64
+#define MIN_MAPPED_SIZE 0x10000		// smaller entries are cheaper to copy
+
+#define USE_ZIP_SEEK
+
+#define USE_PAK_BUNDLES
+
+#define USE_FS_PROFILE
+#define MAX_PROFILED_FILES 4096
+#define PROFILE_HASH_SIZE 1024		// power of 2
+#define PROFILE_REPORT_LINES 20
+
 #define MAX_ZPATH			256
 #define MAX_FILEHASH_SIZE	4096
 
@@ -299,6 +329,23 @@ static	cvar_t		*fs_gamedirvar;
 static	cvar_t		*fs_locked;
 #endif
 static	cvar_t		*fs_excludeReference;
+#ifdef USE_PK3_MAPPING
+static	cvar_t		*fs_mmap;
+#ifdef USE_FS_PROFILE
+static	cvar_t		*fs_profile;
+#endif
+#endif
+#ifdef USE_ASYNC_READS
+static	cvar_t		*fs_ioThreads;
+#endif
+#ifdef USE_DIR_CACHE
+static	cvar_t		*fs_dirCache;
+#endif
+#ifdef USE_ASYNC_WRITES
+static	cvar_t		*fs_writeThread;
+static	cvar_t		*fs_writeFlush;
+static	cvar_t		*fs_writeSync;
+#endif
 
 static	searchpath_t	*fs_searchpaths;
 static	int			fs_readCount;			// total bytes read
@@ -311,6 +358,8 @@ static	int			fs_packCount;			// total number of packs in searchpath
 static	int			fs_dirCount;			// total number of directories in searchpath
 
 static	int			fs_checksumFeed;
+static	int			fs_pakListSequence;	// bumped when loaded paks or their reference flags change
+static	int			fs_loadStamp;		// bumped when file lookups may resolve differently
 
 typedef union qfile_gus {
 	FILE*		o;
@@ -333,10 +382,28 @@ typedef struct {
 	handleOwner_t	owner;
 	int			pakIndex;
 	pack_t		*pak;
+#ifdef USE_FS_PROFILE
+	int			profile;		// fs_profiledFiles index + 1 while recording
+#endif
+#ifdef USE_ASYNC_WRITES
+	qboolean	writeBehind;	// FS_Write data goes to the writer thread
+#endif
 } fileHandleData_t;
 
 static fileHandleData_t	fsh[MAX_FILE_HANDLES];
 
+#ifdef USE_PK3_MAPPING
+// FS_ReadFile buffers pointing straight into a private view of the pk3
+typedef struct {
+	void		*buffer;
+	void		*base;
+	size_t		length;
+} mappedFile_t;
+
+static mappedFile_t	fs_mappedFiles[MAX_MAPPED_FILES];
+static int			fs_numMappedFiles;
+#endif
+
 // TTimo - https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=540
 // whether we did a reorder on the current search path when joining the server
 qboolean fs_reordered;
@@ -364,6 +431,13 @@ void Com_AppendCDKey( const char *filename );
 void Com_ReadCDKey( const char *filename );
 
 static int FS_GetModList( char *listbuf, int bufsize );
+#ifdef USE_MISS_CACHE
+static void FS_ClearMissedFiles( void );
+#endif
+#ifdef USE_ASYNC_WRITES
+static int FS_WriteBehind( const void *buffer, int len, fileHandle_t h );
+static void FS_FinishWrites( fileHandle_t h, qboolean sync );
+#endif
 void FS_Reload( void );
 
 
@@ -459,6 +533,11 @@ void FS_ForceFlush( fileHandle_t f ) {
 	FILE *file;
 
 	file = FS_FileForHandle(f);
+#ifdef USE_ASYNC_WRITES
+	if ( fsh[f].writeBehind ) {
+		FS_FinishWrites( f, qfalse );
+	}
+#endif
 	setvbuf( file, NULL, _IONBF, 0 );
 }
 
@@ -883,6 +962,10 @@ fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
 		return FS_INVALID_HANDLE;
 	}
 
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
 
 	f = FS_HandleForFile();
@@ -916,6 +999,66 @@ fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
 }
 
 
+/*
+===========
+FS_SV_FOpenFileAppend
+
+Opens a file below the home path for appending,
+length receives the size of the data already there
+===========
+*/
+fileHandle_t FS_SV_FOpenFileAppend( const char *filename, int *length ) {
+	char *ospath;
+	fileHandle_t	f;
+	fileHandleData_t *fd;
+
+	*length = 0;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !*filename ) {
+		return FS_INVALID_HANDLE;
+	}
+
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
+	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
+
+	f = FS_HandleForFile();
+	fd = &fsh[ f ];
+	FS_InitHandle( fd );
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_SV_FOpenFileAppend: %s\n", ospath );
+	}
+
+	FS_CheckFilenameIsNotAllowed( ospath, __func__, qtrue );
+
+	fd->handleFiles.file.o = Sys_FOpen( ospath, "ab" );
+	if ( !fd->handleFiles.file.o ) {
+		if ( FS_CreatePath( ospath ) ) {
+			return FS_INVALID_HANDLE;
+		}
+		fd->handleFiles.file.o = Sys_FOpen( ospath, "ab" );
+		if ( !fd->handleFiles.file.o ) {
+			return FS_INVALID_HANDLE;
+		}
+	}
+
+	Q_strncpyz( fd->name, filename, sizeof( fd->name ) );
+	fd->handleSync = qfalse;
+	fd->zipFile = qfalse;
+
+	*length = FS_FileLength( fd->handleFiles.file.o );
+
+	return f;
+}
+
+
 /*
 ===========
 FS_SV_FOpenFileRead
@@ -999,6 +1142,28 @@ int FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
 }
 
 
+/*
+===========
+FS_SV_MapFile
+
+Maps length bytes of a file opened with FS_SV_FOpenFileRead,
+returns NULL when fs_mmap is off or the view can't be created
+===========
+*/
+const byte *FS_SV_MapFile( fileHandle_t f, int length, void **base, size_t *baseLength ) {
+
+	if ( !fs_mmap->integer || length <= 0 ) {
+		return NULL;
+	}
+
+	if ( f <= FS_INVALID_HANDLE || f >= MAX_FILE_HANDLES || fsh[ f ].zipFile || !fsh[ f ].handleFiles.file.o ) {
+		return NULL;
+	}
+
+	return Sys_MapFile( fsh[ f ].handleFiles.file.o, 0, length, base, baseLength );
+}
+
+
 /*
 ===========
 FS_SV_Rename
@@ -1011,6 +1176,10 @@ void FS_SV_Rename( const char *from, const char *to ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
 
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 #ifndef DEDICATED
 	// don't let sound stutter
 	// S_ClearSoundBuffer();
@@ -1044,6 +1213,10 @@ void FS_Rename( const char *from, const char *to ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
 
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 #ifndef DEDICATED
 	// don't let sound stutter
 	// S_ClearSoundBuffer();
@@ -1186,6 +1359,11 @@ void FS_FCloseFile( fileHandle_t f ) {
 		}
 #endif
 	} else {
+#ifdef USE_ASYNC_WRITES
+		if ( fd->writeBehind ) {
+			FS_FinishWrites( f, fs_writeSync->integer ? qtrue : qfalse );
+		}
+#endif
 		if ( fd->handleFiles.file.o ) {
 			fclose( fd->handleFiles.file.o );
 			fd->handleFiles.file.o = NULL;
@@ -1228,6 +1406,10 @@ fileHandle_t FS_FOpenFileWrite( const char *filename ) {
 		return FS_INVALID_HANDLE;
 	}
 
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 	ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, filename );
 
 	if ( fs_debug->integer ) {
@@ -1280,6 +1462,10 @@ fileHandle_t FS_FOpenFileAppend( const char *filename ) {
 		return FS_INVALID_HANDLE;
 	}
 
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 #ifndef DEDICATED
 	// don't let sound stutter
 	// S_ClearSoundBuffer();
@@ -1436,6 +1622,35 @@ static qboolean FS_GeneralRef( const char *filename )
 }
 
 
+/*
+===========
+FS_ReferencePak
+
+Marks the pak as having been referenced and marks specifics on cgame and ui,
+invalidating cached pak lists when the reference flags change
+===========
+*/
+static void FS_ReferencePak( pack_t *pak, const char *filename )
+{
+	int referenced = pak->referenced;
+
+	if ( !( referenced & FS_GENERAL_REF ) && FS_GeneralRef( filename ) ) {
+		referenced |= FS_GENERAL_REF;
+	}
+	if ( !( referenced & FS_CGAME_REF ) && !strcmp( filename, "vm/cgame.qvm" ) ) {
+		referenced |= FS_CGAME_REF;
+	}
+	if ( !( referenced & FS_UI_REF ) && !strcmp( filename, "vm/ui.qvm" ) ) {
+		referenced |= FS_UI_REF;
+	}
+
+	if ( referenced != pak->referenced ) {
+		pak->referenced = referenced;
+		fs_pakListSequence++;
+	}
+}
+
+
 /*
 ===========
 FS_BypassPure
@@ -1468,16 +1683,7 @@ static int FS_OpenFileInPak( fileHandle_t *file, pack_t *pak, fileInPack_t *pakF
 	// mark the pak as having been referenced and mark specifics on cgame and ui
 	// these are loaded from all pk3s
 	// from every pk3 file.
-
-	if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( pakFile->name ) ) {
-		pak->referenced |= FS_GENERAL_REF;
-	}
-	if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( pakFile->name, "vm/cgame.qvm" ) ) {
-		pak->referenced |= FS_CGAME_REF;
-	}
-	if ( !( pak->referenced & FS_UI_REF ) && !strcmp( pakFile->name, "vm/ui.qvm" ) ) {
-		pak->referenced |= FS_UI_REF;
-	}
+	FS_ReferencePak( pak, pakFile->name );
 
 	if ( !pak->handle ) {
 		pak->handle = unzOpen( pak->pakFilename );
@@ -1543,654 +1749,2616 @@ static int FS_OpenFileInPak( fileHandle_t *file, pack_t *pak, fileInPack_t *pakF
 }
 
 
+#ifdef USE_FILE_INDEX
 /*
-===========
-FS_FOpenFileRead
+=============================================================================
 
-Finds the file in the search path.
-Returns filesize and an open FILE pointer.
-Used for streaming data out of either a
-separate file or a ZIP file.
-===========
+FILE INDEX
+
+One hash table over the files of all loaded paks, entries with the same name
+are chained in search order so the first pure match is the one the search
+would find. Directories still have to be probed, but only those in front of
+that pak. Rebuilt whenever search paths are reordered
+=============================================================================
 */
-extern qboolean		com_fullyInitialized;
 
-int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
-	const searchpath_t	*search;
-	char			*netpath;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
-	directory_t		*dir;
-	long			hash;
-	long			fullHash;
-	FILE			*temp;
-	int				length;
-	fileHandleData_t *f;
+typedef struct fileIndex_s {
+	fileInPack_t	*file;
+	int				order;		// position in fs_indexPaths
+	int				next;		// next entry in hash chain, -1 at end
+} fileIndex_t;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-	}
+static fileIndex_t	*fs_index;
+static int			*fs_indexHash;
+static int			fs_indexHashSize;	// power of 2
+static searchpath_t	**fs_indexPaths;	// search paths in search order
+static int			fs_indexPathCount;
+static int			*fs_indexDirs;		// orders of directory search paths
+static int			fs_indexDirCount;
 
-	if ( !filename ) {
-		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
-	}
 
-	// qpaths are not supposed to have a leading slash
-	if ( filename[0] == '/' || filename[0] == '\\' ) {
-		filename++;
+/*
+=============
+FS_FreeFileIndex
+=============
+*/
+static void FS_FreeFileIndex( void )
+{
+	if ( fs_index ) {
+		Z_Free( fs_index );
 	}
 
-	// make absolutely sure that it can't back up the path.
-	// The searchpaths do guarantee that something will always
-	// be prepended, so we don't need to worry about "c:" or "//limbo"
-	if ( FS_CheckDirTraversal( filename ) ) {
-		*file = FS_INVALID_HANDLE;
-		return -1;
-	}
+	fs_index = NULL;
+	fs_indexHash = NULL;
+	fs_indexHashSize = 0;
+	fs_indexPaths = NULL;
+	fs_indexPathCount = 0;
+	fs_indexDirs = NULL;
+	fs_indexDirCount = 0;
+}
 
-	// we will calculate full hash only once then just mask it by current pack->hashSize
-	// we can do that as long as we know properties of our hash function
-	fullHash = FS_HashFileName( filename, 0U );
 
-	if ( file == NULL ) {
-		// just wants to see if file is there
-		for ( search = fs_searchpaths ; search ; search = search->next ) {
-			// is the element a pak file?
-			if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-				// skip non-pure files
-				if ( !FS_PakIsPure( search->pack ) )
-					continue;
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do {
-					// case and separator insensitive comparisons
-					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-						// found it!
-						return pakFile->size; 
-					}
-					pakFile = pakFile->next;
-				} while ( pakFile != NULL );
-			} else if ( search->dir && search->policy != DIR_DENY ) {
-				dir = search->dir;
-				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-				temp = Sys_FOpen( netpath, "rb" );
-				if ( temp ) {
-					length = FS_FileLength( temp );
-					fclose( temp );
-					return length;
-				}
-			}
+/*
+=============
+FS_BuildFileIndex
+=============
+*/
+static void FS_BuildFileIndex( void )
+{
+	searchpath_t *search;
+	fileIndex_t *entry;
+	const pack_t *pak;
+	int numPaths, numFiles, numDirs;
+	int i, n, hash;
+
+	FS_FreeFileIndex();
+
+	numPaths = numFiles = numDirs = 0;
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		} else {
+			numDirs++;
 		}
-		return -1;
+		numPaths++;
 	}
 
-	// make sure the q3key file is only readable by the quake3.exe at initialization
-	// any other time the key should only be accessed in memory using the provided functions
-	if ( com_fullyInitialized && strstr( filename, "q3key" ) ) {
-		*file = FS_INVALID_HANDLE;
-		return -1;
-	}
+	for ( fs_indexHashSize = 16; fs_indexHashSize < numFiles; fs_indexHashSize <<= 1 )
+		;
 
-	//
-	// search through the path, one element at a time
-	//
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure( search->pack ) ) {
-				continue;
-			}
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-					return FS_OpenFileInPak( file, pak, pakFile, uniqueFILE );
-				}
-				pakFile = pakFile->next;
-			} while ( pakFile != NULL );
-		} else if ( search->dir && search->policy != DIR_DENY ) {
-			// check a file in the directory tree
-			dir = search->dir;
+	fs_index = Z_TagMalloc( numFiles * sizeof( fs_index[0] ) + fs_indexHashSize * sizeof( fs_indexHash[0] )
+		+ numPaths * sizeof( fs_indexPaths[0] ) + numDirs * sizeof( fs_indexDirs[0] ), TAG_SEARCH_PATH );
+	fs_indexPaths = (searchpath_t **)( fs_index + numFiles );
+	fs_indexHash = (int *)( fs_indexPaths + numPaths );
+	fs_indexDirs = fs_indexHash + fs_indexHashSize;
 
-			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( !search->pack ) {
+			fs_indexDirs[ fs_indexDirCount++ ] = fs_indexPathCount;
+		}
+		fs_indexPaths[ fs_indexPathCount++ ] = search;
+	}
 
-			temp = Sys_FOpen( netpath, "rb" );
-			if ( temp == NULL ) {
-				continue;
-			}
+	Com_Memset( fs_indexHash, -1, fs_indexHashSize * sizeof( fs_indexHash[0] ) );
 
-			*file = FS_HandleForFile();
-			f = &fsh[ *file ];
-			FS_InitHandle( f );
+	// insert from the lowest priority, in pak order, so that chains
+	// end up in the order of the search and of the pak hash chains
+	entry = fs_index;
+	for ( i = fs_indexPathCount - 1; i >= 0; i-- ) {
+		pak = fs_indexPaths[ i ]->pack;
+		if ( !pak ) {
+			continue;
+		}
+		for ( n = 0; n < pak->numfiles; n++, entry++ ) {
+			entry->file = pak->buildBuffer + n;
+			entry->order = i;
+			hash = FS_HashFileName( entry->file->name, fs_indexHashSize );
+			entry->next = fs_indexHash[ hash ];
+			fs_indexHash[ hash ] = (int)( entry - fs_index );
+		}
+	}
+}
 
-			f->handleFiles.file.o = temp;
-			Q_strncpyz( f->name, filename, sizeof( f->name ) );
-			f->zipFile = qfalse;
 
-			if ( fs_debug->integer ) {
-				Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
-					dir->path, dir->gamedir );
-			}
+/*
+=============
+FS_IndexLookup
 
-			return FS_FileLength( f->handleFiles.file.o );
+Returns the first pure pak, or if pure is qfalse the first non-excluded
+pak, that contains the file. Order is set to its search path position,
+or past all search paths if no such pak found
+=============
+*/
+static pack_t *FS_IndexLookup( const char *filename, unsigned long fullHash, qboolean pure, fileInPack_t **pakFile, int *order )
+{
+	const fileIndex_t *entry;
+	pack_t *pak;
+	int i;
+
+	for ( i = fs_indexHash[ fullHash & ( fs_indexHashSize - 1 ) ]; i >= 0; i = entry->next ) {
+		entry = &fs_index[ i ];
+		// case and separator insensitive comparisons
+		if ( FS_FilenameCompare( entry->file->name, filename ) ) {
+			continue;
 		}
+		pak = fs_indexPaths[ entry->order ]->pack;
+		if ( pure ? !FS_PakIsPure( pak ) : pak->exclude ) {
+			continue;
+		}
+		if ( pakFile ) {
+			*pakFile = entry->file;
+		}
+		if ( order ) {
+			*order = entry->order;
+		}
+		return pak;
 	}
 
-#ifdef FS_MISSING
-	if ( missingFiles ) {
-		fprintf( missingFiles, "%s\n", filename );
+	if ( order ) {
+		*order = fs_indexPathCount;
 	}
-#endif
 
-	*file = FS_INVALID_HANDLE;
-	return -1;
+	return NULL;
 }
+#endif // USE_FILE_INDEX
 
 
+#ifdef USE_MISS_CACHE
 /*
-===========
-FS_TouchFileInPak
-===========
+=============================================================================
+
+MISSED FILES
+
+Names that were not found anywhere in the search path, so repeated probes
+such as image extension fallbacks don't reach the OS for every directory.
+Cleared by everything that can create files or change visibility of paths
+=============================================================================
 */
-void FS_TouchFileInPak( const char *filename ) {
-	const searchpath_t *search;
-	long			fullHash, hash;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
 
-	fullHash = FS_HashFileName( filename, 0U );
+typedef struct missedFile_s {
+	struct missedFile_s *next;
+	char		name[ MAX_QPATH ];
+} missedFile_t;
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		
-		// is the element a pak file?
-		if ( !search->pack )
-			continue;
-		
-		if ( search->pack->exclude ) // skip paks in \fs_excludeReference list
-			continue;
+static missedFile_t	fs_missedFiles[ MAX_MISSED_FILES ];
+static missedFile_t	*fs_missHash[ MISS_HASH_SIZE ];
+static int			fs_numMissedFiles;
+static int			fs_missHits;			// lookups answered by the cache
+static int			fs_missClears;
 
-		if ( search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-					if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( filename ) ) {
-						pak->referenced |= FS_GENERAL_REF;
-					}
-					if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( filename, "vm/cgame.qvm" ) ) {
-						pak->referenced |= FS_CGAME_REF;
-					}
-					if ( !( pak->referenced & FS_UI_REF ) && !strcmp( filename, "vm/ui.qvm" ) ) {
-						pak->referenced |= FS_UI_REF;
-					}
-					return;
-				}
-				pakFile = pakFile->next;
-			} while ( pakFile != NULL );
-		}
+
+/*
+=============
+FS_ClearMissedFiles
+=============
+*/
+static void FS_ClearMissedFiles( void )
+{
+	if ( fs_numMissedFiles ) {
+		Com_Memset( fs_missHash, 0, sizeof( fs_missHash ) );
+		fs_numMissedFiles = 0;
+		fs_missClears++;
 	}
 }
 
 
 /*
-===========
-FS_Home_FOpenFileRead
-===========
+=============
+FS_IsMissedFile
+=============
 */
-int FS_Home_FOpenFileRead( const char *filename, fileHandle_t *file ) 
+static qboolean FS_IsMissedFile( const char *filename, unsigned long fullHash )
 {
-	char path[ MAX_OSPATH*3 + 1 ];
-	fileHandleData_t *fd;
-	fileHandle_t f;	
+	const missedFile_t *m;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	for ( m = fs_missHash[ fullHash & ( MISS_HASH_SIZE - 1 ) ]; m; m = m->next ) {
+		if ( !FS_FilenameCompare( m->name, filename ) ) {
+			fs_missHits++;
+			return qtrue;
+		}
 	}
 
-	// should never happen but for safe
-	if ( !file ) { 
-		return -1;
-	}
+	return qfalse;
+}
 
-	// allocate new file handle
-	f = FS_HandleForFile(); 
-	fd = &fsh[ f ];
-	FS_InitHandle( fd );
 
-	Com_sprintf( path, sizeof( path ), "%s%c%s%c%s", fs_homepath->string,
-		PATH_SEP, fs_gamedir, PATH_SEP, filename );
+/*
+=============
+FS_AddMissedFile
+=============
+*/
+static void FS_AddMissedFile( const char *filename, unsigned long fullHash )
+{
+	missedFile_t *m;
+	int hash;
 
-	if ( fs_debug->integer ) {
-		Com_Printf( "%s: %s\n", __func__, path );
+	if ( strlen( filename ) >= MAX_QPATH ) {
+		return;
 	}
 
-	fd->handleFiles.file.o = Sys_FOpen( path, "rb" );
-	if ( fd->handleFiles.file.o != NULL ) {
-		Q_strncpyz( fd->name, filename, sizeof( fd->name ) );
-		fd->handleSync = qfalse;
-		fd->zipFile = qfalse;
-		*file = f;
-		return FS_FileLength( fd->handleFiles.file.o );
+	if ( fs_numMissedFiles >= MAX_MISSED_FILES ) {
+		FS_ClearMissedFiles();
 	}
 
-	*file = FS_INVALID_HANDLE;
-	return -1;
+	hash = fullHash & ( MISS_HASH_SIZE - 1 );
+	m = &fs_missedFiles[ fs_numMissedFiles++ ];
+	strcpy( m->name, filename );
+	m->next = fs_missHash[ hash ];
+	fs_missHash[ hash ] = m;
 }
+#endif // USE_MISS_CACHE
 
 
+#ifdef USE_DIR_CACHE
 /*
-=================
-FS_Read
+=============================================================================
 
-Properly handles partial reads
-=================
-*/
-int FS_Read( void *buffer, int len, fileHandle_t f ) {
-	int		block, remaining;
-	int		read;
-	byte	*buf;
-	int		tries;
+DIRECTORY LISTINGS
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-	}
+Results of non-recursive Sys_ListFiles calls keyed by OS path, extension
+and directory flag. An entry is reused while the directory modification
+time is unchanged and older than the moment the listing was taken, so
+changes made within the timestamp granularity are never missed.
+Only accessed from the main thread, like the rest of the search path code
+=============================================================================
+*/
 
-	if ( f <= 0 || f >= MAX_FILE_HANDLES ) {
-		return 0;
-	}
+typedef struct cachedDir_s {
+	char		*path;
+	char		*extension;
+	qboolean	dironly;
+	fileTime_t	mtime;
+	fileTime_t	listTime;
+	int			lastUsed;
+	int			numfiles;
+	char		**list;
+} cachedDir_t;
 
-	buf = (byte *)buffer;
-	fs_readCount += len;
+static cachedDir_t	*fs_cachedDirs[ MAX_CACHED_DIRS ];
+static int			fs_dirCacheSequence;
+static int			fs_dirCacheHits;
+static int			fs_dirCacheMisses;
 
-	if ( !fsh[f].zipFile ) {
-		remaining = len;
-		tries = 0;
-		while (remaining) {
-			block = remaining;
-			read = fread( buf, 1, block, fsh[f].handleFiles.file.o );
-			if (read == 0) {
-				// we might have been trying to read from a CD, which
-				// sometimes returns a 0 read on windows
-				if (!tries) {
-					tries = 1;
-				} else {
-					return len-remaining;	//Com_Error (ERR_FATAL, "FS_Read: 0 bytes read");
-				}
-			}
 
-			if (read == -1) {
-				Com_Error (ERR_FATAL, "FS_Read: -1 bytes read");
-			}
+/*
+=============
+FS_ClearDirCache
+=============
+*/
+static void FS_ClearDirCache( void )
+{
+	int i;
 
-			remaining -= read;
-			buf += read;
+	for ( i = 0; i < MAX_CACHED_DIRS; i++ ) {
+		if ( fs_cachedDirs[ i ] ) {
+			free( fs_cachedDirs[ i ] );
+			fs_cachedDirs[ i ] = NULL;
 		}
-		return len;
-	} else {
-		return unzReadCurrentFile( fsh[f].handleFiles.file.z, buffer, len );
 	}
 }
 
 
 /*
-=================
-FS_Write
+=============
+FS_StoreDirListing
 
-Properly handles partial writes
-=================
+Copies key and names into a single allocation
+=============
 */
-int FS_Write( const void *buffer, int len, fileHandle_t h ) {
-	int		block, remaining;
-	int		written;
-	byte	*buf;
-	int		tries;
-	FILE	*f;
+static void FS_StoreDirListing( int slot, const char *directory, const char *extension, qboolean dironly,
+	fileTime_t mtime, fileTime_t listTime, char **list, int numfiles )
+{
+	cachedDir_t *cd;
+	size_t size, pathLen, extLen, len;
+	char *s;
+	int i;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	pathLen = strlen( directory ) + 1;
+	extLen = strlen( extension ) + 1;
+	size = sizeof( *cd ) + ( numfiles + 1 ) * sizeof( cd->list[0] ) + pathLen + extLen;
+	for ( i = 0; i < numfiles; i++ ) {
+		size += strlen( list[i] ) + 1;
 	}
 
-	//if ( h <= 0 || h >= MAX_FILE_HANDLES ) {
-	//	return 0;
-	//}
-
-	f = FS_FileForHandle(h);
-	buf = (byte *)buffer;
-
-	remaining = len;
-	tries = 0;
-	while (remaining) {
-		block = remaining;
-		written = fwrite (buf, 1, block, f);
-		if (written == 0) {
-			if (!tries) {
-				tries = 1;
-			} else {
-				Com_Printf( "FS_Write: 0 bytes written\n" );
-				return 0;
-			}
-		}
-
-		if (written == -1) {
-			Com_Printf( "FS_Write: -1 bytes written\n" );
-			return 0;
-		}
+	if ( fs_cachedDirs[ slot ] ) {
+		free( fs_cachedDirs[ slot ] );
+		fs_cachedDirs[ slot ] = NULL;
+	}
 
-		remaining -= written;
-		buf += written;
+	cd = malloc( size );
+	if ( !cd ) {
+		return;
 	}
-	if ( fsh[h].handleSync ) {
-		fflush( f );
+
+	cd->list = (char**)( cd + 1 );
+	s = (char*)( cd->list + numfiles + 1 );
+	for ( i = 0; i < numfiles; i++ ) {
+		len = strlen( list[i] ) + 1;
+		memcpy( s, list[i], len );
+		cd->list[i] = s;
+		s += len;
 	}
-	return len;
-}
+	cd->list[ numfiles ] = NULL;
 
-void QDECL FS_Printf( fileHandle_t h, const char *fmt, ... ) {
-	va_list		argptr;
-	char		msg[MAXPRINTMSG];
+	cd->path = s;
+	memcpy( cd->path, directory, pathLen );
+	cd->extension = s + pathLen;
+	memcpy( cd->extension, extension, extLen );
 
-	va_start (argptr,fmt);
-	Q_vsnprintf (msg, sizeof(msg), fmt, argptr);
-	va_end (argptr);
+	cd->dironly = dironly;
+	cd->mtime = mtime;
+	cd->listTime = listTime;
+	cd->lastUsed = ++fs_dirCacheSequence;
+	cd->numfiles = numfiles;
 
-	FS_Write(msg, strlen(msg), h);
+	fs_cachedDirs[ slot ] = cd;
 }
 
-#define PK3_SEEK_BUFFER_SIZE 65536
 
 /*
-=================
-FS_Seek
+=============
+FS_ListDirectory
 
-=================
+Cached front-end for Sys_ListFiles without a recursive filter,
+returns a list that must be released with Sys_FreeFileList
+=============
 */
-int FS_Seek( fileHandle_t f, long offset, fsOrigin_t origin ) {
-	int		_origin;
+static char **FS_ListDirectory( const char *directory, const char *extension, int *numfiles, qboolean wantsubs )
+{
+	fileOffset_t size;
+	fileTime_t mtime, ctime, listTime;
+	cachedDir_t *cd;
+	qboolean dironly;
+	char **list;
+	int i, slot;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-		return -1;
+	if ( !fs_dirCache || !fs_dirCache->integer || !Sys_GetFileStats( directory, &size, &mtime, &ctime ) ) {
+		return Sys_ListFiles( directory, extension, NULL, numfiles, wantsubs );
 	}
 
-	if ( fsh[f].zipFile == qtrue ) {
-		//FIXME: this is really, really crappy
-		//(but better than what was here before)
-		byte	buffer[PK3_SEEK_BUFFER_SIZE];
-		int		remainder;
-		int		currentPosition = FS_FTell( f );
+	if ( !extension ) {
+		extension = "";
+	}
 
-		// change negative offsets into FS_SEEK_SET
-		if ( offset < 0 ) {
-			switch( origin ) {
-				case FS_SEEK_END:
-					remainder = fsh[f].zipFileLen + offset;
-					break;
+	dironly = wantsubs || ( extension[0] == '/' && extension[1] == '\0' );
 
-				case FS_SEEK_CUR:
-					remainder = currentPosition + offset;
-					break;
+	slot = 0;
+	for ( i = 0; i < MAX_CACHED_DIRS; i++ ) {
+		cd = fs_cachedDirs[ i ];
+		if ( !cd ) {
+			slot = i;
+			continue;
+		}
+		if ( cd->dironly == dironly && strcmp( cd->path, directory ) == 0 && strcmp( cd->extension, extension ) == 0 ) {
+			slot = i;
+			break;
+		}
+		if ( fs_cachedDirs[ slot ] && cd->lastUsed < fs_cachedDirs[ slot ]->lastUsed ) {
+			slot = i;
+		}
+	}
 
-				case FS_SEEK_SET:
+	// one second of slack covers coarse timestamps on FAT volumes
+	if ( i < MAX_CACHED_DIRS && cd->mtime == mtime && mtime < cd->listTime - 1 ) {
+		fs_dirCacheHits++;
+		cd->lastUsed = ++fs_dirCacheSequence;
+		*numfiles = cd->numfiles;
+		if ( !cd->numfiles ) {
+			return NULL;
+		}
+		list = Z_Malloc( ( cd->numfiles + 1 ) * sizeof( list[0] ) );
+		for ( i = 0; i < cd->numfiles; i++ ) {
+			list[i] = FS_CopyString( cd->list[i] );
+		}
+		list[i] = NULL;
+		return list;
+	}
+
+	fs_dirCacheMisses++;
+
+	listTime = time( NULL );
+	list = Sys_ListFiles( directory, extension, NULL, numfiles, wantsubs );
+
+	// truncated listings are not worth keeping
+	if ( *numfiles < MAX_FOUND_FILES - 1 ) {
+		FS_StoreDirListing( slot, directory, extension, dironly, mtime, listTime, list, *numfiles );
+	}
+
+	return list;
+}
+#else
+#define FS_ListDirectory( directory, extension, numfiles, wantsubs ) Sys_ListFiles( directory, extension, NULL, numfiles, wantsubs )
+#endif // USE_DIR_CACHE
+
+
+#ifdef USE_FS_PROFILE
+/*
+=============================================================================
+
+LOAD PROFILING
+
+With fs_profile enabled every file opened for reading between
+FS_ProfileBegin and FS_ProfileEnd is recorded with the source that
+resolved it, bytes read, time spent in inflate and total time spent
+in filesystem calls, misses are recorded too.
+The report goes to the console and the full list, in the order the
+files were first opened, to fsprofile/<mapname>.txt
+=============================================================================
+*/
+
+typedef struct profiledFile_s {
+	struct profiledFile_s *next;
+	char		name[ MAX_QPATH ];
+	char		source[ MAX_QPATH ];	// pak or directory of the first open
+	int			size;
+	int			opens;				// more than one is a duplicate read
+	int			misses;
+	int64_t		bytes;
+	int64_t		inflateTime;		// usec spent in unzReadCurrentFile
+	int64_t		wallTime;			// usec spent in lookups and reads
+} profiledFile_t;
+
+static profiledFile_t	fs_profiledFiles[ MAX_PROFILED_FILES ];
+static profiledFile_t	*fs_profileHash[ PROFILE_HASH_SIZE ];
+static int				fs_numProfiledFiles;
+static int				fs_profileDropped;		// names that didn't fit
+static qboolean			fs_profileActive;
+static int64_t			fs_profileStart;
+static char				fs_profileMap[ MAX_QPATH ];
+
+
+/*
+=============
+FS_ProfileFile
+=============
+*/
+static profiledFile_t *FS_ProfileFile( const char *filename )
+{
+	profiledFile_t *p;
+	int hash;
+
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+
+	hash = FS_HashFileName( filename, PROFILE_HASH_SIZE );
+	for ( p = fs_profileHash[ hash ]; p; p = p->next ) {
+		if ( !FS_FilenameCompare( p->name, filename ) ) {
+			return p;
+		}
+	}
+
+	if ( fs_numProfiledFiles >= MAX_PROFILED_FILES || strlen( filename ) >= MAX_QPATH ) {
+		fs_profileDropped++;
+		return NULL;
+	}
+
+	p = &fs_profiledFiles[ fs_numProfiledFiles++ ];
+	Com_Memset( p, 0, sizeof( *p ) );
+	strcpy( p->name, filename );
+	p->next = fs_profileHash[ hash ];
+	fs_profileHash[ hash ] = p;
+
+	return p;
+}
+
+
+/*
+=============
+FS_ProfileOpen
+
+Records result of a FS_FOpenFileRead call that took usec microseconds
+=============
+*/
+static void FS_ProfileOpen( const char *filename, const fileHandle_t *file, int len, int64_t usec )
+{
+	profiledFile_t *p;
+	fileHandleData_t *fd;
+
+	p = FS_ProfileFile( filename );
+	if ( !p ) {
+		return;
+	}
+
+	p->wallTime += usec;
+
+	if ( len < 0 ) {
+		p->misses++;
+		return;
+	}
+
+	// probes for existence don't read anything
+	if ( !file ) {
+		return;
+	}
+
+	fd = &fsh[ *file ];
+	fd->profile = ( p - fs_profiledFiles ) + 1;
+
+	if ( p->opens++ == 0 ) {
+		p->size = len;
+		if ( fd->zipFile && fd->pak ) {
+			Com_sprintf( p->source, sizeof( p->source ), "%s/%s", fd->pak->pakGamename, fd->pak->pakBasename );
+		} else {
+			Q_strncpyz( p->source, "directory", sizeof( p->source ) );
+		}
+	}
+}
+
+
+/*
+=============
+FS_ProfileClearHandles
+
+Detaches handles that are still open from the records
+=============
+*/
+static void FS_ProfileClearHandles( void )
+{
+	int i;
+
+	for ( i = 0; i < MAX_FILE_HANDLES; i++ ) {
+		fsh[ i ].profile = 0;
+	}
+}
+
+
+/*
+=============
+FS_ProfileBegin
+
+Starts recording file reads for a level load, keeps recording
+if the load of the same map is already being recorded
+=============
+*/
+void FS_ProfileBegin( const char *mapname )
+{
+	if ( !fs_profile || !fs_profile->integer ) {
+		return;
+	}
+
+	if ( fs_profileActive && !Q_stricmp( fs_profileMap, mapname ) ) {
+		return;
+	}
+
+	Com_Memset( fs_profileHash, 0, sizeof( fs_profileHash ) );
+	fs_numProfiledFiles = 0;
+	fs_profileDropped = 0;
+	FS_ProfileClearHandles();
+
+	Q_strncpyz( fs_profileMap, mapname, sizeof( fs_profileMap ) );
+	fs_profileStart = Sys_Microseconds();
+	fs_profileActive = qtrue;
+}
+
+
+/*
+=============
+FS_ProfileCompareWall
+=============
+*/
+static int QDECL FS_ProfileCompareWall( const void *a, const void *b )
+{
+	const profiledFile_t *pa = *(const profiledFile_t **)a;
+	const profiledFile_t *pb = *(const profiledFile_t **)b;
+
+	if ( pa->wallTime != pb->wallTime ) {
+		return ( pa->wallTime < pb->wallTime ) ? 1 : -1;
+	}
+
+	return pa - pb;
+}
+
+
+/*
+=============
+FS_ProfileCompareOpens
+=============
+*/
+static int QDECL FS_ProfileCompareOpens( const void *a, const void *b )
+{
+	const profiledFile_t *pa = *(const profiledFile_t **)a;
+	const profiledFile_t *pb = *(const profiledFile_t **)b;
+
+	if ( pa->opens + pa->misses != pb->opens + pb->misses ) {
+		return ( pb->opens + pb->misses ) - ( pa->opens + pa->misses );
+	}
+
+	return pa - pb;
+}
+
+
+/*
+=============
+FS_ProfileWriteList
+=============
+*/
+static void FS_ProfileWriteList( void )
+{
+	const profiledFile_t *p;
+	char name[ MAX_OSPATH ];
+	fileHandle_t f;
+	int i;
+
+	Com_sprintf( name, sizeof( name ), "fsprofile/%s.txt", COM_SkipPath( fs_profileMap ) );
+	f = FS_FOpenFileWrite( name );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", name );
+		return;
+	}
+
+	FS_Printf( f, "// name source size opens bytes wall_usec inflate_usec\n" );
+	for ( i = 0, p = fs_profiledFiles; i < fs_numProfiledFiles; i++, p++ ) {
+		if ( p->opens ) {
+			FS_Printf( f, "%s %s %i %i %lli %lli %lli\n", p->name, p->source, p->size, p->opens,
+				(long long)p->bytes, (long long)p->wallTime, (long long)p->inflateTime );
+		}
+	}
+
+	FS_Printf( f, "// missed: name lookups wall_usec\n" );
+	for ( i = 0, p = fs_profiledFiles; i < fs_numProfiledFiles; i++, p++ ) {
+		if ( p->misses ) {
+			FS_Printf( f, "// %s %i %lli\n", p->name, p->misses, (long long)p->wallTime );
+		}
+	}
+
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %s\n", name );
+}
+
+
+/*
+=============
+FS_ProfileEnd
+
+Stops recording and prints the report
+=============
+*/
+void FS_ProfileEnd( void )
+{
+	static profiledFile_t *sorted[ MAX_PROFILED_FILES ];
+	const profiledFile_t *p;
+	int64_t bytes, wallTime, inflateTime;
+	int i, n, opens, files, misses, duplicates;
+
+	if ( !fs_profileActive ) {
+		return;
+	}
+
+	fs_profileActive = qfalse;
+	FS_ProfileClearHandles();
+
+	bytes = wallTime = inflateTime = 0;
+	opens = files = misses = duplicates = 0;
+	for ( i = 0, p = fs_profiledFiles; i < fs_numProfiledFiles; i++, p++ ) {
+		sorted[ i ] = (profiledFile_t *)p;
+		bytes += p->bytes;
+		wallTime += p->wallTime;
+		inflateTime += p->inflateTime;
+		opens += p->opens;
+		misses += p->misses;
+		if ( p->opens ) {
+			files++;
+		}
+		if ( p->opens > 1 ) {
+			duplicates += p->opens - 1;
+		}
+	}
+
+	Com_Printf( "------ File load profile: %s ------\n", fs_profileMap );
+	Com_Printf( "%i files, %i opens, %i duplicate opens, %i misses\n", files, opens, duplicates, misses );
+	Com_Printf( "%lli KB read, %lli msec in filesystem, %lli msec inflating, %lli msec total\n",
+		(long long)( bytes / 1024 ), (long long)( wallTime / 1000 ), (long long)( inflateTime / 1000 ),
+		(long long)( ( Sys_Microseconds() - fs_profileStart ) / 1000 ) );
+	if ( fs_profileDropped ) {
+		Com_Printf( S_COLOR_YELLOW "%i names not recorded\n", fs_profileDropped );
+	}
+
+	qsort( sorted, fs_numProfiledFiles, sizeof( sorted[0] ), FS_ProfileCompareWall );
+	Com_Printf( "\nslowest: usec  inflate  bytes  source  name\n" );
+	for ( i = 0, n = 0; i < fs_numProfiledFiles && n < PROFILE_REPORT_LINES; i++ ) {
+		p = sorted[ i ];
+		if ( p->opens ) {
+			Com_Printf( "%8lli %8lli %9lli  %s  %s\n", (long long)p->wallTime, (long long)p->inflateTime,
+				(long long)p->bytes, p->source, p->name );
+			n++;
+		}
+	}
+
+	qsort( sorted, fs_numProfiledFiles, sizeof( sorted[0] ), FS_ProfileCompareOpens );
+	if ( duplicates ) {
+		Com_Printf( "\nduplicate reads: opens  name\n" );
+		for ( i = 0, n = 0; i < fs_numProfiledFiles && n < PROFILE_REPORT_LINES; i++ ) {
+			p = sorted[ i ];
+			if ( p->opens > 1 ) {
+				Com_Printf( "%5i  %s\n", p->opens, p->name );
+				n++;
+			}
+		}
+	}
+
+	if ( misses ) {
+		Com_Printf( "\nmisses: lookups  name\n" );
+		for ( i = 0, n = 0; i < fs_numProfiledFiles && n < PROFILE_REPORT_LINES; i++ ) {
+			p = sorted[ i ];
+			if ( p->misses ) {
+				Com_Printf( "%5i  %s\n", p->misses, p->name );
+				n++;
+			}
+		}
+	}
+
+	Com_Printf( "-----------------------------------\n" );
+
+	FS_ProfileWriteList();
+}
+#endif // USE_FS_PROFILE
+
+
+/*
+===========
+FS_FOpenFileSearch
+
+Finds the file in the search path.
+Returns filesize and an open FILE pointer.
+Used for streaming data out of either a
+separate file or a ZIP file.
+===========
+*/
+extern qboolean		com_fullyInitialized;
+
+static int FS_FOpenFileSearch( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
+	const searchpath_t	*search;
+	char			*netpath;
+	pack_t			*pak;
+	fileInPack_t	*pakFile;
+	directory_t		*dir;
+#ifdef USE_FILE_INDEX
+	int				i, order;
+#else
+	long			hash;
+#endif
+	long			fullHash;
+	FILE			*temp;
+	int				length;
+	fileHandleData_t *f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !filename ) {
+		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
+	}
+
+	// qpaths are not supposed to have a leading slash
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+
+	// make absolutely sure that it can't back up the path.
+	// The searchpaths do guarantee that something will always
+	// be prepended, so we don't need to worry about "c:" or "//limbo"
+	if ( FS_CheckDirTraversal( filename ) ) {
+		*file = FS_INVALID_HANDLE;
+		return -1;
+	}
+
+	// we will calculate full hash only once then just mask it by current pack->hashSize
+	// we can do that as long as we know properties of our hash function
+	fullHash = FS_HashFileName( filename, 0U );
+
+#ifdef USE_MISS_CACHE
+	if ( FS_IsMissedFile( filename, fullHash ) ) {
+		if ( file ) {
+			*file = FS_INVALID_HANDLE;
+		}
+		return -1;
+	}
+#endif
+
+#ifdef USE_FILE_INDEX
+	if ( file == NULL ) {
+		// just wants to see if file is there
+		pak = FS_IndexLookup( filename, fullHash, qtrue, &pakFile, &order );
+		// directories in front of that pak take precedence
+		for ( i = 0; i < fs_indexDirCount && fs_indexDirs[ i ] < order; i++ ) {
+			search = fs_indexPaths[ fs_indexDirs[ i ] ];
+			if ( search->policy == DIR_DENY ) {
+				continue;
+			}
+			dir = search->dir;
+			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+			temp = Sys_FOpen( netpath, "rb" );
+			if ( temp ) {
+				length = FS_FileLength( temp );
+				fclose( temp );
+				return length;
+			}
+		}
+		if ( pak ) {
+			return pakFile->size;
+		}
+#ifdef USE_MISS_CACHE
+		FS_AddMissedFile( filename, fullHash );
+#endif
+		return -1;
+	}
+#else
+	if ( file == NULL ) {
+		// just wants to see if file is there
+		for ( search = fs_searchpaths ; search ; search = search->next ) {
+			// is the element a pak file?
+			if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
+				// skip non-pure files
+				if ( !FS_PakIsPure( search->pack ) )
+					continue;
+				// look through all the pak file elements
+				pak = search->pack;
+				pakFile = pak->hashTable[hash];
+				do {
+					// case and separator insensitive comparisons
+					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+						// found it!
+						return pakFile->size; 
+					}
+					pakFile = pakFile->next;
+				} while ( pakFile != NULL );
+			} else if ( search->dir && search->policy != DIR_DENY ) {
+				dir = search->dir;
+				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+				temp = Sys_FOpen( netpath, "rb" );
+				if ( temp ) {
+					length = FS_FileLength( temp );
+					fclose( temp );
+					return length;
+				}
+			}
+		}
+#ifdef USE_MISS_CACHE
+		FS_AddMissedFile( filename, fullHash );
+#endif
+		return -1;
+	}
+#endif
+
+	// make sure the q3key file is only readable by the quake3.exe at initialization
+	// any other time the key should only be accessed in memory using the provided functions
+	if ( com_fullyInitialized && strstr( filename, "q3key" ) ) {
+		*file = FS_INVALID_HANDLE;
+		return -1;
+	}
+
+#ifdef USE_FILE_INDEX
+	pak = FS_IndexLookup( filename, fullHash, qtrue, &pakFile, &order );
+
+	// check files in the directory tree in front of that pak
+	for ( i = 0; i < fs_indexDirCount && fs_indexDirs[ i ] < order; i++ ) {
+		search = fs_indexPaths[ fs_indexDirs[ i ] ];
+		if ( search->policy == DIR_DENY ) {
+			continue;
+		}
+
+		dir = search->dir;
+
+		netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+
+		temp = Sys_FOpen( netpath, "rb" );
+		if ( temp == NULL ) {
+			continue;
+		}
+
+		*file = FS_HandleForFile();
+		f = &fsh[ *file ];
+		FS_InitHandle( f );
+
+		f->handleFiles.file.o = temp;
+		Q_strncpyz( f->name, filename, sizeof( f->name ) );
+		f->zipFile = qfalse;
+
+		if ( fs_debug->integer ) {
+			Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
+				dir->path, dir->gamedir );
+		}
+
+		return FS_FileLength( f->handleFiles.file.o );
+	}
+
+	if ( pak ) {
+		return FS_OpenFileInPak( file, pak, pakFile, uniqueFILE );
+	}
+#else
+	//
+	// search through the path, one element at a time
+	//
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		// is the element a pak file?
+		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
+			// disregard if it doesn't match one of the allowed pure pak files
+			if ( !FS_PakIsPure( search->pack ) ) {
+				continue;
+			}
+			// look through all the pak file elements
+			pak = search->pack;
+			pakFile = pak->hashTable[hash];
+			do {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+					// found it!
+					return FS_OpenFileInPak( file, pak, pakFile, uniqueFILE );
+				}
+				pakFile = pakFile->next;
+			} while ( pakFile != NULL );
+		} else if ( search->dir && search->policy != DIR_DENY ) {
+			// check a file in the directory tree
+			dir = search->dir;
+
+			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+
+			temp = Sys_FOpen( netpath, "rb" );
+			if ( temp == NULL ) {
+				continue;
+			}
+
+			*file = FS_HandleForFile();
+			f = &fsh[ *file ];
+			FS_InitHandle( f );
+
+			f->handleFiles.file.o = temp;
+			Q_strncpyz( f->name, filename, sizeof( f->name ) );
+			f->zipFile = qfalse;
+
+			if ( fs_debug->integer ) {
+				Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
+					dir->path, dir->gamedir );
+			}
+
+			return FS_FileLength( f->handleFiles.file.o );
+		}
+	}
+#endif
+
+#ifdef FS_MISSING
+	if ( missingFiles ) {
+		fprintf( missingFiles, "%s\n", filename );
+	}
+#endif
+
+#ifdef USE_MISS_CACHE
+	FS_AddMissedFile( filename, fullHash );
+#endif
+
+	*file = FS_INVALID_HANDLE;
+	return -1;
+}
+
+
+/*
+===========
+FS_FOpenFileRead
+===========
+*/
+int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
+#ifdef USE_FS_PROFILE
+	int64_t		start;
+	int			len;
+
+	if ( fs_profileActive ) {
+		start = Sys_Microseconds();
+		len = FS_FOpenFileSearch( filename, file, uniqueFILE );
+		FS_ProfileOpen( filename, file, len, Sys_Microseconds() - start );
+		return len;
+	}
+#endif
+
+	return FS_FOpenFileSearch( filename, file, uniqueFILE );
+}
+
+
+/*
+===========
+FS_TouchFileInPak
+===========
+*/
+void FS_TouchFileInPak( const char *filename ) {
+#ifdef USE_FILE_INDEX
+	pack_t			*pak;
+
+	pak = FS_IndexLookup( filename, FS_HashFileName( filename, 0U ), qfalse, NULL, NULL );
+	if ( pak ) {
+		FS_ReferencePak( pak, filename );
+	}
+#else
+	const searchpath_t *search;
+	long			fullHash, hash;
+	pack_t			*pak;
+	fileInPack_t	*pakFile;
+
+	fullHash = FS_HashFileName( filename, 0U );
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		
+		// is the element a pak file?
+		if ( !search->pack )
+			continue;
+		
+		if ( search->pack->exclude ) // skip paks in \fs_excludeReference list
+			continue;
+
+		if ( search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
+			pak = search->pack;
+			pakFile = pak->hashTable[hash];
+			do {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+					// found it!
+					FS_ReferencePak( pak, filename );
+					return;
+				}
+				pakFile = pakFile->next;
+			} while ( pakFile != NULL );
+		}
+	}
+#endif
+}
+
+
+/*
+===========
+FS_Home_FOpenFileRead
+===========
+*/
+int FS_Home_FOpenFileRead( const char *filename, fileHandle_t *file ) 
+{
+	char path[ MAX_OSPATH*3 + 1 ];
+	fileHandleData_t *fd;
+	fileHandle_t f;	
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	// should never happen but for safe
+	if ( !file ) { 
+		return -1;
+	}
+
+	// allocate new file handle
+	f = FS_HandleForFile(); 
+	fd = &fsh[ f ];
+	FS_InitHandle( fd );
+
+	Com_sprintf( path, sizeof( path ), "%s%c%s%c%s", fs_homepath->string,
+		PATH_SEP, fs_gamedir, PATH_SEP, filename );
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "%s: %s\n", __func__, path );
+	}
+
+	fd->handleFiles.file.o = Sys_FOpen( path, "rb" );
+	if ( fd->handleFiles.file.o != NULL ) {
+		Q_strncpyz( fd->name, filename, sizeof( fd->name ) );
+		fd->handleSync = qfalse;
+		fd->zipFile = qfalse;
+		*file = f;
+		return FS_FileLength( fd->handleFiles.file.o );
+	}
+
+	*file = FS_INVALID_HANDLE;
+	return -1;
+}
+
+
+/*
+=================
+FS_ReadHandle
+
+Properly handles partial reads
+=================
+*/
+static int FS_ReadHandle( void *buffer, int len, fileHandle_t f ) {
+	int		block, remaining;
+	int		read;
+	byte	*buf;
+	int		tries;
+
+	buf = (byte *)buffer;
+
+	if ( !fsh[f].zipFile ) {
+		remaining = len;
+		tries = 0;
+		while (remaining) {
+			block = remaining;
+			read = fread( buf, 1, block, fsh[f].handleFiles.file.o );
+			if (read == 0) {
+				// we might have been trying to read from a CD, which
+				// sometimes returns a 0 read on windows
+				if (!tries) {
+					tries = 1;
+				} else {
+					return len-remaining;	//Com_Error (ERR_FATAL, "FS_Read: 0 bytes read");
+				}
+			}
+
+			if (read == -1) {
+				Com_Error (ERR_FATAL, "FS_Read: -1 bytes read");
+			}
+
+			remaining -= read;
+			buf += read;
+		}
+		return len;
+	} else {
+		return unzReadCurrentFile( fsh[f].handleFiles.file.z, buffer, len );
+	}
+}
+
+
+/*
+=================
+FS_Read
+=================
+*/
+int FS_Read( void *buffer, int len, fileHandle_t f ) {
+#ifdef USE_FS_PROFILE
+	profiledFile_t *p;
+	int64_t		start, usec;
+	int			read;
+#endif
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( f <= 0 || f >= MAX_FILE_HANDLES ) {
+		return 0;
+	}
+
+	// sound streams are read from decoder threads
+	Sys_AtomicAdd( &fs_readCount, len );
+
+#ifdef USE_FS_PROFILE
+	if ( fsh[f].profile ) {
+		p = &fs_profiledFiles[ fsh[f].profile - 1 ];
+		start = Sys_Microseconds();
+		read = FS_ReadHandle( buffer, len, f );
+		usec = Sys_Microseconds() - start;
+		p->wallTime += usec;
+		if ( fsh[f].zipFile ) {
+			p->inflateTime += usec;
+		}
+		if ( read > 0 ) {
+			p->bytes += read;
+		}
+		return read;
+	}
+#endif
+
+	return FS_ReadHandle( buffer, len, f );
+}
+
+
+/*
+=================
+FS_Write
+
+Properly handles partial writes
+=================
+*/
+int FS_Write( const void *buffer, int len, fileHandle_t h ) {
+	int		block, remaining;
+	int		written;
+	byte	*buf;
+	int		tries;
+	FILE	*f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	//if ( h <= 0 || h >= MAX_FILE_HANDLES ) {
+	//	return 0;
+	//}
+
+#ifdef USE_ASYNC_WRITES
+	if ( fsh[h].writeBehind ) {
+		return FS_WriteBehind( buffer, len, h );
+	}
+#endif
+
+	f = FS_FileForHandle(h);
+	buf = (byte *)buffer;
+
+	remaining = len;
+	tries = 0;
+	while (remaining) {
+		block = remaining;
+		written = fwrite (buf, 1, block, f);
+		if (written == 0) {
+			if (!tries) {
+				tries = 1;
+			} else {
+				Com_Printf( "FS_Write: 0 bytes written\n" );
+				return 0;
+			}
+		}
+
+		if (written == -1) {
+			Com_Printf( "FS_Write: -1 bytes written\n" );
+			return 0;
+		}
+
+		remaining -= written;
+		buf += written;
+	}
+	if ( fsh[h].handleSync ) {
+		fflush( f );
+	}
+	return len;
+}
+
+void QDECL FS_Printf( fileHandle_t h, const char *fmt, ... ) {
+	va_list		argptr;
+	char		msg[MAXPRINTMSG];
+
+	va_start (argptr,fmt);
+	Q_vsnprintf (msg, sizeof(msg), fmt, argptr);
+	va_end (argptr);
+
+	FS_Write(msg, strlen(msg), h);
+}
+
+#define PK3_SEEK_BUFFER_SIZE 65536
+
+/*
+=================
+FS_Seek
+
+=================
+*/
+int FS_Seek( fileHandle_t f, long offset, fsOrigin_t origin ) {
+	int		_origin;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+		return -1;
+	}
+
+#ifdef USE_ASYNC_WRITES
+	if ( fsh[f].writeBehind ) {
+		FS_FinishWrites( f, qfalse );
+	}
+#endif
+
+	if ( fsh[f].zipFile == qtrue ) {
+#ifdef USE_ZIP_SEEK
+		long position;
+
+		switch( origin ) {
+			case FS_SEEK_SET:
+				position = offset;
+				break;
+			case FS_SEEK_CUR:
+				position = FS_FTell( f ) + offset;
+				break;
+			case FS_SEEK_END:
+				position = fsh[f].zipFileLen + offset;
+				break;
+			default:
+				Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
+				return -1;
+		}
+
+		if ( position < 0 ) {
+			position = 0;
+		}
+
+		// stored entries are repositioned directly, deflated ones resume from
+		// the closest inflate checkpoint instead of reinflating from the start
+		unzSeekCurrentFile( fsh[f].handleFiles.file.z, position );
+		return offset;
+#else
+		//FIXME: this is really, really crappy
+		//(but better than what was here before)
+		byte	buffer[PK3_SEEK_BUFFER_SIZE];
+		int		remainder;
+		int		currentPosition = FS_FTell( f );
+
+		// change negative offsets into FS_SEEK_SET
+		if ( offset < 0 ) {
+			switch( origin ) {
+				case FS_SEEK_END:
+					remainder = fsh[f].zipFileLen + offset;
+					break;
+
+				case FS_SEEK_CUR:
+					remainder = currentPosition + offset;
+					break;
+
+				case FS_SEEK_SET:
 				default:
 					remainder = 0;
 					break;
 			}
 
-			if ( remainder < 0 ) {
-				remainder = 0;
-			}
+			if ( remainder < 0 ) {
+				remainder = 0;
+			}
+
+			origin = FS_SEEK_SET;
+		} else {
+			if ( origin == FS_SEEK_END ) {
+				remainder = fsh[f].zipFileLen - currentPosition + offset;
+			} else {
+				remainder = offset;
+			}
+		}
+
+		switch( origin ) {
+			case FS_SEEK_SET:
+				if ( remainder == currentPosition ) {
+					return offset;
+				}
+				unzSetCurrentFileInfoPosition( fsh[f].handleFiles.file.z, fsh[f].zipFilePos );
+				unzOpenCurrentFile( fsh[f].handleFiles.file.z );
+				//fallthrough
+
+			case FS_SEEK_END:
+			case FS_SEEK_CUR:
+				while( remainder > PK3_SEEK_BUFFER_SIZE ) {
+					FS_Read( buffer, PK3_SEEK_BUFFER_SIZE, f );
+					remainder -= PK3_SEEK_BUFFER_SIZE;
+				}
+				FS_Read( buffer, remainder, f );
+				return offset;
+
+			default:
+				Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
+				return -1;
+		}
+#endif
+	} else {
+		FILE *file;
+		file = FS_FileForHandle( f );
+		switch( origin ) {
+		case FS_SEEK_CUR:
+			_origin = SEEK_CUR;
+			break;
+		case FS_SEEK_END:
+			_origin = SEEK_END;
+			break;
+		case FS_SEEK_SET:
+			_origin = SEEK_SET;
+			break;
+		default:
+			Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
+			return -1;
+		}
+
+		return fseek( file, offset, _origin );
+	}
+}
+
+
+/*
+======================================================================================
+
+CONVENIENCE FUNCTIONS FOR ENTIRE FILES
+
+======================================================================================
+*/
+
+qboolean FS_FileIsInPAK( const char *filename, int *pChecksum, char *pakName ) {
+#ifndef USE_FILE_INDEX
+	const searchpath_t	*search;
+	const fileInPack_t	*pakFile;
+	long			hash;
+#endif
+	const pack_t		*pak;
+	long			fullHash;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !filename ) {
+		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed" );
+	}
+
+	// qpaths are not supposed to have a leading slash
+	while ( filename[0] == '/' || filename[0] == '\\' )
+		filename++;
+
+	// make absolutely sure that it can't back up the path.
+	// The searchpaths do guarantee that something will always
+	// be prepended, so we don't need to worry about "c:" or "//limbo" 
+	if ( FS_CheckDirTraversal( filename ) ) {
+		return qfalse;
+	}
+
+	fullHash = FS_HashFileName( filename, 0U );
+
+#ifdef USE_FILE_INDEX
+	pak = FS_IndexLookup( filename, fullHash, qfalse, NULL, NULL );
+	if ( pak ) {
+		if ( pChecksum ) {
+			*pChecksum = pak->pure_checksum;
+		}
+		if ( pakName ) {
+			Com_sprintf( pakName, MAX_OSPATH, "%s/%s", pak->pakGamename, pak->pakBasename );
+		}
+		return qtrue;
+	}
+#else
+	//
+	// search through the path, one element at a time
+	//
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+
+		// is the element a pak file?
+		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
+			// disregard if it doesn't match one of the allowed pure pak files
+			//if ( !FS_PakIsPure( search->pack ) ) {
+			//	continue;
+			//}
+			//
+			if ( search->pack->exclude ) {
+				continue;
+			}
+
+			// look through all the pak file elements
+			pak = search->pack;
+			pakFile = pak->hashTable[hash];
+			do {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+					if ( pChecksum ) {
+						*pChecksum = pak->pure_checksum;
+					}
+					if ( pakName ) {
+						Com_sprintf( pakName, MAX_OSPATH, "%s/%s", pak->pakGamename, pak->pakBasename );
+					}
+					return qtrue;
+				}
+				pakFile = pakFile->next;
+			} while ( pakFile != NULL );
+		}
+	}
+#endif
+	return qfalse;
+}
+
+
+#ifdef USE_PK3_MAPPING
+/*
+============
+FS_ReadMappedFile
+
+Reads an opened pak entry through a private view of the pk3:
+stored entries are returned in place, deflated ones are inflated
+from the view without staging compressed data through the FILE.
+Returns NULL if the entry should be read the regular way
+============
+*/
+static byte *FS_ReadMappedFile( fileHandle_t h, int len ) {
+	const unz_s *zfi;
+	const file_in_zip_read_info_s *info;
+	mappedFile_t *mf;
+	int64_t offset;
+	size_t length;
+	void *base;
+	byte *data, *buf;
+
+	zfi = (unz_s *)fsh[ h ].handleFiles.file.z;
+	info = zfi->pfile_in_zip_read;
+	if ( info == NULL ) {
+		return NULL;
+	}
+
+	offset = (int64_t)info->pos_in_zipfile + info->byte_before_the_zipfile;
+
+	if ( info->compression_method == 0 ) {
+		// the trailing zero overwrites the next local header in our private view,
+		// so the entry must be followed by at least the central directory
+		if ( len < MIN_MAPPED_SIZE || fs_numMappedFiles >= MAX_MAPPED_FILES ) {
+			return NULL;
+		}
+		if ( offset + len >= (int64_t)zfi->central_pos ) {
+			return NULL;
+		}
+		data = Sys_MapFile( zfi->file, offset, len + 1, &base, &length );
+		if ( data == NULL ) {
+			return NULL;
+		}
+		data[ len ] = '\0';
+		mf = &fs_mappedFiles[ fs_numMappedFiles++ ];
+		mf->buffer = data;
+		mf->base = base;
+		mf->length = length;
+		fs_readCount += len;
+#ifdef USE_FS_PROFILE
+		if ( fsh[ h ].profile ) {
+			fs_profiledFiles[ fsh[ h ].profile - 1 ].bytes += len;
+		}
+#endif
+		return data;
+	}
+
+	if ( zfi->cur_file_info.compressed_size < MIN_MAPPED_SIZE ) {
+		return NULL;
+	}
+
+	data = Sys_MapFile( zfi->file, offset, zfi->cur_file_info.compressed_size, &base, &length );
+	if ( data == NULL ) {
+		return NULL;
+	}
+
+	if ( unzSetCurrentFileBuffer( fsh[ h ].handleFiles.file.z, data ) != UNZ_OK ) {
+		Sys_UnmapFile( base, length );
+		return NULL;
+	}
+
+	buf = Hunk_AllocateTempMemory( len + 1 );
+	FS_Read( buf, len, h );
+
+	// handle is closed right after, before anything else reads from the view
+	Sys_UnmapFile( base, length );
+
+	return buf;
+}
+
+
+/*
+============
+FS_UnmapFile
+
+Releases a buffer returned by FS_ReadMappedFile in place
+============
+*/
+static qboolean FS_UnmapFile( void *buffer ) {
+	int i;
+
+	for ( i = 0; i < fs_numMappedFiles; i++ ) {
+		if ( fs_mappedFiles[ i ].buffer == buffer ) {
+			Sys_UnmapFile( fs_mappedFiles[ i ].base, fs_mappedFiles[ i ].length );
+			fs_mappedFiles[ i ] = fs_mappedFiles[ --fs_numMappedFiles ];
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+#endif // USE_PK3_MAPPING
+
+
+/*
+============
+FS_MapFile
+
+Maps a loose file or a stored pk3 entry without copying, the view
+stays valid after the handle is closed
+============
+*/
+int FS_MapFile( const char *qpath, void **buffer ) {
+#ifdef USE_PK3_MAPPING
+	const unz_s *zfi;
+	const file_in_zip_read_info_s *info;
+	mappedFile_t *mf;
+	fileHandle_t h;
+	int64_t offset;
+	size_t length;
+	void *base;
+	byte *data;
+	FILE *file;
+	long len;
+
+	*buffer = NULL;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_MapFile with empty name" );
+	}
+
+	if ( !fs_mmap->integer || fs_numMappedFiles >= MAX_MAPPED_FILES ) {
+		return -1;
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == FS_INVALID_HANDLE ) {
+		return -1;
+	}
+
+	if ( fsh[ h ].zipFile ) {
+		zfi = (unz_s *)fsh[ h ].handleFiles.file.z;
+		info = zfi->pfile_in_zip_read;
+		if ( info == NULL || info->compression_method != 0 ) {
+			FS_FCloseFile( h );
+			return -1;
+		}
+		offset = (int64_t)info->pos_in_zipfile + info->byte_before_the_zipfile;
+		file = zfi->file;
+	} else {
+		offset = 0;
+		file = fsh[ h ].handleFiles.file.o;
+	}
+
+	data = NULL;
+	if ( len > 0 ) {
+		data = Sys_MapFile( file, offset, len, &base, &length );
+	}
+
+	FS_FCloseFile( h );
+
+	if ( data == NULL ) {
+		return -1;
+	}
+
+	mf = &fs_mappedFiles[ fs_numMappedFiles++ ];
+	mf->buffer = data;
+	mf->base = base;
+	mf->length = length;
+	fs_readCount += len;
+	fs_loadCount++;
+
+	*buffer = data;
+	return len;
+#else
+	*buffer = NULL;
+	return -1;
+#endif
+}
+
+
+/*
+============
+FS_FreeMappedFile
+============
+*/
+void FS_FreeMappedFile( void *buffer ) {
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeMappedFile( NULL )" );
+	}
+#ifdef USE_PK3_MAPPING
+	if ( !FS_UnmapFile( buffer ) )
+#endif
+	Com_Error( ERR_FATAL, "FS_FreeMappedFile: buffer is not mapped" );
+}
+
+
+/*
+============
+FS_ReadFile
+
+Filename are relative to the quake search path
+a null buffer will just return the file length without loading
+============
+*/
+int FS_ReadFile( const char *qpath, void **buffer ) {
+	fileHandle_t	h;
+	byte*			buf;
+	qboolean		isConfig;
+	long			len;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFile with empty name" );
+	}
+
+	buf = NULL;	// quiet compiler warning
+	isConfig = qfalse;
+
+	// if this is a .cfg file and we are playing back a journal, read
+	// it from the journal file
+	if ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) {
+		if ( com_journal->integer == 2 ) {
+			int		r;
+
+			Com_DPrintf( "Loading %s from journal file.\n", qpath );
+			r = FS_Read( &len, sizeof( len ), com_journalDataFile );
+			if ( r != sizeof( len ) ) {
+				if (buffer != NULL) *buffer = NULL;
+				return -1;
+			}
+			// if the file didn't exist when the journal was created
+			if (!len) {
+				if (buffer == NULL) {
+					return 1;			// hack for old journal files
+				}
+				*buffer = NULL;
+				return -1;
+			}
+			if (buffer == NULL) {
+				return len;
+			}
+
+			buf = Hunk_AllocateTempMemory(len+1);
+			*buffer = buf;
+
+			r = FS_Read( buf, len, com_journalDataFile );
+			if ( r != len ) {
+				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
+			}
+
+			fs_loadCount++;
+			fs_loadStack++;
+
+			// guarantee that it will have a trailing 0 for string operations
+			buf[len] = '\0';
+
+			return len;
+		} else if ( com_journal->integer == 1 ) {
+			isConfig = qtrue;
+		}
+	}
+
+	// look for it in the filesystem or pack files
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == FS_INVALID_HANDLE ) {
+		if ( buffer ) {
+			*buffer = NULL;
+		}
+		// if we are journaling and it is a config file, write a zero to the journal file
+		if ( isConfig ) {
+			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
+			len = 0;
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		return -1;
+	}
+
+	if ( !buffer ) {
+		if ( isConfig ) {
+			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		FS_FCloseFile( h );
+		return len;
+	}
+
+#ifdef USE_PK3_MAPPING
+	buf = NULL;
+	if ( fsh[ h ].zipFile && fs_mmap->integer ) {
+		buf = FS_ReadMappedFile( h, len );
+	}
+	if ( !buf )
+#endif
+	{
+		buf = Hunk_AllocateTempMemory( len + 1 );
+		FS_Read( buf, len, h );
+	}
+	*buffer = buf;
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	// guarantee that it will have a trailing 0 for string operations
+	buf[ len ] = '\0';
+	FS_FCloseFile( h );
+
+	// if we are journaling and it is a config file, write it to the journal file
+	if ( isConfig ) {
+		Com_DPrintf( "Writing %s to journal file.\n", qpath );
+		FS_Write( &len, sizeof( len ), com_journalDataFile );
+		FS_Write( buf, len, com_journalDataFile );
+		FS_Flush( com_journalDataFile );
+	}
+	return len;
+}
+
+
+#ifdef USE_ASYNC_READS
+/*
+=============================================================================
+
+BACKGROUND READS
+
+FS_ReadFileAsync resolves the file and allocates its buffer on the calling
+thread, only the plain reads and inflating happen on I/O threads, which
+never touch filesystem state, hunk or zone
+=============================================================================
+*/
+
+typedef enum {
+	ASYNC_FREE,
+	ASYNC_QUEUED,
+	ASYNC_DONE,			// buffer filled or file not found
+	ASYNC_FAILED		// retried synchronously by FS_WaitFile
+} asyncState_t;
+
+typedef struct asyncRead_s {
+	volatile asyncState_t state;
+	struct asyncRead_s *next;	// in pending queue
+	char		qpath[ MAX_QPATH ];
+	FILE		*file;			// own pak file or file of dirHandle
+	fileHandle_t dirHandle;		// open handle for files outside of paks
+	int64_t		offset;
+	int			length;			// -1 if not found
+	int			compressedLength;	// 0 for stored data
+	byte		*buffer;
+	byte		*compressed;
+} asyncRead_t;
+
+static asyncRead_t	fs_asyncReads[ MAX_ASYNC_READS ];
+static asyncRead_t	*fs_asyncHead, *fs_asyncTail;
+
+static void			*fs_ioThread[ MAX_IO_THREADS ];
+static int			fs_numIOThreads;
+static void			*fs_ioLock;			// protects queue and request states
+static void			*fs_ioWake;			// posted once per queued request
+static void			*fs_ioDone;			// posted once per completed request
+static qboolean		fs_ioQuit;
+
+// batch of FS_IOParallelFor, taken one index per fs_ioWake post
+static void			(*fs_ioBatchFunc)( void *data, int index );
+static void			*fs_ioBatchData;
+static int			fs_ioBatchCount;
+static int			fs_ioBatchNext;
+static int			fs_ioBatchDone;
+
+
+/*
+=============
+FS_AsyncState
+
+State written by I/O threads, read under lock so that buffer contents are visible
+=============
+*/
+static asyncState_t FS_AsyncState( const asyncRead_t *r )
+{
+	asyncState_t state;
+
+	if ( !fs_ioLock ) {
+		return r->state;
+	}
+
+	Sys_LockMutex( fs_ioLock );
+	state = r->state;
+	Sys_UnlockMutex( fs_ioLock );
+
+	return state;
+}
+
+
+/*
+=============
+FS_AsyncRead
+
+Runs on I/O threads
+=============
+*/
+static asyncState_t FS_AsyncRead( asyncRead_t *r )
+{
+	if ( fseek( r->file, (long)r->offset, SEEK_SET ) != 0 ) {
+		return ASYNC_FAILED;
+	}
+
+	if ( r->compressedLength == 0 ) {
+		if ( r->length && fread( r->buffer, r->length, 1, r->file ) != 1 ) {
+			return ASYNC_FAILED;
+		}
+	} else {
+		if ( fread( r->compressed, r->compressedLength, 1, r->file ) != 1 ) {
+			return ASYNC_FAILED;
+		}
+		if ( unzInflateBuffer( r->buffer, r->length, r->compressed, r->compressedLength ) != UNZ_OK ) {
+			return ASYNC_FAILED;
+		}
+	}
+
+	r->buffer[ r->length ] = '\0';
+
+	return ASYNC_DONE;
+}
+
+
+/*
+=============
+FS_IOThread
+=============
+*/
+static void FS_IOThread( void *arg )
+{
+	asyncRead_t *r;
+	asyncState_t state;
+	int index;
+
+	for ( ;; ) {
+		Sys_WaitSemaphore( fs_ioWake );
+
+		Sys_LockMutex( fs_ioLock );
+		if ( fs_ioQuit ) {
+			Sys_UnlockMutex( fs_ioLock );
+			break;
+		}
+		if ( fs_ioBatchNext < fs_ioBatchCount ) {
+			index = fs_ioBatchNext++;
+			Sys_UnlockMutex( fs_ioLock );
+			fs_ioBatchFunc( fs_ioBatchData, index );
+			Sys_LockMutex( fs_ioLock );
+			fs_ioBatchDone++;
+			Sys_UnlockMutex( fs_ioLock );
+			Sys_PostSemaphore( fs_ioDone, 1 );
+			continue;
+		}
+		r = fs_asyncHead;
+		if ( r ) {
+			fs_asyncHead = r->next;
+			if ( !fs_asyncHead ) {
+				fs_asyncTail = NULL;
+			}
+		}
+		Sys_UnlockMutex( fs_ioLock );
+
+		if ( !r ) {
+			continue;
+		}
+
+		state = FS_AsyncRead( r );
+
+		Sys_LockMutex( fs_ioLock );
+		r->state = state;
+		Sys_UnlockMutex( fs_ioLock );
+
+		Sys_PostSemaphore( fs_ioDone, 1 );
+	}
+}
+
+
+/*
+=============
+FS_IOParallelFor
+
+Calls func( data, index ) for each index in [0..count) on I/O threads and
+waits for completion, the calling thread also participates. Same rules
+as for Com_ParallelFor callbacks, which are not started yet when the
+filesystem initializes
+=============
+*/
+static void FS_IOParallelFor( void (*func)( void *data, int index ), void *data, int count )
+{
+	int index, done;
+
+	if ( !fs_numIOThreads || count <= 1 ) {
+		for ( index = 0; index < count; index++ ) {
+			func( data, index );
+		}
+		return;
+	}
+
+	Sys_LockMutex( fs_ioLock );
+	fs_ioBatchFunc = func;
+	fs_ioBatchData = data;
+	fs_ioBatchCount = count;
+	fs_ioBatchNext = 0;
+	fs_ioBatchDone = 0;
+	Sys_UnlockMutex( fs_ioLock );
+
+	Sys_PostSemaphore( fs_ioWake, count );
+
+	for ( ;; ) {
+		Sys_LockMutex( fs_ioLock );
+		if ( fs_ioBatchNext >= fs_ioBatchCount ) {
+			Sys_UnlockMutex( fs_ioLock );
+			break;
+		}
+		index = fs_ioBatchNext++;
+		Sys_UnlockMutex( fs_ioLock );
+		func( data, index );
+		Sys_LockMutex( fs_ioLock );
+		fs_ioBatchDone++;
+		Sys_UnlockMutex( fs_ioLock );
+	}
+
+	// completions of background reads may be consumed here too
+	for ( ;; ) {
+		Sys_LockMutex( fs_ioLock );
+		done = ( fs_ioBatchDone == fs_ioBatchCount );
+		if ( done ) {
+			fs_ioBatchCount = 0;
+			fs_ioBatchNext = 0;
+		}
+		Sys_UnlockMutex( fs_ioLock );
+		if ( done ) {
+			break;
+		}
+		Sys_WaitSemaphore( fs_ioDone );
+	}
+}
+
+
+/*
+=============
+FS_StopIOThreads
+
+Completes all queued requests, then stops I/O threads
+=============
+*/
+static void FS_StopIOThreads( void )
+{
+	int i;
+
+	for ( i = 0; i < MAX_ASYNC_READS; i++ ) {
+		while ( FS_AsyncState( &fs_asyncReads[ i ] ) == ASYNC_QUEUED ) {
+			Sys_WaitSemaphore( fs_ioDone );
+		}
+	}
+
+	if ( fs_numIOThreads ) {
+		Sys_LockMutex( fs_ioLock );
+		fs_ioQuit = qtrue;
+		Sys_UnlockMutex( fs_ioLock );
+		Sys_PostSemaphore( fs_ioWake, fs_numIOThreads );
+		for ( i = 0; i < fs_numIOThreads; i++ ) {
+			Com_JoinThread( fs_ioThread[ i ] );
+			fs_ioThread[ i ] = NULL;
+		}
+		fs_numIOThreads = 0;
+	}
+
+	Sys_DestroySemaphore( fs_ioDone );
+	Sys_DestroySemaphore( fs_ioWake );
+	Sys_DestroyMutex( fs_ioLock );
+
+	fs_ioDone = NULL;
+	fs_ioWake = NULL;
+	fs_ioLock = NULL;
+}
+
+
+/*
+=============
+FS_StartIOThreads
+=============
+*/
+static void FS_StartIOThreads( void )
+{
+	int count;
+
+	count = fs_ioThreads->integer;
+	if ( count <= 0 || fs_numIOThreads ) {
+		return;
+	}
+
+	fs_ioLock = Sys_CreateMutex();
+	fs_ioWake = Sys_CreateSemaphore();
+	fs_ioDone = Sys_CreateSemaphore();
+	if ( !fs_ioLock || !fs_ioWake || !fs_ioDone ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create I/O synchronization objects\n" );
+		FS_StopIOThreads();
+		return;
+	}
+
+	fs_ioQuit = qfalse;
+	while ( fs_numIOThreads < count ) {
+		fs_ioThread[ fs_numIOThreads ] = Com_CreateThread( JOB_POOL_IO, "fs io", FS_IOThread, NULL );
+		if ( !fs_ioThread[ fs_numIOThreads ] ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: failed to create I/O thread %i\n", fs_numIOThreads );
+			break;
+		}
+		fs_numIOThreads++;
+	}
+}
+
+
+/*
+=============
+FS_ReadFileAsync
+
+Starts reading a file in background, returns a handle for FS_WaitFile.
+Falls back to a synchronous read where background reads are not possible
+=============
+*/
+int FS_ReadFileAsync( const char *qpath )
+{
+	const unz_s *zfi;
+	const file_in_zip_read_info_s *info;
+	asyncRead_t *r;
+	fileHandle_t h;
+	int handle, len;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync with empty name" );
+	}
+
+	for ( handle = 0; handle < MAX_ASYNC_READS; handle++ ) {
+		if ( fs_asyncReads[ handle ].state == ASYNC_FREE ) {
+			break;
+		}
+	}
+	if ( handle == MAX_ASYNC_READS ) {
+		Com_Error( ERR_DROP, "FS_ReadFileAsync: too many pending reads" );
+	}
+
+	r = &fs_asyncReads[ handle ];
+	Com_Memset( r, 0, sizeof( *r ) );
+	Q_strncpyz( r->qpath, qpath, sizeof( r->qpath ) );
+	r->dirHandle = FS_INVALID_HANDLE;
+
+	// journaled configs must go through FS_ReadFile
+	if ( !fs_numIOThreads || ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) ) {
+		r->length = FS_ReadFile( qpath, (void **)&r->buffer );
+		r->state = ASYNC_DONE;
+		return handle;
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == FS_INVALID_HANDLE ) {
+		r->length = -1;
+		r->state = ASYNC_DONE;
+		return handle;
+	}
+
+	if ( fsh[ h ].zipFile ) {
+		zfi = (unz_s *)fsh[ h ].handleFiles.file.z;
+		info = zfi->pfile_in_zip_read;
+		if ( info == NULL || ( r->file = Sys_FOpen( fsh[ h ].pak->pakFilename, "rb" ) ) == NULL ) {
+			FS_FCloseFile( h );
+			r->length = FS_ReadFile( qpath, (void **)&r->buffer );
+			r->state = ASYNC_DONE;
+			return handle;
+		}
+		r->offset = (int64_t)info->pos_in_zipfile + info->byte_before_the_zipfile;
+		if ( info->compression_method != 0 ) {
+			r->compressedLength = zfi->cur_file_info.compressed_size;
+		}
+		FS_FCloseFile( h );
+	} else {
+		r->file = fsh[ h ].handleFiles.file.o;
+		r->dirHandle = h;
+	}
+
+	// compressed data is staged past the end of the same block to keep
+	// temp memory in stack order, counted as a loaded file so that
+	// temp memory is not cleared under I/O threads
+	r->length = len;
+	r->buffer = Hunk_AllocateTempMemory( len + 1 + r->compressedLength );
+	fs_loadStack++;
+	if ( r->compressedLength ) {
+		r->compressed = r->buffer + len + 1;
+	}
+
+	Sys_LockMutex( fs_ioLock );
+	r->state = ASYNC_QUEUED;
+	if ( fs_asyncTail ) {
+		fs_asyncTail->next = r;
+	} else {
+		fs_asyncHead = r;
+	}
+	fs_asyncTail = r;
+	Sys_UnlockMutex( fs_ioLock );
+
+	Sys_PostSemaphore( fs_ioWake, 1 );
+
+	return handle;
+}
+
+
+/*
+=============
+FS_AsyncFileReady
+
+Returns qtrue if FS_WaitFile will not block
+=============
+*/
+qboolean FS_AsyncFileReady( int handle )
+{
+	if ( (unsigned)handle >= MAX_ASYNC_READS || fs_asyncReads[ handle ].state == ASYNC_FREE ) {
+		Com_Error( ERR_DROP, "FS_AsyncFileReady: invalid handle %i", handle );
+	}
 
-			origin = FS_SEEK_SET;
+	return ( FS_AsyncState( &fs_asyncReads[ handle ] ) != ASYNC_QUEUED );
+}
+
+
+/*
+=============
+FS_WaitFile
+
+Completes a read started by FS_ReadFileAsync, returns file length
+or -1 if not found, buffer must be released with FS_FreeFile
+=============
+*/
+int FS_WaitFile( int handle, void **buffer )
+{
+	asyncRead_t *r;
+	int len;
+#ifdef USE_FS_PROFILE
+	profiledFile_t *p;
+	int64_t start;
+
+	start = Sys_Microseconds();
+#endif
+
+	if ( (unsigned)handle >= MAX_ASYNC_READS || fs_asyncReads[ handle ].state == ASYNC_FREE ) {
+		Com_Error( ERR_DROP, "FS_WaitFile: invalid handle %i", handle );
+	}
+
+	r = &fs_asyncReads[ handle ];
+
+	// other completions may be consumed here too, their state is already set
+	while ( FS_AsyncState( r ) == ASYNC_QUEUED ) {
+		Sys_WaitSemaphore( fs_ioDone );
+	}
+
+	if ( r->file ) {
+		if ( r->dirHandle != FS_INVALID_HANDLE ) {
+			FS_FCloseFile( r->dirHandle );
 		} else {
-			if ( origin == FS_SEEK_END ) {
-				remainder = fsh[f].zipFileLen - currentPosition + offset;
-			} else {
-				remainder = offset;
+			fclose( r->file );
+		}
+		if ( r->state == ASYNC_FAILED ) {
+			FS_FreeFile( r->buffer );
+			r->length = FS_ReadFile( r->qpath, (void **)&r->buffer );
+		} else {
+			fs_loadCount++;
+			fs_readCount += r->length;
+#ifdef USE_FS_PROFILE
+			// inflating happened on I/O threads, only the wait is counted
+			if ( fs_profileActive && ( p = FS_ProfileFile( r->qpath ) ) != NULL ) {
+				p->bytes += r->length;
+				p->wallTime += Sys_Microseconds() - start;
 			}
+#endif
 		}
+	}
 
-		switch( origin ) {
-			case FS_SEEK_SET:
-				if ( remainder == currentPosition ) {
-					return offset;
-				}
-				unzSetCurrentFileInfoPosition( fsh[f].handleFiles.file.z, fsh[f].zipFilePos );
-				unzOpenCurrentFile( fsh[f].handleFiles.file.z );
-				//fallthrough
+	len = r->length;
+	*buffer = r->buffer;
 
-			case FS_SEEK_END:
-			case FS_SEEK_CUR:
-				while( remainder > PK3_SEEK_BUFFER_SIZE ) {
-					FS_Read( buffer, PK3_SEEK_BUFFER_SIZE, f );
-					remainder -= PK3_SEEK_BUFFER_SIZE;
-				}
-				FS_Read( buffer, remainder, f );
-				return offset;
+	r->state = ASYNC_FREE;
 
-			default:
-				Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
-				return -1;
-		}
-	} else {
-		FILE *file;
-		file = FS_FileForHandle( f );
-		switch( origin ) {
-		case FS_SEEK_CUR:
-			_origin = SEEK_CUR;
-			break;
-		case FS_SEEK_END:
-			_origin = SEEK_END;
-			break;
-		case FS_SEEK_SET:
-			_origin = SEEK_SET;
-			break;
-		default:
-			Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
-			return -1;
-		}
+	return len;
+}
 
-		return fseek( file, offset, _origin );
+
+/*
+=============
+FS_LoadStamp
+
+Changes whenever the search path is rebuilt or reordered,
+data derived from file contents must be discarded then
+=============
+*/
+int FS_LoadStamp( void ) {
+	return fs_loadStamp;
+}
+
+
+/*
+=============
+FS_InflateBuffer
+
+Inflates a raw deflate stream into a buffer of its exact
+uncompressed size, allocates nothing and is safe on any thread
+=============
+*/
+qboolean FS_InflateBuffer( void *dest, int destLen, const void *source, int sourceLen )
+{
+	if ( destLen <= 0 || sourceLen <= 0 ) {
+		return qfalse;
 	}
+
+	return unzInflateBuffer( dest, destLen, source, sourceLen ) == UNZ_OK ? qtrue : qfalse;
 }
+#endif // USE_ASYNC_READS
 
 
+#ifdef USE_ASYNC_WRITES
 /*
-======================================================================================
+=============================================================================
 
-CONVENIENCE FUNCTIONS FOR ENTIRE FILES
+BACKGROUND WRITES
 
-======================================================================================
+FS_Write data of handles passed to FS_BufferWrites is copied into a ring
+of buffers that a single writer thread writes out in order, the main
+thread only waits when all buffers are queued. Anything else done with
+such a handle first waits for the writer, so files are byte for byte
+the same as with plain writes
+=============================================================================
 */
 
-qboolean FS_FileIsInPAK( const char *filename, int *pChecksum, char *pakName ) {
-	const searchpath_t	*search;
-	const pack_t		*pak;
-	const fileInPack_t	*pakFile;
-	long			hash;
-	long			fullHash;
+typedef struct {
+	FILE		*file;
+	int			size;
+	int			startTime;		// Sys_Milliseconds of the first byte
+	qboolean	sync;			// commit to disk after writing
+	byte		data[ WRITE_BUFFER_SIZE ];
+} writeBuffer_t;
+
+static writeBuffer_t	fs_writeBuffers[ MAX_WRITE_BUFFERS ];
+static int			fs_writeFill;		// buffer filled by the main thread
+static int			fs_writeNext;		// buffer written next, writer thread only
+static int			fs_writeQueued;		// protected by fs_writeLock
+static int			fs_writeLost;		// bytes that failed, protected by fs_writeLock
+static qboolean		fs_writeQuit;
+static void			*fs_writer;
+static void			*fs_writeLock;
+static void			*fs_writeWake;		// posted once per queued buffer
+static void			*fs_writeDone;		// posted once per written buffer
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+
+/*
+=============
+FS_WriterThread
+=============
+*/
+static void FS_WriterThread( void *arg )
+{
+	writeBuffer_t *b;
+	qboolean quit;
+	int lost;
+
+	for ( ;; ) {
+		Sys_WaitSemaphore( fs_writeWake );
+
+		Sys_LockMutex( fs_writeLock );
+		quit = ( fs_writeQuit && fs_writeQueued == 0 );
+		Sys_UnlockMutex( fs_writeLock );
+
+		if ( quit ) {
+			break;
+		}
+
+		b = &fs_writeBuffers[ fs_writeNext ];
+		lost = b->size - (int)fwrite( b->data, 1, b->size, b->file );
+		fflush( b->file );
+		if ( b->sync ) {
+			Sys_FSync( b->file );
+		}
+		fs_writeNext = ( fs_writeNext + 1 ) % MAX_WRITE_BUFFERS;
+
+		Sys_LockMutex( fs_writeLock );
+		fs_writeLost += lost;
+		fs_writeQueued--;
+		Sys_UnlockMutex( fs_writeLock );
+
+		Sys_PostSemaphore( fs_writeDone, 1 );
 	}
+}
 
-	if ( !filename ) {
-		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed" );
+
+/*
+=============
+FS_QueueWriteBuffer
+
+Hands the buffer being filled to the writer thread and waits
+until the next one is free
+=============
+*/
+static void FS_QueueWriteBuffer( qboolean sync )
+{
+	writeBuffer_t *b;
+	int queued;
+
+	b = &fs_writeBuffers[ fs_writeFill ];
+	if ( b->size == 0 ) {
+		return;
 	}
 
-	// qpaths are not supposed to have a leading slash
-	while ( filename[0] == '/' || filename[0] == '\\' )
-		filename++;
+	b->sync = sync;
 
-	// make absolutely sure that it can't back up the path.
-	// The searchpaths do guarantee that something will always
-	// be prepended, so we don't need to worry about "c:" or "//limbo" 
-	if ( FS_CheckDirTraversal( filename ) ) {
-		return qfalse;
+	Sys_LockMutex( fs_writeLock );
+	queued = ++fs_writeQueued;
+	Sys_UnlockMutex( fs_writeLock );
+
+	Sys_PostSemaphore( fs_writeWake, 1 );
+
+	fs_writeFill = ( fs_writeFill + 1 ) % MAX_WRITE_BUFFERS;
+
+	// with every buffer queued the oldest one is the next to fill
+	while ( queued == MAX_WRITE_BUFFERS ) {
+		Sys_WaitSemaphore( fs_writeDone );
+		Sys_LockMutex( fs_writeLock );
+		queued = fs_writeQueued;
+		Sys_UnlockMutex( fs_writeLock );
 	}
 
-	fullHash = FS_HashFileName( filename, 0U );
+	fs_writeBuffers[ fs_writeFill ].size = 0;
+}
 
-	//
-	// search through the path, one element at a time
-	//
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
 
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			//if ( !FS_PakIsPure( search->pack ) ) {
-			//	continue;
-			//}
-			//
-			if ( search->pack->exclude ) {
-				continue;
-			}
+/*
+=============
+FS_WaitWrites
+=============
+*/
+static void FS_WaitWrites( void )
+{
+	int queued;
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if ( pChecksum ) {
-						*pChecksum = pak->pure_checksum;
-					}
-					if ( pakName ) {
-						Com_sprintf( pakName, MAX_OSPATH, "%s/%s", pak->pakGamename, pak->pakBasename );
-					}
-					return qtrue;
-				}
-				pakFile = pakFile->next;
-			} while ( pakFile != NULL );
+	for ( ;; ) {
+		Sys_LockMutex( fs_writeLock );
+		queued = fs_writeQueued;
+		Sys_UnlockMutex( fs_writeLock );
+		if ( !queued ) {
+			break;
 		}
+		Sys_WaitSemaphore( fs_writeDone );
 	}
-	return qfalse;
 }
 
 
 /*
-============
-FS_ReadFile
+=============
+FS_FinishWrites
 
-Filename are relative to the quake search path
-a null buffer will just return the file length without loading
-============
+Writes out everything buffered so far, the calling thread owns the file again
+=============
 */
-int FS_ReadFile( const char *qpath, void **buffer ) {
-	fileHandle_t	h;
-	byte*			buf;
-	qboolean		isConfig;
-	long			len;
+static void FS_FinishWrites( fileHandle_t h, qboolean sync )
+{
+	int lost;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	FS_QueueWriteBuffer( sync );
+	FS_WaitWrites();
+
+	Sys_LockMutex( fs_writeLock );
+	lost = fs_writeLost;
+	fs_writeLost = 0;
+	Sys_UnlockMutex( fs_writeLock );
+
+	if ( lost ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i bytes could not be written to %s\n", lost, fsh[ h ].name );
 	}
+}
 
-	if ( !qpath || !qpath[0] ) {
-		Com_Error( ERR_FATAL, "FS_ReadFile with empty name" );
+
+/*
+=============
+FS_WriteBehind
+=============
+*/
+static int FS_WriteBehind( const void *buffer, int len, fileHandle_t h )
+{
+	const byte *buf;
+	writeBuffer_t *b;
+	FILE *f;
+	int block, remaining;
+
+	f = fsh[ h ].handleFiles.file.o;
+	buf = (const byte *)buffer;
+
+	// keep the order of writes to different files
+	b = &fs_writeBuffers[ fs_writeFill ];
+	if ( b->size && b->file != f ) {
+		FS_QueueWriteBuffer( qfalse );
+		b = &fs_writeBuffers[ fs_writeFill ];
 	}
 
-	buf = NULL;	// quiet compiler warning
-	isConfig = qfalse;
+	for ( remaining = len; remaining > 0; remaining -= block, buf += block ) {
+		if ( b->size == 0 ) {
+			b->file = f;
+			b->startTime = Sys_Milliseconds();
+		}
+		block = MIN( remaining, WRITE_BUFFER_SIZE - b->size );
+		Com_Memcpy( b->data + b->size, buf, block );
+		b->size += block;
+		if ( b->size == WRITE_BUFFER_SIZE ) {
+			FS_QueueWriteBuffer( qfalse );
+			b = &fs_writeBuffers[ fs_writeFill ];
+		}
+	}
 
-	// if this is a .cfg file and we are playing back a journal, read
-	// it from the journal file
-	if ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) {
-		if ( com_journal->integer == 2 ) {
-			int		r;
+	// bounds what a crash can take away from a file
+	if ( b->size && fs_writeFlush->integer && Sys_Milliseconds() - b->startTime >= fs_writeFlush->integer ) {
+		FS_QueueWriteBuffer( fs_writeSync->integer ? qtrue : qfalse );
+	}
 
-			Com_DPrintf( "Loading %s from journal file.\n", qpath );
-			r = FS_Read( &len, sizeof( len ), com_journalDataFile );
-			if ( r != sizeof( len ) ) {
-				if (buffer != NULL) *buffer = NULL;
-				return -1;
-			}
-			// if the file didn't exist when the journal was created
-			if (!len) {
-				if (buffer == NULL) {
-					return 1;			// hack for old journal files
-				}
-				*buffer = NULL;
-				return -1;
-			}
-			if (buffer == NULL) {
-				return len;
-			}
+	return len;
+}
 
-			buf = Hunk_AllocateTempMemory(len+1);
-			*buffer = buf;
 
-			r = FS_Read( buf, len, com_journalDataFile );
-			if ( r != len ) {
-				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
-			}
+/*
+=============
+FS_StopWriter
+
+Files of buffered handles must be closed already
+=============
+*/
+static void FS_StopWriter( void )
+{
+	if ( fs_writer ) {
+		FS_WaitWrites();
+		Sys_LockMutex( fs_writeLock );
+		fs_writeQuit = qtrue;
+		Sys_UnlockMutex( fs_writeLock );
+		Sys_PostSemaphore( fs_writeWake, 1 );
+		Com_JoinThread( fs_writer );
+		fs_writer = NULL;
+	}
 
-			fs_loadCount++;
-			fs_loadStack++;
+	Sys_DestroySemaphore( fs_writeDone );
+	Sys_DestroySemaphore( fs_writeWake );
+	Sys_DestroyMutex( fs_writeLock );
 
-			// guarantee that it will have a trailing 0 for string operations
-			buf[len] = '\0';
+	fs_writeDone = NULL;
+	fs_writeWake = NULL;
+	fs_writeLock = NULL;
+}
 
-			return len;
-		} else if ( com_journal->integer == 1 ) {
-			isConfig = qtrue;
-		}
+
+/*
+=============
+FS_StartWriter
+=============
+*/
+static qboolean FS_StartWriter( void )
+{
+	if ( fs_writer ) {
+		return qtrue;
 	}
 
-	// look for it in the filesystem or pack files
-	len = FS_FOpenFileRead( qpath, &h, qfalse );
-	if ( h == FS_INVALID_HANDLE ) {
-		if ( buffer ) {
-			*buffer = NULL;
-		}
-		// if we are journaling and it is a config file, write a zero to the journal file
-		if ( isConfig ) {
-			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
-			len = 0;
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		return -1;
+	fs_writeLock = Sys_CreateMutex();
+	fs_writeWake = Sys_CreateSemaphore();
+	fs_writeDone = Sys_CreateSemaphore();
+	if ( !fs_writeLock || !fs_writeWake || !fs_writeDone ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create write thread synchronization objects\n" );
+		FS_StopWriter();
+		return qfalse;
 	}
 
-	if ( !buffer ) {
-		if ( isConfig ) {
-			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		FS_FCloseFile( h );
-		return len;
+	fs_writeFill = 0;
+	fs_writeNext = 0;
+	fs_writeQueued = 0;
+	fs_writeLost = 0;
+	fs_writeQuit = qfalse;
+	fs_writeBuffers[ 0 ].size = 0;
+
+	fs_writer = Com_CreateThread( JOB_POOL_IO, "fs writer", FS_WriterThread, NULL );
+	if ( !fs_writer ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create write thread\n" );
+		FS_StopWriter();
+		return qfalse;
 	}
 
-	buf = Hunk_AllocateTempMemory( len + 1 );
-	*buffer = buf;
+	return qtrue;
+}
 
-	FS_Read( buf, len, h );
 
-	fs_loadCount++;
-	fs_loadStack++;
+/*
+=============
+FS_BufferWrites
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[ len ] = '\0';
-	FS_FCloseFile( h );
+Moves further FS_Write calls on a file opened for writing to the
+writer thread, keeps writing synchronously when fs_writeThread is 0.
+Buffers are filled in write order, so interleaving small writes to
+several buffered files queues a partial buffer on every switch
+=============
+*/
+void FS_BufferWrites( fileHandle_t f )
+{
+	fileHandleData_t *fd;
 
-	// if we are journaling and it is a config file, write it to the journal file
-	if ( isConfig ) {
-		Com_DPrintf( "Writing %s to journal file.\n", qpath );
-		FS_Write( &len, sizeof( len ), com_journalDataFile );
-		FS_Write( buf, len, com_journalDataFile );
-		FS_Flush( com_journalDataFile );
+	if ( f <= 0 || f >= MAX_FILE_HANDLES ) {
+		return;
 	}
-	return len;
+
+	fd = &fsh[ f ];
+	if ( fd->zipFile || !fd->handleFiles.file.o || fd->handleSync || fd->writeBehind ) {
+		return;
+	}
+
+	if ( !fs_writeThread->integer || !FS_StartWriter() ) {
+		return;
+	}
+
+	fflush( fd->handleFiles.file.o );
+	fd->writeBehind = qtrue;
 }
+#endif // USE_ASYNC_WRITES
 
 
 /*
@@ -2207,6 +4375,9 @@ void FS_FreeFile( void *buffer ) {
 	}
 	fs_loadStack--;
 
+#ifdef USE_PK3_MAPPING
+	if ( !FS_UnmapFile( buffer ) )
+#endif
 	Hunk_FreeTempMemory( buffer );
 
 	// if all of our temp files are free, clear all of our space
@@ -2861,74 +5032,587 @@ static qboolean FS_SaveCache( void )
 
 	FS_WriteCacheHeader( f );
 
-	while ( sp != NULL )
-	{
-		if ( sp->pack )
-		{
-			FS_SavePackToFile( sp->pack, f );
+	while ( sp != NULL )
+	{
+		if ( sp->pack )
+		{
+			FS_SavePackToFile( sp->pack, f );
+		}
+		sp = sp->next;
+	}
+
+	fclose( f );
+
+	fs_paksReleased = 0;
+	fs_paksSkipped = 0;
+	fs_paksReaded = 0;
+
+	fs_cacheSynced = qtrue;
+
+	return qtrue;
+}
+
+
+/*
+============
+FS_LoadCache
+
+Called at FS_Startup() before loading any pk3 file
+============
+*/
+static void FS_LoadCache( void )
+{
+	const char *filename = CACHE_FILE_NAME;
+	const char *ospath;
+	FILE *f;
+
+	fs_paksReaded = 0;
+	fs_paksReleased = 0;
+
+	if ( fs_cacheLoaded )
+		return;
+
+	fs_paksCached = 0;
+	fs_paksSkipped = 0;
+
+	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
+
+	f = Sys_FOpen( ospath, "rb" );
+	if ( f == NULL )
+		return;
+
+	if ( !FS_ValidateCacheHeader( f ) )
+	{
+		fclose( f );
+		return;
+	}
+
+	while ( FS_LoadPakFromFile( f ) )
+		;
+
+	fclose( f );
+
+	fs_cacheLoaded = qtrue;
+
+	Com_Printf( "...found %i cached paks\n", fs_paksCached );
+}
+
+#endif // USE_PK3_CACHE_FILE
+
+#endif // USE_PK3_CACHE
+
+
+#ifdef USE_PAK_BUNDLES
+/*
+=================================================================================
+
+PAK BUNDLES
+
+A bundle is a regular zip file written by "fs_bundle" that loads faster:
+entry data is page aligned, so that mapped reads are not split across pages,
+and a bundle index stored between the last entry and the central directory
+holds converted file names, their hashes sorted for lookups, central dir
+positions and the pak checksums. The zip global comment announces the index,
+other clients just see a pk3.
+
+=================================================================================
+*/
+
+#define BUNDLE_IDENT	(('I'<<24)+('B'<<16)+('3'<<8)+'Q')	// "Q3BI"
+#define BUNDLE_VERSION	1
+#define BUNDLE_ALIGN	4096	// data alignment of entries not smaller than that
+#define BUNDLE_STORE_RATIO	0.9f	// deflated entries that shrink less are stored
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			numFiles;
+	int			numChecksums;		// crc of every non-empty entry, in central dir order
+	int			namesSize;
+	int			checksum;			// regular pak checksum
+} bundleHeader_t;
+
+typedef struct {
+	unsigned int	hash;			// FS_HashFileName( name, 0 )
+	unsigned int	pos;			// file info position in zip
+	unsigned int	size;			// file size
+	unsigned int	name;			// offset in names
+} bundleEntry_t;
+
+// header, int checksums[numChecksums], bundleEntry_t entries[numFiles], names[namesSize]
+
+
+/*
+=================
+FS_CheckBundle
+
+Validates the bundle index read along with a central directory,
+returns the header or NULL if the pak must be loaded as a plain zip
+=================
+*/
+static const bundleHeader_t *FS_CheckBundle( const unz_central_dir *dir )
+{
+	const bundleHeader_t *header;
+	const bundleEntry_t *entry;
+	const char *names;
+	unsigned int numFiles, numChecksums, namesSize, i, pos;
+
+	if ( dir->bundle == NULL || dir->bundle_size < sizeof( *header ) )
+		return NULL;
+
+	header = (const bundleHeader_t *)dir->bundle;
+	if ( LittleLong( header->ident ) != BUNDLE_IDENT || LittleLong( header->version ) != BUNDLE_VERSION )
+		return NULL;
+
+	numFiles = LittleLong( header->numFiles );
+	numChecksums = LittleLong( header->numChecksums );
+	namesSize = LittleLong( header->namesSize );
+
+	if ( numFiles == 0 || numFiles > dir->number_entry || numChecksums > numFiles || namesSize == 0 )
+		return NULL;
+
+	if ( sizeof( *header ) + numChecksums * sizeof( int ) + numFiles * sizeof( *entry ) + namesSize > dir->bundle_size )
+		return NULL;
+
+	entry = (const bundleEntry_t *)( (const int *)( header + 1 ) + numChecksums );
+	names = (const char *)( entry + numFiles );
+	if ( names[ namesSize - 1 ] != '\0' )
+		return NULL;
+
+	for ( i = 0; i < numFiles; i++, entry++ ) {
+		pos = LittleLong( entry->pos );
+		if ( LittleLong( entry->name ) >= namesSize || pos < dir->offset || pos >= dir->offset + dir->size )
+			return NULL;
+	}
+
+	return header;
+}
+
+
+static void FS_BundlePut16( byte *p, int v ) {
+	p[0] = v & 255; p[1] = ( v >> 8 ) & 255;
+}
+
+
+static void FS_BundlePut32( byte *p, unsigned int v ) {
+	p[0] = v & 255; p[1] = ( v >> 8 ) & 255; p[2] = ( v >> 16 ) & 255; p[3] = v >> 24;
+}
+
+
+typedef struct {
+	char			*name;			// as stored in the source zip
+	unsigned long	pos;			// file info position in the source zip
+	unsigned long	method;
+	unsigned long	dosDate;
+	unsigned long	crc;
+	unsigned long	compressedSize;
+	unsigned long	uncompressedSize;
+	unsigned long	localOffset;
+} bundleFile_t;
+
+
+static int QDECL FS_BundleEntryCompare( const void *a, const void *b )
+{
+	const bundleEntry_t *ea = (const bundleEntry_t *)a;
+	const bundleEntry_t *eb = (const bundleEntry_t *)b;
+
+	if ( ea->hash != eb->hash )
+		return ea->hash < eb->hash ? -1 : 1;
+	return ea->pos < eb->pos ? -1 : ( ea->pos > eb->pos );
+}
+
+
+/*
+=================
+FS_WriteBundleEntry
+
+Copies one entry of an open zip to the bundle at an aligned offset,
+the compressed data is copied as is unless the entry is to be stored
+=================
+*/
+static qboolean FS_WriteBundleEntry( unzFile zip, bundleFile_t *file, qboolean store, fileHandle_t out, unsigned long *offset )
+{
+	const unz_s *zfi = (const unz_s *)zip;
+	byte header[ 30 + 4 ];
+	unsigned long dataOffset, nameLen, extraLen;
+	byte *data;
+	qboolean ok;
+
+	if ( unzSetCurrentFileInfoPosition( zip, file->pos ) != UNZ_OK || unzOpenCurrentFile( zip ) != UNZ_OK )
+		return qfalse;
+
+	if ( file->uncompressedSize == 0 ) {
+		// directories and empty files
+		file->method = 0;
+		file->compressedSize = 0;
+		store = qfalse;
+	} else if ( file->method == 0 ) {
+		store = qfalse;
+	} else if ( file->compressedSize >= file->uncompressedSize * BUNDLE_STORE_RATIO ) {
+		store = qtrue;
+	}
+
+	data = Hunk_AllocateTempMemory( ( store ? file->uncompressedSize : file->compressedSize ) + 1 );
+	if ( store ) {
+		ok = ( unzReadCurrentFile( zip, data, file->uncompressedSize ) == (int)file->uncompressedSize );
+		file->method = 0;
+		file->compressedSize = file->uncompressedSize;
+	} else {
+		ok = ( fseek( zfi->file, zfi->pfile_in_zip_read->pos_in_zipfile + zfi->pfile_in_zip_read->byte_before_the_zipfile, SEEK_SET ) == 0 &&
+			( file->compressedSize == 0 || fread( data, file->compressedSize, 1, zfi->file ) == 1 ) );
+	}
+	unzCloseCurrentFile( zip );
+
+	if ( !ok ) {
+		Hunk_FreeTempMemory( data );
+		return qfalse;
+	}
+
+	// pad the local extra field so that data starts at an aligned offset,
+	// an empty extra field record needs at least 4 bytes
+	nameLen = strlen( file->name );
+	dataOffset = *offset + 30 + nameLen;
+	extraLen = 0;
+	if ( file->compressedSize >= BUNDLE_ALIGN && ( dataOffset & ( BUNDLE_ALIGN - 1 ) ) ) {
+		extraLen = PAD( dataOffset + 4, BUNDLE_ALIGN ) - dataOffset;
+	}
+
+	file->localOffset = *offset;
+
+	FS_BundlePut32( header + 0, 0x04034b50 );
+	FS_BundlePut16( header + 4, 20 );
+	FS_BundlePut16( header + 6, 0 );
+	FS_BundlePut16( header + 8, file->method );
+	FS_BundlePut32( header + 10, file->dosDate );
+	FS_BundlePut32( header + 14, file->crc );
+	FS_BundlePut32( header + 18, file->compressedSize );
+	FS_BundlePut32( header + 22, file->uncompressedSize );
+	FS_BundlePut16( header + 26, nameLen );
+	FS_BundlePut16( header + 28, extraLen );
+	FS_Write( header, 30, out );
+	FS_Write( file->name, nameLen, out );
+	if ( extraLen ) {
+		byte pad[ BUNDLE_ALIGN ];
+		Com_Memset( pad, 0, extraLen );
+		FS_BundlePut16( pad + 0, 0xD935 ); // alignment padding, as used by zipalign
+		FS_BundlePut16( pad + 2, extraLen - 4 );
+		FS_Write( pad, extraLen, out );
+	}
+	FS_Write( data, file->compressedSize, out );
+
+	*offset += 30 + nameLen + extraLen + file->compressedSize;
+
+	Hunk_FreeTempMemory( data );
+	return qtrue;
+}
+
+
+/*
+=================
+FS_Bundle_f
+
+Converts a loaded pk3 to a bundle in <fs_homepath>/bundles/<game>/,
+with identical file names, contents and checksums
+=================
+*/
+static void FS_Bundle_f( void )
+{
+	const searchpath_t *search;
+	const pack_t	*pak;
+	unz_central_dir	dir;
+	unz_file_info	info;
+	char			filename[ MAX_ZPATH ];
+	char			outname[ MAX_OSPATH ];
+	bundleFile_t	*files;
+	bundleHeader_t	*header;
+	bundleEntry_t	*entries;
+	int				*checksums;
+	char			*names, *nameBuf;
+	unsigned long	pos, offset, cdOffset, cdSize, indexSize, namesSize, nameBufSize;
+	unsigned long	i, numFiles, numChecksums;
+	byte			record[ 46 ];
+	unzFile			zip;
+	fileHandle_t	out;
+	qboolean		store, ok;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "Usage: fs_bundle <game/pak> [store]\n" );
+		return;
+	}
+
+	store = ( Cmd_Argc() > 2 && !Q_stricmp( Cmd_Argv( 2 ), "store" ) ) ? qtrue : qfalse;
+
+	pak = NULL;
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( search->pack && !Q_stricmp( Cmd_Argv( 1 ), va( "%s/%s", search->pack->pakGamename, search->pack->pakBasename ) ) ) {
+			pak = search->pack;
+			break;
+		}
+	}
+
+	if ( pak == NULL ) {
+		Com_Printf( "pak %s is not loaded\n", Cmd_Argv( 1 ) );
+		return;
+	}
+
+	if ( unzReadCentralDir( pak->pakFilename, &dir ) != UNZ_OK ) {
+		Com_Printf( S_COLOR_YELLOW "Error reading %s\n", pak->pakFilename );
+		return;
+	}
+
+	zip = unzOpen( pak->pakFilename );
+	if ( zip == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "Error opening %s\n", pak->pakFilename );
+		unzFreeCentralDir( &dir );
+		return;
+	}
+
+	// collect supported entries, in central dir order to keep the checksums
+	files = Z_Malloc( dir.number_entry * sizeof( files[0] ) + 1 );
+	entries = Z_Malloc( dir.number_entry * sizeof( entries[0] ) + 1 );
+	nameBufSize = dir.size + 1; // names can't be larger than the central dir
+	nameBuf = Z_Malloc( nameBufSize * 2 );
+	names = nameBuf + nameBufSize;
+	numFiles = 0;
+	namesSize = 0;
+	pos = dir.offset;
+	for ( i = 0; i < dir.number_entry; i++ ) {
+		files[ numFiles ].pos = pos;
+		if ( unzGetCentralDirEntry( &dir, &pos, &info, filename, sizeof( filename ) ) != UNZ_OK )
+			break;
+		filename[ sizeof( filename ) - 1 ] = '\0';
+		if ( info.compression_method != 0 && info.compression_method != 8 /*Z_DEFLATED*/ ) {
+			Com_Printf( S_COLOR_YELLOW "%s: skipping %s with unsupported compression method %i\n", pak->pakBasename, filename, (int)info.compression_method );
+			continue;
+		}
+		files[ numFiles ].name = nameBuf + namesSize;
+		strcpy( files[ numFiles ].name, filename );
+		files[ numFiles ].method = info.compression_method;
+		files[ numFiles ].dosDate = info.dosDate;
+		files[ numFiles ].crc = info.crc;
+		files[ numFiles ].compressedSize = info.compressed_size;
+		files[ numFiles ].uncompressedSize = info.uncompressed_size;
+		namesSize += strlen( filename ) + 1;
+		numFiles++;
+	}
+
+	Com_sprintf( outname, sizeof( outname ), "bundles/%s/%s.pk3", pak->pakGamename, pak->pakBasename );
+	out = ( numFiles > 0 ) ? FS_SV_FOpenFileWrite( outname ) : FS_INVALID_HANDLE;
+	if ( out == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write %s\n", outname );
+		Z_Free( nameBuf );
+		Z_Free( entries );
+		Z_Free( files );
+		unzClose( zip );
+		unzFreeCentralDir( &dir );
+		return;
+	}
+
+	// entry data
+	ok = qtrue;
+	offset = 0;
+	for ( i = 0; i < numFiles && ok; i++ ) {
+		ok = FS_WriteBundleEntry( zip, &files[ i ], store, out, &offset );
+	}
+
+	unzClose( zip );
+	unzFreeCentralDir( &dir );
+
+	if ( ok ) {
+		// bundle index, entries refer to file info positions of the new central dir
+		Com_Memset( record, 0, sizeof( record ) );
+		FS_Write( record, PAD( offset, sizeof( int ) ) - offset, out );
+		offset = PAD( offset, sizeof( int ) );
+
+		numChecksums = 0;
+		for ( i = 0; i < numFiles; i++ ) {
+			if ( files[ i ].uncompressedSize > 0 ) {
+				numChecksums++;
+			}
+		}
+
+		indexSize = sizeof( *header ) + numChecksums * sizeof( int ) + numFiles * sizeof( entries[0] ) + PAD( namesSize, sizeof( int ) );
+		header = Z_Malloc( indexSize );
+		checksums = (int *)( header + 1 );
+		cdOffset = offset + indexSize;
+
+		numChecksums = 0;
+		pos = cdOffset;
+		namesSize = 0;
+		for ( i = 0; i < numFiles; i++ ) {
+			if ( files[ i ].uncompressedSize > 0 ) {
+				checksums[ numChecksums++ ] = LittleLong( files[ i ].crc );
+			}
+			strcpy( names + namesSize, files[ i ].name );
+			FS_ConvertFilename( names + namesSize );
+			entries[ i ].hash = FS_HashFileName( names + namesSize, 0U );
+			entries[ i ].pos = pos;
+			entries[ i ].size = files[ i ].uncompressedSize;
+			entries[ i ].name = namesSize;
+			namesSize += strlen( files[ i ].name ) + 1;
+			pos += sizeof( record ) + strlen( files[ i ].name );
+		}
+		cdSize = pos - cdOffset;
+
+		qsort( entries, numFiles, sizeof( entries[0] ), FS_BundleEntryCompare );
+
+		header->ident = LittleLong( BUNDLE_IDENT );
+		header->version = LittleLong( BUNDLE_VERSION );
+		header->numFiles = LittleLong( numFiles );
+		header->numChecksums = LittleLong( numChecksums );
+		header->namesSize = LittleLong( PAD( namesSize, sizeof( int ) ) );
+		header->checksum = LittleLong( Com_BlockChecksum( checksums, numChecksums * sizeof( int ) ) );
+
+		for ( i = 0; i < numFiles; i++ ) {
+			entries[ i ].hash = LittleLong( entries[ i ].hash );
+			entries[ i ].pos = LittleLong( entries[ i ].pos );
+			entries[ i ].size = LittleLong( entries[ i ].size );
+			entries[ i ].name = LittleLong( entries[ i ].name );
+		}
+		Com_Memcpy( checksums + numChecksums, entries, numFiles * sizeof( entries[0] ) );
+		Com_Memcpy( (bundleEntry_t *)( checksums + numChecksums ) + numFiles, names, namesSize );
+		FS_Write( header, indexSize, out );
+		Z_Free( header );
+
+		// central directory
+		for ( i = 0; i < numFiles; i++ ) {
+			Com_Memset( record, 0, sizeof( record ) );
+			FS_BundlePut32( record + 0, 0x02014b50 );
+			FS_BundlePut16( record + 4, 20 );
+			FS_BundlePut16( record + 6, 20 );
+			FS_BundlePut16( record + 10, files[ i ].method );
+			FS_BundlePut32( record + 12, files[ i ].dosDate );
+			FS_BundlePut32( record + 16, files[ i ].crc );
+			FS_BundlePut32( record + 20, files[ i ].compressedSize );
+			FS_BundlePut32( record + 24, files[ i ].uncompressedSize );
+			FS_BundlePut16( record + 28, strlen( files[ i ].name ) );
+			FS_BundlePut32( record + 42, files[ i ].localOffset );
+			FS_Write( record, sizeof( record ), out );
+			FS_Write( files[ i ].name, strlen( files[ i ].name ), out );
 		}
-		sp = sp->next;
-	}
 
-	fclose( f );
+		// end of central directory, with the bundle tag as global comment
+		Com_Memset( record, 0, sizeof( record ) );
+		FS_BundlePut32( record + 0, 0x06054b50 );
+		FS_BundlePut16( record + 8, numFiles );
+		FS_BundlePut16( record + 10, numFiles );
+		FS_BundlePut32( record + 12, cdSize );
+		FS_BundlePut32( record + 16, cdOffset );
+		FS_BundlePut16( record + 20, UNZ_BUNDLE_TAG_SIZE + 4 );
+		Com_Memcpy( record + 22, UNZ_BUNDLE_TAG, UNZ_BUNDLE_TAG_SIZE );
+		FS_BundlePut32( record + 22 + UNZ_BUNDLE_TAG_SIZE, indexSize );
+		FS_Write( record, 22 + UNZ_BUNDLE_TAG_SIZE + 4, out );
+	}
 
-	fs_paksReleased = 0;
-	fs_paksSkipped = 0;
-	fs_paksReaded = 0;
+	FS_FCloseFile( out );
 
-	fs_cacheSynced = qtrue;
+	if ( ok ) {
+		Com_Printf( "Wrote %s with %i files\n", outname, (int)numFiles );
+	} else {
+		Com_Printf( S_COLOR_YELLOW "Error reading %s, %s is incomplete\n", pak->pakFilename, outname );
+	}
 
-	return qtrue;
+	Z_Free( nameBuf );
+	Z_Free( entries );
+	Z_Free( files );
 }
+#endif // USE_PAK_BUNDLES
+
+
+typedef struct pakScan_s {
+	char			*zipfile;
+	unz_central_dir	dir;
+#ifdef USE_PAK_BUNDLES
+	const bundleHeader_t *bundle;		// points into dir
+#endif
+	int				*headerLongs;		// malloc'ed, first is the checksum feed
+	int				numHeaderLongs;
+	int				checksum;
+	int				pure_checksum;
+	int				err;
+} pakScan_t;
 
 
 /*
-============
-FS_LoadCache
+=================
+FS_ScanZipFile
 
-Called at FS_Startup() before loading any pk3 file
-============
+Reads the central directory of a pk3 and computes its checksums,
+uses no filesystem state or engine memory so it can run on I/O threads
+=================
 */
-static void FS_LoadCache( void )
+static void FS_ScanZipFile( pakScan_t *scan )
 {
-	const char *filename = CACHE_FILE_NAME;
-	const char *ospath;
-	FILE *f;
-
-	fs_paksReaded = 0;
-	fs_paksReleased = 0;
+	unz_file_info	file_info;
+	unsigned long	pos, i;
 
-	if ( fs_cacheLoaded )
+	scan->err = unzReadCentralDir( scan->zipfile, &scan->dir );
+	if ( scan->err != UNZ_OK ) {
 		return;
+	}
 
-	fs_paksCached = 0;
-	fs_paksSkipped = 0;
-
-	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
-
-	f = Sys_FOpen( ospath, "rb" );
-	if ( f == NULL )
+#ifdef USE_PAK_BUNDLES
+	scan->bundle = FS_CheckBundle( &scan->dir );
+	if ( scan->bundle ) {
+		// checksummed crcs are stored in the index
+		const int *crcs = (const int *)( scan->bundle + 1 );
+		scan->numHeaderLongs = LittleLong( scan->bundle->numChecksums ) + 1;
+		scan->headerLongs = malloc( scan->numHeaderLongs * sizeof( scan->headerLongs[0] ) );
+		if ( scan->headerLongs == NULL ) {
+			scan->err = UNZ_INTERNALERROR;
+			return;
+		}
+		scan->headerLongs[ 0 ] = LittleLong( fs_checksumFeed );
+		memcpy( scan->headerLongs + 1, crcs, ( scan->numHeaderLongs - 1 ) * sizeof( scan->headerLongs[0] ) );
+		scan->checksum = scan->bundle->checksum; // already little endian, like the computed one
+		scan->pure_checksum = Com_BlockChecksum( scan->headerLongs, sizeof( scan->headerLongs[0] ) * scan->numHeaderLongs );
+		scan->pure_checksum = LittleLong( scan->pure_checksum );
 		return;
+	}
+#endif
 
-	if ( !FS_ValidateCacheHeader( f ) )
-	{
-		fclose( f );
+	scan->headerLongs = malloc( ( scan->dir.number_entry + 1 ) * sizeof( scan->headerLongs[0] ) );
+	if ( scan->headerLongs == NULL ) {
+		scan->err = UNZ_INTERNALERROR;
 		return;
 	}
 
-	while ( FS_LoadPakFromFile( f ) )
-		;
+	scan->numHeaderLongs = 0;
+	scan->headerLongs[ scan->numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
 
-	fclose( f );
+	pos = scan->dir.offset;
+	for ( i = 0; i < scan->dir.number_entry; i++ )
+	{
+		if ( unzGetCentralDirEntry( &scan->dir, &pos, &file_info, NULL, 0 ) != UNZ_OK ) {
+			break;
+		}
+		if ( file_info.compression_method != 0 && file_info.compression_method != 8 /*Z_DEFLATED*/ ) {
+			continue;
+		}
+		if ( file_info.uncompressed_size > 0 ) {
+			scan->headerLongs[ scan->numHeaderLongs++ ] = LittleLong( file_info.crc );
+		}
+	}
 
-	fs_cacheLoaded = qtrue;
+	scan->checksum = Com_BlockChecksum( scan->headerLongs + 1, sizeof( scan->headerLongs[0] ) * ( scan->numHeaderLongs - 1 ) );
+	scan->checksum = LittleLong( scan->checksum );
 
-	Com_Printf( "...found %i cached paks\n", fs_paksCached );
+	scan->pure_checksum = Com_BlockChecksum( scan->headerLongs, sizeof( scan->headerLongs[0] ) * scan->numHeaderLongs );
+	scan->pure_checksum = LittleLong( scan->pure_checksum );
 }
 
-#endif // USE_PK3_CACHE_FILE
 
-#endif // USE_PK3_CACHE
+/*
+=================
+FS_FreeZipScan
+=================
+*/
+static void FS_FreeZipScan( pakScan_t *scan )
+{
+	unzFreeCentralDir( &scan->dir );
+	free( scan->headerLongs );
+	scan->headerLongs = NULL;
+}
 
 
 /*
@@ -2936,45 +5620,54 @@ static void FS_LoadCache( void )
 FS_LoadZipFile
 
 Creates a new pak_t in the search chain for the contents
-of a zip file.
+of a zip file. Scan may come from FS_ScanZipFile done in
+advance, otherwise the zip file is scanned here.
 =================
 */
-static pack_t *FS_LoadZipFile( const char *zipfile )
+static pack_t *FS_LoadZipFile( const char *zipfile, pakScan_t *scan )
 {
 	fileInPack_t	*curFile;
 	pack_t			*pack;
-	unzFile			uf;
-	int				err;
-	unz_global_info gi;
+	pakScan_t		localScan;
 	char			filename_inzip[MAX_ZPATH];
 	unz_file_info	file_info;
+	unsigned long	pos;
 	unsigned int	i, namelen, hashSize, size;
 	long			hash;
-	int				fs_numHeaderLongs;
-	int				*fs_headerLongs;
 	int				filecount;
 	char			*namePtr;
 	const char		*basename;
 	int				fileNameLen;
 	int				baseNameLen;
 
+	if ( scan == NULL ) {
 #ifdef USE_PK3_CACHE
-	pack = FS_LoadCachedPK3( zipfile );
-	if ( pack )
-	{
-		// update pure checksum
-		if ( pack->checksumFeed != fs_checksumFeed )
+		pack = FS_LoadCachedPK3( zipfile );
+		if ( pack )
 		{
-			pack->headerLongs[ 0 ] = LittleLong( fs_checksumFeed );
-			pack->pure_checksum = Com_BlockChecksum( pack->headerLongs, sizeof( pack->headerLongs[0] ) * pack->numHeaderLongs );
-			pack->pure_checksum = LittleLong( pack->pure_checksum );
-			pack->checksumFeed = fs_checksumFeed;
+			// update pure checksum
+			if ( pack->checksumFeed != fs_checksumFeed )
+			{
+				pack->headerLongs[ 0 ] = LittleLong( fs_checksumFeed );
+				pack->pure_checksum = Com_BlockChecksum( pack->headerLongs, sizeof( pack->headerLongs[0] ) * pack->numHeaderLongs );
+				pack->pure_checksum = LittleLong( pack->pure_checksum );
+				pack->checksumFeed = fs_checksumFeed;
+			}
+
+			pack->touched = qtrue;
+			return pack; // loaded from cache
 		}
+#endif
+		Com_Memset( &localScan, 0, sizeof( localScan ) );
+		localScan.zipfile = (char *)zipfile;
+		FS_ScanZipFile( &localScan );
+		scan = &localScan;
+	}
 
-		pack->touched = qtrue;
-		return pack; // loaded from cache
+	pack = NULL;
+	if ( scan->err != UNZ_OK ) {
+		goto done;
 	}
-#endif
 
 	// extract basename from zip path
 	basename = strrchr( zipfile, PATH_SEP );
@@ -2987,36 +5680,30 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 	fileNameLen = (int) strlen( zipfile ) + 1;
 	baseNameLen = (int) strlen( basename ) + 1;
 
-	uf = unzOpen( zipfile );
-	err = unzGetGlobalInfo( uf, &gi );
-
-	if ( err != UNZ_OK ) {
-		return NULL;
-	}
-
 	namelen = 0;
 	filecount = 0;
-	unzGoToFirstFile( uf );
-	for (i = 0; i < gi.number_entry; i++)
+#ifdef USE_PAK_BUNDLES
+	if ( scan->bundle ) {
+		namelen = LittleLong( scan->bundle->namesSize );
+		filecount = LittleLong( scan->bundle->numFiles );
+	} else
+#endif
+	for ( pos = scan->dir.offset, i = 0; i < scan->dir.number_entry; i++ )
 	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		filename_inzip[sizeof(filename_inzip)-1] = '\0';
-		if (err != UNZ_OK) {
+		if ( unzGetCentralDirEntry( &scan->dir, &pos, &file_info, filename_inzip, sizeof( filename_inzip ) ) != UNZ_OK ) {
 			break;
 		}
+		filename_inzip[sizeof(filename_inzip)-1] = '\0';
 		if ( file_info.compression_method != 0 && file_info.compression_method != 8 /*Z_DEFLATED*/ ) {
 			Com_Printf( S_COLOR_YELLOW "%s|%s: unsupported compression method %i\n", basename, filename_inzip, (int)file_info.compression_method );
-			unzGoToNextFile( uf );
 			continue;
-		} 
+		}
 		namelen += strlen( filename_inzip ) + 1;
-		unzGoToNextFile( uf );
 		filecount++;
 	}
 
 	if ( filecount == 0 ) {
-		unzClose( uf );
-		return NULL;
+		goto done;
 	}
 
 	// get the hash table size from the number of files in the zip
@@ -3028,12 +5715,11 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 	size += PAD( fileNameLen, sizeof( int ) );
 	size += PAD( baseNameLen, sizeof( int ) );
 #ifdef USE_PK3_CACHE
-	size += ( filecount + 1 ) * sizeof( fs_headerLongs[0] );
+	size += scan->numHeaderLongs * sizeof( scan->headerLongs[0] );
 #endif
 	pack = Z_TagMalloc( size, TAG_PACK );
 	Com_Memset( pack, 0, size );
 
-	pack->handle = uf;
 	pack->numfiles = filecount;
 	pack->hashSize = hashSize;
 	pack->hashTable = (fileInPack_t **)( pack + 1 );
@@ -3044,42 +5730,49 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 	pack->pakFilename = (char*)( namePtr + namelen );
 	pack->pakBasename = (char*)( pack->pakFilename + PAD( fileNameLen, sizeof( int ) ) );
 
-#ifdef USE_PK3_CACHE
-	fs_headerLongs = (int*)( pack->pakBasename + PAD( baseNameLen, sizeof( int ) ) );
-#else
-	fs_headerLongs = Z_Malloc( ( filecount + 1 ) * sizeof( fs_headerLongs[0] ) );
-#endif
-
-	fs_numHeaderLongs = 0;
-	fs_headerLongs[ fs_numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
-
 	Com_Memcpy( pack->pakFilename, zipfile, fileNameLen );
 	Com_Memcpy( pack->pakBasename, basename, baseNameLen );
 
 	// strip .pk3 if needed
 	FS_StripExt( pack->pakBasename, ".pk3" );
 
-	unzGoToFirstFile( uf );
 	curFile = pack->buildBuffer;
-	for ( i = 0; i < gi.number_entry; i++ )
+#ifdef USE_PAK_BUNDLES
+	if ( scan->bundle ) {
+		// names are already converted, with precomputed hashes
+		const bundleEntry_t *entry = (const bundleEntry_t *)( (const int *)( scan->bundle + 1 ) + scan->numHeaderLongs - 1 );
+		const char *names = (const char *)( entry + filecount );
+		Com_Memcpy( namePtr, names, namelen );
+		for ( i = 0; i < filecount; i++, entry++ )
+		{
+			curFile->name = namePtr + LittleLong( entry->name );
+			if ( FS_BannedPakFile( curFile->name ) ) {
+				pack->numfiles--;
+				continue;
+			}
+			curFile->pos = LittleLong( entry->pos );
+			curFile->size = LittleLong( entry->size );
+			hash = LittleLong( entry->hash ) & ( pack->hashSize - 1 );
+			curFile->next = pack->hashTable[ hash ];
+			pack->hashTable[ hash ] = curFile;
+			curFile++;
+		}
+	} else
+#endif
+	for ( pos = scan->dir.offset, i = 0; i < scan->dir.number_entry; i++ )
 	{
-		err = unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0 );
-		filename_inzip[sizeof(filename_inzip)-1] = '\0';
-		if (err != UNZ_OK) {
+		// store the file position in the zip
+		curFile->pos = pos;
+		if ( unzGetCentralDirEntry( &scan->dir, &pos, &file_info, filename_inzip, sizeof( filename_inzip ) ) != UNZ_OK ) {
 			break;
 		}
+		filename_inzip[sizeof(filename_inzip)-1] = '\0';
 		if ( file_info.compression_method != 0 && file_info.compression_method != 8 /*Z_DEFLATED*/ ) {
-			unzGoToNextFile( uf );
 			continue;
-		} 
-		if ( file_info.uncompressed_size > 0 ) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong( file_info.crc );
 		}
 
 		FS_ConvertFilename( filename_inzip );
 		if ( !FS_BannedPakFile( filename_inzip ) ) {
-			// store the file position in the zip
-			unzGetCurrentFileInfoPosition( uf, &curFile->pos );
 			curFile->size = file_info.uncompressed_size;
 			curFile->name = namePtr;
 			strcpy( curFile->name, filename_inzip );
@@ -3093,31 +5786,23 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 		} else {
 			pack->numfiles--;
 		}
-
-		unzGoToNextFile( uf );
 	}
 
-	pack->checksum = Com_BlockChecksum( fs_headerLongs + 1, sizeof( fs_headerLongs[0] ) * ( fs_numHeaderLongs - 1 ) );
-	pack->checksum = LittleLong( pack->checksum );
-
-	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, sizeof( fs_headerLongs[0] ) * fs_numHeaderLongs );
-	pack->pure_checksum = LittleLong( pack->pure_checksum );
+	pack->checksum = scan->checksum;
+	pack->pure_checksum = scan->pure_checksum;
 
 #ifdef USE_PK3_CACHE
-	pack->headerLongs = fs_headerLongs;
-	pack->numHeaderLongs = fs_numHeaderLongs;
+	pack->headerLongs = (int*)( pack->pakBasename + PAD( baseNameLen, sizeof( int ) ) );
+	pack->numHeaderLongs = scan->numHeaderLongs;
 	pack->checksumFeed = fs_checksumFeed;
-#else
-	Z_Free( fs_headerLongs );
+	Com_Memcpy( pack->headerLongs, scan->headerLongs, scan->numHeaderLongs * sizeof( pack->headerLongs[0] ) );
 #endif
 
-#ifdef USE_HANDLE_CACHE
-	FS_AddToHandleList( pack );
-#else
-	if ( fs_locked->integer == 0 )
+	// pak handle is opened on first access
+#ifndef USE_HANDLE_CACHE
+	if ( fs_locked->integer )
 	{
-		unzClose( pack->handle );
-		pack->handle = NULL;
+		pack->handle = unzOpen( zipfile );
 	}
 #endif
 
@@ -3128,6 +5813,11 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 #endif
 #endif
 
+done:
+	if ( scan == &localScan ) {
+		FS_FreeZipScan( scan );
+	}
+
 	return pack;
 }
 
@@ -3167,7 +5857,7 @@ qboolean FS_CompareZipChecksum(const char *zipfile)
 	pack_t *thepak;
 	int index, checksum;
 	
-	thepak = FS_LoadZipFile( zipfile );
+	thepak = FS_LoadZipFile( zipfile, NULL );
 	
 	if ( !thepak )
 		return qfalse;
@@ -3197,7 +5887,7 @@ int FS_GetZipChecksum( const char *zipfile )
 	pack_t *pak;
 	int checksum;
 	
-	pak = FS_LoadZipFile( zipfile );
+	pak = FS_LoadZipFile( zipfile, NULL );
 	
 	if ( !pak )
 		return 0xFFFFFFFF;
@@ -3437,7 +6127,11 @@ static char **FS_ListFilteredFiles( const char *path, const char *extension, con
 			const char *name;
 
 			netpath = FS_BuildOSPath( search->dir->path, search->dir->gamedir, path );
-			sysFiles = Sys_ListFiles( netpath, extension, filter, &numSysFiles, qfalse );
+			if ( filter ) {
+				sysFiles = Sys_ListFiles( netpath, extension, filter, &numSysFiles, qfalse );
+			} else {
+				sysFiles = FS_ListDirectory( netpath, extension, &numSysFiles, qfalse );
+			}
 			for ( i = 0 ; i < numSysFiles ; i++ ) {
 				// unique the match
 				name = sysFiles[ i ];
@@ -3695,7 +6389,7 @@ static int FS_GetModList( char *listbuf, int bufsize ) {
 	for (i = 0; i < ARRAY_LEN( paths ); i++) {
 		if ( !*paths[ i ] || !(*paths[i])->string[0] )
 			continue;
-		pFiles0 = Sys_ListFiles( (*paths[i])->string, NULL, NULL, &dummy, qtrue );
+		pFiles0 = FS_ListDirectory( (*paths[i])->string, NULL, &dummy, qtrue );
 		// Sys_ConcatenateFileLists frees the lists so Sys_FreeFileList isn't required
 		pFiles = Sys_ConcatenateFileLists( pFiles, pFiles0 );
 	}
@@ -3736,8 +6430,8 @@ static int FS_GetModList( char *listbuf, int bufsize ) {
 			path = FS_BuildOSPath( (*paths[j])->string, name, NULL );
 
 			nPaks = nDirs = nPakDirs = 0;
-			pPaks = Sys_ListFiles( path, ".pk3", NULL, &nPaks, qfalse );
-			pDirs = Sys_ListFiles( path, "/", NULL, &nDirs, qfalse );
+			pPaks = FS_ListDirectory( path, ".pk3", &nPaks, qfalse );
+			pDirs = FS_ListDirectory( path, "/", &nDirs, qfalse );
 			for ( k = 0; k < nDirs; k++ ) {
 				// we only want to count directories ending with ".pk3dir"
 				if ( FS_IsExt( pDirs[k], ".pk3dir", strlen( pDirs[k] ) ) ) {
@@ -3963,6 +6657,15 @@ static void FS_Path_f( void ) {
 		}
 	}
 
+#ifdef USE_MISS_CACHE
+	Com_Printf( "\n%i missing files cached, %i lookups skipped, %i cache resets\n",
+		fs_numMissedFiles, fs_missHits, fs_missClears );
+#endif
+#ifdef USE_DIR_CACHE
+	Com_Printf( "%i directory listings reused, %i read from disk\n",
+		fs_dirCacheHits, fs_dirCacheMisses );
+#endif
+
 	Com_Printf( "\n" );
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
 		if ( fsh[i].handleFiles.file.o ) {
@@ -4085,6 +6788,21 @@ static void FS_Which_f( void ) {
 
 //===========================================================================
 
+/*
+================
+FS_ScanZipJob
+================
+*/
+static void FS_ScanZipJob( void *data, int index )
+{
+	pakScan_t *scan = (pakScan_t *)data + index;
+
+	if ( scan->zipfile ) {
+		FS_ScanZipFile( scan );
+	}
+}
+
+
 /*
 ================
 FS_AddGameDirectory
@@ -4110,6 +6828,8 @@ static void FS_AddGameDirectory( const char *path, const char *dir ) {
 	int				pakwhich;
 	int				path_len;
 	int				dir_len;
+	pakScan_t		*scans;
+	int				i;
 
 	for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
 		if ( sp->dir && !Q_stricmp( sp->dir->path, path ) && !Q_stricmp( sp->dir->gamedir, dir )) {
@@ -4146,11 +6866,37 @@ static void FS_AddGameDirectory( const char *path, const char *dir ) {
 	Q_strncpyz( curpath, FS_BuildOSPath( path, dir, NULL ), sizeof( curpath ) );
 
 	// Get .pk3 files
-	pakfiles = Sys_ListFiles(curpath, ".pk3", NULL, &numfiles, qfalse);
+	pakfiles = FS_ListDirectory( curpath, ".pk3", &numfiles, qfalse );
 
 	if ( numfiles >= 2 )
 		FS_SortFileList( pakfiles, numfiles - 1 );
 
+	// read headers of paks missing from cache in parallel,
+	// they are still added to the search path in sorted order below
+	scans = NULL;
+	if ( numfiles ) {
+		scans = Z_Malloc( numfiles * sizeof( scans[0] ) );
+		for ( i = 0; i < numfiles; i++ ) {
+			if ( !FS_IsExt( pakfiles[i], ".pk3", strlen( pakfiles[i] ) ) ) {
+				continue;
+			}
+			pakfile = FS_BuildOSPath( path, dir, pakfiles[i] );
+#ifdef USE_PK3_CACHE
+			if ( FS_LoadCachedPK3( pakfile ) ) {
+				continue;
+			}
+#endif
+			scans[i].zipfile = FS_CopyString( pakfile );
+		}
+#ifdef USE_ASYNC_READS
+		FS_IOParallelFor( FS_ScanZipJob, scans, numfiles );
+#else
+		for ( i = 0; i < numfiles; i++ ) {
+			FS_ScanZipJob( scans, i );
+		}
+#endif
+	}
+
 	pakfilesi = 0;
 	pakdirsi = 0;
 
@@ -4159,7 +6905,7 @@ static void FS_AddGameDirectory( const char *path, const char *dir ) {
 		pakdirs = NULL;
 	} else {
 		// Get top level directories (we'll filter them later since the Sys_ListFiles filtering is terrible)
-		pakdirs = Sys_ListFiles( curpath, "/", NULL, &numdirs, qfalse );
+		pakdirs = FS_ListDirectory( curpath, "/", &numdirs, qfalse );
 		if ( numdirs >= 2 ) {
 			FS_SortFileList( pakdirs, numdirs - 1 );
 		}
@@ -4192,7 +6938,7 @@ static void FS_AddGameDirectory( const char *path, const char *dir ) {
 
 			// The next .pk3 file is before the next .pk3dir
 			pakfile = FS_BuildOSPath( path, dir, pakfiles[pakfilesi] );
-			if ( (pak = FS_LoadZipFile( pakfile ) ) == NULL ) {
+			if ( (pak = FS_LoadZipFile( pakfile, scans[pakfilesi].zipfile ? &scans[pakfilesi] : NULL ) ) == NULL ) {
 				// This isn't a .pk3! Next!
 				pakfilesi++;
 				continue;
@@ -4253,6 +6999,16 @@ static void FS_AddGameDirectory( const char *path, const char *dir ) {
 	}
 
 	// done
+	if ( scans ) {
+		for ( i = 0; i < numfiles; i++ ) {
+			if ( scans[i].zipfile ) {
+				FS_FreeZipScan( &scans[i] );
+				Z_Free( scans[i].zipfile );
+			}
+		}
+		Z_Free( scans );
+	}
+
 	Sys_FreeFileList( pakdirs );
 	Sys_FreeFileList( pakfiles );
 }
@@ -4431,6 +7187,15 @@ void FS_Shutdown( qboolean closemfp )
 	searchpath_t	*p, *next;
 	int i;
 
+#ifdef USE_ASYNC_READS
+	if ( closemfp ) {
+		FS_StopIOThreads();
+	}
+#endif
+
+	// invalidate cached pak lists
+	fs_pakListSequence++;
+
 	// close opened files
 	if ( closemfp ) 
 	{
@@ -4441,6 +7206,12 @@ void FS_Shutdown( qboolean closemfp )
 
 			FS_FCloseFile( i );
 		}
+#ifdef USE_ASYNC_WRITES
+		FS_StopWriter();
+#endif
+#ifdef USE_DIR_CACHE
+		FS_ClearDirCache();
+#endif
 	}
 
 #ifdef DELAY_WRITECONFIG
@@ -4475,6 +7246,14 @@ void FS_Shutdown( qboolean closemfp )
 		Z_Free( p );
 	}
 
+#ifdef USE_FILE_INDEX
+	FS_FreeFileIndex();
+#endif
+
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
 	fs_packFiles = 0;
@@ -4490,6 +7269,9 @@ void FS_Shutdown( qboolean closemfp )
 	Cmd_RemoveCommand( "which" );
 	Cmd_RemoveCommand( "lsof" );
 	Cmd_RemoveCommand( "fs_restart" );
+#ifdef USE_PAK_BUNDLES
+	Cmd_RemoveCommand( "fs_bundle" );
+#endif
 }
 
 
@@ -4550,6 +7332,8 @@ static void FS_ReorderPurePaks( void )
 		**p_previous; // when doing the scan
 	
 	fs_reordered = qfalse;
+	fs_pakListSequence++;
+	fs_loadStamp++;
 
 	// only relevant when connected to pure server
 	if ( !fs_numServerPaks )
@@ -4615,6 +7399,13 @@ FS_LoadedPakPureChecksums
 static int fs_numPureChecksums;
 static int fs_pureChecksum[ MAX_FOUND_FILES ];
 
+static int QDECL FS_PureChecksumCompare( const void *a, const void *b )
+{
+	const int ia = *(const int *)a;
+	const int ib = *(const int *)b;
+	return ( ia > ib ) - ( ia < ib );
+}
+
 static void FS_LoadedPakPureChecksums( void )
 {
 	const searchpath_t *search;
@@ -4631,6 +7422,9 @@ static void FS_LoadedPakPureChecksums( void )
 			fs_numPureChecksums++;
 		}
 	}
+
+	// sorted for binary search in FS_IsPureChecksum()
+	qsort( fs_pureChecksum, fs_numPureChecksums, sizeof( fs_pureChecksum[0] ), FS_PureChecksumCompare );
 }
 
 
@@ -4641,16 +7435,24 @@ FS_IsPureChecksum
 */
 qboolean FS_IsPureChecksum( int sum )
 {
-	int i;
+	int i, n;
 
 	if ( fs_numPureChecksums == 0 )
 		return qtrue;
-	
-	for ( i = 0; i < fs_numPureChecksums; i++ )
-		if ( fs_pureChecksum[i] == sum )
-			return qtrue;
 
-	return qfalse;
+	i = 0;
+	n = fs_numPureChecksums;
+	while ( n > 0 ) {
+		const int half = n >> 1;
+		if ( fs_pureChecksum[ i + half ] < sum ) {
+			i += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+
+	return ( i < fs_numPureChecksums && fs_pureChecksum[i] == sum ) ? qtrue : qfalse;
 }
 
 
@@ -4665,6 +7467,8 @@ static void FS_Startup( void ) {
 
 	Com_Printf( "----- FS_Startup -----\n" );
 
+	fs_loadStamp++;
+
 	fs_debug = Cvar_Get( "fs_debug", "0", 0 );
 	Cvar_SetDescription( fs_debug, "Debugging tool for the filesystem. Run the game in debug mode. Prints additional information regarding read files into the console." );
 	fs_copyfiles = Cvar_Get( "fs_copyfiles", "0", CVAR_INIT );
@@ -4676,6 +7480,39 @@ static void FS_Startup( void ) {
 	fs_addons = Cvar_Get( "fs_addons", BASEGAME "/addons", CVAR_INIT | CVAR_PROTECTED );
 	Cvar_SetDescription( fs_addons, "Write-protected CVAR specifying the path to an optional map folder." );
 	fs_steampath = Cvar_Get( "fs_steampath", Sys_SteamPath(), CVAR_INIT | CVAR_PROTECTED | CVAR_PRIVATE );
+#ifdef USE_ASYNC_READS
+	fs_ioThreads = Cvar_Get( "fs_ioThreads", "2", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	Cvar_CheckRange( fs_ioThreads, "0", XSTRING( MAX_IO_THREADS ), CV_INTEGER );
+	Cvar_SetDescription( fs_ioThreads, "Number of threads reading and inflating files requested in background, 0 reads everything on the main thread." );
+	FS_StartIOThreads();
+#endif
+#ifdef USE_DIR_CACHE
+	fs_dirCache = Cvar_Get( "fs_dirCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_dirCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_dirCache, "Reuse directory listings while the directory modification time is unchanged, speeds up filesystem restarts and file list queries." );
+#endif
+#ifdef USE_ASYNC_WRITES
+	fs_writeThread = Cvar_Get( "fs_writeThread", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_writeThread, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_writeThread, "Write demos being recorded on a background thread, takes effect with the next recording." );
+	fs_writeFlush = Cvar_Get( "fs_writeFlush", "1000", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_writeFlush, "0", "10000", CV_INTEGER );
+	Cvar_SetDescription( fs_writeFlush, "Milliseconds after which data buffered for the write thread is written even if the buffer isn't full, 0 writes full buffers only." );
+	fs_writeSync = Cvar_Get( "fs_writeSync", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_writeSync, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_writeSync, "Make the write thread commit data to disk on every periodic flush and when the file is closed." );
+#endif
+#ifdef USE_PK3_MAPPING
+	fs_mmap = Cvar_Get( "fs_mmap", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_mmap, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_mmap, "Read large pk3 entries through memory mapped views of the pak file, stored entries are used in place without copying." );
+#endif
+#ifdef USE_FS_PROFILE
+	fs_profile = Cvar_Get( "fs_profile", "0", 0 );
+	Cvar_CheckRange( fs_profile, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_profile, "Record files read during level loads with the pak that resolved them, bytes read and time spent.\n"
+		"Prints slowest files, duplicate reads and misses, writes the full list to fsprofile/<mapname>.txt" );
+#endif
 
 	/* parse fs_basegame cvar */
 	if ( basegame_cnt == 0 || Q_stricmp( basegame, fs_basegame->string ) ) {
@@ -4790,6 +7627,10 @@ static void FS_Startup( void ) {
 	// get the pure checksums of the pk3 files loaded by the server
 	FS_LoadedPakPureChecksums();
 
+#ifdef USE_FILE_INDEX
+	FS_BuildFileIndex();
+#endif
+
 	end = Sys_Milliseconds();
 
 	Com_ReadCDKey( basegame );
@@ -4806,6 +7647,9 @@ static void FS_Startup( void ) {
  	Cmd_AddCommand( "which", FS_Which_f );
 	Cmd_SetCommandCompletionFunc( "which", FS_CompleteFileName );
 	Cmd_AddCommand( "fs_restart", FS_Reload );
+#ifdef USE_PAK_BUNDLES
+	Cmd_AddCommand( "fs_bundle", FS_Bundle_f );
+#endif
 
 	// print the current search paths
 	FS_Path_f();
@@ -4837,19 +7681,27 @@ FS_LoadedPakChecksums
 
 Returns a space separated string containing the checksums of all loaded pk3 files.
 Servers with sv_pure set will get this string and pass it to clients.
+The string is rebuilt only when the set of loaded or excluded paks changes.
 =====================
 */
 const char *FS_LoadedPakChecksums( qboolean *overflowed ) {
 	static char	info[BIG_INFO_STRING];
+	static int sequence = -1;
+	static qboolean infoOverflowed;
 	const searchpath_t *search;
 	char buf[ 32 ];
 	char *s, *max;
 	int len;
 
+	if ( sequence == fs_pakListSequence ) {
+		*overflowed = infoOverflowed;
+		return info;
+	}
+
 	s = info;
 	info[0] = '\0';
 	max = &info[sizeof(info)-1];
-	*overflowed = qfalse;
+	infoOverflowed = qfalse;
 
 	for ( search = fs_searchpaths ; search ; search = search->next ) {
 		// is the element a pak file?
@@ -4865,13 +7717,16 @@ const char *FS_LoadedPakChecksums( qboolean *overflowed ) {
 			len = sprintf( buf, "%i", search->pack->checksum );
 
 		if ( s + len > max ) {
-			*overflowed = qtrue;
+			infoOverflowed = qtrue;
 			break;
 		}
 
 		s = Q_stradd( s, buf );
 	}
 
+	sequence = fs_pakListSequence;
+	*overflowed = infoOverflowed;
+
 	return info;
 }
 
@@ -4931,9 +7786,19 @@ The server will send this to the clients so they can check which files should be
 */
 const char *FS_ReferencedPakChecksums( void ) {
 	static char	info[BIG_INFO_STRING];
+	static int sequence = -1;
 	const searchpath_t *search;
+	char buf[ 32 ];
+	char *s, *max;
+	int len;
 
+	if ( sequence == fs_pakListSequence ) {
+		return info;
+	}
+
+	s = info;
 	info[0] = '\0';
+	max = &info[sizeof(info)-1];
 
 	for ( search = fs_searchpaths ; search ; search = search->next ) {
 		// is the element a pak file?
@@ -4942,11 +7807,17 @@ const char *FS_ReferencedPakChecksums( void ) {
 				continue;
 			}
 			if ( search->pack->referenced || !FS_IsBaseGame( search->pack->pakGamename ) ) {
-				Q_strcat( info, sizeof( info ), va( "%i ", search->pack->checksum ) );
+				len = sprintf( buf, "%i ", search->pack->checksum );
+				if ( s + len > max ) {
+					break;
+				}
+				s = Q_stradd( s, buf );
 			}
 		}
 	}
 
+	sequence = fs_pakListSequence;
+
 	return info;
 }
 
@@ -4963,10 +7834,17 @@ The string has a specific order, "cgame ui @ ref1 ref2 ref3 ..."
 */
 const char *FS_ReferencedPakPureChecksums( int maxlen ) {
 	static char	info[ MAX_STRING_CHARS*2 ];
+	static int sequence = -1;
+	static int infoMaxlen;
+	char buf[ 32 ];
 	char *s, *max;
 	const searchpath_t	*search;
 	int nFlags, numPaks, checksum;
 
+	if ( sequence == fs_pakListSequence && infoMaxlen == maxlen ) {
+		return info;
+	}
+
 	max = info + maxlen; // maxlen is always smaller than MAX_STRING_CHARS so we can overflow a bit
 	s = info;
 	*s = '\0';
@@ -4983,7 +7861,8 @@ const char *FS_ReferencedPakPureChecksums( int maxlen ) {
 		for ( search = fs_searchpaths ; search ; search = search->next ) {
 			// is the element a pak file and has it been referenced based on flag?
 			if ( search->pack && (search->pack->referenced & nFlags)) {
-				s = Q_stradd( s, va( "%i ", search->pack->pure_checksum ) );
+				sprintf( buf, "%i ", search->pack->pure_checksum );
+				s = Q_stradd( s, buf );
 				if ( s > max ) // client-side overflow
 					break;
 				if ( nFlags & (FS_CGAME_REF | FS_UI_REF) ) {
@@ -5003,7 +7882,10 @@ const char *FS_ReferencedPakPureChecksums( int maxlen ) {
 		Com_Printf( S_COLOR_YELLOW "WARNING: pure checksum list is too long (%i), you might be not able to play on remote server!\n", (int)(s - info) );
 		*max = '\0';
 	}
-	
+
+	sequence = fs_pakListSequence;
+	infoMaxlen = maxlen;
+
 	return info;
 }
 
@@ -5034,7 +7916,10 @@ qboolean FS_ExcludeReference( void ) {
 			pakName = va( "%s/%s", search->pack->pakGamename, search->pack->pakBasename );
 			for ( i = 0; i < nargs; i++ ) {
 				if ( Q_stricmp( Cmd_Argv( i ), pakName ) == 0 ) {
-					search->pack->exclude = qtrue;
+					if ( !search->pack->exclude ) {
+						search->pack->exclude = qtrue;
+						fs_pakListSequence++;
+					}
 					x = qtrue;
 					break;
 				}
@@ -5056,9 +7941,18 @@ The server will send this to the clients so they can check which files should be
 */
 const char *FS_ReferencedPakNames( void ) {
 	static char	info[BIG_INFO_STRING];
+	static int sequence = -1;
 	const searchpath_t *search;
-	const char *pakName;
+	char *s, *max;
+	int len;
+
+	if ( sequence == fs_pakListSequence ) {
+		return info;
+	}
+
+	s = info;
 	info[0] = '\0';
+	max = &info[sizeof(info)-1];
 
 	// we want to return ALL pk3's from the fs_game path
 	// and referenced one's from baseq3
@@ -5069,15 +7963,22 @@ const char *FS_ReferencedPakNames( void ) {
 				continue;
 			}
 			if ( search->pack->referenced || !FS_IsBaseGame( search->pack->pakGamename ) ) {
-				pakName = va( "%s/%s", search->pack->pakGamename, search->pack->pakBasename );
-				if ( *info != '\0' ) {
-					Q_strcat( info, sizeof( info ), " " );
-				}
-				Q_strcat( info, sizeof( info ), pakName );
+				len = (int)( strlen( search->pack->pakGamename ) + 1 + strlen( search->pack->pakBasename ) );
+				if ( info[0] )
+					len++;
+				if ( s + len > max )
+					break;
+				if ( info[0] )
+					s = Q_stradd( s, " " );
+				s = Q_stradd( s, search->pack->pakGamename );
+				s = Q_stradd( s, "/" );
+				s = Q_stradd( s, search->pack->pakBasename );
 			}
 		}
 	}
 
+	sequence = fs_pakListSequence;
+
 	return info;
 }
 
@@ -5095,8 +7996,9 @@ void FS_ClearPakReferences( int flags ) {
 	}
 	for ( search = fs_searchpaths; search; search = search->next ) {
 		// is the element a pak file and has it been referenced?
-		if ( search->pack ) {
+		if ( search->pack && ( search->pack->referenced & flags ) ) {
 			search->pack->referenced &= ~flags;
+			fs_pakListSequence++;
 		}
 	}
 }
@@ -5144,6 +8046,10 @@ void FS_PureServerSetLoadedPaks( const char *pakSums, const char *pakNames ) {
 
 	FS_SetDirPolicy( c ? DIR_DENY : DIR_ALLOW );
 
+#ifdef USE_MISS_CACHE
+	FS_ClearMissedFiles();
+#endif
+
 	for ( i = 0 ; i < c ; i++ ) {
 		fs_serverPaks[i] = atoi( Cmd_Argv( i ) );
 	}
@@ -5273,6 +8179,54 @@ void FS_InitFilesystem( void ) {
 }
 
 
+/*
+================
+FS_PrepareFork
+
+Stops background threads and closes cached pak handles so a forked
+process gets no half-copied thread state and doesn't share file
+offsets with its parent, FS_ForkDone() is called in both processes
+================
+*/
+void FS_PrepareFork( void ) {
+	searchpath_t *sp;
+
+#ifdef USE_ASYNC_READS
+	FS_StopIOThreads();
+#endif
+
+#ifdef USE_HANDLE_CACHE
+	while ( hhead ) {
+		pack_t *pk = hhead;
+		unzClose( pk->handle );
+		pk->handle = NULL;
+		FS_RemoveFromHandleList( pk );
+	}
+#endif
+
+	for ( sp = fs_searchpaths; sp; sp = sp->next ) {
+		if ( sp->pack && sp->pack->handle && !sp->pack->handleUsed ) {
+			unzClose( sp->pack->handle );
+			sp->pack->handle = NULL;
+		}
+	}
+
+	fflush( NULL );
+}
+
+
+/*
+================
+FS_ForkDone
+================
+*/
+void FS_ForkDone( void ) {
+#ifdef USE_ASYNC_READS
+	FS_StartIOThreads();
+#endif
+}
+
+
 /*
 ================
 FS_Restart
@@ -5362,6 +8316,9 @@ qboolean FS_ConditionalRestart( int checksumFeed, qboolean clientRestart )
 	else if( fs_numServerPaks && !fs_reordered ) 
 	{
 		FS_ReorderPurePaks();
+#ifdef USE_FILE_INDEX
+		FS_BuildFileIndex();
+#endif
 	}
 	
 	return qfalse;
@@ -5428,6 +8385,11 @@ int	FS_FOpenFileByMode( const char *qpath, fileHandle_t *f, fsMode_t mode ) {
 
 int FS_FTell( fileHandle_t f ) {
 	int pos;
+#ifdef USE_ASYNC_WRITES
+	if ( fsh[f].writeBehind ) {
+		FS_FinishWrites( f, qfalse );
+	}
+#endif
 	if ( fsh[f].zipFile ) {
 		pos = unztell( fsh[f].handleFiles.file.z );
 	} else {
@@ -5439,6 +8401,11 @@ int FS_FTell( fileHandle_t f ) {
 
 void FS_Flush( fileHandle_t f ) 
 {
+#ifdef USE_ASYNC_WRITES
+	if ( fsh[f].writeBehind ) {
+		FS_FinishWrites( f, qfalse );
+	}
+#endif
 	fflush( fsh[f].handleFiles.file.o );
 }
 
@@ -5634,6 +8601,11 @@ void FS_PipeClose( fileHandle_t f )
 	if ( fsh[f].zipFile )
 		return;
 
+#ifdef USE_ASYNC_WRITES
+	if ( fsh[f].writeBehind )
+		FS_FinishWrites( f, qfalse );
+#endif
+
 	if ( fsh[f].handleFiles.file.o ) {
 #ifdef _WIN32
 		_pclose( fsh[f].handleFiles.file.o );
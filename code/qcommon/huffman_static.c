@@ -137,7 +137,8 @@ const uint16_t HuffmanDecoderTable[ 2048 ] =
 };
 
 
-static const uint16_t HuffmanEncoderTable[ 256 ] =
+// low 4 bits are code length, next 11 bits are the code sent lowest bit first
+const uint16_t HuffmanEncoderTable[ 256 ] =
 {
 	34, 437, 1159, 1735, 2584, 280, 263, 1014, 341, 839, 1687, 183, 311, 726, 920, 2761,
 	599, 1417, 7945, 8073, 7642, 16186, 8890, 12858, 3913, 6362, 2746, 13882, 7866, 1080, 1273, 3400,
@@ -177,20 +178,37 @@ void HuffmanPutBit( byte* fout, int32_t bitIndex, int bit )
 
 int HuffmanPutSymbol( byte* fout, uint32_t offset, int symbol )
 {
-	int32_t bits;
-	uint32_t i;
 	const uint16_t result = HuffmanEncoderTable[ symbol ];
 	const uint16_t bitCount = result & 15;
 	const uint16_t code = (result >> 4) & 0x7FF;
 
-	bits = (int32_t)code;
-	for( i = 0; i < bitCount; ++i )
+	HuffmanPutBits( fout, offset, code, bitCount );
+
+	return bitCount;
+}
+
+
+// stores count low bits of an accumulator at once, like count HuffmanPutBit() calls
+void HuffmanPutBits( byte* fout, int32_t bitIndex, uint64_t bits, int count )
+{
+	byte *out = fout + ( bitIndex >> 3 );
+	const int bitOffset = bitIndex & 7;
+
+	if ( bitOffset != 0 )
 	{
-		HuffmanPutBit( fout, offset + i, bits & 1 );
-		bits >>= 1;
+		// bits above bitOffset are zero since the byte was started
+		*out++ |= (byte)( bits << bitOffset );
+		bits >>= 8 - bitOffset;
+		count -= 8 - bitOffset;
 	}
 
-	return bitCount;
+	// remaining bytes are new so they don't need to be preserved
+	while ( count > 0 )
+	{
+		*out++ = (byte)bits;
+		bits >>= 8;
+		count -= 8;
+	}
 }
 
 
@@ -0,0 +1,566 @@
+// worker thread pool for splitting independent work across CPU cores,
+// also keeps track of subsystem threads for naming and core pinning
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+#define MAX_JOB_BATCHES		4	// concurrent Com_ParallelFor calls from different threads
+#define MAX_JOB_THREADS		32	// subsystem threads started with Com_CreateThread
+
+#define JOB_GROUP_WORKERS	JOB_NUM_POOLS	// affinity group of worker threads
+
+typedef struct {
+	jobFunc_t	func;
+	void		*data;
+	int			count;
+	int			next;			// next index to process
+	volatile int done;			// processed indexes
+	jobPool_t	pool;
+	qboolean	active;
+	void		*doneSem;		// posted by whoever finished the last index
+} jobBatch_t;
+
+typedef struct {
+	void		*thread;
+	int			group;
+	const char	*name;
+	void		(*func)( void *arg );
+	void		*arg;
+	uint64_t	pinned;			// affinity mask set from com_jobs
+} jobThread_t;
+
+typedef struct {
+	void		*threads[ MAX_JOB_WORKERS ];
+	int			numThreads;
+
+	void		*lock;			// protects batches
+	void		*wakeSem;		// posted once per worker that should look for work
+
+	jobBatch_t	batches[ MAX_JOB_BATCHES ];
+	qboolean	quit;
+} jobSystem_t;
+
+static jobSystem_t jobs;
+
+// owned by the main thread
+static jobThread_t jobThreads[ MAX_JOB_THREADS ];
+
+static THREAD_LOCAL jobPool_t	jobThreadPool;	// default priority of Com_ParallelFor calls
+static THREAD_LOCAL qboolean	jobWorker;
+
+static const char *jobGroupNames[ JOB_NUM_POOLS + 1 ] = {
+	"server", "renderer", "io", "audio", "bot", "workers"
+};
+
+static char jobWorkerNames[ MAX_JOB_WORKERS ][ 16 ];
+
+static cvar_t *com_jobThreads;
+static cvar_t *com_jobs;
+
+
+/*
+================
+Com_JobTake
+
+Picks next index of the batch with highest priority, or of the given batch only,
+returns batch or NULL when there is nothing left
+================
+*/
+static jobBatch_t *Com_JobTake( jobBatch_t *only, int *index )
+{
+	jobBatch_t *batch, *best;
+	int i;
+
+	Sys_LockMutex( jobs.lock );
+
+	best = NULL;
+	if ( only ) {
+		if ( only->next < only->count ) {
+			best = only;
+		}
+	} else {
+		for ( i = 0, batch = jobs.batches; i < MAX_JOB_BATCHES; i++, batch++ ) {
+			if ( batch->active && batch->next < batch->count && ( !best || batch->pool < best->pool ) ) {
+				best = batch;
+			}
+		}
+	}
+
+	if ( best ) {
+		*index = best->next++;
+	}
+
+	Sys_UnlockMutex( jobs.lock );
+
+	return best;
+}
+
+
+/*
+================
+Com_JobRun
+
+Grabs indexes until there are no more left
+================
+*/
+static void Com_JobRun( jobBatch_t *only )
+{
+	jobBatch_t *batch;
+	int index, count;
+
+	while ( ( batch = Com_JobTake( only, &index ) ) != NULL ) {
+		count = batch->count;
+
+		Com_TraceBegin( jobGroupNames[ batch->pool ] );
+		batch->func( batch->data, index );
+		Com_TraceEnd();
+
+		if ( Sys_AtomicAdd( &batch->done, 1 ) == count ) {
+			Sys_PostSemaphore( batch->doneSem, 1 );
+		}
+	}
+}
+
+
+/*
+================
+Com_JobThread
+================
+*/
+static void Com_JobThread( void *arg )
+{
+	jobWorker = qtrue;
+
+	for ( ;; ) {
+		Sys_WaitSemaphore( jobs.wakeSem );
+		if ( jobs.quit ) {
+			break;
+		}
+		Com_JobRun( NULL );
+	}
+
+	Com_ScratchThreadExit();
+}
+
+
+/*
+================
+Com_JobGroupMask
+
+Affinity mask for threads of the group from com_jobs, 0 if not set
+================
+*/
+#ifdef USE_AFFINITY_MASK
+static uint64_t Com_JobGroupMask( int group )
+{
+	char name[ 32 ], mask[ 64 ];
+	const char *s;
+	int len;
+
+	if ( !com_jobs ) {
+		return 0;
+	}
+
+	// "group:mask" entries separated by spaces
+	s = com_jobs->string;
+	while ( *s != '\0' ) {
+		while ( *s == ' ' ) {
+			s++;
+		}
+		if ( *s == '\0' ) {
+			break;
+		}
+		len = 0;
+		while ( *s != '\0' && *s != ':' && *s != ' ' ) {
+			if ( len < (int)sizeof( name ) - 1 ) {
+				name[ len++ ] = *s;
+			}
+			s++;
+		}
+		name[ len ] = '\0';
+		len = 0;
+		if ( *s == ':' ) {
+			s++;
+			while ( *s != '\0' && *s != ' ' ) {
+				if ( len < (int)sizeof( mask ) - 1 ) {
+					mask[ len++ ] = *s;
+				}
+				s++;
+			}
+		}
+		mask[ len ] = '\0';
+		if ( mask[0] != '\0' && Q_stricmp( name, jobGroupNames[ group ] ) == 0 ) {
+			return Com_ParseAffinityMask( mask );
+		}
+	}
+
+	return 0;
+}
+#endif
+
+
+/*
+================
+Com_ApplyJobAffinity
+
+Pins all known threads according to com_jobs
+================
+*/
+static void Com_ApplyJobAffinity( void )
+{
+#ifdef USE_AFFINITY_MASK
+	uint64_t masks[ JOB_NUM_POOLS + 1 ];
+	jobThread_t *t;
+	int i;
+
+	for ( i = 0; i <= JOB_NUM_POOLS; i++ ) {
+		masks[ i ] = Com_JobGroupMask( i );
+	}
+
+	for ( i = 0, t = jobThreads; i < MAX_JOB_THREADS; i++, t++ ) {
+		if ( !t->thread ) {
+			continue;
+		}
+		if ( masks[ t->group ] ) {
+			if ( masks[ t->group ] != t->pinned && Sys_SetThreadAffinityMask( t->thread, masks[ t->group ] ) ) {
+				t->pinned = masks[ t->group ];
+			}
+		} else if ( t->pinned ) {
+			// back to whole process mask
+			Sys_SetThreadAffinityMask( t->thread, Com_ParseAffinityMask( "" ) );
+			t->pinned = 0;
+		}
+	}
+#endif
+}
+
+
+/*
+================
+Com_ThreadMain
+================
+*/
+static void Com_ThreadMain( void *arg )
+{
+	const jobThread_t *t = (const jobThread_t *)arg;
+
+	if ( t->group < JOB_NUM_POOLS ) {
+		jobThreadPool = (jobPool_t)t->group;
+	}
+
+	Com_TraceThreadName( t->name );
+
+	t->func( t->arg );
+}
+
+
+/*
+================
+Com_StartThread
+================
+*/
+static void *Com_StartThread( int group, const char *name, void (*func)( void *arg ), void *arg )
+{
+	jobThread_t *t;
+	int i;
+
+	for ( i = 0, t = jobThreads; i < MAX_JOB_THREADS; i++, t++ ) {
+		if ( !t->func ) {
+			break;
+		}
+	}
+
+	if ( i == MAX_JOB_THREADS ) {
+		// not tracked
+		return Sys_CreateThread( func, arg );
+	}
+
+	t->group = group;
+	t->pinned = 0;
+	t->name = name;
+	t->func = func;
+	t->arg = arg;
+	t->thread = Sys_CreateThread( Com_ThreadMain, t );
+
+	if ( !t->thread ) {
+		t->func = NULL;
+		return NULL;
+	}
+
+	Com_ApplyJobAffinity();
+
+	return t->thread;
+}
+
+
+/*
+================
+Com_CreateThread
+
+Starts a long running subsystem thread, name must be a static string.
+The thread is pinned to cores of its pool from com_jobs, named in traces
+and its Com_ParallelFor calls get priority of the pool. Must be called
+from the main thread and stopped with Com_JoinThread
+================
+*/
+void *Com_CreateThread( jobPool_t pool, const char *name, void (*func)( void *arg ), void *arg )
+{
+	return Com_StartThread( pool, name, func, arg );
+}
+
+
+/*
+================
+Com_JoinThread
+================
+*/
+void Com_JoinThread( void *thread )
+{
+	int i;
+
+	if ( !thread ) {
+		return;
+	}
+
+	Sys_JoinThread( thread );
+
+	for ( i = 0; i < MAX_JOB_THREADS; i++ ) {
+		if ( jobThreads[ i ].thread == thread ) {
+			Com_Memset( &jobThreads[ i ], 0, sizeof( jobThreads[ i ] ) );
+			break;
+		}
+	}
+}
+
+
+/*
+================
+Com_StartJobThreads
+================
+*/
+static void Com_StartJobThreads( void )
+{
+	int count, i;
+
+	count = com_jobThreads->integer;
+	if ( count <= 0 ) {
+		// leave one core for the main thread
+		count = Sys_NumProcessors() - 1;
+	}
+	if ( count > MAX_JOB_WORKERS ) {
+		count = MAX_JOB_WORKERS;
+	}
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	jobs.lock = Sys_CreateMutex();
+	jobs.wakeSem = Sys_CreateSemaphore();
+
+	for ( i = 0; i < MAX_JOB_BATCHES; i++ ) {
+		jobs.batches[ i ].doneSem = Sys_CreateSemaphore();
+		if ( !jobs.batches[ i ].doneSem ) {
+			break;
+		}
+	}
+
+	if ( !jobs.lock || !jobs.wakeSem || i < MAX_JOB_BATCHES ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create job synchronization objects\n" );
+		Com_ShutdownJobs();
+		return;
+	}
+
+	jobs.quit = qfalse;
+	jobs.numThreads = 0;
+
+	while ( jobs.numThreads < count ) {
+		Com_sprintf( jobWorkerNames[ jobs.numThreads ], sizeof( jobWorkerNames[0] ), "worker %i", jobs.numThreads + 1 );
+		jobs.threads[ jobs.numThreads ] = Com_StartThread( JOB_GROUP_WORKERS, jobWorkerNames[ jobs.numThreads ], Com_JobThread, NULL );
+		if ( !jobs.threads[ jobs.numThreads ] ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: failed to create job thread %i\n", jobs.numThreads );
+			break;
+		}
+		jobs.numThreads++;
+	}
+
+	Com_DPrintf( "...started %i job threads\n", jobs.numThreads );
+}
+
+
+/*
+================
+Com_JobWorkers
+
+Returns number of worker threads, 0 means that everything runs on the main thread
+================
+*/
+int Com_JobWorkers( void )
+{
+	return jobs.numThreads;
+}
+
+
+/*
+================
+Com_ParallelForPool
+
+Calls func( data, index ) for each index in [0..count) and waits for completion,
+calling thread also participates. Batches from different threads run at the
+same time, idle workers take indexes of the batch with highest priority pool.
+Callbacks may run on any thread and in any order so they must not touch shared
+state without own synchronization and must not call Com_Printf or Com_Error,
+temporary memory should come from Com_ScratchAlloc
+================
+*/
+void Com_ParallelForPool( jobPool_t pool, jobFunc_t func, void *data, int count )
+{
+	jobBatch_t *batch;
+	int i, workers;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	workers = count - 1;
+	if ( workers > jobs.numThreads ) {
+		workers = jobs.numThreads;
+	}
+
+	batch = NULL;
+	if ( workers > 0 && !jobWorker ) {
+		Sys_LockMutex( jobs.lock );
+		for ( i = 0; i < MAX_JOB_BATCHES; i++ ) {
+			if ( !jobs.batches[ i ].active ) {
+				batch = &jobs.batches[ i ];
+				batch->func = func;
+				batch->data = data;
+				batch->count = count;
+				batch->next = 0;
+				batch->done = 0;
+				batch->pool = pool;
+				batch->active = qtrue;
+				break;
+			}
+		}
+		Sys_UnlockMutex( jobs.lock );
+	}
+
+	// no workers, nested call or all batches taken
+	if ( !batch ) {
+		for ( i = 0; i < count; i++ ) {
+			func( data, i );
+		}
+		return;
+	}
+
+	Sys_PostSemaphore( jobs.wakeSem, workers );
+
+	Com_JobRun( batch );
+
+	Sys_WaitSemaphore( batch->doneSem );
+
+	Sys_LockMutex( jobs.lock );
+	batch->active = qfalse;
+	Sys_UnlockMutex( jobs.lock );
+}
+
+
+/*
+================
+Com_ParallelFor
+
+Com_ParallelForPool with priority of the calling thread's pool
+================
+*/
+void Com_ParallelFor( jobFunc_t func, void *data, int count )
+{
+	Com_ParallelForPool( jobThreadPool, func, data, count );
+}
+
+
+static void Com_JobsChanged( cvar_t *var )
+{
+	Com_ApplyJobAffinity();
+}
+
+
+/*
+================
+Com_JobList_f
+================
+*/
+static void Com_JobList_f( void )
+{
+	int i;
+
+	Com_Printf( "%i job workers\n", jobs.numThreads );
+
+	for ( i = 0; i < MAX_JOB_THREADS; i++ ) {
+		if ( jobThreads[ i ].thread ) {
+			Com_Printf( " %-12s %s\n", jobGroupNames[ jobThreads[ i ].group ], jobThreads[ i ].name );
+		}
+	}
+}
+
+
+/*
+================
+Com_InitJobs
+================
+*/
+void Com_InitJobs( void )
+{
+	com_jobThreads = Cvar_Get( "com_jobThreads", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	Cvar_CheckRange( com_jobThreads, "-1", XSTRING( MAX_JOB_WORKERS ), CV_INTEGER );
+	Cvar_SetDescription( com_jobThreads, "Number of worker threads used by parallel engine tasks:\n"
+		" -1 - disabled, everything runs on the main thread\n"
+		"  0 - auto-detect from number of CPU cores" );
+
+	com_jobs = Cvar_Get( "com_jobs", "", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( com_jobs, "Core pinning of engine threads as space separated group:mask entries, "
+		"groups are workers, renderer, io, audio, masks use \\com_affinityMask syntax, e.g. \"workers:P io:E audio:E\". "
+		"Parallel work is shared by priority: server, renderer, io, audio, bot. See \\joblist." );
+	Cvar_SetChangeCallback( com_jobs, Com_JobsChanged );
+
+	Cmd_AddCommand( "joblist", Com_JobList_f );
+
+	if ( com_jobThreads->integer >= 0 ) {
+		Com_StartJobThreads();
+	}
+
+	// threads started before cvars were registered
+	Com_ApplyJobAffinity();
+}
+
+
+/*
+================
+Com_ShutdownJobs
+================
+*/
+void Com_ShutdownJobs( void )
+{
+	int i;
+
+	if ( jobs.numThreads ) {
+		jobs.quit = qtrue;
+		Sys_PostSemaphore( jobs.wakeSem, jobs.numThreads );
+		for ( i = 0; i < jobs.numThreads; i++ ) {
+			Com_JoinThread( jobs.threads[ i ] );
+			jobs.threads[ i ] = NULL;
+		}
+		jobs.numThreads = 0;
+	}
+
+	for ( i = 0; i < MAX_JOB_BATCHES; i++ ) {
+		Sys_DestroySemaphore( jobs.batches[ i ].doneSem );
+		jobs.batches[ i ].doneSem = NULL;
+	}
+
+	Sys_DestroySemaphore( jobs.wakeSem );
+	Sys_DestroyMutex( jobs.lock );
+
+	jobs.wakeSem = NULL;
+	jobs.lock = NULL;
+}
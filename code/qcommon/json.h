@@ -83,6 +83,30 @@ double JSON_ValueGetDouble(const char *json, const char *jsonEnd);
 float JSON_ValueGetFloat(const char *json, const char *jsonEnd);
 int JSON_ValueGetInt(const char *json, const char *jsonEnd);
 
+// --------------------------------------------------------------------------
+//   Writer Functions
+// --------------------------------------------------------------------------
+
+// Writes compact JSON into a fixed buffer, separators are inserted as needed.
+// name is used for members of objects and must be NULL for array elements
+// and the top level value. On overflow output stops and overflowed is set,
+// buf always stays nul terminated.
+typedef struct
+{
+	char *buf;
+	unsigned int size;
+	unsigned int len;
+	int overflowed;
+} jsonWriter_t;
+
+void JSON_WriterInit(jsonWriter_t *w, char *buf, unsigned int size);
+void JSON_WriteObjectBegin(jsonWriter_t *w, const char *name);
+void JSON_WriteObjectEnd(jsonWriter_t *w);
+void JSON_WriteArrayBegin(jsonWriter_t *w, const char *name);
+void JSON_WriteArrayEnd(jsonWriter_t *w);
+void JSON_WriteInt(jsonWriter_t *w, const char *name, int value);
+void JSON_WriteString(jsonWriter_t *w, const char *name, const char *value);
+
 #endif
 
 #ifdef JSON_IMPLEMENTATION
@@ -346,6 +370,113 @@ int JSON_ValueGetInt(const char *json, const char *jsonEnd)
 	return iValue;
 }
 
+// --------------------------------------------------------------------------
+//   Writer Functions
+// --------------------------------------------------------------------------
+
+static void JSON_WriteChar(jsonWriter_t *w, char c)
+{
+	if (w->len + 1 >= w->size)
+	{
+		w->overflowed = 1;
+		return;
+	}
+
+	w->buf[w->len++] = c;
+	w->buf[w->len] = '\0';
+}
+
+static void JSON_WriteRaw(jsonWriter_t *w, const char *str)
+{
+	while (*str)
+		JSON_WriteChar(w, *str++);
+}
+
+static void JSON_WriteQuoted(jsonWriter_t *w, const char *str)
+{
+	char hex[8];
+
+	JSON_WriteChar(w, '"');
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+		{
+			JSON_WriteChar(w, '\\');
+			JSON_WriteChar(w, *str);
+		}
+		else if ((unsigned char)*str < ' ')
+		{
+			sprintf(hex, "\\u%04x", (unsigned char)*str);
+			JSON_WriteRaw(w, hex);
+		}
+		else
+			JSON_WriteChar(w, *str);
+	}
+	JSON_WriteChar(w, '"');
+}
+
+static void JSON_WriteName(jsonWriter_t *w, const char *name)
+{
+	char last = w->len ? w->buf[w->len - 1] : '\0';
+
+	if (last != '\0' && last != '{' && last != '[' && last != ':')
+		JSON_WriteChar(w, ',');
+
+	if (name)
+	{
+		JSON_WriteQuoted(w, name);
+		JSON_WriteChar(w, ':');
+	}
+}
+
+void JSON_WriterInit(jsonWriter_t *w, char *buf, unsigned int size)
+{
+	w->buf = buf;
+	w->size = size;
+	w->len = 0;
+	w->overflowed = 0;
+
+	if (size)
+		buf[0] = '\0';
+}
+
+void JSON_WriteObjectBegin(jsonWriter_t *w, const char *name)
+{
+	JSON_WriteName(w, name);
+	JSON_WriteChar(w, '{');
+}
+
+void JSON_WriteObjectEnd(jsonWriter_t *w)
+{
+	JSON_WriteChar(w, '}');
+}
+
+void JSON_WriteArrayBegin(jsonWriter_t *w, const char *name)
+{
+	JSON_WriteName(w, name);
+	JSON_WriteChar(w, '[');
+}
+
+void JSON_WriteArrayEnd(jsonWriter_t *w)
+{
+	JSON_WriteChar(w, ']');
+}
+
+void JSON_WriteInt(jsonWriter_t *w, const char *name, int value)
+{
+	char num[16];
+
+	JSON_WriteName(w, name);
+	sprintf(num, "%d", value);
+	JSON_WriteRaw(w, num);
+}
+
+void JSON_WriteString(jsonWriter_t *w, const char *name, const char *value)
+{
+	JSON_WriteName(w, name);
+	JSON_WriteQuoted(w, value);
+}
+
 #undef IS_SEPARATOR
 #undef IS_STRUCT_OPEN
 #undef IS_STRUCT_CLOSE
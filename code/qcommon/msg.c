@@ -21,6 +21,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "q_shared.h"
 #include "qcommon.h"
+#if idx64
+#include <emmintrin.h>
+#endif
 
 static int pcount[256];
 
@@ -126,23 +129,26 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			Com_Error(ERR_DROP, "can't write %d bits", bits);
 		}
 	} else {
-		value &= (0xffffffff>>(32-bits));
-		if ( bits & 7 ) {
-			int nbits;
-			nbits = bits&7;
-			for ( i = 0; i < nbits ; i++ ) {
-				HuffmanPutBit( msg->data, msg->bit, (value & 1) );
-				msg->bit++;
-				value = (value>>1);
-			}
-			bits = bits - nbits;
-		}
-		if ( bits ) {
-			for( i = 0 ; i < bits ; i += 8 ) {
-				msg->bit += HuffmanPutSymbol( msg->data, msg->bit, (value & 0xFF) );
-				value = (value>>8);
-			}
+		uint32_t uvalue, entry;
+		uint64_t acc;
+		int count;
+
+		uvalue = (uint32_t)value & (0xffffffff>>(32-bits));
+
+		// raw sub-byte bits followed by the huffman code of each byte, at most
+		// 7 + 4 * 11 bits, are gathered first and then stored together
+		count = bits & 7;
+		acc = uvalue & ( ( 1U << count ) - 1 );
+		uvalue >>= count;
+		for ( i = count; i < bits; i += 8 ) {
+			entry = HuffmanEncoderTable[ uvalue & 0xFF ];
+			acc |= (uint64_t)( ( entry >> 4 ) & 0x7FF ) << count;
+			count += entry & 15;
+			uvalue >>= 8;
 		}
+
+		HuffmanPutBits( msg->data, msg->bit, acc, count );
+		msg->bit += count;
 		msg->cursize = (msg->bit>>3)+1;
 	}
 
@@ -198,11 +204,15 @@ static int MSG_ReadBits( msg_t *msg, int bits ) {
 		const int nbits = bits & 7;
 		int bitIndex = msg->bit; // dereference optimization
 		if ( nbits )
-		{		
-			for ( i = 0; i < nbits; i++ ) {
-				value |= HuffmanGetBit( buffer, bitIndex ) << i;
-				bitIndex++;
+		{
+			// raw bits span two bytes at most
+			const int bitOffset = bitIndex & 7;
+			value = buffer[ bitIndex >> 3 ] >> bitOffset;
+			if ( bitOffset + nbits > 8 ) {
+				value |= buffer[ (bitIndex >> 3) + 1 ] << ( 8 - bitOffset );
 			}
+			value &= ( 1 << nbits ) - 1;
+			bitIndex += nbits;
 			bits -= nbits;
 		}
 		if ( bits )
@@ -259,6 +269,59 @@ void MSG_WriteData( msg_t *buf, const void *data, int length ) {
 	}
 }
 
+/*
+=================
+MSG_WriteBitstream
+
+Appends already encoded bits taken from arbitrary bit offset of the source buffer,
+output is identical to writing the same values with MSG_WriteBits()
+=================
+*/
+void MSG_WriteBitstream( msg_t *msg, const byte *data, int offset, int bits ) {
+	int	in, out, n, s;
+	int	value;
+
+	if ( msg->overflowed != qfalse || bits <= 0 )
+		return;
+
+	if ( msg->bit + bits > msg->maxbits ) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	while ( bits > 0 ) {
+		n = bits > 8 ? 8 : bits;
+
+		// fetch next n bits
+		in = offset >> 3;
+		s = offset & 7;
+		value = data[ in ] >> s;
+		if ( s + n > 8 ) {
+			value |= data[ in + 1 ] << ( 8 - s );
+		}
+		value &= ( 1 << n ) - 1;
+
+		// huffman writer clears each byte on first bit so
+		// bits above current position are always zero
+		out = msg->bit >> 3;
+		s = msg->bit & 7;
+		if ( s == 0 ) {
+			msg->data[ out ] = value;
+		} else {
+			msg->data[ out ] |= value << s;
+			if ( s + n > 8 ) {
+				msg->data[ out + 1 ] = value >> ( 8 - s );
+			}
+		}
+
+		msg->bit += n;
+		offset += n;
+		bits -= n;
+	}
+
+	msg->cursize = (msg->bit>>3)+1;
+}
+
 void MSG_WriteShort( msg_t *sb, int c ) {
 #ifdef PARANOID
 	if (c < ((short)0x8000) || c > (short)0x7fff)
@@ -515,6 +578,177 @@ int MSG_HashKey(const char *string, int maxlen) {
 	return hash;
 }
 
+/*
+=============================================================================
+
+LZ compression of byte blocks
+
+Literal bytes and back references are grouped by eight after a flag byte,
+bit N set means that item N is a reference: 12 bits of distance-1 and
+4 bits of length-LZ_MIN_MATCH, length nibble 15 is followed by one more
+byte of length. Used for blocks that huffman alone handles poorly, like
+the repeated names and paths of configstrings.
+
+=============================================================================
+*/
+
+#define	LZ_WINDOW		4096
+#define	LZ_MIN_MATCH	3
+#define	LZ_MAX_MATCH	(LZ_MIN_MATCH + 15 + 255)
+#define	LZ_MAX_CHAIN	32
+#define	LZ_HASH_SIZE	4096
+#define	LZ_HASH(p)		((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & (LZ_HASH_SIZE-1))
+
+/*
+=================
+MSG_LZCompress
+
+Returns compressed length or -1 if it doesn't fit into outSize
+=================
+*/
+int MSG_LZCompress( byte *out, int outSize, const byte *in, int inLen ) {
+	int		head[ LZ_HASH_SIZE ];
+	int		prev[ LZ_WINDOW ];
+	int		pos, outLen, flagPos, flagBit;
+	int		i, h, cand, len, depth;
+	int		bestLen, bestDist;
+
+	for ( i = 0; i < LZ_HASH_SIZE; i++ ) {
+		head[ i ] = -1;
+	}
+
+	outLen = 0;
+	flagPos = 0;
+	flagBit = 8;
+	pos = 0;
+
+	while ( pos < inLen ) {
+		if ( flagBit == 8 ) {
+			if ( outLen >= outSize ) {
+				return -1;
+			}
+			flagPos = outLen++;
+			out[ flagPos ] = 0;
+			flagBit = 0;
+		}
+
+		// find longest match within the window
+		bestLen = 0;
+		bestDist = 0;
+		if ( pos + LZ_MIN_MATCH <= inLen ) {
+			cand = head[ LZ_HASH( in + pos ) ];
+			for ( depth = 0; cand >= 0 && pos - cand <= LZ_WINDOW && depth < LZ_MAX_CHAIN; depth++ ) {
+				for ( len = 0; pos + len < inLen && len < LZ_MAX_MATCH; len++ ) {
+					if ( in[ cand + len ] != in[ pos + len ] ) {
+						break;
+					}
+				}
+				if ( len > bestLen ) {
+					bestLen = len;
+					bestDist = pos - cand;
+					if ( len == LZ_MAX_MATCH ) {
+						break;
+					}
+				}
+				cand = prev[ cand & (LZ_WINDOW-1) ];
+			}
+		}
+
+		if ( bestLen >= LZ_MIN_MATCH ) {
+			len = bestLen - LZ_MIN_MATCH;
+			if ( outLen + ( len >= 15 ? 3 : 2 ) > outSize ) {
+				return -1;
+			}
+			out[ flagPos ] |= 1 << flagBit;
+			out[ outLen++ ] = ( bestDist - 1 ) & 255;
+			if ( len >= 15 ) {
+				out[ outLen++ ] = ( ( bestDist - 1 ) >> 8 ) | ( 15 << 4 );
+				out[ outLen++ ] = len - 15;
+			} else {
+				out[ outLen++ ] = ( ( bestDist - 1 ) >> 8 ) | ( len << 4 );
+			}
+		} else {
+			if ( outLen >= outSize ) {
+				return -1;
+			}
+			bestLen = 1;
+			out[ outLen++ ] = in[ pos ];
+		}
+		flagBit++;
+
+		// add consumed positions to the hash chains
+		for ( i = 0; i < bestLen; i++, pos++ ) {
+			if ( pos + LZ_MIN_MATCH <= inLen ) {
+				h = LZ_HASH( in + pos );
+				prev[ pos & (LZ_WINDOW-1) ] = head[ h ];
+				head[ h ] = pos;
+			}
+		}
+	}
+
+	return outLen;
+}
+
+
+/*
+=================
+MSG_LZDecompress
+
+Returns decompressed length or -1 on malformed or oversized input
+=================
+*/
+int MSG_LZDecompress( byte *out, int outSize, const byte *in, int inLen ) {
+	int		inPos, outLen, flags, flagBit;
+	int		dist, len;
+
+	inPos = 0;
+	outLen = 0;
+	flags = 0;
+	flagBit = 8;
+
+	while ( inPos < inLen ) {
+		if ( flagBit == 8 ) {
+			flags = in[ inPos++ ];
+			flagBit = 0;
+			if ( inPos >= inLen ) {
+				break;
+			}
+		}
+
+		if ( flags & ( 1 << flagBit ) ) {
+			if ( inPos + 2 > inLen ) {
+				return -1;
+			}
+			dist = ( in[ inPos ] | ( ( in[ inPos + 1 ] & 15 ) << 8 ) ) + 1;
+			len = in[ inPos + 1 ] >> 4;
+			inPos += 2;
+			if ( len == 15 ) {
+				if ( inPos >= inLen ) {
+					return -1;
+				}
+				len += in[ inPos++ ];
+			}
+			len += LZ_MIN_MATCH;
+			if ( dist > outLen || outLen + len > outSize ) {
+				return -1;
+			}
+			// may overlap, copy bytewise
+			for ( ; len > 0; len--, outLen++ ) {
+				out[ outLen ] = out[ outLen - dist ];
+			}
+		} else {
+			if ( outLen >= outSize ) {
+				return -1;
+			}
+			out[ outLen++ ] = in[ inPos++ ];
+		}
+		flagBit++;
+	}
+
+	return outLen;
+}
+
+
 #ifndef DEDICATED
 extern cvar_t *cl_shownet;
 #define	LOG(x) if( cl_shownet && cl_shownet->integer == 4 ) { Com_Printf("%s ", x ); };
@@ -738,6 +972,104 @@ static const netField_t entityStateFields[] =
 #define	FLOAT_INT_BITS	13
 #define	FLOAT_INT_BIAS	(1<<(FLOAT_INT_BITS-1))
 
+#define	ENTITYSTATE_WORDS	( sizeof( entityState_t ) / sizeof( int ) )
+
+// maps entityState_t word index to entityStateFields index, -1 for "number"
+static int entityWordField[ ENTITYSTATE_WORDS ];
+
+
+/*
+==================
+MSG_InitEntityWordFields
+
+Called once at startup, before snapshot jobs can delta entities
+==================
+*/
+void MSG_InitEntityWordFields( void ) {
+	int i;
+
+	for ( i = 0; i < ENTITYSTATE_WORDS; i++ ) {
+		entityWordField[ i ] = -1;
+	}
+
+	for ( i = 0; i < ARRAY_LEN( entityStateFields ); i++ ) {
+		entityWordField[ entityStateFields[ i ].offset / sizeof( int ) ] = i;
+	}
+}
+
+
+/*
+==================
+MSG_HighestBit64
+
+Returns index of the highest set bit plus one, 0 for empty mask
+==================
+*/
+static int MSG_HighestBit64( uint64_t mask ) {
+#if defined (__GNUC__) || defined (__clang__)
+	return mask ? 64 - __builtin_clzll( mask ) : 0;
+#else
+	int n = 0;
+	if ( mask >> 32 ) { n += 32; mask >>= 32; }
+	if ( mask >> 16 ) { n += 16; mask >>= 16; }
+	if ( mask >> 8 ) { n += 8; mask >>= 8; }
+	if ( mask >> 4 ) { n += 4; mask >>= 4; }
+	if ( mask >> 2 ) { n += 2; mask >>= 2; }
+	if ( mask >> 1 ) { n += 1; mask >>= 1; }
+	return n + (int)mask;
+#endif
+}
+
+
+/*
+==================
+MSG_DeltaEntityFields
+
+Compares whole entityState_t structures at once and returns bitmask
+of changed fields in entityStateFields order, number field is ignored
+==================
+*/
+static uint64_t MSG_DeltaEntityFields( const entityState_t *from, const entityState_t *to ) {
+	uint64_t wordMask, fieldMask;
+	int i, f;
+
+	wordMask = 0;
+#if idx64
+	{
+		const __m128i *a = (const __m128i *)from;
+		const __m128i *b = (const __m128i *)to;
+		for ( i = 0; i < ENTITYSTATE_WORDS / 4; i++ ) {
+			const __m128i eq = _mm_cmpeq_epi32( _mm_loadu_si128( a + i ), _mm_loadu_si128( b + i ) );
+			wordMask |= (uint64_t)( ~_mm_movemask_ps( _mm_castsi128_ps( eq ) ) & 15 ) << ( i * 4 );
+		}
+		for ( i = i * 4; i < ENTITYSTATE_WORDS; i++ ) {
+			if ( ((const int *)from)[ i ] != ((const int *)to)[ i ] ) {
+				wordMask |= 1ULL << i;
+			}
+		}
+	}
+#else
+	for ( i = 0; i < ENTITYSTATE_WORDS; i++ ) {
+		if ( ((const int *)from)[ i ] != ((const int *)to)[ i ] ) {
+			wordMask |= 1ULL << i;
+		}
+	}
+#endif
+
+	// remap to field order, there are only few changes in a typical delta
+	fieldMask = 0;
+	while ( wordMask ) {
+		i = MSG_HighestBit64( wordMask ) - 1;
+		wordMask &= ~( 1ULL << i );
+		f = entityWordField[ i ];
+		if ( f >= 0 ) {
+			fieldMask |= 1ULL << f;
+		}
+	}
+
+	return fieldMask;
+}
+
 /*
 ==================
 MSG_WriteDeltaEntity
@@ -751,19 +1083,18 @@ identical, under the assumption that the in-order delta code will catch it.
 */
 void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entityState_t *to, qboolean force ) {
 	int			i, lc;
-	int			numFields;
 	const netField_t *field;
 	int			trunc;
 	float		fullFloat;
-	const int	*fromF, *toF;
-
-	numFields = ARRAY_LEN( entityStateFields );
+	const int	*toF;
+	uint64_t	changed;
 
 	// all fields should be 32 bits to avoid any compiler packing issues
 	// the "number" field is not part of the field list
 	// if this assert fails, someone added a field to the entityState_t
 	// struct without updating the message fields
-	assert( numFields + 1 == sizeof( *from )/4 );
+	assert( ARRAY_LEN( entityStateFields ) + 1 == sizeof( *from )/4 );
+	assert( ARRAY_LEN( entityStateFields ) <= 64 );
 
 	// a NULL to is a delta remove message
 	if ( to == NULL ) {
@@ -779,15 +1110,9 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 		Com_Error( ERR_DROP, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
-	lc = 0;
-	// build the change vector as bytes so it is endian independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
+	// build the change vector so it is endian independent
+	changed = MSG_DeltaEntityFields( from, to );
+	lc = MSG_HighestBit64( changed );
 
 	if ( lc == 0 ) {
 		// nothing at all changed
@@ -808,16 +1133,15 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 	MSG_WriteByte( msg, lc );	// # of changes
 
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-
-		if ( *fromF == *toF ) {
+		if ( ( changed & ( 1ULL << i ) ) == 0 ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
 
 		MSG_WriteBits( msg, 1, 1 );	// changed
 
+		toF = (const int *)( (const byte *)to + field->offset );
+
 		if ( field->bits == 0 ) {
 			// float
 			fullFloat = *(const float *)toF;
@@ -850,6 +1174,236 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 	}
 }
 
+static volatile int benchSink; // keeps benchmark loops from being optimized out
+
+/*
+==================
+MSG_DeltaEntityBench_f
+
+Compares per-field change detection with MSG_DeltaEntityFields
+on a set of random entity deltas
+==================
+*/
+void MSG_DeltaEntityBench_f( void ) {
+	static entityState_t from[ 256 ], to[ 256 ];
+	const netField_t *field;
+	int64_t start, timeRef, timeFast;
+	int i, n, pass, passes, lc, lcRef, mismatches;
+	uint64_t mask;
+	int nChanges;
+
+	passes = atoi( Cmd_Argv( 1 ) );
+	if ( passes <= 0 ) {
+		passes = 2000;
+	}
+
+	for ( n = 0; n < ARRAY_LEN( from ); n++ ) {
+		Com_RandomBytes( (byte *)&from[ n ], sizeof( from[ n ] ) );
+		to[ n ] = from[ n ];
+		// typical delta touches only a few fields
+		nChanges = rand() % 6;
+		for ( i = 0; i < nChanges; i++ ) {
+			field = &entityStateFields[ rand() % ARRAY_LEN( entityStateFields ) ];
+			*(int *)( (byte *)&to[ n ] + field->offset ) ^= rand() | 1;
+		}
+	}
+
+	mismatches = 0;
+
+	start = Sys_Microseconds();
+	for ( pass = 0; pass < passes; pass++ ) {
+		for ( n = 0; n < ARRAY_LEN( from ); n++ ) {
+			lcRef = 0;
+			for ( i = 0, field = entityStateFields ; i < ARRAY_LEN( entityStateFields ) ; i++, field++ ) {
+				if ( *(int *)( (byte *)&from[ n ] + field->offset ) != *(int *)( (byte *)&to[ n ] + field->offset ) ) {
+					lcRef = i+1;
+				}
+			}
+			benchSink = lcRef;
+		}
+	}
+	timeRef = Sys_Microseconds() - start;
+
+	start = Sys_Microseconds();
+	for ( pass = 0; pass < passes; pass++ ) {
+		for ( n = 0; n < ARRAY_LEN( from ); n++ ) {
+			lc = MSG_HighestBit64( MSG_DeltaEntityFields( &from[ n ], &to[ n ] ) );
+			benchSink = lc;
+		}
+	}
+	timeFast = Sys_Microseconds() - start;
+
+	// validate results
+	for ( n = 0; n < ARRAY_LEN( from ); n++ ) {
+		mask = MSG_DeltaEntityFields( &from[ n ], &to[ n ] );
+		lcRef = 0;
+		for ( i = 0, field = entityStateFields ; i < ARRAY_LEN( entityStateFields ) ; i++, field++ ) {
+			const qboolean diff = *(int *)( (byte *)&from[ n ] + field->offset ) != *(int *)( (byte *)&to[ n ] + field->offset );
+			if ( diff != ( ( mask >> i ) & 1 ) ) {
+				mismatches++;
+			}
+			if ( diff ) {
+				lcRef = i+1;
+			}
+		}
+		if ( lcRef != MSG_HighestBit64( mask ) ) {
+			mismatches++;
+		}
+	}
+
+	Com_Printf( "%i entity deltas: field walk %i usec, change mask %i usec, %i mismatches\n",
+		passes * (int)ARRAY_LEN( from ), (int)timeRef, (int)timeFast, mismatches );
+}
+
+
+
+#define BITS_CHECK_FIELDS	300
+#define BITS_CHECK_BYTES	( BITS_CHECK_FIELDS * 51 / 8 + 16 )
+
+/*
+==================
+MSG_WriteBitsRef
+
+Huffman coded MSG_WriteBits path that stores one bit at a time
+==================
+*/
+static void MSG_WriteBitsRef( byte *data, int *bit, int value, int bits ) {
+	uint32_t code;
+	int i, n, count;
+
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+
+	value &= (0xffffffff>>(32-bits));
+	for ( i = 0; i < ( bits & 7 ); i++ ) {
+		HuffmanPutBit( data, (*bit)++, value & 1 );
+		value >>= 1;
+	}
+	for ( ; i < bits; i += 8 ) {
+		code = ( HuffmanEncoderTable[ value & 0xFF ] >> 4 ) & 0x7FF;
+		count = HuffmanEncoderTable[ value & 0xFF ] & 15;
+		for ( n = 0; n < count; n++ ) {
+			HuffmanPutBit( data, (*bit)++, code & 1 );
+			code >>= 1;
+		}
+		value >>= 8;
+	}
+}
+
+
+/*
+==================
+MSG_ReadBitsRef
+
+Huffman coded MSG_ReadBits path that loads one bit at a time. Like the
+original code, signed values are extended from the width without the
+raw sub-byte bits
+==================
+*/
+static int MSG_ReadBitsRef( const byte *data, int *bit, int bits ) {
+	unsigned int sym;
+	qboolean sgn;
+	int i, value, nbits;
+
+	sgn = ( bits < 0 ) ? qtrue : qfalse;
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+
+	value = 0;
+	nbits = bits & 7;
+	for ( i = 0; i < nbits; i++ ) {
+		value |= HuffmanGetBit( data, (*bit)++ ) << i;
+	}
+	for ( i = nbits; i < bits; i += 8 ) {
+		*bit += HuffmanGetSymbol( &sym, data, *bit );
+		value |= sym << i;
+	}
+
+	bits -= nbits;
+	if ( sgn && bits > 0 && bits < 32 && ( value & ( 1 << ( bits - 1 ) ) ) ) {
+		value |= -1 ^ ( ( 1 << bits ) - 1 );
+	}
+
+	return value;
+}
+
+
+/*
+==================
+MSG_BitsCheck_f
+
+Writes and reads random field streams with MSG_WriteBits and MSG_ReadBits
+and with the bit at a time reference, buffers, bit positions and values
+must be the same
+==================
+*/
+void MSG_BitsCheck_f( void ) {
+	static byte bufRef[ BITS_CHECK_BYTES ], bufNew[ BITS_CHECK_BYTES ];
+	int values[ BITS_CHECK_FIELDS ], bits[ BITS_CHECK_FIELDS ];
+	int run, runs, i, numFields, totalFields, bitRef, expected, width, mismatches;
+	msg_t msg;
+
+	runs = atoi( Cmd_Argv( 1 ) );
+	if ( runs <= 0 ) {
+		runs = 20000;
+	}
+
+	totalFields = 0;
+	mismatches = 0;
+
+	for ( run = 0; run < runs; run++ ) {
+		numFields = 1 + rand() % BITS_CHECK_FIELDS;
+		Com_RandomBytes( (byte *)values, numFields * sizeof( values[0] ) );
+		for ( i = 0; i < numFields; i++ ) {
+			bits[ i ] = 1 + rand() % 32;
+			if ( bits[ i ] < 32 && ( rand() & 1 ) ) {
+				bits[ i ] = -bits[ i ];
+			}
+		}
+		totalFields += numFields;
+
+		// stale data must be overwritten the same way
+		Com_RandomBytes( bufRef, sizeof( bufRef ) );
+		Com_Memcpy( bufNew, bufRef, sizeof( bufNew ) );
+
+		bitRef = 0;
+		MSG_Init( &msg, bufNew, sizeof( bufNew ) );
+		for ( i = 0; i < numFields; i++ ) {
+			MSG_WriteBitsRef( bufRef, &bitRef, values[ i ], bits[ i ] );
+			MSG_WriteBits( &msg, values[ i ], bits[ i ] );
+		}
+
+		if ( msg.bit != bitRef || memcmp( bufRef, bufNew, ( bitRef + 7 ) >> 3 ) ) {
+			mismatches++;
+			continue;
+		}
+
+		bitRef = 0;
+		MSG_BeginReading( &msg );
+		for ( i = 0; i < numFields; i++ ) {
+			expected = MSG_ReadBitsRef( bufRef, &bitRef, bits[ i ] );
+			if ( MSG_ReadBits( &msg, bits[ i ] ) != expected || msg.bit != bitRef ) {
+				mismatches++;
+				break;
+			}
+			// low bits must be what was written, sign extension of signed
+			// fields overwrites the bits above their byte coded part
+			width = abs( bits[ i ] );
+			if ( bits[ i ] < 0 && width > 8 ) {
+				width -= width & 7;
+			}
+			if ( (uint32_t)( expected ^ values[ i ] ) & ( 0xffffffff >> ( 32 - width ) ) ) {
+				mismatches++;
+				break;
+			}
+		}
+	}
+
+	Com_Printf( "%i runs, %i fields: %i mismatches\n", runs, totalFields, mismatches );
+}
+
 /*
 ==================
 MSG_ReadDeltaEntity
@@ -50,10 +50,15 @@ to the new value before sending out any replies.
 
 #define	FRAGMENT_BIT			(1U<<31)
 
+// sequence, qport, checksum and fragment start/length
+#define	NETCHAN_HEADER_SIZE		16
+
 cvar_t		*showpackets;
 cvar_t		*showdrop;
 cvar_t		*qport;
 
+static int64_t netBytesSent[2];
+
 static const char *netsrcString[2] = {
 	"client",
 	"server"
@@ -107,12 +112,13 @@ Send one fragment of the current message
 */
 void Netchan_TransmitNextFragment( netchan_t *chan ) {
 	msg_t		send;
-	byte		send_buf[MAX_PACKETLEN+8];
+	byte		send_buf[NETCHAN_HEADER_SIZE];
+	netIovec_t	iov[2];
 	int			fragmentLength;
 	int			outgoingSequence;
 
-	// write the packet header
-	MSG_InitOOB( &send, send_buf, sizeof(send_buf)-8 );
+	// write the packet header, fragment data is sent from unsentBuffer
+	MSG_InitOOB( &send, send_buf, sizeof( send_buf ) );
 
 	outgoingSequence = chan->outgoingSequence | FRAGMENT_BIT;
 	MSG_WriteLong( &send, outgoingSequence );
@@ -133,19 +139,23 @@ void Netchan_TransmitNextFragment( netchan_t *chan ) {
 
 	MSG_WriteShort( &send, chan->unsentFragmentStart );
 	MSG_WriteShort( &send, fragmentLength );
-	MSG_WriteData( &send, chan->unsentBuffer + chan->unsentFragmentStart, fragmentLength );
+
+	iov[0].data = send.data;
+	iov[0].length = send.cursize;
+	iov[1].data = chan->unsentBuffer + chan->unsentFragmentStart;
+	iov[1].length = fragmentLength;
 
 	// send the datagram
-	NET_SendPacket( chan->sock, send.cursize, send.data, &chan->remoteAddress );
+	NET_SendPacketV( chan->sock, 2, iov, &chan->remoteAddress );
 
 	// Store send time and size of this packet for rate control
 	chan->lastSentTime = Sys_Milliseconds();
-	chan->lastSentSize = send.cursize;
+	chan->lastSentSize = send.cursize + fragmentLength;
 
 	if ( showpackets->integer ) {
 		Com_Printf ("%s send %4i : s=%i fragment=%i,%i\n"
 			, netsrcString[ chan->sock ]
-			, send.cursize
+			, chan->lastSentSize
 			, chan->outgoingSequence
 			, chan->unsentFragmentStart, fragmentLength);
 	}
@@ -173,7 +183,8 @@ A 0 length will still generate a packet.
 */
 void Netchan_Transmit( netchan_t *chan, int length, const byte *data ) {
 	msg_t		send;
-	byte		send_buf[MAX_PACKETLEN+8];
+	byte		send_buf[NETCHAN_HEADER_SIZE];
+	netIovec_t	iov[2];
 
 	if ( length > MAX_MSGLEN ) {
 		Com_Error( ERR_DROP, "Netchan_Transmit: length = %i", length );
@@ -191,8 +202,8 @@ void Netchan_Transmit( netchan_t *chan, int length, const byte *data ) {
 		return;
 	}
 
-	// write the packet header
-	MSG_InitOOB( &send, send_buf, sizeof(send_buf)-8 );
+	// write the packet header, message data is sent from the caller's buffer
+	MSG_InitOOB( &send, send_buf, sizeof( send_buf ) );
 
 	MSG_WriteLong( &send, chan->outgoingSequence );
 
@@ -205,19 +216,22 @@ void Netchan_Transmit( netchan_t *chan, int length, const byte *data ) {
 
 	chan->outgoingSequence++;
 
-	MSG_WriteData( &send, data, length );
+	iov[0].data = send.data;
+	iov[0].length = send.cursize;
+	iov[1].data = data;
+	iov[1].length = length;
 
 	// send the datagram
-	NET_SendPacket( chan->sock, send.cursize, send.data, &chan->remoteAddress );
+	NET_SendPacketV( chan->sock, 2, iov, &chan->remoteAddress );
 
 	// Store send time and size of this packet for rate control
 	chan->lastSentTime = Sys_Milliseconds();
-	chan->lastSentSize = send.cursize;
+	chan->lastSentSize = send.cursize + length;
 
 	if ( showpackets->integer ) {
 		Com_Printf( "%s send %4i : s=%i ack=%i\n"
 			, netsrcString[ chan->sock ]
-			, send.cursize
+			, chan->lastSentSize
 			, chan->outgoingSequence - 1
 			, chan->incomingSequence );
 	}
@@ -452,17 +466,21 @@ qboolean NET_GetLoopPacket( netsrc_t sock, netadr_t *net_from, msg_t *net_messag
 }
 
 
-static void NET_SendLoopPacket( netsrc_t sock, int length, const void *data )
+static void NET_SendLoopPacket( netsrc_t sock, int length, int count, const netIovec_t *iov )
 {
-	int		i;
+	int		i, n;
 	loopback_t	*loop;
+	byte	*data;
 
 	loop = &loopbacks[sock^1];
 
 	i = loop->send & (MAX_LOOPBACK-1);
 	loop->send++;
 
-	Com_Memcpy (loop->msgs[i].data, data, length);
+	for ( n = 0, data = loop->msgs[i].data; n < count; n++ ) {
+		Com_Memcpy( data, iov[n].data, iov[n].length );
+		data += iov[n].length;
+	}
 	loop->msgs[i].datalen = length;
 }
 
@@ -478,16 +496,22 @@ typedef struct packetQueue_s {
 
 static packetQueue_t *packetQueue = NULL;
 
-static void NET_QueuePacket( int length, const void *data, const netadr_t *to, int offset )
+static void NET_QueuePacket( int length, int count, const netIovec_t *iov, const netadr_t *to, int offset )
 {
 	packetQueue_t *new, *next = packetQueue;
+	byte *data;
+	int i;
 
 	if(offset > 999)
 		offset = 999;
 
-	new = S_Malloc(sizeof(packetQueue_t));
-	new->data = S_Malloc(length);
-	Com_Memcpy(new->data, data, length);
+	// header and datagram share one allocation
+	new = S_Malloc(sizeof(packetQueue_t) + length);
+	new->data = (byte *)(new + 1);
+	for ( i = 0, data = new->data; i < count; i++ ) {
+		Com_Memcpy( data, iov[i].data, iov[i].length );
+		data += iov[i].length;
+	}
 	new->length = length;
 	new->to = *to;
 	new->release = Sys_Milliseconds() + (int)((float)offset / com_timescale->value);	
@@ -519,21 +543,43 @@ void NET_FlushPacketQueue( void )
 		Sys_SendPacket( packetQueue->length, packetQueue->data, &packetQueue->to );
 		last = packetQueue;
 		packetQueue = packetQueue->next;
-		Z_Free( last->data );
 		Z_Free( last );
 	}
 }
 
 
 void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t *to ) {
+	netIovec_t iov;
+
+	iov.data = data;
+	iov.length = length;
+
+	NET_SendPacketV( sock, 1, &iov, to );
+}
+
+
+/*
+=================
+NET_SendPacketV
+
+Sends the pieces as a single datagram, they are only gathered
+into one buffer when the packet has to be stored
+=================
+*/
+void NET_SendPacketV( netsrc_t sock, int count, const netIovec_t *iov, const netadr_t *to ) {
+	int length, i;
+
+	for ( i = 0, length = 0; i < count; i++ ) {
+		length += iov[i].length;
+	}
 
 	// sequenced packets are shown in netchan, so just show oob
-	if ( showpackets->integer && *(int32_t *)data == -1 ) {
+	if ( showpackets->integer && iov[0].length >= 4 && *(const int32_t *)iov[0].data == -1 ) {
 		Com_Printf ("send packet %4i\n", length);
 	}
 
 	if ( to->type == NA_LOOPBACK ) {
-		NET_SendLoopPacket( sock, length, data );
+		NET_SendLoopPacket( sock, length, count, iov );
 		return;
 	}
 	if ( to->type == NA_BOT ) {
@@ -542,20 +588,35 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 	if ( to->type == NA_BAD ) {
 		return;
 	}
+
+	netBytesSent[ sock ] += length;
+
 #ifndef DEDICATED
 	if ( sock == NS_CLIENT && cl_packetdelay->integer > 0 ) {
-		NET_QueuePacket( length, data, to, cl_packetdelay->integer );
+		NET_QueuePacket( length, count, iov, to, cl_packetdelay->integer );
 	} else
 #endif
 	if ( sock == NS_SERVER && sv_packetdelay->integer > 0 ) {
-		NET_QueuePacket( length, data, to, sv_packetdelay->integer );
+		NET_QueuePacket( length, count, iov, to, sv_packetdelay->integer );
 	}
 	else {
-		Sys_SendPacket( length, data, to );
+		Sys_SendPacketV( count, iov, to );
 	}
 }
 
 
+/*
+===============
+NET_BytesSent
+
+Payload bytes handed to the network since startup, loopback excluded
+===============
+*/
+int64_t NET_BytesSent( netsrc_t sock ) {
+	return netBytesSent[ sock ];
+}
+
+
 /*
 ===============
 NET_OutOfBandPrint
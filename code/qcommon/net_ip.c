@@ -20,6 +20,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE // recvmmsg(), sendmmsg()
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -101,6 +105,19 @@ typedef int SOCKET;
 typedef int	ioctlarg_t;
 #	define socketError			errno
 
+#	ifdef __linux__
+#		define USE_MMSG
+#		define USE_EPOLL
+#		define USE_RECV_THREADS
+#		include <sys/epoll.h>
+#		include <sys/timerfd.h>
+#		include <sys/eventfd.h>
+#		include <poll.h>
+#	elif defined( __APPLE__ ) || defined( __FreeBSD__ ) || defined( __OpenBSD__ ) || defined( __NetBSD__ ) || defined( __DragonFly__ )
+#		define USE_KQUEUE
+#		include <sys/event.h>
+#	endif
+
 #endif
 
 typedef union {
@@ -191,10 +208,101 @@ static struct ipv6_mreq curgroup;
 static struct sockaddr_in6 boundto;
 #endif
 
+#ifdef USE_MMSG
+// batched datagram I/O, one syscall per queue instead of per packet
+#define NET_RECV_BATCH	16
+#define NET_SEND_BATCH	64
+
+typedef struct {
+	struct mmsghdr	hdr[ NET_RECV_BATCH ];
+	struct iovec	iov[ NET_RECV_BATCH ];
+	sockaddr_t		from[ NET_RECV_BATCH ];
+	byte			data[ NET_RECV_BATCH ][ MAX_MSGLEN_BUF ];
+	int				count;
+	int				next;
+} recvBatch_t;
+
+typedef struct {
+	struct mmsghdr	hdr[ NET_SEND_BATCH ];
+	struct iovec	iov[ NET_SEND_BATCH ];
+	sockaddr_t		to[ NET_SEND_BATCH ];
+	byte			data[ NET_SEND_BATCH ][ MAX_PACKETLEN ];
+	int				count;
+} sendBatch_t;
+
+static sendBatch_t	ip_send;
+#ifdef USE_IPV6
+static sendBatch_t	ip6_send;
+#endif
+static qboolean		sendBatching;
+static qboolean		mmsgUnsupported;	// ENOSYS, fallback to single packet calls
+#else
+typedef struct {
+	int				count;
+	int				next;
+} recvBatch_t;
+#endif
+
+static recvBatch_t	ip_recv;
+#ifdef USE_IPV6
+static recvBatch_t	ip6_recv;
+static recvBatch_t	multicast6_recv;
+#endif
+
+#define NET_RECV_PENDING( rb ) ( (rb)->next < (rb)->count )
+
+#if defined( USE_EPOLL ) || defined( USE_KQUEUE )
+// event based NET_Sleep backend with sub-millisecond timeouts
+#define USE_POLLER
+static int		poll_fd = -1;
+#ifdef USE_EPOLL
+static int		timer_fd = -1;		// epoll_wait() timeout is in milliseconds
+#endif
+#endif
+
+#ifdef USE_RECV_THREADS
+// dedicated server IPv4 traffic may be read by separate threads from several
+// SO_REUSEPORT sockets, queries are answered there and everything else is
+// queued for the main thread
+#define MAX_RECV_THREADS	8
+#define RECV_QUEUE_SIZE		512
+#define RECV_PACKET_SIZE	4096	// game and connect packets are much smaller
+
+typedef struct {
+	netadr_t	from;
+	int			length;
+	byte		data[ RECV_PACKET_SIZE ];
+} queuedPacket_t;
+
+static cvar_t			*net_recvThreads;
+
+static SOCKET			recv_sockets[ MAX_RECV_THREADS ];	// [0] is ip_socket
+static void				*recv_threads[ MAX_RECV_THREADS ];
+static int				numRecvThreads;
+static volatile qboolean recvQuit;
+
+static void				*net_lock;		// held by main thread except when it waits in NET_Sleep
+static qboolean			net_locked;		// by main thread, may be not when called from signal handler
+static void				*queue_lock;
+static int				event_fd = -1;	// signals main thread about queued packets
+
+static queuedPacket_t	*recvQueue;
+static int				queueHead;
+static int				queueTail;
+static int				queueDrops;
+
+static qboolean NET_GetQueuedPacket( netadr_t *net_from, msg_t *net_message );
+#endif
+
 #ifndef IF_NAMESIZE
   #define IF_NAMESIZE 16
 #endif
 
+// NET_IPSocket() port sharing modes
+#define NET_REUSE_NONE	0
+#define NET_REUSE_FIRST	1	// first socket of the group, must get a free port
+#define NET_REUSE_JOIN	2
+
 // use an admin local address per default so that network admins can decide on how to handle quake3 traffic.
 #define NET_MULTICAST_IP6 "ff04::696f:7175:616b:6533"
 
@@ -636,6 +744,66 @@ qboolean NET_IsLocalAddress( const netadr_t *adr )
 
 //=============================================================================
 
+/*
+==================
+NET_RecvFrom
+
+recvfrom() replacement that drains all queued datagrams with
+single recvmmsg() call and returns them one by one
+==================
+*/
+static int NET_RecvFrom( SOCKET s, recvBatch_t *rb, void *buf, int len, sockaddr_t *from, socklen_t *fromlen )
+{
+#ifdef USE_MMSG
+	struct msghdr *h;
+	int i, ret;
+
+	if ( !NET_RECV_PENDING( rb ) ) {
+		rb->count = rb->next = 0;
+
+		if ( mmsgUnsupported || len > MAX_MSGLEN ) {
+			return recvfrom( s, buf, len, 0, (struct sockaddr *) from, fromlen );
+		}
+
+		for ( i = 0; i < NET_RECV_BATCH; i++ ) {
+			rb->iov[i].iov_base = rb->data[i];
+			rb->iov[i].iov_len = len;
+			h = &rb->hdr[i].msg_hdr;
+			memset( h, 0, sizeof( *h ) );
+			h->msg_name = &rb->from[i];
+			h->msg_namelen = sizeof( rb->from[i] );
+			h->msg_iov = &rb->iov[i];
+			h->msg_iovlen = 1;
+		}
+
+		ret = recvmmsg( s, rb->hdr, NET_RECV_BATCH, MSG_DONTWAIT, NULL );
+		if ( ret <= 0 ) {
+			if ( ret == SOCKET_ERROR && socketError == ENOSYS ) {
+				Com_DPrintf( "recvmmsg() is not supported, using recvfrom()\n" );
+				mmsgUnsupported = qtrue;
+				return recvfrom( s, buf, len, 0, (struct sockaddr *) from, fromlen );
+			}
+			return SOCKET_ERROR;
+		}
+		rb->count = ret;
+	}
+
+	i = rb->next++;
+	ret = rb->hdr[i].msg_len;
+	if ( ret > len ) {
+		ret = len;
+	}
+	memcpy( buf, rb->data[i], ret );
+	memcpy( from, &rb->from[i], rb->hdr[i].msg_hdr.msg_namelen );
+	*fromlen = rb->hdr[i].msg_hdr.msg_namelen;
+
+	return ret;
+#else
+	return recvfrom( s, buf, len, 0, (struct sockaddr *) from, fromlen );
+#endif
+}
+
+
 /*
 ==================
 NET_GetPacket
@@ -650,10 +818,15 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 	socklen_t	fromlen;
 	int		err;
 
-	if(ip_socket != INVALID_SOCKET && FD_ISSET(ip_socket, fdr))
+#ifdef USE_RECV_THREADS
+	if ( NET_GetQueuedPacket( net_from, net_message ) )
+		return qtrue;
+#endif
+
+	if(ip_socket != INVALID_SOCKET && (FD_ISSET(ip_socket, fdr) || NET_RECV_PENDING(&ip_recv)))
 	{
 		fromlen = sizeof(from);
-		ret = recvfrom( ip_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
+		ret = NET_RecvFrom( ip_socket, &ip_recv, net_message->data, net_message->maxsize, &from, &fromlen );
 
 		if (ret == SOCKET_ERROR)
 		{
@@ -695,10 +868,10 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 	}
 
 #ifdef USE_IPV6
-	if(ip6_socket != INVALID_SOCKET && FD_ISSET(ip6_socket, fdr))
+	if(ip6_socket != INVALID_SOCKET && (FD_ISSET(ip6_socket, fdr) || NET_RECV_PENDING(&ip6_recv)))
 	{
 		fromlen = sizeof(from);
-		ret = recvfrom(ip6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
+		ret = NET_RecvFrom( ip6_socket, &ip6_recv, net_message->data, net_message->maxsize, &from, &fromlen );
 
 		if (ret == SOCKET_ERROR)
 		{
@@ -724,10 +897,10 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 		}
 	}
 
-	if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET(multicast6_socket, fdr))
+	if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && (FD_ISSET(multicast6_socket, fdr) || NET_RECV_PENDING(&multicast6_recv)))
 	{
 		fromlen = sizeof(from);
-		ret = recvfrom(multicast6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
+		ret = NET_RecvFrom( multicast6_socket, &multicast6_recv, net_message->data, net_message->maxsize, &from, &fromlen );
 
 		if (ret == SOCKET_ERROR)
 		{
@@ -760,14 +933,195 @@ static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_
 //=============================================================================
 
 
+#ifdef USE_MMSG
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+static void NET_FlushSendBatch( SOCKET s, sendBatch_t *sb )
+{
+	struct msghdr *h;
+	int i, ret;
+
+	for ( i = 0; i < sb->count; ) {
+		if ( mmsgUnsupported ) {
+			h = &sb->hdr[i].msg_hdr;
+			ret = sendto( s, h->msg_iov->iov_base, h->msg_iov->iov_len, 0, (struct sockaddr *) h->msg_name, h->msg_namelen );
+			ret = ( ret == SOCKET_ERROR ) ? SOCKET_ERROR : 1;
+		} else {
+			ret = sendmmsg( s, sb->hdr + i, sb->count - i, 0 );
+		}
+		if ( ret == SOCKET_ERROR ) {
+			int err = socketError;
+			if ( err == ENOSYS && !mmsgUnsupported ) {
+				Com_DPrintf( "sendmmsg() is not supported, using sendto()\n" );
+				mmsgUnsupported = qtrue;
+				continue;
+			}
+			// wouldblock is silent
+			if ( err != EAGAIN ) {
+				Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+			}
+			// skip failed datagram
+			ret = 1;
+		} else if ( ret == 0 ) {
+			break;
+		}
+		i += ret;
+	}
+
+	sb->count = 0;
+}
+
+
+/*
+==================
+NET_QueueSendBatch
+
+Returns qfalse if packet must be sent immediately
+==================
+*/
+static qboolean NET_QueueSendBatch( SOCKET s, sendBatch_t *sb, int length, int count, const netIovec_t *iov, const sockaddr_t *addr, socklen_t addrlen )
+{
+	struct msghdr *h;
+	byte *data;
+	int i, n;
+
+	if ( length > MAX_PACKETLEN ) {
+		// keep order of datagrams
+		NET_FlushSendBatch( s, sb );
+		return qfalse;
+	}
+
+	if ( sb->count >= NET_SEND_BATCH ) {
+		NET_FlushSendBatch( s, sb );
+	}
+
+	n = sb->count++;
+	for ( i = 0, data = sb->data[n]; i < count; i++ ) {
+		memcpy( data, iov[i].data, iov[i].length );
+		data += iov[i].length;
+	}
+	memcpy( &sb->to[n], addr, addrlen );
+	sb->iov[n].iov_base = sb->data[n];
+	sb->iov[n].iov_len = length;
+	h = &sb->hdr[n].msg_hdr;
+	memset( h, 0, sizeof( *h ) );
+	h->msg_name = &sb->to[n];
+	h->msg_namelen = addrlen;
+	h->msg_iov = &sb->iov[n];
+	h->msg_iovlen = 1;
+
+	return qtrue;
+}
+#endif
+
+
+/*
+==================
+Sys_BeginSendBatch
+
+Packets sent until Sys_EndSendBatch() may be queued and flushed together
+==================
+*/
+void Sys_BeginSendBatch( void ) {
+#ifdef USE_MMSG
+	sendBatching = qtrue;
+#endif
+}
+
+
+/*
+==================
+Sys_EndSendBatch
+==================
+*/
+void Sys_EndSendBatch( void ) {
+#ifdef USE_MMSG
+	sendBatching = qfalse;
+	if ( ip_send.count ) {
+		NET_FlushSendBatch( ip_socket, &ip_send );
+	}
+#ifdef USE_IPV6
+	if ( ip6_send.count ) {
+		NET_FlushSendBatch( ip6_socket, &ip6_send );
+	}
+#endif
+#endif
+}
+
+
+/*
+==================
+NET_SendTo
+
+Sends the pieces as one datagram without gathering them first
+==================
+*/
+static int NET_SendTo( SOCKET s, int count, const netIovec_t *iov, const sockaddr_t *addr, socklen_t addrlen )
+{
+#ifdef _WIN32
+	WSABUF buf[ MAX_NET_IOVECS ];
+	DWORD sent;
+	int i;
+
+	for ( i = 0; i < count; i++ ) {
+		buf[i].buf = (CHAR *)iov[i].data;
+		buf[i].len = iov[i].length;
+	}
+
+	if ( WSASendTo( s, buf, count, &sent, 0, (const struct sockaddr *) addr, addrlen, NULL, NULL ) == SOCKET_ERROR )
+		return SOCKET_ERROR;
+
+	return (int)sent;
+#else
+	struct iovec v[ MAX_NET_IOVECS ];
+	struct msghdr h;
+	int i;
+
+	for ( i = 0; i < count; i++ ) {
+		v[i].iov_base = (void *)iov[i].data;
+		v[i].iov_len = iov[i].length;
+	}
+
+	memset( &h, 0, sizeof( h ) );
+	h.msg_name = (void *)addr;
+	h.msg_namelen = addrlen;
+	h.msg_iov = v;
+	h.msg_iovlen = count;
+
+	return sendmsg( s, &h, 0 );
+#endif
+}
+
+
 /*
 ==================
 Sys_SendPacket
 ==================
 */
 void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
+	netIovec_t iov;
+
+	iov.data = data;
+	iov.length = length;
+
+	Sys_SendPacketV( 1, &iov, to );
+}
+
+
+/*
+==================
+Sys_SendPacketV
+
+Sends up to MAX_NET_IOVECS pieces as a single datagram
+==================
+*/
+void Sys_SendPacketV( int count, const netIovec_t *iov, const netadr_t *to ) {
 	int ret = SOCKET_ERROR;
 	sockaddr_t addr;
+	int length, i;
 
 	switch ( to->type ) {
 		case NA_BROADCAST:
@@ -782,6 +1136,11 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
 			return;
 	}
 
+	if ( count < 1 || count > MAX_NET_IOVECS ) {
+		Com_Error( ERR_FATAL, "Sys_SendPacket: bad piece count %i", count );
+		return;
+	}
+
 #ifdef USE_IPV6
 	if( (ip_socket == INVALID_SOCKET && to->type == NA_IP) ||
 		(ip_socket == INVALID_SOCKET && to->type == NA_BROADCAST) ||
@@ -796,28 +1155,50 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
 		return;
 #endif
 
+	for ( i = 0, length = 0; i < count; i++ ) {
+		length += iov[i].length;
+	}
+
 	NetadrToSockadr( to, &addr );
 
 	if ( usingSocks && to->type == NA_IP ) {
 		socks5_udp_request_t cmd;
 
 		if ( length <= sizeof( cmd.s.u.v4.data ) ) {
+			byte *data;
 			cmd.s.reserved[0] = 0;
 			cmd.s.reserved[1] = 0;
 			cmd.s.fragnum = 0;  // not fragmented
 			cmd.s.addrtype = 1; // address type: IPV4
 			cmd.s.u.v4.addr.s_addr = addr.v4.sin_addr.s_addr;
 			cmd.s.u.v4.port = addr.v4.sin_port;
-			memcpy( cmd.s.u.v4.data, data, length );
+			for ( i = 0, data = (byte *)cmd.s.u.v4.data; i < count; i++ ) {
+				memcpy( data, iov[i].data, iov[i].length );
+				data += iov[i].length;
+			}
 			ret = sendto( ip_socket, cmd.buf, length + 10, 0, ( struct sockaddr * ) &socksRelayAddr.v4, sizeof( socksRelayAddr.v4 ) );
 		}
 	}
 	else {
+#ifdef USE_MMSG
+		if ( sendBatching && to->type != NA_BROADCAST ) {
+			if ( addr.ss.ss_family == AF_INET ) {
+				if ( NET_QueueSendBatch( ip_socket, &ip_send, length, count, iov, &addr, sizeof( struct sockaddr_in ) ) )
+					return;
+			}
+#ifdef USE_IPV6
+			else if ( addr.ss.ss_family == AF_INET6 ) {
+				if ( NET_QueueSendBatch( ip6_socket, &ip6_send, length, count, iov, &addr, sizeof( struct sockaddr_in6 ) ) )
+					return;
+			}
+#endif
+		}
+#endif
 		if ( addr.ss.ss_family == AF_INET )
-			ret = sendto( ip_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in) );
+			ret = NET_SendTo( ip_socket, count, iov, &addr, sizeof(struct sockaddr_in) );
 #ifdef USE_IPV6
 		else if ( addr.ss.ss_family == AF_INET6 )
-			ret = sendto( ip6_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in6) );
+			ret = NET_SendTo( ip6_socket, count, iov, &addr, sizeof(struct sockaddr_in6) );
 #endif
 	}
 
@@ -961,11 +1342,14 @@ void Sys_ShowIP( void ) {
 NET_IPSocket
 ====================
 */
-static SOCKET NET_IPSocket( const char *net_interface, int port, int *err ) {
+static SOCKET NET_IPSocket( const char *net_interface, int port, int reuse, int *err ) {
 	SOCKET				newsocket;
 	struct sockaddr_in	address;
 	ioctlarg_t			_true = 1;
 	int					i = 1;
+#ifdef SO_REUSEPORT
+	SOCKET				probe;
+#endif
 
 	*err = 0;
 
@@ -1014,6 +1398,30 @@ static SOCKET NET_IPSocket( const char *net_interface, int port, int *err ) {
 		address.sin_port = htons( (short)port );
 	}
 
+#ifdef SO_REUSEPORT
+	if ( reuse == NET_REUSE_FIRST ) {
+		// SO_REUSEPORT would let us join another server's socket group
+		// so check that port is really free with exclusive bind first
+		probe = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
+		if ( probe != INVALID_SOCKET ) {
+			if ( bind( probe, (void *)&address, sizeof(address) ) == SOCKET_ERROR ) {
+				Com_Printf( "WARNING: NET_IPSocket: bind: %s\n", NET_ErrorString() );
+				*err = socketError;
+				closesocket( probe );
+				closesocket( newsocket );
+				return INVALID_SOCKET;
+			}
+			closesocket( probe );
+		}
+	}
+
+	if ( reuse != NET_REUSE_NONE ) {
+		if ( setsockopt( newsocket, SOL_SOCKET, SO_REUSEPORT, (char *) &i, sizeof(i) ) == SOCKET_ERROR ) {
+			Com_Printf( "WARNING: NET_IPSocket: setsockopt SO_REUSEPORT: %s\n", NET_ErrorString() );
+		}
+	}
+#endif
+
 	if( bind( newsocket, (void *)&address, sizeof(address) ) == SOCKET_ERROR ) {
 		Com_Printf( "WARNING: NET_IPSocket: bind: %s\n", NET_ErrorString() );
 		*err = socketError;
@@ -1515,6 +1923,7 @@ static void NET_OpenIP( void ) {
 	int		i;
 	int		err;
 	int		port;
+	int		reuse;
 #ifdef USE_IPV6
 	int		port6;
 #endif
@@ -1553,8 +1962,13 @@ static void NET_OpenIP( void ) {
 
 	if(net_enabled->integer & NET_ENABLEV4)
 	{
+		reuse = NET_REUSE_NONE;
+#ifdef USE_RECV_THREADS
+		if ( com_dedicated->integer && net_recvThreads->integer > 1 && !net_socksEnabled->integer )
+			reuse = NET_REUSE_FIRST;
+#endif
 		for( i = 0 ; i < 10 ; i++ ) {
-			ip_socket = NET_IPSocket( net_ip->string, port + i, &err );
+			ip_socket = NET_IPSocket( net_ip->string, port + i, reuse, &err );
 			if (ip_socket != INVALID_SOCKET) {
 				Cvar_SetIntegerValue( "net_port", port + i );
 
@@ -1675,6 +2089,15 @@ static qboolean NET_GetCvars( void ) {
 	modified += net_socksPassword->modified;
 	net_socksPassword->modified = qfalse;
 
+#ifdef USE_RECV_THREADS
+	net_recvThreads = Cvar_Get( "net_recvThreads", "0", CVAR_LATCH | CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( net_recvThreads, "0", XSTRING( MAX_RECV_THREADS ), CV_INTEGER );
+	Cvar_SetDescription( net_recvThreads, "Number of threads reading IPv4 traffic on dedicated server, each one with its own SO_REUSEPORT socket. "
+		"Status and info queries are answered from these threads so query floods can't stall the game frame, 0 - disabled." );
+	modified += net_recvThreads->modified;
+	net_recvThreads->modified = qfalse;
+#endif
+
 	net_dropsim = Cvar_Get( "net_dropsim", "", CVAR_TEMP );
 	Cvar_SetDescription( net_dropsim, "Simulated packet drops." );
 
@@ -1682,6 +2105,435 @@ static qboolean NET_GetCvars( void ) {
 }
 
 
+#ifdef USE_POLLER
+/*
+====================
+NET_ClosePoller
+====================
+*/
+static void NET_ClosePoller( void ) {
+#ifdef USE_EPOLL
+	if ( timer_fd != -1 ) {
+		close( timer_fd );
+		timer_fd = -1;
+	}
+#endif
+	if ( poll_fd != -1 ) {
+		close( poll_fd );
+		poll_fd = -1;
+	}
+}
+
+
+/*
+====================
+NET_PollAdd
+====================
+*/
+static qboolean NET_PollAdd( int fd ) {
+#ifdef USE_EPOLL
+	struct epoll_event ev;
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	return epoll_ctl( poll_fd, EPOLL_CTL_ADD, fd, &ev ) == 0 ? qtrue : qfalse;
+#else
+	struct kevent ev;
+
+	EV_SET( &ev, fd, EVFILT_READ, EV_ADD, 0, 0, NULL );
+
+	return kevent( poll_fd, &ev, 1, NULL, 0, NULL ) == 0 ? qtrue : qfalse;
+#endif
+}
+
+
+/*
+====================
+NET_OpenPoller
+
+Registers opened sockets, NET_Sleep will fallback to select() on failure
+====================
+*/
+static void NET_OpenPoller( void ) {
+	qboolean ok;
+
+	NET_ClosePoller();
+
+#ifdef USE_EPOLL
+	poll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if ( poll_fd == -1 ) {
+		return;
+	}
+	timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	ok = ( timer_fd != -1 && NET_PollAdd( timer_fd ) ) ? qtrue : qfalse;
+#else
+	poll_fd = kqueue();
+	if ( poll_fd == -1 ) {
+		return;
+	}
+	ok = qtrue;
+#endif
+
+	if ( ok && ip_socket != INVALID_SOCKET ) {
+		ok = NET_PollAdd( ip_socket );
+	}
+#ifdef USE_IPV6
+	if ( ok && ip6_socket != INVALID_SOCKET ) {
+		ok = NET_PollAdd( ip6_socket );
+	}
+#endif
+
+	if ( !ok ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: NET_OpenPoller: %s, using select()\n", NET_ErrorString() );
+		NET_ClosePoller();
+	}
+}
+
+
+/*
+====================
+NET_PollWait
+
+Returns number of ready sockets, marked in fdr
+====================
+*/
+static int NET_PollWait( int timeout, fd_set *fdr ) {
+#ifdef USE_EPOLL
+	struct epoll_event ev[4];
+	struct itimerspec its;
+#else
+	struct kevent ev[4];
+	struct timespec ts;
+#endif
+	int i, n, fd, count;
+
+	FD_ZERO( fdr );
+
+#ifdef USE_EPOLL
+	if ( timeout > 0 ) {
+		// re-arming also resets any expiration left from previous wait
+		memset( &its, 0, sizeof( its ) );
+		its.it_value.tv_sec = timeout / 1000000;
+		its.it_value.tv_nsec = ( timeout % 1000000 ) * 1000;
+		timerfd_settime( timer_fd, 0, &its, NULL );
+		n = epoll_wait( poll_fd, ev, ARRAY_LEN( ev ), -1 );
+	} else {
+		n = epoll_wait( poll_fd, ev, ARRAY_LEN( ev ), 0 );
+	}
+#else
+	ts.tv_sec = timeout / 1000000;
+	ts.tv_nsec = ( timeout % 1000000 ) * 1000;
+	n = kevent( poll_fd, NULL, 0, ev, ARRAY_LEN( ev ), &ts );
+#endif
+
+	if ( n < 0 ) {
+		return SOCKET_ERROR;
+	}
+
+	count = 0;
+	for ( i = 0; i < n; i++ ) {
+#ifdef USE_EPOLL
+		fd = ev[i].data.fd;
+#else
+		fd = (int)ev[i].ident;
+#endif
+#ifdef USE_RECV_THREADS
+		if ( fd == event_fd ) {
+			uint64_t value;
+			// reset counter, queue is checked in NET_GetPacket
+			if ( read( event_fd, &value, sizeof( value ) ) < 0 ) {
+				continue;
+			}
+			count++;
+			continue;
+		}
+#endif
+		if ( fd == ip_socket ) {
+			FD_SET( fd, fdr );
+			count++;
+		}
+#ifdef USE_IPV6
+		else if ( fd == ip6_socket ) {
+			FD_SET( fd, fdr );
+			count++;
+		}
+#endif
+	}
+
+	return count;
+}
+#endif // USE_POLLER
+
+
+#ifdef USE_RECV_THREADS
+/*
+====================
+NET_QueueRecvPacket
+====================
+*/
+static void NET_QueueRecvPacket( const netadr_t *from, const msg_t *msg )
+{
+	queuedPacket_t *qp;
+	uint64_t value = 1;
+	int next;
+
+	Sys_LockMutex( queue_lock );
+	next = ( queueHead + 1 ) % RECV_QUEUE_SIZE;
+	if ( next == queueTail ) {
+		queueDrops++;
+		Sys_UnlockMutex( queue_lock );
+		return;
+	}
+	qp = &recvQueue[ queueHead ];
+	qp->from = *from;
+	qp->length = msg->cursize;
+	memcpy( qp->data, msg->data, msg->cursize );
+	queueHead = next;
+	Sys_UnlockMutex( queue_lock );
+
+	if ( write( event_fd, &value, sizeof( value ) ) < 0 ) {
+		// counter overflow, main thread is going to wake anyway
+	}
+}
+
+
+/*
+====================
+NET_GetQueuedPacket
+====================
+*/
+static qboolean NET_GetQueuedPacket( netadr_t *net_from, msg_t *net_message )
+{
+	const queuedPacket_t *qp;
+
+	if ( !numRecvThreads ) {
+		return qfalse;
+	}
+
+	Sys_LockMutex( queue_lock );
+	if ( queueTail == queueHead ) {
+		Sys_UnlockMutex( queue_lock );
+		return qfalse;
+	}
+	qp = &recvQueue[ queueTail ];
+	*net_from = qp->from;
+	memcpy( net_message->data, qp->data, qp->length );
+	net_message->cursize = qp->length;
+	net_message->readcount = 0;
+	queueTail = ( queueTail + 1 ) % RECV_QUEUE_SIZE;
+	Sys_UnlockMutex( queue_lock );
+
+	return qtrue;
+}
+
+
+/*
+====================
+NET_RecvThread
+====================
+*/
+static void NET_RecvThread( void *arg )
+{
+	byte		buf[ MAX_MSGLEN_BUF ];
+	SOCKET		sock = recv_sockets[ (intptr_t)arg ];
+	struct pollfd pfd;
+	sockaddr_t	from;
+	socklen_t	fromlen;
+	netadr_t	adr;
+	msg_t		msg;
+	qboolean	handled;
+	int			ret;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+
+	while ( !recvQuit ) {
+		// timeout just in case if shutdown() won't wake us
+		if ( poll( &pfd, 1, 250 ) <= 0 ) {
+			continue;
+		}
+
+		fromlen = sizeof( from );
+		ret = recvfrom( sock, (void *)buf, MAX_MSGLEN, 0, (struct sockaddr *) &from, &fromlen );
+		if ( ret == SOCKET_ERROR || recvQuit ) {
+			continue;
+		}
+
+		// oversize packets are dropped as in NET_GetPacket
+		if ( ret >= MAX_MSGLEN ) {
+			continue;
+		}
+
+		memset( &from.v4.sin_zero, 0, sizeof( from.v4.sin_zero ) );
+		adr.type = NA_BAD;
+		SockadrToNetadr( &from, &adr );
+
+		MSG_Init( &msg, buf, MAX_MSGLEN );
+		msg.cursize = ret;
+
+		handled = qfalse;
+		if ( ret >= 4 && *(int32_t *)buf == -1 ) {
+			// main thread is suspended while we are holding net_lock
+			Sys_LockMutex( net_lock );
+			if ( !recvQuit ) {
+				handled = SV_OffloadPacket( &adr, &msg );
+			}
+			Sys_UnlockMutex( net_lock );
+		}
+
+		if ( !handled && ret <= RECV_PACKET_SIZE ) {
+			NET_QueueRecvPacket( &adr, &msg );
+		}
+	}
+}
+
+
+/*
+====================
+NET_StopRecvThreads
+====================
+*/
+static void NET_StopRecvThreads( void )
+{
+	int i;
+
+	if ( !net_lock ) {
+		return;
+	}
+
+	recvQuit = qtrue;
+
+	for ( i = 0; i < numRecvThreads; i++ ) {
+		shutdown( recv_sockets[ i ], SHUT_RD );
+	}
+
+	// let threads finish pending queries
+	if ( net_locked ) {
+		Sys_UnlockMutex( net_lock );
+		net_locked = qfalse;
+	}
+
+	for ( i = 0; i < numRecvThreads; i++ ) {
+		Com_JoinThread( recv_threads[ i ] );
+		recv_threads[ i ] = NULL;
+		// first one is ip_socket which is closed by caller
+		if ( i > 0 ) {
+			closesocket( recv_sockets[ i ] );
+		}
+		recv_sockets[ i ] = INVALID_SOCKET;
+	}
+
+	if ( queueDrops ) {
+		Com_DPrintf( "...%i packets dropped on receive queue overflow\n", queueDrops );
+	}
+
+	numRecvThreads = 0;
+
+	Sys_DestroyMutex( net_lock );
+	Sys_DestroyMutex( queue_lock );
+	net_lock = NULL;
+	queue_lock = NULL;
+
+	if ( event_fd != -1 ) {
+		close( event_fd );
+		event_fd = -1;
+	}
+
+	if ( recvQueue ) {
+		Z_Free( recvQueue );
+		recvQueue = NULL;
+	}
+}
+
+
+/*
+====================
+NET_StartRecvThreads
+====================
+*/
+static void NET_StartRecvThreads( void )
+{
+	struct epoll_event ev;
+	int i, count, err;
+
+	count = net_recvThreads->integer;
+
+	if ( count <= 0 || !com_dedicated->integer || usingSocks || ip_socket == INVALID_SOCKET || poll_fd == -1 ) {
+		return;
+	}
+
+	net_lock = Sys_CreateMutex();
+	queue_lock = Sys_CreateMutex();
+	event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.fd = event_fd;
+
+	if ( !net_lock || !queue_lock || event_fd == -1 || epoll_ctl( poll_fd, EPOLL_CTL_ADD, event_fd, &ev ) != 0 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: NET_StartRecvThreads: failed to create synchronization objects\n" );
+		Sys_DestroyMutex( net_lock );
+		Sys_DestroyMutex( queue_lock );
+		net_lock = queue_lock = NULL;
+		if ( event_fd != -1 ) {
+			close( event_fd );
+			event_fd = -1;
+		}
+		return;
+	}
+
+	recvQueue = Z_Malloc( RECV_QUEUE_SIZE * sizeof( recvQueue[0] ) );
+	queueHead = queueTail = queueDrops = 0;
+
+	recv_sockets[ 0 ] = ip_socket;
+	for ( i = 1; i < count; i++ ) {
+		recv_sockets[ i ] = NET_IPSocket( net_ip->string, net_port->integer, NET_REUSE_JOIN, &err );
+		if ( recv_sockets[ i ] == INVALID_SOCKET ) {
+			break;
+		}
+	}
+	count = i;
+
+	Sys_LockMutex( net_lock );
+	net_locked = qtrue;
+	recvQuit = qfalse;
+
+	for ( i = 0; i < count; i++ ) {
+		recv_threads[ i ] = Com_CreateThread( JOB_POOL_IO, "net recv", NET_RecvThread, (void *)(intptr_t)i );
+		if ( !recv_threads[ i ] ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: failed to create network thread %i\n", i );
+			break;
+		}
+	}
+
+	// sockets without thread
+	while ( count > i ) {
+		count--;
+		if ( count > 0 ) {
+			closesocket( recv_sockets[ count ] );
+		}
+		recv_sockets[ count ] = INVALID_SOCKET;
+	}
+
+	numRecvThreads = count;
+
+	if ( !numRecvThreads ) {
+		Sys_UnlockMutex( net_lock );
+		net_locked = qfalse;
+		NET_StopRecvThreads();
+		return;
+	}
+
+	// main thread doesn't read ip_socket anymore
+	epoll_ctl( poll_fd, EPOLL_CTL_DEL, ip_socket, &ev );
+
+	Com_Printf( "...started %i network threads\n", numRecvThreads );
+}
+#endif // USE_RECV_THREADS
+
+
 /*
 ====================
 NET_Config
@@ -1727,6 +2579,21 @@ static void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if( stop ) {
+		Sys_EndSendBatch();
+
+		ip_recv.count = ip_recv.next = 0;
+#ifdef USE_IPV6
+		ip6_recv.count = ip6_recv.next = 0;
+		multicast6_recv.count = multicast6_recv.next = 0;
+#endif
+
+#ifdef USE_RECV_THREADS
+		NET_StopRecvThreads();
+#endif
+#ifdef USE_POLLER
+		NET_ClosePoller();
+#endif
+
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -1759,6 +2626,12 @@ static void NET_Config( qboolean enableNetworking ) {
 			NET_OpenIP();
 #ifdef USE_IPV6
 			NET_SetMulticast6();
+#endif
+#ifdef USE_POLLER
+			NET_OpenPoller();
+#endif
+#ifdef USE_RECV_THREADS
+			NET_StartRecvThreads();
 #endif
 		}
 	}
@@ -1813,7 +2686,7 @@ void NET_Shutdown( void ) {
 ====================
 NET_Event
 
-Called from NET_Sleep which uses select() to determine which sockets have seen action.
+Called from NET_Sleep which uses select() or epoll/kqueue to determine which sockets have seen action.
 ====================
 */
 static void NET_Event( const fd_set *fdr )
@@ -1864,11 +2737,24 @@ qboolean NET_Sleep( int timeout )
 	struct timeval tv;
 	fd_set fdr;
 	int retval;
+	qboolean pending;
 	SOCKET highestfd = INVALID_SOCKET;
 
+	// in case if batch was interrupted by error
+	Sys_EndSendBatch();
+
 	if ( timeout < 0 )
 		timeout = 0;
 
+	// datagrams left from previous batched receive
+	pending = NET_RECV_PENDING( &ip_recv ) ? qtrue : qfalse;
+#ifdef USE_IPV6
+	if ( NET_RECV_PENDING( &ip6_recv ) || NET_RECV_PENDING( &multicast6_recv ) )
+		pending = qtrue;
+#endif
+	if ( pending )
+		timeout = 0;
+
 	FD_ZERO( &fdr );
 
 	if ( ip_socket != INVALID_SOCKET )
@@ -1903,12 +2789,37 @@ qboolean NET_Sleep( int timeout )
 #endif
 	}
 
-	tv.tv_sec = timeout / 1000000;
-	tv.tv_usec = timeout - tv.tv_sec * 1000000;
+#ifdef USE_RECV_THREADS
+	if ( numRecvThreads ) {
+		Sys_LockMutex( queue_lock );
+		if ( queueHead != queueTail )
+			pending = qtrue;
+		Sys_UnlockMutex( queue_lock );
+		if ( pending )
+			timeout = 0;
+		// let network threads answer queries while we are idle
+		net_locked = qfalse;
+		Sys_UnlockMutex( net_lock );
+		retval = NET_PollWait( timeout, &fdr );
+		Sys_LockMutex( net_lock );
+		net_locked = qtrue;
+	} else
+#endif
+#ifdef USE_POLLER
+	if ( poll_fd != -1 ) {
+		retval = NET_PollWait( timeout, &fdr );
+	} else
+#endif
+	{
+		tv.tv_sec = timeout / 1000000;
+		tv.tv_usec = timeout - tv.tv_sec * 1000000;
 
-	retval = select( highestfd + 1, &fdr, NULL, NULL, &tv );
+		retval = select( highestfd + 1, &fdr, NULL, NULL, &tv );
+	}
 
-	if ( retval > 0 ) {
+	if ( retval > 0 || pending ) {
+		if ( retval <= 0 )
+			FD_ZERO( &fdr );
 		NET_Event( &fdr );
 		return qfalse;
 	}
@@ -1917,7 +2828,7 @@ qboolean NET_Sleep( int timeout )
 #ifndef _WIN32
 		if ( socketError != EINTR )
 #endif
-		Com_Printf( S_COLOR_YELLOW "Warning: select() syscall failed: %s\n", 
+		Com_Printf( S_COLOR_YELLOW "Warning: NET_Sleep() syscall failed: %s\n", 
 			NET_ErrorString() );
 	}
 
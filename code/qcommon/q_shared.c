@@ -954,22 +954,108 @@ SkipBracedSection
 The next token should be an open brace or set depth to 1 if already parsed it.
 Skips until a matching close brace is found.
 Internal brace depths are properly skipped.
+
+Tokenizes exactly like COM_ParseExt( program, qtrue ) but only the
+last token is copied into com_token, shader scripts are scanned with
+this several times during renderer startup
 =================
 */
 qboolean SkipBracedSection( const char **program, int depth ) {
-	const char			*token;
+	const char	*data, *start;
+	int			c, len;
 
-	do {
-		token = COM_ParseExt( program, qtrue );
-		if( token[1] == 0 ) {
-			if( token[0] == '{' ) {
-				depth++;
+	data = *program;
+	start = NULL;
+	len = 0;
+	com_tokenline = 0;
+
+	while ( data ) {
+		// skip whitespace and comments
+		while ( 1 ) {
+			while ( ( c = *data ) <= ' ' ) {
+				if ( !c ) {
+					data = NULL;
+					break;
+				}
+				if ( c == '\n' ) {
+					com_lines++;
+				}
+				data++;
+			}
+			if ( !data ) {
+				break;
 			}
-			else if( token[0] == '}' ) {
+			if ( c == '/' && data[1] == '/' ) {
+				data += 2;
+				while ( *data && *data != '\n' ) {
+					data++;
+				}
+			} else if ( c == '/' && data[1] == '*' ) {
+				data += 2;
+				while ( *data && ( *data != '*' || data[1] != '/' ) ) {
+					if ( *data == '\n' ) {
+						com_lines++;
+					}
+					data++;
+				}
+				if ( *data ) {
+					data += 2;
+				}
+			} else {
+				break;
+			}
+		}
+
+		if ( !data ) {
+			com_tokenline = 0;
+			len = 0;
+			break;
+		}
+
+		com_tokenline = com_lines;
+
+		if ( c == '"' ) {
+			start = ++data;
+			while ( ( c = *data ) != '"' && c != '\0' ) {
+				if ( c == '\n' ) {
+					com_lines++;
+				}
+				data++;
+			}
+			len = data - start;
+			if ( c == '"' ) {
+				data++;
+			}
+		} else {
+			start = data;
+			do {
+				data++;
+			} while ( *data > ' ' );
+			len = data - start;
+		}
+
+		if ( len == 1 ) {
+			if ( *start == '{' ) {
+				depth++;
+			} else if ( *start == '}' ) {
 				depth--;
 			}
 		}
-	} while( depth && *program );
+
+		if ( !depth ) {
+			break;
+		}
+	}
+
+	if ( len > MAX_TOKEN_CHARS - 1 ) {
+		len = MAX_TOKEN_CHARS - 1;
+	}
+	if ( len ) {
+		memcpy( com_token, start, len );
+	}
+	com_token[ len ] = '\0';
+
+	*program = data;
 
 	return ( depth == 0 );
 }
@@ -1896,28 +1982,76 @@ const char *Info_ValueForKey( const char *s, const char *key )
 }
 
 
-#define MAX_INFO_TOKENS ((MAX_INFO_STRING/3)+2)
+/*
+===================
+Info_DictHash
+===================
+*/
+static int Info_DictHash( const char *key, int len )
+{
+	int hash, i;
+
+	hash = 0;
+	for ( i = 0; i < len; i++ )
+		hash += locase[ (byte)key[i] ] * ( 119 + i );
+
+	return ( hash ^ ( hash >> 6 ) ) & ( INFO_DICT_HASH - 1 );
+}
 
-static const char *info_keys[ MAX_INFO_TOKENS ];
-static const char *info_values[ MAX_INFO_TOKENS ];
-static int info_tokens;
 
 /*
 ===================
-Info_Tokenize
+Info_DictAdd
+===================
+*/
+static void Info_DictAdd( infoDict_t *dict, int key, int value )
+{
+	const char *k = dict->data + key;
+	int len, hash, i;
 
-Tokenizes all key/value pairs from specified infostring
-NOT suitable for big infostrings
+	len = (int)strlen( k );
+	hash = Info_DictHash( k, len );
+
+	// first occurrence wins, as with Info_ValueForKey()
+	for ( i = dict->hashTable[ hash ]; i; i = dict->hashNext[ i - 1 ] )
+	{
+		if ( Q_stricmp( dict->data + dict->keys[ i - 1 ], k ) == 0 )
+			return;
+	}
+
+	dict->keys[ dict->numKeys ] = key;
+	dict->values[ dict->numKeys ] = value;
+	dict->hashNext[ dict->numKeys ] = dict->hashTable[ hash ];
+	dict->hashTable[ hash ] = ++dict->numKeys;
+}
+
+
+/*
+===================
+Info_DictParse
+
+Splits infostring into key/value pairs with hashed keys so any number of
+lookups costs about the same as a single Info_ValueForKey() call. Strings
+that don't fit are not copied and lookups fall back to Info_ValueForKey()
+on the source string, which then must stay unchanged while dict is used
 ===================
 */
-void Info_Tokenize( const char *s )
+qboolean Info_DictParse( infoDict_t *dict, const char *s )
 {
-	static char tokenBuffer[ MAX_INFO_STRING ];
-	char *o = tokenBuffer;
+	char *o = dict->data;
+	int key;
 
-	info_tokens = 0;
+	dict->numKeys = 0;
+	dict->source = NULL;
+	Com_Memset( dict->hashTable, 0, sizeof( dict->hashTable ) );
 	*o = '\0';
 
+	if ( strlen( s ) >= sizeof( dict->data ) )
+	{
+		dict->source = s;
+		return qfalse;
+	}
+
 	for ( ;; )
 	{
 		while ( *s == '\\' ) // skip leading/trailing separators
@@ -1926,46 +2060,52 @@ void Info_Tokenize( const char *s )
 		if ( *s == '\0' )
 			break;
 
-		info_keys[ info_tokens ] = o;
+		key = (int)( o - dict->data );
 		while ( *s != '\\' )
 		{
 			if ( *s == '\0' )
 			{
 				*o = '\0'; // terminate key
-				info_values[ info_tokens++ ] = o;
-				return;
+				Info_DictAdd( dict, key, (int)( o - dict->data ) );
+				return qtrue;
 			}
 			*o++ = *s++;
 		}
 		*o++ = '\0'; // terminate key
 		s++; // skip '\\'
 
-		info_values[ info_tokens++ ] = o;
+		Info_DictAdd( dict, key, (int)( o - dict->data ) );
 		while ( *s != '\\' && *s != '\0' )
 		{
 			*o++ = *s++;
 		}
 		*o++ = '\0';
 	}
+
+	return qtrue;
 }
 
 
 /*
 ===================
-Info_ValueForKeyToken
+Info_DictValue
 
-Fast lookup from tokenized infostring
+Returns value from parsed infostring or an empty string,
+result stays valid until dict is parsed again
 ===================
 */
-const char *Info_ValueForKeyToken( const char *key )
+const char *Info_DictValue( const infoDict_t *dict, const char *key )
 {
 	int i;
 
-	for ( i = 0; i < info_tokens; i++ ) 
+	if ( dict->source )
+		return Info_ValueForKey( dict->source, key );
+
+	for ( i = dict->hashTable[ Info_DictHash( key, (int)strlen( key ) ) ]; i; i = dict->hashNext[ i - 1 ] )
 	{
-		if ( Q_stricmp( info_keys[ i ], key ) == 0 )
+		if ( Q_stricmp( dict->data + dict->keys[ i - 1 ], key ) == 0 )
 		{
-			return info_values[ i ];
+			return dict->data + dict->values[ i - 1 ];
 		}
 	}
 
@@ -1973,6 +2113,35 @@ const char *Info_ValueForKeyToken( const char *key )
 }
 
 
+static infoDict_t info_dict;
+
+/*
+===================
+Info_Tokenize
+
+Tokenizes all key/value pairs from specified infostring
+for following Info_ValueForKeyToken() calls
+===================
+*/
+void Info_Tokenize( const char *s )
+{
+	Info_DictParse( &info_dict, s );
+}
+
+
+/*
+===================
+Info_ValueForKeyToken
+
+Fast lookup from tokenized infostring
+===================
+*/
+const char *Info_ValueForKeyToken( const char *key )
+{
+	return Info_DictValue( &info_dict, key );
+}
+
+
 /*
 ===================
 Info_NextPair
@@ -2234,3 +2403,116 @@ const char *Com_SkipTokens( const char *s, int numTokens, const char *sep )
 	else
 		return s;
 }
+
+
+#ifndef Q3_VM
+/*
+==================
+Com_WordBits
+
+Converts word to little-endian bit order
+==================
+*/
+static uint64_t Com_WordBits( uint64_t w )
+{
+#ifdef Q3_BIG_ENDIAN
+	w = ( ( w & 0x00000000FFFFFFFFULL ) << 32 ) | ( ( w & 0xFFFFFFFF00000000ULL ) >> 32 );
+	w = ( ( w & 0x0000FFFF0000FFFFULL ) << 16 ) | ( ( w & 0xFFFF0000FFFF0000ULL ) >> 16 );
+	w = ( ( w & 0x00FF00FF00FF00FFULL ) << 8 ) | ( ( w & 0xFF00FF00FF00FF00ULL ) >> 8 );
+#endif
+	return w;
+}
+
+
+/*
+==================
+Com_LowestBit
+
+Index of the lowest set bit, mask must not be zero
+==================
+*/
+static int Com_LowestBit( uint64_t mask )
+{
+#if defined (__GNUC__) || defined (__clang__)
+	return __builtin_ctzll( mask );
+#else
+	int n = 0;
+	if ( !( mask & 0xFFFFFFFFULL ) ) { n += 32; mask >>= 32; }
+	if ( !( mask & 0xFFFFULL ) ) { n += 16; mask >>= 16; }
+	if ( !( mask & 0xFFULL ) ) { n += 8; mask >>= 8; }
+	if ( !( mask & 0xFULL ) ) { n += 4; mask >>= 4; }
+	if ( !( mask & 0x3ULL ) ) { n += 2; mask >>= 2; }
+	if ( !( mask & 0x1ULL ) ) { n += 1; }
+	return n;
+#endif
+}
+
+
+/*
+==================
+Com_TestBitRange
+
+Returns qtrue if any bit in [first..last] is set
+==================
+*/
+qboolean Com_TestBitRange( const uint64_t *words, int first, int last )
+{
+	uint64_t mask;
+	int i, lastWord;
+
+	if ( first > last ) {
+		return qfalse;
+	}
+
+	i = first >> 6;
+	lastWord = last >> 6;
+	mask = ~0ULL << ( first & 63 );
+
+	for ( ; i < lastWord; i++ ) {
+		if ( Com_WordBits( words[i] ) & mask ) {
+			return qtrue;
+		}
+		mask = ~0ULL;
+	}
+
+	mask &= ~0ULL >> ( 63 - ( last & 63 ) );
+
+	return ( Com_WordBits( words[i] ) & mask ) ? qtrue : qfalse;
+}
+
+
+/*
+==================
+Com_NextBit
+
+Returns index of the first set bit starting from bit, -1 if there are no more
+==================
+*/
+int Com_NextBit( const uint64_t *words, int numWords, int bit )
+{
+	uint64_t w;
+	int i;
+
+	if ( bit < 0 ) {
+		bit = 0;
+	}
+
+	i = bit >> 6;
+	if ( i >= numWords ) {
+		return -1;
+	}
+
+	w = Com_WordBits( words[i] ) & ( ~0ULL << ( bit & 63 ) );
+	while ( !w ) {
+		if ( ++i >= numWords ) {
+			return -1;
+		}
+		w = words[i];
+		if ( w ) {
+			w = Com_WordBits( w );
+		}
+	}
+
+	return ( i << 6 ) + Com_LowestBit( w );
+}
+#endif
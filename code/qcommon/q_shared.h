@@ -140,6 +140,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define FORMAT_PRINTF(x, y) /* nothing */
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+#define THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL /* nothing */
+#endif
+
 /**********************************************************************
   VM Considerations
 
@@ -397,6 +405,13 @@ void Snd_Memset (void* dest, const int val, const size_t count);
 #define Com_Memset memset
 #define Com_Memcpy memcpy
 
+#ifndef Q3_VM
+// bit vectors stored as 64-bit words with the same bit order
+// as byte arrays, i.e. bit n is ( bytes[n >> 3] & ( 1 << ( n & 7 ) ) )
+qboolean	Com_TestBitRange( const uint64_t *words, int first, int last );
+int			Com_NextBit( const uint64_t *words, int numWords, int bit );
+#endif
+
 #define CIN_system	1
 #define CIN_loop	2
 #define	CIN_hold	4
@@ -913,7 +928,23 @@ void Com_TruncateLongString( char *buffer, const char *s );
 //
 // key / value info strings
 //
+#define MAX_INFO_DICT_KEYS	((MAX_INFO_STRING/3)+2)
+#define INFO_DICT_HASH		64
+
+// infostring split into pairs with hashed keys, see Info_DictParse()
+typedef struct {
+	const char	*source;					// too long to be copied, lookups use Info_ValueForKey()
+	int			numKeys;
+	short		hashTable[ INFO_DICT_HASH ];	// first key + 1 in each bucket
+	short		hashNext[ MAX_INFO_DICT_KEYS ];	// next key + 1 in the same bucket
+	short		keys[ MAX_INFO_DICT_KEYS ];		// offsets into data
+	short		values[ MAX_INFO_DICT_KEYS ];
+	char		data[ MAX_INFO_STRING ];
+} infoDict_t;
+
 const char *Info_ValueForKey( const char *s, const char *key );
+qboolean Info_DictParse( infoDict_t *dict, const char *s );
+const char *Info_DictValue( const infoDict_t *dict, const char *key );
 void Info_Tokenize( const char *s );
 const char *Info_ValueForKeyToken( const char *key );
 #define Info_SetValueForKey( buf, key, value ) Info_SetValueForKey_s( (buf), MAX_INFO_STRING, (key), (value) )
@@ -1012,8 +1043,9 @@ struct cvar_s {
 	cvar_t		*prev;
 	cvar_t		*hashNext;
 	cvar_t		*hashPrev;
-	int			hashIndex;
+	unsigned int hashValue;			// full name hash, bucket is hashValue & (size-1)
 	cvarGroup_t	group;				// to track changes
+	void		(*onChange)( cvar_t *var );	// called when the value has changed
 };
 
 #define	MAX_CVAR_VALUE_STRING	256
@@ -1089,6 +1121,17 @@ typedef struct {
 	int		numPoints;
 } markFragment_t;
 
+// one projection for R_MarkFragmentsBatch(), the fragment range is returned
+#define MAX_MARK_REQUEST_POINTS	8
+
+typedef struct {
+	int		numPoints;
+	vec3_t	points[MAX_MARK_REQUEST_POINTS];
+	vec3_t	projection;
+	int		firstFragment;
+	int		numFragments;
+} markRequest_t;
+
 
 
 typedef struct {
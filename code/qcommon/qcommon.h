@@ -74,6 +74,7 @@ void MSG_Init( msg_t *buf, byte *data, int length );
 void MSG_InitOOB( msg_t *buf, byte *data, int length );
 void MSG_Clear( msg_t *buf );
 void MSG_WriteData( msg_t *buf, const void *data, int length );
+void MSG_WriteBitstream( msg_t *msg, const byte *data, int offset, int bits );
 void MSG_Bitstream( msg_t *buf );
 
 // TTimo
@@ -97,6 +98,8 @@ void MSG_WriteString (msg_t *sb, const char *s);
 void MSG_WriteBigString (msg_t *sb, const char *s);
 void MSG_WriteAngle16 (msg_t *sb, float f);
 int MSG_HashKey(const char *string, int maxlen);
+int MSG_LZCompress( byte *out, int outSize, const byte *in, int inLen );
+int MSG_LZDecompress( byte *out, int outSize, const byte *in, int inLen );
 
 void	MSG_BeginReading (msg_t *sb);
 void	MSG_BeginReadingOOB(msg_t *sb);
@@ -122,7 +125,10 @@ void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *
 void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const playerState_t *to );
 void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerState_t *to );
 
+void MSG_InitEntityWordFields( void );
 void MSG_ReportChangeVectors_f( void );
+void MSG_DeltaEntityBench_f( void );
+void MSG_BitsCheck_f( void );
 
 //============================================================================
 
@@ -193,10 +199,20 @@ typedef struct {
 #endif
 } netadr_t;
 
+// one piece of a datagram sent with scatter/gather
+typedef struct {
+	const void	*data;
+	int			length;
+} netIovec_t;
+
+#define MAX_NET_IOVECS	4
+
 void		NET_Init( void );
 void		NET_Shutdown( void );
 void		NET_FlushPacketQueue(void);
 void		NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t *to );
+void		NET_SendPacketV( netsrc_t sock, int count, const netIovec_t *iov, const netadr_t *to );
+int64_t		NET_BytesSent( netsrc_t sock );
 void		QDECL NET_OutOfBandPrint( netsrc_t net_socket, const netadr_t *adr, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
 void		NET_OutOfBandCompress( netsrc_t sock, const netadr_t *adr, const byte *data, int len );
 
@@ -226,6 +242,22 @@ qboolean	NET_Sleep( int timeout );
 						// will overflow the reliable commands buffer
 #define MAX_DOWNLOAD_BLKSIZE		1024	// 896 byte block chunks
 
+// download extension, requested with "download <file> <DL_EXT_VERSION>" and confirmed
+// by DL_EXT_MARKER after the file size in block zero. Blocks are large enough to be
+// carried as netchan fragments and the client only acks every DL_EXT_ACK_BLOCKS
+#define DL_EXT_VERSION				1
+#define DL_EXT_MARKER				-1
+#define DL_EXT_ACK_BLOCKS			8
+#define MAX_DOWNLOAD_WINDOW_EXT		128
+#define MAX_DOWNLOAD_BLKSIZE_EXT	(MAX_MSGLEN/2 - 64)	// still fits after worst case huffman expansion
+
+// gamestate extension, advertised with the optional "gsext" connect userinfo key, lets the
+// server put all configstrings into one LZ compressed svc_configstringBlock of
+// [short] index [string] entries once they are larger than GS_EXT_MIN_BLOCK
+#define GS_EXT_VERSION				1
+#define GS_EXT_MIN_BLOCK			1024
+#define GS_EXT_MAX_BLOCK			(MAX_GAMESTATE_CHARS + MAX_CONFIGSTRINGS*2)
+
 #define NETCHAN_GENCHECKSUM(challenge, sequence) ((challenge) ^ ((sequence) * (challenge)))
 
 /*
@@ -341,6 +373,9 @@ enum svc_ops_e {
 	// new commands, supported only by ioquake3 protocol but not legacy
 	svc_voipSpeex,     // not wrapped in USE_VOIP, so this value is reserved.
 	svc_voipOpus,      //
+
+	// gamestate extension, see GS_EXT_VERSION
+	svc_configstringBlock,		// [long] size [long] compressed size [bytes] only in gamestate messages
 };
 
 
@@ -412,6 +447,24 @@ void	VM_Clear(void);
 void	VM_Forced_Unload_Start(void);
 void	VM_Forced_Unload_Done(void);
 vm_t	*VM_Restart( vm_t *vm );
+qboolean	VM_MemoryStats( vmIndex_t index, const char **name, int *codeBytes, int *dataBytes );
+
+// native module state moved by VM_ReloadDll()
+typedef struct {
+	byte	*oldData;
+	byte	*newData;
+	size_t	dataSize;
+} vmReload_t;
+
+qboolean	VM_ReloadDll( vm_t *vm, vmReload_t *reload );
+void		*VM_ReloadPointer( const vmReload_t *reload, void *ptr );
+
+// extra instances sharing data segment of a loaded qvm, each with own stack
+// and compiled code so they can run vmMain on different threads
+void	VM_ReserveWorkers( vmIndex_t index, int count );
+vm_t	*VM_CreateWorker( vm_t *vm, int slot, syscall_t systemCalls );
+void	VM_ResetWorker( vm_t *worker );
+void	VM_FreeWorker( vm_t *worker );
 
 intptr_t	QDECL VM_Call( vm_t *vm, int nargs, int callNum, ... );
 
@@ -519,6 +572,7 @@ void	Cmd_CommandCompletion( void(*callback)(const char *s) );
 void	Cmd_SetCommandCompletionFunc( const char *command, completionFunc_t complete );
 qboolean Cmd_CompleteArgument( const char *command, const char *args, int argNum );
 void	Cmd_CompleteWriteCfgName( const char *args, int argNum );
+void	Cmd_Bench_f( void );
 
 int		Cmd_Argc( void );
 void	Cmd_Clear( void );
@@ -641,8 +695,12 @@ void	Cvar_CheckRange( cvar_t *cv, const char *minVal, const char *maxVal, cvarVa
 void	Cvar_SetDescription( cvar_t *var, const char *var_description );
 
 void	Cvar_SetGroup( cvar_t *var, cvarGroup_t group );
+void	Cvar_SetChangeCallback( cvar_t *var, void (*func)( cvar_t *var ) );
+// func runs right after each value change instead of polling var->modified
 int		Cvar_CheckGroup( cvarGroup_t group );
 void	Cvar_ResetGroup( cvarGroup_t group, qboolean resetModifiedFlags );
+int		Cvar_ListLatched( const char *prefix, const char **names, int maxNames );
+// names of cvars starting with prefix that wait for a restart to apply their latched values
 
 void	Cvar_Restart( qboolean unsetVM );
 
@@ -749,7 +807,9 @@ qboolean FS_ResetReadOnlyAttribute( const char *filename );
 qboolean FS_SV_FileExists( const char *file );
 
 fileHandle_t FS_SV_FOpenFileWrite( const char *filename );
+fileHandle_t FS_SV_FOpenFileAppend( const char *filename, int *length );
 int		FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp );
+const byte *FS_SV_MapFile( fileHandle_t f, int length, void **base, size_t *baseLength );
 void	FS_SV_Rename( const char *from, const char *to );
 int		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFILE );
 // if uniqueFILE is true, then a new FILE will be fopened even if the file
@@ -791,12 +851,46 @@ int		FS_ReadFile( const char *qpath, void **buffer );
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+int		FS_ReadFileAsync( const char *qpath );
+// starts loading a whole file on the background i/o threads and returns
+// a handle for FS_WaitFile, reads synchronously when fs_ioThreads is 0
+
+qboolean FS_AsyncFileReady( int handle );
+// true once FS_WaitFile on the handle will not block
+
+int		FS_WaitFile( int handle, void **buffer );
+// completes a FS_ReadFileAsync request, same results as FS_ReadFile,
+// the buffer must be released with FS_FreeFile
+
+qboolean FS_InflateBuffer( void *dest, int destLen, const void *source, int sourceLen );
+// inflates a raw deflate stream of exactly destLen bytes, thread safe
+
+int		FS_LoadStamp( void );
+// changes when the search path is rebuilt or reordered
+
+void	FS_ProfileBegin( const char *mapname );
+void	FS_ProfileEnd( void );
+// with fs_profile enabled records file reads of a level load and reports them
+
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
+void	FS_BufferWrites( fileHandle_t f );
+// further writes to the file are done by a background thread,
+// the handle can be used as before
+
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+int		FS_MapFile( const char *qpath, void **buffer );
+// returns the length of a loose file or stored pk3 entry mapped in place,
+// unwritten pages are shared with every process mapping the same file.
+// -1 length == not present or can't be mapped, use FS_ReadFile instead.
+// No 0 byte is appended, writes stay private to this process.
+
+void	FS_FreeMappedFile( void *buffer );
+// releases the view returned by FS_MapFile
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
@@ -885,6 +979,11 @@ char *FS_CopyString( const char *in );
 fileHandle_t FS_PipeOpenWrite( const char *cmd, const char *filename );
 void FS_PipeClose( fileHandle_t f );
 
+// forked server instances
+
+void FS_PrepareFork( void );
+void FS_ForkDone( void );
+
 
 /*
 ==============================================================
@@ -941,12 +1040,17 @@ extern	int	CPU_Flags;
 #define CPU_SSE2   0x08
 #define CPU_SSE3   0x10
 #define CPU_SSE41  0x20
+#define CPU_AVX    0x40
+#define CPU_AVX2   0x80
 
 // ARM flags
 #define CPU_ARMv7  0x01
 #define CPU_IDIVA  0x02
 #define CPU_VFPv3  0x04
 
+// CPU_Flags limited by com_simd, for picking SIMD kernels at init time
+int Com_SIMDFlags( void );
+
 // TTimo
 // centralized and cleaned, that's the max string you can send to a Com_Printf / Com_DPrintf (above gets truncated)
 // bump to 8192 as 4096 may be not enough to print some data like gl extensions - CE
@@ -957,6 +1061,7 @@ void		Info_Print( const char *s );
 
 void		Com_BeginRedirect (char *buffer, int buffersize, void (*flush)(const char *));
 void		Com_EndRedirect( void );
+void		Com_SetThreadErrorHandler( void (*handler)( void *arg, int code, const char *msg ), void *arg );
 void 		QDECL Com_Printf( const char *fmt, ... ) __attribute__ ((format (printf, 1, 2)));
 void 		QDECL Com_DPrintf( const char *fmt, ... ) __attribute__ ((format (printf, 1, 2)));
 void 		QDECL Com_WPrintf( const char *fmt, ... ) __attribute__ ((format (printf, 1, 2)));
@@ -1043,7 +1148,9 @@ extern	cvar_t	*com_yieldCPU;
 extern	cvar_t	*vm_rtChecks;
 #ifdef USE_AFFINITY_MASK
 extern	cvar_t	*com_affinityMask;
+uint64_t Com_ParseAffinityMask( const char *str );
 #endif
+extern	cvar_t	*com_benchmark;
 
 // com_speeds times
 extern	int		time_game;
@@ -1128,8 +1235,48 @@ void Hunk_FreeTempMemory( void *buf );
 int	Hunk_MemoryRemaining( void );
 void Hunk_Log( void);
 
+// per-thread scratch memory, reset by the next allocation in a later frame
+// unless a scope opened with Com_ScratchMark is still open
+void *Com_ScratchAlloc( int size );
+int Com_ScratchMark( void );
+void Com_ScratchRelease( int mark );
+void Com_ScratchThreadExit( void );
+
 unsigned int Com_TouchMemory( void );
 
+// worker thread pool, see jobs.c
+#define MAX_JOB_WORKERS 16
+
+// subsystems sharing the workers, in order of priority
+typedef enum {
+	JOB_POOL_SERVER,	// main thread
+	JOB_POOL_RENDERER,
+	JOB_POOL_IO,
+	JOB_POOL_AUDIO,
+	JOB_POOL_BOT,
+	JOB_NUM_POOLS
+} jobPool_t;
+
+typedef void (*jobFunc_t)( void *data, int index );
+
+void Com_InitJobs( void );
+void Com_ShutdownJobs( void );
+int Com_JobWorkers( void );
+void Com_ParallelFor( jobFunc_t func, void *data, int count );
+void Com_ParallelForPool( jobPool_t pool, jobFunc_t func, void *data, int count );
+void *Com_CreateThread( jobPool_t pool, const char *name, void (*func)( void *arg ), void *arg );
+void Com_JoinThread( void *thread );
+
+// frame phase profiler, see trace.c
+void Com_InitTrace( void );
+void Com_TraceFrame( void );
+void Com_TraceBegin( const char *name );
+void Com_TraceEnd( void );
+void Com_TraceCounter( const char *name, int value );
+void Com_TraceThreadName( const char *name );
+void Com_TraceStats( qboolean enable );
+void Com_TraceStatsReport( int frames );
+
 // commandLine should not include the executable name (argv[0])
 void Com_Init( char *commandLine );
 void Com_Frame( qboolean noDelay );
@@ -1193,6 +1340,15 @@ void CL_StartHunkUsers( void );
 void CL_Snd_Restart(void);
 // Restart sound subsystem
 
+qboolean CL_RendererMemoryStats( int *numImages, int *imageBytes, int *vboBytes );
+// renderer memory estimates, qfalse if no renderer is loaded
+
+void CL_WaitFrame( void );
+// lets the renderer delay input sampling until the previous frame is out
+
+void CL_SendAsyncCmd( void );
+// sends a packet that became due while waiting for the next frame
+
 void Key_KeynameCompletion( void(*callback)(const char *s) );
 // for keyname autocompletion
 
@@ -1216,9 +1372,13 @@ void SV_Shutdown( const char *finalmsg );
 void SV_Frame( int msec );
 void SV_TrackCvarChanges( void );
 void SV_PacketEvent( const netadr_t *from, msg_t *msg );
+qboolean SV_OffloadPacket( const netadr_t *from, msg_t *msg );
 int SV_FrameMsec( void );
 qboolean SV_GameCommand( void );
 int SV_SendQueuedPackets( void );
+qboolean SV_BotIdleFrame( int usec );
+void SV_SnapshotStorageStats( int *totalBytes, int *usedBytes, int *highwaterBytes );
+qboolean SV_BotLibMemoryStats( int *chunkBytes, int *usedBytes, int *usedBlocks, int *largeBlocks );
 
 void SV_AddDedicatedCommands( void );
 void SV_RemoveDedicatedCommands( void );
@@ -1287,12 +1447,14 @@ void	QDECL Sys_SetStatus( const char *format, ...) __attribute__ ((format (print
 #ifdef USE_AFFINITY_MASK
 uint64_t Sys_GetAffinityMask( void );
 qboolean Sys_SetAffinityMask( const uint64_t mask );
+qboolean Sys_SetThreadAffinityMask( void *thread, const uint64_t mask );
 #endif
 
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds( void );
 int64_t	Sys_Microseconds( void );
+int64_t	Sys_Nanoseconds( void );
 
 void	Sys_SnapVector( float *vector );
 
@@ -1305,6 +1467,9 @@ void	Sys_ShowConsole( int level, qboolean quitOnClose );
 void	Sys_SetErrorText( const char *text );
 
 void	Sys_SendPacket( int length, const void *data, const netadr_t *to );
+void	Sys_SendPacketV( int count, const netIovec_t *iov, const netadr_t *to );
+void	Sys_BeginSendBatch( void );
+void	Sys_EndSendBatch( void );
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 //Does NOT parse port numbers, only base addresses.
@@ -1314,6 +1479,7 @@ void		Sys_ShowIP(void);
 
 qboolean	Sys_Mkdir( const char *path );
 FILE	*Sys_FOpen( const char *ospath, const char *mode );
+void	Sys_FSync( FILE *f );
 qboolean Sys_ResetReadOnlyAttribute( const char *ospath );
 
 const char *Sys_Pwd( void );
@@ -1330,6 +1496,13 @@ void Sys_FreeFileList( char **list );
 
 qboolean Sys_GetFileStats( const char *filename, fileOffset_t *size, fileTime_t *mtime, fileTime_t *ctime );
 
+// private copy-on-write view of a file range, returns pointer to offset in the view
+void	*Sys_MapFile( FILE *f, int64_t offset, size_t length, void **base, size_t *baseLength );
+void	Sys_UnmapFile( void *base, size_t baseLength );
+
+// zero filled page aligned memory that is never released, with large pages if requested
+void	*Sys_AllocPages( size_t size, qboolean *largePages );
+
 void Sys_BeginProfiling( void );
 void Sys_EndProfiling( void );
 
@@ -1342,12 +1515,52 @@ void *Sys_LoadFunction( void *handle, const char *name );
 int   Sys_LoadFunctionErrors( void );
 void  Sys_UnloadLibrary( void *handle );
 
+// native module image description, see VM_ReloadDll()
+typedef struct {
+	const char	*path;			// file the image was loaded from
+	byte		*base;			// whole mapped image
+	size_t		size;
+	byte		*code;			// executable part of the image
+	size_t		codeSize;
+	byte		*data;			// writable data and bss, relocation tables excluded
+	size_t		dataSize;
+	uint32_t	layout;			// hash of data size and exported data objects
+} libraryLayout_t;
+
+qboolean Sys_LibraryLayout( void *handle, libraryLayout_t *layout );
+void	*Sys_LibrarySymbol( const void *addr, void *handle );
+void	*Sys_LoadLibraryCopy( const char *path );
+
+// threading primitives, the main thread owns the engine state and any
+// code running on other threads must not call Com_Printf or Com_Error
+// unless it has set Com_SetThreadErrorHandler
+void	*Sys_CreateThread( void (*func)( void *arg ), void *arg );
+void	Sys_JoinThread( void *thread );
+void	*Sys_CreateMutex( void );
+void	Sys_DestroyMutex( void *mutex );
+void	Sys_LockMutex( void *mutex );
+void	Sys_UnlockMutex( void *mutex );
+void	*Sys_CreateSemaphore( void );
+void	Sys_DestroySemaphore( void *sem );
+void	Sys_WaitSemaphore( void *sem );
+void	Sys_PostSemaphore( void *sem, int count );
+int		Sys_NumProcessors( void );
+int		Sys_ForkInstances( int count );	// returns instance number, 0 in the original process
+
+// atomic operations on shared counters, loads acquire and stores release
+int		Sys_AtomicAdd( volatile int *ptr, int value );	// returns new value
+qboolean Sys_AtomicCompareSwap( volatile int *ptr, int expected, int value );
+int		Sys_AtomicLoad( volatile int *ptr );
+void	Sys_AtomicStore( volatile int *ptr, int value );
+
 // adaptive huffman functions
 void Huff_Compress( msg_t *buf, int offset );
 void Huff_Decompress( msg_t *buf, int offset );
 
 // static huffman functions
+extern const uint16_t HuffmanEncoderTable[ 256 ];
 void HuffmanPutBit( byte* fout, int32_t bitIndex, int bit );
+void HuffmanPutBits( byte* fout, int32_t bitIndex, uint64_t bits, int count );
 int HuffmanPutSymbol( byte* fout, uint32_t offset, int symbol );
 int HuffmanGetBit( const byte* buffer, int bitIndex );
 int HuffmanGetSymbol( unsigned int* symbol, const byte* buffer, int bitIndex );
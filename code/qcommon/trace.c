@@ -0,0 +1,380 @@
+// frame phase profiler, scoped timers recorded into a ring buffer
+// that can be saved in Chrome trace event format (chrome://tracing)
+
+#include "q_shared.h"
+#include "qcommon.h"
+#include "json.h"
+
+#define MAX_TRACE_EVENTS	65536	// must be power of two
+#define MAX_TRACE_DEPTH		16
+#define MAX_TRACE_STATS		32
+#define MAX_TRACE_THREADS	64
+
+typedef struct {
+	const char	*name;		// static string
+	int64_t		start;		// Sys_Microseconds
+	int			duration;	// value of a counter
+	int			thread;
+	qboolean	counter;
+} traceEvent_t;
+
+typedef struct {
+	const char	*name;
+	int64_t		start;
+} traceScope_t;
+
+typedef struct {
+	const char	*name;
+	int64_t		total;
+	int			count;
+} traceStat_t;
+
+static traceEvent_t		traceEvents[ MAX_TRACE_EVENTS ];
+static volatile int		traceHead;		// total events recorded
+static volatile int		traceThreads;
+static qboolean			traceEnabled;
+static qboolean			traceRequested;	// applied at frame start
+static qboolean			traceStatsEnabled;
+
+// per-phase totals of the main thread, for benchmarks
+static traceStat_t		traceStats[ MAX_TRACE_STATS ];
+static int				traceNumStats;
+
+// names of long-lived threads, indexed by trace thread id
+static const char		*traceThreadNames[ MAX_TRACE_THREADS ];
+
+static THREAD_LOCAL traceScope_t	traceStack[ MAX_TRACE_DEPTH ];
+static THREAD_LOCAL int				traceDepth;
+static THREAD_LOCAL int				traceThread;	// 1 for main thread
+
+static cvar_t *com_trace;
+
+
+/*
+================
+Com_TraceBegin
+
+Opens a timed scope, name must be a static string.
+Safe to call from any thread
+================
+*/
+void Com_TraceBegin( const char *name )
+{
+	if ( !traceEnabled ) {
+		return;
+	}
+
+	if ( traceDepth < MAX_TRACE_DEPTH ) {
+		traceStack[ traceDepth ].name = name;
+		traceStack[ traceDepth ].start = Sys_Microseconds();
+	}
+
+	traceDepth++;
+}
+
+
+/*
+================
+Com_TraceAddStat
+
+Names are static strings so pointers are compared
+================
+*/
+static void Com_TraceAddStat( const char *name, int duration )
+{
+	traceStat_t *stat;
+	int i;
+
+	for ( i = 0, stat = traceStats; i < traceNumStats; i++, stat++ ) {
+		if ( stat->name == name ) {
+			break;
+		}
+	}
+
+	if ( i == traceNumStats ) {
+		if ( traceNumStats >= MAX_TRACE_STATS ) {
+			return;
+		}
+		traceNumStats++;
+		stat->name = name;
+		stat->total = 0;
+		stat->count = 0;
+	}
+
+	stat->total += duration;
+	stat->count++;
+}
+
+
+/*
+================
+Com_TraceEnd
+
+Closes innermost scope opened by Com_TraceBegin
+================
+*/
+void Com_TraceEnd( void )
+{
+	const traceScope_t *scope;
+	traceEvent_t *ev;
+	int index;
+
+	if ( !traceEnabled || traceDepth <= 0 ) {
+		// switched inside of the scope
+		return;
+	}
+
+	traceDepth--;
+	if ( traceDepth >= MAX_TRACE_DEPTH ) {
+		return;
+	}
+
+	if ( !traceThread ) {
+		traceThread = Sys_AtomicAdd( &traceThreads, 1 );
+	}
+
+	scope = &traceStack[ traceDepth ];
+
+	index = Sys_AtomicAdd( &traceHead, 1 ) - 1;
+	ev = &traceEvents[ index & ( MAX_TRACE_EVENTS - 1 ) ];
+	ev->name = scope->name;
+	ev->start = scope->start;
+	ev->duration = (int)( Sys_Microseconds() - scope->start );
+	ev->thread = traceThread;
+	ev->counter = qfalse;
+
+	if ( traceStatsEnabled && traceThread == 1 ) {
+		Com_TraceAddStat( scope->name, ev->duration );
+	}
+}
+
+
+/*
+================
+Com_TraceCounter
+
+Records a sample of a counter track, name must be a static string.
+Safe to call from any thread
+================
+*/
+void Com_TraceCounter( const char *name, int value )
+{
+	traceEvent_t *ev;
+	int index;
+
+	if ( !traceEnabled ) {
+		return;
+	}
+
+	if ( !traceThread ) {
+		traceThread = Sys_AtomicAdd( &traceThreads, 1 );
+	}
+
+	index = Sys_AtomicAdd( &traceHead, 1 ) - 1;
+	ev = &traceEvents[ index & ( MAX_TRACE_EVENTS - 1 ) ];
+	ev->name = name;
+	ev->start = Sys_Microseconds();
+	ev->duration = value;
+	ev->thread = traceThread;
+	ev->counter = qtrue;
+}
+
+
+/*
+================
+Com_TraceFrame
+
+Called by the main thread at start of each frame, closes scopes
+left open by an ERR_DROP and applies com_trace changes
+================
+*/
+void Com_TraceFrame( void )
+{
+	if ( !traceThread ) {
+		traceThread = Sys_AtomicAdd( &traceThreads, 1 );
+	}
+
+	traceDepth = 0;
+	traceEnabled = traceRequested || traceStatsEnabled;
+}
+
+
+/*
+================
+Com_TraceThreadName
+
+Assigns a trace thread id to the calling thread and labels it
+in dumps, name must be a static string or outlive the thread
+================
+*/
+void Com_TraceThreadName( const char *name )
+{
+	if ( !traceThread ) {
+		traceThread = Sys_AtomicAdd( &traceThreads, 1 );
+	}
+
+	if ( traceThread < MAX_TRACE_THREADS ) {
+		traceThreadNames[ traceThread ] = name;
+	}
+}
+
+
+/*
+================
+Com_TraceStats
+
+Starts or stops accumulating per-phase totals of the main thread,
+takes effect on the next frame
+================
+*/
+void Com_TraceStats( qboolean enable )
+{
+	if ( enable ) {
+		traceNumStats = 0;
+	}
+	traceStatsEnabled = enable;
+}
+
+
+/*
+================
+Com_TraceStatsReport
+
+Prints accumulated totals averaged over frames
+================
+*/
+void Com_TraceStatsReport( int frames )
+{
+	const traceStat_t *stat;
+	int i;
+
+	if ( frames <= 0 ) {
+		frames = 1;
+	}
+
+	Com_Printf( "%-24s %10s %10s %8s\n", "phase", "total ms", "usec/frm", "calls" );
+	for ( i = 0, stat = traceStats; i < traceNumStats; i++, stat++ ) {
+		Com_Printf( "%-24s %10.2f %10.2f %8i\n", stat->name, stat->total / 1000.0,
+			(double)stat->total / frames, stat->count );
+	}
+}
+
+
+static void Com_TraceChanged( cvar_t *var )
+{
+	traceRequested = var->integer ? qtrue : qfalse;
+}
+
+
+/*
+================
+Com_TraceDump_f
+================
+*/
+static void Com_TraceDump_f( void )
+{
+	char filename[ MAX_QPATH ];
+	char buf[ 256 ];
+	const traceEvent_t *ev;
+	jsonWriter_t w;
+	fileHandle_t f;
+	int64_t base;
+	int i, first, count;
+
+	if ( Cmd_Argc() > 2 ) {
+		Com_Printf( "usage: com_traceDump [filename]\n" );
+		return;
+	}
+
+	count = Sys_AtomicLoad( &traceHead );
+	if ( count == 0 ) {
+		Com_Printf( "No trace events recorded, set com_trace 1 first.\n" );
+		return;
+	}
+
+	first = 0;
+	if ( count > MAX_TRACE_EVENTS ) {
+		first = count - MAX_TRACE_EVENTS;
+	}
+
+	if ( Cmd_Argc() == 2 ) {
+		Q_strncpyz( filename, Cmd_Argv( 1 ), sizeof( filename ) );
+	} else {
+		Q_strncpyz( filename, "trace", sizeof( filename ) );
+	}
+	COM_DefaultExtension( filename, sizeof( filename ), ".json" );
+
+	f = FS_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't write %s.\n", filename );
+		return;
+	}
+
+	// timestamps relative to the oldest event keep numbers small
+	base = traceEvents[ first & ( MAX_TRACE_EVENTS - 1 ) ].start;
+	for ( i = first; i < count; i++ ) {
+		ev = &traceEvents[ i & ( MAX_TRACE_EVENTS - 1 ) ];
+		if ( ev->start < base ) {
+			base = ev->start;
+		}
+	}
+
+	FS_Printf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	FS_Printf( f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}" );
+	for ( i = 2; i < MAX_TRACE_THREADS; i++ ) {
+		if ( traceThreadNames[ i ] ) {
+			FS_Printf( f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}", i, traceThreadNames[ i ] );
+		}
+	}
+
+	for ( i = first; i < count; i++ ) {
+		ev = &traceEvents[ i & ( MAX_TRACE_EVENTS - 1 ) ];
+		if ( !ev->name ) {
+			continue; // still being written by another thread
+		}
+		JSON_WriterInit( &w, buf, sizeof( buf ) );
+		JSON_WriteObjectBegin( &w, NULL );
+		JSON_WriteString( &w, "name", ev->name );
+		if ( ev->counter ) {
+			JSON_WriteString( &w, "ph", "C" );
+			JSON_WriteInt( &w, "ts", (int)( ev->start - base ) );
+			JSON_WriteInt( &w, "pid", 1 );
+			JSON_WriteObjectBegin( &w, "args" );
+			JSON_WriteInt( &w, "value", ev->duration );
+			JSON_WriteObjectEnd( &w );
+		} else {
+			JSON_WriteString( &w, "ph", "X" );
+			JSON_WriteInt( &w, "ts", (int)( ev->start - base ) );
+			JSON_WriteInt( &w, "dur", ev->duration );
+			JSON_WriteInt( &w, "pid", 1 );
+			JSON_WriteInt( &w, "tid", ev->thread );
+		}
+		JSON_WriteObjectEnd( &w );
+		FS_Printf( f, ",\n%s", buf );
+	}
+
+	FS_Printf( f, "\n]}\n" );
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i trace events to %s\n", count - first, filename );
+}
+
+
+/*
+================
+Com_InitTrace
+================
+*/
+void Com_InitTrace( void )
+{
+	// main thread takes id 1 before any worker is started
+	Com_TraceThreadName( "main" );
+
+	com_trace = Cvar_Get( "com_trace", "0", CVAR_TEMP );
+	Cvar_CheckRange( com_trace, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( com_trace, "Record timings of frame phases into a ring buffer, save it with \\com_traceDump." );
+	Cvar_SetChangeCallback( com_trace, Com_TraceChanged );
+	Com_TraceChanged( com_trace );
+
+	Cmd_AddCommand( "com_traceDump", Com_TraceDump_f );
+}
@@ -668,6 +668,7 @@ static int inflateSetDictionary OF((z_streamp strm,
 */
 
 static int inflateReset OF((z_streamp strm));
+static int inflateCopy OF((z_streamp dest, z_streamp source));
 /*
      This function is equivalent to inflateEnd followed by inflateInit,
    but does not free and reallocate all the internal decompression state.
@@ -1060,6 +1061,25 @@ static void   zcfree  OF((voidp opaque, voidp ptr));
 #define UNZ_BUFSIZE (65536)
 #endif
 
+// largest compressed file staged for finf_inflate()
+#ifndef UNZ_WHOLEBUFSIZE
+#define UNZ_WHOLEBUFSIZE (256*1024)
+#endif
+
+// deflated files at least this large save inflate checkpoints for seeking
+#ifndef UNZ_CHECKPOINT_MIN
+#define UNZ_CHECKPOINT_MIN (1024*1024)
+#endif
+
+// smallest distance in uncompressed bytes between two checkpoints
+#ifndef UNZ_CHECKPOINT_SPAN
+#define UNZ_CHECKPOINT_SPAN (256*1024)
+#endif
+
+#ifndef UNZ_MAX_CHECKPOINTS
+#define UNZ_MAX_CHECKPOINTS (8)
+#endif
+
 #ifndef UNZ_MAXFILENAMEINZIP
 #define UNZ_MAXFILENAMEINZIP (256)
 #endif
@@ -1417,6 +1437,138 @@ extern unzFile unzOpen (const char* path)
 }
 
 
+static void unzlocal_DosDateToTmuDate (uLong ulDosDate, tm_unz* ptm);
+
+/*
+  Read the central directory into memory, same checks as unzOpen
+*/
+extern int unzReadCentralDir (const char *path, unz_central_dir *dir)
+{
+	byte buf[22+UNZ_BUNDLE_TAG_SIZE+4];
+	uLong central_pos, number_disk, number_disk_with_CD, number_entry_CD;
+	uLong size_comment;
+	FILE *fin;
+
+	memset(dir, 0, sizeof(*dir));
+
+	fin=F_OPEN(path,"rb");
+	if (fin==NULL)
+		return UNZ_ERRNO;
+
+	central_pos = unzlocal_SearchCentralDir(fin);
+	if (central_pos==0 || fseek(fin,central_pos,SEEK_SET)!=0 || unzlocal_getData(fin,buf,22)!=UNZ_OK)
+	{
+		fclose(fin);
+		return UNZ_ERRNO;
+	}
+
+	number_disk = buf[4] | (buf[5] << 8);
+	number_disk_with_CD = buf[6] | (buf[7] << 8);
+	dir->number_entry = buf[8] | (buf[9] << 8);
+	number_entry_CD = buf[10] | (buf[11] << 8);
+	dir->size = buf[12] | (buf[13] << 8) | (buf[14] << 16) | ((uLong)buf[15] << 24);
+	dir->offset = buf[16] | (buf[17] << 8) | (buf[18] << 16) | ((uLong)buf[19] << 24);
+	size_comment = buf[20] | (buf[21] << 8);
+
+	if (number_entry_CD!=dir->number_entry || number_disk_with_CD!=0 || number_disk!=0 ||
+		central_pos<dir->offset+dir->size)
+	{
+		fclose(fin);
+		return UNZ_BADZIPFILE;
+	}
+
+	if (size_comment >= UNZ_BUNDLE_TAG_SIZE+4 &&
+		unzlocal_getData(fin,buf+22,UNZ_BUNDLE_TAG_SIZE+4)==UNZ_OK &&
+		memcmp(buf+22,UNZ_BUNDLE_TAG,UNZ_BUNDLE_TAG_SIZE)==0)
+	{
+		const byte *p = buf+22+UNZ_BUNDLE_TAG_SIZE;
+		dir->bundle_size = p[0] | (p[1] << 8) | (p[2] << 16) | ((uLong)p[3] << 24);
+		if (dir->bundle_size > central_pos-dir->size)
+			dir->bundle_size = 0;
+	}
+
+	/* byte_before_the_zipfile is central_pos - (offset + size) */
+	dir->data = (unsigned char*)malloc(dir->bundle_size+dir->size ? dir->bundle_size+dir->size : 1);
+	if (dir->data==NULL ||
+		fseek(fin,central_pos-dir->size-dir->bundle_size,SEEK_SET)!=0 ||
+		(dir->bundle_size+dir->size && fread(dir->data,dir->bundle_size+dir->size,1,fin)!=1))
+	{
+		fclose(fin);
+		unzFreeCentralDir(dir);
+		return UNZ_ERRNO;
+	}
+
+	if (dir->bundle_size)
+	{
+		dir->bundle = dir->data;
+		dir->data += dir->bundle_size;
+	}
+
+	fclose(fin);
+	return UNZ_OK;
+}
+
+
+extern int unzGetCentralDirEntry (const unz_central_dir *dir, unsigned long *pos, unz_file_info *pfile_info, char *szFileName, unsigned long fileNameBufferSize)
+{
+	const byte *p;
+	uLong offset;
+
+	offset = *pos - dir->offset;
+	if (*pos < dir->offset || offset + SIZECENTRALDIRITEM > dir->size)
+		return UNZ_BADZIPFILE;
+
+	p = dir->data + offset;
+	if (memcmp(p, "\x50\x4b\x01\x02", 4) != 0)
+		return UNZ_BADZIPFILE;
+
+	pfile_info->version = p[4] | (p[5] << 8);
+	pfile_info->version_needed = p[6] | (p[7] << 8);
+	pfile_info->flag = p[8] | (p[9] << 8);
+	pfile_info->compression_method = p[10] | (p[11] << 8);
+	pfile_info->dosDate = p[12] | (p[13] << 8) | (p[14] << 16) | ((uLong)p[15] << 24);
+	unzlocal_DosDateToTmuDate(pfile_info->dosDate, &pfile_info->tmu_date);
+	pfile_info->crc = p[16] | (p[17] << 8) | (p[18] << 16) | ((uLong)p[19] << 24);
+	pfile_info->compressed_size = p[20] | (p[21] << 8) | (p[22] << 16) | ((uLong)p[23] << 24);
+	pfile_info->uncompressed_size = p[24] | (p[25] << 8) | (p[26] << 16) | ((uLong)p[27] << 24);
+	pfile_info->size_filename = p[28] | (p[29] << 8);
+	pfile_info->size_file_extra = p[30] | (p[31] << 8);
+	pfile_info->size_file_comment = p[32] | (p[33] << 8);
+	pfile_info->disk_num_start = p[34] | (p[35] << 8);
+	pfile_info->internal_fa = p[36] | (p[37] << 8);
+	pfile_info->external_fa = p[38] | (p[39] << 8) | (p[40] << 16) | ((uLong)p[41] << 24);
+
+	offset += SIZECENTRALDIRITEM;
+	if (offset + pfile_info->size_filename > dir->size)
+		return UNZ_BADZIPFILE;
+
+	if (szFileName!=NULL && fileNameBufferSize>0)
+	{
+		if (pfile_info->size_filename<fileNameBufferSize)
+		{
+			memcpy(szFileName, dir->data + offset, pfile_info->size_filename);
+			szFileName[pfile_info->size_filename]='\0';
+		}
+		else
+			memcpy(szFileName, dir->data + offset, fileNameBufferSize);
+	}
+
+	*pos += SIZECENTRALDIRITEM + pfile_info->size_filename +
+		pfile_info->size_file_extra + pfile_info->size_file_comment;
+
+	return UNZ_OK;
+}
+
+
+extern void unzFreeCentralDir (unz_central_dir *dir)
+{
+	free(dir->bundle ? dir->bundle : dir->data);
+	dir->data = NULL;
+	dir->bundle = NULL;
+	dir->bundle_size = 0;
+}
+
+
 /*
   Close a ZipFile opened with unzipOpen.
   If there is files inside the .Zip opened with unzipOpenCurrentFile (see later),
@@ -1943,6 +2095,11 @@ extern int unzOpenCurrentFile (unzFile file)
 	}
 
 	pfile_in_zip_read_info->stream_initialised=0;
+	pfile_in_zip_read_info->whole_buffer=NULL;
+	pfile_in_zip_read_info->in_memory=NULL;
+	pfile_in_zip_read_info->checkpoints=NULL;
+	pfile_in_zip_read_info->num_checkpoints=0;
+	pfile_in_zip_read_info->checkpoint_interval=0;
 	
 	// already checked in unzlocal_CheckCurrentFileCoherencyHeader()
 	//if ((s->cur_file_info.compression_method!=0) &&
@@ -1969,6 +2126,13 @@ extern int unzOpenCurrentFile (unzFile file)
 	  err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
 	  if (err == Z_OK)
 	    pfile_in_zip_read_info->stream_initialised=1;
+
+	  if (err == Z_OK && s->cur_file_info.uncompressed_size >= UNZ_CHECKPOINT_MIN)
+	  {
+	    pfile_in_zip_read_info->checkpoint_interval = s->cur_file_info.uncompressed_size / UNZ_MAX_CHECKPOINTS;
+	    if (pfile_in_zip_read_info->checkpoint_interval < UNZ_CHECKPOINT_SPAN)
+	      pfile_in_zip_read_info->checkpoint_interval = UNZ_CHECKPOINT_SPAN;
+	  }
         /* windowBits is passed < 0 to tell that there is no zlib header.
          * Note that in this case inflate *requires* an extra "dummy" byte
          * after the compressed stream in order to complete decompression and
@@ -1995,6 +2159,660 @@ extern int unzOpenCurrentFile (unzFile file)
 }
 
 
+/*
+  Supply the whole compressed data of the current file (opened by unzOpenCurrentFile)
+  from memory, unzReadCurrentFile will consume it instead of reading the zipfile.
+  buf must stay valid until unzCloseCurrentFile.
+*/
+extern int unzSetCurrentFileBuffer (unzFile file, const void *buf)
+{
+	unz_s* s;
+	file_in_zip_read_info_s* pfile_in_zip_read_info;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+	pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+	if (pfile_in_zip_read_info==NULL)
+		return UNZ_PARAMERROR;
+
+	if (pfile_in_zip_read_info->rest_read_compressed != s->cur_file_info.compressed_size)
+		return UNZ_PARAMERROR;
+
+	pfile_in_zip_read_info->in_memory = (const Byte*)buf;
+	pfile_in_zip_read_info->stream.next_in = (Byte*)buf;
+	pfile_in_zip_read_info->stream.avail_in = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+	pfile_in_zip_read_info->pos_in_zipfile += pfile_in_zip_read_info->rest_read_compressed;
+	pfile_in_zip_read_info->rest_read_compressed = 0;
+
+	return UNZ_OK;
+}
+
+
+/*
+  Fast inflate of a whole deflate stream into a buffer of known size.
+
+  Bits are kept in a 64-bit buffer refilled once per match, Huffman codes
+  up to FINF_FASTBITS long are decoded with a single table lookup that also
+  yields the length or distance base and extra bit count, longer codes fall
+  back to canonical decoding. Unlike inflate() there is no sliding window
+  or state machine since both the whole input and output are in memory.
+*/
+
+#define FINF_FASTBITS	11
+#define FINF_MAXBITS	15
+#define FINF_MAXLCODES	286
+#define FINF_MAXDCODES	30
+#define FINF_FIXLCODES	288
+
+// decoded table entry: value << 16 | extra bits << 8 | flags | code length
+#define FINF_LITERAL	0x10
+#define FINF_END		0x20
+#define FINF_INVALID	0x40
+#define FINF_LENMASK	0x0F
+
+typedef enum {
+	FINF_CODELENS,
+	FINF_LITLEN,
+	FINF_DIST
+} finfTable_t;
+
+typedef struct {
+	uint32_t		fast[ 1 << FINF_FASTBITS ];	// 0 for codes longer than FINF_FASTBITS
+	unsigned short	count[ FINF_MAXBITS + 1 ];	// number of codes of each length
+	uint32_t		entry[ FINF_FIXLCODES ];	// decoded entries ordered by code
+} finfHuffman_t;
+
+typedef struct {
+	const unsigned char	*in;
+	const unsigned char	*inEnd;
+	unsigned char		*out;
+	unsigned char		*outStart;
+	unsigned char		*outEnd;
+	uint64_t			bitbuf;
+	unsigned			bitcnt;
+	unsigned			overrun;				// zero bytes fed past the end of input
+} finfState_t;
+
+static const unsigned short finf_lbase[ 29 ] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char finf_lext[ 29 ] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short finf_dbase[ 30 ] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577 };
+static const unsigned char finf_dext[ 30 ] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+
+/* make at least 56 bits available, zeros are fed past the end of input */
+static void finf_refill( finfState_t *s )
+{
+#ifdef Q3_LITTLE_ENDIAN
+	if ( s->inEnd - s->in >= 8 ) {
+		uint64_t v;
+		Com_Memcpy( &v, s->in, sizeof( v ) );
+		s->bitbuf |= v << s->bitcnt;
+		s->in += ( 63 - s->bitcnt ) >> 3;
+		s->bitcnt |= 56;
+		return;
+	}
+#endif
+	while ( s->bitcnt <= 56 ) {
+		if ( s->in < s->inEnd ) {
+			s->bitbuf |= (uint64_t)*s->in++ << s->bitcnt;
+		} else {
+			s->overrun++;
+		}
+		s->bitcnt += 8;
+	}
+}
+
+
+/* takes n <= 32 bits, caller must have refilled */
+static unsigned finf_bits( finfState_t *s, unsigned n )
+{
+	const unsigned v = (unsigned)( s->bitbuf & ( ( (uint64_t)1 << n ) - 1 ) );
+	s->bitbuf >>= n;
+	s->bitcnt -= n;
+	return v;
+}
+
+
+static uint32_t finf_entry( finfTable_t table, int sym )
+{
+	switch ( table ) {
+	case FINF_LITLEN:
+		if ( sym < 256 )
+			return (uint32_t)sym << 16 | FINF_LITERAL;
+		if ( sym == 256 )
+			return FINF_END;
+		if ( sym - 257 >= 29 )
+			return FINF_INVALID;
+		return (uint32_t)finf_lbase[ sym - 257 ] << 16 | finf_lext[ sym - 257 ] << 8;
+	case FINF_DIST:
+		if ( sym >= 30 )
+			return FINF_INVALID;
+		return (uint32_t)finf_dbase[ sym ] << 16 | finf_dext[ sym ] << 8;
+	default:
+		return (uint32_t)sym << 16;
+	}
+}
+
+
+/*
+  Build decoding tables from code lengths, returns 0 for a complete code,
+  > 0 for an incomplete one and < 0 for an over-subscribed one
+*/
+static int finf_build( finfHuffman_t *h, finfTable_t table, const unsigned char *length, int n )
+{
+	unsigned short offs[ FINF_MAXBITS + 1 ];
+	unsigned code, rev, step;
+	int left, len, sym, i;
+
+	Com_Memset( h->fast, 0, sizeof( h->fast ) );
+	Com_Memset( h->count, 0, sizeof( h->count ) );
+	for ( sym = 0; sym < n; sym++ )
+		h->count[ length[ sym ] ]++;
+	if ( h->count[ 0 ] == n )
+		return 0;	// no codes, complete but decoding will fail
+
+	left = 1;
+	for ( len = 1; len <= FINF_MAXBITS; len++ ) {
+		left <<= 1;
+		left -= h->count[ len ];
+		if ( left < 0 )
+			return left;
+	}
+
+	offs[ 1 ] = 0;
+	for ( len = 1; len < FINF_MAXBITS; len++ )
+		offs[ len + 1 ] = offs[ len ] + h->count[ len ];
+	for ( sym = 0; sym < n; sym++ )
+		if ( length[ sym ] != 0 )
+			h->entry[ offs[ length[ sym ] ]++ ] = finf_entry( table, sym );
+
+	// canonical codes are assigned in symbol order within each length,
+	// deflate sends them starting from the most significant bit
+	code = 0;
+	i = 0;
+	for ( len = 1; len <= FINF_FASTBITS; len++ ) {
+		for ( sym = 0; sym < h->count[ len ]; sym++, i++, code++ ) {
+			rev = 0;
+			for ( step = 0; step < (unsigned)len; step++ )
+				rev |= ( ( code >> step ) & 1 ) << ( len - 1 - step );
+			for ( step = rev; step < ( 1 << FINF_FASTBITS ); step += 1 << len )
+				h->fast[ step ] = h->entry[ i ] | len;
+		}
+		code <<= 1;
+	}
+
+	return left;
+}
+
+
+/* canonical decoding of codes longer than FINF_FASTBITS, returns entry | code length */
+static uint32_t finf_decodeSlow( const finfHuffman_t *h, uint64_t bitbuf )
+{
+	int code, first, index, count, len;
+
+	code = first = index = 0;
+	for ( len = 1; len <= FINF_MAXBITS; len++ ) {
+		code |= (int)( bitbuf & 1 );
+		bitbuf >>= 1;
+		count = h->count[ len ];
+		if ( code - count < first )
+			return h->entry[ index + ( code - first ) ] | len;
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+
+	return FINF_INVALID | FINF_MAXBITS;
+}
+
+
+/* decode an entry, caller must have refilled */
+static uint32_t finf_decode( finfState_t *s, const finfHuffman_t *h )
+{
+	uint32_t entry;
+
+	entry = h->fast[ s->bitbuf & ( ( 1 << FINF_FASTBITS ) - 1 ) ];
+	if ( entry == 0 )
+		entry = finf_decodeSlow( h, s->bitbuf );
+
+	s->bitbuf >>= entry & FINF_LENMASK;
+	s->bitcnt -= entry & FINF_LENMASK;
+
+	return entry;
+}
+
+
+/*
+  Decode literals and matches until the end of block. Decoder state lives in locals
+  here since output stores through a byte pointer could alias the state structure.
+*/
+static int finf_codes( finfState_t *s, const finfHuffman_t *lencode, const finfHuffman_t *distcode )
+{
+	const unsigned char *in = s->in;
+	const unsigned char *const inEnd = s->inEnd;
+	unsigned char *out = s->out;
+	unsigned char *const outStart = s->outStart;
+	unsigned char *const outEnd = s->outEnd;
+	uint64_t bitbuf = s->bitbuf;
+	unsigned bitcnt = s->bitcnt;
+	unsigned overrun = s->overrun;
+	const unsigned char *from;
+	unsigned len, dist, n;
+	uint32_t entry;
+	int err;
+
+#ifdef Q3_LITTLE_ENDIAN
+#define FINF_REFILL() \
+	if ( inEnd - in >= 8 ) { \
+		uint64_t v; \
+		Com_Memcpy( &v, in, sizeof( v ) ); \
+		bitbuf |= v << bitcnt; \
+		in += ( 63 - bitcnt ) >> 3; \
+		bitcnt |= 56; \
+	} else { \
+		while ( bitcnt <= 56 ) { \
+			if ( in < inEnd ) bitbuf |= (uint64_t)*in++ << bitcnt; else overrun++; \
+			bitcnt += 8; \
+		} \
+	}
+#else
+#define FINF_REFILL() \
+	while ( bitcnt <= 56 ) { \
+		if ( in < inEnd ) bitbuf |= (uint64_t)*in++ << bitcnt; else overrun++; \
+		bitcnt += 8; \
+	}
+#endif
+#define FINF_DECODE( h ) \
+	entry = (h)->fast[ bitbuf & ( ( 1 << FINF_FASTBITS ) - 1 ) ]; \
+	if ( entry == 0 ) entry = finf_decodeSlow( (h), bitbuf ); \
+	bitbuf >>= entry & FINF_LENMASK; \
+	bitcnt -= entry & FINF_LENMASK
+
+	for ( ;; ) {
+		FINF_REFILL();
+		FINF_DECODE( lencode );
+		if ( entry & FINF_LITERAL ) {
+			if ( out >= outEnd ) {
+				err = -1;
+				break;
+			}
+			*out++ = entry >> 16;
+			// a second literal still fits without refill
+			FINF_DECODE( lencode );
+			if ( entry & FINF_LITERAL ) {
+				if ( out >= outEnd ) {
+					err = -1;
+					break;
+				}
+				*out++ = entry >> 16;
+				continue;
+			}
+			FINF_REFILL();
+		}
+		if ( entry & ( FINF_END | FINF_INVALID ) ) {
+			err = ( entry & FINF_END ) ? 0 : -1;
+			break;
+		}
+
+		// up to 15 + 5 + 15 + 13 bits for the whole match
+		n = ( entry >> 8 ) & 0xFF;
+		len = ( entry >> 16 ) + (unsigned)( bitbuf & ( ( (uint64_t)1 << n ) - 1 ) );
+		bitbuf >>= n;
+		bitcnt -= n;
+
+		FINF_DECODE( distcode );
+		if ( entry & FINF_INVALID ) {
+			err = -1;
+			break;
+		}
+		n = ( entry >> 8 ) & 0xFF;
+		dist = ( entry >> 16 ) + (unsigned)( bitbuf & ( ( (uint64_t)1 << n ) - 1 ) );
+		bitbuf >>= n;
+		bitcnt -= n;
+
+		if ( dist > (unsigned)( out - outStart ) || len > (unsigned)( outEnd - out ) ) {
+			err = -1;
+			break;
+		}
+
+		from = out - dist;
+		if ( dist >= 8 && (unsigned)( outEnd - out ) >= len + 8 ) {
+			// whole words, may write up to 7 bytes ahead that are overwritten later
+			unsigned char *end = out + len;
+			do {
+				Com_Memcpy( out, from, 8 );
+				out += 8;
+				from += 8;
+			} while ( out < end );
+			out = end;
+		} else if ( dist == 1 ) {
+			Com_Memset( out, out[ -1 ], len );
+			out += len;
+		} else {
+			// overlapping copy repeats the last dist bytes
+			while ( len-- )
+				*out++ = *from++;
+		}
+	}
+
+#undef FINF_REFILL
+#undef FINF_DECODE
+
+	s->in = in;
+	s->out = out;
+	s->bitbuf = bitbuf;
+	s->bitcnt = bitcnt;
+	s->overrun = overrun;
+
+	return err;
+}
+
+
+static int finf_stored( finfState_t *s )
+{
+	unsigned len;
+
+	// discard the rest of the current byte, whole bytes left
+	// in the bit buffer are given back to the input
+	finf_bits( s, s->bitcnt & 7 );
+	if ( s->overrun * 8 > s->bitcnt )
+		return -1;
+	s->in -= ( s->bitcnt >> 3 ) - s->overrun;
+	s->bitbuf = 0;
+	s->bitcnt = 0;
+	s->overrun = 0;
+
+	if ( s->inEnd - s->in < 4 )
+		return -1;
+	len = s->in[ 0 ] | s->in[ 1 ] << 8;
+	if ( ( s->in[ 2 ] ^ 0xFF ) != ( len & 0xFF ) || ( s->in[ 3 ] ^ 0xFF ) != ( len >> 8 ) )
+		return -1;
+	s->in += 4;
+
+	if ( (unsigned)( s->inEnd - s->in ) < len || (unsigned)( s->outEnd - s->out ) < len )
+		return -1;
+	Com_Memcpy( s->out, s->in, len );
+	s->in += len;
+	s->out += len;
+
+	return 0;
+}
+
+
+static int finf_fixed( finfState_t *s )
+{
+	static const unsigned short order[ 4 ][ 2 ] = { { 8, 144 }, { 9, 256 }, { 7, 280 }, { 8, FINF_FIXLCODES } };
+	unsigned char lengths[ FINF_FIXLCODES ];
+	finfHuffman_t lencode, distcode;
+	int sym, i;
+
+	for ( sym = 0, i = 0; i < 4; i++ )
+		for ( ; sym < order[ i ][ 1 ]; sym++ )
+			lengths[ sym ] = order[ i ][ 0 ];
+	finf_build( &lencode, FINF_LITLEN, lengths, FINF_FIXLCODES );
+
+	Com_Memset( lengths, 5, FINF_MAXDCODES );
+	finf_build( &distcode, FINF_DIST, lengths, FINF_MAXDCODES );
+
+	return finf_codes( s, &lencode, &distcode );
+}
+
+
+static int finf_dynamic( finfState_t *s )
+{
+	static const unsigned char order[ 19 ] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	unsigned char lengths[ FINF_MAXLCODES + FINF_MAXDCODES ];
+	finfHuffman_t lencode, distcode;
+	int nlen, ndist, ncode, index, err, sym, len;
+	uint32_t entry;
+
+	finf_refill( s );
+	nlen = finf_bits( s, 5 ) + 257;
+	ndist = finf_bits( s, 5 ) + 1;
+	ncode = finf_bits( s, 4 ) + 4;
+	if ( nlen > FINF_MAXLCODES || ndist > FINF_MAXDCODES )
+		return -1;
+
+	for ( index = 0; index < ncode; index++ ) {
+		finf_refill( s );
+		lengths[ order[ index ] ] = finf_bits( s, 3 );
+	}
+	for ( ; index < 19; index++ )
+		lengths[ order[ index ] ] = 0;
+
+	// complete code required for code lengths
+	if ( finf_build( &lencode, FINF_CODELENS, lengths, 19 ) != 0 )
+		return -1;
+
+	for ( index = 0; index < nlen + ndist; ) {
+		finf_refill( s );
+		entry = finf_decode( s, &lencode );
+		if ( entry & FINF_INVALID )
+			return -1;
+		sym = entry >> 16;
+		if ( sym < 16 ) {
+			lengths[ index++ ] = sym;
+			continue;
+		}
+		len = 0;
+		if ( sym == 16 ) {
+			if ( index == 0 )
+				return -1;
+			len = lengths[ index - 1 ];
+			sym = 3 + finf_bits( s, 2 );
+		} else if ( sym == 17 ) {
+			sym = 3 + finf_bits( s, 3 );
+		} else {
+			sym = 11 + finf_bits( s, 7 );
+		}
+		if ( index + sym > nlen + ndist )
+			return -1;
+		while ( sym-- )
+			lengths[ index++ ] = len;
+	}
+
+	// end of block code is required
+	if ( lengths[ 256 ] == 0 )
+		return -1;
+
+	// incomplete codes are only allowed for a single length 1 code
+	err = finf_build( &lencode, FINF_LITLEN, lengths, nlen );
+	if ( err < 0 || ( err > 0 && nlen - lencode.count[ 0 ] != 1 ) )
+		return -1;
+
+	err = finf_build( &distcode, FINF_DIST, lengths + nlen, ndist );
+	if ( err < 0 || ( err > 0 && ndist - distcode.count[ 0 ] != 1 ) )
+		return -1;
+
+	return finf_codes( s, &lencode, &distcode );
+}
+
+
+/*
+  Inflate a raw deflate stream, succeeds only if exactly destLen bytes are produced
+*/
+static int finf_inflate( unsigned char *dest, unsigned long destLen, const unsigned char *source, unsigned long sourceLen )
+{
+	finfState_t s;
+	int last, type, err;
+
+	s.in = source;
+	s.inEnd = source + sourceLen;
+	s.out = s.outStart = dest;
+	s.outEnd = dest + destLen;
+	s.bitbuf = 0;
+	s.bitcnt = 0;
+	s.overrun = 0;
+
+	do {
+		finf_refill( &s );
+		last = finf_bits( &s, 1 );
+		type = finf_bits( &s, 2 );
+		if ( type == 0 )
+			err = finf_stored( &s );
+		else if ( type == 1 )
+			err = finf_fixed( &s );
+		else if ( type == 2 )
+			err = finf_dynamic( &s );
+		else
+			err = -1;
+		// consumed past the end of input
+		if ( err == 0 && s.overrun * 8 > s.bitcnt )
+			err = -1;
+		if ( err )
+			return err;
+	} while ( !last );
+
+	return ( s.out == s.outEnd ) ? 0 : -1;
+}
+
+
+/*
+  Inflate a raw deflate stream of known size, allocates nothing so it is safe
+  to call from any thread. Returns UNZ_OK or UNZ_BADZIPFILE
+*/
+extern int unzInflateBuffer (void* dest, unsigned long destLen, const void* source, unsigned long sourceLen)
+{
+	if (finf_inflate((Byte*)dest, destLen, (const Byte*)source, sourceLen) != 0)
+		return UNZ_BADZIPFILE;
+	return UNZ_OK;
+}
+
+
+/*
+  Release the inflate checkpoints of the current file
+*/
+static void unzlocal_FreeCheckpoints (file_in_zip_read_info_s* p)
+{
+	int i;
+	for (i = 0; i < p->num_checkpoints; i++)
+		inflateEnd(&p->checkpoints[i].stream);
+	TRYFREE(p->checkpoints);
+	p->checkpoints = NULL;
+	p->num_checkpoints = 0;
+}
+
+
+static voidp unzlocal_CheckpointAlloc (voidp opaque, unsigned items, unsigned size)
+{
+	// checkpoints are too large for the small zone used by inflate itself
+	if (opaque) items += size - size; /* make compiler happy */
+	return (voidp)Z_Malloc(items*size);
+}
+
+
+/*
+  Save the inflate state when the next checkpoint position is reached.
+  The pending compressed input must either be fully consumed or come from
+  memory, so that restoring the state does not depend on read_buffer.
+*/
+static void unzlocal_SaveCheckpoint (file_in_zip_read_info_s* p)
+{
+	unz_checkpoint_s *cp;
+	uLong last;
+
+	if (p->num_checkpoints >= UNZ_MAX_CHECKPOINTS)
+		return;
+
+	last = p->num_checkpoints ? p->checkpoints[p->num_checkpoints-1].stream.total_out : 0;
+	if (p->stream.total_out < last + p->checkpoint_interval)
+		return;
+
+	if (p->stream.avail_in != 0 && p->in_memory == NULL)
+		return;
+
+	if (p->checkpoints == NULL)
+	{
+		p->checkpoints = (unz_checkpoint_s*)ALLOC(UNZ_MAX_CHECKPOINTS * sizeof(unz_checkpoint_s));
+		if (p->checkpoints == NULL)
+		{
+			p->checkpoint_interval = 0;
+			return;
+		}
+	}
+
+	cp = &p->checkpoints[p->num_checkpoints];
+	cp->stream.zalloc = (alloc_func)unzlocal_CheckpointAlloc;
+	cp->stream.zfree = (free_func)zcfree;
+	cp->stream.opaque = (voidp)0;
+	if (inflateCopy(&cp->stream, &p->stream) != Z_OK)
+	{
+		// out of memory or bad data, keep what we have
+		p->checkpoint_interval = 0;
+		return;
+	}
+	cp->pos_in_zipfile = p->pos_in_zipfile;
+	cp->rest_read_compressed = p->rest_read_compressed;
+	cp->rest_read_uncompressed = p->rest_read_uncompressed;
+	p->num_checkpoints++;
+}
+
+
+/*
+  Inflate the whole current file at once with finf_inflate(). Compressed data
+  comes from unzSetCurrentFileBuffer() or is staged here if small enough.
+  On failure the staged data is left for the regular inflate() loop.
+  Returns the number of bytes read or -1
+*/
+static int unzlocal_ReadWholeFile (unz_s* s, Byte* buf)
+{
+	file_in_zip_read_info_s* p = s->pfile_in_zip_read;
+	const uLong compressed = s->cur_file_info.compressed_size;
+
+	if (p->rest_read_compressed == compressed && p->stream.avail_in == 0)
+	{
+		if (compressed > UNZ_WHOLEBUFSIZE || compressed == 0)
+			return -1;
+		p->whole_buffer = (char*)ALLOC(compressed);
+		if (fseek(p->file, p->pos_in_zipfile + p->byte_before_the_zipfile, SEEK_SET) != 0 ||
+			fread(p->whole_buffer, compressed, 1, p->file) != 1)
+		{
+			TRYFREE(p->whole_buffer);
+			p->whole_buffer = NULL;
+			return -1;
+		}
+		p->pos_in_zipfile += compressed;
+		p->rest_read_compressed = 0;
+		p->in_memory = (const Byte*)p->whole_buffer;
+		p->stream.next_in = (Byte*)p->whole_buffer;
+		p->stream.avail_in = (uInt)compressed;
+	}
+	else if (p->rest_read_compressed != 0 || p->stream.avail_in != compressed)
+		return -1;
+
+	if (finf_inflate(buf, p->rest_read_uncompressed, p->stream.next_in, p->stream.avail_in) != 0)
+		return -1;
+
+	p->stream.next_in += p->stream.avail_in;
+	p->stream.avail_in = 0;
+	p->stream.total_out += p->rest_read_uncompressed;
+	p->rest_read_uncompressed = 0;
+
+	// checkpoints could refer to the staged data, seeks restart from the zipfile
+	if (p->in_memory == (const Byte*)p->whole_buffer)
+	{
+		unzlocal_FreeCheckpoints(p);
+		p->in_memory = NULL;
+	}
+	TRYFREE(p->whole_buffer);
+	p->whole_buffer = NULL;
+
+	return (int)s->cur_file_info.uncompressed_size;
+}
+
+
 /*
   Read bytes from the current file.
   buf contain buffer where data must be copied
@@ -2025,6 +2843,17 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 	if (len==0)
 		return 0;
 
+	// whole deflated file requested at once
+	if (pfile_in_zip_read_info->compression_method==Z_DEFLATED &&
+		pfile_in_zip_read_info->stream.total_out==0 &&
+		len >= pfile_in_zip_read_info->rest_read_uncompressed &&
+		pfile_in_zip_read_info->rest_read_uncompressed > 0)
+	{
+		int read = unzlocal_ReadWholeFile(s, (Byte*)buf);
+		if (read > 0)
+			return read;
+	}
+
 	pfile_in_zip_read_info->stream.next_out = (Byte*)buf;
 
 	pfile_in_zip_read_info->stream.avail_out = (uInt)len;
@@ -2035,6 +2864,9 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 
 	while (pfile_in_zip_read_info->stream.avail_out>0)
 	{
+		if (pfile_in_zip_read_info->checkpoint_interval)
+			unzlocal_SaveCheckpoint(pfile_in_zip_read_info);
+
 		if ((pfile_in_zip_read_info->stream.avail_in==0) &&
             (pfile_in_zip_read_info->rest_read_compressed>0))
 		{
@@ -2062,16 +2894,15 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 
 		if (pfile_in_zip_read_info->compression_method==0)
 		{
-			uInt uDoCopy,i ;
+			uInt uDoCopy;
 			if (pfile_in_zip_read_info->stream.avail_out < 
                             pfile_in_zip_read_info->stream.avail_in)
 				uDoCopy = pfile_in_zip_read_info->stream.avail_out ;
 			else
 				uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
 				
-			for (i=0;i<uDoCopy;i++)
-				*(pfile_in_zip_read_info->stream.next_out+i) =
-                        *(pfile_in_zip_read_info->stream.next_in+i);
+			Com_Memcpy(pfile_in_zip_read_info->stream.next_out,
+				pfile_in_zip_read_info->stream.next_in, uDoCopy);
 					
 //			pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
 //								pfile_in_zip_read_info->stream.next_out,
@@ -2127,6 +2958,124 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 }
 
 
+/*
+  Set the position in uncompressed data of the current file
+*/
+extern int unzSeekCurrentFile (unzFile file, unsigned long pos)
+{
+	unz_s* s;
+	file_in_zip_read_info_s* p;
+	const unz_checkpoint_s *cp;
+	uLong start, size, cur;
+	Byte skip[ 8192 ];
+	int i, err;
+
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+	p=s->pfile_in_zip_read;
+
+	if (p==NULL || p->read_buffer==NULL)
+		return UNZ_PARAMERROR;
+
+	size = s->cur_file_info.uncompressed_size;
+	if (pos > size)
+		pos = size;
+
+	cur = p->stream.total_out;
+	if (pos == cur)
+		return UNZ_OK;
+
+	// offset of the compressed data in the zipfile
+	start = p->pos_in_zipfile - (s->cur_file_info.compressed_size - p->rest_read_compressed);
+
+	if (p->compression_method == 0)
+	{
+		if (p->in_memory)
+		{
+			p->stream.next_in = (Byte*)p->in_memory + pos;
+			p->stream.avail_in = (uInt)(size - pos);
+		}
+		else
+		{
+			p->pos_in_zipfile = start + pos;
+			p->rest_read_compressed = size - pos;
+			p->stream.avail_in = 0;
+			if (fseek(p->file, p->pos_in_zipfile + p->byte_before_the_zipfile, SEEK_SET) != 0)
+				return UNZ_ERRNO;
+		}
+		p->rest_read_uncompressed = size - pos;
+		p->stream.total_out = pos;
+		return UNZ_OK;
+	}
+
+	if (!p->stream_initialised)
+		return UNZ_PARAMERROR;
+
+	// closest checkpoint before the target
+	cp = NULL;
+	for (i = 0; i < p->num_checkpoints; i++)
+	{
+		if (p->checkpoints[i].stream.total_out > pos)
+			break;
+		cp = &p->checkpoints[i];
+	}
+
+	if (cp != NULL && (pos < cur || cp->stream.total_out > cur))
+	{
+		inflateEnd(&p->stream);
+		p->stream.zalloc = (alloc_func)0;
+		if (inflateCopy(&p->stream, (z_streamp)&cp->stream) != Z_OK)
+		{
+			p->stream_initialised = 0;
+			p->rest_read_uncompressed = 0;
+			return UNZ_INTERNALERROR;
+		}
+		p->pos_in_zipfile = cp->pos_in_zipfile;
+		p->rest_read_compressed = cp->rest_read_compressed;
+		p->rest_read_uncompressed = cp->rest_read_uncompressed;
+		if (p->in_memory == NULL && p->rest_read_compressed > 0)
+		{
+			if (fseek(p->file, p->pos_in_zipfile + p->byte_before_the_zipfile, SEEK_SET) != 0)
+				return UNZ_ERRNO;
+		}
+	}
+	else if (pos < cur)
+	{
+		// restart from the beginning of the file
+		inflateReset(&p->stream);
+		if (p->in_memory)
+		{
+			p->stream.next_in = (Byte*)p->in_memory;
+			p->stream.avail_in = (uInt)s->cur_file_info.compressed_size;
+		}
+		else
+		{
+			// the first read seeks to pos_in_zipfile
+			p->pos_in_zipfile = start;
+			p->rest_read_compressed = s->cur_file_info.compressed_size;
+			p->stream.avail_in = 0;
+		}
+		p->rest_read_uncompressed = size;
+	}
+
+	// decompress up to the target
+	while (p->stream.total_out < pos)
+	{
+		uLong len = pos - p->stream.total_out;
+		if (len > sizeof(skip))
+			len = sizeof(skip);
+		err = unzReadCurrentFile(file, skip, (unsigned)len);
+		if (err < 0)
+			return err;
+		if (err == 0)
+			break;
+	}
+
+	return UNZ_OK;
+}
+
+
 /*
   Give the current position in uncompressed data
 */
@@ -2249,6 +3198,9 @@ extern int unzCloseCurrentFile (unzFile file)
 
 	TRYFREE(pfile_in_zip_read_info->read_buffer);
 	pfile_in_zip_read_info->read_buffer = NULL;
+	TRYFREE(pfile_in_zip_read_info->whole_buffer);
+	pfile_in_zip_read_info->whole_buffer = NULL;
+	unzlocal_FreeCheckpoints(pfile_in_zip_read_info);
 	if (pfile_in_zip_read_info->stream_initialised)
 		inflateEnd(&pfile_in_zip_read_info->stream);
 
@@ -4060,6 +5012,110 @@ int inflateEnd(z_streamp z)
 }
 
 
+/* rebase a pointer into the copied huffman tree space, fixed trees are static */
+#define HUFT_REBASE(p, from, to) \
+  (((p) >= (from) && (p) < (from) + MANY) ? (to) + ((p) - (from)) : (p))
+
+/*
+  Duplicate the complete state of an inflate stream, including the sliding
+  window, the decoding trees and any in-progress block, so that decompression
+  can later be resumed from this exact point. The copy is freed by inflateEnd().
+*/
+int inflateCopy(z_streamp dest, z_streamp source)
+{
+  struct internal_state *state;
+  inflate_blocks_statef *s, *d;
+  z_stream a;
+  uInt wsize, n;
+
+  if (dest == Z_NULL || source == Z_NULL || source->state == Z_NULL ||
+      source->state->blocks == Z_NULL)
+    return Z_STREAM_ERROR;
+  s = source->state->blocks;
+  if (s->mode == BAD || source->state->mode == imBAD)
+    return Z_DATA_ERROR;
+
+  /* the copy is allocated with the allocator of dest when one is set */
+  a.zalloc = dest->zalloc ? dest->zalloc : source->zalloc;
+  a.zfree = dest->zalloc ? dest->zfree : source->zfree;
+  a.opaque = dest->zalloc ? dest->opaque : source->opaque;
+
+  if ((state = (struct internal_state *)
+       ZALLOC(&a,1,sizeof(struct internal_state))) == Z_NULL)
+    return Z_MEM_ERROR;
+  if ((d = (inflate_blocks_statef *)
+       ZALLOC(&a,1,sizeof(struct inflate_blocks_state))) == Z_NULL)
+  {
+    ZFREE(&a, state);
+    return Z_MEM_ERROR;
+  }
+  *state = *source->state;
+  *d = *s;
+  state->blocks = d;
+
+  wsize = (uInt)(s->end - s->window);
+  d->hufts = (inflate_huft *)ZALLOC(&a, sizeof(inflate_huft), MANY);
+  d->window = (Byte *)ZALLOC(&a, 1, wsize);
+  if (s->mode == BTREE || s->mode == DTREE)
+  {
+    n = 258 + (s->sub.trees.table & 0x1f) + ((s->sub.trees.table >> 5) & 0x1f);
+    d->sub.trees.blens = (uInt*)ZALLOC(&a, n, sizeof(uInt));
+    if (d->sub.trees.blens != Z_NULL)
+      Com_Memcpy(d->sub.trees.blens, s->sub.trees.blens, n * sizeof(uInt));
+  }
+  else if (s->mode == CODES)
+  {
+    d->sub.decode.codes = (inflate_codes_statef *)
+      ZALLOC(&a, 1, sizeof(struct inflate_codes_state));
+    if (d->sub.decode.codes != Z_NULL)
+      *d->sub.decode.codes = *s->sub.decode.codes;
+  }
+  if (d->hufts == Z_NULL || d->window == Z_NULL ||
+      ((s->mode == BTREE || s->mode == DTREE) && d->sub.trees.blens == Z_NULL) ||
+      (s->mode == CODES && d->sub.decode.codes == Z_NULL))
+  {
+    if (s->mode == BTREE || s->mode == DTREE)
+      TRY_FREE(&a, d->sub.trees.blens)
+    else if (s->mode == CODES)
+      TRY_FREE(&a, d->sub.decode.codes)
+    TRY_FREE(&a, d->window)
+    TRY_FREE(&a, d->hufts)
+    ZFREE(&a, d);
+    ZFREE(&a, state);
+    return Z_MEM_ERROR;
+  }
+
+  Com_Memcpy(d->hufts, s->hufts, MANY * sizeof(inflate_huft));
+  Com_Memcpy(d->window, s->window, wsize);
+  d->end = d->window + wsize;
+  d->read = d->window + (s->read - s->window);
+  d->write = d->window + (s->write - s->window);
+
+  if (s->mode == BTREE || s->mode == DTREE)
+  {
+    if (s->sub.trees.tb != Z_NULL)
+      d->sub.trees.tb = HUFT_REBASE(s->sub.trees.tb, s->hufts, d->hufts);
+  }
+  else if (s->mode == CODES)
+  {
+    inflate_codes_statef *c = d->sub.decode.codes;
+    c->ltree = HUFT_REBASE(c->ltree, s->hufts, d->hufts);
+    c->dtree = HUFT_REBASE(c->dtree, s->hufts, d->hufts);
+    if (c->mode == LEN || c->mode == DIST)
+      c->sub.code.tree = HUFT_REBASE(c->sub.code.tree, s->hufts, d->hufts);
+  }
+
+  *dest = *source;
+  dest->zalloc = a.zalloc;
+  dest->zfree = a.zfree;
+  dest->opaque = a.opaque;
+  dest->state = state;
+  return Z_OK;
+}
+
+#undef HUFT_REBASE
+
+
 
 int inflateInit2_(z_streamp z, int w, const char *version, int stream_size)
 {
@@ -49,6 +49,24 @@ typedef struct unz_global_info_s
 } unz_global_info;
 
 
+/* unz_central_dir holds the whole central directory of a zipfile in memory,
+   read by unzReadCentralDir for parsing without an open unzFile */
+typedef struct unz_central_dir_s
+{
+	unsigned char *data;                /* central directory records, malloc'ed */
+	unsigned long size;                 /* size of data */
+	unsigned long offset;               /* offset of central dir, base of file info positions */
+	unsigned long number_entry;         /* total number of entries in the central dir */
+	unsigned char *bundle;              /* bundle index preceding the central dir, if any */
+	unsigned long bundle_size;
+} unz_central_dir;
+
+/* a global comment starting with UNZ_BUNDLE_TAG and followed by a 32-bit little
+   endian size announces a bundle index stored right before the central dir */
+#define UNZ_BUNDLE_TAG "Q3BUNDLE"
+#define UNZ_BUNDLE_TAG_SIZE 8
+
+
 /* unz_file_info contain information about a file in the zipfile */
 typedef struct unz_file_info_s
 {
@@ -106,13 +124,29 @@ typedef struct z_stream_s {
 typedef z_stream *z_streamp;
 
 
+/* unz_checkpoint_s is a saved inflate state inside a deflated file,
+    seeks restart decompression from the nearest one */
+typedef struct
+{
+	z_stream stream;                    /* deep copy of the inflate stream */
+	unsigned long pos_in_zipfile;       /* position of the next compressed read */
+	unsigned long rest_read_compressed;
+	unsigned long rest_read_uncompressed;
+} unz_checkpoint_s;
+
 /* file_in_zip_read_info_s contain internal information about a file in zipfile,
     when reading and decompress it */
 typedef struct
 {
 	char  *read_buffer;         /* internal buffer for compressed data */
+	char  *whole_buffer;        /* whole compressed data for finf_inflate */
+	const unsigned char *in_memory; /* compressed data supplied from memory, if any */
 	z_stream stream;            /* zLib stream structure for inflate */
 
+	unz_checkpoint_s *checkpoints;      /* inflate states saved while reading, for seeks */
+	int  num_checkpoints;
+	unsigned long checkpoint_interval;  /* uncompressed bytes between checkpoints, 0 if disabled */
+
 	unsigned long pos_in_zipfile;       /* position in unsigned char on the zipfile, for fseek*/
 	unsigned long stream_initialised;   /* flag set if stream structure is initialised*/
 
@@ -216,6 +250,25 @@ extern int unzGetGlobalComment (unzFile file, char *szComment, unsigned long uSi
 */
 
 
+extern int unzReadCentralDir (const char *path, unz_central_dir *dir);
+/*
+  Read the central directory of a zipfile into memory. Uses no engine memory
+  so it is safe to call from any thread, release with unzFreeCentralDir.
+  A bundle index is read along with it, in the same block.
+  return UNZ_OK if there is no problem
+*/
+
+extern int unzGetCentralDirEntry (const unz_central_dir *dir, unsigned long *pos, unz_file_info *pfile_info, char *szFileName, unsigned long fileNameBufferSize);
+/*
+  Parse the file info at position *pos of a central directory read by
+  unzReadCentralDir and advance *pos to the next entry. Positions are the
+  ones of unzGetCurrentFileInfoPosition, the first is dir->offset.
+  return UNZ_OK or UNZ_BADZIPFILE if the entry does not fit or is corrupted
+*/
+
+extern void unzFreeCentralDir (unz_central_dir *dir);
+
+
 /***************************************************************************/
 /* Unzip package allow you browse the directory of the zipfile */
 
@@ -295,6 +348,17 @@ extern int unzCloseCurrentFile (unzFile file);
 */
 
 												
+extern int unzInflateBuffer (void* dest, unsigned long destLen, const void* source, unsigned long sourceLen);
+/*
+  Inflate a whole raw deflate stream from memory, thread safe
+*/
+
+extern int unzSetCurrentFileBuffer (unzFile file, const void *buf);
+/*
+  Supply the compressed data of the current file from memory, e.g. a mapped view
+  of the zipfile, so unzReadCurrentFile does not read it through the FILE.
+*/
+
 extern int unzReadCurrentFile (unzFile file, void* buf, unsigned len);
 
 /*
@@ -308,6 +372,15 @@ extern int unzReadCurrentFile (unzFile file, void* buf, unsigned len);
     (UNZ_ERRNO for IO error, or zLib error for uncompress error)
 */
 
+extern int unzSeekCurrentFile (unzFile file, unsigned long pos);
+
+/*
+  Set the position in uncompressed data of the current file, clamped to its size.
+  Stored files are repositioned directly, deflated files resume from the closest
+  inflate checkpoint saved while reading (or from the start) and skip forward.
+  return UNZ_OK if there is no problem
+*/
+
 extern long unztell(unzFile file);
 
 /*
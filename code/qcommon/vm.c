@@ -35,6 +35,7 @@ and one exported function: Perform
 */
 
 #include "vm_local.h"
+#include <setjmp.h>
 
 opcode_info_t ops[ OP_MAX ] =
 {
@@ -204,6 +205,9 @@ const char *opname[ 256 ] = {
 };
 
 cvar_t	*vm_rtChecks;
+cvar_t	*vm_codeCache;
+cvar_t	*vm_codeKey;
+cvar_t	*vm_tierUp;
 
 #ifdef DEBUG
 int		vm_debugLevel;
@@ -212,6 +216,9 @@ int		vm_debugLevel;
 // used by Com_Error to get rid of running vm's before longjmp
 static int forced_unload;
 
+// worker stacks to reserve in data segment, see VM_ReserveWorkers
+static int vmWorkerStacks[ VM_COUNT ];
+
 static struct vm_s vmTable[ VM_COUNT ];
 
 static const char *vmName[ VM_COUNT ] = {
@@ -222,6 +229,12 @@ static const char *vmName[ VM_COUNT ] = {
 
 static void VM_VmInfo_f( void );
 static void VM_VmProfile_f( void );
+static void VM_VmBench_f( void );
+static void VM_VmCompile_f( void );
+static void VM_StopSyscallProfile( vm_t *vm );
+static void VM_StopStackProfile( vm_t *vm );
+static int64_t VM_StackProfileCall( vm_t *vm );
+static void VM_StackProfileReturn( vm_t *vm, int64_t start );
 
 #ifdef DEBUG
 void VM_Debug( int level ) {
@@ -275,8 +288,22 @@ void VM_Init( void ) {
 #endif
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE | CVAR_PROTECTED );	// !@# SHIP WITH SET TO 2
 
+	vm_codeCache = Cvar_Get( "vm_codeCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( vm_codeCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( vm_codeCache, "Store compiled QVM code in the home directory and reuse it on next loads of the same QVM." );
+
+	vm_codeKey = Cvar_Get( "vm_codeKey", "", CVAR_PROTECTED | CVAR_PRIVATE );
+	Cvar_SetDescription( vm_codeKey, "Secret used to sign cached QVM code, cached code with other or no signature is not loaded when set.\nSee \\vmcompile." );
+
+	vm_tierUp = Cvar_Get( "vm_tierUp", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( vm_tierUp, "0", "100000", CV_INTEGER );
+	Cvar_SetDescription( vm_tierUp, "Count function calls in compiled QVM code during given number of vmMain calls, "
+		"then recompile it with most called functions placed together.\n 0 - disabled\nApplied on VM load, see \\vmprofile." );
+
 	Cmd_AddCommand( "vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand( "vminfo", VM_VmInfo_f );
+	Cmd_AddCommand( "vmbench", VM_VmBench_f );
+	Cmd_AddCommand( "vmcompile", VM_VmCompile_f );
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -792,6 +819,11 @@ static vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc ) {
 	if ( dataLength < PROGRAM_STACK_SIZE + PROGRAM_STACK_EXTRA ) {
 		dataLength = PROGRAM_STACK_SIZE + PROGRAM_STACK_EXTRA;
 	}
+	if ( vmWorkerStacks[ vm->index ] ) {
+		// worker stacks go between bss and main stack
+		dataLength = vm->exactDataLength + PROGRAM_STACK_SIZE + PROGRAM_STACK_EXTRA
+			+ vmWorkerStacks[ vm->index ] * WORKER_STACK_SIZE;
+	}
 	vm->dataLength = dataLength;
 
 	// round up to next power of 2 so all data operations can
@@ -1636,6 +1668,69 @@ void VM_ReplaceInstructions( vm_t *vm, instruction_t *buf ) {
 }
 
 
+/*
+=================
+VM_FindFunctions
+
+Locates all functions for profiling, only done once per vm
+=================
+*/
+void VM_FindFunctions( vm_t *vm, const instruction_t *buf ) {
+	int i, n;
+
+	if ( vm->funcStart ) {
+		return;
+	}
+
+	for ( i = 0, n = 0; i < vm->instructionCount; i++ ) {
+		if ( buf[i].op == OP_ENTER ) {
+			n++;
+		}
+	}
+
+	if ( !n ) {
+		return;
+	}
+
+	vm->funcStart = Z_Malloc( n * sizeof( vm->funcStart[0] ) );
+	vm->funcFrame = Z_Malloc( n * sizeof( vm->funcFrame[0] ) );
+	for ( i = 0, n = 0; i < vm->instructionCount; i++ ) {
+		if ( buf[i].op == OP_ENTER ) {
+			vm->funcFrame[ n ] = buf[i].value;
+			vm->funcStart[ n++ ] = i;
+		}
+	}
+	vm->numFuncs = n;
+}
+
+
+/*
+=================
+VM_ReadQVM
+
+Reads bytecode of already loaded vm again, without touching its data segment
+=================
+*/
+static vmHeader_t *VM_ReadQVM( const vm_t *vm ) {
+	char		filename[MAX_QPATH];
+	vmHeader_t	*header;
+	int			length;
+
+	Com_sprintf( filename, sizeof( filename ), "vm/%s.qvm", vm->name );
+	length = FS_ReadFile( filename, (void **)&header );
+	if ( !header ) {
+		return NULL;
+	}
+
+	if ( crc32_buffer( (const byte*) header, length ) != vm->crc32sum || VM_ValidateHeader( header, length ) ) {
+		FS_FreeFile( header );
+		return NULL;
+	}
+
+	return header;
+}
+
+
 /*
 =================
 VM_Restart
@@ -1653,6 +1748,8 @@ vm_t *VM_Restart( vm_t *vm ) {
 		dllSyscall_t	dllSyscall;
 		vmIndex_t		index;
 
+		VM_StopSyscallProfile( vm );
+
 		index = vm->index;
 		systemCall = vm->systemCall;
 		dllSyscall = vm->dllSyscall;
@@ -1720,6 +1817,153 @@ static void * QDECL VM_LoadDll( const char *name, vmMainFunc_t *entryPoint, dllS
 }
 
 
+/*
+=================
+VM_ReloadPointer
+
+Moves pointer into data of the replaced module image, see VM_ReloadDll
+=================
+*/
+void *VM_ReloadPointer( const vmReload_t *reload, void *ptr )
+{
+	if ( (byte *)ptr >= reload->oldData && (byte *)ptr < reload->oldData + reload->dataSize )
+		return reload->newData + ( (byte *)ptr - reload->oldData );
+	else
+		return ptr;
+}
+
+
+/*
+=================
+VM_ReloadDll
+
+Loads a rebuilt copy of the module library and moves current module state
+into it, so development servers can pick up code changes without restart.
+
+Writable data of the old image is copied over the new one and every word
+that points into the old image is translated: pointers into data are moved
+by offset, pointers to exported functions and objects are looked up by name
+in the new library and all other pointers to constant data are kept, the old
+image stays mapped until the module is freed. Reload is refused when data
+layout hash differs or some pointer into old code has no exported symbol.
+
+Engine pointers into module data should be moved with VM_ReloadPointer
+=================
+*/
+qboolean VM_ReloadDll( vm_t *vm, vmReload_t *reload )
+{
+	libraryLayout_t old, cur;
+	vmMainFunc_t entryPoint;
+	dllEntry_t dllEntry;
+	void *handle, *ptr, *first;
+	void **data;
+	size_t i, count;
+	int unresolved;
+
+	Com_Memset( reload, 0, sizeof( *reload ) );
+
+	if ( !vm->dllHandle ) {
+		Com_Printf( "%s is not a native module\n", vm->name );
+		return qfalse;
+	}
+
+	if ( vm->callLevel ) {
+		Com_Printf( "%s is running\n", vm->name );
+		return qfalse;
+	}
+
+	if ( vm->numRetiredDll >= MAX_DLL_RELOADS ) {
+		Com_Printf( "%s was reloaded too many times, restart the map\n", vm->name );
+		return qfalse;
+	}
+
+	if ( !Sys_LibraryLayout( vm->dllHandle, &old ) ) {
+		Com_Printf( "%s reloading is not supported on this platform\n", vm->name );
+		return qfalse;
+	}
+
+	// later images are loaded from temporary copies
+	if ( !vm->dllPath ) {
+		vm->dllPath = CopyString( old.path );
+	}
+
+	handle = Sys_LoadLibraryCopy( vm->dllPath );
+	if ( !handle ) {
+		Com_Printf( S_COLOR_YELLOW "failed to load %s\n", vm->dllPath );
+		return qfalse;
+	}
+
+	dllEntry = Sys_LoadFunction( handle, "dllEntry" );
+	entryPoint = Sys_LoadFunction( handle, "vmMain" );
+
+	if ( !dllEntry || !entryPoint || !Sys_LibraryLayout( handle, &cur ) ) {
+		Com_Printf( S_COLOR_YELLOW "%s is not a valid module\n", vm->dllPath );
+		Sys_UnloadLibrary( handle );
+		return qfalse;
+	}
+
+	if ( cur.layout != old.layout || cur.dataSize != old.dataSize ) {
+		Com_Printf( S_COLOR_YELLOW "%s data layout has changed (%08x, %08x), restart the map\n",
+			vm->name, cur.layout, old.layout );
+		Sys_UnloadLibrary( handle );
+		return qfalse;
+	}
+
+	count = old.dataSize / sizeof( void * );
+	data = Z_Malloc( count * sizeof( void * ) );
+	Com_Memcpy( data, old.data, count * sizeof( void * ) );
+
+	unresolved = 0;
+	first = NULL;
+
+	for ( i = 0; i < count; i++ ) {
+		ptr = data[ i ];
+		if ( (byte *)ptr < old.base || (byte *)ptr >= old.base + old.size ) {
+			continue;
+		}
+		if ( (byte *)ptr >= old.data && (byte *)ptr < old.data + old.dataSize ) {
+			data[ i ] = cur.data + ( (byte *)ptr - old.data );
+			continue;
+		}
+		ptr = Sys_LibrarySymbol( data[ i ], handle );
+		if ( ptr && (byte *)ptr >= cur.base && (byte *)ptr < cur.base + cur.size ) {
+			data[ i ] = ptr;
+			continue;
+		}
+		if ( (byte *)data[ i ] >= old.code && (byte *)data[ i ] < old.code + old.codeSize ) {
+			if ( !unresolved++ )
+				first = data[ i ];
+		}
+		// anything else points to constant data of the old image
+	}
+
+	if ( unresolved ) {
+		Com_Printf( S_COLOR_YELLOW "%s holds %i pointers to non-exported code (first at +%x), restart the map\n",
+			vm->name, unresolved, (unsigned int)( (byte *)first - old.base ) );
+		Z_Free( data );
+		Sys_UnloadLibrary( handle );
+		return qfalse;
+	}
+
+	Com_Memcpy( cur.data, data, count * sizeof( void * ) );
+	Z_Free( data );
+
+	dllEntry( vm->dllSyscall );
+
+	vm->retiredDll[ vm->numRetiredDll++ ] = vm->dllHandle;
+	vm->dllHandle = handle;
+	vm->entryPoint = entryPoint;
+
+	reload->oldData = old.data;
+	reload->newData = cur.data;
+	reload->dataSize = old.dataSize;
+
+	Com_Printf( "%s reloaded from %s, %i KB of data moved\n", vm->name, vm->dllPath, (int)( old.dataSize / 1024 ) );
+
+	return qtrue;
+}
+
+
 /*
 ================
 VM_Create
@@ -1814,6 +2058,9 @@ vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscall
 	if ( interpret >= VMI_COMPILED ) {
 		if ( VM_Compile( vm, header ) ) {
 			vm->compiled = qtrue;
+			if ( vm->funcCalls ) {
+				vm->tierUpCalls = vm_tierUp->integer;
+			}
 		}
 	}
 #endif
@@ -1838,6 +2085,133 @@ vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscall
 }
 
 
+/*
+================
+VM_ReserveWorkers
+
+Sets number of worker stacks reserved on next VM_Create of this vm,
+must stay the same for VM_Restart
+================
+*/
+void VM_ReserveWorkers( vmIndex_t index, int count ) {
+	if ( (unsigned)index < VM_COUNT ) {
+		vmWorkerStacks[ index ] = count > 0 ? count : 0;
+	}
+}
+
+
+/*
+================
+VM_CreateWorker
+
+Creates an instance of a loaded qvm that shares its data segment but has its
+own stack in one of the reserved slots and its own compiled code, so it can
+run vmMain on another thread while the main instance waits in a system call.
+Native modules can't be instanced, returns NULL then
+================
+*/
+vm_t *VM_CreateWorker( vm_t *vm, int slot, syscall_t systemCalls ) {
+	vmHeader_t	*header;
+	vm_t		*worker;
+	int32_t		top;
+
+	if ( vm->dllHandle || !vm->dataBase || vm->parent ) {
+		return NULL;
+	}
+
+	if ( slot < 0 || slot >= vmWorkerStacks[ vm->index ] ) {
+		return NULL;
+	}
+
+	top = vm->stackBottom - slot * WORKER_STACK_SIZE;
+	if ( top - WORKER_STACK_SIZE < (int32_t)vm->exactDataLength ) {
+		Com_Printf( S_COLOR_YELLOW "%s: no space for worker stack %i\n", vm->name, slot );
+		return NULL;
+	}
+
+	header = VM_ReadQVM( vm );
+	if ( !header ) {
+		Com_Printf( S_COLOR_YELLOW "%s: couldn't reload bytecode for worker %i\n", vm->name, slot );
+		return NULL;
+	}
+
+	worker = Z_Malloc( sizeof( *worker ) );
+	worker->parent = vm;
+	worker->name = vm->name;
+	worker->index = vm->index;
+	worker->systemCall = systemCalls;
+	worker->privateFlag = vm->privateFlag;
+	worker->crc32sum = vm->crc32sum;
+
+	worker->dataBase = vm->dataBase;
+	worker->dataMask = vm->dataMask;
+	worker->dataLength = vm->dataLength;
+	worker->exactDataLength = vm->exactDataLength;
+	worker->dataAlloc = vm->dataAlloc;
+	worker->jumpTableTargets = vm->jumpTableTargets;
+	worker->numJumpTableTargets = vm->numJumpTableTargets;
+
+	worker->instructionCount = header->instructionCount;
+	worker->codeLength = header->codeLength;
+
+	worker->programStack = top;
+	worker->stackBottom = top - WORKER_STACK_SIZE;
+
+#ifndef NO_VM_COMPILED
+	if ( vm->compiled && VM_Compile( worker, header ) ) {
+		worker->compiled = qtrue;
+	}
+#endif
+	if ( !worker->compiled && !VM_PrepareInterpreter2( worker, header ) ) {
+		FS_FreeFile( header );
+		VM_FreeWorker( worker );
+		return NULL;
+	}
+
+	FS_FreeFile( header );
+
+	return worker;
+}
+
+
+/*
+================
+VM_ResetWorker
+
+Restores worker stack after it was left with longjmp
+================
+*/
+void VM_ResetWorker( vm_t *worker ) {
+	worker->programStack = worker->stackBottom + WORKER_STACK_SIZE;
+	worker->callLevel = 0;
+}
+
+
+/*
+================
+VM_FreeWorker
+================
+*/
+void VM_FreeWorker( vm_t *worker ) {
+
+	if ( !worker ) {
+		return;
+	}
+
+	if ( worker->destroy )
+		worker->destroy( worker );
+
+	if ( worker->funcCalls )
+		Z_Free( worker->funcCalls );
+	if ( worker->funcStart )
+		Z_Free( worker->funcStart );
+	if ( worker->funcFrame )
+		Z_Free( worker->funcFrame );
+
+	Z_Free( worker );
+}
+
+
 /*
 ==============
 VM_Free
@@ -1858,11 +2232,29 @@ void VM_Free( vm_t *vm ) {
 		}
 	}
 
+	VM_StopSyscallProfile( vm );
+	VM_StopStackProfile( vm );
+
 	if ( vm->destroy )
 		vm->destroy( vm );
 
 	if ( vm->dllHandle )
 		Sys_UnloadLibrary( vm->dllHandle );
+	while ( vm->numRetiredDll > 0 )
+		Sys_UnloadLibrary( vm->retiredDll[ --vm->numRetiredDll ] );
+	if ( vm->dllPath )
+		Z_Free( vm->dllPath );
+
+	if ( vm->funcHot )
+		Z_Free( vm->funcHot );
+	if ( vm->funcCalls )
+		Z_Free( vm->funcCalls );
+	if ( vm->funcStart )
+		Z_Free( vm->funcStart );
+	if ( vm->funcFrame )
+		Z_Free( vm->funcFrame );
+	if ( vm->funcNames )
+		Z_Free( (void *)vm->funcNames );
 
 #if 0	// now automatically freed by hunk
 	if ( vm->codeBase.ptr ) {
@@ -1887,6 +2279,35 @@ void VM_Clear( void ) {
 }
 
 
+/*
+==============
+VM_MemoryStats
+
+Returns qfalse if VM is not running,
+native modules have no code or data segment of their own
+==============
+*/
+qboolean VM_MemoryStats( vmIndex_t index, const char **name, int *codeBytes, int *dataBytes ) {
+	const vm_t *vm;
+
+	vm = &vmTable[ index ];
+	if ( !vm->name ) {
+		return qfalse;
+	}
+
+	*name = vm->name;
+	if ( vm->dllHandle ) {
+		*codeBytes = 0;
+		*dataBytes = 0;
+	} else {
+		*codeBytes = vm->codeLength;
+		*dataBytes = vm->dataAlloc;
+	}
+
+	return qtrue;
+}
+
+
 void VM_Forced_Unload_Start(void) {
 	forced_unload = 1;
 }
@@ -1897,52 +2318,220 @@ void VM_Forced_Unload_Done(void) {
 }
 
 
+#ifndef NO_VM_COMPILED
+#define HOT_FUNC_SHARE	0.95	// part of profiled calls covered by hot functions
+#define MAX_HOT_FUNCS	128
+
+typedef struct {
+	uint32_t	calls;
+	int			func;
+} funcCalls_t;
+
+static int QDECL VM_FuncCallsSort( const void *a, const void *b ) {
+	const funcCalls_t *fa = (const funcCalls_t *)a;
+	const funcCalls_t *fb = (const funcCalls_t *)b;
+
+	if ( fa->calls != fb->calls ) {
+		return fa->calls > fb->calls ? -1 : 1;
+	}
+
+	return fa->func - fb->func;
+}
+
+
 /*
-==============
-VM_Call
+=================
+VM_RecompileError
 
+Com_Error handler while recompiling, DROP in the compilers ends up here
+=================
+*/
+static void VM_RecompileError( void *arg, int code, const char *msg ) {
+	if ( code == ERR_FATAL ) {
+		Com_SetThreadErrorHandler( NULL, NULL );
+		Com_Error( code, "%s", msg );
+	}
 
-Upon a system call, the stack will look like:
+	Com_Printf( S_COLOR_YELLOW "%s\n", msg );
 
-sp+32	parm1
-sp+28	parm0
-sp+24	return value
-sp+20	return address
-sp+16	local1
-sp+14	local0
-sp+12	arg1
-sp+8	arg0
-sp+4	return stack
-sp		return address
+	Q_longjmp( *(jmp_buf *)arg, 1 );
+}
 
-An interpreted function will immediately execute
-an OP_ENTER instruction, which will subtract space for
-locals from sp
-==============
+
+/*
+=================
+VM_Recompile
+
+Replaces compiled code of the vm, current code is kept when compilation
+fails, including compiler errors that would otherwise drop the server.
+Must be called between vmMain calls
+=================
 */
+static qboolean VM_Recompile( vm_t *vm, vmHeader_t *header ) {
+	vm_t	old;
+	jmp_buf	abort;
+	qboolean compiled;
+
+	// keep current code until replacement is ready
+	Com_Memset( &old, 0, sizeof( old ) );
+	old.codeBase = vm->codeBase;
+	old.codeSize = vm->codeSize;
+	old.codeLength = vm->codeLength;
+	old.destroy = vm->destroy;
+
+	if ( Q_setjmp( abort ) ) {
+		compiled = qfalse;
+	} else {
+		Com_SetThreadErrorHandler( VM_RecompileError, &abort );
+		compiled = VM_Compile( vm, header );
+	}
 
-intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
-{
-	//vm_t	*oldVM;
-	intptr_t r;
-	int i;
+	Com_SetThreadErrorHandler( NULL, NULL );
 
-	if ( !vm ) {
-		Com_Error( ERR_FATAL, "VM_Call with NULL vm" );
+	if ( !compiled ) {
+		// code allocated by the last pass before the compiler gave up
+		if ( vm->codeBase.ptr && vm->codeBase.ptr != old.codeBase.ptr && old.destroy ) {
+			old.destroy( vm );
+		}
+		vm->codeBase = old.codeBase;
+		vm->codeSize = old.codeSize;
+		vm->codeLength = old.codeLength;
+		vm->destroy = old.destroy;
+		Com_Printf( S_COLOR_YELLOW "%s: recompilation failed, keeping current code\n", vm->name );
+		return qfalse;
 	}
 
-#ifdef DEBUG
-	if ( vm_debugLevel ) {
-	  Com_Printf( "VM_Call( %d )\n", callnum );
+	if ( old.destroy ) {
+		old.destroy( &old );
 	}
 
-	if ( nargs >= MAX_VMMAIN_CALL_ARGS ) {
-		Com_Error( ERR_DROP, "VM_Call: nargs >= MAX_VMMAIN_CALL_ARGS" );
+	return qtrue;
+}
+
+
+/*
+=================
+VM_TierUp
+
+Recompiles the vm with most called functions placed together, must be
+called between vmMain calls so there is no compiled code running
+=================
+*/
+static void VM_TierUp( vm_t *vm ) {
+	funcCalls_t	*sorted;
+	vmHeader_t	*header;
+	double		total, covered;
+	int			i, numHot;
+
+	total = 0;
+	for ( i = 0; i < vm->numFuncs; i++ ) {
+		total += vm->funcCalls[i];
 	}
-#endif
 
-	++vm->callLevel;
-	// if we have a dll loaded, call it directly
+	if ( total == 0 ) {
+		return;
+	}
+
+	header = VM_ReadQVM( vm );
+	if ( !header ) {
+		Com_Printf( S_COLOR_YELLOW "%s: couldn't reload bytecode for recompilation\n", vm->name );
+		return;
+	}
+
+	sorted = Z_Malloc( vm->numFuncs * sizeof( sorted[0] ) );
+	for ( i = 0; i < vm->numFuncs; i++ ) {
+		sorted[i].calls = vm->funcCalls[i];
+		sorted[i].func = i;
+	}
+
+	qsort( sorted, vm->numFuncs, sizeof( sorted[0] ), VM_FuncCallsSort );
+
+	vm->funcHot = Z_Malloc( vm->numFuncs );
+
+	covered = 0;
+	for ( numHot = 0; numHot < vm->numFuncs && numHot < MAX_HOT_FUNCS && sorted[numHot].calls; numHot++ ) {
+		if ( covered >= total * HOT_FUNC_SHARE ) {
+			break;
+		}
+		vm->funcHot[ sorted[numHot].func ] = 1;
+		covered += sorted[numHot].calls;
+	}
+
+	Z_Free( sorted );
+
+	if ( VM_Recompile( vm, header ) ) {
+		// nothing references counters anymore
+		Z_Free( vm->funcCalls );
+		vm->funcCalls = NULL;
+		Com_Printf( "%s: recompiled with %i hot functions covering %.1f%% of calls\n", vm->name, numHot, covered * 100.0 / total );
+	} else {
+		Z_Free( vm->funcHot );
+		vm->funcHot = NULL;
+	}
+
+	FS_FreeFile( header );
+}
+#endif
+
+
+/*
+==============
+VM_Call
+
+
+Upon a system call, the stack will look like:
+
+sp+32	parm1
+sp+28	parm0
+sp+24	return value
+sp+20	return address
+sp+16	local1
+sp+14	local0
+sp+12	arg1
+sp+8	arg0
+sp+4	return stack
+sp		return address
+
+An interpreted function will immediately execute
+an OP_ENTER instruction, which will subtract space for
+locals from sp
+==============
+*/
+
+intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
+{
+	//vm_t	*oldVM;
+	intptr_t r;
+	int64_t profileStart;
+	int i;
+
+	if ( !vm ) {
+		Com_Error( ERR_FATAL, "VM_Call with NULL vm" );
+	}
+
+#ifdef DEBUG
+	if ( vm_debugLevel ) {
+	  Com_Printf( "VM_Call( %d )\n", callnum );
+	}
+
+	if ( nargs >= MAX_VMMAIN_CALL_ARGS ) {
+		Com_Error( ERR_DROP, "VM_Call: nargs >= MAX_VMMAIN_CALL_ARGS" );
+	}
+#endif
+
+#ifndef NO_VM_COMPILED
+	if ( vm->tierUpCalls && !vm->callLevel && --vm->tierUpCalls == 0 ) {
+		VM_TierUp( vm );
+	}
+#endif
+
+	profileStart = 0;
+	if ( vm->stackProfile ) {
+		profileStart = VM_StackProfileCall( vm );
+	}
+
+	++vm->callLevel;
+	// if we have a dll loaded, call it directly
 	if ( vm->entryPoint )
 	{
 		//rcg010207 -  see dissertation at top of VM_DllSyscall() in this file.
@@ -1984,6 +2573,10 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 	}
 	--vm->callLevel;
 
+	if ( vm->stackProfile ) {
+		VM_StackProfileReturn( vm, profileStart );
+	}
+
 	return r;
 }
 
@@ -2035,6 +2628,500 @@ static vm_t *VM_NameToVM( const char *name )
 }
 
 
+/*
+===============================================================================
+
+SYSTEM CALL PROFILING
+
+vm->systemCall is temporarily replaced by a wrapper which counts calls and
+time spent in each trap, time includes nested vm calls made by the trap
+
+Same wrapper samples call stacks, every system call is a sample point:
+qvm frames are walked through call sites saved at the bottom of each
+stack frame, time since previous sample is charged to the calling stack
+and time spent in the trap, without nested vm calls, to the stack
+extended with the trap frame. Compiled code saves call sites only after
+it has been recompiled for the first stack profile
+
+===============================================================================
+*/
+
+#define MAX_PROFILED_SYSCALLS	1024
+
+#define MAX_PROFILED_DEPTH		32
+#define MAX_PROFILED_STACKS		4096	// must be power of 2
+
+#define QVM_SAMPLE				-1		// qvm code, not a trap
+
+typedef struct {
+	int32_t		frames[ MAX_PROFILED_DEPTH ];	// function indices, outermost first
+	int			depth;
+	int			trap;
+	uint32_t	hash;
+	uint32_t	samples;
+	int64_t		nsec;
+} stackSample_t;
+
+typedef struct stackProfile_s {
+	stackSample_t	stacks[ MAX_PROFILED_STACKS ];
+	int			numStacks;
+	uint32_t	dropped;	// samples of stacks not fitting into table
+	int64_t		last;		// end of previous sample
+	int64_t		nested;		// time spent in vmMain calls
+} stackProfile_t;
+
+typedef struct syscallProfile_s {
+	uint32_t	calls;
+	int64_t		nsec;
+} syscallProfile_t;
+
+typedef struct {
+	syscallProfile_t	prof;
+	int					trap;
+} syscallSort_t;
+
+
+/*
+==============
+VM_ProfileSyscall
+==============
+*/
+static int VM_StackWalk( const vm_t *vm, int32_t *frames );
+static void VM_StackSample( stackProfile_t *prof, const int32_t *frames, int depth, int trap, int64_t nsec );
+
+static intptr_t VM_ProfileSyscall( vm_t *vm, intptr_t *args ) {
+	int32_t frames[ MAX_PROFILED_DEPTH ];
+	stackProfile_t *stacks;
+	syscallProfile_t *prof;
+	intptr_t trap, ret;
+	int64_t start, end, nested;
+	int depth;
+
+	// arguments may be overwritten by the handler
+	trap = args[0];
+
+	start = Sys_Nanoseconds();
+
+	stacks = vm->stackProfile;
+	depth = 0;
+	nested = 0;
+	if ( stacks ) {
+		depth = VM_StackWalk( vm, frames );
+		VM_StackSample( stacks, frames, depth, QVM_SAMPLE, start - stacks->last );
+		nested = stacks->nested;
+	}
+
+	ret = vm->profiledSystemCall( args );
+
+	end = Sys_Nanoseconds();
+
+	if ( vm->syscallProfile && trap >= 0 && trap < MAX_PROFILED_SYSCALLS ) {
+		prof = &vm->syscallProfile[ trap ];
+		prof->calls++;
+		prof->nsec += end - start;
+	}
+
+	if ( stacks ) {
+		VM_StackSample( stacks, frames, depth, trap, end - start - ( stacks->nested - nested ) );
+		stacks->last = end;
+	}
+
+	return ret;
+}
+
+
+static intptr_t QDECL VM_ProfileGameSyscall( intptr_t *args ) {
+	return VM_ProfileSyscall( &vmTable[ VM_GAME ], args );
+}
+
+
+static intptr_t QDECL VM_ProfileCGameSyscall( intptr_t *args ) {
+	return VM_ProfileSyscall( &vmTable[ VM_CGAME ], args );
+}
+
+
+static intptr_t QDECL VM_ProfileUISyscall( intptr_t *args ) {
+	return VM_ProfileSyscall( &vmTable[ VM_UI ], args );
+}
+
+
+static const syscall_t syscallProfilers[ VM_COUNT ] = {
+	VM_ProfileGameSyscall,
+	VM_ProfileCGameSyscall,
+	VM_ProfileUISyscall
+};
+
+
+static void VM_HookSyscalls( vm_t *vm ) {
+	if ( !vm->profiledSystemCall ) {
+		vm->profiledSystemCall = vm->systemCall;
+		vm->systemCall = syscallProfilers[ vm->index ];
+	}
+}
+
+
+static void VM_UnhookSyscalls( vm_t *vm ) {
+	if ( vm->profiledSystemCall && !vm->syscallProfile && !vm->stackProfile ) {
+		vm->systemCall = vm->profiledSystemCall;
+		vm->profiledSystemCall = NULL;
+	}
+}
+
+
+/*
+==============
+VM_StopSyscallProfile
+==============
+*/
+static void VM_StopSyscallProfile( vm_t *vm ) {
+	if ( !vm->syscallProfile ) {
+		return;
+	}
+
+	Z_Free( vm->syscallProfile );
+	vm->syscallProfile = NULL;
+
+	VM_UnhookSyscalls( vm );
+}
+
+
+static int QDECL VM_SyscallSort( const void *a, const void *b ) {
+	const syscallSort_t *sa = (const syscallSort_t *)a;
+	const syscallSort_t *sb = (const syscallSort_t *)b;
+
+	if ( sa->prof.nsec != sb->prof.nsec ) {
+		return sa->prof.nsec > sb->prof.nsec ? -1 : 1;
+	}
+
+	return sa->trap - sb->trap;
+}
+
+
+/*
+==============
+VM_SyscallProfile
+
+Starts profiling on first call, shows results and stops on second
+==============
+*/
+static void VM_SyscallProfile( vm_t *vm ) {
+	syscallSort_t	*sorted;
+	double			total;
+	uint32_t		calls;
+	int				i, n;
+
+	if ( vm->callLevel ) {
+		Com_Printf( "%s is running.\n", vm->name );
+		return;
+	}
+
+	if ( !vm->syscallProfile ) {
+		if ( vm->dllHandle ) {
+			Com_Printf( "Native modules call engine directly, nothing to profile.\n" );
+			return;
+		}
+		vm->syscallProfile = Z_Malloc( MAX_PROFILED_SYSCALLS * sizeof( vm->syscallProfile[0] ) );
+		VM_HookSyscalls( vm );
+		Com_Printf( "Profiling %s system calls, run the command again to show results.\n", vm->name );
+		return;
+	}
+
+	sorted = Z_Malloc( MAX_PROFILED_SYSCALLS * sizeof( sorted[0] ) );
+
+	total = 0;
+	calls = 0;
+	for ( i = 0, n = 0; i < MAX_PROFILED_SYSCALLS; i++ ) {
+		if ( vm->syscallProfile[i].calls ) {
+			sorted[n].prof = vm->syscallProfile[i];
+			sorted[n].trap = i;
+			total += sorted[n].prof.nsec;
+			calls += sorted[n].prof.calls;
+			n++;
+		}
+	}
+
+	qsort( sorted, n, sizeof( sorted[0] ), VM_SyscallSort );
+
+	Com_Printf( "trap      calls       msec  ns/call\n" );
+	for ( i = 0; i < n; i++ ) {
+		Com_Printf( "%4i %10u %10.3f %8.0f %3i%%\n", sorted[i].trap, sorted[i].prof.calls,
+			sorted[i].prof.nsec / 1000000.0, (double)sorted[i].prof.nsec / sorted[i].prof.calls,
+			total > 0 ? (int)( 100.0 * sorted[i].prof.nsec / total ) : 0 );
+	}
+	Com_Printf( "     %10u %10.3f total\n", calls, total / 1000000.0 );
+
+	Z_Free( sorted );
+
+	VM_StopSyscallProfile( vm );
+}
+
+
+/*
+==============
+VM_InstructionToFunc
+==============
+*/
+static int VM_InstructionToFunc( const vm_t *vm, int32_t pc ) {
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = vm->numFuncs - 1;
+	while ( lo < hi ) {
+		mid = ( lo + hi + 1 ) / 2;
+		if ( vm->funcStart[ mid ] <= pc )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+
+/*
+==============
+VM_StackWalk
+
+Collects functions of the stack that made current system call,
+returns number of frames
+==============
+*/
+static int VM_StackWalk( const vm_t *vm, int32_t *frames ) {
+	int32_t	walk[ MAX_PROFILED_DEPTH ];
+	int32_t	stack, pc;
+	int		depth, func, i;
+
+	// frame of the calling function, see system call stack layout at VM_Call
+	stack = vm->programStack + 8;
+
+	for ( depth = 0; depth < MAX_PROFILED_DEPTH; depth++ ) {
+		if ( stack < vm->stackBottom || stack > (int32_t)vm->dataMask - 3 ) {
+			break;
+		}
+		// call site, or -1 at vmMain entry
+		pc = *(int32_t *)( vm->dataBase + stack );
+		if ( (unsigned)pc >= (unsigned)vm->instructionCount ) {
+			break;
+		}
+		func = VM_InstructionToFunc( vm, pc );
+		walk[ depth ] = func;
+		stack += vm->funcFrame[ func ];
+	}
+
+	for ( i = 0; i < depth; i++ ) {
+		frames[ i ] = walk[ depth - 1 - i ];
+	}
+
+	return depth;
+}
+
+
+/*
+==============
+VM_StackSample
+==============
+*/
+static void VM_StackSample( stackProfile_t *prof, const int32_t *frames, int depth, int trap, int64_t nsec ) {
+	stackSample_t *s;
+	uint32_t hash;
+	int i, n;
+
+	hash = trap * 31 + depth;
+	for ( i = 0; i < depth; i++ ) {
+		hash = hash * 31 + frames[ i ];
+	}
+
+	i = hash & ( MAX_PROFILED_STACKS - 1 );
+	for ( n = 0; n < MAX_PROFILED_STACKS; n++, i = ( i + 1 ) & ( MAX_PROFILED_STACKS - 1 ) ) {
+		s = &prof->stacks[ i ];
+		if ( !s->samples ) {
+			// keep the table sparse
+			if ( prof->numStacks >= MAX_PROFILED_STACKS * 3 / 4 ) {
+				prof->dropped++;
+				return;
+			}
+			memcpy( s->frames, frames, depth * sizeof( frames[0] ) );
+			s->depth = depth;
+			s->trap = trap;
+			s->hash = hash;
+			prof->numStacks++;
+			break;
+		}
+		if ( s->hash == hash && s->trap == trap && s->depth == depth && !memcmp( s->frames, frames, depth * sizeof( frames[0] ) ) ) {
+			break;
+		}
+	}
+
+	s->samples++;
+	s->nsec += nsec;
+}
+
+
+static int64_t VM_StackProfileCall( vm_t *vm ) {
+	vm->stackProfile->last = Sys_Nanoseconds();
+	return vm->stackProfile->last;
+}
+
+
+/*
+==============
+VM_StackProfileReturn
+
+Charges qvm code executed after last system call to vmMain
+==============
+*/
+static void VM_StackProfileReturn( vm_t *vm, int64_t start ) {
+	stackProfile_t *prof = vm->stackProfile;
+	const int32_t root = 0;
+	int64_t now;
+
+	now = Sys_Nanoseconds();
+
+	if ( start ) {
+		VM_StackSample( prof, &root, vm->numFuncs ? 1 : 0, QVM_SAMPLE, now - prof->last );
+		prof->nested += now - start;
+	}
+
+	prof->last = now;
+}
+
+
+/*
+==============
+VM_StopStackProfile
+
+Compiled code keeps saving call sites until the vm is reloaded
+==============
+*/
+static void VM_StopStackProfile( vm_t *vm ) {
+	if ( !vm->stackProfile ) {
+		return;
+	}
+
+	Z_Free( vm->stackProfile );
+	vm->stackProfile = NULL;
+
+	VM_UnhookSyscalls( vm );
+}
+
+
+static const char *VM_FuncName( const vm_t *vm, int func ) {
+	if ( vm->funcNames[ func ] ) {
+		return vm->funcNames[ func ];
+	}
+	return va( "func_%i", vm->funcStart[ func ] );
+}
+
+
+static const char *VM_TrapName( vm_t *vm, int trap ) {
+	const vmSymbol_t *sym;
+
+	// traps are listed with negative values in map files
+	for ( sym = vm->symbols; sym && sym->symValue < 0; sym = sym->next ) {
+		if ( sym->symValue == -1 - trap ) {
+			return sym->symName;
+		}
+	}
+
+	return va( "trap_%i", trap );
+}
+
+
+/*
+==============
+VM_StackProfile
+
+Starts profiling on first call, writes folded stacks and stops on second
+==============
+*/
+static void VM_StackProfile( vm_t *vm, const char *filename ) {
+	const stackSample_t *s;
+	fileHandle_t	f;
+	int64_t			total;
+	int				i, n, value;
+
+	if ( vm->callLevel ) {
+		Com_Printf( "%s is running.\n", vm->name );
+		return;
+	}
+
+	if ( !vm->stackProfile ) {
+		if ( vm->dllHandle ) {
+			Com_Printf( "Native modules don't have qvm stack frames, nothing to profile.\n" );
+			return;
+		}
+		if ( !vm->numFuncs ) {
+			Com_Printf( "%s has no functions to profile.\n", vm->name );
+			return;
+		}
+		if ( !vm->funcNames ) {
+			vm->funcNames = Z_Malloc( vm->numFuncs * sizeof( vm->funcNames[0] ) );
+			for ( i = 0; vm->symbols && i < vm->numFuncs; i++ ) {
+				// symbol values were converted from instructions if code offsets were known on load
+				value = vm->instructionPointers ? vm->instructionPointers[ vm->funcStart[i] ] : vm->funcStart[i];
+				vm->funcNames[i] = VM_ValueToFunctionSymbol( vm, value )->symName;
+			}
+		}
+#ifndef NO_VM_COMPILED
+		if ( vm->compiled && !vm->callSites ) {
+			vmHeader_t *header = VM_ReadQVM( vm );
+			if ( !header ) {
+				Com_Printf( S_COLOR_YELLOW "%s: couldn't reload bytecode for recompilation\n", vm->name );
+				return;
+			}
+			vm->callSites = qtrue;
+			if ( !VM_Recompile( vm, header ) ) {
+				vm->callSites = qfalse;
+				FS_FreeFile( header );
+				return;
+			}
+			FS_FreeFile( header );
+		}
+#endif
+		vm->stackProfile = Z_Malloc( sizeof( *vm->stackProfile ) );
+		VM_HookSyscalls( vm );
+		Com_Printf( "Profiling %s call stacks, run the command again to write results.\n", vm->name );
+		return;
+	}
+
+	f = FS_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write %s.\n", filename );
+		VM_StopStackProfile( vm );
+		return;
+	}
+
+	total = 0;
+	for ( i = 0; i < MAX_PROFILED_STACKS; i++ ) {
+		s = &vm->stackProfile->stacks[ i ];
+		if ( !s->samples ) {
+			continue;
+		}
+		// flamegraph.pl and compatible tools read "frame;frame;frame value" lines
+		for ( n = 0; n < s->depth; n++ ) {
+			FS_Printf( f, n ? ";%s" : "%s", VM_FuncName( vm, s->frames[ n ] ) );
+		}
+		if ( s->trap != QVM_SAMPLE ) {
+			FS_Printf( f, s->depth ? ";%s" : "%s", VM_TrapName( vm, s->trap ) );
+		} else if ( !s->depth ) {
+			FS_Printf( f, "%s", vm->name );
+		}
+		FS_Printf( f, " %lli\n", (long long)( s->nsec / 1000 ) );
+		total += s->nsec;
+	}
+
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i stacks, %.3f msec to %s", vm->stackProfile->numStacks, total / 1000000.0, filename );
+	if ( vm->stackProfile->dropped ) {
+		Com_Printf( ", %u samples dropped", vm->stackProfile->dropped );
+	}
+	Com_Printf( "\n" );
+
+	VM_StopStackProfile( vm );
+}
+
+
 /*
 ==============
 VM_VmProfile_f
@@ -2048,7 +3135,7 @@ static void VM_VmProfile_f( void ) {
 	double		total;
 
 	if ( Cmd_Argc() < 2 ) {
-		Com_Printf( "usage: %s <game|cgame|ui>\n", Cmd_Argv( 0 ) );
+		Com_Printf( "usage: %s <game|cgame|ui> [syscalls|stacks [file]]\n", Cmd_Argv( 0 ) );
 		return;
 	}
 
@@ -2057,10 +3144,30 @@ static void VM_VmProfile_f( void ) {
 		return;
 	}
 
+	if ( Cmd_Argc() > 2 && !Q_stricmp( Cmd_Argv( 2 ), "syscalls" ) ) {
+		VM_SyscallProfile( vm );
+		return;
+	}
+
+	if ( Cmd_Argc() > 2 && !Q_stricmp( Cmd_Argv( 2 ), "stacks" ) ) {
+		VM_StackProfile( vm, Cmd_Argc() > 3 ? Cmd_Argv( 3 ) : va( "%s.folded", vm->name ) );
+		return;
+	}
+
 	if ( !vm->numSymbols ) {
 		return;
 	}
 
+	// compiled code is not sampled, report entry counts when they are collected
+	if ( vm->funcCalls ) {
+		for ( sym = vm->symbols; sym; sym = sym->next ) {
+			sym->profileCount = 0;
+		}
+		for ( i = 0; i < vm->numFuncs; i++ ) {
+			VM_ValueToFunctionSymbol( vm, vm->funcStart[i] )->profileCount += vm->funcCalls[i];
+		}
+	}
+
 	sorted = Z_Malloc( vm->numSymbols * sizeof( *sorted ) );
 	sorted[0] = vm->symbols;
 	total = sorted[0]->profileCount;
@@ -2087,6 +3194,364 @@ static void VM_VmProfile_f( void ) {
 }
 
 
+/*
+==============================================================
+
+QVM microbenchmark
+
+Generated bytecode that mixes integer, bit test, float, memory and call
+operations in a loop, so interpreter and compiler output of any architecture
+can be timed against each other without a mod installed
+
+==============================================================
+*/
+
+#define BENCH_BSS_SIZE		2048
+#define BENCH_DATA			1024	// int array[256] in bss
+
+typedef struct {
+	byte	*code;		// NULL on first pass
+	int		length;
+	int		count;
+} benchAsm_t;
+
+typedef enum {
+	BL_FUNC,
+	BL_BODY,
+	BL_SKIP,
+	BL_COND,
+	BL_COUNT
+} benchLabel_t;
+
+static void VM_BenchOp( benchAsm_t *a, opcode_t op, int32_t value ) {
+	if ( a->code ) {
+		a->code[ a->length ] = op;
+		if ( ops[ op ].size == 4 ) {
+			a->code[ a->length + 1 ] = value & 255;
+			a->code[ a->length + 2 ] = ( value >> 8 ) & 255;
+			a->code[ a->length + 3 ] = ( value >> 16 ) & 255;
+			a->code[ a->length + 4 ] = ( value >> 24 ) & 255;
+		} else if ( ops[ op ].size == 1 ) {
+			a->code[ a->length + 1 ] = value & 255;
+		}
+	}
+	a->length += 1 + ops[ op ].size;
+	a->count++;
+}
+
+
+static void VM_BenchLoadLocal( benchAsm_t *a, int ofs ) {
+	VM_BenchOp( a, OP_LOCAL, ofs );
+	VM_BenchOp( a, OP_LOAD4, 0 );
+}
+
+
+/*
+=================
+VM_BenchProgram
+
+int vmMain( int command, int count ) {
+	int i, sum, tmp;
+	float f;
+
+	for ( sum = 0, f = 0, i = 0; i < count; i++ ) {
+		sum += i * 3 ^ ( i >> 2 );
+		if ( i & 4 )
+			sum -= 1;
+		f = f * 0.5f + i;
+		array[ i & 255 ] += i;
+		tmp = func( i );
+		sum += tmp;
+	}
+	return sum + (int)f;
+}
+
+int func( int x ) {
+	return ( x & 1023 ) * ( x & 1023 ) % 7 + x / 3;
+}
+=================
+*/
+static void VM_BenchProgram( benchAsm_t *a, int *label ) {
+	const int frame = 32;
+	floatint_t half;
+
+	half.f = 0.5f;
+
+	// vmMain, locals: i at 16, sum at 20, f at 24, tmp at 28
+	VM_BenchOp( a, OP_ENTER, frame );
+	VM_BenchOp( a, OP_LOCAL, 20 ); VM_BenchOp( a, OP_CONST, 0 ); VM_BenchOp( a, OP_STORE4, 0 );
+	VM_BenchOp( a, OP_LOCAL, 24 ); VM_BenchOp( a, OP_CONST, 0 ); VM_BenchOp( a, OP_STORE4, 0 );
+	VM_BenchOp( a, OP_LOCAL, 16 ); VM_BenchOp( a, OP_CONST, 0 ); VM_BenchOp( a, OP_STORE4, 0 );
+	VM_BenchOp( a, OP_CONST, label[ BL_COND ] ); VM_BenchOp( a, OP_JUMP, 0 );
+
+	label[ BL_BODY ] = a->count;
+	VM_BenchOp( a, OP_LOCAL, 20 );
+	VM_BenchLoadLocal( a, 20 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 3 ); VM_BenchOp( a, OP_MULI, 0 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 2 ); VM_BenchOp( a, OP_RSHI, 0 );
+	VM_BenchOp( a, OP_BXOR, 0 ); VM_BenchOp( a, OP_ADD, 0 ); VM_BenchOp( a, OP_STORE4, 0 );
+
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 4 ); VM_BenchOp( a, OP_BAND, 0 );
+	VM_BenchOp( a, OP_CONST, 0 ); VM_BenchOp( a, OP_EQ, label[ BL_SKIP ] );
+	VM_BenchOp( a, OP_LOCAL, 20 );
+	VM_BenchLoadLocal( a, 20 ); VM_BenchOp( a, OP_CONST, 1 ); VM_BenchOp( a, OP_SUB, 0 );
+	VM_BenchOp( a, OP_STORE4, 0 );
+
+	label[ BL_SKIP ] = a->count;
+	VM_BenchOp( a, OP_LOCAL, 24 );
+	VM_BenchLoadLocal( a, 24 ); VM_BenchOp( a, OP_CONST, half.i ); VM_BenchOp( a, OP_MULF, 0 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CVIF, 0 ); VM_BenchOp( a, OP_ADDF, 0 );
+	VM_BenchOp( a, OP_STORE4, 0 );
+
+	VM_BenchOp( a, OP_CONST, BENCH_DATA );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 255 ); VM_BenchOp( a, OP_BAND, 0 );
+	VM_BenchOp( a, OP_CONST, 2 ); VM_BenchOp( a, OP_LSH, 0 ); VM_BenchOp( a, OP_ADD, 0 );
+	VM_BenchOp( a, OP_CONST, BENCH_DATA );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 255 ); VM_BenchOp( a, OP_BAND, 0 );
+	VM_BenchOp( a, OP_CONST, 2 ); VM_BenchOp( a, OP_LSH, 0 ); VM_BenchOp( a, OP_ADD, 0 );
+	VM_BenchOp( a, OP_LOAD4, 0 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_ADD, 0 ); VM_BenchOp( a, OP_STORE4, 0 );
+
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_ARG, 8 );
+	VM_BenchOp( a, OP_LOCAL, 28 ); VM_BenchOp( a, OP_CONST, label[ BL_FUNC ] ); VM_BenchOp( a, OP_CALL, 0 );
+	VM_BenchOp( a, OP_STORE4, 0 );
+	VM_BenchOp( a, OP_LOCAL, 20 );
+	VM_BenchLoadLocal( a, 20 ); VM_BenchLoadLocal( a, 28 ); VM_BenchOp( a, OP_ADD, 0 );
+	VM_BenchOp( a, OP_STORE4, 0 );
+
+	VM_BenchOp( a, OP_LOCAL, 16 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 1 ); VM_BenchOp( a, OP_ADD, 0 );
+	VM_BenchOp( a, OP_STORE4, 0 );
+
+	label[ BL_COND ] = a->count;
+	VM_BenchLoadLocal( a, 16 ); VM_BenchLoadLocal( a, frame + 12 );
+	VM_BenchOp( a, OP_LTI, label[ BL_BODY ] );
+
+	VM_BenchLoadLocal( a, 20 ); VM_BenchLoadLocal( a, 24 ); VM_BenchOp( a, OP_CVFI, 0 );
+	VM_BenchOp( a, OP_ADD, 0 );
+	VM_BenchOp( a, OP_LEAVE, frame );
+	VM_BenchOp( a, OP_PUSH, 0 );
+	VM_BenchOp( a, OP_LEAVE, frame );
+
+	// func, argument at 16
+	label[ BL_FUNC ] = a->count;
+	VM_BenchOp( a, OP_ENTER, 8 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 1023 ); VM_BenchOp( a, OP_BAND, 0 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 1023 ); VM_BenchOp( a, OP_BAND, 0 );
+	VM_BenchOp( a, OP_MULI, 0 ); VM_BenchOp( a, OP_CONST, 7 ); VM_BenchOp( a, OP_MODI, 0 );
+	VM_BenchLoadLocal( a, 16 ); VM_BenchOp( a, OP_CONST, 3 ); VM_BenchOp( a, OP_DIVI, 0 );
+	VM_BenchOp( a, OP_ADD, 0 );
+	VM_BenchOp( a, OP_LEAVE, 8 );
+	VM_BenchOp( a, OP_PUSH, 0 );
+	VM_BenchOp( a, OP_LEAVE, 8 );
+}
+
+
+static intptr_t VM_BenchSystemCalls( intptr_t *args ) {
+	Com_Error( ERR_DROP, "vmbench: unexpected system call %i", (int)args[0] );
+	return 0;
+}
+
+
+/*
+=================
+VM_BenchCreate
+
+Builds benchmark image into a detached instance, see VM_DETACHED.
+Interpreter tables are allocated on the hunk so few kilobytes
+stay there until next hunk clear
+=================
+*/
+static vm_t *VM_BenchCreate( qboolean compile ) {
+	int			label[ BL_COUNT ];
+	benchAsm_t	a;
+	vmHeader_t	*header;
+	vm_t		*vm;
+	int			i;
+
+	Com_Memset( label, 0, sizeof( label ) );
+	Com_Memset( &a, 0, sizeof( a ) );
+	VM_BenchProgram( &a, label ); // resolve labels
+
+	header = Z_Malloc( sizeof( *header ) + a.length );
+	header->vmMagic = VM_MAGIC;
+	header->instructionCount = a.count;
+	header->codeOffset = sizeof( *header );
+	header->codeLength = a.length;
+	header->dataOffset = header->codeOffset + header->codeLength;
+	header->bssLength = BENCH_BSS_SIZE;
+
+	a.code = (byte*)header + header->codeOffset;
+	a.length = a.count = 0;
+	VM_BenchProgram( &a, label );
+
+	vm = Z_Malloc( sizeof( *vm ) );
+	vm->name = "vmbench";
+	vm->index = VM_BAD;
+	vm->systemCall = VM_BenchSystemCalls;
+	vm->instructionCount = header->instructionCount;
+	vm->codeLength = header->codeLength;
+	vm->exactDataLength = header->bssLength;
+
+	vm->dataLength = PROGRAM_STACK_SIZE + PROGRAM_STACK_EXTRA + vm->exactDataLength;
+	for ( i = 0 ; vm->dataLength > ( 1 << i ) ; i++ )
+		;
+	vm->dataMask = ( 1 << i ) - 1;
+	vm->dataAlloc = ( 1 << i ) + VM_DATA_GUARD_SIZE;
+	vm->dataBase = Z_Malloc( vm->dataAlloc );
+
+	vm->programStack = vm->dataMask + 1;
+	vm->stackBottom = vm->programStack - PROGRAM_STACK_SIZE - PROGRAM_STACK_EXTRA;
+
+#ifndef NO_VM_COMPILED
+	if ( compile && VM_Compile( vm, header ) ) {
+		vm->compiled = qtrue;
+	}
+#endif
+	if ( !vm->compiled && ( compile || !VM_PrepareInterpreter2( vm, header ) ) ) {
+		Z_Free( vm->dataBase );
+		Z_Free( vm );
+		vm = NULL;
+	}
+
+	Z_Free( header );
+
+	return vm;
+}
+
+
+static void VM_BenchFree( vm_t *vm ) {
+	if ( vm->destroy )
+		vm->destroy( vm );
+	if ( vm->funcStart )
+		Z_Free( vm->funcStart );
+	if ( vm->funcFrame )
+		Z_Free( vm->funcFrame );
+	Z_Free( vm->dataBase );
+	Z_Free( vm );
+}
+
+
+/*
+==============
+VM_VmBench_f
+==============
+*/
+static void VM_VmBench_f( void ) {
+	static const char *modes[] = { "interpreted", "compiled" };
+	vm_t	*vm;
+	int		count, runs, i, n;
+	int64_t	start, best;
+	int		result[2];
+
+	count = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 1000000;
+	runs = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 5;
+	if ( count <= 0 || runs <= 0 ) {
+		Com_Printf( "usage: %s [iterations] [runs]\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	for ( n = 0; n < 2; n++ ) {
+		vm = VM_BenchCreate( n ? qtrue : qfalse );
+		if ( !vm ) {
+			Com_Printf( "%s: %s code is not available\n", Cmd_Argv( 0 ), modes[n] );
+			return;
+		}
+		best = 0;
+		for ( i = 0; i < runs; i++ ) {
+			Com_Memset( vm->dataBase, 0, vm->dataAlloc );
+			start = Sys_Microseconds();
+			result[n] = VM_Call( vm, 1, 0, count );
+			start = Sys_Microseconds() - start;
+			if ( i == 0 || start < best )
+				best = start;
+		}
+		Com_Printf( "%-12s %8i usec, %.2f ns per iteration\n", modes[n], (int)best, best * 1000.0 / count );
+		VM_BenchFree( vm );
+	}
+
+	if ( result[0] != result[1] ) {
+		Com_Printf( S_COLOR_YELLOW "%s: result mismatch %i vs %i\n", Cmd_Argv( 0 ), result[0], result[1] );
+	}
+}
+
+
+/*
+==============
+VM_VmCompile_f
+
+Compiles a qvm into vm_codeCache without running it, so servers can be
+deployed with code generated ahead of time by the same binary, e.g.
+	q3ded +set vm_codeKey <secret> +vmcompile game +quit
+Data segment of the image stays on the hunk until next hunk clear
+==============
+*/
+static void VM_VmCompile_f( void ) {
+	static const char *names[] = { "game", "cgame", "ui" };
+	vmHeader_t	*header;
+	vm_t		*vm;
+	int			index;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: %s <game|cgame|ui>\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	for ( index = 0; index < VM_COUNT; index++ ) {
+		if ( !Q_stricmp( Cmd_Argv( 1 ), names[ index ] ) ) {
+			break;
+		}
+	}
+	if ( index == VM_COUNT ) {
+		Com_Printf( " unknown VM name '%s'\n", Cmd_Argv( 1 ) );
+		return;
+	}
+
+#ifdef NO_VM_COMPILED
+	Com_Printf( "Architecture doesn't have a bytecode compiler\n" );
+#else
+	if ( !vm_codeCache->integer ) {
+		Com_Printf( "Code cache is disabled, see vm_codeCache\n" );
+		return;
+	}
+
+	if ( vm_tierUp->integer ) {
+		Com_Printf( S_COLOR_YELLOW "Warning: instrumented code is never cached, see vm_tierUp\n" );
+	}
+
+	if ( vmTable[ index ].name ) {
+		Com_Printf( "%s is already loaded: %s\n", names[ index ],
+			vmTable[ index ].codeCached ? "code is cached" : "code is not cached" );
+		return;
+	}
+
+	vm = Z_Malloc( sizeof( *vm ) );
+	vm->name = vmName[ index ];
+	vm->index = index;
+
+	// same layout as VM_Create() so cached data mask matches
+	header = VM_LoadQVM( vm, qtrue );
+	if ( header ) {
+		vm->instructionCount = header->instructionCount;
+		vm->codeLength = header->codeLength;
+		vm->programStack = vm->dataMask + 1;
+		vm->stackBottom = vm->programStack - PROGRAM_STACK_SIZE - PROGRAM_STACK_EXTRA;
+
+		if ( VM_Compile( vm, header ) && vm->codeCached ) {
+			Com_Printf( "%s code is cached%s\n", vm->name, vm_codeKey->string[0] ? " and signed" : "" );
+		} else {
+			Com_Printf( S_COLOR_YELLOW "%s code is not cached\n", vm->name );
+		}
+
+		FS_FreeFile( header );
+		VM_Free( vm );
+	}
+
+	Z_Free( vm );
+#endif
+}
+
+
 /*
 ==============
 VM_VmInfo_f
@@ -2108,7 +3573,7 @@ static void VM_VmInfo_f( void ) {
 			continue;
 		}
 		if ( vm->compiled ) {
-			Com_Printf( "compiled on load\n" );
+			Com_Printf( vm->codeCached ? "compiled on load, cached\n" : "compiled on load\n" );
 		} else {
 			Com_Printf( "interpreted\n" );
 		}
@@ -364,6 +364,8 @@ static void emit( uint32_t isn )
 
 #define MOV32i(Rd, immrs)       ORR32i(Rd, WZR, immrs)
 
+#define TST32i(Rn, immrs)       ( (0<<31) /*sf*/ | (0b11<<29) | (0b100100 << 23) | ((immrs) << 10) | ((Rn)<<5) | WZR )
+
 // MUL, alias for MADD
 #define MUL32(Rd, Rn, Rm)       ( (0<<31) | (0b00<<29) | (0b11011<<24) | (0b000<<21) | (Rm<<16) | (0<<15) | (WZR<<10) /*Ra*/ | (Rn<<5) | Rd )
 
@@ -511,6 +513,10 @@ static void emit( uint32_t isn )
 // CBNZ - Compare and Branch on Nonzero
 #define CBNZ32(Rt, simm19)         ( (0<<31) | (0b011010<<25) | (1<<24) /*op*/ | (encode_offset19(simm19)<<5) | Rt )
 
+// TBZ/TBNZ - Test bit and Branch if Zero/Nonzero within +/-32K
+#define TBZ(Rt, bit, simm14)       ( (((bit)>>5)<<31) | (0b011011<<25) | (0<<24) /*op*/ | (((bit)&31)<<19) | (encode_offset14(simm14)<<5) | Rt )
+#define TBNZ(Rt, bit, simm14)      ( (((bit)>>5)<<31) | (0b011011<<25) | (1<<24) /*op*/ | (((bit)&31)<<19) | (encode_offset14(simm14)<<5) | Rt )
+
 // conditional branch within +/-1M
 #define Bcond(cond, simm19)        ( (0b0101010<<25) | (0<<24) | (encode_offset19(simm19)<<5) | (0<<4) | cond )
 
@@ -2241,6 +2247,24 @@ static uint32_t encode_offset19( uint32_t ofs )
 }
 
 
+static uint32_t encode_offset14( uint32_t ofs )
+{
+	const uint32_t x = ofs >> 2;
+	const uint32_t t = x >> 14;
+
+	if ( ( ( t != 0x3FFFF && t != 0x00 ) || ( ofs & 3 ) ) && pass != 0 )
+		DROP( "can't encode %i", ofs );
+
+	return x & 0x3FFF;
+}
+
+
+static qboolean can_encode_offset14( int32_t ofs )
+{
+	return ( ofs >= -0x8000 && ofs < 0x8000 ) ? qtrue : qfalse;
+}
+
+
 static void emitAlign( const uint32_t align )
 {
 	while ( compiledOfs & (align-1) )
@@ -2504,6 +2528,82 @@ static void emitBlockCopy( vm_t *vm, const uint32_t count )
 
 
 #ifdef CONST_OPTIMIZE
+static qboolean IsBlockTrap( const int trap )
+{
+	return ( trap == ~TRAP_MEMSET || trap == ~TRAP_MEMCPY || trap == ~TRAP_STRNCPY );
+}
+
+
+/*
+=================
+emitBlockTrap
+
+Calls memset/memcpy/Q_strncpy directly with translated addresses instead of
+leaving the VM through the system call handler. memcpy reports out-of-range
+errors as VM_CheckBounds2() does, memset and strncpy mask the address as
+VM_ArgPtr() does and also clamp the length to the end of the data segment.
+Returns args[1] in R0, the same as the trap handlers do.
+=================
+*/
+static void emitBlockTrap( vm_t *vm, const int trap )
+{
+	intptr_t func;
+	uint32_t rx;
+
+	alloc_rx( R0 | FORCED ); // dst
+	alloc_rx( R1 | FORCED ); // src or value
+	alloc_rx( R2 | FORCED ); // count
+	alloc_rx( R3 | FORCED ); // scratch
+	rx = alloc_rx( R16 );
+
+	emit(LDR32i(R0, rPROCBASE, 8));  // r0 = [procBase + 8]
+	emit(LDR32i(R1, rPROCBASE, 12)); // r1 = [procBase + 12]
+	emit(LDR32i(R2, rPROCBASE, 16)); // r2 = [procBase + 16]
+
+	if ( trap == ~TRAP_MEMCPY ) {
+		emit(ORR32(R3, R0, R1));        // r3 = r0 | r1
+		emit(ORR32(R3, R3, R2));        // r3 |= r2
+		emit(CMP32(R3, rDATAMASK));
+		emit(Bcond(LS, +8));
+		emitFuncOffset( vm, FUNC_BADW );
+		emit(ADD32(R3, R0, R2));        // r3 = r0 + r2
+		emit(CMP32(R3, rDATAMASK));
+		emit(Bcond(LS, +8));
+		emitFuncOffset( vm, FUNC_BADW );
+		emit(ADD32(R3, R1, R2));        // r3 = r1 + r2
+		emit(CMP32(R3, rDATAMASK));
+		emit(Bcond(LS, +8));
+		emitFuncOffset( vm, FUNC_BADR );
+		emit(ADD64(R1, R1, rDATABASE)); // r1 += dataBase
+		func = (intptr_t)memcpy;
+	} else {
+		emit(AND32(R0, R0, rDATAMASK)); // r0 &= dataMask
+		emit(ADD32i(R3, rDATAMASK, 1)); // r3 = dataMask + 1
+		emit(SUB32(R3, R3, R0));        // r3 -= r0
+		emit(CMP32(R2, R3));
+		emit(Bcond(LS, +8));
+		emit(MOV32(R2, R3));            // r2 = min( r2, r3 )
+		if ( trap == ~TRAP_STRNCPY ) {
+			emit(AND32(R1, R1, rDATAMASK)); // r1 &= dataMask
+			emit(ADD64(R1, R1, rDATABASE)); // r1 += dataBase
+			func = (intptr_t)Q_strncpy;
+		} else {
+			func = (intptr_t)memset;
+		}
+	}
+
+	emit(ADD64(R0, R0, rDATABASE)); // r0 += dataBase
+	emit_MOVXi(rx, func);
+	emit(BLR(rx));
+	emit(LDR32i(R0, rPROCBASE, 8));  // r0 = args[1]
+
+	unmask_rx( rx );
+	unmask_rx( R3 );
+	unmask_rx( R2 );
+	unmask_rx( R1 );
+}
+
+
 static qboolean ConstOptimize( vm_t *vm, instruction_t *ci, instruction_t *ni )
 {
 	uint32_t immrs;
@@ -2535,6 +2635,30 @@ static qboolean ConstOptimize( vm_t *vm, instruction_t *ci, instruction_t *ni )
 	case OP_BOR:
 	case OP_BXOR:
 		x = ci->value;
+		if ( ni->op == OP_BAND && (ni+1)->op == OP_CONST && (ni+1)->value == 0 && ( (ni+2)->op == OP_EQ || (ni+2)->op == OP_NE ) ) {
+			// fused `if ( var & mask )` test, result of the BAND is not needed
+			if ( !(ni+1)->jused && !(ni+2)->jused && encode_logic_imm( x, 32, &immrs ) ) {
+				const int32_t target = (ni+2)->value;
+				rx[0] = load_rx_opstack( R0 | RCONST ); dec_opstack(); // r0 = *opstack; opstack -= 4
+				// single-bit test can be encoded directly but it have short range
+				// so use it only for backward jumps where final offset is already known
+				if ( ( x & ( x - 1 ) ) == 0 && target < ip && can_encode_offset14( vm->instructionPointers[ target ] - compiledOfs ) ) {
+					uint32_t bit = 0;
+					while ( ( x >> bit ) != 1 )
+						bit++;
+					if ( (ni+2)->op == OP_EQ )
+						emit(TBZ(rx[0], bit, vm->instructionPointers[ target ] - compiledOfs));
+					else
+						emit(TBNZ(rx[0], bit, vm->instructionPointers[ target ] - compiledOfs));
+				} else {
+					emit(TST32i(rx[0], immrs)); // flags = r0 & const
+					emit(Bcond(get_comp((ni+2)->op), vm->instructionPointers[ target ] - compiledOfs));
+				}
+				unmask_rx( rx[0] );
+				ip += 3; // OP_BAND + OP_CONST + OP_EQ | OP_NE
+				return qtrue;
+			}
+		}
 		if ( encode_logic_imm( x, 32, &immrs ) ) {
 			//rx[1] = rx[0] = load_rx_opstack( R0 );	// r1 = r0 = *opstack
 			load_rx_opstack2( &rx[1], R1, &rx[0], R0 ); // r1 = r0 = *opstack
@@ -2604,6 +2728,18 @@ static qboolean ConstOptimize( vm_t *vm, instruction_t *ci, instruction_t *ni )
 			ip += 1; // OP_CALL
 			return qtrue;
 		}
+		if ( vm->callSites ) {
+			rx[0] = alloc_rx( R16 );
+			emit_MOVRi( rx[0], ip );
+			emit(STR32i(rx[0], rPROCBASE, 0)); // [procBase] = ip - for stack walks
+			unmask_rx( rx[0] );
+		}
+		if ( IsBlockTrap( ci->value ) ) {
+			emitBlockTrap( vm, ci->value );
+			ip += 1; // OP_CALL;
+			store_syscall_opstack();
+			return qtrue;
+		}
 		if ( ci->value < 0 ) // syscall
 		{
 			alloc_rx( R0 | FORCED );
@@ -2738,6 +2874,8 @@ qboolean VM_Compile( vm_t *vm, vmHeader_t *header )
 		vm->instructionPointers = Hunk_Alloc( header->instructionCount * sizeof(vm->instructionPointers[0]), h_high );
 	}
 
+	VM_FindFunctions( vm, inst );
+
 	VM_ReplaceInstructions( vm, inst );
 
 	litBase = NULL;
@@ -2911,6 +3049,12 @@ __recompile:
 			case OP_CALL:
 				rx[0] = load_rx_opstack( R0 | FORCED ); // r0 = *opstack
 				flush_volatile();
+				if ( vm->callSites ) {
+					rx[1] = alloc_rx( R16 );
+					emit_MOVRi( rx[1], ip );
+					emit(STR32i(rx[1], rPROCBASE, 0)); // [procBase] = ip - for stack walks
+					unmask_rx( rx[1] );
+				}
 				if ( opstack != 1 ) {
 					emit( ADD64i( rOPSTACK, rOPSTACK, ( opstack - 1 ) * sizeof( int32_t ) ) );
 					emitFuncOffset( vm, FUNC_CALL );
@@ -3512,9 +3656,8 @@ int32_t VM_CallCompiled( vm_t *vm, int nargs, int32_t *args )
 		image[i + 2] = args[i];
 	}
 
-	// these only needed for interpreter:
-	// image[1] =  0; // return stack
-	// image[0] = -1; // will terminate loop on return
+	// terminates stack walks, see vmprofile stacks
+	image[0] = -1;
 
 #ifdef DEBUG_VM
 	opStack[0] = 0xDEADC0DE;
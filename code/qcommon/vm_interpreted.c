@@ -22,6 +22,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "vm_local.h"
 
+// direct threaded dispatch through a label table where the compiler
+// supports computed goto, portable switch dispatch otherwise
+#if defined( __GNUC__ ) && !defined( VM_SWITCH_DISPATCH )
+#define VM_THREADED_DISPATCH
+#endif
+
 
 char *VM_Indent( vm_t *vm ) {
 	static char	*string = "                                        ";
@@ -50,9 +56,41 @@ typedef enum {
 	MOP_LOCAL_LOAD4_CONST,
 	MOP_LOCAL_LOCAL,
 	MOP_LOCAL_LOCAL_LOAD4,
+	MOP_CONST_ADD,
+	MOP_CONST_SUB,
+	MOP_CONST_EQ,
+	MOP_CONST_NE,
+	MOP_CONST_LTI,
+	MOP_CONST_LEI,
+	MOP_CONST_GTI,
+	MOP_CONST_GEI,
+	MOP_MAX
 } macro_op_t;
 
 
+/*
+=================
+VM_ConstMOp
+
+Macro-op for CONST followed by op, 0 if there is none
+=================
+*/
+static int VM_ConstMOp( int op )
+{
+	switch ( op ) {
+		case OP_ADD: return MOP_CONST_ADD;
+		case OP_SUB: return MOP_CONST_SUB;
+		case OP_EQ:  return MOP_CONST_EQ;
+		case OP_NE:  return MOP_CONST_NE;
+		case OP_LTI: return MOP_CONST_LTI;
+		case OP_LEI: return MOP_CONST_LEI;
+		case OP_GTI: return MOP_CONST_GTI;
+		case OP_GEI: return MOP_CONST_GEI;
+		default:     return 0;
+	}
+}
+
+
 /*
 =================
 VM_FindMOps
@@ -73,7 +111,8 @@ static void VM_FindMOps( instruction_t *buf, int instructionCount )
 		op0 = ci->op;
 
 		if ( op0 == OP_LOCAL ) {
-			if ( (ci+1)->op == OP_LOAD4 && (ci+2)->op == OP_CONST ) {
+			// leave CONST to be fused with the following add or compare
+			if ( (ci+1)->op == OP_LOAD4 && (ci+2)->op == OP_CONST && !VM_ConstMOp( (ci+3)->op ) ) {
 				ci->op = MOP_LOCAL_LOAD4_CONST;
 				ci += 3; i += 3;
 				continue;
@@ -96,6 +135,16 @@ static void VM_FindMOps( instruction_t *buf, int instructionCount )
 			}
 		}
 
+		if ( op0 == OP_CONST ) {
+			// branch target stays in the following instruction
+			op0 = VM_ConstMOp( (ci+1)->op );
+			if ( op0 ) {
+				ci->op = op0;
+				ci += 2; i += 2;
+				continue;
+			}
+		}
+
 		ci++;
 		i++;
 	}
@@ -122,6 +171,8 @@ qboolean VM_PrepareInterpreter2( vm_t *vm, vmHeader_t *header )
 		return qfalse;
 	}
 
+	VM_FindFunctions( vm, buf );
+
 	VM_ReplaceInstructions( vm, buf );
 
 	VM_FindMOps( buf, vm->instructionCount );
@@ -167,6 +218,82 @@ int VM_CallInterpreted2( vm_t *vm, int nargs, int32_t *args ) {
 	int		opcode;
 	int32_t	*img;
 	int		i;
+#ifdef VM_THREADED_DISPATCH
+	static const void *const dispatchTable[ MOP_MAX ] = {
+		[OP_UNDEF] = &&op_OP_UNDEF,
+		[OP_IGNORE] = &&op_OP_IGNORE,
+		[OP_BREAK] = &&op_OP_BREAK,
+		[OP_ENTER] = &&op_OP_ENTER,
+		[OP_LEAVE] = &&op_OP_LEAVE,
+		[OP_CALL] = &&op_OP_CALL,
+		[OP_PUSH] = &&op_OP_PUSH,
+		[OP_POP] = &&op_OP_POP,
+		[OP_CONST] = &&op_OP_CONST,
+		[OP_LOCAL] = &&op_OP_LOCAL,
+		[OP_JUMP] = &&op_OP_JUMP,
+		[OP_EQ] = &&op_OP_EQ,
+		[OP_NE] = &&op_OP_NE,
+		[OP_LTI] = &&op_OP_LTI,
+		[OP_LEI] = &&op_OP_LEI,
+		[OP_GTI] = &&op_OP_GTI,
+		[OP_GEI] = &&op_OP_GEI,
+		[OP_LTU] = &&op_OP_LTU,
+		[OP_LEU] = &&op_OP_LEU,
+		[OP_GTU] = &&op_OP_GTU,
+		[OP_GEU] = &&op_OP_GEU,
+		[OP_EQF] = &&op_OP_EQF,
+		[OP_NEF] = &&op_OP_NEF,
+		[OP_LTF] = &&op_OP_LTF,
+		[OP_LEF] = &&op_OP_LEF,
+		[OP_GTF] = &&op_OP_GTF,
+		[OP_GEF] = &&op_OP_GEF,
+		[OP_LOAD1] = &&op_OP_LOAD1,
+		[OP_LOAD2] = &&op_OP_LOAD2,
+		[OP_LOAD4] = &&op_OP_LOAD4,
+		[OP_STORE1] = &&op_OP_STORE1,
+		[OP_STORE2] = &&op_OP_STORE2,
+		[OP_STORE4] = &&op_OP_STORE4,
+		[OP_ARG] = &&op_OP_ARG,
+		[OP_BLOCK_COPY] = &&op_OP_BLOCK_COPY,
+		[OP_SEX8] = &&op_OP_SEX8,
+		[OP_SEX16] = &&op_OP_SEX16,
+		[OP_NEGI] = &&op_OP_NEGI,
+		[OP_ADD] = &&op_OP_ADD,
+		[OP_SUB] = &&op_OP_SUB,
+		[OP_DIVI] = &&op_OP_DIVI,
+		[OP_DIVU] = &&op_OP_DIVU,
+		[OP_MODI] = &&op_OP_MODI,
+		[OP_MODU] = &&op_OP_MODU,
+		[OP_MULI] = &&op_OP_MULI,
+		[OP_MULU] = &&op_OP_MULU,
+		[OP_BAND] = &&op_OP_BAND,
+		[OP_BOR] = &&op_OP_BOR,
+		[OP_BXOR] = &&op_OP_BXOR,
+		[OP_BCOM] = &&op_OP_BCOM,
+		[OP_LSH] = &&op_OP_LSH,
+		[OP_RSHI] = &&op_OP_RSHI,
+		[OP_RSHU] = &&op_OP_RSHU,
+		[OP_NEGF] = &&op_OP_NEGF,
+		[OP_ADDF] = &&op_OP_ADDF,
+		[OP_SUBF] = &&op_OP_SUBF,
+		[OP_DIVF] = &&op_OP_DIVF,
+		[OP_MULF] = &&op_OP_MULF,
+		[OP_CVIF] = &&op_OP_CVIF,
+		[OP_CVFI] = &&op_OP_CVFI,
+		[MOP_LOCAL_LOAD4] = &&op_MOP_LOCAL_LOAD4,
+		[MOP_LOCAL_LOAD4_CONST] = &&op_MOP_LOCAL_LOAD4_CONST,
+		[MOP_LOCAL_LOCAL] = &&op_MOP_LOCAL_LOCAL,
+		[MOP_LOCAL_LOCAL_LOAD4] = &&op_MOP_LOCAL_LOCAL_LOAD4,
+		[MOP_CONST_ADD] = &&op_MOP_CONST_ADD,
+		[MOP_CONST_SUB] = &&op_MOP_CONST_SUB,
+		[MOP_CONST_EQ] = &&op_MOP_CONST_EQ,
+		[MOP_CONST_NE] = &&op_MOP_CONST_NE,
+		[MOP_CONST_LTI] = &&op_MOP_CONST_LTI,
+		[MOP_CONST_LEI] = &&op_MOP_CONST_LEI,
+		[MOP_CONST_GTI] = &&op_MOP_CONST_GTI,
+		[MOP_CONST_GEI] = &&op_MOP_CONST_GEI,
+	};
+#endif
 
 	// interpret the code
 	//vm->currentlyInterpreting = qtrue;
@@ -183,6 +310,7 @@ int VM_CallInterpreted2( vm_t *vm, int nargs, int32_t *args ) {
 	// that as long as opStack is valid, opStack-1 will
 	// not corrupt anything
 	opStack = &stack[1];
+	opStack[-1] = opStack[0] = 0;
 	opStackTop = stack + ARRAY_LEN( stack ) - 1;
 
 	programStack -= (MAX_VMMAIN_CALL_ARGS + 2) * sizeof( int32_t );
@@ -195,6 +323,19 @@ int VM_CallInterpreted2( vm_t *vm, int nargs, int32_t *args ) {
 
 	ci = inst;
 
+#ifdef VM_THREADED_DISPATCH
+	// every handler jumps straight to the next one, the switch
+	// below only dispatches the first instruction
+#define CASE( x ) case x: op_##x
+#define DISPATCH v0 = ci->value; opcode = ci->op; ci++; goto *dispatchTable[ opcode ]
+#define NEXT { r0.i = opStack[0]; r1.i = opStack[-1]; DISPATCH; }
+#define NEXT_FAST { DISPATCH; }
+#else
+#define CASE( x ) case x
+#define NEXT break
+#define NEXT_FAST goto nextInstruction2
+#endif
+
 	// main interpreter loop, will exit when a LEAVE instruction
 	// grabs the -1 program counter
 
@@ -203,7 +344,9 @@ int VM_CallInterpreted2( vm_t *vm, int nargs, int32_t *args ) {
 		r0.i = opStack[0];
 		r1.i = opStack[-1];
 
+#ifndef VM_THREADED_DISPATCH
 nextInstruction2:
+#endif
 
 		v0 = ci->value;
 		opcode = ci->op;
@@ -211,15 +354,18 @@ nextInstruction2:
 
 		switch ( opcode ) {
 
-		case OP_IGNORE:
+		CASE( OP_UNDEF ):
+			NEXT;
+
+		CASE( OP_IGNORE ):
 			ci += v0;
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_BREAK:
+		CASE( OP_BREAK ):
 			vm->breakCount++;
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_ENTER:
+		CASE( OP_ENTER ):
 			// get size of stack frame
 			programStack -= v0;
 			if ( programStack < vm->stackBottom ) {
@@ -228,9 +374,9 @@ nextInstruction2:
 			if ( opStack + ((ci-1)->opStack/4) >= opStackTop ) {
 				Com_Error( ERR_DROP, "VM opStack overflow" );
 			}
-			break;
+			NEXT;
 
-		case OP_LEAVE:
+		CASE( OP_LEAVE ):
 			// remove our stack frame
 			programStack += v0;
 
@@ -243,9 +389,9 @@ nextInstruction2:
 				Com_Error( ERR_DROP, "VM program counter out of range in OP_LEAVE" );
 			}
 			ci = inst + v1;
-			break;
+			NEXT;
 
-		case OP_CALL:
+		CASE( OP_CALL ):
 			// save current program counter
 			*(int *)&image[ programStack ] = ci - inst;
 
@@ -282,36 +428,36 @@ nextInstruction2:
 			} else {
 				Com_Error( ERR_DROP, "VM program counter out of range in OP_CALL" );
 			}
-			break;
+			NEXT;
 
 		// push and pop are only needed for discarded or bad function return values
-		case OP_PUSH:
+		CASE( OP_PUSH ):
 			opStack++;
-			break;
+			NEXT;
 
-		case OP_POP:
+		CASE( OP_POP ):
 			opStack--;
-			break;
+			NEXT;
 
-		case OP_CONST:
+		CASE( OP_CONST ):
 			opStack++;
 			r1.i = r0.i;
 			r0.i = *opStack = v0;
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_LOCAL:
+		CASE( OP_LOCAL ):
 			opStack++;
 			r1.i = r0.i;
 			r0.i = *opStack = v0 + programStack;
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_JUMP:
+		CASE( OP_JUMP ):
 			if ( r0.u >= vm->instructionCount ) {
 				Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
 			}
 			ci = inst + r0.i;
 			opStack--;
-			break;
+			NEXT;
 
 		/*
 		===================================================================
@@ -319,138 +465,138 @@ nextInstruction2:
 		===================================================================
 		*/
 
-		case OP_EQ:
+		CASE( OP_EQ ):
 			opStack -= 2;
 			if ( r1.i == r0.i )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_NE:
+		CASE( OP_NE ):
 			opStack -= 2;
 			if ( r1.i != r0.i )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_LTI:
+		CASE( OP_LTI ):
 			opStack -= 2;
 			if ( r1.i < r0.i )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_LEI:
+		CASE( OP_LEI ):
 			opStack -= 2;
 			if ( r1.i <= r0.i )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_GTI:
+		CASE( OP_GTI ):
 			opStack -= 2;
 			if ( r1.i > r0.i )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_GEI:
+		CASE( OP_GEI ):
 			opStack -= 2;
 			if ( r1.i >= r0.i )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_LTU:
+		CASE( OP_LTU ):
 			opStack -= 2;
 			if ( r1.u < r0.u )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_LEU:
+		CASE( OP_LEU ):
 			opStack -= 2;
 			if ( r1.u <= r0.u )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_GTU:
+		CASE( OP_GTU ):
 			opStack -= 2;
 			if ( r1.u > r0.u )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_GEU:
+		CASE( OP_GEU ):
 			opStack -= 2;
 			if ( r1.u >= r0.u )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_EQF:
+		CASE( OP_EQF ):
 			opStack -= 2;
 			if ( r1.f == r0.f )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_NEF:
+		CASE( OP_NEF ):
 			opStack -= 2;
 			if ( r1.f != r0.f )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_LTF:
+		CASE( OP_LTF ):
 			opStack -= 2;
 			if ( r1.f < r0.f )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_LEF:
+		CASE( OP_LEF ):
 			opStack -= 2;
 			if ( r1.f <= r0.f )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_GTF:
+		CASE( OP_GTF ):
 			opStack -= 2;
 			if ( r1.f > r0.f )
 				ci = inst + v0;
-			break;
+			NEXT;
 
-		case OP_GEF:
+		CASE( OP_GEF ):
 			opStack -= 2;
 			if ( r1.f >= r0.f )
 				ci = inst + v0;
-			break;
+			NEXT;
 
 		//===================================================================
 
-		case OP_LOAD1:
+		CASE( OP_LOAD1 ):
 			r0.i = *opStack = image[ r0.i & dataMask ];
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_LOAD2:
+		CASE( OP_LOAD2 ):
 			r0.i = *opStack = *(unsigned short *)&image[ r0.i & dataMask ];
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_LOAD4:
+		CASE( OP_LOAD4 ):
 			r0.i = *opStack = *(int32_t *)&image[ r0.i & dataMask ];
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case OP_STORE1:
+		CASE( OP_STORE1 ):
 			image[ r1.i & dataMask ] = r0.i;
 			opStack -= 2;
-			break;
+			NEXT;
 
-		case OP_STORE2:
+		CASE( OP_STORE2 ):
 			*(short *)&image[ r1.i & dataMask ] = r0.i;
 			opStack -= 2;
-			break;
+			NEXT;
 
-		case OP_STORE4:
+		CASE( OP_STORE4 ):
 			*(int *)&image[ r1.i & dataMask ] = r0.i;
 			opStack -= 2;
-			break;
+			NEXT;
 
-		case OP_ARG:
+		CASE( OP_ARG ):
 			// single byte offset from programStack
 			*(int32_t *)&image[ ( v0 + programStack ) /*& ( dataMask & ~3 ) */ ] = r0.i;
 			opStack--;
-			break;
+			NEXT;
 
-		case OP_BLOCK_COPY:
+		CASE( OP_BLOCK_COPY ):
 			{
 				int		*src, *dest;
 				int		count, srci, desti;
@@ -468,139 +614,202 @@ nextInstruction2:
 				memcpy( dest, src, count );
 				opStack -= 2;
 			}
-			break;
+			NEXT;
 
-		case OP_SEX8:
+		CASE( OP_SEX8 ):
 			*opStack = (signed char)*opStack;
-			break;
+			NEXT;
 
-		case OP_SEX16:
+		CASE( OP_SEX16 ):
 			*opStack = (signed short)*opStack;
-			break;
+			NEXT;
 
-		case OP_NEGI:
+		CASE( OP_NEGI ):
 			*opStack = -r0.i;
-			break;
+			NEXT;
 
-		case OP_ADD:
+		CASE( OP_ADD ):
 			*(--opStack) = r1.i + r0.i;
-			break;
+			NEXT;
 
-		case OP_SUB:
+		CASE( OP_SUB ):
 			*(--opStack) = r1.i - r0.i;
-			break;
+			NEXT;
 
-		case OP_DIVI:
+		CASE( OP_DIVI ):
 			*(--opStack) = r1.i / r0.i;
-			break;
+			NEXT;
 
-		case OP_DIVU:
+		CASE( OP_DIVU ):
 			*(--opStack) = r1.u / r0.u;
-			break;
+			NEXT;
 
-		case OP_MODI:
+		CASE( OP_MODI ):
 			*(--opStack) = r1.i % r0.i;
-			break;
+			NEXT;
 
-		case OP_MODU:
+		CASE( OP_MODU ):
 			*(--opStack) = r1.u % r0.u;
-			break;
+			NEXT;
 
-		case OP_MULI:
+		CASE( OP_MULI ):
 			*(--opStack) = r1.i * r0.i;
-			break;
+			NEXT;
 
-		case OP_MULU:
+		CASE( OP_MULU ):
 			*(--opStack) = r1.u * r0.u;
-			break;
+			NEXT;
 
-		case OP_BAND:
+		CASE( OP_BAND ):
 			*(--opStack) = r1.u & r0.u;
-			break;
+			NEXT;
 
-		case OP_BOR:
+		CASE( OP_BOR ):
 			*(--opStack) = r1.u | r0.u;
-			break;
+			NEXT;
 
-		case OP_BXOR:
+		CASE( OP_BXOR ):
 			*(--opStack) = r1.u ^ r0.u;
-			break;
+			NEXT;
 
-		case OP_BCOM:
+		CASE( OP_BCOM ):
 			*opStack = ~ r0.u;
-			break;
+			NEXT;
 
-		case OP_LSH:
+		CASE( OP_LSH ):
 			*(--opStack) = r1.i << r0.i;
-			break;
+			NEXT;
 
-		case OP_RSHI:
+		CASE( OP_RSHI ):
 			*(--opStack) = r1.i >> r0.i;
-			break;
+			NEXT;
 
-		case OP_RSHU:
+		CASE( OP_RSHU ):
 			*(--opStack) = r1.u >> r0.i;
-			break;
+			NEXT;
 
-		case OP_NEGF:
+		CASE( OP_NEGF ):
 			*(float *)opStack =  - r0.f;
-			break;
+			NEXT;
 
-		case OP_ADDF:
+		CASE( OP_ADDF ):
 			*(float *)(--opStack) = r1.f + r0.f;
-			break;
+			NEXT;
 
-		case OP_SUBF:
+		CASE( OP_SUBF ):
 			*(float *)(--opStack) = r1.f - r0.f;
-			break;
+			NEXT;
 
-		case OP_DIVF:
+		CASE( OP_DIVF ):
 			*(float *)(--opStack) = r1.f / r0.f;
-			break;
+			NEXT;
 
-		case OP_MULF:
+		CASE( OP_MULF ):
 			*(float *)(--opStack) = r1.f * r0.f;
-			break;
+			NEXT;
 
-		case OP_CVIF:
+		CASE( OP_CVIF ):
 			*(float *)opStack = (float) r0.i;
-			break;
+			NEXT;
 
-		case OP_CVFI:
+		CASE( OP_CVFI ):
 			*opStack = (int) r0.f;
-			break;
+			NEXT;
 
-		case MOP_LOCAL_LOAD4:
+		CASE( MOP_LOCAL_LOAD4 ):
 			ci++;
 			opStack++;
 			r1.i = r0.i;
 			r0.i = *opStack = *(int32_t *)&image[ v0 + programStack ];
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case MOP_LOCAL_LOAD4_CONST:
+		CASE( MOP_LOCAL_LOAD4_CONST ):
 			r1.i = opStack[1] = *(int32_t *)&image[ v0 + programStack ];
 			r0.i = opStack[2] = (ci+1)->value;
 			opStack += 2;
 			ci += 2;
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case MOP_LOCAL_LOCAL:
+		CASE( MOP_LOCAL_LOCAL ):
 			r1.i = opStack[1] = v0 + programStack;
 			r0.i = opStack[2] = ci->value + programStack;
 			opStack += 2;
 			ci++;
-			goto nextInstruction2;
+			NEXT_FAST;
 
-		case MOP_LOCAL_LOCAL_LOAD4:
+		CASE( MOP_LOCAL_LOCAL_LOAD4 ):
 			r1.i = opStack[1] = v0 + programStack;
 			r0.i /*= opStack[2]*/ = ci->value + programStack;
 			r0.i = opStack[2] = *(int32_t *)&image[ r0.i /*& dataMask*/ ];
 			opStack += 2;
 			ci += 2;
-			goto nextInstruction2;
+			NEXT_FAST;
+
+		CASE( MOP_CONST_ADD ):
+			r0.i = *opStack = r0.i + v0;
+			ci++;
+			NEXT_FAST;
+
+		CASE( MOP_CONST_SUB ):
+			r0.i = *opStack = r0.i - v0;
+			ci++;
+			NEXT_FAST;
+
+		CASE( MOP_CONST_EQ ):
+			opStack--;
+			if ( r0.i == v0 )
+				ci = inst + ci->value;
+			else
+				ci++;
+			NEXT;
+
+		CASE( MOP_CONST_NE ):
+			opStack--;
+			if ( r0.i != v0 )
+				ci = inst + ci->value;
+			else
+				ci++;
+			NEXT;
+
+		CASE( MOP_CONST_LTI ):
+			opStack--;
+			if ( r0.i < v0 )
+				ci = inst + ci->value;
+			else
+				ci++;
+			NEXT;
+
+		CASE( MOP_CONST_LEI ):
+			opStack--;
+			if ( r0.i <= v0 )
+				ci = inst + ci->value;
+			else
+				ci++;
+			NEXT;
+
+		CASE( MOP_CONST_GTI ):
+			opStack--;
+			if ( r0.i > v0 )
+				ci = inst + ci->value;
+			else
+				ci++;
+			NEXT;
+
+		CASE( MOP_CONST_GEI ):
+			opStack--;
+			if ( r0.i >= v0 )
+				ci = inst + ci->value;
+			else
+				ci++;
+			NEXT;
 		}
 	}
 
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef NEXT_FAST
+
 done:
 	//vm->currentlyInterpreting = qfalse;
 
@@ -35,6 +35,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // for some buggy mods
 #define	PROGRAM_STACK_EXTRA	(32*1024)
 
+// stack of each worker instance, placed below the main stack, see VM_CreateWorker
+#define	WORKER_STACK_SIZE	PROGRAM_STACK_SIZE
+
 // reserved space for effective LOCAL+LOAD* checks
 // also to avoid runtime range checks for many small arguments/structs in systemcalls
 #define	VM_DATA_GUARD_SIZE	1024
@@ -166,6 +169,8 @@ typedef union vmFunc_u {
 	void (*func)(void);
 } vmFunc_t;
 
+#define MAX_DLL_RELOADS	32
+
 struct vm_s {
 
 	syscall_t	systemCall;
@@ -219,8 +224,39 @@ struct vm_s {
 	qboolean	forceDataMask;
 
 	int			privateFlag;
+
+	// profile guided recompilation, see vm_tierUp
+	int			numFuncs;
+	int32_t		*funcStart;			// instruction index of each OP_ENTER
+	int32_t		*funcFrame;			// stack frame size of each function
+	uint32_t	*funcCalls;			// entry counters of instrumented code
+	byte		*funcHot;			// functions placed together on recompilation
+	int			tierUpCalls;		// vmMain calls left before recompilation
+
+	// system call profiling, see vmprofile
+	struct syscallProfile_s	*syscallProfile;
+	syscall_t	profiledSystemCall;	// original handler while profiling
+	struct stackProfile_s	*stackProfile;	// see vmprofile stacks
+	const char	**funcNames;		// resolved before any recompilation moves code offsets
+	qboolean	callSites;			// compiled code saves call site in each stack frame
+	qboolean	codeCached;			// compiled code was loaded from or written to vm_codeCache
+
+	// native module reloading, see VM_ReloadDll
+	char		*dllPath;			// library file to reload from
+	void		*retiredDll[ MAX_DLL_RELOADS ];	// replaced images, kept mapped
+	int			numRetiredDll;
+
+	// worker instance, see VM_CreateWorker
+	vm_t		*parent;			// owner of the shared data segment
 };
 
+// instances outside of vmTable: workers and vmbench images, never cached or recompiled
+#define VM_DETACHED( vm ) ( (vm)->parent != NULL || (vm)->index == VM_BAD )
+
+extern cvar_t *vm_codeCache;
+extern cvar_t *vm_codeKey;
+extern cvar_t *vm_tierUp;
+
 qboolean VM_Compile( vm_t *vm, vmHeader_t *header );
 int32_t VM_CallCompiled( vm_t *vm, int nargs, int32_t *args );
 
@@ -239,6 +275,7 @@ const char *VM_CheckInstructions( instruction_t *buf, int instructionCount,
 								 int dataLength );
 
 void VM_ReplaceInstructions( vm_t *vm, instruction_t *buf );
+void VM_FindFunctions( vm_t *vm, const instruction_t *buf );
 
 #define JUMP	(1<<0)
 #define FPU		(1<<1)
@@ -80,6 +80,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //#define RET_OPTIMIZE   // increases code size
 //#define MACRO_OPTIMIZE // slows down a bit?
 
+#if idx64
+#define CODE_CACHE       // store generated code on disk, see vm_codeCache
+#endif
+
 // allow sharing both variables and constants in registers
 #define REG_TYPE_MASK
 // number of variables/memory mappings per register
@@ -98,6 +102,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #endif
 
 #define FUNC_ALIGN		4
+#define HOT_FUNC_ALIGN	16
 
 /*
   -------------
@@ -174,6 +179,9 @@ typedef enum
 	FUNC_CALL,
 	FUNC_SYSC,
 	FUNC_BCPY,
+	FUNC_MSET,
+	FUNC_MCPY,
+	FUNC_SCPY,
 	FUNC_PSOF,
 	FUNC_OSOF,
 	FUNC_BADJ,
@@ -209,7 +217,44 @@ static	int jumpSizeChanged;
 
 static	int	funcOffset[ FUNC_LAST ];
 
+static	int      *funcOrder;	// emission order of functions
+static	qboolean instrument;	// count function calls, see vm_tierUp
+
+// absolute addresses embedded in generated code
+typedef enum {
+	RELOC_VM,		// field of vm_t
+	RELOC_DATA,		// data segment
+	RELOC_CODE,		// generated code
+	RELOC_ERRFUNC,	// pointer to error handler from errFuncTable[]
+	RELOC_COUNTER,	// function call counter, never cached
+	RELOC_COUNT
+} relocType_t;
+
+typedef enum {
+	EF_ERRJUMP,
+	EF_BADJUMP,
+	EF_BADSTACK,
+	EF_BADOPSTACK,
+	EF_BADDATAREAD,
+	EF_BADDATAWRITE,
+	EF_COUNT
+} errFunc_t;
 
+#ifdef CODE_CACHE
+typedef struct {
+	int32_t	offset;		// of 64-bit immediate in code
+	int32_t	type;
+	int32_t	value;
+} reloc_t;
+
+#define MAX_RELOCS 32
+
+static	reloc_t relocs[ MAX_RELOCS ];
+static	int numRelocs;
+#endif
+
+
+static intptr_t VM_RelocTarget( const vm_t *vm, int type, int32_t value );
 static void *VM_Alloc_Compiled( vm_t *vm, int codeLength, int tableLength );
 static void VM_Destroy_Compiled( vm_t *vm );
 static void VM_FreeBuffers( void );
@@ -221,6 +266,7 @@ static void Emit4( int32_t v );
 static void Emit8( int64_t v );
 #endif
 
+// VM_Recompile catches this error and keeps the current code
 #ifdef _MSC_VER
 #define DROP( reason, ... ) \
 	do { \
@@ -730,6 +776,25 @@ static void mov_rx_ptr( uint32_t reg, const void *ptr )
 #endif
 }
 
+// load absolute address that code cache may need to patch
+static void mov_rx_reloc( const vm_t *vm, uint32_t reg, relocType_t type, int32_t value )
+{
+#ifdef CODE_CACHE
+	// always 64-bit immediate so code size doesn't depend on address
+	emit_rex1( reg | R_REX );
+	Emit1( 0xB8 + ( reg & 7 ) );
+	if ( numRelocs < MAX_RELOCS ) {
+		relocs[ numRelocs ].offset = compiledOfs;
+		relocs[ numRelocs ].type = type;
+		relocs[ numRelocs ].value = value;
+	}
+	numRelocs++;
+	Emit8( VM_RelocTarget( vm, type, value ) );
+#else
+	mov_rx_ptr( reg, (const void *) VM_RelocTarget( vm, type, value ) );
+#endif
+}
+
 static void emit_not_rx( uint32_t reg )
 {
 	modrm_t modrm;
@@ -2773,10 +2838,41 @@ static void( *const badOpStackPtr )( void ) = BadOpStack;
 static void( *const badDataReadPtr )( void ) = BadDataRead;
 static void( *const badDataWritePtr )( void ) = BadDataWrite;
 
+static const void *const errFuncTable[ EF_COUNT ] = {
+	&errJumpPtr,
+	&badJumpPtr,
+	&badStackPtr,
+	&badOpStackPtr,
+	&badDataReadPtr,
+	&badDataWritePtr
+};
+
+
+/*
+=================
+VM_RelocTarget
+=================
+*/
+static intptr_t VM_RelocTarget( const vm_t *vm, int type, int32_t value )
+{
+	switch ( type ) {
+		case RELOC_VM: return (intptr_t) vm + value;
+		case RELOC_DATA: return (intptr_t) vm->dataBase + value;
+		case RELOC_CODE: return (intptr_t) vm->codeBase.ptr + value;
+		case RELOC_ERRFUNC: return (intptr_t) errFuncTable[ value ];
+		case RELOC_COUNTER: return (intptr_t) vm->funcCalls + value;
+	}
+	return 0;
+}
+
 
 static void VM_FreeBuffers( void )
 {
 	// should be freed in reversed allocation order
+	if ( funcOrder ) {
+		Z_Free( funcOrder );
+		funcOrder = NULL;
+	}
 	Z_Free( instructionOffsets );
 	Z_Free( inst );
 }
@@ -2891,6 +2987,13 @@ static void EmitAlign( int align )
 }
 
 
+static void EmitAlignHot( void )
+{
+	while ( compiledOfs & ( HOT_FUNC_ALIGN - 1 ) )
+		emit_nop();
+}
+
+
 #if JUMP_OPTIMIZE
 static const char *NearJumpStr( int op )
 {
@@ -3162,6 +3265,9 @@ static void emit_CheckProc( vm_t *vm, instruction_t *ins )
 static void EmitCallFunc( vm_t *vm )
 {
 	static int sysCallOffset = 0;
+#if idx64
+	int n;
+#endif
 
 	init_opstack(); // to avoid any side-effects on emit_CheckJump()
 
@@ -3212,7 +3318,7 @@ static void EmitCallFunc( vm_t *vm )
 	emit_store_rx( R_EAX | R_REX, R_ECX, 0 );	// mov [rcx], rax
 
 	// vm->programStack = programStack - 4; // or 8
-	mov_rx_ptr( R_EDX, &vm->programStack ); // mov rdx, &vm->programStack
+	mov_rx_reloc( vm, R_EDX, RELOC_VM, offsetof( vm_t, programStack ) ); // mov rdx, &vm->programStack
 
 	emit_lea( R_EAX, R_PSTACK, -8 );		// lea eax, [programStack-8]
 	emit_store_rx( R_EAX, R_EDX, 0 );		// mov [rdx], eax
@@ -3224,14 +3330,13 @@ static void EmitCallFunc( vm_t *vm )
 	emit_op_rx_imm32( X_ADD, R_ECX | R_REX, 8 ); // add rcx, 8
 
 	// dest_params[1-15] = params[1-15];
-	emit_xor_rx( R_EDX, R_EDX );			// xor edx, edx
-	// loop
-	EmitString( "48 63 04 96" );			// movsxd rax, dword [rsi+rdx*4]
-	EmitString( "48 89 04 D1" );			// mov qword ptr[rcx+rdx*8], rax
-	EmitString( "83 C2 01" );				// add edx, 1
-	EmitString( "83 FA" );					// cmp edx, 15
-	Emit1( ( PARAM_STACK / 8 ) - 1 );
-	EmitString( "7C F0" );					// jl -16
+	// unrolled, this runs on every system call
+	for ( n = 0; n < ( PARAM_STACK / 8 ) - 1; n++ ) {
+		EmitString( "48 63 46" );			// movsxd rax, dword [rsi+n*4]
+		Emit1( n * 4 );
+		EmitString( "48 89 41" );			// mov qword ptr [rcx+n*8], rax
+		Emit1( n * 8 );
+	}
 
 #ifdef _WIN32
 	// rcx = &int64_params[0]
@@ -3333,6 +3438,260 @@ static void EmitBCPYFunc( vm_t *vm )
 }
 
 
+#if idx64
+/*
+=================
+Block system calls
+
+TRAP_MEMSET, TRAP_MEMCPY and TRAP_STRNCPY are handled by the functions below
+instead of leaving the VM through the system call trampoline. Arguments are
+read from [procBase + 8], [procBase + 12] and [procBase + 16], result is
+returned in eax as args[1], the same as the trap handlers do.
+
+Bounds handling follows VM_CheckBounds() and VM_CheckBounds2(): memcpy
+reports an out-of-range error, memset and strncpy mask the address as
+VM_ArgPtr() does and also clamp the length to the end of the data segment.
+
+scratch: rax, rcx, rdx, r8, r9, r10, xmm0, xmm1
+=================
+*/
+
+// forward short jump, target should be set by SetJumpShort()
+static int EmitJumpShort( int opcode )
+{
+	Emit1( opcode );
+	Emit1( 0 );
+	return compiledOfs;
+}
+
+
+static void SetJumpShort( int ofs )
+{
+	if ( code ) {
+		code[ ofs - 1 ] = compiledOfs - ofs;
+	}
+}
+
+
+static void EmitJumpBack( int opcode, int target )
+{
+	Emit1( opcode );
+	Emit1( target - compiledOfs - 1 );
+}
+
+
+static void EmitJumpFunc( int opcode, func_t func )
+{
+	const int v = funcOffset[ func ] - compiledOfs;
+	Emit1( 0x0F );
+	Emit1( opcode );						// jcc +funcOffset[ func ]
+	Emit4( v - 6 );
+}
+
+
+// eax = eax & dataMask, ecx = min( ecx, dataMask + 1 - eax )
+static void EmitClampBlock( void )
+{
+	emit_and_rx( R_EAX, R_DATAMASK );		// and eax, r11d
+	emit_lea( R_R10, R_DATAMASK, 1 );		// lea r10d, [r11+1]
+	emit_sub_rx( R_R10, R_EAX );			// sub r10d, eax
+	emit_cmp_rx( R_ECX, R_R10 );			// cmp ecx, r10d
+	emit_op_reg( 0x0F, 0x47, R_R10, R_ECX );	// cmova ecx, r10d
+}
+
+
+static void emit_movdqu_load( uint32_t xmmreg, uint32_t base, uint32_t index, int32_t disp )
+{
+	Emit1( 0xF3 );
+	emit_op_reg_base_index( 0x0F, 0x6F, xmmreg, base, index, 1, disp );
+}
+
+
+static void emit_movdqu_store( uint32_t xmmreg, uint32_t base, uint32_t index, int32_t disp )
+{
+	Emit1( 0xF3 );
+	emit_op_reg_base_index( 0x0F, 0x7F, xmmreg, base, index, 1, disp );
+}
+
+
+/*
+=================
+EmitMSETFunc
+
+Returns offset of the fill loop: r9 - destination, dl - value, ecx - count
+=================
+*/
+static int EmitMSETFunc( vm_t *vm )
+{
+	int fill, loop, big, done;
+
+	emit_load4( R_EAX, R_PROCBASE, 8 );		// mov eax, [rbp+8] - dst
+	emit_load4( R_EDX, R_PROCBASE, 12 );	// mov edx, [rbp+12] - value
+	emit_load4( R_ECX, R_PROCBASE, 16 );	// mov ecx, [rbp+16] - count
+	EmitClampBlock();
+	emit_lea_base_index( R_R9 | R_REX, R_DATABASE, R_EAX ); // lea r9, [rbx+rax]
+
+	fill = compiledOfs;
+	emit_zex8( R_EDX, R_EDX );				// movzx edx, dl
+	emit_mul_rx_imm( R_EDX, 0x01010101 );	// imul edx, edx, 0x01010101
+	emit_mov_sx_rx( R_XMM0, R_EDX );		// movd xmm0, edx
+	EmitString( "66 0F 70 C0 00" );			// pshufd xmm0, xmm0, 0
+
+	emit_op_rx_imm32( X_CMP, R_ECX, 16 );	// cmp ecx, 16
+	big = EmitJumpShort( 0x73 );			// jae +big
+	emit_test_rx( R_ECX, R_ECX );			// test ecx, ecx
+	done = EmitJumpShort( 0x74 );			// jz +done
+	loop = compiledOfs;
+	emit_op_reg_base_index( 0, 0x88, R_EDX, R_R9, R_ECX, 1, -1 ); // mov [r9+rcx-1], dl
+	emit_op_rx_imm32( X_SUB, R_ECX, 1 );	// sub ecx, 1
+	EmitJumpBack( 0x75, loop );				// jnz -loop
+	SetJumpShort( done );
+	emit_load4( R_EAX, R_PROCBASE, 8 );		// mov eax, [rbp+8]
+	emit_ret();								// ret
+
+	SetJumpShort( big );
+	emit_op_rx_imm32( X_SUB, R_ECX, 16 );	// sub ecx, 16
+	emit_xor_rx( R_R10, R_R10 );			// xor r10d, r10d
+	loop = compiledOfs;
+	emit_movdqu_store( R_XMM0, R_R9, R_R10, 0 ); // movdqu [r9+r10], xmm0
+	emit_op_rx_imm32( X_ADD, R_R10, 16 );	// add r10d, 16
+	emit_cmp_rx( R_R10, R_ECX );			// cmp r10d, ecx
+	EmitJumpBack( 0x72, loop );				// jb -loop
+	emit_movdqu_store( R_XMM0, R_R9, R_ECX, 0 ); // movdqu [r9+rcx], xmm0 - overlapped tail
+	emit_load4( R_EAX, R_PROCBASE, 8 );		// mov eax, [rbp+8]
+	emit_ret();								// ret
+
+	return fill;
+}
+
+
+static void EmitMCPYFunc( vm_t *vm )
+{
+	int loop, big, done;
+
+	emit_load4( R_EAX, R_PROCBASE, 8 );		// mov eax, [rbp+8] - dst
+	emit_load4( R_EDX, R_PROCBASE, 12 );	// mov edx, [rbp+12] - src
+	emit_load4( R_ECX, R_PROCBASE, 16 );	// mov ecx, [rbp+16] - count
+
+	// same conditions as in VM_CheckBounds2()
+	emit_mov_rx( R_R10, R_EAX );			// mov r10d, eax
+	emit_or_rx( R_R10, R_EDX );				// or r10d, edx
+	emit_or_rx( R_R10, R_ECX );				// or r10d, ecx
+	emit_cmp_rx( R_R10, R_DATAMASK );		// cmp r10d, r11d
+	EmitJumpFunc( 0x87, FUNC_DATW );		// ja +FUNC_DATW
+	emit_lea_base_index( R_R10, R_EAX, R_ECX ); // lea r10d, [rax+rcx]
+	emit_cmp_rx( R_R10, R_DATAMASK );		// cmp r10d, r11d
+	EmitJumpFunc( 0x87, FUNC_DATW );		// ja +FUNC_DATW
+	emit_lea_base_index( R_R10, R_EDX, R_ECX ); // lea r10d, [rdx+rcx]
+	emit_cmp_rx( R_R10, R_DATAMASK );		// cmp r10d, r11d
+	EmitJumpFunc( 0x87, FUNC_DATR );		// ja +FUNC_DATR
+
+	emit_lea_base_index( R_R9 | R_REX, R_DATABASE, R_EAX ); // lea r9, [rbx+rax]
+	emit_lea_base_index( R_R8 | R_REX, R_DATABASE, R_EDX ); // lea r8, [rbx+rdx]
+
+	emit_op_rx_imm32( X_CMP, R_ECX, 16 );	// cmp ecx, 16
+	big = EmitJumpShort( 0x73 );			// jae +big
+	emit_test_rx( R_ECX, R_ECX );			// test ecx, ecx
+	done = EmitJumpShort( 0x74 );			// jz +done
+	loop = compiledOfs;
+	emit_op_reg_base_index( 0x0F, 0xB6, R_EDX, R_R8, R_ECX, 1, -1 ); // movzx edx, byte [r8+rcx-1]
+	emit_op_reg_base_index( 0, 0x88, R_EDX, R_R9, R_ECX, 1, -1 ); // mov [r9+rcx-1], dl
+	emit_op_rx_imm32( X_SUB, R_ECX, 1 );	// sub ecx, 1
+	EmitJumpBack( 0x75, loop );				// jnz -loop
+	SetJumpShort( done );
+	emit_ret();								// ret
+
+	SetJumpShort( big );
+	emit_movdqu_load( R_XMM1, R_R8, R_ECX, -16 ); // movdqu xmm1, [r8+rcx-16]
+	emit_op_rx_imm32( X_SUB, R_ECX, 16 );	// sub ecx, 16
+	emit_xor_rx( R_R10, R_R10 );			// xor r10d, r10d
+	loop = compiledOfs;
+	emit_movdqu_load( R_XMM0, R_R8, R_R10, 0 ); // movdqu xmm0, [r8+r10]
+	emit_movdqu_store( R_XMM0, R_R9, R_R10, 0 ); // movdqu [r9+r10], xmm0
+	emit_op_rx_imm32( X_ADD, R_R10, 16 );	// add r10d, 16
+	emit_cmp_rx( R_R10, R_ECX );			// cmp r10d, ecx
+	EmitJumpBack( 0x72, loop );				// jb -loop
+	emit_movdqu_store( R_XMM1, R_R9, R_ECX, 0 ); // movdqu [r9+rcx], xmm1 - overlapped tail
+	emit_ret();								// ret
+}
+
+
+/*
+=================
+EmitSCPYFunc
+
+Q_strncpy() semantics: copy up to count bytes, backwards if destination
+overlaps source tail, then pad remaining space with zeroes in the fill loop
+=================
+*/
+static void EmitSCPYFunc( vm_t *vm, int fill )
+{
+	int loop, j1, j2, copied;
+
+	emit_load4( R_EAX, R_PROCBASE, 8 );		// mov eax, [rbp+8] - dst
+	emit_load4( R_EDX, R_PROCBASE, 12 );	// mov edx, [rbp+12] - src
+	emit_load4( R_ECX, R_PROCBASE, 16 );	// mov ecx, [rbp+16] - count
+	EmitClampBlock();
+	emit_and_rx( R_EDX, R_DATAMASK );		// and edx, r11d
+	emit_lea_base_index( R_R9 | R_REX, R_DATABASE, R_EAX ); // lea r9, [rbx+rax]
+	emit_lea_base_index( R_R8 | R_REX, R_DATABASE, R_EDX ); // lea r8, [rbx+rdx]
+
+	// do not scan source past the data segment
+	emit_lea( R_EAX, R_DATAMASK, 1 );		// lea eax, [r11+1]
+	emit_sub_rx( R_EAX, R_EDX );			// sub eax, edx
+	emit_cmp_rx( R_EAX, R_ECX );			// cmp eax, ecx
+	emit_op_reg( 0x0F, 0x47, R_ECX, R_EAX );	// cmova eax, ecx
+
+	// r10 = string length
+	emit_xor_rx( R_R10, R_R10 );			// xor r10d, r10d
+	loop = compiledOfs;
+	emit_cmp_rx( R_R10, R_EAX );			// cmp r10d, eax
+	j1 = EmitJumpShort( 0x73 );				// jae +scanned
+	emit_op_reg_base_index( 0, 0x80, 0x7, R_R8, R_R10, 1, 0 ); // cmp byte [r8+r10], 0
+	Emit1( 0x00 );
+	j2 = EmitJumpShort( 0x74 );				// jz +scanned
+	emit_op_rx_imm32( X_ADD, R_R10, 1 );	// add r10d, 1
+	EmitJumpBack( 0xEB, loop );				// jmp -loop
+	SetJumpShort( j1 );
+	SetJumpShort( j2 );
+
+	emit_sub_rx( R_ECX, R_R10 );			// sub ecx, r10d - padding length
+
+	// check if destination is inside of the source string
+	emit_cmp_rx( R_R9 | R_REX, R_R8 );		// cmp r9, r8
+	j1 = EmitJumpShort( 0x76 );				// jbe +forward
+	emit_lea_base_index( R_EAX | R_REX, R_R8, R_R10 ); // lea rax, [r8+r10]
+	emit_cmp_rx( R_R9 | R_REX, R_EAX );		// cmp r9, rax
+	j2 = EmitJumpShort( 0x73 );				// jae +forward
+	emit_mov_rx( R_EAX, R_R10 );			// mov eax, r10d
+	loop = compiledOfs;
+	emit_op_reg_base_index( 0x0F, 0xB6, R_EDX, R_R8, R_EAX, 1, -1 ); // movzx edx, byte [r8+rax-1]
+	emit_op_reg_base_index( 0, 0x88, R_EDX, R_R9, R_EAX, 1, -1 ); // mov [r9+rax-1], dl
+	emit_op_rx_imm32( X_SUB, R_EAX, 1 );	// sub eax, 1
+	EmitJumpBack( 0x75, loop );				// jnz -loop
+	copied = EmitJumpShort( 0xEB );			// jmp +copied
+
+	SetJumpShort( j1 );
+	SetJumpShort( j2 );
+	emit_xor_rx( R_EAX, R_EAX );			// xor eax, eax
+	loop = compiledOfs;
+	emit_cmp_rx( R_EAX, R_R10 );			// cmp eax, r10d
+	j1 = EmitJumpShort( 0x73 );				// jae +copied
+	emit_op_reg_base_index( 0x0F, 0xB6, R_EDX, R_R8, R_EAX, 1, 0 ); // movzx edx, byte [r8+rax]
+	emit_op_reg_base_index( 0, 0x88, R_EDX, R_R9, R_EAX, 1, 0 ); // mov [r9+rax], dl
+	emit_op_rx_imm32( X_ADD, R_EAX, 1 );	// add eax, 1
+	EmitJumpBack( 0xEB, loop );				// jmp -loop
+	SetJumpShort( j1 );
+	SetJumpShort( copied );
+
+	emit_add_rx( R_R9 | R_REX, R_R10 );		// add r9, r10
+	emit_xor_rx( R_EDX, R_EDX );			// xor edx, edx
+	Emit1( 0xE9 );							// jmp -fill
+	Emit4( fill - compiledOfs - 4 );
+}
+#endif // idx64
+
+
 static void EmitFloatJump( instruction_t *i, int op, int addr )
 {
 	switch ( op ) {
@@ -3371,7 +3730,7 @@ static void EmitFloatJump( instruction_t *i, int op, int addr )
 
 static void EmitPSOFFunc( vm_t *vm )
 {
-	mov_rx_ptr( R_EAX, &badStackPtr ); // mov eax, &badStackPtr
+	mov_rx_reloc( vm, R_EAX, RELOC_ERRFUNC, EF_BADSTACK ); // mov eax, &badStackPtr
 	EmitString( "FF 10" );		// call [eax]
 	emit_ret();					// ret
 }
@@ -3379,7 +3738,7 @@ static void EmitPSOFFunc( vm_t *vm )
 
 static void EmitOSOFFunc( vm_t *vm )
 {
-	mov_rx_ptr( R_EAX, &badOpStackPtr ); // mov eax, &badOpStackPtr
+	mov_rx_reloc( vm, R_EAX, RELOC_ERRFUNC, EF_BADOPSTACK ); // mov eax, &badOpStackPtr
 	EmitString( "FF 10" );		// call [eax]
 	emit_ret();					// ret
 }
@@ -3387,7 +3746,7 @@ static void EmitOSOFFunc( vm_t *vm )
 
 static void EmitBADJFunc( vm_t *vm )
 {
-	mov_rx_ptr( R_EAX, &badJumpPtr ); // mov eax, &badJumpPtr
+	mov_rx_reloc( vm, R_EAX, RELOC_ERRFUNC, EF_BADJUMP ); // mov eax, &badJumpPtr
 	EmitString( "FF 10" );		// call [eax]
 	emit_ret();					// ret
 }
@@ -3395,7 +3754,7 @@ static void EmitBADJFunc( vm_t *vm )
 
 static void EmitERRJFunc( vm_t *vm )
 {
-	mov_rx_ptr( R_EAX, &errJumpPtr ); // mov eax, &errJumpPtr
+	mov_rx_reloc( vm, R_EAX, RELOC_ERRFUNC, EF_ERRJUMP ); // mov eax, &errJumpPtr
 	EmitString( "FF 10" );		// call [eax]
 	emit_ret();					// ret
 }
@@ -3403,7 +3762,7 @@ static void EmitERRJFunc( vm_t *vm )
 
 static void EmitDATRFunc( vm_t *vm )
 {
-	mov_rx_ptr( R_EAX, &badDataReadPtr ); // mov eax, &badDataReadPtr
+	mov_rx_reloc( vm, R_EAX, RELOC_ERRFUNC, EF_BADDATAREAD ); // mov eax, &badDataReadPtr
 	EmitString( "FF 10" );		// call [eax]
 	emit_ret();					// ret
 }
@@ -3411,7 +3770,7 @@ static void EmitDATRFunc( vm_t *vm )
 
 static void EmitDATWFunc( vm_t *vm )
 {
-	mov_rx_ptr( R_EAX, &badDataWritePtr ); // mov eax, &badDataWritePtr
+	mov_rx_reloc( vm, R_EAX, RELOC_ERRFUNC, EF_BADDATAWRITE ); // mov eax, &badDataWritePtr
 	EmitString( "FF 10" );		// call [eax]
 	emit_ret();					// ret
 }
@@ -3419,6 +3778,18 @@ static void EmitDATWFunc( vm_t *vm )
 
 #ifdef CONST_OPTIMIZE
 
+// returns block function used instead of system call, FUNC_ENTR if none
+static func_t IsBlockTrap( const int trap )
+{
+	switch ( trap ) {
+		case ~TRAP_MEMSET:  return FUNC_MSET;
+		case ~TRAP_MEMCPY:  return FUNC_MCPY;
+		case ~TRAP_STRNCPY: return FUNC_SCPY;
+		default: return FUNC_ENTR;
+	}
+}
+
+
 static qboolean IsFloorTrap( const vm_t *vm, const int trap )
 {
 	if ( trap == ~CG_FLOOR && vm->index == VM_CGAME )
@@ -3670,6 +4041,20 @@ static qboolean ConstOptimize( vm_t *vm, instruction_t *ci, instruction_t *ni )
 
 			flush_volatile();
 
+			if ( vm->callSites ) {
+				emit_store_imm32( ip, R_PROCBASE, 0 ); // mov dword [procBase], ip - for stack walks
+			}
+
+#if idx64
+			if ( IsBlockTrap( ci->value ) ) {
+				mask_rx( R_EAX );
+				EmitCallOffset( IsBlockTrap( ci->value ) ); // eax = args[1]
+				ip += 1; // OP_CALL
+				store_syscall_opstack();
+				return qtrue;
+			}
+#endif
+
 			if ( ci->value < 0 ) { // syscall
 				mask_rx( R_EAX );
 				mov_rx_imm32( R_EAX, ~ci->value ); // eax - syscall number
@@ -3883,11 +4268,414 @@ static void dump_code( const char *vmname, uint8_t *c, int32_t code_len )
 VM_Compile
 =================
 */
+#ifdef CODE_CACHE
+/*
+=================
+Compiled code cache
+
+Generated code is stored in the home directory together with relocations
+for all embedded absolute addresses and reused while the QVM, engine build
+and code generation settings stay the same, see vm_codeCache
+=================
+*/
+#define CODE_CACHE_IDENT	(('C'<<24)+('M'<<16)+('V'<<8)+'Q')
+#define CODE_CACHE_VERSION	4	// bump on any change in code generation or layout
+
+typedef struct {
+	int32_t		ident;
+	int32_t		version;
+	uint32_t	build;			// of engine version and compile time
+	uint32_t	crc32sum;		// of the qvm file
+	int32_t		instructionCount;
+	uint32_t	dataMask;
+	int32_t		rtChecks;
+	int32_t		forceDataMask;
+	int32_t		cpuFlags;
+	int32_t		codeLength;
+	int32_t		numRelocs;
+	uint32_t	checksum;		// of relocations, code and instruction offsets
+	char		signature[32];	// keyed digest of the same data, see vm_codeKey
+} codeCacheHeader_t;
+
+
+/*
+=================
+VM_CodeCacheName
+=================
+*/
+static const char *VM_CodeCacheName( const vm_t *vm )
+{
+	return va( "cache/%s-%08x.vmc", vm->name, vm->crc32sum );
+}
+
+
+/*
+=================
+VM_FillCodeCacheHeader
+=================
+*/
+static void VM_FillCodeCacheHeader( const vm_t *vm, codeCacheHeader_t *header )
+{
+	static const char build[] = Q3_VERSION " " __DATE__ " " __TIME__;
+
+	Com_Memset( header, 0, sizeof( *header ) );
+	header->ident = CODE_CACHE_IDENT;
+	header->version = CODE_CACHE_VERSION;
+	header->build = crc32_buffer( (const byte *) build, sizeof( build ) - 1 );
+	header->crc32sum = vm->crc32sum;
+	header->instructionCount = vm->instructionCount;
+	header->dataMask = vm->dataMask;
+	header->rtChecks = vm_rtChecks->integer;
+	header->forceDataMask = vm->forceDataMask;
+	header->cpuFlags = CPU_Flags;
+}
+
+
+/*
+=================
+VM_SignCodeCache
+
+Nested keyed MD5 of cached data, zero filled if there is no key
+=================
+*/
+static void VM_SignCodeCache( const byte *buf, int length, char *signature )
+{
+	char inner[33];
+	int keyLength;
+
+	keyLength = (int)strlen( vm_codeKey->string );
+	if ( !keyLength ) {
+		Com_Memset( signature, 0, 32 );
+		return;
+	}
+
+	Q_strncpyz( inner, Com_MD5Buf( (const char *) buf, length, vm_codeKey->string, keyLength ), sizeof( inner ) );
+	Com_Memcpy( signature, Com_MD5Buf( vm_codeKey->string, keyLength, inner, 32 ), 32 );
+}
+
+
+/*
+=================
+VM_ValidateCodeCache
+
+Checks that cached data can't point outside of its own buffers
+=================
+*/
+static qboolean VM_ValidateCodeCache( const vm_t *vm, const codeCacheHeader_t *header, const reloc_t *rel, const int32_t *offsets )
+{
+	int i;
+
+	for ( i = 0; i < header->numRelocs; i++, rel++ ) {
+		if ( rel->offset < 0 || rel->offset > header->codeLength - (int)sizeof( intptr_t ) ) {
+			return qfalse;
+		}
+		switch ( rel->type ) {
+			case RELOC_VM:
+				if ( rel->value < 0 || rel->value > (int)( sizeof( vm_t ) - sizeof( intptr_t ) ) )
+					return qfalse;
+				break;
+			case RELOC_DATA:
+				if ( rel->value < 0 || rel->value > (int)vm->dataMask )
+					return qfalse;
+				break;
+			case RELOC_CODE:
+				if ( rel->value < 0 || rel->value > PAD( header->codeLength, 8 ) )
+					return qfalse;
+				break;
+			case RELOC_ERRFUNC:
+				if ( rel->value < 0 || rel->value >= EF_COUNT )
+					return qfalse;
+				break;
+			default:
+				return qfalse;
+		}
+	}
+
+	for ( i = 0; i < header->instructionCount; i++ ) {
+		if ( offsets[i] < -1 || offsets[i] >= header->codeLength ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+VM_LoadCodeCache
+
+Maps cached code for the vm, on success code and instructionPointers are set up
+=================
+*/
+static qboolean VM_LoadCodeCache( vm_t *vm )
+{
+	codeCacheHeader_t header, expected;
+	const char *filename;
+	const reloc_t *rel;
+	const int32_t *offsets;
+	fileHandle_t f;
+	intptr_t target;
+	char signature[32];
+	byte *buf;
+	int len, payload, i;
+
+	if ( !vm_codeCache->integer ) {
+		return qfalse;
+	}
+
+	filename = VM_CodeCacheName( vm );
+
+	// not affected by pure server restrictions
+	len = FS_SV_FOpenFileRead( filename, &f );
+	if ( f == FS_INVALID_HANDLE ) {
+		return qfalse;
+	}
+
+	VM_FillCodeCacheHeader( vm, &expected );
+
+	if ( len < (int)sizeof( header ) || FS_Read( &header, sizeof( header ), f ) != sizeof( header )
+		|| header.codeLength <= 0 || header.numRelocs < 0 || header.numRelocs > MAX_RELOCS ) {
+		FS_FCloseFile( f );
+		Com_DPrintf( "%s is invalid\n", filename );
+		return qfalse;
+	}
+
+	expected.codeLength = header.codeLength;
+	expected.numRelocs = header.numRelocs;
+	expected.checksum = header.checksum;
+	Com_Memcpy( expected.signature, header.signature, sizeof( expected.signature ) );
+
+	payload = header.numRelocs * sizeof( reloc_t ) + header.codeLength + header.instructionCount * sizeof( int32_t );
+	if ( memcmp( &header, &expected, sizeof( header ) ) || len - (int)sizeof( header ) != payload ) {
+		FS_FCloseFile( f );
+		Com_DPrintf( "%s is outdated\n", filename );
+		return qfalse;
+	}
+
+	buf = Z_Malloc( payload );
+	if ( FS_Read( buf, payload, f ) != payload || crc32_buffer( buf, payload ) != header.checksum ) {
+		FS_FCloseFile( f );
+		Z_Free( buf );
+		Com_DPrintf( "%s is corrupted\n", filename );
+		return qfalse;
+	}
+
+	FS_FCloseFile( f );
+
+	VM_SignCodeCache( buf, payload, signature );
+	if ( memcmp( signature, header.signature, sizeof( signature ) ) ) {
+		Z_Free( buf );
+		Com_Printf( S_COLOR_YELLOW "%s: %s is not signed with vm_codeKey\n", vm->name, VM_CodeCacheName( vm ) );
+		return qfalse;
+	}
+
+	rel = (const reloc_t *) buf;
+	offsets = (const int32_t *)( buf + header.numRelocs * sizeof( reloc_t ) + header.codeLength );
+
+	if ( !VM_ValidateCodeCache( vm, &header, rel, offsets ) ) {
+		Z_Free( buf );
+		Com_DPrintf( "%s is invalid\n", filename );
+		return qfalse;
+	}
+
+	code = (byte*)VM_Alloc_Compiled( vm, PAD( header.codeLength, 8 ), header.instructionCount * sizeof( intptr_t ) );
+	if ( code == NULL ) {
+		Z_Free( buf );
+		return qfalse;
+	}
+
+	Com_Memcpy( code, buf + header.numRelocs * sizeof( reloc_t ), header.codeLength );
+	instructionPointers = (intptr_t*)(byte*)(code + PAD( header.codeLength, 8 ));
+
+	for ( i = 0; i < header.numRelocs; i++, rel++ ) {
+		target = VM_RelocTarget( vm, rel->type, rel->value );
+		Com_Memcpy( code + rel->offset, &target, sizeof( target ) );
+	}
+
+	for ( i = 0; i < header.instructionCount; i++ ) {
+		if ( offsets[i] < 0 ) {
+			instructionPointers[ i ] = (intptr_t)badJumpPtr;
+		} else {
+			instructionPointers[ i ] = (intptr_t)vm->codeBase.ptr + offsets[ i ];
+		}
+	}
+
+	compiledOfs = header.codeLength;
+
+	Z_Free( buf );
+
+	return qtrue;
+}
+
+
+/*
+=================
+VM_WriteCodeCache
+
+Must be called before VM_FreeBuffers()
+=================
+*/
+static void VM_WriteCodeCache( vm_t *vm )
+{
+	codeCacheHeader_t header;
+	const char *filename;
+	fileHandle_t f;
+	int32_t *offsets;
+	byte *buf, *codeCopy;
+	int payload, i;
+
+	if ( !vm_codeCache->integer ) {
+		return;
+	}
+
+	if ( numRelocs > MAX_RELOCS ) {
+		Com_DPrintf( "%s: too many relocations, code is not cached\n", vm->name );
+		return;
+	}
+
+	payload = numRelocs * sizeof( reloc_t ) + compiledOfs + vm->instructionCount * sizeof( int32_t );
+	buf = Z_Malloc( payload );
+
+	Com_Memcpy( buf, relocs, numRelocs * sizeof( reloc_t ) );
+
+	// clear embedded addresses so file contents don't depend on them
+	codeCopy = buf + numRelocs * sizeof( reloc_t );
+	Com_Memcpy( codeCopy, code, compiledOfs );
+	for ( i = 0; i < numRelocs; i++ ) {
+		Com_Memset( codeCopy + relocs[i].offset, 0, sizeof( intptr_t ) );
+	}
+
+	offsets = (int32_t *)( codeCopy + compiledOfs );
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		offsets[i] = inst[i].jused ? instructionOffsets[i] : -1;
+	}
+
+	VM_FillCodeCacheHeader( vm, &header );
+	header.codeLength = compiledOfs;
+	header.numRelocs = numRelocs;
+	header.checksum = crc32_buffer( buf, payload );
+	VM_SignCodeCache( buf, payload, header.signature );
+
+	filename = VM_CodeCacheName( vm );
+
+	f = FS_SV_FOpenFileWrite( filename );
+	if ( f != FS_INVALID_HANDLE ) {
+		FS_Write( &header, sizeof( header ), f );
+		FS_Write( buf, payload, f );
+		FS_FCloseFile( f );
+		vm->codeCached = qtrue;
+		Com_DPrintf( "wrote %s\n", filename );
+	}
+
+	Z_Free( buf );
+}
+#endif // CODE_CACHE
+
+
+/*
+=================
+VM_ProtectCode
+
+Removes write access from generated code
+=================
+*/
+static qboolean VM_ProtectCode( vm_t *vm )
+{
+#ifdef VM_X86_MMAP
+	if ( mprotect( vm->codeBase.ptr, vm->codeSize, PROT_READ|PROT_EXEC ) ) {
+		VM_Destroy_Compiled( vm );
+		Com_Printf( S_COLOR_YELLOW "VM_CompileX86: mprotect failed\n" );
+		return qfalse;
+	}
+#elif _WIN32
+	{
+		DWORD oldProtect = 0;
+
+		// remove write permissions.
+		if ( !VirtualProtect( vm->codeBase.ptr, vm->codeSize, PAGE_EXECUTE_READ, &oldProtect ) ) {
+			VM_Destroy_Compiled( vm );
+			Com_Printf( S_COLOR_YELLOW "%s(%s): VirtualProtect failed\n", __func__, vm->name );
+			return qfalse;
+		}
+	}
+#endif
+	return qtrue;
+}
+
+
+/*
+=================
+FunctionStart
+=================
+*/
+static int FunctionStart( const vm_t *vm, int func )
+{
+	// anything before first function goes along with it
+	return func == 0 ? 0 : vm->funcStart[ func ];
+}
+
+
+/*
+=================
+FunctionEnd
+=================
+*/
+static int FunctionEnd( const vm_t *vm, int func )
+{
+	return func + 1 < vm->numFuncs ? vm->funcStart[ func + 1 ] : vm->instructionCount;
+}
+
+
+/*
+=================
+VM_FunctionOrder
+
+Entry function always goes first, in profile guided recompilation
+hot functions follow it so they share cache lines and pages
+=================
+*/
+static int *VM_FunctionOrder( const vm_t *vm )
+{
+	int *order;
+	int i, n;
+
+	if ( !vm->numFuncs ) {
+		return NULL;
+	}
+
+	order = (int*)Z_Malloc( vm->numFuncs * sizeof( order[0] ) );
+
+	n = 0;
+	order[ n++ ] = 0;
+
+	if ( vm->funcHot ) {
+		for ( i = 1; i < vm->numFuncs; i++ ) {
+			if ( vm->funcHot[ i ] ) {
+				order[ n++ ] = i;
+			}
+		}
+		for ( i = 1; i < vm->numFuncs; i++ ) {
+			if ( !vm->funcHot[ i ] ) {
+				order[ n++ ] = i;
+			}
+		}
+	} else {
+		for ( i = 1; i < vm->numFuncs; i++ ) {
+			order[ n++ ] = i;
+		}
+	}
+
+	return order;
+}
+
+
 qboolean VM_Compile( vm_t *vm, vmHeader_t *header ) {
 	const char	*errMsg;
 	int		instructionCount;
 	instruction_t *ci;
 	int		i, n;
+	int		chunk, chunkEnd, func;
 	uint32_t rx[3];
 	uint32_t sx[2];
 	int proc_base;
@@ -3918,8 +4706,35 @@ qboolean VM_Compile( vm_t *vm, vmHeader_t *header ) {
 
 	VM_ReplaceInstructions( vm, inst );
 
+	VM_FindFunctions( vm, inst );
+
+	vm->codeCached = qfalse;
+
+	// first compilation counts calls, next one places hot functions together
+	// worker and benchmark instances are never recompiled
+	instrument = ( vm_tierUp->integer > 0 && !vm->funcHot && vm->numFuncs > 0 && !VM_DETACHED( vm ) );
+	if ( instrument && !vm->funcCalls ) {
+		vm->funcCalls = Z_Malloc( vm->numFuncs * sizeof( vm->funcCalls[0] ) );
+	}
+
+#ifdef CODE_CACHE
+	// worker code differs in stack bounds, see VM_CreateWorker
+	if ( !instrument && !vm->funcHot && !vm->callSites && !VM_DETACHED( vm ) && VM_LoadCodeCache( vm ) ) {
+		VM_FreeBuffers();
+		if ( !VM_ProtectCode( vm ) ) {
+			return qfalse;
+		}
+		vm->destroy = VM_Destroy_Compiled;
+		vm->codeCached = qtrue;
+		Com_Printf( "VM file %s loaded %i bytes of cached code\n", vm->name, compiledOfs );
+		return qtrue;
+	}
+#endif
+
 	VM_FindMOps( inst, vm->instructionCount );
 
+	funcOrder = VM_FunctionOrder( vm );
+
 #if JUMP_OPTIMIZE
 	for ( i = 0; i < header->instructionCount; i++ ) {
 		if ( ops[inst[i].op].flags & JUMP ) {
@@ -3950,6 +4765,9 @@ __compile:
 	// translate all instructions
 	ip = 0;
 	compiledOfs = 0;
+#ifdef CODE_CACHE
+	numRelocs = 0;
+#endif
 #if JUMP_OPTIMIZE
 	jumpSizeChanged = 0;
 #endif
@@ -3977,21 +4795,23 @@ __compile:
 	emit_push( R_R14 );				// push r14
 	emit_push( R_R15 );				// push r15
 
-	mov_rx_ptr( R_DATABASE, vm->dataBase );			// mov rbx, vm->dataBase
+	mov_rx_reloc( vm, R_DATABASE, RELOC_DATA, 0 );	// mov rbx, vm->dataBase
 
-	// do not use wrapper, force constant size there
-	emit_mov_rx_imm64( R_INSPOINTERS, (intptr_t) instructionPointers ); // mov r8, vm->instructionPointers
+	// constant size, table is placed right after code
+	mov_rx_reloc( vm, R_INSPOINTERS, RELOC_CODE, code ? (byte *) instructionPointers - code : 0 ); // mov r8, vm->instructionPointers
 
 	mov_rx_imm32( R_DATAMASK, vm->dataMask );		// mov r11d, vm->dataMask
 	mov_rx_imm32( R_STACKBOTTOM, vm->stackBottom );	// mov r14d, vm->stackBottom
 
-	mov_rx_ptr( R_EAX, &vm->opStack );				// mov rax, &vm->opStack
+	mov_rx_reloc( vm, R_EAX, RELOC_VM, offsetof( vm_t, opStack ) ); // mov rax, &vm->opStack
 
 	emit_load4( R_OPSTACK | R_REX, R_EAX, 0 );		// mov rdi, [rax]
 
-	mov_rx_ptr( R_SYSCALL, vm->systemCall );		// mov r13, vm->systemCall
+	// load on every entry so system call handler can be replaced at runtime
+	mov_rx_reloc( vm, R_EAX, RELOC_VM, offsetof( vm_t, systemCall ) ); // mov rax, &vm->systemCall
+	emit_load4( R_SYSCALL | R_REX, R_EAX, 0 );		// mov r13, [rax]
 
-	mov_rx_ptr( R_EAX, &vm->programStack );			// mov rax, &vm->programStack
+	mov_rx_reloc( vm, R_EAX, RELOC_VM, offsetof( vm_t, programStack ) ); // mov rax, &vm->programStack
 
 	emit_load4( R_PSTACK, R_EAX, 0 ); // mov esi, dword ptr [rax]
 
@@ -4000,7 +4820,7 @@ __compile:
 	EmitCallOffset( FUNC_ENTR );
 
 #ifdef DEBUG_VM
-	mov_rx_ptr( R_EAX, &vm->programStack );		// mov rax, &vm->programStack
+	mov_rx_reloc( vm, R_EAX, RELOC_VM, offsetof( vm_t, programStack ) ); // mov rax, &vm->programStack
 	emit_store_rx( R_PSTACK, R_EAX, 0 );		// mov [rax], esi
 #endif
 
@@ -4042,7 +4862,25 @@ __compile:
 	// main function entry offset
 	funcOffset[FUNC_ENTR] = compiledOfs;
 
-	while ( ip < instructionCount ) {
+	chunk = 0;
+	if ( funcOrder ) {
+		func = funcOrder[ 0 ];
+		chunkEnd = FunctionEnd( vm, func );
+	} else {
+		func = -1;
+		chunkEnd = instructionCount;
+	}
+
+	for ( ;; ) {
+		if ( ip >= chunkEnd ) {
+			if ( !funcOrder || ++chunk >= vm->numFuncs ) {
+				break;
+			}
+			func = funcOrder[ chunk ];
+			ip = FunctionStart( vm, func );
+			chunkEnd = FunctionEnd( vm, func );
+		}
+
 		ci = &inst[ip + 0];
 
 #ifdef REGS_OPTIMIZE
@@ -4070,10 +4908,19 @@ __compile:
 				break;
 
 			case OP_ENTER:
-				EmitAlign( FUNC_ALIGN );
+				if ( vm->funcHot && func >= 0 && vm->funcHot[ func ] ) {
+					EmitAlignHot();
+				} else {
+					EmitAlign( FUNC_ALIGN );
+				}
 
 				instructionOffsets[ ip-1 ] = compiledOfs;
 
+				if ( instrument && func >= 0 ) {
+					mov_rx_reloc( vm, R_EAX, RELOC_COUNTER, func * sizeof( uint32_t ) ); // mov eax, &vm->funcCalls[ func ]
+					EmitString( "FF 00" );				// inc dword ptr [eax]
+				}
+
 				proc_base = ip; // this points on next instruction after OP_ENTER
 
 				// locate endproc
@@ -4133,6 +4980,9 @@ __compile:
 			case OP_CALL:
 				rx[0] = load_rx_opstack( R_EAX | FORCED ); // eax = *opstack
 				flush_volatile();
+				if ( vm->callSites ) {
+					emit_store_imm32( ip, R_PROCBASE, 0 ); // mov dword [procBase], ip - for stack walks
+				}
 				if ( opstack != 1 ) {
 					emit_op_rx_imm32( X_ADD, R_OPSTACK | R_REX, ( opstack - 1 ) * sizeof( int32_t ) );
 					EmitCallOffset( FUNC_CALL ); // call +FUNC_CALL
@@ -4656,6 +5506,20 @@ __compile:
 		funcOffset[FUNC_BCPY] = compiledOfs;
 		EmitBCPYFunc( vm );
 
+#if idx64
+		EmitAlign( FUNC_ALIGN );
+		funcOffset[FUNC_MSET] = compiledOfs;
+		n = EmitMSETFunc( vm );
+
+		EmitAlign( FUNC_ALIGN );
+		funcOffset[FUNC_MCPY] = compiledOfs;
+		EmitMCPYFunc( vm );
+
+		EmitAlign( FUNC_ALIGN );
+		funcOffset[FUNC_SCPY] = compiledOfs;
+		EmitSCPYFunc( vm, n );
+#endif
+
 		// ***************
 		// error functions
 		// ***************
@@ -4732,26 +5596,17 @@ __compile:
 		instructionPointers[ i ] = (intptr_t)vm->codeBase.ptr + instructionOffsets[ i ];
 	}
 
+#ifdef CODE_CACHE
+	if ( !instrument && !vm->funcHot && !vm->callSites && !VM_DETACHED( vm ) ) {
+		VM_WriteCodeCache( vm );
+	}
+#endif
+
 	VM_FreeBuffers();
 
-#ifdef VM_X86_MMAP
-	if ( mprotect( vm->codeBase.ptr, vm->codeSize, PROT_READ|PROT_EXEC ) ) {
-		VM_Destroy_Compiled( vm );
-		Com_Printf( S_COLOR_YELLOW "VM_CompileX86: mprotect failed\n" );
+	if ( !VM_ProtectCode( vm ) ) {
 		return qfalse;
 	}
-#elif _WIN32
-	{
-		DWORD oldProtect = 0;
-
-		// remove write permissions.
-		if ( !VirtualProtect( vm->codeBase.ptr, vm->codeSize, PAGE_EXECUTE_READ, &oldProtect ) ) {
-			VM_Destroy_Compiled( vm );
-			Com_Printf( S_COLOR_YELLOW "%s(%s): VirtualProtect failed\n", __func__, vm->name );
-			return qfalse;
-		}
-	}
-#endif
 
 	vm->destroy = VM_Destroy_Compiled;
 
@@ -4850,9 +5705,8 @@ int32_t VM_CallCompiled( vm_t *vm, int nargs, int32_t *args )
 		image[i + 2] = args[i];
 	}
 
-	// these only needed for interpreter:
-	// image[1] =  0; // return stack
-	// image[0] = -1; // will terminate loop on return
+	// terminates stack walks, see vmprofile stacks
+	image[0] = -1;
 
 #ifdef DEBUG_VM
 	opStack[0] = 0xDEADC0DE;
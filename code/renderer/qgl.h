@@ -119,6 +119,15 @@ typedef ptrdiff_t GLintptrARB;
 #define GL_STATIC_DRAW_ARB                  0x88E4
 #endif
 
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#define GL_PIXEL_PACK_BUFFER_ARB            0x88EB
+#endif
+
+#ifndef GL_STREAM_READ_ARB
+#define GL_READ_ONLY_ARB                    0x88B8
+#define GL_STREAM_READ_ARB                  0x88E1
+#endif
+
 #ifndef GL_ARB_vertex_program
 #define GL_ARB_vertex_program 1
 #define GL_VERTEX_PROGRAM_ARB               0x8620
@@ -164,6 +173,38 @@ typedef char GLchar;
 #define GL_RENDERBUFFER                     0x8D41
 #endif
 
+#ifndef GL_SAMPLES_PASSED
+#define GL_QUERY_RESULT                     0x8866
+#define GL_QUERY_RESULT_AVAILABLE           0x8867
+#define GL_SAMPLES_PASSED                   0x8914
+#endif
+
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP                        0x8E28
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_WRITE_BIT                    0x0002
+#define GL_MAP_PERSISTENT_BIT               0x0040
+#define GL_MAP_COHERENT_BIT                 0x0080
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE       0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT          0x00000001
+#define GL_TIMEOUT_EXPIRED                  0x911B
+#define GL_WAIT_FAILED                      0x911D
+typedef struct __GLsync *GLsync;
+#endif
+
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER                  0x8B30
+#define GL_VERTEX_SHADER                    0x8B31
+#define GL_COMPILE_STATUS                   0x8B81
+#define GL_LINK_STATUS                      0x8B82
+#define GL_INFO_LOG_LENGTH                  0x8B84
+#endif
+
 //===========================================================================
 
 #define QGL_Core_PROCS \
@@ -237,6 +278,20 @@ typedef char GLchar;
 	GLE( void, glBindBufferARB, GLenum target, GLuint buffer ) \
 	GLE( void, glBufferDataARB, GLenum target, GLsizeiptrARB size, const GLvoid *data, GLenum usage )
 
+#define QGL_PBO_PROCS \
+	GLE( void *, glMapBufferARB, GLenum target, GLenum access ) \
+	GLE( GLboolean, glUnmapBufferARB, GLenum target )
+
+#define QGL_MULTIDRAW_PROCS \
+	GLE( void, glMultiDrawElements, GLenum mode, const GLsizei *count, GLenum type, const GLvoid *const *indices, GLsizei drawcount )
+
+#define QGL_STREAM_PROCS \
+	GLE( void, glBufferStorage, GLenum target, GLsizeiptrARB size, const GLvoid *data, GLbitfield flags ) \
+	GLE( void *, glMapBufferRange, GLenum target, GLintptrARB offset, GLsizeiptrARB length, GLbitfield access ) \
+	GLE( GLsync, glFenceSync, GLenum condition, GLbitfield flags ) \
+	GLE( GLenum, glClientWaitSync, GLsync sync, GLbitfield flags, uint64_t timeout ) \
+	GLE( void, glDeleteSync, GLsync sync )
+
 #define QGL_FBO_PROCS \
 	GLE( void, glBindRenderbuffer, GLenum target, GLuint renderbuffer ) \
 	GLE( void, glDeleteFramebuffers, GLsizei n, const GLuint *framebuffers ) \
@@ -257,6 +312,37 @@ typedef char GLchar;
 	GLE( void, glRenderbufferStorageMultisample, GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height ) \
 	GLE( void, glGetInternalformativ, GLenum target, GLenum internalformat, GLenum pname, GLsizei bufSize, GLint *params )
 
+#define QGL_QUERY_PROCS \
+	GLE( void, glGenQueries, GLsizei n, GLuint *ids ) \
+	GLE( void, glDeleteQueries, GLsizei n, const GLuint *ids ) \
+	GLE( void, glBeginQuery, GLenum target, GLuint id ) \
+	GLE( void, glEndQuery, GLenum target ) \
+	GLE( void, glGetQueryObjectiv, GLuint id, GLenum pname, GLint *params ) \
+	GLE( void, glGetQueryObjectuiv, GLuint id, GLenum pname, GLuint *params )
+
+#define QGL_GLSL_PROCS \
+	GLE( GLuint, glCreateShader, GLenum type ) \
+	GLE( void, glShaderSource, GLuint shader, GLsizei count, const char **string, const GLint *length ) \
+	GLE( void, glCompileShader, GLuint shader ) \
+	GLE( void, glGetShaderiv, GLuint shader, GLenum pname, GLint *params ) \
+	GLE( void, glGetShaderInfoLog, GLuint shader, GLsizei bufSize, GLsizei *length, char *infoLog ) \
+	GLE( void, glDeleteShader, GLuint shader ) \
+	GLE( GLuint, glCreateProgram, void ) \
+	GLE( void, glAttachShader, GLuint program, GLuint shader ) \
+	GLE( void, glLinkProgram, GLuint program ) \
+	GLE( void, glGetProgramiv, GLuint program, GLenum pname, GLint *params ) \
+	GLE( void, glGetProgramInfoLog, GLuint program, GLsizei bufSize, GLsizei *length, char *infoLog ) \
+	GLE( void, glDeleteProgram, GLuint program ) \
+	GLE( void, glUseProgram, GLuint program ) \
+	GLE( GLint, glGetUniformLocation, GLuint program, const char *name ) \
+	GLE( void, glUniform1i, GLint location, GLint v0 ) \
+	GLE( void, glUniform1f, GLint location, GLfloat v0 ) \
+	GLE( void, glUniform4fv, GLint location, GLsizei count, const GLfloat *value )
+
+#define QGL_TIMER_PROCS \
+	GLE( void, glQueryCounter, GLuint id, GLenum target ) \
+	GLE( void, glGetQueryObjectui64v, GLuint id, GLenum pname, uint64_t *params )
+
 #define QGL_Win32_PROCS \
 	GLE( HGLRC, wglCreateContext, HDC ) \
 	GLE( BOOL,  wglDeleteContext ,HGLRC ) \
@@ -19,6 +19,7 @@
 static GLuint programs[ PROGRAM_COUNT ];
 static GLuint current_vp;
 static GLuint current_fp;
+static GLuint current_glsl;
 
 static int programCompiled = 0;
 static int programEnabled	= 0;
@@ -995,6 +996,90 @@ qboolean ARB_CompileProgram( programType ptype, const char *text, GLuint program
 }
 
 
+static GLuint GLSL_CompileShader( GLenum type, const char *text )
+{
+	char log[1024];
+	GLuint shader;
+	GLint status;
+
+	shader = qglCreateShader( type );
+	qglShaderSource( shader, 1, &text, NULL );
+	qglCompileShader( shader );
+	qglGetShaderiv( shader, GL_COMPILE_STATUS, &status );
+	if ( !status )
+	{
+		qglGetShaderInfoLog( shader, sizeof( log ), NULL, log );
+		ri.Printf( PRINT_ALL, S_COLOR_YELLOW "%s Compile Error: %s\n" S_COLOR_CYAN "%s\n", (type == GL_FRAGMENT_SHADER) ? "FS" : "VS",
+			log, text );
+		qglDeleteShader( shader );
+		return 0;
+	}
+
+	return shader;
+}
+
+
+/*
+=============
+GLSL_CompileProgram
+
+Returns linked program object or 0 on error
+=============
+*/
+GLuint GLSL_CompileProgram( const char *vertexText, const char *fragmentText )
+{
+	char log[1024];
+	GLuint vs, fs, program;
+	GLint status;
+
+	vs = GLSL_CompileShader( GL_VERTEX_SHADER, vertexText );
+	if ( !vs )
+		return 0;
+
+	fs = GLSL_CompileShader( GL_FRAGMENT_SHADER, fragmentText );
+	if ( !fs )
+	{
+		qglDeleteShader( vs );
+		return 0;
+	}
+
+	program = qglCreateProgram();
+	qglAttachShader( program, vs );
+	qglAttachShader( program, fs );
+	qglLinkProgram( program );
+
+	// program keeps shaders alive while attached
+	qglDeleteShader( vs );
+	qglDeleteShader( fs );
+
+	qglGetProgramiv( program, GL_LINK_STATUS, &status );
+	if ( !status )
+	{
+		qglGetProgramInfoLog( program, sizeof( log ), NULL, log );
+		ri.Printf( PRINT_ALL, S_COLOR_YELLOW "GLSL Link Error: %s\n", log );
+		qglDeleteProgram( program );
+		return 0;
+	}
+
+	return program;
+}
+
+
+void GLSL_UseProgram( GLuint program )
+{
+	if ( current_glsl != program )
+	{
+		if ( program )
+		{
+			// ARB programs are ignored while GLSL program is in use
+			ARB_ProgramEnableExt( 0, 0 );
+		}
+		current_glsl = program;
+		qglUseProgram( program );
+	}
+}
+
+
 qboolean ARB_UpdatePrograms( void )
 {
 #ifdef USE_PMLIGHT
@@ -1963,7 +2048,9 @@ void R_BloomScreen( void )
 			if ( !backEnd.projection2D )
 				RB_SetGL2D();
 			qglColor4f( 1, 1, 1, 1 );
+			RB_GpuTimer( GPU_TIMER_BLOOM );
 			FBO_Bloom( 0, 0, qfalse );
+			RB_GpuTimer( GPU_TIMER_2D );
 		}
 	}
 }
@@ -2005,9 +2092,11 @@ void FBO_PostProcess( void )
 	minimized = ri.CL_IsMinimized();
 
 	if ( r_bloom->integer && programCompiled && qglActiveTextureARB ) {
+		RB_GpuTimer( GPU_TIMER_BLOOM );
 		if ( FBO_Bloom( gamma, obScale, !minimized ) ) {
 			return;
 		}
+		RB_GpuTimer( GPU_TIMER_POST );
 	}
 
 	// check if we can perform final draw directly into back buffer
@@ -2212,6 +2301,10 @@ void QGL_DoneARB( void )
 #ifdef USE_FBO
 	QGL_DoneFBO();
 #endif
+	if ( current_glsl )
+	{
+		GLSL_UseProgram( 0 );
+	}
 	if ( programCompiled )
 	{
 		ARB_ProgramDisable();
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_local.h"
 
 backEndData_t	*backEndData;
+backEndData_t	*backEndFrames[ SMP_FRAMES ];
 backEndState_t	backEnd;
 
 const float *GL_Ortho( const float left, const float right, const float bottom, const float top, const float znear, const float zfar )
@@ -482,6 +483,131 @@ static void SetViewportAndScissor( void ) {
 }
 
 
+/*
+=================
+GPU timer queries
+
+Timestamps of GL_ARB_timer_query, every frame uses its own set of queries
+which is read back GPU_QUERY_FRAMES later, a frame whose results are still
+not available is dropped rather than stalling the pipeline
+=================
+*/
+#define GPU_QUERY_FRAMES 4
+
+typedef struct {
+	GLuint		queries[ MAX_GPU_TIMESTAMPS ];
+	byte		timers[ MAX_GPU_TIMESTAMPS ];
+	int			count;
+	qboolean	pending;
+} gpuQueryFrame_t;
+
+static gpuQueryFrame_t	gpuQueryFrames[ GPU_QUERY_FRAMES ];
+static gpuQueryFrame_t	*gpuQuery;		// recording, NULL if not
+static int				gpuQueryIndex;
+static qboolean			gpuQueryInited;
+
+
+static void RB_WriteGpuTimestamp( int timer ) {
+	qglQueryCounter( gpuQuery->queries[ gpuQuery->count ], GL_TIMESTAMP );
+	gpuQuery->timers[ gpuQuery->count++ ] = timer;
+}
+
+
+static void RB_ReadGpuTimestamps( gpuQueryFrame_t *frame ) {
+	uint64_t stamps[ MAX_GPU_TIMESTAMPS ];
+	GLint available;
+	int i;
+
+	frame->pending = qfalse;
+
+	available = 0;
+	qglGetQueryObjectiv( frame->queries[ frame->count - 1 ], GL_QUERY_RESULT_AVAILABLE, &available );
+	if ( !available ) {
+		return;
+	}
+
+	for ( i = 0; i < frame->count; i++ ) {
+		qglGetQueryObjectui64v( frame->queries[i], GL_QUERY_RESULT, &stamps[i] );
+	}
+
+	R_GpuTimerFrame( frame->timers, stamps, frame->count, 1.0f );
+}
+
+
+static void RB_GpuTimerBegin( void ) {
+	int i;
+
+	if ( gpuQuery || !qglQueryCounter || !R_GpuTimersActive() ) {
+		return;
+	}
+
+	if ( !gpuQueryInited ) {
+		for ( i = 0; i < GPU_QUERY_FRAMES; i++ ) {
+			qglGenQueries( MAX_GPU_TIMESTAMPS, gpuQueryFrames[i].queries );
+		}
+		gpuQueryInited = qtrue;
+	}
+
+	gpuQuery = &gpuQueryFrames[ gpuQueryIndex ];
+	if ( gpuQuery->pending ) {
+		RB_ReadGpuTimestamps( gpuQuery );
+	}
+
+	gpuQuery->count = 0;
+	RB_WriteGpuTimestamp( GPU_TIMER_WORLD );
+}
+
+
+/*
+=================
+RB_GpuTimer
+
+Starts a new segment when the active pass changes,
+the last query of the frame is kept for RB_GpuTimerEnd()
+=================
+*/
+void RB_GpuTimer( gpuTimer_t timer ) {
+	if ( !gpuQuery || gpuQuery->timers[ gpuQuery->count - 1 ] == timer ) {
+		return;
+	}
+
+	if ( gpuQuery->count >= MAX_GPU_TIMESTAMPS - 1 ) {
+		return;
+	}
+
+	RB_WriteGpuTimestamp( timer );
+}
+
+
+static void RB_GpuTimerEnd( void ) {
+	if ( !gpuQuery ) {
+		return;
+	}
+
+	RB_WriteGpuTimestamp( GPU_TIMER_COUNT );
+	gpuQuery->pending = qtrue;
+	gpuQuery = NULL;
+
+	gpuQueryIndex = ( gpuQueryIndex + 1 ) % GPU_QUERY_FRAMES;
+}
+
+
+void RB_GpuTimerShutdown( void ) {
+	int i;
+
+	if ( gpuQueryInited ) {
+		for ( i = 0; i < GPU_QUERY_FRAMES; i++ ) {
+			qglDeleteQueries( MAX_GPU_TIMESTAMPS, gpuQueryFrames[i].queries );
+		}
+	}
+
+	Com_Memset( gpuQueryFrames, 0, sizeof( gpuQueryFrames ) );
+	gpuQuery = NULL;
+	gpuQueryIndex = 0;
+	gpuQueryInited = qfalse;
+}
+
+
 /*
 =================
 RB_BeginDrawingView
@@ -501,6 +627,8 @@ static void RB_BeginDrawingView( void ) {
 		glState.finishCalled = qtrue;
 	}
 
+	RB_GpuTimer( backEnd.viewParms.portalView != PV_NONE ? GPU_TIMER_PORTAL : GPU_TIMER_WORLD );
+
 	// we will need to change the projection matrix before drawing
 	// 2D images again
 	backEnd.projection2D = qfalse;
@@ -549,6 +677,86 @@ static void RB_BeginDrawingView( void ) {
 static void RB_LightingPass( void );
 #endif
 
+/*
+==================
+RB_IsInstanced
+
+Model surfaces which can share a world space batch with
+surfaces of other entities
+==================
+*/
+static qboolean RB_IsInstanced( const drawSurf_t *drawSurf, int entityNum, const shader_t *shader, int dlighted ) {
+	const trRefEntity_t *ent;
+
+	if ( !r_instancing->integer || !shader->instancing || entityNum == REFENTITYNUM_WORLD || dlighted ) {
+		return qfalse;
+	}
+
+	if ( *drawSurf->surface != SF_MD3 ) {
+		return qfalse;
+	}
+
+	ent = &backEnd.refdef.entities[ entityNum ];
+	if ( ent->e.reType != RT_MODEL || ( ent->e.renderfx & RF_DEPTHHACK ) ) {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+==================
+RB_EntityTime
+==================
+*/
+static double RB_EntityTime( const trRefEntity_t *ent, double originalTime ) {
+	if ( ent->intShaderTime )
+		return originalTime - (double)(ent->e.shaderTime.i) * 0.001;
+	else
+		return originalTime - (double)ent->e.shaderTime.f;
+}
+
+
+/*
+==================
+RB_SurfaceInstanced
+
+Tessellates a model surface and moves it into world space
+==================
+*/
+static void RB_SurfaceInstanced( const md3Surface_t *surface, const orientationr_t *or ) {
+	float	*xyz, *normal;
+	vec3_t	v;
+	int		i, first;
+
+	// flush ahead so that all new vertexes follow first
+	RB_CHECKOVERFLOW( surface->numVerts, surface->numTriangles * 3 );
+
+	first = tess.numVertexes;
+	rb_surfaceTable[ SF_MD3 ]( (void *)surface );
+
+	// lighting is entity specific, evaluate it while normals are in model space
+	if ( tess.shader->instancing == INSTANCE_LIT ) {
+		RB_CalcDiffuseColorVertexes( first, tess.numVertexes - first );
+	}
+
+	for ( i = first; i < tess.numVertexes; i++ ) {
+		xyz = tess.xyz[i];
+		VectorCopy( xyz, v );
+		xyz[0] = or->origin[0] + v[0] * or->axis[0][0] + v[1] * or->axis[1][0] + v[2] * or->axis[2][0];
+		xyz[1] = or->origin[1] + v[0] * or->axis[0][1] + v[1] * or->axis[1][1] + v[2] * or->axis[2][1];
+		xyz[2] = or->origin[2] + v[0] * or->axis[0][2] + v[1] * or->axis[1][2] + v[2] * or->axis[2][2];
+
+		normal = tess.normal[i];
+		VectorCopy( normal, v );
+		normal[0] = v[0] * or->axis[0][0] + v[1] * or->axis[1][0] + v[2] * or->axis[2][0];
+		normal[1] = v[0] * or->axis[0][1] + v[1] * or->axis[1][1] + v[2] * or->axis[2][1];
+		normal[2] = v[0] * or->axis[0][2] + v[1] * or->axis[1][2] + v[2] * or->axis[2][2];
+	}
+}
+
+
 /*
 ==================
 RB_RenderDrawSurfList
@@ -567,6 +775,8 @@ static void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 	float			oldShaderSort;
 #endif
 	double			originalTime; // -EC-
+	qboolean		instanced, oldInstanced, merge;
+	orientationr_t	instanceOr;
 
 	// save original time for entity shader offsets
 	originalTime = backEnd.refdef.floatTime;
@@ -582,11 +792,12 @@ static void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 	oldShaderSort = -1;
 #endif
 	depthRange = qfalse;
+	oldInstanced = qfalse;
 
 	backEnd.pc.c_surfaces += numDrawSurfs;
 
 	for (i = 0, drawSurf = drawSurfs ; i < numDrawSurfs ; i++, drawSurf++) {
-		if ( drawSurf->sort == oldSort ) {
+		if ( drawSurf->sort == oldSort && !oldInstanced ) {
 			// fast path, same as previous sort
 			rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
 			continue;
@@ -594,13 +805,19 @@ static void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 
 		R_DecomposeSort( drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted );
 
+		// identical models of several entities continue one batch in world space
+		instanced = RB_IsInstanced( drawSurf, entityNum, shader, dlighted );
+		merge = instanced && oldInstanced && !( ( oldSort ^ drawSurf->sort ) & ~QSORT_REFENTITYNUM_MASK )
+			&& RB_EntityTime( &backEnd.refdef.entities[ entityNum ], originalTime ) == backEnd.refdef.floatTime;
+
 		//
 		// change the tess parameters if needed
 		// a "entityMergable" shader is a shader that can have surfaces from separate
 		// entities merged into a single batch, like smoke and blood puff sprites
-		if ( ( (oldSort ^ drawSurfs->sort ) & ~QSORT_REFENTITYNUM_MASK ) || !shader->entityMergable ) {
+		if ( !merge && ( ( (oldSort ^ drawSurfs->sort ) & ~QSORT_REFENTITYNUM_MASK ) || !shader->entityMergable ) ) {
 			if ( oldShader != NULL ) {
 				RB_EndSurface();
+				tess.instanced = qfalse;
 			}
 #ifdef USE_PMLIGHT
 			#define INSERT_POINT SS_FOG
@@ -618,15 +835,25 @@ static void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 			oldShaderSort = shader->sort;
 #endif
 			RB_BeginSurface( shader, fogNum );
+			tess.instanced = instanced;
 			oldShader = shader;
 		}
 
 		oldSort = drawSurf->sort;
 
+		if ( oldInstanced && !instanced ) {
+			oldEntityNum = -1; // restore the entity matrix
+		}
+		oldInstanced = instanced;
+
 		//
 		// change the modelview matrix if needed
 		//
-		if ( entityNum != oldEntityNum ) {
+		if ( entityNum != oldEntityNum && merge ) {
+			backEnd.currentEntity = &backEnd.refdef.entities[entityNum];
+			R_RotateForEntity( backEnd.currentEntity, &backEnd.viewParms, &instanceOr );
+			oldEntityNum = entityNum;
+		} else if ( entityNum != oldEntityNum ) {
 			depthRange = isCrosshair = qfalse;
 
 			if ( entityNum != REFENTITYNUM_WORLD ) {
@@ -638,6 +865,11 @@ static void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 
 				// set up the transformation matrix
 				R_RotateForEntity( backEnd.currentEntity, &backEnd.viewParms, &backEnd.or );
+				if ( instanced ) {
+					// RB_SurfaceInstanced moves vertexes into world space
+					instanceOr = backEnd.or;
+					backEnd.or = backEnd.viewParms.world;
+				}
 				// set up the dynamic lighting if needed
 #ifdef USE_LEGACY_DLIGHTS
 #ifdef USE_PMLIGHT
@@ -726,12 +958,17 @@ static void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 		}
 
 		// add the triangles for this surface
-		rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
+		if ( instanced ) {
+			RB_SurfaceInstanced( (md3Surface_t *)drawSurf->surface, &instanceOr );
+		} else {
+			rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
+		}
 	}
 
 	// draw the contents of the last shader batch
 	if ( oldShader != NULL ) {
 		RB_EndSurface();
+		tess.instanced = qfalse;
 	}
 
 	backEnd.refdef.floatTime = originalTime;
@@ -957,6 +1194,8 @@ RB_SetGL2D
 void RB_SetGL2D( void ) {
 	backEnd.projection2D = qtrue;
 
+	RB_GpuTimer( GPU_TIMER_2D );
+
 	// set 2D virtual screen size
 	qglViewport( 0, 0, glConfig.vidWidth, glConfig.vidHeight );
 	qglScissor( 0, 0, glConfig.vidWidth, glConfig.vidHeight );
@@ -995,6 +1234,8 @@ void RE_StretchRaw( int x, int y, int w, int h, int cols, int rows, byte *data,
 		return;
 	}
 
+	R_SyncRenderThread();
+
 	start = 0;
 	if ( r_speeds->integer ) {
 		start = ri.Milliseconds();
@@ -1025,6 +1266,8 @@ void RE_UploadCinematic( int w, int h, int cols, int rows, byte *data, int clien
 
 	image_t *image;
 
+	R_SyncRenderThread();
+
 	if ( !tr.scratchImage[ client ] ) {
 		tr.scratchImage[ client ] = R_CreateImage( va( "*scratch%i", client ), NULL, data, cols, rows, IMGFLAG_CLAMPTOEDGE | IMGFLAG_RGB | IMGFLAG_NOSCALE );
 	}
@@ -1069,17 +1312,48 @@ static const void *RB_SetColor( const void *data ) {
 }
 
 
+/*
+==============================================================================
+
+2D BATCHING
+
+A run of stretch pic and set color commands is gathered and regrouped by
+shader before it is drawn. A pic is moved back into the last batch of its
+shader only if it doesn't overlap any batch of another shader that comes
+after it, so blending gives the same result as drawing in submission order.
+
+==============================================================================
+*/
+
+#define MAX_BATCH_PICS		1024
+#define MAX_PIC_BATCHES		64
+
+typedef struct {
+	const stretchPicCommand_t *cmd;
+	color4ub_t	color;
+	int			next;
+} batchPic_t;
+
+typedef struct {
+	shader_t	*shader;
+	float		mins[2];
+	float		maxs[2];
+	int			first;
+	int			last;
+} picBatch_t;
+
+static batchPic_t	batchPics[ MAX_BATCH_PICS ];
+static picBatch_t	picBatches[ MAX_PIC_BATCHES ];
+
+
 /*
 =============
-RB_StretchPic
+RB_StretchPicQuad
 =============
 */
-static const void *RB_StretchPic( const void *data ) {
-	const stretchPicCommand_t	*cmd;
+static void RB_StretchPicQuad( const stretchPicCommand_t *cmd, color4ub_t color ) {
 	shader_t *shader;
 
-	cmd = (const stretchPicCommand_t *)data;
-
 	shader = cmd->shader;
 	if ( shader != tess.shader ) {
 		if ( tess.numIndexes ) {
@@ -1102,9 +1376,96 @@ static const void *RB_StretchPic( const void *data ) {
 	R_BloomScreen();
 #endif
 
-	RB_AddQuadStamp2( cmd->x, cmd->y, cmd->w, cmd->h, cmd->s1, cmd->t1, cmd->s2, cmd->t2, backEnd.color2D );
+	RB_AddQuadStamp2( cmd->x, cmd->y, cmd->w, cmd->h, cmd->s1, cmd->t1, cmd->s2, cmd->t2, color );
+}
 
-	return (const void *)(cmd + 1);
+
+/*
+=============
+RB_StretchPic
+
+Consumes all stretch pic and set color commands that follow
+=============
+*/
+static const void *RB_StretchPic( const void *data ) {
+	const stretchPicCommand_t *cmd;
+	picBatch_t *batch;
+	float mins[2], maxs[2];
+	int numPics, numBatches;
+	int i, j;
+
+	numPics = 0;
+	numBatches = 0;
+
+	while ( numPics < MAX_BATCH_PICS ) {
+		data = PADP( data, sizeof( void * ) );
+		if ( *(const int *)data == RC_SET_COLOR ) {
+			data = RB_SetColor( data );
+			continue;
+		}
+		if ( *(const int *)data != RC_STRETCH_PIC ) {
+			break;
+		}
+
+		cmd = (const stretchPicCommand_t *)data;
+
+		mins[0] = MIN( cmd->x, cmd->x + cmd->w );
+		mins[1] = MIN( cmd->y, cmd->y + cmd->h );
+		maxs[0] = MAX( cmd->x, cmd->x + cmd->w );
+		maxs[1] = MAX( cmd->y, cmd->y + cmd->h );
+
+		// last batch with the same shader
+		for ( i = numBatches - 1; i >= 0; i-- ) {
+			if ( picBatches[ i ].shader == cmd->shader ) {
+				break;
+			}
+		}
+
+		// pic can't be drawn before anything it covers
+		for ( j = i + 1; i >= 0 && j < numBatches; j++ ) {
+			batch = &picBatches[ j ];
+			if ( mins[0] < batch->maxs[0] && maxs[0] > batch->mins[0] && mins[1] < batch->maxs[1] && maxs[1] > batch->mins[1] ) {
+				i = -1;
+			}
+		}
+
+		if ( i < 0 ) {
+			if ( numBatches == MAX_PIC_BATCHES ) {
+				break;
+			}
+			batch = &picBatches[ numBatches++ ];
+			batch->shader = cmd->shader;
+			batch->mins[0] = mins[0];
+			batch->mins[1] = mins[1];
+			batch->maxs[0] = maxs[0];
+			batch->maxs[1] = maxs[1];
+			batch->first = numPics;
+		} else {
+			batch = &picBatches[ i ];
+			batch->mins[0] = MIN( batch->mins[0], mins[0] );
+			batch->mins[1] = MIN( batch->mins[1], mins[1] );
+			batch->maxs[0] = MAX( batch->maxs[0], maxs[0] );
+			batch->maxs[1] = MAX( batch->maxs[1], maxs[1] );
+			batchPics[ batch->last ].next = numPics;
+		}
+
+		batch->last = numPics;
+
+		batchPics[ numPics ].cmd = cmd;
+		batchPics[ numPics ].color = backEnd.color2D;
+		batchPics[ numPics ].next = -1;
+		numPics++;
+
+		data = (const void *)(cmd + 1);
+	}
+
+	for ( i = 0; i < numBatches; i++ ) {
+		for ( j = picBatches[ i ].first; j >= 0; j = batchPics[ j ].next ) {
+			RB_StretchPicQuad( batchPics[ j ].cmd, batchPics[ j ].color );
+		}
+	}
+
+	return data;
 }
 
 
@@ -1120,6 +1481,8 @@ static void RB_LightingPass( void )
 	tess.allowVBO = qfalse; // for now
 #endif
 
+	RB_GpuTimer( GPU_TIMER_DLIGHT );
+
 	tess.dlightPass = qtrue;
 
 	for ( i = 0; i < backEnd.viewParms.num_dlights; i++ )
@@ -1135,6 +1498,7 @@ static void RB_LightingPass( void )
 	tess.dlightPass = qfalse;
 
 	backEnd.viewParms.num_dlights = 0;
+	RB_GpuTimer( backEnd.viewParms.portalView != PV_NONE ? GPU_TIMER_PORTAL : GPU_TIMER_WORLD );
 	GL_ProgramDisable();
 }
 #endif
@@ -1298,6 +1662,14 @@ static const void *RB_DrawBuffer( const void *data ) {
 
 	cmd = (const drawBufferCommand_t *)data;
 
+	// new frame, reset per-frame state here rather than in RE_BeginFrame
+	// so the front end doesn't touch it while the render thread runs
+	RB_GpuTimerBegin();
+
+	glState.finishCalled = qfalse;
+	backEnd.doneBloom = qfalse;
+	backEnd.color2D.u32 = ~0U;
+
 #ifdef USE_FBO
 	if ( fboEnabled ) {
 		FBO_BindMain();
@@ -1477,7 +1849,9 @@ static const void *RB_FinishBloom( const void *data )
 				if ( !backEnd.projection2D )
 					RB_SetGL2D();
 				qglColor4f( 1, 1, 1, 1 );
+				RB_GpuTimer( GPU_TIMER_BLOOM );
 				FBO_Bloom( 0, 0, qfalse );
+				RB_GpuTimer( GPU_TIMER_2D );
 			}
 		}
 	}
@@ -1516,14 +1890,18 @@ static const void *RB_SwapBuffers( const void *data ) {
 		qglFinish();
 	}
 
+	RB_GpuTimer( GPU_TIMER_POST );
+
 #ifdef USE_FBO
 	if ( fboEnabled ) {
 		FBO_PostProcess();
 	}
 #endif
 
+	RB_GpuTimerEnd();
+
 	// buffer swap may take undefined time to complete, we can't measure it in a reliable way
-	backEnd.pc.msec = ri.Milliseconds() - backEnd.pc.msec;
+	backEnd.pc.usec = (int)( ri.Microseconds() - backEnd.execStart );
 
 	if ( backEnd.screenshotMask && tr.frameCount > 1 ) {
 #ifdef USE_FBO
@@ -1561,6 +1939,10 @@ static const void *RB_SwapBuffers( const void *data ) {
 		backEnd.screenshotMask = 0;
 	}
 
+#ifdef USE_VBO
+	VBO_StreamEndFrame();
+#endif
+
 	ri.GLimp_EndFrame();
 
 #ifdef USE_FBO
@@ -1585,7 +1967,7 @@ RB_ExecuteRenderCommands
 */
 void RB_ExecuteRenderCommands( const void *data ) {
 
-	backEnd.pc.msec = ri.Milliseconds();
+	backEnd.execStart = ri.Microseconds();
 
 	while ( 1 ) {
 		data = PADP(data, sizeof(void *));
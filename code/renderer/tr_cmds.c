@@ -19,8 +19,208 @@ along with Quake III Arena source code; if not, write to the Free Software
 Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
+#include <setjmp.h>
 #include "tr_local.h"
 
+/*
+=============================================================
+
+GPU TIMERS
+
+The back end writes a timestamp whenever the active pass changes,
+results are read a few frames later without stalling and charged
+to the pass of every segment.
+
+=============================================================
+*/
+
+static const char *gpuTimerNames[ GPU_TIMER_COUNT ] = {
+	"world", "portal", "dlight", "2d", "bloom", "post"
+};
+
+static double	gpuFrame[ GPU_TIMER_COUNT ];	// last frame, milliseconds
+static double	gpuFrameTotal;
+static double	gpuSum[ GPU_TIMER_COUNT ];
+static double	gpuSumTotal;
+static double	gpuMaxTotal;
+static int		gpuFrames;
+static qboolean	gpuStatsActive;
+
+static frameStats_t	frameStats;
+static qboolean		frameStatsActive;
+
+
+/*
+=================
+R_GpuTimersActive
+
+Back end records timestamps while this is set
+=================
+*/
+qboolean R_GpuTimersActive( void )
+{
+	return ( r_speeds->integer == 8 || gpuStatsActive || frameStatsActive ) ? qtrue : qfalse;
+}
+
+
+/*
+=================
+R_GpuTimerFrame
+
+Called by the back end with results of a finished frame, timers[i]
+is the pass that ran between stamps[i] and stamps[i+1]
+=================
+*/
+void R_GpuTimerFrame( const byte *timers, const uint64_t *stamps, int count, float nsPerTick )
+{
+	int i;
+
+	if ( count < 2 ) {
+		return;
+	}
+
+	Com_Memset( gpuFrame, 0, sizeof( gpuFrame ) );
+
+	for ( i = 0; i < count - 1; i++ ) {
+		if ( stamps[i+1] <= stamps[i] || timers[i] >= GPU_TIMER_COUNT ) {
+			continue;
+		}
+		gpuFrame[ timers[i] ] += (double)( stamps[i+1] - stamps[i] ) * nsPerTick * 1e-6;
+	}
+
+	gpuFrameTotal = 0.0;
+	for ( i = 0; i < GPU_TIMER_COUNT; i++ ) {
+		gpuFrameTotal += gpuFrame[i];
+	}
+
+	if ( gpuStatsActive ) {
+		for ( i = 0; i < GPU_TIMER_COUNT; i++ ) {
+			gpuSum[i] += gpuFrame[i];
+		}
+		gpuSumTotal += gpuFrameTotal;
+		if ( gpuFrameTotal > gpuMaxTotal ) {
+			gpuMaxTotal = gpuFrameTotal;
+		}
+		gpuFrames++;
+	}
+}
+
+
+/*
+=================
+R_GpuTimerPrint
+=================
+*/
+static void R_GpuTimerPrint( const double *msec, double total, const char *suffix )
+{
+	char buf[ 256 ];
+	int i, len;
+
+	len = 0;
+	for ( i = 0; i < GPU_TIMER_COUNT; i++ ) {
+		Com_sprintf( buf + len, sizeof( buf ) - len, "%s %.2f  ", gpuTimerNames[i], msec[i] );
+		len += (int)strlen( buf + len );
+	}
+
+	ri.Printf( PRINT_ALL, "gpu ms: %stotal %.2f%s\n", buf, total, suffix );
+}
+
+
+/*
+=================
+R_GpuStats_f
+
+gpustats start|stop, prints per-pass averages since start
+=================
+*/
+void R_GpuStats_f( void )
+{
+	double avg[ GPU_TIMER_COUNT ];
+	const char *cmd;
+	char suffix[ 64 ];
+	int i;
+
+	cmd = ri.Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		R_SyncRenderThread();
+		Com_Memset( gpuSum, 0, sizeof( gpuSum ) );
+		gpuSumTotal = 0.0;
+		gpuMaxTotal = 0.0;
+		gpuFrames = 0;
+		gpuStatsActive = qtrue;
+		return;
+	}
+
+	if ( cmd[0] && Q_stricmp( cmd, "stop" ) ) {
+		ri.Printf( PRINT_ALL, "usage: gpustats [start|stop]\n" );
+		return;
+	}
+
+	if ( !gpuFrames ) {
+		ri.Printf( PRINT_ALL, "No GPU timings recorded%s.\n", gpuStatsActive ? " yet" : ", use \\gpustats start first" );
+	} else {
+		for ( i = 0; i < GPU_TIMER_COUNT; i++ ) {
+			avg[i] = gpuSum[i] / gpuFrames;
+		}
+		Com_sprintf( suffix, sizeof( suffix ), "  max %.2f  frames %i", gpuMaxTotal, gpuFrames );
+		R_GpuTimerPrint( avg, gpuSumTotal / gpuFrames, suffix );
+	}
+
+	if ( cmd[0] ) {
+		gpuStatsActive = qfalse;
+	}
+}
+
+
+/*
+=================
+R_UpdateFrameStats
+
+Called after the back end has finished the previous frame,
+before its counters are cleared
+=================
+*/
+static void R_UpdateFrameStats( void )
+{
+	if ( !frameStatsActive ) {
+		return;
+	}
+
+	frameStats.frontEndUsec = tr.frontEndUsec;
+	frameStats.backEndUsec = backEnd.pc.usec;
+	frameStats.gpuMsec = (float)gpuFrameTotal;
+	frameStats.surfaces = backEnd.pc.c_surfaces;
+	frameStats.shaders = backEnd.pc.c_shaders;
+	frameStats.pipelines = 0;
+}
+
+
+/*
+=================
+RE_GetFrameStats
+
+Returns counters of the last frame and keeps GPU timers running,
+NULL stops gathering
+=================
+*/
+void RE_GetFrameStats( frameStats_t *stats )
+{
+	if ( !stats ) {
+		frameStatsActive = qfalse;
+		return;
+	}
+
+	if ( !frameStatsActive ) {
+		Com_Memset( &frameStats, 0, sizeof( frameStats ) );
+		gpuFrameTotal = 0.0;
+		frameStatsActive = qtrue;
+	}
+
+	*stats = frameStats;
+}
+
+
 /*
 =====================
 R_PerformanceCounters
@@ -64,12 +264,420 @@ static void R_PerformanceCounters( void ) {
 		ri.Printf( PRINT_ALL, "flare adds:%i tests:%i renders:%i\n", 
 			backEnd.pc.c_flareAdds, backEnd.pc.c_flareTests, backEnd.pc.c_flareRenders );
 	}
+	else if (r_speeds->integer == 7 )
+	{
+		ri.Printf( PRINT_ALL, "occluders:%i occluded nodes:%i entities:%i\n",
+			tr.pc.c_occluders, tr.pc.c_occluded_nodes, tr.pc.c_occluded_ents );
+	}
+	else if (r_speeds->integer == 8 )
+	{
+		R_GpuTimerPrint( gpuFrame, gpuFrameTotal, "" );
+	}
 
 	Com_Memset( &tr.pc, 0, sizeof( tr.pc ) );
 	Com_Memset( &backEnd.pc, 0, sizeof( backEnd.pc ) );
 }
 
 
+/*
+=============================================================
+
+RENDER THREAD
+
+With r_smp the back end executes a finished command list on its own
+thread while the front end fills the other backEndData buffer.
+Main thread code that touches GPU objects or back end state must
+call R_SyncRenderThread() first.
+
+=============================================================
+*/
+
+#define SMP_PRINT_SIZE	16384
+#define SMP_MAX_CVARS	4
+
+typedef struct {
+	void		*thread;
+	void		*wakeSem;
+	void		*doneSem;
+	volatile int quit;
+
+	qboolean	pending;			// render thread owns the back end
+	const void	*commands;
+	qboolean	release;			// give GL context back to the main thread
+	qboolean	frontEndContext;	// GL context is current on the main thread
+	qboolean	backEndContext;
+	int			backEndUsec;
+	int			cinematics;			// video handles to run on the main thread
+
+	// render thread output, replayed on the main thread
+	jmp_buf		abortFrame;
+	qboolean	errorPending;
+	errorParm_t	errorCode;
+	char		errorText[ MAX_STRING_CHARS ];
+	char		printText[ SMP_PRINT_SIZE ];
+	int			printLength;
+	char		cvarName[ SMP_MAX_CVARS ][ MAX_QPATH ];
+	char		cvarValue[ SMP_MAX_CVARS ][ MAX_CVAR_VALUE_STRING ];
+	int			numCvars;
+
+	// original imports
+	void	(QDECL *Printf)( printParm_t printLevel, const char *fmt, ... );
+	void	NORETURN_PTR (QDECL *Error)( errorParm_t errorLevel, const char *fmt, ... );
+	void	(*Cvar_Set)( const char *name, const char *value );
+} renderThread_t;
+
+static renderThread_t smp;
+static THREAD_LOCAL qboolean renderThread;
+
+
+/*
+====================
+R_ThreadPrintf
+
+Buffers render thread prints, console is not thread-safe
+====================
+*/
+static void FORMAT_PRINTF(2, 3) QDECL R_ThreadPrintf( printParm_t printLevel, const char *fmt, ... ) {
+	char		text[ MAXPRINTMSG ];
+	va_list		argptr;
+	int			len;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !renderThread ) {
+		smp.Printf( printLevel, "%s", text );
+		return;
+	}
+
+	// level byte, text and terminator
+	len = (int)strlen( text ) + 2;
+	if ( smp.printLength + len > sizeof( smp.printText ) ) {
+		return;
+	}
+
+	smp.printText[ smp.printLength ] = (char)( printLevel + 1 );
+	strcpy( smp.printText + smp.printLength + 1, text );
+	smp.printLength += len;
+}
+
+
+/*
+====================
+R_ThreadError
+
+Aborts the render thread frame, error is raised on the main thread
+====================
+*/
+static void NORETURN FORMAT_PRINTF(2, 3) QDECL R_ThreadError( errorParm_t code, const char *fmt, ... ) {
+	char		text[ MAXPRINTMSG ];
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !renderThread ) {
+		smp.Error( code, "%s", text );
+	}
+
+	Q_strncpyz( smp.errorText, text, sizeof( smp.errorText ) );
+	smp.errorCode = code;
+	smp.errorPending = qtrue;
+
+	Q_longjmp( smp.abortFrame, 1 );
+}
+
+
+/*
+====================
+R_ThreadCvarSet
+====================
+*/
+static void R_ThreadCvarSet( const char *name, const char *value ) {
+
+	if ( !renderThread ) {
+		smp.Cvar_Set( name, value );
+		return;
+	}
+
+	if ( smp.numCvars < SMP_MAX_CVARS ) {
+		Q_strncpyz( smp.cvarName[ smp.numCvars ], name, sizeof( smp.cvarName[0] ) );
+		Q_strncpyz( smp.cvarValue[ smp.numCvars ], value, sizeof( smp.cvarValue[0] ) );
+		smp.numCvars++;
+	}
+}
+
+
+/*
+====================
+R_RenderThread
+====================
+*/
+static void R_RenderThread( void *arg ) {
+
+	renderThread = qtrue;
+
+	while ( 1 ) {
+		ri.Sys_WaitSemaphore( smp.wakeSem );
+		if ( smp.quit ) {
+			break;
+		}
+
+		if ( Q_setjmp( smp.abortFrame ) == 0 ) {
+			if ( smp.release ) {
+				if ( smp.backEndContext ) {
+					ri.GLimp_MakeCurrent( qfalse );
+					smp.backEndContext = qfalse;
+				}
+			} else {
+				if ( !smp.backEndContext ) {
+					ri.GLimp_MakeCurrent( qtrue );
+					smp.backEndContext = qtrue;
+				}
+				RB_ExecuteRenderCommands( smp.commands );
+				smp.backEndUsec = backEnd.pc.usec;
+				GL_CheckErrors();
+			}
+		}
+
+		ri.Sys_PostSemaphore( smp.doneSem, 1 );
+	}
+
+	if ( smp.backEndContext ) {
+		ri.GLimp_MakeCurrent( qfalse );
+		smp.backEndContext = qfalse;
+	}
+}
+
+
+/*
+====================
+R_FlushThreadOutput
+====================
+*/
+static void R_FlushThreadOutput( qboolean raiseError ) {
+	const char *s;
+	int i;
+
+	for ( s = smp.printText; s < smp.printText + smp.printLength; s += strlen( s ) + 1 ) {
+		smp.Printf( (printParm_t)( s[0] - 1 ), "%s", s + 1 );
+	}
+	smp.printLength = 0;
+
+	for ( i = 0; i < smp.numCvars; i++ ) {
+		smp.Cvar_Set( smp.cvarName[i], smp.cvarValue[i] );
+	}
+	smp.numCvars = 0;
+
+	if ( smp.errorPending ) {
+		smp.errorPending = qfalse;
+		if ( raiseError ) {
+			smp.Error( smp.errorCode, "%s", smp.errorText );
+		}
+	}
+}
+
+
+/*
+====================
+R_WaitRenderThread
+
+Waits until the render thread finishes its current job
+====================
+*/
+static void R_WaitRenderThread( void ) {
+
+	if ( !smp.pending ) {
+		return;
+	}
+
+	ri.Sys_WaitSemaphore( smp.doneSem );
+	smp.pending = qfalse;
+
+	R_FlushThreadOutput( qtrue );
+}
+
+
+/*
+====================
+R_WakeRenderThread
+====================
+*/
+static void R_WakeRenderThread( const void *commands, qboolean release ) {
+
+	smp.commands = commands;
+	smp.release = release;
+	smp.pending = qtrue;
+
+	ri.Sys_PostSemaphore( smp.wakeSem, 1 );
+}
+
+
+/*
+====================
+R_SyncRenderThread
+
+Waits for the back end and makes the GL context current on the main thread
+====================
+*/
+void R_SyncRenderThread( void ) {
+
+	if ( !smp.thread || renderThread ) {
+		return;
+	}
+
+	R_WaitRenderThread();
+
+	if ( !smp.frontEndContext ) {
+		R_WakeRenderThread( NULL, qtrue );
+		R_WaitRenderThread();
+		ri.GLimp_MakeCurrent( qtrue );
+		smp.frontEndContext = qtrue;
+	}
+}
+
+
+/*
+====================
+R_DeferCinematic
+
+Video maps are decoded and uploaded by the main thread before the
+next frame starts, render thread draws the previous video frame
+====================
+*/
+qboolean R_DeferCinematic( int handle ) {
+
+	if ( !renderThread ) {
+		return qfalse;
+	}
+
+	if ( (unsigned)handle < ARRAY_LEN( tr.scratchImage ) && tr.scratchImage[ handle ] ) {
+		GL_Bind( tr.scratchImage[ handle ] );
+	} else {
+		GL_Bind( tr.whiteImage );
+	}
+
+	if ( (unsigned)handle < ARRAY_LEN( tr.scratchImage ) ) {
+		smp.cinematics |= 1 << handle;
+	}
+
+	return qtrue;
+}
+
+
+/*
+====================
+R_RunCinematics
+====================
+*/
+static void R_RunCinematics( void ) {
+	int handle, mask;
+
+	mask = smp.cinematics;
+	smp.cinematics = 0;
+
+	R_SyncRenderThread();
+
+	for ( handle = 0; mask; handle++, mask >>= 1 ) {
+		if ( mask & 1 ) {
+			ri.CIN_RunCinematic( handle );
+			ri.CIN_UploadCinematic( handle );
+		}
+	}
+}
+
+
+/*
+====================
+R_InitRenderThread
+====================
+*/
+void R_InitRenderThread( void ) {
+
+	if ( smp.thread || !ri.GLimp_MakeCurrent ) {
+		return;
+	}
+
+	Com_Memset( &smp, 0, sizeof( smp ) );
+
+	smp.wakeSem = ri.Sys_CreateSemaphore();
+	smp.doneSem = ri.Sys_CreateSemaphore();
+
+	if ( smp.wakeSem && smp.doneSem ) {
+		smp.Printf = ri.Printf;
+		smp.Error = ri.Error;
+		smp.Cvar_Set = ri.Cvar_Set;
+
+		ri.Printf = R_ThreadPrintf;
+		ri.Error = R_ThreadError;
+		ri.Cvar_Set = R_ThreadCvarSet;
+
+		smp.frontEndContext = qtrue;
+		smp.thread = ri.Sys_CreateThread( R_RenderThread, NULL );
+	}
+
+	if ( !smp.thread ) {
+		if ( smp.Printf ) {
+			ri.Printf = smp.Printf;
+			ri.Error = smp.Error;
+			ri.Cvar_Set = smp.Cvar_Set;
+		}
+		if ( smp.wakeSem )
+			ri.Sys_DestroySemaphore( smp.wakeSem );
+		if ( smp.doneSem )
+			ri.Sys_DestroySemaphore( smp.doneSem );
+		Com_Memset( &smp, 0, sizeof( smp ) );
+		ri.Printf( PRINT_WARNING, "...failed to start render thread\n" );
+		return;
+	}
+
+	glConfig.smpActive = qtrue;
+
+	ri.Printf( PRINT_ALL, "...render thread started\n" );
+}
+
+
+/*
+====================
+R_ShutdownRenderThread
+====================
+*/
+void R_ShutdownRenderThread( void ) {
+
+	if ( !smp.thread ) {
+		return;
+	}
+
+	// errors of the last frame are dropped, we are shutting down anyway
+	if ( smp.pending ) {
+		ri.Sys_WaitSemaphore( smp.doneSem );
+		smp.pending = qfalse;
+	}
+	R_FlushThreadOutput( qfalse );
+
+	smp.quit = 1;
+	ri.Sys_PostSemaphore( smp.wakeSem, 1 );
+	ri.Sys_JoinThread( smp.thread );
+
+	if ( !smp.frontEndContext ) {
+		ri.GLimp_MakeCurrent( qtrue );
+	}
+
+	ri.Sys_DestroySemaphore( smp.wakeSem );
+	ri.Sys_DestroySemaphore( smp.doneSem );
+
+	ri.Printf = smp.Printf;
+	ri.Error = smp.Error;
+	ri.Cvar_Set = smp.Cvar_Set;
+
+	Com_Memset( &smp, 0, sizeof( smp ) );
+
+	glConfig.smpActive = qfalse;
+}
+
+
 /*
 ====================
 R_IssueRenderCommands
@@ -95,8 +703,29 @@ static void R_IssueRenderCommands( void ) {
 
 	// actually start the commands going
 	if ( !r_skipBackEnd->integer ) {
-		// let it start on the new batch
-		RB_ExecuteRenderCommands( cmdList->cmds );
+		if ( smp.thread ) {
+			qboolean screenshot = backEnd.screenshotMask != 0;
+
+			R_WaitRenderThread();
+
+			if ( smp.cinematics ) {
+				R_RunCinematics();
+			}
+			if ( smp.frontEndContext ) {
+				ri.GLimp_MakeCurrent( qfalse );
+				smp.frontEndContext = qfalse;
+			}
+			// let it start on the new batch
+			R_WakeRenderThread( cmdList->cmds, qfalse );
+
+			// screenshots use temp hunk memory and the file system
+			if ( screenshot ) {
+				R_WaitRenderThread();
+			}
+		} else {
+			// let it start on the new batch
+			RB_ExecuteRenderCommands( cmdList->cmds );
+		}
 	}
 }
 
@@ -112,7 +741,9 @@ void R_IssuePendingRenderCommands( void ) {
 	if ( !tr.registered ) {
 		return;
 	}
+	R_SyncRenderThread();
 	R_IssueRenderCommands();
+	R_SyncRenderThread();
 }
 
 
@@ -295,17 +926,13 @@ void RE_BeginFrame( stereoFrame_t stereoFrame ) {
 		return;
 	}
 
-	glState.finishCalled = qfalse;
-
 	tr.frameCount++;
 	tr.frameSceneNum = 0;
 
-	backEnd.doneBloom = qfalse;
-
-	backEnd.color2D.u32 = ~0U;
-
-	// check for errors
-	GL_CheckErrors();
+	// check for errors, render thread does it after each frame
+	if ( !smp.thread ) {
+		GL_CheckErrors();
+	}
 
 	if ( ( cmd = R_GetCommandBuffer( sizeof( *cmd ) ) ) == NULL )
 		return;
@@ -429,6 +1056,11 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 	}
 	cmd->commandId = RC_SWAP_BUFFERS;
 
+	// back end counters of the previous frame
+	R_WaitRenderThread();
+
+	R_UpdateFrameStats();
+
 	R_PerformanceCounters();
 
 	R_IssueRenderCommands();
@@ -436,18 +1068,27 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 	R_InitNextFrame();
 
 	if ( frontEndMsec ) {
-		*frontEndMsec = tr.frontEndMsec;
+		*frontEndMsec = tr.frontEndUsec / 1000;
 	}
-	tr.frontEndMsec = 0;
-	if ( backEndMsec ) {
-		*backEndMsec = backEnd.pc.msec;
+	tr.frontEndUsec = 0;
+	if ( smp.thread ) {
+		// this frame is still running
+		if ( backEndMsec ) {
+			*backEndMsec = smp.backEndUsec / 1000;
+		}
+	} else {
+		// kept until R_UpdateFrameStats() of the next frame, R_PerformanceCounters() clears it
+		if ( backEndMsec ) {
+			*backEndMsec = backEnd.pc.usec / 1000;
+		}
 	}
-	backEnd.pc.msec = 0;
 	backEnd.throttle = qfalse;
 
 	// recompile GPU shaders if needed
 	if ( ri.Cvar_CheckGroup( CVG_RENDERER ) )
 	{
+		R_SyncRenderThread();
+
 		ARB_UpdatePrograms();
 
 #ifdef USE_FBO
@@ -480,6 +1121,8 @@ void RE_TakeVideoFrame( int width, int height,
 		return;
 	}
 
+	R_SyncRenderThread();
+
 	backEnd.screenshotMask |= SCREENSHOT_AVI;
 
 	cmd = &backEnd.vcmd;
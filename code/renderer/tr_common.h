@@ -27,6 +27,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define MAX_TEXTURE_UNITS 8
 
+#define MAX_GPU_TIMESTAMPS 32	// per frame, see gpuTimer_t
+
 typedef enum
 {
 	IMGFLAG_NONE           = 0x0000,
@@ -97,7 +99,35 @@ extern	cvar_t	*r_saveFontData;
 float R_NoiseGet4f( float x, float y, float z, double t );
 void  R_NoiseInit( void );
 
+// software occlusion buffer
+void R_OcclusionClear( const float *modelMatrix, const float *projectionMatrix );
+void R_OcclusionAddTriangle( const vec3_t a, const vec3_t b, const vec3_t c );
+void R_OcclusionBuild( void );
+qboolean R_OcclusionTestBounds( const vec3_t mins, const vec3_t maxs );
+
+#if idx64
+// SSE2 image processing kernels, bit-exact with scalar code
+#define USE_SIMD_IMAGE
+void R_ResampleRowSSE2( unsigned *out, const unsigned *inrow, const unsigned *inrow2, const unsigned *p1, const unsigned *p2, int count );
+void R_MipMapRowSSE2( byte *out, const byte *in, const byte *in2, int count );
+void R_MipMap2SpanSSE2( unsigned *out, const unsigned *row0, const unsigned *row1, const unsigned *row2, const unsigned *row3, int count );
+void R_BlendOverTextureSSE2( byte *data, int pixelCount, int inverseAlpha, const int *premult );
+
+// SSE2 texcoord and deform kernels, bit-exact with scalar code
+#define USE_SIMD_SHADE
+void R_TransformTexCoordsSSE2( const float *src, float *dst, int count, const float matrix[2][2], const float translate[2] );
+void R_ScaleTexCoordsSSE2( const float *src, float *dst, int count, const float scale[2] );
+void R_ScrollTexCoordsSSE2( const float *src, float *dst, int count, double scrollS, double scrollT );
+void R_EnvironmentTexCoordsSSE2( const float *xyz, const float *normal, float *st, int count, const vec3_t viewOrigin );
+void R_DeformVertexesSSE2( float *xyz, const float *normal, int count, float scale );
+void R_TriangleFacingSSE2( const float *xyz, const uint32_t *indexes, int numTris, const vec3_t lightDir, int *facing );
+void R_ClassifyTriangleSSE2( const vec3_t points[3], const float *planes, int numGroups, float epsilon, byte *front, byte *back );
+void R_BlendLightGridSSE2( const float *samples, const float *factors, int validMask, float *out );
+#endif
+
 image_t *R_FindImageFile( const char *name, imgFlags_t flags );
+const char *R_LoadImage( const char *name, byte **pic, int *width, int *height );
+void R_PrefetchImages( char (*names)[ MAX_QPATH ], int count );
 image_t *R_CreateImage( const char *name, const char *name2, byte *pic, int width, int height, imgFlags_t flags );
 void R_UploadSubImage( byte *data, int x, int y, int width, int height, image_t *image );
 
@@ -106,6 +136,7 @@ qhandle_t RE_RegisterShaderLightMap( const char *name, int lightmapIndex );
 qhandle_t RE_RegisterShader( const char *name );
 qhandle_t RE_RegisterShaderNoMip( const char *name );
 qhandle_t RE_RegisterShaderFromImage(const char *name, int lightmapIndex, image_t *image, qboolean mipRawImage);
+qhandle_t RE_RegisterFontAtlas( const char *name, const qhandle_t *pages, int numPages, int *columns );
 
 // font stuff
 void R_InitFreeType( void );
@@ -126,6 +157,11 @@ void R_LoadPCX( const char *name, byte **pic, int *width, int *height );
 void R_LoadPNG( const char *name, byte **pic, int *width, int *height );
 void R_LoadTGA( const char *name, byte **pic, int *width, int *height );
 
+// level load image prefetching
+#define MAX_PREFETCH_IMAGES 1024
+void R_PrefetchTGA( const char **names, int count );
+void R_FreePrefetchedImages( void );
+
 /*
 ====================================================================
 
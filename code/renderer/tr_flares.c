@@ -40,6 +40,10 @@ After all opaque surfaces have been rendered, the depth buffer is read back for
 each flare in view.  If the point has not been obscured by a closer surface, the
 flare should be drawn.
 
+With occlusion queries a depth tested dot is drawn for each flare instead and
+its sample count is read a frame or more later, when the result is available,
+so the pipeline never stalls.
+
 Surfaces that have a repeated texture should never be flagged as flaring, because
 there will only be a single flare added at the midpoint of the polygon.
 
@@ -61,6 +65,10 @@ typedef struct flare_s {
 	struct		flare_s	*next;		// for active chain
 
 	int			addedFrame;
+	uint32_t	testCount;			// occlusion results read for this surface
+
+	qboolean	queryPending;		// query issued but not read yet
+	qboolean	queryStale;			// pending query was issued for an older surface
 
 	portalView_t portalView;
 	int			frameSceneNum;
@@ -85,14 +93,22 @@ typedef struct flare_s {
 flare_t		r_flareStructs[MAX_FLARES];
 flare_t		*r_activeFlares, *r_inactiveFlares;
 
+static GLuint	r_flareQueries[MAX_FLARES];
+static qboolean	r_flareQueriesInited;
+
 /*
 ==================
 R_ClearFlares
 ==================
 */
 void R_ClearFlares( void ) {
+	qboolean	pending[MAX_FLARES];
 	int		i;
 
+	for ( i = 0 ; i < MAX_FLARES ; i++ ) {
+		pending[i] = r_flareStructs[i].queryPending;
+	}
+
 	Com_Memset( r_flareStructs, 0, sizeof( r_flareStructs ) );
 	r_activeFlares = NULL;
 	r_inactiveFlares = NULL;
@@ -101,6 +117,29 @@ void R_ClearFlares( void ) {
 		r_flareStructs[i].next = r_inactiveFlares;
 		r_inactiveFlares = &r_flareStructs[i];
 	}
+
+	// results of queries in flight will be dropped
+	for ( i = 0 ; i < MAX_FLARES ; i++ ) {
+		r_flareStructs[i].queryPending = pending[i];
+		r_flareStructs[i].queryStale = pending[i];
+	}
+}
+
+
+/*
+==================
+R_ShutdownFlares
+==================
+*/
+void R_ShutdownFlares( void ) {
+	if ( r_flareQueriesInited ) {
+		qglDeleteQueries( MAX_FLARES, r_flareQueries );
+		r_flareQueriesInited = qfalse;
+	}
+
+	Com_Memset( r_flareStructs, 0, sizeof( r_flareStructs ) );
+	r_activeFlares = NULL;
+	r_inactiveFlares = NULL;
 }
 
 
@@ -178,6 +217,8 @@ void RB_AddFlare( void *surface, int fogNum, vec3_t point, vec3_t color, vec3_t
 	if ( f->addedFrame != backEnd.viewParms.frameCount - 1 ) {
 		f->visible = qfalse;
 		f->fadeTime = backEnd.refdef.time - 2000;
+		f->testCount = 0;
+		f->queryStale = f->queryPending;
 	}
 
 	f->addedFrame = backEnd.viewParms.frameCount;
@@ -257,6 +298,101 @@ FLARE BACK END
 ===============================================================================
 */
 
+/*
+==================
+RB_BeginFlareQueries
+
+Sets up projection where window z maps to depth
+==================
+*/
+static void RB_BeginFlareQueries( GLboolean *rgba ) {
+
+	if ( !r_flareQueriesInited ) {
+		qglGenQueries( MAX_FLARES, r_flareQueries );
+		r_flareQueriesInited = qtrue;
+	}
+
+	if ( backEnd.viewParms.portalView != PV_NONE ) {
+		qglDisable( GL_CLIP_PLANE0 );
+	}
+
+	qglPushMatrix();
+	qglLoadIdentity();
+	qglMatrixMode( GL_PROJECTION );
+	qglPushMatrix();
+	qglLoadMatrixf( GL_Ortho( backEnd.viewParms.viewportX, backEnd.viewParms.viewportX + backEnd.viewParms.viewportWidth,
+		backEnd.viewParms.viewportY, backEnd.viewParms.viewportY + backEnd.viewParms.viewportHeight, 0, 1 ) );
+
+	GL_ClientState( 0, CLS_NONE );
+
+	// depth test without writes
+	GL_State( 0 );
+	qglGetBooleanv( GL_COLOR_WRITEMASK, rgba );
+	qglColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+}
+
+
+/*
+==================
+RB_EndFlareQueries
+==================
+*/
+static void RB_EndFlareQueries( const GLboolean *rgba ) {
+	qglColorMask( rgba[0], rgba[1], rgba[2], rgba[3] );
+
+	qglPopMatrix();
+	qglMatrixMode( GL_MODELVIEW );
+	qglPopMatrix();
+}
+
+
+/*
+==================
+RB_QueryFlare
+
+Returns visibility from the latest available query result
+and issues a new query when the previous one has been read
+==================
+*/
+static qboolean RB_QueryFlare( flare_t *f ) {
+	const GLuint query = r_flareQueries[ f - r_flareStructs ];
+	qboolean visible;
+	GLuint samples;
+	GLint available;
+	vec3_t dot;
+
+	visible = f->visible;
+
+	if ( f->queryPending ) {
+		qglGetQueryObjectiv( query, GL_QUERY_RESULT_AVAILABLE, &available );
+		if ( !available ) {
+			return visible;
+		}
+		qglGetQueryObjectuiv( query, GL_QUERY_RESULT, &samples );
+		if ( !f->queryStale ) {
+			visible = ( samples != 0 );
+			f->testCount++;
+		}
+		f->queryPending = qfalse;
+		f->queryStale = qfalse;
+	}
+
+	dot[0] = f->windowX;
+	dot[1] = f->windowY;
+	dot[2] = -f->drawZ;
+
+	qglVertexPointer( 3, GL_FLOAT, 0, dot );
+
+	qglBeginQuery( GL_SAMPLES_PASSED, query );
+	qglDrawArrays( GL_POINTS, 0, 1 );
+	qglEndQuery( GL_SAMPLES_PASSED );
+
+	f->queryPending = qtrue;
+
+	return visible;
+}
+
+
 /*
 ==================
 RB_TestFlare
@@ -269,13 +405,19 @@ static void RB_TestFlare( flare_t *f ) {
 
 	backEnd.pc.c_flareTests++;
 
-	// doing a readpixels is as good as doing a glFinish(), so
-	// don't bother with another sync
-	glState.finishCalled = qfalse;
+	if ( qglBeginQuery ) {
+		visible = RB_QueryFlare( f );
+	} else {
+		// doing a readpixels is as good as doing a glFinish(), so
+		// don't bother with another sync
+		glState.finishCalled = qfalse;
+
+		// read back the z buffer contents
+		qglReadPixels( f->windowX, f->windowY, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth );
+		visible = (depth > f->drawZ);
+		f->testCount = 1;
+	}
 
-	// read back the z buffer contents
-	qglReadPixels( f->windowX, f->windowY, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth );
-	visible = (depth > f->drawZ);
 	if ( visible ) {
 		if ( !f->visible ) {
 			f->visible = qtrue;
@@ -398,6 +540,7 @@ void RB_RenderFlares (void) {
 	flare_t		*f;
 	flare_t		**prev;
 	qboolean	draw;
+	GLboolean	rgba[4];
 
 	if ( !r_flares->integer ) {
 		return;
@@ -412,9 +555,12 @@ void RB_RenderFlares (void) {
 	backEnd.currentEntity = &tr.worldEntity;
 	backEnd.or = backEnd.viewParms.world;
 
+	if ( qglBeginQuery ) {
+		RB_BeginFlareQueries( rgba );
+	}
 #ifdef USE_FBO
 	// we can't read from multisampled renderbuffer storage
-	if ( blitMSfbo ) {
+	else if ( blitMSfbo ) {
 		FBO_BlitMS( qtrue );
 	}
 #endif
@@ -437,7 +583,9 @@ void RB_RenderFlares (void) {
 		f->drawIntensity = 0;
 		if ( f->frameSceneNum == backEnd.viewParms.frameSceneNum && f->portalView == backEnd.viewParms.portalView ) {
 			RB_TestFlare( f );
-			if ( f->drawIntensity ) {
+			if ( f->testCount == 0 ) {
+				// recently added, wait for the first query result
+			} else if ( f->drawIntensity ) {
 				draw = qtrue;
 			} else {
 				// this flare has completely faded out, so remove it from the chain
@@ -451,9 +599,12 @@ void RB_RenderFlares (void) {
 		prev = &f->next;
 	}
 
+	if ( qglBeginQuery ) {
+		RB_EndFlareQueries( rgba );
+	}
 #ifdef USE_FBO
 	// bind primary framebuffer again
-	if ( blitMSfbo ) {
+	else if ( blitMSfbo ) {
 		FBO_BindMain();
 	}
 #endif
@@ -79,6 +79,8 @@ cvar_t	*r_dlightSaturation;
 
 #ifdef USE_VBO
 cvar_t	*r_vbo;
+cvar_t	*r_vboStream;
+cvar_t	*r_glsl;
 #endif
 
 #ifdef USE_FBO
@@ -102,6 +104,7 @@ cvar_t	*r_renderScale;
 cvar_t	*r_dlightBacks;
 
 cvar_t	*r_lodbias;
+cvar_t	*r_modelCache;
 cvar_t	*r_lodscale;
 
 cvar_t	*r_norefresh;
@@ -111,6 +114,8 @@ cvar_t	*r_speeds;
 cvar_t	*r_fullbright;
 cvar_t	*r_novis;
 cvar_t	*r_nocull;
+cvar_t	*r_instancing;
+cvar_t	*r_occlusion;
 cvar_t	*r_facePlaneCull;
 cvar_t	*r_showcluster;
 cvar_t	*r_nocurves;
@@ -148,6 +153,7 @@ cvar_t	*r_picmip;
 cvar_t	*r_nomip;
 cvar_t	*r_showtris;
 cvar_t	*r_showsky;
+cvar_t	*r_fullSky;
 cvar_t	*r_shownormals;
 cvar_t	*r_finish;
 cvar_t	*r_clear;
@@ -161,11 +167,13 @@ cvar_t	*r_noportals;
 cvar_t	*r_portalOnly;
 
 cvar_t	*r_subdivisions;
+cvar_t	*r_patchCache;
 cvar_t	*r_lodCurveError;
 
 cvar_t	*r_overBrightBits;
 cvar_t	*r_mapOverBrightBits;
 cvar_t	*r_mapGreyScale;
+cvar_t	*r_imagePrefetch;
 
 cvar_t	*r_debugSurface;
 cvar_t	*r_simpleMipMaps;
@@ -182,11 +190,11 @@ cvar_t	*r_saveFontData;
 
 cvar_t	*r_marksOnTriangleMeshes;
 
-cvar_t	*r_aviMotionJpegQuality;
 cvar_t	*r_screenshotJpegQuality;
 
 static cvar_t *r_maxpolys;
 static cvar_t* r_maxpolyverts;
+static cvar_t* r_smp;
 int		max_polys;
 int		max_polyverts;
 
@@ -197,8 +205,14 @@ static char gl_extensions[ 32768 ];
 	QGL_Ext_PROCS;
 	QGL_ARB_PROGRAM_PROCS;
 	QGL_VBO_PROCS;
+	QGL_PBO_PROCS;
+	QGL_MULTIDRAW_PROCS;
+	QGL_STREAM_PROCS;
 	QGL_FBO_PROCS;
 	QGL_FBO_OPT_PROCS;
+	QGL_QUERY_PROCS;
+	QGL_GLSL_PROCS;
+	QGL_TIMER_PROCS;
 #undef GLE
 
 typedef struct {
@@ -211,8 +225,14 @@ static sym_t core_procs[] = { QGL_Core_PROCS };
 static sym_t ext_procs[] = { QGL_Ext_PROCS };
 static sym_t arb_procs[] = { QGL_ARB_PROGRAM_PROCS };
 static sym_t vbo_procs[] = { QGL_VBO_PROCS };
+static sym_t pbo_procs[] = { QGL_PBO_PROCS };
+static sym_t multidraw_procs[] = { QGL_MULTIDRAW_PROCS };
+static sym_t stream_procs[] = { QGL_STREAM_PROCS };
 static sym_t fbo_procs[] = { QGL_FBO_PROCS };
 static sym_t fbo_opt_procs[] = { QGL_FBO_OPT_PROCS };
+static sym_t query_procs[] = { QGL_QUERY_PROCS };
+static sym_t glsl_procs[] = { QGL_GLSL_PROCS };
+static sym_t timer_procs[] = { QGL_TIMER_PROCS };
 #undef GLE
 
 
@@ -254,8 +274,14 @@ static void R_ClearSymTables( void )
 	R_ClearSymbols( ext_procs, ARRAY_LEN( ext_procs ) );
 	R_ClearSymbols( arb_procs, ARRAY_LEN( arb_procs ) );
 	R_ClearSymbols( vbo_procs, ARRAY_LEN( vbo_procs ) );
+	R_ClearSymbols( pbo_procs, ARRAY_LEN( pbo_procs ) );
+	R_ClearSymbols( multidraw_procs, ARRAY_LEN( multidraw_procs ) );
+	R_ClearSymbols( stream_procs, ARRAY_LEN( stream_procs ) );
 	R_ClearSymbols( fbo_procs, ARRAY_LEN( fbo_procs ) );
 	R_ClearSymbols( fbo_opt_procs, ARRAY_LEN( fbo_opt_procs ) );
+	R_ClearSymbols( query_procs, ARRAY_LEN( query_procs ) );
+	R_ClearSymbols( glsl_procs, ARRAY_LEN( glsl_procs ) );
+	R_ClearSymbols( timer_procs, ARRAY_LEN( timer_procs ) );
 }
 
 
@@ -538,8 +564,41 @@ static void R_InitExtensions( void )
 			ri.Printf( PRINT_ALL, "...using ARB vertex buffer objects\n" );
 		}
 	}
+
+	if ( qglBindBufferARB && gl_version >= 14 )
+	{
+		err = R_ResolveSymbols( multidraw_procs, ARRAY_LEN( multidraw_procs ) );
+		if ( err )
+		{
+			qglMultiDrawElements = NULL; // indicates presence of multi-draw
+		}
+	}
+
+	if ( qglBindBufferARB && R_HaveExtension( "GL_ARB_buffer_storage" ) && ( gl_version >= 32 || R_HaveExtension( "GL_ARB_sync" ) ) )
+	{
+		err = R_ResolveSymbols( stream_procs, ARRAY_LEN( stream_procs ) );
+		if ( err )
+		{
+			ri.Printf( PRINT_WARNING, "Error resolving buffer storage function '%s'\n", err );
+			qglBufferStorage = NULL; // indicates presence of persistently mapped buffers
+		}
+		else
+		{
+			ri.Printf( PRINT_ALL, "...using persistently mapped buffers\n" );
+		}
+	}
 #endif // USE_VBO
 
+	if ( R_HaveExtension( "GL_ARB_pixel_buffer_object" ) && qglBindBufferARB )
+	{
+		err = R_ResolveSymbols( pbo_procs, ARRAY_LEN( pbo_procs ) );
+		if ( err )
+		{
+			ri.Printf( PRINT_WARNING, "Error resolving PBO function '%s'\n", err );
+			qglMapBufferARB = NULL; // indicates presence of pixel buffer objects
+		}
+	}
+
 #ifdef USE_FBO
 	if ( R_HaveExtension( "GL_EXT_framebuffer_object" ) && R_HaveExtension( "GL_EXT_framebuffer_blit" ) )
 	{
@@ -556,6 +615,41 @@ static void R_InitExtensions( void )
 		}
 	}
 #endif // USE_FBO
+
+	if ( R_HaveExtension( "GL_ARB_occlusion_query" ) )
+	{
+		err = R_ResolveSymbols( query_procs, ARRAY_LEN( query_procs ) );
+		if ( err )
+		{
+			ri.Printf( PRINT_WARNING, "Error resolving occlusion query function '%s'\n", err );
+			qglBeginQuery = NULL; // indicates presence of occlusion queries
+		}
+	}
+
+	// core 2.0 entry points, no fallback to the ARB_shader_objects names
+	if ( gl_version >= 20 && R_HaveExtension( "GL_ARB_shading_language_100" ) )
+	{
+		err = R_ResolveSymbols( glsl_procs, ARRAY_LEN( glsl_procs ) );
+		if ( err )
+		{
+			ri.Printf( PRINT_WARNING, "Error resolving GLSL function '%s'\n", err );
+			qglCreateProgram = NULL; // indicates presence of GLSL functionality
+		}
+		else
+		{
+			ri.Printf( PRINT_ALL, "...GLSL programs available\n" );
+		}
+	}
+
+	if ( qglBeginQuery && R_HaveExtension( "GL_ARB_timer_query" ) )
+	{
+		err = R_ResolveSymbols( timer_procs, ARRAY_LEN( timer_procs ) );
+		if ( err )
+		{
+			ri.Printf( PRINT_WARNING, "Error resolving timer query function '%s'\n", err );
+			qglQueryCounter = NULL; // indicates presence of timer queries
+		}
+	}
 }
 
 
@@ -1108,6 +1202,8 @@ static void R_ScreenShot_f( void ) {
 		return;
 	}
 
+	R_SyncRenderThread();
+
 	if ( !strcmp( ri.Cmd_Argv(1), "levelshot" ) ) {
 		R_LevelShot();
 		return;
@@ -1167,6 +1263,179 @@ static void R_ScreenShot_f( void ) {
 
 //============================================================================
 
+/*
+==============================================================================
+
+VIDEO FRAME READBACK
+
+Frames are read into a ring of pixel pack buffers and mapped one frame
+later when the transfer is done, so capture doesn't stall the pipeline.
+Every frame is delivered one frame late, except for the last one of a
+capture which is dropped, so video frames stay in sync with audio.
+
+Conversion for the encoder is split between job threads.
+
+==============================================================================
+*/
+
+#define VIDEO_READBACK_FRAMES	2
+#define VIDEO_JOB_BLOCKS		8
+
+typedef struct {
+	GLuint		buffer;
+	int			size;
+	int			width;
+	int			height;
+	int			frameCount;		// tr.frameCount at the time of read, 0 if empty
+} videoReadback_t;
+
+typedef struct {
+	const byte	*src;			// rows as read back, bottom-up
+	byte		*dst;
+	int			srcPitch;
+	int			dstPitch;
+	int			linelen;
+	int			height;
+	qboolean	swap;			// RGB to BGR
+} videoJob_t;
+
+static videoReadback_t	videoReadback[ VIDEO_READBACK_FRAMES ];
+static int				videoReadbackIndex;
+static qboolean			videoReadbackMapped;
+
+
+/*
+==================
+RB_MapVideoPixels
+
+Returns pixels of the oldest frame in the ring and queues read of the
+current one, NULL if there is no frame to deliver yet
+==================
+*/
+static const byte *RB_MapVideoPixels( byte *buffer, int width, int height, int size )
+{
+	videoReadback_t *rb;
+	const byte *data;
+
+	if ( !qglMapBufferARB ) {
+		qglReadPixels( 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, buffer );
+		return buffer;
+	}
+
+	rb = &videoReadback[ videoReadbackIndex ];
+	if ( !rb->buffer ) {
+		qglGenBuffersARB( 1, &rb->buffer );
+	}
+
+	qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, rb->buffer );
+	if ( rb->size != size ) {
+		qglBufferDataARB( GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ_ARB );
+		rb->size = size;
+	}
+
+	qglReadPixels( 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL );
+	rb->width = width;
+	rb->height = height;
+	rb->frameCount = tr.frameCount;
+
+	videoReadbackIndex = ( videoReadbackIndex + 1 ) % VIDEO_READBACK_FRAMES;
+	rb = &videoReadback[ videoReadbackIndex ];
+
+	// must be a previous frame of the same capture
+	if ( !rb->frameCount || rb->frameCount != tr.frameCount - ( VIDEO_READBACK_FRAMES - 1 ) || rb->width != width || rb->height != height ) {
+		qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+		return NULL;
+	}
+
+	rb->frameCount = 0;
+
+	qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, rb->buffer );
+	data = qglMapBufferARB( GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB );
+	if ( !data ) {
+		qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+		return NULL;
+	}
+
+	videoReadbackMapped = qtrue;
+
+	return data;
+}
+
+
+/*
+==================
+RB_UnmapVideoPixels
+==================
+*/
+static void RB_UnmapVideoPixels( void )
+{
+	if ( videoReadbackMapped ) {
+		qglUnmapBufferARB( GL_PIXEL_PACK_BUFFER_ARB );
+		qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+		videoReadbackMapped = qfalse;
+	}
+}
+
+
+/*
+==================
+RB_ShutdownVideoReadback
+==================
+*/
+static void RB_ShutdownVideoReadback( void )
+{
+	int i;
+
+	for ( i = 0; i < VIDEO_READBACK_FRAMES; i++ ) {
+		if ( videoReadback[i].buffer ) {
+			qglDeleteBuffersARB( 1, &videoReadback[i].buffer );
+		}
+	}
+
+	Com_Memset( videoReadback, 0, sizeof( videoReadback ) );
+	videoReadbackIndex = 0;
+	videoReadbackMapped = qfalse;
+}
+
+
+/*
+==================
+RB_VideoFrameJob
+
+Converts a block of rows for the encoder, called from job threads
+==================
+*/
+static void RB_VideoFrameJob( void *data, int block )
+{
+	const videoJob_t *job = (const videoJob_t *)data;
+	const int blockSize = ( job->height + VIDEO_JOB_BLOCKS - 1 ) / VIDEO_JOB_BLOCKS;
+	const byte *src;
+	byte *dst;
+	int x, y, first, last;
+
+	first = MIN( block * blockSize, job->height );
+	last = MIN( first + blockSize, job->height );
+
+	for ( y = first; y < last; y++ ) {
+		src = job->src + y * job->srcPitch;
+		dst = job->dst + y * job->dstPitch;
+		if ( job->swap ) {
+			// swap R and B and remove line paddings
+			for ( x = 0; x < job->linelen; x += 3 ) {
+				dst[x+0] = src[x+2];
+				dst[x+1] = src[x+1];
+				dst[x+2] = src[x+0];
+			}
+			Com_Memset( dst + job->linelen, '\0', job->dstPitch - job->linelen );
+		} else if ( dst != src ) {
+			Com_Memcpy( dst, src, job->linelen );
+		}
+		// gamma correction
+		R_GammaCorrect( dst, job->linelen );
+	}
+}
+
+
 /*
 ==================
 RB_TakeVideoFrameCmd
@@ -1175,10 +1444,12 @@ RB_TakeVideoFrameCmd
 const void *RB_TakeVideoFrameCmd( const void *data )
 {
 	const videoFrameCommand_t *cmd;
+	const byte	*pixels;
 	byte		*cBuf;
-	size_t		memcount, linelen;
-	int			padwidth, avipadwidth, padlen, avipadlen;
+	size_t		linelen;
+	int			padwidth, avipadwidth;
 	int			packAlign;
+	videoJob_t	job;
 
 	cmd = (const videoFrameCommand_t *)data;
 
@@ -1188,54 +1459,39 @@ const void *RB_TakeVideoFrameCmd( const void *data )
 
 	// Alignment stuff for glReadPixels
 	padwidth = PAD(linelen, packAlign);
-	padlen = padwidth - linelen;
 	// AVI line padding
 	avipadwidth = PAD(linelen, AVI_LINE_PADDING);
-	avipadlen = avipadwidth - linelen;
 
 	cBuf = PADP(cmd->captureBuffer, packAlign);
 
-	qglReadPixels(0, 0, cmd->width, cmd->height, GL_RGB,
-		GL_UNSIGNED_BYTE, cBuf);
-
-	memcount = padwidth * cmd->height;
+	pixels = RB_MapVideoPixels( cBuf, cmd->width, cmd->height, padwidth * cmd->height );
+	if ( !pixels ) {
+		return (const void *)(cmd + 1);
+	}
 
-	// gamma correction
-	R_GammaCorrect( cBuf, memcount );
+	job.src = pixels;
+	job.srcPitch = padwidth;
+	job.linelen = linelen;
+	job.height = cmd->height;
 
 	if ( cmd->motionJpeg )
 	{
-		memcount = ri.CL_SaveJPGToBuffer( cmd->encodeBuffer, linelen * cmd->height,
-			r_aviMotionJpegQuality->integer,
-			cmd->width, cmd->height, cBuf, padlen );
-		ri.CL_WriteAVIVideoFrame(cmd->encodeBuffer, memcount);
+		// compressed by the client, rows are passed without padding
+		job.dst = cmd->encodeBuffer;
+		job.dstPitch = linelen;
+		job.swap = qfalse;
+		ri.ParallelFor( RB_VideoFrameJob, &job, VIDEO_JOB_BLOCKS );
+		RB_UnmapVideoPixels();
+
+		ri.CL_WriteAVIVideoFrame(cmd->encodeBuffer, linelen * cmd->height);
 	}
 	else
 	{
-		byte *lineend, *memend;
-		byte *srcptr, *destptr;
-
-		srcptr = cBuf;
-		destptr = cmd->encodeBuffer;
-		memend = srcptr + memcount;
-
-		// swap R and B and remove line paddings
-		while(srcptr < memend)
-		{
-			lineend = srcptr + linelen;
-			while(srcptr < lineend)
-			{
-				*destptr++ = srcptr[2];
-				*destptr++ = srcptr[1];
-				*destptr++ = srcptr[0];
-				srcptr += 3;
-			}
-
-			Com_Memset(destptr, '\0', avipadlen);
-			destptr += avipadlen;
-
-			srcptr += padlen;
-		}
+		job.dst = cmd->encodeBuffer;
+		job.dstPitch = avipadwidth;
+		job.swap = qtrue;
+		ri.ParallelFor( RB_VideoFrameJob, &job, VIDEO_JOB_BLOCKS );
+		RB_UnmapVideoPixels();
 
 		ri.CL_WriteAVIVideoFrame(cmd->encodeBuffer, avipadwidth * cmd->height);
 	}
@@ -1317,6 +1573,8 @@ RE_SyncRender
 */
 static void RE_SyncRender( void )
 {
+	R_SyncRenderThread();
+
 	if ( qglFinish && backEnd.doneSurfaces )
 	{
 		qglFinish();
@@ -1324,6 +1582,23 @@ static void RE_SyncRender( void )
 }
 
 
+/*
+===============
+RE_MemoryStats
+===============
+*/
+static void RE_MemoryStats( refMemoryStats_t *stats )
+{
+	stats->numImages = tr.numImages;
+	stats->imageBytes = R_ImageMemory();
+#ifdef USE_VBO
+	stats->vboBytes = VBO_Size();
+#else
+	stats->vboBytes = 0;
+#endif
+}
+
+
 /*
 ================
 R_PrintLongString
@@ -1472,6 +1747,7 @@ static void R_Register( void )
 	ri.Cmd_AddCommand( "screenshotJPEG", R_ScreenShot_f );
 	ri.Cmd_AddCommand( "screenshotBMP", R_ScreenShot_f );
 	ri.Cmd_AddCommand( "gfxinfo", GfxInfo_f );
+	ri.Cmd_AddCommand( "gpustats", R_GpuStats_f );
 
 	//
 	// temporary latched variables that can only change over a restart
@@ -1520,19 +1796,35 @@ static void R_Register( void )
 #ifdef USE_VBO
 	r_vbo = ri.Cvar_Get( "r_vbo", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription( r_vbo, "Use Vertex Buffer Objects to cache static map geometry, may improve FPS on modern GPUs, increases hunk memory usage by 15-30MB (map-dependent)." );
+	r_vboStream = ri.Cvar_Get( "r_vboStream", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_vboStream, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_vboStream, "Stream dynamic geometry through a persistently mapped buffer instead of client-side vertex arrays, requires GL_ARB_buffer_storage." );
+	r_glsl = ri.Cvar_Get( "r_glsl", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_glsl, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_glsl, "Render static map geometry with GLSL programs instead of ARB assembly programs and fixed-function multitexturing, requires \\r_vbo 1 and OpenGL 2.0." );
 #endif
 
 	r_mapGreyScale = ri.Cvar_Get( "r_mapGreyScale", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_CheckRange( r_mapGreyScale, "-1", "1", CV_FLOAT );
 	ri.Cvar_SetDescription(r_mapGreyScale, "Desaturate world map textures only, works independently from \\r_greyscale, negative values only desaturate lightmaps.");
 
+	r_imagePrefetch = ri.Cvar_Get( "r_imagePrefetch", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_imagePrefetch, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_imagePrefetch, "Decode map textures on all cores before the map shaders are loaded." );
+
 	r_subdivisions = ri.Cvar_Get( "r_subdivisions", "4", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription(r_subdivisions, "Distance to subdivide bezier curved surfaces. Higher values mean less subdivision and less geometric complexity.");
+	r_patchCache = ri.Cvar_Get( "r_patchCache", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_patchCache, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_patchCache, "Save subdivided curved surfaces of each map into the patchcache directory of the home path and load them from there later." );
 
 	r_maxpolys = ri.Cvar_Get( "r_maxpolys", XSTRING( MAX_POLYS ), CVAR_LATCH );
 	ri.Cvar_SetDescription( r_maxpolys, "Maximum number of polygons to draw in a scene." );
 	r_maxpolyverts = ri.Cvar_Get( "r_maxpolyverts", XSTRING( MAX_POLYVERTS ), CVAR_LATCH );
 	ri.Cvar_SetDescription( r_maxpolyverts, "Maximum number of polygon vertices to draw in a scene." );
+	r_smp = ri.Cvar_Get( "r_smp", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_smp, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_smp, "Execute render commands on a separate thread while the next frame is prepared, output lags one frame behind the game." );
 
 	//
 	// archived variables that can change at any time
@@ -1542,6 +1834,9 @@ static void R_Register( void )
 	ri.Cvar_SetDescription( r_lodCurveError, "Level of detail error on curved surface grids. Higher values result in better quality at a distance." );
 	r_lodbias = ri.Cvar_Get( "r_lodbias", "-2", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_lodbias, "Sets the level of detail of in-game models:\n -2: Ultra (further delays LOD transition in the distance)\n -1: Very High (delays LOD transition in the distance)\n 0: High\n 1: Medium\n 2: Low" );
+	r_modelCache = ri.Cvar_Get( "r_modelCache", "64", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_modelCache, "0", "1024", CV_INTEGER );
+	ri.Cvar_SetDescription( r_modelCache, "Megabytes of loaded md3 models kept between maps, 0 disables the cache.\nEdited loose files are picked up after " S_COLOR_CYAN "\\fs_restart" S_COLOR_WHITE " only." );
 	r_znear = ri.Cvar_Get( "r_znear", "4", CVAR_CHEAT );
 	ri.Cvar_CheckRange( r_znear, "0.001", "200", CV_FLOAT );
 	ri.Cvar_SetDescription( r_znear, "Viewport distance from view origin (how close objects can be to the player before they're clipped out of the scene)." );
@@ -1704,12 +1999,18 @@ static void R_Register( void )
 	ri.Cvar_SetDescription( r_drawentities, "Draw all world entities." );
 	r_nocull = ri.Cvar_Get ("r_nocull", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_nocull, "Draw all culled objects." );
+	r_instancing = ri.Cvar_Get( "r_instancing", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_instancing, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_instancing, "Draw surfaces of several entities sharing a model and shader as one batch transformed on the CPU." );
+	r_occlusion = ri.Cvar_Get( "r_occlusion", "0", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_occlusion, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_occlusion, "Skip world nodes and entities hidden behind large walls, rasterized into a small software depth buffer for every view." );
 	r_novis = ri.Cvar_Get ("r_novis", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_novis, "Disables usage of PVS." );
 	r_showcluster = ri.Cvar_Get ("r_showcluster", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_showcluster, "Shows current cluster index." );
 	r_speeds = ri.Cvar_Get ("r_speeds", "0", CVAR_CHEAT);
-	ri.Cvar_SetDescription( r_speeds, "Prints out various debugging stats from PVS:\n 0: Disabled\n 1: Backend BSP\n 2: Frontend grid culling\n 3: Current view cluster index\n 4: Dynamic lighting\n 5: zFar clipping\n 6: Flares" );
+	ri.Cvar_SetDescription( r_speeds, "Prints out various debugging stats from PVS:\n 0: Disabled\n 1: Backend BSP\n 2: Frontend grid culling\n 3: Current view cluster index\n 4: Dynamic lighting\n 5: zFar clipping\n 6: Flares\n 7: Occlusion culling\n 8: GPU time of render passes, needs timer queries" );
 	r_debugSurface = ri.Cvar_Get ("r_debugSurface", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_debugSurface, "Backend visual debugging tool for bezier mesh surfaces." );
 	r_nobind = ri.Cvar_Get ("r_nobind", "0", CVAR_CHEAT);
@@ -1718,6 +2019,9 @@ static void R_Register( void )
 	ri.Cvar_SetDescription( r_showtris, "Debugging tool: Wireframe rendering of polygon triangles in the world." );
 	r_showsky = ri.Cvar_Get( "r_showsky", "0", 0 );
 	ri.Cvar_SetDescription( r_showsky, "Forces sky in front of all surfaces." );
+	r_fullSky = ri.Cvar_Get( "r_fullSky", "0", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_fullSky, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_fullSky, "Draws every sky box side in view instead of clipping sky surfaces against the box on the CPU, trades overdraw for CPU time on big outdoor maps." );
 	r_shownormals = ri.Cvar_Get ("r_shownormals", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_shownormals, "Debugging tool: Show wireframe surface normals." );
 	r_clear = ri.Cvar_Get( "r_clear", "0", 0 );
@@ -1737,8 +2041,6 @@ static void R_Register( void )
 	r_marksOnTriangleMeshes = ri.Cvar_Get("r_marksOnTriangleMeshes", "0", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_marksOnTriangleMeshes, "Enables impact marks on triangle mesh surfaces (ie: MD3 models.) Requires impact marks to be enabled in the game code." );
 
-	r_aviMotionJpegQuality = ri.Cvar_Get( "r_aviMotionJpegQuality", "90", CVAR_ARCHIVE_ND );
-	ri.Cvar_SetDescription( r_aviMotionJpegQuality, "Controls quality of Jpeg video capture when \\cl_aviMotionJpeg 1." );
 	r_screenshotJpegQuality = ri.Cvar_Get( "r_screenshotJpegQuality", "90", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_screenshotJpegQuality, "Controls quality of Jpeg screenshots when using screenshotJpeg." );
 
@@ -1871,10 +2173,16 @@ void R_Init( void ) {
 	max_polys = r_maxpolys->integer;
 	max_polyverts = r_maxpolyverts->integer;
 
-	ptr = ri.Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
-	backEndData = (backEndData_t *) ptr;
-	backEndData->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData ));
-	backEndData->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys);
+	// second set of back end data lets the front end run ahead of the render thread
+	Com_Memset( backEndFrames, 0, sizeof( backEndFrames ) );
+	for ( i = 0; i < ( r_smp->integer ? SMP_FRAMES : 1 ); i++ ) {
+		ptr = ri.Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
+		backEndFrames[i] = (backEndData_t *) ptr;
+		backEndFrames[i]->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData ));
+		backEndFrames[i]->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys);
+	}
+	backEndData = backEndFrames[0];
+	tr.smpFrame = 0;
 
 	R_InitNextFrame();
 
@@ -1896,6 +2204,10 @@ void R_Init( void ) {
 	if ( err != GL_NO_ERROR )
 		ri.Printf( PRINT_WARNING, "glGetError() = 0x%x\n", err );
 
+	if ( backEndFrames[1] ) {
+		R_InitRenderThread();
+	}
+
 	ri.Printf( PRINT_ALL, "----- finished R_Init -----\n" );
 }
 
@@ -1909,6 +2221,8 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 
 	ri.Printf( PRINT_ALL, "RE_Shutdown( %i )\n", code );
 
+	R_ShutdownRenderThread();
+
 	ri.Cmd_RemoveCommand( "modellist" );
 	ri.Cmd_RemoveCommand( "screenshotBMP" );
 	ri.Cmd_RemoveCommand( "screenshotJPEG" );
@@ -1917,6 +2231,7 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 	ri.Cmd_RemoveCommand( "shaderlist" );
 	ri.Cmd_RemoveCommand( "skinlist" );
 	ri.Cmd_RemoveCommand( "gfxinfo" );
+	ri.Cmd_RemoveCommand( "gpustats" );
 	ri.Cmd_RemoveCommand( "shaderstate" );
 
 	if ( tr.registered ) {
@@ -1924,6 +2239,8 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 		R_DeleteTextures();
 	}
 
+	R_FreePrefetchedImages();
+
 	R_DoneFreeType();
 
 	// shut down platform specific OpenGL stuff
@@ -1933,8 +2250,15 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 
 #ifdef USE_VBO
 		VBO_Cleanup();
+		VBO_ShutdownStream();
 #endif
 
+		RB_GpuTimerShutdown();
+
+		RB_ShutdownVideoReadback();
+
+		R_ShutdownFlares();
+
 		R_ClearSymTables();
 
 		Com_Memset( &glState, 0, sizeof( glState ) );
@@ -1945,6 +2269,11 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 		}
 	}
 
+	// models may come from another search path or renderer next time
+	if ( code != REF_KEEP_CONTEXT ) {
+		R_ClearModelCache();
+	}
+
 	ri.FreeAll();
 
 	tr.registered = qfalse;
@@ -2006,8 +2335,10 @@ refexport_t *GetRefAPI ( int apiVersion, refimport_t *rimp ) {
 
 	re.BeginFrame = RE_BeginFrame;
 	re.EndFrame = RE_EndFrame;
+	re.GetFrameStats = RE_GetFrameStats;
 
 	re.MarkFragments = R_MarkFragments;
+	re.MarkFragmentsBatch = R_MarkFragmentsBatch;
 	re.LerpTag = R_LerpTag;
 	re.ModelBounds = R_ModelBounds;
 
@@ -2040,6 +2371,7 @@ refexport_t *GetRefAPI ( int apiVersion, refimport_t *rimp ) {
 	re.GetConfig = RE_GetConfig;
 	re.VertexLighting = RE_VertexLighting;
 	re.SyncRender = RE_SyncRender;
+	re.MemoryStats = RE_MemoryStats;
 
 	return &re;
 }
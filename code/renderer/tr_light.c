@@ -126,6 +126,123 @@ extern	cvar_t	*r_ambientScale;
 extern	cvar_t	*r_directedScale;
 extern	cvar_t	*r_debugLight;
 
+#define LIGHT_CELL_CACHE	256		// power of 2
+
+// eight decoded corners of a grid cell, ambient, directed and normal
+// are padded to four floats each so they can be blended as vectors
+typedef struct {
+	int		index;				// grid index of the low corner, -1 if unused
+	int		validMask;			// corners inside the grid and not in walls
+	float	sample[8][12];
+} lightGridCell_t;
+
+static lightGridCell_t	lightCells[ LIGHT_CELL_CACHE ];
+
+// last unscaled grid result, multi-part models share their lighting origin
+static struct {
+	qboolean	valid;
+	vec3_t		origin;
+	vec3_t		ambientLight;
+	vec3_t		directedLight;
+	vec3_t		lightDir;
+} lightLast;
+
+
+/*
+=================
+R_ClearLightGridCache
+
+Called when a new light grid is loaded
+=================
+*/
+void R_ClearLightGridCache( void ) {
+	int		i;
+
+	for ( i = 0; i < LIGHT_CELL_CACHE; i++ ) {
+		lightCells[i].index = -1;
+	}
+	lightLast.valid = qfalse;
+}
+
+
+/*
+=================
+R_GetLightGridCell
+
+Decodes the eight samples around the cell at pos or returns them from cache
+=================
+*/
+static const lightGridCell_t *R_GetLightGridCell( const int pos[3], const int gridStep[3] ) {
+	lightGridCell_t *cell;
+	const byte	*gridData, *data;
+	float		*sample;
+	int			index;
+	int			i, j;
+	int			lat, lng;
+
+	index = pos[0] * gridStep[0] + pos[1] * gridStep[1] + pos[2] * gridStep[2];
+
+	cell = &lightCells[ ( ( (unsigned)index >> 3 ) * 2654435761U >> 24 ) & ( LIGHT_CELL_CACHE - 1 ) ];
+	if ( cell->index == index ) {
+		return cell;
+	}
+
+	cell->index = index;
+	cell->validMask = 0;
+
+	gridData = tr.world->lightGridData + index;
+
+	for ( i = 0 ; i < 8 ; i++ ) {
+		data = gridData;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			if ( i & (1<<j) ) {
+				if ( pos[j] + 1 > tr.world->lightGridBounds[j] - 1 ) {
+					break; // ignore values outside lightgrid
+				}
+				data += gridStep[j];
+			}
+		}
+
+		if ( j != 3 ) {
+			continue;
+		}
+
+		if ( !(data[0]+data[1]+data[2]) ) {
+			continue;	// ignore samples in walls
+		}
+
+		cell->validMask |= 1 << i;
+		sample = cell->sample[i];
+
+		sample[0] = data[0];
+		sample[1] = data[1];
+		sample[2] = data[2];
+		sample[3] = 0;
+
+		sample[4] = data[3];
+		sample[5] = data[4];
+		sample[6] = data[5];
+		sample[7] = 0;
+
+		lat = data[7];
+		lng = data[6];
+		lat *= (FUNCTABLE_SIZE/256);
+		lng *= (FUNCTABLE_SIZE/256);
+
+		// decode X as cos( lat ) * sin( long )
+		// decode Y as sin( lat ) * sin( long )
+		// decode Z as cos( long )
+
+		sample[8] = tr.sinTable[(lat+(FUNCTABLE_SIZE/4))&FUNCTABLE_MASK] * tr.sinTable[lng];
+		sample[9] = tr.sinTable[lat] * tr.sinTable[lng];
+		sample[10] = tr.sinTable[(lng+(FUNCTABLE_SIZE/4))&FUNCTABLE_MASK];
+		sample[11] = 0;
+	}
+
+	return cell;
+}
+
+
 /*
 =================
 R_SetupEntityLightingGrid
@@ -133,13 +250,14 @@ R_SetupEntityLightingGrid
 =================
 */
 static void R_SetupEntityLightingGrid( trRefEntity_t *ent ) {
+	const lightGridCell_t *cell;
 	vec3_t	lightOrigin;
 	int		pos[3];
 	int		i, j;
-	byte	*gridData;
 	float	frac[3];
 	int		gridStep[3];
-	vec3_t	direction;
+	float	factors[8];
+	float	blend[12];
 	float	totalFactor;
 
 	if ( ent->e.renderfx & RF_LIGHTING_ORIGIN ) {
@@ -151,6 +269,17 @@ static void R_SetupEntityLightingGrid( trRefEntity_t *ent ) {
 		VectorCopy( ent->e.origin, lightOrigin );
 	}
 
+	if ( lightLast.valid && VectorCompare( lightOrigin, lightLast.origin ) ) {
+		VectorCopy( lightLast.ambientLight, ent->ambientLight );
+		VectorCopy( lightLast.directedLight, ent->directedLight );
+		VectorCopy( lightLast.lightDir, ent->lightDir );
+		VectorScale( ent->ambientLight, r_ambientScale->value, ent->ambientLight );
+		VectorScale( ent->directedLight, r_directedScale->value, ent->directedLight );
+		return;
+	}
+
+	VectorCopy( lightOrigin, lightLast.origin );
+
 	VectorSubtract( lightOrigin, tr.world->lightGridOrigin, lightOrigin );
 	for ( i = 0 ; i < 3 ; i++ ) {
 		float	v;
@@ -165,71 +294,47 @@ static void R_SetupEntityLightingGrid( trRefEntity_t *ent ) {
 		}
 	}
 
-	VectorClear( ent->ambientLight );
-	VectorClear( ent->directedLight );
-	VectorClear( direction );
-
 	assert( tr.world->lightGridData ); // NULL with -nolight maps
 
 	// trilerp the light value
 	gridStep[0] = 8;
 	gridStep[1] = 8 * tr.world->lightGridBounds[0];
 	gridStep[2] = 8 * tr.world->lightGridBounds[0] * tr.world->lightGridBounds[1];
-	gridData = tr.world->lightGridData + pos[0] * gridStep[0]
-		+ pos[1] * gridStep[1] + pos[2] * gridStep[2];
+
+	cell = R_GetLightGridCell( pos, gridStep );
 
 	totalFactor = 0;
 	for ( i = 0 ; i < 8 ; i++ ) {
 		float	factor;
-		byte	*data;
-		int		lat, lng;
-		vec3_t	normal;
 		factor = 1.0;
-		data = gridData;
 		for ( j = 0 ; j < 3 ; j++ ) {
 			if ( i & (1<<j) ) {
-				if ( pos[j] + 1 > tr.world->lightGridBounds[j] - 1 ) {
-					break; // ignore values outside lightgrid
-				}
 				factor *= frac[j];
-				data += gridStep[j];
 			} else {
 				factor *= (1.0f - frac[j]);
 			}
 		}
-
-		if ( j != 3 ) {
-			continue;
+		factors[i] = factor;
+		if ( cell->validMask & (1<<i) ) {
+			totalFactor += factor;
 		}
+	}
 
-		if ( !(data[0]+data[1]+data[2]) ) {
-			continue;	// ignore samples in walls
+#ifdef USE_SIMD_SHADE
+	R_BlendLightGridSSE2( cell->sample[0], factors, cell->validMask, blend );
+#else
+	Com_Memset( blend, 0, sizeof( blend ) );
+	for ( i = 0 ; i < 8 ; i++ ) {
+		if ( cell->validMask & (1<<i) ) {
+			for ( j = 0 ; j < 12 ; j++ ) {
+				blend[j] += factors[i] * cell->sample[i][j];
+			}
 		}
-		totalFactor += factor;
-
-		ent->ambientLight[0] += factor * data[0];
-		ent->ambientLight[1] += factor * data[1];
-		ent->ambientLight[2] += factor * data[2];
-
-		ent->directedLight[0] += factor * data[3];
-		ent->directedLight[1] += factor * data[4];
-		ent->directedLight[2] += factor * data[5];
-
-		lat = data[7];
-		lng = data[6];
-		lat *= (FUNCTABLE_SIZE/256);
-		lng *= (FUNCTABLE_SIZE/256);
-
-		// decode X as cos( lat ) * sin( long )
-		// decode Y as sin( lat ) * sin( long )
-		// decode Z as cos( long )
-
-		normal[0] = tr.sinTable[(lat+(FUNCTABLE_SIZE/4))&FUNCTABLE_MASK] * tr.sinTable[lng];
-		normal[1] = tr.sinTable[lat] * tr.sinTable[lng];
-		normal[2] = tr.sinTable[(lng+(FUNCTABLE_SIZE/4))&FUNCTABLE_MASK];
-
-		VectorMA( direction, factor, normal, direction );
 	}
+#endif
+
+	VectorCopy( blend + 0, ent->ambientLight );
+	VectorCopy( blend + 4, ent->directedLight );
 
 	if ( totalFactor > 0 && totalFactor < 0.99 ) {
 		totalFactor = 1.0f / totalFactor;
@@ -237,10 +342,15 @@ static void R_SetupEntityLightingGrid( trRefEntity_t *ent ) {
 		VectorScale( ent->directedLight, totalFactor, ent->directedLight );
 	}
 
+	VectorNormalize2( blend + 8, ent->lightDir );
+
+	VectorCopy( ent->ambientLight, lightLast.ambientLight );
+	VectorCopy( ent->directedLight, lightLast.directedLight );
+	VectorCopy( ent->lightDir, lightLast.lightDir );
+	lightLast.valid = qtrue;
+
 	VectorScale( ent->ambientLight, r_ambientScale->value, ent->ambientLight );
 	VectorScale( ent->directedLight, r_directedScale->value, ent->directedLight );
-
-	VectorNormalize2( direction, ent->lightDir );
 }
 
 
@@ -28,6 +28,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define MARKER_OFFSET			0	// 1
 
+#define MAX_MARK_PLANES			(MAX_VERTS_ON_POLY+2)
+#define MAX_PLANE_GROUPS		((MAX_MARK_PLANES+3)/4)
+
+// bounding planes of the projected polygon, also laid out four
+// at a time so a triangle is classified against all of them at once
+typedef struct {
+	int			numPlanes;
+	vec3_t		normals[MAX_MARK_PLANES];
+	float		dists[MAX_MARK_PLANES];
+	int			numGroups;
+	float		groups[MAX_PLANE_GROUPS][16] QALIGN(16);
+} markPlanes_t;
+
 /*
 =============
 R_ChopPolyBehindPlane
@@ -40,7 +53,7 @@ Out must have space for two more vertexes than in
 #define	SIDE_ON		2
 static void R_ChopPolyBehindPlane( int numInPoints, vec3_t inPoints[MAX_VERTS_ON_POLY],
 								int *numOutPoints, vec3_t outPoints[MAX_VERTS_ON_POLY],
-							vec3_t normal, vec_t dist, vec_t epsilon) {
+							const vec3_t normal, vec_t dist, vec_t epsilon) {
 	float		dists[MAX_VERTS_ON_POLY+4];
 	int			sides[MAX_VERTS_ON_POLY+4];
 	int			counts[3];
@@ -133,7 +146,7 @@ R_BoxSurfaces_r
 
 =================
 */
-static void R_BoxSurfaces_r(mnode_t *node, vec3_t mins, vec3_t maxs, surfaceType_t **list, int listsize, int *listlength, vec3_t dir) {
+static void R_BoxSurfaces_r(mnode_t *node, vec3_t mins, vec3_t maxs, const vec3_t cullBounds[2], surfaceType_t **list, int listsize, int *listlength, vec3_t dir) {
 
 	int			s, c;
 	msurface_t	*surf, **mark;
@@ -146,7 +159,7 @@ static void R_BoxSurfaces_r(mnode_t *node, vec3_t mins, vec3_t maxs, surfaceType
 		} else if (s == 2) {
 			node = node->children[1];
 		} else {
-			R_BoxSurfaces_r(node->children[0], mins, maxs, list, listsize, listlength, dir);
+			R_BoxSurfaces_r(node->children[0], mins, maxs, cullBounds, list, listsize, listlength, dir);
 			node = node->children[1];
 		}
 	}
@@ -164,6 +177,12 @@ static void R_BoxSurfaces_r(mnode_t *node, vec3_t mins, vec3_t maxs, surfaceType
 			|| ( surf->shader->contentFlags & CONTENTS_FOG ) ) {
 			surf->viewCount = tr.viewCount;
 		}
+		// nothing of the surface can be inside of the bounding planes
+		else if ( surf->bounds[0][0] > cullBounds[1][0] || surf->bounds[1][0] < cullBounds[0][0]
+			|| surf->bounds[0][1] > cullBounds[1][1] || surf->bounds[1][1] < cullBounds[0][1]
+			|| surf->bounds[0][2] > cullBounds[1][2] || surf->bounds[1][2] < cullBounds[0][2] ) {
+			surf->viewCount = tr.viewCount;
+		}
 		// extra check for surfaces to avoid list overflows
 		else if (*(surf->data) == SF_FACE) {
 			// the face plane should go through the box
@@ -189,6 +208,71 @@ static void R_BoxSurfaces_r(mnode_t *node, vec3_t mins, vec3_t maxs, surfaceType
 	}
 }
 
+/*
+=================
+R_SetupMarkPlanes
+
+Copies the bounding planes into groups of four, unused slots
+get a plane that every point is far in front of
+=================
+*/
+static void R_SetupMarkPlanes( markPlanes_t *planes ) {
+	float *group;
+	int i, j;
+
+	planes->numGroups = ( planes->numPlanes + 3 ) / 4;
+
+	for ( i = 0; i < planes->numGroups * 4; i++ ) {
+		group = planes->groups[ i >> 2 ];
+		j = i & 3;
+		if ( i < planes->numPlanes ) {
+			group[ 0 + j ] = planes->normals[i][0];
+			group[ 4 + j ] = planes->normals[i][1];
+			group[ 8 + j ] = planes->normals[i][2];
+			group[ 12 + j ] = planes->dists[i];
+		} else {
+			group[ 0 + j ] = 0.0f;
+			group[ 4 + j ] = 0.0f;
+			group[ 8 + j ] = 0.0f;
+			group[ 12 + j ] = -1e9f;
+		}
+	}
+}
+
+
+/*
+=================
+R_ClassifyTriangle
+=================
+*/
+static void R_ClassifyTriangle( const vec3_t points[3], const markPlanes_t *planes, byte *front, byte *back ) {
+#ifdef USE_SIMD_SHADE
+	R_ClassifyTriangleSSE2( points, planes->groups[0], planes->numGroups, 0.5f, front, back );
+#else
+	float dot;
+	int i, j;
+
+	Com_Memset( front, 0, planes->numGroups );
+	Com_Memset( back, 0, planes->numGroups );
+
+	for ( i = 0; i < planes->numGroups * 4; i++ ) {
+		for ( j = 0; j < 3; j++ ) {
+			if ( i < planes->numPlanes ) {
+				dot = DotProduct( points[j], planes->normals[i] ) - planes->dists[i];
+			} else {
+				dot = 1e9f;
+			}
+			if ( dot > 0.5f ) {
+				front[ i >> 2 ] |= 1 << ( i & 3 );
+			} else if ( dot < -0.5f ) {
+				back[ i >> 2 ] |= 1 << ( i & 3 );
+			}
+		}
+	}
+#endif
+}
+
+
 /*
 =================
 R_AddMarkFragments
@@ -196,22 +280,36 @@ R_AddMarkFragments
 =================
 */
 static void R_AddMarkFragments(int numClipPoints, vec3_t clipPoints[2][MAX_VERTS_ON_POLY],
-				   int numPlanes, vec3_t *normals, float *dists,
+				   const markPlanes_t *planes,
 				   int maxPoints, vec3_t pointBuffer,
 				   int maxFragments, markFragment_t *fragmentBuffer,
 				   int *returnedPoints, int *returnedFragments,
 				   vec3_t mins, vec3_t maxs) {
+	byte front[MAX_PLANE_GROUPS], back[MAX_PLANE_GROUPS];
 	int pingPong, i;
 	markFragment_t	*mf;
 
+	// a triangle with no point in front of some plane is clipped away,
+	// planes it has no point behind of don't change it
+	R_ClassifyTriangle( clipPoints[0], planes, front, back );
+	for ( i = 0 ; i < planes->numGroups ; i++ ) {
+		if ( front[i] != 15 ) {
+			return;
+		}
+	}
+
 	// chop the surface by all the bounding planes of the to be projected polygon
 	pingPong = 0;
 
-	for ( i = 0 ; i < numPlanes ; i++ ) {
+	for ( i = 0 ; i < planes->numPlanes ; i++ ) {
+
+		if ( !( back[i>>2] & ( 1 << ( i & 3 ) ) ) ) {
+			continue;
+		}
 
 		R_ChopPolyBehindPlane( numClipPoints, clipPoints[pingPong],
 						   &numClipPoints, clipPoints[!pingPong],
-							normals[i], dists[i], 0.5 );
+							planes->normals[i], planes->dists[i], 0.5 );
 		pingPong ^= 1;
 		if ( numClipPoints == 0 ) {
 			break;
@@ -256,14 +354,16 @@ R_MarkFragments
 */
 int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projection,
 				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer ) {
-	int				numsurfaces, numPlanes;
+	int				numsurfaces;
 	int				i, j, k, m, n;
 	surfaceType_t	*surfaces[64];
 	vec3_t			mins, maxs;
+	vec3_t			cullBounds[2];
 	int				returnedFragments;
 	int				returnedPoints;
-	vec3_t			normals[MAX_VERTS_ON_POLY+2];
-	float			dists[MAX_VERTS_ON_POLY+2];
+	markPlanes_t	planes;
+	vec3_t			*normals = planes.normals;
+	float			*dists = planes.dists;
 	vec3_t			clipPoints[2][MAX_VERTS_ON_POLY];
 	int				numClipPoints;
 	float			*v;
@@ -312,10 +412,29 @@ int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projectio
 	VectorCopy(projectionDir, normals[numPoints+1]);
 	VectorInverse(normals[numPoints+1]);
 	dists[numPoints+1] = DotProduct(normals[numPoints+1], points[0]) - 20;
-	numPlanes = numPoints + 2;
+	planes.numPlanes = numPoints + 2;
+
+	R_SetupMarkPlanes( &planes );
+
+	// the volume inside of the planes, near and far planes are relative to the first point
+	ClearBounds( cullBounds[0], cullBounds[1] );
+	for ( i = 0 ; i < numPoints ; i++ ) {
+		vec3_t	temp;
+		float	d;
+
+		d = DotProduct( projectionDir, points[0] ) - DotProduct( projectionDir, points[i] );
+		VectorMA( points[i], d - 32 - 1, projectionDir, temp );
+		AddPointToBounds( temp, cullBounds[0], cullBounds[1] );
+		VectorMA( points[i], d + 20 + 1, projectionDir, temp );
+		AddPointToBounds( temp, cullBounds[0], cullBounds[1] );
+	}
+	for ( i = 0 ; i < 3 ; i++ ) {
+		cullBounds[0][i] -= 1;
+		cullBounds[1][i] += 1;
+	}
 
 	numsurfaces = 0;
-	R_BoxSurfaces_r(tr.world->nodes, mins, maxs, surfaces, 64, &numsurfaces, projectionDir);
+	R_BoxSurfaces_r(tr.world->nodes, mins, maxs, (const vec3_t *)cullBounds, surfaces, 64, &numsurfaces, projectionDir);
 	//assert(numsurfaces <= 64);
 	//assert(numsurfaces != 64);
 
@@ -368,7 +487,7 @@ int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projectio
 					if (DotProduct(normal, projectionDir) < -0.1) {
 						// add the fragments of this triangle
 						R_AddMarkFragments(numClipPoints, clipPoints,
-										   numPlanes, normals, dists,
+										   &planes,
 										   maxPoints, pointBuffer,
 										   maxFragments, fragmentBuffer,
 										   &returnedPoints, &returnedFragments, mins, maxs);
@@ -392,7 +511,7 @@ int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projectio
 					if (DotProduct(normal, projectionDir) < -0.05) {
 						// add the fragments of this triangle
 						R_AddMarkFragments(numClipPoints, clipPoints,
-										   numPlanes, normals, dists,
+										   &planes,
 										   maxPoints, pointBuffer,
 										   maxFragments, fragmentBuffer,
 										   &returnedPoints, &returnedFragments, mins, maxs);
@@ -422,7 +541,7 @@ int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projectio
 
 				// add the fragments of this face
 				R_AddMarkFragments( 3 , clipPoints,
-								   numPlanes, normals, dists,
+								   &planes,
 								   maxPoints, pointBuffer,
 								   maxFragments, fragmentBuffer,
 								   &returnedPoints, &returnedFragments, mins, maxs);
@@ -445,7 +564,7 @@ int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projectio
 
 				// add the fragments of this face
 				R_AddMarkFragments(3, clipPoints,
-								   numPlanes, normals, dists,
+								   &planes,
 								   maxPoints, pointBuffer,
 								   maxFragments, fragmentBuffer, &returnedPoints, &returnedFragments, mins, maxs);
 				if(returnedFragments == maxFragments)
@@ -458,3 +577,50 @@ int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projectio
 	return returnedFragments;
 }
 
+
+/*
+=================
+R_MarkFragmentsBatch
+
+Projects several marks in one call, fragments of all requests share
+the buffers and their points are indexed from the start of pointBuffer
+=================
+*/
+int R_MarkFragmentsBatch( int numRequests, markRequest_t *requests,
+				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer ) {
+	markRequest_t	*req;
+	markFragment_t	*mf;
+	int				returnedFragments;
+	int				returnedPoints;
+	int				i, j, n;
+
+	returnedPoints = 0;
+	returnedFragments = 0;
+
+	for ( i = 0, req = requests ; i < numRequests ; i++, req++ ) {
+		req->firstFragment = returnedFragments;
+		req->numFragments = 0;
+
+		if ( returnedFragments >= maxFragments || returnedPoints >= maxPoints ) {
+			continue;
+		}
+
+		n = R_MarkFragments( MIN( req->numPoints, MAX_MARK_REQUEST_POINTS ), (const vec3_t *)req->points, req->projection,
+			maxPoints - returnedPoints, pointBuffer + returnedPoints * 3,
+			maxFragments - returnedFragments, fragmentBuffer + returnedFragments );
+
+		mf = fragmentBuffer + returnedFragments;
+		for ( j = 0 ; j < n ; j++, mf++ ) {
+			mf->firstPoint += returnedPoints;
+		}
+		if ( n ) {
+			mf--;
+			returnedPoints = mf->firstPoint + mf->numPoints;
+		}
+
+		req->numFragments = n;
+		returnedFragments += n;
+	}
+
+	return returnedFragments;
+}
@@ -104,6 +104,9 @@ static int R_CullModel( md3Header_t *header, const trRefEntity_t *ent, vec3_t bo
 
 			case CULL_IN:
 				tr.pc.c_sphere_cull_md3_in++;
+				if ( R_OccludedLocalBox( (const vec3_t *)bounds ) ) {
+					return CULL_OUT;
+				}
 				return CULL_IN;
 
 			case CULL_CLIP:
@@ -132,6 +135,9 @@ static int R_CullModel( md3Header_t *header, const trRefEntity_t *ent, vec3_t bo
 				else if ( sphereCull == CULL_IN )
 				{
 					tr.pc.c_sphere_cull_md3_in++;
+					if ( R_OccludedLocalBox( (const vec3_t *)bounds ) ) {
+						return CULL_OUT;
+					}
 					return CULL_IN;
 				}
 				else
@@ -26,8 +26,168 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	LL(x) x=LittleLong(x)
 
 static qboolean R_LoadMD3(model_t *mod, int lod, void *buffer, int fileSize, const char *name );
+static void R_FinishMD3( model_t *mod, int lod );
 static qboolean R_LoadMDR(model_t *mod, void *buffer, int filesize, const char *name );
 
+/*
+==============================================================================
+
+MD3 CACHE
+
+Swapped and validated md3 data is kept outside of the hunk so map
+restarts and maps sharing player and item models don't have to read
+and check them again, everything is dropped once the search path
+changes because a name may resolve to a different file then
+
+==============================================================================
+*/
+
+#define MD3_CACHE_HASH_SIZE 256
+
+typedef struct md3Cache_s {
+	struct md3Cache_s	*next;		// hash chain
+	struct md3Cache_s	*newer;		// eviction order
+	char				name[MAX_QPATH+20];
+	int					size;
+	md3Header_t			*data;
+} md3Cache_t;
+
+static md3Cache_t	*md3CacheHash[MD3_CACHE_HASH_SIZE];
+static md3Cache_t	*md3CacheOldest;
+static md3Cache_t	*md3CacheNewest;
+static int			md3CacheSize;
+static int			md3CacheStamp;
+
+
+/*
+====================
+R_ClearModelCache
+====================
+*/
+void R_ClearModelCache( void ) {
+	md3Cache_t *entry, *next;
+
+	for ( entry = md3CacheOldest; entry; entry = next ) {
+		next = entry->newer;
+		ri.Free( entry );
+	}
+
+	Com_Memset( md3CacheHash, 0, sizeof( md3CacheHash ) );
+	md3CacheOldest = NULL;
+	md3CacheNewest = NULL;
+	md3CacheSize = 0;
+}
+
+
+/*
+====================
+R_ValidateModelCache
+====================
+*/
+static void R_ValidateModelCache( void ) {
+	const int stamp = ri.FS_LoadStamp();
+
+	if ( stamp != md3CacheStamp || r_modelCache->integer <= 0 ) {
+		R_ClearModelCache();
+		md3CacheStamp = stamp;
+	}
+}
+
+
+/*
+====================
+R_FindCachedMD3
+====================
+*/
+static const md3Cache_t *R_FindCachedMD3( const char *name ) {
+	const md3Cache_t *entry;
+
+	entry = md3CacheHash[ Com_GenerateHashValue( name, MD3_CACHE_HASH_SIZE ) ];
+	for ( ; entry; entry = entry->next ) {
+		if ( !Q_stricmp( entry->name, name ) ) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+====================
+R_EvictCachedMD3
+====================
+*/
+static void R_EvictCachedMD3( void ) {
+	md3Cache_t *entry, **prev;
+
+	entry = md3CacheOldest;
+	prev = &md3CacheHash[ Com_GenerateHashValue( entry->name, MD3_CACHE_HASH_SIZE ) ];
+	while ( *prev != entry ) {
+		prev = &(*prev)->next;
+	}
+	*prev = entry->next;
+
+	md3CacheOldest = entry->newer;
+	if ( !md3CacheOldest ) {
+		md3CacheNewest = NULL;
+	}
+
+	md3CacheSize -= entry->size;
+	ri.Free( entry );
+}
+
+
+/*
+====================
+R_CacheMD3
+
+Stores a swapped model before shaders are registered
+====================
+*/
+static void R_CacheMD3( const char *name, const md3Header_t *hdr ) {
+	const int limit = r_modelCache->integer * 1024 * 1024;
+	md3Cache_t *entry;
+	unsigned long hash;
+	int size;
+
+	size = hdr->ofsEnd;
+	if ( size > limit || strlen( name ) >= sizeof( entry->name ) ) {
+		return;
+	}
+
+	if ( R_FindCachedMD3( name ) ) {
+		return;
+	}
+
+	while ( md3CacheOldest && md3CacheSize + size > limit ) {
+		R_EvictCachedMD3();
+	}
+
+	entry = ri.MallocPersistent( sizeof( *entry ) + size );
+	Q_strncpyz( entry->name, name, sizeof( entry->name ) );
+	entry->size = size;
+	entry->data = (md3Header_t *)( entry + 1 );
+	Com_Memcpy( entry->data, hdr, size );
+
+	hash = Com_GenerateHashValue( name, MD3_CACHE_HASH_SIZE );
+	entry->next = md3CacheHash[ hash ];
+	md3CacheHash[ hash ] = entry;
+
+	entry->newer = NULL;
+	if ( md3CacheNewest ) {
+		md3CacheNewest->newer = entry;
+	} else {
+		md3CacheOldest = entry;
+	}
+	md3CacheNewest = entry;
+
+	md3CacheSize += size;
+}
+
+//=============================================================================
+
+
 /*
 ====================
 R_RegisterMD3
@@ -42,6 +202,7 @@ static qhandle_t R_RegisterMD3(const char *name, model_t *mod)
 	int			lod;
 	uint32_t	ident;
 	qboolean	loaded = qfalse;
+	const md3Cache_t *cached;
 	int			numLoaded;
 	int			fileSize;
 	char filename[MAX_QPATH], namebuf[MAX_QPATH+20];
@@ -49,6 +210,8 @@ static qhandle_t R_RegisterMD3(const char *name, model_t *mod)
 
 	numLoaded = 0;
 
+	R_ValidateModelCache();
+
 	strcpy(filename, name);
 
 	fext = strchr(filename, '.');
@@ -67,26 +230,42 @@ static qhandle_t R_RegisterMD3(const char *name, model_t *mod)
 		else
 			Com_sprintf(namebuf, sizeof(namebuf), "%s.%s", filename, fext);
 
-		fileSize = ri.FS_ReadFile( namebuf, &buf.v );
-		if ( !buf.v )
-			continue;
+		cached = R_FindCachedMD3( namebuf );
+		if ( cached )
+		{
+			mod->type = MOD_MESH;
+			mod->dataSize += cached->size;
+			mod->md3[lod] = ri.Hunk_Alloc( cached->size, h_low );
+			Com_Memcpy( mod->md3[lod], cached->data, cached->size );
+			loaded = qtrue;
+		}
+		else
+		{
+			fileSize = ri.FS_ReadFile( namebuf, &buf.v );
+			if ( !buf.v )
+				continue;
+
+			if ( fileSize < sizeof( md3Header_t ) ) {
+				ri.Printf( PRINT_WARNING, "%s: truncated header for %s\n", __func__, name );
+				ri.FS_FreeFile( buf.v );
+				break;
+			}
+
+			ident = LittleLong( *buf.u );
+			if ( ident == MD3_IDENT ) {
+				loaded = R_LoadMD3( mod, lod, buf.v, fileSize, name );
+				if ( loaded )
+					R_CacheMD3( namebuf, mod->md3[lod] );
+			}
+			else
+				ri.Printf( PRINT_WARNING,"%s: unknown fileid for %s\n", __func__, name );
 
-		if ( fileSize < sizeof( md3Header_t ) ) {
-			ri.Printf( PRINT_WARNING, "%s: truncated header for %s\n", __func__, name );
 			ri.FS_FreeFile( buf.v );
-			break;
 		}
-		
-		ident = LittleLong( *buf.u );
-		if ( ident == MD3_IDENT )
-			loaded = R_LoadMD3( mod, lod, buf.v, fileSize, name );
-		else
-			ri.Printf( PRINT_WARNING,"%s: unknown fileid for %s\n", __func__, name );
-		
-		ri.FS_FreeFile( buf.v );
 
 		if ( loaded )
 		{
+			R_FinishMD3( mod, lod );
 			mod->numLods++;
 			numLoaded++;
 		}
@@ -304,7 +483,7 @@ qhandle_t RE_RegisterModel( const char *name ) {
 	// only set the name after the model has been successfully loaded
 	Q_strncpyz( mod->name, name, sizeof( mod->name ) );
 
-	//R_IssuePendingRenderCommands();
+	R_SyncRenderThread();
 
 	mod->type = MOD_BAD;
 	mod->numLods = 0;
@@ -386,7 +565,6 @@ static qboolean R_LoadMD3( model_t *mod, int lod, void *buffer, int fileSize, co
 	md3Header_t			*pinmodel, *hdr;
 	md3Frame_t			*frame;
 	md3Surface_t		*surf;
-	md3Shader_t			*shader;
 	md3Triangle_t		*tri;
 	md3St_t				*st;
 	md3XyzNormal_t		*xyz;
@@ -549,22 +727,6 @@ static qboolean R_LoadMD3( model_t *mod, int lod, void *buffer, int fileSize, co
 			surf->name[j-2] = 0;
 		}
 
-		// register the shaders
-		shader = (md3Shader_t *) ( (byte *)surf + surf->ofsShaders );
-		for ( j = 0 ; j < surf->numShaders ; j++, shader++ ) {
-			shader_t	*sh;
-
-			// zero-terminate shader name
-			shader->name[sizeof( shader->name ) - 1] = '\0';
-
-			sh = R_FindShader( shader->name, LIGHTMAP_NONE, qtrue );
-			if ( sh->defaultShader ) {
-				shader->shaderIndex = 0;
-			} else {
-				shader->shaderIndex = sh->index;
-			}
-		}
-
 		// swap all the triangles
 		tri = (md3Triangle_t *) ( (byte *)surf + surf->ofsTriangles );
 		for ( j = 0 ; j < surf->numTriangles; j++, tri++ ) {
@@ -599,6 +761,49 @@ static qboolean R_LoadMD3( model_t *mod, int lod, void *buffer, int fileSize, co
 }
 
 
+/*
+=================
+R_FinishMD3
+
+Registers shaders and builds derived data of a swapped model,
+either freshly loaded or copied from the cache
+=================
+*/
+static void R_FinishMD3( model_t *mod, int lod ) {
+	md3Header_t			*hdr;
+	md3Surface_t		*surf;
+	md3Shader_t			*shader;
+	shader_t			*sh;
+	int					i, j;
+
+	hdr = mod->md3[lod];
+
+	surf = (md3Surface_t *) ( (byte *)hdr + hdr->ofsSurfaces );
+	for ( i = 0 ; i < hdr->numSurfaces; i++) {
+
+		// register the shaders
+		shader = (md3Shader_t *) ( (byte *)surf + surf->ofsShaders );
+		for ( j = 0 ; j < surf->numShaders ; j++, shader++ ) {
+
+			// zero-terminate shader name
+			shader->name[sizeof( shader->name ) - 1] = '\0';
+
+			sh = R_FindShader( shader->name, LIGHTMAP_NONE, qtrue );
+			if ( sh->defaultShader ) {
+				shader->shaderIndex = 0;
+			} else {
+				shader->shaderIndex = sh->index;
+			}
+		}
+
+		R_BuildShadowEdges( surf );
+
+		// find the next surface
+		surf = (md3Surface_t *)( (byte *)surf + surf->ofsEnd );
+	}
+}
+
+
 /*
 =================
 R_LoadMDR
@@ -952,9 +1157,11 @@ void RE_BeginRegistration( glconfig_t *glconfigOut ) {
 
 	*glconfigOut = glConfig;
 
-	//R_IssuePendingRenderCommands();
+	R_SyncRenderThread();
 
 	tr.viewCluster = -1;		// force markleafs to regenerate
+	tr.visSlotCluster[ VIS_SLOT_MAIN ] = -1;
+	tr.visSlotCluster[ VIS_SLOT_PORTAL ] = -1;
 	R_ClearFlares();
 	RE_ClearScene();
 
@@ -974,6 +1181,10 @@ void R_ModelInit( void ) {
 	// leave a space for NULL model
 	tr.numModels = 0;
 
+	R_IQMClearPoseCache();
+
+	R_ClearShadowEdges();
+
 	mod = R_AllocModel();
 	mod->type = MOD_BAD;
 }
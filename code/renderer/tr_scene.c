@@ -47,6 +47,12 @@ R_InitNextFrame
 */
 void R_InitNextFrame( void ) {
 
+	// switch to the buffer that isn't being rendered
+	if ( backEndFrames[ 1 ] ) {
+		tr.smpFrame ^= 1;
+		backEndData = backEndFrames[ tr.smpFrame ];
+	}
+
 	backEndData->commands.used = 0;
 
 	r_firstSceneDrawSurf = 0;
@@ -378,7 +384,7 @@ to handle mirrors,
 */
 void RE_RenderScene( const refdef_t *fd ) {
 	viewParms_t		parms;
-	int				startTime;
+	int64_t			startTime;
 
 	if ( !tr.registered ) {
 		return;
@@ -388,7 +394,7 @@ void RE_RenderScene( const refdef_t *fd ) {
 		return;
 	}
 
-	startTime = ri.Milliseconds();
+	startTime = ri.Microseconds();
 
 	if (!tr.world && !( fd->rdflags & RDF_NOWORLDMODEL ) ) {
 		ri.Error (ERR_DROP, "R_RenderScene: NULL worldmodel");
@@ -515,5 +521,5 @@ void RE_RenderScene( const refdef_t *fd ) {
 	r_firstSceneDlight = r_numdlights;
 	r_firstScenePoly = r_numpolys;
 
-	tr.frontEndMsec += ri.Milliseconds() - startTime;
+	tr.frontEndUsec += (int)( ri.Microseconds() - startTime );
 }
@@ -31,16 +31,94 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 
+#ifdef USE_VBO
+static const glIndex_t *streamIndexes;
+static int streamNumIndexes;
+static int streamIndexOffset;
+#endif
+
+
+/*
+==================
+R_StreamIndexes
+
+Copies indexes into the stream buffer, R_DrawElements() will draw
+from that copy until next call, NULL stops it
+==================
+*/
+void R_StreamIndexes( const glIndex_t *indexes, int numIndexes ) {
+#ifdef USE_VBO
+	streamIndexes = NULL;
+	if ( indexes ) {
+		streamIndexOffset = VBO_StreamData( indexes, numIndexes * sizeof( glIndex_t ) );
+		if ( streamIndexOffset >= 0 ) {
+			streamIndexes = indexes;
+			streamNumIndexes = numIndexes;
+		}
+	}
+#endif
+}
+
+
 /*
 ==================
 R_DrawElements
 ==================
 */
 void R_DrawElements( int numIndexes, const glIndex_t *indexes ) {
+#ifdef USE_VBO
+	if ( indexes == streamIndexes && numIndexes <= streamNumIndexes ) {
+		qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, VBO_StreamBuffer() );
+		qglDrawElements( GL_TRIANGLES, numIndexes, GL_INDEX_TYPE, (const GLvoid *)(intptr_t)streamIndexOffset );
+		qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, 0 );
+		return;
+	}
+#endif
 	qglDrawElements( GL_TRIANGLES, numIndexes, GL_INDEX_TYPE, indexes );
 }
 
 
+/*
+==================
+R_ArrayPointer
+
+Sets array pointer of count elements, data is sourced from
+the stream buffer when possible
+==================
+*/
+void R_ArrayPointer( GLenum array, GLint size, GLenum type, GLsizei stride, const void *data, int count ) {
+	const GLvoid *ptr = data;
+#ifdef USE_VBO
+	int elemSize, offset;
+
+	elemSize = stride ? stride : size * ( type == GL_FLOAT ? sizeof( GLfloat ) : sizeof( GLubyte ) );
+	offset = VBO_StreamData( data, elemSize * count );
+	if ( offset >= 0 ) {
+		qglBindBufferARB( GL_ARRAY_BUFFER_ARB, VBO_StreamBuffer() );
+		ptr = (const GLvoid *)(intptr_t)offset;
+	}
+#endif
+
+	switch ( array ) {
+		case GL_VERTEX_ARRAY:
+			qglVertexPointer( size, type, stride, ptr );
+			break;
+		case GL_COLOR_ARRAY:
+			qglColorPointer( size, type, stride, ptr );
+			break;
+		default:
+			qglTexCoordPointer( size, type, stride, ptr );
+			break;
+	}
+
+#ifdef USE_VBO
+	if ( ptr != data ) {
+		qglBindBufferARB( GL_ARRAY_BUFFER_ARB, VBO_Active() );
+	}
+#endif
+}
+
+
 /*
 =============================================================
 
@@ -62,8 +140,10 @@ void R_BindAnimatedImage( const textureBundle_t *bundle ) {
 	double	v;
 
 	if ( bundle->isVideoMap ) {
-		ri.CIN_RunCinematic(bundle->videoMapHandle);
-		ri.CIN_UploadCinematic(bundle->videoMapHandle);
+		if ( !R_DeferCinematic( bundle->videoMapHandle ) ) {
+			ri.CIN_RunCinematic(bundle->videoMapHandle);
+			ri.CIN_UploadCinematic(bundle->videoMapHandle);
+		}
 		return;
 	}
 
@@ -278,11 +358,11 @@ static void DrawMultitextured( const shaderCommands_t *input, int stage ) {
 		R_ComputeTexCoords( 1, &pStage->bundle[1] );
 		GL_ClientState( 0, CLS_TEXCOORD_ARRAY | CLS_COLOR_ARRAY );
 
-		qglTexCoordPointer( 2, GL_FLOAT, 0, input->svars.texcoordPtr[0] );
-		qglColorPointer( 4, GL_UNSIGNED_BYTE, 0, input->svars.colors[0].rgba );
+		R_ArrayPointer( GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 0, input->svars.texcoordPtr[0], input->numVertexes );
+		R_ArrayPointer( GL_COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, 0, input->svars.colors[0].rgba, input->numVertexes );
 
 		GL_ClientState( 1, CLS_TEXCOORD_ARRAY );
-		qglTexCoordPointer( 2, GL_FLOAT, 0, input->svars.texcoordPtr[1] );
+		R_ArrayPointer( GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 0, input->svars.texcoordPtr[1], input->numVertexes );
 	}
 
 	//
@@ -486,8 +566,8 @@ static void RB_FogPass( void ) {
 	GL_ClientState( 1, CLS_NONE );
 	GL_ClientState( 0, CLS_TEXCOORD_ARRAY | CLS_COLOR_ARRAY );
 
-	qglColorPointer( 4, GL_UNSIGNED_BYTE, 0, tess.svars.colors[0].rgba );
-	qglTexCoordPointer( 2, GL_FLOAT, 0, tess.svars.texcoords[0] );
+	R_ArrayPointer( GL_COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, 0, tess.svars.colors[0].rgba, tess.numVertexes );
+	R_ArrayPointer( GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 0, tess.svars.texcoords[0], tess.numVertexes );
 
 	GL_SelectTexture( 0 );
 	GL_Bind( tr.fogImage );
@@ -845,8 +925,8 @@ static void RB_IterateStagesGeneric( const shaderCommands_t *input )
 				GL_ClientState( 1, CLS_NONE );
 				GL_ClientState( 0, CLS_TEXCOORD_ARRAY | CLS_COLOR_ARRAY );
 
-				qglTexCoordPointer( 2, GL_FLOAT, 0, input->svars.texcoordPtr[0] );
-				qglColorPointer( 4, GL_UNSIGNED_BYTE, 0, input->svars.colors[0].rgba );
+				R_ArrayPointer( GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 0, input->svars.texcoordPtr[0], input->numVertexes );
+				R_ArrayPointer( GL_COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, 0, input->svars.colors[0].rgba, input->numVertexes );
 			}
 
 			//
@@ -944,14 +1024,14 @@ void RB_StageIteratorGeneric( void )
 		if ( tess.xstages[0] )
 		{
 			R_ComputeColors( tess.xstages[0] );
-			qglColorPointer( 4, GL_UNSIGNED_BYTE, 0, tess.svars.colors[0].rgba );
+			R_ArrayPointer( GL_COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, 0, tess.svars.colors[0].rgba, tess.numVertexes );
 			R_ComputeTexCoords( 0, &tess.xstages[0]->bundle[0] );
-			qglTexCoordPointer( 2, GL_FLOAT, 0, tess.svars.texcoordPtr[0] );
+			R_ArrayPointer( GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 0, tess.svars.texcoordPtr[0], tess.numVertexes );
 			if ( shader->multitextureEnv )
 			{
 				GL_ClientState( 1, CLS_TEXCOORD_ARRAY );
 				R_ComputeTexCoords( 1, &tess.xstages[0]->bundle[1] );
-				qglTexCoordPointer( 2, GL_FLOAT, 0, tess.svars.texcoordPtr[1] );
+				R_ArrayPointer( GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 0, tess.svars.texcoordPtr[1], tess.numVertexes );
 			}
 			else
 			{
@@ -960,7 +1040,9 @@ void RB_StageIteratorGeneric( void )
 		}
 	}
 
-	qglVertexPointer( 3, GL_FLOAT, sizeof( input->xyz[0] ), input->xyz ); // padded for SIMD
+	R_ArrayPointer( GL_VERTEX_ARRAY, 3, GL_FLOAT, sizeof( input->xyz[0] ), input->xyz, input->numVertexes ); // padded for SIMD
+
+	R_StreamIndexes( input->indexes, input->numIndexes );
 
 	//
 	// lock XYZ
@@ -1004,6 +1086,8 @@ void RB_StageIteratorGeneric( void )
 		qglUnlockArraysEXT();
 	}
 
+	R_StreamIndexes( NULL, 0 );
+
 	GL_ClientState( 1, CLS_NONE );
 
 	//
@@ -130,6 +130,11 @@ static void RB_CalcDeformVertexes( deformStage_t *ds )
 	{
 		scale = EvalWaveForm( &ds->deformationWave );
 
+#ifdef USE_SIMD_SHADE
+		R_DeformVertexesSSE2( xyz, normal, tess.numVertexes, scale );
+		return;
+#endif
+
 		for ( i = 0; i < tess.numVertexes; i++, xyz += 4, normal += 4 )
 		{
 			VectorScale( normal, scale, offset );
@@ -1041,6 +1046,11 @@ void RB_CalcEnvironmentTexCoords( float *st )
 	v = tess.xyz[0];
 	normal = tess.normal[0];
 
+#ifdef USE_SIMD_SHADE
+	R_EnvironmentTexCoordsSSE2( v, normal, st, tess.numVertexes, backEnd.or.viewOrigin );
+	return;
+#endif
+
 	for (i = 0 ; i < tess.numVertexes ; i++, v += 4, normal += 4, st += 2 ) 
 	{
 		VectorSubtract (backEnd.or.viewOrigin, v, viewer);
@@ -1083,6 +1093,11 @@ void RB_CalcScaleTexCoords( const float scale[2], float *src, float *dst )
 {
 	int i;
 
+#ifdef USE_SIMD_SHADE
+	R_ScaleTexCoordsSSE2( src, dst, tess.numVertexes, scale );
+	return;
+#endif
+
 	for ( i = 0; i < tess.numVertexes; i++, dst += 2, src += 2 )
 	{
 		dst[0] = src[0] * scale[0];
@@ -1110,6 +1125,11 @@ void RB_CalcScrollTexCoords( const float scrollSpeed[2], float *src, float *dst
 	adjustedScrollS = adjustedScrollS - floor( adjustedScrollS );
 	adjustedScrollT = adjustedScrollT - floor( adjustedScrollT );
 
+#ifdef USE_SIMD_SHADE
+	R_ScrollTexCoordsSSE2( src, dst, tess.numVertexes, adjustedScrollS, adjustedScrollT );
+	return;
+#endif
+
 	for ( i = 0; i < tess.numVertexes; i++, dst += 2, src += 2 )
 	{
 		dst[0] = src[0] + adjustedScrollS;
@@ -1125,6 +1145,11 @@ void RB_CalcTransformTexCoords( const texModInfo_t *tmi, float *src, float *dst
 {
 	int i;
 
+#ifdef USE_SIMD_SHADE
+	R_TransformTexCoordsSSE2( src, dst, tess.numVertexes, tmi->matrix, tmi->translate );
+	return;
+#endif
+
 	for ( i = 0; i < tess.numVertexes; i++, dst += 2, src += 2 )
 	{
 		const float s = src[0];
@@ -1230,7 +1255,7 @@ void RB_CalcSpecularAlpha( unsigned char *alphas ) {
 **
 ** The basic vertex lighting calc
 */
-static void RB_CalcDiffuseColor_scalar( unsigned char *colors )
+static void RB_CalcDiffuseColor_scalar( int firstVertex, int numVertexes, unsigned char *colors )
 {
 	int				i, j;
 	float			*v, *normal;
@@ -1240,17 +1265,15 @@ static void RB_CalcDiffuseColor_scalar( unsigned char *colors )
 	vec3_t			ambientLight;
 	vec3_t			lightDir;
 	vec3_t			directedLight;
-	int				numVertexes;
 	ent = backEnd.currentEntity;
 	ambientLightInt = ent->ambientLightInt;
 	VectorCopy( ent->ambientLight, ambientLight );
 	VectorCopy( ent->directedLight, directedLight );
 	VectorCopy( ent->lightDir, lightDir );
 
-	v = tess.xyz[0];
-	normal = tess.normal[0];
+	v = tess.xyz[firstVertex];
+	normal = tess.normal[firstVertex];
 
-	numVertexes = tess.numVertexes;
 	for (i = 0 ; i < numVertexes ; i++, v += 4, normal += 4) {
 		incoming = DotProduct (normal, lightDir);
 		if ( incoming <= 0 ) {
@@ -1282,5 +1305,22 @@ static void RB_CalcDiffuseColor_scalar( unsigned char *colors )
 
 void RB_CalcDiffuseColor( unsigned char *colors )
 {
-	RB_CalcDiffuseColor_scalar( colors );
+	if ( tess.instanced ) {
+		// already lit by RB_CalcDiffuseColorVertexes
+		Com_Memcpy( colors, tess.vertexColors, tess.numVertexes * sizeof( tess.vertexColors[0] ) );
+		return;
+	}
+
+	RB_CalcDiffuseColor_scalar( 0, tess.numVertexes, colors );
+}
+
+
+/*
+** RB_CalcDiffuseColorVertexes
+**
+** Lights a range of vertexes into tess.vertexColors for instanced batches
+*/
+void RB_CalcDiffuseColorVertexes( int firstVertex, int numVertexes )
+{
+	RB_CalcDiffuseColor_scalar( firstVertex, numVertexes, tess.vertexColors[firstVertex].rgba );
 }
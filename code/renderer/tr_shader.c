@@ -37,8 +37,18 @@ static	texModInfo_t	texMods[MAX_SHADER_STAGES][TR_MAX_TEXMODS+1]; // reserve one
 #define FILE_HASH_SIZE		1024
 static	shader_t*		hashTable[FILE_HASH_SIZE];
 
-#define MAX_SHADERTEXT_HASH		2048
-static const char **shaderTextHashTable[MAX_SHADERTEXT_HASH];
+// index of shader names in s_shaderText, built once by ScanAndLoadShaderFiles
+typedef struct shaderTextEntry_s {
+	const char	*name;		// name token
+	const char	*body;		// text after the name
+	unsigned long	hash;
+	struct shaderTextEntry_s *next;
+} shaderTextEntry_t;
+
+#define MIN_SHADERTEXT_HASH		2048
+#define SHADERTEXT_FULL_HASH	0x80000000U
+static shaderTextEntry_t **shaderTextHashTable;
+static unsigned int shaderTextHashSize;
 
 /*
 ================
@@ -57,6 +67,9 @@ void RE_RemapShader(const char *shaderName, const char *newShaderName, const cha
 	shader_t	*sh, *sh2;
 	qhandle_t	h;
 
+	// back end reads remappedShader
+	R_SyncRenderThread();
+
 	sh = R_FindShaderByName( shaderName );
 	if (sh == NULL || sh == tr.defaultShader) {
 		h = RE_RegisterShaderLightMap(shaderName, 0);
@@ -2488,6 +2501,9 @@ static shader_t *GeneratePermanentShader( void ) {
 	int			i, b;
 	int			size, hash;
 
+	// sorted shader indexes are about to change
+	R_SyncRenderThread();
+
 	if ( tr.numShaders >= MAX_SHADERS ) {
 		ri.Printf( PRINT_WARNING, "WARNING: GeneratePermanentShader - MAX_SHADERS hit\n");
 		return tr.defaultShader;
@@ -2701,6 +2717,71 @@ static void DetectNeeds( void )
 }
 
 
+/*
+=========================
+ComputeInstancing
+
+Checks if surfaces of several entities may be drawn in world space
+as one batch, see RB_SurfaceInstanced
+=========================
+*/
+static int ComputeInstancing( void ) {
+	const textureBundle_t *bundle;
+	qboolean lit;
+	int i, n, m;
+
+	if ( shader.numDeforms || shader.isSky || shader.entityMergable || shader.sort == SS_PORTAL || !stages[0].active ) {
+		return INSTANCE_NONE;
+	}
+
+	lit = qfalse;
+
+	for ( i = 0; i < MAX_SHADER_STAGES; i++ ) {
+		if ( !stages[i].active ) {
+			break;
+		}
+		for ( n = 0; n < NUM_TEXTURE_BUNDLES; n++ ) {
+			bundle = &stages[i].bundle[n];
+			if ( n > 0 && !bundle->image[0] ) {
+				continue;
+			}
+			switch ( stages[i].rgbGen ) {
+				case CGEN_IDENTITY:
+				case CGEN_IDENTITY_LIGHTING:
+				case CGEN_WAVEFORM:
+				case CGEN_CONST:
+					break;
+				case CGEN_LIGHTING_DIFFUSE:
+					lit = qtrue;
+					break;
+				default:
+					return INSTANCE_NONE;
+			}
+			switch ( stages[i].alphaGen ) {
+				case AGEN_IDENTITY:
+				case AGEN_SKIP:
+				case AGEN_WAVEFORM:
+				case AGEN_CONST:
+					break;
+				default:
+					return INSTANCE_NONE;
+			}
+			if ( bundle->tcGen != TCGEN_TEXTURE && bundle->tcGen != TCGEN_IDENTITY ) {
+				return INSTANCE_NONE;
+			}
+			for ( m = 0; m < bundle->numTexMods; m++ ) {
+				// both use model space positions
+				if ( bundle->texMods[m].type == TMOD_ENTITY_TRANSLATE || bundle->texMods[m].type == TMOD_TURBULENT ) {
+					return INSTANCE_NONE;
+				}
+			}
+		}
+	}
+
+	return lit ? INSTANCE_LIT : INSTANCE_UNLIT;
+}
+
+
 /*
 =========================
 FinishShader
@@ -2956,6 +3037,8 @@ static shader_t *FinishShader( void ) {
 	// determine which stage iterator function is appropriate
 	ComputeStageIteratorFunc();
 
+	shader.instancing = ComputeInstancing();
+
 	return GeneratePermanentShader();
 }
 
@@ -2974,25 +3057,95 @@ If found, it will return a valid shader
 =====================
 */
 static const char *FindShaderInShaderText( const char *shadername ) {
+	const shaderTextEntry_t *entry;
 	const char *token, *p;
-	int i, hash;
+	unsigned long hash;
+
+	if ( !shaderTextHashTable )
+		return NULL;
 
-	hash = generateHashValue( shadername, MAX_SHADERTEXT_HASH );
+	hash = generateHashValue( shadername, SHADERTEXT_FULL_HASH );
 
-	if( shaderTextHashTable[hash] )
+	for ( entry = shaderTextHashTable[ hash & ( shaderTextHashSize - 1 ) ]; entry; entry = entry->next )
 	{
-		for (i = 0; shaderTextHashTable[hash][i]; i++)
-		{
-			p = shaderTextHashTable[hash][i];
-			token = COM_ParseExt( &p, qtrue );
-			if( !Q_stricmp( token, shadername ) )
-				return p;
-		}
+		if ( entry->hash != hash )
+			continue;
+		p = entry->name;
+		token = COM_ParseExt( &p, qtrue );
+		if ( !Q_stricmp( token, shadername ) )
+			return entry->body;
 	}
 	return NULL;
 }
 
 
+/*
+===============
+R_PrefetchShaderImages
+
+Collects images of the stages of given shaders and
+decodes them ahead of the shaders being parsed
+===============
+*/
+void R_PrefetchShaderImages( const dshader_t *shaders, int count )
+{
+	char	strippedName[ MAX_QPATH ];
+	char	(*names)[ MAX_QPATH ];
+	const char *text, *token;
+	int		i, n, depth;
+
+	if ( !r_imagePrefetch->integer ) {
+		return;
+	}
+
+	names = ri.Hunk_AllocateTempMemory( MAX_PREFETCH_IMAGES * sizeof( *names ) );
+	n = 0;
+
+	for ( i = 0; i < count && n < MAX_PREFETCH_IMAGES; i++ ) {
+		COM_StripExtension( shaders[i].shader, strippedName, sizeof( strippedName ) );
+		text = FindShaderInShaderText( strippedName );
+		if ( !text ) {
+			// implicit shader of a single image
+			Q_strncpyz( names[ n++ ], shaders[i].shader, sizeof( names[0] ) );
+			continue;
+		}
+
+		depth = 0;
+		while ( n < MAX_PREFETCH_IMAGES ) {
+			token = COM_ParseExt( &text, qtrue );
+			if ( !token[0] ) {
+				break;
+			}
+			if ( token[0] == '{' ) {
+				depth++;
+			} else if ( token[0] == '}' ) {
+				if ( --depth <= 0 ) {
+					break;
+				}
+			} else if ( !Q_stricmp( token, "map" ) || !Q_stricmp( token, "clampmap" ) ) {
+				token = COM_ParseExt( &text, qfalse );
+				if ( token[0] ) {
+					Q_strncpyz( names[ n++ ], token, sizeof( names[0] ) );
+				}
+			} else if ( !Q_stricmp( token, "animMap" ) ) {
+				COM_ParseExt( &text, qfalse ); // frequency
+				while ( n < MAX_PREFETCH_IMAGES ) {
+					token = COM_ParseExt( &text, qfalse );
+					if ( !token[0] ) {
+						break;
+					}
+					Q_strncpyz( names[ n++ ], token, sizeof( names[0] ) );
+				}
+			}
+		}
+	}
+
+	R_PrefetchImages( names, n );
+
+	ri.Hunk_FreeTempMemory( names );
+}
+
+
 /*
 ==================
 R_FindShaderByName
@@ -3262,6 +3415,79 @@ qhandle_t RE_RegisterShaderFromImage(const char *name, int lightmapIndex, image_
 	return sh->index;
 }
 
+/*
+====================
+RE_RegisterFontAtlas
+
+Packs the glyph pages of a font into one image laid out as a square
+grid, so text is drawn with a single shader. Returns 0 if any page has
+a shader script, can't be loaded or differs in size from the others.
+====================
+*/
+qhandle_t RE_RegisterFontAtlas( const char *name, const qhandle_t *pages, int numPages, int *columns ) {
+	const shader_t *sh;
+	image_t *image;
+	byte *pic, *atlas;
+	int width, height, pageSize;
+	int i, y, size, x0, y0;
+
+	atlas = NULL;
+	pageSize = 0;
+	size = 0;
+
+	for ( *columns = 1; *columns * *columns < numPages; *columns <<= 1 )
+		;
+
+	for ( i = 0; i < numPages; i++ ) {
+		sh = R_GetShaderByHandle( pages[ i ] );
+		if ( sh->explicitlyDefined || sh->defaultShader ) {
+			break;
+		}
+
+		R_LoadImage( sh->name, &pic, &width, &height );
+		if ( pic == NULL ) {
+			break;
+		}
+
+		if ( atlas == NULL ) {
+			pageSize = width;
+			size = pageSize * *columns;
+			if ( width != height || size > glConfig.maxTextureSize ) {
+				ri.Free( pic );
+				break;
+			}
+			atlas = ri.Malloc( size * size * 4 );
+			Com_Memset( atlas, 0, size * size * 4 );
+		}
+
+		if ( width != pageSize || height != pageSize ) {
+			ri.Free( pic );
+			break;
+		}
+
+		x0 = ( i % *columns ) * pageSize;
+		y0 = ( i / *columns ) * pageSize;
+		for ( y = 0; y < pageSize; y++ ) {
+			Com_Memcpy( atlas + ( ( y0 + y ) * size + x0 ) * 4, pic + y * pageSize * 4, pageSize * 4 );
+		}
+
+		ri.Free( pic );
+	}
+
+	if ( i < numPages ) {
+		if ( atlas ) {
+			ri.Free( atlas );
+		}
+		return 0;
+	}
+
+	image = R_CreateImage( name, NULL, atlas, size, size, IMGFLAG_CLAMPTOEDGE );
+	ri.Free( atlas );
+
+	return RE_RegisterShaderFromImage( name, LIGHTMAP_2D, image, qfalse );
+}
+
+
 
 /*
 ====================
@@ -3448,6 +3674,9 @@ void	R_ShaderList_f (void) {
 
 #define	MAX_SHADER_FILES 16384
 
+// shader files read ahead on filesystem I/O threads while parsing
+#define	SHADER_READ_AHEAD 16
+
 static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char **buffers )
 {
 	char filename[MAX_QPATH+8];
@@ -3455,19 +3684,42 @@ static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char
 	const char *p, *token;
 	long summand, sum = 0;
 	int shaderLine;
-	int i;
+	int i, j, readAhead;
+	int handles[SHADER_READ_AHEAD];
 	const char *shaderStart;
 	qboolean denyErrors;
 
+	// files are requested in order so that their temp memory stays in stack order
+	for ( readAhead = 0; readAhead < numShaderFiles && readAhead < SHADER_READ_AHEAD; readAhead++ )
+	{
+		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[readAhead] );
+		handles[readAhead] = ri.FS_ReadFileAsync( filename );
+	}
+
 	// load and parse shader files
 	for ( i = 0; i < numShaderFiles; i++ )
 	{
+		summand = ri.FS_WaitFile( handles[i % SHADER_READ_AHEAD], (void **)&buffers[i] );
+
+		if ( readAhead < numShaderFiles )
+		{
+			Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[readAhead] );
+			handles[readAhead % SHADER_READ_AHEAD] = ri.FS_ReadFileAsync( filename );
+			readAhead++;
+		}
+
 		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
 		//ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", filename );
-		summand = ri.FS_ReadFile( filename, (void **)&buffers[i] );
 
 		if ( !buffers[i] )
+		{
+			// complete pending reads before dropping
+			for ( j = i + 1; j < readAhead; j++ )
+			{
+				ri.FS_WaitFile( handles[j % SHADER_READ_AHEAD], (void **)&buffers[j] );
+			}
 			ri.Error( ERR_DROP, "Couldn't load %s", filename );
+		}
 
 		// comment some buggy shaders from pak0
 		if ( summand == 35910 && strcmp( shaderFiles[i], "sky.shader" ) == 0 )
@@ -3519,8 +3771,9 @@ static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char
 				if ( denyErrors || !p )
 				{
 					ri.Printf( PRINT_WARNING, "Ignoring entire file '%s' due to error.\n", filename );
-					ri.FS_FreeFile( buffers[i] );
-					buffers[i] = NULL;
+					// freed with other files to keep temp memory in stack order
+					buffers[i][0] = '\0';
+					shaderStart = NULL;
 					break;
 				}
 
@@ -3533,8 +3786,9 @@ static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char
 			{
 				ri.Printf(PRINT_WARNING, "WARNING: Ignoring shader file %s. Shader \"%s\" " \
 					"on line %d missing closing brace.\n", filename, shaderName, shaderLine );
-				ri.FS_FreeFile( buffers[i] );
-				buffers[i] = NULL;
+				// freed with other files to keep temp memory in stack order
+				buffers[i][0] = '\0';
+				shaderStart = NULL;
 				break;
 			}
 
@@ -3572,13 +3826,19 @@ static void ScanAndLoadShaderFiles( void )
 	char *xbuffers[MAX_SHADER_FILES];
 	int numShaderFiles, numShaderxFiles;
 	int i;
-	const char *token, *hashMem;
+	const char *token;
 	char *textEnd;
 	const char *p, *oldp;
-	int shaderTextHashTableSizes[MAX_SHADERTEXT_HASH], hash, size;
+	shaderTextEntry_t *entry;
+	unsigned long hash;
+	int count;
 
 	long sum = 0;
 
+	// previous index went away with the hunk
+	shaderTextHashTable = NULL;
+	shaderTextHashSize = 0;
+
 	// scan for legacy shader files
 	shaderFiles = ri.FS_ListFiles( "scripts", ".shader", &numShaderFiles );
 
@@ -3642,42 +3902,42 @@ static void ScanAndLoadShaderFiles( void )
 		ri.FS_FreeFileList( shaderFiles );
 
 	//COM_Compress( s_shaderText );
-	Com_Memset( shaderTextHashTableSizes, 0, sizeof( shaderTextHashTableSizes ) );
-	size = 0;
+	count = 0;
 
 	p = s_shaderText;
-	// look for shader names
+	// count shader names
 	while ( 1 ) {
 		token = COM_ParseExt( &p, qtrue );
 		if ( token[0] == 0 ) {
 			break;
 		}
-		hash = generateHashValue(token, MAX_SHADERTEXT_HASH);
-		shaderTextHashTableSizes[hash]++;
-		size++;
+		count++;
 		SkipBracedSection(&p, 0);
 	}
 
-	size += MAX_SHADERTEXT_HASH;
+	// keep chains short with large texture packs
+	shaderTextHashSize = MIN_SHADERTEXT_HASH;
+	while ( shaderTextHashSize < count )
+		shaderTextHashSize <<= 1;
 
-	hashMem = ri.Hunk_Alloc( size * sizeof(char *), h_low );
-
-	for (i = 0; i < MAX_SHADERTEXT_HASH; i++) {
-		shaderTextHashTable[i] = (const char **) hashMem;
-		hashMem = ((char *) hashMem) + ((shaderTextHashTableSizes[i] + 1) * sizeof(char *));
-	}
+	shaderTextHashTable = ri.Hunk_Alloc( shaderTextHashSize * sizeof( *shaderTextHashTable ) + count * sizeof( *entry ), h_low );
+	entry = (shaderTextEntry_t *)( shaderTextHashTable + shaderTextHashSize );
 
 	p = s_shaderText;
-	// look for shader names
-	while ( 1 ) {
+	// look for shader names, later definitions are linked first and win
+	for ( i = 0; i < count; i++, entry++ ) {
 		oldp = p;
 		token = COM_ParseExt( &p, qtrue );
 		if ( token[0] == 0 ) {
 			break;
 		}
 
-		hash = generateHashValue(token, MAX_SHADERTEXT_HASH);
-		shaderTextHashTable[hash][--shaderTextHashTableSizes[hash]] = (char*)oldp;
+		hash = generateHashValue( token, SHADERTEXT_FULL_HASH );
+		entry->name = oldp;
+		entry->body = p;
+		entry->hash = hash;
+		entry->next = shaderTextHashTable[ hash & ( shaderTextHashSize - 1 ) ];
+		shaderTextHashTable[ hash & ( shaderTextHashSize - 1 ) ] = entry;
 
 		SkipBracedSection(&p, 0);
 	}
@@ -59,6 +59,30 @@ static void R_AddEdgeDef( int i1, int i2, int f ) {
 }
 
 
+/*
+=================
+R_AddSilEdge
+
+Extrudes a silhouette edge into a quad of the shadow volume
+=================
+*/
+static qboolean R_AddSilEdge( int i, int i2 ) {
+	if ( tess.numIndexes > ARRAY_LEN( tess.indexes ) - 6 ) {
+		return qfalse;
+	}
+
+	tess.indexes[ tess.numIndexes + 0 ] = i;
+	tess.indexes[ tess.numIndexes + 1 ] = i + tess.numVertexes;
+	tess.indexes[ tess.numIndexes + 2 ] = i2;
+	tess.indexes[ tess.numIndexes + 3 ] = i2;
+	tess.indexes[ tess.numIndexes + 4 ] = i + tess.numVertexes;
+	tess.indexes[ tess.numIndexes + 5 ] = i2 + tess.numVertexes;
+	tess.numIndexes += 6;
+
+	return qtrue;
+}
+
+
 static void R_CalcShadowEdges( void ) {
 	qboolean sil_edge;
 	int		i;
@@ -92,23 +116,354 @@ static void R_CalcShadowEdges( void ) {
 			// if it doesn't share the edge with another front facing
 			// triangle, it is a sil edge
 			if ( sil_edge ) {
-				if ( tess.numIndexes > ARRAY_LEN( tess.indexes ) - 6 ) {
+				if ( !R_AddSilEdge( i, i2 ) ) {
 					i = tess.numVertexes;
 					break;
 				}
-				tess.indexes[ tess.numIndexes + 0 ] = i;
-				tess.indexes[ tess.numIndexes + 1 ] = i + tess.numVertexes;
-				tess.indexes[ tess.numIndexes + 2 ] = i2;
-				tess.indexes[ tess.numIndexes + 3 ] = i2;
-				tess.indexes[ tess.numIndexes + 4 ] = i + tess.numVertexes;
-				tess.indexes[ tess.numIndexes + 5 ] = i2 + tess.numVertexes;
-				tess.numIndexes += 6;
 			}
 		}
 	}
 }
 
 
+/*
+==============================================================================
+
+CACHED SHADOW EDGES
+
+Triangle connectivity of every MD3 surface is found once at load time.
+Each triangle edge keeps the triangle on its reverse side, edges shared
+by more than two triangles keep the first one found, so silhouettes are
+extracted without rebuilding per-vertex edge lists every frame.
+
+Silhouettes of entities whose frame, surfaces and light direction have
+not changed since a recent frame are taken from a small cache.
+
+==============================================================================
+*/
+
+#define SHADOW_EDGES_HASH		1024
+#define MAX_SHADOW_SURFS		64
+
+#define SHADOW_CACHE_ENTRIES	64
+#define SHADOW_CACHE_SURFS		8
+#define SHADOW_CACHE_INDEXES	(256*1024)
+
+typedef struct shadowEdges_s {
+	const md3Surface_t		*surface;
+	int						*neighbors;		// numTriangles*3, -1 for open edges
+	struct shadowEdges_s	*next;
+} shadowEdges_t;
+
+typedef struct {
+	const md3Surface_t	*surface;
+	const int			*neighbors;
+	int					firstVertex;
+	int					firstTriangle;
+} shadowSurf_t;
+
+typedef struct {
+	const md3Surface_t	*surfaces[ SHADOW_CACHE_SURFS ];
+	int			numSurfaces;
+	int			frame;
+	int			oldframe;
+	float		backlerp;
+	vec3_t		lightDir;
+	int			firstIndex;
+	int			numIndexes;
+} shadowCache_t;
+
+static shadowEdges_t	*shadowEdgesHash[ SHADOW_EDGES_HASH ];
+
+static shadowSurf_t		shadowSurfs[ MAX_SHADOW_SURFS ];
+static int				numShadowSurfs;
+
+static shadowCache_t	shadowCache[ SHADOW_CACHE_ENTRIES ];
+static glIndex_t		shadowCacheIndexes[ SHADOW_CACHE_INDEXES ];
+static int				shadowCacheNext;
+static int				shadowCacheUsed;
+
+
+static int R_ShadowEdgesHash( const md3Surface_t *surface ) {
+	return (int)( ( (intptr_t)surface >> 4 ) & ( SHADOW_EDGES_HASH - 1 ) );
+}
+
+
+/*
+=================
+R_ClearShadowEdges
+
+Surface pointers are only valid until the hunk is cleared
+=================
+*/
+void R_ClearShadowEdges( void ) {
+	Com_Memset( shadowEdgesHash, 0, sizeof( shadowEdgesHash ) );
+	Com_Memset( shadowCache, 0, sizeof( shadowCache ) );
+	shadowCacheNext = 0;
+	shadowCacheUsed = 0;
+	numShadowSurfs = 0;
+}
+
+
+/*
+=================
+R_BuildShadowEdges
+
+Called for every MD3 surface after it has been swapped
+=================
+*/
+void R_BuildShadowEdges( const md3Surface_t *surface ) {
+	const int *triangles;
+	shadowEdges_t *edges;
+	int *first, *next;
+	int numEdges;
+	int i, j, k, v1, v2;
+
+	numEdges = surface->numTriangles * 3;
+	if ( numEdges <= 0 || surface->numVerts <= 0 ) {
+		return;
+	}
+
+	triangles = (const int *) ( (const byte *)surface + surface->ofsTriangles );
+
+	for ( i = 0; i < numEdges; i++ ) {
+		if ( (unsigned)triangles[i] >= (unsigned)surface->numVerts ) {
+			return; // leave it to the generic path
+		}
+	}
+
+	edges = ri.Hunk_Alloc( sizeof( *edges ) + numEdges * sizeof( int ), h_low );
+	edges->surface = surface;
+	edges->neighbors = (int *)( edges + 1 );
+
+	// chain edges by their starting vertex
+	first = ri.Malloc( ( surface->numVerts + numEdges ) * sizeof( int ) );
+	next = first + surface->numVerts;
+	for ( i = 0; i < surface->numVerts; i++ ) {
+		first[i] = -1;
+	}
+	for ( i = 0; i < numEdges; i++ ) {
+		v1 = triangles[i];
+		next[i] = first[v1];
+		first[v1] = i;
+	}
+
+	// find the reverse edge
+	for ( i = 0; i < numEdges; i++ ) {
+		v1 = triangles[i];
+		v2 = triangles[ i - i % 3 + ( i + 1 ) % 3 ];
+		edges->neighbors[i] = -1;
+		for ( j = first[v2]; j >= 0; j = next[j] ) {
+			k = j - j % 3 + ( j + 1 ) % 3;
+			if ( triangles[k] == v1 ) {
+				edges->neighbors[i] = j / 3;
+				break;
+			}
+		}
+	}
+
+	ri.Free( first );
+
+	i = R_ShadowEdgesHash( surface );
+	edges->next = shadowEdgesHash[i];
+	shadowEdgesHash[i] = edges;
+}
+
+
+/*
+=================
+RB_AddShadowSurface
+
+Called when an MD3 surface is added to the shadow shader tess
+=================
+*/
+void RB_AddShadowSurface( const md3Surface_t *surface, int firstVertex, int firstIndex ) {
+	const shadowEdges_t *edges;
+	shadowSurf_t *surf;
+
+	if ( firstIndex == 0 ) {
+		numShadowSurfs = 0;
+	}
+
+	if ( numShadowSurfs >= MAX_SHADOW_SURFS ) {
+		return;
+	}
+
+	for ( edges = shadowEdgesHash[ R_ShadowEdgesHash( surface ) ]; edges; edges = edges->next ) {
+		if ( edges->surface == surface ) {
+			break;
+		}
+	}
+
+	surf = &shadowSurfs[ numShadowSurfs++ ];
+	surf->surface = surface;
+	surf->neighbors = edges ? edges->neighbors : NULL;
+	surf->firstVertex = firstVertex;
+	surf->firstTriangle = firstIndex / 3;
+}
+
+
+/*
+=================
+R_FindShadowCache
+=================
+*/
+static shadowCache_t *R_FindShadowCache( const vec3_t lightDir ) {
+	const refEntity_t *ent = &backEnd.currentEntity->e;
+	shadowCache_t *cache;
+	int i, j;
+
+	if ( numShadowSurfs > SHADOW_CACHE_SURFS ) {
+		return NULL;
+	}
+
+	for ( i = 0, cache = shadowCache; i < SHADOW_CACHE_ENTRIES; i++, cache++ ) {
+		if ( cache->numSurfaces != numShadowSurfs || cache->frame != ent->frame || cache->oldframe != ent->oldframe ) {
+			continue;
+		}
+		if ( ent->frame != ent->oldframe && cache->backlerp != ent->backlerp ) {
+			continue;
+		}
+		if ( !VectorCompare( cache->lightDir, lightDir ) ) {
+			continue;
+		}
+		for ( j = 0; j < numShadowSurfs; j++ ) {
+			if ( cache->surfaces[j] != shadowSurfs[j].surface ) {
+				break;
+			}
+		}
+		if ( j == numShadowSurfs ) {
+			return cache;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+=================
+R_StoreShadowCache
+=================
+*/
+static void R_StoreShadowCache( const vec3_t lightDir ) {
+	const refEntity_t *ent = &backEnd.currentEntity->e;
+	shadowCache_t *cache;
+	int i;
+
+	if ( numShadowSurfs > SHADOW_CACHE_SURFS || tess.numIndexes > SHADOW_CACHE_INDEXES ) {
+		return;
+	}
+
+	if ( shadowCacheUsed + tess.numIndexes > SHADOW_CACHE_INDEXES ) {
+		// out of space, start over
+		Com_Memset( shadowCache, 0, sizeof( shadowCache ) );
+		shadowCacheNext = 0;
+		shadowCacheUsed = 0;
+	}
+
+	cache = &shadowCache[ shadowCacheNext ];
+	shadowCacheNext = ( shadowCacheNext + 1 ) % SHADOW_CACHE_ENTRIES;
+
+	for ( i = 0; i < numShadowSurfs; i++ ) {
+		cache->surfaces[i] = shadowSurfs[i].surface;
+	}
+	cache->numSurfaces = numShadowSurfs;
+	cache->frame = ent->frame;
+	cache->oldframe = ent->oldframe;
+	cache->backlerp = ent->backlerp;
+	VectorCopy( lightDir, cache->lightDir );
+	cache->firstIndex = shadowCacheUsed;
+	cache->numIndexes = tess.numIndexes;
+
+	Com_Memcpy( shadowCacheIndexes + shadowCacheUsed, tess.indexes, tess.numIndexes * sizeof( glIndex_t ) );
+	shadowCacheUsed += tess.numIndexes;
+}
+
+
+/*
+=================
+R_CachedShadowEdges
+
+Builds the silhouette from cached connectivity, returns qfalse
+if any triangle in tess comes from a surface without it
+=================
+*/
+static qboolean R_CachedShadowEdges( const vec3_t lightDir ) {
+	const shadowSurf_t *surf;
+	const shadowCache_t *cache;
+	const int *triangles;
+	int numTris;
+	int i, j, t, e, n;
+
+	numTris = 0;
+	for ( i = 0, surf = shadowSurfs; i < numShadowSurfs; i++, surf++ ) {
+		if ( !surf->neighbors || surf->firstTriangle != numTris ) {
+			return qfalse;
+		}
+		numTris += surf->surface->numTriangles;
+	}
+
+	if ( numTris == 0 || numTris * 3 != tess.numIndexes ) {
+		return qfalse;
+	}
+
+	cache = R_FindShadowCache( lightDir );
+	if ( cache ) {
+		Com_Memcpy( tess.indexes, shadowCacheIndexes + cache->firstIndex, cache->numIndexes * sizeof( glIndex_t ) );
+		tess.numIndexes = cache->numIndexes;
+		return qtrue;
+	}
+
+#ifdef USE_SIMD_SHADE
+	R_TriangleFacingSSE2( tess.xyz[0], tess.indexes, numTris, lightDir, facing );
+#else
+	for ( i = 0; i < numTris; i++ ) {
+		vec3_t	d1, d2, normal;
+		float	*v1, *v2, *v3;
+
+		v1 = tess.xyz[ tess.indexes[ i*3 + 0 ] ];
+		v2 = tess.xyz[ tess.indexes[ i*3 + 1 ] ];
+		v3 = tess.xyz[ tess.indexes[ i*3 + 2 ] ];
+
+		VectorSubtract( v2, v1, d1 );
+		VectorSubtract( v3, v1, d2 );
+		CrossProduct( d1, d2, normal );
+
+		facing[ i ] = DotProduct( normal, lightDir ) > 0 ? 1 : 0;
+	}
+#endif
+
+	tess.numIndexes = 0;
+
+	// a front facing edge is a silhouette edge unless
+	// the triangle on its other side faces the light too
+	for ( i = 0, surf = shadowSurfs; i < numShadowSurfs; i++, surf++ ) {
+		triangles = (const int *) ( (const byte *)surf->surface + surf->surface->ofsTriangles );
+		for ( t = 0; t < surf->surface->numTriangles; t++ ) {
+			if ( !facing[ surf->firstTriangle + t ] ) {
+				continue;
+			}
+			for ( e = 0; e < 3; e++ ) {
+				n = surf->neighbors[ t*3 + e ];
+				if ( n >= 0 && facing[ surf->firstTriangle + n ] ) {
+					continue;
+				}
+				j = surf->firstVertex;
+				if ( !R_AddSilEdge( j + triangles[ t*3 + e ], j + triangles[ t*3 + ( e + 1 ) % 3 ] ) ) {
+					goto done;
+				}
+			}
+		}
+	}
+done:
+
+	R_StoreShadowCache( lightDir );
+
+	return qtrue;
+}
+
+
 /*
 =================
 RB_ShadowTessEnd
@@ -149,6 +504,10 @@ void RB_ShadowTessEnd( void ) {
 		VectorMA( tess.xyz[i], -512, lightDir, tess.xyz[i+tess.numVertexes] );
 	}
 
+	if ( R_CachedShadowEdges( lightDir ) ) {
+		goto draw;
+	}
+
 	// decide which triangles face the light
 	Com_Memset( numEdgeDefs, 0, tess.numVertexes * sizeof( numEdgeDefs[0] ) );
 
@@ -186,6 +545,7 @@ void RB_ShadowTessEnd( void ) {
 
 	R_CalcShadowEdges();
 
+draw:
 	GL_ClientState( 1, CLS_NONE );
 	GL_ClientState( 0, CLS_NONE );
 
@@ -276,6 +276,25 @@ static void RB_ClipSkyPolygons( const shaderCommands_t *input )
 	}
 }
 
+/*
+================
+RB_FullSkyBox
+
+Marks every side as fully visible, sides out of view are
+dropped by CullSkySide and anything in front of the sky
+covers it since it is drawn before the opaque surfaces
+================
+*/
+static void RB_FullSkyBox( void )
+{
+	int		i;
+
+	for ( i = 0; i < 6; i++ ) {
+		sky_mins[0][i] = sky_mins[1][i] = -1;
+		sky_maxs[0][i] = sky_maxs[1][i] = 1;
+	}
+}
+
 /*
 ===================================================================================
 
@@ -828,7 +847,11 @@ void RB_StageIteratorSky( void ) {
 	// go through all the polygons and project them onto
 	// the sky box to see which blocks on each side need
 	// to be drawn
-	RB_ClipSkyPolygons( &tess );
+	if ( r_fullSky->integer ) {
+		RB_FullSkyBox();
+	} else {
+		RB_ClipSkyPolygons( &tess );
+	}
 
 	// r_showsky will let all the sky blocks be drawn in
 	// front of everything to allow developers to see how
@@ -825,6 +825,10 @@ static void RB_SurfaceMesh(md3Surface_t *surface) {
 	}
 	tess.numIndexes += indexes;
 
+	if ( tess.shader == tr.shadowShader ) {
+		RB_AddShadowSurface( surface, Doug, Bob );
+	}
+
 	texCoords = (float *) ((byte *)surface + surface->ofsSt);
 
 	numVerts = surface->numVerts;
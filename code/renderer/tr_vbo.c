@@ -61,11 +61,6 @@ typedef struct vbo_item_s {
 	int			num_vertexes;
 } vbo_item_t;
 
-typedef struct ibo_item_s {
-	int offset;
-	int length;
-} ibo_item_t;
-
 typedef struct vbo_s {
 	byte *vbo_buffer;
 	int vbo_offset;
@@ -78,9 +73,13 @@ typedef struct vbo_s {
 	glIndex_t *soft_buffer;
 	uint32_t soft_buffer_indexes;
 
-	ibo_item_t *ibo_items;
+	// index runs, laid out for glMultiDrawElements()
+	GLsizei *ibo_items_length;
+	const GLvoid **ibo_items_offset;
 	int ibo_items_count;
 
+	int soft_stream_offset; // soft index buffer copy in the stream buffer, -1 if none
+
 	vbo_item_t *items;
 	int items_count;
 
@@ -92,6 +91,9 @@ typedef struct vbo_s {
 
 	short fogFPindex;	// fog-only
 	short fogVPindex[2];// eye-in/eye-out
+	short fogGLSLindex[2];// eye-in/eye-out
+
+	qboolean glsl;		// GLSL programs replace ARB programs and fixed-function
 
 } vbo_t;
 
@@ -286,6 +288,183 @@ const char *BuildFP( int multitexture, int alphatest, int fogMode )
 }
 
 
+/*
+=============
+BuildVS
+
+GLSL counterpart of BuildVP()
+=============
+*/
+static const char *BuildVS( int multitexture, int fogmode, int texgen )
+{
+	static char buf[2048];
+	const char *tex0;
+	const char *tex1;
+
+	strcpy( buf,
+	"#version 110\n"
+	"uniform vec4 viewOrigin;\n"
+	"uniform vec4 fogDistanceVector;\n"
+	"uniform vec4 fogDepthVector;\n"
+	"uniform float eyeT;\n"
+	"varying vec2 tc0;\n"
+	"varying vec2 tc1;\n"
+	"varying vec2 fogTC;\n"
+	"varying vec4 color;\n"
+	"void main() {\n"
+	// invariant with fixed-function, needed for multi-pass rendering
+	"gl_Position = ftransform();\n"
+	"color = gl_Color;\n" );
+
+	switch ( fogmode ) {
+		default:
+		case VP_FOG_NONE:
+			break;
+		case VP_FOG_EYE_IN:
+			strcat( buf,
+			"float t = dot( gl_Vertex.xyz, fogDepthVector.xyz ) + fogDepthVector.w;\n"
+			"fogTC.x = dot( gl_Vertex.xyz, fogDistanceVector.xyz ) + fogDistanceVector.w;\n"
+			"fogTC.y = t < 0.0 ? 1.0 / 32.0 : 31.0 / 32.0;\n" );
+			break;
+		case VP_FOG_EYE_OUT:
+			strcat( buf,
+			"float t = dot( gl_Vertex.xyz, fogDepthVector.xyz ) + fogDepthVector.w;\n"
+			"fogTC.x = dot( gl_Vertex.xyz, fogDistanceVector.xyz ) + fogDistanceVector.w;\n"
+			"fogTC.y = t < 1.0 ? 1.0 / 32.0 : 1.0 / 32.0 + 30.0 / 32.0 * t / ( t - eyeT );\n" );
+			break;
+	}
+
+	if ( texgen ) {
+		// environment mapping
+		strcat( buf,
+		"vec3 viewer = normalize( viewOrigin.xyz - gl_Vertex.xyz );\n"
+		"vec3 reflected = gl_Normal * ( 2.0 * dot( gl_Normal, viewer ) ) - viewer;\n"
+		"vec2 env = vec2( 0.5 + reflected.y * 0.5, 0.5 - reflected.z * 0.5 );\n" );
+	}
+
+	tex0 = ( texgen & 1 ) ? "tc0 = env;\n" : "tc0 = gl_MultiTexCoord0.st;\n";
+	tex1 = ( texgen & 2 ) ? "tc1 = env;\n" : "tc1 = gl_MultiTexCoord1.st;\n";
+
+	switch ( multitexture ) {
+		case GL_ADD:
+		case GL_MODULATE:
+			strcat( buf, tex0 );
+			strcat( buf, tex1 );
+			break;
+		case GL_REPLACE:
+			strcat( buf, tex1 );
+			break;
+		default:
+			strcat( buf, tex0 );
+			break;
+	}
+
+	strcat( buf, "}\n" );
+
+	return buf;
+}
+
+
+static const char *genATestFS( int function )
+{
+	switch ( function )
+	{
+		case GLS_ATEST_GT_0:
+			return "if ( base.a <= 0.0 ) discard;\n";
+		case GLS_ATEST_LT_80:
+			return "if ( base.a >= 0.5 ) discard;\n";
+		case GLS_ATEST_GE_80:
+			return "if ( base.a < 0.5 ) discard;\n";
+		default:
+			return "";
+	}
+}
+
+
+/*
+=============
+BuildFS
+
+GLSL counterpart of BuildFP()
+=============
+*/
+static const char *BuildFS( int multitexture, int alphatest, int fogMode )
+{
+	static char buf[2048];
+
+	strcpy( buf,
+	"#version 110\n"
+	"uniform sampler2D texture0;\n"
+	"uniform sampler2D texture1;\n"
+	"uniform sampler2D fogTexture;\n"
+	"uniform vec4 fogColor;\n"
+	"varying vec2 tc0;\n"
+	"varying vec2 tc1;\n"
+	"varying vec2 fogTC;\n"
+	"varying vec4 color;\n"
+	"void main() {\n" );
+
+	if ( fogMode == FP_FOG_ONLY ) {
+		strcat( buf, "gl_FragColor = texture2D( fogTexture, fogTC ) * fogColor;\n" );
+		strcat( buf, "}\n" );
+		return buf;
+	}
+
+	switch ( multitexture ) {
+		case 0:
+			strcat( buf, "vec4 base = texture2D( texture0, tc0 );\n" );
+			strcat( buf, genATestFS( alphatest ) );
+			break;
+		case GL_ADD:
+			strcat( buf, "vec4 base = texture2D( texture0, tc0 );\n" );
+			strcat( buf, genATestFS( alphatest ) );
+			strcat( buf, "base += texture2D( texture1, tc1 );\n" );
+			break;
+		case GL_MODULATE:
+			strcat( buf, "vec4 base = texture2D( texture0, tc0 );\n" );
+			strcat( buf, genATestFS( alphatest ) );
+			strcat( buf, "base *= texture2D( texture1, tc1 );\n" );
+			break;
+		case GL_REPLACE:
+			strcat( buf, "vec4 base = texture2D( texture1, tc1 );\n" );
+			break;
+		default:
+			ri.Error( ERR_DROP, "Invalid multitexture mode %04x", multitexture );
+			break;
+	}
+
+	if ( fogMode == FP_FOG_BLEND ) {
+		strcat( buf,
+		"base *= color;\n"
+		"vec4 fog = texture2D( fogTexture, fogTC ) * fogColor;\n"
+		"gl_FragColor = clamp( mix( base, fog, fog.a ), 0.0, 1.0 );\n" );
+	} else {
+		strcat( buf, "gl_FragColor = base * color;\n" );
+	}
+
+	strcat( buf, "}\n" );
+
+	return buf;
+}
+
+
+typedef struct {
+	GLuint	program;
+	short	VPindex;	// same keys as ARB programs
+	short	FPindex;
+	GLint	viewOrigin;
+	GLint	fogDistanceVector;
+	GLint	fogDepthVector;
+	GLint	eyeT;
+	GLint	fogColor;
+} glslProgram_t;
+
+// linked variants, 0 is reserved for "none"
+#define MAX_GLSL_PROGRAMS 128
+static glslProgram_t vbo_glsl[ MAX_GLSL_PROGRAMS ];
+static int vbo_glsl_count;
+
+
 // multitexture modes: single, mt-add, mt-modulate, mt-replace
 // environment mapping: none, tx0, tx1, tx0 + tx1
 // fog modes: disabled, eye-in, eye-out, fog-only
@@ -463,6 +642,62 @@ static void CompileFragmentProgram( int FPindex, int mtx, int atestBits, int fog
 }
 
 
+/*
+=============
+CompileGLSLProgram
+
+Returns index of the linked variant, 0 if it can't be used
+=============
+*/
+static short CompileGLSLProgram( int mtx, int texgen, int atestBits, int vpFog, int fpFog )
+{
+	glslProgram_t *prog;
+	int VPindex, FPindex;
+	GLuint program;
+	int i;
+
+	VPindex = getVPindex( mtx, vpFog, texgen );
+	FPindex = getFPindex( mtx, atestBits, fpFog );
+
+	for ( i = 1; i < vbo_glsl_count; i++ ) {
+		if ( vbo_glsl[ i ].VPindex == VPindex && vbo_glsl[ i ].FPindex == FPindex ) {
+			return vbo_glsl[ i ].program ? i : 0;
+		}
+	}
+
+	if ( vbo_glsl_count >= MAX_GLSL_PROGRAMS ) {
+		return 0;
+	}
+
+	program = GLSL_CompileProgram( BuildVS( mtx, vpFog, texgen ), BuildFS( mtx, atestBits, fpFog ) );
+
+	// failed variants are kept too so they are not compiled again
+	prog = &vbo_glsl[ vbo_glsl_count++ ];
+	prog->program = program;
+	prog->VPindex = VPindex;
+	prog->FPindex = FPindex;
+
+	if ( !program ) {
+		return 0;
+	}
+
+	prog->viewOrigin = qglGetUniformLocation( program, "viewOrigin" );
+	prog->fogDistanceVector = qglGetUniformLocation( program, "fogDistanceVector" );
+	prog->fogDepthVector = qglGetUniformLocation( program, "fogDepthVector" );
+	prog->eyeT = qglGetUniformLocation( program, "eyeT" );
+	prog->fogColor = qglGetUniformLocation( program, "fogColor" );
+
+	// same texture units as with ARB programs
+	GLSL_UseProgram( program );
+	qglUniform1i( qglGetUniformLocation( program, "texture0" ), 0 );
+	qglUniform1i( qglGetUniformLocation( program, "texture1" ), 1 );
+	qglUniform1i( qglGetUniformLocation( program, "fogTexture" ), 2 );
+	GLSL_UseProgram( 0 );
+
+	return prog - vbo_glsl;
+}
+
+
 /*
 =============
 isStaticShader
@@ -558,6 +793,16 @@ static qboolean isStaticShader( shader_t *shader )
 				CompileFragmentProgram( stage->vboFPindex[0], mtx, atestBits, FP_FOG_NONE );
 			}
 		}
+
+		// every stage gets its GLSL variants, ARB programs above are kept as fallback
+		Com_Memset( stage->vboGLSLindex, 0, sizeof( stage->vboGLSLindex ) );
+		if ( world_vbo.glsl ) {
+			stage->vboGLSLindex[0] = CompileGLSLProgram( mtx, texgen, atestBits, VP_FOG_NONE, FP_FOG_NONE );
+			if ( shader->numUnfoggedPasses == 1 ) {
+				stage->vboGLSLindex[1] = CompileGLSLProgram( mtx, texgen, atestBits, VP_FOG_EYE_IN, FP_FOG_BLEND );
+				stage->vboGLSLindex[2] = CompileGLSLProgram( mtx, texgen, atestBits, VP_FOG_EYE_OUT, FP_FOG_BLEND );
+			}
+		}
 	}
 
 	world_vbo.fogVPindex[0] = getVPindex( 0, VP_FOG_EYE_IN, 0 );
@@ -566,10 +811,15 @@ static qboolean isStaticShader( shader_t *shader )
 	world_vbo.fogFPindex = getFPindex( 0, 0, FP_FOG_ONLY );
 
 	CompileVertexProgram( world_vbo.fogVPindex[0], 0, VP_FOG_EYE_IN, 0 );
-	CompileVertexProgram( world_vbo.fogVPindex[0], 0, VP_FOG_EYE_OUT, 0 );
+	CompileVertexProgram( world_vbo.fogVPindex[1], 0, VP_FOG_EYE_OUT, 0 );
 
 	CompileFragmentProgram( world_vbo.fogFPindex, 0 /*mtx*/, 0 /*atest*/, FP_FOG_ONLY );
 
+	if ( world_vbo.glsl ) {
+		world_vbo.fogGLSLindex[0] = CompileGLSLProgram( 0, 0, 0, VP_FOG_EYE_IN, FP_FOG_ONLY );
+		world_vbo.fogGLSLindex[1] = CompileGLSLProgram( 0, 0, 0, VP_FOG_EYE_OUT, FP_FOG_ONLY );
+	}
+
 	return qtrue;
 }
 
@@ -733,27 +983,22 @@ static qboolean VBO_BindData( void )
 }
 
 
-static void VBO_BindIndex( qboolean enable )
+static void VBO_BindIndexBuffer( GLuint buffer )
 {
-	if ( !enable )
-	{
-		if ( curr_index_bind )
-		{
-			qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, 0 );
-			curr_index_bind = 0;
-		}
-	}
-	else
+	if ( curr_index_bind != buffer )
 	{
-		if ( !curr_index_bind )
-		{
-			qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, VBO_world_indexes );
-			curr_index_bind = VBO_world_indexes;
-		}
+		qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, buffer );
+		curr_index_bind = buffer;
 	}
 }
 
 
+static void VBO_BindIndex( qboolean enable )
+{
+	VBO_BindIndexBuffer( enable ? VBO_world_indexes : 0 );
+}
+
+
 void VBO_UnBind( void )
 {
 	if ( curr_index_bind )
@@ -772,6 +1017,170 @@ void VBO_UnBind( void )
 }
 
 
+/*
+==============================================================================
+
+STREAM BUFFER
+
+Dynamic vertexes and indexes are copied into a persistently mapped
+ring instead of being sourced from client memory on every draw call.
+
+The ring is split into one segment per frame in flight, a fence is
+placed after each frame and checked before its segment is rewritten.
+When the current segment is full data is drawn from client memory
+until the next frame.
+
+Array bindings are captured by gl*Pointer() calls so the buffer is
+only bound while setting pointers and drawing with streamed indexes.
+
+==============================================================================
+*/
+
+#define STREAM_FRAMES		3
+#define STREAM_SEGMENT_SIZE	( 8 * 1024 * 1024 )
+#define STREAM_ALIGN		64
+
+typedef struct {
+	GLuint		buffer;
+	byte		*data;			// persistently mapped
+	int			segment;
+	int			offset;			// within current segment
+	GLsync		fence[ STREAM_FRAMES ];
+	qboolean	failed;			// don't retry after errors
+} streamBuffer_t;
+
+static streamBuffer_t stream;
+
+
+static qboolean VBO_InitStream( void )
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptrARB size = STREAM_FRAMES * STREAM_SEGMENT_SIZE;
+
+	if ( stream.failed || !qglBufferStorage || !r_vboStream->integer )
+		return qfalse;
+
+	// reset error state
+	qglGetError();
+
+	qglGenBuffersARB( 1, &stream.buffer );
+	qglBindBufferARB( GL_ARRAY_BUFFER_ARB, stream.buffer );
+	qglBufferStorage( GL_ARRAY_BUFFER_ARB, size, NULL, flags );
+	stream.data = qglMapBufferRange( GL_ARRAY_BUFFER_ARB, 0, size, flags );
+	qglBindBufferARB( GL_ARRAY_BUFFER_ARB, curr_vertex_bind );
+
+	if ( qglGetError() != GL_NO_ERROR || !stream.data )
+	{
+		ri.Printf( PRINT_WARNING, "...failed to map stream buffer\n" );
+		qglDeleteBuffersARB( 1, &stream.buffer );
+		stream.buffer = 0;
+		stream.data = NULL;
+		stream.failed = qtrue;
+		return qfalse;
+	}
+
+	stream.segment = 0;
+	stream.offset = 0;
+
+	return qtrue;
+}
+
+
+void VBO_ShutdownStream( void )
+{
+	int i;
+
+	for ( i = 0; i < STREAM_FRAMES; i++ )
+	{
+		if ( stream.fence[ i ] )
+		{
+			qglDeleteSync( stream.fence[ i ] );
+		}
+	}
+
+	if ( stream.buffer )
+	{
+		if ( curr_index_bind == stream.buffer )
+			curr_index_bind = 0;
+		// also unmaps it
+		qglDeleteBuffersARB( 1, &stream.buffer );
+	}
+
+	Com_Memset( &stream, 0, sizeof( stream ) );
+}
+
+
+/*
+=============
+VBO_StreamData
+
+Copies data into the stream buffer, returns its offset
+or -1 if data should be sourced from client memory
+=============
+*/
+int VBO_StreamData( const void *data, int size )
+{
+	int offset;
+
+	if ( size <= 0 )
+		return -1;
+
+	if ( !stream.data && !VBO_InitStream() )
+		return -1;
+
+	if ( stream.offset + size > STREAM_SEGMENT_SIZE )
+		return -1;
+
+	offset = stream.segment * STREAM_SEGMENT_SIZE + stream.offset;
+	Com_Memcpy( stream.data + offset, data, size );
+
+	stream.offset = PAD( stream.offset + size, STREAM_ALIGN );
+
+	return offset;
+}
+
+
+GLuint VBO_StreamBuffer( void )
+{
+	return stream.buffer;
+}
+
+
+/*
+=============
+VBO_StreamEndFrame
+
+Fences the current segment and waits until the next one is consumed
+=============
+*/
+void VBO_StreamEndFrame( void )
+{
+	GLsync fence;
+	GLenum res;
+
+	if ( !stream.data )
+		return;
+
+	stream.fence[ stream.segment ] = qglFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	stream.segment = ( stream.segment + 1 ) % STREAM_FRAMES;
+	stream.offset = 0;
+
+	fence = stream.fence[ stream.segment ];
+	if ( fence )
+	{
+		// practically never blocks, that frame was submitted STREAM_FRAMES-1 frames ago
+		res = qglClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL );
+		if ( res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED )
+		{
+			ri.Printf( PRINT_DEVELOPER, "stream buffer fence wait failed\n" );
+		}
+		qglDeleteSync( fence );
+		stream.fence[ stream.segment ] = NULL;
+	}
+}
+
+
 static int surfSortFunc( const void *a, const void *b )
 {
 	const msurface_t **sa = (const msurface_t **)a;
@@ -817,6 +1226,14 @@ void R_BuildWorldVBO( msurface_t *surf, int surfCount )
 
 	VBO_Cleanup();
 
+	if ( r_glsl->integer ) {
+		if ( qglCreateProgram ) {
+			world_vbo.glsl = qtrue;
+		} else {
+			ri.Printf( PRINT_WARNING, "... GLSL programs are not available\n" );
+		}
+	}
+
 	vbo_size = 0;
 
 	// initial scan to count surfaces/indexes/vertexes for memory allocation
@@ -896,7 +1313,9 @@ void R_BuildWorldVBO( msurface_t *surf, int surfCount )
 	vbo->soft_buffer_indexes = 0;
 
 	// ibo runs buffer
-	vbo->ibo_items = ri.Hunk_Alloc( ( (numStaticIndexes / MIN_IBO_RUN) + 1 ) * sizeof( ibo_item_t ), h_low );
+	n = (numStaticIndexes / MIN_IBO_RUN) + 1;
+	vbo->ibo_items_length = ri.Hunk_Alloc( n * sizeof( vbo->ibo_items_length[0] ), h_low );
+	vbo->ibo_items_offset = ri.Hunk_Alloc( n * sizeof( vbo->ibo_items_offset[0] ), h_low );
 	vbo->ibo_items_count = 0;
 
 	surfList = ri.Hunk_AllocateTempMemory( numStaticSurfaces * sizeof( msurface_t* ) );
@@ -1081,6 +1500,20 @@ void VBO_Cleanup( void )
 	}
 	memset( vbo_fp, 0, sizeof( vbo_fp ) );
 
+	if ( vbo_glsl_count )
+	{
+		GLSL_UseProgram( 0 );
+		for ( i = 1; i < vbo_glsl_count; i++ )
+		{
+			if ( vbo_glsl[i].program )
+			{
+				qglDeleteProgram( vbo_glsl[i].program );
+			}
+		}
+	}
+	memset( vbo_glsl, 0, sizeof( vbo_glsl ) );
+	vbo_glsl_count = 1;
+
 	memset( &world_vbo, 0, sizeof( world_vbo ) );
 
 	for ( i = 0; i < tr.numShaders; i++ )
@@ -1092,6 +1525,19 @@ void VBO_Cleanup( void )
 }
 
 
+/*
+=============
+VBO_Size
+
+Bytes of static world geometry in video memory
+=============
+*/
+int VBO_Size( void )
+{
+	return world_vbo.vbo_size + world_vbo.ibo_size;
+}
+
+
 /*
 =============
 qsort_int
@@ -1198,12 +1644,10 @@ static void VBO_AddItemDataToSoftBuffer( int itemIndex )
 static void VBO_AddItemRangeToIBOBuffer( int offset, int length )
 {
 	vbo_t *vbo = &world_vbo;
-	ibo_item_t *it;
 
-	it = vbo->ibo_items + vbo->ibo_items_count++;
-
-	it->offset = offset * sizeof( glIndex_t ) + tess.shader->iboOffset;
-	it->length = length;
+	vbo->ibo_items_offset[ vbo->ibo_items_count ] = (const GLvoid *)(intptr_t)( offset * sizeof( glIndex_t ) + tess.shader->iboOffset );
+	vbo->ibo_items_length[ vbo->ibo_items_count ] = length;
+	vbo->ibo_items_count++;
 }
 
 
@@ -1216,9 +1660,16 @@ static void VBO_RenderIBOItems( void )
 	if ( vbo->ibo_items_count )
 	{
 		VBO_BindIndex( qtrue );
-		for ( i = 0; i < vbo->ibo_items_count; i++ )
+		if ( qglMultiDrawElements )
+		{
+			qglMultiDrawElements( GL_TRIANGLES, vbo->ibo_items_length, GL_INDEX_TYPE, vbo->ibo_items_offset, vbo->ibo_items_count );
+		}
+		else
 		{
-			qglDrawElements( GL_TRIANGLES, vbo->ibo_items[ i ].length, GL_INDEX_TYPE, (const GLvoid *)(intptr_t) vbo->ibo_items[ i ].offset );
+			for ( i = 0; i < vbo->ibo_items_count; i++ )
+			{
+				qglDrawElements( GL_TRIANGLES, vbo->ibo_items_length[ i ], GL_INDEX_TYPE, vbo->ibo_items_offset[ i ] );
+			}
 		}
 	}
 }
@@ -1230,8 +1681,16 @@ static void VBO_RenderSoftItems( void )
 
 	if ( vbo->soft_buffer_indexes )
 	{
-		VBO_BindIndex( qfalse );
-		qglDrawElements( GL_TRIANGLES, vbo->soft_buffer_indexes, GL_INDEX_TYPE, vbo->soft_buffer );
+		if ( vbo->soft_stream_offset >= 0 )
+		{
+			VBO_BindIndexBuffer( stream.buffer );
+			qglDrawElements( GL_TRIANGLES, vbo->soft_buffer_indexes, GL_INDEX_TYPE, (const GLvoid *)(intptr_t) vbo->soft_stream_offset );
+		}
+		else
+		{
+			VBO_BindIndex( qfalse );
+			qglDrawElements( GL_TRIANGLES, vbo->soft_buffer_indexes, GL_INDEX_TYPE, vbo->soft_buffer );
+		}
 	}
 }
 
@@ -1295,34 +1754,55 @@ static void VBO_PrepareQueues( void )
 		}
 		i += item_run;
 	}
+
+	vbo->soft_stream_offset = VBO_StreamData( vbo->soft_buffer, vbo->soft_buffer_indexes * sizeof( glIndex_t ) );
 }
 
 
-static const fogProgramParms_t *VBO_SetupFog( int VPindex, int FPindex, GLuint *pvp, GLuint *pfp )
+static const fogProgramParms_t *VBO_SetupFog( int VPindex, int FPindex, const short *GLSLindex, GLuint *pvp, GLuint *pfp, const glslProgram_t **pglsl )
 {
 	const fogProgramParms_t *fparm;
+	const glslProgram_t *glsl;
 	GLuint vp, fp;
 
 	GL_BindTexture( 2, tr.fogImage->texnum );
 	GL_SelectTexture( 0 );
 
 	fparm = RB_CalcFogProgramParms();
-	if ( fparm->eyeOutside )
-		vp = vbo_vp[ VPindex + 1 ];
-	else
-		vp = vbo_vp[ VPindex + 0 ];
 
-	fp = vbo_fp[ FPindex ];
+	glsl = NULL;
+	if ( GLSLindex[ fparm->eyeOutside ? 1 : 0 ] )
+		glsl = &vbo_glsl[ GLSLindex[ fparm->eyeOutside ? 1 : 0 ] ];
+
+	if ( glsl ) {
+		vp = fp = glsl->program;
+
+		GLSL_UseProgram( glsl->program );
+
+		qglUniform4fv( glsl->fogDistanceVector, 1, fparm->fogDistanceVector );
+		qglUniform4fv( glsl->fogDepthVector, 1, fparm->fogDepthVector );
+		qglUniform1f( glsl->eyeT, fparm->eyeT );
+		qglUniform4fv( glsl->fogColor, 1, fparm->fogColor );
+	} else {
+		if ( fparm->eyeOutside )
+			vp = vbo_vp[ VPindex + 1 ];
+		else
+			vp = vbo_vp[ VPindex + 0 ];
 
-	ARB_ProgramEnableExt( vp, fp );
+		fp = vbo_fp[ FPindex ];
 
-	qglProgramLocalParameter4fvARB( GL_VERTEX_PROGRAM_ARB, 2, fparm->fogDistanceVector );
-	qglProgramLocalParameter4fvARB( GL_VERTEX_PROGRAM_ARB, 3, fparm->fogDepthVector );
-	qglProgramLocalParameter4fARB( GL_VERTEX_PROGRAM_ARB, 4, fparm->eyeT, 0.0f, 0.0f, 0.0f );
-	qglProgramLocalParameter4fvARB( GL_FRAGMENT_PROGRAM_ARB, 0, fparm->fogColor );
+		GLSL_UseProgram( 0 );
+		ARB_ProgramEnableExt( vp, fp );
+
+		qglProgramLocalParameter4fvARB( GL_VERTEX_PROGRAM_ARB, 2, fparm->fogDistanceVector );
+		qglProgramLocalParameter4fvARB( GL_VERTEX_PROGRAM_ARB, 3, fparm->fogDepthVector );
+		qglProgramLocalParameter4fARB( GL_VERTEX_PROGRAM_ARB, 4, fparm->eyeT, 0.0f, 0.0f, 0.0f );
+		qglProgramLocalParameter4fvARB( GL_FRAGMENT_PROGRAM_ARB, 0, fparm->fogColor );
+	}
 
 	*pvp = vp;
 	*pfp = fp;
+	*pglsl = glsl;
 
 	return fparm;
 }
@@ -1335,6 +1815,7 @@ static void RB_IterateStagesVBO( const shaderCommands_t *input )
 {
 	const shaderStage_t *pStage;
 	const fogProgramParms_t *fparm;
+	const glslProgram_t *glsl;
 	int i;
 	GLbitfield stateBits, normalMask;
 	qboolean fogPass;
@@ -1345,9 +1826,10 @@ static void RB_IterateStagesVBO( const shaderCommands_t *input )
 	if ( fogPass && tess.shader->numUnfoggedPasses == 1 ) {
 		// combined fog + single stage program
 		pStage = input->xstages[ 0 ];
-		fparm = VBO_SetupFog( pStage->vboVPindex[1], pStage->vboFPindex[1], &vp, &fp ); 
+		fparm = VBO_SetupFog( pStage->vboVPindex[1], pStage->vboFPindex[1], pStage->vboGLSLindex + 1, &vp, &fp, &glsl );
 	} else {
 		fparm = NULL;
+		glsl = NULL;
 		vp = fp = 0;
 	}
 
@@ -1371,9 +1853,17 @@ static void RB_IterateStagesVBO( const shaderCommands_t *input )
 		stateBits = pStage->stateBits;
 
 		if ( fparm == NULL ) {
-			vp = vbo_vp[ pStage->vboVPindex[0] ];
-			fp = vbo_fp[ pStage->vboFPindex[0] ];
-			ARB_ProgramEnableExt( vp, fp );
+			if ( pStage->vboGLSLindex[0] ) {
+				glsl = &vbo_glsl[ pStage->vboGLSLindex[0] ];
+				vp = fp = glsl->program;
+				GLSL_UseProgram( glsl->program );
+			} else {
+				glsl = NULL;
+				vp = vbo_vp[ pStage->vboVPindex[0] ];
+				fp = vbo_fp[ pStage->vboFPindex[0] ];
+				GLSL_UseProgram( 0 );
+				ARB_ProgramEnableExt( vp, fp );
+			}
 		}
 
 		if ( fp ) {
@@ -1384,11 +1874,16 @@ static void RB_IterateStagesVBO( const shaderCommands_t *input )
 
 		if ( pStage->tessFlags & ( TESS_ENV0 | TESS_ENV1 ) ) {
 			// setup viewpos needed for environment mapping program
-			qglProgramLocalParameter4fARB( GL_VERTEX_PROGRAM_ARB, 0,
-				backEnd.or.viewOrigin[0],
-				backEnd.or.viewOrigin[1],
-				backEnd.or.viewOrigin[2],
-				0.0 );
+			if ( glsl ) {
+				const vec4_t viewOrigin = { backEnd.or.viewOrigin[0], backEnd.or.viewOrigin[1], backEnd.or.viewOrigin[2], 0.0f };
+				qglUniform4fv( glsl->viewOrigin, 1, viewOrigin );
+			} else {
+				qglProgramLocalParameter4fARB( GL_VERTEX_PROGRAM_ARB, 0,
+					backEnd.or.viewOrigin[0],
+					backEnd.or.viewOrigin[1],
+					backEnd.or.viewOrigin[2],
+					0.0 );
+			}
 			normalMask = CLS_NORMAL_ARRAY;
 		} else {
 			normalMask = 0;
@@ -1456,7 +1951,7 @@ static void RB_IterateStagesVBO( const shaderCommands_t *input )
 
 		GL_ClientState( 0, CLS_NONE );
 
-		VBO_SetupFog( world_vbo.fogVPindex[0], world_vbo.fogFPindex, &vp, &fp );
+		VBO_SetupFog( world_vbo.fogVPindex[0], world_vbo.fogFPindex, world_vbo.fogGLSLindex, &vp, &fp, &glsl );
 
 		if ( tess.shader->fogPass == FP_EQUAL ) {
 			GL_State( GLS_SRCBLEND_SRC_ALPHA | GLS_DSTBLEND_ONE_MINUS_SRC_ALPHA | GLS_DEPTHFUNC_EQUAL );
@@ -1467,6 +1962,7 @@ static void RB_IterateStagesVBO( const shaderCommands_t *input )
 		VBO_RenderIndexes();
 	}
 
+	GLSL_UseProgram( 0 );
 	ARB_ProgramEnableExt( 0, 0 );
 
 	if ( r_showtris->integer ) {
@@ -449,7 +449,7 @@ static void R_RecursiveLightNode( const mnode_t* node )
 	int c;
 	do {
 		// if the node wasn't marked as potentially visible, exit
-		if ( node->visframe != tr.visCount )
+		if ( node->visframe[tr.visSlot] != tr.visCount )
 			return;
 
 		if ( node->contents != CONTENTS_NODE )
@@ -584,6 +584,101 @@ void R_AddBrushModelSurfaces ( trRefEntity_t *ent ) {
 */
 
 
+/*
+=============================================================
+
+	OCCLUSION CULLING
+
+=============================================================
+*/
+
+#define MAX_VIEW_OCCLUDERS	64
+
+/*
+================
+R_SetupOcclusion
+
+Rasterizes the occluders that look biggest from the view origin
+================
+*/
+static void R_SetupOcclusion( void ) {
+	const occluder_t *best[ MAX_VIEW_OCCLUDERS ];
+	float		scores[ MAX_VIEW_OCCLUDERS ];
+	occluder_t	*occ;
+	const shader_t *sh;
+	const int	*indexes;
+	vec3_t		center;
+	float		d, score;
+	int			i, j, numBest;
+
+	if ( !r_occlusion->integer || r_nocull->integer || tr.viewParms.portalView != PV_NONE ) {
+		return;
+	}
+
+	numBest = 0;
+	for ( i = 0, occ = tr.world->occluders; i < tr.world->numOccluders; i++, occ++ ) {
+		sh = occ->surf->shader;
+		if ( sh->remappedShader ) {
+			continue;
+		}
+
+		// only the drawn side of a face hides anything
+		d = DotProduct( tr.viewParms.or.origin, occ->face->plane.normal ) - occ->face->plane.dist;
+		if ( ( sh->cullType == CT_FRONT_SIDED && d <= 0.0f ) || ( sh->cullType == CT_BACK_SIDED && d >= 0.0f ) ) {
+			continue;
+		}
+
+		for ( j = 0; j < 4; j++ ) {
+			if ( BoxOnPlaneSide( occ->bounds[0], occ->bounds[1], &tr.viewParms.frustum[j] ) == 2 ) {
+				break;
+			}
+		}
+		if ( j != 4 ) {
+			continue;
+		}
+
+		// approximate projected size
+		VectorAdd( occ->bounds[0], occ->bounds[1], center );
+		VectorScale( center, 0.5f, center );
+		score = occ->area / ( DistanceSquared( center, tr.viewParms.or.origin ) + 1.0f );
+
+		// keep the list sorted by score
+		if ( numBest == MAX_VIEW_OCCLUDERS ) {
+			if ( score <= scores[ numBest - 1 ] ) {
+				continue;
+			}
+			numBest--;
+		}
+		for ( j = numBest; j > 0 && scores[ j - 1 ] < score; j-- ) {
+			scores[ j ] = scores[ j - 1 ];
+			best[ j ] = best[ j - 1 ];
+		}
+		scores[ j ] = score;
+		best[ j ] = occ;
+		numBest++;
+	}
+
+	if ( !numBest ) {
+		return;
+	}
+
+	R_OcclusionClear( tr.viewParms.world.modelMatrix, tr.viewParms.projectionMatrix );
+
+	for ( i = 0; i < numBest; i++ ) {
+		const srfSurfaceFace_t *face = best[ i ]->face;
+		indexes = (const int *)((const byte *)face + face->ofsIndices);
+		for ( j = 0; j < face->numIndices - 2; j += 3 ) {
+			R_OcclusionAddTriangle( face->points[ indexes[ j ] ], face->points[ indexes[ j + 1 ] ], face->points[ indexes[ j + 2 ] ] );
+		}
+	}
+
+	R_OcclusionBuild();
+
+	tr.occlusionActive = qtrue;
+	tr.pc.c_occluders += numBest;
+}
+
+
 /*
 ================
 R_RecursiveWorldNode
@@ -595,7 +690,7 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 		unsigned int newDlights[2];
 
 		// if the node wasn't marked as potentially visible, exit
-		if (node->visframe != tr.visCount) {
+		if (node->visframe[tr.visSlot] != tr.visCount) {
 			return;
 		}
 
@@ -647,6 +742,11 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 
 		}
 
+		if ( tr.occlusionActive && R_OcclusionTestBounds( node->mins, node->maxs ) ) {
+			tr.pc.c_occluded_nodes++;
+			return;
+		}
+
 		if ( node->contents != CONTENTS_NODE ) {
 			break;
 		}
@@ -798,6 +898,28 @@ qboolean R_inPVS( const vec3_t p1, const vec3_t p2 ) {
 	return qtrue;
 }
 
+/*
+===============
+R_SelectVisSlot
+
+Saves leaf marks state of the current slot and restores the requested one
+===============
+*/
+static void R_SelectVisSlot( int slot ) {
+
+	if ( slot == tr.visSlot ) {
+		return;
+	}
+
+	tr.visSlotCount[ tr.visSlot ] = tr.visCount;
+	tr.visSlotCluster[ tr.visSlot ] = tr.viewCluster;
+
+	tr.visSlot = slot;
+	tr.visCount = tr.visSlotCount[ slot ];
+	tr.viewCluster = tr.visSlotCluster[ slot ];
+}
+
+
 /*
 ===============
 R_MarkLeaves
@@ -812,6 +934,10 @@ static void R_MarkLeaves (void) {
 	int		i;
 	int		cluster;
 
+	// portal views keep their own marks, otherwise a visible portal
+	// into another cluster makes both views remark everything each frame
+	R_SelectVisSlot( tr.viewParms.portalView != PV_NONE ? VIS_SLOT_PORTAL : VIS_SLOT_MAIN );
+
 	// lockpvs lets designers walk around to determine the
 	// extent of the current pvs
 	if ( r_lockpvs->integer ) {
@@ -838,20 +964,55 @@ static void R_MarkLeaves (void) {
 		}
 	}
 
-	tr.visCount++;
+	if ( tr.refdef.areamaskModified ) {
+		// marks of the other slots used the old area visibility
+		for ( i = 0; i < VIS_SLOTS; i++ ) {
+			tr.visSlotCluster[ i ] = -2;
+		}
+	}
+
+	tr.visCount = ++tr.visStamp;
 	tr.viewCluster = cluster;
 
 	if ( r_novis->integer || tr.viewCluster == -1 ) {
 		for (i=0 ; i<tr.world->numnodes ; i++) {
 			if (tr.world->nodes[i].contents != CONTENTS_SOLID) {
-				tr.world->nodes[i].visframe = tr.visCount;
+				tr.world->nodes[i].visframe[tr.visSlot] = tr.visCount;
 			}
 		}
 		return;
 	}
 
 	vis = R_ClusterPVS (tr.viewCluster);
-	
+
+	if ( tr.world->clusterLeafs ) {
+		// walk only the clusters that are set in the PVS
+		const int numWords = ( tr.world->numClusters + 63 ) >> 6;
+		const uint64_t *words = (const uint64_t *)vis;
+		int j;
+
+		for ( cluster = Com_NextBit( words, numWords, 0 ); cluster >= 0 && cluster < tr.world->numClusters;
+			cluster = Com_NextBit( words, numWords, cluster + 1 ) ) {
+			for ( j = tr.world->clusterFirstLeaf[ cluster ]; j < tr.world->clusterFirstLeaf[ cluster + 1 ]; j++ ) {
+				leaf = tr.world->clusterLeafs[ j ];
+
+				// check for door connection
+				if ( (tr.refdef.areamask[leaf->area>>3] & (1<<(leaf->area&7)) ) ) {
+					continue;		// not visible
+				}
+
+				parent = leaf;
+				do {
+					if (parent->visframe[tr.visSlot] == tr.visCount)
+						break;
+					parent->visframe[tr.visSlot] = tr.visCount;
+					parent = parent->parent;
+				} while (parent);
+			}
+		}
+		return;
+	}
+
 	for (i=0,leaf=tr.world->nodes ; i<tr.world->numnodes ; i++, leaf++) {
 		cluster = leaf->cluster;
 		if ( cluster < 0 || cluster >= tr.world->numClusters ) {
@@ -870,9 +1031,9 @@ static void R_MarkLeaves (void) {
 
 		parent = leaf;
 		do {
-			if (parent->visframe == tr.visCount)
+			if (parent->visframe[tr.visSlot] == tr.visCount)
 				break;
-			parent->visframe = tr.visCount;
+			parent->visframe[tr.visSlot] = tr.visCount;
 			parent = parent->parent;
 		} while (parent);
 	}
@@ -890,6 +1051,8 @@ void R_AddWorldSurfaces( void ) {
 	int i;
 #endif
 
+	tr.occlusionActive = qfalse;
+
 	if ( !r_drawworld->integer ) {
 		return;
 	}
@@ -907,6 +1070,8 @@ void R_AddWorldSurfaces( void ) {
 	// clear out the visible min/max
 	ClearBounds( tr.viewParms.visBounds[0], tr.viewParms.visBounds[1] );
 
+	R_SetupOcclusion();
+
 	// perform frustum culling and add all the potentially visible surfaces
 	if ( tr.refdef.num_dlights > MAX_DLIGHTS ) {
 		tr.refdef.num_dlights = MAX_DLIGHTS;
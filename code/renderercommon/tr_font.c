@@ -74,6 +74,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 extern void R_IssuePendingRenderCommands( void );
 extern qhandle_t RE_RegisterShaderNoMip( const char *name );
+extern qhandle_t RE_RegisterFontAtlas( const char *name, const qhandle_t *pages, int numPages, int *columns );
 
 #ifdef BUILD_FREETYPE
 #include <ft2build.h>
@@ -94,6 +95,10 @@ FT_Library ftLibrary = NULL;
 static int registeredFontCount = 0;
 static fontInfo_t registeredFont[MAX_FONTS];
 
+// glyph pages rendered with FreeType, big enough to hold a whole font
+// at usual point sizes so it is drawn with a single shader
+#define FONT_PAGE_SIZE 512
+
 #ifdef BUILD_FREETYPE
 void R_GetGlyphInfo(FT_GlyphSlot glyph, int *left, int *right, int *width, int *top, int *bottom, int *height, int *pitch) {
 	*left  = _FLOOR( glyph->metrics.horiBearingX );
@@ -233,12 +238,12 @@ static glyphInfo_t *RE_ConstructGlyphInfo(unsigned char *imageOut, int *xOut, in
 		scaled_height = glyph.height;
 
 		// we need to make sure we fit
-		if (*xOut + scaled_width + 1 >= 255) {
+		if (*xOut + scaled_width + 1 >= FONT_PAGE_SIZE - 1) {
 			*xOut = 0;
 			*yOut += *maxHeight + 1;
 		}
 
-		if (*yOut + *maxHeight + 1 >= 255) {
+		if (*yOut + *maxHeight + 1 >= FONT_PAGE_SIZE - 1) {
 			*yOut = -1;
 			*xOut = -1;
 			ri.Free(bitmap->buffer);
@@ -248,7 +253,7 @@ static glyphInfo_t *RE_ConstructGlyphInfo(unsigned char *imageOut, int *xOut, in
 
 
 		src = bitmap->buffer;
-		dst = imageOut + (*yOut * 256) + *xOut;
+		dst = imageOut + (*yOut * FONT_PAGE_SIZE) + *xOut;
 
 		if (bitmap->pixel_mode == ft_pixel_mode_mono) {
 			for (i = 0; i < glyph.height; i++) {
@@ -273,13 +278,13 @@ static glyphInfo_t *RE_ConstructGlyphInfo(unsigned char *imageOut, int *xOut, in
 				}
 
 				src += glyph.pitch;
-				dst += 256;
+				dst += FONT_PAGE_SIZE;
 			}
 		} else {
 			for (i = 0; i < glyph.height; i++) {
 				Com_Memcpy(dst, src, glyph.pitch);
 				src += glyph.pitch;
-				dst += 256;
+				dst += FONT_PAGE_SIZE;
 			}
 		}
 
@@ -288,10 +293,10 @@ static glyphInfo_t *RE_ConstructGlyphInfo(unsigned char *imageOut, int *xOut, in
 
 		glyph.imageHeight = scaled_height;
 		glyph.imageWidth = scaled_width;
-		glyph.s = (float)*xOut / 256;
-		glyph.t = (float)*yOut / 256;
-		glyph.s2 = glyph.s + (float)scaled_width / 256;
-		glyph.t2 = glyph.t + (float)scaled_height / 256;
+		glyph.s = (float)*xOut / FONT_PAGE_SIZE;
+		glyph.t = (float)*yOut / FONT_PAGE_SIZE;
+		glyph.s2 = glyph.s + (float)scaled_width / FONT_PAGE_SIZE;
+		glyph.t2 = glyph.t + (float)scaled_height / FONT_PAGE_SIZE;
 
 		*xOut += scaled_width + 1;
 
@@ -334,6 +339,67 @@ float readFloat( void ) {
 	return me.ffred;
 }
 
+/*
+===============
+R_MergeFontPages
+
+Moves the glyphs of a pre-rendered font from its 256x256 pages into
+one atlas, the font is left untouched if the pages can't be merged
+===============
+*/
+static void R_MergeFontPages( fontInfo_t *font, int pointSize ) {
+	qhandle_t pages[ GLYPHS_PER_FONT ];
+	int pageIndex[ GLYPHS_PER_FONT ];
+	char name[ MAX_QPATH ];
+	glyphInfo_t *glyph;
+	int i, j, numPages, columns;
+	float x0, y0, scale;
+	qhandle_t h;
+
+	numPages = 0;
+	for ( i = GLYPH_START; i <= GLYPH_END; i++ ) {
+		if ( !font->glyphs[i].glyph ) {
+			continue;
+		}
+		for ( j = 0; j < numPages; j++ ) {
+			if ( pages[j] == font->glyphs[i].glyph ) {
+				break;
+			}
+		}
+		if ( j == numPages ) {
+			pages[ numPages++ ] = font->glyphs[i].glyph;
+		}
+		pageIndex[i] = j;
+	}
+
+	if ( numPages < 2 ) {
+		return;
+	}
+
+	Com_sprintf( name, sizeof( name ), "fonts/fontAtlas_%i", pointSize );
+	h = RE_RegisterFontAtlas( name, pages, numPages, &columns );
+	if ( !h ) {
+		return;
+	}
+
+	scale = 1.0f / columns;
+	for ( i = GLYPH_START; i <= GLYPH_END; i++ ) {
+		glyph = &font->glyphs[i];
+		if ( !glyph->glyph ) {
+			continue;
+		}
+		x0 = pageIndex[i] % columns;
+		y0 = pageIndex[i] / columns;
+		glyph->s = ( glyph->s + x0 ) * scale;
+		glyph->t = ( glyph->t + y0 ) * scale;
+		glyph->s2 = ( glyph->s2 + x0 ) * scale;
+		glyph->t2 = ( glyph->t2 + y0 ) * scale;
+		glyph->glyph = h;
+		Q_strncpyz( glyph->shaderName, name, sizeof( glyph->shaderName ) );
+	}
+}
+
+
 void RE_RegisterFont(const char *fontName, int pointSize, fontInfo_t *font) {
 #ifdef BUILD_FREETYPE
 	FT_Face face;
@@ -404,6 +470,7 @@ void RE_RegisterFont(const char *fontName, int pointSize, fontInfo_t *font) {
 		for (i = GLYPH_START; i <= GLYPH_END; i++) {
 			font->glyphs[i].glyph = RE_RegisterShaderNoMip(font->glyphs[i].shaderName);
 		}
+		R_MergeFontPages(font, pointSize);
 		Com_Memcpy(&registeredFont[registeredFontCount++], font, sizeof(fontInfo_t));
 		ri.FS_FreeFile(faceData);
 		return;
@@ -437,15 +504,15 @@ void RE_RegisterFont(const char *fontName, int pointSize, fontInfo_t *font) {
 
 	//*font = &registeredFonts[registeredFontCount++];
 
-	// make a 256x256 image buffer, once it is full, register it, clean it and keep going 
+	// make a FONT_PAGE_SIZE square image buffer, once it is full, register it, clean it and keep going 
 	// until all glyphs are rendered
 
-	out = ri.Malloc(256*256);
+	out = ri.Malloc(FONT_PAGE_SIZE*FONT_PAGE_SIZE);
 	if (out == NULL) {
 		ri.Printf(PRINT_WARNING, "RE_RegisterFont: ri.Malloc failure during output image creation.\n");
 		return;
 	}
-	Com_Memset(out, 0, 256*256);
+	Com_Memset(out, 0, FONT_PAGE_SIZE*FONT_PAGE_SIZE);
 
 	maxHeight = 0;
 
@@ -473,7 +540,7 @@ void RE_RegisterFont(const char *fontName, int pointSize, fontInfo_t *font) {
 			// we need to create an image from the bitmap, set all the handles in the glyphs to this point
 			// 
 
-			scaledSize = 256*256;
+			scaledSize = FONT_PAGE_SIZE*FONT_PAGE_SIZE;
 			newSize = scaledSize * 4;
 			imageBuff = ri.Malloc(newSize);
 			left = 0;
@@ -498,18 +565,18 @@ void RE_RegisterFont(const char *fontName, int pointSize, fontInfo_t *font) {
 
 			Com_sprintf (name, sizeof(name), "fonts/fontImage_%i_%i.tga", imageNumber++, pointSize);
 			if (r_saveFontData->integer) { 
-				WriteTGA(name, imageBuff, 256, 256);
+				WriteTGA(name, imageBuff, FONT_PAGE_SIZE, FONT_PAGE_SIZE);
 			}
 
 			//Com_sprintf (name, sizeof(name), "fonts/fontImage_%i_%i", imageNumber++, pointSize);
-			image = R_CreateImage(name, NULL, imageBuff, 256, 256, IMGFLAG_CLAMPTOEDGE );
+			image = R_CreateImage(name, NULL, imageBuff, FONT_PAGE_SIZE, FONT_PAGE_SIZE, IMGFLAG_CLAMPTOEDGE );
 			h = RE_RegisterShaderFromImage(name, LIGHTMAP_2D, image, qfalse);
 			for (j = lastStart; j < i; j++) {
 				font->glyphs[j].glyph = h;
 				Q_strncpyz(font->glyphs[j].shaderName, name, sizeof(font->glyphs[j].shaderName));
 			}
 			lastStart = i;
-			Com_Memset(out, 0, 256*256);
+			Com_Memset(out, 0, FONT_PAGE_SIZE*FONT_PAGE_SIZE);
 			xOut = 0;
 			yOut = 0;
 			ri.Free(imageBuff);
@@ -23,6 +23,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "../renderercommon/tr_public.h"
 #include "../qcommon/puff.h"
 
+#if idx64
+#include <emmintrin.h>
+#endif
+
 // we could limit the png size to a lower value here
 #ifndef INT_MAX
 #define INT_MAX 0x1fffffff
@@ -500,11 +504,73 @@ static qboolean FindChunk(struct BufferedFile *BF, uint32_t ChunkType)
 	return(qtrue);
 }
 
+/*
+ *  Size of the filtered image data described by the header,
+ *  zero if the header is invalid.
+ */
+
+static uint32_t ExpectedDataLength(const struct PNG_Chunk_IHDR *IHDR)
+{
+	static const uint32_t WOffset[PNG_Adam7_NumPasses] = { 0, 4, 0, 2, 0, 1, 0 };
+	static const uint32_t WSkip[PNG_Adam7_NumPasses]   = { 8, 8, 4, 4, 2, 2, 1 };
+	static const uint32_t HOffset[PNG_Adam7_NumPasses] = { 0, 0, 4, 0, 2, 0, 1 };
+	static const uint32_t HSkip[PNG_Adam7_NumPasses]   = { 8, 8, 8, 4, 4, 2, 2 };
+	uint32_t Width, Height, BitsPerPixel, PassWidth, PassHeight, Length, a;
+
+	switch(IHDR->ColourType)
+	{
+		case PNG_ColourType_Grey      : BitsPerPixel = PNG_NumColourComponents_Grey;      break;
+		case PNG_ColourType_True      : BitsPerPixel = PNG_NumColourComponents_True;      break;
+		case PNG_ColourType_Indexed   : BitsPerPixel = PNG_NumColourComponents_Indexed;   break;
+		case PNG_ColourType_GreyAlpha : BitsPerPixel = PNG_NumColourComponents_GreyAlpha; break;
+		case PNG_ColourType_TrueAlpha : BitsPerPixel = PNG_NumColourComponents_TrueAlpha; break;
+		default : return(0);
+	}
+
+	BitsPerPixel *= IHDR->BitDepth;
+
+	Width  = BigLong(IHDR->Width);
+	Height = BigLong(IHDR->Height);
+
+	if(Width >= (1 << 24) || Height >= (1 << 24))
+	{
+		return(0);
+	}
+
+	if(IHDR->InterlaceMethod == PNG_InterlaceMethod_NonInterlaced)
+	{
+		return(((Width * BitsPerPixel + 7) / 8 + 1) * Height);
+	}
+
+	if(IHDR->InterlaceMethod != PNG_InterlaceMethod_Interlaced)
+	{
+		return(0);
+	}
+
+	Length = 0;
+
+	for(a = 0; a < PNG_Adam7_NumPasses; a++)
+	{
+		PassWidth  = (Width  > WOffset[a]) ? (Width  - WOffset[a] + WSkip[a] - 1) / WSkip[a] : 0;
+		PassHeight = (Height > HOffset[a]) ? (Height - HOffset[a] + HSkip[a] - 1) / HSkip[a] : 0;
+
+		if(PassWidth && PassHeight)
+		{
+			Length += ((PassWidth * BitsPerPixel + 7) / 8 + 1) * PassHeight;
+		}
+	}
+
+	return(Length);
+}
+
 /*
  *  Decompress all IDATs
+ *
+ *  With a known ExpectedLength the stream is inflated in one go
+ *  by the engine decoder, puff() is only the fallback.
  */
 
-static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
+static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer, uint32_t ExpectedLength)
 {
 	uint8_t  *DecompressedData;
 	uint32_t  DecompressedDataLength;
@@ -696,6 +762,34 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
 		} 
 	}
 
+	if(CompressedDataLength <= PNG_ZlibHeader_Size + PNG_ZlibCheckValue_Size)
+	{
+		ri.Free(CompressedData);
+
+		return((unsigned)-1);
+	}
+
+	/*
+	 *  Fast path, inflate straight into a buffer of the expected size.
+	 */
+
+	if(ExpectedLength > 0 && ExpectedLength <= INT_MAX)
+	{
+		DecompressedData = ri.Malloc(ExpectedLength);
+
+		if(ri.FS_InflateBuffer(DecompressedData, ExpectedLength,
+			CompressedData + PNG_ZlibHeader_Size, CompressedDataLength - PNG_ZlibHeader_Size - PNG_ZlibCheckValue_Size))
+		{
+			ri.Free(CompressedData);
+
+			*Buffer = DecompressedData;
+
+			return(ExpectedLength);
+		}
+
+		ri.Free(DecompressedData);
+	}
+
 	/*
 	 *  Let puff() calculate the decompressed data length.
 	 */
@@ -815,23 +909,86 @@ static uint8_t PredictPaeth(uint8_t a, uint8_t b, uint8_t c)
 
 /*
  *  Reverse the filters.
+ *
+ *  The filter type is checked once per scanline, bytes without a left
+ *  neighbour see zeros. Every 4 byte per pixel filter has an SSE2 version
+ *  on x86_64 that gives the same results.
  */
 
+#if idx64
+
+static void UnfilterAverage4(uint8_t *Row, const uint8_t *Up, uint32_t Length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a, b, x;
+	uint32_t i;
+
+	a = zero;
+
+	for(i = 0; i < Length; i += 4)
+	{
+		b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)(Up + i)), zero);
+		x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)(Row + i)), zero);
+		x = _mm_add_epi16(x, _mm_srli_epi16(_mm_add_epi16(a, b), 1));
+		x = _mm_packus_epi16(_mm_and_si128(x, _mm_set1_epi16(0xFF)), zero);
+		*(int *)(Row + i) = _mm_cvtsi128_si32(x);
+		a = _mm_unpacklo_epi8(x, zero);
+	}
+}
+
+static void UnfilterPaeth4(uint8_t *Row, const uint8_t *Up, uint32_t Length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a, b, c, x, pa, pb, pc, t, ma, mb, pred;
+	uint32_t i;
+
+	a = c = zero;
+
+	for(i = 0; i < Length; i += 4)
+	{
+		b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)(Up + i)), zero);
+		x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)(Row + i)), zero);
+
+		// pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+		pa = _mm_sub_epi16(b, c);
+		pb = _mm_sub_epi16(a, c);
+		pc = _mm_add_epi16(pa, pb);
+		pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+		pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+		pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+		// a if pa <= pb && pa <= pc, else b if pb <= pc, else c
+		ma = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+		mb = _mm_cmpgt_epi16(pb, pc);
+		t = _mm_or_si128(_mm_andnot_si128(mb, b), _mm_and_si128(mb, c));
+		pred = _mm_or_si128(_mm_andnot_si128(ma, a), _mm_and_si128(ma, t));
+
+		x = _mm_add_epi16(x, pred);
+		x = _mm_packus_epi16(_mm_and_si128(x, _mm_set1_epi16(0xFF)), zero);
+		*(int *)(Row + i) = _mm_cvtsi128_si32(x);
+
+		a = _mm_unpacklo_epi8(x, zero);
+		c = b;
+	}
+}
+
+#endif
+
 static qboolean UnfilterImage(uint8_t  *DecompressedData, 
 		uint32_t  ImageHeight,
 		uint32_t  BytesPerScanline, 
 		uint32_t  BytesPerPixel)
 {
-	uint8_t   *DecompPtr;
+	uint8_t   *Row;
+	const uint8_t *Up;
 	uint8_t   FilterType;
-	uint8_t  *PixelLeft, *PixelUp, *PixelUpLeft;
-	uint32_t  w, h, p;
+	uint32_t  h, i, Length;
 
 	/*
-	 *  some zeros for the filters
+	 *  a zero line above the first one
 	 */
 
-	uint8_t Zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	static const uint8_t Zeros[1] = {0};
 
 	/*
 	 *  input verification
@@ -852,18 +1009,10 @@ static qboolean UnfilterImage(uint8_t  *DecompressedData,
 	}
 
 	/*
-	 *  Set the pointer to the start of the decompressed Data.
-	 */
-
-	DecompPtr = DecompressedData;
-
-	/*
-	 *  Un-filtering is done in place.
+	 *  Un-filtering is done in place, only whole pixels are covered.
 	 */
 
-	/*
-	 *  Go trough all scanlines.
-	 */
+	Length = (BytesPerScanline / BytesPerPixel) * BytesPerPixel;
 
 	for(h = 0; h < ImageHeight; h++)
 	{
@@ -871,118 +1020,126 @@ static qboolean UnfilterImage(uint8_t  *DecompressedData,
 		 *  Every scanline starts with a FilterType byte.
 		 */
 
-		FilterType = *DecompPtr;
-		DecompPtr++;
-
-		/*
-		 *  Left pixel of the first byte in a scanline is zero.
-		 */
-
-		PixelLeft = Zeros;
-
-		/*
-		 *  Set PixelUp to previous line only if we are on the second line or above.
-		 *
-		 *  Plus one byte for the FilterType
-		 */
-
-		if(h > 0)
-		{
-			PixelUp = DecompPtr - (BytesPerScanline + 1);
-		}
-		else
-		{
-			PixelUp = Zeros;
-		}
-
-		/*
-		 * The pixel left to the first pixel of the previous scanline is zero too.
-		 */
-
-		PixelUpLeft = Zeros;
-
-		/*
-		 *  Cycle trough all pixels of the scanline.
-		 */
+		FilterType = DecompressedData[h * (BytesPerScanline + 1)];
+		Row = DecompressedData + h * (BytesPerScanline + 1) + 1;
 
-		for(w = 0; w < (BytesPerScanline / BytesPerPixel); w++)
+		if(h == 0)
 		{
 			/*
-			 *  Cycle trough the bytes of the pixel.
+			 *  Up is zero on the first line, Up becomes None,
+			 *  Paeth becomes Sub and Average halves the left byte.
 			 */
 
-			for(p = 0; p < BytesPerPixel; p++)
+			Up = Zeros;
+
+			if(FilterType == PNG_FilterType_Up)
 			{
-				switch(FilterType)
-				{ 
-					case PNG_FilterType_None :
-					{
-						/*
-						 *  The byte is unfiltered.
-						 */
+				continue;
+			}
 
-						break;
-					}
+			if(FilterType == PNG_FilterType_Paeth)
+			{
+				FilterType = PNG_FilterType_Sub;
+			}
 
-					case PNG_FilterType_Sub :
-					{
-						DecompPtr[p] += PixelLeft[p];
+			if(FilterType == PNG_FilterType_Average)
+			{
+				for(i = BytesPerPixel; i < Length; i++)
+				{
+					Row[i] += Row[i - BytesPerPixel] / 2;
+				}
 
-						break;
-					}
+				continue;
+			}
+		}
+		else
+		{
+			Up = Row - (BytesPerScanline + 1);
+		}
 
-					case PNG_FilterType_Up :
-					{
-						DecompPtr[p] += PixelUp[p];
+		switch(FilterType)
+		{ 
+			case PNG_FilterType_None :
+			{
+				break;
+			}
 
-						break;
-					}
+			case PNG_FilterType_Sub :
+			{
+				for(i = BytesPerPixel; i < Length; i++)
+				{
+					Row[i] += Row[i - BytesPerPixel];
+				}
 
-					case PNG_FilterType_Average :
-					{
-						DecompPtr[p] += ((uint8_t) ((((uint16_t) PixelLeft[p]) + ((uint16_t) PixelUp[p])) / 2));
+				break;
+			}
 
-						break;
-					}
+			case PNG_FilterType_Up :
+			{
+				i = 0;
+#if idx64
+				for(; i + 16 <= Length; i += 16)
+				{
+					_mm_storeu_si128((__m128i *)(Row + i), _mm_add_epi8(_mm_loadu_si128((const __m128i *)(Row + i)), _mm_loadu_si128((const __m128i *)(Up + i))));
+				}
+#endif
+				for(; i < Length; i++)
+				{
+					Row[i] += Up[i];
+				}
 
-					case PNG_FilterType_Paeth :
-					{
-						DecompPtr[p] += PredictPaeth(PixelLeft[p], PixelUp[p], PixelUpLeft[p]);
+				break;
+			}
 
-						break;
-					}
+			case PNG_FilterType_Average :
+			{
+#if idx64
+				if(BytesPerPixel == 4)
+				{
+					UnfilterAverage4(Row, Up, Length);
 
-					default :
-					{
-						return(qfalse);
-					}
+					break;
+				}
+#endif
+				for(i = 0; i < BytesPerPixel; i++)
+				{
+					Row[i] += Up[i] / 2;
 				}
-			}
 
-			PixelLeft = DecompPtr;
+				for(; i < Length; i++)
+				{
+					Row[i] += (uint8_t) ((((uint16_t) Row[i - BytesPerPixel]) + ((uint16_t) Up[i])) / 2);
+				}
 
-			/*
-			 *  We only have an upleft pixel if we are on the second line or above.
-			 */
+				break;
+			}
 
-			if(h > 0)
+			case PNG_FilterType_Paeth :
 			{
-				PixelUpLeft = DecompPtr - (BytesPerScanline + 1);
-			}
+#if idx64
+				if(BytesPerPixel == 4)
+				{
+					UnfilterPaeth4(Row, Up, Length);
 
-			/*
-			 *  Skip to the next pixel.
-			 */
+					break;
+				}
+#endif
+				for(i = 0; i < BytesPerPixel; i++)
+				{
+					Row[i] += Up[i];
+				}
 
-			DecompPtr += BytesPerPixel;
+				for(; i < Length; i++)
+				{
+					Row[i] += PredictPaeth(Row[i - BytesPerPixel], Up[i], Up[i - BytesPerPixel]);
+				}
 
-			/*
-			 *  We only have a previous line if we are on the second line and above.
-			 */
+				break;
+			}
 
-			if(h > 0)
+			default :
 			{
-				PixelUp = DecompPtr - (BytesPerScanline + 1);
+				return(qfalse);
 			}
 		}
 	}
@@ -1456,6 +1613,39 @@ static qboolean DecodeImageNonInterlaced(struct PNG_Chunk_IHDR *IHDR,
 	OutPtr = OutBuffer;
 	DecompPtr = DecompressedData;
 
+	/*
+	 *  8 bit RGBA and RGB scanlines are copied without per pixel conversion.
+	 */
+
+	if((IHDR->BitDepth == PNG_BitDepth_8) &&
+		((IHDR->ColourType == PNG_ColourType_TrueAlpha) || ((IHDR->ColourType == PNG_ColourType_True) && !HasTransparentColour)))
+	{
+		for(h = 0; h < IHDR_Height; h++)
+		{
+			DecompPtr++;
+
+			if(IHDR->ColourType == PNG_ColourType_TrueAlpha)
+			{
+				memcpy(OutPtr, DecompPtr, IHDR_Width * Q3IMAGE_BYTESPERPIXEL);
+			}
+			else
+			{
+				for(w = 0; w < IHDR_Width; w++)
+				{
+					OutPtr[w * 4 + 0] = DecompPtr[w * 3 + 0];
+					OutPtr[w * 4 + 1] = DecompPtr[w * 3 + 1];
+					OutPtr[w * 4 + 2] = DecompPtr[w * 3 + 2];
+					OutPtr[w * 4 + 3] = 0xFF;
+				}
+			}
+
+			OutPtr += IHDR_Width * Q3IMAGE_BYTESPERPIXEL;
+			DecompPtr += BytesPerScanline;
+		}
+
+		return(qtrue);
+	}
+
 	/*
 	 *  Create the output image.
 	 */
@@ -2387,7 +2577,7 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 	 *  Decompress all IDAT chunks
 	 */
 
-	DecompressedDataLength = DecompressIDATs(ThePNG, &DecompressedData);
+	DecompressedDataLength = DecompressIDATs(ThePNG, &DecompressedData, ExpectedDataLength(IHDR));
 	if ( DecompressedDataLength == (unsigned)-1 )
 		DecompressedDataLength = 0;
 
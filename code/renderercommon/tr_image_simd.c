@@ -0,0 +1,202 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "../qcommon/q_shared.h"
+#include "../renderercommon/tr_public.h"
+
+/*
+
+SSE2 inner loops of the image processing in tr_image.c, SSE2 is always
+available on x86_64 so there is nothing to detect.
+
+Every kernel repeats the integer math of the scalar loop it replaces,
+sums stay in 16-bit lanes and never overflow, so results are bit-exact.
+
+*/
+
+#if idx64
+
+#include <emmintrin.h>
+
+/*
+=================
+R_ResampleRowSSE2
+
+Point samples two rows at four columns each and averages them,
+p1 and p2 hold byte offsets of the left and right samples
+=================
+*/
+void R_ResampleRowSSE2( unsigned *out, const unsigned *inrow, const unsigned *inrow2, const unsigned *p1, const unsigned *p2, int count )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const byte *r1 = (const byte *)inrow;
+	const byte *r2 = (const byte *)inrow2;
+	__m128i a, b, c, d, lo, hi;
+	const byte *pix1, *pix2, *pix3, *pix4;
+	int j;
+
+#define SAMPLE(row,ofs,n) *(const int *)((row) + (ofs)[ j + (n) ])
+	for ( j = 0; j + 4 <= count; j += 4 ) {
+		a = _mm_setr_epi32( SAMPLE( r1, p1, 0 ), SAMPLE( r1, p1, 1 ), SAMPLE( r1, p1, 2 ), SAMPLE( r1, p1, 3 ) );
+		b = _mm_setr_epi32( SAMPLE( r1, p2, 0 ), SAMPLE( r1, p2, 1 ), SAMPLE( r1, p2, 2 ), SAMPLE( r1, p2, 3 ) );
+		c = _mm_setr_epi32( SAMPLE( r2, p1, 0 ), SAMPLE( r2, p1, 1 ), SAMPLE( r2, p1, 2 ), SAMPLE( r2, p1, 3 ) );
+		d = _mm_setr_epi32( SAMPLE( r2, p2, 0 ), SAMPLE( r2, p2, 1 ), SAMPLE( r2, p2, 2 ), SAMPLE( r2, p2, 3 ) );
+
+		lo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) ),
+			_mm_add_epi16( _mm_unpacklo_epi8( c, zero ), _mm_unpacklo_epi8( d, zero ) ) );
+		hi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) ),
+			_mm_add_epi16( _mm_unpackhi_epi8( c, zero ), _mm_unpackhi_epi8( d, zero ) ) );
+
+		lo = _mm_srli_epi16( lo, 2 );
+		hi = _mm_srli_epi16( hi, 2 );
+
+		_mm_storeu_si128( (__m128i *)( out + j ), _mm_packus_epi16( lo, hi ) );
+	}
+#undef SAMPLE
+
+	for ( ; j < count; j++ ) {
+		pix1 = r1 + p1[j];
+		pix2 = r1 + p2[j];
+		pix3 = r2 + p1[j];
+		pix4 = r2 + p2[j];
+		((byte *)(out+j))[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0])>>2;
+		((byte *)(out+j))[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1])>>2;
+		((byte *)(out+j))[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2])>>2;
+		((byte *)(out+j))[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3])>>2;
+	}
+}
+
+
+/*
+=================
+R_MipMapRowSSE2
+
+Box filters two rows into count output pixels, may operate in place
+=================
+*/
+void R_MipMapRowSSE2( byte *out, const byte *in, const byte *in2, int count )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a, b, lo, hi;
+	int j;
+
+	for ( j = 0; j + 2 <= count; j += 2, out += 8, in += 16, in2 += 16 ) {
+		a = _mm_loadu_si128( (const __m128i *)in );
+		b = _mm_loadu_si128( (const __m128i *)in2 );
+
+		// vertical sums of four input columns
+		lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+		hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+
+		// horizontal pairs
+		lo = _mm_add_epi16( lo, _mm_srli_si128( lo, 8 ) );
+		hi = _mm_add_epi16( hi, _mm_srli_si128( hi, 8 ) );
+		lo = _mm_srli_epi16( _mm_unpacklo_epi64( lo, hi ), 2 );
+
+		_mm_storel_epi64( (__m128i *)out, _mm_packus_epi16( lo, lo ) );
+	}
+
+	for ( ; j < count; j++, out += 4, in += 8, in2 += 8 ) {
+		out[0] = (in[0] + in[4] + in2[0] + in2[4])>>2;
+		out[1] = (in[1] + in[5] + in2[1] + in2[5])>>2;
+		out[2] = (in[2] + in[6] + in2[2] + in2[6])>>2;
+		out[3] = (in[3] + in[7] + in2[3] + in2[7])>>2;
+	}
+}
+
+
+/*
+=================
+R_MipMap2SpanSSE2
+
+4x4 tent filter of R_MipMap2 for output pixels that need no
+horizontal wrapping, rows point to the leftmost input column
+of the first output pixel
+=================
+*/
+void R_MipMap2SpanSSE2( unsigned *out, const unsigned *row0, const unsigned *row1, const unsigned *row2, const unsigned *row3, int count )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wlo = _mm_setr_epi16( 1, 1, 1, 1, 2, 2, 2, 2 );
+	const __m128i whi = _mm_setr_epi16( 2, 2, 2, 2, 1, 1, 1, 1 );
+	const __m128i div9 = _mm_set1_epi16( 7282 );	// (x * 7282) >> 16 == x / 9 for x < 2296
+	__m128i a, b, c, d, lo, hi;
+	int j;
+
+	for ( j = 0; j < count; j++, row0 += 2, row1 += 2, row2 += 2, row3 += 2 ) {
+		a = _mm_loadu_si128( (const __m128i *)row0 );
+		b = _mm_loadu_si128( (const __m128i *)row1 );
+		c = _mm_loadu_si128( (const __m128i *)row2 );
+		d = _mm_loadu_si128( (const __m128i *)row3 );
+
+		// vertical 1 2 2 1
+		lo = _mm_add_epi16( _mm_unpacklo_epi8( b, zero ), _mm_unpacklo_epi8( c, zero ) );
+		lo = _mm_add_epi16( _mm_slli_epi16( lo, 1 ), _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( d, zero ) ) );
+		hi = _mm_add_epi16( _mm_unpackhi_epi8( b, zero ), _mm_unpackhi_epi8( c, zero ) );
+		hi = _mm_add_epi16( _mm_slli_epi16( hi, 1 ), _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( d, zero ) ) );
+
+		// horizontal 1 2 2 1
+		lo = _mm_add_epi16( _mm_mullo_epi16( lo, wlo ), _mm_mullo_epi16( hi, whi ) );
+		lo = _mm_add_epi16( lo, _mm_srli_si128( lo, 8 ) );
+
+		// total / 36
+		lo = _mm_mulhi_epu16( _mm_srli_epi16( lo, 2 ), div9 );
+
+		out[j] = (unsigned)_mm_cvtsi128_si32( _mm_packus_epi16( lo, lo ) );
+	}
+}
+
+
+/*
+=================
+R_BlendOverTextureSSE2
+
+Blends color channels, alpha is kept
+=================
+*/
+void R_BlendOverTextureSSE2( byte *data, int pixelCount, int inverseAlpha, const int *premult )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i inv = _mm_set1_epi16( inverseAlpha );
+	const __m128i pre = _mm_setr_epi16( premult[0], premult[1], premult[2], 0, premult[0], premult[1], premult[2], 0 );
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+	__m128i v, lo, hi;
+	int i;
+
+	// 255 * inverseAlpha + premult fits in unsigned 16 bits
+	for ( i = 0; i + 4 <= pixelCount; i += 4, data += 16 ) {
+		v = _mm_loadu_si128( (const __m128i *)data );
+		lo = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( v, zero ), inv ), pre ), 9 );
+		hi = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( v, zero ), inv ), pre ), 9 );
+		lo = _mm_packus_epi16( lo, hi );
+		lo = _mm_or_si128( _mm_andnot_si128( alpha, lo ), _mm_and_si128( alpha, v ) );
+		_mm_storeu_si128( (__m128i *)data, lo );
+	}
+
+	for ( ; i < pixelCount; i++, data += 4 ) {
+		data[0] = ( data[0] * inverseAlpha + premult[0] ) >> 9;
+		data[1] = ( data[1] * inverseAlpha + premult[1] ) >> 9;
+		data[2] = ( data[2] * inverseAlpha + premult[2] ) >> 9;
+	}
+}
+
+#endif // idx64
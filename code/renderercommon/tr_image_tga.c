@@ -39,112 +39,102 @@ typedef struct _TargaHeader {
 	unsigned char	pixel_size, attributes;
 } TargaHeader;
 
-void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
-{
-	unsigned	columns, rows, numPixels;
-	byte	*pixbuf;
-	int		row, column;
-	byte	*buf_p;
-	byte	*end;
-	union {
-		byte *b;
-		void *v;
-	} buffer;
-	TargaHeader	targa_header;
-	byte		*targa_rgba;
-	int length;
 
-	*pic = NULL;
-
-	if(width)
-		*width = 0;
-	if(height)
-		*height = 0;
-
-	//
-	// load the file
-	//
-	length = ri.FS_ReadFile ( ( char * ) name, &buffer.v);
-	if (!buffer.b || length < 0) {
-		return;
-	}
-
-	if(length < 18)
-	{
-		ri.Error( ERR_DROP, "LoadTGA: header too short (%s)", name );
-	}
+/*
+=================
+TGA_ReadHeader
 
-	buf_p = buffer.b;
-	end = buffer.b + length;
-
-	targa_header.id_length = buf_p[0];
-	targa_header.colormap_type = buf_p[1];
-	targa_header.image_type = buf_p[2];
-
-	memcpy(&targa_header.colormap_index, &buf_p[3], 2);
-	memcpy(&targa_header.colormap_length, &buf_p[5], 2);
-	targa_header.colormap_size = buf_p[7];
-	memcpy(&targa_header.x_origin, &buf_p[8], 2);
-	memcpy(&targa_header.y_origin, &buf_p[10], 2);
-	memcpy(&targa_header.width, &buf_p[12], 2);
-	memcpy(&targa_header.height, &buf_p[14], 2);
-	targa_header.pixel_size = buf_p[16];
-	targa_header.attributes = buf_p[17];
-
-	targa_header.colormap_index = LittleShort(targa_header.colormap_index);
-	targa_header.colormap_length = LittleShort(targa_header.colormap_length);
-	targa_header.x_origin = LittleShort(targa_header.x_origin);
-	targa_header.y_origin = LittleShort(targa_header.y_origin);
-	targa_header.width = LittleShort(targa_header.width);
-	targa_header.height = LittleShort(targa_header.height);
-
-	buf_p += 18;
-
-	if (targa_header.image_type!=2
-		&& targa_header.image_type!=10
-		&& targa_header.image_type != 3 )
+Validates the header, returns NULL or an error message
+=================
+*/
+static const char *TGA_ReadHeader( const byte *buffer, int length, TargaHeader *header )
+{
+	const byte *buf_p;
+	unsigned columns, rows, numPixels;
+
+	if ( length < 18 )
+		return "header too short";
+
+	buf_p = buffer;
+
+	header->id_length = buf_p[0];
+	header->colormap_type = buf_p[1];
+	header->image_type = buf_p[2];
+
+	memcpy(&header->colormap_index, &buf_p[3], 2);
+	memcpy(&header->colormap_length, &buf_p[5], 2);
+	header->colormap_size = buf_p[7];
+	memcpy(&header->x_origin, &buf_p[8], 2);
+	memcpy(&header->y_origin, &buf_p[10], 2);
+	memcpy(&header->width, &buf_p[12], 2);
+	memcpy(&header->height, &buf_p[14], 2);
+	header->pixel_size = buf_p[16];
+	header->attributes = buf_p[17];
+
+	header->colormap_index = LittleShort(header->colormap_index);
+	header->colormap_length = LittleShort(header->colormap_length);
+	header->x_origin = LittleShort(header->x_origin);
+	header->y_origin = LittleShort(header->y_origin);
+	header->width = LittleShort(header->width);
+	header->height = LittleShort(header->height);
+
+	if (header->image_type!=2
+		&& header->image_type!=10
+		&& header->image_type != 3 )
 	{
-		ri.Error (ERR_DROP, "LoadTGA: Only type 2 (RGB), 3 (gray), and 10 (RGB) TGA images supported");
+		return "Only type 2 (RGB), 3 (gray), and 10 (RGB) TGA images supported";
 	}
 
-	if ( targa_header.colormap_type != 0 )
-	{
-		ri.Error( ERR_DROP, "LoadTGA: colormaps not supported" );
-	}
+	if ( header->colormap_type != 0 )
+		return "colormaps not supported";
 
-	if ( ( targa_header.pixel_size != 32 && targa_header.pixel_size != 24 ) && targa_header.image_type != 3 )
-	{
-		ri.Error (ERR_DROP, "LoadTGA: Only 32 or 24 bit images supported (no colormaps)");
-	}
+	if ( ( header->pixel_size != 32 && header->pixel_size != 24 ) && header->image_type != 3 )
+		return "Only 32 or 24 bit images supported (no colormaps)";
 
-	columns = targa_header.width;
-	rows = targa_header.height;
+	columns = header->width;
+	rows = header->height;
 	numPixels = columns * rows * 4;
 
 	if(!columns || !rows || numPixels > 0x7FFFFFFF || numPixels / columns / 4 != rows)
-	{
-		ri.Error (ERR_DROP, "LoadTGA: %s has an invalid image size", name);
-	}
+		return "invalid image size";
 
+	if ( 18 + header->id_length > length )
+		return "header too short";
 
-	targa_rgba = ri.Malloc (numPixels);
+	return NULL;
+}
 
-	if (targa_header.id_length != 0)
-	{
-		if (buf_p + targa_header.id_length > end)
-			ri.Error( ERR_DROP, "LoadTGA: header too short (%s)", name );
 
-		buf_p += targa_header.id_length;  // skip TARGA image comment
-	}
+/*
+=================
+TGA_Decode
 
-	if ( targa_header.image_type == 2 || targa_header.image_type == 3 )
+Unpacks the image into width * height * 4 bytes of targa_rgba,
+uses no imports so it can run on job threads
+=================
+*/
+static const char *TGA_Decode( const byte *buffer, int length, const TargaHeader *header, byte *targa_rgba )
+{
+	unsigned	columns, rows;
+	byte	*pixbuf;
+	int		row, column;
+	const byte	*buf_p;
+	const byte	*end;
+
+	columns = header->width;
+	rows = header->height;
+
+	buf_p = buffer + 18 + header->id_length;  // skip TARGA image comment
+	end = buffer + length;
+
+	if ( header->image_type == 2 || header->image_type == 3 )
 	{
-		if ( buf_p + columns * rows * targa_header.pixel_size / 8 > end )
+		if ( buf_p + columns * rows * header->pixel_size / 8 > end )
 		{
-			ri.Error( ERR_DROP, "LoadTGA: file truncated (%s)", name );
+			return "file truncated";
 		}
 		// Uncompressed RGB or gray scale image
-		switch ( targa_header.pixel_size ) {
+		switch ( header->pixel_size ) {
 			case 8:
 				for ( row = rows - 1; row >= 0; row-- )	{
 					pixbuf = targa_rgba + row * columns * 4;
@@ -190,24 +180,23 @@ void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
 				}
 				break;
 			default:
-				ri.Error( ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'", targa_header.pixel_size, name );
-				break;
+				return "illegal pixel_size";
 		}
 	}
-	else if (targa_header.image_type==10) {   // Runlength encoded RGB images
+	else if (header->image_type==10) {   // Runlength encoded RGB images
 		unsigned char red,green,blue,alphabyte,packetHeader,packetSize,j;
 
 		for(row=rows-1; row>=0; row--) {
 			pixbuf = targa_rgba + row*columns*4;
 			for(column=0; column<columns; ) {
 				if(buf_p + 1 > end)
-					ri.Error (ERR_DROP, "LoadTGA: file truncated (%s)", name);
+					return "file truncated";
 				packetHeader= *buf_p++;
 				packetSize = 1 + (packetHeader & 0x7f);
 				if (packetHeader & 0x80) {        // run-length packet
-					if(buf_p + targa_header.pixel_size/8 > end)
-						ri.Error (ERR_DROP, "LoadTGA: file truncated (%s)", name);
-					switch (targa_header.pixel_size) {
+					if(buf_p + header->pixel_size/8 > end)
+						return "file truncated";
+					switch (header->pixel_size) {
 						case 24:
 								blue = *buf_p++;
 								green = *buf_p++;
@@ -221,9 +210,7 @@ void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
 								alphabyte = *buf_p++;
 								break;
 						default:
-							ri.Error( ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'", targa_header.pixel_size, name );
-							red = green = blue = alphabyte = 0; // silence compiler warning
-							break;
+							return "illegal pixel_size";
 					}
 
 					for(j=0;j<packetSize;j++) {
@@ -244,10 +231,10 @@ void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
 				}
 				else {                            // non run-length packet
 
-					if(buf_p + targa_header.pixel_size/8*packetSize > end)
-						ri.Error (ERR_DROP, "LoadTGA: file truncated (%s)", name);
+					if(buf_p + header->pixel_size/8*packetSize > end)
+						return "file truncated";
 					for(j=0;j<packetSize;j++) {
-						switch (targa_header.pixel_size) {
+						switch (header->pixel_size) {
 							case 24:
 									blue = *buf_p++;
 									green = *buf_p++;
@@ -268,8 +255,7 @@ void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
 									*pixbuf++ = alphabyte;
 									break;
 							default:
-								ri.Error( ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'", targa_header.pixel_size, name );
-								break;
+								return "illegal pixel_size";
 						}
 						column++;
 						if ((unsigned int)column==columns) { // pixel packet run spans across rows
@@ -287,6 +273,244 @@ void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
 		}
 	}
 
+	return NULL;
+}
+
+
+/*
+========================================================================
+
+Prefetched images, decoded on job threads before the level load
+asks for them. Files are read and buffers allocated on the main
+thread, only TGA_Decode runs on jobs. Anything that fails is left
+to R_LoadTGA so errors are reported as usual.
+
+========================================================================
+*/
+
+#define PREFETCH_BATCH_FILES	64
+#define PREFETCH_BATCH_BYTES	( 16 * 1024 * 1024 )	// of file data in temp memory
+#define PREFETCH_MAX_PIXELS		( 128 * 1024 * 1024 )	// decoded bytes held at once
+
+typedef struct {
+	char		name[ MAX_QPATH ];
+	byte		*pic;
+	int			width;
+	int			height;
+	qboolean	topDown;
+	// valid during decoding only
+	const byte	*file;
+	int			length;
+	TargaHeader	header;
+	const char	*error;
+} tgaPrefetch_t;
+
+static tgaPrefetch_t	*prefetched;
+static int				numPrefetched;
+
+
+static void TGA_DecodeJob( void *data, int index )
+{
+	tgaPrefetch_t *p = (tgaPrefetch_t *)data + index;
+
+	p->error = TGA_Decode( p->file, p->length, &p->header, p->pic );
+}
+
+
+/*
+=================
+TGA_DecodeBatch
+=================
+*/
+static void TGA_DecodeBatch( tgaPrefetch_t *batch, int count )
+{
+	tgaPrefetch_t *p;
+	int i;
+
+	ri.ParallelFor( TGA_DecodeJob, batch, count );
+
+	// file buffers are temp memory, release them in reverse order
+	for ( i = count - 1; i >= 0; i-- ) {
+		p = batch + i;
+		ri.FS_FreeFile( (void *)p->file );
+		p->file = NULL;
+		if ( p->error ) {
+			ri.Free( p->pic );
+			p->pic = NULL;
+		}
+	}
+}
+
+
+/*
+=================
+R_FreePrefetchedImages
+=================
+*/
+void R_FreePrefetchedImages( void )
+{
+	int i;
+
+	if ( !prefetched ) {
+		return;
+	}
+
+	for ( i = 0; i < numPrefetched; i++ ) {
+		if ( prefetched[i].pic ) {
+			ri.Free( prefetched[i].pic );
+		}
+	}
+
+	ri.Free( prefetched );
+	prefetched = NULL;
+	numPrefetched = 0;
+}
+
+
+/*
+=================
+R_PrefetchTGA
+
+Decodes the given TGA files in parallel,
+R_FreePrefetchedImages releases what wasn't used
+=================
+*/
+void R_PrefetchTGA( const char **names, int count )
+{
+	tgaPrefetch_t *p;
+	void *buffer;
+	int i, length, first, batchBytes, totalPixels;
+
+	R_FreePrefetchedImages();
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	prefetched = ri.Malloc( count * sizeof( *prefetched ) );
+	Com_Memset( prefetched, 0, count * sizeof( *prefetched ) );
+
+	first = 0;
+	batchBytes = 0;
+	totalPixels = 0;
+
+	for ( i = 0; i < count; i++ ) {
+		length = ri.FS_ReadFile( names[i], &buffer );
+		if ( !buffer ) {
+			continue;
+		}
+
+		p = &prefetched[ numPrefetched ];
+		if ( TGA_ReadHeader( buffer, length, &p->header ) || totalPixels + p->header.width * p->header.height * 4 > PREFETCH_MAX_PIXELS ) {
+			ri.FS_FreeFile( buffer );
+			continue;
+		}
+
+		Q_strncpyz( p->name, names[i], sizeof( p->name ) );
+		p->width = p->header.width;
+		p->height = p->header.height;
+		p->topDown = ( p->header.attributes & 0x20 ) ? qtrue : qfalse;
+		p->pic = ri.Malloc( p->width * p->height * 4 );
+		p->file = buffer;
+		p->length = length;
+		numPrefetched++;
+
+		batchBytes += length;
+		totalPixels += p->width * p->height * 4;
+
+		if ( numPrefetched - first >= PREFETCH_BATCH_FILES || batchBytes >= PREFETCH_BATCH_BYTES ) {
+			TGA_DecodeBatch( prefetched + first, numPrefetched - first );
+			first = numPrefetched;
+			batchBytes = 0;
+		}
+	}
+
+	if ( numPrefetched > first ) {
+		TGA_DecodeBatch( prefetched + first, numPrefetched - first );
+	}
+}
+
+
+/*
+=================
+TGA_TakePrefetched
+=================
+*/
+static qboolean TGA_TakePrefetched( const char *name, byte **pic, int *width, int *height )
+{
+	tgaPrefetch_t *p;
+	int i;
+
+	for ( i = 0, p = prefetched; i < numPrefetched; i++, p++ ) {
+		if ( p->pic && !Q_stricmp( p->name, name ) ) {
+			break;
+		}
+	}
+
+	if ( i == numPrefetched ) {
+		return qfalse;
+	}
+
+	if ( p->topDown ) {
+		ri.Printf( PRINT_WARNING, "WARNING: '%s' TGA file header declares top-down image, ignoring\n", name );
+	}
+
+	if ( width )
+		*width = p->width;
+	if ( height )
+		*height = p->height;
+
+	*pic = p->pic;
+	p->pic = NULL;
+
+	return qtrue;
+}
+
+
+void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
+{
+	union {
+		byte *b;
+		void *v;
+	} buffer;
+	TargaHeader	targa_header;
+	byte		*targa_rgba;
+	const char	*error;
+	int length;
+
+	*pic = NULL;
+
+	if(width)
+		*width = 0;
+	if(height)
+		*height = 0;
+
+	if ( TGA_TakePrefetched( name, pic, width, height ) ) {
+		return;
+	}
+
+	//
+	// load the file
+	//
+	length = ri.FS_ReadFile ( ( char * ) name, &buffer.v);
+	if (!buffer.b || length < 0) {
+		return;
+	}
+
+	error = TGA_ReadHeader( buffer.b, length, &targa_header );
+	if ( error )
+	{
+		ri.Error( ERR_DROP, "LoadTGA: %s (%s)", error, name );
+	}
+
+	targa_rgba = ri.Malloc( targa_header.width * targa_header.height * 4 );
+
+	error = TGA_Decode( buffer.b, length, &targa_header, targa_rgba );
+	if ( error )
+	{
+		ri.Error( ERR_DROP, "LoadTGA: %s (%s)", error, name );
+	}
+
 #if 0
   // TTimo: this is the chunk of code to ensure a behavior that meets TGA specs
   // bit 5 set => top-down
@@ -311,9 +535,9 @@ void R_LoadTGA ( const char *name, byte **pic, int *width, int *height)
   }
 
   if (width)
-	  *width = columns;
+	  *width = targa_header.width;
   if (height)
-	  *height = rows;
+	  *height = targa_header.height;
 
   *pic = targa_rgba;
 
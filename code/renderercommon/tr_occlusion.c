@@ -0,0 +1,302 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "../qcommon/q_shared.h"
+#include "../renderercommon/tr_public.h"
+
+/*
+
+Software occlusion buffer, a small depth pyramid of large occluders
+rasterized on the CPU for the current view before any surface is added.
+
+Every texel stores 1/w of the nearest occluder, 0 where nothing was drawn.
+Upper levels keep the minimum of their four children i.e. the farthest
+occluder of the area they cover, so a box is hidden if its nearest
+point is behind every texel it overlaps on any level.
+
+Occluders are sampled at texel centers, box rectangles are grown by one
+texel so nothing that peeks past an occluder edge can be culled.
+
+Tests only read the buffer and are safe to run from job threads.
+
+*/
+
+#define OCC_WIDTH		256
+#define OCC_HEIGHT		128
+#define OCC_LEVELS		8		// down to 2x1
+#define OCC_NEAR		1.0f	// minimal w, anything closer is never an occluder and never occluded
+#define OCC_BIAS		1.001f
+
+typedef struct {
+	int			width;
+	int			height;
+	float		*data;
+} occLevel_t;
+
+static float		occBuffer[ OCC_WIDTH * OCC_HEIGHT * 4 / 3 + OCC_LEVELS ];
+static occLevel_t	occLevels[ OCC_LEVELS ];
+static float		occMatrix[16];		// world to clip space
+static qboolean		occReady;
+
+
+/*
+=================
+R_OcclusionTransform
+=================
+*/
+static float R_OcclusionTransform( const vec3_t p, float *sx, float *sy ) {
+	const float *m = occMatrix;
+	float x, y, w;
+
+	w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+	if ( w < OCC_NEAR ) {
+		return 0.0f;
+	}
+
+	x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+	y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+
+	w = 1.0f / w;
+	*sx = ( x * w * 0.5f + 0.5f ) * OCC_WIDTH;
+	*sy = ( y * w * 0.5f + 0.5f ) * OCC_HEIGHT;
+
+	return w;
+}
+
+
+/*
+=================
+R_OcclusionClear
+
+Starts a new view, matrices are in OpenGL column-major order
+=================
+*/
+void R_OcclusionClear( const float *modelMatrix, const float *projectionMatrix ) {
+	float *data;
+	int i, j, w, h;
+
+	if ( !occLevels[0].data ) {
+		data = occBuffer;
+		w = OCC_WIDTH;
+		h = OCC_HEIGHT;
+		for ( i = 0; i < OCC_LEVELS; i++ ) {
+			occLevels[i].width = w;
+			occLevels[i].height = h;
+			occLevels[i].data = data;
+			data += w * h;
+			w = MAX( w >> 1, 1 );
+			h = MAX( h >> 1, 1 );
+		}
+	}
+
+	for ( i = 0; i < 4; i++ ) {
+		for ( j = 0; j < 4; j++ ) {
+			occMatrix[ i * 4 + j ] =
+				projectionMatrix[ 0 * 4 + j ] * modelMatrix[ i * 4 + 0 ] +
+				projectionMatrix[ 1 * 4 + j ] * modelMatrix[ i * 4 + 1 ] +
+				projectionMatrix[ 2 * 4 + j ] * modelMatrix[ i * 4 + 2 ] +
+				projectionMatrix[ 3 * 4 + j ] * modelMatrix[ i * 4 + 3 ];
+		}
+	}
+
+	Com_Memset( occLevels[0].data, 0, OCC_WIDTH * OCC_HEIGHT * sizeof( float ) );
+
+	occReady = qfalse;
+}
+
+
+/*
+=================
+R_OcclusionAddTriangle
+
+Rasterizes an opaque world triangle, caller checks facing.
+Triangles crossing the near plane are skipped rather than clipped
+=================
+*/
+void R_OcclusionAddTriangle( const vec3_t a, const vec3_t b, const vec3_t c ) {
+	float ax, ay, bx, by, cx, cy;
+	float aw, bw, cw;
+	float area, e0, e1, e2, py, px, z;
+	int x0, y0, x1, y1, x, y;
+	float *row;
+
+	aw = R_OcclusionTransform( a, &ax, &ay );
+	bw = R_OcclusionTransform( b, &bx, &by );
+	cw = R_OcclusionTransform( c, &cx, &cy );
+	if ( aw == 0.0f || bw == 0.0f || cw == 0.0f ) {
+		return;
+	}
+
+	area = ( bx - ax ) * ( cy - ay ) - ( by - ay ) * ( cx - ax );
+	if ( fabs( area ) < 1e-6f ) {
+		return;
+	}
+
+	if ( area < 0.0f ) {
+		// make winding counter-clockwise
+		float t;
+		t = bx; bx = cx; cx = t;
+		t = by; by = cy; cy = t;
+		t = bw; bw = cw; cw = t;
+		area = -area;
+	}
+
+	// pixel centers covered by the bounding rectangle
+	x0 = MAX( (int)floor( MIN( ax, MIN( bx, cx ) ) - 0.5f ) + 1, 0 );
+	y0 = MAX( (int)floor( MIN( ay, MIN( by, cy ) ) - 0.5f ) + 1, 0 );
+	x1 = MIN( (int)floor( MAX( ax, MAX( bx, cx ) ) - 0.5f ), OCC_WIDTH - 1 );
+	y1 = MIN( (int)floor( MAX( ay, MAX( by, cy ) ) - 0.5f ), OCC_HEIGHT - 1 );
+
+	area = 1.0f / area;
+
+	for ( y = y0; y <= y1; y++ ) {
+		row = occLevels[0].data + y * OCC_WIDTH;
+		py = y + 0.5f;
+		for ( x = x0; x <= x1; x++ ) {
+			px = x + 0.5f;
+			// barycentric weights from the edge functions
+			e0 = ( cx - bx ) * ( py - by ) - ( cy - by ) * ( px - bx );
+			e1 = ( ax - cx ) * ( py - cy ) - ( ay - cy ) * ( px - cx );
+			e2 = ( bx - ax ) * ( py - ay ) - ( by - ay ) * ( px - ax );
+			if ( e0 < 0.0f || e1 < 0.0f || e2 < 0.0f ) {
+				continue;
+			}
+			// 1/w is linear in screen space
+			z = ( e0 * aw + e1 * bw + e2 * cw ) * area;
+			if ( z > row[ x ] ) {
+				row[ x ] = z;
+			}
+		}
+	}
+}
+
+
+/*
+=================
+R_OcclusionBuild
+
+Builds the depth pyramid, call after all occluders are added
+=================
+*/
+void R_OcclusionBuild( void ) {
+	const occLevel_t *src;
+	const occLevel_t *dst;
+	const float *s0, *s1;
+	float *d, v;
+	int i, x, y;
+
+	for ( i = 1; i < OCC_LEVELS; i++ ) {
+		src = &occLevels[ i - 1 ];
+		dst = &occLevels[ i ];
+		for ( y = 0; y < dst->height; y++ ) {
+			s0 = src->data + ( y * 2 ) * src->width;
+			s1 = s0 + ( src->height > 1 ? src->width : 0 );
+			d = dst->data + y * dst->width;
+			for ( x = 0; x < dst->width; x++ ) {
+				v = MIN( s0[ x * 2 ], s0[ x * 2 + 1 ] );
+				v = MIN( v, s1[ x * 2 ] );
+				v = MIN( v, s1[ x * 2 + 1 ] );
+				d[ x ] = v;
+			}
+		}
+	}
+
+	occReady = qtrue;
+}
+
+
+/*
+=================
+R_OcclusionTestBounds
+
+Returns qtrue if the world space box is completely hidden by occluders
+=================
+*/
+qboolean R_OcclusionTestBounds( const vec3_t mins, const vec3_t maxs ) {
+	const occLevel_t *level;
+	const float *row;
+	float sx, sy, w, nearest;
+	float minX, minY, maxX, maxY;
+	int x0, y0, x1, y1, x, y, i;
+	vec3_t p;
+
+	if ( !occReady ) {
+		return qfalse;
+	}
+
+	minX = minY = 1e9f;
+	maxX = maxY = -1e9f;
+	nearest = 0.0f;
+
+	for ( i = 0; i < 8; i++ ) {
+		p[0] = ( i & 1 ) ? maxs[0] : mins[0];
+		p[1] = ( i & 2 ) ? maxs[1] : mins[1];
+		p[2] = ( i & 4 ) ? maxs[2] : mins[2];
+		w = R_OcclusionTransform( p, &sx, &sy );
+		if ( w == 0.0f ) {
+			return qfalse; // crosses the near plane
+		}
+		// w is linear over the box so its corners bound the depth range
+		if ( w > nearest ) {
+			nearest = w;
+		}
+		if ( sx < minX ) minX = sx;
+		if ( sx > maxX ) maxX = sx;
+		if ( sy < minY ) minY = sy;
+		if ( sy > maxY ) maxY = sy;
+	}
+
+	if ( maxX < 0.0f || maxY < 0.0f || minX >= OCC_WIDTH || minY >= OCC_HEIGHT ) {
+		return qfalse; // outside of the buffer, let frustum culling decide
+	}
+
+	nearest *= OCC_BIAS;
+
+	x0 = MAX( (int)floor( minX ) - 1, 0 );
+	y0 = MAX( (int)floor( minY ) - 1, 0 );
+	x1 = MIN( (int)floor( maxX ) + 1, OCC_WIDTH - 1 );
+	y1 = MIN( (int)floor( maxY ) + 1, OCC_HEIGHT - 1 );
+
+	// pick the level where the rectangle spans no more than four texels
+	for ( i = 0; i < OCC_LEVELS - 1; i++ ) {
+		if ( ( x1 >> i ) - ( x0 >> i ) < 4 && ( y1 >> i ) - ( y0 >> i ) < 4 ) {
+			break;
+		}
+	}
+
+	level = &occLevels[ i ];
+	x0 >>= i; x1 >>= i;
+	y0 >>= i; y1 >>= i;
+	x1 = MIN( x1, level->width - 1 );
+	y1 = MIN( y1, level->height - 1 );
+
+	for ( y = y0; y <= y1; y++ ) {
+		row = level->data + y * level->width;
+		for ( x = x0; x <= x1; x++ ) {
+			if ( row[ x ] <= nearest ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
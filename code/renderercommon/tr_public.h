@@ -25,7 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_types.h"
 #include "vulkan/vulkan.h"
 
-#define	REF_API_VERSION		8
+#define	REF_API_VERSION		14
 
 //
 // these are the functions exported by the refresh module
@@ -37,6 +37,22 @@ typedef enum {
 	REF_UNLOAD_DLL
 } refShutdownCode_t;
 
+typedef struct {
+	int		numImages;
+	int		imageBytes;		// estimated from upload size and format
+	int		vboBytes;		// static world geometry
+} refMemoryStats_t;
+
+// back end values lag one frame behind the front end, GPU time a few more
+typedef struct {
+	int		frontEndUsec;
+	int		backEndUsec;
+	float	gpuMsec;		// 0 if timer queries are not supported
+	int		surfaces;		// drawn surfaces
+	int		shaders;		// shader changes
+	int		pipelines;		// pipeline binds, 0 for OpenGL
+} frameStats_t;
+
 typedef struct {
 	// called before the library is unloaded
 	// if the system is just reconfiguring, pass destroyWindow = qfalse,
@@ -91,9 +107,14 @@ typedef struct {
 	// if the pointers are not NULL, timing info will be returned
 	void	(*EndFrame)( int *frontEndMsec, int *backEndMsec );
 
+	// counters of the last frame, keeps GPU timers running until called with NULL
+	void	(*GetFrameStats)( frameStats_t *stats );
+
 
 	int		(*MarkFragments)( int numPoints, const vec3_t *points, const vec3_t projection,
 				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer );
+	int		(*MarkFragmentsBatch)( int numRequests, markRequest_t *requests,
+				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer );
 
 	int		(*LerpTag)( orientation_t *tag,  qhandle_t model, int startFrame, int endFrame,
 					 float frac, const char *tagName );
@@ -121,6 +142,15 @@ typedef struct {
 	void	(*VertexLighting)( qboolean allowed );
 	void	(*SyncRender)( void );
 
+	void	(*MemoryStats)( refMemoryStats_t *stats );
+
+	// blocks until input for the next frame should be sampled, may be NULL
+	void	(*WaitFrame)( void );
+
+	// applies latched cvars that only need render targets and pipelines to be
+	// rebuilt while images, models and shaders stay loaded, qfalse means that
+	// a full restart is needed, may be NULL
+	qboolean (*SoftRestart)( void );
 
 } refexport_t;
 
@@ -154,6 +184,7 @@ typedef struct {
 	void	*(*Malloc)( int bytes );
 	void	(*Free)( void *buf );
 	void	(*FreeAll)( void );
+	void	*(*MallocPersistent)( int bytes );	// not released by FreeAll, use Free
 
 	cvar_t	*(*Cvar_Get)( const char *name, const char *value, int flags );
 	void	(*Cvar_Set)( const char *name, const char *value );
@@ -164,6 +195,7 @@ typedef struct {
 	void	(*Cvar_SetGroup)( cvar_t *var, cvarGroup_t group );
 	int		(*Cvar_CheckGroup)( cvarGroup_t group );
 	void	(*Cvar_ResetGroup)( cvarGroup_t group, qboolean resetModifiedFlags );
+	int		(*Cvar_ListLatched)( const char *prefix, const char **names, int maxNames );
 
 	void	(*Cvar_VariableStringBuffer)( const char *var_name, char *buffer, int bufsize );
 	const char *(*Cvar_VariableString)( const char *var_name );
@@ -192,6 +224,16 @@ typedef struct {
 	void	(*FS_WriteFile)( const char *qpath, const void *buffer, int size );
 	qboolean (*FS_FileExists)( const char *file );
 
+	// background loading, every handle must be completed with FS_WaitFile
+	int		(*FS_ReadFileAsync)( const char *name );
+	int		(*FS_WaitFile)( int handle, void **buf );
+
+	// raw deflate stream of exactly destLen bytes, thread safe
+	qboolean (*FS_InflateBuffer)( void *dest, int destLen, const void *source, int sourceLen );
+
+	// changes when file lookups may resolve to different data
+	int		(*FS_LoadStamp)( void );
+
 	// cinematic stuff
 	void	(*CIN_UploadCinematic)( int handle );
 	int		(*CIN_PlayCinematic)( const char *arg0, int xpos, int ypos, int width, int height, int bits );
@@ -211,6 +253,20 @@ typedef struct {
 
 	int		(*Com_RealTime)( qtime_t *qtime );
 
+	// calls func( data, index ) for each index in [0..count) on engine job threads,
+	// callbacks must not use any other imports
+	void	(*ParallelFor)( void (*func)( void *data, int index ), void *data, int count );
+
+	// renderer-owned worker threads, same rules as for ParallelFor callbacks
+	void	*(*Sys_CreateThread)( void (*func)( void *arg ), void *arg );
+	void	(*Sys_JoinThread)( void *thread );
+	void	*(*Sys_CreateSemaphore)( void );
+	void	(*Sys_DestroySemaphore)( void *sem );
+	void	(*Sys_WaitSemaphore)( void *sem );
+	void	(*Sys_PostSemaphore)( void *sem, int count );
+	int		(*Sys_AtomicLoad)( volatile int *ptr );
+	void	(*Sys_AtomicStore)( volatile int *ptr, int value );
+
 	// platform-dependent functions
 	void(*GLimp_InitGamma)(glconfig_t *config);
 	void(*GLimp_SetGamma)(unsigned char red[256], unsigned char green[256], unsigned char blue[256]);
@@ -220,6 +276,8 @@ typedef struct {
 	void	(*GLimp_Shutdown)( qboolean unloadDLL );
 	void	(*GLimp_EndFrame)( void );
 	void*	(*GL_GetProcAddress)( const char *name );
+	// binds (qtrue) or releases (qfalse) the context on the calling thread
+	qboolean (*GLimp_MakeCurrent)( qboolean current );
 
 	// Vulkan
 	void	(*VKimp_Init)( glconfig_t *config );
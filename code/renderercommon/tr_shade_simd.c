@@ -0,0 +1,357 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "../qcommon/q_shared.h"
+#include "../renderercommon/tr_public.h"
+
+/*
+
+SSE2 inner loops of the per-vertex texcoord and deform math in
+tr_shade_calc.c, operations are done in the same order and precision
+as in the scalar loops they replace so results are bit-exact.
+
+Vertex positions and normals are vec4_t arrays, texcoords are pairs.
+
+Shadow volume facing tests gather triangle corners through the index list,
+mark fragment planes are classified four at a time.
+
+Light grid cells are blended from eight decoded corner samples.
+
+*/
+
+#if idx64
+
+#include <emmintrin.h>
+
+/*
+=================
+R_TransformTexCoordsSSE2
+
+dst = src * matrix + translate, two texcoord pairs per iteration,
+may operate in place
+=================
+*/
+void R_TransformTexCoordsSSE2( const float *src, float *dst, int count, const float matrix[2][2], const float translate[2] )
+{
+	const __m128 a = _mm_setr_ps( matrix[0][0], matrix[1][1], matrix[0][0], matrix[1][1] );
+	const __m128 b = _mm_setr_ps( matrix[1][0], matrix[0][1], matrix[1][0], matrix[0][1] );
+	const __m128 c = _mm_setr_ps( translate[0], translate[1], translate[0], translate[1] );
+	__m128 v, w;
+	float s, t;
+	int i;
+
+	for ( i = 0; i + 2 <= count; i += 2, src += 4, dst += 4 ) {
+		v = _mm_loadu_ps( src );
+		w = _mm_shuffle_ps( v, v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		v = _mm_add_ps( _mm_add_ps( _mm_mul_ps( v, a ), _mm_mul_ps( w, b ) ), c );
+		_mm_storeu_ps( dst, v );
+	}
+
+	for ( ; i < count; i++, src += 2, dst += 2 ) {
+		s = src[0];
+		t = src[1];
+		dst[0] = s * matrix[0][0] + t * matrix[1][0] + translate[0];
+		dst[1] = s * matrix[0][1] + t * matrix[1][1] + translate[1];
+	}
+}
+
+
+/*
+=================
+R_ScaleTexCoordsSSE2
+=================
+*/
+void R_ScaleTexCoordsSSE2( const float *src, float *dst, int count, const float scale[2] )
+{
+	const __m128 m = _mm_setr_ps( scale[0], scale[1], scale[0], scale[1] );
+	int i;
+
+	for ( i = 0; i + 2 <= count; i += 2, src += 4, dst += 4 ) {
+		_mm_storeu_ps( dst, _mm_mul_ps( _mm_loadu_ps( src ), m ) );
+	}
+
+	for ( ; i < count; i++, src += 2, dst += 2 ) {
+		dst[0] = src[0] * scale[0];
+		dst[1] = src[1] * scale[1];
+	}
+}
+
+
+/*
+=================
+R_ScrollTexCoordsSSE2
+
+Sums are done in double precision like the scalar code does
+=================
+*/
+void R_ScrollTexCoordsSSE2( const float *src, float *dst, int count, double scrollS, double scrollT )
+{
+	const __m128d m = _mm_setr_pd( scrollS, scrollT );
+	__m128 v;
+	__m128d lo, hi;
+	int i;
+
+	for ( i = 0; i + 2 <= count; i += 2, src += 4, dst += 4 ) {
+		v = _mm_loadu_ps( src );
+		lo = _mm_add_pd( _mm_cvtps_pd( v ), m );
+		hi = _mm_add_pd( _mm_cvtps_pd( _mm_movehl_ps( v, v ) ), m );
+		_mm_storeu_ps( dst, _mm_movelh_ps( _mm_cvtpd_ps( lo ), _mm_cvtpd_ps( hi ) ) );
+	}
+
+	for ( ; i < count; i++, src += 2, dst += 2 ) {
+		dst[0] = src[0] + scrollS;
+		dst[1] = src[1] + scrollT;
+	}
+}
+
+
+/*
+=================
+R_EnvironmentTexCoordsSSE2
+
+Four vertexes per iteration, transposed into one register per component
+=================
+*/
+void R_EnvironmentTexCoordsSSE2( const float *xyz, const float *normal, float *st, int count, const vec3_t viewOrigin )
+{
+	const __m128 ox = _mm_set1_ps( viewOrigin[0] );
+	const __m128 oy = _mm_set1_ps( viewOrigin[1] );
+	const __m128 oz = _mm_set1_ps( viewOrigin[2] );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	const __m128 two = _mm_set1_ps( 2.0f );
+#ifndef _MSC_SSE2
+	const __m128 one = _mm_set1_ps( 1.0f );
+#endif
+	__m128 x, y, z, w, nx, ny, nz, nw, il, d, s, t;
+	vec3_t viewer;
+	float r1, r2;
+	int i;
+
+	for ( i = 0; i + 4 <= count; i += 4, xyz += 16, normal += 16, st += 8 ) {
+		x = _mm_loadu_ps( xyz + 0 );
+		y = _mm_loadu_ps( xyz + 4 );
+		z = _mm_loadu_ps( xyz + 8 );
+		w = _mm_loadu_ps( xyz + 12 );
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+
+		nx = _mm_loadu_ps( normal + 0 );
+		ny = _mm_loadu_ps( normal + 4 );
+		nz = _mm_loadu_ps( normal + 8 );
+		nw = _mm_loadu_ps( normal + 12 );
+		_MM_TRANSPOSE4_PS( nx, ny, nz, nw );
+
+		x = _mm_sub_ps( ox, x );
+		y = _mm_sub_ps( oy, y );
+		z = _mm_sub_ps( oz, z );
+
+		// same reciprocal square root as Q_rsqrt
+		il = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_mul_ps( z, z ) );
+#ifdef _MSC_SSE2
+		il = _mm_rsqrt_ps( il );
+#else
+		il = _mm_div_ps( one, _mm_sqrt_ps( il ) );
+#endif
+		x = _mm_mul_ps( x, il );
+		y = _mm_mul_ps( y, il );
+		z = _mm_mul_ps( z, il );
+
+		d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, x ), _mm_mul_ps( ny, y ) ), _mm_mul_ps( nz, z ) );
+
+		y = _mm_sub_ps( _mm_mul_ps( _mm_mul_ps( ny, two ), d ), y );
+		z = _mm_sub_ps( _mm_mul_ps( _mm_mul_ps( nz, two ), d ), z );
+
+		s = _mm_add_ps( half, _mm_mul_ps( y, half ) );
+		t = _mm_sub_ps( half, _mm_mul_ps( z, half ) );
+
+		_mm_storeu_ps( st + 0, _mm_unpacklo_ps( s, t ) );
+		_mm_storeu_ps( st + 4, _mm_unpackhi_ps( s, t ) );
+	}
+
+	for ( ; i < count; i++, xyz += 4, normal += 4, st += 2 ) {
+		VectorSubtract( viewOrigin, xyz, viewer );
+		VectorNormalizeFast( viewer );
+
+		r1 = DotProduct( normal, viewer );
+		r2 = normal[2]*2*r1 - viewer[2];
+		r1 = normal[1]*2*r1 - viewer[1];
+
+		st[0] = 0.5 + r1 * 0.5;
+		st[1] = 0.5 - r2 * 0.5;
+	}
+}
+
+
+/*
+=================
+R_DeformVertexesSSE2
+
+xyz += normal * scale, w components are kept
+=================
+*/
+void R_DeformVertexesSSE2( float *xyz, const float *normal, int count, float scale )
+{
+	const __m128 m = _mm_set1_ps( scale );
+	const __m128 mask = _mm_castsi128_ps( _mm_setr_epi32( -1, -1, -1, 0 ) );
+	__m128 offset;
+	int i;
+
+	for ( i = 0; i < count; i++, xyz += 4, normal += 4 ) {
+		offset = _mm_and_ps( _mm_mul_ps( _mm_loadu_ps( normal ), m ), mask );
+		_mm_storeu_ps( xyz, _mm_add_ps( _mm_loadu_ps( xyz ), offset ) );
+	}
+}
+
+
+/*
+=================
+R_TriangleFacingSSE2
+
+facing[i] = 1 if triangle i faces lightDir, four triangles per iteration
+=================
+*/
+void R_TriangleFacingSSE2( const float *xyz, const uint32_t *indexes, int numTris, const vec3_t lightDir, int *facing )
+{
+	const __m128 lx = _mm_set1_ps( lightDir[0] );
+	const __m128 ly = _mm_set1_ps( lightDir[1] );
+	const __m128 lz = _mm_set1_ps( lightDir[2] );
+	const __m128i one = _mm_set1_epi32( 1 );
+	__m128 x1, y1, z1, w1, x2, y2, z2, w2, x3, y3, z3, w3;
+	__m128 nx, ny, nz, d;
+	const float *v1, *v2, *v3;
+	vec3_t d1, d2, normal;
+	int i;
+
+#define VERT(t,n) ( xyz + indexes[ (t) * 3 + (n) ] * 4 )
+	for ( i = 0; i + 4 <= numTris; i += 4, indexes += 12, facing += 4 ) {
+		x1 = _mm_loadu_ps( VERT( 0, 0 ) );
+		y1 = _mm_loadu_ps( VERT( 1, 0 ) );
+		z1 = _mm_loadu_ps( VERT( 2, 0 ) );
+		w1 = _mm_loadu_ps( VERT( 3, 0 ) );
+		_MM_TRANSPOSE4_PS( x1, y1, z1, w1 );
+
+		x2 = _mm_loadu_ps( VERT( 0, 1 ) );
+		y2 = _mm_loadu_ps( VERT( 1, 1 ) );
+		z2 = _mm_loadu_ps( VERT( 2, 1 ) );
+		w2 = _mm_loadu_ps( VERT( 3, 1 ) );
+		_MM_TRANSPOSE4_PS( x2, y2, z2, w2 );
+
+		x3 = _mm_loadu_ps( VERT( 0, 2 ) );
+		y3 = _mm_loadu_ps( VERT( 1, 2 ) );
+		z3 = _mm_loadu_ps( VERT( 2, 2 ) );
+		w3 = _mm_loadu_ps( VERT( 3, 2 ) );
+		_MM_TRANSPOSE4_PS( x3, y3, z3, w3 );
+
+		// d1 = v2 - v1, d2 = v3 - v1
+		x2 = _mm_sub_ps( x2, x1 );
+		y2 = _mm_sub_ps( y2, y1 );
+		z2 = _mm_sub_ps( z2, z1 );
+		x3 = _mm_sub_ps( x3, x1 );
+		y3 = _mm_sub_ps( y3, y1 );
+		z3 = _mm_sub_ps( z3, z1 );
+
+		nx = _mm_sub_ps( _mm_mul_ps( y2, z3 ), _mm_mul_ps( z2, y3 ) );
+		ny = _mm_sub_ps( _mm_mul_ps( z2, x3 ), _mm_mul_ps( x2, z3 ) );
+		nz = _mm_sub_ps( _mm_mul_ps( x2, y3 ), _mm_mul_ps( y2, x3 ) );
+
+		d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, lx ), _mm_mul_ps( ny, ly ) ), _mm_mul_ps( nz, lz ) );
+
+		_mm_storeu_si128( (__m128i *)facing, _mm_and_si128( _mm_castps_si128( _mm_cmpgt_ps( d, _mm_setzero_ps() ) ), one ) );
+	}
+
+	for ( ; i < numTris; i++, indexes += 3, facing++ ) {
+		v1 = VERT( 0, 0 );
+		v2 = VERT( 0, 1 );
+		v3 = VERT( 0, 2 );
+		VectorSubtract( v2, v1, d1 );
+		VectorSubtract( v3, v1, d2 );
+		CrossProduct( d1, d2, normal );
+		*facing = DotProduct( normal, lightDir ) > 0 ? 1 : 0;
+	}
+#undef VERT
+}
+
+
+/*
+=================
+R_ClassifyTriangleSSE2
+
+Sides of a triangle against groups of four planes stored as rows of normal
+x, y, z and dist. Bit n of front[g] is set if any point is more than epsilon
+in front of plane g*4+n, back[g] likewise for points behind
+=================
+*/
+void R_ClassifyTriangleSSE2( const vec3_t points[3], const float *planes, int numGroups, float epsilon, byte *front, byte *back )
+{
+	const __m128 eps = _mm_set1_ps( epsilon );
+	const __m128 neps = _mm_set1_ps( -epsilon );
+	__m128 nx, ny, nz, nd, d, f, b;
+	int g, i;
+
+	for ( g = 0; g < numGroups; g++, planes += 16 ) {
+		nx = _mm_load_ps( planes + 0 );
+		ny = _mm_load_ps( planes + 4 );
+		nz = _mm_load_ps( planes + 8 );
+		nd = _mm_load_ps( planes + 12 );
+		f = b = _mm_setzero_ps();
+		for ( i = 0; i < 3; i++ ) {
+			d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( points[i][0] ), nx ), _mm_mul_ps( _mm_set1_ps( points[i][1] ), ny ) ), _mm_mul_ps( _mm_set1_ps( points[i][2] ), nz ) );
+			d = _mm_sub_ps( d, nd );
+			f = _mm_or_ps( f, _mm_cmpgt_ps( d, eps ) );
+			b = _mm_or_ps( b, _mm_cmplt_ps( d, neps ) );
+		}
+		front[g] = _mm_movemask_ps( f );
+		back[g] = _mm_movemask_ps( b );
+	}
+}
+
+
+/*
+=================
+R_BlendLightGridSSE2
+
+Accumulates factor-weighted ambient, directed and normal vectors of the
+corners set in validMask, samples are rows of twelve floats
+=================
+*/
+void R_BlendLightGridSSE2( const float *samples, const float *factors, int validMask, float *out )
+{
+	__m128 ambient, directed, normal, f;
+	int i;
+
+	ambient = directed = normal = _mm_setzero_ps();
+
+	for ( i = 0; i < 8; i++, samples += 12 ) {
+		if ( !( validMask & ( 1 << i ) ) ) {
+			continue;
+		}
+		f = _mm_set1_ps( factors[i] );
+		ambient = _mm_add_ps( ambient, _mm_mul_ps( f, _mm_loadu_ps( samples + 0 ) ) );
+		directed = _mm_add_ps( directed, _mm_mul_ps( f, _mm_loadu_ps( samples + 4 ) ) );
+		normal = _mm_add_ps( normal, _mm_mul_ps( f, _mm_loadu_ps( samples + 8 ) ) );
+	}
+
+	_mm_storeu_ps( out + 0, ambient );
+	_mm_storeu_ps( out + 4, directed );
+	_mm_storeu_ps( out + 8, normal );
+}
+
+#endif // idx64
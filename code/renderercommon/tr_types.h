@@ -209,7 +209,7 @@ typedef struct {
 	// used CDS.
 	qboolean				isFullscreen;
 	qboolean				stereoEnabled;
-	qboolean				smpActive;		// UNUSED, present for compatibility
+	qboolean				smpActive;		// render thread is running (r_smp)
 } glconfig_t;
 
 #define	myftol(x) ((int)(x))
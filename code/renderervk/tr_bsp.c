@@ -288,23 +288,68 @@ static float R_ProcessLightmap( byte *image, const byte *buf_p, float maxIntensi
 }
 
 
+typedef struct {
+	const byte	*src;
+	byte		*images;
+	int			imageSize;
+} lightmapBatch_t;
+
+static void R_ProcessLightmapJob( void *data, int index )
+{
+	const lightmapBatch_t *batch = (const lightmapBatch_t *)data;
+
+	R_ProcessLightmap( batch->images + index * batch->imageSize, batch->src + index * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3, 0 );
+}
+
+
+/*
+===============
+R_ProcessLightmaps
+
+expand all lightmaps on job threads before uploading,
+free result with ri.Hunk_FreeTempMemory()
+===============
+*/
+static byte *R_ProcessLightmaps( const byte *buf, int count, int imageSize )
+{
+	lightmapBatch_t batch;
+
+	batch.src = buf;
+	batch.imageSize = imageSize;
+	batch.images = ri.Hunk_AllocateTempMemory( count * imageSize );
+
+	ri.ParallelFor( R_ProcessLightmapJob, &batch, count );
+
+	return batch.images;
+}
+
+
+/*
+===============
+SetLightmapParams
+
+Picks atlas layout with as few pages as texture size limit allows, pages are
+sized to whole lightmap cells instead of powers of two so nearly no space is
+wasted and most maps fit into one page, i.e. one shader per surface shader
+===============
+*/
 static int SetLightmapParams( int numLightmaps, int maxTextureSize )
 {
-	lightmapWidth = log2pad( LIGHTMAP_LEN, 1 );
-	lightmapHeight = log2pad( LIGHTMAP_LEN, 1 );
+	int maxCount, perPage, numPages;
+
+	maxCount = maxTextureSize / LIGHTMAP_LEN;
+
+	numPages = ( numLightmaps + maxCount * maxCount - 1 ) / ( maxCount * maxCount );
+	perPage = ( numLightmaps + numPages - 1 ) / numPages;
 
+	// close to square
 	lightmapCountX = 1;
-	lightmapCountY = 1;
+	while ( lightmapCountX * lightmapCountX < perPage && lightmapCountX < maxCount )
+		lightmapCountX++;
+	lightmapCountY = ( perPage + lightmapCountX - 1 ) / lightmapCountX;
 
-	while ( lightmapWidth < maxTextureSize && lightmapCountX * lightmapCountY < numLightmaps )
-	{
-		lightmapWidth = log2pad( lightmapWidth + LIGHTMAP_LEN, 1 );
-		lightmapCountX = lightmapWidth / LIGHTMAP_LEN;
-		if ( lightmapCountX * lightmapCountY >= numLightmaps )
-			break;
-		lightmapHeight = log2pad( lightmapHeight + LIGHTMAP_LEN, 1 );
-		lightmapCountY = lightmapHeight / LIGHTMAP_LEN;
-	}
+	lightmapWidth = lightmapCountX * LIGHTMAP_LEN;
+	lightmapHeight = lightmapCountY * LIGHTMAP_LEN;
 
 	tr.lightmapMod = lightmapCountX * lightmapCountY;
 
@@ -313,6 +358,8 @@ static int SetLightmapParams( int numLightmaps, int maxTextureSize )
 
 	numLightmaps = ( numLightmaps + tr.lightmapMod - 1 ) / tr.lightmapMod;
 
+	ri.Printf( PRINT_DEVELOPER, "...%i lightmap pages of %ix%i\n", numLightmaps, lightmapWidth, lightmapHeight );
+
 	return numLightmaps;
 }
 
@@ -336,12 +383,12 @@ int R_GetLightmapCoords( const int lightmapIndex, float *x, float *y )
 R_LoadMergedLightmaps
 ===============
 */
-static void R_LoadMergedLightmaps( const lump_t *l, byte *image )
+static void R_LoadMergedLightmaps( const lump_t *l )
 {
 	const byte	*buf;
-	int			offs;
+	byte		*images, *image;
+	int			numImages, n;
 	int			i, x, y;
- 	float		maxIntensity = 0;
 
 	if ( l->filelen < LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3 )
 		return;
@@ -349,34 +396,37 @@ static void R_LoadMergedLightmaps( const lump_t *l, byte *image )
 	buf = fileBase + l->fileofs;
 
 	// create all the lightmaps
-	tr.numLightmaps = l->filelen / (LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3);
+	numImages = l->filelen / (LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3);
+	images = R_ProcessLightmaps( buf, numImages, LIGHTMAP_LEN * LIGHTMAP_LEN * 4 );
+
+	tr.numLightmaps = numImages;
 
 	tr.numLightmaps = SetLightmapParams( tr.numLightmaps, glConfig.maxTextureSize );
 
 	tr.lightmaps = ri.Hunk_Alloc( tr.numLightmaps * sizeof(image_t *), h_low );
 
-	for ( offs = 0, i = 0 ; i < tr.numLightmaps; i++ ) {
+	for ( n = 0, i = 0 ; i < tr.numLightmaps; i++ ) {
 
 		tr.lightmaps[ i ] = R_CreateImage( va( "*mergedLightmap%d", i ), NULL, NULL,
 			lightmapWidth, lightmapHeight, lightmapFlags | IMGFLAG_CLAMPTOBORDER );
 
 		for ( y = 0; y < lightmapCountY; y++ ) {
-			if ( offs >= l->filelen )
+			if ( n >= numImages )
 				break;
 
 			for ( x = 0; x < lightmapCountX; x++ ) {
-				if ( offs >= l->filelen )
+				if ( n >= numImages )
 					break;
 
-				R_ProcessLightmap( image, buf + offs, maxIntensity );
-				
+				image = images + n * LIGHTMAP_LEN * LIGHTMAP_LEN * 4;
+
 #ifdef USE_VULKAN
 				vk_upload_image_data( tr.lightmaps[ i ], x * LIGHTMAP_LEN, y * LIGHTMAP_LEN, LIGHTMAP_LEN, LIGHTMAP_LEN, 1, image, LIGHTMAP_LEN * LIGHTMAP_LEN * 4, qtrue );
 #else
 				R_UploadSubImage( image, x * LIGHTMAP_LEN, y * LIGHTMAP_LEN, LIGHTMAP_LEN, LIGHTMAP_LEN, tr.lightmaps[ i ] );
 #endif
 
-				offs += LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3;
+				n++;
 			}
 		}
 #ifdef USE_VULKAN
@@ -386,9 +436,7 @@ static void R_LoadMergedLightmaps( const lump_t *l, byte *image )
 #endif
 	}
 
-	//if ( r_lightmap->integer == 2 )	{
-	//	ri.Printf( PRINT_ALL, "Brightest lightmap value: %d\n", ( int ) ( maxIntensity * 255 ) );
-	//}
+	ri.Hunk_FreeTempMemory( images );
 }
 
 
@@ -399,9 +447,8 @@ R_LoadLightmaps
 */
 static void R_LoadLightmaps( const lump_t *l ) {
 	const byte	*buf;
-	byte		image[LIGHTMAP_LEN*LIGHTMAP_LEN*4];
+	byte		*images;
 	int			i, numLightmaps;
-	float		maxIntensity = 0;
 
 	tr.numLightmaps = 0;
 	tr.mergeLightmaps = qfalse;
@@ -430,7 +477,7 @@ static void R_LoadLightmaps( const lump_t *l ) {
 		// check for low texture sizes
 		if ( glConfig.maxTextureSize >= LIGHTMAP_LEN * 2 ) {
 			tr.mergeLightmaps = qtrue;
-			R_LoadMergedLightmaps( l, image ); // reuse stack space
+			R_LoadMergedLightmaps( l );
 			return;
 		}
 	}
@@ -442,15 +489,12 @@ static void R_LoadLightmaps( const lump_t *l ) {
 
 	tr.lightmaps = ri.Hunk_Alloc( tr.numLightmaps * sizeof(image_t *), h_low );
 
+	images = R_ProcessLightmaps( buf, tr.numLightmaps, LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4 );
 	for ( i = 0 ; i < tr.numLightmaps ; i++ ) {
-		maxIntensity = R_ProcessLightmap( image, buf + i * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3, maxIntensity );
-		tr.lightmaps[i] = R_CreateImage( va( "*lightmap%d", i ), NULL, image, LIGHTMAP_SIZE, LIGHTMAP_SIZE,
-			lightmapFlags | IMGFLAG_CLAMPTOEDGE );
+		tr.lightmaps[i] = R_CreateImage( va( "*lightmap%d", i ), NULL, images + i * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4,
+			LIGHTMAP_SIZE, LIGHTMAP_SIZE, lightmapFlags | IMGFLAG_CLAMPTOEDGE );
 	}
-
-	//if ( r_lightmap->integer == 2 )	{
-	//	ri.Printf( PRINT_ALL, "Brightest lightmap value: %d\n", ( int ) ( maxIntensity * 255 ) );
-	//}
+	ri.Hunk_FreeTempMemory( images );
 }
 
 
@@ -467,6 +511,84 @@ void RE_SetWorldVisData( const byte *vis ) {
 }
 
 
+/*
+=================
+R_SetVisLeafs
+
+Storage for the linear leaf culling in R_AddWorldSurfaces
+=================
+*/
+static void R_SetVisLeafs( void ) {
+	int		numLeafs;
+
+	numLeafs = MAX( s_worldData.numnodes - s_worldData.numDecisionNodes, 1 );
+
+	s_worldData.numLeafs = numLeafs;
+	s_worldData.numVisLeafs = 0;
+	s_worldData.visLeafsFrame = -1;
+	s_worldData.visLeafs = ri.Hunk_Alloc( numLeafs * sizeof( *s_worldData.visLeafs ), h_low );
+	s_worldData.visLeafBounds = ri.Hunk_Alloc( numLeafs * 6 * sizeof( *s_worldData.visLeafBounds ), h_low );
+	s_worldData.visLeafVisible = ri.Hunk_Alloc( numLeafs * sizeof( *s_worldData.visLeafVisible ), h_low );
+	s_worldData.visLeafDlights = ri.Hunk_Alloc( numLeafs * sizeof( *s_worldData.visLeafDlights ), h_low );
+}
+
+
+/*
+=================
+R_SetClusterLeafs
+
+Groups leafs by cluster so R_MarkLeaves can walk only clusters set in the PVS
+=================
+*/
+static void R_SetClusterLeafs( void ) {
+	mnode_t	*leaf;
+	int		*offsets;
+	int		i, cluster, numLeafs;
+
+	s_worldData.clusterLeafs = NULL;
+	s_worldData.clusterFirstLeaf = NULL;
+
+	if ( s_worldData.numClusters <= 0 ) {
+		return;
+	}
+
+	if ( s_worldData.vis && ( s_worldData.clusterBytes & 7 || (intptr_t)s_worldData.vis & 7 ) ) {
+		return;
+	}
+
+	numLeafs = s_worldData.numnodes - s_worldData.numDecisionNodes;
+	offsets = ri.Hunk_Alloc( ( s_worldData.numClusters + 1 ) * sizeof( *offsets ), h_low );
+	s_worldData.clusterLeafs = ri.Hunk_Alloc( MAX( numLeafs, 1 ) * sizeof( *s_worldData.clusterLeafs ), h_low );
+	s_worldData.clusterFirstLeaf = offsets;
+
+	// count leafs per cluster, then place them in original order
+	leaf = s_worldData.nodes + s_worldData.numDecisionNodes;
+	for ( i = 0; i < numLeafs; i++, leaf++ ) {
+		cluster = leaf->cluster;
+		if ( cluster >= 0 && cluster < s_worldData.numClusters ) {
+			offsets[ cluster + 1 ]++;
+		}
+	}
+	for ( i = 0; i < s_worldData.numClusters; i++ ) {
+		offsets[ i + 1 ] += offsets[ i ];
+	}
+
+	leaf = s_worldData.nodes + s_worldData.numDecisionNodes;
+	for ( i = 0; i < numLeafs; i++, leaf++ ) {
+		cluster = leaf->cluster;
+		if ( cluster >= 0 && cluster < s_worldData.numClusters ) {
+			s_worldData.clusterLeafs[ offsets[ cluster ]++ ] = leaf;
+		}
+	}
+
+	// restore first leaf offsets
+	for ( i = s_worldData.numClusters; i > 0; i-- ) {
+		offsets[ i ] = offsets[ i - 1 ];
+	}
+	offsets[ 0 ] = 0;
+}
+
+
 /*
 =================
 R_LoadVisibility
@@ -481,25 +603,37 @@ static void R_LoadVisibility( const lump_t *l ) {
 	Com_Memset( s_worldData.novis, 0xff, len );
 
 	len = l->filelen;
-	if ( !len ) {
-		return;
-	}
-	buf = fileBase + l->fileofs;
-
-	s_worldData.numClusters = LittleLong( ((int *)buf)[0] );
-	s_worldData.clusterBytes = LittleLong( ((int *)buf)[1] );
+	if ( len ) {
+		buf = fileBase + l->fileofs;
 
-	// CM_Load should have given us the vis data to share, so
-	// we don't need to allocate another copy
-	if ( tr.externalVisData ) {
-		s_worldData.vis = tr.externalVisData;
-	} else {
-		byte	*dest;
+		s_worldData.numClusters = LittleLong( ((int *)buf)[0] );
+		s_worldData.clusterBytes = LittleLong( ((int *)buf)[1] );
 
-		dest = ri.Hunk_Alloc( len - 8, h_low );
-		Com_Memcpy( dest, buf + 8, len - 8 );
-		s_worldData.vis = dest;
+		// CM_Load should have given us the vis data to share, so
+		// we don't need to allocate another copy
+		if ( tr.externalVisData ) {
+			s_worldData.vis = tr.externalVisData;
+		} else {
+			byte	*dest;
+			int		rowBytes, numRows, i;
+
+			// pad rows to 64-bit words for R_MarkLeaves
+			rowBytes = PAD( s_worldData.clusterBytes, sizeof( uint64_t ) );
+			numRows = s_worldData.clusterBytes > 0 ? ( len - 8 ) / s_worldData.clusterBytes : 0;
+			if ( numRows > s_worldData.numClusters ) {
+				numRows = s_worldData.numClusters;
+			}
+			dest = ri.Hunk_Alloc( MAX( s_worldData.numClusters, 1 ) * rowBytes, h_low );
+			for ( i = 0; i < numRows; i++ ) {
+				Com_Memcpy( dest + i * rowBytes, buf + 8 + i * s_worldData.clusterBytes, s_worldData.clusterBytes );
+			}
+			s_worldData.clusterBytes = rowBytes;
+			s_worldData.vis = dest;
+		}
 	}
+
+	R_SetClusterLeafs();
+	R_SetVisLeafs();
 }
 
 //===============================================================================
@@ -731,15 +865,360 @@ static void ParseFace( const dsurface_t *ds, const drawVert_t *verts, msurface_t
 }
 
 
+/*
+=================================================================
+
+PATCH CACHE
+
+Curved surfaces are subdivided, stitched and get their LoD error tables
+on every load, the resulting grids are saved as patchcache/<map>.grd in
+the home path and loaded from there while nothing that shapes them has
+changed.
+
+The key covers processed control points and LoD groups of all patches
+and r_subdivisions, a mismatching file is simply built again and
+overwritten. Data is kept in native byte order, included in the key.
+
+=================================================================
+*/
+
+#define PATCHCACHE_IDENT	(('D'<<24)+('R'<<16)+('G'<<8)+'P')
+#define PATCHCACHE_VERSION	1
+
+typedef struct {
+	int32_t		ident;
+	int32_t		version;
+	uint32_t	key;
+	int32_t		numGrids;
+	int32_t		size;		// of all grid records following the header
+} patchCacheHeader_t;
+
+typedef struct {
+	int32_t		surfaceNum;
+	int32_t		width;
+	int32_t		height;
+	float		meshBounds[2][3];
+	float		localOrigin[3];
+	float		meshRadius;
+	float		lodOrigin[3];
+	float		lodRadius;
+	// widthLodError[width], heightLodError[height] and verts[width*height] follow
+} patchCacheGrid_t;
+
+static srfGridMesh_t	**s_cachedGrids;	// per surface, NULL if not cached
+
+
+static int R_PatchCacheGridSize( int width, int height ) {
+	return sizeof( patchCacheGrid_t ) + ( width + height ) * sizeof( float ) + width * height * sizeof( drawVert_t );
+}
+
+
+static void R_PatchCacheName( char *name, int size ) {
+	char base[ MAX_QPATH ];
+
+	COM_StripExtension( s_worldData.name, base, sizeof( base ) );
+	if ( !Q_stricmpn( base, "maps/", 5 ) ) {
+		Com_sprintf( name, size, "patchcache/%s.grd", base + 5 );
+	} else {
+		Com_sprintf( name, size, "patchcache/%s.grd", base );
+	}
+}
+
+
+/*
+=================
+R_PatchCacheHash
+
+FNV-1a
+=================
+*/
+static uint32_t R_PatchCacheHash( uint32_t hash, const void *data, int size ) {
+	const byte *p = (const byte *)data;
+	int i;
+
+	for ( i = 0; i < size; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619U;
+	}
+
+	return hash;
+}
+
+
+static qboolean R_PatchVisible( const dsurface_t *ds ) {
+	if ( LittleLong( ds->surfaceType ) != MST_PATCH ) {
+		return qfalse;
+	}
+
+	// nodraw surfaces are not subdivided
+	if ( s_worldData.shaders[ LittleLong( ds->shaderNum ) ].surfaceFlags & SURF_NODRAW ) {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+===============
+R_LoadPatchPoints
+
+Control points of a patch as subdivided by ParseMesh
+===============
+*/
+static int R_LoadPatchPoints( const dsurface_t *ds, const drawVert_t *verts, drawVert_t *points ) {
+	int				i, j;
+	int				numPoints;
+	int				lightmapNum;
+	float			lightmapX, lightmapY;
+
+	lightmapNum = LittleLong( ds->lightmapNum );
+	if ( lightmapNum >= 0 && tr.mergeLightmaps ) {
+		lightmapNum = R_GetLightmapCoords( lightmapNum, &lightmapX, &lightmapY );
+	} else {
+		lightmapX = lightmapY = 0.0f;
+	}
+
+	verts += LittleLong( ds->firstVert );
+	numPoints = LittleLong( ds->patchWidth ) * LittleLong( ds->patchHeight );
+	for ( i = 0 ; i < numPoints ; i++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			points[i].xyz[j] = LittleFloat( verts[i].xyz[j] );
+			points[i].normal[j] = LittleFloat( verts[i].normal[j] );
+		}
+		for ( j = 0 ; j < 2 ; j++ ) {
+			points[i].st[j] = LittleFloat( verts[i].st[j] );
+			points[i].lightmap[j] = LittleFloat( verts[i].lightmap[j] );
+		}
+		R_ColorShiftLightingBytes( verts[i].color.rgba, points[i].color.rgba, qtrue );
+		if ( lightmapNum >= 0 && tr.mergeLightmaps ) {
+			// adjust lightmap coords
+			points[i].lightmap[0] = points[i].lightmap[0] * tr.lightmapScale[0] + lightmapX;
+			points[i].lightmap[1] = points[i].lightmap[1] * tr.lightmapScale[1] + lightmapY;
+		}
+	}
+
+	return numPoints;
+}
+
+
+/*
+===============
+R_PatchCacheKey
+===============
+*/
+static uint32_t R_PatchCacheKey( const dsurface_t *in, const drawVert_t *verts, int count, int *numPatches ) {
+	drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE];
+	int state[4];
+	uint32_t key;
+	float subdivisions;
+	int i, numPoints;
+
+	state[0] = PATCHCACHE_VERSION;
+	state[1] = count;
+	state[2] = LittleLong( 1 );
+	state[3] = sizeof( drawVert_t );
+	subdivisions = r_subdivisions->value;
+
+	key = R_PatchCacheHash( 2166136261U, state, sizeof( state ) );
+	key = R_PatchCacheHash( key, &subdivisions, sizeof( subdivisions ) );
+
+	*numPatches = 0;
+
+	for ( i = 0; i < count; i++, in++ ) {
+		if ( !R_PatchVisible( in ) ) {
+			continue;
+		}
+		numPoints = R_LoadPatchPoints( in, verts, points );
+		key = R_PatchCacheHash( key, &i, sizeof( i ) );
+		key = R_PatchCacheHash( key, &in->patchWidth, sizeof( in->patchWidth ) * 2 );
+		key = R_PatchCacheHash( key, in->lightmapVecs, sizeof( in->lightmapVecs[0] ) * 2 );
+		key = R_PatchCacheHash( key, points, numPoints * sizeof( points[0] ) );
+		(*numPatches)++;
+	}
+
+	return key;
+}
+
+
+/*
+===============
+R_LoadPatchCache
+
+Fills s_cachedGrids with hunk grids of a matching cache file
+===============
+*/
+static void R_LoadPatchCache( const dsurface_t *in, int count, uint32_t key, int numPatches ) {
+	char name[ MAX_QPATH ];
+	const patchCacheHeader_t *hdr;
+	const patchCacheGrid_t *rec;
+	const byte *data, *end;
+	srfGridMesh_t *grid;
+	void *buf;
+	int size, i, n, last, gridSize;
+
+	s_cachedGrids = NULL;
+
+	R_PatchCacheName( name, sizeof( name ) );
+
+	size = ri.FS_ReadFile( name, &buf );
+	if ( !buf ) {
+		return;
+	}
+
+	hdr = (const patchCacheHeader_t *)buf;
+	if ( size < (int)sizeof( *hdr ) || hdr->ident != PATCHCACHE_IDENT || hdr->version != PATCHCACHE_VERSION
+		|| hdr->key != key || hdr->numGrids != numPatches || hdr->size != size - (int)sizeof( *hdr ) ) {
+		ri.FS_FreeFile( buf );
+		return;
+	}
+
+	// validate all records before any allocation
+	data = (const byte *)( hdr + 1 );
+	end = data + hdr->size;
+	last = -1;
+	for ( n = 0; n < hdr->numGrids; n++ ) {
+		rec = (const patchCacheGrid_t *)data;
+		if ( end - data < (int)sizeof( *rec ) || rec->surfaceNum <= last || rec->surfaceNum >= count
+			|| !R_PatchVisible( in + rec->surfaceNum ) || rec->width < 1 || rec->width > MAX_GRID_SIZE
+			|| rec->height < 1 || rec->height > MAX_GRID_SIZE ) {
+			break;
+		}
+		gridSize = R_PatchCacheGridSize( rec->width, rec->height );
+		if ( end - data < gridSize ) {
+			break;
+		}
+		last = rec->surfaceNum;
+		data += gridSize;
+	}
+
+	if ( n != hdr->numGrids || data != end ) {
+		ri.FS_FreeFile( buf );
+		return;
+	}
+
+	s_cachedGrids = ri.Malloc( count * sizeof( *s_cachedGrids ) );
+	Com_Memset( s_cachedGrids, 0, count * sizeof( *s_cachedGrids ) );
+
+	data = (const byte *)( hdr + 1 );
+	for ( n = 0; n < hdr->numGrids; n++ ) {
+		rec = (const patchCacheGrid_t *)data;
+
+		size = (rec->width * rec->height - 1) * sizeof( drawVert_t ) + sizeof( *grid );
+		grid = ri.Hunk_Alloc( size, h_low );
+		grid->surfaceType = SF_GRID;
+		grid->width = rec->width;
+		grid->height = rec->height;
+		VectorCopy( rec->meshBounds[0], grid->meshBounds[0] );
+		VectorCopy( rec->meshBounds[1], grid->meshBounds[1] );
+		VectorCopy( rec->localOrigin, grid->localOrigin );
+		grid->meshRadius = rec->meshRadius;
+		VectorCopy( rec->lodOrigin, grid->lodOrigin );
+		grid->lodRadius = rec->lodRadius;
+		grid->lodFixed = 2;
+		grid->lodStitched = qtrue;
+
+		data = (const byte *)( rec + 1 );
+		grid->widthLodError = ri.Hunk_Alloc( grid->width * 4, h_low );
+		Com_Memcpy( grid->widthLodError, data, grid->width * 4 );
+		data += grid->width * 4;
+
+		grid->heightLodError = ri.Hunk_Alloc( grid->height * 4, h_low );
+		Com_Memcpy( grid->heightLodError, data, grid->height * 4 );
+		data += grid->height * 4;
+
+		i = grid->width * grid->height;
+		Com_Memcpy( grid->verts, data, i * sizeof( drawVert_t ) );
+		data += i * sizeof( drawVert_t );
+
+		s_cachedGrids[ rec->surfaceNum ] = grid;
+	}
+
+	ri.FS_FreeFile( buf );
+
+	ri.Printf( PRINT_ALL, "...loaded %i patches from %s\n", numPatches, name );
+}
+
+
+/*
+===============
+R_SavePatchCache
+
+Writes grids of all patches after stitching and LoD fixes
+===============
+*/
+static void R_SavePatchCache( uint32_t key ) {
+	char name[ MAX_QPATH ];
+	patchCacheHeader_t *hdr;
+	patchCacheGrid_t *rec;
+	const srfGridMesh_t *grid;
+	byte *buf, *data;
+	int i, size, numGrids;
+
+	size = sizeof( *hdr );
+	numGrids = 0;
+	for ( i = 0; i < s_worldData.numsurfaces; i++ ) {
+		grid = (srfGridMesh_t *) s_worldData.surfaces[i].data;
+		if ( grid->surfaceType != SF_GRID )
+			continue;
+		size += R_PatchCacheGridSize( grid->width, grid->height );
+		numGrids++;
+	}
+
+	if ( !numGrids ) {
+		return;
+	}
+
+	buf = ri.Hunk_AllocateTempMemory( size );
+
+	hdr = (patchCacheHeader_t *)buf;
+	hdr->ident = PATCHCACHE_IDENT;
+	hdr->version = PATCHCACHE_VERSION;
+	hdr->key = key;
+	hdr->numGrids = numGrids;
+	hdr->size = size - sizeof( *hdr );
+
+	data = (byte *)( hdr + 1 );
+	for ( i = 0; i < s_worldData.numsurfaces; i++ ) {
+		grid = (srfGridMesh_t *) s_worldData.surfaces[i].data;
+		if ( grid->surfaceType != SF_GRID )
+			continue;
+
+		rec = (patchCacheGrid_t *)data;
+		rec->surfaceNum = i;
+		rec->width = grid->width;
+		rec->height = grid->height;
+		VectorCopy( grid->meshBounds[0], rec->meshBounds[0] );
+		VectorCopy( grid->meshBounds[1], rec->meshBounds[1] );
+		VectorCopy( grid->localOrigin, rec->localOrigin );
+		rec->meshRadius = grid->meshRadius;
+		VectorCopy( grid->lodOrigin, rec->lodOrigin );
+		rec->lodRadius = grid->lodRadius;
+
+		data = (byte *)( rec + 1 );
+		Com_Memcpy( data, grid->widthLodError, grid->width * 4 );
+		data += grid->width * 4;
+		Com_Memcpy( data, grid->heightLodError, grid->height * 4 );
+		data += grid->height * 4;
+		Com_Memcpy( data, grid->verts, grid->width * grid->height * sizeof( drawVert_t ) );
+		data += grid->width * grid->height * sizeof( drawVert_t );
+	}
+
+	R_PatchCacheName( name, sizeof( name ) );
+	ri.FS_WriteFile( name, buf, size );
+
+	ri.Hunk_FreeTempMemory( buf );
+}
+
+
 /*
 ===============
 ParseMesh
 ===============
 */
-static void ParseMesh( const dsurface_t *ds, const drawVert_t *verts, msurface_t *surf ) {
+static void ParseMesh( const dsurface_t *ds, const drawVert_t *verts, msurface_t *surf, srfGridMesh_t *cached ) {
 	srfGridMesh_t	*grid;
-	int				i, j;
-	int				width, height, numPoints;
+	int				i;
+	int				width, height;
 	drawVert_t points[MAX_PATCH_SIZE*MAX_PATCH_SIZE];
 	int				lightmapNum;
 	float			lightmapX, lightmapY;
@@ -770,27 +1249,16 @@ static void ParseMesh( const dsurface_t *ds, const drawVert_t *verts, msurface_t
 		return;
 	}
 
+	if ( cached ) {
+		// already stitched, LoD group is set as well
+		surf->data = (surfaceType_t *)cached;
+		return;
+	}
+
 	width = LittleLong( ds->patchWidth );
 	height = LittleLong( ds->patchHeight );
 
-	verts += LittleLong( ds->firstVert );
-	numPoints = width * height;
-	for ( i = 0 ; i < numPoints ; i++ ) {
-		for ( j = 0 ; j < 3 ; j++ ) {
-			points[i].xyz[j] = LittleFloat( verts[i].xyz[j] );
-			points[i].normal[j] = LittleFloat( verts[i].normal[j] );
-		}
-		for ( j = 0 ; j < 2 ; j++ ) {
-			points[i].st[j] = LittleFloat( verts[i].st[j] );
-			points[i].lightmap[j] = LittleFloat( verts[i].lightmap[j] );
-		}
-		R_ColorShiftLightingBytes( verts[i].color.rgba, points[i].color.rgba, qtrue );
-		if ( lightmapNum >= 0 && tr.mergeLightmaps ) {
-			// adjust lightmap coords
-			points[i].lightmap[0] = points[i].lightmap[0] * tr.lightmapScale[0] + lightmapX;
-			points[i].lightmap[1] = points[i].lightmap[1] * tr.lightmapScale[1] + lightmapY;
-		}
-	}
+	R_LoadPatchPoints( ds, verts, points );
 
 	// pre-tesseleate
 	grid = R_SubdividePatchToGrid( width, height, points );
@@ -1614,6 +2082,38 @@ static void R_MovePatchSurfacesToHunk( void ) {
 }
 
 
+/*
+===============
+R_SetSurfaceBounds
+===============
+*/
+static void R_SetSurfaceBounds( msurface_t *surf ) {
+	const srfSurfaceFace_t *face;
+	int i;
+
+	switch ( *surf->data ) {
+	case SF_FACE:
+		face = (const srfSurfaceFace_t *)surf->data;
+		ClearBounds( surf->bounds[0], surf->bounds[1] );
+		for ( i = 0; i < face->numPoints; i++ ) {
+			AddPointToBounds( face->points[i], surf->bounds[0], surf->bounds[1] );
+		}
+		break;
+	case SF_GRID:
+		VectorCopy( ((const srfGridMesh_t *)surf->data)->meshBounds[0], surf->bounds[0] );
+		VectorCopy( ((const srfGridMesh_t *)surf->data)->meshBounds[1], surf->bounds[1] );
+		break;
+	case SF_TRIANGLES:
+		VectorCopy( ((const srfTriangles_t *)surf->data)->bounds[0], surf->bounds[0] );
+		VectorCopy( ((const srfTriangles_t *)surf->data)->bounds[1], surf->bounds[1] );
+		break;
+	default:
+		ClearBounds( surf->bounds[0], surf->bounds[1] );
+		break;
+	}
+}
+
+
 /*
 ===============
 R_LoadSurfaces
@@ -1626,7 +2126,8 @@ static void R_LoadSurfaces( const lump_t *surfs, const lump_t *verts, const lump
 	int			*indexes;
 	int			count;
 	int			numFaces, numMeshes, numTriSurfs, numFlares;
-	int			i;
+	int			i, numPatches;
+	uint32_t	key;
 
 	numFaces = 0;
 	numMeshes = 0;
@@ -1651,10 +2152,20 @@ static void R_LoadSurfaces( const lump_t *surfs, const lump_t *verts, const lump
 	s_worldData.surfaces = out;
 	s_worldData.numsurfaces = count;
 
+	key = 0;
+	numPatches = 0;
+	s_cachedGrids = NULL;
+	if ( r_patchCache->integer ) {
+		key = R_PatchCacheKey( in, dv, count, &numPatches );
+		if ( numPatches ) {
+			R_LoadPatchCache( in, count, key, numPatches );
+		}
+	}
+
 	for ( i = 0 ; i < count ; i++, in++, out++ ) {
 		switch ( LittleLong( in->surfaceType ) ) {
 		case MST_PATCH:
-			ParseMesh( in, dv, out );
+			ParseMesh( in, dv, out, s_cachedGrids ? s_cachedGrids[ i ] : NULL );
 			numMeshes++;
 			break;
 		case MST_TRIANGLE_SOUP:
@@ -1674,16 +2185,29 @@ static void R_LoadSurfaces( const lump_t *surfs, const lump_t *verts, const lump
 		}
 	}
 
+	if ( s_cachedGrids ) {
+		ri.Free( s_cachedGrids );
+		s_cachedGrids = NULL;
+	} else {
 #ifdef PATCH_STITCHING
-	R_StitchAllPatches();
+		R_StitchAllPatches();
 #endif
 
-	R_FixSharedVertexLodError();
+		R_FixSharedVertexLodError();
 
 #ifdef PATCH_STITCHING
-	R_MovePatchSurfacesToHunk();
+		R_MovePatchSurfacesToHunk();
 #endif
 
+		if ( numPatches ) {
+			R_SavePatchCache( key );
+		}
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		R_SetSurfaceBounds( &s_worldData.surfaces[i] );
+	}
+
 	ri.Printf( PRINT_ALL, "...loaded %d faces, %i meshes, %i trisurfs, %i flares\n", 
 		numFaces, numMeshes, numTriSurfs, numFlares );
 }
@@ -2101,6 +2625,8 @@ static void R_LoadLightGrid( const lump_t *l ) {
 	world_t	*w;
 	float	*wMins, *wMaxs;
 
+	R_ClearLightGridCache();
+
 	w = &s_worldData;
 
 	w->lightGridInverseSize[0] = 1.0f / w->lightGridSize[0];
@@ -2239,6 +2765,97 @@ qboolean RE_GetEntityToken( char *buffer, int size ) {
 }
 
 
+/*
+=================
+R_IsOccluderShader
+=================
+*/
+static qboolean R_IsOccluderShader( const shader_t *sh ) {
+	int		i;
+
+	if ( sh->sort != SS_OPAQUE || sh->isSky || sh->polygonOffset || sh->numDeforms || !sh->stages[0] ) {
+		return qfalse;
+	}
+
+	if ( !( sh->stages[0]->stateBits & GLS_DEPTHMASK_TRUE ) ) {
+		return qfalse;
+	}
+
+	for ( i = 0; i < MAX_SHADER_STAGES && sh->stages[i] && sh->stages[i]->active; i++ ) {
+		if ( sh->stages[i]->stateBits & GLS_ATEST_BITS ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+R_SetOccluders
+
+Collects large opaque planar faces of the world model
+for R_SetupOcclusion
+=================
+*/
+#define OCCLUDER_MIN_AREA	4096.0f
+
+static void R_SetOccluders( void ) {
+	const srfSurfaceFace_t *face;
+	const msurface_t *surf;
+	const int	*indexes;
+	occluder_t	*occ;
+	vec3_t		v1, v2, cross;
+	float		area;
+	int			i, j, pass;
+
+	s_worldData.occluders = NULL;
+	s_worldData.numOccluders = 0;
+
+	// count, then fill
+	for ( pass = 0; pass < 2; pass++ ) {
+		occ = s_worldData.occluders;
+		surf = s_worldData.bmodels[0].firstSurface;
+		for ( i = 0; i < s_worldData.bmodels[0].numSurfaces; i++, surf++ ) {
+			face = (const srfSurfaceFace_t *)surf->data;
+			if ( face->surfaceType != SF_FACE || !R_IsOccluderShader( surf->shader ) ) {
+				continue;
+			}
+			indexes = (const int *)((const byte *)face + face->ofsIndices);
+			area = 0.0f;
+			for ( j = 0; j < face->numIndices - 2; j += 3 ) {
+				VectorSubtract( face->points[ indexes[ j + 1 ] ], face->points[ indexes[ j ] ], v1 );
+				VectorSubtract( face->points[ indexes[ j + 2 ] ], face->points[ indexes[ j ] ], v2 );
+				CrossProduct( v1, v2, cross );
+				area += VectorLength( cross ) * 0.5f;
+			}
+			if ( area < OCCLUDER_MIN_AREA ) {
+				continue;
+			}
+			if ( pass == 1 ) {
+				occ->surf = surf;
+				occ->face = face;
+				occ->area = area;
+				ClearBounds( occ->bounds[0], occ->bounds[1] );
+				for ( j = 0; j < face->numPoints; j++ ) {
+					AddPointToBounds( face->points[ j ], occ->bounds[0], occ->bounds[1] );
+				}
+				occ++;
+			} else {
+				s_worldData.numOccluders++;
+			}
+		}
+		if ( pass == 0 ) {
+			if ( !s_worldData.numOccluders ) {
+				return;
+			}
+			s_worldData.occluders = ri.Hunk_Alloc( s_worldData.numOccluders * sizeof( *s_worldData.occluders ), h_low );
+		}
+	}
+}
+
+
 /*
 =================
 RE_LoadWorldMap
@@ -2260,6 +2877,8 @@ void RE_LoadWorldMap( const char *name ) {
 		ri.Error( ERR_DROP, "ERROR: attempted to redundantly load world map" );
 	}
 
+	R_SyncRenderThread();
+
 	// set default sun direction to be used if it isn't
 	// overridden by a shader
 	tr.sunDirection[0] = 0.45f;
@@ -2320,13 +2939,16 @@ void RE_LoadWorldMap( const char *name ) {
 	R_LoadShaders( &header->lumps[LUMP_SHADERS] );
 	R_LoadPlanes( &header->lumps[LUMP_PLANES] );
 	R_LoadFogs( &header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES] );
+	R_PrefetchShaderImages( s_worldData.shaders, s_worldData.numShaders );
 	R_LoadSurfaces( &header->lumps[LUMP_SURFACES], &header->lumps[LUMP_DRAWVERTS], &header->lumps[LUMP_DRAWINDEXES] );
+	R_FreePrefetchedImages();
 	R_LoadMarksurfaces( &header->lumps[LUMP_LEAFSURFACES] );
 	R_LoadNodesAndLeafs( &header->lumps[LUMP_NODES], &header->lumps[LUMP_LEAFS] );
 	R_LoadSubmodels( &header->lumps[LUMP_MODELS] );
 	R_LoadVisibility( &header->lumps[LUMP_VISIBILITY] );
 	R_LoadEntities( &header->lumps[LUMP_ENTITIES] );
 	R_LoadLightGrid( &header->lumps[LUMP_LIGHTGRID] );
+	R_SetOccluders();
 
 #ifdef USE_VBO
 	R_BuildWorldVBO( s_worldData.surfaces, s_worldData.numsurfaces );
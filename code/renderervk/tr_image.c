@@ -149,6 +149,104 @@ int R_SumOfUsedImages( void ) {
 }
 
 
+/*
+===============
+R_ImageEstimatedSize
+
+Approximate video memory used by image
+===============
+*/
+static int R_ImageEstimatedSize( const image_t *image, const char **format ) {
+	int estSize;
+
+	*format = "???? ";
+	estSize = image->uploadHeight * image->uploadWidth;
+
+	switch ( image->internalFormat )
+	{
+#ifdef USE_VULKAN
+		case VK_FORMAT_B8G8R8A8_UNORM:
+			*format = "BGRA ";
+			estSize *= 4;
+			break;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			*format = "RGBA ";
+			estSize *= 4;
+			break;
+		case VK_FORMAT_R8G8B8_UNORM:
+			*format = "RGB  ";
+			estSize *= 3;
+			break;
+		case VK_FORMAT_B4G4R4A4_UNORM_PACK16:
+			*format = "RGBA ";
+			estSize *= 2;
+			break;
+		case VK_FORMAT_A1R5G5B5_UNORM_PACK16:
+			*format = "RGB  ";
+			estSize *= 2;
+			break;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			*format = "BC1  ";
+			estSize /= 2;
+			break;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+			*format = "BC3  ";
+			break;
+#else
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			*format = "DXT1 ";
+			// 64 bits per 16 pixels, so 4 bits per pixel
+			estSize /= 2;
+			break;
+		case GL_RGB4_S3TC:
+			*format = "S3TC ";
+			// same as DXT1?
+			estSize /= 2;
+			break;
+		case GL_RGBA4:
+		case GL_RGBA8:
+		case GL_RGBA:
+			*format = "RGBA ";
+			// 4 bytes per pixel
+			estSize *= 4;
+			break;
+		case GL_RGB5:
+		case GL_RGB8:
+		case GL_RGB:
+			*format = "RGB  ";
+			// 3 bytes per pixel?
+			estSize *= 3;
+			break;
+#endif
+	}
+
+	// mipmap adds about 50%
+	if (image->flags & IMGFLAG_MIPMAP)
+		estSize += estSize / 2;
+
+	return estSize;
+}
+
+
+/*
+===============
+R_ImageMemory
+===============
+*/
+int R_ImageMemory( void ) {
+	const char *format;
+	int i, total;
+
+	total = 0;
+	for ( i = 0; i < tr.numImages; i++ ) {
+		total += R_ImageEstimatedSize( tr.images[ i ], &format );
+	}
+
+	return total;
+}
+
+
 /*
 ===============
 R_ImageList_f
@@ -163,69 +261,13 @@ void R_ImageList_f( void ) {
 
 	for ( i = 0; i < tr.numImages; i++ )
 	{
-		const char *format = "???? ";
+		const char *format;
 		const char *sizeSuffix;
 		int estSize;
 		int displaySize;
 
 		image = tr.images[ i ];
-		estSize = image->uploadHeight * image->uploadWidth;
-
-		switch ( image->internalFormat )
-		{
-#ifdef USE_VULKAN
-			case VK_FORMAT_B8G8R8A8_UNORM:
-				format = "BGRA ";
-				estSize *= 4;
-				break;
-			case VK_FORMAT_R8G8B8A8_UNORM:
-				format = "RGBA ";
-				estSize *= 4;
-				break;
-			case VK_FORMAT_R8G8B8_UNORM:
-				format = "RGB  ";
-				estSize *= 3;
-				break;
-			case VK_FORMAT_B4G4R4A4_UNORM_PACK16:
-				format = "RGBA ";
-				estSize *= 2;
-				break;
-			case VK_FORMAT_A1R5G5B5_UNORM_PACK16:
-				format = "RGB  ";
-				estSize *= 2;
-				break;
-#else
-			case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
-			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
-				format = "DXT1 ";
-				// 64 bits per 16 pixels, so 4 bits per pixel
-				estSize /= 2;
-				break;
-			case GL_RGB4_S3TC:
-				format = "S3TC ";
-				// same as DXT1?
-				estSize /= 2;
-				break;
-			case GL_RGBA4:
-			case GL_RGBA8:
-			case GL_RGBA:
-				format = "RGBA ";
-				// 4 bytes per pixel
-				estSize *= 4;
-				break;
-			case GL_RGB5:
-			case GL_RGB8:
-			case GL_RGB:
-				format = "RGB  ";
-				// 3 bytes per pixel?
-				estSize *= 3;
-				break;
-#endif
-		}
-
-		// mipmap adds about 50%
-		if (image->flags & IMGFLAG_MIPMAP)
-			estSize += estSize / 2;
+		estSize = R_ImageEstimatedSize( image, &format );
 
 		sizeSuffix = "b ";
 		displaySize = estSize;
@@ -308,6 +350,10 @@ static void ResampleTexture( unsigned *in, int inwidth, int inheight, unsigned *
 	for (i=0 ; i<outheight ; i++, out += outwidth) {
 		inrow = in + inwidth*(int)((i+0.25)*inheight/outheight);
 		inrow2 = in + inwidth*(int)((i+0.75)*inheight/outheight);
+#ifdef USE_SIMD_IMAGE
+		R_ResampleRowSSE2( out, inrow, inrow2, p1, p2, outwidth );
+		continue;
+#endif
 		for (j=0 ; j<outwidth ; j++) {
 			pix1 = (byte *)inrow + p1[j];
 			pix2 = (byte *)inrow + p2[j];
@@ -381,11 +427,17 @@ static void R_LightScaleTexture( byte *in, int inwidth, int inheight, qboolean o
 		}
 		else
 		{
+			byte	table[256];
+
+			// one lookup per channel instead of two
+			for (i=0 ; i<256 ; i++)
+				table[i] = s_gammatable[s_intensitytable[i]];
+
 			for (i=0 ; i<c ; i++, p+=4)
 			{
-				p[0] = s_gammatable[s_intensitytable[p[0]]];
-				p[1] = s_gammatable[s_intensitytable[p[1]]];
-				p[2] = s_gammatable[s_intensitytable[p[2]]];
+				p[0] = table[p[0]];
+				p[1] = table[p[1]];
+				p[2] = table[p[2]];
 			}
 		}
 	}
@@ -421,6 +473,18 @@ static void R_MipMap2( unsigned * const out, unsigned * const in, int inWidth, i
 
 	for ( i = 0 ; i < outHeight ; i++ ) {
 		for ( j = 0 ; j < outWidth ; j++ ) {
+#ifdef USE_SIMD_IMAGE
+			if ( j == 1 && outWidth > 2 ) {
+				// columns that need no wrapping
+				R_MipMap2SpanSSE2( temp + i * outWidth + 1,
+					in + ((i*2-1)&inHeightMask)*inWidth + 1,
+					in + ((i*2)&inHeightMask)*inWidth + 1,
+					in + ((i*2+1)&inHeightMask)*inWidth + 1,
+					in + ((i*2+2)&inHeightMask)*inWidth + 1,
+					outWidth - 2 );
+				j = outWidth - 1;
+			}
+#endif
 			outpix = (byte *) ( temp + i * outWidth + j );
 			for ( k = 0 ; k < 4 ; k++ ) {
 				total = 
@@ -494,6 +558,12 @@ static void R_MipMap( byte *out, byte *in, int width, int height ) {
 	}
 
 	for (i=0 ; i<height ; i++, in+=row) {
+#ifdef USE_SIMD_IMAGE
+		R_MipMapRowSSE2( out, in, in + row, width );
+		out += width * 4;
+		in += width * 8;
+		continue;
+#endif
 		for (j=0 ; j<width ; j++, out+=4, in+=8) {
 			out[0] = (in[0] + in[4] + in[row+0] + in[row+4])>>2;
 			out[1] = (in[1] + in[5] + in[row+1] + in[row+5])>>2;
@@ -540,6 +610,11 @@ static void R_BlendOverTexture( byte *data, int pixelCount, int mipLevel ) {
 	premult[1] = blend[1] * blend[3];
 	premult[2] = blend[2] * blend[3];
 
+#ifdef USE_SIMD_IMAGE
+	R_BlendOverTextureSSE2( data, pixelCount, inverseAlpha, premult );
+	return;
+#endif
+
 	for ( i = 0 ; i < pixelCount ; i++, data+=4 ) {
 		data[0] = ( data[0] * inverseAlpha + premult[0] ) >> 9;
 		data[1] = ( data[1] * inverseAlpha + premult[1] ) >> 9;
@@ -574,9 +649,33 @@ typedef struct {
 	int mip_levels;
 	int base_level_width;
 	int base_level_height;
+	qboolean gpu_mipmaps;	// buffer holds base level only
 } Image_Upload_Data;
 
-static void generate_image_upload_data( image_t *image, byte *data, Image_Upload_Data *upload_data ) {
+
+/*
+================
+R_GpuMipmaps
+
+Mip chain of the image can be generated by vk_upload_image_mipmaps()
+================
+*/
+static qboolean R_GpuMipmaps( const image_t *image ) {
+
+	if ( !( image->flags & IMGFLAG_MIPMAP ) || !vk.mipmapBlit || !r_gpuMipmaps->integer )
+		return qfalse;
+
+	if ( r_colorMipLevels->integer )
+		return qfalse;
+
+	// blits are done in RGBA8 only
+	if ( r_texturebits->integer > 0 && r_texturebits->integer <= 16 && !( image->flags & IMGFLAG_LIGHTMAP ) )
+		return qfalse;
+
+	return qtrue;
+}
+
+static void generate_image_upload_data( image_t *image, byte *data, Image_Upload_Data *upload_data, qboolean gpu_mipmaps ) {
 	
 	qboolean mipmap = image->flags & IMGFLAG_MIPMAP;
 	qboolean picmip = image->flags & IMGFLAG_PICMIP;
@@ -714,8 +813,16 @@ static void generate_image_upload_data( image_t *image, byte *data, Image_Upload
 
 	Com_Memcpy(upload_data->buffer, scaled_buffer, mip_level_size);
 	upload_data->buffer_size = mip_level_size;
-	
-	if ( mipmap ) {
+
+	if ( mipmap && gpu_mipmaps ) {
+		// rest of the chain is blitted by vk_upload_image_mipmaps()
+		while (scaled_width > 1 || scaled_height > 1) {
+			scaled_width = MAX( scaled_width >> 1, 1 );
+			scaled_height = MAX( scaled_height >> 1, 1 );
+			miplevel++;
+		}
+		upload_data->gpu_mipmaps = qtrue;
+	} else if ( mipmap ) {
 		while (scaled_width > 1 || scaled_height > 1) {
 			R_MipMap((byte *)scaled_buffer, (byte *)scaled_buffer, scaled_width, scaled_height);
 
@@ -746,16 +853,85 @@ static void generate_image_upload_data( image_t *image, byte *data, Image_Upload
 }
 
 
+/*
+================
+R_ImageCacheKey
+
+Covers everything generate_image_upload_data() output depends on
+================
+*/
+static uint32_t R_ImageCacheKey( const image_t *image, const byte *pic ) {
+	int state[10];
+	uint32_t key;
+
+	state[0] = image->width;
+	state[1] = image->height;
+	state[2] = image->flags;
+	state[3] = r_picmip->integer;
+	state[4] = r_nomip->integer ? tr.mapLoading : 1;
+	state[5] = r_drawFlat->integer ? tr.mapLoading : 0;
+	state[6] = r_roundImagesDown->integer;
+	state[7] = glConfig.maxTextureSize;
+	state[8] = glConfig.deviceSupportsGamma || vk.fboActive;
+	state[9] = 0;
+
+	key = R_TexCacheHash( 2166136261U, state, sizeof( state ) );
+	key = R_TexCacheHash( key, s_gammatable, sizeof( s_gammatable ) );
+	key = R_TexCacheHash( key, s_intensitytable, sizeof( s_intensitytable ) );
+	key = R_TexCacheHash( key, pic, image->width * image->height * 4 );
+
+	return key;
+}
+
+
+static void upload_vk_compressed_image( image_t *image, const texCacheData_t *cache ) {
+
+	image->internalFormat = cache->format;
+
+	image->handle = VK_NULL_HANDLE;
+	image->view = VK_NULL_HANDLE;
+	image->descriptor = VK_NULL_HANDLE;
+
+	image->uploadWidth = cache->width;
+	image->uploadHeight = cache->height;
+
+	vk_create_image( image, cache->width, cache->height, cache->mipLevels );
+	vk_upload_image_data( image, 0, 0, cache->width, cache->height, cache->mipLevels, cache->data, cache->size, qfalse );
+}
+
+
 static void upload_vk_image( image_t *image, byte *pic ) {
 
 	Image_Upload_Data upload_data;
+	texCacheData_t cache;
+	qboolean useCache;
+	uint32_t key;
 	int w, h;
 
-	generate_image_upload_data( image, pic, &upload_data );
+	useCache = ( pic != NULL && R_TexCacheEnabled( image ) ) ? qtrue : qfalse;
+	key = 0;
+
+	if ( useCache ) {
+		key = R_ImageCacheKey( image, pic );
+		if ( R_TexCacheLoad( image, key, &cache ) ) {
+			upload_vk_compressed_image( image, &cache );
+			R_TexCacheFree( &cache );
+			return;
+		}
+	}
+
+	generate_image_upload_data( image, pic, &upload_data, useCache ? qfalse : R_GpuMipmaps( image ) );
 
 	w = upload_data.base_level_width;
 	h = upload_data.base_level_height;
 
+	if ( useCache && R_TexCacheEncode( image, key, upload_data.buffer, w, h, upload_data.mip_levels, &cache ) ) {
+		upload_vk_compressed_image( image, &cache );
+		R_TexCacheFree( &cache );
+		ri.Hunk_FreeTempMemory( upload_data.buffer );
+		return;
+	}
+
 	if ( r_texturebits->integer > 16 || r_texturebits->integer == 0 || ( image->flags & IMGFLAG_LIGHTMAP ) ) {
 		image->internalFormat = VK_FORMAT_R8G8B8A8_UNORM;
 		//image->internalFormat = VK_FORMAT_B8G8R8A8_UNORM;
@@ -772,7 +948,11 @@ static void upload_vk_image( image_t *image, byte *pic ) {
 	image->uploadHeight = h;
 
 	vk_create_image( image, w, h, upload_data.mip_levels );
-	vk_upload_image_data( image, 0, 0, w, h, upload_data.mip_levels, upload_data.buffer, upload_data.buffer_size, qfalse );
+	if ( upload_data.gpu_mipmaps ) {
+		vk_upload_image_mipmaps( image, w, h, upload_data.mip_levels, upload_data.buffer );
+	} else {
+		vk_upload_image_data( image, 0, 0, w, h, upload_data.mip_levels, upload_data.buffer, upload_data.buffer_size, qfalse );
+	}
 
 	ri.Hunk_FreeTempMemory( upload_data.buffer );
 }
@@ -1019,6 +1199,9 @@ image_t *R_CreateImage( const char *name, const char *name2, byte *pic, int widt
 	int			namelen, namelen2;
 	const char	*slash;
 
+	// uploads must not overlap with the render thread
+	R_SyncRenderThread();
+
 	namelen = (int)strlen( name ) + 1;
 	if ( namelen > MAX_QPATH ) {
 		ri.Error( ERR_DROP, "R_CreateImage: \"%s\" is too long", name );
@@ -1164,7 +1347,7 @@ Loads any of the supported image types into a canonical
 32 bit format.
 =================
 */
-static const char *R_LoadImage( const char *name, byte **pic, int *width, int *height )
+const char *R_LoadImage( const char *name, byte **pic, int *width, int *height )
 {
 	static char localName[ MAX_QPATH ];
 	const char *altName, *ext;
@@ -1326,6 +1509,133 @@ image_t	*R_FindImageFile( const char *name, imgFlags_t flags )
 }
 
 
+/*
+===============
+R_ImageLoaded
+===============
+*/
+static qboolean R_ImageLoaded( const char *name )
+{
+	const image_t *image;
+	char	strippedName[ MAX_QPATH ];
+	int		hash;
+
+	hash = generateHashValue( name );
+
+	for ( image = hashTable[ hash ]; image; image = image->next ) {
+		if ( !Q_stricmp( name, image->imgName ) ) {
+			return qtrue;
+		}
+	}
+
+	if ( strrchr( name, '.' ) > name ) {
+		COM_StripExtension( name, strippedName, sizeof( strippedName ) );
+		for ( image = hashTable[ hash ]; image; image = image->next ) {
+			if ( !Q_stricmp( strippedName, image->imgName ) ) {
+				return qtrue;
+			}
+		}
+	}
+
+	return qfalse;
+}
+
+
+/*
+===============
+R_ImageFileName
+
+Picks the file R_LoadImage would load for the name,
+without decoding anything
+===============
+*/
+static qboolean R_ImageFileName( const char *name, char *fileName, int size )
+{
+	char	localName[ MAX_QPATH ];
+	const char *ext;
+	int		orgLoader = -1;
+	int		i;
+
+	Q_strncpyz( localName, name, sizeof( localName ) );
+
+	ext = COM_GetExtension( localName );
+	if ( *ext )
+	{
+		for ( i = 0; i < numImageLoaders; i++ )
+		{
+			if ( !Q_stricmp( ext, imageLoaders[ i ].ext ) )
+			{
+				if ( ri.FS_ReadFile( localName, NULL ) > 0 ) {
+					Q_strncpyz( fileName, localName, size );
+					return qtrue;
+				}
+				orgLoader = i;
+				COM_StripExtension( name, localName, sizeof( localName ) );
+				break;
+			}
+		}
+	}
+
+	for ( i = 0; i < numImageLoaders; i++ )
+	{
+		if ( i == orgLoader )
+			continue;
+
+		Com_sprintf( fileName, size, "%s.%s", localName, imageLoaders[ i ].ext );
+		if ( ri.FS_ReadFile( fileName, NULL ) > 0 ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+
+/*
+===============
+R_PrefetchImages
+
+Decodes images about to be loaded by R_FindImageFile on job threads,
+only TGA files can be decoded there for now
+===============
+*/
+void R_PrefetchImages( char (*names)[ MAX_QPATH ], int count )
+{
+	char	(*files)[ MAX_QPATH ];
+	const char **list;
+	int		i, j, numFiles;
+
+	files = ri.Hunk_AllocateTempMemory( count * sizeof( *files ) + count * sizeof( *list ) );
+	list = (const char **)( files + count );
+	numFiles = 0;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( names[i][0] == '*' || names[i][0] == '$' || R_ImageLoaded( names[i] ) ) {
+			continue;
+		}
+		if ( !R_ImageFileName( names[i], files[ numFiles ], sizeof( files[ numFiles ] ) ) ) {
+			continue;
+		}
+		if ( Q_stricmp( COM_GetExtension( files[ numFiles ] ), "tga" ) ) {
+			continue;
+		}
+		for ( j = 0; j < numFiles; j++ ) {
+			if ( !Q_stricmp( list[j], files[ numFiles ] ) ) {
+				break;
+			}
+		}
+		if ( j == numFiles ) {
+			list[ numFiles ] = files[ numFiles ];
+			numFiles++;
+		}
+	}
+
+	R_PrefetchTGA( list, numFiles );
+
+	ri.Hunk_FreeTempMemory( files );
+}
+
+
 /*
 ================
 R_CreateDlightImage
@@ -1633,6 +1943,8 @@ void R_SetColorMappings( void ) {
 		return;
 	}
 
+	R_SyncRenderThread();
+
 	// setup the overbright lighting
 	// negative value will force gamma in windowed mode
 	tr.overbrightBits = abs( r_overBrightBits->integer );
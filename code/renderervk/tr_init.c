@@ -76,12 +76,17 @@ cvar_t  *r_mergeLightmaps;
 cvar_t	*r_dlightMode;
 cvar_t	*r_dlightScale;
 cvar_t	*r_dlightIntensity;
+cvar_t	*r_dlightMerge;
 #endif
 cvar_t	*r_dlightSaturation;
 #ifdef USE_VULKAN
 cvar_t	*r_device;
+cvar_t	*r_pipelineCache;
+cvar_t	*r_pipelineAsync;
+cvar_t	*r_linearCull;
 #ifdef USE_VBO
 cvar_t	*r_vbo;
+cvar_t	*r_vboIndirect;
 #endif
 cvar_t	*r_fbo;
 cvar_t	*r_hdr;
@@ -99,6 +104,7 @@ cvar_t	*r_ext_supersample;
 cvar_t	*r_dlightBacks;
 
 cvar_t	*r_lodbias;
+cvar_t	*r_modelCache;
 cvar_t	*r_lodscale;
 
 cvar_t	*r_norefresh;
@@ -108,6 +114,10 @@ cvar_t	*r_speeds;
 cvar_t	*r_fullbright;
 cvar_t	*r_novis;
 cvar_t	*r_nocull;
+cvar_t	*r_instancing;
+cvar_t	*r_md3Frames;
+cvar_t	*r_textureCache;
+cvar_t	*r_occlusion;
 cvar_t	*r_facePlaneCull;
 cvar_t	*r_showcluster;
 cvar_t	*r_nocurves;
@@ -138,10 +148,21 @@ cvar_t	*r_nobind;
 cvar_t	*r_singleShader;
 cvar_t	*r_roundImagesDown;
 cvar_t	*r_colorMipLevels;
+cvar_t	*r_gpuMipmaps;
+#ifdef USE_VULKAN
+cvar_t	*r_lowLatency;
+cvar_t	*r_framesInFlight;
+cvar_t	*r_geometryDeviceLocal;
+cvar_t	*r_dynamicResolution;
+cvar_t	*r_dynamicResolutionTarget;
+cvar_t	*r_dynamicResolutionMin;
+static cvar_t *r_latency;
+#endif
 cvar_t	*r_picmip;
 cvar_t	*r_nomip;
 cvar_t	*r_showtris;
 cvar_t	*r_showsky;
+cvar_t	*r_fullSky;
 cvar_t	*r_shownormals;
 cvar_t	*r_finish;
 cvar_t	*r_clear;
@@ -155,11 +176,13 @@ cvar_t	*r_noportals;
 cvar_t	*r_portalOnly;
 
 cvar_t	*r_subdivisions;
+cvar_t	*r_patchCache;
 cvar_t	*r_lodCurveError;
 
 cvar_t	*r_overBrightBits;
 cvar_t	*r_mapOverBrightBits;
 cvar_t	*r_mapGreyScale;
+cvar_t	*r_imagePrefetch;
 
 cvar_t	*r_debugSurface;
 cvar_t	*r_simpleMipMaps;
@@ -176,11 +199,11 @@ cvar_t	*r_saveFontData;
 
 cvar_t	*r_marksOnTriangleMeshes;
 
-cvar_t	*r_aviMotionJpegQuality;
 cvar_t	*r_screenshotJpegQuality;
 
 static cvar_t *r_maxpolys;
 static cvar_t* r_maxpolyverts;
+static cvar_t* r_smp;
 int		max_polys;
 int		max_polyverts;
 
@@ -1072,6 +1095,8 @@ static void R_ScreenShot_f( void ) {
 		return;
 	}
 
+	R_SyncRenderThread();
+
 	if ( !strcmp( ri.Cmd_Argv(1), "levelshot" ) ) {
 		R_LevelShot();
 		return;
@@ -1131,6 +1156,71 @@ static void R_ScreenShot_f( void ) {
 
 //============================================================================
 
+/*
+==============================================================================
+
+VIDEO FRAME READBACK
+
+Frames are copied into per command buffer staging buffers at the end of
+the frame and converted when the same command buffer is reused, so capture
+doesn't stall the pipeline, see vk_read_video_pixels().
+
+Conversion for the encoder is split between job threads.
+
+==============================================================================
+*/
+
+#define VIDEO_JOB_BLOCKS		8
+
+typedef struct {
+	const byte	*src;			// rows as read back, bottom-up
+	byte		*dst;
+	int			srcPitch;
+	int			dstPitch;
+	int			linelen;
+	int			height;
+	qboolean	swap;			// RGB to BGR
+} videoJob_t;
+
+
+/*
+==================
+RB_VideoFrameJob
+
+Converts a block of rows for the encoder, called from job threads
+==================
+*/
+static void RB_VideoFrameJob( void *data, int block )
+{
+	const videoJob_t *job = (const videoJob_t *)data;
+	const int blockSize = ( job->height + VIDEO_JOB_BLOCKS - 1 ) / VIDEO_JOB_BLOCKS;
+	const byte *src;
+	byte *dst;
+	int x, y, first, last;
+
+	first = MIN( block * blockSize, job->height );
+	last = MIN( first + blockSize, job->height );
+
+	for ( y = first; y < last; y++ ) {
+		src = job->src + y * job->srcPitch;
+		dst = job->dst + y * job->dstPitch;
+		if ( job->swap ) {
+			// swap R and B and remove line paddings
+			for ( x = 0; x < job->linelen; x += 3 ) {
+				dst[x+0] = src[x+2];
+				dst[x+1] = src[x+1];
+				dst[x+2] = src[x+0];
+			}
+			Com_Memset( dst + job->linelen, '\0', job->dstPitch - job->linelen );
+		} else if ( dst != src ) {
+			Com_Memcpy( dst, src, job->linelen );
+		}
+		// gamma correction
+		R_GammaCorrect( dst, job->linelen );
+	}
+}
+
+
 /*
 ==================
 RB_TakeVideoFrameCmd
@@ -1140,9 +1230,10 @@ const void *RB_TakeVideoFrameCmd( const void *data )
 {
 	const videoFrameCommand_t *cmd;
 	byte		*cBuf;
-	size_t		memcount, linelen;
-	int			padwidth, avipadwidth, padlen, avipadlen;
+	size_t		linelen;
+	int			padwidth, avipadwidth;
 	int			packAlign;
+	videoJob_t	job;
 
 	cmd = (const videoFrameCommand_t *)data;
 
@@ -1156,57 +1247,40 @@ const void *RB_TakeVideoFrameCmd( const void *data )
 
 	// Alignment stuff for glReadPixels
 	padwidth = PAD(linelen, packAlign);
-	padlen = padwidth - linelen;
 	// AVI line padding
 	avipadwidth = PAD(linelen, AVI_LINE_PADDING);
-	avipadlen = avipadwidth - linelen;
 
 	cBuf = PADP(cmd->captureBuffer, packAlign);
 
 #ifdef USE_VULKAN
-	vk_read_pixels(cBuf, cmd->width, cmd->height);
+	if ( !vk_read_video_pixels( cBuf, cmd->width, cmd->height ) ) {
+		return (const void *)(cmd + 1);
+	}
 #else
 	qglReadPixels(0, 0, cmd->width, cmd->height, GL_RGB, GL_UNSIGNED_BYTE, cBuf);
 #endif
 
-	memcount = padwidth * cmd->height;
-
-	// gamma correction
-	R_GammaCorrect( cBuf, memcount );
+	job.src = cBuf;
+	job.srcPitch = padwidth;
+	job.linelen = linelen;
+	job.height = cmd->height;
 
 	if ( cmd->motionJpeg )
 	{
-		memcount = ri.CL_SaveJPGToBuffer( cmd->encodeBuffer, linelen * cmd->height,
-			r_aviMotionJpegQuality->integer,
-			cmd->width, cmd->height, cBuf, padlen );
-		ri.CL_WriteAVIVideoFrame(cmd->encodeBuffer, memcount);
+		// compressed by the client, rows are passed without padding
+		job.dst = cmd->encodeBuffer;
+		job.dstPitch = linelen;
+		job.swap = qfalse;
+		ri.ParallelFor( RB_VideoFrameJob, &job, VIDEO_JOB_BLOCKS );
+
+		ri.CL_WriteAVIVideoFrame(cmd->encodeBuffer, linelen * cmd->height);
 	}
 	else
 	{
-		byte *lineend, *memend;
-		byte *srcptr, *destptr;
-
-		srcptr = cBuf;
-		destptr = cmd->encodeBuffer;
-		memend = srcptr + memcount;
-
-		// swap R and B and remove line paddings
-		while(srcptr < memend)
-		{
-			lineend = srcptr + linelen;
-			while(srcptr < lineend)
-			{
-				*destptr++ = srcptr[2];
-				*destptr++ = srcptr[1];
-				*destptr++ = srcptr[0];
-				srcptr += 3;
-			}
-
-			Com_Memset(destptr, '\0', avipadlen);
-			destptr += avipadlen;
-
-			srcptr += padlen;
-		}
+		job.dst = cmd->encodeBuffer;
+		job.dstPitch = avipadwidth;
+		job.swap = qtrue;
+		ri.ParallelFor( RB_VideoFrameJob, &job, VIDEO_JOB_BLOCKS );
 
 		ri.CL_WriteAVIVideoFrame(cmd->encodeBuffer, avipadwidth * cmd->height);
 	}
@@ -1453,12 +1527,26 @@ static void GfxInfo_f( void )
 static void VkInfo_f( void )
 {
 	ri.Printf(PRINT_ALL, "max_vertex_usage: %iKb\n", (int)((vk.stats.vertex_buffer_max + 1023) / 1024) );
+	if ( vk.stats.frames ) {
+		ri.Printf(PRINT_ALL, "avg_vertex_usage: %iKb/frame\n", (int)((vk.stats.vertex_buffer_total / vk.stats.frames + 1023) / 1024) );
+	}
+	ri.Printf(PRINT_ALL, "geometry buffer: %iKb x %i%s, grown %i times\n", (int)(vk.geometry_buffer_size / 1024), vk.num_command_buffers,
+		vk.geometry_buffer_device_local ? " device-local" : "", vk.stats.geometry_grows );
 	ri.Printf(PRINT_ALL, "max_push_size: %ib\n", vk.stats.push_size_max );
+	if ( vk.dynamicResolution ) {
+		ri.Printf(PRINT_ALL, "dynamic resolution: %ix%i, gpu time %.2fms\n", (int)(glConfig.vidWidth * vk.dynamicScale), (int)(glConfig.vidHeight * vk.dynamicScale), vk.gpuFrameTime );
+	}
 
 	ri.Printf(PRINT_ALL, "pipeline handles: %i\n", vk.pipeline_create_count );
 	ri.Printf(PRINT_ALL, "pipeline descriptors: %i, base: %i\n", vk.pipelines_count, vk.pipelines_world_base );
 	ri.Printf(PRINT_ALL, "image chunks: %i\n", vk_world.num_image_chunks );
 }
+
+
+static void VkMemInfo_f( void )
+{
+	vk_memory_info();
+}
 #endif
 
 
@@ -1469,6 +1557,8 @@ RE_SyncRender
 */
 static void RE_SyncRender( void )
 {
+	R_SyncRenderThread();
+
 #ifdef USE_VULKAN
 	if ( vk.device )
 		vk_wait_idle();
@@ -1479,6 +1569,93 @@ static void RE_SyncRender( void )
 }
 
 
+#ifdef USE_VULKAN
+/*
+===============
+RE_WaitFrame
+===============
+*/
+static void RE_WaitFrame( void )
+{
+	if ( !r_lowLatency->integer )
+		return;
+
+	// frame queued for the render thread must be submitted first
+	R_SyncRenderThread();
+
+	vk_wait_frame();
+}
+
+
+/*
+===============
+RE_SoftRestart
+
+Applies latched cvars that only affect render targets, gives up
+if anything else waits for a restart or nothing changed at all
+===============
+*/
+static qboolean RE_SoftRestart( void )
+{
+	static cvar_t **const softCvars[] = {
+		&r_bloom, &r_hdr, &r_presentBits, &r_ext_multisample, &r_ext_alpha_to_coverage
+	};
+	const char *names[ 16 ];
+	int i, j, count;
+
+	if ( !tr.registered || !vk.device ) {
+		return qfalse;
+	}
+
+	count = ri.Cvar_ListLatched( "r_", names, ARRAY_LEN( names ) );
+	if ( count == 0 || count > ARRAY_LEN( names ) ) {
+		return qfalse;
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		for ( j = 0; j < ARRAY_LEN( softCvars ); j++ ) {
+			if ( Q_stricmp( names[i], (*softCvars[j])->name ) == 0 ) {
+				break;
+			}
+		}
+		if ( j == ARRAY_LEN( softCvars ) ) {
+			return qfalse;
+		}
+	}
+
+	R_SyncRenderThread();
+
+	// registering again takes the latched value
+	for ( i = 0; i < ARRAY_LEN( softCvars ); i++ ) {
+		if ( (*softCvars[i])->latchedString ) {
+			ri.Cvar_Get( (*softCvars[i])->name, "", 0 );
+		}
+	}
+
+	vk_restart_attachments();
+
+	return qtrue;
+}
+#endif
+
+
+/*
+===============
+RE_MemoryStats
+===============
+*/
+static void RE_MemoryStats( refMemoryStats_t *stats )
+{
+	stats->numImages = tr.numImages;
+	stats->imageBytes = R_ImageMemory();
+#ifdef USE_VBO
+	stats->vboBytes = VBO_Size();
+#else
+	stats->vboBytes = 0;
+#endif
+}
+
+
 /*
 ===============
 R_Register
@@ -1495,8 +1672,10 @@ static void R_Register( void )
 	ri.Cmd_AddCommand( "screenshotJPEG", R_ScreenShot_f );
 	ri.Cmd_AddCommand( "screenshotBMP", R_ScreenShot_f );
 	ri.Cmd_AddCommand( "gfxinfo", GfxInfo_f );
+	ri.Cmd_AddCommand( "gpustats", R_GpuStats_f );
 #ifdef USE_VULKAN
 	ri.Cmd_AddCommand( "vkinfo", VkInfo_f );
+	ri.Cmd_AddCommand( "vkmeminfo", VkMemInfo_f );
 #endif
 
 	//
@@ -1535,29 +1714,48 @@ static void R_Register( void )
 	ri.Cvar_SetDescription( r_roundImagesDown, "When images are scaled, round images down instead of up." );
 	r_colorMipLevels = ri.Cvar_Get ("r_colorMipLevels", "0", CVAR_LATCH );
 	ri.Cvar_SetDescription( r_colorMipLevels, "Debugging tool to artificially color different mipmap levels so that they are more apparent." );
+	r_gpuMipmaps = ri.Cvar_Get( "r_gpuMipmaps", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_gpuMipmaps, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_gpuMipmaps, "Generate mipmaps of RGBA8 textures with linear filtered blits on the GPU instead of the CPU." );
 	r_detailTextures = ri.Cvar_Get( "r_detailtextures", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription( r_detailTextures, "Enables usage of shader stages flagged as detail." );
 	r_texturebits = ri.Cvar_Get( "r_texturebits", "32", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription( r_texturebits, "Number of texture bits per texture." );
+	r_textureCache = ri.Cvar_Get( "r_textureCache", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_textureCache, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_textureCache, "Block-compress mipmapped textures once into the texcache directory of the home path and load them from there later, uses 4-8 times less video memory at some quality loss." );
 
 	r_mergeLightmaps = ri.Cvar_Get( "r_mergeLightmaps", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription( r_mergeLightmaps, "Merge built-in small lightmaps into bigger lightmaps (atlases)." );
 #if defined (USE_VULKAN) && defined (USE_VBO)
 	r_vbo = ri.Cvar_Get( "r_vbo", "1", CVAR_ARCHIVE | CVAR_LATCH );
 	ri.Cvar_SetDescription( r_vbo, "Use Vertex Buffer Objects to cache static map geometry, may improve FPS on modern GPUs, increases hunk memory usage by 15-30MB (map-dependent)." );
+	r_vboIndirect = ri.Cvar_Get( "r_vboIndirect", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_vboIndirect, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_vboIndirect, "Draw all runs of static map geometry from video memory with multi-draw indirect commands, requires \\r_vbo 1 and multiDrawIndirect device support." );
 #endif
 
 	r_mapGreyScale = ri.Cvar_Get( "r_mapGreyScale", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_CheckRange( r_mapGreyScale, "-1", "1", CV_FLOAT );
 	ri.Cvar_SetDescription(r_mapGreyScale, "Desaturate world map textures only, works independently from \\r_greyscale, negative values only desaturate lightmaps.");
 
+	r_imagePrefetch = ri.Cvar_Get( "r_imagePrefetch", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_imagePrefetch, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_imagePrefetch, "Decode map textures on all cores before the map shaders are loaded." );
+
 	r_subdivisions = ri.Cvar_Get( "r_subdivisions", "4", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription(r_subdivisions, "Distance to subdivide bezier curved surfaces. Higher values mean less subdivision and less geometric complexity.");
+	r_patchCache = ri.Cvar_Get( "r_patchCache", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_patchCache, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_patchCache, "Save subdivided curved surfaces of each map into the patchcache directory of the home path and load them from there later." );
 
 	r_maxpolys = ri.Cvar_Get( "r_maxpolys", XSTRING( MAX_POLYS ), CVAR_LATCH );
 	ri.Cvar_SetDescription( r_maxpolys, "Maximum number of polygons to draw in a scene." );
 	r_maxpolyverts = ri.Cvar_Get( "r_maxpolyverts", XSTRING( MAX_POLYVERTS ), CVAR_LATCH );
 	ri.Cvar_SetDescription( r_maxpolyverts, "Maximum number of polygon vertices to draw in a scene." );
+	r_smp = ri.Cvar_Get( "r_smp", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_smp, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_smp, "Execute render commands on a separate thread while the next frame is prepared, output lags one frame behind the game." );
 
 	//
 	// archived variables that can change at any time
@@ -1567,6 +1765,9 @@ static void R_Register( void )
 	ri.Cvar_SetDescription( r_lodCurveError, "Level of detail error on curved surface grids. Higher values result in better quality at a distance." );
 	r_lodbias = ri.Cvar_Get( "r_lodbias", "-2", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_lodbias, "Sets the level of detail of in-game models:\n -2: Ultra (further delays LOD transition in the distance)\n -1: Very High (delays LOD transition in the distance)\n 0: High\n 1: Medium\n 2: Low" );
+	r_modelCache = ri.Cvar_Get( "r_modelCache", "64", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_modelCache, "0", "1024", CV_INTEGER );
+	ri.Cvar_SetDescription( r_modelCache, "Megabytes of loaded md3 models kept between maps, 0 disables the cache.\nEdited loose files are picked up after " S_COLOR_CYAN "\\fs_restart" S_COLOR_WHITE " only." );
 	r_flares = ri.Cvar_Get ("r_flares", "0", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_flares, "Enables corona effects on light sources." );
 	r_znear = ri.Cvar_Get( "r_znear", "4", CVAR_CHEAT );
@@ -1598,6 +1799,9 @@ static void R_Register( void )
 	r_dlightIntensity = ri.Cvar_Get( "r_dlightIntensity", "1.0", CVAR_ARCHIVE_ND );
 	ri.Cvar_CheckRange( r_dlightIntensity, "0.1", "1", CV_FLOAT );
 	ri.Cvar_SetDescription( r_dlightIntensity, "Adjusts dynamic light intensity but not radius." );
+	r_dlightMerge = ri.Cvar_Get( "r_dlightMerge", "24", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_dlightMerge, "0", "128", CV_FLOAT );
+	ri.Cvar_SetDescription( r_dlightMerge, "Combines per-pixel dynamic lights closer than this distance into one light so lit surfaces are drawn once for all of them, 0 disables merging." );
 #endif // USE_PMLIGHT
 
 	r_dlightSaturation = ri.Cvar_Get( "r_dlightSaturation", "1", CVAR_ARCHIVE_ND );
@@ -1649,6 +1853,29 @@ static void R_Register( void )
 	ri.Cvar_CheckRange( r_presentBits, "16", "30", CV_INTEGER );
 	ri.Cvar_SetDescription( r_presentBits, "Select color bits used for presentation surfaces\nRequires " S_COLOR_CYAN "\\r_fbo 1." );
 
+#ifdef USE_VULKAN
+	r_lowLatency = ri.Cvar_Get( "r_lowLatency", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_lowLatency, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_lowLatency, "Wait until the previous frame is presented, or rendered without VK_KHR_present_wait support, before input is sampled for the next one. Lowers input latency when GPU bound at some cost of framerate." );
+	r_framesInFlight = ri.Cvar_Get( "r_framesInFlight", "2", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_framesInFlight, "1", "3", CV_INTEGER );
+	ri.Cvar_SetDescription( r_framesInFlight, "Number of frames the CPU may prepare ahead of the GPU:\n 1 - lowest latency\n 2 - default\n 3 - keeps the GPU busy on heavy maps at the cost of latency" );
+	r_geometryDeviceLocal = ri.Cvar_Get( "r_geometryDeviceLocal", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_geometryDeviceLocal, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_geometryDeviceLocal, "Place per-frame vertex, index and uniform data in video memory visible to the CPU (resizable BAR), falls back to system memory if not available." );
+	r_dynamicResolution = ri.Cvar_Get( "r_dynamicResolution", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_dynamicResolution, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_dynamicResolution, "Lower render resolution while GPU frame time exceeds \\r_dynamicResolutionTarget, the image is upscaled in the gamma pass.\nRequires " S_COLOR_CYAN "\\r_fbo 1." );
+	r_dynamicResolutionTarget = ri.Cvar_Get( "r_dynamicResolutionTarget", "4", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_dynamicResolutionTarget, "0.5", "100", CV_FLOAT );
+	ri.Cvar_SetDescription( r_dynamicResolutionTarget, "GPU frame time in milliseconds to hold with \\r_dynamicResolution." );
+	r_dynamicResolutionMin = ri.Cvar_Get( "r_dynamicResolutionMin", "0.5", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_dynamicResolutionMin, "0.25", "1", CV_FLOAT );
+	ri.Cvar_SetDescription( r_dynamicResolutionMin, "Lowest render scale \\r_dynamicResolution may use." );
+	r_latency = ri.Cvar_Get( "r_latency", "0", CVAR_ROM );
+	ri.Cvar_SetDescription( r_latency, "Milliseconds from sampling input to presentation of the frame, averaged over one second, measured with \\r_lowLatency 1." );
+#endif
+
 	//
 	// temporary variables that can change at any time
 	//
@@ -1693,12 +1920,24 @@ static void R_Register( void )
 	ri.Cvar_SetDescription( r_drawentities, "Draw all world entities." );
 	r_nocull = ri.Cvar_Get ("r_nocull", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_nocull, "Draw all culled objects." );
+	r_instancing = ri.Cvar_Get( "r_instancing", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_instancing, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_instancing, "Draw surfaces of several entities sharing a model and shader as one batch transformed on the CPU." );
+	r_md3Frames = ri.Cvar_Get( "r_md3Frames", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_md3Frames, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_md3Frames, "Decode md3 vertex frames into floats when models are loaded so animation is a plain interpolation, takes three times the memory of packed frames.\nRequires " S_COLOR_CYAN "\\vid_restart." );
+	r_occlusion = ri.Cvar_Get( "r_occlusion", "0", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_occlusion, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_occlusion, "Skip world nodes and entities hidden behind large walls, rasterized into a small software depth buffer for every view." );
+	r_linearCull = ri.Cvar_Get( "r_linearCull", "1", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_linearCull, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_linearCull, "Cull world leafs in linear passes over the PVS split across job threads instead of walking the BSP tree." );
 	r_novis = ri.Cvar_Get ("r_novis", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_novis, "Disables usage of PVS." );
 	r_showcluster = ri.Cvar_Get ("r_showcluster", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_showcluster, "Shows current cluster index." );
 	r_speeds = ri.Cvar_Get ("r_speeds", "0", CVAR_CHEAT);
-	ri.Cvar_SetDescription( r_speeds, "Prints out various debugging stats from PVS:\n 0: Disabled\n 1: Backend BSP\n 2: Frontend grid culling\n 3: Current view cluster index\n 4: Dynamic lighting\n 5: zFar clipping\n 6: Flares" );
+	ri.Cvar_SetDescription( r_speeds, "Prints out various debugging stats from PVS:\n 0: Disabled\n 1: Backend BSP\n 2: Frontend grid culling\n 3: Current view cluster index\n 4: Dynamic lighting\n 5: zFar clipping\n 6: Flares\n 7: Occlusion culling\n 8: GPU time of render passes, needs timer queries" );
 	r_debugSurface = ri.Cvar_Get ("r_debugSurface", "0", CVAR_CHEAT);
 	ri.Cvar_SetDescription( r_debugSurface, "Backend visual debugging tool for bezier mesh surfaces." );
 	r_nobind = ri.Cvar_Get ("r_nobind", "0", CVAR_CHEAT);
@@ -1724,8 +1963,6 @@ static void R_Register( void )
 	r_marksOnTriangleMeshes = ri.Cvar_Get("r_marksOnTriangleMeshes", "0", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_marksOnTriangleMeshes, "Enables impact marks on triangle mesh surfaces (ie: MD3 models.) Requires impact marks to be enabled in the game code." );
 
-	r_aviMotionJpegQuality = ri.Cvar_Get( "r_aviMotionJpegQuality", "90", CVAR_ARCHIVE_ND );
-	ri.Cvar_SetDescription( r_aviMotionJpegQuality, "Controls quality of Jpeg video capture when \\cl_aviMotionJpeg 1." );
 	r_screenshotJpegQuality = ri.Cvar_Get( "r_screenshotJpegQuality", "90", CVAR_ARCHIVE_ND );
 	ri.Cvar_SetDescription( r_screenshotJpegQuality, "Controls quality of Jpeg screenshots when using screenshotJpeg." );
 
@@ -1777,6 +2014,9 @@ static void R_Register( void )
 
 	r_showsky = ri.Cvar_Get( "r_showsky", "0", CVAR_LATCH );
 	ri.Cvar_SetDescription( r_showsky, "Forces sky in front of all surfaces." );
+	r_fullSky = ri.Cvar_Get( "r_fullSky", "0", CVAR_ARCHIVE_ND );
+	ri.Cvar_CheckRange( r_fullSky, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_fullSky, "Draws every sky box side in view instead of clipping sky surfaces against the box on the CPU, trades overdraw for CPU time on big outdoor maps." );
 #ifdef USE_VULKAN
 	r_device = ri.Cvar_Get( "r_device", "-1", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_CheckRange( r_device, "-2", NULL, CV_INTEGER );
@@ -1786,6 +2026,14 @@ static void R_Register( void )
 		" -2 - first integrated GPU" );
 	r_device->modified = qfalse;
 
+	r_pipelineCache = ri.Cvar_Get( "r_pipelineCache", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_pipelineCache, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_pipelineCache, "Save compiled pipelines to the home path and load them on startup, avoids hitches when shaders are first seen." );
+
+	r_pipelineAsync = ri.Cvar_Get( "r_pipelineAsync", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	ri.Cvar_CheckRange( r_pipelineAsync, "0", "1", CV_INTEGER );
+	ri.Cvar_SetDescription( r_pipelineAsync, "Compile pipelines of a loaded map in parallel and create late ones on a background thread, surfaces are not drawn until their pipeline is ready." );
+
 	r_fbo = ri.Cvar_Get( "r_fbo", "1", CVAR_ARCHIVE_ND | CVAR_LATCH );
 	ri.Cvar_SetDescription( r_fbo, "Use framebuffer objects, enables gamma correction in windowed mode and allows arbitrary video size and screenshot/video capture.\n Required for bloom, HDR rendering, anti-aliasing and greyscale effects." );
 	r_hdr = ri.Cvar_Get( "r_hdr", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
@@ -1897,10 +2145,16 @@ void R_Init( void ) {
 	max_polys = r_maxpolys->integer;
 	max_polyverts = r_maxpolyverts->integer;
 
-	ptr = ri.Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
-	backEndData = (backEndData_t *) ptr;
-	backEndData->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData ));
-	backEndData->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys);
+	// second set of back end data lets the front end run ahead of the render thread
+	Com_Memset( backEndFrames, 0, sizeof( backEndFrames ) );
+	for ( i = 0; i < ( r_smp->integer ? SMP_FRAMES : 1 ); i++ ) {
+		ptr = ri.Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
+		backEndFrames[i] = (backEndData_t *) ptr;
+		backEndFrames[i]->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData ));
+		backEndFrames[i]->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys);
+	}
+	backEndData = backEndFrames[0];
+	tr.smpFrame = 0;
 
 	R_InitNextFrame();
 
@@ -1928,6 +2182,10 @@ void R_Init( void ) {
 		ri.Printf( PRINT_WARNING, "glGetError() = 0x%x\n", err );
 #endif
 
+	if ( backEndFrames[1] ) {
+		R_InitRenderThread();
+	}
+
 	ri.Printf( PRINT_ALL, "----- finished R_Init -----\n" );
 }
 
@@ -1947,6 +2205,8 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 #endif
 	ri.Printf( PRINT_ALL, "RE_Shutdown( %i )\n", code );
 
+	R_ShutdownRenderThread();
+
 	ri.Cmd_RemoveCommand( "modellist" );
 	ri.Cmd_RemoveCommand( "screenshotBMP" );
 	ri.Cmd_RemoveCommand( "screenshotJPEG" );
@@ -1955,9 +2215,11 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 	ri.Cmd_RemoveCommand( "shaderlist" );
 	ri.Cmd_RemoveCommand( "skinlist" );
 	ri.Cmd_RemoveCommand( "gfxinfo" );
+	ri.Cmd_RemoveCommand( "gpustats" );
 	ri.Cmd_RemoveCommand( "shaderstate" );
 #ifdef USE_VULKAN
 	ri.Cmd_RemoveCommand( "vkinfo" );
+	ri.Cmd_RemoveCommand( "vkmeminfo" );
 #endif
 
 	if ( tr.registered ) {
@@ -1968,6 +2230,8 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 #endif
 	}
 
+	R_FreePrefetchedImages();
+
 	R_DoneFreeType();
 
 #ifdef USE_VULKAN
@@ -1998,6 +2262,11 @@ static void RE_Shutdown( refShutdownCode_t code ) {
 #endif
 	}
 
+	// models may come from another search path or renderer next time
+	if ( code != REF_KEEP_CONTEXT ) {
+		R_ClearModelCache();
+	}
+
 	ri.FreeAll();
 
 	tr.registered = qfalse;
@@ -2013,8 +2282,11 @@ Touch all images to make sure they are resident
 =============
 */
 static void RE_EndRegistration( void ) {
+	R_SyncRenderThread();
+
 #ifdef USE_VULKAN
 	vk_wait_idle();
+	vk_precompile_pipelines();
 	// command buffer is not in recording state at this stage
 	// so we can't issue RB_ShowImages() there
 #else
@@ -2064,8 +2336,10 @@ refexport_t *GetRefAPI ( int apiVersion, refimport_t *rimp ) {
 
 	re.BeginFrame = RE_BeginFrame;
 	re.EndFrame = RE_EndFrame;
+	re.GetFrameStats = RE_GetFrameStats;
 
 	re.MarkFragments = R_MarkFragments;
+	re.MarkFragmentsBatch = R_MarkFragmentsBatch;
 	re.LerpTag = R_LerpTag;
 	re.ModelBounds = R_ModelBounds;
 
@@ -2098,6 +2372,11 @@ refexport_t *GetRefAPI ( int apiVersion, refimport_t *rimp ) {
 	re.GetConfig = RE_GetConfig;
 	re.VertexLighting = RE_VertexLighting;
 	re.SyncRender = RE_SyncRender;
+	re.MemoryStats = RE_MemoryStats;
+#ifdef USE_VULKAN
+	re.WaitFrame = RE_WaitFrame;
+	re.SoftRestart = RE_SoftRestart;
+#endif
 
 	return &re;
 }
@@ -417,6 +417,11 @@ typedef struct {
 	float	depthForOpaque;
 } fogParms_t;
 
+// shader_t->instancing
+#define INSTANCE_NONE	0
+#define INSTANCE_UNLIT	1	// output depends neither on the entity nor on model space positions
+#define INSTANCE_LIT	2	// as above but with rgbGen lightingDiffuse evaluated per entity
+
 typedef struct shader_s {
 	char		name[MAX_QPATH];		// game path, including extension
 	int			lightmapSearchIndex;	// for a shader to match, both name and lightmapIndex must match
@@ -439,6 +444,7 @@ typedef struct shader_s {
 	int			contentFlags;
 
 	qboolean	entityMergable;			// merge across entites optimizable (smoke, blood)
+	int			instancing;				// INSTANCE_*, surfaces of models may be batched in world space
 
 	qboolean	isSky;
 	skyParms_t	sky;
@@ -476,6 +482,7 @@ typedef struct shader_s {
 	int			lightingBundle;
 #endif
 	qboolean	fogCollapse;
+	qboolean	fogAdjust;		// stages modulated by fog use fog pipelines, fog itself is a separate pass
 	int			tessFlags;
 
 #ifdef USE_VBO
@@ -876,13 +883,18 @@ typedef struct msurface_s {
 	int					lightCount;		// if == tr.lightCount, already added to the litsurf list for the current light
 #endif // USE_PMLIGHT
 	surfaceType_t		*data;			// any of srf*_t
+	vec3_t				bounds[2];		// for mark fragment culling
 } msurface_t;
 
 
+#define VIS_SLOT_MAIN	0
+#define VIS_SLOT_PORTAL	1		// portal and mirror views
+#define VIS_SLOTS		2
+
 typedef struct mnode_s {
 	// common with leaf and node
 	int			contents;		// -1 for nodes, to differentiate from leafs
-	int			visframe;		// node needs to be traversed if current
+	int			visframe[VIS_SLOTS];	// node needs to be traversed if current in tr.visSlot
 	vec3_t		mins, maxs;		// for bounding box culling
 	struct mnode_s	*parent;
 
@@ -904,6 +916,13 @@ typedef struct {
 	int			numSurfaces;
 } bmodel_t;
 
+typedef struct {
+	const msurface_t		*surf;
+	const srfSurfaceFace_t	*face;
+	float		area;
+	vec3_t		bounds[2];
+} occluder_t;
+
 typedef struct {
 	char		name[MAX_QPATH];		// ie: maps/tim_dm2.bsp
 	char		baseName[MAX_QPATH];	// ie: tim_dm2
@@ -944,6 +963,21 @@ typedef struct {
 
 	byte		*novis;			// clusterBytes of 0xff
 
+	mnode_t		**clusterLeafs;		// leafs grouped by cluster, NULL if vis rows are not 64-bit aligned
+	int			*clusterFirstLeaf;	// [numClusters+1] offsets in clusterLeafs
+
+	occluder_t	*occluders;			// large opaque faces for R_SetupOcclusion
+	int			numOccluders;
+
+	// leafs marked by R_MarkLeaves, refreshed when tr.visCount changes
+	int			numLeafs;
+	int			numVisLeafs;
+	int			visLeafsFrame;
+	mnode_t		**visLeafs;
+	float		*visLeafBounds;		// numLeafs mins x, y, z then maxs x, y, z
+	byte		*visLeafVisible;
+	unsigned int *visLeafDlights;
+
 	char		*entityString;
 	const char	*entityParsePoint;
 } world_t;
@@ -958,6 +992,15 @@ typedef enum {
 	MOD_IQM
 } modtype_t;
 
+// md3 vertex frames decoded at load time, see R_DecodeMD3Frames
+typedef struct {
+	vec3_t		xyz;
+	vec3_t		normal;
+} md3Vert_t;
+
+// md3Surface_t->flags is not used by the game, it keeps the offset of decoded frames
+#define MD3_DECODED_FRAMES( surf ) ( (surf)->flags ? (const md3Vert_t *)( (const byte *)(surf) + (surf)->flags ) : NULL )
+
 typedef struct model_s {
 	char		name[MAX_QPATH];
 	modtype_t	type;
@@ -974,6 +1017,7 @@ typedef struct model_s {
 #define	MAX_MOD_KNOWN	1024
 
 void		R_ModelInit (void);
+void		R_ClearModelCache( void );
 model_t		*R_GetModelByHandle( qhandle_t hModel );
 int			R_LerpTag( orientation_t *tag, qhandle_t handle, int startFrame, int endFrame, 
 					 float frac, const char *tagName );
@@ -1035,6 +1079,7 @@ typedef struct {
 
 	int		c_leafs;
 	int		c_dlightSurfaces;
+	int		c_occluders, c_occluded_nodes, c_occluded_ents;
 	int		c_dlightSurfacesCulled;
 #ifdef USE_PMLIGHT
 	int		c_light_cull_out;
@@ -1043,6 +1088,7 @@ typedef struct {
 	int		c_lit_surfs;
 	int		c_lit_culls;
 	int		c_lit_masks;
+	int		c_dlights_merged;
 #endif
 } frontEndCounters_t;
 
@@ -1084,7 +1130,9 @@ typedef struct {
 	int		c_flareTests;
 	int		c_flareRenders;
 
-	int		msec;			// total msec for backend run
+	int		c_pipelines;
+
+	int		usec;			// total usec for backend run
 #ifdef USE_PMLIGHT
 	int		c_lit_batches;
 	int		c_lit_vertices;
@@ -1095,6 +1143,18 @@ typedef struct {
 #endif
 } backEndCounters_t;
 
+// GPU time of the frame is split into segments, each one is
+// charged to the pass that was active when it started
+typedef enum {
+	GPU_TIMER_WORLD,
+	GPU_TIMER_PORTAL,
+	GPU_TIMER_DLIGHT,
+	GPU_TIMER_2D,
+	GPU_TIMER_BLOOM,
+	GPU_TIMER_POST,
+	GPU_TIMER_COUNT
+} gpuTimer_t;
+
 typedef struct videoFrameCommand_s {
 	int					commandId;
 	int					width;
@@ -1119,6 +1179,7 @@ typedef struct {
 	viewParms_t	viewParms;
 	orientationr_t	or;
 	backEndCounters_t	pc;
+	int64_t		execStart;		// RB_ExecuteRenderCommands() entry time
 	qboolean	isHyperspace;
 	const trRefEntity_t *currentEntity;
 	qboolean	skyRenderedThisView;	// flag for drawing sun
@@ -1144,6 +1205,8 @@ typedef struct {
 	qboolean screenMapDone;
 	qboolean doneBloom;
 
+	const void *commands;	// list being executed, backEndData may already be refilled
+
 } backEndState_t;
 
 typedef struct drawSurfsCommand_s drawSurfsCommand_t;
@@ -1160,7 +1223,11 @@ typedef struct {
 	qboolean				registered;		// cleared at shutdown, set at beginRegistration
 	qboolean				inited;			// cleared at shutdown, set at InitOpenGL
 
-	int						visCount;		// incremented every time a new vis cluster is entered
+	int						visCount;		// changed every time a new vis cluster is entered
+	int						visStamp;		// source of unique visCount values
+	int						visSlot;		// VIS_SLOT_PORTAL while a portal view is generated
+	int						visSlotCount[VIS_SLOTS];	// visCount and viewCluster of inactive slots
+	int						visSlotCluster[VIS_SLOTS];
 	int						frameCount;		// incremented every frame
 	int						sceneCount;		// incremented every scene
 	int						viewCount;		// incremented every view (twice a scene if portaled)
@@ -1170,6 +1237,7 @@ typedef struct {
 #endif
 
 	int						frameSceneNum;	// zeroed at RE_BeginFrame
+	int						smpFrame;		// backEndFrames index filled by the front end
 
 	qboolean				worldMapLoaded;
 	world_t					*world;
@@ -1219,6 +1287,7 @@ typedef struct {
 	trRefdef_t				refdef;
 
 	int						viewCluster;
+	qboolean				occlusionActive;	// occlusion buffer is ready for the current view
 #ifdef USE_PMLIGHT
 	dlight_t				*light;				// current light during R_RecursiveLightNode
 #endif
@@ -1226,7 +1295,7 @@ typedef struct {
 	vec3_t					sunDirection;
 
 	frontEndCounters_t		pc;
-	int						frontEndMsec;		// not in pc due to clearing issue
+	int						frontEndUsec;		// not in pc due to clearing issue
 
 	//
 	// put large tables at the end, so most elements will be
@@ -1303,6 +1372,7 @@ extern cvar_t	*r_zproj;				// z distance of projection plane
 extern cvar_t	*r_stereoSeparation;			// separation of cameras for stereo rendering
 
 extern cvar_t	*r_lodbias;				// push/pull LOD transitions
+extern cvar_t	*r_modelCache;			// megabytes of md3 data kept between maps
 extern cvar_t	*r_lodscale;
 
 extern cvar_t	*r_fastsky;				// controls whether sky should be cleared or drawn
@@ -1316,12 +1386,17 @@ extern cvar_t	*r_dlightMode;			// 0 - vq3, 1 - pmlight
 //extern cvar_t	*r_dlightSpecColor;		// -1.0 - 1.0
 extern cvar_t	*r_dlightScale;			// 0.1 - 1.0
 extern cvar_t	*r_dlightIntensity;		// 0.1 - 1.0
+extern cvar_t	*r_dlightMerge;			// 0 - 128
 #endif
 extern cvar_t	*r_dlightSaturation;	// 0.0 - 1.0
 #ifdef USE_VULKAN
 extern cvar_t	*r_device;
+extern cvar_t	*r_pipelineCache;
+extern cvar_t	*r_pipelineAsync;
+extern cvar_t	*r_linearCull;
 #ifdef USE_VBO
 extern cvar_t	*r_vbo;
+extern cvar_t	*r_vboIndirect;
 #endif
 extern cvar_t	*r_fbo;
 extern cvar_t	*r_hdr;
@@ -1347,6 +1422,10 @@ extern	cvar_t	*r_speeds;				// various levels of information display
 extern  cvar_t	*r_detailTextures;		// enables/disables detail texturing stages
 extern	cvar_t	*r_novis;				// disable/enable usage of PVS
 extern	cvar_t	*r_nocull;
+extern	cvar_t	*r_instancing;
+extern	cvar_t	*r_md3Frames;
+extern	cvar_t	*r_textureCache;
+extern	cvar_t	*r_occlusion;
 extern	cvar_t	*r_facePlaneCull;		// enables culling of planar surfaces with back side test
 extern	cvar_t	*r_nocurves;
 extern	cvar_t	*r_showcluster;
@@ -1357,6 +1436,15 @@ extern	cvar_t	*r_nobind;						// turns off binding to appropriate textures
 extern	cvar_t	*r_singleShader;				// make most world faces use default shader
 extern	cvar_t	*r_roundImagesDown;
 extern	cvar_t	*r_colorMipLevels;				// development aid to see texture mip usage
+extern	cvar_t	*r_gpuMipmaps;
+#ifdef USE_VULKAN
+extern	cvar_t	*r_lowLatency;
+extern	cvar_t	*r_framesInFlight;
+extern	cvar_t	*r_geometryDeviceLocal;
+extern	cvar_t	*r_dynamicResolution;
+extern	cvar_t	*r_dynamicResolutionTarget;
+extern	cvar_t	*r_dynamicResolutionMin;
+#endif
 extern	cvar_t	*r_picmip;						// controls picmip values
 extern	cvar_t	*r_nomip;						// apply picmip only on worldspawn textures
 extern	cvar_t	*r_finish;
@@ -1371,6 +1459,7 @@ extern	cvar_t	*r_vertexLight;					// vertex lighting mode for better performance
 
 extern	cvar_t	*r_showtris;					// enables wireframe rendering of the world
 extern	cvar_t	*r_showsky;						// forces sky in front of all surfaces
+extern	cvar_t	*r_fullSky;						// draw whole sky box sides without clipping sky surfaces
 extern	cvar_t	*r_shownormals;					// draws wireframe normals
 extern	cvar_t	*r_clear;						// force screen clear every frame
 
@@ -1384,6 +1473,7 @@ extern	cvar_t	*r_noportals;
 extern	cvar_t	*r_portalOnly;
 
 extern	cvar_t	*r_subdivisions;
+extern	cvar_t	*r_patchCache;
 extern	cvar_t	*r_lodCurveError;
 extern	cvar_t	*r_skipBackEnd;
 
@@ -1396,6 +1486,7 @@ extern	cvar_t	*r_ignoreGLErrors;
 extern	cvar_t	*r_overBrightBits;
 extern	cvar_t	*r_mapOverBrightBits;
 extern	cvar_t	*r_mapGreyScale;
+extern	cvar_t	*r_imagePrefetch;
 
 extern	cvar_t	*r_debugSurface;
 extern	cvar_t	*r_simpleMipMaps;
@@ -1437,6 +1528,7 @@ void R_AddLitSurf( surfaceType_t *surface, shader_t *shader, int fogIndex );
 
 void R_LocalPointToWorld( const vec3_t local, vec3_t world );
 int R_CullLocalBox( const vec3_t bounds[2] );
+qboolean R_OccludedLocalBox( const vec3_t bounds[2] );
 int R_CullPointAndRadius( const vec3_t origin, float radius );
 int R_CullLocalPointAndRadius( const vec3_t origin, float radius );
 int R_CullDlight( const dlight_t *dl );
@@ -1529,8 +1621,29 @@ void	R_SkinList_f( void );
 void	R_InitFogTable( void );
 float	R_FogFactor( float s, float t );
 void	R_InitImages( void );
+
+#ifdef USE_VULKAN
+// vk_texcache.c
+typedef struct {
+	byte		*buffer;		// temp memory of a new encoding
+	void		*fileBuffer;	// or file contents
+	byte		*data;			// all mip levels
+	int			size;
+	int			format;
+	int			width;
+	int			height;
+	int			mipLevels;
+} texCacheData_t;
+
+uint32_t	R_TexCacheHash( uint32_t hash, const void *data, int size );
+qboolean	R_TexCacheEnabled( const image_t *image );
+qboolean	R_TexCacheLoad( const image_t *image, uint32_t key, texCacheData_t *out );
+qboolean	R_TexCacheEncode( const image_t *image, uint32_t key, const byte *mips, int width, int height, int mipLevels, texCacheData_t *out );
+void		R_TexCacheFree( texCacheData_t *data );
+#endif
 void	R_DeleteTextures( void );
 int		R_SumOfUsedImages( void );
+int		R_ImageMemory( void );
 void	R_InitSkins( void );
 skin_t	*R_GetSkinByHandle( qhandle_t hSkin );
 
@@ -1542,6 +1655,7 @@ const void *RB_TakeVideoFrameCmd( const void *data );
 // tr_shader.c
 //
 shader_t	*R_FindShader( const char *name, int lightmapIndex, qboolean mipRawImage );
+void		R_PrefetchShaderImages( const dshader_t *shaders, int count );
 shader_t	*R_GetShaderByHandle( qhandle_t hShader );
 shader_t	*R_GetShaderByState( int index, long *cycleTime );
 shader_t	*R_FindShaderByName( const char *name );
@@ -1554,6 +1668,7 @@ void		RE_RemapShader(const char *oldShader, const char *newShader, const char *t
 // tr_surface.c
 //
 void		RB_SurfaceGridEstimate( srfGridMesh_t *cv, int *numVertexes, int *numIndexes ); 
+void		RB_PrepareMeshes( const drawSurf_t *drawSurfs, int numDrawSurfs );
 
 /*
 ====================================================================
@@ -1597,6 +1712,7 @@ typedef struct shaderCommands_s
 	shader_t	*shader;
 	double		shaderTime;	// -EC- set to double for frameloss fix
 	int			fogNum;
+	qboolean	instanced;	// vertexes of several entities in world space, see RB_SurfaceInstanced
 #ifdef USE_LEGACY_DLIGHTS
 	int			dlightBits;	// or together of all vertexDlightBits
 #endif
@@ -1681,6 +1797,7 @@ void R_DlightBmodel( bmodel_t *bmodel );
 void R_SetupEntityLighting( const trRefdef_t *refdef, trRefEntity_t *ent );
 void R_TransformDlights( int count, dlight_t *dl, orientationr_t *or );
 int R_LightForPoint( vec3_t point, vec3_t ambientLight, vec3_t directedLight, vec3_t lightDir );
+void R_ClearLightGridCache( void );
 
 #ifdef USE_PMLIGHT
 void VK_LightingPass( void );
@@ -1700,6 +1817,9 @@ SHADOWS
 */
 
 void RB_ShadowTessEnd( void );
+void RB_AddShadowSurface( const md3Surface_t *surface, int firstVertex, int firstIndex );
+void R_BuildShadowEdges( const md3Surface_t *surface );
+void R_ClearShadowEdges( void );
 void RB_ShadowFinish( void );
 void RB_ProjectionShadowDeform( void );
 
@@ -1741,6 +1861,8 @@ MARKERS, POLYGON PROJECTION ON WORLD POLYGONS
 
 int R_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projection,
 				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer );
+int R_MarkFragmentsBatch( int numRequests, markRequest_t *requests,
+				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer );
 
 
 /*
@@ -1794,6 +1916,7 @@ void RB_MDRSurfaceAnim( mdrSurface_t *surface );
 qboolean R_LoadIQM (model_t *mod, void *buffer, int filesize, const char *name );
 void R_AddIQMSurfaces( trRefEntity_t *ent );
 void RB_IQMSurfaceAnim( const surfaceType_t *surface );
+void R_IQMClearPoseCache( void );
 int R_IQMLerpTag( orientation_t *tag, iqmData_t *data,
                   int startFrame, int endFrame,
                   float frac, const char *tagName );
@@ -1829,6 +1952,7 @@ void	RB_CalcColorFromEntity( unsigned char *dstColors );
 void	RB_CalcColorFromOneMinusEntity( unsigned char *dstColors );
 void	RB_CalcSpecularAlpha( unsigned char *alphas );
 void	RB_CalcDiffuseColor( unsigned char *colors );
+void	RB_CalcDiffuseColorVertexes( int firstVertex, int numVertexes );
 
 /*
 =============================================================
@@ -1955,20 +2079,34 @@ typedef struct {
 extern	int		max_polys;
 extern	int		max_polyverts;
 
+// front end fills one while the render thread executes the other
+#define	SMP_FRAMES		2
+
 extern	backEndData_t	*backEndData;
+extern	backEndData_t	*backEndFrames[ SMP_FRAMES ];
 
 void RB_ExecuteRenderCommands( const void *data );
 void RB_TakeScreenshot( int x, int y, int width, int height, const char *fileName );
+
+qboolean R_GpuTimersActive( void );
+void R_GpuTimerFrame( const byte *timers, const uint64_t *stamps, int count, float nsPerTick );
+void R_GpuStats_f( void );
 void RB_TakeScreenshotJPEG( int x, int y, int width, int height, const char *fileName );
 void RB_TakeScreenshotBMP( int x, int y, int width, int height, const char *fileName, int clipboard );
 
 void R_AddDrawSurfCmd( drawSurf_t *drawSurfs, int numDrawSurfs );
 
+void R_InitRenderThread( void );
+void R_ShutdownRenderThread( void );
+void R_SyncRenderThread( void );
+qboolean R_DeferCinematic( int handle );
+
 void RE_SetColor( const float *rgba );
 void RE_StretchPic ( float x, float y, float w, float h, 
 					  float s1, float t1, float s2, float t2, qhandle_t hShader );
 void RE_BeginFrame( stereoFrame_t stereoFrame );
 void RE_EndFrame( int *frontEndMsec, int *backEndMsec );
+void RE_GetFrameStats( frameStats_t *stats );
 void RE_TakeVideoFrame( int width, int height,
 		byte *captureBuffer, byte *encodeBuffer, qboolean motionJpeg );
 
@@ -1993,6 +2131,7 @@ extern void VBO_PushData( int itemIndex, shaderCommands_t *input );
 extern void VBO_UnBind( void );
 
 extern void VBO_Cleanup( void );
+extern int VBO_Size( void );
 extern void VBO_QueueItem( int itemIndex );
 extern void VBO_ClearQueue( void );
 extern void VBO_Flush( void );
@@ -43,6 +43,70 @@ refimport_t	ri;
 // point at this for their sorting surface
 static surfaceType_t entitySurface = SF_ENTITY;
 
+/*
+=================
+R_OccludedPoints
+
+Tests world space points of an entity box against the occlusion buffer
+=================
+*/
+static qboolean R_OccludedPoints( const vec3_t *points, int numPoints ) {
+	vec3_t	mins, maxs;
+	int		i;
+
+	if ( !tr.occlusionActive || tr.currentEntityNum == REFENTITYNUM_WORLD ) {
+		return qfalse;
+	}
+
+	// view weapon ignores depth, stencil shadows may fall into view
+	if ( tr.currentEntity->e.renderfx & RF_DEPTHHACK ) {
+		return qfalse;
+	}
+	if ( r_shadows->integer == 2 && !( tr.currentEntity->e.renderfx & RF_NOSHADOW ) ) {
+		return qfalse;
+	}
+
+	ClearBounds( mins, maxs );
+	for ( i = 0; i < numPoints; i++ ) {
+		AddPointToBounds( points[i], mins, maxs );
+	}
+
+	if ( R_OcclusionTestBounds( mins, maxs ) ) {
+		tr.pc.c_occluded_ents++;
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+
+/*
+=================
+R_OccludedLocalBox
+
+Returns qtrue if the box of the current entity is hidden by occluders
+=================
+*/
+qboolean R_OccludedLocalBox( const vec3_t bounds[2] ) {
+	vec3_t	transformed[8];
+	vec3_t	v;
+	int		i;
+
+	if ( !tr.occlusionActive || tr.currentEntityNum == REFENTITYNUM_WORLD ) {
+		return qfalse;
+	}
+
+	for ( i = 0 ; i < 8 ; i++ ) {
+		v[0] = bounds[i&1][0];
+		v[1] = bounds[(i>>1)&1][1];
+		v[2] = bounds[(i>>2)&1][2];
+		R_LocalPointToWorld( v, transformed[i] );
+	}
+
+	return R_OccludedPoints( (const vec3_t *)transformed, 8 );
+}
+
+
 /*
 =================
 R_CullLocalBox
@@ -99,6 +163,10 @@ int R_CullLocalBox( const vec3_t bounds[2] ) {
 		anyBack |= back;
 	}
 
+	if ( R_OccludedPoints( (const vec3_t *)transformed, 8 ) ) {
+		return CULL_OUT;
+	}
+
 	if ( !anyBack ) {
 		return CULL_IN;		// completely inside frustum
 	}
@@ -491,7 +559,7 @@ Set up the culling frustum planes for the current view using the results we got
 the projection matrix.
 =================
 */
-static void R_SetupFrustum( viewParms_t *dest, float xmin, float xmax, float ymax, float zProj, float stereoSep )
+static void R_SetupFrustum( viewParms_t *dest, float xmin, float xmax, float ymin, float ymax, float zProj, float stereoSep )
 {
 	vec3_t ofsorigin;
 	float oppleg, adjleg, length;
@@ -529,15 +597,13 @@ static void R_SetupFrustum( viewParms_t *dest, float xmin, float xmax, float yma
 		VectorMA(dest->frustum[1].normal, -zProj / length, dest->or.axis[1], dest->frustum[1].normal);
 	}
 
-	length = sqrt(ymax * ymax + zProj * zProj);
-	oppleg = ymax / length;
-	adjleg = zProj / length;
+	length = sqrt(ymin * ymin + zProj * zProj);
+	VectorScale(dest->or.axis[0], -ymin / length, dest->frustum[2].normal);
+	VectorMA(dest->frustum[2].normal, zProj / length, dest->or.axis[2], dest->frustum[2].normal);
 
-	VectorScale(dest->or.axis[0], oppleg, dest->frustum[2].normal);
-	VectorMA(dest->frustum[2].normal, adjleg, dest->or.axis[2], dest->frustum[2].normal);
-
-	VectorScale(dest->or.axis[0], oppleg, dest->frustum[3].normal);
-	VectorMA(dest->frustum[3].normal, -adjleg, dest->or.axis[2], dest->frustum[3].normal);
+	length = sqrt(ymax * ymax + zProj * zProj);
+	VectorScale(dest->or.axis[0], ymax / length, dest->frustum[3].normal);
+	VectorMA(dest->frustum[3].normal, -zProj / length, dest->or.axis[2], dest->frustum[3].normal);
 	
 	for (i=0 ; i<4 ; i++) {
 		dest->frustum[i].type = PLANE_NON_AXIAL;
@@ -604,7 +670,22 @@ void R_SetupProjection( viewParms_t *dest, float zProj, qboolean computeFrustum
 	
 	// Now that we have all the data for the projection matrix we can also setup the view frustum.
 	if ( computeFrustum )
-		R_SetupFrustum( dest, xmin, xmax, ymax, zProj, stereoSep );
+	{
+		// portal views only cover the screen bounds of the portal surface
+		if ( dest->portalView != PV_NONE && dest->viewportWidth > 0 && dest->viewportHeight > 0 )
+		{
+			const float sx = width / dest->viewportWidth;
+			const float sy = height / dest->viewportHeight;
+			const float x0 = xmin + ( dest->scissorX - dest->viewportX ) * sx;
+			const float y0 = ymin + ( dest->scissorY - dest->viewportY ) * sy;
+
+			xmax = MIN( xmax, x0 + dest->scissorWidth * sx );
+			ymax = MIN( ymax, y0 + dest->scissorHeight * sy );
+			xmin = MAX( xmin, x0 );
+			ymin = MAX( ymin, y0 );
+		}
+		R_SetupFrustum( dest, xmin, xmax, ymin, ymax, zProj, stereoSep );
+	}
 }
 
 
@@ -978,6 +1059,9 @@ static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, qboolean *isMirror
 
 	*isMirror = qfalse;
 
+	// uses tess and back end surface functions
+	R_SyncRenderThread();
+
 	R_RotateForViewer();
 
 	R_DecomposeSort( drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted );
@@ -1190,11 +1274,8 @@ static qboolean R_MirrorViewBySurface( const drawSurf_t *drawSurf, int entityNum
 	}
 #endif
 
-#ifdef USE_VULKAN
-	if ( tess.numVertexes > 2 && r_fastsky->integer && vk.fastSky ) {
-#else
-	if ( tess.numVertexes > 2 && r_fastsky->integer ) {
-#endif
+	// restrict both scissor and culling frustum of the new view
+	if ( tess.numVertexes > 2 ) {
 		int mins[2], maxs[2];
 		R_GetModelViewBounds( mins, maxs );
 		newParms.scissorX = newParms.viewportX + mins[0];
@@ -1212,8 +1293,6 @@ static qboolean R_MirrorViewBySurface( const drawSurf_t *drawSurf, int entityNum
 	R_MirrorVector (oldParms.or.axis[1], &surface, &camera, newParms.or.axis[1]);
 	R_MirrorVector (oldParms.or.axis[2], &surface, &camera, newParms.or.axis[2]);
 
-	// OPTIMIZE: restrict the viewport on the mirrored view
-
 	// render the mirror view
 	R_RenderView( &newParms );
 
@@ -1271,29 +1350,108 @@ DRAWSURF SORTING
 /*
 ===============
 R_Radix
+
+Stable counting sort of one key byte,
+count holds the histogram of source
+===============
+*/
+static void R_Radix( int shift, int size, const int *count, const drawSurf_t *source, drawSurf_t *dest )
+{
+	int		index[ 256 ];
+	int		i;
+
+	index[ 0 ] = 0;
+	for ( i = 1; i < 256; i++ ) {
+		index[ i ] = index[ i - 1 ] + count[ i - 1 ];
+	}
+
+	for ( i = 0; i < size; i++ ) {
+		dest[ index[ ( source[ i ].sort >> shift ) & 255 ]++ ] = source[ i ];
+	}
+}
+
+
+#define RADIX_BLOCKS		8
+#define RADIX_PARALLEL_MIN	8192	// smaller lists are not worth the job dispatch
+
+typedef struct {
+	const drawSurf_t	*source;
+	drawSurf_t			*dest;
+	int					size;
+	int					shift;
+	int					counts[ RADIX_BLOCKS ][ 256 ];	// histograms, then scatter offsets
+} radixJob_t;
+
+static radixJob_t radixJob;
+
+
+static void R_RadixBlock( const radixJob_t *job, int block, int *first, int *last )
+{
+	const int blockSize = ( job->size + RADIX_BLOCKS - 1 ) / RADIX_BLOCKS;
+
+	*first = MIN( block * blockSize, job->size );
+	*last = MIN( *first + blockSize, job->size );
+}
+
+
+static void R_RadixCountJob( void *data, int block )
+{
+	radixJob_t *job = (radixJob_t *)data;
+	int *count = job->counts[ block ];
+	int i, first, last;
+
+	R_RadixBlock( job, block, &first, &last );
+
+	Com_Memset( count, 0, sizeof( job->counts[0] ) );
+	for ( i = first; i < last; i++ ) {
+		count[ ( job->source[ i ].sort >> job->shift ) & 255 ]++;
+	}
+}
+
+
+static void R_RadixScatterJob( void *data, int block )
+{
+	radixJob_t *job = (radixJob_t *)data;
+	int *index = job->counts[ block ];
+	int i, first, last;
+
+	R_RadixBlock( job, block, &first, &last );
+
+	for ( i = first; i < last; i++ ) {
+		job->dest[ index[ ( job->source[ i ].sort >> job->shift ) & 255 ]++ ] = job->source[ i ];
+	}
+}
+
+
+/*
+===============
+R_RadixParallel
+
+Every job counts and then scatters its own block, offsets are
+assigned bucket by bucket in block order so the pass stays stable
 ===============
 */
-static ID_INLINE void R_Radix( int byte, int size, const drawSurf_t *source, drawSurf_t *dest )
+static void R_RadixParallel( int shift, int size, const drawSurf_t *source, drawSurf_t *dest )
 {
-  int           count[ 256 ] = { 0 };
-  int           index[ 256 ];
-  int           i;
-  unsigned char *sortKey;
-  unsigned char *end;
+	int i, j, n, offset;
 
-  sortKey = ( (unsigned char *)&source[ 0 ].sort ) + byte;
-  end = sortKey + ( size * sizeof( drawSurf_t ) );
-  for( ; sortKey < end; sortKey += sizeof( drawSurf_t ) )
-    ++count[ *sortKey ];
+	radixJob.source = source;
+	radixJob.dest = dest;
+	radixJob.size = size;
+	radixJob.shift = shift;
 
-  index[ 0 ] = 0;
+	ri.ParallelFor( R_RadixCountJob, &radixJob, RADIX_BLOCKS );
 
-  for( i = 1; i < 256; ++i )
-    index[ i ] = index[ i - 1 ] + count[ i - 1 ];
+	offset = 0;
+	for ( i = 0; i < 256; i++ ) {
+		for ( j = 0; j < RADIX_BLOCKS; j++ ) {
+			n = radixJob.counts[ j ][ i ];
+			radixJob.counts[ j ][ i ] = offset;
+			offset += n;
+		}
+	}
 
-  sortKey = ( (unsigned char *)&source[ 0 ].sort ) + byte;
-  for( i = 0; i < size; ++i, sortKey += sizeof( drawSurf_t ) )
-    dest[ index[ *sortKey ]++ ] = source[ i ];
+	ri.ParallelFor( R_RadixScatterJob, &radixJob, RADIX_BLOCKS );
 }
 
 
@@ -1301,23 +1459,58 @@ static ID_INLINE void R_Radix( int byte, int size, const drawSurf_t *source, dra
 ===============
 R_RadixSort
 
-Radix sort with 4 byte size buckets
+Radix sort with 4 byte size buckets, histograms of all bytes are built
+in one pass, bytes that are equal in every key are skipped and lists
+that are already in order are left alone
 ===============
 */
 static void R_RadixSort( drawSurf_t *source, int size )
 {
-  static drawSurf_t scratch[ MAX_DRAWSURFS ];
-#ifdef Q3_LITTLE_ENDIAN
-  R_Radix( 0, size, source, scratch );
-  R_Radix( 1, size, scratch, source );
-  R_Radix( 2, size, source, scratch );
-  R_Radix( 3, size, scratch, source );
-#else
-  R_Radix( 3, size, source, scratch );
-  R_Radix( 2, size, scratch, source );
-  R_Radix( 1, size, source, scratch );
-  R_Radix( 0, size, scratch, source );
-#endif //Q3_LITTLE_ENDIAN
+	static drawSurf_t scratch[ MAX_DRAWSURFS ];
+	static int count[ 4 ][ 256 ];
+	drawSurf_t *src, *dst, *tmp;
+	unsigned int sort, prev;
+	qboolean sorted;
+	int i, b;
+
+	Com_Memset( count, 0, sizeof( count ) );
+	sorted = qtrue;
+	prev = 0;
+	for ( i = 0; i < size; i++ ) {
+		sort = source[ i ].sort;
+		count[ 0 ][ sort & 255 ]++;
+		count[ 1 ][ ( sort >> 8 ) & 255 ]++;
+		count[ 2 ][ ( sort >> 16 ) & 255 ]++;
+		count[ 3 ][ sort >> 24 ]++;
+		if ( sort < prev ) {
+			sorted = qfalse;
+		}
+		prev = sort;
+	}
+
+	if ( sorted ) {
+		return;
+	}
+
+	src = source;
+	dst = scratch;
+	sort = source[ 0 ].sort;
+
+	for ( b = 0; b < 4; b++ ) {
+		if ( count[ b ][ ( sort >> ( b * 8 ) ) & 255 ] == size ) {
+			continue;
+		}
+		if ( size >= RADIX_PARALLEL_MIN ) {
+			R_RadixParallel( b * 8, size, src, dst );
+		} else {
+			R_Radix( b * 8, size, count[ b ], src, dst );
+		}
+		tmp = src; src = dst; dst = tmp;
+	}
+
+	if ( src != source ) {
+		Com_Memcpy( source, src, size * sizeof( drawSurf_t ) );
+	}
 }
 
 
@@ -1223,6 +1223,68 @@ static void ComputePoseMats( iqmData_t *data, int frame, int oldframe,
 	}
 }
 
+/*
+** Pose cache
+**
+** Pose matrices only depend on model data, frames and backlerp so all
+** surfaces of a model, repeated drawing in lighting passes and portal
+** views as well as entities playing the same animation share them
+*/
+#define MAX_POSE_CACHE_ITEMS	16
+
+typedef struct {
+	const iqmData_t	*data;
+	int				frame;
+	int				oldframe;
+	float			backlerp;
+	float			poseMats[IQM_MAX_JOINTS * 12];
+} poseCacheItem_t;
+
+static poseCacheItem_t	poseCache[ MAX_POSE_CACHE_ITEMS ];
+static int				poseCacheNext;
+
+
+/*
+=================
+R_IQMClearPoseCache
+
+Model data addresses get reused after registration
+=================
+*/
+void R_IQMClearPoseCache( void ) {
+	Com_Memset( poseCache, 0, sizeof( poseCache ) );
+	poseCacheNext = 0;
+}
+
+
+static const float *CachedPoseMats( iqmData_t *data, int frame, int oldframe, float backlerp ) {
+	poseCacheItem_t *item;
+	int i;
+
+	if ( oldframe == frame ) {
+		backlerp = 0.0f;
+	}
+
+	for ( i = 0, item = poseCache; i < MAX_POSE_CACHE_ITEMS; i++, item++ ) {
+		if ( item->data == data && item->frame == frame && item->oldframe == oldframe && item->backlerp == backlerp ) {
+			return item->poseMats;
+		}
+	}
+
+	// replace the oldest one
+	item = &poseCache[ poseCacheNext ];
+	poseCacheNext = ( poseCacheNext + 1 ) % MAX_POSE_CACHE_ITEMS;
+
+	ComputePoseMats( data, frame, oldframe, backlerp, item->poseMats );
+	item->data = data;
+	item->frame = frame;
+	item->oldframe = oldframe;
+	item->backlerp = backlerp;
+
+	return item->poseMats;
+}
+
+
 static void ComputeJointMats( iqmData_t *data, int frame, int oldframe,
 			      float backlerp, float *mat ) {
 	float	*mat1;
@@ -1256,7 +1318,7 @@ Compute vertices for this model surface
 void RB_IQMSurfaceAnim( const surfaceType_t *surface ) {
 	srfIQModel_t	*surf = (srfIQModel_t *)surface;
 	iqmData_t	*data = surf->data;
-	float		poseMats[IQM_MAX_JOINTS * 12];
+	const float	*poseMats;
 	float		influenceVtxMat[SHADER_MAX_VERTEXES * 12];
 	float		influenceNrmMat[SHADER_MAX_VERTEXES * 9];
 	int		i;
@@ -1297,7 +1359,7 @@ void RB_IQMSurfaceAnim( const surfaceType_t *surface ) {
 
 	if ( data->num_poses > 0 ) {
 		// compute interpolated joint matrices
-		ComputePoseMats( data, frame, oldframe, backlerp, poseMats );
+		poseMats = CachedPoseMats( data, frame, oldframe, backlerp );
 
 		// compute vertex blend influence matricies
 		for( i = 0; i < surf->num_influences; i++ ) {
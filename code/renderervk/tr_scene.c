@@ -47,6 +47,12 @@ R_InitNextFrame
 */
 void R_InitNextFrame( void ) {
 
+	// switch to the buffer that isn't being rendered
+	if ( backEndFrames[ 1 ] ) {
+		tr.smpFrame ^= 1;
+		backEndData = backEndFrames[ tr.smpFrame ];
+	}
+
 	backEndData->commands.used = 0;
 
 	r_firstSceneDrawSurf = 0;
@@ -238,6 +244,60 @@ void RE_AddRefEntityToScene( const refEntity_t *ent, qboolean intShaderTime ) {
 }
 
 
+#ifdef USE_PMLIGHT
+/*
+=====================
+R_MergeDlights
+
+Every per-pixel light draws all surfaces it touches once more, so
+lights almost sharing an origin (explosions, several projectiles
+hitting the same spot) are combined into one light covering both.
+Returns the new number of lights
+=====================
+*/
+static int R_MergeDlights( dlight_t *dlights, int count, float distance ) {
+	dlight_t *dl, *other;
+	vec3_t delta;
+	float d, w, radius;
+	int i, j, n;
+
+	n = count;
+	for ( i = 0; i < n; i++ ) {
+		dl = &dlights[i];
+		if ( dl->linear ) {
+			continue;
+		}
+		for ( j = i + 1; j < n; ) {
+			other = &dlights[j];
+			if ( other->linear || other->additive != dl->additive ) {
+				j++;
+				continue;
+			}
+			VectorSubtract( other->origin, dl->origin, delta );
+			d = VectorLength( delta );
+			if ( d > distance ) {
+				j++;
+				continue;
+			}
+
+			// move toward the wider light and cover both spheres
+			w = other->radius / ( dl->radius + other->radius );
+			radius = MAX( dl->radius + d * w, other->radius + d * ( 1.0f - w ) );
+			VectorMA( dl->origin, w, delta, dl->origin );
+			VectorAdd( dl->color, other->color, dl->color );
+			dl->radius = radius;
+
+			// keep the array packed, order doesn't matter
+			*other = dlights[ --n ];
+			tr.pc.c_dlights_merged++;
+		}
+	}
+
+	return n;
+}
+#endif
+
+
 /*
 =====================
 RE_AddDynamicLightToScene
@@ -385,7 +445,7 @@ void RE_RenderScene( const refdef_t *fd ) {
 	renderCommand_t	lastRenderCommand;
 #endif
 	viewParms_t		parms;
-	int				startTime;
+	int64_t			startTime;
 
 	if ( !tr.registered ) {
 		return;
@@ -395,7 +455,7 @@ void RE_RenderScene( const refdef_t *fd ) {
 		return;
 	}
 
-	startTime = ri.Milliseconds();
+	startTime = ri.Microseconds();
 
 	if (!tr.world && !( fd->rdflags & RDF_NOWORLDMODEL ) ) {
 		ri.Error (ERR_DROP, "R_RenderScene: NULL worldmodel");
@@ -466,6 +526,15 @@ void RE_RenderScene( const refdef_t *fd ) {
 		tr.refdef.num_dlights = 0;
 	}
 
+#ifdef USE_PMLIGHT
+#ifdef USE_LEGACY_DLIGHTS
+	if ( r_dlightMode->integer )
+#endif
+	if ( r_dlightMerge->value > 0.0f ) {
+		tr.refdef.num_dlights = R_MergeDlights( tr.refdef.dlights, tr.refdef.num_dlights, r_dlightMerge->value );
+	}
+#endif
+
 	// a single frame may have multiple scenes draw inside it --
 	// a 3D game view, 3D status bar renderings, 3D menus, etc.
 	// They need to be distinguished by the light flare code, because
@@ -564,5 +633,5 @@ void RE_RenderScene( const refdef_t *fd ) {
 	r_firstSceneDlight = r_numdlights;
 	r_firstScenePoly = r_numpolys;
 
-	tr.frontEndMsec += ri.Milliseconds() - startTime;
+	tr.frontEndUsec += (int)( ri.Microseconds() - startTime );
 }
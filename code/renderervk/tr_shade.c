@@ -66,8 +66,10 @@ static void R_BindAnimatedImage( const textureBundle_t *bundle ) {
 	double	v;
 
 	if ( bundle->isVideoMap ) {
-		ri.CIN_RunCinematic(bundle->videoMapHandle);
-		ri.CIN_UploadCinematic(bundle->videoMapHandle);
+		if ( !R_DeferCinematic( bundle->videoMapHandle ) ) {
+			ri.CIN_RunCinematic(bundle->videoMapHandle);
+			ri.CIN_UploadCinematic(bundle->videoMapHandle);
+		}
 		return;
 	}
 
@@ -544,6 +546,7 @@ static void ProjectDlightTexture( void ) {
 #endif // USE_LEGACY_DLIGHTS
 
 uint32_t VK_PushUniform( const vkUniform_t *uniform );
+void VK_SetFogUniform( vkUniform_t *uniform );
 void VK_SetFogParams( vkUniform_t *uniform, int *fogStage );
 static vkUniform_t uniform;
 
@@ -955,6 +958,12 @@ static void RB_IterateStagesGeneric( const shaderCommands_t *input )
 		VectorCopy( backEnd.or.viewOrigin, uniform.eyePos );
 		vk_update_descriptor( VK_DESC_FOG_COLLAPSE, tr.fogImage->descriptor );
 		pushUniform = qtrue;
+	} else if ( tess.fogNum && input->shader->fogAdjust ) {
+		VK_SetFogUniform( &uniform );
+		fog_stage = 1;
+		VectorCopy( backEnd.or.viewOrigin, uniform.eyePos );
+		vk_update_descriptor( VK_DESC_FOG_COLLAPSE, tr.fogImage->descriptor );
+		pushUniform = qtrue;
 	} else
 #endif
 	{
@@ -1089,21 +1098,28 @@ static void RB_IterateStagesGeneric( const shaderCommands_t *input )
 
 #ifdef USE_VULKAN
 
+void VK_SetFogUniform( vkUniform_t *uniform )
+{
+	const fogProgramParms_t *fp = RB_CalcFogProgramParms();
+
+	// vertex data
+	Vector4Copy( fp->fogDistanceVector, uniform->fogDistanceVector );
+	Vector4Copy( fp->fogDepthVector, uniform->fogDepthVector );
+	uniform->fogEyeT[0] = fp->eyeT;
+	if ( fp->eyeOutside ) {
+		uniform->fogEyeT[1] = 0.0; // fog eye out
+	} else {
+		uniform->fogEyeT[1] = 1.0; // fog eye in
+	}
+	// fragment data
+	Vector4Copy( fp->fogColor, uniform->fogColor );
+}
+
+
 void VK_SetFogParams( vkUniform_t *uniform, int *fogStage )
 {
 	if ( tess.fogNum && tess.shader->fogPass ) {
-		const fogProgramParms_t *fp = RB_CalcFogProgramParms();
-		// vertex data
-		Vector4Copy( fp->fogDistanceVector, uniform->fogDistanceVector );
-		Vector4Copy( fp->fogDepthVector, uniform->fogDepthVector );
-		uniform->fogEyeT[0] = fp->eyeT;
-		if ( fp->eyeOutside ) {
-			uniform->fogEyeT[1] = 0.0; // fog eye out
-		} else {
-			uniform->fogEyeT[1] = 1.0; // fog eye in
-		}
-		// fragment data
-		Vector4Copy( fp->fogColor, uniform->fogColor );
+		VK_SetFogUniform( uniform );
 		*fogStage = 1;
 	} else {
 		*fogStage = 0;
@@ -1147,7 +1163,7 @@ static void VK_SetLightParams( vkUniform_t *uniform, const dlight_t *dl ) {
 uint32_t VK_PushUniform( const vkUniform_t *uniform ) {
 	const uint32_t offset = vk.cmd->uniform_read_offset = PAD( vk.cmd->vertex_buffer_offset, vk.uniform_alignment );
 
-	if ( offset + vk.uniform_item_size > vk.geometry_buffer_size )
+	if ( !vk_reserve_geometry( offset + vk.uniform_item_size ) )
 		return ~0U;
 
 	// push uniform
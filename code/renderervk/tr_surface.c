@@ -713,21 +713,20 @@ static void VectorArrayNormalize(vec4_t *normals, unsigned int count)
 /*
 ** LerpMeshVertexes
 */
-static void LerpMeshVertexes_scalar(md3Surface_t *surf, float backlerp)
+static void LerpMeshVertexes_scalar(const md3Surface_t *surf, const trRefEntity_t *ent, float backlerp, float *outXyz, float *outNormal)
 {
 	short	*oldXyz, *newXyz, *oldNormals, *newNormals;
-	float	*outXyz, *outNormal;
+	vec4_t	*normals;
 	float	oldXyzScale, newXyzScale;
 	float	oldNormalScale, newNormalScale;
 	int		vertNum;
 	unsigned lat, lng;
 	int		numVerts;
 
-	outXyz = tess.xyz[tess.numVertexes];
-	outNormal = tess.normal[tess.numVertexes];
+	normals = (vec4_t *)outNormal;
 
 	newXyz = (short *)((byte *)surf + surf->ofsXyzNormals)
-		+ (backEnd.currentEntity->e.frame * surf->numVerts * 4);
+		+ (ent->e.frame * surf->numVerts * 4);
 	newNormals = newXyz + 3;
 
 	newXyzScale = MD3_XYZ_SCALE * (1.0 - backlerp);
@@ -766,7 +765,7 @@ static void LerpMeshVertexes_scalar(md3Surface_t *surf, float backlerp)
 		// interpolate and copy the vertex and normal
 		//
 		oldXyz = (short *)((byte *)surf + surf->ofsXyzNormals)
-			+ (backEnd.currentEntity->e.oldframe * surf->numVerts * 4);
+			+ (ent->e.oldframe * surf->numVerts * 4);
 		oldNormals = oldXyz + 3;
 
 		oldXyzScale = MD3_XYZ_SCALE * backlerp;
@@ -807,14 +806,185 @@ static void LerpMeshVertexes_scalar(md3Surface_t *surf, float backlerp)
 
 //			VectorNormalize (outNormal);
 		}
-    	VectorArrayNormalize((vec4_t *)tess.normal[tess.numVertexes], numVerts);
+    	VectorArrayNormalize(normals, numVerts);
    	}
 }
 
 
-static void LerpMeshVertexes(md3Surface_t *surf, float backlerp)
+/*
+** LerpMeshVertexes_decoded
+**
+** Same for frames unpacked by R_DecodeMD3Frames
+*/
+static void LerpMeshVertexes_decoded(const md3Surface_t *surf, const md3Vert_t *frames, const trRefEntity_t *ent, float backlerp, float *outXyz, float *outNormal)
+{
+	const md3Vert_t *newVerts, *oldVerts;
+	vec4_t	*normals;
+	float	oldScale, newScale;
+	int		vertNum;
+	int		numVerts;
+
+	normals = (vec4_t *)outNormal;
+	numVerts = surf->numVerts;
+	newVerts = frames + ent->e.frame * numVerts;
+
+	if ( backlerp == 0 ) {
+		for ( vertNum = 0; vertNum < numVerts; vertNum++, outXyz += 4, outNormal += 4 ) {
+			VectorCopy( newVerts[vertNum].xyz, outXyz );
+			VectorCopy( newVerts[vertNum].normal, outNormal );
+		}
+	} else {
+		oldVerts = frames + ent->e.oldframe * numVerts;
+		oldScale = backlerp;
+		newScale = 1.0 - backlerp;
+
+		for ( vertNum = 0; vertNum < numVerts; vertNum++, outXyz += 4, outNormal += 4 ) {
+			outXyz[0] = oldVerts[vertNum].xyz[0] * oldScale + newVerts[vertNum].xyz[0] * newScale;
+			outXyz[1] = oldVerts[vertNum].xyz[1] * oldScale + newVerts[vertNum].xyz[1] * newScale;
+			outXyz[2] = oldVerts[vertNum].xyz[2] * oldScale + newVerts[vertNum].xyz[2] * newScale;
+
+			outNormal[0] = oldVerts[vertNum].normal[0] * oldScale + newVerts[vertNum].normal[0] * newScale;
+			outNormal[1] = oldVerts[vertNum].normal[1] * oldScale + newVerts[vertNum].normal[1] * newScale;
+			outNormal[2] = oldVerts[vertNum].normal[2] * oldScale + newVerts[vertNum].normal[2] * newScale;
+		}
+		VectorArrayNormalize( normals, numVerts );
+	}
+}
+
+
+static void LerpMeshVertexes(const md3Surface_t *surf, const trRefEntity_t *ent, float backlerp, float *outXyz, float *outNormal)
+{
+	const md3Vert_t *frames = MD3_DECODED_FRAMES( surf );
+
+	if ( frames ) {
+		LerpMeshVertexes_decoded( surf, frames, ent, backlerp, outXyz, outNormal );
+	} else {
+		LerpMeshVertexes_scalar( surf, ent, backlerp, outXyz, outNormal );
+	}
+}
+
+
+/*
+** Mesh cache
+**
+** Interpolated vertexes of all md3 surfaces in a view are computed on job
+** threads before the draw surface list is walked, RB_SurfaceMesh() then only
+** copies them into tess. surfaces drawn more than once in a view (lighting
+** passes) are interpolated just once
+*/
+#define MAX_MESH_CACHE_ITEMS	1024
+#define MAX_MESH_CACHE_VERTS	32768
+#define MESH_CACHE_HASH_SIZE	256		// must be power of two
+#define MESH_CACHE_MIN_VERTS	2048	// not worth dispatching smaller views
+
+typedef struct meshCacheItem_s {
+	const md3Surface_t	*surf;
+	const trRefEntity_t	*ent;
+	float				backlerp;
+	int					firstVert;
+	struct meshCacheItem_s *next;
+} meshCacheItem_t;
+
+static struct {
+	meshCacheItem_t	*hash[ MESH_CACHE_HASH_SIZE ];
+	meshCacheItem_t	items[ MAX_MESH_CACHE_ITEMS ];
+	int				numItems;
+	int				numVerts;
+	vec4_t			xyz[ MAX_MESH_CACHE_VERTS ];
+	vec4_t			normal[ MAX_MESH_CACHE_VERTS ];
+} meshCache;
+
+
+static unsigned int MeshCacheHash( const md3Surface_t *surf, const trRefEntity_t *ent )
+{
+	return ( (unsigned int)( (intptr_t)surf >> 4 ) ^ (unsigned int)( (intptr_t)ent >> 6 ) ) & ( MESH_CACHE_HASH_SIZE - 1 );
+}
+
+
+static const meshCacheItem_t *MeshCacheFind( const md3Surface_t *surf, const trRefEntity_t *ent )
+{
+	const meshCacheItem_t *item;
+
+	for ( item = meshCache.hash[ MeshCacheHash( surf, ent ) ]; item; item = item->next ) {
+		if ( item->surf == surf && item->ent == ent ) {
+			return item;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void MeshCacheJob( void *data, int index )
+{
+	const meshCacheItem_t *item = meshCache.items + index;
+
+	LerpMeshVertexes( item->surf, item->ent, item->backlerp, meshCache.xyz[ item->firstVert ], meshCache.normal[ item->firstVert ] );
+}
+
+
+/*
+=============
+RB_PrepareMeshes
+
+Called before each view is rendered
+=============
+*/
+void RB_PrepareMeshes( const drawSurf_t *drawSurfs, int numDrawSurfs )
 {
-	LerpMeshVertexes_scalar( surf, backlerp );
+	const md3Surface_t *surf;
+	const trRefEntity_t *ent;
+	meshCacheItem_t *item;
+	shader_t *shader;
+	int i, entityNum, fogNum, dlighted;
+	unsigned int hash;
+
+	if ( meshCache.numItems ) {
+		Com_Memset( meshCache.hash, 0, sizeof( meshCache.hash ) );
+		meshCache.numItems = 0;
+	}
+	meshCache.numVerts = 0;
+
+	for ( i = 0; i < numDrawSurfs; i++ ) {
+		if ( *drawSurfs[i].surface != SF_MD3 ) {
+			continue;
+		}
+
+		R_DecomposeSort( drawSurfs[i].sort, &entityNum, &shader, &fogNum, &dlighted );
+		if ( entityNum == REFENTITYNUM_WORLD ) {
+			continue;
+		}
+
+		surf = (const md3Surface_t *)drawSurfs[i].surface;
+		ent = &backEnd.refdef.entities[ entityNum ];
+		if ( MeshCacheFind( surf, ent ) ) {
+			continue;
+		}
+
+		if ( meshCache.numItems >= MAX_MESH_CACHE_ITEMS || meshCache.numVerts + surf->numVerts > MAX_MESH_CACHE_VERTS ) {
+			break; // rest will be interpolated while drawing
+		}
+
+		item = meshCache.items + meshCache.numItems++;
+		item->surf = surf;
+		item->ent = ent;
+		item->backlerp = ( ent->e.oldframe == ent->e.frame ) ? 0 : ent->e.backlerp;
+		item->firstVert = meshCache.numVerts;
+		meshCache.numVerts += surf->numVerts;
+	}
+
+	if ( meshCache.numVerts < MESH_CACHE_MIN_VERTS ) {
+		meshCache.numItems = 0;
+		return;
+	}
+
+	for ( i = 0, item = meshCache.items; i < meshCache.numItems; i++, item++ ) {
+		hash = MeshCacheHash( item->surf, item->ent );
+		item->next = meshCache.hash[ hash ];
+		meshCache.hash[ hash ] = item;
+	}
+
+	ri.ParallelFor( MeshCacheJob, NULL, meshCache.numItems );
 }
 
 
@@ -824,6 +994,7 @@ RB_SurfaceMesh
 =============
 */
 static void RB_SurfaceMesh(md3Surface_t *surface) {
+	const meshCacheItem_t *item;
 	int				j;
 	float			backlerp;
 	int				*triangles;
@@ -842,14 +1013,19 @@ static void RB_SurfaceMesh(md3Surface_t *surface) {
 	tess.surfType = SF_MD3;
 #endif
 
-	if (  backEnd.currentEntity->e.oldframe == backEnd.currentEntity->e.frame ) {
-		backlerp = 0;
-	} else  {
-		backlerp = backEnd.currentEntity->e.backlerp;
+	item = meshCache.numItems ? MeshCacheFind( surface, backEnd.currentEntity ) : NULL;
+	if ( item ) {
+		Com_Memcpy( tess.xyz[ tess.numVertexes ], meshCache.xyz[ item->firstVert ], surface->numVerts * sizeof( vec4_t ) );
+		Com_Memcpy( tess.normal[ tess.numVertexes ], meshCache.normal[ item->firstVert ], surface->numVerts * sizeof( vec4_t ) );
+	} else {
+		if ( backEnd.currentEntity->e.oldframe == backEnd.currentEntity->e.frame ) {
+			backlerp = 0;
+		} else  {
+			backlerp = backEnd.currentEntity->e.backlerp;
+		}
+		LerpMeshVertexes( surface, backEnd.currentEntity, backlerp, tess.xyz[ tess.numVertexes ], tess.normal[ tess.numVertexes ] );
 	}
 
-	LerpMeshVertexes (surface, backlerp);
-
 	triangles = (int *) ((byte *)surface + surface->ofsTriangles);
 	indexes = surface->numTriangles * 3;
 	Bob = tess.numIndexes;
@@ -859,6 +1035,10 @@ static void RB_SurfaceMesh(md3Surface_t *surface) {
 	}
 	tess.numIndexes += indexes;
 
+	if ( tess.shader == tr.shadowShader ) {
+		RB_AddShadowSurface( surface, Doug, Bob );
+	}
+
 	texCoords = (float *) ((byte *)surface + surface->ofsSt);
 
 	numVerts = surface->numVerts;
@@ -449,7 +449,7 @@ static void R_RecursiveLightNode( const mnode_t* node )
 	int c;
 	do {
 		// if the node wasn't marked as potentially visible, exit
-		if ( node->visframe != tr.visCount )
+		if ( node->visframe[tr.visSlot] != tr.visCount )
 			return;
 
 		if ( node->contents != CONTENTS_NODE )
@@ -584,6 +584,147 @@ void R_AddBrushModelSurfaces ( trRefEntity_t *ent ) {
 */
 
 
+/*
+================
+R_AddWorldLeaf
+================
+*/
+static void R_AddWorldLeaf( const mnode_t *node, unsigned int dlightBits ) {
+	// leaf node, so add mark surfaces
+	int			c;
+	msurface_t	*surf, **mark;
+
+	tr.pc.c_leafs++;
+
+	// add to z buffer bounds
+	if ( node->mins[0] < tr.viewParms.visBounds[0][0] ) {
+		tr.viewParms.visBounds[0][0] = node->mins[0];
+	}
+	if ( node->mins[1] < tr.viewParms.visBounds[0][1] ) {
+		tr.viewParms.visBounds[0][1] = node->mins[1];
+	}
+	if ( node->mins[2] < tr.viewParms.visBounds[0][2] ) {
+		tr.viewParms.visBounds[0][2] = node->mins[2];
+	}
+
+	if ( node->maxs[0] > tr.viewParms.visBounds[1][0] ) {
+		tr.viewParms.visBounds[1][0] = node->maxs[0];
+	}
+	if ( node->maxs[1] > tr.viewParms.visBounds[1][1] ) {
+		tr.viewParms.visBounds[1][1] = node->maxs[1];
+	}
+	if ( node->maxs[2] > tr.viewParms.visBounds[1][2] ) {
+		tr.viewParms.visBounds[1][2] = node->maxs[2];
+	}
+
+	// add the individual surfaces
+	mark = node->firstmarksurface;
+	c = node->nummarksurfaces;
+	while (c--) {
+		// the surface may have already been added if it
+		// spans multiple leafs
+		surf = *mark;
+		R_AddWorldSurface( surf, dlightBits );
+		mark++;
+	}
+}
+
+
+/*
+=============================================================
+
+	OCCLUSION CULLING
+
+=============================================================
+*/
+
+#define MAX_VIEW_OCCLUDERS	64
+
+/*
+================
+R_SetupOcclusion
+
+Rasterizes the occluders that look biggest from the view origin
+================
+*/
+static void R_SetupOcclusion( void ) {
+	const occluder_t *best[ MAX_VIEW_OCCLUDERS ];
+	float		scores[ MAX_VIEW_OCCLUDERS ];
+	occluder_t	*occ;
+	const shader_t *sh;
+	const int	*indexes;
+	vec3_t		center;
+	float		d, score;
+	int			i, j, numBest;
+
+	if ( !r_occlusion->integer || r_nocull->integer || tr.viewParms.portalView != PV_NONE ) {
+		return;
+	}
+
+	numBest = 0;
+	for ( i = 0, occ = tr.world->occluders; i < tr.world->numOccluders; i++, occ++ ) {
+		sh = occ->surf->shader;
+		if ( sh->remappedShader ) {
+			continue;
+		}
+
+		// only the drawn side of a face hides anything
+		d = DotProduct( tr.viewParms.or.origin, occ->face->plane.normal ) - occ->face->plane.dist;
+		if ( ( sh->cullType == CT_FRONT_SIDED && d <= 0.0f ) || ( sh->cullType == CT_BACK_SIDED && d >= 0.0f ) ) {
+			continue;
+		}
+
+		for ( j = 0; j < 4; j++ ) {
+			if ( BoxOnPlaneSide( occ->bounds[0], occ->bounds[1], &tr.viewParms.frustum[j] ) == 2 ) {
+				break;
+			}
+		}
+		if ( j != 4 ) {
+			continue;
+		}
+
+		// approximate projected size
+		VectorAdd( occ->bounds[0], occ->bounds[1], center );
+		VectorScale( center, 0.5f, center );
+		score = occ->area / ( DistanceSquared( center, tr.viewParms.or.origin ) + 1.0f );
+
+		// keep the list sorted by score
+		if ( numBest == MAX_VIEW_OCCLUDERS ) {
+			if ( score <= scores[ numBest - 1 ] ) {
+				continue;
+			}
+			numBest--;
+		}
+		for ( j = numBest; j > 0 && scores[ j - 1 ] < score; j-- ) {
+			scores[ j ] = scores[ j - 1 ];
+			best[ j ] = best[ j - 1 ];
+		}
+		scores[ j ] = score;
+		best[ j ] = occ;
+		numBest++;
+	}
+
+	if ( !numBest ) {
+		return;
+	}
+
+	R_OcclusionClear( tr.viewParms.world.modelMatrix, tr.viewParms.projectionMatrix );
+
+	for ( i = 0; i < numBest; i++ ) {
+		const srfSurfaceFace_t *face = best[ i ]->face;
+		indexes = (const int *)((const byte *)face + face->ofsIndices);
+		for ( j = 0; j < face->numIndices - 2; j += 3 ) {
+			R_OcclusionAddTriangle( face->points[ indexes[ j ] ], face->points[ indexes[ j + 1 ] ], face->points[ indexes[ j + 2 ] ] );
+		}
+	}
+
+	R_OcclusionBuild();
+
+	tr.occlusionActive = qtrue;
+	tr.pc.c_occluders += numBest;
+}
+
+
 /*
 ================
 R_RecursiveWorldNode
@@ -595,7 +736,7 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 		unsigned int newDlights[2];
 
 		// if the node wasn't marked as potentially visible, exit
-		if (node->visframe != tr.visCount) {
+		if (node->visframe[tr.visSlot] != tr.visCount) {
 			return;
 		}
 
@@ -647,6 +788,11 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 
 		}
 
+		if ( tr.occlusionActive && R_OcclusionTestBounds( node->mins, node->maxs ) ) {
+			tr.pc.c_occluded_nodes++;
+			return;
+		}
+
 		if ( node->contents != CONTENTS_NODE ) {
 			break;
 		}
@@ -693,43 +839,201 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 #endif
 	} while ( 1 );
 
-	{
-		// leaf node, so add mark surfaces
-		int			c;
-		msurface_t	*surf, **mark;
+	R_AddWorldLeaf( node, dlightBits );
+}
 
-		tr.pc.c_leafs++;
 
-		// add to z buffer bounds
-		if ( node->mins[0] < tr.viewParms.visBounds[0][0] ) {
-			tr.viewParms.visBounds[0][0] = node->mins[0];
-		}
-		if ( node->mins[1] < tr.viewParms.visBounds[0][1] ) {
-			tr.viewParms.visBounds[0][1] = node->mins[1];
-		}
-		if ( node->mins[2] < tr.viewParms.visBounds[0][2] ) {
-			tr.viewParms.visBounds[0][2] = node->mins[2];
+/*
+=============================================================
+
+	LINEAR LEAF CULLING
+
+Leafs marked by R_MarkLeaves are gathered once per vis change with
+their bounds in structure-of-arrays form, so the frustum and dlight
+tests of each view are flat loops the compiler can vectorize. Long
+lists are split across job threads, surfaces are then added in leaf
+order on the calling thread since R_AddWorldSurface is not reentrant.
+
+Every ancestor box contains the leaf box, so testing leafs alone culls
+exactly what R_RecursiveWorldNode does.
+
+=============================================================
+*/
+
+#define LEAF_CULL_BATCH 512
+#define LEAF_OCCLUDED 2
+
+typedef struct {
+	const cplane_t	*planes;
+	int				numPlanes;
+	const dlight_t	*dlights;
+	int				numDlights;
+	qboolean		occlusion;
+} leafCull_t;
+
+
+/*
+================
+R_BuildVisLeafs
+================
+*/
+static void R_BuildVisLeafs( world_t *w ) {
+	const mnode_t *leaf;
+	float	*minX, *minY, *minZ, *maxX, *maxY, *maxZ;
+	int		i, n;
+
+	minX = w->visLeafBounds;
+	minY = minX + w->numLeafs;
+	minZ = minY + w->numLeafs;
+	maxX = minZ + w->numLeafs;
+	maxY = maxX + w->numLeafs;
+	maxZ = maxY + w->numLeafs;
+
+	n = 0;
+	leaf = w->nodes + w->numDecisionNodes;
+	for ( i = 0; i < w->numnodes - w->numDecisionNodes; i++, leaf++ ) {
+		if ( leaf->visframe[tr.visSlot] != tr.visCount ) {
+			continue;
 		}
+		w->visLeafs[ n ] = (mnode_t *)leaf;
+		minX[ n ] = leaf->mins[0];
+		minY[ n ] = leaf->mins[1];
+		minZ[ n ] = leaf->mins[2];
+		maxX[ n ] = leaf->maxs[0];
+		maxY[ n ] = leaf->maxs[1];
+		maxZ[ n ] = leaf->maxs[2];
+		n++;
+	}
 
-		if ( node->maxs[0] > tr.viewParms.visBounds[1][0] ) {
-			tr.viewParms.visBounds[1][0] = node->maxs[0];
+	w->numVisLeafs = n;
+	w->visLeafsFrame = tr.visCount;
+}
+
+
+/*
+================
+R_CullLeafsJob
+
+Runs on job threads, writes only its own batch of visLeafVisible/visLeafDlights
+================
+*/
+static void R_CullLeafsJob( void *data, int index ) {
+	const leafCull_t *lc = (const leafCull_t *)data;
+	const world_t *w = tr.world;
+	const float *minX, *minY, *minZ, *maxX, *maxY, *maxZ;
+	byte	*visible;
+	unsigned int *dlights;
+	int		first, last, i, p;
+
+	minX = w->visLeafBounds;
+	minY = minX + w->numLeafs;
+	minZ = minY + w->numLeafs;
+	maxX = minZ + w->numLeafs;
+	maxY = maxX + w->numLeafs;
+	maxZ = maxY + w->numLeafs;
+
+	visible = w->visLeafVisible;
+	dlights = w->visLeafDlights;
+
+	first = index * LEAF_CULL_BATCH;
+	last = MIN( first + LEAF_CULL_BATCH, w->numVisLeafs );
+
+	for ( i = first; i < last; i++ ) {
+		visible[ i ] = 1;
+	}
+
+	for ( p = 0; p < lc->numPlanes; p++ ) {
+		const cplane_t *plane = &lc->planes[ p ];
+		// box corner farthest along the plane normal, culled if it is behind
+		const float *x = plane->normal[0] >= 0.0f ? maxX : minX;
+		const float *y = plane->normal[1] >= 0.0f ? maxY : minY;
+		const float *z = plane->normal[2] >= 0.0f ? maxZ : minZ;
+		const float nx = plane->normal[0];
+		const float ny = plane->normal[1];
+		const float nz = plane->normal[2];
+		const float dist = plane->dist;
+
+		for ( i = first; i < last; i++ ) {
+			visible[ i ] &= ( nx * x[ i ] + ny * y[ i ] + nz * z[ i ] >= dist );
 		}
-		if ( node->maxs[1] > tr.viewParms.visBounds[1][1] ) {
-			tr.viewParms.visBounds[1][1] = node->maxs[1];
+	}
+
+	if ( lc->occlusion ) {
+		vec3_t mins, maxs;
+		for ( i = first; i < last; i++ ) {
+			if ( visible[ i ] ) {
+				VectorSet( mins, minX[ i ], minY[ i ], minZ[ i ] );
+				VectorSet( maxs, maxX[ i ], maxY[ i ], maxZ[ i ] );
+				if ( R_OcclusionTestBounds( mins, maxs ) ) {
+					visible[ i ] = LEAF_OCCLUDED;
+				}
+			}
 		}
-		if ( node->maxs[2] > tr.viewParms.visBounds[1][2] ) {
-			tr.viewParms.visBounds[1][2] = node->maxs[2];
+	}
+
+	if ( !lc->numDlights ) {
+		return;
+	}
+
+	for ( i = first; i < last; i++ ) {
+		dlights[ i ] = 0;
+	}
+
+	for ( p = 0; p < lc->numDlights; p++ ) {
+		const dlight_t *dl = &lc->dlights[ p ];
+		const float ox = dl->origin[0];
+		const float oy = dl->origin[1];
+		const float oz = dl->origin[2];
+		const float radius2 = dl->radius * dl->radius;
+		const unsigned int bit = 1U << p;
+
+		for ( i = first; i < last; i++ ) {
+			// distance from the light to the closest point of the box
+			const float dx = MAX( minX[ i ] - ox, 0.0f ) + MAX( ox - maxX[ i ], 0.0f );
+			const float dy = MAX( minY[ i ] - oy, 0.0f ) + MAX( oy - maxY[ i ], 0.0f );
+			const float dz = MAX( minZ[ i ] - oz, 0.0f ) + MAX( oz - maxZ[ i ], 0.0f );
+			dlights[ i ] |= ( dx * dx + dy * dy + dz * dz < radius2 ) ? bit : 0;
 		}
+	}
+}
+
+
+/*
+================
+R_LinearWorldLeafs
+================
+*/
+static void R_LinearWorldLeafs( unsigned int dlightBits ) {
+	world_t		*w = tr.world;
+	leafCull_t	lc;
+	int			i;
+
+	if ( w->visLeafsFrame != tr.visCount ) {
+		R_BuildVisLeafs( w );
+	}
 
-		// add the individual surfaces
-		mark = node->firstmarksurface;
-		c = node->nummarksurfaces;
-		while (c--) {
-			// the surface may have already been added if it
-			// spans multiple leafs
-			surf = *mark;
-			R_AddWorldSurface( surf, dlightBits );
-			mark++;
+	lc.planes = tr.viewParms.frustum;
+	lc.numPlanes = r_nocull->integer ? 0 : 4;
+	lc.dlights = NULL;
+	lc.numDlights = 0;
+	lc.occlusion = tr.occlusionActive;
+#ifdef USE_LEGACY_DLIGHTS
+#ifdef USE_PMLIGHT
+	if ( !r_dlightMode->integer )
+#endif
+	if ( dlightBits ) {
+		lc.dlights = tr.refdef.dlights;
+		lc.numDlights = tr.refdef.num_dlights;
+	}
+#endif
+
+	ri.ParallelFor( R_CullLeafsJob, &lc, ( w->numVisLeafs + LEAF_CULL_BATCH - 1 ) / LEAF_CULL_BATCH );
+
+	for ( i = 0; i < w->numVisLeafs; i++ ) {
+		if ( w->visLeafVisible[ i ] == LEAF_OCCLUDED ) {
+			tr.pc.c_occluded_nodes++;
+		} else if ( w->visLeafVisible[ i ] ) {
+			R_AddWorldLeaf( w->visLeafs[ i ], lc.numDlights ? w->visLeafDlights[ i ] : 0 );
 		}
 	}
 }
@@ -798,6 +1102,28 @@ qboolean R_inPVS( const vec3_t p1, const vec3_t p2 ) {
 	return qtrue;
 }
 
+/*
+===============
+R_SelectVisSlot
+
+Saves leaf marks state of the current slot and restores the requested one
+===============
+*/
+static void R_SelectVisSlot( int slot ) {
+
+	if ( slot == tr.visSlot ) {
+		return;
+	}
+
+	tr.visSlotCount[ tr.visSlot ] = tr.visCount;
+	tr.visSlotCluster[ tr.visSlot ] = tr.viewCluster;
+
+	tr.visSlot = slot;
+	tr.visCount = tr.visSlotCount[ slot ];
+	tr.viewCluster = tr.visSlotCluster[ slot ];
+}
+
+
 /*
 ===============
 R_MarkLeaves
@@ -812,6 +1138,10 @@ static void R_MarkLeaves (void) {
 	int		i;
 	int		cluster;
 
+	// portal views keep their own marks, otherwise a visible portal
+	// into another cluster makes both views remark everything each frame
+	R_SelectVisSlot( tr.viewParms.portalView != PV_NONE ? VIS_SLOT_PORTAL : VIS_SLOT_MAIN );
+
 	// lockpvs lets designers walk around to determine the
 	// extent of the current pvs
 	if ( r_lockpvs->integer ) {
@@ -838,20 +1168,55 @@ static void R_MarkLeaves (void) {
 		}
 	}
 
-	tr.visCount++;
+	if ( tr.refdef.areamaskModified ) {
+		// marks of the other slots used the old area visibility
+		for ( i = 0; i < VIS_SLOTS; i++ ) {
+			tr.visSlotCluster[ i ] = -2;
+		}
+	}
+
+	tr.visCount = ++tr.visStamp;
 	tr.viewCluster = cluster;
 
 	if ( r_novis->integer || tr.viewCluster == -1 ) {
 		for (i=0 ; i<tr.world->numnodes ; i++) {
 			if (tr.world->nodes[i].contents != CONTENTS_SOLID) {
-				tr.world->nodes[i].visframe = tr.visCount;
+				tr.world->nodes[i].visframe[tr.visSlot] = tr.visCount;
 			}
 		}
 		return;
 	}
 
 	vis = R_ClusterPVS (tr.viewCluster);
-	
+
+	if ( tr.world->clusterLeafs ) {
+		// walk only the clusters that are set in the PVS
+		const int numWords = ( tr.world->numClusters + 63 ) >> 6;
+		const uint64_t *words = (const uint64_t *)vis;
+		int j;
+
+		for ( cluster = Com_NextBit( words, numWords, 0 ); cluster >= 0 && cluster < tr.world->numClusters;
+			cluster = Com_NextBit( words, numWords, cluster + 1 ) ) {
+			for ( j = tr.world->clusterFirstLeaf[ cluster ]; j < tr.world->clusterFirstLeaf[ cluster + 1 ]; j++ ) {
+				leaf = tr.world->clusterLeafs[ j ];
+
+				// check for door connection
+				if ( (tr.refdef.areamask[leaf->area>>3] & (1<<(leaf->area&7)) ) ) {
+					continue;		// not visible
+				}
+
+				parent = leaf;
+				do {
+					if (parent->visframe[tr.visSlot] == tr.visCount)
+						break;
+					parent->visframe[tr.visSlot] = tr.visCount;
+					parent = parent->parent;
+				} while (parent);
+			}
+		}
+		return;
+	}
+
 	for (i=0,leaf=tr.world->nodes ; i<tr.world->numnodes ; i++, leaf++) {
 		cluster = leaf->cluster;
 		if ( cluster < 0 || cluster >= tr.world->numClusters ) {
@@ -870,9 +1235,9 @@ static void R_MarkLeaves (void) {
 
 		parent = leaf;
 		do {
-			if (parent->visframe == tr.visCount)
+			if (parent->visframe[tr.visSlot] == tr.visCount)
 				break;
-			parent->visframe = tr.visCount;
+			parent->visframe[tr.visSlot] = tr.visCount;
 			parent = parent->parent;
 		} while (parent);
 	}
@@ -890,6 +1255,8 @@ void R_AddWorldSurfaces( void ) {
 	int i;
 #endif
 
+	tr.occlusionActive = qfalse;
+
 	if ( !r_drawworld->integer ) {
 		return;
 	}
@@ -907,12 +1274,18 @@ void R_AddWorldSurfaces( void ) {
 	// clear out the visible min/max
 	ClearBounds( tr.viewParms.visBounds[0], tr.viewParms.visBounds[1] );
 
+	R_SetupOcclusion();
+
 	// perform frustum culling and add all the potentially visible surfaces
 	if ( tr.refdef.num_dlights > MAX_DLIGHTS ) {
 		tr.refdef.num_dlights = MAX_DLIGHTS;
 	}
 
-	R_RecursiveWorldNode( tr.world->nodes, 15, ( 1ULL << tr.refdef.num_dlights ) - 1 );
+	if ( r_linearCull->integer ) {
+		R_LinearWorldLeafs( ( 1ULL << tr.refdef.num_dlights ) - 1 );
+	} else {
+		R_RecursiveWorldNode( tr.world->nodes, 15, ( 1ULL << tr.refdef.num_dlights ) - 1 );
+	}
 
 #ifdef USE_PMLIGHT
 #ifdef USE_LEGACY_DLIGHTS
@@ -39,6 +39,8 @@ static PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR	qvkGetPhysicalDeviceSurface
 static PFN_vkGetPhysicalDeviceSurfaceFormatsKHR			qvkGetPhysicalDeviceSurfaceFormatsKHR;
 static PFN_vkGetPhysicalDeviceSurfacePresentModesKHR	qvkGetPhysicalDeviceSurfacePresentModesKHR;
 static PFN_vkGetPhysicalDeviceSurfaceSupportKHR			qvkGetPhysicalDeviceSurfaceSupportKHR;
+static PFN_vkGetPhysicalDeviceFeatures2KHR				qvkGetPhysicalDeviceFeatures2KHR;
+static PFN_vkGetPhysicalDeviceMemoryProperties2KHR		qvkGetPhysicalDeviceMemoryProperties2KHR;
 #ifdef USE_VK_VALIDATION
 static PFN_vkCreateDebugReportCallbackEXT				qvkCreateDebugReportCallbackEXT;
 static PFN_vkDestroyDebugReportCallbackEXT				qvkDestroyDebugReportCallbackEXT;
@@ -59,18 +61,23 @@ static PFN_vkCmdClearAttachments						qvkCmdClearAttachments;
 static PFN_vkCmdCopyBuffer								qvkCmdCopyBuffer;
 static PFN_vkCmdCopyBufferToImage						qvkCmdCopyBufferToImage;
 static PFN_vkCmdCopyImage								qvkCmdCopyImage;
+static PFN_vkCmdCopyImageToBuffer						qvkCmdCopyImageToBuffer;
 static PFN_vkCmdDraw									qvkCmdDraw;
 static PFN_vkCmdDrawIndexed								qvkCmdDrawIndexed;
+static PFN_vkCmdDrawIndexedIndirect						qvkCmdDrawIndexedIndirect;
 static PFN_vkCmdEndRenderPass							qvkCmdEndRenderPass;
 static PFN_vkCmdNextSubpass								qvkCmdNextSubpass;
 static PFN_vkCmdPipelineBarrier							qvkCmdPipelineBarrier;
 static PFN_vkCmdPushConstants							qvkCmdPushConstants;
+static PFN_vkCmdResetQueryPool							qvkCmdResetQueryPool;
 static PFN_vkCmdSetDepthBias							qvkCmdSetDepthBias;
 static PFN_vkCmdSetScissor								qvkCmdSetScissor;
 static PFN_vkCmdSetViewport								qvkCmdSetViewport;
+static PFN_vkCmdWriteTimestamp							qvkCmdWriteTimestamp;
 static PFN_vkCreateBuffer								qvkCreateBuffer;
 static PFN_vkCreateCommandPool							qvkCreateCommandPool;
 static PFN_vkCreateDescriptorPool						qvkCreateDescriptorPool;
+static PFN_vkCreateQueryPool							qvkCreateQueryPool;
 static PFN_vkCreateDescriptorSetLayout					qvkCreateDescriptorSetLayout;
 static PFN_vkCreateFence								qvkCreateFence;
 static PFN_vkCreateFramebuffer							qvkCreateFramebuffer;
@@ -86,6 +93,7 @@ static PFN_vkCreateShaderModule							qvkCreateShaderModule;
 static PFN_vkDestroyBuffer								qvkDestroyBuffer;
 static PFN_vkDestroyCommandPool							qvkDestroyCommandPool;
 static PFN_vkDestroyDescriptorPool						qvkDestroyDescriptorPool;
+static PFN_vkDestroyQueryPool							qvkDestroyQueryPool;
 static PFN_vkDestroyDescriptorSetLayout					qvkDestroyDescriptorSetLayout;
 static PFN_vkDestroyDevice								qvkDestroyDevice;
 static PFN_vkDestroyFence								qvkDestroyFence;
@@ -109,6 +117,8 @@ static PFN_vkGetBufferMemoryRequirements				qvkGetBufferMemoryRequirements;
 static PFN_vkGetDeviceQueue								qvkGetDeviceQueue;
 static PFN_vkGetImageMemoryRequirements					qvkGetImageMemoryRequirements;
 static PFN_vkGetImageSubresourceLayout					qvkGetImageSubresourceLayout;
+static PFN_vkGetPipelineCacheData						qvkGetPipelineCacheData;
+static PFN_vkGetQueryPoolResults						qvkGetQueryPoolResults;
 static PFN_vkInvalidateMappedMemoryRanges				qvkInvalidateMappedMemoryRanges;
 static PFN_vkMapMemory									qvkMapMemory;
 static PFN_vkQueueSubmit								qvkQueueSubmit;
@@ -130,10 +140,17 @@ static PFN_vkGetImageMemoryRequirements2KHR				qvkGetImageMemoryRequirements2KHR
 
 static PFN_vkDebugMarkerSetObjectNameEXT				qvkDebugMarkerSetObjectNameEXT;
 
+static PFN_vkWaitForPresentKHR							qvkWaitForPresentKHR;
+
+static qboolean vk_physical_device_properties2; // VK_KHR_get_physical_device_properties2 is enabled on the instance
+
 ////////////////////////////////////////////////////////////////////////////
 
-// forward declaration
+// forward declarations
 VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex );
+static void vk_start_pipeline_worker( void );
+static void vk_stop_pipeline_worker( void );
+static void vk_wait_pipelines( void );
 
 static uint32_t find_memory_type( uint32_t memory_type_bits, VkMemoryPropertyFlags properties ) {
 	VkPhysicalDeviceMemoryProperties memory_properties;
@@ -302,7 +319,7 @@ static VkFlags get_composite_alpha( VkCompositeAlphaFlagsKHR flags )
 */
 
 
-static VkCommandBuffer begin_command_buffer( void )
+static VkCommandBuffer allocate_command_buffer( void )
 {
 	VkCommandBufferBeginInfo begin_info;
 	VkCommandBufferAllocateInfo alloc_info;
@@ -326,6 +343,37 @@ static VkCommandBuffer begin_command_buffer( void )
 }
 
 
+static void end_command_buffer( VkCommandBuffer command_buffer );
+
+/*
+Image uploads made outside of a frame are recorded into one command buffer
+and submitted in a single round-trip when the staging buffer fills up,
+before a frame begins or before any other one-time command buffer, so
+loading a map doesn't wait for the queue on every texture
+*/
+static void vk_flush_uploads( void )
+{
+	VkCommandBuffer command_buffer = vk_world.upload_command_buffer;
+
+	if ( command_buffer == VK_NULL_HANDLE )
+		return;
+
+	vk_world.upload_command_buffer = VK_NULL_HANDLE;
+	vk_world.staging_offset = 0;
+
+	end_command_buffer( command_buffer );
+}
+
+
+static VkCommandBuffer begin_command_buffer( void )
+{
+	// keep submission order with pending uploads
+	vk_flush_uploads();
+
+	return allocate_command_buffer();
+}
+
+
 static void end_command_buffer( VkCommandBuffer command_buffer )
 {
 	VkSubmitInfo submit_info;
@@ -352,7 +400,7 @@ static void end_command_buffer( VkCommandBuffer command_buffer )
 }
 
 
-static void record_image_layout_transition( VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags image_aspect_flags, VkImageLayout old_layout, VkImageLayout new_layout ) {
+static void record_image_levels_transition( VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags image_aspect_flags, uint32_t base_level, uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout ) {
 	VkImageMemoryBarrier barrier;
 	uint32_t src_stage, dst_stage;
 
@@ -427,8 +475,8 @@ static void record_image_layout_transition( VkCommandBuffer command_buffer, VkIm
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = image_aspect_flags;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	barrier.subresourceRange.baseMipLevel = base_level;
+	barrier.subresourceRange.levelCount = level_count;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
 
@@ -436,6 +484,11 @@ static void record_image_layout_transition( VkCommandBuffer command_buffer, VkIm
 }
 
 
+static void record_image_layout_transition( VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags image_aspect_flags, VkImageLayout old_layout, VkImageLayout new_layout ) {
+	record_image_levels_transition( command_buffer, image, image_aspect_flags, 0, VK_REMAINING_MIP_LEVELS, old_layout, new_layout );
+}
+
+
 // debug markers
 #define SET_OBJECT_NAME(obj,objName,objType) vk_set_object_name( (uint64_t)(obj), (objName), (objType) )
 
@@ -460,7 +513,7 @@ static void vk_create_swapchain( VkPhysicalDevice physical_device, VkDevice devi
 	VkExtent2D image_extent;
 	uint32_t present_mode_count, i;
 	VkPresentModeKHR present_mode;
-	VkPresentModeKHR *present_modes;
+	VkPresentModeKHR present_modes[ 16 ];
 	uint32_t image_count;
 	VkSwapchainCreateInfoKHR desc;
 	qboolean mailbox_supported = qfalse;
@@ -492,9 +545,8 @@ static void vk_create_swapchain( VkPhysicalDevice physical_device, VkDevice devi
 	}
 
 	// determine present mode and swapchain image count
-	VK_CHECK(qvkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, NULL));
-
-	present_modes = (VkPresentModeKHR *) ri.Malloc( present_mode_count * sizeof( VkPresentModeKHR ) );
+	// no heap allocations, swapchain may be recreated on the render thread
+	present_mode_count = ARRAY_LEN( present_modes );
 	VK_CHECK(qvkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, present_modes));
 
 	ri.Printf( PRINT_ALL, "...presentation modes:" );
@@ -510,8 +562,6 @@ static void vk_create_swapchain( VkPhysicalDevice physical_device, VkDevice devi
 	}
 	ri.Printf( PRINT_ALL, "\n" );
 
-	ri.Free( present_modes );
-
 	if ( ( v = ri.Cvar_VariableIntegerValue( "r_swapInterval" ) ) != 0 ) {
 		if ( v == 2 && mailbox_supported )
 			present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
@@ -574,6 +624,12 @@ static void vk_create_swapchain( VkPhysicalDevice physical_device, VkDevice devi
 
 	VK_CHECK( qvkCreateSwapchainKHR( device, &desc, NULL, swapchain ) );
 
+	// present ids are counted per swapchain
+	vk.present_id = 0;
+	for ( i = 0; i < vk.num_command_buffers; i++ ) {
+		vk.tess[ i ].present_id = 0;
+	}
+
 	VK_CHECK( qvkGetSwapchainImagesKHR( vk.device, vk.swapchain, &vk.swapchain_image_count, NULL ) );
 	vk.swapchain_image_count = MIN( vk.swapchain_image_count, MAX_SWAPCHAIN_IMAGES );
 	VK_CHECK( qvkGetSwapchainImagesKHR( vk.device, vk.swapchain, &vk.swapchain_image_count, vk.swapchain_images ) );
@@ -985,31 +1041,43 @@ static void vk_create_render_passes( void )
 }
 
 
+/*
+=============
+allocate_and_bind_image_memory
+
+Sub-allocates image memory from chunks of the same memory type, picking
+the fullest chunk that still fits to keep the rest for large images.
+Images larger than a chunk get a dedicated allocation.
+Everything is released at once in vk_release_resources()
+=============
+*/
 static void allocate_and_bind_image_memory(VkImage image) {
 	VkMemoryRequirements memory_requirements;
-	VkDeviceSize alignment;
+	VkDeviceSize offset, best_offset;
+	uint32_t memory_type;
 	ImageChunk *chunk;
 	int i;
 
 	qvkGetImageMemoryRequirements(vk.device, image, &memory_requirements);
 
-	if ( memory_requirements.size > vk.image_chunk_size ) {
-		ri.Error( ERR_FATAL, "Vulkan: could not allocate memory, image is too large (%ikbytes).",
-			(int)(memory_requirements.size/1024) );
-	}
+	memory_type = find_memory_type( memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
 
 	chunk = NULL;
+	best_offset = 0;
 
 	// Try to find an existing chunk of sufficient capacity.
-	alignment = memory_requirements.alignment;
 	for ( i = 0; i < vk_world.num_image_chunks; i++ ) {
+		if ( vk_world.image_chunks[i].memory_type != memory_type ) {
+			continue;
+		}
 		// ensure that memory region has proper alignment
-		VkDeviceSize offset = PAD( vk_world.image_chunks[i].used, alignment );
-
-		if ( offset + memory_requirements.size <= vk.image_chunk_size ) {
+		offset = PAD( vk_world.image_chunks[i].used, memory_requirements.alignment );
+		if ( offset + memory_requirements.size > vk_world.image_chunks[i].size ) {
+			continue;
+		}
+		if ( chunk == NULL || vk_world.image_chunks[i].size - offset < chunk->size - best_offset ) {
 			chunk = &vk_world.image_chunks[i];
-			chunk->used = offset + memory_requirements.size;
-			break;
+			best_offset = offset;
 		}
 	}
 
@@ -1024,24 +1092,32 @@ static void allocate_and_bind_image_memory(VkImage image) {
 
 		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 		alloc_info.pNext = NULL;
-		alloc_info.allocationSize = vk.image_chunk_size;
-		alloc_info.memoryTypeIndex = find_memory_type( memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		alloc_info.allocationSize = MAX( vk.image_chunk_size, memory_requirements.size );
+		alloc_info.memoryTypeIndex = memory_type;
 
 		VK_CHECK( qvkAllocateMemory( vk.device, &alloc_info, NULL, &memory ) );
 
 		chunk = &vk_world.image_chunks[vk_world.num_image_chunks];
 		chunk->memory = memory;
-		chunk->used = memory_requirements.size;
+		chunk->size = alloc_info.allocationSize;
+		chunk->memory_type = memory_type;
+		chunk->used = 0;
 
 		SET_OBJECT_NAME( memory, va( "image memory chunk %i", vk_world.num_image_chunks ), VK_DEBUG_REPORT_OBJECT_TYPE_DEVICE_MEMORY_EXT );
 
 		vk_world.num_image_chunks++;
+		best_offset = 0;
 	}
 
-	VK_CHECK(qvkBindImageMemory(vk.device, image, chunk->memory, chunk->used - memory_requirements.size));
+	chunk->used = best_offset + memory_requirements.size;
+	chunk->images++;
+
+	VK_CHECK(qvkBindImageMemory(vk.device, image, chunk->memory, best_offset));
 }
 
 
+#define STAGING_BUFFER_SIZE ( 16 * 1024 * 1024 )
+
 static void ensure_staging_buffer_allocation(VkDeviceSize size) {
 	VkBufferCreateInfo buffer_desc;
 	VkMemoryRequirements memory_requirements;
@@ -1052,13 +1128,15 @@ static void ensure_staging_buffer_allocation(VkDeviceSize size) {
 	if (vk_world.staging_buffer_size >= size)
 		return;
 
+	vk_flush_uploads();
+
 	if (vk_world.staging_buffer != VK_NULL_HANDLE)
 		qvkDestroyBuffer(vk.device, vk_world.staging_buffer, NULL);
 
 	if (vk_world.staging_buffer_memory != VK_NULL_HANDLE)
 		qvkFreeMemory(vk.device, vk_world.staging_buffer_memory, NULL);
 
-	vk_world.staging_buffer_size = MAX( size, 1024 * 1024 );
+	vk_world.staging_buffer_size = MAX( size, STAGING_BUFFER_SIZE );
 
 	buffer_desc.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	buffer_desc.pNext = NULL;
@@ -1154,6 +1232,7 @@ static void create_instance( void )
 	flags = 0;
 	count = 0;
 	extension_count = 0;
+	vk_physical_device_properties2 = qfalse;
 	VK_CHECK(qvkEnumerateInstanceExtensionProperties(NULL, &count, NULL));
 
 	extension_properties = (VkExtensionProperties *)ri.Malloc(sizeof(VkExtensionProperties) * count);
@@ -1183,6 +1262,10 @@ static void create_instance( void )
 			flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
 		}
 
+		if ( Q_stricmp( ext, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME ) == 0 ) {
+			vk_physical_device_properties2 = qtrue;
+		}
+
 		ri.Printf(PRINT_DEVELOPER, "instance extension: %s\n", ext);
 	}
 
@@ -1339,7 +1422,7 @@ static qboolean vk_select_surface_format( VkPhysicalDevice physical_device, VkSu
 {
 	VkFormat base_bgr, base_rgb;
 	VkFormat ext_bgr, ext_rgb;
-	VkSurfaceFormatKHR *candidates;
+	VkSurfaceFormatKHR candidates[ 64 ];
 	uint32_t format_count;
 	VkResult res;
 
@@ -1354,7 +1437,8 @@ static qboolean vk_select_surface_format( VkPhysicalDevice physical_device, VkSu
 		return qfalse;
 	}
 
-	candidates = (VkSurfaceFormatKHR*)ri.Malloc( format_count * sizeof(VkSurfaceFormatKHR) );
+	// no heap allocations, called on the render thread on swapchain restart
+	format_count = MIN( format_count, ARRAY_LEN( candidates ) );
 
 	VK_CHECK( qvkGetPhysicalDeviceSurfaceFormatsKHR( physical_device, surface, &format_count, candidates ) );
 
@@ -1400,8 +1484,6 @@ static qboolean vk_select_surface_format( VkPhysicalDevice physical_device, VkSu
 		vk.present_format = vk.base_format;
 	}
 
-	ri.Free( candidates );
-
 	return qtrue;
 }
 
@@ -1418,6 +1500,13 @@ static void setup_surface_formats( VkPhysicalDevice physical_device )
 
 	vk.blitEnabled = vk_blit_enabled( physical_device, vk.color_format, vk.capture_format );
 
+	{
+		const VkFormatFeatureFlags mip_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		VkFormatProperties props;
+		qvkGetPhysicalDeviceFormatProperties( physical_device, VK_FORMAT_R8G8B8A8_UNORM, &props );
+		vk.mipmapBlit = ( props.optimalTilingFeatures & mip_features ) == mip_features ? qtrue : qfalse;
+	}
+
 	if ( !vk.blitEnabled )
 	{
 		vk.capture_format = vk.color_format;
@@ -1488,7 +1577,7 @@ static qboolean vk_create_device( VkPhysicalDevice physical_device, int device_i
 
 	// create VkDevice
 	{
-		const char *device_extension_list[4];
+		const char *device_extension_list[7];
 		uint32_t device_extension_count;
 		const char *ext, *end;
 		char *str;
@@ -1498,11 +1587,17 @@ static qboolean vk_create_device( VkPhysicalDevice physical_device, int device_i
 		VkPhysicalDeviceFeatures device_features;
 		VkPhysicalDeviceFeatures features;
 		VkDeviceCreateInfo device_desc;
+		VkPhysicalDevicePresentIdFeaturesKHR present_id_features;
+		VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features;
+		VkPhysicalDeviceFeatures2KHR features2;
 		VkResult res;
 		qboolean swapchainSupported = qfalse;
 		qboolean dedicatedAllocation = qfalse;
 		qboolean memoryRequirements2 = qfalse;
 		qboolean debugMarker = qfalse;
+		qboolean presentId = qfalse;
+		qboolean presentWait = qfalse;
+		qboolean memoryBudget = qfalse;
 		uint32_t i, len, count = 0;
 
 		VK_CHECK( qvkEnumerateDeviceExtensionProperties( physical_device, NULL, &count, NULL ) );
@@ -1523,6 +1618,12 @@ static qboolean vk_create_device( VkPhysicalDevice physical_device, int device_i
 				memoryRequirements2 = qtrue;
 			} else if ( strcmp( ext, VK_EXT_DEBUG_MARKER_EXTENSION_NAME ) == 0 ) {
 				debugMarker = qtrue;
+			} else if ( strcmp( ext, VK_KHR_PRESENT_ID_EXTENSION_NAME ) == 0 ) {
+				presentId = qtrue;
+			} else if ( strcmp( ext, VK_KHR_PRESENT_WAIT_EXTENSION_NAME ) == 0 ) {
+				presentWait = qtrue;
+			} else if ( strcmp( ext, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME ) == 0 ) {
+				memoryBudget = qtrue;
 			}
 			// add this device extension to glConfig
 			if ( i != 0 ) {
@@ -1566,6 +1667,12 @@ static qboolean vk_create_device( VkPhysicalDevice physical_device, int device_i
 			vk.debugMarkers = qtrue;
 		}
 
+		// heap budgets for vkmeminfo
+		if ( memoryBudget && qvkGetPhysicalDeviceMemoryProperties2KHR ) {
+			device_extension_list[ device_extension_count++ ] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+			vk.memoryBudget = qtrue;
+		}
+
 		qvkGetPhysicalDeviceFeatures( physical_device, &device_features );
 
 		if ( device_features.fillModeNonSolid == VK_FALSE ) {
@@ -1593,6 +1700,16 @@ static qboolean vk_create_device( VkPhysicalDevice physical_device, int device_i
 			vk.fragmentStores = qtrue;
 		}
 
+		if ( device_features.multiDrawIndirect ) { // VBO_RenderIBOItems
+			features.multiDrawIndirect = VK_TRUE;
+			vk.multiDrawIndirect = qtrue;
+		}
+
+		if ( device_features.textureCompressionBC ) { // vk_texcache.c
+			features.textureCompressionBC = VK_TRUE;
+			vk.textureCompressionBC = qtrue;
+		}
+
 		if ( r_ext_texture_filter_anisotropic->integer && device_features.samplerAnisotropy ) {
 			features.samplerAnisotropy = VK_TRUE;
 			vk.samplerAnisotropy = qtrue;
@@ -1600,6 +1717,30 @@ static qboolean vk_create_device( VkPhysicalDevice physical_device, int device_i
 
 		device_desc.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		device_desc.pNext = NULL;
+
+		// r_lowLatency waits for presentation of the previous frame
+		if ( r_lowLatency->integer && presentId && presentWait && qvkGetPhysicalDeviceFeatures2KHR ) {
+			Com_Memset( &present_id_features, 0, sizeof( present_id_features ) );
+			present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+			Com_Memset( &present_wait_features, 0, sizeof( present_wait_features ) );
+			present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+			present_wait_features.pNext = &present_id_features;
+			Com_Memset( &features2, 0, sizeof( features2 ) );
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+			features2.pNext = &present_wait_features;
+
+			qvkGetPhysicalDeviceFeatures2KHR( physical_device, &features2 );
+
+			if ( present_id_features.presentId && present_wait_features.presentWait ) {
+				device_extension_list[ device_extension_count++ ] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+				device_extension_list[ device_extension_count++ ] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+				// enable only these two features, chain is already set up
+				present_id_features.pNext = NULL;
+				device_desc.pNext = &present_wait_features;
+				vk.presentWait = qtrue;
+			}
+		}
+
 		device_desc.flags = 0;
 		device_desc.queueCreateInfoCount = 1;
 		device_desc.pQueueCreateInfos = &queue_desc;
@@ -1704,6 +1845,11 @@ static void init_vulkan_library( void )
 		INIT_INSTANCE_FUNCTION( vkGetPhysicalDeviceSurfacePresentModesKHR )
 		INIT_INSTANCE_FUNCTION( vkGetPhysicalDeviceSurfaceSupportKHR )
 
+		if ( vk_physical_device_properties2 ) {
+			INIT_INSTANCE_FUNCTION_EXT( vkGetPhysicalDeviceFeatures2KHR )
+			INIT_INSTANCE_FUNCTION_EXT( vkGetPhysicalDeviceMemoryProperties2KHR )
+		}
+
 #ifdef USE_VK_VALIDATION
 		INIT_INSTANCE_FUNCTION_EXT( vkCreateDebugReportCallbackEXT )
 		INIT_INSTANCE_FUNCTION_EXT( vkDestroyDebugReportCallbackEXT )
@@ -1795,18 +1941,23 @@ static void init_vulkan_library( void )
 	INIT_DEVICE_FUNCTION(vkCmdCopyBuffer)
 	INIT_DEVICE_FUNCTION(vkCmdCopyBufferToImage)
 	INIT_DEVICE_FUNCTION(vkCmdCopyImage)
+	INIT_DEVICE_FUNCTION(vkCmdCopyImageToBuffer)
 	INIT_DEVICE_FUNCTION(vkCmdDraw)
 	INIT_DEVICE_FUNCTION(vkCmdDrawIndexed)
+	INIT_DEVICE_FUNCTION(vkCmdDrawIndexedIndirect)
 	INIT_DEVICE_FUNCTION(vkCmdEndRenderPass)
 	INIT_DEVICE_FUNCTION(vkCmdNextSubpass)
 	INIT_DEVICE_FUNCTION(vkCmdPipelineBarrier)
 	INIT_DEVICE_FUNCTION(vkCmdPushConstants)
+	INIT_DEVICE_FUNCTION(vkCmdResetQueryPool)
 	INIT_DEVICE_FUNCTION(vkCmdSetDepthBias)
 	INIT_DEVICE_FUNCTION(vkCmdSetScissor)
 	INIT_DEVICE_FUNCTION(vkCmdSetViewport)
+	INIT_DEVICE_FUNCTION(vkCmdWriteTimestamp)
 	INIT_DEVICE_FUNCTION(vkCreateBuffer)
 	INIT_DEVICE_FUNCTION(vkCreateCommandPool)
 	INIT_DEVICE_FUNCTION(vkCreateDescriptorPool)
+	INIT_DEVICE_FUNCTION(vkCreateQueryPool)
 	INIT_DEVICE_FUNCTION(vkCreateDescriptorSetLayout)
 	INIT_DEVICE_FUNCTION(vkCreateFence)
 	INIT_DEVICE_FUNCTION(vkCreateFramebuffer)
@@ -1822,6 +1973,7 @@ static void init_vulkan_library( void )
 	INIT_DEVICE_FUNCTION(vkDestroyBuffer)
 	INIT_DEVICE_FUNCTION(vkDestroyCommandPool)
 	INIT_DEVICE_FUNCTION(vkDestroyDescriptorPool)
+	INIT_DEVICE_FUNCTION(vkDestroyQueryPool)
 	INIT_DEVICE_FUNCTION(vkDestroyDescriptorSetLayout)
 	INIT_DEVICE_FUNCTION(vkDestroyDevice)
 	INIT_DEVICE_FUNCTION(vkDestroyFence)
@@ -1845,6 +1997,8 @@ static void init_vulkan_library( void )
 	INIT_DEVICE_FUNCTION(vkGetDeviceQueue)
 	INIT_DEVICE_FUNCTION(vkGetImageMemoryRequirements)
 	INIT_DEVICE_FUNCTION(vkGetImageSubresourceLayout)
+	INIT_DEVICE_FUNCTION(vkGetPipelineCacheData)
+	INIT_DEVICE_FUNCTION(vkGetQueryPoolResults)
 	INIT_DEVICE_FUNCTION(vkInvalidateMappedMemoryRanges)
 	INIT_DEVICE_FUNCTION(vkMapMemory)
 	INIT_DEVICE_FUNCTION(vkQueueSubmit)
@@ -1872,6 +2026,13 @@ static void init_vulkan_library( void )
 	if ( vk.debugMarkers ) {
 		INIT_DEVICE_FUNCTION_EXT(vkDebugMarkerSetObjectNameEXT)
 	}
+
+	if ( vk.presentWait ) {
+		INIT_DEVICE_FUNCTION_EXT(vkWaitForPresentKHR)
+		if ( !qvkWaitForPresentKHR ) {
+			vk.presentWait = qfalse;
+		}
+	}
 }
 
 #undef INIT_INSTANCE_FUNCTION
@@ -1899,6 +2060,8 @@ static void deinit_instance_functions( void )
 	qvkGetPhysicalDeviceSurfaceFormatsKHR = NULL;
 	qvkGetPhysicalDeviceSurfacePresentModesKHR = NULL;
 	qvkGetPhysicalDeviceSurfaceSupportKHR = NULL;
+	qvkGetPhysicalDeviceFeatures2KHR = NULL;
+	qvkGetPhysicalDeviceMemoryProperties2KHR = NULL;
 #ifdef USE_VK_VALIDATION
 	qvkCreateDebugReportCallbackEXT = NULL;
 	qvkDestroyDebugReportCallbackEXT = NULL;
@@ -1925,18 +2088,23 @@ static void deinit_device_functions( void )
 	qvkCmdCopyBuffer							= NULL;
 	qvkCmdCopyBufferToImage						= NULL;
 	qvkCmdCopyImage								= NULL;
+	qvkCmdCopyImageToBuffer						= NULL;
 	qvkCmdDraw									= NULL;
 	qvkCmdDrawIndexed							= NULL;
+	qvkCmdDrawIndexedIndirect					= NULL;
 	qvkCmdEndRenderPass							= NULL;
 	qvkCmdNextSubpass							= NULL;
 	qvkCmdPipelineBarrier						= NULL;
 	qvkCmdPushConstants							= NULL;
+	qvkCmdResetQueryPool						= NULL;
 	qvkCmdSetDepthBias							= NULL;
 	qvkCmdSetScissor							= NULL;
 	qvkCmdSetViewport							= NULL;
+	qvkCmdWriteTimestamp						= NULL;
 	qvkCreateBuffer								= NULL;
 	qvkCreateCommandPool						= NULL;
 	qvkCreateDescriptorPool						= NULL;
+	qvkCreateQueryPool							= NULL;
 	qvkCreateDescriptorSetLayout				= NULL;
 	qvkCreateFence								= NULL;
 	qvkCreateFramebuffer						= NULL;
@@ -1952,6 +2120,7 @@ static void deinit_device_functions( void )
 	qvkDestroyBuffer							= NULL;
 	qvkDestroyCommandPool						= NULL;
 	qvkDestroyDescriptorPool					= NULL;
+	qvkDestroyQueryPool							= NULL;
 	qvkDestroyDescriptorSetLayout				= NULL;
 	qvkDestroyDevice							= NULL;
 	qvkDestroyFence								= NULL;
@@ -1975,6 +2144,8 @@ static void deinit_device_functions( void )
 	qvkGetDeviceQueue							= NULL;
 	qvkGetImageMemoryRequirements				= NULL;
 	qvkGetImageSubresourceLayout				= NULL;
+	qvkGetPipelineCacheData						= NULL;
+	qvkGetQueryPoolResults						= NULL;
 	qvkInvalidateMappedMemoryRanges				= NULL;
 	qvkMapMemory								= NULL;
 	qvkQueueSubmit								= NULL;
@@ -1995,6 +2166,8 @@ static void deinit_device_functions( void )
 	qvkGetImageMemoryRequirements2KHR			= NULL;
 
 	qvkDebugMarkerSetObjectNameEXT				= NULL;
+
+	qvkWaitForPresentKHR						= NULL;
 }
 
 
@@ -2259,7 +2432,7 @@ void vk_init_descriptors( void )
 	qvkUpdateDescriptorSets( vk.device, 1, &desc, 0, NULL );
 
 	// allocated and update descriptor set
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ )
+	for ( i = 0; i < vk.num_command_buffers; i++ )
 	{
 		alloc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		alloc.pNext = NULL;
@@ -2268,10 +2441,12 @@ void vk_init_descriptors( void )
 		alloc.pSetLayouts = &vk.set_layout_uniform;
 
 		VK_CHECK( qvkAllocateDescriptorSets( vk.device, &alloc, &vk.tess[i].uniform_descriptor ) );
+		VK_CHECK( qvkAllocateDescriptorSets( vk.device, &alloc, &vk.tess[i].spare_descriptor ) );
 
 		vk_update_uniform_descriptor( vk.tess[ i ].uniform_descriptor, vk.tess[ i ].vertex_buffer );
 
 		SET_OBJECT_NAME( vk.tess[ i ].uniform_descriptor, va( "uniform descriptor %i", i ), VK_DEBUG_REPORT_OBJECT_TYPE_DESCRIPTOR_SET_EXT );
+		SET_OBJECT_NAME( vk.tess[ i ].spare_descriptor, va( "spare uniform descriptor %i", i ), VK_DEBUG_REPORT_OBJECT_TYPE_DESCRIPTOR_SET_EXT );
 	}
 
 	if ( vk.color_image_view )
@@ -2300,75 +2475,272 @@ void vk_init_descriptors( void )
 }
 
 
+static void vk_destroy_geometry_buffer( VkBuffer buffer, VkDeviceMemory memory )
+{
+	qvkDestroyBuffer( vk.device, buffer, NULL );
+	qvkFreeMemory( vk.device, memory, NULL );
+}
+
+
 static void vk_release_geometry_buffers( void )
 {
+	vk_tess_t *tess;
 	int i;
 
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ ) {
-		qvkDestroyBuffer( vk.device, vk.tess[i].vertex_buffer, NULL );
-		vk.tess[i].vertex_buffer = VK_NULL_HANDLE;
+	for ( i = 0; i < vk.num_command_buffers; i++ ) {
+		tess = &vk.tess[i];
+		vk_destroy_geometry_buffer( tess->vertex_buffer, tess->vertex_buffer_memory );
+		tess->vertex_buffer = VK_NULL_HANDLE;
+		tess->vertex_buffer_memory = VK_NULL_HANDLE;
+		tess->vertex_buffer_ptr = NULL;
+		tess->vertex_buffer_size = 0;
+		if ( tess->retired.buffer != VK_NULL_HANDLE ) {
+			vk_destroy_geometry_buffer( tess->retired.buffer, tess->retired.memory );
+			tess->spare_descriptor = tess->retired.descriptor;
+			Com_Memset( &tess->retired, 0, sizeof( tess->retired ) );
+		}
+	}
+}
+
+
+/*
+=============
+vk_create_readback_buffer
+
+Host visible destination of video frames copied at the end of the frame
+=============
+*/
+static void vk_create_readback_buffer( vk_tess_t *tess, VkDeviceSize size )
+{
+	VkMemoryRequirements memory_requirements;
+	VkMemoryPropertyFlags memory_flags;
+	VkMemoryAllocateInfo alloc_info;
+	VkBufferCreateInfo desc;
+	void *data;
+
+	desc.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	desc.pNext = NULL;
+	desc.flags = 0;
+	desc.size = size;
+	desc.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	desc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	desc.queueFamilyIndexCount = 0;
+	desc.pQueueFamilyIndices = NULL;
+
+	VK_CHECK( qvkCreateBuffer( vk.device, &desc, NULL, &tess->readback_buffer ) );
+
+	qvkGetBufferMemoryRequirements( vk.device, tess->readback_buffer, &memory_requirements );
+
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.pNext = NULL;
+	alloc_info.allocationSize = memory_requirements.size;
+
+	// host_cached bit is desirable for fast reads
+	alloc_info.memoryTypeIndex = find_memory_type2( memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &memory_flags );
+	if ( alloc_info.memoryTypeIndex == ~0U ) {
+		alloc_info.memoryTypeIndex = find_memory_type2( memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memory_flags );
+		if ( alloc_info.memoryTypeIndex == ~0U ) {
+			ri.Error( ERR_FATAL, "%s(): failed to find matching memory type for video capture", __func__ );
+		}
+	}
+
+	VK_CHECK( qvkAllocateMemory( vk.device, &alloc_info, NULL, &tess->readback_memory ) );
+	VK_CHECK( qvkBindBufferMemory( vk.device, tess->readback_buffer, tess->readback_memory, 0 ) );
+	VK_CHECK( qvkMapMemory( vk.device, tess->readback_memory, 0, VK_WHOLE_SIZE, 0, &data ) );
+
+	tess->readback_ptr = (byte*)data;
+	tess->readback_size = size;
+	tess->readback_invalidate = ( memory_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) ? qfalse : qtrue;
+
+	SET_OBJECT_NAME( tess->readback_buffer, va( "readback buffer %i", (int)( tess - vk.tess ) ), VK_DEBUG_REPORT_OBJECT_TYPE_BUFFER_EXT );
+	SET_OBJECT_NAME( tess->readback_memory, va( "readback buffer memory %i", (int)( tess - vk.tess ) ), VK_DEBUG_REPORT_OBJECT_TYPE_DEVICE_MEMORY_EXT );
+}
+
+
+static void vk_release_readback_buffer( vk_tess_t *tess )
+{
+	if ( tess->readback_buffer != VK_NULL_HANDLE ) {
+		qvkDestroyBuffer( vk.device, tess->readback_buffer, NULL );
+		qvkFreeMemory( vk.device, tess->readback_memory, NULL );
 	}
 
-	qvkFreeMemory( vk.device, vk.geometry_buffer_memory, NULL );
-	vk.geometry_buffer_memory = VK_NULL_HANDLE;
+	tess->readback_buffer = VK_NULL_HANDLE;
+	tess->readback_memory = VK_NULL_HANDLE;
+	tess->readback_ptr = NULL;
+	tess->readback_size = 0;
+	tess->readback_pending = qfalse;
 }
 
 
-static void vk_create_geometry_buffers( VkDeviceSize size )
+/*
+=============
+vk_create_geometry_buffer
+
+Creates persistently mapped buffer of the frame, with r_geometryDeviceLocal
+it is placed in device-local host-visible memory (resizable BAR) if available
+=============
+*/
+static void vk_create_geometry_buffer( vk_tess_t *tess, VkDeviceSize size )
 {
 	VkMemoryRequirements vb_memory_requirements;
 	VkMemoryAllocateInfo alloc_info;
 	VkBufferCreateInfo desc;
-	VkDeviceSize vertex_buffer_offset;
-	uint32_t memory_type_bits;
 	uint32_t memory_type;
 	void *data;
-	int i;
 
 	desc.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	desc.pNext = NULL;
 	desc.flags = 0;
+	desc.size = size;
+	desc.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
 	desc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	desc.queueFamilyIndexCount = 0;
 	desc.pQueueFamilyIndices = NULL;
 
-	Com_Memset( &vb_memory_requirements, 0, sizeof( vb_memory_requirements ) );
+	VK_CHECK( qvkCreateBuffer( vk.device, &desc, NULL, &tess->vertex_buffer ) );
 
-	for ( i = 0 ; i < NUM_COMMAND_BUFFERS; i++ ) {
-		desc.size = size;
-		desc.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		VK_CHECK( qvkCreateBuffer( vk.device, &desc, NULL, &vk.tess[i].vertex_buffer ) );
+	qvkGetBufferMemoryRequirements( vk.device, tess->vertex_buffer, &vb_memory_requirements );
 
-		qvkGetBufferMemoryRequirements( vk.device, vk.tess[i].vertex_buffer, &vb_memory_requirements );
+	memory_type = ~0U;
+	if ( r_geometryDeviceLocal->integer ) {
+		memory_type = find_memory_type2( vb_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, NULL );
 	}
 
-	memory_type_bits = vb_memory_requirements.memoryTypeBits;
-	memory_type = find_memory_type( memory_type_bits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-
 	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	alloc_info.pNext = NULL;
-	alloc_info.allocationSize = vb_memory_requirements.size * NUM_COMMAND_BUFFERS;
+	alloc_info.allocationSize = vb_memory_requirements.size;
 	alloc_info.memoryTypeIndex = memory_type;
 
-	VK_CHECK( qvkAllocateMemory( vk.device, &alloc_info, NULL, &vk.geometry_buffer_memory ) );
-	VK_CHECK( qvkMapMemory( vk.device, vk.geometry_buffer_memory, 0, VK_WHOLE_SIZE, 0, &data ) );
+	if ( memory_type == ~0U || qvkAllocateMemory( vk.device, &alloc_info, NULL, &tess->vertex_buffer_memory ) != VK_SUCCESS ) {
+		// BAR heap may be small or exhausted, use system memory then
+		alloc_info.memoryTypeIndex = find_memory_type( vb_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+		VK_CHECK( qvkAllocateMemory( vk.device, &alloc_info, NULL, &tess->vertex_buffer_memory ) );
+		vk.geometry_buffer_device_local = qfalse;
+	} else {
+		vk.geometry_buffer_device_local = qtrue;
+	}
 
-	vertex_buffer_offset = 0;
+	VK_CHECK( qvkMapMemory( vk.device, tess->vertex_buffer_memory, 0, VK_WHOLE_SIZE, 0, &data ) );
+	VK_CHECK( qvkBindBufferMemory( vk.device, tess->vertex_buffer, tess->vertex_buffer_memory, 0 ) );
+
+	tess->vertex_buffer_ptr = (byte*)data;
+	tess->vertex_buffer_size = size;
+
+	SET_OBJECT_NAME( tess->vertex_buffer, va( "geometry buffer %i", (int)( tess - vk.tess ) ), VK_DEBUG_REPORT_OBJECT_TYPE_BUFFER_EXT );
+	SET_OBJECT_NAME( tess->vertex_buffer_memory, va( "geometry buffer memory %i", (int)( tess - vk.tess ) ), VK_DEBUG_REPORT_OBJECT_TYPE_DEVICE_MEMORY_EXT );
+}
+
+
+static void vk_create_geometry_buffers( VkDeviceSize size )
+{
+	int i;
 
-	for ( i = 0 ; i < NUM_COMMAND_BUFFERS; i++ ) {
-		qvkBindBufferMemory( vk.device, vk.tess[i].vertex_buffer, vk.geometry_buffer_memory, vertex_buffer_offset );
-		vk.tess[i].vertex_buffer_ptr = (byte*)data + vertex_buffer_offset;
+	for ( i = 0 ; i < vk.num_command_buffers; i++ ) {
+		vk_create_geometry_buffer( &vk.tess[i], size );
 		vk.tess[i].vertex_buffer_offset = 0;
-		vertex_buffer_offset += vb_memory_requirements.size;
+	}
+
+	vk.geometry_buffer_size = size;
+
+	Com_Memset( &vk.stats, 0, sizeof( vk.stats ) );
+}
 
-		SET_OBJECT_NAME( vk.tess[i].vertex_buffer, va( "geometry buffer %i", i ), VK_DEBUG_REPORT_OBJECT_TYPE_BUFFER_EXT );
+
+/*
+=============
+vk_grow_geometry_buffer
+
+Replaces the geometry buffer of the current frame by a larger one while
+the frame is still being recorded. Commands recorded so far keep using
+the old buffer which is released after the frame fence, data written in
+it is copied so offsets taken from either buffer stay valid.
+Other frames follow in vk_begin_frame once their previous submit is done.
+Returns qfalse if the buffer has already been replaced during this frame
+=============
+*/
+static qboolean vk_grow_geometry_buffer( VkDeviceSize size )
+{
+	vk_tess_t *tess = vk.cmd;
+	const byte *data = tess->vertex_buffer_ptr;
+
+	if ( tess->retired.buffer != VK_NULL_HANDLE || tess->spare_descriptor == VK_NULL_HANDLE ) {
+		return qfalse;
 	}
 
-	SET_OBJECT_NAME( vk.geometry_buffer_memory, "geometry buffer memory", VK_DEBUG_REPORT_OBJECT_TYPE_BUFFER_EXT );
+	tess->retired.buffer = tess->vertex_buffer;
+	tess->retired.memory = tess->vertex_buffer_memory;
+	tess->retired.descriptor = tess->uniform_descriptor;
 
-	vk.geometry_buffer_size = vb_memory_requirements.size;
+	vk_create_geometry_buffer( tess, size );
 
-	Com_Memset( &vk.stats, 0, sizeof( vk.stats ) );
+	Com_Memcpy( tess->vertex_buffer_ptr, data, tess->vertex_buffer_offset );
+
+	tess->uniform_descriptor = tess->spare_descriptor;
+	tess->spare_descriptor = VK_NULL_HANDLE;
+	vk_update_uniform_descriptor( tess->uniform_descriptor, tess->vertex_buffer );
+
+	if ( vk.geometry_buffer_size < size ) {
+		vk.geometry_buffer_size = size;
+	}
+
+	vk.stats.geometry_grows++;
+
+	ri.Printf( PRINT_DEVELOPER, "...geometry buffer %i grown to %iK\n", (int)( tess - vk.tess ), (int)( size / 1024 ) );
+
+	return qtrue;
+}
+
+
+/*
+=============
+vk_reserve_geometry
+
+Makes sure that first size bytes of the current geometry buffer can be written,
+schedules a resize with frame drop only if it can't be grown in place
+=============
+*/
+qboolean vk_reserve_geometry( VkDeviceSize size )
+{
+	if ( size <= vk.cmd->vertex_buffer_size ) {
+		return qtrue;
+	}
+
+	if ( vk.geometry_buffer_size_new == 0 && vk_grow_geometry_buffer( log2pad( size, 1 ) ) ) {
+		return qtrue;
+	}
+
+	// schedule geometry buffer resize
+	if ( vk.geometry_buffer_size_new < log2pad( size, 1 ) ) {
+		vk.geometry_buffer_size_new = log2pad( size, 1 );
+	}
+
+	return qfalse;
+}
+
+
+/*
+=============
+vk_update_geometry_buffer
+
+Called once the previous submit of the current frame has finished
+=============
+*/
+static void vk_update_geometry_buffer( void )
+{
+	vk_tess_t *tess = vk.cmd;
+
+	if ( tess->retired.buffer != VK_NULL_HANDLE ) {
+		vk_destroy_geometry_buffer( tess->retired.buffer, tess->retired.memory );
+		tess->spare_descriptor = tess->retired.descriptor;
+		Com_Memset( &tess->retired, 0, sizeof( tess->retired ) );
+	}
+
+	if ( tess->vertex_buffer_size < vk.geometry_buffer_size ) {
+		// catch up with the frame that has grown, nothing references old buffer now
+		vk_destroy_geometry_buffer( tess->vertex_buffer, tess->vertex_buffer_memory );
+		vk_create_geometry_buffer( tess, vk.geometry_buffer_size );
+		vk_update_uniform_descriptor( tess->uniform_descriptor, tess->vertex_buffer );
+	}
 }
 
 
@@ -3295,8 +3667,8 @@ static void vk_create_attachments( void )
 				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &vk.msaa_image, &vk.msaa_image_view, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, qtrue );
 		}
 
-		if ( r_ext_supersample->integer ) {
-			// capture buffer
+		if ( r_ext_supersample->integer || vk.dynamicResolution ) {
+			// capture buffer, color image may hold only a part of the frame with dynamic resolution
 			usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 			create_color_attachment( gls.captureWidth, gls.captureHeight, VK_SAMPLE_COUNT_1_BIT, vk.capture_format,
 				usage, &vk.capture.image, &vk.capture.image_view, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, qfalse );
@@ -3475,7 +3847,7 @@ static void vk_create_sync_primitives( void ) {
 	desc.flags = 0;
 
 	// all commands submitted
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ )
+	for ( i = 0; i < vk.num_command_buffers; i++ )
 	{
 		desc.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 		desc.pNext = NULL;
@@ -3503,7 +3875,7 @@ static void vk_create_sync_primitives( void ) {
 static void vk_destroy_sync_primitives( void  ) {
 	uint32_t i;
 
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ ) {
+	for ( i = 0; i < vk.num_command_buffers; i++ ) {
 		qvkDestroySemaphore( vk.device, vk.tess[i].image_acquired, NULL );
 		qvkDestroySemaphore( vk.device, vk.tess[i].rendering_finished, NULL );
 		qvkDestroyFence( vk.device, vk.tess[i].rendering_finished_fence, NULL );
@@ -3576,7 +3948,7 @@ static void vk_restart_swapchain( const char *funcname )
 
 	vk_wait_idle();
 
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ ) {
+	for ( i = 0; i < vk.num_command_buffers; i++ ) {
 		qvkResetCommandBuffer( vk.tess[i].command_buffer, 0 );
 	}
 
@@ -3644,6 +4016,181 @@ static void vk_set_render_scale( void )
 }
 
 
+/*
+==================
+Pipeline cache
+
+Saved in the home path so pipelines don't need to be compiled cold on
+each start and vid_restart. Our header keys the data by device and
+driver version because some drivers misbehave on foreign cache data
+==================
+*/
+#define PIPELINE_CACHE_IDENT	(('C'<<24)+('P'<<16)+('K'<<8)+'V')
+#define PIPELINE_CACHE_VERSION	1
+
+typedef struct {
+	uint32_t	ident;
+	uint32_t	version;
+	uint32_t	vendorID;
+	uint32_t	deviceID;
+	uint32_t	driverVersion;
+	uint8_t		uuid[ VK_UUID_SIZE ];
+	uint32_t	dataSize;
+} pipelineCacheHeader_t;
+
+static pipelineCacheHeader_t pipelineCacheKey;
+static size_t pipelineCacheLoadedSize;
+
+
+static const char *vk_pipeline_cache_name( void )
+{
+	return va( "cache/vk-%04x-%04x.vkc", pipelineCacheKey.vendorID, pipelineCacheKey.deviceID );
+}
+
+
+static void vk_create_pipeline_cache( const VkPhysicalDeviceProperties *props )
+{
+	VkPipelineCacheCreateInfo ci;
+	const pipelineCacheHeader_t *header;
+	void *buf;
+	int len;
+
+	Com_Memset( &pipelineCacheKey, 0, sizeof( pipelineCacheKey ) );
+	pipelineCacheKey.ident = PIPELINE_CACHE_IDENT;
+	pipelineCacheKey.version = PIPELINE_CACHE_VERSION;
+	pipelineCacheKey.vendorID = props->vendorID;
+	pipelineCacheKey.deviceID = props->deviceID;
+	pipelineCacheKey.driverVersion = props->driverVersion;
+	Com_Memcpy( pipelineCacheKey.uuid, props->pipelineCacheUUID, VK_UUID_SIZE );
+
+	Com_Memset( &ci, 0, sizeof( ci ) );
+	ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	pipelineCacheLoadedSize = 0;
+	buf = NULL;
+
+	if ( r_pipelineCache->integer ) {
+		len = ri.FS_ReadFile( vk_pipeline_cache_name(), &buf );
+		if ( buf ) {
+			header = (const pipelineCacheHeader_t *) buf;
+			if ( len >= (int)sizeof( *header ) && header->dataSize == len - sizeof( *header )
+				&& memcmp( header, &pipelineCacheKey, offsetof( pipelineCacheHeader_t, dataSize ) ) == 0 ) {
+				ci.initialDataSize = header->dataSize;
+				ci.pInitialData = header + 1;
+				pipelineCacheLoadedSize = header->dataSize;
+			} else {
+				ri.Printf( PRINT_DEVELOPER, "...discarding outdated pipeline cache\n" );
+			}
+		}
+	}
+
+	if ( qvkCreatePipelineCache( vk.device, &ci, NULL, &vk.pipelineCache ) != VK_SUCCESS ) {
+		// should not happen with validated data, but start empty anyway
+		ci.initialDataSize = 0;
+		ci.pInitialData = NULL;
+		pipelineCacheLoadedSize = 0;
+		VK_CHECK( qvkCreatePipelineCache( vk.device, &ci, NULL, &vk.pipelineCache ) );
+	}
+
+	if ( buf ) {
+		ri.FS_FreeFile( buf );
+	}
+
+	if ( pipelineCacheLoadedSize ) {
+		ri.Printf( PRINT_ALL, "...loaded %i bytes of pipeline cache\n", (int)pipelineCacheLoadedSize );
+	}
+}
+
+
+static void vk_save_pipeline_cache( void )
+{
+	pipelineCacheHeader_t *header;
+	size_t size;
+	byte *buf;
+
+	if ( !r_pipelineCache->integer || !qvkGetPipelineCacheData ) {
+		return;
+	}
+
+	if ( qvkGetPipelineCacheData( vk.device, vk.pipelineCache, &size, NULL ) != VK_SUCCESS || size == 0 ) {
+		return;
+	}
+
+	// nothing new was compiled
+	if ( size == pipelineCacheLoadedSize ) {
+		return;
+	}
+
+	buf = ri.Malloc( sizeof( *header ) + size );
+	if ( qvkGetPipelineCacheData( vk.device, vk.pipelineCache, &size, buf + sizeof( *header ) ) == VK_SUCCESS ) {
+		header = (pipelineCacheHeader_t *) buf;
+		*header = pipelineCacheKey;
+		header->dataSize = (uint32_t)size;
+		ri.FS_WriteFile( vk_pipeline_cache_name(), buf, sizeof( *header ) + size );
+		pipelineCacheLoadedSize = size;
+	}
+	ri.Free( buf );
+}
+
+
+/*
+=============
+vk_select_samples
+
+Sample count of the main color and depth attachments from r_ext_multisample
+=============
+*/
+static void vk_select_samples( void )
+{
+	vk.msaaActive = ( vk.fboActive && r_ext_multisample->integer ) ? qtrue : qfalse;
+
+	if ( /*vk.fboActive &&*/ vk.msaaActive ) {
+		VkSampleCountFlags mask = vkMaxSamples;
+		vkSamples = MAX( log2pad( r_ext_multisample->integer, 1 ), VK_SAMPLE_COUNT_2_BIT );
+		while ( vkSamples > mask )
+				vkSamples >>= 1;
+		ri.Printf( PRINT_ALL, "...using %ix MSAA\n", vkSamples );
+	} else {
+		vkSamples = VK_SAMPLE_COUNT_1_BIT;
+	}
+}
+
+
+/*
+=============
+vk_restart_attachments
+
+Rebuilds swapchain, attachments, render passes and post-processing pipelines
+for changed r_fbo dependent settings, other pipelines are recreated from their
+definitions on first use so uploaded images and buffers stay as they are
+=============
+*/
+void vk_restart_attachments( void )
+{
+	VkDescriptorSetAllocateInfo alloc;
+	uint32_t i;
+
+	// async compiles must not see the sample count change
+	vk_wait_pipelines();
+
+	vk_select_samples();
+
+	// bloom descriptors are only allocated when it was enabled at startup
+	if ( vk.color_image_view && r_bloom->integer && vk.bloom_image_descriptor[0] == VK_NULL_HANDLE ) {
+		alloc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc.pNext = NULL;
+		alloc.descriptorPool = vk.descriptor_pool;
+		alloc.descriptorSetCount = 1;
+		alloc.pSetLayouts = &vk.set_layout_sampler;
+		for ( i = 0; i < ARRAY_LEN( vk.bloom_image_descriptor ); i++ ) {
+			VK_CHECK( qvkAllocateDescriptorSets( vk.device, &alloc, &vk.bloom_image_descriptor[i] ) );
+		}
+	}
+
+	vk_restart_swapchain( __func__ );
+}
+
+
 void vk_initialize( void )
 {
 	char buf[64], driver_version[64];
@@ -3669,6 +4216,7 @@ void vk_initialize( void )
 	vk.storage_alignment = MAX( props.limits.minStorageBufferOffsetAlignment, sizeof( uint32_t ) );
 
 	vk.maxAnisotropy = props.limits.maxSamplerAnisotropy;
+	vk.maxDrawIndirectCount = props.limits.maxDrawIndirectCount;
 
 	vk.blitFilter = GL_NEAREST;
 	vk.windowAdjusted = qfalse;
@@ -3676,28 +4224,22 @@ void vk_initialize( void )
 
 	vk_set_render_scale();
 
-	if ( r_fbo->integer ) {
-		vk.fboActive = qtrue;
-		if ( r_ext_multisample->integer ) {
-			vk.msaaActive = qtrue;
-		}
+	vk.fboActive = r_fbo->integer ? qtrue : qfalse;
+
+	vk.timestampPeriod = props.limits.timestampComputeAndGraphics ? props.limits.timestampPeriod : 0.0f;
+	vk.dynamicScale = 1.0f;
+	vk.gpuFrameTime = 0.0f;
+	if ( vk.fboActive && r_dynamicResolution->integer && props.limits.timestampComputeAndGraphics ) {
+		vk.dynamicResolution = qtrue;
 	} else {
-		vk.fboActive = qfalse;
+		vk.dynamicResolution = qfalse;
 	}
 
 	// multisampling
 
 	vkMaxSamples = MIN( props.limits.sampledImageColorSampleCounts, props.limits.sampledImageDepthSampleCounts );
 
-	if ( /*vk.fboActive &&*/ vk.msaaActive ) {
-		VkSampleCountFlags mask = vkMaxSamples;
-		vkSamples = MAX( log2pad( r_ext_multisample->integer, 1 ), VK_SAMPLE_COUNT_2_BIT );
-		while ( vkSamples > mask )
-				vkSamples >>= 1;
-		ri.Printf( PRINT_ALL, "...using %ix MSAA\n", vkSamples );
-	} else {
-		vkSamples = VK_SAMPLE_COUNT_1_BIT;
-	}
+	vk_select_samples();
 
 	vk.screenMapSamples = MIN( vkMaxSamples, VK_SAMPLE_COUNT_4_BIT );
 
@@ -3722,6 +4264,9 @@ void vk_initialize( void )
 	// default chunk size, may be doubled on demand
 	vk.image_chunk_size = IMAGE_CHUNK_SIZE;
 
+	// sizes every per-frame ring: command buffers, semaphores, geometry buffers and uniform descriptors
+	vk.num_command_buffers = r_framesInFlight->integer;
+
 	vk.maxLod = 1 + Q_log2( glConfig.maxTextureSize );
 
 	if ( props.limits.maxPerStageDescriptorSamplers != 0xFFFFFFFF )
@@ -3819,7 +4364,7 @@ void vk_initialize( void )
 	//
 	// Command buffers and color attachments.
 	//
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ )
+	for ( i = 0; i < vk.num_command_buffers; i++ )
 	{
 		VkCommandBufferAllocateInfo alloc_info;
 
@@ -3846,10 +4391,10 @@ void vk_initialize( void )
 		pool_size[0].descriptorCount = MAX_DRAWIMAGES + 1 + 1 + 1 + VK_NUM_BLOOM_PASSES * 2; // color, screenmap, bloom descriptors
 
 		pool_size[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		pool_size[1].descriptorCount = NUM_COMMAND_BUFFERS;
+		pool_size[1].descriptorCount = vk.num_command_buffers * 2; // current and spare of each geometry buffer
 
 		//pool_size[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-		//pool_size[2].descriptorCount = NUM_COMMAND_BUFFERS;
+		//pool_size[2].descriptorCount = vk.num_command_buffers;
 
 		pool_size[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 		pool_size[2].descriptorCount = 1;
@@ -3868,6 +4413,26 @@ void vk_initialize( void )
 		VK_CHECK( qvkCreateDescriptorPool( vk.device, &desc, NULL, &vk.descriptor_pool ) );
 	}
 
+	//
+	// Timestamp queries for dynamic resolution and per-pass GPU timers.
+	//
+	if ( vk.timestampPeriod > 0.0f )
+	{
+		VkQueryPoolCreateInfo desc;
+
+		desc.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		desc.pNext = NULL;
+		desc.flags = 0;
+		desc.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		desc.queryCount = vk.num_command_buffers * MAX_GPU_TIMESTAMPS;
+		desc.pipelineStatistics = 0;
+
+		VK_CHECK( qvkCreateQueryPool( vk.device, &desc, NULL, &vk.timestampPool ) );
+
+		if ( vk.dynamicResolution )
+			ri.Printf( PRINT_ALL, "...using dynamic resolution\n" );
+	}
+
 	//
 	// Descriptor set layout.
 	//
@@ -3951,16 +4516,13 @@ void vk_initialize( void )
 	vk_create_geometry_buffers( vk.geometry_buffer_size_new );
 	vk.geometry_buffer_size_new = 0;
 
-	vk_create_storage_buffer( MAX_FLARES * vk.storage_alignment );
+	vk_create_storage_buffer( MAX_FLARES * vk.num_command_buffers * vk.storage_alignment );
 
 	vk_create_shader_modules();
 
-	{
-		VkPipelineCacheCreateInfo ci;
-		Com_Memset( &ci, 0, sizeof( ci ) );
-		ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-		VK_CHECK( qvkCreatePipelineCache( vk.device, &ci, NULL, &vk.pipelineCache ) );
-	}
+	vk_create_pipeline_cache( &props );
+
+	vk_start_pipeline_worker();
 
 	vk.renderPassIndex = RENDER_PASS_MAIN; // default render pass
 
@@ -4105,6 +4667,8 @@ static void vk_destroy_pipelines( qboolean resetCounter )
 {
 	uint32_t i, j;
 
+	vk_wait_pipelines();
+
 	for ( i = 0; i < vk.pipelines_count; i++ ) {
 		for ( j = 0; j < RENDER_PASS_COUNT; j++ ) {
 			if ( vk.pipelines[i].handle[j] != VK_NULL_HANDLE ) {
@@ -4153,10 +4717,14 @@ void vk_shutdown( refShutdownCode_t code )
 {
 	int i, j, k, l;
 
+	vk_stop_pipeline_worker();
+
 	if ( qvkQueuePresentKHR == NULL ) { // not fully initialized
 		goto __cleanup;
 	}
 
+	vk_flush_uploads();
+
 	vk_destroy_framebuffers();
 
 	vk_destroy_pipelines( qtrue ); // reset counter
@@ -4168,6 +4736,7 @@ void vk_shutdown( refShutdownCode_t code )
 	vk_destroy_swapchain();
 
 	if ( vk.pipelineCache != VK_NULL_HANDLE ) {
+		vk_save_pipeline_cache();
 		qvkDestroyPipelineCache( vk.device, vk.pipelineCache, NULL );
 		vk.pipelineCache = VK_NULL_HANDLE;
 	}
@@ -4176,6 +4745,11 @@ void vk_shutdown( refShutdownCode_t code )
 
 	qvkDestroyDescriptorPool(vk.device, vk.descriptor_pool, NULL);
 
+	if ( vk.timestampPool != VK_NULL_HANDLE ) {
+		qvkDestroyQueryPool( vk.device, vk.timestampPool, NULL );
+		vk.timestampPool = VK_NULL_HANDLE;
+	}
+
 	qvkDestroyDescriptorSetLayout(vk.device, vk.set_layout_sampler, NULL);
 	qvkDestroyDescriptorSetLayout(vk.device, vk.set_layout_uniform, NULL);
 	qvkDestroyDescriptorSetLayout(vk.device, vk.set_layout_storage, NULL);
@@ -4191,6 +4765,10 @@ void vk_shutdown( refShutdownCode_t code )
 
 	vk_release_geometry_buffers();
 
+	for ( i = 0; i < vk.num_command_buffers; i++ ) {
+		vk_release_readback_buffer( &vk.tess[i] );
+	}
+
 	vk_destroy_sync_primitives();
 
 	qvkDestroyBuffer( vk.device, vk.storage.buffer, NULL );
@@ -4301,9 +4879,89 @@ void vk_wait_idle( void )
 }
 
 
+/*
+=============
+vk_memory_info
+
+Prints device memory heaps with their budgets and how renderer allocations use them
+=============
+*/
+void vk_memory_info( void )
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget;
+	VkPhysicalDeviceMemoryProperties2KHR props2;
+	const VkPhysicalDeviceMemoryProperties *props;
+	VkDeviceSize type_size[ VK_MAX_MEMORY_TYPES ];
+	VkDeviceSize type_used[ VK_MAX_MEMORY_TYPES ];
+	int type_chunks[ VK_MAX_MEMORY_TYPES ];
+	int type_images[ VK_MAX_MEMORY_TYPES ];
+	VkMemoryRequirements reqs;
+	const ImageChunk *chunk;
+	uint32_t i;
+
+	Com_Memset( &budget, 0, sizeof( budget ) );
+	budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	Com_Memset( &props2, 0, sizeof( props2 ) );
+	props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+	props2.pNext = vk.memoryBudget ? &budget : NULL;
+
+	if ( qvkGetPhysicalDeviceMemoryProperties2KHR ) {
+		qvkGetPhysicalDeviceMemoryProperties2KHR( vk.physical_device, &props2 );
+	} else {
+		qvkGetPhysicalDeviceMemoryProperties( vk.physical_device, &props2.memoryProperties );
+	}
+	props = &props2.memoryProperties;
+
+	for ( i = 0; i < props->memoryHeapCount; i++ ) {
+		if ( vk.memoryBudget ) {
+			ri.Printf( PRINT_ALL, "heap %i: %5iM%s, budget %5iM, used %5iM\n", i,
+				(int)( props->memoryHeaps[i].size >> 20 ),
+				( props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ) ? " device-local" : "",
+				(int)( budget.heapBudget[i] >> 20 ), (int)( budget.heapUsage[i] >> 20 ) );
+		} else {
+			ri.Printf( PRINT_ALL, "heap %i: %5iM%s\n", i,
+				(int)( props->memoryHeaps[i].size >> 20 ),
+				( props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ) ? " device-local" : "" );
+		}
+	}
+
+	Com_Memset( type_size, 0, sizeof( type_size ) );
+	Com_Memset( type_used, 0, sizeof( type_used ) );
+	Com_Memset( type_chunks, 0, sizeof( type_chunks ) );
+	Com_Memset( type_images, 0, sizeof( type_images ) );
+
+	for ( i = 0, chunk = vk_world.image_chunks; i < vk_world.num_image_chunks; i++, chunk++ ) {
+		type_size[ chunk->memory_type ] += chunk->size;
+		type_used[ chunk->memory_type ] += chunk->used;
+		type_chunks[ chunk->memory_type ]++;
+		type_images[ chunk->memory_type ] += chunk->images;
+	}
+
+	for ( i = 0; i < props->memoryTypeCount; i++ ) {
+		if ( type_chunks[i] ) {
+			ri.Printf( PRINT_ALL, "images: %i in %i chunks of type %i (heap %i), %iK allocated, %iK used\n",
+				type_images[i], type_chunks[i], i, props->memoryTypes[i].heapIndex,
+				(int)( type_size[i] >> 10 ), (int)( type_used[i] >> 10 ) );
+		}
+	}
+
+	ri.Printf( PRINT_ALL, "geometry buffers: %i x %iK%s\n", vk.num_command_buffers, (int)( vk.geometry_buffer_size >> 10 ),
+		vk.geometry_buffer_device_local ? " device-local" : "" );
+
+	if ( vk.vbo.vertex_buffer != VK_NULL_HANDLE ) {
+		qvkGetBufferMemoryRequirements( vk.device, vk.vbo.vertex_buffer, &reqs );
+		ri.Printf( PRINT_ALL, "static VBO: %iK\n", (int)( reqs.size >> 10 ) );
+	}
+
+	ri.Printf( PRINT_ALL, "staging buffer: %iK\n", (int)( vk_world.staging_buffer_size >> 10 ) );
+}
+
+
 void vk_release_resources( void ) {
 	int i, j;
 
+	vk_flush_uploads();
 	vk_wait_idle();
 
 	for (i = 0; i < vk_world.num_image_chunks; i++)
@@ -4318,6 +4976,8 @@ void vk_release_resources( void ) {
 	for (i = 0; i < vk_world.num_samplers; i++)
 		qvkDestroySampler(vk.device, vk_world.samplers[i], NULL);
 
+	vk_wait_pipelines();
+
 	for ( i = vk.pipelines_world_base; i < vk.pipelines_count; i++ ) {
 		for ( j = 0; j < RENDER_PASS_COUNT; j++ ) {
 			if ( vk.pipelines[i].handle[j] != VK_NULL_HANDLE ) {
@@ -4345,7 +5005,7 @@ void vk_release_resources( void ) {
 	Com_Memset( &vk_world, 0, sizeof( vk_world ) );
 
 	// Reset geometry buffers offsets
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ ) {
+	for ( i = 0; i < vk.num_command_buffers; i++ ) {
 		vk.tess[i].uniform_read_offset = 0;
 		vk.tess[i].vertex_buffer_offset = 0;
 	}
@@ -4381,6 +5041,7 @@ void vk_create_image( image_t *image, int width, int height, int mip_levels ) {
 	VkFormat format = image->internalFormat;
 
 	if ( image->handle ) {
+		vk_flush_uploads();
 		qvkDestroyImage( vk.device, image->handle, NULL );
 		image->handle = VK_NULL_HANDLE;
 	}
@@ -4407,6 +5068,10 @@ void vk_create_image( image_t *image, int width, int height, int mip_levels ) {
 		desc.samples = VK_SAMPLE_COUNT_1_BIT;
 		desc.tiling = VK_IMAGE_TILING_OPTIMAL;
 		desc.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if ( mip_levels > 1 ) {
+			// source of vk_upload_image_mipmaps() blits
+			desc.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
 		desc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		desc.queueFamilyIndexCount = 0;
 		desc.pQueueFamilyIndices = NULL;
@@ -4528,13 +5193,117 @@ static byte *resample_image_data( const int target_format, byte *data, const int
 }
 
 
+/*
+Copies data into the staging buffer and returns the command buffer
+of pending uploads to record its transfer into
+*/
+static VkCommandBuffer stage_upload_data( const byte *data, int size, qboolean batch, VkDeviceSize *data_offset )
+{
+	VkCommandBuffer command_buffer;
+	VkDeviceSize offset;
+
+	offset = PAD( vk_world.staging_offset, 16 );
+	if ( !batch || offset + size > vk_world.staging_buffer_size ) {
+		vk_flush_uploads();
+		offset = 0;
+	}
+
+	ensure_staging_buffer_allocation( size );
+	Com_Memcpy( vk_world.staging_buffer_ptr + offset, data, size );
+
+	command_buffer = vk_world.upload_command_buffer;
+	if ( command_buffer == VK_NULL_HANDLE ) {
+		command_buffer = allocate_command_buffer();
+		// executed on submission, i.e. after all host writes of the batch
+		record_buffer_memory_barrier( command_buffer, vk_world.staging_buffer, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT );
+		vk_world.upload_command_buffer = command_buffer;
+	}
+	vk_world.staging_offset = offset + size;
+
+	*data_offset = offset;
+
+	return command_buffer;
+}
+
+
+/*
+Uploads the base level of a new RGBA8 image and fills
+the rest of its mip chain with linear filtered blits
+*/
+void vk_upload_image_mipmaps( image_t *image, int width, int height, int mipmaps, byte *pixels ) {
+
+	VkCommandBuffer command_buffer;
+	VkBufferImageCopy region;
+	VkImageBlit blit;
+	VkDeviceSize offset;
+	qboolean batch;
+	int i, w, h;
+
+	batch = ( vk.frame_count == 0 ) ? qtrue : qfalse;
+
+	command_buffer = stage_upload_data( pixels, width * height * 4, batch, &offset );
+
+	Com_Memset( &region, 0, sizeof( region ) );
+	region.bufferOffset = offset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent.width = width;
+	region.imageExtent.height = height;
+	region.imageExtent.depth = 1;
+
+	record_image_layout_transition( command_buffer, image->handle, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+	qvkCmdCopyBufferToImage( command_buffer, vk_world.staging_buffer, image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+
+	Com_Memset( &blit, 0, sizeof( blit ) );
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount = 1;
+	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.layerCount = 1;
+	blit.srcOffsets[1].z = 1;
+	blit.dstOffsets[1].z = 1;
+
+	w = width;
+	h = height;
+	for ( i = 1; i < mipmaps; i++ ) {
+		record_image_levels_transition( command_buffer, image->handle, VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL );
+
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcOffsets[1].x = w;
+		blit.srcOffsets[1].y = h;
+
+		w = MAX( w >> 1, 1 );
+		h = MAX( h >> 1, 1 );
+
+		blit.dstSubresource.mipLevel = i;
+		blit.dstOffsets[1].x = w;
+		blit.dstOffsets[1].y = h;
+
+		qvkCmdBlitImage( command_buffer, image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR );
+	}
+
+	if ( mipmaps > 1 ) {
+		record_image_levels_transition( command_buffer, image->handle, VK_IMAGE_ASPECT_COLOR_BIT, 0, mipmaps - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+	}
+	record_image_levels_transition( command_buffer, image->handle, VK_IMAGE_ASPECT_COLOR_BIT, mipmaps - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+
+	if ( !batch ) {
+		vk_flush_uploads();
+	}
+}
+
+
 void vk_upload_image_data( image_t *image, int x, int y, int width, int height, int mipmaps, byte *pixels, int size, qboolean update ) {
 
 	VkCommandBuffer command_buffer;
 	VkBufferImageCopy regions[16];
 	VkBufferImageCopy region;
+	VkDeviceSize offset;
+	qboolean batch;
 	byte *buf;
 	int bpp;
+	int i;
 
 	int num_regions = 0;
 	int buffer_size = 0;
@@ -4560,7 +5329,12 @@ void vk_upload_image_data( image_t *image, int x, int y, int width, int height,
 		regions[num_regions] = region;
 		num_regions++;
 
-		buffer_size += width * height * bpp;
+		if ( image->internalFormat == VK_FORMAT_BC1_RGB_UNORM_BLOCK )
+			buffer_size += ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * 8;
+		else if ( image->internalFormat == VK_FORMAT_BC3_UNORM_BLOCK )
+			buffer_size += ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * 16;
+		else
+			buffer_size += width * height * bpp;
 
 		if ( num_regions >= mipmaps || (width == 1 && height == 1) || num_regions >= ARRAY_LEN( regions ) )
 			break;
@@ -4575,12 +5349,14 @@ void vk_upload_image_data( image_t *image, int x, int y, int width, int height,
 		if (height < 1) height = 1;
 	}
 
-	ensure_staging_buffer_allocation(buffer_size);
-	Com_Memcpy( vk_world.staging_buffer_ptr, buf, buffer_size );
+	// images updated while a frame is recorded may be in use by it
+	batch = ( vk.frame_count == 0 ) ? qtrue : qfalse;
 
-	command_buffer = begin_command_buffer();
+	command_buffer = stage_upload_data( buf, buffer_size, batch, &offset );
 
-	record_buffer_memory_barrier( command_buffer, vk_world.staging_buffer, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT );
+	for ( i = 0; i < num_regions; i++ ) {
+		regions[i].bufferOffset += offset;
+	}
 	
 	if ( update ) {
 		record_image_layout_transition( command_buffer, image->handle, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
@@ -4590,7 +5366,9 @@ void vk_upload_image_data( image_t *image, int x, int y, int width, int height,
 	qvkCmdCopyBufferToImage( command_buffer, vk_world.staging_buffer, image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, num_regions, regions );
 	record_image_layout_transition( command_buffer, image->handle, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
 
-	end_command_buffer( command_buffer );
+	if ( !batch ) {
+		vk_flush_uploads();
+	}
 
 	if ( buf != pixels ) {
 		ri.Hunk_FreeTempMemory( buf );
@@ -4638,6 +5416,8 @@ void vk_update_descriptor_set( image_t *image, qboolean mipmap ) {
 
 void vk_destroy_image_resources( VkImage *image, VkImageView *imageView )
 {
+	vk_flush_uploads();
+
 	if ( image != NULL ) {
 		if ( *image != VK_NULL_HANDLE ) {
 			qvkDestroyImage( vk.device, *image, NULL );
@@ -4694,6 +5474,45 @@ static qboolean vk_surface_format_color_depth( VkFormat format, int *r, int *g,
 }
 
 
+static void get_post_process_viewport( int program_index, uint32_t width, uint32_t height, float scale, VkViewport *viewport, VkRect2D *scissor )
+{
+	if ( program_index == 0 ) {
+		// gamma correction
+		viewport->x = 0.0 + vk.blitX0;
+		viewport->y = 0.0 + vk.blitY0;
+		viewport->width = gls.windowWidth - vk.blitX0 * 2;
+		viewport->height = gls.windowHeight - vk.blitY0 * 2;
+	} else {
+		// other post-processing
+		viewport->x = 0.0;
+		viewport->y = 0.0;
+		viewport->width = width;
+		viewport->height = height;
+	}
+
+	viewport->minDepth = 0.0;
+	viewport->maxDepth = 1.0;
+
+	scissor->offset.x = viewport->x;
+	scissor->offset.y = viewport->y;
+	scissor->extent.width = viewport->width;
+	scissor->extent.height = viewport->height;
+
+	if ( scale != 1.0f ) {
+		if ( program_index == 2 ) {
+			// bloom blending into the color image
+			viewport->width *= scale;
+			viewport->height *= scale;
+			scissor->extent.width = viewport->width;
+			scissor->extent.height = viewport->height;
+		} else {
+			viewport->width /= scale;
+			viewport->height /= scale;
+		}
+	}
+}
+
+
 void vk_create_post_process_pipeline( int program_index, uint32_t width, uint32_t height )
 {
 	VkPipelineShaderStageCreateInfo shader_stages[2];
@@ -4706,6 +5525,8 @@ void vk_create_post_process_pipeline( int program_index, uint32_t width, uint32_
 	VkPipelineColorBlendStateCreateInfo blend_state;
 	VkPipelineColorBlendAttachmentState attachment_blend_state;
 	VkGraphicsPipelineCreateInfo create_info;
+	VkPipelineDynamicStateCreateInfo dynamic_state;
+	VkDynamicState dynamic_state_array[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 	VkViewport viewport;
 	VkRect2D scissor;
 	VkSpecializationMapEntry spec_entries[11];
@@ -4864,27 +5685,7 @@ void vk_create_post_process_pipeline( int program_index, uint32_t width, uint32_
 	//
 	// Viewport.
 	//
-	if ( program_index == 0 ) {
-		// gamma correction
-		viewport.x = 0.0 + vk.blitX0;
-		viewport.y = 0.0 + vk.blitY0;
-		viewport.width = gls.windowWidth - vk.blitX0 * 2;
-		viewport.height = gls.windowHeight - vk.blitY0 * 2;
-	} else {
-		// other post-processing
-		viewport.x = 0.0;
-		viewport.y = 0.0;
-		viewport.width = width;
-		viewport.height = height;
-	}
-
-	viewport.minDepth = 0.0;
-	viewport.maxDepth = 1.0;
-
-	scissor.offset.x = viewport.x;
-	scissor.offset.y = viewport.y;
-	scissor.extent.width = viewport.width;
-	scissor.extent.height = viewport.height;
+	get_post_process_viewport( program_index, width, height, 1.0f, &viewport, &scissor );
 
 	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewport_state.pNext = NULL;
@@ -4971,19 +5772,57 @@ void vk_create_post_process_pipeline( int program_index, uint32_t width, uint32_
 	create_info.pDepthStencilState = (program_index == 2) ? &depth_stencil_state : NULL;
 	create_info.pDepthStencilState = &depth_stencil_state;
 	create_info.pColorBlendState = &blend_state;
-	create_info.pDynamicState = NULL;
+	create_info.pDynamicState = vk.dynamicResolution ? &dynamic_state : NULL;
 	create_info.layout = layout;
 	create_info.renderPass = renderpass;
 	create_info.subpass = 0;
 	create_info.basePipelineHandle = VK_NULL_HANDLE;
 	create_info.basePipelineIndex = -1;
 
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.pNext = NULL;
+	dynamic_state.flags = 0;
+	dynamic_state.dynamicStateCount = ARRAY_LEN( dynamic_state_array );
+	dynamic_state.pDynamicStates = dynamic_state_array;
+
 	VK_CHECK( qvkCreateGraphicsPipelines( vk.device, VK_NULL_HANDLE, 1, &create_info, NULL, pipeline ) );
 
 	SET_OBJECT_NAME( *pipeline, pipeline_name, VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_EXT );
 }
 
 
+/*
+=============
+vk_set_post_process_viewport
+
+With dynamic resolution the frame occupies dynamicScale of the color image,
+passes that read it stretch their viewport beyond the scissor so that only
+that part is sampled, bloom blending shrinks it to the same part
+=============
+*/
+static void vk_set_post_process_viewport( int program_index )
+{
+	VkViewport viewport;
+	VkRect2D scissor;
+	uint32_t width, height;
+
+	if ( !vk.dynamicResolution )
+		return;
+
+	switch ( program_index ) {
+		case 2: width = glConfig.vidWidth; height = glConfig.vidHeight; break;
+		case 1:
+		case 3: width = gls.captureWidth; height = gls.captureHeight; break;
+		default: width = height = 0; break;
+	}
+
+	get_post_process_viewport( program_index, width, height, vk.dynamicScale, &viewport, &scissor );
+
+	qvkCmdSetViewport( vk.cmd->command_buffer, 0, 1, &viewport );
+	qvkCmdSetScissor( vk.cmd->command_buffer, 0, 1, &scissor );
+}
+
+
 void vk_create_blur_pipeline( uint32_t index, uint32_t width, uint32_t height, qboolean horizontal_pass )
 {
 	VkPipelineShaderStageCreateInfo shader_stages[2];
@@ -5153,10 +5992,11 @@ void vk_create_blur_pipeline( uint32_t index, uint32_t width, uint32_t height, q
 }
 
 
-static VkVertexInputBindingDescription bindings[8];
-static VkVertexInputAttributeDescription attribs[8];
-static uint32_t num_binds;
-static uint32_t num_attrs;
+// pipelines may be compiled on worker threads
+static THREAD_LOCAL VkVertexInputBindingDescription bindings[8];
+static THREAD_LOCAL VkVertexInputAttributeDescription attribs[8];
+static THREAD_LOCAL uint32_t num_binds;
+static THREAD_LOCAL uint32_t num_attrs;
 
 static void push_bind( uint32_t binding, uint32_t stride )
 {
@@ -5176,7 +6016,12 @@ static void push_attr( uint32_t location, uint32_t binding, VkFormat format )
 }
 
 
-VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex ) {
+/*
+ * async mode is used by worker threads: invalid definitions and
+ * driver failures return VK_NULL_HANDLE instead of raising an error,
+ * the pipeline will be created again by the main thread to report it
+ */
+static VkPipeline vk_create_pipeline_ext( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex, qboolean async ) {
 	VkShaderModule *vs_module = NULL;
 	VkShaderModule *fs_module = NULL;
 	//int32_t vert_spec_data[1]; // clippping
@@ -5374,6 +6219,8 @@ VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassI
 			break;
 
 		default:
+			if ( async )
+				return VK_NULL_HANDLE;
 			ri.Error(ERR_DROP, "create_pipeline: unknown shader type %i\n", def->shader_type);
 			return 0;
 	}
@@ -5851,6 +6698,8 @@ VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassI
 			break;
 
 		default:
+			if ( async )
+				return VK_NULL_HANDLE;
 			ri.Error( ERR_DROP, "%s: invalid shader type - %i", __func__, def->shader_type );
 			break;
 	}
@@ -5914,6 +6763,8 @@ VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassI
 			rasterization_state.cullMode = (def->mirror ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_FRONT_BIT);
 			break;
 		default:
+			if ( async )
+				return VK_NULL_HANDLE;
 			ri.Error( ERR_DROP, "create_pipeline: invalid face culling mode %i\n", def->face_culling );
 			break;
 	}
@@ -6034,6 +6885,8 @@ VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassI
 				attachment_blend_state.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA_SATURATE;
 				break;
 			default:
+				if ( async )
+					return VK_NULL_HANDLE;
 				ri.Error( ERR_DROP, "create_pipeline: invalid src blend state bits\n" );
 				break;
 		}
@@ -6063,6 +6916,8 @@ VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassI
 				attachment_blend_state.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_DST_ALPHA;
 				break;
 			default:
+				if ( async )
+					return VK_NULL_HANDLE;
 				ri.Error( ERR_DROP, "create_pipeline: invalid dst blend state bits\n" );
 				break;
 		}
@@ -6129,8 +6984,23 @@ VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassI
 	create_info.basePipelineHandle = VK_NULL_HANDLE;
 	create_info.basePipelineIndex = -1;
 
+	if ( async ) {
+		if ( qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, &pipeline ) != VK_SUCCESS )
+			return VK_NULL_HANDLE;
+		return pipeline;
+	}
+
 	VK_CHECK( qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, &pipeline ) );
 
+	return pipeline;
+}
+
+
+VkPipeline create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex ) {
+	VkPipeline pipeline;
+
+	pipeline = vk_create_pipeline_ext( def, renderPassIndex, qfalse );
+
 	vk.pipeline_create_count++;
 
 	return pipeline;
@@ -6149,89 +7019,362 @@ uint32_t vk_alloc_pipeline( const Vk_Pipeline_Def *def ) {
 		for ( j = 0; j < RENDER_PASS_COUNT; j++ ) {
 			pipeline->handle[j] = VK_NULL_HANDLE;
 		}
+		pipeline->asyncHandle = VK_NULL_HANDLE;
+		pipeline->asyncState = PIPELINE_IDLE;
 		return vk.pipelines_count++;
 	}
 }
 
 
-VkPipeline vk_gen_pipeline( uint32_t index ) {
-	if ( index < vk.pipelines_count ) {
-		VK_Pipeline_t *pipeline = vk.pipelines + index;
-		if ( pipeline->handle[ vk.renderPassIndex ] == VK_NULL_HANDLE )
-			pipeline->handle[ vk.renderPassIndex ] = create_pipeline( &pipeline->def, vk.renderPassIndex );
-		return pipeline->handle[ vk.renderPassIndex ];
-	} else {
-		return VK_NULL_HANDLE;
+/*
+ * Background pipeline compilation
+ *
+ * Pipelines first seen during rendering are queued to a single worker
+ * thread instead of stalling the frame, surfaces using them are skipped
+ * until the result is adopted by the main thread on a later lookup.
+ * The worker only reads pipeline definitions and the device, so it must
+ * be drained before any pipeline, render pass or shader module is destroyed.
+ */
+#define PIPELINE_QUEUE_SIZE 256 // must be power of two
+
+static struct {
+	void		*thread;
+	void		*work;		// posted for each queued pipeline
+	void		*done;		// posted by worker for each finished pipeline
+	uint32_t	queue[ PIPELINE_QUEUE_SIZE ];
+	int			head;		// main thread only
+	volatile int tail;		// worker only
+	int			pending;	// queued pipelines not yet waited with done semaphore
+	volatile int quit;
+} vk_compiler;
+
+static qboolean pipelineSkipDraw; // bound pipeline is not compiled yet
+
+
+static void vk_pipeline_worker( void *arg )
+{
+	VK_Pipeline_t *pipeline;
+	VkPipeline handle;
+	int tail;
+
+	for ( ;; ) {
+		ri.Sys_WaitSemaphore( vk_compiler.work );
+		if ( ri.Sys_AtomicLoad( &vk_compiler.quit ) ) {
+			break;
+		}
+		tail = vk_compiler.tail;
+		pipeline = vk.pipelines + vk_compiler.queue[ tail & ( PIPELINE_QUEUE_SIZE - 1 ) ];
+		handle = vk_create_pipeline_ext( &pipeline->def, pipeline->asyncPass, qtrue );
+		pipeline->asyncHandle = handle;
+		ri.Sys_AtomicStore( &pipeline->asyncState, handle != VK_NULL_HANDLE ? PIPELINE_DONE : PIPELINE_FAILED );
+		ri.Sys_AtomicStore( &vk_compiler.tail, tail + 1 );
+		ri.Sys_PostSemaphore( vk_compiler.done, 1 );
 	}
 }
 
 
-uint32_t vk_find_pipeline_ext( uint32_t base, const Vk_Pipeline_Def *def, qboolean use ) {
-	const Vk_Pipeline_Def *cur_def;
-	uint32_t index;
+static void vk_start_pipeline_worker( void )
+{
+	if ( !r_pipelineAsync->integer || vk_compiler.thread ) {
+		return;
+	}
 
-	for ( index = base; index < vk.pipelines_count; index++ ) {
-		cur_def = &vk.pipelines[ index ].def;
-		if ( memcmp( cur_def, def, sizeof( *def ) ) == 0 ) {
-			goto found;
-		}
+	Com_Memset( &vk_compiler, 0, sizeof( vk_compiler ) );
+
+	vk_compiler.work = ri.Sys_CreateSemaphore();
+	vk_compiler.done = ri.Sys_CreateSemaphore();
+	if ( !vk_compiler.work || !vk_compiler.done ) {
+		goto fail;
 	}
 
-	index = vk_alloc_pipeline( def );
-found:
+	vk_compiler.thread = ri.Sys_CreateThread( vk_pipeline_worker, NULL );
+	if ( !vk_compiler.thread ) {
+		goto fail;
+	}
 
-	if ( use )
-		vk_gen_pipeline( index );
+	return;
 
-	return index;
+fail:
+	ri.Printf( PRINT_WARNING, "...failed to start pipeline compiler thread\n" );
+	if ( vk_compiler.work )
+		ri.Sys_DestroySemaphore( vk_compiler.work );
+	if ( vk_compiler.done )
+		ri.Sys_DestroySemaphore( vk_compiler.done );
+	Com_Memset( &vk_compiler, 0, sizeof( vk_compiler ) );
 }
 
 
-void vk_get_pipeline_def( uint32_t pipeline, Vk_Pipeline_Def *def ) {
-	if ( pipeline >= vk.pipelines_count ) {
-		Com_Memset( def, 0, sizeof( *def ) );
-	} else {
-		Com_Memcpy( def, &vk.pipelines[ pipeline ].def, sizeof( *def ) );
+/*
+ * Takes over finished background result, returns state observed
+ */
+static int vk_adopt_pipeline( VK_Pipeline_t *pipeline )
+{
+	int state;
+
+	state = ri.Sys_AtomicLoad( &pipeline->asyncState );
+
+	if ( state == PIPELINE_DONE ) {
+		if ( pipeline->handle[ pipeline->asyncPass ] == VK_NULL_HANDLE ) {
+			pipeline->handle[ pipeline->asyncPass ] = pipeline->asyncHandle;
+			vk.pipeline_create_count++;
+		} else {
+			qvkDestroyPipeline( vk.device, pipeline->asyncHandle, NULL );
+		}
+		pipeline->asyncHandle = VK_NULL_HANDLE;
+		pipeline->asyncState = PIPELINE_IDLE;
+	} else if ( state == PIPELINE_FAILED ) {
+		pipeline->asyncState = PIPELINE_IDLE;
 	}
+
+	return state;
 }
 
 
-static void get_viewport_rect(VkRect2D *r)
+/*
+ * Waits for all queued pipelines and adopts them
+ */
+static void vk_wait_pipelines( void )
 {
-	if ( backEnd.projection2D )
-	{
-		r->offset.x = 0;
-		r->offset.y = 0;
-		r->extent.width = vk.renderWidth;
-		r->extent.height = vk.renderHeight;
+	uint32_t i;
+
+	if ( !vk_compiler.pending ) {
+		return;
 	}
-	else
-	{
-		r->offset.x = backEnd.viewParms.viewportX * vk.renderScaleX;
-		r->offset.y = vk.renderHeight - (backEnd.viewParms.viewportY + backEnd.viewParms.viewportHeight) * vk.renderScaleY;
-		r->extent.width = (float)backEnd.viewParms.viewportWidth * vk.renderScaleX;
-		r->extent.height = (float)backEnd.viewParms.viewportHeight * vk.renderScaleY;
+
+	while ( vk_compiler.pending > 0 ) {
+		ri.Sys_WaitSemaphore( vk_compiler.done );
+		vk_compiler.pending--;
+	}
+
+	for ( i = 0; i < vk.pipelines_count; i++ ) {
+		if ( vk.pipelines[i].asyncState != PIPELINE_IDLE ) {
+			vk_adopt_pipeline( vk.pipelines + i );
+		}
 	}
 }
 
-static void get_viewport(VkViewport *viewport, Vk_Depth_Range depth_range) {
-	VkRect2D r;
 
-	get_viewport_rect( &r );
+static void vk_stop_pipeline_worker( void )
+{
+	if ( !vk_compiler.thread ) {
+		return;
+	}
 
-	viewport->x = (float)r.offset.x;
-	viewport->y = (float)r.offset.y;
-	viewport->width = (float)r.extent.width;
-	viewport->height = (float)r.extent.height;
+	vk_wait_pipelines();
 
-	switch ( depth_range ) {
-		default:
-#ifdef USE_REVERSED_DEPTH
-		//case DEPTH_RANGE_NORMAL:
-			viewport->minDepth = 0.0f;
-			viewport->maxDepth = 1.0f;
-			break;
-		case DEPTH_RANGE_ZERO:
+	ri.Sys_AtomicStore( &vk_compiler.quit, 1 );
+	ri.Sys_PostSemaphore( vk_compiler.work, 1 );
+	ri.Sys_JoinThread( vk_compiler.thread );
+
+	ri.Sys_DestroySemaphore( vk_compiler.work );
+	ri.Sys_DestroySemaphore( vk_compiler.done );
+
+	Com_Memset( &vk_compiler, 0, sizeof( vk_compiler ) );
+}
+
+
+static qboolean vk_queue_pipeline( uint32_t index, renderPass_t renderPassIndex )
+{
+	VK_Pipeline_t *pipeline = vk.pipelines + index;
+
+	if ( !vk_compiler.thread ) {
+		return qfalse;
+	}
+
+	if ( vk_compiler.head - ri.Sys_AtomicLoad( &vk_compiler.tail ) >= PIPELINE_QUEUE_SIZE ) {
+		return qfalse; // queue is full
+	}
+
+	pipeline->asyncPass = renderPassIndex;
+	pipeline->asyncState = PIPELINE_QUEUED;
+
+	vk_compiler.queue[ vk_compiler.head & ( PIPELINE_QUEUE_SIZE - 1 ) ] = index;
+	vk_compiler.head++;
+	vk_compiler.pending++;
+
+	ri.Sys_PostSemaphore( vk_compiler.work, 1 );
+
+	return qtrue;
+}
+
+
+VkPipeline vk_gen_pipeline( uint32_t index ) {
+	if ( index < vk.pipelines_count ) {
+		VK_Pipeline_t *pipeline = vk.pipelines + index;
+		if ( pipeline->handle[ vk.renderPassIndex ] == VK_NULL_HANDLE ) {
+			if ( pipeline->asyncState != PIPELINE_IDLE ) {
+				vk_wait_pipelines();
+			}
+			if ( pipeline->handle[ vk.renderPassIndex ] == VK_NULL_HANDLE )
+				pipeline->handle[ vk.renderPassIndex ] = create_pipeline( &pipeline->def, vk.renderPassIndex );
+		}
+		return pipeline->handle[ vk.renderPassIndex ];
+	} else {
+		return VK_NULL_HANDLE;
+	}
+}
+
+
+/*
+ * Same as vk_gen_pipeline() but returns VK_NULL_HANDLE
+ * while pipeline is being compiled in background
+ */
+static VkPipeline vk_gen_pipeline_async( uint32_t index ) {
+	VK_Pipeline_t *pipeline;
+
+	if ( index >= vk.pipelines_count ) {
+		return VK_NULL_HANDLE;
+	}
+
+	pipeline = vk.pipelines + index;
+	if ( pipeline->handle[ vk.renderPassIndex ] != VK_NULL_HANDLE ) {
+		return pipeline->handle[ vk.renderPassIndex ];
+	}
+
+	switch ( vk_adopt_pipeline( pipeline ) ) {
+		case PIPELINE_IDLE:
+			if ( vk_queue_pipeline( index, vk.renderPassIndex ) )
+				return VK_NULL_HANDLE;
+			break;
+		case PIPELINE_QUEUED:
+			if ( pipeline->asyncPass == vk.renderPassIndex )
+				return VK_NULL_HANDLE;
+			break;
+		case PIPELINE_DONE:
+			if ( pipeline->handle[ vk.renderPassIndex ] != VK_NULL_HANDLE )
+				return pipeline->handle[ vk.renderPassIndex ];
+			break;
+		case PIPELINE_FAILED:
+			// compile again to report the error
+			break;
+	}
+
+	return vk_gen_pipeline( index );
+}
+
+
+static void vk_precompile_job( void *data, int index )
+{
+	VK_Pipeline_t *pipeline = vk.pipelines + ((const uint32_t *)data)[ index ];
+
+	pipeline->asyncHandle = vk_create_pipeline_ext( &pipeline->def, RENDER_PASS_MAIN, qtrue );
+}
+
+
+/*
+ * Compiles all known pipelines for the main render pass on job threads,
+ * called at the end of registration so the first frames do not stall
+ */
+void vk_precompile_pipelines( void )
+{
+	uint32_t *list;
+	uint32_t i, count, created;
+	int start;
+
+	if ( !r_pipelineAsync->integer ) {
+		return;
+	}
+
+	vk_wait_pipelines();
+
+	list = ri.Malloc( vk.pipelines_count * sizeof( list[0] ) );
+
+	for ( i = 0, count = 0; i < vk.pipelines_count; i++ ) {
+		if ( vk.pipelines[i].handle[ RENDER_PASS_MAIN ] == VK_NULL_HANDLE ) {
+			vk.pipelines[i].asyncHandle = VK_NULL_HANDLE;
+			list[ count++ ] = i;
+		}
+	}
+
+	start = ri.Milliseconds();
+
+	ri.ParallelFor( vk_precompile_job, list, count );
+
+	for ( i = 0, created = 0; i < count; i++ ) {
+		VK_Pipeline_t *pipeline = vk.pipelines + list[i];
+		if ( pipeline->asyncHandle != VK_NULL_HANDLE ) {
+			// failed ones will be created on first use
+			pipeline->handle[ RENDER_PASS_MAIN ] = pipeline->asyncHandle;
+			pipeline->asyncHandle = VK_NULL_HANDLE;
+			vk.pipeline_create_count++;
+			created++;
+		}
+	}
+
+	ri.Free( list );
+
+	if ( count ) {
+		ri.Printf( PRINT_DEVELOPER, "...precompiled %i of %i pipelines in %i msec\n", created, count, ri.Milliseconds() - start );
+	}
+}
+
+
+uint32_t vk_find_pipeline_ext( uint32_t base, const Vk_Pipeline_Def *def, qboolean use ) {
+	const Vk_Pipeline_Def *cur_def;
+	uint32_t index;
+
+	for ( index = base; index < vk.pipelines_count; index++ ) {
+		cur_def = &vk.pipelines[ index ].def;
+		if ( memcmp( cur_def, def, sizeof( *def ) ) == 0 ) {
+			goto found;
+		}
+	}
+
+	index = vk_alloc_pipeline( def );
+found:
+
+	if ( use )
+		vk_gen_pipeline( index );
+
+	return index;
+}
+
+
+void vk_get_pipeline_def( uint32_t pipeline, Vk_Pipeline_Def *def ) {
+	if ( pipeline >= vk.pipelines_count ) {
+		Com_Memset( def, 0, sizeof( *def ) );
+	} else {
+		Com_Memcpy( def, &vk.pipelines[ pipeline ].def, sizeof( *def ) );
+	}
+}
+
+
+static void get_viewport_rect(VkRect2D *r)
+{
+	if ( backEnd.projection2D )
+	{
+		r->offset.x = 0;
+		r->offset.y = 0;
+		r->extent.width = vk.renderWidth;
+		r->extent.height = vk.renderHeight;
+	}
+	else
+	{
+		r->offset.x = backEnd.viewParms.viewportX * vk.renderScaleX;
+		r->offset.y = vk.renderHeight - (backEnd.viewParms.viewportY + backEnd.viewParms.viewportHeight) * vk.renderScaleY;
+		r->extent.width = (float)backEnd.viewParms.viewportWidth * vk.renderScaleX;
+		r->extent.height = (float)backEnd.viewParms.viewportHeight * vk.renderScaleY;
+	}
+}
+
+static void get_viewport(VkViewport *viewport, Vk_Depth_Range depth_range) {
+	VkRect2D r;
+
+	get_viewport_rect( &r );
+
+	viewport->x = (float)r.offset.x;
+	viewport->y = (float)r.offset.y;
+	viewport->width = (float)r.extent.width;
+	viewport->height = (float)r.extent.height;
+
+	switch ( depth_range ) {
+		default:
+#ifdef USE_REVERSED_DEPTH
+		//case DEPTH_RANGE_NORMAL:
+			viewport->minDepth = 0.0f;
+			viewport->maxDepth = 1.0f;
+			break;
+		case DEPTH_RANGE_ZERO:
 			viewport->minDepth = 1.0f;
 			viewport->maxDepth = 1.0f;
 			break;
@@ -6268,10 +7411,10 @@ static void get_scissor_rect(VkRect2D *r) {
 
 	if ( backEnd.viewParms.portalView != PV_NONE )
 	{
-		r->offset.x = backEnd.viewParms.scissorX;
-		r->offset.y = glConfig.vidHeight - backEnd.viewParms.scissorY - backEnd.viewParms.scissorHeight;
-		r->extent.width = backEnd.viewParms.scissorWidth;
-		r->extent.height = backEnd.viewParms.scissorHeight;
+		r->offset.x = backEnd.viewParms.scissorX * vk.renderScaleX;
+		r->offset.y = vk.renderHeight - ( backEnd.viewParms.scissorY + backEnd.viewParms.scissorHeight ) * vk.renderScaleY;
+		r->extent.width = backEnd.viewParms.scissorWidth * vk.renderScaleX;
+		r->extent.height = backEnd.viewParms.scissorHeight * vk.renderScaleY;
 	}
 	else
 	{
@@ -6282,10 +7425,10 @@ static void get_scissor_rect(VkRect2D *r) {
 		if (r->offset.y < 0)
 			r->offset.y = 0;
 
-		if (r->offset.x + r->extent.width > glConfig.vidWidth)
-			r->extent.width = glConfig.vidWidth - r->offset.x;
-		if (r->offset.y + r->extent.height > glConfig.vidHeight)
-			r->extent.height = glConfig.vidHeight - r->offset.y;
+		if (r->offset.x + r->extent.width > vk.renderWidth)
+			r->extent.width = vk.renderWidth - r->offset.x;
+		if (r->offset.y + r->extent.height > vk.renderHeight)
+			r->extent.height = vk.renderHeight - r->offset.y;
 	}
 }
 
@@ -6432,10 +7575,8 @@ static void vk_bind_attr( int index, unsigned int item_size, const void *src ) {
 	const uint32_t offset = PAD( vk.cmd->vertex_buffer_offset, 32 );
 	const uint32_t size = tess.numVertexes * item_size;
 
-	if ( offset + size > vk.geometry_buffer_size ) {
-		// schedule geometry buffer resize
-		vk.geometry_buffer_size_new = log2pad( offset + size, 1 );
-	} else {
+	if ( vk_reserve_geometry( (VkDeviceSize)offset + size ) ) {
+		shade_bufs[ index ] = vk.cmd->vertex_buffer;
 		vk.cmd->buf_offset[ index ] = offset;
 		Com_Memcpy( vk.cmd->vertex_buffer_ptr + offset, src, size );
 		vk.cmd->vertex_buffer_offset = (VkDeviceSize)offset + size;
@@ -6449,9 +7590,7 @@ uint32_t vk_tess_index( uint32_t numIndexes, const void *src ) {
 	const uint32_t offset = vk.cmd->vertex_buffer_offset;
 	const uint32_t size = numIndexes * sizeof( tess.indexes[0] );
 
-	if ( offset + size > vk.geometry_buffer_size ) {
-		// schedule geometry buffer resize
-		vk.geometry_buffer_size_new = log2pad( offset + size, 1 );
+	if ( !vk_reserve_geometry( (VkDeviceSize)offset + size ) ) {
 		return ~0U;
 	} else {
 		Com_Memcpy( vk.cmd->vertex_buffer_ptr + offset, src, size );
@@ -6477,6 +7616,37 @@ void vk_draw_indexed( uint32_t indexCount, uint32_t firstIndex )
 }
 
 
+/*
+=============
+vk_draw_indexed_indirect
+
+Issues count draws from the bound index buffer with a single command,
+parameters are stored in the geometry buffer of the current frame.
+Returns qfalse if it is out of space, caller should draw directly then
+=============
+*/
+qboolean vk_draw_indexed_indirect( const VkDrawIndexedIndirectCommand *cmds, uint32_t count )
+{
+	const uint32_t offset = PAD( vk.cmd->vertex_buffer_offset, 4 );
+	const uint32_t size = count * sizeof( cmds[0] );
+
+	if ( !vk.multiDrawIndirect || count > vk.maxDrawIndirectCount ) {
+		return qfalse;
+	}
+
+	if ( !vk_reserve_geometry( (VkDeviceSize)offset + size ) ) {
+		return qfalse;
+	}
+
+	Com_Memcpy( vk.cmd->vertex_buffer_ptr + offset, cmds, size );
+	vk.cmd->vertex_buffer_offset = (VkDeviceSize)offset + size;
+
+	qvkCmdDrawIndexedIndirect( vk.cmd->command_buffer, vk.cmd->vertex_buffer, offset, count, sizeof( cmds[0] ) );
+
+	return qtrue;
+}
+
+
 void vk_bind_index( void )
 {
 #ifdef USE_VBO
@@ -6683,11 +7853,17 @@ void vk_bind_descriptor_sets( void )
 void vk_bind_pipeline( uint32_t pipeline ) {
 	VkPipeline vkpipe;
 
-	vkpipe = vk_gen_pipeline( pipeline );
+	vkpipe = vk_gen_pipeline_async( pipeline );
+
+	pipelineSkipDraw = ( vkpipe == VK_NULL_HANDLE );
+	if ( pipelineSkipDraw ) {
+		return;
+	}
 
 	if ( vkpipe != vk.cmd->last_pipeline ) {
 		qvkCmdBindPipeline( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkpipe );
 		vk.cmd->last_pipeline = vkpipe;
+		backEnd.pc.c_pipelines++;
 	}
 
 	vk_world.dirty_depth_attachment |= ( vk.pipelines[ pipeline ].def.state_bits & GLS_DEPTHMASK_TRUE );
@@ -6703,6 +7879,11 @@ void vk_draw_geometry( Vk_Depth_Range depth_range, qboolean indexed ) {
 		return;
 	}
 
+	if ( pipelineSkipDraw ) {
+		// pipeline is still compiling in background
+		return;
+	}
+
 	vk_bind_descriptor_sets();
 
 	// configure pipeline's dynamic state
@@ -6772,18 +7953,35 @@ static void vk_begin_render_pass( VkRenderPass renderPass, VkFramebuffer frameBu
 }
 
 
+/*
+=============
+vk_set_dynamic_render_size
+
+Main and post-bloom render passes cover dynamicScale of the color attachments
+=============
+*/
+static void vk_set_dynamic_render_size( void )
+{
+	if ( vk.dynamicScale < 1.0f ) {
+		vk.renderWidth = MAX( (uint32_t)( glConfig.vidWidth * vk.dynamicScale ), 1 );
+		vk.renderHeight = MAX( (uint32_t)( glConfig.vidHeight * vk.dynamicScale ), 1 );
+		vk.renderScaleX = (float)vk.renderWidth / (float)glConfig.vidWidth;
+		vk.renderScaleY = (float)vk.renderHeight / (float)glConfig.vidHeight;
+	} else {
+		vk.renderWidth = glConfig.vidWidth;
+		vk.renderHeight = glConfig.vidHeight;
+		vk.renderScaleX = vk.renderScaleY = 1.0f;
+	}
+}
+
+
 void vk_begin_main_render_pass( void )
 {
 	VkFramebuffer frameBuffer = vk.framebuffers.main[ vk.swapchain_image_index ];
 
 	vk.renderPassIndex = RENDER_PASS_MAIN;
 
-	vk.renderWidth = glConfig.vidWidth;
-	vk.renderHeight = glConfig.vidHeight;
-
-	//vk.renderScaleX = (float)vk.renderWidth / (float)glConfig.vidWidth;
-	//vk.renderScaleY = (float)vk.renderHeight / (float)glConfig.vidHeight;
-	vk.renderScaleX = vk.renderScaleY = 1.0f;
+	vk_set_dynamic_render_size();
 
 	vk_begin_render_pass( vk.render_pass.main, frameBuffer, qtrue, vk.renderWidth, vk.renderHeight );
 }
@@ -6795,12 +7993,7 @@ void vk_begin_post_bloom_render_pass( void )
 
 	vk.renderPassIndex = RENDER_PASS_POST_BLOOM;
 
-	vk.renderWidth = glConfig.vidWidth;
-	vk.renderHeight = glConfig.vidHeight;
-
-	//vk.renderScaleX = (float)vk.renderWidth / (float)glConfig.vidWidth;
-	//vk.renderScaleY = (float)vk.renderHeight / (float)glConfig.vidHeight;
-	vk.renderScaleX = vk.renderScaleY = 1.0f;
+	vk_set_dynamic_render_size();
 
 	vk_begin_render_pass( vk.render_pass.post_bloom, frameBuffer, qfalse, vk.renderWidth, vk.renderHeight );
 }
@@ -6866,7 +8059,7 @@ void vk_end_render_pass( void )
 
 static qboolean vk_find_screenmap_drawsurfs( void )
 {
-	const void *curCmd = &backEndData->commands.cmds;
+	const void *curCmd = backEnd.commands;
 	const drawBufferCommand_t *db_cmd;
 	const drawSurfsCommand_t *ds_cmd;
 
@@ -6891,6 +8084,118 @@ static qboolean vk_find_screenmap_drawsurfs( void )
 #define UINT64_MAX 0xFFFFFFFFFFFFFFFFULL
 #endif
 
+#define DYNAMIC_RESOLUTION_FRAMES 8
+
+/*
+=============
+vk_update_dynamic_resolution
+
+Every few frames scales the render area to hold r_dynamicResolutionTarget,
+pixel count and so most of the GPU time follows square of the scale
+=============
+*/
+static void vk_update_dynamic_resolution( float frameTime )
+{
+	float target, scale;
+
+	vk.gpuTimeSum += frameTime;
+	if ( ++vk.gpuTimeCount < DYNAMIC_RESOLUTION_FRAMES )
+		return;
+
+	vk.gpuFrameTime = vk.gpuTimeSum / vk.gpuTimeCount;
+	vk.gpuTimeSum = 0.0f;
+	vk.gpuTimeCount = 0;
+
+	target = r_dynamicResolutionTarget->value;
+	scale = vk.dynamicScale;
+
+	if ( vk.gpuFrameTime > target ) {
+		// go halfway to the estimated scale
+		scale *= 0.5f + 0.5f * sqrtf( target / vk.gpuFrameTime );
+	} else if ( vk.gpuFrameTime < target * 0.85f ) {
+		// grow slowly to avoid oscillation
+		scale += 0.02f;
+	}
+
+	if ( scale < r_dynamicResolutionMin->value )
+		scale = r_dynamicResolutionMin->value;
+	if ( scale > 1.0f )
+		scale = 1.0f;
+
+	vk.dynamicScale = scale;
+}
+
+
+/*
+=============
+vk_read_timestamps
+
+Reads timestamps of the previous submit of the current command buffer,
+its fence has been waited so results are available
+=============
+*/
+static void vk_read_timestamps( void )
+{
+	uint64_t ts[ MAX_GPU_TIMESTAMPS ];
+	uint32_t count;
+
+	if ( !vk.cmd->timestamps )
+		return;
+
+	vk.cmd->timestamps = qfalse;
+	count = vk.cmd->timestamp_count;
+
+	if ( qvkGetQueryPoolResults( vk.device, vk.timestampPool, (uint32_t)( vk.cmd - vk.tess ) * MAX_GPU_TIMESTAMPS, count, sizeof( ts[0] ) * count, ts, sizeof( ts[0] ), VK_QUERY_RESULT_64_BIT ) != VK_SUCCESS )
+		return;
+
+	if ( ts[ count - 1 ] <= ts[0] )
+		return;
+
+	if ( vk.gpuTimers )
+		R_GpuTimerFrame( vk.cmd->timestamp_timer, ts, count, vk.timestampPeriod );
+
+	if ( vk.dynamicResolution )
+		vk_update_dynamic_resolution( (double)( ts[ count - 1 ] - ts[0] ) * vk.timestampPeriod * 1e-6 );
+}
+
+
+/*
+=============
+vk_write_timestamp
+=============
+*/
+static void vk_write_timestamp( VkPipelineStageFlagBits stage, int timer )
+{
+	const uint32_t query = (uint32_t)( vk.cmd - vk.tess ) * MAX_GPU_TIMESTAMPS + vk.cmd->timestamp_count;
+
+	qvkCmdWriteTimestamp( vk.cmd->command_buffer, stage, vk.timestampPool, query );
+	vk.cmd->timestamp_timer[ vk.cmd->timestamp_count++ ] = timer;
+}
+
+
+/*
+=============
+vk_gpu_timer
+
+Starts a new GPU timer segment when the active pass changes,
+the last query of the frame is kept for vk_end_frame()
+=============
+*/
+void vk_gpu_timer( int timer )
+{
+	if ( !vk.timestampsActive || !vk.gpuTimers )
+		return;
+
+	if ( vk.cmd->timestamp_timer[ vk.cmd->timestamp_count - 1 ] == timer )
+		return;
+
+	if ( vk.cmd->timestamp_count >= MAX_GPU_TIMESTAMPS - 1 )
+		return;
+
+	vk_write_timestamp( VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timer );
+}
+
+
 void vk_begin_frame( void )
 {
 	VkCommandBufferBeginInfo begin_info;
@@ -6900,10 +8205,12 @@ void vk_begin_frame( void )
 	if ( vk.frame_count++ ) // might happen during stereo rendering
 		return;
 
+	vk_flush_uploads();
+
 	if ( vk.cmd->waitForFence ) {
 
 		vk.cmd = &vk.tess[ vk.cmd_index++ ];
-		vk.cmd_index %= NUM_COMMAND_BUFFERS;
+		vk.cmd_index %= vk.num_command_buffers;
 
 		vk.cmd->waitForFence = qfalse;
 		res = qvkWaitForFences(vk.device, 1, &vk.cmd->rendering_finished_fence, VK_FALSE, 1e10);
@@ -6939,8 +8246,19 @@ void vk_begin_frame( void )
 		// so we will reuse it with current swapchain image as well
 	}
 
+	vk_update_geometry_buffer();
+
+	vk_read_timestamps();
+
+	vk.gpuTimers = R_GpuTimersActive();
+	vk.timestampsActive = ( vk.timestampPool != VK_NULL_HANDLE && ( vk.dynamicResolution || vk.gpuTimers ) );
+
 	VK_CHECK( qvkResetFences( vk.device, 1, &vk.cmd->rendering_finished_fence ) );
 
+	vk.cmd->present_id = 0;
+	vk.cmd->input_time = vk.input_time;
+	vk.input_time = 0;
+
 	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	begin_info.pNext = NULL;
 	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
@@ -6948,6 +8266,12 @@ void vk_begin_frame( void )
 
 	VK_CHECK( qvkBeginCommandBuffer( vk.cmd->command_buffer, &begin_info ) );
 
+	if ( vk.timestampsActive ) {
+		qvkCmdResetQueryPool( vk.cmd->command_buffer, vk.timestampPool, (uint32_t)( vk.cmd - vk.tess ) * MAX_GPU_TIMESTAMPS, MAX_GPU_TIMESTAMPS );
+		vk.cmd->timestamp_count = 0;
+		vk_write_timestamp( VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, GPU_TIMER_WORLD );
+	}
+
 	// Ensure visibility of geometry buffers writes.
 	//record_buffer_memory_barrier( vk.cmd->command_buffer, vk.cmd->vertex_buffer, vk.cmd->vertex_buffer_offset, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT );
 
@@ -6971,6 +8295,9 @@ void vk_begin_frame( void )
 		vk.stats.vertex_buffer_max = vk.cmd->vertex_buffer_offset;
 	}
 
+	vk.stats.vertex_buffer_total += vk.cmd->vertex_buffer_offset;
+	vk.stats.frames++;
+
 	if ( vk.stats.push_size > vk.stats.push_size_max ) {
 		vk.stats.push_size_max = vk.stats.push_size;
 	}
@@ -7027,13 +8354,135 @@ static void vk_resize_geometry_buffer( void )
 	vk_create_geometry_buffers( vk.geometry_buffer_size_new );
 	vk.geometry_buffer_size_new = 0;
 
-	for ( i = 0; i < NUM_COMMAND_BUFFERS; i++ )
+	for ( i = 0; i < vk.num_command_buffers; i++ )
 		vk_update_uniform_descriptor( vk.tess[ i ].uniform_descriptor, vk.tess[ i ].vertex_buffer );
 
 	ri.Printf( PRINT_DEVELOPER, "...geometry buffer resized to %iK\n", (int)( vk.geometry_buffer_size / 1024 ) );
 }
 
 
+static qboolean vk_readback_format( VkFormat format, uint32_t *pixel_width ) {
+	switch ( format ) {
+		case VK_FORMAT_B4G4R4A4_UNORM_PACK16:
+			*pixel_width = 2;
+			return qtrue;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			*pixel_width = 4;
+			return qtrue;
+		case VK_FORMAT_R16G16B16A16_UNORM:
+			*pixel_width = 8;
+			return qtrue;
+		default:
+			*pixel_width = 4;
+			return qfalse;
+	}
+}
+
+
+static void vk_readback_source( VkImage *image, VkImageLayout *layout, VkFormat *format )
+{
+	if ( vk.fboActive ) {
+		if ( vk.capture.image ) {
+			*image = vk.capture.image;
+			*layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			*format = vk.capture_format;
+		} else {
+			*image = vk.color_image;
+			*layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			*format = vk.color_format;
+		}
+	} else {
+		*image = vk.swapchain_images[ vk.swapchain_image_index ];
+		*layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		*format = vk.present_format.format;
+	}
+}
+
+
+/*
+=================
+vk_record_readback
+
+Copies the final image of the frame into the readback buffer of the
+command buffer, vk_read_video_pixels() picks it up after its fence
+=================
+*/
+static void vk_record_readback( uint32_t width, uint32_t height )
+{
+	VkCommandBuffer command_buffer = vk.cmd->command_buffer;
+	vk_tess_t *tess = vk.cmd;
+	VkImageLayout layout;
+	VkImage image;
+	VkFormat format;
+	VkMemoryBarrier barrier;
+	VkBufferImageCopy region;
+	uint32_t pixel_width;
+	VkDeviceSize size;
+
+	tess->readback_pending = qfalse;
+
+	if ( !vk.fboActive && ri.CL_IsMinimized() ) {
+		return;
+	}
+
+	vk_readback_source( &image, &layout, &format );
+
+	if ( !vk_readback_format( format, &pixel_width ) ) {
+		return; // vk_read_video_pixels() will blit it synchronously
+	}
+
+	size = (VkDeviceSize)width * height * pixel_width;
+	if ( tess->readback_size < size ) {
+		vk_release_readback_buffer( tess );
+		vk_create_readback_buffer( tess, size );
+	}
+
+	// rendering to the source image is done
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = NULL;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	qvkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL );
+
+	if ( layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ) {
+		record_image_layout_transition( command_buffer, image, VK_IMAGE_ASPECT_COLOR_BIT, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL );
+	}
+
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset.x = 0;
+	region.imageOffset.y = 0;
+	region.imageOffset.z = 0;
+	region.imageExtent.width = width;
+	region.imageExtent.height = height;
+	region.imageExtent.depth = 1;
+
+	qvkCmdCopyImageToBuffer( command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, tess->readback_buffer, 1, &region );
+
+	if ( layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ) {
+		record_image_layout_transition( command_buffer, image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout );
+	}
+
+	// make it visible for the host
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	qvkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL );
+
+	tess->readback_pending = qtrue;
+	tess->readback_width = width;
+	tess->readback_height = height;
+	tess->readback_format = format;
+}
+
+
 void vk_end_frame( void )
 {
 	const VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -7059,6 +8508,8 @@ void vk_end_frame( void )
 			vk_bloom();
 		}
 
+		vk_gpu_timer( GPU_TIMER_POST );
+
 		if ( backEnd.screenshotMask && vk.capture.image )
 		{
 			vk_end_render_pass();
@@ -7066,6 +8517,7 @@ void vk_end_frame( void )
 			// render to capture FBO
 			vk_begin_render_pass( vk.render_pass.capture, vk.framebuffers.capture, qfalse, gls.captureWidth, gls.captureHeight );
 			qvkCmdBindPipeline( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.capture_pipeline );
+			vk_set_post_process_viewport( 3 );
 			qvkCmdBindDescriptorSets( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.pipeline_layout_post_process, 0, 1, &vk.color_descriptor, 0, NULL );
 
 			qvkCmdDraw( vk.cmd->command_buffer, 4, 1, 0, 0 );
@@ -7083,6 +8535,7 @@ void vk_end_frame( void )
 
 			vk_begin_render_pass( vk.render_pass.gamma, vk.framebuffers.gamma[ vk.swapchain_image_index ], qfalse, vk.renderWidth, vk.renderHeight );
 			qvkCmdBindPipeline( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.gamma_pipeline );
+			vk_set_post_process_viewport( 0 );
 			qvkCmdBindDescriptorSets( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.pipeline_layout_post_process, 0, 1, &vk.color_descriptor, 0, NULL );
 
 			qvkCmdDraw( vk.cmd->command_buffer, 4, 1, 0, 0 );
@@ -7091,6 +8544,20 @@ void vk_end_frame( void )
 
 	vk_end_render_pass();
 
+	if ( backEnd.screenshotMask & SCREENSHOT_AVI ) {
+		vk_record_readback( backEnd.vcmd.width, backEnd.vcmd.height );
+	} else {
+		uint32_t i;
+		// capture is over, drop frames in flight
+		for ( i = 0; i < vk.num_command_buffers; i++ ) {
+			vk.tess[i].readback_pending = qfalse;
+		}
+	}
+
+	if ( vk.timestampsActive ) {
+		vk_write_timestamp( VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GPU_TIMER_COUNT );
+	}
+
 	VK_CHECK( qvkEndCommandBuffer( vk.cmd->command_buffer ) );
 
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -7113,9 +8580,11 @@ void vk_end_frame( void )
 
 	VK_CHECK( qvkQueueSubmit( vk.queue, 1, &submit_info, vk.cmd->rendering_finished_fence ) );
 	vk.cmd->waitForFence = qtrue;
+	vk.cmd->timestamps = vk.timestampsActive;
+	vk.timestampsActive = qfalse;
 
 	// presentation may take undefined time to complete, we can't measure it in a reliable way
-	backEnd.pc.msec = ri.Milliseconds() - backEnd.pc.msec;
+	backEnd.pc.usec = (int)( ri.Microseconds() - backEnd.execStart );
 
 	// vk_present_frame();
 }
@@ -7123,6 +8592,7 @@ void vk_end_frame( void )
 void vk_present_frame( void )
 {
 	VkPresentInfoKHR present_info;
+	VkPresentIdKHR present_id;
 	VkResult res;
 
 	if ( ri.CL_IsMinimized() )
@@ -7140,6 +8610,15 @@ void vk_present_frame( void )
 	present_info.pImageIndices = &vk.swapchain_image_index;
 	present_info.pResults = NULL;
 
+	if ( vk.presentWait ) {
+		vk.cmd->present_id = ++vk.present_id;
+		present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		present_id.pNext = NULL;
+		present_id.swapchainCount = 1;
+		present_id.pPresentIds = &vk.cmd->present_id;
+		present_info.pNext = &present_id;
+	}
+
 	res = qvkQueuePresentKHR( vk.queue, &present_info );
 	switch ( res ) {
 		case VK_SUCCESS:
@@ -7160,6 +8639,67 @@ void vk_present_frame( void )
 }
 
 
+/*
+=================
+vk_wait_frame
+
+Blocks until the most recently submitted frame is presented, or at least
+finished by the GPU without VK_KHR_present_wait, so that the client samples
+input for the next frame as late as possible instead of queueing behind it.
+
+Time from the previous wait to the completion of the frame rendered in
+between is reported through r_latency
+=================
+*/
+void vk_wait_frame( void )
+{
+	static int64_t latencySum, latencyLast;
+	static int latencyCount;
+	vk_tess_t *cmd;
+	int64_t now;
+	VkResult res;
+
+	if ( !vk.active || ri.CL_IsMinimized() )
+		return;
+
+	cmd = vk.cmd;
+	if ( !cmd || !cmd->waitForFence )
+		return;
+
+	if ( vk.presentWait && cmd->present_id ) {
+		// don't stall forever on compositors that never report presentation
+		res = qvkWaitForPresentKHR( vk.device, vk.swapchain, cmd->present_id, 100 * 1000000ULL );
+		if ( res < 0 && res != VK_ERROR_OUT_OF_DATE_KHR ) {
+			ri.Printf( PRINT_DEVELOPER, "vkWaitForPresentKHR returned %s\n", vk_result_string( res ) );
+		}
+	} else {
+		res = qvkWaitForFences( vk.device, 1, &cmd->rendering_finished_fence, VK_FALSE, 1e10 );
+		if ( res != VK_SUCCESS ) {
+			ri.Printf( PRINT_DEVELOPER, "vkWaitForFences returned %s\n", vk_result_string( res ) );
+		}
+	}
+
+	now = ri.Microseconds();
+
+	if ( cmd->input_time ) {
+		latencySum += now - cmd->input_time;
+		latencyCount++;
+		cmd->input_time = 0;
+	}
+
+	if ( now - latencyLast >= 1000000 ) {
+		if ( latencyCount ) {
+			ri.Cvar_Set( "r_latency", va( "%.1f", (double)latencySum / latencyCount / 1000.0 ) );
+		}
+		latencySum = 0;
+		latencyCount = 0;
+		latencyLast = now;
+	}
+
+	vk.input_time = now;
+}
+
+
 static qboolean is_bgr( VkFormat format ) {
 	switch ( format ) {
 		case VK_FORMAT_B8G8R8A8_UNORM:
@@ -7175,6 +8715,95 @@ static qboolean is_bgr( VkFormat format ) {
 }
 
 
+#define CONVERT_JOB_BLOCKS 8
+
+typedef struct {
+	byte		*buffer;
+	const byte	*data;
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	rowPitch;
+	uint32_t	pixel_width;
+	qboolean	swap;
+} convertJob_t;
+
+
+/*
+=================
+vk_convert_job
+
+Converts a block of rows to bottom-up RGB
+=================
+*/
+static void vk_convert_job( void *data, int index )
+{
+	const convertJob_t *job = (const convertJob_t *)data;
+	const uint32_t y0 = job->height * index / CONVERT_JOB_BLOCKS;
+	const uint32_t y1 = job->height * ( index + 1 ) / CONVERT_JOB_BLOCKS;
+	const byte *src;
+	byte *buffer_ptr;
+	uint32_t i, n;
+
+	src = job->data + (size_t)y0 * job->rowPitch;
+	buffer_ptr = job->buffer + (size_t)job->width * ( job->height - 1 - y0 ) * 3;
+
+	for ( i = y0; i < y1; i++ ) {
+		switch ( job->pixel_width ) {
+			case 2: {
+				const uint16_t *s = (const uint16_t*)src;
+				for ( n = 0; n < job->width; n++ ) {
+					buffer_ptr[n*3+0] = ((s[n]>>12)&0xF)<<4;
+					buffer_ptr[n*3+1] = ((s[n]>>8)&0xF)<<4;
+					buffer_ptr[n*3+2] = ((s[n]>>4)&0xF)<<4;
+				}
+			} break;
+
+			case 4: {
+				for ( n = 0; n < job->width; n++ ) {
+					Com_Memcpy( &buffer_ptr[n*3], &src[n*4], 3 );
+				}
+			} break;
+
+			case 8: {
+				const uint16_t *s = (const uint16_t*)src;
+				for ( n = 0; n < job->width; n++ ) {
+					buffer_ptr[n*3+0] = s[n*4+0]>>8;
+					buffer_ptr[n*3+1] = s[n*4+1]>>8;
+					buffer_ptr[n*3+2] = s[n*4+2]>>8;
+				}
+			} break;
+		}
+
+		if ( job->swap ) {
+			for ( n = 0; n < job->width; n++ ) {
+				byte tmp = buffer_ptr[n*3+0];
+				buffer_ptr[n*3+0] = buffer_ptr[n*3+2];
+				buffer_ptr[n*3+2] = tmp;
+			}
+		}
+
+		buffer_ptr -= job->width * 3;
+		src += job->rowPitch;
+	}
+}
+
+
+static void vk_convert_pixels( byte *buffer, const byte *data, uint32_t width, uint32_t height, uint32_t rowPitch, VkFormat format )
+{
+	convertJob_t job;
+
+	job.buffer = buffer;
+	job.data = data;
+	job.width = width;
+	job.height = height;
+	job.rowPitch = rowPitch;
+	job.swap = is_bgr( format );
+	vk_readback_format( format, &job.pixel_width );
+
+	ri.ParallelFor( vk_convert_job, &job, CONVERT_JOB_BLOCKS );
+}
+
+
 void vk_read_pixels( byte *buffer, uint32_t width, uint32_t height )
 {
 	VkCommandBuffer command_buffer;
@@ -7189,10 +8818,7 @@ void vk_read_pixels( byte *buffer, uint32_t width, uint32_t height )
 	VkImage srcImage;
 	VkImageLayout srcImageLayout;
 	VkImage dstImage;
-	byte *buffer_ptr;
 	byte *data;
-	uint32_t pixel_width;
-	uint32_t i, n;
 	qboolean invalidate_ptr;
 
 	VK_CHECK( qvkWaitForFences( vk.device, 1, &vk.cmd->rendering_finished_fence, VK_FALSE, 1e12 ) );
@@ -7347,55 +8973,7 @@ void vk_read_pixels( byte *buffer, uint32_t width, uint32_t height )
 
 	data += layout.offset;
 
-	switch ( vk.capture_format ) {
-		case VK_FORMAT_B4G4R4A4_UNORM_PACK16: pixel_width = 2; break;
-		case VK_FORMAT_R16G16B16A16_UNORM: pixel_width = 8; break;
-		default: pixel_width = 4; break;
-	}
-
-	buffer_ptr = buffer + width * (height - 1) * 3;
-	for ( i = 0; i < height; i++ ) {
-		switch ( pixel_width ) {
-			case 2: {
-				uint16_t *src = (uint16_t*)data;
-				for ( n = 0; n < width; n++ ) {
-					buffer_ptr[n*3+0] = ((src[n]>>12)&0xF)<<4;
-					buffer_ptr[n*3+1] = ((src[n]>>8)&0xF)<<4;
-					buffer_ptr[n*3+2] = ((src[n]>>4)&0xF)<<4;
-				}
-			} break;
-
-			case 4: {
-				for ( n = 0; n < width; n++ ) {
-					Com_Memcpy( &buffer_ptr[n*3], &data[n*4], 3 );
-					//buffer_ptr[n*3+0] = data[n*4+0];
-					//buffer_ptr[n*3+1] = data[n*4+1];
-					//buffer_ptr[n*3+2] = data[n*4+2];
-				}
-			} break;
-
-			case 8: {
-				const uint16_t *src = (uint16_t*)data;
-				for ( n = 0; n < width; n++ ) {
-					buffer_ptr[n*3+0] = src[n*4+0]>>8;
-					buffer_ptr[n*3+1] = src[n*4+1]>>8;
-					buffer_ptr[n*3+2] = src[n*4+2]>>8;
-				}
-			} break;
-		}
-		buffer_ptr -= width * 3;
-		data += layout.rowPitch;
-	}
-
-	if ( is_bgr( vk.capture_format ) ) {
-		buffer_ptr = buffer;
-		for ( i = 0; i < width * height; i++ ) {
-			byte tmp = buffer_ptr[0];
-			buffer_ptr[0] = buffer_ptr[2];
-			buffer_ptr[2] = tmp;
-			buffer_ptr += 3;
-		}
-	}
+	vk_convert_pixels( buffer, data, width, height, layout.rowPitch, vk.capture_format );
 
 	qvkDestroyImage( vk.device, dstImage, NULL );
 	qvkFreeMemory( vk.device, memory, NULL );
@@ -7414,6 +8992,56 @@ void vk_read_pixels( byte *buffer, uint32_t width, uint32_t height )
 }
 
 
+/*
+=================
+vk_read_video_pixels
+
+Called after submission, returns the frame captured by the oldest
+command buffer i.e. the one vk_begin_frame() will wait for next.
+Returns qfalse while the ring is filling up
+=================
+*/
+qboolean vk_read_video_pixels( byte *buffer, uint32_t width, uint32_t height )
+{
+	vk_tess_t *tess = &vk.tess[ vk.cmd_index ];
+	VkImageLayout layout;
+	VkImage image;
+	VkFormat format;
+	uint32_t pixel_width;
+
+	vk_readback_source( &image, &layout, &format );
+
+	if ( !vk_readback_format( format, &pixel_width ) ) {
+		vk_read_pixels( buffer, width, height );
+		return qtrue;
+	}
+
+	if ( !tess->readback_pending || tess->readback_width != width || tess->readback_height != height ) {
+		return qfalse;
+	}
+
+	if ( tess->waitForFence ) {
+		VK_CHECK( qvkWaitForFences( vk.device, 1, &tess->rendering_finished_fence, VK_FALSE, 1e12 ) );
+	}
+
+	if ( tess->readback_invalidate ) {
+		VkMappedMemoryRange range;
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.pNext = NULL;
+		range.memory = tess->readback_memory;
+		range.size = VK_WHOLE_SIZE;
+		range.offset = 0;
+		qvkInvalidateMappedMemoryRanges( vk.device, 1, &range );
+	}
+
+	vk_convert_pixels( buffer, tess->readback_ptr, width, height, width * pixel_width, tess->readback_format );
+
+	tess->readback_pending = qfalse;
+
+	return qtrue;
+}
+
+
 qboolean vk_bloom( void )
 {
 	uint32_t i;
@@ -7428,11 +9056,14 @@ qboolean vk_bloom( void )
 		return qfalse;
 	}
 
+	vk_gpu_timer( GPU_TIMER_BLOOM );
+
 	vk_end_render_pass(); // end main
 
 	// bloom extraction
 	vk_begin_bloom_extract_render_pass();
 	qvkCmdBindPipeline( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.bloom_extract_pipeline );
+	vk_set_post_process_viewport( 1 );
 	qvkCmdBindDescriptorSets( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.pipeline_layout_post_process, 0, 1, &vk.color_descriptor, 0, NULL );
 	qvkCmdDraw( vk.cmd->command_buffer, 4, 1, 0, 0 );
 	vk_end_render_pass();
@@ -7479,6 +9110,7 @@ qboolean vk_bloom( void )
 
 		// blend downscaled buffers to main fbo
 		qvkCmdBindPipeline( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.bloom_blend_pipeline );
+		vk_set_post_process_viewport( 2 );
 		qvkCmdBindDescriptorSets( vk.cmd->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vk.pipeline_layout_blend, 0, ARRAY_LEN(dset), dset, 0, NULL );
 		qvkCmdDraw( vk.cmd->command_buffer, 4, 1, 0, 0 );
 	}
@@ -7495,6 +9127,7 @@ qboolean vk_bloom( void )
 
 		// force depth range and viewport/scissor updates
 		vk.cmd->depth_range = DEPTH_RANGE_COUNT;
+		Com_Memset( &vk.cmd->scissor_rect, 0, sizeof( vk.cmd->scissor_rect ) );
 
 		// restore clobbered descriptor sets
 		for ( i = 0; i < VK_NUM_BLOOM_PASSES; i++ ) {
@@ -7509,5 +9142,7 @@ qboolean vk_bloom( void )
 
 	backEnd.doneBloom = qtrue;
 
+	vk_gpu_timer( GPU_TIMER_2D );
+
 	return qtrue;
 }
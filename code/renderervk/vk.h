@@ -16,7 +16,7 @@
 #define IMAGE_CHUNK_SIZE (32 * 1024 * 1024)
 #define MAX_IMAGE_CHUNKS 56
 
-#define NUM_COMMAND_BUFFERS 2	// number of command buffers / render semaphores / framebuffer sets
+#define MAX_COMMAND_BUFFERS 3	// max. number of command buffers / render semaphores / geometry buffers, see r_framesInFlight
 
 #define USE_REVERSED_DEPTH
 //#define USE_BUFFER_CLEAR
@@ -182,9 +182,20 @@ typedef struct {
 	} color;
 } Vk_Pipeline_Def;
 
+enum {
+	PIPELINE_IDLE,
+	PIPELINE_QUEUED,	// waiting for or being compiled by worker thread
+	PIPELINE_DONE,
+	PIPELINE_FAILED
+};
+
 typedef struct VK_Pipeline {
 	Vk_Pipeline_Def def;
 	VkPipeline handle[ RENDER_PASS_COUNT ];
+	// background compilation result, adopted by the main thread
+	VkPipeline asyncHandle;
+	renderPass_t asyncPass;
+	volatile int asyncState;
 } VK_Pipeline_t;
 
 // this structure must be in sync with shader uniforms!
@@ -232,12 +243,16 @@ void vk_initialize( void );
 // Called after initialization or renderer restart
 void vk_init_descriptors( void );
 
+// Applies changed r_fbo dependent settings without releasing other resources.
+void vk_restart_attachments( void );
+
 // Shutdown vulkan subsystem by releasing resources acquired by Vk_Instance.
 void vk_shutdown( refShutdownCode_t code );
 
 // Releases vulkan resources allocated during program execution.
 // This effectively puts vulkan subsystem into initial state (the state we have after vk_initialize call).
 void vk_release_resources( void );
+void vk_memory_info( void );
 
 void vk_wait_idle( void );
 
@@ -246,6 +261,7 @@ void vk_wait_idle( void );
 //
 void vk_create_image( image_t *image, int width, int height, int mip_levels );
 void vk_upload_image_data( image_t *image, int x, int y, int width, int height, int miplevels, byte *pixels, int size, qboolean update );
+void vk_upload_image_mipmaps( image_t *image, int width, int height, int miplevels, byte *pixels );
 void vk_update_descriptor_set( image_t *image, qboolean mipmap );
 void vk_destroy_image_resources( VkImage *image, VkImageView *imageView );
 
@@ -254,6 +270,7 @@ void vk_get_pipeline_def( uint32_t pipeline, Vk_Pipeline_Def *def );
 
 void vk_create_post_process_pipeline( int program_index, uint32_t width, uint32_t height );
 void vk_create_pipelines( void );
+void vk_precompile_pipelines( void );
 
 //
 // Rendering setup.
@@ -264,6 +281,7 @@ void vk_clear_depth( qboolean clear_stencil );
 void vk_begin_frame( void );
 void vk_end_frame( void );
 void vk_present_frame( void );
+void vk_wait_frame( void );
 
 void vk_end_render_pass( void );
 void vk_begin_main_render_pass( void );
@@ -276,14 +294,18 @@ void vk_bind_lighting( int stage, int bundle );
 void vk_draw_geometry( Vk_Depth_Range depth_range, qboolean indexed );
 
 void vk_read_pixels( byte* buffer, uint32_t width, uint32_t height ); // screenshots
+qboolean vk_read_video_pixels( byte *buffer, uint32_t width, uint32_t height );
 qboolean vk_bloom( void );
+void vk_gpu_timer( int timer );
 
 qboolean vk_alloc_vbo( const byte *vbo_data, int vbo_size );
 void vk_update_mvp( const float *m );
 
 uint32_t vk_tess_index( uint32_t numIndexes, const void *src );
+qboolean vk_reserve_geometry( VkDeviceSize size );
 void vk_bind_index_buffer( VkBuffer buffer, uint32_t offset );
 void vk_draw_indexed( uint32_t indexCount, uint32_t firstIndex );
+qboolean vk_draw_indexed_indirect( const VkDrawIndexedIndirectCommand *cmds, uint32_t count );
 
 void vk_reset_descriptor( int index );
 void vk_update_descriptor( int index, VkDescriptorSet descriptor );
@@ -305,11 +327,38 @@ typedef struct vk_tess_s {
 	VkFence rendering_finished_fence;
 	qboolean waitForFence;
 
+	uint64_t present_id;	// VK_KHR_present_id of this frame, 0 if not presented
+	qboolean timestamps;	// frame timestamps were submitted
+	uint32_t timestamp_count;
+	byte timestamp_timer[ MAX_GPU_TIMESTAMPS ];	// gpuTimer_t following each timestamp
+	int64_t input_time;		// when vk_wait_frame released the client to sample input
+
+	// video frame copied at the end of the frame
+	VkBuffer readback_buffer;
+	VkDeviceMemory readback_memory;
+	byte *readback_ptr;
+	VkDeviceSize readback_size;
+	qboolean readback_invalidate;	// memory is not host-coherent
+	qboolean readback_pending;
+	uint32_t readback_width;
+	uint32_t readback_height;
+	VkFormat readback_format;
+
 	VkBuffer vertex_buffer;
+	VkDeviceMemory vertex_buffer_memory;
 	byte *vertex_buffer_ptr; // pointer to mapped vertex buffer
 	VkDeviceSize vertex_buffer_offset;
+	VkDeviceSize vertex_buffer_size;
 
 	VkDescriptorSet uniform_descriptor;
+	VkDescriptorSet spare_descriptor; // takes over uniform_descriptor when the buffer grows
+
+	// replaced by a grown buffer but still used by this frame, released after its fence
+	struct {
+		VkBuffer		buffer;
+		VkDeviceMemory	memory;
+		VkDescriptorSet	descriptor;
+	} retired;
 	uint32_t		uniform_read_offset;
 	VkDeviceSize	buf_offset[8];
 	VkDeviceSize	vbo_offset[8];
@@ -418,8 +467,9 @@ typedef struct {
 		VkFramebuffer capture;
 	} framebuffers;
 
-	vk_tess_t tess[ NUM_COMMAND_BUFFERS ], *cmd;
+	vk_tess_t tess[ MAX_COMMAND_BUFFERS ], *cmd;
 	int cmd_index;
+	uint32_t num_command_buffers;	// frames in flight
 
 	struct {
 		VkBuffer		buffer;
@@ -437,14 +487,18 @@ typedef struct {
 		VkDeviceMemory	buffer_memory;
 	} vbo;
 
-	// host visible memory that holds vertex, index and uniform data
-	VkDeviceMemory geometry_buffer_memory;
+	// host visible memory that holds vertex, index and uniform data,
+	// each frame has its own buffer that is grown to geometry_buffer_size
 	VkDeviceSize geometry_buffer_size;
 	VkDeviceSize geometry_buffer_size_new;
+	qboolean geometry_buffer_device_local;
 
 	// statistics
 	struct {
 		VkDeviceSize vertex_buffer_max;
+		VkDeviceSize vertex_buffer_total;	// streamed since last reset
+		uint32_t frames;
+		uint32_t geometry_grows;
 		uint32_t push_size;
 		uint32_t push_size_max;
 	} stats;
@@ -549,10 +603,19 @@ typedef struct {
 	qboolean wideLines;
 	qboolean samplerAnisotropy;
 	qboolean fragmentStores;
+	qboolean multiDrawIndirect;
+	qboolean textureCompressionBC;
+	qboolean mipmapBlit;		// mip chains of RGBA8 images can be generated with blits
 	qboolean dedicatedAllocation;
 	qboolean debugMarkers;
+	qboolean presentWait;		// VK_KHR_present_id and VK_KHR_present_wait are enabled
+	qboolean memoryBudget;		// VK_EXT_memory_budget is enabled
+
+	uint64_t present_id;		// last id passed to vkQueuePresentKHR
+	int64_t input_time;
 
 	float maxAnisotropy;
+	uint32_t maxDrawIndirectCount;
 	float maxLod;
 
 	VkFormat color_format;
@@ -580,6 +643,17 @@ typedef struct {
 	float renderScaleX;
 	float renderScaleY;
 
+	// r_dynamicResolution, main render pass covers dynamicScale of the attachments
+	qboolean dynamicResolution;
+	float dynamicScale;			// fixed within a frame
+	float gpuFrameTime;			// average of the last period, milliseconds
+	float gpuTimeSum;
+	int gpuTimeCount;
+	float timestampPeriod;		// nanoseconds per tick, zero if not supported
+	VkQueryPool timestampPool;	// MAX_GPU_TIMESTAMPS per command buffer
+	qboolean timestampsActive;	// recording into the current command buffer
+	qboolean gpuTimers;			// per-pass timings requested
+
 	renderPass_t renderPassIndex;
 
 	uint32_t screenMapWidth;
@@ -594,7 +668,10 @@ typedef struct {
 
 typedef struct {
 	VkDeviceMemory memory;
+	VkDeviceSize size;
 	VkDeviceSize used;
+	uint32_t memory_type;
+	uint32_t images;
 } ImageChunk;
 
 // Vk_World contains vulkan resources/state requested by the game code.
@@ -618,6 +695,8 @@ typedef struct {
 	VkDeviceMemory staging_buffer_memory;
 	VkDeviceSize staging_buffer_size;
 	byte *staging_buffer_ptr; // pointer to mapped staging buffer
+	VkDeviceSize staging_offset; // end of data used by pending uploads
+	VkCommandBuffer upload_command_buffer; // pending image uploads, see vk_flush_uploads()
 
 	//
 	// State.
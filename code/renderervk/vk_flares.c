@@ -294,7 +294,6 @@ RB_TestFlare
 static void RB_TestFlare( flare_t *f ) {
 	qboolean		visible;
 	float			fade;
-	float			*m;
 	uint32_t		offset;
 
 	backEnd.pc.c_flareTests++;
@@ -311,30 +310,29 @@ static void RB_TestFlare( flare_t *f ) {
 	In next frame we read storage buffer: if there is a non-zero value
 	then our flare WAS visible (as we're working with 1-frame delay),
 	multisampled image will cause multiple fragment shader invocations.
+
+	Every command buffer owns its own set of test slots: the slot we are
+	about to overwrite was last written by this very command buffer whose
+	fence has already been waited on in vk_begin_frame(), so the host never
+	reads a value that is still in flight and never has to stall for it,
+	at the cost of r_framesInFlight frames of latency instead of one.
 */
 
 	// we neeed only single uint32_t but take care of alignment
-	offset = (f - r_flareStructs) * vk.storage_alignment;
+	offset = ( ( vk.cmd - vk.tess ) * MAX_FLARES + ( f - r_flareStructs ) ) * vk.storage_alignment;
 
-	if ( f->testCount ) {
+	if ( f->testCount >= vk.num_command_buffers ) {
 		uint32_t *cnt = (uint32_t*)(vk.storage.buffer_ptr + offset);
 		if ( *cnt )
 			visible = qtrue;
 		else
 			visible = qfalse;
 
-		f->testCount = 1;
+		f->testCount = vk.num_command_buffers;
 	} else {
 		visible = qfalse;
 	}
 
-	// reset test result in storage buffer
-	// *((uint32_t*)(vk.storage.buffer_ptr + offset)) = 0x00;
-
-	m = vk_ortho( backEnd.viewParms.viewportX, backEnd.viewParms.viewportX + backEnd.viewParms.viewportWidth,
-		backEnd.viewParms.viewportY, backEnd.viewParms.viewportY + backEnd.viewParms.viewportHeight, 0, 1 );
-	vk_update_mvp( m );
-
 	tess.xyz[0][0] = f->windowX;
 	tess.xyz[0][1] = f->windowY;
 	tess.xyz[0][2] = -f->drawZ;
@@ -343,12 +341,11 @@ static void RB_TestFlare( flare_t *f ) {
 #ifdef USE_VBO
 	tess.vboIndex = 0;
 #endif
-	// render test dot
+	// render test dot, a new dynamic offset needs the set to be rebound
 	vk_reset_descriptor( VK_DESC_STORAGE );
 	vk_update_descriptor( VK_DESC_STORAGE, vk.storage.descriptor );
 	vk_update_descriptor_offset( VK_DESC_STORAGE, offset );
 
-	vk_bind_pipeline( vk.dot_pipeline );
 	vk_bind_geometry( TESS_XYZ );
 	vk_draw_geometry( DEPTH_RANGE_NORMAL, qfalse );
 
@@ -480,6 +477,7 @@ void RB_RenderFlares( void ) {
 	flare_t		**prev;
 	qboolean	draw;
 	float		*m;
+	qboolean	testing;
 
 	if ( !r_flares->integer ) {
 		return;
@@ -502,6 +500,7 @@ void RB_RenderFlares( void ) {
 
 	// perform z buffer readback on each flare in this view
 	draw = qfalse;
+	testing = qfalse;
 	prev = &r_activeFlares;
 	while ( ( f = *prev ) != NULL ) {
 		// throw out any flares that weren't added last frame
@@ -515,9 +514,17 @@ void RB_RenderFlares( void ) {
 		// don't draw any here that aren't from this scene / portal
 		f->drawIntensity = 0;
 		if ( f->frameSceneNum == backEnd.viewParms.frameSceneNum && f->portalView == backEnd.viewParms.portalView ) {
+			if ( !testing ) {
+				// test dots of this view share projection and pipeline
+				m = vk_ortho( backEnd.viewParms.viewportX, backEnd.viewParms.viewportX + backEnd.viewParms.viewportWidth,
+					backEnd.viewParms.viewportY, backEnd.viewParms.viewportY + backEnd.viewParms.viewportHeight, 0, 1 );
+				vk_update_mvp( m );
+				vk_bind_pipeline( vk.dot_pipeline );
+				testing = qtrue;
+			}
 			RB_TestFlare( f );
-			if ( f->testCount == 0 ) {
-				// recently added, wait 1 frame for test result
+			if ( f->testCount < vk.num_command_buffers ) {
+				// recently added, wait for test result
 			} else if ( f->drawIntensity ) {
 				draw = qtrue;
 			} else {
@@ -0,0 +1,498 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "tr_local.h"
+#include "vk.h"
+
+/*
+
+Compressed texture cache
+
+Mipmapped images are block-compressed once with all their mip levels
+into BC1 (opaque) or BC3 (with alpha) and saved as texcache/<name>.bcn
+in the home path. Later loads upload the file directly, skipping
+resampling, mipmapping and light scaling, with 1/8 or 1/4 of the
+RGBA8 memory and upload size.
+
+Each file keeps a key built from source pixels, image flags and every
+setting that changes the processed image, a mismatching file is simply
+encoded again and overwritten.
+
+*/
+
+#define TEXCACHE_IDENT		(('1'<<24)+('N'<<16)+('C'<<8)+'B')
+#define TEXCACHE_VERSION	1
+
+typedef struct {
+	int32_t		ident;
+	int32_t		version;
+	uint32_t	key;
+	int32_t		format;		// 1 - BC1, 3 - BC3
+	int32_t		width;
+	int32_t		height;
+	int32_t		mipLevels;
+	int32_t		size;		// of all compressed levels following the header
+} texCacheHeader_t;
+
+typedef struct {
+	const byte	*src;
+	byte		*dst;
+	int			width;
+	int			height;
+	int			blockBytes;
+} bcnJob_t;
+
+
+/*
+=================
+R_TexCacheHash
+
+FNV-1a, buffer size must be a multiple of 4 bytes
+=================
+*/
+uint32_t R_TexCacheHash( uint32_t hash, const void *data, int size )
+{
+	const uint32_t *p = (const uint32_t *)data;
+	int i;
+
+	for ( i = 0; i < size / 4; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619U;
+	}
+
+	return hash;
+}
+
+
+/*
+=================
+R_TexCacheEnabled
+=================
+*/
+qboolean R_TexCacheEnabled( const image_t *image )
+{
+	if ( !r_textureCache->integer || !vk.textureCompressionBC )
+		return qfalse;
+
+	if ( !( image->flags & IMGFLAG_MIPMAP ) || ( image->flags & ( IMGFLAG_LIGHTMAP | IMGFLAG_NO_COMPRESSION ) ) )
+		return qfalse;
+
+	// development aid, not worth caching
+	if ( r_colorMipLevels->integer )
+		return qfalse;
+
+	// generated internally
+	if ( image->imgName[0] == '*' )
+		return qfalse;
+
+	return qtrue;
+}
+
+
+static void R_TexCacheName( const image_t *image, char *name, int size )
+{
+	char base[ MAX_QPATH ];
+
+	COM_StripExtension( image->imgName, base, sizeof( base ) );
+	Com_sprintf( name, size, "texcache/%s.bcn", base );
+}
+
+
+static void GetBlock( const byte *src, int width, int height, int bx, int by, byte block[16][4] )
+{
+	const byte *p;
+	int x, y, sx, sy;
+
+	// levels smaller than a block repeat their edge
+	for ( y = 0; y < 4; y++ ) {
+		sy = MIN( by * 4 + y, height - 1 );
+		for ( x = 0; x < 4; x++ ) {
+			sx = MIN( bx * 4 + x, width - 1 );
+			p = src + ( sy * width + sx ) * 4;
+			block[ y * 4 + x ][0] = p[0];
+			block[ y * 4 + x ][1] = p[1];
+			block[ y * 4 + x ][2] = p[2];
+			block[ y * 4 + x ][3] = p[3];
+		}
+	}
+}
+
+
+static uint16_t PackRGB565( const int *c )
+{
+	return ( ( c[0] >> 3 ) << 11 ) | ( ( c[1] >> 2 ) << 5 ) | ( c[2] >> 3 );
+}
+
+
+static void UnpackRGB565( uint16_t v, int *c )
+{
+	c[0] = ( v >> 11 ) & 31;
+	c[1] = ( v >> 5 ) & 63;
+	c[2] = v & 31;
+
+	c[0] = ( c[0] << 3 ) | ( c[0] >> 2 );
+	c[1] = ( c[1] << 2 ) | ( c[1] >> 4 );
+	c[2] = ( c[2] << 3 ) | ( c[2] >> 2 );
+}
+
+
+/*
+=================
+EncodeColorBlock
+
+Inset bounding box endpoints on the diagonal that follows the
+dominant direction of the block colors, four-color mode only
+=================
+*/
+static void EncodeColorBlock( const byte block[16][4], byte *out )
+{
+	int mins[3], maxs[3], mid[3], palette[4][3];
+	int i, j, inset, best, bestDist, dist, d;
+	int covRB, covGB, t;
+	uint16_t c0, c1;
+	uint32_t indexes;
+
+	mins[0] = mins[1] = mins[2] = 255;
+	maxs[0] = maxs[1] = maxs[2] = 0;
+
+	for ( i = 0; i < 16; i++ ) {
+		for ( j = 0; j < 3; j++ ) {
+			if ( block[i][j] < mins[j] ) mins[j] = block[i][j];
+			if ( block[i][j] > maxs[j] ) maxs[j] = block[i][j];
+		}
+	}
+
+	covRB = covGB = 0;
+	for ( j = 0; j < 3; j++ ) {
+		mid[j] = ( mins[j] + maxs[j] ) >> 1;
+	}
+	for ( i = 0; i < 16; i++ ) {
+		covRB += ( block[i][0] - mid[0] ) * ( block[i][2] - mid[2] );
+		covGB += ( block[i][1] - mid[1] ) * ( block[i][2] - mid[2] );
+	}
+
+	for ( j = 0; j < 3; j++ ) {
+		inset = ( maxs[j] - mins[j] ) >> 4;
+		mins[j] += inset;
+		maxs[j] -= inset;
+	}
+
+	if ( covRB < 0 ) {
+		t = mins[0]; mins[0] = maxs[0]; maxs[0] = t;
+	}
+	if ( covGB < 0 ) {
+		t = mins[1]; mins[1] = maxs[1]; maxs[1] = t;
+	}
+
+	c0 = PackRGB565( maxs );
+	c1 = PackRGB565( mins );
+
+	if ( c0 < c1 ) {
+		uint16_t c = c0; c0 = c1; c1 = c;
+	}
+
+	indexes = 0;
+
+	if ( c0 != c1 ) {
+		UnpackRGB565( c0, palette[0] );
+		UnpackRGB565( c1, palette[1] );
+		for ( j = 0; j < 3; j++ ) {
+			palette[2][j] = ( 2 * palette[0][j] + palette[1][j] ) / 3;
+			palette[3][j] = ( palette[0][j] + 2 * palette[1][j] ) / 3;
+		}
+
+		for ( i = 0; i < 16; i++ ) {
+			best = 0;
+			bestDist = INT_MAX;
+			for ( j = 0; j < 4; j++ ) {
+				d = block[i][0] - palette[j][0]; dist = d * d;
+				d = block[i][1] - palette[j][1]; dist += d * d;
+				d = block[i][2] - palette[j][2]; dist += d * d;
+				if ( dist < bestDist ) {
+					bestDist = dist;
+					best = j;
+				}
+			}
+			indexes |= (uint32_t)best << ( i * 2 );
+		}
+	}
+
+	out[0] = c0 & 255;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 255;
+	out[3] = c1 >> 8;
+	out[4] = indexes & 255;
+	out[5] = ( indexes >> 8 ) & 255;
+	out[6] = ( indexes >> 16 ) & 255;
+	out[7] = indexes >> 24;
+}
+
+
+/*
+=================
+EncodeAlphaBlock
+
+Eight interpolated alpha values between block minimum and maximum
+=================
+*/
+static void EncodeAlphaBlock( const byte block[16][4], byte *out )
+{
+	int a0, a1, palette[8];
+	int i, j, best, bestDist, dist;
+	uint64_t indexes;
+
+	a0 = 0;
+	a1 = 255;
+	for ( i = 0; i < 16; i++ ) {
+		if ( block[i][3] > a0 ) a0 = block[i][3];
+		if ( block[i][3] < a1 ) a1 = block[i][3];
+	}
+
+	indexes = 0;
+
+	if ( a0 != a1 ) {
+		palette[0] = a0;
+		palette[1] = a1;
+		for ( j = 1; j < 7; j++ ) {
+			palette[j + 1] = ( ( 7 - j ) * a0 + j * a1 ) / 7;
+		}
+
+		for ( i = 0; i < 16; i++ ) {
+			best = 0;
+			bestDist = INT_MAX;
+			for ( j = 0; j < 8; j++ ) {
+				dist = abs( block[i][3] - palette[j] );
+				if ( dist < bestDist ) {
+					bestDist = dist;
+					best = j;
+				}
+			}
+			indexes |= (uint64_t)best << ( i * 3 );
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for ( i = 0; i < 6; i++ ) {
+		out[i + 2] = ( indexes >> ( i * 8 ) ) & 255;
+	}
+}
+
+
+static void BCnJob( void *data, int index )
+{
+	const bcnJob_t *job = (const bcnJob_t *)data;
+	byte block[16][4];
+	byte *out;
+	int bx, blocksX;
+
+	blocksX = ( job->width + 3 ) / 4;
+	out = job->dst + index * blocksX * job->blockBytes;
+
+	for ( bx = 0; bx < blocksX; bx++, out += job->blockBytes ) {
+		GetBlock( job->src, job->width, job->height, bx, index, block );
+		if ( job->blockBytes == 16 ) {
+			EncodeAlphaBlock( block, out );
+			EncodeColorBlock( block, out + 8 );
+		} else {
+			EncodeColorBlock( block, out );
+		}
+	}
+}
+
+
+static int LevelSize( int width, int height, int blockBytes )
+{
+	return ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * blockBytes;
+}
+
+
+/*
+=================
+R_TexCacheLoad
+
+Reads a compressed image saved for the same key
+=================
+*/
+qboolean R_TexCacheLoad( const image_t *image, uint32_t key, texCacheData_t *out )
+{
+	char name[ MAX_QPATH ];
+	texCacheHeader_t hdr;
+	void *buf;
+	int size, blockBytes, w, h, i, dataSize;
+
+	Com_Memset( out, 0, sizeof( *out ) );
+
+	R_TexCacheName( image, name, sizeof( name ) );
+
+	size = ri.FS_ReadFile( name, &buf );
+	if ( !buf ) {
+		return qfalse;
+	}
+
+	if ( size < (int)sizeof( hdr ) ) {
+		ri.FS_FreeFile( buf );
+		return qfalse;
+	}
+
+	Com_Memcpy( &hdr, buf, sizeof( hdr ) );
+	hdr.ident = LittleLong( hdr.ident );
+	hdr.version = LittleLong( hdr.version );
+	hdr.key = LittleLong( hdr.key );
+	hdr.format = LittleLong( hdr.format );
+	hdr.width = LittleLong( hdr.width );
+	hdr.height = LittleLong( hdr.height );
+	hdr.mipLevels = LittleLong( hdr.mipLevels );
+	hdr.size = LittleLong( hdr.size );
+
+	if ( hdr.ident != TEXCACHE_IDENT || hdr.version != TEXCACHE_VERSION || hdr.key != key
+		|| ( hdr.format != 1 && hdr.format != 3 ) || hdr.mipLevels < 1 || hdr.mipLevels > 16
+		|| hdr.width < 1 || hdr.height < 1 || hdr.width > glConfig.maxTextureSize || hdr.height > glConfig.maxTextureSize ) {
+		ri.FS_FreeFile( buf );
+		return qfalse;
+	}
+
+	// validate size against the mip chain
+	blockBytes = ( hdr.format == 1 ) ? 8 : 16;
+	w = hdr.width;
+	h = hdr.height;
+	dataSize = 0;
+	for ( i = 0; i < hdr.mipLevels; i++ ) {
+		dataSize += LevelSize( w, h, blockBytes );
+		w = MAX( w >> 1, 1 );
+		h = MAX( h >> 1, 1 );
+	}
+
+	if ( dataSize != hdr.size || size < (int)sizeof( hdr ) + dataSize ) {
+		ri.FS_FreeFile( buf );
+		return qfalse;
+	}
+
+	out->fileBuffer = buf;
+	out->data = (byte *)buf + sizeof( hdr );
+	out->size = dataSize;
+	out->format = ( hdr.format == 1 ) ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+	out->width = hdr.width;
+	out->height = hdr.height;
+	out->mipLevels = hdr.mipLevels;
+
+	return qtrue;
+}
+
+
+/*
+=================
+R_TexCacheEncode
+
+Compresses processed RGBA mip levels and saves them for later loads,
+base dimensions must be a multiple of the block size
+=================
+*/
+qboolean R_TexCacheEncode( const image_t *image, uint32_t key, const byte *mips, int width, int height, int mipLevels, texCacheData_t *out )
+{
+	char name[ MAX_QPATH ];
+	texCacheHeader_t *hdr;
+	qboolean alpha;
+	bcnJob_t job;
+	byte *dst;
+	int i, w, h, size, blockBytes;
+
+	Com_Memset( out, 0, sizeof( *out ) );
+
+	if ( ( width & 3 ) || ( height & 3 ) || mipLevels > 16 ) {
+		return qfalse;
+	}
+
+	alpha = qfalse;
+	for ( i = 0; i < width * height; i++ ) {
+		if ( mips[ i * 4 + 3 ] != 255 ) {
+			alpha = qtrue;
+			break;
+		}
+	}
+
+	blockBytes = alpha ? 16 : 8;
+
+	w = width;
+	h = height;
+	size = 0;
+	for ( i = 0; i < mipLevels; i++ ) {
+		size += LevelSize( w, h, blockBytes );
+		w = MAX( w >> 1, 1 );
+		h = MAX( h >> 1, 1 );
+	}
+
+	out->buffer = ri.Hunk_AllocateTempMemory( sizeof( *hdr ) + size );
+
+	hdr = (texCacheHeader_t *)out->buffer;
+	hdr->ident = LittleLong( TEXCACHE_IDENT );
+	hdr->version = LittleLong( TEXCACHE_VERSION );
+	hdr->key = LittleLong( key );
+	hdr->format = LittleLong( alpha ? 3 : 1 );
+	hdr->width = LittleLong( width );
+	hdr->height = LittleLong( height );
+	hdr->mipLevels = LittleLong( mipLevels );
+	hdr->size = LittleLong( size );
+
+	dst = out->buffer + sizeof( *hdr );
+
+	job.blockBytes = blockBytes;
+	job.src = mips;
+	job.width = width;
+	job.height = height;
+	for ( i = 0; i < mipLevels; i++ ) {
+		job.dst = dst;
+		ri.ParallelFor( BCnJob, &job, ( job.height + 3 ) / 4 );
+		dst += LevelSize( job.width, job.height, blockBytes );
+		job.src += job.width * job.height * 4;
+		job.width = MAX( job.width >> 1, 1 );
+		job.height = MAX( job.height >> 1, 1 );
+	}
+
+	R_TexCacheName( image, name, sizeof( name ) );
+	ri.FS_WriteFile( name, out->buffer, sizeof( *hdr ) + size );
+
+	out->data = out->buffer + sizeof( *hdr );
+	out->size = size;
+	out->format = alpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	out->width = width;
+	out->height = height;
+	out->mipLevels = mipLevels;
+
+	return qtrue;
+}
+
+
+/*
+=================
+R_TexCacheFree
+=================
+*/
+void R_TexCacheFree( texCacheData_t *data )
+{
+	if ( data->fileBuffer ) {
+		ri.FS_FreeFile( data->fileBuffer );
+	} else if ( data->buffer ) {
+		ri.Hunk_FreeTempMemory( data->buffer );
+	}
+
+	Com_Memset( data, 0, sizeof( *data ) );
+}
@@ -44,12 +44,18 @@ So long device-local index runs are rendered via multiple draw calls,
 all remaining short index sequences are grouped together into single
 host-visible index buffer which is finally rendered via single draw call.
 
+With r_vboIndirect and multiDrawIndirect support every run is instead
+drawn from device-local memory by one indirect draw, so nothing but
+20 bytes of draw parameters per run is copied at render time.
+
 */
 
 #define MAX_VBO_STAGES MAX_SHADER_STAGES
 
 #define MIN_IBO_RUN 320
 
+#define MAX_INDIRECT_BATCH 256
+
 //[ibo]: [index0][index1][index2]
 //[vbo]: [index0][vertex0...][index1][vertex1...][index2][vertex2...]
 
@@ -463,11 +469,90 @@ void VBO_UnBind( void )
 }
 
 
+static const msurface_t *surfSortBase;
+static const uint32_t *surfSortKeys;
+
 static int surfSortFunc( const void *a, const void *b )
 {
 	const msurface_t **sa = (const msurface_t **)a;
 	const msurface_t **sb = (const msurface_t **)b;
-	return (*sa)->shader - (*sb)->shader;
+	uint32_t ka, kb;
+
+	if ( (*sa)->shader != (*sb)->shader )
+		return (*sa)->shader - (*sb)->shader;
+
+	// spatial order within shader
+	ka = surfSortKeys[ *sa - surfSortBase ];
+	kb = surfSortKeys[ *sb - surfSortBase ];
+	if ( ka != kb )
+		return ka < kb ? -1 : 1;
+
+	return *sa - *sb;
+}
+
+
+/*
+=============
+spreadBits
+
+Spreads low 10 bits of value to every third bit for morton codes
+=============
+*/
+static uint32_t spreadBits( uint32_t v )
+{
+	v &= 0x3FF;
+	v = ( v | ( v << 16 ) ) & 0x030000FF;
+	v = ( v | ( v << 8 ) ) & 0x0300F00F;
+	v = ( v | ( v << 4 ) ) & 0x030C30C3;
+	v = ( v | ( v << 2 ) ) & 0x09249249;
+	return v;
+}
+
+
+/*
+=============
+R_SurfaceSortKeys
+
+Morton codes of surface centers, surfaces of the same shader that are
+close to each other get adjacent index ranges and so tend to be visible
+together, which lets VBO_PrepareQueues() draw them as one longer run
+=============
+*/
+static uint32_t *R_SurfaceSortKeys( const msurface_t *surf, int surfCount )
+{
+	uint32_t *keys;
+	vec3_t mins, maxs, center;
+	float scale[3];
+	int i, j, q[3];
+
+	keys = ri.Hunk_AllocateTempMemory( surfCount * sizeof( keys[0] ) );
+
+	ClearBounds( mins, maxs );
+	for ( i = 0; i < surfCount; i++ ) {
+		if ( surf[i].bounds[0][0] <= surf[i].bounds[1][0] ) {
+			AddPointToBounds( surf[i].bounds[0], mins, maxs );
+			AddPointToBounds( surf[i].bounds[1], mins, maxs );
+		}
+	}
+
+	for ( j = 0; j < 3; j++ ) {
+		scale[j] = ( maxs[j] > mins[j] ) ? 1023.0f / ( maxs[j] - mins[j] ) : 0.0f;
+	}
+
+	for ( i = 0; i < surfCount; i++ ) {
+		if ( surf[i].bounds[0][0] > surf[i].bounds[1][0] ) {
+			keys[i] = 0;
+			continue;
+		}
+		VectorAdd( surf[i].bounds[0], surf[i].bounds[1], center );
+		for ( j = 0; j < 3; j++ ) {
+			q[j] = (int)( ( center[j] * 0.5f - mins[j] ) * scale[j] );
+			q[j] = MAX( 0, MIN( q[j], 1023 ) );
+		}
+		keys[i] = spreadBits( q[0] ) | ( spreadBits( q[1] ) << 1 ) | ( spreadBits( q[2] ) << 2 );
+	}
+
+	return keys;
 }
 
 
@@ -583,7 +668,7 @@ void R_BuildWorldVBO( msurface_t *surf, int surfCount )
 	vbo->ibo_size = ibo_size;
 
 	// ibo runs buffer
-	vbo->ibo_items = ri.Hunk_Alloc( ( (numStaticIndexes / MIN_IBO_RUN) + 1 ) * sizeof( ibo_item_t ), h_low );
+	vbo->ibo_items = ri.Hunk_Alloc( ( numStaticSurfaces + 1 ) * sizeof( ibo_item_t ), h_low );
 	vbo->ibo_items_count = 0;
 
 	surfList = ri.Hunk_AllocateTempMemory( numStaticSurfaces * sizeof( msurface_t* ) );
@@ -610,8 +695,12 @@ void R_BuildWorldVBO( msurface_t *surf, int surfCount )
 		ri.Error( ERR_DROP, "Invalid VBO surface count" );
 	}
 
-	// sort surfaces by shader
+	// sort surfaces by shader and location
+	surfSortKeys = R_SurfaceSortKeys( surf, surfCount );
+	surfSortBase = surf;
 	qsort( surfList, numStaticSurfaces, sizeof( surfList[0] ), surfSortFunc );
+	ri.Hunk_FreeTempMemory( (void *)surfSortKeys );
+	surfSortKeys = NULL;
 
 	tess.numIndexes = 0;
 	tess.numVertexes = 0;
@@ -711,6 +800,19 @@ void VBO_Cleanup( void )
 }
 
 
+/*
+=============
+VBO_Size
+
+Bytes of static world geometry in video memory, indexes included
+=============
+*/
+int VBO_Size( void )
+{
+	return world_vbo.vbo_size;
+}
+
+
 /*
 =============
 qsort_int
@@ -841,7 +943,30 @@ void VBO_RenderIBOItems( void )
 	{
 		vk_bind_index_buffer( vk.vbo.vertex_buffer, tess.shader->iboOffset );
 
-		for ( i = 0; i < vbo->ibo_items_count; i++ )
+		i = 0;
+		if ( vbo->ibo_items_count > 1 && vk.multiDrawIndirect )
+		{
+			VkDrawIndexedIndirectCommand cmds[ MAX_INDIRECT_BATCH ];
+			int n, count;
+
+			while ( i < vbo->ibo_items_count )
+			{
+				count = MIN( vbo->ibo_items_count - i, MAX_INDIRECT_BATCH );
+				for ( n = 0; n < count; n++ )
+				{
+					cmds[ n ].indexCount = vbo->ibo_items[ i + n ].length;
+					cmds[ n ].instanceCount = 1;
+					cmds[ n ].firstIndex = vbo->ibo_items[ i + n ].offset;
+					cmds[ n ].vertexOffset = 0;
+					cmds[ n ].firstInstance = 0;
+				}
+				if ( !vk_draw_indexed_indirect( cmds, count ) )
+					break; // draw the rest directly
+				i += count;
+			}
+		}
+
+		for ( ; i < vbo->ibo_items_count; i++ )
 		{
 			vk_draw_indexed( vbo->ibo_items[ i ].length, vbo->ibo_items[ i ].offset );
 		}
@@ -860,7 +985,7 @@ void VBO_RenderIBOItems( void )
 void VBO_PrepareQueues( void )
 {
 	vbo_t *vbo = &world_vbo;
-	int i, item_run, index_run, n;
+	int i, item_run, index_run, n, min_run;
 	const int *a;
 
 	vbo->items_queue[ vbo->items_queue_count ] = 0; // terminate run
@@ -872,12 +997,18 @@ void VBO_PrepareQueues( void )
 	vbo->soft_buffer_indexes = 0;
 	vbo->ibo_items_count = 0;
 
+	// indirect draws make every device-local run as cheap as copying its indexes
+	if ( r_vboIndirect->integer && vk.multiDrawIndirect )
+		min_run = 0;
+	else
+		min_run = MIN_IBO_RUN;
+
 	a = vbo->items_queue;
 	i = 0;
 	while ( i < vbo->items_queue_count )
 	{
 		item_run = run_length( a, i, vbo->items_queue_count, &index_run );
-		if ( index_run < MIN_IBO_RUN )
+		if ( index_run < min_run )
 		{
 			for ( n = 0; n < item_run; n++ )
 				VBO_AddItemDataToSoftBuffer( a[ i + n ] );
@@ -661,6 +661,22 @@ void GLimp_EndFrame( void )
 }
 
 
+/*
+===============
+GLimp_MakeCurrent
+
+Moves the context between the main and the render thread
+===============
+*/
+qboolean GLimp_MakeCurrent( qboolean current )
+{
+	if ( current )
+		return SDL_GL_MakeCurrent( SDL_window, SDL_glContext ) == 0 ? qtrue : qfalse;
+	else
+		return SDL_GL_MakeCurrent( SDL_window, NULL ) == 0 ? qtrue : qfalse;
+}
+
+
 /*
 ===============
 GL_GetProcAddress
@@ -29,6 +29,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "../client/client.h"
 #include "sdl_glw.h"
 
+#if !defined( _WIN32 ) && !defined( __APPLE__ )
+#define USE_RAW_INPUT_THREAD
+#include "../unix/linux_local.h"
+#endif
+
 static cvar_t *in_keyboardDebug;
 static cvar_t *in_forceCharset;
 
@@ -399,6 +404,23 @@ static void IN_GobbleMouseEvents( void )
 
 //#define DEBUG_EVENTS
 
+/*
+===============
+IN_RawMouseEvents
+
+True when motion, buttons 1-3 and wheel come from the input thread
+===============
+*/
+static qboolean IN_RawMouseEvents( void )
+{
+#ifdef USE_RAW_INPUT_THREAD
+	return IN_RawInputRunning();
+#else
+	return qfalse;
+#endif
+}
+
+
 /*
 ===============
 IN_ActivateMouse
@@ -421,6 +443,10 @@ static void IN_ActivateMouse( void )
 
 		SDL_WarpMouseInWindow( SDL_window, glw_state.window_width / 2, glw_state.window_height / 2 );
 
+#ifdef USE_RAW_INPUT_THREAD
+		IN_SetRawInputActive( qtrue );
+#endif
+
 #ifdef DEBUG_EVENTS
 		Com_Printf( "%4i %s\n", Sys_Milliseconds(), __func__ );
 #endif
@@ -464,6 +490,10 @@ static void IN_DeactivateMouse( void )
 #endif
 		IN_GobbleMouseEvents();
 
+#ifdef USE_RAW_INPUT_THREAD
+		IN_SetRawInputActive( qfalse );
+#endif
+
 		SDL_SetWindowGrab( SDL_window, SDL_FALSE );
 		SDL_SetRelativeMouseMode( SDL_FALSE );
 
@@ -1208,7 +1238,7 @@ void HandleEvents( void )
 				break;
 
 			case SDL_MOUSEMOTION:
-				if( mouseActive )
+				if( mouseActive && !IN_RawMouseEvents() )
 				{
 					if( !e.motion.xrel && !e.motion.yrel )
 						break;
@@ -1220,6 +1250,8 @@ void HandleEvents( void )
 			case SDL_MOUSEBUTTONUP:
 				{
 					int b;
+					if( e.button.button <= SDL_BUTTON_RIGHT && mouseActive && IN_RawMouseEvents() )
+						break;
 					switch( e.button.button )
 					{
 						case SDL_BUTTON_LEFT:   b = K_MOUSE1;     break;
@@ -1235,6 +1267,8 @@ void HandleEvents( void )
 				break;
 
 			case SDL_MOUSEWHEEL:
+				if( mouseActive && IN_RawMouseEvents() )
+					break;
 				if( e.wheel.y > 0 )
 				{
 					Com_QueueEvent( in_eventTime, SE_KEY, K_MWHEELUP, qtrue, 0, NULL );
@@ -1461,6 +1495,15 @@ void IN_Init( void )
 
 	mouseAvailable = ( in_mouse->value != 0 ) ? qtrue : qfalse;
 
+#ifdef USE_RAW_INPUT_THREAD
+	// raw X events only matter with the x11 video driver
+	{
+		const char *driver = SDL_GetCurrentVideoDriver();
+		if ( driver && !Q_stricmp( driver, "x11" ) )
+			IN_InitRawInput();
+	}
+#endif
+
 	SDL_StartTextInput();
 
 	//IN_DeactivateMouse();
@@ -1487,6 +1530,10 @@ void IN_Shutdown( void )
 
 	IN_DeactivateMouse();
 
+#ifdef USE_RAW_INPUT_THREAD
+	IN_ShutdownRawInput();
+#endif
+
 	mouseAvailable = qfalse;
 
 #ifdef USE_JOYSTICK
@@ -37,13 +37,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
+	int			gridCell;			// sv_areaGrid cell + 1, 0 if not linked there
+	int			gridSlot;
 
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -56,8 +57,12 @@ typedef enum {
 // so leave more room for slow-snaps clients etc.
 #define NUM_SNAPSHOT_FRAMES (PACKET_BACKUP*4)
 
+// entities of common snapshots are referenced by index into svs.snapshotEntities,
+// storage has PACKET_BACKUP*MAX_GENTITIES entries so 16 bits are enough
+typedef uint16_t snapEntityIndex_t;
+
 typedef struct snapshotFrame_s {
-	entityState_t *ents[ MAX_GENTITIES ];
+	snapEntityIndex_t ents[ MAX_GENTITIES ];
 	int	frameNum;
 	int start;
 	int count;
@@ -72,7 +77,6 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int				checksumFeedServerId;
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	char			*configstrings[MAX_CONFIGSTRINGS];
 	svEntity_t		svEntities[MAX_GENTITIES];
@@ -91,6 +95,13 @@ typedef struct {
 	int				time;
 
 	byte			baselineUsed[ MAX_GENTITIES ];
+
+	struct serverCommand_s *csCommands[MAX_CONFIGSTRINGS];	// "cs" commands of current values, built on demand
+
+	// encoded configstrings and baselines of the gamestate, plain and with
+	// GS_EXT_VERSION block, built on demand, see SV_InvalidateGameState()
+	int				gameStateBits[2];
+	byte			gameStateData[2][MAX_MSGLEN];
 } server_t;
 
 typedef struct {
@@ -108,7 +119,7 @@ typedef struct {
 	int				messageSize;		// used to rate drop packets
 
 	int				frameNum;			// from snapshot storage to compare with last valid
-	entityState_t	*ents[ MAX_SNAPSHOT_ENTITIES ];
+	snapEntityIndex_t	ents[ MAX_SNAPSHOT_ENTITIES ];	// into svs.snapshotEntities
 
 } clientSnapshot_t;
 
@@ -150,11 +161,50 @@ struct leakyBucket_s {
 	leakyBucket_t *prev, *next;
 };
 
+// reliable command text, a broadcast is stored once and referenced
+// from the reliable command queue of every client it goes to
+typedef struct serverCommand_s {
+	int				refCount;
+	char			text[1];
+} serverCommand_t;
+
+// large buffers and client state that per-frame loops over svs.clients don't
+// touch, kept in svs.clientsCold[] with the same index as the client_t
+typedef struct {
+	char			userinfo[MAX_INFO_STRING];		// name, etc
+	serverCommand_t	*reliableCommands[MAX_RELIABLE_COMMANDS];
+	char			lastClientCommandString[MAX_STRING_CHARS];
+
+	// configstrings changed since they were last sent, see csUpdated
+	int				numPendingCs;
+	short			pendingCs[MAX_CONFIGSTRINGS];
+
+	// downloading
+	char			downloadName[MAX_QPATH]; // if not empty string, we are downloading
+	fileHandle_t	download;			// file being downloaded
+ 	int				downloadSize;		// total bytes (can't use EOF because of paks)
+ 	int				downloadCount;		// bytes sent
+	int				downloadClientBlock;	// last block we sent to the client, awaiting ack
+	int				downloadCurrentBlock;	// current block number
+	int				downloadXmitBlock;	// last block we xmited
+	const byte		*downloadBlocks[MAX_DOWNLOAD_WINDOW_EXT];	// the buffers for the download blocks
+	int				downloadBlockSize[MAX_DOWNLOAD_WINDOW_EXT];
+	qboolean		downloadEOF;		// We have sent the EOF block
+	int				downloadSendTime;	// time we last got an ack from the client
+	qboolean		downloadExt;		// client asked for the download extension
+	int				downloadWindow;		// MAX_DOWNLOAD_WINDOW or MAX_DOWNLOAD_WINDOW_EXT
+	int				downloadBlockLen;	// MAX_DOWNLOAD_BLKSIZE or MAX_DOWNLOAD_BLKSIZE_EXT
+	const byte		*downloadMap;		// blocks point into this view when set
+	void			*downloadMapBase;
+	size_t			downloadMapLength;
+
+	char			tld[3]; // "XX\0"
+	const char		*country;
+} clientCold_t;
+
 typedef struct client_s {
 	clientState_t	state;
-	char			userinfo[MAX_INFO_STRING];		// name, etc
 
-	char			reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
 	int				reliableSequence;		// last added reliable message, not necessarily sent or acknowledged yet
 	int				reliableAcknowledge;	// last acknowledged reliable message
 	int				messageAcknowledge;
@@ -164,7 +214,6 @@ typedef struct client_s {
 
 	usercmd_t		lastUsercmd;
 	int				lastClientCommand;	// reliable client message sequence
-	char			lastClientCommandString[MAX_STRING_CHARS];
 	sharedEntity_t	*gentity;			// SV_GentityNum(clientnum)
 	char			name[MAX_NAME_LENGTH];			// extracted from userinfo, high bits masked
 
@@ -172,19 +221,6 @@ typedef struct client_s {
 	qboolean		downloading;		// set at "download", reset at gamestate retransmission
 	// int				serverId;		// last acknowledged serverId
 
-	// downloading
-	char			downloadName[MAX_QPATH]; // if not empty string, we are downloading
-	fileHandle_t	download;			// file being downloaded
- 	int				downloadSize;		// total bytes (can't use EOF because of paks)
- 	int				downloadCount;		// bytes sent
-	int				downloadClientBlock;	// last block we sent to the client, awaiting ack
-	int				downloadCurrentBlock;	// current block number
-	int				downloadXmitBlock;	// last block we xmited
-	unsigned char	*downloadBlocks[MAX_DOWNLOAD_WINDOW];	// the buffers for the download blocks
-	int				downloadBlockSize[MAX_DOWNLOAD_WINDOW];
-	qboolean		downloadEOF;		// We have sent the EOF block
-	int				downloadSendTime;	// time we last got an ack from the client
-
 	int				deltaMessage;		// frame last client usercmd message
 	int				lastPacketTime;		// svs.time when packet was last received
 	int				lastConnectTime;	// svs.time when connection started
@@ -218,10 +254,10 @@ typedef struct client_s {
 	// client can decode long strings
 	qboolean		longstr;
 
-	qboolean		justConnected;
+	// client can decode compressed configstring block in gamestate
+	qboolean		gamestateExt;
 
-	char			tld[3]; // "XX\0"
-	const char		*country;
+	qboolean		justConnected;
 
 } client_t;
 
@@ -238,6 +274,7 @@ typedef struct {
 	int			snapFlagServerBit;			// ^= SNAPFLAG_SERVERCOUNT every SV_SpawnServer()
 
 	client_t	*clients;					// [sv_maxclients->integer];
+	clientCold_t	*clientsCold;			// [sv_maxclients->integer], see SV_ClientCold()
 	int			numSnapshotEntities;		// PACKET_BACKUP*MAX_SNAPSHOT_ENTITIES
 	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
 	int			nextHeartbeatTime;
@@ -247,6 +284,7 @@ typedef struct {
 
 	// common snapshot storage
 	int			freeStorageEntities;
+	int			storageHighwater;		// most entities in use since storage init
 	int			currentStoragePosition;	// next snapshotEntities to use
 	int			snapshotFrame;			// incremented with each common snapshot built
 	int			currentSnapshotFrame;	// for initializing empty frames
@@ -275,6 +313,10 @@ extern	serverStatic_t	svs;				// persistant server info across maps
 extern	server_t		sv;					// cleared each map
 extern	vm_t			*gvm;				// game virtual machine
 
+static ID_INLINE clientCold_t *SV_ClientCold( const client_t *cl ) {
+	return &svs.clientsCold[ cl - svs.clients ];
+}
+
 extern	cvar_t	*sv_fps;
 extern	cvar_t	*sv_timeout;
 extern	cvar_t	*sv_zombietime;
@@ -305,6 +347,18 @@ extern	cvar_t	*sv_lanForceRate;
 
 extern	cvar_t *sv_levelTimeReset;
 extern	cvar_t *sv_filter;
+extern	cvar_t *sv_snapshotThreads;
+extern	cvar_t *sv_visCache;
+extern	cvar_t *sv_deltaCache;
+extern	cvar_t *sv_gamestateCompress;
+extern	cvar_t *sv_areaGrid;
+extern	cvar_t *sv_traceCache;
+extern	cvar_t *sv_botThinkWorkers;
+extern	cvar_t *com_benchmarkBots;
+extern	cvar_t *sv_overloadPolicy;
+extern	cvar_t *sv_statsd;
+extern	cvar_t *sv_statsdPrefix;
+extern	cvar_t *sv_statsdInterval;
 
 #ifdef USE_BANS
 extern	cvar_t	*sv_banFile;
@@ -319,11 +373,21 @@ extern	int serverBansCount;
 //
 qboolean SVC_RateLimit( rateLimit_t *bucket, int burst, int period );
 qboolean SVC_RateLimitAddress( const netadr_t *from, int burst, int period );
+void SV_InvalidateQueryCache( void );
+void SV_QueryCache_f( void );
+void SV_PerfAddNetwork( int64_t usec, int bytes );
+qboolean SV_ThrottleSnapshot( const client_t *cl );
+void SV_Perf_f( void );
 void SVC_RateRestoreBurstAddress( const netadr_t *from, int burst, int period );
 void SVC_RateRestoreToxicAddress( const netadr_t *from, int burst, int period );
 void SVC_RateDropAddress( const netadr_t *from, int burst, int period );
 
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+serverCommand_t *SV_NewServerCommand( const char *cmd );
+void SV_QueueServerCommand( client_t *client, serverCommand_t *cmd );
+void SV_ReleaseServerCommand( serverCommand_t *cmd );
+void SV_FreeReliableCommands( client_t *client );
+const char *SV_ReliableCommand( const client_t *client, int sequence );
 
 void SV_AddOperatorCommands( void );
 void SV_RemoveOperatorCommands( void );
@@ -355,6 +419,7 @@ void SV_InitChallenger( void );
 
 void SV_DirectConnect( const netadr_t *from );
 void SV_PrintClientStateChange( const client_t *cl, clientState_t newState );
+void SV_InvalidateGameState( void );
 
 void SV_ExecuteClientMessage( client_t *cl, msg_t *msg );
 void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilter );
@@ -389,21 +454,39 @@ void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
 
 void SV_InitSnapshotStorage( void );
+void SV_FreeSnapshotJobs( void );
+void SV_VisCache_f( void );
 void SV_IssueNewSnapshot( void );
+const snapshotFrame_t *SV_CommonSnapshot( void );
 
 int SV_RemainingGameState( void );
 
+//
+// sv_demo.c
+//
+void SV_Record_f( void );
+void SV_StopRecord_f( void );
+void SV_DemoExtract_f( void );
+void SV_StopRecord( void );
+void SV_DemoFrame( void );
+void SV_DemoServerCommand( const client_t *cl, const char *cmd );
+void SV_DemoConfigstring( int index );
+
 //
 // sv_game.c
 //
+#define	MAX_GAME_WORKERS	16		// game qvm instances for G_BOT_THINK_PARALLEL
+
 int	SV_NumForGentity( sharedEntity_t *ent );
 sharedEntity_t *SV_GentityNum( int num );
 playerState_t *SV_GameClientNum( int num );
 svEntity_t	*SV_SvEntityForGentity( sharedEntity_t *gEnt );
 sharedEntity_t *SV_GEntityForSvEntity( svEntity_t *svEnt );
 void		SV_InitGameProgs ( void );
+void		SV_ReserveGameWorkers( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
+qboolean	SV_ReloadGameProgs( void );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
 
 //
@@ -416,6 +499,9 @@ void		SV_BotFreeClient( int clientNum );
 void		SV_BotInitCvars(void);
 int			SV_BotLibSetup( void );
 int			SV_BotLibShutdown( void );
+void		SV_AASBench_f( void );
+void		SV_BotScriptBench_f( void );
+void		SV_BotProfile_f( void );
 int			SV_BotGetSnapshotEntity( int client, int ent );
 int			SV_BotGetConsoleMessage( int client, char *buf, int size );
 
@@ -448,6 +534,10 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_TraceBench_f( void );
+void SV_FreeTraceRecord( void );
+void SV_InvalidateTraceCache( void );
+void SV_TraceCache_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -38,6 +38,8 @@ static int bot_maxdebugpolys;
 extern botlib_export_t	*botlib_export;
 int	bot_enable;
 
+static cvar_t *bot_routewarmup;
+
 
 /*
 ==================
@@ -67,8 +69,8 @@ int SV_BotAllocateClient( void ) {
 	cl->netchan.remoteAddress.type = NA_BOT;
 	cl->rate = 0;
 
-	cl->tld[0] = '\0';
-	cl->country = "BOT";
+	SV_ClientCold( cl )->tld[0] = '\0';
+	SV_ClientCold( cl )->country = "BOT";
 
 	return i;
 }
@@ -457,6 +459,30 @@ void SV_BotFrame( int time ) {
 	VM_Call( gvm, 1, BOTAI_START_FRAME, time );
 }
 
+/*
+===============
+SV_BotIdleFrame
+
+Spends idle time before the next server frame on the routing caches
+towards the level items from the areas the bots are in, at most
+bot_routewarmup msec and less than the given time.
+Returns qfalse when nothing is left to do
+===============
+*/
+qboolean SV_BotIdleFrame( int usec ) {
+	if ( !bot_enable || !botlib_export || !gvm || sv.state != SS_GAME ) {
+		return qfalse;
+	}
+
+	if ( bot_routewarmup->integer <= 0 ) {
+		return qfalse;
+	}
+
+	usec = MIN( usec, bot_routewarmup->integer * 1000 );
+
+	return botlib_export->ai.BotWarmGoalRoutes( usec ) ? qtrue : qfalse;
+}
+
 /*
 ===============
 SV_BotLibSetup
@@ -472,9 +498,219 @@ int SV_BotLibSetup( void ) {
 		return -1;
 	}
 
+	botlib_export->BotLibVarSet( "routingtableareas", Cvar_VariableString( "bot_routingtable" ) );
+
 	return botlib_export->BotLibSetup();
 }
 
+/*
+===============
+SV_AASBench_f
+
+Compares AAS point area queries with and without the point area grid
+===============
+*/
+void SV_AASBench_f( void ) {
+	int count;
+
+	if ( sv.state != SS_GAME || !bot_enable || !botlib_export ) {
+		Com_Printf( "Bots are not running.\n" );
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 100000;
+	if ( count < 1 || count > 1000000 ) {
+		Com_Printf( "point count should be in range 1..1000000\n" );
+		return;
+	}
+
+	botlib_export->aas.AAS_PointAreaNumBench( count );
+}
+
+/*
+===============
+SV_BotScriptBenchFiles
+
+Parses every bot script in the list, returns the number of tokens read
+===============
+*/
+static int SV_BotScriptBenchFiles( char **files, int numFiles, int *errors ) {
+	pc_token_t token;
+	int i, handle, numTokens;
+
+	numTokens = 0;
+	for ( i = 0; i < numFiles; i++ ) {
+		handle = botlib_export->PC_LoadSourceHandle( files[i] );
+		if ( !handle ) {
+			(*errors)++;
+			continue;
+		}
+		while ( botlib_export->PC_ReadTokenHandle( handle, &token ) ) {
+			numTokens++;
+		}
+		botlib_export->PC_FreeSourceHandle( handle );
+	}
+
+	return numTokens;
+}
+
+/*
+===============
+SV_BotScriptBench_f
+
+Times the precompiler on all bot scripts with and without the token cache
+===============
+*/
+void SV_BotScriptBench_f( void ) {
+	static const char *dirs[] = { "botfiles", "botfiles/bots" };
+	char *files[ 1024 ];
+	char **list;
+	char cacheSize[ 32 ];
+	int64_t start, parseTime, cachedTime;
+	int i, j, n, numFiles, numTokens, passes, errors;
+
+	if ( !bot_enable || !botlib_export ) {
+		Com_Printf( "Bots are not running.\n" );
+		return;
+	}
+
+	passes = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 4;
+	if ( passes < 1 || passes > 100 ) {
+		Com_Printf( "pass count should be in range 1..100\n" );
+		return;
+	}
+
+	numFiles = 0;
+	for ( i = 0; i < ARRAY_LEN( dirs ); i++ ) {
+		list = FS_ListFiles( dirs[i], ".c", &n );
+		for ( j = 0; j < n && numFiles < ARRAY_LEN( files ); j++ ) {
+			files[ numFiles++ ] = CopyString( va( "%s/%s", dirs[i], list[j] ) );
+		}
+		FS_FreeFileList( list );
+	}
+
+	if ( !numFiles ) {
+		Com_Printf( "No bot scripts found.\n" );
+		return;
+	}
+
+	// an empty cache makes every load tokenize and preprocess the file
+	botlib_export->BotLibVarGet( "max_sourcecache", cacheSize, sizeof( cacheSize ) );
+	if ( !cacheSize[0] ) {
+		Q_strncpyz( cacheSize, "4096", sizeof( cacheSize ) );
+	}
+	botlib_export->BotLibVarSet( "max_sourcecache", "0" );
+
+	errors = 0;
+	numTokens = 0;
+	start = Sys_Microseconds();
+	for ( i = 0; i < passes; i++ ) {
+		numTokens = SV_BotScriptBenchFiles( files, numFiles, &errors );
+	}
+	parseTime = Sys_Microseconds() - start;
+
+	botlib_export->BotLibVarSet( "max_sourcecache", cacheSize );
+
+	// fill the cache before timing
+	SV_BotScriptBenchFiles( files, numFiles, &errors );
+	start = Sys_Microseconds();
+	for ( i = 0; i < passes; i++ ) {
+		SV_BotScriptBenchFiles( files, numFiles, &errors );
+	}
+	cachedTime = Sys_Microseconds() - start;
+
+	for ( i = 0; i < numFiles; i++ ) {
+		Z_Free( files[i] );
+	}
+
+	Com_Printf( "%i bot scripts, %i tokens, %i failed loads\n", numFiles, numTokens, errors );
+	Com_Printf( "preprocessed: %.3f msec per pass\n", parseTime / ( passes * 1000.0 ) );
+	Com_Printf( "cached:       %.3f msec per pass\n", cachedTime / ( passes * 1000.0 ) );
+}
+
+/*
+===============
+SV_BotProfilePrint
+===============
+*/
+static void SV_BotProfilePrint( const char *num, const char *name, const bot_profile_t *p ) {
+	Com_Printf( "%3s %-15.15s %8.1f %8.1f %8.1f %8.1f %6.1f %8i %7i %7i %8i %7i\n", num, name,
+		p->usec[ BOTPROFILE_GOAL ] / 1000.0, p->usec[ BOTPROFILE_MOVE ] / 1000.0,
+		p->usec[ BOTPROFILE_PREDICT ] / 1000.0,
+		( p->usec[ BOTPROFILE_ROUTEAREA ] + p->usec[ BOTPROFILE_ROUTEPORTAL ] ) / 1000.0,
+		p->usec[ BOTPROFILE_CHAT ] / 1000.0, p->count[ BOTPROFILE_PREDICT ],
+		p->count[ BOTPROFILE_ROUTEAREA ], p->count[ BOTPROFILE_ROUTEPORTAL ],
+		p->cachehits, p->cachemisses );
+}
+
+/*
+===============
+SV_BotProfile_f
+
+Prints the time the bot library spent for every bot since the map was
+loaded, sections are inclusive, routing updates are also part of the
+goal and move time of the bot that caused them
+===============
+*/
+void SV_BotProfile_f( void ) {
+	bot_profile_t profile, total;
+	char name[ MAX_NAME_LENGTH ];
+	int i, j;
+
+	if ( sv.state != SS_GAME || !bot_enable || !botlib_export ) {
+		Com_Printf( "Bots are not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		botlib_export->BotLibProfileReset();
+		return;
+	}
+
+	Com_Printf( "num name                goal     move  predict    route   chat predicts areaupd portupd     hits  misses\n" );
+	Com_Printf( "--- --------------- -------- -------- -------- -------- ------ -------- ------- ------- -------- -------\n" );
+
+	Com_Memset( &total, 0, sizeof( total ) );
+	for ( i = -1; i < sv_maxclients->integer && i < MAX_CLIENTS; i++ ) {
+		if ( !botlib_export->BotLibProfile( i, &profile ) ) {
+			continue;
+		}
+		for ( j = 0; j < BOTPROFILE_SECTIONS; j++ ) {
+			total.count[j] += profile.count[j];
+			total.usec[j] += profile.usec[j];
+		}
+		total.cachehits += profile.cachehits;
+		total.cachemisses += profile.cachemisses;
+
+		if ( i < 0 ) {
+			SV_BotProfilePrint( "-", "(no bot)", &profile );
+			continue;
+		}
+		Q_strncpyz( name, svs.clients[i].name, sizeof( name ) );
+		Q_CleanStr( name );
+		SV_BotProfilePrint( va( "%i", i ), name, &profile );
+	}
+
+	SV_BotProfilePrint( "", "total", &total );
+	Com_Printf( "times in msec, \"bot_profile reset\" clears the profile\n" );
+}
+
+/*
+===============
+SV_BotLibMemoryStats
+
+Botlib memory pool usage for meminfo and memreport
+===============
+*/
+qboolean SV_BotLibMemoryStats( int *chunkBytes, int *usedBytes, int *usedBlocks, int *largeBlocks ) {
+	if ( !botlib_export ) {
+		return qfalse;
+	}
+
+	botlib_export->BotLibMemoryStats( chunkBytes, usedBytes, usedBlocks, largeBlocks );
+	return qtrue;
+}
+
 /*
 ===============
 SV_ShutdownBotLib
@@ -529,6 +765,8 @@ void SV_BotInitCvars(void) {
 	Cvar_Get("bot_interbreedbots", "10", CVAR_CHEAT);	//number of bots used for interbreeding
 	Cvar_Get("bot_interbreedcycle", "20", CVAR_CHEAT);	//bot interbreeding cycle
 	Cvar_Get("bot_interbreedwrite", "", CVAR_CHEAT);	//write interbreeded bots to this file
+	Cvar_Get("bot_routingtable", "0", 0);				//precompute routing on maps with up to this many areas
+	bot_routewarmup = Cvar_Get("bot_routewarmup", "2", 0);	//msec of idle server frame time used to warm routing caches
 }
 
 /*
@@ -564,6 +802,8 @@ void SV_BotInitBotLib(void) {
 	botlib_import.FS_Write = FS_Write;
 	botlib_import.FS_FCloseFile = FS_FCloseFile;
 	botlib_import.FS_Seek = FS_Seek;
+	botlib_import.FS_MapFile = FS_MapFile;
+	botlib_import.FS_FreeMappedFile = FS_FreeMappedFile;
 
 	//debug lines
 	botlib_import.DebugLineCreate = BotImport_DebugLineCreate;
@@ -594,23 +834,28 @@ int SV_BotGetConsoleMessage( int client, char *buf, int size )
 {
 	if ( (unsigned) client < sv_maxclients->integer ) {
 		client_t* cl;
-		int index;
+		const char *cmd;
 
 		cl = &svs.clients[client];
 		cl->lastPacketTime = svs.time;
 
+		// coalesced configstring updates
+		if ( SV_ClientCold( cl )->numPendingCs && cl->state == CS_ACTIVE ) {
+			SV_UpdateConfigstrings( cl );
+		}
+
 		if ( cl->reliableAcknowledge == cl->reliableSequence ) {
 			return qfalse;
 		}
 
 		cl->reliableAcknowledge++;
-		index = cl->reliableAcknowledge & ( MAX_RELIABLE_COMMANDS - 1 );
+		cmd = SV_ReliableCommand( cl, cl->reliableAcknowledge );
 
-		if ( !cl->reliableCommands[index][0] ) {
+		if ( !cmd[0] ) {
 			return qfalse;
 		}
 
-		Q_strncpyz( buf, cl->reliableCommands[index], size );
+		Q_strncpyz( buf, cmd, size );
 		return qtrue;
 	} else {
 		return qfalse;
@@ -653,7 +898,7 @@ int SV_BotGetSnapshotEntity( int client, int sequence ) {
 		if ( (unsigned) sequence >= frame->num_entities ) {
 			return -1;
 		}
-		return frame->ents[sequence]->number;
+		return svs.snapshotEntities[ frame->ents[sequence] ].number;
 	} else {
 		return -1;
 	}
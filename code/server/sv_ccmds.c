@@ -321,6 +321,8 @@ static void SV_MapRestart_f( void ) {
 	sv.state = SS_GAME;
 	sv.restarting = qfalse;
 
+	SV_DemoServerCommand( NULL, "map_restart\n" );
+
 	// connect and begin all the clients
 	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
 		client = &svs.clients[i];
@@ -1473,7 +1475,7 @@ static void SV_DumpUser_f( void ) {
 
 	Com_Printf( "userinfo\n" );
 	Com_Printf( "--------\n" );
-	Info_Print( cl->userinfo );
+	Info_Print( SV_ClientCold( cl )->userinfo );
 }
 
 
@@ -1526,6 +1528,25 @@ static void SV_CompleteMapName( const char *args, int argNum ) {
 }
 
 
+/*
+==================
+SV_ReloadGame_f
+
+Replaces native game module with a rebuilt library without map restart
+==================
+*/
+static void SV_ReloadGame_f( void ) {
+
+	// make sure server is running
+	if ( !com_sv_running->integer || !gvm ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	SV_ReloadGameProgs();
+}
+
+
 /*
 ==================
 SV_AddOperatorCommands
@@ -1557,7 +1578,19 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("status", SV_Status_f);
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
+	Cmd_AddCommand ("vm_reload", SV_ReloadGame_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("viscache", SV_VisCache_f);
+	Cmd_AddCommand ("tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("tracecache", SV_TraceCache_f);
+	Cmd_AddCommand ("querycache", SV_QueryCache_f);
+	Cmd_AddCommand ("svperf", SV_Perf_f);
+	Cmd_AddCommand ("aasbench", SV_AASBench_f);
+	Cmd_AddCommand ("botscriptbench", SV_BotScriptBench_f);
+	Cmd_AddCommand ("bot_profile", SV_BotProfile_f);
+	Cmd_AddCommand ("svrecord", SV_Record_f);
+	Cmd_AddCommand ("svstoprecord", SV_StopRecord_f);
+	Cmd_AddCommand ("svdemoextract", SV_DemoExtract_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -1603,6 +1636,17 @@ void SV_RemoveOperatorCommands( void ) {
 	Cmd_RemoveCommand ("dumpuser");
 	Cmd_RemoveCommand ("map_restart");
 	Cmd_RemoveCommand ("sectorlist");
+	Cmd_RemoveCommand ("viscache");
+	Cmd_RemoveCommand ("tracebench");
+	Cmd_RemoveCommand ("tracecache");
+	Cmd_RemoveCommand ("querycache");
+	Cmd_RemoveCommand ("svperf");
+	Cmd_RemoveCommand ("aasbench");
+	Cmd_RemoveCommand ("botscriptbench");
+	Cmd_RemoveCommand ("bot_profile");
+	Cmd_RemoveCommand ("svrecord");
+	Cmd_RemoveCommand ("svstoprecord");
+	Cmd_RemoveCommand ("svdemoextract");
 #endif
 }
 
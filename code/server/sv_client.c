@@ -387,24 +387,45 @@ static void SV_SaveSequences( void ) {
 
 
 static void SV_InjectLocation( const char *tld, const char *country ) {
-	const char *cmd;
+	serverCommand_t **slot, *patched, *source;
+	char text[ MAX_STRING_CHARS ];
 	char *str;
 	int i, n;
+
+	// the broadcast is shared by all clients, patch it once
+	source = patched = NULL;
+
 	for ( i = 0; i < sv_maxclients->integer; i++ ) {
 		if ( seqs[i] != svs.clients[i].reliableSequence ) {
 			for ( n = seqs[i]; n != svs.clients[i].reliableSequence + 1; n++ ) {
-				cmd = svs.clients[i].reliableCommands[n & (MAX_RELIABLE_COMMANDS-1)];
-				str = strstr( cmd, "connected\n\"" );
-				if ( str && str[11] == '\0' && str < cmd + 512 ) {
+				slot = &svs.clientsCold[i].reliableCommands[n & (MAX_RELIABLE_COMMANDS-1)];
+				if ( !*slot ) {
+					continue;
+				}
+				if ( *slot != source ) {
+					str = strstr( (*slot)->text, "connected\n\"" );
+					if ( !str || str[11] != '\0' || str >= (*slot)->text + 512 ) {
+						continue;
+					}
+					Q_strncpyz( text, (*slot)->text, sizeof( text ) );
+					str = text + ( str - (*slot)->text );
 					if ( *tld == '\0' )
 						sprintf( str, S_COLOR_WHITE "connected (%s)\n\"", country );
 					else
 						sprintf( str, S_COLOR_WHITE "connected (" S_COLOR_RED "%s" S_COLOR_WHITE ", %s)\n\"", tld, country );
-					break;
+					SV_ReleaseServerCommand( patched );
+					patched = SV_NewServerCommand( text );
+					source = *slot;
 				}
+				patched->refCount++;
+				SV_ReleaseServerCommand( *slot );
+				*slot = patched;
+				break;
 			}
 		}
 	}
+
+	SV_ReleaseServerCommand( patched );
 }
 
 
@@ -469,6 +490,7 @@ void SV_DirectConnect( const netadr_t *from ) {
 	char		userinfo[MAX_INFO_STRING], tld[3];
 	int			i, n;
 	client_t	*cl, *newcl;
+	clientCold_t	*cold;
 	//sharedEntity_t *ent;
 	int			clientNum;
 	int			qport;
@@ -752,7 +774,10 @@ gotnewcl:
 	// accept the new client
 	// this is the only place a client_t is ever initialized
 	// we got a newcl, so reset the reliableSequence and reliableAcknowledge
+	SV_FreeReliableCommands( newcl );
 	Com_Memset( newcl, 0, sizeof( *newcl ) );
+	cold = SV_ClientCold( newcl );
+	Com_Memset( cold, 0, sizeof( *cold ) );
 	clientNum = newcl - svs.clients;
 #if 0 // skip this until CS_PRIMED
 	//ent = SV_GentityNum( clientNum );
@@ -770,12 +795,13 @@ gotnewcl:
 	newcl->netchan_end_queue = &newcl->netchan_start_queue;
 
 	// save the userinfo
-	Q_strncpyz( newcl->userinfo, userinfo, sizeof(newcl->userinfo) );
+	Q_strncpyz( cold->userinfo, userinfo, sizeof(cold->userinfo) );
 
 	newcl->longstr = longstr;
+	newcl->gamestateExt = ( longstr && !compat && atoi( Info_ValueForKey( userinfo, "gsext" ) ) >= GS_EXT_VERSION );
 
-	strcpy( newcl->tld, tld );
-	newcl->country = SV_FindCountry( newcl->tld );
+	strcpy( cold->tld, tld );
+	cold->country = SV_FindCountry( cold->tld );
 
 	SV_UserinfoChanged( newcl, qtrue, qfalse ); // update userinfo, do not run filter
 
@@ -795,7 +821,7 @@ gotnewcl:
 	}
 
 	if ( sv_clientTLD->integer ) {
-		SV_InjectLocation( newcl->tld, newcl->country );
+		SV_InjectLocation( cold->tld, cold->country );
 	}
 
 	// send the connect packet to the client
@@ -1004,6 +1030,105 @@ int SV_RemainingGameState( void )
 }
 
 
+/*
+================
+SV_WriteConfigstringBlock
+
+Packs all configstrings into one compressed block of the gamestate
+extension, returns qfalse if that would not save anything
+================
+*/
+static qboolean SV_WriteConfigstringBlock( msg_t *msg ) {
+	static byte	block[ GS_EXT_MAX_BLOCK ];
+	static byte	data[ MAX_MSGLEN ];
+	const char	*s;
+	int			i, size, compressedSize;
+
+	size = 0;
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		s = sv.configstrings[ i ];
+		if ( *s == '\0' ) {
+			continue;
+		}
+		if ( size + 2 + strlen( s ) + 1 > sizeof( block ) ) {
+			return qfalse;
+		}
+		block[ size++ ] = i & 255;
+		block[ size++ ] = i >> 8;
+		// same filtering as in MSG_WriteBigString()
+		for ( ; *s != '\0'; s++ ) {
+			block[ size++ ] = ( *s & 0x80 || *s == '%' ) ? '.' : *s;
+		}
+		block[ size++ ] = '\0';
+	}
+
+	if ( size < GS_EXT_MIN_BLOCK ) {
+		return qfalse;
+	}
+
+	compressedSize = MSG_LZCompress( data, sizeof( data ), block, size );
+	if ( compressedSize <= 0 || compressedSize >= size ) {
+		return qfalse;
+	}
+
+	MSG_WriteByte( msg, svc_configstringBlock );
+	MSG_WriteLong( msg, size );
+	MSG_WriteLong( msg, compressedSize );
+	MSG_WriteData( msg, data, compressedSize );
+
+	return qtrue;
+}
+
+
+/*
+================
+SV_WriteGameStateData
+
+Writes configstrings and baselines, optionally with compressed configstrings
+================
+*/
+static void SV_WriteGameStateData( msg_t *msg, qboolean compress ) {
+	int			start;
+	entityState_t nullstate;
+	const svEntity_t *svEnt;
+
+	// write the configstrings
+	if ( !compress || !SV_WriteConfigstringBlock( msg ) ) {
+		for ( start = 0 ; start < MAX_CONFIGSTRINGS ; start++ ) {
+			if ( *sv.configstrings[ start ] != '\0' ) {
+				MSG_WriteByte( msg, svc_configstring );
+				MSG_WriteShort( msg, start );
+				MSG_WriteBigString( msg, sv.configstrings[ start ] );
+			}
+		}
+	}
+
+	// write the baselines
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+	for ( start = 0 ; start < MAX_GENTITIES; start++ ) {
+		if ( !sv.baselineUsed[ start ] ) {
+			continue;
+		}
+		svEnt = &sv.svEntities[ start ];
+		MSG_WriteByte( msg, svc_baseline );
+		MSG_WriteDeltaEntity( msg, &nullstate, &svEnt->baseline, qtrue );
+	}
+}
+
+
+/*
+================
+SV_InvalidateGameState
+
+Drops the encoded gamestate after configstring or baseline changes
+================
+*/
+void SV_InvalidateGameState( void ) {
+	sv.gameStateBits[ 0 ] = 0;
+	sv.gameStateBits[ 1 ] = 0;
+}
+
+
 /*
 ================
 SV_SendClientGameState
@@ -1016,10 +1141,8 @@ the wrong gamestate.
 ================
 */
 static void SV_SendClientGameState( client_t *client ) {
-	int			start;
-	entityState_t nullstate;
-	const svEntity_t *svEnt;
-	msg_t		msg;
+	int			start, ext;
+	msg_t		msg, buf;
 	byte		msgBuffer[ MAX_MSGLEN_BUF ];
 
 	Com_DPrintf( "SV_SendClientGameState() for %s\n", client->name );
@@ -1062,26 +1185,22 @@ static void SV_SendClientGameState( client_t *client ) {
 	MSG_WriteByte( &msg, svc_gamestate );
 	MSG_WriteLong( &msg, client->reliableSequence );
 
-	// write the configstrings
-	for ( start = 0 ; start < MAX_CONFIGSTRINGS ; start++ ) {
-		if ( *sv.configstrings[ start ] != '\0' ) {
-			MSG_WriteByte( &msg, svc_configstring );
-			MSG_WriteShort( &msg, start );
-			MSG_WriteBigString( &msg, sv.configstrings[ start ] );
+	// write the configstrings and baselines, same for all clients until changed
+	ext = ( client->gamestateExt && sv_gamestateCompress->integer ) ? 1 : 0;
+	if ( sv.gameStateBits[ ext ] ) {
+		MSG_WriteBitstream( &msg, sv.gameStateData[ ext ], 0, sv.gameStateBits[ ext ] );
+	} else {
+		start = msg.bit;
+		SV_WriteGameStateData( &msg, ext );
+		if ( !msg.overflowed ) {
+			sv.gameStateBits[ ext ] = msg.bit - start;
+			MSG_Init( &buf, sv.gameStateData[ ext ], sizeof( sv.gameStateData[ ext ] ) );
+			MSG_WriteBitstream( &buf, msg.data, start, sv.gameStateBits[ ext ] );
 		}
-		client->csUpdated[ start ] = qfalse;
 	}
 
-	// write the baselines
-	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
-	for ( start = 0 ; start < MAX_GENTITIES; start++ ) {
-		if ( !sv.baselineUsed[ start ] ) {
-			continue;
-		}
-		svEnt = &sv.svEntities[ start ];
-		MSG_WriteByte( &msg, svc_baseline );
-		MSG_WriteDeltaEntity( &msg, &nullstate, &svEnt->baseline, qtrue );
-	}
+	Com_Memset( client->csUpdated, 0, sizeof( client->csUpdated ) );
+	SV_ClientCold( client )->numPendingCs = 0;
 
 	MSG_WriteByte( &msg, svc_EOF );
 
@@ -1167,24 +1286,31 @@ clear/free any download vars
 ==================
 */
 static void SV_CloseDownload( client_t *cl ) {
+	clientCold_t *cold = SV_ClientCold( cl );
 	int i;
 
 	// EOF
-	if ( cl->download != FS_INVALID_HANDLE ) {
-		FS_FCloseFile( cl->download );
-		cl->download = FS_INVALID_HANDLE;
+	if ( cold->download != FS_INVALID_HANDLE ) {
+		FS_FCloseFile( cold->download );
+		cold->download = FS_INVALID_HANDLE;
 	}
 
-	*cl->downloadName = '\0';
+	*cold->downloadName = '\0';
 
 	// Free the temporary buffer space
-	for (i = 0; i < MAX_DOWNLOAD_WINDOW; i++) {
-		if (cl->downloadBlocks[i]) {
-			Z_Free( cl->downloadBlocks[i] );
-			cl->downloadBlocks[i] = NULL;
+	for (i = 0; i < MAX_DOWNLOAD_WINDOW_EXT; i++) {
+		if (cold->downloadBlocks[i]) {
+			if ( !cold->downloadMap )
+				Z_Free( (void *)cold->downloadBlocks[i] );
+			cold->downloadBlocks[i] = NULL;
 		}
 	}
 
+	if ( cold->downloadMap ) {
+		Sys_UnmapFile( cold->downloadMapBase, cold->downloadMapLength );
+		cold->downloadMap = NULL;
+	}
+
 }
 
 
@@ -1196,8 +1322,10 @@ Abort a download if in progress
 ==================
 */
 static void SV_StopDownload_f( client_t *cl ) {
-	if (*cl->downloadName)
-		Com_DPrintf( "clientDownload: %d : file \"%s\" aborted\n", (int) (cl - svs.clients), cl->downloadName );
+	const clientCold_t *cold = SV_ClientCold( cl );
+
+	if (*cold->downloadName)
+		Com_DPrintf( "clientDownload: %d : file \"%s\" aborted\n", (int) (cl - svs.clients), cold->downloadName );
 
 	SV_CloseDownload( cl );
 }
@@ -1226,25 +1354,47 @@ static void SV_DoneDownload_f( client_t *cl ) {
 SV_NextDownload_f
 
 The argument will be the last acknowledged block from the client, it should be
-the same as cl->downloadClientBlock
+the same as downloadClientBlock. With the download extension the ack covers
+every block up to the argument, a second "lost" argument reports that the
+following block didn't arrive.
 ==================
 */
 static void SV_NextDownload_f( client_t *cl )
 {
+	clientCold_t *cold = SV_ClientCold( cl );
 	int block = atoi( Cmd_Argv(1) );
 
-	if (block == cl->downloadClientBlock) {
+	if ( cold->downloadExt && block >= cold->downloadClientBlock - 1 && block < cold->downloadCurrentBlock ) {
+		if ( block >= cold->downloadClientBlock ) {
+			if ( cold->downloadBlockSize[block % cold->downloadWindow] == 0 ) {
+				Com_Printf( "clientDownload: %d : file \"%s\" completed\n", (int) (cl - svs.clients), cold->downloadName );
+				SV_CloseDownload( cl );
+				return;
+			}
+
+			cold->downloadSendTime = svs.time;
+			cold->downloadClientBlock = block + 1;
+		}
+
+		if ( !Q_stricmp( Cmd_Argv(2), "lost" ) ) {
+			// resend from the hole right away instead of waiting for the timeout
+			cold->downloadXmitBlock = cold->downloadClientBlock;
+		}
+		return;
+	}
+
+	if (block == cold->downloadClientBlock) {
 		Com_DPrintf( "clientDownload: %d : client acknowledge of block %d\n", (int) (cl - svs.clients), block );
 
 		// Find out if we are done.  A zero-length block indicates EOF
-		if (cl->downloadBlockSize[cl->downloadClientBlock % MAX_DOWNLOAD_WINDOW] == 0) {
-			Com_Printf( "clientDownload: %d : file \"%s\" completed\n", (int) (cl - svs.clients), cl->downloadName );
+		if (cold->downloadBlockSize[cold->downloadClientBlock % cold->downloadWindow] == 0) {
+			Com_Printf( "clientDownload: %d : file \"%s\" completed\n", (int) (cl - svs.clients), cold->downloadName );
 			SV_CloseDownload( cl );
 			return;
 		}
 
-		cl->downloadSendTime = svs.time;
-		cl->downloadClientBlock++;
+		cold->downloadSendTime = svs.time;
+		cold->downloadClientBlock++;
 		return;
 	}
 	// We aren't getting an acknowledge for the correct block, drop the client
@@ -1260,13 +1410,17 @@ SV_BeginDownload_f
 ==================
 */
 static void SV_BeginDownload_f( client_t *cl ) {
+	clientCold_t *cold = SV_ClientCold( cl );
 
 	// Kill any existing download
 	SV_CloseDownload( cl );
 
-	// cl->downloadName is non-zero now, SV_WriteDownloadToClient will see this and open
+	// cold->downloadName is non-zero now, SV_WriteDownloadToClient will see this and open
 	// the file itself
-	Q_strncpyz( cl->downloadName, Cmd_Argv(1), sizeof(cl->downloadName) );
+	Q_strncpyz( cold->downloadName, Cmd_Argv(1), sizeof(cold->downloadName) );
+
+	// only modern clients on the new protocol may ask for the extension
+	cold->downloadExt = ( cl->longstr && !cl->compat && atoi( Cmd_Argv(2) ) >= DL_EXT_VERSION );
 
 	SV_PrintClientStateChange( cl, CS_CONNECTED );
 	cl->state = CS_CONNECTED;
@@ -1282,24 +1436,26 @@ static void SV_BeginDownload_f( client_t *cl ) {
 SV_WriteDownloadToClient
 
 Check to see if the client wants a file, open it if needed and start pumping the client
-Fill up msg with data, return number of download blocks added
+Fill up msg with data, return the amount of data added in MAX_DOWNLOAD_BLKSIZE units
 ==================
 */
 static int SV_WriteDownloadToClient( client_t *cl )
 {
+	clientCold_t *cold = SV_ClientCold( cl );
 	int curindex;
 	int unreferenced = 1;
 	char errorMessage[1024];
 	char pakbuf[MAX_QPATH], *pakptr;
 	int numRefPaks;
 	msg_t msg;
-	byte msgBuffer[MAX_DOWNLOAD_BLKSIZE*2+8];
+	byte msgBuffer[MAX_DOWNLOAD_BLKSIZE_EXT*2+8];
+	int len;
 
-	if ( cl->download == FS_INVALID_HANDLE ) {
+	if ( cold->download == FS_INVALID_HANDLE ) {
 		qboolean idPack = qfalse;
 		qboolean missionPack = qfalse;
  		// Chop off filename extension.
-		Q_strncpyz( pakbuf, cl->downloadName, sizeof( pakbuf ) );
+		Q_strncpyz( pakbuf, cold->downloadName, sizeof( pakbuf ) );
 		pakptr = strrchr( pakbuf, '.' );
 
 		if(pakptr)
@@ -1331,49 +1487,49 @@ static int SV_WriteDownloadToClient( client_t *cl )
 			}
 		}
 
-		cl->download = FS_INVALID_HANDLE;
+		cold->download = FS_INVALID_HANDLE;
 
 		// We open the file here
 		if ( !(sv_allowDownload->integer & DLF_ENABLE) ||
 			(sv_allowDownload->integer & DLF_NO_UDP) ||
 			idPack || unreferenced ||
-			( cl->downloadSize = FS_SV_FOpenFileRead( cl->downloadName, &cl->download ) ) < 0 ) {
+			( cold->downloadSize = FS_SV_FOpenFileRead( cold->downloadName, &cold->download ) ) < 0 ) {
 
 			// cannot auto-download file
 			if(unreferenced)
 			{
-				Com_Printf("clientDownload: %d : \"%s\" is not referenced and cannot be downloaded.\n", (int) (cl - svs.clients), cl->downloadName);
-				Com_sprintf(errorMessage, sizeof(errorMessage), "File \"%s\" is not referenced and cannot be downloaded.", cl->downloadName);
+				Com_Printf("clientDownload: %d : \"%s\" is not referenced and cannot be downloaded.\n", (int) (cl - svs.clients), cold->downloadName);
+				Com_sprintf(errorMessage, sizeof(errorMessage), "File \"%s\" is not referenced and cannot be downloaded.", cold->downloadName);
 			}
 			else if (idPack) {
-				Com_Printf("clientDownload: %d : \"%s\" cannot download id pk3 files\n", (int) (cl - svs.clients), cl->downloadName);
+				Com_Printf("clientDownload: %d : \"%s\" cannot download id pk3 files\n", (int) (cl - svs.clients), cold->downloadName);
 				if (missionPack) {
 					Com_sprintf(errorMessage, sizeof(errorMessage), "Cannot autodownload Team Arena file \"%s\"\n"
-									"The Team Arena mission pack can be found in your local game store.", cl->downloadName);
+									"The Team Arena mission pack can be found in your local game store.", cold->downloadName);
 				}
 				else {
-					Com_sprintf(errorMessage, sizeof(errorMessage), "Cannot autodownload id pk3 file \"%s\"", cl->downloadName);
+					Com_sprintf(errorMessage, sizeof(errorMessage), "Cannot autodownload id pk3 file \"%s\"", cold->downloadName);
 				}
 			}
 			else if ( !(sv_allowDownload->integer & DLF_ENABLE) ||
 				(sv_allowDownload->integer & DLF_NO_UDP) ) {
 
-				Com_Printf("clientDownload: %d : \"%s\" download disabled\n", (int) (cl - svs.clients), cl->downloadName);
+				Com_Printf("clientDownload: %d : \"%s\" download disabled\n", (int) (cl - svs.clients), cold->downloadName);
 				if (sv_pure->integer) {
 					Com_sprintf(errorMessage, sizeof(errorMessage), "Could not download \"%s\" because autodownloading is disabled on the server.\n\n"
 										"You will need to get this file elsewhere before you "
-										"can connect to this pure server.\n", cl->downloadName);
+										"can connect to this pure server.\n", cold->downloadName);
 				} else {
 					Com_sprintf(errorMessage, sizeof(errorMessage), "Could not download \"%s\" because autodownloading is disabled on the server.\n\n"
                     "The server you are connecting to is not a pure server, "
                     "set autodownload to No in your settings and you might be "
-                    "able to join the game anyway.\n", cl->downloadName);
+                    "able to join the game anyway.\n", cold->downloadName);
 				}
 			} else {
         // NOTE TTimo this is NOT supposed to happen unless bug in our filesystem scheme?
         //   if the pk3 is referenced, it must have been found somewhere in the filesystem
-				Com_Printf("clientDownload: %d : \"%s\" file not found on server\n", (int) (cl - svs.clients), cl->downloadName);
-				Com_sprintf(errorMessage, sizeof(errorMessage), "File \"%s\" not found on server for autodownloading.\n", cl->downloadName);
+				Com_Printf("clientDownload: %d : \"%s\" file not found on server\n", (int) (cl - svs.clients), cold->downloadName);
+				Com_sprintf(errorMessage, sizeof(errorMessage), "File \"%s\" not found on server for autodownloading.\n", cold->downloadName);
 			}
 
 			MSG_Init( &msg, msgBuffer, sizeof( msgBuffer ) - 8 );
@@ -1387,99 +1543,128 @@ static int SV_WriteDownloadToClient( client_t *cl )
 			MSG_WriteByte( &msg, svc_EOF );
 			SV_Netchan_Transmit( cl, &msg );
 
-			*cl->downloadName = '\0';
+			*cold->downloadName = '\0';
 
-			if ( cl->download != FS_INVALID_HANDLE ) {
-				FS_FCloseFile( cl->download );
-				cl->download = FS_INVALID_HANDLE;
+			if ( cold->download != FS_INVALID_HANDLE ) {
+				FS_FCloseFile( cold->download );
+				cold->download = FS_INVALID_HANDLE;
 			}
 
 			return 1;
 		}
 
-		Com_Printf( "clientDownload: %d : beginning \"%s\"\n", (int) (cl - svs.clients), cl->downloadName );
+		Com_Printf( "clientDownload: %d : beginning \"%s\"\n", (int) (cl - svs.clients), cold->downloadName );
 
-		cl->downloadCurrentBlock = cl->downloadClientBlock = cl->downloadXmitBlock = 0;
-		cl->downloadCount = 0;
-		cl->downloadEOF = qfalse;
+		cold->downloadCurrentBlock = cold->downloadClientBlock = cold->downloadXmitBlock = 0;
+		cold->downloadCount = 0;
+		cold->downloadEOF = qfalse;
+
+		if ( cold->downloadExt ) {
+			cold->downloadWindow = MAX_DOWNLOAD_WINDOW_EXT;
+			cold->downloadBlockLen = MAX_DOWNLOAD_BLKSIZE_EXT;
+			// blocks are sent straight from the page cache
+			cold->downloadMap = FS_SV_MapFile( cold->download, cold->downloadSize, &cold->downloadMapBase, &cold->downloadMapLength );
+		} else {
+			cold->downloadWindow = MAX_DOWNLOAD_WINDOW;
+			cold->downloadBlockLen = MAX_DOWNLOAD_BLKSIZE;
+		}
 	}
 
 	// Perform any reads that we need to
-	while (cl->downloadCurrentBlock - cl->downloadClientBlock < MAX_DOWNLOAD_WINDOW &&
-		cl->downloadSize != cl->downloadCount) {
+	while (cold->downloadCurrentBlock - cold->downloadClientBlock < cold->downloadWindow &&
+		cold->downloadSize != cold->downloadCount) {
 
-		curindex = (cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW);
+		curindex = (cold->downloadCurrentBlock % cold->downloadWindow);
 
-		if (!cl->downloadBlocks[curindex])
-			cl->downloadBlocks[curindex] = Z_Malloc( MAX_DOWNLOAD_BLKSIZE );
+		if ( cold->downloadMap ) {
+			len = cold->downloadSize - cold->downloadCount;
+			if ( len > cold->downloadBlockLen )
+				len = cold->downloadBlockLen;
+			cold->downloadBlocks[curindex] = cold->downloadMap + cold->downloadCount;
+			cold->downloadBlockSize[curindex] = len;
+		} else {
+			if (!cold->downloadBlocks[curindex])
+				cold->downloadBlocks[curindex] = Z_Malloc( cold->downloadBlockLen );
 
-		cl->downloadBlockSize[curindex] = FS_Read( cl->downloadBlocks[curindex], MAX_DOWNLOAD_BLKSIZE, cl->download );
+			cold->downloadBlockSize[curindex] = FS_Read( (void *)cold->downloadBlocks[curindex], cold->downloadBlockLen, cold->download );
+		}
 
-		if (cl->downloadBlockSize[curindex] < 0) {
+		if (cold->downloadBlockSize[curindex] < 0) {
 			// EOF right now
-			cl->downloadCount = cl->downloadSize;
+			cold->downloadCount = cold->downloadSize;
 			break;
 		}
 
-		cl->downloadCount += cl->downloadBlockSize[curindex];
+		cold->downloadCount += cold->downloadBlockSize[curindex];
 
 		// Load in next block
-		cl->downloadCurrentBlock++;
+		cold->downloadCurrentBlock++;
 	}
 
 	// Check to see if we have eof condition and add the EOF block
-	if (cl->downloadCount == cl->downloadSize &&
-		!cl->downloadEOF &&
-		cl->downloadCurrentBlock - cl->downloadClientBlock < MAX_DOWNLOAD_WINDOW) {
+	if (cold->downloadCount == cold->downloadSize &&
+		!cold->downloadEOF &&
+		cold->downloadCurrentBlock - cold->downloadClientBlock < cold->downloadWindow) {
 
-		cl->downloadBlockSize[cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW] = 0;
-		cl->downloadCurrentBlock++;
+		cold->downloadBlockSize[cold->downloadCurrentBlock % cold->downloadWindow] = 0;
+		cold->downloadCurrentBlock++;
 
-		cl->downloadEOF = qtrue;  // We have added the EOF block
+		cold->downloadEOF = qtrue;  // We have added the EOF block
 	}
 
-	if (cl->downloadClientBlock == cl->downloadCurrentBlock)
+	if (cold->downloadClientBlock == cold->downloadCurrentBlock)
 		return 0; // Nothing to transmit
 
 	// Write out the next section of the file, if we have already reached our window,
 	// automatically start retransmitting
-	if (cl->downloadXmitBlock == cl->downloadCurrentBlock)
+	if (cold->downloadXmitBlock == cold->downloadCurrentBlock)
 	{
 		// We have transmitted the complete window, should we start resending?
-		if (svs.time - cl->downloadSendTime > 1000)
-			cl->downloadXmitBlock = cl->downloadClientBlock;
+		if (svs.time - cold->downloadSendTime > 1000)
+			cold->downloadXmitBlock = cold->downloadClientBlock;
 		else
 			return 0;
 	}
 
+	// large blocks go out as several fragments, let the previous one drain first
+	if ( cold->downloadExt && ( cl->netchan.unsentFragments || cl->netchan_start_queue ) )
+		return 0;
+
 	// Send current block
-	curindex = (cl->downloadXmitBlock % MAX_DOWNLOAD_WINDOW);
+	curindex = (cold->downloadXmitBlock % cold->downloadWindow);
 
 	MSG_Init( &msg, msgBuffer, sizeof( msgBuffer ) - 8 );
 	MSG_WriteLong( &msg, cl->lastClientCommand );
 
 	MSG_WriteByte( &msg, svc_download );
-	MSG_WriteShort( &msg, cl->downloadXmitBlock );
+	MSG_WriteShort( &msg, cold->downloadXmitBlock );
 
 	// block zero is special, contains file size
-	if ( cl->downloadXmitBlock == 0 )
-		MSG_WriteLong( &msg, cl->downloadSize );
+	if ( cold->downloadXmitBlock == 0 ) {
+		MSG_WriteLong( &msg, cold->downloadSize );
+		if ( cold->downloadExt )
+			MSG_WriteShort( &msg, DL_EXT_MARKER );
+	}
 
-	MSG_WriteShort( &msg, cl->downloadBlockSize[curindex] );
+	MSG_WriteShort( &msg, cold->downloadBlockSize[curindex] );
 
 	// Write the block
-	if ( cl->downloadBlockSize[curindex] > 0 )
-		MSG_WriteData( &msg, cl->downloadBlocks[curindex], cl->downloadBlockSize[curindex] );
+	if ( cold->downloadBlockSize[curindex] > 0 )
+		MSG_WriteData( &msg, cold->downloadBlocks[curindex], cold->downloadBlockSize[curindex] );
 
 	MSG_WriteByte( &msg, svc_EOF );
 	SV_Netchan_Transmit( cl, &msg );
 
-	Com_DPrintf( "clientDownload: %d : writing block %d\n", (int) (cl - svs.clients), cl->downloadXmitBlock );
+	Com_DPrintf( "clientDownload: %d : writing block %d\n", (int) (cl - svs.clients), cold->downloadXmitBlock );
 
 	// Move on to the next block
 	// It will get sent with next snap shot.  The rate will keep us in line.
-	cl->downloadXmitBlock++;
-	cl->downloadSendTime = svs.time;
+	cold->downloadXmitBlock++;
+	cold->downloadSendTime = svs.time;
+
+	// sv_dlRate accounting is done in legacy blocks
+	if ( cold->downloadExt )
+		return ( cold->downloadBlockLen + MAX_DOWNLOAD_BLKSIZE - 1 ) / MAX_DOWNLOAD_BLKSIZE;
 
 	return 1;
 }
@@ -1533,7 +1718,7 @@ int SV_SendDownloadMessages( void )
 	for( i = 0; i < sv_maxclients->integer; i++ )
 	{
 		cl = &svs.clients[ i ];
-		if ( cl->state >= CS_CONNECTED && *cl->downloadName )
+		if ( cl->state >= CS_CONNECTED && *SV_ClientCold( cl )->downloadName )
 		{
 			numDLs += SV_WriteDownloadToClient( cl );
 		}
@@ -1555,6 +1740,13 @@ static void SV_Disconnect_f( client_t *cl ) {
 }
 
 
+static int QDECL SV_ChecksumCompare( const void *a, const void *b ) {
+	const int ia = *(const int *)a;
+	const int ib = *(const int *)b;
+	return ( ia > ib ) - ( ia < ib );
+}
+
+
 /*
 =================
 SV_VerifyPaks_f
@@ -1569,8 +1761,9 @@ This routine would be a bit simpler with a goto but i abstained
 =================
 */
 static void SV_VerifyPaks_f( client_t *cl ) {
-	int nChkSum1, nChkSum2, nClientPaks, i, j, nCurArg;
+	int nChkSum1, nChkSum2, nClientPaks, i, nCurArg;
 	int nClientChkSum[512];
+	int nSortedChkSum[512];
 	const char *pArg;
 	qboolean bGood = qtrue;
 
@@ -1647,17 +1840,15 @@ static void SV_VerifyPaks_f( client_t *cl ) {
 
 			// make sure none of the client check sums are the same
 			// so the client can't send 5 the same checksums
-			for (i = 0; i < nClientPaks; i++) {
-				for (j = 0; j < nClientPaks; j++) {
-					if (i == j)
-						continue;
-					if (nClientChkSum[i] == nClientChkSum[j]) {
-						bGood = qfalse;
-						break;
-					}
-				}
-				if (bGood == qfalse)
+			if ( nClientPaks > 0 ) {
+				Com_Memcpy( nSortedChkSum, nClientChkSum, nClientPaks * sizeof( nSortedChkSum[0] ) );
+				qsort( nSortedChkSum, nClientPaks, sizeof( nSortedChkSum[0] ), SV_ChecksumCompare );
+			}
+			for (i = 1; i < nClientPaks; i++) {
+				if (nSortedChkSum[i] == nSortedChkSum[i-1]) {
+					bGood = qfalse;
 					break;
+				}
 			}
 			if (bGood == qfalse)
 				break;
@@ -1724,11 +1915,16 @@ into a more C friendly form.
 =================
 */
 void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilter ) {
+	clientCold_t *cold = SV_ClientCold( cl );
+	infoDict_t info;
 	char buf[ MAX_NAME_LENGTH ];
 	const char *val;
 	const char *ip;
 	int	i;
 
+	// name may change
+	SV_InvalidateQueryCache();
+
 	if ( cl->netchan.remoteAddress.type == NA_BOT ) {
 		cl->lastSnapshotTime = svs.time - 9999; // generate a snapshot immediately
 		cl->snapshotMsec = 1000 / sv_fps->integer;
@@ -1736,6 +1932,9 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 		return;
 	}
 
+	// parse once for all following lookups
+	Info_DictParse( &info, cold->userinfo );
+
 	// rate command
 
 	// if the client is on the same subnet as the server and we aren't running an
@@ -1743,7 +1942,7 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 	if ( cl->netchan.remoteAddress.type == NA_LOOPBACK || ( cl->netchan.isLANAddress && com_dedicated->integer != 2 && sv_lanForceRate->integer ) ) {
 		cl->rate = 0; // lans should not rate limit
 	} else {
-		val = Info_ValueForKey( cl->userinfo, "rate" );
+		val = Info_DictValue( &info, "rate" );
 		if ( val[0] )
 			cl->rate = atoi( val );
 		else
@@ -1761,7 +1960,7 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 	}
 
 	// snaps command
-	val = Info_ValueForKey( cl->userinfo, "snaps" );
+	val = Info_DictValue( &info, "snaps" );
 	if ( val[0] && !NET_IsLocalAddress( &cl->netchan.remoteAddress ) )
 		i = atoi( val );
 	else
@@ -1786,20 +1985,20 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 		return;
 
 	// name for C code
-	val = Info_ValueForKey( cl->userinfo, "name" );
+	val = Info_DictValue( &info, "name" );
 	// truncate if it is too long as it may cause memory corruption in OSP mod
 	if ( gvm->forceDataMask && strlen( val ) >= sizeof( buf ) ) {
 		Q_strncpyz( buf, val, sizeof( buf ) );
-		Info_SetValueForKey( cl->userinfo, "name", buf );
+		Info_SetValueForKey( cold->userinfo, "name", buf );
 		val = buf;
 	}
 	Q_strncpyz( cl->name, val, sizeof( cl->name ) );
 
-	val = Info_ValueForKey( cl->userinfo, "handicap" );
+	val = Info_DictValue( &info, "handicap" );
 	if ( val[0] ) {
 		i = atoi( val );
 		if ( i <= 0 || i > 100 || strlen( val ) > 4 ) {
-			Info_SetValueForKey( cl->userinfo, "handicap", "100" );
+			Info_SetValueForKey( cold->userinfo, "handicap", "100" );
 		}
 	}
 
@@ -1811,14 +2010,14 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 	else
 		ip = NET_AdrToString( &cl->netchan.remoteAddress );
 
-	if ( !Info_SetValueForKey( cl->userinfo, "ip", ip ) )
+	if ( !Info_SetValueForKey( cold->userinfo, "ip", ip ) )
 		SV_DropClient( cl, "userinfo string length exceeded" );
 
-	Info_SetValueForKey( cl->userinfo, "tld", cl->tld );
+	Info_SetValueForKey( cold->userinfo, "tld", cold->tld );
 
 	if ( runFilter )
 	{
-		val = SV_RunFilters( cl->userinfo, &cl->netchan.remoteAddress );
+		val = SV_RunFilters( cold->userinfo, &cl->netchan.remoteAddress );
 		if ( *val != '\0' )
 		{
 			SV_DropClient( cl, val );
@@ -1842,7 +2041,7 @@ static void SV_UpdateUserinfo_f( client_t *cl ) {
 		return;
 	}
 
-	Q_strncpyz( cl->userinfo, info, sizeof( cl->userinfo ) );
+	Q_strncpyz( SV_ClientCold( cl )->userinfo, info, sizeof( svs.clientsCold[0].userinfo ) );
 
 	SV_UserinfoChanged( cl, qtrue, qtrue ); // update userinfo, run filter
 	// call prog code to allow overrides
@@ -1882,7 +2081,7 @@ void SV_PrintLocations_f( client_t *client ) {
 		if ( len > max_namelength )
 			max_namelength = len;
 
-		len = strlen( cl->country );
+		len = strlen( svs.clientsCold[ i ].country );
 		if ( len > max_ctrylength )
 			max_ctrylength = len;
 	}
@@ -1903,7 +2102,7 @@ void SV_PrintLocations_f( client_t *client ) {
 			continue;
 
 		len = Com_sprintf( line, sizeof( line ), "%2i %s%-*s" S_COLOR_WHITE " %2s %s\n",
-			i, cl->name, max_namelength-SV_Strlen(cl->name), "", cl->tld, cl->country );
+			i, cl->name, max_namelength-SV_Strlen(cl->name), "", svs.clientsCold[ i ].tld, svs.clientsCold[ i ].country );
 
 		if ( s - buf + len >= sizeof( buf )-1 ) // flush accumulated buffer
 		{
@@ -2063,7 +2262,7 @@ static qboolean SV_ClientCommand( client_t *cl, msg_t *msg ) {
 	}
 
 	cl->lastClientCommand = seq;
-	Q_strncpyz( cl->lastClientCommandString, s, sizeof( cl->lastClientCommandString ) );
+	Q_strncpyz( SV_ClientCold( cl )->lastClientCommandString, s, sizeof( svs.clientsCold[0].lastClientCommandString ) );
 
 	return qtrue; // continue procesing
 }
@@ -2132,7 +2331,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 	// also use the message acknowledge
 	key ^= cl->messageAcknowledge;
 	// also use the last acknowledged server command in the key
-	key ^= MSG_HashKey(cl->reliableCommands[ cl->reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ], 32);
+	key ^= MSG_HashKey(SV_ReliableCommand( cl, cl->reliableAcknowledge ), 32);
 
 	oldcmd = &nullcmd;
 	for ( i = 0 ; i < cmdCount ; i++ ) {
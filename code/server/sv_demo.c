@@ -0,0 +1,1098 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "server.h"
+
+/*
+=============================================================================
+
+SERVER SIDE DEMOS
+
+A server demo stores the common snapshot frame of every server frame with
+all entities and the playerstates of all active clients, delta compressed
+against the previously recorded frame, so recording costs about as much as
+one extra client no matter how many points of view are extracted later.
+The file is written through FS_BufferWrites, so the disk is kept off the
+server frame.
+
+The file is a sequence of records, each an int length followed by a huffman
+coded message, a length of -1 ends the file.
+
+The first record:
+
+4	SVDEMO_VERSION
+4	protocol
+4	maxclients
+4	checksumFeed
+<svdm_configstring | svdm_baseline>
+1	svdm_EOF
+
+Every other record:
+
+<svdm_command | svdm_configstring> issued since the previous frame
+1	svdm_frame
+4	serverTime
+<packetentities against the previous frame>
+<entities sent to some clients only>
+<playerstates against the previous frame>
+1	svdm_EOF
+
+svdemoextract writes a regular client demo from the point of view of any
+recorded client. There is no PVS information in the file, so extracted
+snapshots carry every entity the client may receive, the nearest ones
+when there are more than MAX_SNAPSHOT_ENTITIES.
+
+=============================================================================
+*/
+
+#define SVDEMO_EXT		"svdm"
+#define SVDEMO_VERSION	1
+#define SVDEMO_MSGLEN	0x40000		// records hold all entities and playerstates
+
+// entity flags stored for the extractor
+#define SVDEMO_CLIENTFLAGS	( SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK )
+
+typedef enum {
+	svdm_bad,
+	svdm_configstring,	// [short] index [bigstring] value
+	svdm_baseline,		// first record only
+	svdm_command,		// [short] client or -1 for all [string] command
+	svdm_frame,
+	svdm_EOF
+} svdm_ops_t;
+
+typedef struct {
+	fileHandle_t	file;
+	char			name[ MAX_QPATH ];
+	int				lastTime;		// sv.time of the last recorded frame
+	int				frames;
+	int				bytes;
+
+	msg_t			msg;			// record being built
+	byte			msgData[ SVDEMO_MSGLEN ];
+
+	int				numEntities[ 2 ];
+	int				current;		// entities[ current ] is the last recorded frame
+	entityState_t	entities[ 2 ][ MAX_GENTITIES ];
+	entityState_t	baselines[ MAX_GENTITIES ];
+
+	qboolean		psValid[ MAX_CLIENTS ];
+	playerState_t	ps[ MAX_CLIENTS ];
+} svDemo_t;
+
+static svDemo_t *svDemo;
+
+
+/*
+=============
+SV_DemoWriteEntities
+
+Same encoding as SV_EmitPacketEntities for flat entity lists sorted by number
+=============
+*/
+static void SV_DemoWriteEntities( msg_t *msg, const entityState_t *from, int fromCount, const entityState_t *to, int toCount, const entityState_t *baselines )
+{
+	const entityState_t *oldent, *newent;
+	int oldindex, newindex;
+	int oldnum, newnum;
+
+	oldent = NULL;
+	newent = NULL;
+	oldindex = 0;
+	newindex = 0;
+	while ( newindex < toCount || oldindex < fromCount ) {
+		if ( newindex >= toCount ) {
+			newnum = MAX_GENTITIES+1;
+		} else {
+			newent = &to[ newindex ];
+			newnum = newent->number;
+		}
+
+		if ( oldindex >= fromCount ) {
+			oldnum = MAX_GENTITIES+1;
+		} else {
+			oldent = &from[ oldindex ];
+			oldnum = oldent->number;
+		}
+
+		if ( newnum == oldnum ) {
+			MSG_WriteDeltaEntity( msg, oldent, newent, qfalse );
+			oldindex++;
+			newindex++;
+		} else if ( newnum < oldnum ) {
+			MSG_WriteDeltaEntity( msg, &baselines[ newnum ], newent, qtrue );
+			newindex++;
+		} else {
+			MSG_WriteDeltaEntity( msg, oldent, NULL, qtrue );
+			oldindex++;
+		}
+	}
+
+	MSG_WriteBits( msg, (MAX_GENTITIES-1), GENTITYNUM_BITS );	// end of packetentities
+}
+
+
+/*
+=============
+SV_DemoReadEntities
+
+Returns the number of entities in the new list or -1 on a bad message
+=============
+*/
+static int SV_DemoReadEntities( msg_t *msg, const entityState_t *from, int fromCount, entityState_t *to, const entityState_t *baselines )
+{
+	int oldindex, count;
+	int newnum;
+
+	oldindex = 0;
+	count = 0;
+
+	for ( ;; ) {
+		newnum = MSG_ReadEntitynum( msg );
+		if ( newnum < 0 ) {
+			return -1;
+		}
+		if ( newnum == MAX_GENTITIES-1 ) {
+			break;
+		}
+
+		// entities before this one are unchanged
+		while ( oldindex < fromCount && from[ oldindex ].number < newnum ) {
+			to[ count++ ] = from[ oldindex++ ];
+		}
+
+		if ( oldindex < fromCount && from[ oldindex ].number == newnum ) {
+			MSG_ReadDeltaEntity( msg, &from[ oldindex ], &to[ count ], newnum );
+			oldindex++;
+		} else {
+			MSG_ReadDeltaEntity( msg, &baselines[ newnum ], &to[ count ], newnum );
+		}
+
+		// removed entities are returned with MAX_GENTITIES-1
+		if ( to[ count ].number != MAX_GENTITIES-1 ) {
+			count++;
+		}
+	}
+
+	while ( oldindex < fromCount ) {
+		to[ count++ ] = from[ oldindex++ ];
+	}
+
+	return count;
+}
+
+
+/*
+=============
+SV_DemoWriteRecord
+=============
+*/
+static void SV_DemoWriteRecord( void )
+{
+	int len;
+
+	if ( svDemo->msg.overflowed ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: server demo record overflowed, recording stopped\n" );
+		SV_StopRecord();
+		return;
+	}
+
+	len = LittleLong( svDemo->msg.cursize );
+	FS_Write( &len, 4, svDemo->file );
+	FS_Write( svDemo->msg.data, svDemo->msg.cursize, svDemo->file );
+
+	svDemo->bytes += svDemo->msg.cursize + 4;
+
+	MSG_Init( &svDemo->msg, svDemo->msgData, sizeof( svDemo->msgData ) );
+	svDemo->msg.allowoverflow = qtrue;
+}
+
+
+/*
+=============
+SV_DemoCheckRecordSize
+
+Ends the record early when commands pile up between frames
+=============
+*/
+static void SV_DemoCheckRecordSize( void )
+{
+	if ( svDemo->msg.cursize > SVDEMO_MSGLEN / 2 ) {
+		MSG_WriteByte( &svDemo->msg, svdm_EOF );
+		SV_DemoWriteRecord();
+	}
+}
+
+
+/*
+=============
+SV_DemoServerCommand
+
+Records a reliable command sent to one or all clients
+=============
+*/
+void SV_DemoServerCommand( const client_t *cl, const char *cmd )
+{
+	if ( !svDemo ) {
+		return;
+	}
+
+	// configstrings are recorded by SV_DemoConfigstring
+	if ( !Q_strncmp( cmd, "cs ", 3 ) || !Q_strncmp( cmd, "bcs", 3 ) ) {
+		return;
+	}
+
+	MSG_WriteByte( &svDemo->msg, svdm_command );
+	MSG_WriteShort( &svDemo->msg, cl ? (int)( cl - svs.clients ) : -1 );
+	MSG_WriteString( &svDemo->msg, cmd );
+
+	SV_DemoCheckRecordSize();
+}
+
+
+/*
+=============
+SV_DemoConfigstring
+=============
+*/
+void SV_DemoConfigstring( int index )
+{
+	if ( !svDemo ) {
+		return;
+	}
+
+	MSG_WriteByte( &svDemo->msg, svdm_configstring );
+	MSG_WriteShort( &svDemo->msg, index );
+	MSG_WriteBigString( &svDemo->msg, sv.configstrings[ index ] );
+
+	SV_DemoCheckRecordSize();
+}
+
+
+/*
+=============
+SV_DemoFrame
+
+Records the common snapshot frame once per server frame
+=============
+*/
+void SV_DemoFrame( void )
+{
+	const snapshotFrame_t *frame;
+	const sharedEntity_t *ent;
+	const entityState_t *from;
+	entityState_t *to;
+	const playerState_t *ps;
+	const client_t *cl;
+	msg_t *msg;
+	int i, count;
+
+	if ( !svDemo || sv.state != SS_GAME || sv.time == svDemo->lastTime ) {
+		return;
+	}
+
+	svDemo->lastTime = sv.time;
+	msg = &svDemo->msg;
+
+	frame = SV_CommonSnapshot();
+
+	from = svDemo->entities[ svDemo->current ];
+	to = svDemo->entities[ svDemo->current ^ 1 ];
+	count = frame->count;
+	for ( i = 0; i < count; i++ ) {
+		to[ i ] = svs.snapshotEntities[ frame->ents[ i ] ];
+	}
+
+	MSG_WriteByte( msg, svdm_frame );
+	MSG_WriteLong( msg, sv.time );
+
+	SV_DemoWriteEntities( msg, from, svDemo->numEntities[ svDemo->current ], to, count, svDemo->baselines );
+
+	// entities that only some clients receive
+	for ( i = 0; i < count; i++ ) {
+		ent = SV_GentityNum( to[ i ].number );
+		if ( ent->r.svFlags & SVDEMO_CLIENTFLAGS ) {
+			MSG_WriteBits( msg, to[ i ].number, GENTITYNUM_BITS );
+			MSG_WriteLong( msg, ent->r.svFlags & SVDEMO_CLIENTFLAGS );
+			MSG_WriteLong( msg, ent->r.singleClient );
+		}
+	}
+	MSG_WriteBits( msg, (MAX_GENTITIES-1), GENTITYNUM_BITS );
+
+	for ( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ ) {
+		if ( cl->state != CS_ACTIVE || !cl->gentity ) {
+			svDemo->psValid[ i ] = qfalse;
+			continue;
+		}
+		ps = SV_GameClientNum( i );
+		MSG_WriteByte( msg, i );
+		MSG_WriteDeltaPlayerstate( msg, svDemo->psValid[ i ] ? &svDemo->ps[ i ] : NULL, ps );
+		svDemo->ps[ i ] = *ps;
+		svDemo->psValid[ i ] = qtrue;
+	}
+	MSG_WriteByte( msg, MAX_CLIENTS );	// end of playerstates
+
+	MSG_WriteByte( msg, svdm_EOF );
+
+	svDemo->current ^= 1;
+	svDemo->numEntities[ svDemo->current ] = count;
+	svDemo->frames++;
+
+	SV_DemoWriteRecord();
+}
+
+
+/*
+=============
+SV_DemoWriteHeader
+=============
+*/
+static void SV_DemoWriteHeader( void )
+{
+	entityState_t nullstate;
+	msg_t *msg;
+	int i;
+
+	msg = &svDemo->msg;
+
+	MSG_WriteLong( msg, SVDEMO_VERSION );
+	MSG_WriteLong( msg, com_protocol->integer );
+	MSG_WriteLong( msg, sv_maxclients->integer );
+	MSG_WriteLong( msg, sv.checksumFeed );
+
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		if ( *sv.configstrings[ i ] != '\0' ) {
+			MSG_WriteByte( msg, svdm_configstring );
+			MSG_WriteShort( msg, i );
+			MSG_WriteBigString( msg, sv.configstrings[ i ] );
+		}
+	}
+
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+	for ( i = 0; i < MAX_GENTITIES; i++ ) {
+		if ( !sv.baselineUsed[ i ] ) {
+			continue;
+		}
+		svDemo->baselines[ i ] = sv.svEntities[ i ].baseline;
+		MSG_WriteByte( msg, svdm_baseline );
+		MSG_WriteDeltaEntity( msg, &nullstate, &svDemo->baselines[ i ], qtrue );
+	}
+
+	MSG_WriteByte( msg, svdm_EOF );
+
+	SV_DemoWriteRecord();
+}
+
+
+/*
+=============
+SV_DemoFileName
+
+Builds demos/<name>.svdm from an optional name with or without extension
+=============
+*/
+static void SV_DemoFileName( const char *name, char *fileName, int fileNameSize )
+{
+	char base[ MAX_QPATH ];
+
+	Q_strncpyz( base, name, sizeof( base ) );
+	if ( !Q_stricmp( COM_GetExtension( base ), SVDEMO_EXT ) ) {
+		COM_StripExtension( base, base, sizeof( base ) );
+	}
+
+	Com_sprintf( fileName, fileNameSize, "demos/%s.%s", base, SVDEMO_EXT );
+}
+
+
+/*
+=============
+SV_Record_f
+=============
+*/
+void SV_Record_f( void )
+{
+	char name[ MAX_QPATH ];
+	fileHandle_t f;
+	qtime_t t;
+
+	if ( Cmd_Argc() > 2 ) {
+		Com_Printf( "svrecord [demoname]\n" );
+		return;
+	}
+
+	if ( svDemo ) {
+		Com_Printf( "Already recording to %s.\n", svDemo->name );
+		return;
+	}
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() == 2 ) {
+		SV_DemoFileName( Cmd_Argv( 1 ), name, sizeof( name ) );
+	} else {
+		Com_RealTime( &t );
+		SV_DemoFileName( va( "server-%04d%02d%02d-%02d%02d%02d-%s",
+			1900 + t.tm_year, 1 + t.tm_mon, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+			sv_mapname->string ), name, sizeof( name ) );
+	}
+
+	f = FS_FOpenFileWrite( name );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "ERROR: couldn't open %s.\n", name );
+		return;
+	}
+
+	// frames are written every server frame, keep the disk out of it
+	FS_BufferWrites( f );
+
+	svDemo = Z_Malloc( sizeof( *svDemo ) );
+	svDemo->file = f;
+	svDemo->lastTime = sv.time - 1;
+	Q_strncpyz( svDemo->name, name, sizeof( svDemo->name ) );
+
+	MSG_Init( &svDemo->msg, svDemo->msgData, sizeof( svDemo->msgData ) );
+	svDemo->msg.allowoverflow = qtrue;
+
+	SV_DemoWriteHeader();
+
+	Com_Printf( "recording server demo to %s.\n", name );
+}
+
+
+/*
+=============
+SV_StopRecord
+
+Called on map changes and server shutdown as well
+=============
+*/
+void SV_StopRecord( void )
+{
+	int len;
+
+	if ( !svDemo ) {
+		return;
+	}
+
+	len = -1;
+	FS_Write( &len, 4, svDemo->file );
+	FS_FCloseFile( svDemo->file );
+
+	Com_Printf( "Stopped server demo %s, %i frames, %i KB.\n", svDemo->name, svDemo->frames, svDemo->bytes / 1024 );
+
+	Z_Free( svDemo );
+	svDemo = NULL;
+}
+
+
+/*
+=============
+SV_StopRecord_f
+=============
+*/
+void SV_StopRecord_f( void )
+{
+	if ( !svDemo ) {
+		Com_Printf( "Not recording a server demo.\n" );
+		return;
+	}
+
+	SV_StopRecord();
+}
+
+
+/*
+=============================================================================
+
+POINT OF VIEW EXTRACTION
+
+=============================================================================
+*/
+
+typedef struct {
+	fileHandle_t	in;
+	fileHandle_t	out;
+	int				clientNum;
+	int				protocol;
+	int				checksumFeed;
+
+	byte			recordData[ SVDEMO_MSGLEN ];
+	char			*configstrings[ MAX_CONFIGSTRINGS ];
+	entityState_t	baselines[ MAX_GENTITIES ];
+	qboolean		baselineUsed[ MAX_GENTITIES ];
+
+	// world state of the last recorded frame
+	int				serverTime;
+	int				numEntities[ 2 ];
+	int				current;
+	entityState_t	entities[ 2 ][ MAX_GENTITIES ];
+	int				clientFlags[ MAX_GENTITIES ];
+	int				singleClient[ MAX_GENTITIES ];
+	qboolean		psValid[ MAX_CLIENTS ];
+	playerState_t	ps[ MAX_CLIENTS ];
+
+	// client demo being written
+	qboolean		gamestateWritten;
+	int				messageNum;
+	int				commandSequence;
+	msg_t			msg;
+	byte			msgData[ MAX_MSGLEN_BUF ];
+
+	int				snapMessageNum;	// message of the last snapshot, 0 if none
+	playerState_t	snapPs;
+	int				snapNumEntities;
+	entityState_t	snapEntities[ MAX_SNAPSHOT_ENTITIES ];
+
+	int				snapshots;
+} demoExtract_t;
+
+static float *extractDist;
+
+
+/*
+=============
+SV_ExtractBeginMessage
+=============
+*/
+static void SV_ExtractBeginMessage( demoExtract_t *dx )
+{
+	MSG_Init( &dx->msg, dx->msgData, MAX_MSGLEN );
+	MSG_Bitstream( &dx->msg );
+	dx->msg.allowoverflow = qtrue;
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	MSG_WriteLong( &dx->msg, 0 );
+}
+
+
+/*
+=============
+SV_ExtractWriteMessage
+=============
+*/
+static qboolean SV_ExtractWriteMessage( demoExtract_t *dx )
+{
+	int len;
+
+	if ( dx->msg.overflowed ) {
+		SV_ExtractBeginMessage( dx );
+		return qfalse;
+	}
+
+	MSG_WriteByte( &dx->msg, svc_EOF );
+
+	len = LittleLong( dx->messageNum );
+	FS_Write( &len, 4, dx->out );
+	len = LittleLong( dx->msg.cursize );
+	FS_Write( &len, 4, dx->out );
+	FS_Write( dx->msg.data, dx->msg.cursize, dx->out );
+
+	dx->messageNum++;
+
+	SV_ExtractBeginMessage( dx );
+	return qtrue;
+}
+
+
+/*
+=============
+SV_ExtractCommand
+=============
+*/
+static void SV_ExtractCommand( demoExtract_t *dx, const char *cmd )
+{
+	if ( !dx->gamestateWritten ) {
+		return; // part of the gamestate
+	}
+
+	// leave room for the snapshot
+	if ( dx->msg.cursize + (int)strlen( cmd ) > MAX_MSGLEN / 2 ) {
+		SV_ExtractWriteMessage( dx );
+	}
+
+	dx->commandSequence++;
+	MSG_WriteByte( &dx->msg, svc_serverCommand );
+	MSG_WriteLong( &dx->msg, dx->commandSequence );
+	MSG_WriteString( &dx->msg, cmd );
+}
+
+
+/*
+=============
+SV_ExtractConfigstring
+
+Same commands as SV_SendConfigstring
+=============
+*/
+static void SV_ExtractConfigstring( demoExtract_t *dx, int index )
+{
+	const int maxChunkSize = MAX_STRING_CHARS - 24;
+	const char *cs, *cmd;
+	char buf[ MAX_STRING_CHARS ];
+	int sent, remaining;
+
+	cs = dx->configstrings[ index ] ? dx->configstrings[ index ] : "";
+	remaining = strlen( cs );
+
+	if ( remaining < maxChunkSize ) {
+		SV_ExtractCommand( dx, va( "cs %i \"%s\"", index, cs ) );
+		return;
+	}
+
+	for ( sent = 0; remaining > 0; sent += maxChunkSize - 1, remaining -= maxChunkSize - 1 ) {
+		if ( sent == 0 ) {
+			cmd = "bcs0";
+		} else if ( remaining < maxChunkSize ) {
+			cmd = "bcs2";
+		} else {
+			cmd = "bcs1";
+		}
+		Q_strncpyz( buf, cs + sent, maxChunkSize );
+		SV_ExtractCommand( dx, va( "%s %i \"%s\"", cmd, index, buf ) );
+	}
+}
+
+
+/*
+=============
+SV_ExtractGamestate
+
+Same message as SV_SendClientGameState with the configstrings
+of the first frame the client is in
+=============
+*/
+static qboolean SV_ExtractGamestate( demoExtract_t *dx )
+{
+	entityState_t nullstate;
+	int i;
+
+	// commands before the gamestate are part of it
+	SV_ExtractBeginMessage( dx );
+
+	MSG_WriteByte( &dx->msg, svc_gamestate );
+	MSG_WriteLong( &dx->msg, dx->commandSequence );
+
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		if ( dx->configstrings[ i ] && *dx->configstrings[ i ] ) {
+			MSG_WriteByte( &dx->msg, svc_configstring );
+			MSG_WriteShort( &dx->msg, i );
+			MSG_WriteBigString( &dx->msg, dx->configstrings[ i ] );
+		}
+	}
+
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+	for ( i = 0; i < MAX_GENTITIES; i++ ) {
+		if ( dx->baselineUsed[ i ] ) {
+			MSG_WriteByte( &dx->msg, svc_baseline );
+			MSG_WriteDeltaEntity( &dx->msg, &nullstate, &dx->baselines[ i ], qtrue );
+		}
+	}
+
+	MSG_WriteByte( &dx->msg, svc_EOF );
+
+	MSG_WriteLong( &dx->msg, dx->clientNum );
+	MSG_WriteLong( &dx->msg, dx->checksumFeed );
+
+	if ( !SV_ExtractWriteMessage( dx ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: gamestate overflow\n" );
+		return qfalse;
+	}
+
+	dx->gamestateWritten = qtrue;
+	return qtrue;
+}
+
+
+/*
+=============
+SV_ExtractCompareDist
+=============
+*/
+static int QDECL SV_ExtractCompareDist( const void *a, const void *b )
+{
+	const float da = extractDist[ *(const int *)a ];
+	const float db = extractDist[ *(const int *)b ];
+
+	if ( da < db )
+		return -1;
+	if ( da > db )
+		return 1;
+	return 0;
+}
+
+
+/*
+=============
+SV_ExtractCompareIndex
+=============
+*/
+static int QDECL SV_ExtractCompareIndex( const void *a, const void *b )
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+
+/*
+=============
+SV_ExtractSnapshot
+
+Writes the current frame as seen by the extracted client
+=============
+*/
+static void SV_ExtractSnapshot( demoExtract_t *dx )
+{
+	static int list[ MAX_GENTITIES ];
+	static float dist[ MAX_GENTITIES ];
+	static entityState_t snapEntities[ MAX_SNAPSHOT_ENTITIES ];
+	const entityState_t *ents, *es;
+	const playerState_t *ps;
+	vec3_t delta;
+	int i, count, numEnts, deltaNum, flags;
+
+	ps = &dx->ps[ dx->clientNum ];
+	ents = dx->entities[ dx->current ];
+	numEnts = dx->numEntities[ dx->current ];
+
+	// same filters as SV_AddEntitiesVisibleFromPoint without the PVS
+	count = 0;
+	for ( i = 0; i < numEnts; i++ ) {
+		es = &ents[ i ];
+		if ( es->number == ps->clientNum ) {
+			continue;
+		}
+		flags = dx->clientFlags[ es->number ];
+		if ( flags & SVF_SINGLECLIENT && dx->singleClient[ es->number ] != ps->clientNum ) {
+			continue;
+		}
+		if ( flags & SVF_NOTSINGLECLIENT && dx->singleClient[ es->number ] == ps->clientNum ) {
+			continue;
+		}
+		if ( flags & SVF_CLIENTMASK && ( ps->clientNum >= 32 || ( ~dx->singleClient[ es->number ] & ( 1 << ps->clientNum ) ) ) ) {
+			continue;
+		}
+		list[ count++ ] = i;
+	}
+
+	// keep the nearest entities
+	if ( count > MAX_SNAPSHOT_ENTITIES ) {
+		for ( i = 0; i < count; i++ ) {
+			VectorSubtract( ents[ list[ i ] ].pos.trBase, ps->origin, delta );
+			dist[ list[ i ] ] = VectorLengthSquared( delta );
+		}
+		extractDist = dist;
+		qsort( list, count, sizeof( list[0] ), SV_ExtractCompareDist );
+		count = MAX_SNAPSHOT_ENTITIES;
+		qsort( list, count, sizeof( list[0] ), SV_ExtractCompareIndex );
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		snapEntities[ i ] = ents[ list[ i ] ];
+	}
+
+	if ( dx->snapMessageNum && dx->messageNum - dx->snapMessageNum < PACKET_BACKUP ) {
+		deltaNum = dx->messageNum - dx->snapMessageNum;
+	} else {
+		deltaNum = 0;
+	}
+
+	MSG_WriteByte( &dx->msg, svc_snapshot );
+	MSG_WriteLong( &dx->msg, dx->serverTime );
+	MSG_WriteByte( &dx->msg, deltaNum );
+	MSG_WriteByte( &dx->msg, 0 );	// snapFlags
+	MSG_WriteByte( &dx->msg, 0 );	// no areabits, everything is visible
+
+	if ( deltaNum ) {
+		MSG_WriteDeltaPlayerstate( &dx->msg, &dx->snapPs, ps );
+		SV_DemoWriteEntities( &dx->msg, dx->snapEntities, dx->snapNumEntities, snapEntities, count, dx->baselines );
+	} else {
+		MSG_WriteDeltaPlayerstate( &dx->msg, NULL, ps );
+		SV_DemoWriteEntities( &dx->msg, NULL, 0, snapEntities, count, dx->baselines );
+	}
+
+	dx->snapMessageNum = dx->messageNum;
+	if ( !SV_ExtractWriteMessage( dx ) ) {
+		// send a full snapshot next time
+		dx->snapMessageNum = 0;
+		return;
+	}
+
+	dx->snapPs = *ps;
+	dx->snapNumEntities = count;
+	Com_Memcpy( dx->snapEntities, snapEntities, count * sizeof( snapEntities[0] ) );
+	dx->snapshots++;
+}
+
+
+/*
+=============
+SV_ExtractFrame
+=============
+*/
+static qboolean SV_ExtractFrame( demoExtract_t *dx, msg_t *msg )
+{
+	qboolean prevValid[ MAX_CLIENTS ];
+	int i, count, num;
+
+	dx->serverTime = MSG_ReadLong( msg );
+
+	count = SV_DemoReadEntities( msg, dx->entities[ dx->current ], dx->numEntities[ dx->current ],
+		dx->entities[ dx->current ^ 1 ], dx->baselines );
+	if ( count < 0 ) {
+		return qfalse;
+	}
+	dx->current ^= 1;
+	dx->numEntities[ dx->current ] = count;
+
+	Com_Memset( dx->clientFlags, 0, sizeof( dx->clientFlags ) );
+	for ( ;; ) {
+		num = MSG_ReadEntitynum( msg );
+		if ( num < 0 ) {
+			return qfalse;
+		}
+		if ( num == MAX_GENTITIES-1 ) {
+			break;
+		}
+		dx->clientFlags[ num ] = MSG_ReadLong( msg );
+		dx->singleClient[ num ] = MSG_ReadLong( msg );
+	}
+
+	// clients missing from the previous frame are sent without delta
+	Com_Memcpy( prevValid, dx->psValid, sizeof( prevValid ) );
+	Com_Memset( dx->psValid, 0, sizeof( dx->psValid ) );
+	for ( ;; ) {
+		i = MSG_ReadByte( msg );
+		if ( i < 0 ) {
+			return qfalse;
+		}
+		if ( i >= MAX_CLIENTS ) {
+			break;
+		}
+		MSG_ReadDeltaPlayerstate( msg, prevValid[ i ] ? &dx->ps[ i ] : NULL, &dx->ps[ i ] );
+		dx->psValid[ i ] = qtrue;
+	}
+
+	if ( !dx->psValid[ dx->clientNum ] ) {
+		return qtrue;
+	}
+
+	if ( !dx->gamestateWritten && !SV_ExtractGamestate( dx ) ) {
+		return qfalse;
+	}
+
+	SV_ExtractSnapshot( dx );
+	return qtrue;
+}
+
+
+/*
+=============
+SV_ExtractRecord
+
+Parses one record, returns qfalse at the end of the demo or on errors
+=============
+*/
+static qboolean SV_ExtractRecord( demoExtract_t *dx, qboolean header )
+{
+	entityState_t nullstate;
+	msg_t msg;
+	const char *s;
+	int len, cmd, index;
+
+	if ( FS_Read( &len, 4, dx->in ) != 4 ) {
+		return qfalse;
+	}
+	len = LittleLong( len );
+	if ( len == -1 ) {
+		return qfalse;
+	}
+	if ( len < 0 || len > SVDEMO_MSGLEN ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: bad server demo record length %i\n", len );
+		return qfalse;
+	}
+	if ( FS_Read( dx->recordData, len, dx->in ) != len ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: server demo file is truncated\n" );
+		return qfalse;
+	}
+
+	MSG_Init( &msg, dx->recordData, SVDEMO_MSGLEN );
+	msg.cursize = len;
+	MSG_BeginReading( &msg );
+
+	if ( header ) {
+		if ( MSG_ReadLong( &msg ) != SVDEMO_VERSION ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: unsupported server demo version\n" );
+			return qfalse;
+		}
+		dx->protocol = MSG_ReadLong( &msg );
+		MSG_ReadLong( &msg ); // maxclients
+		dx->checksumFeed = MSG_ReadLong( &msg );
+	}
+
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+
+	for ( ;; ) {
+		if ( msg.readcount > msg.cursize ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: read past end of server demo record\n" );
+			return qfalse;
+		}
+
+		cmd = MSG_ReadByte( &msg );
+		switch ( cmd ) {
+		case svdm_EOF:
+			return qtrue;
+
+		case svdm_configstring:
+			index = MSG_ReadShort( &msg );
+			if ( index < 0 || index >= MAX_CONFIGSTRINGS ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: bad configstring index %i\n", index );
+				return qfalse;
+			}
+			s = MSG_ReadBigString( &msg );
+			if ( dx->configstrings[ index ] ) {
+				Z_Free( dx->configstrings[ index ] );
+			}
+			dx->configstrings[ index ] = CopyString( s );
+			SV_ExtractConfigstring( dx, index );
+			break;
+
+		case svdm_baseline:
+			index = MSG_ReadEntitynum( &msg );
+			if ( index < 0 || index >= MAX_GENTITIES - 1 ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: bad baseline number %i\n", index );
+				return qfalse;
+			}
+			MSG_ReadDeltaEntity( &msg, &nullstate, &dx->baselines[ index ], index );
+			dx->baselineUsed[ index ] = qtrue;
+			break;
+
+		case svdm_command:
+			index = MSG_ReadShort( &msg );
+			s = MSG_ReadString( &msg );
+			if ( index == -1 || index == dx->clientNum ) {
+				SV_ExtractCommand( dx, s );
+			}
+			break;
+
+		case svdm_frame:
+			if ( !SV_ExtractFrame( dx, &msg ) ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: bad server demo frame\n" );
+				return qfalse;
+			}
+			break;
+
+		default:
+			Com_Printf( S_COLOR_YELLOW "WARNING: bad server demo command %i\n", cmd );
+			return qfalse;
+		}
+	}
+}
+
+
+/*
+=============
+SV_DemoExtract_f
+
+Writes a client demo from the point of view of one recorded client
+=============
+*/
+void SV_DemoExtract_f( void )
+{
+	char inName[ MAX_QPATH ];
+	char outName[ MAX_QPATH ];
+	char base[ MAX_QPATH ];
+	demoExtract_t *dx;
+	int i, len;
+
+	if ( Cmd_Argc() < 3 || Cmd_Argc() > 4 ) {
+		Com_Printf( "svdemoextract <demoname> <clientnum> [output]\n" );
+		return;
+	}
+
+	SV_DemoFileName( Cmd_Argv( 1 ), inName, sizeof( inName ) );
+
+	dx = Z_Malloc( sizeof( *dx ) );
+	dx->clientNum = atoi( Cmd_Argv( 2 ) );
+	if ( dx->clientNum < 0 || dx->clientNum >= MAX_CLIENTS ) {
+		Com_Printf( "Bad client number %s.\n", Cmd_Argv( 2 ) );
+		Z_Free( dx );
+		return;
+	}
+
+	FS_FOpenFileRead( inName, &dx->in, qtrue );
+	if ( dx->in == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't open %s.\n", inName );
+		Z_Free( dx );
+		return;
+	}
+
+	if ( !SV_ExtractRecord( dx, qtrue ) ) {
+		Com_Printf( "Couldn't read the header of %s.\n", inName );
+		FS_FCloseFile( dx->in );
+		Z_Free( dx );
+		return;
+	}
+
+	if ( Cmd_Argc() == 4 ) {
+		Q_strncpyz( base, Cmd_Argv( 3 ), sizeof( base ) );
+	} else {
+		COM_StripExtension( COM_SkipPath( inName ), base, sizeof( base ) );
+		Q_strcat( base, sizeof( base ), va( "-%i", dx->clientNum ) );
+	}
+	Com_sprintf( outName, sizeof( outName ), "demos/%s.%s%d", base, DEMOEXT, dx->protocol );
+
+	dx->out = FS_FOpenFileWrite( outName );
+	if ( dx->out == FS_INVALID_HANDLE ) {
+		Com_Printf( "ERROR: couldn't open %s.\n", outName );
+		FS_FCloseFile( dx->in );
+		Z_Free( dx );
+		return;
+	}
+	FS_BufferWrites( dx->out );
+
+	SV_ExtractBeginMessage( dx );
+
+	while ( SV_ExtractRecord( dx, qfalse ) )
+		;
+
+	len = -1;
+	FS_Write( &len, 4, dx->out );
+	FS_Write( &len, 4, dx->out );
+	FS_FCloseFile( dx->out );
+	FS_FCloseFile( dx->in );
+
+	if ( dx->snapshots ) {
+		Com_Printf( "Wrote %s, %i snapshots.\n", outName, dx->snapshots );
+	} else {
+		Com_Printf( "Client %i is not in %s.\n", dx->clientNum, inName );
+		FS_HomeRemove( outName );
+	}
+
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		if ( dx->configstrings[ i ] ) {
+			Z_Free( dx->configstrings[ i ] );
+		}
+	}
+	Z_Free( dx );
+}
@@ -52,9 +52,50 @@ typedef struct filter_node_s
 
 	unsigned tagged:1;
 
+	struct filter_scope_s *scope;	// compiled child list, NULL if it is just walked
+
 } filter_node_t;
 
+/*
+Large scopes, like ban lists, are compiled into hash tables so userinfo is
+only compared with nodes that can match it:
+- quoted "==" values and "~" patterns without wildcards hash whole values
+- "~" patterns ending with a single '*' hash their literal prefix, which is
+  probed once for every distinct prefix length, so ip ranges like "1.2.*"
+  cost a few lookups regardless of their count
+Other nodes are evaluated one by one as before, both are merged back by
+position in the scope so the first matching action still wins
+*/
+#define FILTER_INDEX_MIN		16	// smaller scopes are just walked
+#define FILTER_MAX_KEYS			8	// distinct hashed keys per scope
+#define FILTER_MAX_PREFIXES		16	// distinct prefix lengths per key
+#define FILTER_MAX_CANDIDATES	64	// hashed matches, more fall back to walking
+
+typedef struct
+{
+	const char *name;				// lowercase userinfo key
+	unsigned is_fname:1;
+	unsigned exact:1;				// has whole value nodes
+	int numPrefixes;
+	int prefix[ FILTER_MAX_PREFIXES ];
+} filter_key_t;
+
+typedef struct filter_scope_s
+{
+	filter_node_t **node;			// all nodes in scope order
+	int count;
+	int *residual;					// positions of nodes evaluated one by one
+	int numResidual;
+	int *hashHead;					// position + 1, 0 is empty
+	int *hashNext;
+	unsigned hashMask;
+	int numKeys;
+	filter_key_t key[ FILTER_MAX_KEYS ];
+} filter_scope_t;
+
 static filter_node_t *nodes;
+static filter_scope_t *rootScope;
+static qboolean filtersCompiled;
 
 static char filterMessage[ MAX_FILTER_MESSAGE ];
 static char filterDate[ 64 ];  // current date string in "YYYY-MM-DD HH:mm" format
@@ -107,12 +148,34 @@ static void free_nodes( filter_node_t *node )
 		{
 			free_nodes( node->child );
 		}
+		if ( node->scope != NULL )
+		{
+			Z_Free( node->scope );
+		}
 		Z_Free( node );
 		node = next;
 	}
 }
 
 
+static const char *key_value( const char *key, unsigned is_fname )
+{
+	if ( is_fname )
+	{
+		if ( filterName[0] == '\0' )
+		{
+			CleanStr( filterName, sizeof( filterName ), Info_ValueForKeyToken( "name" ) );
+		}
+		//value = node->p1; // p1 points on filterName
+		return filterName;
+	}
+	else
+	{
+		return Info_ValueForKeyToken( key );
+	}
+}
+
+
 static int eval_node( const filter_node_t *node )
 {
 	if ( node->fop == FOP_DROP )
@@ -139,18 +202,8 @@ static int eval_node( const filter_node_t *node )
 			value = node->p1;
 		}
 		else
-		if ( node->is_fname )
-		{
-			if ( filterName[0] == '\0' )
-			{
-				CleanStr( filterName, sizeof( filterName ), Info_ValueForKeyToken( "name" ) );
-			}
-			//value = node->p1; // p1 points on filterName
-			value = filterName;
-		}
-		else
 		{
-			value = Info_ValueForKeyToken( node->p1 ); 
+			value = key_value( node->p1, node->is_fname );
 		}
 
 		if ( node->is_string )
@@ -281,6 +334,8 @@ static void dump_nodes( const filter_node_t *node, int level, int skip_tagged, F
 }
 
 
+static int walk_scope( const filter_scope_t *scope );
+
 static int walk_nodes( const filter_node_t *node )
 {
 	while ( node != NULL )
@@ -288,13 +343,285 @@ static int walk_nodes( const filter_node_t *node )
 		int res;
 		if ( ( res = eval_node( node ) ) != 0 ) // evaluate current node
 		{
-			if ( res < 0 || ( res = walk_nodes( node->child ) ) < 0 )
+			if ( res < 0 )
 			{
 				return res;
 			}
+			if ( node->scope )
+				res = walk_scope( node->scope );
+			else
+				res = walk_nodes( node->child );
+			if ( res < 0 )
+			{
+				return res;
+			}
+		}
+		node = node->next;
+	}
+
+	return 0;
+}
+
+
+static unsigned hash_value( int key, const char *s, int len )
+{
+	unsigned hash = 2166136261U ^ ( key * 0x9E3779B1U );
+
+	// same case folding as Q_stricmp() and Com_FilterExt()
+	while ( len-- != 0 && *s != '\0' )
+	{
+		hash = ( hash ^ locase[ (byte)*s++ ] ) * 16777619U;
+	}
+
+	return hash ^ ( hash >> 15 );
+}
+
+
+// returns qtrue if node can be hashed, *len is prefix length or -1 for whole values
+static qboolean index_length( const filter_node_t *node, int *len )
+{
+	const char *s;
+
+	if ( node->is_date || !node->is_string || node->is_cvar )
+		return qfalse;
+
+	if ( node->fop == FOP_EQ && node->is_quoted )
+	{
+		*len = -1;
+		return qtrue;
+	}
+
+	if ( node->fop != FOP_MATCH )
+		return qfalse;
+
+	for ( s = node->p2.string; *s != '\0'; s++ )
+	{
+		if ( *s == '?' )
+			return qfalse;
+		if ( *s == '*' )
+		{
+			if ( s[1] != '\0' )
+				return qfalse;
+			*len = s - node->p2.string;
+			return qtrue;
+		}
+	}
+
+	*len = -1;
+	return qtrue;
+}
+
+
+static filter_key_t *scope_key( filter_scope_t *scope, const filter_node_t *node, int len )
+{
+	filter_key_t *key;
+	int i;
+
+	for ( i = 0, key = scope->key; i < scope->numKeys; i++, key++ )
+	{
+		if ( node->is_fname ? key->is_fname : ( !key->is_fname && strcmp( key->name, node->p1 ) == 0 ) )
+			break;
+	}
+
+	if ( i == scope->numKeys )
+	{
+		if ( scope->numKeys >= FILTER_MAX_KEYS )
+			return NULL;
+		key->name = node->p1;
+		key->is_fname = node->is_fname;
+		scope->numKeys++;
+	}
+
+	if ( len < 0 )
+	{
+		key->exact = 1;
+		return key;
+	}
+
+	for ( i = 0; i < key->numPrefixes; i++ )
+	{
+		if ( key->prefix[ i ] == len )
+			return key;
+	}
+
+	if ( key->numPrefixes >= FILTER_MAX_PREFIXES )
+		return NULL;
+
+	key->prefix[ key->numPrefixes++ ] = len;
+	return key;
+}
+
+
+// compiles child scopes as well, returns NULL if list is better walked
+static filter_scope_t *compile_scope( filter_node_t *list )
+{
+	filter_scope_t *scope;
+	filter_node_t *node;
+	filter_key_t *key;
+	int count, indexed, hashSize, i, len;
+	unsigned h;
+
+	count = indexed = 0;
+	for ( node = list; node != NULL; node = node->next )
+	{
+		if ( node->child )
+			node->scope = compile_scope( node->child );
+		if ( index_length( node, &len ) )
+			indexed++;
+		count++;
+	}
+
+	if ( indexed < FILTER_INDEX_MIN )
+		return NULL;
+
+	for ( hashSize = 64; hashSize < indexed * 2; hashSize <<= 1 )
+		;
+
+	scope = (filter_scope_t *) Z_Malloc( sizeof( *scope ) + count * ( sizeof( scope->node[0] ) + sizeof( int ) * 2 ) + hashSize * sizeof( int ) );
+	memset( scope, 0, sizeof( *scope ) );
+	scope->node = (filter_node_t **)( scope + 1 );
+	scope->residual = (int *)( scope->node + count );
+	scope->hashNext = scope->residual + count;
+	scope->hashHead = scope->hashNext + count;
+	scope->hashMask = hashSize - 1;
+	scope->count = count;
+	memset( scope->hashHead, 0, hashSize * sizeof( int ) );
+
+	for ( i = 0, node = list; node != NULL; node = node->next )
+		scope->node[ i++ ] = node;
+
+	// insert backwards so chains are ordered by position
+	for ( i = count - 1; i >= 0; i-- )
+	{
+		node = scope->node[ i ];
+		key = NULL;
+		if ( index_length( node, &len ) )
+			key = scope_key( scope, node, len );
+		if ( key == NULL )
+			continue;
+		h = hash_value( ( key - scope->key ) * 2 + ( len >= 0 ), node->p2.string, len ) & scope->hashMask;
+		scope->hashNext[ i ] = scope->hashHead[ h ];
+		scope->hashHead[ h ] = i + 1;
+		scope->residual[ i ] = -1;
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		if ( scope->residual[ i ] != -1 )
+			scope->residual[ scope->numResidual++ ] = i;
+	}
+
+	return scope;
+}
+
+
+static void free_scopes( filter_node_t *node )
+{
+	while ( node != NULL )
+	{
+		if ( node->child )
+			free_scopes( node->child );
+		if ( node->scope )
+		{
+			Z_Free( node->scope );
+			node->scope = NULL;
 		}
 		node = node->next;
 	}
+}
+
+
+// drops compiled data, tree is compiled again on next use
+static void invalidate_filters( void )
+{
+	if ( rootScope )
+	{
+		Z_Free( rootScope );
+		rootScope = NULL;
+	}
+	filtersCompiled = qfalse;
+}
+
+
+static void compile_filters( void )
+{
+	invalidate_filters();
+	free_scopes( nodes );
+
+	rootScope = compile_scope( nodes );
+	filtersCompiled = qtrue;
+}
+
+
+static int walk_scope( const filter_scope_t *scope )
+{
+	int cand[ FILTER_MAX_CANDIDATES ];
+	const filter_key_t *key;
+	const filter_node_t *node;
+	const char *value;
+	int numCand, i, j, k, n, p, res, len;
+	unsigned h;
+
+	// collect hashed nodes which match, sorted by position
+	numCand = 0;
+	for ( k = 0, key = scope->key; k < scope->numKeys; k++, key++ )
+	{
+		value = key_value( key->name, key->is_fname );
+		len = strlen( value );
+		for ( i = key->exact ? -1 : 0; i < key->numPrefixes; i++ )
+		{
+			if ( i < 0 )
+				h = hash_value( k * 2, value, -1 );
+			else if ( key->prefix[ i ] <= len )
+				h = hash_value( k * 2 + 1, value, key->prefix[ i ] );
+			else
+				continue;
+
+			for ( n = scope->hashHead[ h & scope->hashMask ]; n != 0; n = scope->hashNext[ n - 1 ] )
+			{
+				p = n - 1;
+				for ( j = numCand; j > 0 && cand[ j - 1 ] > p; j-- )
+					;
+				if ( j > 0 && cand[ j - 1 ] == p )
+					continue; // already seen from another probe
+				if ( !eval_node( scope->node[ p ] ) )
+					continue;
+				if ( numCand >= FILTER_MAX_CANDIDATES )
+					return walk_nodes( scope->node[ 0 ] );
+				memmove( cand + j + 1, cand + j, ( numCand - j ) * sizeof( cand[0] ) );
+				cand[ j ] = p;
+				numCand++;
+			}
+		}
+	}
+
+	// merge with nodes that always have to be evaluated
+	i = j = 0;
+	while ( i < scope->numResidual || j < numCand )
+	{
+		if ( j >= numCand || ( i < scope->numResidual && scope->residual[ i ] < cand[ j ] ) )
+		{
+			node = scope->node[ scope->residual[ i++ ] ];
+			res = eval_node( node );
+		}
+		else
+		{
+			node = scope->node[ cand[ j++ ] ];
+			res = 1;
+		}
+
+		if ( res != 0 )
+		{
+			if ( res < 0 )
+				return res;
+			if ( node->scope )
+				res = walk_scope( node->scope );
+			else
+				res = walk_nodes( node->child );
+			if ( res < 0 )
+				return res;
+		}
+	}
 
 	return 0;
 }
@@ -671,6 +998,7 @@ static qboolean parse_file( const char *filename )
 	int size;
 	
 	// unconditionally release old filters
+	invalidate_filters();
 	free_nodes( nodes );
 	nodes = NULL;
 
@@ -772,6 +1100,7 @@ static void SV_ReloadFilters( const char *filename, filter_node_t *new_node )
 			// link new new node
 			new_node->next = nodes;
 			nodes = new_node;
+			invalidate_filters();
 			dump = qtrue;
 		}
 
@@ -843,7 +1172,10 @@ const char *SV_RunFilters( const char *userinfo, const netadr_t *addr )
 	filterMessage[0] = '\0';
 	filterCurrMsec = Sys_Milliseconds();
 
-	if ( walk_nodes( nodes ) != 0 )
+	if ( !filtersCompiled )
+		compile_filters();
+
+	if ( ( rootScope ? walk_scope( rootScope ) : walk_nodes( nodes ) ) != 0 )
 	{
 		if ( filterMessage[0] )
 			return filterMessage;
@@ -991,7 +1323,7 @@ void SV_AddFilter_f( void )
 	keys = 0;
 	reason = "";
 
-	Info_Tokenize( cl->userinfo );
+	Info_Tokenize( SV_ClientCold( cl )->userinfo );
 
 	// attach userinfo keys
 	for ( i = 2; i < Cmd_Argc(); i++ )
@@ -23,7 +23,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "server.h"
 
+#include <setjmp.h>
+
 #include "../botlib/botlib.h"
+#include "../botlib/be_aas.h"
 
 botlib_export_t	*botlib_export;
 
@@ -347,10 +350,614 @@ static qboolean SV_GetValue( char* value, int valueSize, const char* key )
 		return qtrue;
 	}
 
+	if ( !Q_stricmp( key, "trap_TraceBatch_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_TRACE_BATCH );
+		return qtrue;
+	}
+
+	if ( !Q_stricmp( key, "trap_BotThinkParallel_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_BOT_THINK_PARALLEL );
+		return qtrue;
+	}
+
+	if ( !Q_stricmp( key, "trap_AAS_AreaTravelTimes_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_AAS_AREA_TRAVEL_TIMES );
+		return qtrue;
+	}
+
+	if ( !Q_stricmp( key, "trap_AAS_PointAreaNums_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_AAS_POINT_AREA_NUMS );
+		return qtrue;
+	}
+
+	if ( !Q_stricmp( key, "trap_AAS_PredictClientMovements_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_AAS_PREDICT_CLIENT_MOVEMENTS );
+		return qtrue;
+	}
+
 	return qfalse;
 }
 
 
+/*
+====================
+SV_TraceBatch
+
+Runs a set of traces in one system call
+====================
+*/
+static void SV_TraceBatch( intptr_t requests, intptr_t results, int count ) {
+	const traceRequest_t *req;
+	trace_t *tr;
+	int i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	if ( count > MAX_TRACE_BATCH ) {
+		Com_Error( ERR_DROP, "%s: bad count %i", __func__, count );
+	}
+
+	VM_CHECKBOUNDS( gvm, requests, count * sizeof( *req ) );
+	VM_CHECKBOUNDS( gvm, results, count * sizeof( *tr ) );
+
+	req = VM_ArgPtr( requests );
+	tr = VM_ArgPtr( results );
+
+	for ( i = 0; i < count; i++, req++, tr++ ) {
+		SV_Trace( tr, req->start, req->mins, req->maxs, req->end, req->passEntityNum, req->contentmask, req->capsule ? qtrue : qfalse );
+	}
+}
+
+
+/*
+====================
+SV_AASAreaTravelTimes
+
+Travel times from one area towards a set of goal areas in one system call
+====================
+*/
+static int SV_AASAreaTravelTimes( intptr_t *args ) {
+	int count = args[4];
+
+	if ( count <= 0 ) {
+		return 0;
+	}
+
+	if ( count > MAX_AAS_BATCH ) {
+		Com_Error( ERR_DROP, "%s: bad count %i", __func__, count );
+	}
+
+	VM_CHECKBOUNDS( gvm, args[3], count * sizeof( int ) );
+	VM_CHECKBOUNDS( gvm, args[6], count * sizeof( int ) );
+
+	return botlib_export->aas.AAS_AreaTravelTimesToGoalAreas( args[1], VMA(2), VMA(3), count, args[5], VMA(6) );
+}
+
+
+/*
+====================
+SV_AASPointAreaNums
+
+Areas of a set of points in one system call
+====================
+*/
+static int SV_AASPointAreaNums( intptr_t points, intptr_t areanums, int count ) {
+
+	if ( count <= 0 ) {
+		return 0;
+	}
+
+	if ( count > MAX_AAS_BATCH ) {
+		Com_Error( ERR_DROP, "%s: bad count %i", __func__, count );
+	}
+
+	VM_CHECKBOUNDS( gvm, points, count * sizeof( vec3_t ) );
+	VM_CHECKBOUNDS( gvm, areanums, count * sizeof( int ) );
+
+	return botlib_export->aas.AAS_PointAreaNums( VM_ArgPtr( points ), count, VM_ArgPtr( areanums ) );
+}
+
+
+/*
+====================
+SV_AASPredictClientMovements
+
+Movement predictions of several bots in one system call
+====================
+*/
+static int SV_AASPredictClientMovements( intptr_t predictions, int count ) {
+
+	if ( count <= 0 ) {
+		return 0;
+	}
+
+	if ( count > MAX_AAS_BATCH ) {
+		Com_Error( ERR_DROP, "%s: bad count %i", __func__, count );
+	}
+
+	VM_CHECKBOUNDS( gvm, predictions, count * sizeof( aas_clientpredict_t ) );
+
+	return botlib_export->aas.AAS_PredictClientMovements( VM_ArgPtr( predictions ), count );
+}
+
+
+/*
+====================
+Parallel bot thinking
+
+With sv_botThinkWorkers the game qvm gets extra instances that share its data
+segment, each with own stack and compiled code, see VM_CreateWorker.
+G_BOT_THINK_PARALLEL runs BOTAI_THINK_PARALLEL on them for a set of clients
+using job threads while the main instance waits in the system call.
+
+Workers may only call a limited set of system calls: math and memory traps run
+directly, world queries and botlib calls are serialized with a lock because
+collision and botlib code keep shared scratch state. Prints and errors are
+collected per worker and passed on by the main thread once all are done,
+Com_Error raised on a worker (system calls, botlib, vm faults) releases the
+lock and leaves the worker vm the same way as G_ERROR.
+====================
+*/
+#define WORKER_PRINT_SIZE	4096
+
+typedef struct {
+	vm_t		*vm;
+	jmp_buf		abort;						// leaves the worker vm on error
+	qboolean	locked;						// holds gw.lock
+	int			errorCode;
+	char		error[ MAX_STRING_CHARS ];
+	char		print[ WORKER_PRINT_SIZE ];
+	int			printLength;
+} gameWorker_t;
+
+typedef struct {
+	gameWorker_t	workers[ MAX_GAME_WORKERS ];
+	int				numWorkers;
+
+	void			*lock;						// serializes shared system calls and client selection
+
+	int				clientNums[ MAX_CLIENTS ];
+	int				count;
+	int				next;
+	int				time;
+} gameWorkers_t;
+
+static gameWorkers_t gw;
+
+static intptr_t SV_GameSystemCalls( intptr_t *args );
+
+
+/*
+====================
+SV_GameWorkerAbort
+====================
+*/
+static void QDECL SV_GameWorkerAbort( gameWorker_t *w, const char *fmt, ... ) {
+	va_list argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( w->error, sizeof( w->error ), fmt, argptr );
+	va_end( argptr );
+
+	Q_longjmp( w->abort, 1 );
+}
+
+
+/*
+====================
+SV_GameWorkerError
+
+Com_Error handler of the worker threads
+====================
+*/
+static void SV_GameWorkerError( void *arg, int code, const char *msg ) {
+	gameWorker_t *w = (gameWorker_t *)arg;
+
+	if ( w->locked ) {
+		w->locked = qfalse;
+		Sys_UnlockMutex( gw.lock );
+	}
+
+	w->errorCode = code;
+	SV_GameWorkerAbort( w, "%s", msg );
+}
+
+
+/*
+====================
+SV_GameWorkerLock
+====================
+*/
+static void SV_GameWorkerLock( gameWorker_t *w ) {
+	Sys_LockMutex( gw.lock );
+	w->locked = qtrue;
+}
+
+
+/*
+====================
+SV_GameWorkerUnlock
+====================
+*/
+static void SV_GameWorkerUnlock( gameWorker_t *w ) {
+	w->locked = qfalse;
+	Sys_UnlockMutex( gw.lock );
+}
+
+
+/*
+====================
+SV_GameWorkerPrint
+====================
+*/
+static void SV_GameWorkerPrint( gameWorker_t *w, const char *text ) {
+	int len;
+
+	len = (int)strlen( text );
+	if ( len > (int)sizeof( w->print ) - 1 - w->printLength ) {
+		len = (int)sizeof( w->print ) - 1 - w->printLength;
+	}
+
+	Com_Memcpy( w->print + w->printLength, text, len );
+	w->printLength += len;
+	w->print[ w->printLength ] = '\0';
+}
+
+
+/*
+====================
+SV_GameWorkerSystemCalls
+
+Filters system calls made by BOTAI_THINK_PARALLEL
+====================
+*/
+static intptr_t SV_GameWorkerSystemCalls( gameWorker_t *w, intptr_t *args ) {
+	unsigned int dst, src, len;
+	intptr_t r;
+
+	switch ( args[0] ) {
+	case G_PRINT:
+		SV_GameWorkerPrint( w, (const char *)VMA(1) );
+		return 0;
+	case G_ERROR:
+		SV_GameWorkerAbort( w, "%s", (const char *)VMA(1) );
+		return 0;
+
+	// no shared state
+	case G_MILLISECONDS:
+	case G_SNAPVECTOR:
+	case G_MATRIXMULTIPLY:
+	case G_ANGLEVECTORS:
+	case G_PERPENDICULARVECTOR:
+	case G_FLOOR:
+	case G_CEIL:
+	case G_TESTPRINTINT:
+	case G_TESTPRINTFLOAT:
+	case TRAP_MEMSET:
+	case TRAP_STRNCPY:
+	case TRAP_SIN:
+	case TRAP_COS:
+	case TRAP_ATAN2:
+	case TRAP_SQRT:
+		return SV_GameSystemCalls( args );
+
+	case TRAP_MEMCPY:
+		// same check as VM_CheckBounds2() without Com_Error
+		dst = args[1];
+		src = args[2];
+		len = args[3];
+		if ( (dst | src | len) > gvm->dataMask || (dst + len) > gvm->dataMask || (src + len) > gvm->dataMask ) {
+			SV_GameWorkerAbort( w, "program tried to bypass data segment bounds" );
+		}
+		return SV_GameSystemCalls( args );
+
+	case G_TRACE_BATCH:
+		if ( args[3] > MAX_TRACE_BATCH ) {
+			SV_GameWorkerAbort( w, "G_TRACE_BATCH: bad count %i", (int)args[3] );
+		}
+		break;
+
+	case G_AAS_AREA_TRAVEL_TIMES:
+		if ( args[4] > MAX_AAS_BATCH ) {
+			SV_GameWorkerAbort( w, "G_AAS_AREA_TRAVEL_TIMES: bad count %i", (int)args[4] );
+		}
+		break;
+
+	case G_AAS_POINT_AREA_NUMS:
+		if ( args[2] > MAX_AAS_BATCH ) {
+			SV_GameWorkerAbort( w, "G_AAS_POINT_AREA_NUMS: bad count %i", (int)args[2] );
+		}
+		break;
+
+	case G_AAS_PREDICT_CLIENT_MOVEMENTS:
+		if ( args[2] > MAX_AAS_BATCH ) {
+			SV_GameWorkerAbort( w, "G_AAS_PREDICT_CLIENT_MOVEMENTS: bad count %i", (int)args[2] );
+		}
+		break;
+
+	// world queries
+	case G_TRACE:
+	case G_TRACECAPSULE:
+	case G_POINT_CONTENTS:
+	case G_ENTITIES_IN_BOX:
+	case G_ENTITY_CONTACT:
+	case G_ENTITY_CONTACTCAPSULE:
+	case G_IN_PVS:
+	case G_IN_PVS_IGNORE_PORTALS:
+	case G_AREAS_CONNECTED:
+	case G_GET_USERCMD:
+		if ( (unsigned)args[1] >= sv_maxclients->integer ) {
+			SV_GameWorkerAbort( w, "G_GET_USERCMD: bad clientNum %i", (int)args[1] );
+		}
+		break;
+
+	case G_GET_CONFIGSTRING:
+		if ( args[3] < 1 || (unsigned)args[1] >= MAX_CONFIGSTRINGS ) {
+			SV_GameWorkerAbort( w, "G_GET_CONFIGSTRING: bad index %i or bufferSize %i", (int)args[1], (int)args[3] );
+		}
+		break;
+
+	case G_GET_USERINFO:
+		if ( args[3] < 1 || (unsigned)args[1] >= sv_maxclients->integer ) {
+			SV_GameWorkerAbort( w, "G_GET_USERINFO: bad index %i or bufferSize %i", (int)args[1], (int)args[3] );
+		}
+		break;
+
+	case G_GET_SERVERINFO:
+	case G_CVAR_VARIABLE_INTEGER_VALUE:
+	case G_TRAP_GETVALUE:
+		break;
+
+	// botlib calls that change global botlib state, load files or run commands
+	case BOTLIB_SETUP:
+	case BOTLIB_SHUTDOWN:
+	case BOTLIB_LIBVAR_SET:
+	case BOTLIB_PC_ADD_GLOBAL_DEFINE:
+	case BOTLIB_PC_LOAD_SOURCE:
+	case BOTLIB_PC_FREE_SOURCE:
+	case BOTLIB_PC_READ_TOKEN:
+	case BOTLIB_PC_SOURCE_FILE_AND_LINE:
+	case BOTLIB_START_FRAME:
+	case BOTLIB_LOAD_MAP:
+	case BOTLIB_UPDATENTITY:
+	case BOTLIB_TEST:
+	case BOTLIB_USER_COMMAND:
+	case BOTLIB_EA_SAY:
+	case BOTLIB_EA_SAY_TEAM:
+	case BOTLIB_EA_COMMAND:
+	case BOTLIB_AI_ENTER_CHAT:
+	case BOTLIB_AI_LOAD_CHARACTER:
+	case BOTLIB_AI_LOAD_CHAT_FILE:
+	case BOTLIB_AI_LOAD_ITEM_WEIGHTS:
+	case BOTLIB_AI_LOAD_WEAPON_WEIGHTS:
+	case BOTLIB_AI_INIT_LEVEL_ITEMS:
+	case BOTLIB_AI_UPDATE_ENTITY_ITEMS:
+		SV_GameWorkerAbort( w, "system call %i is not allowed in BOTAI_THINK_PARALLEL", (int)args[0] );
+		return 0;
+
+	default:
+		if ( args[0] < BOTLIB_SETUP || args[0] >= G_TRACE_BATCH ) {
+			SV_GameWorkerAbort( w, "system call %i is not allowed in BOTAI_THINK_PARALLEL", (int)args[0] );
+		}
+		break;
+	}
+
+	SV_GameWorkerLock( w );
+	r = SV_GameSystemCalls( args );
+	SV_GameWorkerUnlock( w );
+
+	return r;
+}
+
+
+// system call handler of each worker instance
+#define GAME_WORKER_CALLS(n) static intptr_t SV_GameWorkerCalls##n( intptr_t *args ) { return SV_GameWorkerSystemCalls( &gw.workers[n], args ); }
+
+GAME_WORKER_CALLS(0)  GAME_WORKER_CALLS(1)  GAME_WORKER_CALLS(2)  GAME_WORKER_CALLS(3)
+GAME_WORKER_CALLS(4)  GAME_WORKER_CALLS(5)  GAME_WORKER_CALLS(6)  GAME_WORKER_CALLS(7)
+GAME_WORKER_CALLS(8)  GAME_WORKER_CALLS(9)  GAME_WORKER_CALLS(10) GAME_WORKER_CALLS(11)
+GAME_WORKER_CALLS(12) GAME_WORKER_CALLS(13) GAME_WORKER_CALLS(14) GAME_WORKER_CALLS(15)
+
+static const syscall_t gameWorkerCalls[ MAX_GAME_WORKERS ] = {
+	SV_GameWorkerCalls0,  SV_GameWorkerCalls1,  SV_GameWorkerCalls2,  SV_GameWorkerCalls3,
+	SV_GameWorkerCalls4,  SV_GameWorkerCalls5,  SV_GameWorkerCalls6,  SV_GameWorkerCalls7,
+	SV_GameWorkerCalls8,  SV_GameWorkerCalls9,  SV_GameWorkerCalls10, SV_GameWorkerCalls11,
+	SV_GameWorkerCalls12, SV_GameWorkerCalls13, SV_GameWorkerCalls14, SV_GameWorkerCalls15
+};
+
+
+/*
+====================
+SV_GameWorkerCount
+
+Number of worker stacks to reserve in game qvm
+====================
+*/
+static int SV_GameWorkerCount( void ) {
+	int count;
+
+	count = sv_botThinkWorkers->integer;
+	if ( count > Com_JobWorkers() + 1 ) {
+		count = Com_JobWorkers() + 1;
+	}
+	if ( count > MAX_GAME_WORKERS ) {
+		count = MAX_GAME_WORKERS;
+	}
+
+	// nothing to run in parallel with
+	return count > 1 ? count : 0;
+}
+
+
+/*
+====================
+SV_ReserveGameWorkers
+
+Gives the game qvm its worker stacks before it is loaded, so \vmcompile
+generates code for the same data layout as the server
+====================
+*/
+void SV_ReserveGameWorkers( void ) {
+	VM_ReserveWorkers( VM_GAME, SV_GameWorkerCount() );
+}
+
+
+/*
+====================
+SV_StartGameWorkers
+====================
+*/
+static void SV_StartGameWorkers( int count ) {
+	vm_t *vm;
+	int i;
+
+	if ( count <= 0 || gvm->dllHandle ) {
+		return;
+	}
+
+	gw.lock = Sys_CreateMutex();
+	if ( !gw.lock ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create game worker lock\n" );
+		return;
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		vm = VM_CreateWorker( gvm, i, gameWorkerCalls[ i ] );
+		if ( !vm ) {
+			break;
+		}
+		gw.workers[ gw.numWorkers++ ].vm = vm;
+	}
+
+	if ( gw.numWorkers ) {
+		Com_Printf( "%i game workers for parallel bot thinking\n", gw.numWorkers );
+	}
+}
+
+
+/*
+====================
+SV_StopGameWorkers
+====================
+*/
+static void SV_StopGameWorkers( void ) {
+	int i;
+
+	for ( i = 0; i < gw.numWorkers; i++ ) {
+		VM_FreeWorker( gw.workers[ i ].vm );
+	}
+
+	Sys_DestroyMutex( gw.lock );
+
+	Com_Memset( &gw, 0, sizeof( gw ) );
+}
+
+
+/*
+====================
+SV_BotThinkJob
+
+Thinks for clients until there are no more left, index selects the worker
+====================
+*/
+static void SV_BotThinkJob( void *data, int index ) {
+	gameWorker_t *w = &gw.workers[ index ];
+	int n;
+
+	w->locked = qfalse;
+
+	if ( Q_setjmp( w->abort ) ) {
+		Com_SetThreadErrorHandler( NULL, NULL );
+		VM_ResetWorker( w->vm );
+		return;
+	}
+
+	Com_SetThreadErrorHandler( SV_GameWorkerError, w );
+
+	for ( ;; ) {
+		SV_GameWorkerLock( w );
+		n = gw.next < gw.count ? gw.next++ : -1;
+		SV_GameWorkerUnlock( w );
+
+		if ( n < 0 ) {
+			break;
+		}
+
+		VM_Call( w->vm, 2, BOTAI_THINK_PARALLEL, gw.clientNums[ n ], gw.time );
+	}
+
+	Com_SetThreadErrorHandler( NULL, NULL );
+}
+
+
+/*
+====================
+SV_BotThinkParallel
+====================
+*/
+static qboolean SV_BotThinkParallel( intptr_t clientNums, int count, int time ) {
+	const int *nums;
+	gameWorker_t *w;
+	int i, numJobs;
+
+	if ( gw.numWorkers <= 0 || count <= 0 ) {
+		return qfalse;
+	}
+
+	if ( count > sv_maxclients->integer ) {
+		Com_Error( ERR_DROP, "%s: bad count %i", __func__, count );
+	}
+
+	VM_CHECKBOUNDS( gvm, clientNums, count * sizeof( int ) );
+
+	nums = VM_ArgPtr( clientNums );
+	for ( i = 0; i < count; i++ ) {
+		if ( (unsigned)nums[ i ] >= sv_maxclients->integer ) {
+			Com_Error( ERR_DROP, "%s: bad clientNum %i", __func__, nums[ i ] );
+		}
+		gw.clientNums[ i ] = nums[ i ];
+	}
+
+	gw.count = count;
+	gw.next = 0;
+	gw.time = time;
+
+	for ( i = 0; i < gw.numWorkers; i++ ) {
+		gw.workers[ i ].errorCode = ERR_DROP;
+		gw.workers[ i ].error[0] = '\0';
+		gw.workers[ i ].print[0] = '\0';
+		gw.workers[ i ].printLength = 0;
+	}
+
+	numJobs = count < gw.numWorkers ? count : gw.numWorkers;
+
+	Com_ParallelForPool( JOB_POOL_BOT, SV_BotThinkJob, NULL, numJobs );
+
+	for ( i = 0; i < numJobs; i++ ) {
+		w = &gw.workers[ i ];
+		if ( w->printLength ) {
+			Com_Printf( "%s", w->print );
+		}
+	}
+
+	for ( i = 0; i < numJobs; i++ ) {
+		w = &gw.workers[ i ];
+		if ( w->error[0] ) {
+			Com_Error( w->errorCode, "%s", w->error );
+		}
+	}
+
+	return qtrue;
+}
+
+
 /*
 ====================
 SV_GameSystemCalls
@@ -950,6 +1557,22 @@ static intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case G_TESTPRINTFLOAT:
 		return sprintf( VMA(1), "%f", VMF(2) );
 
+	case G_TRACE_BATCH:
+		SV_TraceBatch( args[1], args[2], args[3] );
+		return 0;
+
+	case G_AAS_AREA_TRAVEL_TIMES:
+		return SV_AASAreaTravelTimes( args );
+
+	case G_AAS_POINT_AREA_NUMS:
+		return SV_AASPointAreaNums( args[1], args[2], args[3] );
+
+	case G_AAS_PREDICT_CLIENT_MOVEMENTS:
+		return SV_AASPredictClientMovements( args[1], args[2] );
+
+	case G_BOT_THINK_PARALLEL:
+		return SV_BotThinkParallel( args[1], args[2], args[3] );
+
 	case G_TRAP_GETVALUE:
 		VM_CHECKBOUNDS( gvm, args[1], args[2] );
 		return SV_GetValue( VMA(1), args[2], VMA(3) );
@@ -993,6 +1616,7 @@ Called every time a map changes
 ===============
 */
 void SV_ShutdownGameProgs( void ) {
+	SV_StopGameWorkers();
 	if ( !gvm ) {
 		return;
 	}
@@ -1056,6 +1680,35 @@ void SV_RestartGameProgs( void ) {
 }
 
 
+/*
+===================
+SV_ReloadGameProgs
+
+Moves current game state into a rebuilt native game module, see VM_ReloadDll
+===================
+*/
+qboolean SV_ReloadGameProgs( void ) {
+	vmReload_t reload;
+	int i;
+
+	if ( !gvm || !VM_ReloadDll( gvm, &reload ) ) {
+		return qfalse;
+	}
+
+	// entity arrays registered with SV_LocateGameData
+	sv.gentities = VM_ReloadPointer( &reload, sv.gentities );
+	sv.gameClients = VM_ReloadPointer( &reload, sv.gameClients );
+
+	for ( i = 0; i < sv_maxclients->integer; i++ ) {
+		if ( svs.clients[i].gentity ) {
+			svs.clients[i].gentity = VM_ReloadPointer( &reload, svs.clients[i].gentity );
+		}
+	}
+
+	return qtrue;
+}
+
+
 /*
 ===============
 SV_InitGameProgs
@@ -1065,6 +1718,7 @@ Called on a normal map change, not on a map_restart
 */
 void SV_InitGameProgs( void ) {
 	cvar_t	*var;
+	int		workers;
 	//FIXME these are temp while I make bots run in vm
 	extern int	bot_enable;
 
@@ -1077,11 +1731,15 @@ void SV_InitGameProgs( void ) {
 	}
 
 	// load the dll or bytecode
+	workers = SV_GameWorkerCount();
+	VM_ReserveWorkers( VM_GAME, workers );
 	gvm = VM_Create( VM_GAME, SV_GameSystemCalls, SV_DllSyscall, Cvar_VariableIntegerValue( "vm_game" ) );
 	if ( !gvm ) {
 		Com_Error( ERR_DROP, "VM_Create on game failed" );
 	}
 
+	SV_StartGameWorkers( workers );
+
 	SV_InitGameVM( qfalse );
 
 	// load userinfo filters
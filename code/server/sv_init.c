@@ -64,36 +64,76 @@ static void SV_SendConfigstring(client_t *client, int index)
 			remaining -= (maxChunkSize - 1);
 		}
 	} else {
-		// standard cs, just send it
-		SV_SendServerCommand( client, "cs %i \"%s\"", index,
-			sv.configstrings[index] );
+		// standard cs, the command is built once for all clients
+		if ( !sv.csCommands[index] ) {
+			sv.csCommands[index] = SV_NewServerCommand( va( "cs %i \"%s\"", index,
+				sv.configstrings[index] ) );
+		}
+		SV_QueueServerCommand( client, sv.csCommands[index] );
 	}
 }
 
+
+/*
+===============
+SV_MarkConfigstring
+
+Configstring updates of a client are coalesced by index until
+they are sent by SV_UpdateConfigstrings
+===============
+*/
+static void SV_MarkConfigstring( client_t *client, int index )
+{
+	clientCold_t *cold;
+
+	if ( client->csUpdated[ index ] ) {
+		return;
+	}
+
+	cold = SV_ClientCold( client );
+	client->csUpdated[ index ] = qtrue;
+	cold->pendingCs[ cold->numPendingCs++ ] = index;
+}
+
+
 /*
 ===============
 SV_UpdateConfigstrings
 
-Called when a client goes from CS_PRIMED to CS_ACTIVE.  Updates all
-Configstring indexes that have changed while the client was in CS_PRIMED
+Sends configstrings changed since the gamestate or the last update, called
+when a client goes from CS_PRIMED to CS_ACTIVE, before any other command
+is queued to an active client and before its snapshots
 ===============
 */
 void SV_UpdateConfigstrings(client_t *client)
 {
-	int index;
+	clientCold_t *cold = SV_ClientCold( client );
+	int i, n, index;
+
+	// sending queues commands, which would flush again
+	n = cold->numPendingCs;
+	cold->numPendingCs = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		index = cold->pendingCs[ i ];
 
-	for( index = 0; index < MAX_CONFIGSTRINGS; index++ ) {
 		// if the CS hasn't changed since we went to CS_PRIMED, ignore
 		if(!client->csUpdated[index])
 			continue;
 
+		client->csUpdated[index] = qfalse;
+
 		// do not always send server info to all clients
 		if ( index == CS_SERVERINFO && ( SV_GentityNum( client - svs.clients )->r.svFlags & SVF_NOSERVERINFO ) ) {
 			continue;
 		}
 
 		SV_SendConfigstring(client, index);
-		client->csUpdated[index] = qfalse;
+
+		// dropped for a command overflow
+		if ( client->state == CS_ZOMBIE ) {
+			break;
+		}
 	}
 }
 
@@ -124,23 +164,26 @@ void SV_SetConfigstring (int index, const char *val) {
 	Z_Free( sv.configstrings[index] );
 	sv.configstrings[index] = CopyString( val );
 
+	SV_ReleaseServerCommand( sv.csCommands[index] );
+	sv.csCommands[index] = NULL;
+
+	SV_InvalidateGameState();
+
+	SV_InvalidateQueryCache();
+
+	SV_DemoConfigstring( index );
+
 	// send it to all the clients if we aren't
 	// spawning a new server
 	if ( sv.state == SS_GAME || sv.restarting ) {
 
-		// send the data to all relevant clients
+		// mark it for all relevant clients, repeated updates
+		// before the next send cost nothing
 		for (i = 0, client = svs.clients; i < sv_maxclients->integer ; i++, client++) {
-			if ( client->state < CS_ACTIVE ) {
-				if ( client->state == CS_PRIMED )
-					client->csUpdated[ index ] = qtrue;
-				continue;
-			}
-			// do not always send server info to all clients
-			if ( index == CS_SERVERINFO && ( SV_GentityNum( i )->r.svFlags & SVF_NOSERVERINFO ) ) {
+			if ( client->state < CS_PRIMED ) {
 				continue;
 			}
-
-			SV_SendConfigstring(client, index);
+			SV_MarkConfigstring( client, index );
 		}
 	}
 }
@@ -182,7 +225,7 @@ void SV_SetUserinfo( int index, const char *val ) {
 		val = "";
 	}
 
-	Q_strncpyz( svs.clients[index].userinfo, val, sizeof( svs.clients[ index ].userinfo ) );
+	Q_strncpyz( svs.clientsCold[index].userinfo, val, sizeof( svs.clientsCold[ index ].userinfo ) );
 	Q_strncpyz( svs.clients[index].name, Info_ValueForKey( val, "name" ), sizeof(svs.clients[index].name) );
 }
 
@@ -201,7 +244,7 @@ void SV_GetUserinfo( int index, char *buffer, int bufferSize ) {
 	if ( index < 0 || index >= sv_maxclients->integer ) {
 		Com_Error (ERR_DROP, "SV_GetUserinfo: bad index %i", index);
 	}
-	Q_strncpyz( buffer, svs.clients[ index ].userinfo, bufferSize );
+	Q_strncpyz( buffer, svs.clientsCold[ index ].userinfo, bufferSize );
 }
 
 
@@ -231,6 +274,8 @@ static void SV_CreateBaseline( void ) {
 		sv.svEntities[ entnum ].baseline = ent->s;
 		sv.baselineUsed[ entnum ] = 1;
 	}
+
+	SV_InvalidateGameState();
 }
 
 
@@ -281,6 +326,8 @@ static void SV_Startup( void ) {
 
 	svs.clients = Z_TagMalloc( sv_maxclients->integer * sizeof( client_t ), TAG_CLIENTS );
 	Com_Memset( svs.clients, 0, sv_maxclients->integer * sizeof( client_t ) );
+	svs.clientsCold = Z_TagMalloc( sv_maxclients->integer * sizeof( clientCold_t ), TAG_CLIENTS );
+	Com_Memset( svs.clientsCold, 0, sv_maxclients->integer * sizeof( clientCold_t ) );
 	SV_SetSnapshotParams();
 	svs.initialized = qtrue;
 
@@ -307,6 +354,7 @@ void SV_ChangeMaxClients( void ) {
 	int		oldMaxClients;
 	int		i;
 	client_t	*oldClients;
+	clientCold_t	*oldClientsCold;
 	int		count;
 
 	// get the highest client number in use
@@ -328,31 +376,45 @@ void SV_ChangeMaxClients( void ) {
 	}
 
 	oldClients = Hunk_AllocateTempMemory( count * sizeof(client_t) );
+	oldClientsCold = Hunk_AllocateTempMemory( count * sizeof(clientCold_t) );
 	// copy the clients to hunk memory
 	for ( i = 0 ; i < count ; i++ ) {
 		if ( svs.clients[i].state >= CS_CONNECTED ) {
 			oldClients[i] = svs.clients[i];
+			oldClientsCold[i] = svs.clientsCold[i];
 		}
 		else {
 			Com_Memset(&oldClients[i], 0, sizeof(client_t));
 		}
 	}
 
+	// release queued commands of the clients that are not kept
+	for ( i = 0 ; i < oldMaxClients ; i++ ) {
+		if ( i >= count || svs.clients[i].state < CS_CONNECTED ) {
+			SV_FreeReliableCommands( &svs.clients[i] );
+		}
+	}
+
 	// free old clients arrays
+	Z_Free( svs.clientsCold );
 	Z_Free( svs.clients );
 
 	// allocate new clients
 	svs.clients = Z_TagMalloc( sv_maxclients->integer * sizeof(client_t), TAG_CLIENTS );
 	Com_Memset( svs.clients, 0, sv_maxclients->integer * sizeof(client_t) );
+	svs.clientsCold = Z_TagMalloc( sv_maxclients->integer * sizeof(clientCold_t), TAG_CLIENTS );
+	Com_Memset( svs.clientsCold, 0, sv_maxclients->integer * sizeof(clientCold_t) );
 
 	// copy the clients over
 	for ( i = 0 ; i < count ; i++ ) {
 		if ( oldClients[i].state >= CS_CONNECTED ) {
 			svs.clients[i] = oldClients[i];
+			svs.clientsCold[i] = oldClientsCold[i];
 		}
 	}
 
 	// free the old clients on the hunk
+	Hunk_FreeTempMemory( oldClientsCold );
 	Hunk_FreeTempMemory( oldClients );
 
 	SV_SetSnapshotParams();
@@ -371,6 +433,7 @@ static void SV_ClearServer( void ) {
 		if ( sv.configstrings[i] ) {
 			Z_Free( sv.configstrings[i] );
 		}
+		SV_ReleaseServerCommand( sv.csCommands[i] );
 	}
 
 	if ( !sv_levelTimeReset->integer ) {
@@ -398,6 +461,9 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 	qboolean	isBot;
 	const char	*p;
 
+	// server demos end with the map
+	SV_StopRecord();
+
 	// shut down the existing game if it is running
 	SV_ShutdownGameProgs();
 
@@ -406,6 +472,8 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 
 	Sys_SetStatus( "Initializing server..." );
 
+	FS_ProfileBegin( mapname );
+
 #ifndef DEDICATED
 	// if not running a dedicated server CL_MapLoading will connect the client to the server
 	// also print some status stuff
@@ -660,10 +728,26 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 
 	Com_Printf ("-----------------------------------\n");
 
+	// listen server keeps recording until cgame is loaded
+	if ( com_dedicated->integer ) {
+		FS_ProfileEnd();
+	}
+
 	Sys_SetStatus( "Running map %s", mapname );
 }
 
 
+/*
+===============
+SV_RateCvarChanged
+===============
+*/
+static void SV_RateCvarChanged( cvar_t *var )
+{
+	SV_TrackCvarChanges();
+}
+
+
 /*
 ===============
 SV_Init
@@ -780,6 +864,57 @@ void SV_Init( void )
 	sv_filter = Cvar_Get( "sv_filter", "filter.txt", CVAR_ARCHIVE );
 	Cvar_SetDescription( sv_filter, "Cvar that point on filter file, if it is "" then filtering will be disabled." );
 
+	sv_snapshotThreads = Cvar_Get( "sv_snapshotThreads", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_snapshotThreads, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_snapshotThreads, "Build and encode client snapshots in parallel on worker threads, see com_jobThreads." );
+	sv_visCache = Cvar_Get( "sv_visCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_visCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_visCache, "Share entity visibility checks between clients standing in the same PVS cluster and area, see \\viscache." );
+	sv_deltaCache = Cvar_Get( "sv_deltaCache", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_deltaCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_deltaCache, "Reuse encoded packet entities for clients that delta from the same frame to the same entity set, e.g. spectators following the same player, see \\viscache." );
+	sv_gamestateCompress = Cvar_Get( "sv_gamestateCompress", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_gamestateCompress, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_gamestateCompress, "Send configstrings of the gamestate as one compressed block to clients that support it." );
+
+	sv_areaGrid = Cvar_Get( "sv_areaGrid", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_areaGrid, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_areaGrid, "Spatial index used for entity area queries and traces, applied on map load:\n"
+		" 0 - binary sector tree\n"
+		" 1 - loose uniform grid, better for lots of small entities\n"
+		"See \\sectorlist, \\tracebench." );
+
+	sv_traceCache = Cvar_Get( "sv_traceCache", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_traceCache, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_traceCache, "Return stored results for identical traces and point contents checks made by game and bots within the same frame until any entity is linked or unlinked. "
+		"May give stale results for mods that move entities without relinking them, see \\tracecache for hit rates." );
+
+	sv_overloadPolicy = Cvar_Get( "sv_overloadPolicy", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_overloadPolicy, "0", "2", CV_INTEGER );
+	Cvar_SetDescription( sv_overloadPolicy, "What to do while server frames take longer than the \\sv_fps budget:\n"
+		" 0 - only record it, see \\svperf\n"
+		" 1 - halve snapshot rate for spectators\n"
+		" 2 - halve snapshot rate for all remote clients" );
+
+	sv_statsd = Cvar_Get( "sv_statsd", "", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( sv_statsd, "StatsD collector address (host[:port], default port 8125) that receives frame time, traffic, client count, "
+		"rate limit drops and memory metrics over UDP, empty disables." );
+	sv_statsdPrefix = Cvar_Get( "sv_statsdPrefix", "q3server", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( sv_statsdPrefix, "Prefix for metric names pushed to \\sv_statsd, use a unique value per server instance." );
+	sv_statsdInterval = Cvar_Get( "sv_statsdInterval", "10", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_statsdInterval, "1", "300", CV_INTEGER );
+	Cvar_SetDescription( sv_statsdInterval, "Seconds between metric pushes to \\sv_statsd." );
+
+	sv_botThinkWorkers = Cvar_Get( "sv_botThinkWorkers", "0", CVAR_ARCHIVE_ND | CVAR_LATCH );
+	Cvar_CheckRange( sv_botThinkWorkers, "0", XSTRING( MAX_GAME_WORKERS ), CV_INTEGER );
+	Cvar_SetDescription( sv_botThinkWorkers, "Number of extra game qvm instances that run bot think frames on worker threads "
+		"when the game module asks for it with G_BOT_THINK_PARALLEL, 0 disables, see com_jobThreads." );
+	SV_ReserveGameWorkers();
+
+	com_benchmarkBots = Cvar_Get( "com_benchmarkBots", "0", CVAR_INIT );
+	Cvar_CheckRange( com_benchmarkBots, "0", XSTRING( MAX_CLIENTS ), CV_INTEGER );
+	Cvar_SetDescription( com_benchmarkBots, "Number of bots added when the map is loaded in \\com_benchmark mode, names are taken from scripts/bots.txt." );
+
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
 
@@ -791,11 +926,11 @@ void SV_Init( void )
 	Cbuf_AddText("rehashbans\n");
 #endif
 
-	// track group cvar changes
-	Cvar_SetGroup( sv_lanForceRate, CVG_SERVER );
-	Cvar_SetGroup( sv_minRate, CVG_SERVER );
-	Cvar_SetGroup( sv_maxRate, CVG_SERVER );
-	Cvar_SetGroup( sv_fps, CVG_SERVER );
+	// update rate settings, etc. as soon as these change
+	Cvar_SetChangeCallback( sv_lanForceRate, SV_RateCvarChanged );
+	Cvar_SetChangeCallback( sv_minRate, SV_RateCvarChanged );
+	Cvar_SetChangeCallback( sv_maxRate, SV_RateCvarChanged );
+	Cvar_SetChangeCallback( sv_fps, SV_RateCvarChanged );
 
 	// force initial check
 	SV_TrackCvarChanges();
@@ -860,6 +995,7 @@ void SV_Shutdown( const char *finalmsg ) {
 		SV_FinalMessage( finalmsg );
 	}
 
+	SV_StopRecord();
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
 	SV_ShutdownGameProgs();
@@ -874,11 +1010,16 @@ void SV_Shutdown( const char *finalmsg ) {
 	if ( svs.clients ) {
 		int index;
 
-		for ( index = 0; index < sv_maxclients->integer; index++ )
+		for ( index = 0; index < sv_maxclients->integer; index++ ) {
 			SV_FreeClient( &svs.clients[ index ] );
+			SV_FreeReliableCommands( &svs.clients[ index ] );
+		}
 
+		Z_Free( svs.clientsCold );
 		Z_Free( svs.clients );
 	}
+	SV_FreeSnapshotJobs();
+	SV_FreeTraceRecord();
 	Com_Memset( &svs, 0, sizeof( svs ) );
 	sv.time = 0;
 
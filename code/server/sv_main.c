@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include "server.h"
+#include "../qcommon/json.h"
 
 serverStatic_t	svs;				// persistant server info
 server_t		sv;					// local server
@@ -56,6 +57,18 @@ cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates t
 
 cvar_t *sv_levelTimeReset;
 cvar_t *sv_filter;
+cvar_t *sv_snapshotThreads;
+cvar_t *sv_visCache;
+cvar_t *sv_deltaCache;
+cvar_t *sv_gamestateCompress;
+cvar_t *sv_areaGrid;
+cvar_t *sv_traceCache;
+cvar_t *sv_botThinkWorkers;
+cvar_t *com_benchmarkBots;
+cvar_t *sv_overloadPolicy;
+cvar_t *sv_statsd;
+cvar_t *sv_statsdPrefix;
+cvar_t *sv_statsdInterval;
 
 #ifdef USE_BANS
 cvar_t	*sv_banFile;
@@ -100,58 +113,97 @@ static const char *SV_ExpandNewlines( const char *in ) {
 
 /*
 ======================
-SV_ReplacePendingServerCommands
+SV_NewServerCommand
 
-FIXME: This is ugly
+Returns the command with one reference held by the caller
 ======================
 */
-#if 0 // unused
-static int SV_ReplacePendingServerCommands( client_t *client, const char *cmd ) {
-	int i, index, csnum1, csnum2;
-
-	for ( i = client->reliableSent+1; i <= client->reliableSequence; i++ ) {
-		index = i & ( MAX_RELIABLE_COMMANDS - 1 );
-		//
-		if ( !Q_strncmp(cmd, client->reliableCommands[ index ], strlen("cs")) ) {
-			sscanf(cmd, "cs %i", &csnum1);
-			sscanf(client->reliableCommands[ index ], "cs %i", &csnum2);
-			if ( csnum1 == csnum2 ) {
-				Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
-				/*
-				if ( client->netchan.remoteAddress.type != NA_BOT ) {
-					Com_Printf( "WARNING: client %i removed double pending config string %i: %s\n", client-svs.clients, csnum1, cmd );
-				}
-				*/
-				return qtrue;
-			}
-		}
+serverCommand_t *SV_NewServerCommand( const char *cmd ) {
+	serverCommand_t *sc;
+	int len;
+
+	len = strlen( cmd );
+	if ( len > MAX_STRING_CHARS - 1 ) {
+		len = MAX_STRING_CHARS - 1;
 	}
-	return qfalse;
+
+	sc = S_Malloc( sizeof( *sc ) + len );
+	sc->refCount = 1;
+	Com_Memcpy( sc->text, cmd, len );
+	sc->text[ len ] = '\0';
+
+	return sc;
 }
-#endif
 
 
 /*
 ======================
-SV_AddServerCommand
+SV_ReleaseServerCommand
+======================
+*/
+void SV_ReleaseServerCommand( serverCommand_t *cmd ) {
+	if ( cmd && --cmd->refCount == 0 ) {
+		Z_Free( cmd );
+	}
+}
+
+
+/*
+======================
+SV_FreeReliableCommands
+
+Drops the references of the client's reliable command queue
+======================
+*/
+void SV_FreeReliableCommands( client_t *client ) {
+	clientCold_t *cold = SV_ClientCold( client );
+	int i;
+
+	for ( i = 0; i < MAX_RELIABLE_COMMANDS; i++ ) {
+		SV_ReleaseServerCommand( cold->reliableCommands[ i ] );
+		cold->reliableCommands[ i ] = NULL;
+	}
+}
+
+
+/*
+======================
+SV_ReliableCommand
+
+Text of a queued reliable command, empty for unused slots
+======================
+*/
+const char *SV_ReliableCommand( const client_t *client, int sequence ) {
+	const serverCommand_t *cmd;
+
+	cmd = SV_ClientCold( client )->reliableCommands[ sequence & ( MAX_RELIABLE_COMMANDS - 1 ) ];
+
+	return cmd ? cmd->text : "";
+}
+
+
+/*
+======================
+SV_QueueServerCommand
 
 The given command will be transmitted to the client, and is guaranteed to
-not have future snapshot_t executed before it is executed
+not have future snapshot_t executed before it is executed.
+The queue takes its own reference to the command
 ======================
 */
-void SV_AddServerCommand( client_t *client, const char *cmd ) {
+void SV_QueueServerCommand( client_t *client, serverCommand_t *cmd ) {
+	clientCold_t *cold = SV_ClientCold( client );
 	int		index, i, n;
 
-	// this is very ugly but it's also a waste to for instance send multiple config string updates
-	// for the same config string index in one snapshot
-//	if ( SV_ReplacePendingServerCommands( client, cmd ) ) {
-//		return;
-//	}
-
 	// do not send commands until the gamestate has been sent
 	if ( client->state < CS_PRIMED )
 		return;
 
+	// coalesced configstring updates go out before anything issued after them
+	if ( cold->numPendingCs && client->state == CS_ACTIVE ) {
+		SV_UpdateConfigstrings( client );
+	}
+
 	client->reliableSequence++;
 	// if we would be losing an old command that hasn't been acknowledged,
 	// we must drop the connection
@@ -162,14 +214,33 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 		n = client->reliableSequence - client->reliableAcknowledge;
 		for ( i = 0; i < n; i++ ) {
 			const int idx = client->reliableAcknowledge + 1 + i;
-			Com_Printf( "cmd %5d: %s\n", i, client->reliableCommands[ idx & ( MAX_RELIABLE_COMMANDS - 1 ) ] );
+			Com_Printf( "cmd %5d: %s\n", i, SV_ReliableCommand( client, idx ) );
 		}
-		Com_Printf( "cmd %5d: %s\n", i, cmd );
+		Com_Printf( "cmd %5d: %s\n", i, cmd->text );
 		SV_DropClient( client, "Server command overflow" );
 		return;
 	}
 	index = client->reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 );
-	Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
+	SV_ReleaseServerCommand( cold->reliableCommands[ index ] );
+	cold->reliableCommands[ index ] = cmd;
+	cmd->refCount++;
+}
+
+
+/*
+======================
+SV_AddServerCommand
+======================
+*/
+void SV_AddServerCommand( client_t *client, const char *cmd ) {
+	serverCommand_t *sc;
+
+	if ( client->state < CS_PRIMED )
+		return;
+
+	sc = SV_NewServerCommand( cmd );
+	SV_QueueServerCommand( client, sc );
+	SV_ReleaseServerCommand( sc );
 }
 
 
@@ -185,6 +256,7 @@ A NULL client will broadcast to all clients
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 	va_list		argptr;
 	char		message[MAX_STRING_CHARS+128]; // slightly larger than allowed, to detect overflows
+	serverCommand_t	*cmd;
 	client_t	*client;
 	int			j, len;
 	
@@ -192,6 +264,8 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 	len = Q_vsnprintf( message, sizeof( message ), fmt, argptr );
 	va_end( argptr );
 
+	SV_DemoServerCommand( cl, message );
+
 	if ( cl != NULL ) {
 		// outdated clients can't properly decode 1023-chars-long strings
 		// http://aluigi.altervista.org/adv/q3msgboom-adv.txt
@@ -206,12 +280,20 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 		Com_Printf( "broadcast: %s\n", SV_ExpandNewlines( message ) );
 	}
 
-	// send the data to all relevant clients
+	// send the data to all relevant clients, they all share the same text
+	cmd = NULL;
 	for ( j = 0, client = svs.clients; j < sv_maxclients->integer ; j++, client++ ) {
+		if ( client->state < CS_PRIMED ) {
+			continue;
+		}
 		if ( len <= 1022 || client->longstr ) {
-			SV_AddServerCommand( client, message );
+			if ( !cmd ) {
+				cmd = SV_NewServerCommand( message );
+			}
+			SV_QueueServerCommand( client, cmd );
 		}
 	}
+	SV_ReleaseServerCommand( cmd );
 }
 
 
@@ -585,6 +667,9 @@ static void SVC_RateRestoreToxic( leakyBucket_t *bucket ) {
 }
 
 
+static int rateLimitDrops;
+
+
 /*
 ================
 SVC_RateLimitAddress
@@ -595,7 +680,12 @@ Rate limit for a particular address
 qboolean SVC_RateLimitAddress( const netadr_t *from, int burst, int period ) {
 	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
 
-	return bucket ? SVC_RateLimit( &bucket->rate, burst, period ) : qtrue;
+	if ( bucket && !SVC_RateLimit( &bucket->rate, burst, period ) ) {
+		return qfalse;
+	}
+
+	rateLimitDrops++;
+	return qtrue;
 }
 
 
@@ -639,6 +729,78 @@ void SVC_RateDropAddress( const netadr_t *from, int burst, int period ) {
 }
 
 
+/*
+==============================================================================
+
+Query responses are cached until anything they are built from changes,
+so refresh storms from masters and browsers cost a copy and challenge splice.
+Configstring and userinfo updates bump queryVersion, scores, pings and
+connected slots are compared on each request
+
+==============================================================================
+*/
+
+typedef struct {
+	int		version;
+	int		numClients;
+	int		clients[ MAX_CLIENTS * 2 ];	// status: score and ping, info: counters
+	char	info[ MAX_INFO_STRING ];		// without challenge
+	char	players[ MAX_PACKETLEN ];
+	int		hits;
+	int		misses;
+} queryCache_t;
+
+static int			queryVersion;
+static queryCache_t	statusCache = { -1 };
+static queryCache_t	infoCache = { -1 };
+
+
+/*
+================
+SV_InvalidateQueryCache
+================
+*/
+void SV_InvalidateQueryCache( void ) {
+	queryVersion++;
+}
+
+
+/*
+================
+SV_QueryCacheValid
+
+Checks version and client signature, updates both on miss
+================
+*/
+static qboolean SV_QueryCacheValid( queryCache_t *qc, const int *clients, int numClients ) {
+
+	// serverinfo cvars are copied to configstring on next frame only
+	if ( qc->version == queryVersion && !( cvar_modifiedFlags & ( CVAR_SERVERINFO | CVAR_SYSTEMINFO ) )
+		&& qc->numClients == numClients && !memcmp( qc->clients, clients, numClients * sizeof( clients[0] ) ) ) {
+		qc->hits++;
+		return qtrue;
+	}
+
+	qc->misses++;
+	qc->version = queryVersion;
+	qc->numClients = numClients;
+	memcpy( qc->clients, clients, numClients * sizeof( clients[0] ) );
+
+	return qfalse;
+}
+
+
+/*
+================
+SV_QueryCache_f
+================
+*/
+void SV_QueryCache_f( void ) {
+	Com_Printf( "getstatus: %i cached, %i built\n", statusCache.hits, statusCache.misses );
+	Com_Printf( "getinfo: %i cached, %i built\n", infoCache.hits, infoCache.misses );
+}
+
+
 /*
 ================
 SVC_Status
@@ -650,9 +812,9 @@ the simple info query.
 */
 static void SVC_Status( const netadr_t *from ) {
 	char	player[MAX_NAME_LENGTH + 32]; // score + ping + name
-	char	status[MAX_PACKETLEN];
+	int		clients[MAX_CLIENTS * 2];
 	char	*s;
-	int		i;
+	int		i, n;
 	client_t	*cl;
 	playerState_t	*ps;
 	int		statusLength;
@@ -686,33 +848,50 @@ static void SVC_Status( const netadr_t *from ) {
 	if ( strlen( Cmd_Argv( 1 ) ) > 128 )
 		return;
 
-	Q_strncpyz( infostring, Cvar_InfoString( CVAR_SERVERINFO, NULL ), sizeof( infostring ) );
+	for ( i = 0, n = 0 ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED ) {
+			ps = SV_GameClientNum( i );
+			clients[ n++ ] = ps->persistant[ PERS_SCORE ];
+			clients[ n++ ] = svs.clients[i].ping;
+		} else {
+			// never matches a real score/ping pair
+			clients[ n++ ] = 0x7FFFFFFF;
+			clients[ n++ ] = 0x7FFFFFFF;
+		}
+	}
 
-	// echo back the parameter to status. so master servers can use it as a challenge
-	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv( 1 ) );
+	if ( !SV_QueryCacheValid( &statusCache, clients, n ) ) {
+		Q_strncpyz( statusCache.info, Cvar_InfoString( CVAR_SERVERINFO, NULL ), sizeof( statusCache.info ) );
 
-	s = status;
-	status[0] = '\0';
-	statusLength = strlen( infostring ) + 16; // strlen( "statusResponse\n\n" )
+		s = statusCache.players;
+		*s = '\0';
+		// reserve space for "\\challenge\\" and up to 128 characters of the challenge
+		statusLength = strlen( statusCache.info ) + 16 + 144; // strlen( "statusResponse\n\n" )
 
-	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
-		cl = &svs.clients[i];
-		if ( cl->state >= CS_CONNECTED ) {
+		for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+			cl = &svs.clients[i];
+			if ( cl->state >= CS_CONNECTED ) {
 
-			ps = SV_GameClientNum( i );
-			playerLength = Com_sprintf( player, sizeof( player ), "%i %i \"%s\"\n", 
-				ps->persistant[ PERS_SCORE ], cl->ping, cl->name );
-			
-			if ( statusLength + playerLength >= MAX_PACKETLEN-4 )
-				break; // can't hold any more
-			
-			s = Q_stradd( s, player );
-			statusLength += playerLength;
+				ps = SV_GameClientNum( i );
+				playerLength = Com_sprintf( player, sizeof( player ), "%i %i \"%s\"\n", 
+					ps->persistant[ PERS_SCORE ], cl->ping, cl->name );
+				
+				if ( statusLength + playerLength >= MAX_PACKETLEN-4 )
+					break; // can't hold any more
+				
+				s = Q_stradd( s, player );
+				statusLength += playerLength;
+			}
 		}
 	}
 
-	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status );
+	strcpy( infostring, statusCache.info );
+
+	// echo back the parameter to status. so master servers can use it as a challenge
+	// to prevent timed spoofed reply packets that add ghost servers
+	Info_SetValueForKey( infostring, "challenge", Cmd_Argv( 1 ) );
+
+	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, statusCache.players );
 }
 
 
@@ -726,8 +905,10 @@ if a user is interested in a server to do a full status
 */
 static void SVC_Info( const netadr_t *from ) {
 	int		i, count, humans;
+	int		clients[2];
 	const char	*gamedir;
-	char	infostring[MAX_INFO_STRING];
+	char	*infostring;
+	char	response[MAX_INFO_STRING+160];
 
 	// ignore if we are in single player
 #ifndef DEDICATED
@@ -772,28 +953,37 @@ static void SVC_Info( const netadr_t *from ) {
 		}
 	}
 
-	infostring[0] = '\0';
+	clients[0] = count;
+	clients[1] = humans;
+
+	infostring = infoCache.info;
+
+	if ( !SV_QueryCacheValid( &infoCache, clients, ARRAY_LEN( clients ) ) ) {
+		infostring[0] = '\0';
+
+		Info_SetValueForKey( infostring, "protocol", va( "%i", com_protocol->integer ) );
+		Info_SetValueForKey( infostring, "hostname", sv_hostname->string );
+		Info_SetValueForKey( infostring, "mapname", sv_mapname->string );
+		Info_SetValueForKey( infostring, "clients", va("%i", count) );
+		Info_SetValueForKey(infostring, "g_humanplayers", va("%i", humans));
+		Info_SetValueForKey( infostring, "sv_maxclients", 
+			va("%i", sv_maxclients->integer - sv_privateClients->integer ) );
+		Info_SetValueForKey( infostring, "gametype", va("%i", sv_gametype->integer ) );
+		Info_SetValueForKey( infostring, "pure", va("%i", sv_pure->integer ) );
+		Info_SetValueForKey(infostring, "g_needpass", va("%d", Cvar_VariableIntegerValue("g_needpass")));
+		gamedir = Cvar_VariableString( "fs_game" );
+		if( *gamedir ) {
+			Info_SetValueForKey( infostring, "game", gamedir );
+		}
+	}
+
+	response[0] = '\0';
 
 	// echo back the parameter to status. so servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
-
-	Info_SetValueForKey( infostring, "protocol", va( "%i", com_protocol->integer ) );
-	Info_SetValueForKey( infostring, "hostname", sv_hostname->string );
-	Info_SetValueForKey( infostring, "mapname", sv_mapname->string );
-	Info_SetValueForKey( infostring, "clients", va("%i", count) );
-	Info_SetValueForKey(infostring, "g_humanplayers", va("%i", humans));
-	Info_SetValueForKey( infostring, "sv_maxclients", 
-		va("%i", sv_maxclients->integer - sv_privateClients->integer ) );
-	Info_SetValueForKey( infostring, "gametype", va("%i", sv_gametype->integer ) );
-	Info_SetValueForKey( infostring, "pure", va("%i", sv_pure->integer ) );
-	Info_SetValueForKey(infostring, "g_needpass", va("%d", Cvar_VariableIntegerValue("g_needpass")));
-	gamedir = Cvar_VariableString( "fs_game" );
-	if( *gamedir ) {
-		Info_SetValueForKey( infostring, "game", gamedir );
-	}
-
-	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s", infostring );
+	Info_SetValueForKey( response, "challenge", Cmd_Argv(1) );
+
+	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s%s", response, infostring );
 }
 
 
@@ -963,14 +1153,56 @@ static void SV_ConnectionlessPacket( const netadr_t *from, msg_t *msg ) {
 	}
 }
 
+
+/*
+=================
+SV_OffloadPacket
+
+Called from network threads while main thread is suspended in NET_Sleep(),
+answers server queries so floods won't reach the main thread, returns
+qfalse for everything else that must go through SV_PacketEvent()
+=================
+*/
+qboolean SV_OffloadPacket( const netadr_t *from, msg_t *msg ) {
+	const char *c;
+
+	if ( msg->cursize < 6 || *(int32_t *)msg->data != -1 || !com_sv_running->integer ) {
+		return qfalse;
+	}
+
+	// compressed, handled by the main thread
+	if ( !memcmp( "connect ", msg->data + 4, 8 ) ) {
+		return qfalse;
+	}
+
+	MSG_BeginReadingOOB( msg );
+	MSG_ReadLong( msg );		// skip the -1 marker
+
+	Cmd_TokenizeString( MSG_ReadStringLine( msg ) );
+
+	c = Cmd_Argv(0);
+
+	if ( !Q_stricmp(c, "getstatus") ) {
+		SVC_Status( from );
+	} else if ( !Q_stricmp(c, "getinfo") ) {
+		SVC_Info( from );
+	} else if ( !Q_stricmp(c, "getchallenge") ) {
+		SV_GetChallenge( from );
+	} else {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
 //============================================================================
 
 /*
 =================
-SV_PacketEvent
+SV_ProcessPacket
 =================
 */
-void SV_PacketEvent( const netadr_t *from, msg_t *msg ) {
+static void SV_ProcessPacket( const netadr_t *from, msg_t *msg ) {
 	int			i;
 	client_t	*cl;
 	int			qport;
@@ -1030,6 +1262,22 @@ void SV_PacketEvent( const netadr_t *from, msg_t *msg ) {
 }
 
 
+/*
+=================
+SV_PacketEvent
+=================
+*/
+void SV_PacketEvent( const netadr_t *from, msg_t *msg ) {
+	int64_t start;
+
+	start = Sys_Microseconds();
+
+	SV_ProcessPacket( from, msg );
+
+	SV_PerfAddNetwork( Sys_Microseconds() - start, msg->cursize );
+}
+
+
 /*
 ===================
 SV_CalcPings
@@ -1228,8 +1476,6 @@ void SV_TrackCvarChanges( void )
 		Com_DPrintf( "sv_minRate adjusted to 1000\n" );
 	}
 
-	Cvar_ResetGroup( CVG_SERVER, qfalse );
-
 	if ( sv.state == SS_DEAD || !svs.clients )
 		return;
 
@@ -1274,6 +1520,589 @@ static void SV_Restart( const char *reason ) {
 }
 
 
+/*
+=============================================================================
+
+HEADLESS BENCHMARK
+
+com_benchmark <frames> on a dedicated server: once a map is loaded
+com_benchmarkBots are added, after a warmup the given number of server
+frames is run back to back with a fixed time step, then frames/s and
+per-phase averages are printed and the server quits
+
+=============================================================================
+*/
+
+#define BENCHMARK_WARMUP	100		// frames to let bots connect and spawn
+
+typedef enum {
+	BENCH_WAITMAP,
+	BENCH_WARMUP,
+	BENCH_RUN,
+	BENCH_DONE
+} benchState_t;
+
+static benchState_t	benchState;
+static int			benchFrames;
+static int64_t		benchStart;
+
+
+/*
+==================
+SV_BenchmarkAddBots
+
+Cycles through bot names from scripts/bots.txt
+==================
+*/
+static void SV_BenchmarkAddBots( int count )
+{
+	char names[ MAX_CLIENTS ][ MAX_NAME_LENGTH ];
+	union {
+		char *c;
+		void *v;
+	} f;
+	const char *text, *token;
+	int i, numNames;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	numNames = 0;
+	FS_ReadFile( "scripts/bots.txt", &f.v );
+	if ( f.v ) {
+		text = f.c;
+		while ( numNames < MAX_CLIENTS ) {
+			token = COM_ParseExt( &text, qtrue );
+			if ( !token[0] ) {
+				break;
+			}
+			if ( !Q_stricmp( token, "name" ) ) {
+				token = COM_ParseExt( &text, qfalse );
+				Q_strncpyz( names[ numNames++ ], token, sizeof( names[0] ) );
+			}
+		}
+		FS_FreeFile( f.v );
+	}
+
+	if ( numNames == 0 ) {
+		Com_Printf( S_COLOR_YELLOW "benchmark: no bot names in scripts/bots.txt\n" );
+		return;
+	}
+
+	if ( count > sv_maxclients->integer ) {
+		Com_Printf( S_COLOR_YELLOW "benchmark: only %i of %i bots fit in sv_maxclients\n",
+			sv_maxclients->integer, count );
+		count = sv_maxclients->integer;
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		Cbuf_AddText( va( "addbot %s 4\n", names[ i % numNames ] ) );
+	}
+}
+
+
+/*
+==================
+SV_BenchmarkFrame
+==================
+*/
+static void SV_BenchmarkFrame( void )
+{
+	int64_t usec;
+	int i, clients;
+
+	switch ( benchState ) {
+	case BENCH_WAITMAP:
+		if ( sv.state != SS_GAME ) {
+			break;
+		}
+		SV_BenchmarkAddBots( com_benchmarkBots->integer );
+		benchFrames = 0;
+		benchState = BENCH_WARMUP;
+		break;
+
+	case BENCH_WARMUP:
+		if ( ++benchFrames < BENCHMARK_WARMUP ) {
+			break;
+		}
+		Com_Printf( "benchmark: running %i frames at sv_fps %i\n", com_benchmark->integer, sv_fps->integer );
+		// phase totals start with the next frame
+		Com_TraceStats( qtrue );
+		benchFrames = 0;
+		benchStart = Sys_Microseconds();
+		benchState = BENCH_RUN;
+		break;
+
+	case BENCH_RUN:
+		if ( ++benchFrames < com_benchmark->integer ) {
+			break;
+		}
+		usec = Sys_Microseconds() - benchStart;
+		if ( usec <= 0 ) {
+			usec = 1;
+		}
+		Com_TraceStats( qfalse );
+		for ( i = 0, clients = 0; i < sv_maxclients->integer; i++ ) {
+			if ( svs.clients[ i ].state == CS_ACTIVE ) {
+				clients++;
+			}
+		}
+		Com_Printf( "benchmark: %i frames in %.1f msec, %.1f frames/s, %i active clients\n",
+			benchFrames, usec / 1000.0, benchFrames * 1e6 / usec, clients );
+		Com_TraceStatsReport( benchFrames );
+		Cbuf_AddText( "quit\n" );
+		benchState = BENCH_DONE;
+		break;
+
+	case BENCH_DONE:
+		break;
+	}
+}
+
+
+/*
+=============================================================================
+
+FRAME BUDGET
+
+Time spent in each phase is accumulated until a game frame runs, then
+stored as one sample in a ring of the most recent ticks. A tick overruns
+when its work takes longer than the interval of the game frames it ran.
+An averaged load over the budget switches the server into the overloaded
+state, where \sv_overloadPolicy may lower snapshot rates.
+
+=============================================================================
+*/
+
+#define PERF_SAMPLES		256		// power of 2
+#define PERF_BUCKETS		7
+#define OVERLOAD_ENTER		900		// permille of the budget
+#define OVERLOAD_LEAVE		700
+#define PORT_STATSD			8125
+
+typedef enum {
+	PERF_NETWORK,
+	PERF_BOTS,
+	PERF_GAME,
+	PERF_SNAPSHOTS,
+	PERF_OTHER,
+	PERF_PHASES
+} perfPhase_t;
+
+static const char *perfPhaseNames[ PERF_PHASES ] = {
+	"network", "bots", "game", "snapshots", "other"
+};
+
+// upper bounds of histogram buckets in permille of the budget
+static const int perfBucketLimits[ PERF_BUCKETS - 1 ] = {
+	250, 500, 750, 1000, 1500, 2000
+};
+
+typedef struct {
+	int		usec[ PERF_PHASES ];
+	int		total;
+	int		budget;
+} perfSample_t;
+
+static struct {
+	perfSample_t	samples[ PERF_SAMPLES ];
+	int				numSamples;		// total stored, ring index is numSamples & ( PERF_SAMPLES - 1 )
+	int64_t			pending[ PERF_PHASES ];
+
+	int				overruns;
+	int				catchUpFrames;	// extra game frames run to make up lost time
+	int				worstUsec;
+	int				load;			// averaged, permille of the budget
+	qboolean		overloaded;
+	int				overloadEvents;
+	int				throttledSnapshots;
+
+	// totals since the last metrics push
+	int				periodTicks;
+	int				periodMax;
+	int64_t			periodUsec[ PERF_PHASES ];
+	int64_t			periodTotal;
+	int64_t			bytesReceived;
+} svPerf;
+
+
+/*
+==================
+SV_PerfAddNetwork
+
+Packets are processed between frames, charged to the next sample
+==================
+*/
+void SV_PerfAddNetwork( int64_t usec, int bytes ) {
+	svPerf.pending[ PERF_NETWORK ] += usec;
+	svPerf.bytesReceived += bytes;
+}
+
+
+/*
+==================
+SV_PerfCommit
+==================
+*/
+static void SV_PerfCommit( int gameFrames ) {
+	perfSample_t *ps;
+	int64_t total;
+	int i, budget, load;
+
+	ps = &svPerf.samples[ svPerf.numSamples & ( PERF_SAMPLES - 1 ) ];
+	svPerf.numSamples++;
+
+	total = 0;
+	for ( i = 0; i < PERF_PHASES; i++ ) {
+		ps->usec[ i ] = (int)MIN( svPerf.pending[ i ], INT_MAX );
+		svPerf.periodUsec[ i ] += svPerf.pending[ i ];
+		total += svPerf.pending[ i ];
+		svPerf.pending[ i ] = 0;
+	}
+
+	// wall clock budget, independent of timescale
+	budget = gameFrames * ( 1000000 / sv_fps->integer );
+	ps->total = (int)MIN( total, INT_MAX );
+	ps->budget = budget;
+
+	if ( ps->total > budget ) {
+		svPerf.overruns++;
+	}
+	if ( gameFrames > 1 ) {
+		svPerf.catchUpFrames += gameFrames - 1;
+	}
+	if ( ps->total > svPerf.worstUsec ) {
+		svPerf.worstUsec = ps->total;
+	}
+
+	svPerf.periodTicks++;
+	svPerf.periodTotal += total;
+	if ( ps->total > svPerf.periodMax ) {
+		svPerf.periodMax = ps->total;
+	}
+
+	// smooth over roughly the last 16 ticks
+	load = (int)MIN( total * 1000 / budget, 100000 );
+	svPerf.load += ( load - svPerf.load ) / 16;
+
+	if ( !svPerf.overloaded && svPerf.load > OVERLOAD_ENTER ) {
+		svPerf.overloaded = qtrue;
+		svPerf.overloadEvents++;
+		if ( sv_overloadPolicy->integer ) {
+			Com_DPrintf( "server overloaded, %i%% of frame budget\n", svPerf.load / 10 );
+		}
+	} else if ( svPerf.overloaded && svPerf.load < OVERLOAD_LEAVE ) {
+		svPerf.overloaded = qfalse;
+	}
+}
+
+
+/*
+==================
+SV_IsSpectator
+
+Team and movement type as used by baseq3 and most mods
+==================
+*/
+static qboolean SV_IsSpectator( const client_t *cl ) {
+	const playerState_t *ps;
+
+	if ( cl->state != CS_ACTIVE ) {
+		return qfalse;
+	}
+
+	ps = SV_GameClientNum( cl - svs.clients );
+
+	return ( ps->persistant[ PERS_TEAM ] == TEAM_SPECTATOR || ps->pm_type == PM_SPECTATOR );
+}
+
+
+/*
+==================
+SV_ThrottleSnapshot
+
+Returns qtrue if the overload policy skips this snapshot,
+affected clients get every second one
+==================
+*/
+qboolean SV_ThrottleSnapshot( const client_t *cl ) {
+
+	if ( !svPerf.overloaded || !sv_overloadPolicy->integer ) {
+		return qfalse;
+	}
+
+	if ( cl->netchan.remoteAddress.type == NA_LOOPBACK || cl->netchan.remoteAddress.type == NA_BOT ) {
+		return qfalse;
+	}
+
+	if ( sv_overloadPolicy->integer < 2 && !SV_IsSpectator( cl ) ) {
+		return qfalse;
+	}
+
+	if ( svs.time - cl->lastSnapshotTime < 2 * cl->snapshotMsec * com_timescale->value ) {
+		svPerf.throttledSnapshots++;
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+
+/*
+==================
+SV_PerfCompare
+==================
+*/
+static int QDECL SV_PerfCompare( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+
+/*
+==================
+SV_PerfReportPhase
+
+Average, 95th percentile and maximum of one column over the window
+==================
+*/
+static void SV_PerfReportPhase( jsonWriter_t *w, const char *name, int phase, int count ) {
+	static int values[ PERF_SAMPLES ];
+	const perfSample_t *ps;
+	int64_t sum;
+	int i;
+
+	sum = 0;
+	for ( i = 0; i < count; i++ ) {
+		ps = &svPerf.samples[ i ];
+		values[ i ] = ( phase < 0 ) ? ps->total : ps->usec[ phase ];
+		sum += values[ i ];
+	}
+
+	qsort( values, count, sizeof( values[0] ), SV_PerfCompare );
+
+	JSON_WriteObjectBegin( w, name );
+	JSON_WriteInt( w, "avg", count ? (int)( sum / count ) : 0 );
+	JSON_WriteInt( w, "p95", count ? values[ ( count * 95 ) / 100 ] : 0 );
+	JSON_WriteInt( w, "max", count ? values[ count - 1 ] : 0 );
+	JSON_WriteObjectEnd( w );
+}
+
+
+/*
+==================
+SV_Perf_f
+
+Prints frame budget telemetry as a single line of JSON, times are
+in microseconds. "svperf reset" clears counters and the window
+==================
+*/
+void SV_Perf_f( void ) {
+	static char buf[ 4096 ];
+	int histogram[ PERF_BUCKETS ];
+	const perfSample_t *ps;
+	jsonWriter_t w;
+	int i, j, count, overruns, load;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &svPerf, 0, sizeof( svPerf ) );
+		// restart metrics from the cleared counters
+		sv_statsd->modified = qtrue;
+		return;
+	}
+
+	count = MIN( svPerf.numSamples, PERF_SAMPLES );
+
+	Com_Memset( histogram, 0, sizeof( histogram ) );
+	overruns = 0;
+	for ( i = 0; i < count; i++ ) {
+		ps = &svPerf.samples[ i ];
+		if ( ps->total > ps->budget ) {
+			overruns++;
+		}
+		load = ps->budget ? (int)( (int64_t)ps->total * 1000 / ps->budget ) : 0;
+		for ( j = 0; j < PERF_BUCKETS - 1; j++ ) {
+			if ( load < perfBucketLimits[ j ] ) {
+				break;
+			}
+		}
+		histogram[ j ]++;
+	}
+
+	JSON_WriterInit( &w, buf, sizeof( buf ) );
+	JSON_WriteObjectBegin( &w, NULL );
+	JSON_WriteInt( &w, "fps", sv_fps->integer );
+	JSON_WriteInt( &w, "budget", 1000000 / sv_fps->integer );
+	JSON_WriteInt( &w, "ticks", svPerf.numSamples );
+	JSON_WriteInt( &w, "overruns", svPerf.overruns );
+	JSON_WriteInt( &w, "catchUpFrames", svPerf.catchUpFrames );
+	JSON_WriteInt( &w, "worst", svPerf.worstUsec );
+	JSON_WriteInt( &w, "loadPermille", svPerf.load );
+	JSON_WriteInt( &w, "overloaded", svPerf.overloaded );
+	JSON_WriteInt( &w, "overloadEvents", svPerf.overloadEvents );
+	JSON_WriteInt( &w, "policy", sv_overloadPolicy->integer );
+	JSON_WriteInt( &w, "throttledSnapshots", svPerf.throttledSnapshots );
+
+	JSON_WriteObjectBegin( &w, "window" );
+	JSON_WriteInt( &w, "ticks", count );
+	JSON_WriteInt( &w, "overruns", overruns );
+	JSON_WriteArrayBegin( &w, "histogram" );
+	for ( i = 0; i < PERF_BUCKETS; i++ ) {
+		JSON_WriteInt( &w, NULL, histogram[ i ] );
+	}
+	JSON_WriteArrayEnd( &w );
+	JSON_WriteArrayBegin( &w, "bucketLimits" );
+	for ( i = 0; i < PERF_BUCKETS - 1; i++ ) {
+		JSON_WriteInt( &w, NULL, perfBucketLimits[ i ] );
+	}
+	JSON_WriteArrayEnd( &w );
+	JSON_WriteObjectBegin( &w, "phases" );
+	for ( i = 0; i < PERF_PHASES; i++ ) {
+		SV_PerfReportPhase( &w, perfPhaseNames[ i ], i, count );
+	}
+	SV_PerfReportPhase( &w, "total", -1, count );
+	JSON_WriteObjectEnd( &w );
+	JSON_WriteObjectEnd( &w );
+
+	JSON_WriteObjectEnd( &w );
+
+	if ( w.overflowed ) {
+		Com_Printf( S_COLOR_YELLOW "svperf: report truncated at %i bytes\n", w.len );
+		return;
+	}
+
+	// redirect buffers are small, don't let a single print get truncated
+	for ( i = 0; i < w.len; i += 512 ) {
+		Com_Printf( "%.*s", MIN( 512, (int)w.len - i ), buf + i );
+	}
+	Com_Printf( "\n" );
+}
+
+
+/*
+==================
+SV_StatsdAppend
+==================
+*/
+static void QDECL SV_StatsdAppend( char *buf, int size, const char *name, const char *fmt, ... ) {
+	va_list argptr;
+	int len;
+
+	len = (int)strlen( buf );
+	Com_sprintf( buf + len, size - len, "%s.%s:", sv_statsdPrefix->string, name );
+	len += (int)strlen( buf + len );
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( buf + len, size - len, fmt, argptr );
+	va_end( argptr );
+}
+
+
+/*
+==================
+SV_StatsdFrame
+
+Pushes server metrics to a StatsD collector as a single datagram
+every \sv_statsdInterval seconds. Times are averages in microseconds
+over the ticks since the last push, traffic is in bytes per second
+==================
+*/
+static void SV_StatsdFrame( void ) {
+	static netadr_t adr;
+	static int nextPush;
+	static int lastPush;
+	static int64_t lastBytesSent;
+	static int64_t lastBytesReceived;
+	static int lastOverruns;
+	static int lastThrottled;
+	static int lastDrops;
+	char buf[ 1400 ];
+	int64_t bytesSent;
+	int i, now, elapsed, ticks, humans, bots;
+
+	if ( !sv_statsd->string[0] ) {
+		return;
+	}
+
+	now = Sys_Milliseconds();
+
+	if ( sv_statsd->modified ) {
+		sv_statsd->modified = qfalse;
+		Com_Printf( "Resolving %s\n", sv_statsd->string );
+		switch ( NET_StringToAdr( sv_statsd->string, &adr, NA_UNSPEC ) ) {
+			case 0: adr.type = NA_BAD; break;
+			case 2: adr.port = BigShort( PORT_STATSD ); break;
+		}
+		if ( adr.type == NA_BAD ) {
+			Com_Printf( S_COLOR_YELLOW "Couldn't resolve %s, metrics disabled\n", sv_statsd->string );
+		}
+		// start from current counters
+		lastPush = now;
+		nextPush = now;
+		lastBytesSent = NET_BytesSent( NS_SERVER );
+		lastBytesReceived = svPerf.bytesReceived;
+		lastOverruns = svPerf.overruns;
+		lastThrottled = svPerf.throttledSnapshots;
+		lastDrops = rateLimitDrops;
+		svPerf.periodTicks = 0;
+	}
+
+	if ( adr.type == NA_BAD || now - nextPush < 0 ) {
+		return;
+	}
+
+	nextPush = now + sv_statsdInterval->integer * 1000;
+	elapsed = MAX( now - lastPush, 1 );
+	lastPush = now;
+
+	humans = bots = 0;
+	for ( i = 0; i < sv_maxclients->integer; i++ ) {
+		if ( svs.clients[i].state < CS_CONNECTED ) {
+			continue;
+		}
+		if ( svs.clients[i].netchan.remoteAddress.type == NA_BOT ) {
+			bots++;
+		} else {
+			humans++;
+		}
+	}
+
+	ticks = MAX( svPerf.periodTicks, 1 );
+	bytesSent = NET_BytesSent( NS_SERVER );
+
+	buf[0] = '\0';
+	SV_StatsdAppend( buf, sizeof( buf ), "frame.avg_us", "%i|g\n", (int)( svPerf.periodTotal / ticks ) );
+	SV_StatsdAppend( buf, sizeof( buf ), "frame.max_us", "%i|g\n", svPerf.periodMax );
+	SV_StatsdAppend( buf, sizeof( buf ), "frame.ticks", "%i|c\n", svPerf.periodTicks );
+	SV_StatsdAppend( buf, sizeof( buf ), "frame.overruns", "%i|c\n", svPerf.overruns - lastOverruns );
+	SV_StatsdAppend( buf, sizeof( buf ), "frame.load_permille", "%i|g\n", svPerf.load );
+	for ( i = 0; i < PERF_PHASES; i++ ) {
+		SV_StatsdAppend( buf, sizeof( buf ), va( "phase.%s_us", perfPhaseNames[ i ] ), "%i|g\n", (int)( svPerf.periodUsec[ i ] / ticks ) );
+	}
+	SV_StatsdAppend( buf, sizeof( buf ), "clients.humans", "%i|g\n", humans );
+	SV_StatsdAppend( buf, sizeof( buf ), "clients.bots", "%i|g\n", bots );
+	SV_StatsdAppend( buf, sizeof( buf ), "net.bytes_in", "%i|g\n", (int)( ( svPerf.bytesReceived - lastBytesReceived ) * 1000 / elapsed ) );
+	SV_StatsdAppend( buf, sizeof( buf ), "net.bytes_out", "%i|g\n", (int)( ( bytesSent - lastBytesSent ) * 1000 / elapsed ) );
+	SV_StatsdAppend( buf, sizeof( buf ), "net.ratelimit_drops", "%i|c\n", rateLimitDrops - lastDrops );
+	SV_StatsdAppend( buf, sizeof( buf ), "snapshots.throttled", "%i|c\n", svPerf.throttledSnapshots - lastThrottled );
+	SV_StatsdAppend( buf, sizeof( buf ), "mem.hunk_free", "%i|g\n", Hunk_MemoryRemaining() );
+	SV_StatsdAppend( buf, sizeof( buf ), "mem.zone_free", "%i|g", Z_AvailableMemory() );
+
+	NET_SendPacket( NS_SERVER, (int)strlen( buf ), buf, &adr );
+
+	lastBytesSent = bytesSent;
+	lastBytesReceived = svPerf.bytesReceived;
+	lastOverruns = svPerf.overruns;
+	lastThrottled = svPerf.throttledSnapshots;
+	lastDrops = rateLimitDrops;
+
+	svPerf.periodTicks = 0;
+	svPerf.periodMax = 0;
+	svPerf.periodTotal = 0;
+	Com_Memset( svPerf.periodUsec, 0, sizeof( svPerf.periodUsec ) );
+}
+
+
 /*
 ==================
 SV_Frame
@@ -1285,11 +2114,10 @@ happen before SV_Frame is called
 void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
+	int		gameFrames;
+	int64_t	phaseTime, now;
 	int		i;
 
-	if ( Cvar_CheckGroup( CVG_SERVER ) )
-		SV_TrackCvarChanges(); // update rate settings, etc.
-
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
 		SV_Shutdown( "Server was killed" );
@@ -1326,8 +2154,11 @@ void SV_Frame( int msec ) {
 
 	sv.timeResidual += msec;
 
-	if ( !com_dedicated->integer )
+	if ( !com_dedicated->integer ) {
+		phaseTime = Sys_Microseconds();
 		SV_BotFrame( sv.time + sv.timeResidual );
+		svPerf.pending[ PERF_BOTS ] += Sys_Microseconds() - phaseTime;
+	}
 
 	// if time is about to hit the 32nd bit, kick all clients
 	// and clear sv.time, rather
@@ -1376,36 +2207,90 @@ void SV_Frame( int msec ) {
 		startTime = 0;	// quite a compiler warning
 	}
 
+	phaseTime = Sys_Microseconds();
+
 	// update ping based on the all received frames
 	SV_CalcPings();
 
-	if (com_dedicated->integer) SV_BotFrame (sv.time);
+	now = Sys_Microseconds();
+	svPerf.pending[ PERF_OTHER ] += now - phaseTime;
+	phaseTime = now;
+
+	if (com_dedicated->integer) {
+		Com_TraceBegin( "SV_BotFrame" );
+		SV_BotFrame (sv.time);
+		Com_TraceEnd();
+
+		now = Sys_Microseconds();
+		svPerf.pending[ PERF_BOTS ] += now - phaseTime;
+		phaseTime = now;
+	}
 
 	// run the game simulation in chunks
+	gameFrames = 0;
 	while ( sv.timeResidual >= frameMsec ) {
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
 		sv.time += frameMsec;
 
+		SV_InvalidateTraceCache();
+
 		// let everything in the world think and move
+		Com_TraceBegin( "GAME_RUN_FRAME" );
 		VM_Call( gvm, 1, GAME_RUN_FRAME, sv.time );
+		Com_TraceEnd();
+
+		CM_FloodStatsFrame();
+
+		gameFrames++;
 	}
 
+	now = Sys_Microseconds();
+	svPerf.pending[ PERF_GAME ] += now - phaseTime;
+	phaseTime = now;
+
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
 
 	// check timeouts
+	Com_TraceBegin( "SV_CheckTimeouts" );
 	SV_CheckTimeouts();
+	Com_TraceEnd();
+
+	now = Sys_Microseconds();
+	svPerf.pending[ PERF_OTHER ] += now - phaseTime;
+	phaseTime = now;
 
 	// reset current and build new snapshot on first query
 	SV_IssueNewSnapshot();
 
 	// send messages back to the clients
+	Com_TraceBegin( "SV_SendClientMessages" );
 	SV_SendClientMessages();
+	Com_TraceEnd();
+
+	now = Sys_Microseconds();
+	svPerf.pending[ PERF_SNAPSHOTS ] += now - phaseTime;
+	phaseTime = now;
+
+	SV_DemoFrame();
 
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat(HEARTBEAT_FOR_MASTER);
+
+	svPerf.pending[ PERF_OTHER ] += Sys_Microseconds() - phaseTime;
+
+	// idle frames are charged to the next tick that runs the game
+	if ( gameFrames ) {
+		SV_PerfCommit( gameFrames );
+	}
+
+	SV_StatsdFrame();
+
+	if ( com_benchmark->integer ) {
+		SV_BenchmarkFrame();
+	}
 }
 
 
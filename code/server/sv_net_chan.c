@@ -93,7 +93,8 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
 	int serverId, messageAcknowledge, reliableAcknowledge;
 	int i, index, srdc, sbit;
 	qboolean soob;
-	byte key, *string;
+	const byte *string;
+	byte key;
 
 	srdc = msg->readcount;
 	sbit = msg->bit;
@@ -109,7 +110,7 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
 	msg->bit = sbit;
 	msg->readcount = srdc;
 
-	string = (byte *)client->reliableCommands[ reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ];
+	string = (const byte *)SV_ReliableCommand( client, reliableAcknowledge );
 	index = 0;
 	//
 	key = client->challenge ^ serverId ^ messageAcknowledge;
@@ -229,7 +230,7 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 		MSG_Copy(&netbuf->msg, netbuf->msgBuffer, sizeof( netbuf->msgBuffer ), msg);
 		if ( client->compat ) 
 		{
-			Q_strncpyz(netbuf->clientCommandString, client->lastClientCommandString,
+			Q_strncpyz(netbuf->clientCommandString, SV_ClientCold( client )->lastClientCommandString,
 				sizeof(netbuf->clientCommandString));
 		}
 		netbuf->next = NULL;
@@ -240,7 +241,7 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 	else
 	{
 		if ( client->compat )
-			SV_Netchan_Encode(client, msg, client->lastClientCommandString);
+			SV_Netchan_Encode(client, msg, SV_ClientCold( client )->lastClientCommandString);
 		Netchan_Transmit( &client->netchan, msg->cursize, msg->data );
 	}
 }
@@ -45,6 +45,22 @@ A normal server packet will look like:
 =============================================================================
 */
 
+// snapshot diagnostics that can't be printed from worker threads
+#define SNAPWARN_OLD_PACKET	1
+#define SNAPWARN_OLD_FRAME	2
+#define SNAPWARN_OVERFLOW	4
+
+typedef struct {
+	client_t	*client;
+	const char	*error;
+	int			warnings;
+	msg_t		msg;
+	byte		msg_buf[ MAX_MSGLEN_BUF ];
+} snapshotJob_t;
+
+static snapshotJob_t	*snapshotJobs;
+static int			numSnapshotJobs;
+
 /*
 =============
 SV_EmitPacketEntities
@@ -73,14 +89,14 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 		if ( newindex >= to->num_entities ) {
 			newnum = MAX_GENTITIES+1;
 		} else {
-			newent = to->ents[ newindex ];
+			newent = &svs.snapshotEntities[ to->ents[ newindex ] ];
 			newnum = newent->number;
 		}
 
 		if ( oldindex >= from_num_entities ) {
 			oldnum = MAX_GENTITIES+1;
 		} else {
-			oldent = from->ents[ oldindex ];
+			oldent = &svs.snapshotEntities[ from->ents[ oldindex ] ];
 			oldnum = oldent->number;
 		}
 
@@ -113,20 +129,168 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 }
 
 
+/*
+=============================================================================
+
+Encoded packet entities are fully defined by the from/to entity index lists
+because indexes refer to immutable common snapshot storage and static huffman
+output doesn't depend on message position, so clients with matching lists
+(spectators following the same player, tv clients etc.) can share the bitstream
+
+=============================================================================
+*/
+
+#define DELTA_CACHE_SIZE	64
+#define DELTA_CACHE_BYTES	( MAX_MSGLEN * 16 )
+
+typedef struct {
+	const clientSnapshot_t	*from;		// may be NULL
+	const clientSnapshot_t	*to;
+	int						offset;		// in deltaCacheData, bits
+	int						bits;
+} deltaCacheEntry_t;
+
+static deltaCacheEntry_t	deltaCache[ DELTA_CACHE_SIZE ];
+static int					deltaCacheCount;
+static int					deltaCacheUsed;		// bytes
+static int					deltaCacheFrame = -1;
+static byte					*deltaCacheData;	// allocated on main thread
+static void					*deltaCacheLock;	// only used with snapshot threads
+
+static int					deltaCacheHits;
+static int					deltaCacheMisses;
+
+
+/*
+=============
+SV_SameEntityList
+=============
+*/
+static qboolean SV_SameEntityList( const clientSnapshot_t *a, const clientSnapshot_t *b ) {
+	if ( a == b ) {
+		return qtrue;
+	}
+	if ( !a || !b ) {
+		return qfalse;
+	}
+	if ( a->frameNum != b->frameNum || a->num_entities != b->num_entities ) {
+		return qfalse;
+	}
+	return memcmp( a->ents, b->ents, a->num_entities * sizeof( a->ents[0] ) ) == 0 ? qtrue : qfalse;
+}
+
+
+/*
+=============
+SV_FindDeltaCache
+=============
+*/
+static const deltaCacheEntry_t *SV_FindDeltaCache( const clientSnapshot_t *from, const clientSnapshot_t *to ) {
+	const deltaCacheEntry_t *dc;
+	int i;
+
+	for ( i = 0, dc = deltaCache; i < deltaCacheCount; i++, dc++ ) {
+		if ( SV_SameEntityList( dc->to, to ) && SV_SameEntityList( dc->from, from ) ) {
+			return dc;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+=============
+SV_WritePacketEntities
+
+SV_EmitPacketEntities() frontend that shares encoded result between clients
+=============
+*/
+static void SV_WritePacketEntities( const clientSnapshot_t *from, const clientSnapshot_t *to, msg_t *msg ) {
+	const deltaCacheEntry_t *dc;
+	deltaCacheEntry_t *nc;
+	int startbit, bits;
+	msg_t buf;
+
+	if ( !sv_deltaCache->integer || !deltaCacheData || !svs.currFrame || msg->overflowed ) {
+		SV_EmitPacketEntities( from, to, msg );
+		return;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_LockMutex( deltaCacheLock );
+	}
+
+	if ( deltaCacheFrame != svs.currFrame->frameNum ) {
+		deltaCacheFrame = svs.currFrame->frameNum;
+		deltaCacheCount = 0;
+		deltaCacheUsed = 0;
+	}
+
+	dc = SV_FindDeltaCache( from, to );
+	if ( dc ) {
+		deltaCacheHits++;
+	} else {
+		deltaCacheMisses++;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_UnlockMutex( deltaCacheLock );
+	}
+
+	// published entries are never modified until next frame
+	if ( dc ) {
+		MSG_WriteBitstream( msg, deltaCacheData, dc->offset, dc->bits );
+		return;
+	}
+
+	startbit = msg->bit;
+	SV_EmitPacketEntities( from, to, msg );
+	if ( msg->overflowed ) {
+		return;
+	}
+	bits = msg->bit - startbit;
+
+	if ( deltaCacheLock ) {
+		Sys_LockMutex( deltaCacheLock );
+	}
+
+	// another thread may have stored the same one meanwhile
+	if ( deltaCacheCount < DELTA_CACHE_SIZE && deltaCacheUsed + (bits+7)/8 <= DELTA_CACHE_BYTES
+		&& !SV_FindDeltaCache( from, to ) ) {
+		MSG_Init( &buf, deltaCacheData + deltaCacheUsed, DELTA_CACHE_BYTES - deltaCacheUsed );
+		MSG_WriteBitstream( &buf, msg->data, startbit, bits );
+		nc = &deltaCache[ deltaCacheCount ];
+		nc->from = from;
+		nc->to = to;
+		nc->offset = deltaCacheUsed * 8;
+		nc->bits = bits;
+		deltaCacheUsed += (bits+7)/8;
+		deltaCacheCount++;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_UnlockMutex( deltaCacheLock );
+	}
+}
+
+
 /*
 ==================
 SV_WriteSnapshotToClient
 ==================
 */
-static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
+static int SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 	const clientSnapshot_t	*oldframe;
 	const clientSnapshot_t	*frame;
 	int					lastframe;
 	int					i;
 	int					snapFlags;
+	int					warnings;
 
 	// this is the snapshot we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	warnings = 0;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( /* client->deltaMessage <= 0 || */ client->state != CS_ACTIVE ) {
@@ -135,10 +299,8 @@ static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 		lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage >= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
-		if ( com_developer->integer ) {
-			if ( client->deltaMessage != client->netchan.outgoingSequence - ( PACKET_BACKUP + 1 ) ) {
-				Com_Printf( "%s: Delta request from out of date packet.\n", client->name );
-			}
+		if ( client->deltaMessage != client->netchan.outgoingSequence - ( PACKET_BACKUP + 1 ) ) {
+			warnings |= SNAPWARN_OLD_PACKET;
 		}
 		oldframe = NULL;
 		lastframe = 0;
@@ -148,7 +310,7 @@ static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 		// we may refer on outdated frame
 		if ( oldframe->frameNum - svs.lastValidFrame < 0 ) {
-			Com_DPrintf( "%s: Delta request from out of date frame.\n", client->name );
+			warnings |= SNAPWARN_OLD_FRAME;
 			oldframe = NULL;
 			lastframe = 0;
 		}
@@ -198,7 +360,7 @@ static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 		MSG_WriteBits( msg, 0, 1 ); // no array changes
 		// packet entities
 		MSG_WriteBits( msg, (MAX_GENTITIES-1), GENTITYNUM_BITS );
-		return;
+		return warnings;
 	}
 
 	// delta encode the playerstate
@@ -209,7 +371,7 @@ static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 	}
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	SV_WritePacketEntities( oldframe, frame, msg );
 
 	// padding for rate debugging
 	if ( sv_padPackets->integer ) {
@@ -217,6 +379,29 @@ static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 			MSG_WriteByte (msg, svc_nop);
 		}
 	}
+
+	return warnings;
+}
+
+
+/*
+==================
+SV_PrintSnapshotWarnings
+
+Diagnostics collected while writing the snapshot,
+printed from the main thread only
+==================
+*/
+static void SV_PrintSnapshotWarnings( const client_t *client, int warnings ) {
+	if ( warnings & SNAPWARN_OLD_PACKET && com_developer->integer ) {
+		Com_Printf( "%s: Delta request from out of date packet.\n", client->name );
+	}
+	if ( warnings & SNAPWARN_OLD_FRAME ) {
+		Com_DPrintf( "%s: Delta request from out of date frame.\n", client->name );
+	}
+	if ( warnings & SNAPWARN_OVERFLOW ) {
+		Com_Printf( "WARNING: msg overflowed for %s\n", client->name );
+	}
 }
 
 
@@ -237,7 +422,7 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 		const int index = client->reliableAcknowledge + 1 + i;
 		MSG_WriteByte( msg, svc_serverCommand );
 		MSG_WriteLong( msg, index );
-		MSG_WriteString( msg, client->reliableCommands[ index & (MAX_RELIABLE_COMMANDS-1) ] );
+		MSG_WriteString( msg, SV_ReliableCommand( client, index ) );
 	}
 }
 
@@ -255,6 +440,8 @@ typedef struct {
 	int		numSnapshotEntities;
 	entityNum_t	snapshotEntities[ MAX_SNAPSHOT_ENTITIES ];
 	qboolean unordered;
+	const char *error;
+	byte	added[ MAX_GENTITIES / 8 ];	// used to prevent double adding from portal views
 } snapshotEntityNumbers_t;
 
 
@@ -293,9 +480,9 @@ static void SV_SortEntityNumbers( entityNum_t *num, const int size ) {
 SV_AddIndexToSnapshot
 ===============
 */
-static void SV_AddIndexToSnapshot( svEntity_t *svEnt, int index, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddIndexToSnapshot( int entityNum, int index, snapshotEntityNumbers_t *eNums ) {
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[ entityNum >> 3 ] |= 1 << ( entityNum & 7 );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities >= MAX_SNAPSHOT_ENTITIES ) {
@@ -307,6 +494,195 @@ static void SV_AddIndexToSnapshot( svEntity_t *svEnt, int index, snapshotEntityN
 }
 
 
+/*
+===============
+SV_EntityVisible
+
+Client-independent part of the visibility test
+===============
+*/
+static qboolean SV_EntityVisible( const sharedEntity_t *ent, const svEntity_t *svEnt, int clientarea, const uint64_t *pvs ) {
+	const byte *bitvector = (const byte *)pvs;
+	int		i, l;
+
+	// broadcast entities are always sent
+	if ( ent->r.svFlags & SVF_BROADCAST ) {
+		return qtrue;
+	}
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			return qfalse;		// blocked by a door
+		}
+	}
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			break;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that couldn't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			// scan words instead of single bits, result is the same as with the original
+			// per-cluster loop which rejects only when the first visible one is lastCluster
+			if ( l <= svEnt->lastCluster && !Com_TestBitRange( pvs, l, svEnt->lastCluster - 1 )
+				&& Com_TestBitRange( pvs, svEnt->lastCluster, svEnt->lastCluster ) ) {
+				return qfalse;	// not visible
+			}
+		} else {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+=============================================================================
+
+Per-frame cache of entities visible from (cluster, area) pair, so clients
+standing in the same place reuse PVS and area checks. Area portal states
+can't change while snapshots are being built so entries stay valid until
+next common snapshot frame
+
+=============================================================================
+*/
+
+#define VIS_CACHE_SIZE 64
+
+typedef struct {
+	int		cluster;
+	int		area;
+	byte	visible[ MAX_GENTITIES / 8 ];	// indexed by common snapshot frame entity
+} visCacheEntry_t;
+
+static visCacheEntry_t	visCache[ VIS_CACHE_SIZE ];
+static int				visCacheCount;
+static int				visCacheFrame = -1;
+static void				*visCacheLock;		// only used with snapshot threads
+
+static int				visCacheHits;
+static int				visCacheMisses;
+static int				visCacheOverflows;
+
+
+/*
+===============
+SV_BuildVisibleSet
+===============
+*/
+static void SV_BuildVisibleSet( int clientarea, const uint64_t *clientpvs, byte *visible ) {
+	const entityState_t *es;
+	int e;
+
+	Com_Memset( visible, 0, MAX_GENTITIES / 8 );
+
+	for ( e = 0 ; e < svs.currFrame->count; e++ ) {
+		es = &svs.snapshotEntities[ svs.currFrame->ents[ e ] ];
+		if ( SV_EntityVisible( SV_GentityNum( es->number ), &sv.svEntities[ es->number ], clientarea, clientpvs ) ) {
+			visible[ e >> 3 ] |= 1 << ( e & 7 );
+		}
+	}
+}
+
+
+/*
+===============
+SV_GetVisibleSet
+
+Returns cached visibility bitset or builds it in provided buffer if cache is full
+===============
+*/
+static const byte *SV_GetVisibleSet( int clientcluster, int clientarea, const uint64_t *clientpvs, byte *buffer ) {
+	visCacheEntry_t *vc;
+	const byte *visible;
+	int i;
+
+	if ( visCacheLock ) {
+		Sys_LockMutex( visCacheLock );
+	}
+
+	if ( visCacheFrame != svs.currFrame->frameNum ) {
+		visCacheFrame = svs.currFrame->frameNum;
+		visCacheCount = 0;
+	}
+
+	for ( i = 0, vc = visCache; i < visCacheCount; i++, vc++ ) {
+		if ( vc->cluster == clientcluster && vc->area == clientarea ) {
+			visCacheHits++;
+			if ( visCacheLock ) {
+				Sys_UnlockMutex( visCacheLock );
+			}
+			return vc->visible;
+		}
+	}
+
+	visCacheMisses++;
+
+	if ( visCacheCount < VIS_CACHE_SIZE ) {
+		vc = &visCache[ visCacheCount++ ];
+		vc->cluster = clientcluster;
+		vc->area = clientarea;
+		visible = vc->visible;
+	} else {
+		visCacheOverflows++;
+		visible = buffer;
+	}
+
+	SV_BuildVisibleSet( clientarea, clientpvs, (byte *)visible );
+
+	if ( visCacheLock ) {
+		Sys_UnlockMutex( visCacheLock );
+	}
+
+	return visible;
+}
+
+
+/*
+===============
+SV_VisCache_f
+===============
+*/
+void SV_VisCache_f( void ) {
+	int total;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		visCacheHits = visCacheMisses = visCacheOverflows = 0;
+		deltaCacheHits = deltaCacheMisses = 0;
+		return;
+	}
+
+	total = visCacheHits + visCacheMisses;
+
+	Com_Printf( "visibility cache: %s\n", sv_visCache->integer ? "enabled" : "disabled" );
+	Com_Printf( "%i hits, %i misses (%i%% hit rate), %i overflows\n", visCacheHits, visCacheMisses,
+		total ? (int)( (int64_t)visCacheHits * 100 / total ) : 0, visCacheOverflows );
+	Com_Printf( "%i entries in current frame\n", visCacheCount );
+
+	total = deltaCacheHits + deltaCacheMisses;
+
+	Com_Printf( "entity delta cache: %s\n", sv_deltaCache->integer ? "enabled" : "disabled" );
+	Com_Printf( "%i hits, %i misses (%i%% hit rate)\n", deltaCacheHits, deltaCacheMisses,
+		total ? (int)( (int64_t)deltaCacheHits * 100 / total ) : 0 );
+	Com_Printf( "%i entries, %i bytes in current frame\n", deltaCacheCount, deltaCacheUsed );
+}
+
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -314,15 +690,15 @@ SV_AddEntitiesVisibleFromPoint
 */
 static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_t *frame,
 									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
+	int		e;
 	sharedEntity_t *ent;
 	svEntity_t	*svEnt;
 	entityState_t  *es;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
+	const uint64_t	*clientpvs;
+	const byte	*visible;
+	byte	buffer[ MAX_GENTITIES / 8 ];
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -338,10 +714,26 @@ static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_
 	// calculate the visible areas
 	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
 
-	clientpvs = CM_ClusterPVS (clientcluster);
+	clientpvs = CM_ClusterPVSWords( clientcluster, NULL );
+
+	if ( sv_visCache->integer ) {
+		visible = SV_GetVisibleSet( clientcluster, clientarea, clientpvs, buffer );
+	} else {
+		visible = NULL;
+	}
 
 	for ( e = 0 ; e < svs.currFrame->count; e++ ) {
-		es = svs.currFrame->ents[ e ];
+		if ( visible ) {
+			if ( visible[ e >> 3 ] == 0 ) {
+				e |= 7;
+				continue;
+			}
+			if ( ( visible[ e >> 3 ] & ( 1 << ( e & 7 ) ) ) == 0 ) {
+				continue;
+			}
+		}
+
+		es = &svs.snapshotEntities[ svs.currFrame->ents[ e ] ];
 		ent = SV_GentityNum( es->number );
 
 		// entities can be flagged to be sent to only one client
@@ -358,68 +750,32 @@ static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_
 		}
 		// entities can be flagged to be sent to a given mask of clients
 		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
+			if ( frame->ps.clientNum >= 32 ) {
+				eNums->error = "SVF_CLIENTMASK: clientNum >= 32";
+				return;
+			}
 			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
 				continue;
 		}
 
-		svEnt = &sv.svEntities[ es->number ];
-
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+		if ( eNums->added[ es->number >> 3 ] & ( 1 << ( es->number & 7 ) ) ) {
 			continue;
 		}
 
-		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddIndexToSnapshot( svEnt, e, eNums );
-			continue;
-		}
+		svEnt = &sv.svEntities[ es->number ];
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
-			}
+		if ( !visible && !SV_EntityVisible( ent, svEnt, clientarea, clientpvs ) ) {
+			continue;
 		}
 
-		bitvector = clientpvs;
+		// add it
+		SV_AddIndexToSnapshot( es->number, e, eNums );
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
+		// broadcast entities don't merge portal views
+		if ( ent->r.svFlags & SVF_BROADCAST ) {
 			continue;
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
-		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that couldn't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
-				continue;
-			}
-		}
-
-		// add it
-		SV_AddIndexToSnapshot( svEnt, e, eNums );
 
 		// if it's a portal entity, add everything visible from its camera position
 		if ( ent->r.svFlags & SVF_PORTAL && !portal ) {
@@ -432,6 +788,9 @@ static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_
 			}
 			eNums->unordered = qtrue;
 			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, portal );
+			if ( eNums->error ) {
+				return;
+			}
 		}
 	}
 
@@ -454,6 +813,7 @@ void SV_InitSnapshotStorage( void )
 	// initialize snapshot storage
 	Com_Memset( svs.snapFrames, 0, sizeof( svs.snapFrames ) );
 	svs.freeStorageEntities = svs.numSnapshotEntities;
+	svs.storageHighwater = 0;
 	svs.currentStoragePosition = 0;
 
 	svs.snapshotFrame = 0;
@@ -461,6 +821,24 @@ void SV_InitSnapshotStorage( void )
 	svs.lastValidFrame = 0;
 
 	svs.currFrame = NULL;
+
+	visCacheFrame = -1;
+	deltaCacheFrame = -1;
+}
+
+
+/*
+===============
+SV_SnapshotStorageStats
+
+Sizes of common snapshot storage in bytes, for memreport
+===============
+*/
+void SV_SnapshotStorageStats( int *totalBytes, int *usedBytes, int *highwaterBytes )
+{
+	*totalBytes = svs.numSnapshotEntities * sizeof( entityState_t );
+	*usedBytes = ( svs.numSnapshotEntities - svs.freeStorageEntities ) * sizeof( entityState_t );
+	*highwaterBytes = svs.storageHighwater * sizeof( entityState_t );
 }
 
 
@@ -474,6 +852,10 @@ This should be called before any new client snaphot built
 void SV_IssueNewSnapshot( void ) 
 {
 	svs.currFrame = NULL;
+
+	// entities might be relinked since last visibility check
+	visCacheFrame = -1;
+	deltaCacheFrame = -1;
 	
 	// value that clients can use even for their empty frames
 	// as it will not increment on new snapshot built
@@ -524,12 +906,9 @@ static void SV_BuildCommonSnapshot( void )
 			}
 
 			list[ count++ ] = ent;
-			sv.svEntities[ num ].snapshotCounter = -1;
 		}
 	}
 
-	sv.snapshotCounter = -1;
-
 	sf = &svs.snapFrames[ svs.snapshotFrame % NUM_SNAPSHOT_FRAMES ];
 	
 	// track last valid frame
@@ -557,6 +936,9 @@ static void SV_BuildCommonSnapshot( void )
 	// allocate storage
 	sf->count = count;
 	svs.freeStorageEntities -= count;
+	if ( svs.numSnapshotEntities - svs.freeStorageEntities > svs.storageHighwater ) {
+		svs.storageHighwater = svs.numSnapshotEntities - svs.freeStorageEntities;
+	}
 
 	sf->start = svs.currentStoragePosition; 
 	svs.currentStoragePosition = ( svs.currentStoragePosition + count ) % svs.numSnapshotEntities;
@@ -571,8 +953,25 @@ static void SV_BuildCommonSnapshot( void )
 	for ( i = 0 ; i < count ; i++, index = (index+1) % svs.numSnapshotEntities ) {
 		//index %= svs.numSnapshotEntities;
 		svs.snapshotEntities[ index ] = list[ i ]->s;
-		sf->ents[ i ] = &svs.snapshotEntities[ index ];
+		sf->ents[ i ] = index;
+	}
+}
+
+
+/*
+===============
+SV_CommonSnapshot
+
+Common snapshot frame of the current server frame, built on first use
+===============
+*/
+const snapshotFrame_t *SV_CommonSnapshot( void )
+{
+	if ( svs.currFrame == NULL ) {
+		SV_BuildCommonSnapshot();
 	}
+
+	return svs.currFrame;
 }
 
 
@@ -587,14 +986,15 @@ This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+May run on worker threads so errors are returned to the caller instead of raised here
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static const char *SV_BuildClientSnapshot( client_t *client ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
 	snapshotEntityNumbers_t		entityNumbers;
 	int							i, cl;
-	svEntity_t					*svEnt;
 	int							clientNum;
 	playerState_t				*ps;
 
@@ -611,7 +1011,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	frame->frameNum = svs.currentSnapshotFrame;
 	
 	if ( client->state == CS_ZOMBIE )
-		return;
+		return NULL;
 
 	// grab the current playerState_t
 	ps = SV_GameClientNum( cl );
@@ -619,14 +1019,14 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		return "SV_SvEntityForGentity: bad gEnt";
 	}
 
 	// we set client->gentity only after sending gamestate
 	// so don't send any packetentities changes until CS_PRIMED
 	// because new gamestate will invalidate them anyway
 	if ( !client->gentity ) {
-		return;
+		return NULL;
 	}
 
 	if ( svs.currFrame == NULL ) {
@@ -634,18 +1034,16 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		SV_BuildCommonSnapshot();
 	}
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// empty entities before visibility check
 	entityNumbers.numSnapshotEntities = 0;
+	entityNumbers.error = NULL;
+	Com_Memset( entityNumbers.added, 0, sizeof( entityNumbers.added ) );
 
 	frame->frameNum = svs.currFrame->frameNum;
 
 	// never send client's own entity, because it can
 	// be regenerated from the playerstate
-	svEnt = &sv.svEntities[ clientNum ];
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	entityNumbers.added[ clientNum >> 3 ] |= 1 << ( clientNum & 7 );
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -655,6 +1053,9 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// may include portal entities that merge other viewpoints
 	entityNumbers.unordered = qfalse;
 	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	if ( entityNumbers.error ) {
+		return entityNumbers.error;
+	}
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
@@ -676,6 +1077,8 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ )	{
 		frame->ents[ i ] = svs.currFrame->ents[ entityNumbers.snapshotEntities[ i ] ];
 	}
+
+	return NULL;
 }
 
 
@@ -700,18 +1103,21 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client )
 
 /*
 =======================
-SV_SendClientSnapshot
-
-Also called by SV_FinalMessage
+SV_WriteClientSnapshot
 
+Builds snapshot and encodes complete client message, may run on worker threads
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[ MAX_MSGLEN_BUF ];
-	msg_t		msg;
+static void SV_WriteClientSnapshot( snapshotJob_t *job ) {
+	client_t *client = job->client;
+
+	job->warnings = 0;
 
 	// build the snapshot
-	SV_BuildClientSnapshot( client );
+	job->error = SV_BuildClientSnapshot( client );
+	if ( job->error ) {
+		return;
+	}
 
 	// bots need to have their snapshots build, but
 	// the query them directly without needing to be sent
@@ -719,27 +1125,107 @@ void SV_SendClientSnapshot( client_t *client ) {
 		return;
 	}
 
-	MSG_Init( &msg, msg_buf, MAX_MSGLEN );
-	msg.allowoverflow = qtrue;
+	MSG_Init( &job->msg, job->msg_buf, MAX_MSGLEN );
+	job->msg.allowoverflow = qtrue;
 
 	// NOTE, MRE: all server->client messages now acknowledge
 	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	MSG_WriteLong( &job->msg, client->lastClientCommand );
 
 	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	SV_UpdateServerCommandsToClient( client, &job->msg );
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	job->warnings = SV_WriteSnapshotToClient( client, &job->msg );
 
 	// check for overflow
-	if ( msg.overflowed ) {
-		Com_Printf( "WARNING: msg overflowed for %s\n", client->name );
-		MSG_Clear( &msg );
+	if ( job->msg.overflowed ) {
+		job->warnings |= SNAPWARN_OVERFLOW;
+		MSG_Clear( &job->msg );
+	}
+}
+
+
+/*
+=======================
+SV_TransmitClientSnapshot
+
+Main thread part, hands encoded message to the network channel
+=======================
+*/
+static void SV_TransmitClientSnapshot( snapshotJob_t *job ) {
+
+	if ( job->error ) {
+		Com_Error( ERR_DROP, "%s", job->error );
+	}
+
+	if ( job->client->netchan.remoteAddress.type == NA_BOT ) {
+		return;
+	}
+
+	SV_PrintSnapshotWarnings( job->client, job->warnings );
+
+	SV_SendMessageToClient( &job->msg, job->client );
+}
+
+
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	snapshotJob_t	job;
+
+	// coalesced configstring updates go before the snapshot
+	if ( SV_ClientCold( client )->numPendingCs && client->state == CS_ACTIVE ) {
+		SV_UpdateConfigstrings( client );
+	}
+
+	job.client = client;
+
+	SV_WriteClientSnapshot( &job );
+	SV_TransmitClientSnapshot( &job );
+}
+
+
+/*
+=======================
+SV_SnapshotJob
+=======================
+*/
+static void SV_SnapshotJob( void *data, int index ) {
+	SV_WriteClientSnapshot( (snapshotJob_t *)data + index );
+}
+
+
+/*
+=======================
+SV_FreeSnapshotJobs
+=======================
+*/
+void SV_FreeSnapshotJobs( void ) {
+	if ( snapshotJobs ) {
+		Z_Free( snapshotJobs );
+		snapshotJobs = NULL;
 	}
+	numSnapshotJobs = 0;
 
-	SV_SendMessageToClient( &msg, client );
+	Sys_DestroyMutex( visCacheLock );
+	visCacheLock = NULL;
+	visCacheFrame = -1;
+
+	if ( deltaCacheData ) {
+		Z_Free( deltaCacheData );
+		deltaCacheData = NULL;
+	}
+	Sys_DestroyMutex( deltaCacheLock );
+	deltaCacheLock = NULL;
+	deltaCacheFrame = -1;
 }
 
 
@@ -750,11 +1236,14 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages( void )
 {
-	int		i;
+	int		i, count;
 	client_t	*c;
+	client_t	*list[ MAX_CLIENTS ];
 
 	svs.msgTime = Sys_Milliseconds();
 
+	count = 0;
+
 	// send a message to each connected client
 	for ( i = 0; i < sv_maxclients->integer; i++ )
 	{
@@ -775,6 +1264,9 @@ void SV_SendClientMessages( void )
 		if ( svs.time - c->lastSnapshotTime < c->snapshotMsec * com_timescale->value )
 			continue;		// It's not time yet
 
+		if ( SV_ThrottleSnapshot( c ) )
+			continue;		// Overloaded, skip every other snapshot
+
 		if ( c->netchan.unsentFragments || c->netchan_start_queue )
 		{
 			c->rateDelayed = qtrue;
@@ -788,9 +1280,68 @@ void SV_SendClientMessages( void )
 			continue;
 		}
 
+		// coalesced configstring updates go before the snapshot,
+		// queueing commands is not possible on worker threads
+		if ( SV_ClientCold( c )->numPendingCs && c->state == CS_ACTIVE ) {
+			SV_UpdateConfigstrings( c );
+		}
+
+		list[ count++ ] = c;
+	}
+
+	if ( count > 1 && sv_deltaCache->integer && !deltaCacheData ) {
+		deltaCacheData = Z_Malloc( DELTA_CACHE_BYTES );
+	}
+
+	if ( count > 1 && sv_snapshotThreads->integer && Com_JobWorkers() > 0 ) {
+		if ( numSnapshotJobs < sv_maxclients->integer ) {
+			SV_FreeSnapshotJobs();
+			snapshotJobs = Z_Malloc( sv_maxclients->integer * sizeof( snapshotJobs[0] ) );
+			numSnapshotJobs = sv_maxclients->integer;
+		}
+
+		// common snapshot must be ready before the fan-out
+		// so workers will only read from it
+		if ( svs.currFrame == NULL ) {
+			for ( i = 0; i < count; i++ ) {
+				if ( list[ i ]->gentity && list[ i ]->state != CS_ZOMBIE ) {
+					SV_BuildCommonSnapshot();
+					break;
+				}
+			}
+		}
+
+		if ( !visCacheLock ) {
+			visCacheLock = Sys_CreateMutex();
+		}
+		if ( !deltaCacheLock ) {
+			deltaCacheLock = Sys_CreateMutex();
+		}
+
+		for ( i = 0; i < count; i++ ) {
+			snapshotJobs[ i ].client = list[ i ];
+		}
+
+		Com_ParallelFor( SV_SnapshotJob, snapshotJobs, count );
+
+		// transmit in client order
+		Sys_BeginSendBatch();
+		for ( i = 0; i < count; i++ ) {
+			SV_TransmitClientSnapshot( &snapshotJobs[ i ] );
+			list[ i ]->lastSnapshotTime = svs.time;
+			list[ i ]->rateDelayed = qfalse;
+		}
+		Sys_EndSendBatch();
+		return;
+	}
+
+	Sys_BeginSendBatch();
+	for ( i = 0; i < count; i++ ) {
+		c = list[ i ];
 		// generate and send a new message
 		SV_SendClientSnapshot( c );
 		c->lastSnapshotTime = svs.time;
 		c->rateDelayed = qfalse;
 	}
+	Sys_EndSendBatch();
 }
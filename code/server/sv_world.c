@@ -75,16 +75,73 @@ static worldSector_t	sv_worldSectors[AREA_NODES];
 static int			sv_numworldSectors;
 
 
+/*
+===============================================================================
+
+Alternative loose grid over the world x/y plane, optimized for lots of small
+entities like projectiles (sv_areaGrid 1).  Each entity is stored once
+in the cell that contains its center if it is not larger than the cell,
+so cell contents never extend past half a cell from its borders and queries
+just expand their bounds by that amount.  Everything else goes into one
+overflow list that is always checked.  Cells keep entity numbers in flat
+arrays instead of linked lists.
+
+===============================================================================
+*/
+
+#define	GRID_MAX_CELLS	64		// per axis
+#define	GRID_MIN_SIZE	128		// cell size
+#define	GRID_CELL_ENTS	32		// cell capacity, extra entities go to overflow list
+
+typedef struct {
+	vec2_t			origin;
+	float			cellSize;
+	int				size[2];
+	int				numCells;		// overflow list goes after the last cell
+	int				*counts;
+	unsigned short	*ents;			// GRID_CELL_ENTS per cell, then MAX_GENTITIES for overflow
+} worldGrid_t;
+
+static worldGrid_t	sv_grid;
+static int			sv_worldIndex;	// 0 - sectors, 1 - grid
+
+static void SV_CreateWorldGrid( const vec3_t mins, const vec3_t maxs );
+
+
 /*
 ===============
 SV_SectorList_f
 ===============
 */
 void SV_SectorList_f( void ) {
-	int				i, c;
+	int				i, c, used, maxc;
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
+	if ( sv_worldIndex ) {
+		used = maxc = c = 0;
+		for ( i = 0 ; i < sv_grid.numCells ; i++ ) {
+			if ( sv_grid.counts[i] ) {
+				used++;
+				c += sv_grid.counts[i];
+				if ( sv_grid.counts[i] > maxc ) {
+					maxc = sv_grid.counts[i];
+				}
+			}
+		}
+		Com_Printf( "grid %ix%i, cell size %i\n", sv_grid.size[0], sv_grid.size[1], (int)sv_grid.cellSize );
+		Com_Printf( "%i entities in %i cells, up to %i per cell\n", c, used, maxc );
+		Com_Printf( "%i entities in overflow list\n", sv_grid.counts[ sv_grid.numCells ] );
+		if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "cells" ) ) {
+			for ( i = 0 ; i < sv_grid.numCells ; i++ ) {
+				if ( sv_grid.counts[i] ) {
+					Com_Printf( "cell %i,%i: %i entities\n", i % sv_grid.size[0], i / sv_grid.size[0], sv_grid.counts[i] );
+				}
+			}
+		}
+		return;
+	}
+
 	for ( i = 0 ; i < AREA_NODES ; i++ ) {
 		sec = &sv_worldSectors[i];
 
@@ -138,6 +195,180 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 	return anode;
 }
 
+/*
+===============
+SV_CreateWorldGrid
+
+Allocates grid for the given world size, it is always built so
+index can be switched by tracebench without reloading the map
+===============
+*/
+static void SV_CreateWorldGrid( const vec3_t mins, const vec3_t maxs ) {
+	float	size;
+	int		i;
+
+	size = MAX( maxs[0] - mins[0], maxs[1] - mins[1] ) / GRID_MAX_CELLS;
+	if ( size < GRID_MIN_SIZE ) {
+		size = GRID_MIN_SIZE;
+	}
+
+	sv_grid.cellSize = size;
+	for ( i = 0 ; i < 2 ; i++ ) {
+		sv_grid.origin[i] = mins[i];
+		sv_grid.size[i] = (int)ceil( ( maxs[i] - mins[i] ) / size );
+		if ( sv_grid.size[i] < 1 ) {
+			sv_grid.size[i] = 1;
+		} else if ( sv_grid.size[i] > GRID_MAX_CELLS ) {
+			sv_grid.size[i] = GRID_MAX_CELLS;
+		}
+	}
+
+	sv_grid.numCells = sv_grid.size[0] * sv_grid.size[1];
+	sv_grid.counts = Hunk_Alloc( ( sv_grid.numCells + 1 ) * sizeof( sv_grid.counts[0] ), h_high );
+	sv_grid.ents = Hunk_Alloc( ( sv_grid.numCells * GRID_CELL_ENTS + MAX_GENTITIES ) * sizeof( sv_grid.ents[0] ), h_high );
+}
+
+
+/*
+===============
+SV_GridLink
+===============
+*/
+static void SV_GridLink( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	unsigned short *list;
+	int		x, y, cell;
+
+	// overflow list
+	cell = sv_grid.numCells;
+
+	if ( gEnt->r.absmax[0] - gEnt->r.absmin[0] <= sv_grid.cellSize && gEnt->r.absmax[1] - gEnt->r.absmin[1] <= sv_grid.cellSize ) {
+		x = (int)floor( ( 0.5f * ( gEnt->r.absmin[0] + gEnt->r.absmax[0] ) - sv_grid.origin[0] ) / sv_grid.cellSize );
+		y = (int)floor( ( 0.5f * ( gEnt->r.absmin[1] + gEnt->r.absmax[1] ) - sv_grid.origin[1] ) / sv_grid.cellSize );
+		if ( x >= 0 && x < sv_grid.size[0] && y >= 0 && y < sv_grid.size[1] ) {
+			cell = y * sv_grid.size[0] + x;
+			if ( sv_grid.counts[ cell ] >= GRID_CELL_ENTS ) {
+				cell = sv_grid.numCells;
+			}
+		}
+	}
+
+	list = sv_grid.ents + cell * GRID_CELL_ENTS;
+
+	ent->gridCell = cell + 1;
+	ent->gridSlot = sv_grid.counts[ cell ]++;
+	list[ ent->gridSlot ] = ent - sv.svEntities;
+}
+
+
+/*
+===============
+SV_GridUnlink
+===============
+*/
+static void SV_GridUnlink( svEntity_t *ent ) {
+	unsigned short *list;
+	int		cell, last;
+
+	cell = ent->gridCell - 1;
+	list = sv_grid.ents + cell * GRID_CELL_ENTS;
+
+	// move last one into the free slot
+	last = --sv_grid.counts[ cell ];
+	if ( ent->gridSlot != last ) {
+		list[ ent->gridSlot ] = list[ last ];
+		sv.svEntities[ list[ last ] ].gridSlot = ent->gridSlot;
+	}
+
+	ent->gridCell = 0;
+}
+
+
+/*
+===============
+SV_SectorLink
+===============
+*/
+static void SV_SectorLink( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	worldSector_t	*node;
+
+	// find the first world sector node that the ent's box crosses
+	node = sv_worldSectors;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( gEnt->r.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if ( gEnt->r.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	
+	// link it in
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
+}
+
+
+/*
+===============
+SV_SectorUnlink
+===============
+*/
+static void SV_SectorUnlink( svEntity_t *ent ) {
+	svEntity_t		*scan;
+	worldSector_t	*ws;
+
+	ws = ent->worldSector;
+	ent->worldSector = NULL;
+
+	if ( ws->entities == ent ) {
+		ws->entities = ent->nextEntityInWorldSector;
+		return;
+	}
+
+	for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
+		if ( scan->nextEntityInWorldSector == ent ) {
+			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
+			return;
+		}
+	}
+
+	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+}
+
+
+/*
+===============
+SV_SetWorldIndex
+
+Moves all linked entities to another spatial index
+===============
+*/
+static void SV_SetWorldIndex( int index ) {
+	svEntity_t *ent;
+	int i;
+
+	if ( sv_worldIndex == index ) {
+		return;
+	}
+
+	for ( i = 0, ent = sv.svEntities ; i < sv.num_entities ; i++, ent++ ) {
+		if ( ent->worldSector ) {
+			SV_SectorUnlink( ent );
+			SV_GridLink( ent, SV_GEntityForSvEntity( ent ) );
+		} else if ( ent->gridCell ) {
+			SV_GridUnlink( ent );
+			SV_SectorLink( ent, SV_GEntityForSvEntity( ent ) );
+		}
+	}
+
+	sv_worldIndex = index;
+}
+
+
 /*
 ===============
 SV_ClearWorld
@@ -155,6 +386,14 @@ void SV_ClearWorld( void ) {
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
 	SV_CreateworldSector( 0, mins, maxs );
+
+	SV_CreateWorldGrid( mins, maxs );
+
+	sv_worldIndex = sv_areaGrid->integer;
+
+	SV_InvalidateTraceCache();
+
+	SV_FreeTraceRecord();
 }
 
 
@@ -166,32 +405,19 @@ SV_UnlinkEntity
 */
 void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	svEntity_t		*ent;
-	svEntity_t		*scan;
-	worldSector_t	*ws;
 
 	ent = SV_SvEntityForGentity( gEnt );
 
 	gEnt->r.linked = qfalse;
 
-	ws = ent->worldSector;
-	if ( !ws ) {
-		return;		// not linked in anywhere
-	}
-	ent->worldSector = NULL;
-
-	if ( ws->entities == ent ) {
-		ws->entities = ent->nextEntityInWorldSector;
-		return;
-	}
+	SV_InvalidateTraceCache();
 
-	for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
-		if ( scan->nextEntityInWorldSector == ent ) {
-			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-			return;
-		}
+	if ( ent->worldSector ) {
+		SV_SectorUnlink( ent );
+	} else if ( ent->gridCell ) {
+		SV_GridUnlink( ent );
 	}
-
-	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+	// else not linked in anywhere
 }
 
 
@@ -203,7 +429,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -215,7 +440,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
-	if ( ent->worldSector ) {
+	SV_InvalidateTraceCache();
+
+	if ( ent->worldSector || ent->gridCell ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
 
@@ -332,24 +559,11 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+	if ( sv_worldIndex ) {
+		SV_GridLink( ent, gEnt );
+	} else {
+		SV_SectorLink( ent, gEnt );
 	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
 
 	gEnt->r.linked = qtrue;
 }
@@ -372,6 +586,39 @@ typedef struct {
 } areaParms_t;
 
 
+/*
+====================
+SV_AreaAddEntity
+
+Returns qfalse when list is full
+====================
+*/
+static qboolean SV_AreaAddEntity( svEntity_t *check, areaParms_t *ap ) {
+	const sharedEntity_t *gcheck;
+
+	gcheck = SV_GEntityForSvEntity( check );
+
+	if ( gcheck->r.absmin[0] > ap->maxs[0]
+	|| gcheck->r.absmin[1] > ap->maxs[1]
+	|| gcheck->r.absmin[2] > ap->maxs[2]
+	|| gcheck->r.absmax[0] < ap->mins[0]
+	|| gcheck->r.absmax[1] < ap->mins[1]
+	|| gcheck->r.absmax[2] < ap->mins[2]) {
+		return qtrue;
+	}
+
+	if ( ap->count == ap->maxcount ) {
+		Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+		return qfalse;
+	}
+
+	ap->list[ap->count] = check - sv.svEntities;
+	ap->count++;
+
+	return qtrue;
+}
+
+
 /*
 ====================
 SV_AreaEntities_r
@@ -380,29 +627,13 @@ SV_AreaEntities_r
 */
 static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	svEntity_t	*check, *next;
-	sharedEntity_t *gcheck;
 
 	for ( check = node->entities  ; check ; check = next ) {
 		next = check->nextEntityInWorldSector;
 
-		gcheck = SV_GEntityForSvEntity( check );
-
-		if ( gcheck->r.absmin[0] > ap->maxs[0]
-		|| gcheck->r.absmin[1] > ap->maxs[1]
-		|| gcheck->r.absmin[2] > ap->maxs[2]
-		|| gcheck->r.absmax[0] < ap->mins[0]
-		|| gcheck->r.absmax[1] < ap->mins[1]
-		|| gcheck->r.absmax[2] < ap->mins[2]) {
-			continue;
-		}
-
-		if ( ap->count == ap->maxcount ) {
-			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+		if ( !SV_AreaAddEntity( check, ap ) ) {
 			return;
 		}
-
-		ap->list[ap->count] = check - sv.svEntities;
-		ap->count++;
 	}
 	
 	if (node->axis == -1) {
@@ -418,6 +649,53 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+/*
+====================
+SV_GridAreaEntities
+====================
+*/
+static void SV_GridAreaEntities( areaParms_t *ap ) {
+	const unsigned short *list;
+	int		range[2][2];
+	float	loose;
+	int		i, x, y, cell;
+
+	// cell contents may stick out up to half of the cell size
+	loose = sv_grid.cellSize * 0.5f;
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		range[i][0] = (int)floor( ( ap->mins[i] - loose - sv_grid.origin[i] ) / sv_grid.cellSize );
+		range[i][1] = (int)floor( ( ap->maxs[i] + loose - sv_grid.origin[i] ) / sv_grid.cellSize );
+		if ( range[i][0] < 0 ) {
+			range[i][0] = 0;
+		}
+		if ( range[i][1] >= sv_grid.size[i] ) {
+			range[i][1] = sv_grid.size[i] - 1;
+		}
+	}
+
+	for ( y = range[1][0] ; y <= range[1][1] ; y++ ) {
+		for ( x = range[0][0] ; x <= range[0][1] ; x++ ) {
+			cell = y * sv_grid.size[0] + x;
+			list = sv_grid.ents + cell * GRID_CELL_ENTS;
+			for ( i = 0 ; i < sv_grid.counts[ cell ] ; i++ ) {
+				if ( !SV_AreaAddEntity( &sv.svEntities[ list[i] ], ap ) ) {
+					return;
+				}
+			}
+		}
+	}
+
+	cell = sv_grid.numCells;
+	list = sv_grid.ents + cell * GRID_CELL_ENTS;
+	for ( i = 0 ; i < sv_grid.counts[ cell ] ; i++ ) {
+		if ( !SV_AreaAddEntity( &sv.svEntities[ list[i] ], ap ) ) {
+			return;
+		}
+	}
+}
+
+
 /*
 ================
 SV_AreaEntities
@@ -432,7 +710,11 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_worldIndex ) {
+		SV_GridAreaEntities( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
@@ -587,24 +869,266 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 }
 
 
+/*
+===============================================================================
+
+TRACE CACHE
+
+Identical trace and point contents queries made until the next entity
+link/unlink or game frame return stored results (sv_traceCache 1).
+Game code that moves entities or changes their contents without
+relinking them may see stale results
+
+===============================================================================
+*/
+
+#define TRACE_CACHE_SIZE	512		// must be power of two
+#define CONTENTS_CACHE_SIZE	256		// must be power of two
+
+typedef struct {
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	int		passEntityNum;
+	int		contentmask;
+	int		capsule;
+} traceKey_t;
+
+typedef struct {
+	traceKey_t	key;
+	int			generation;
+	trace_t		trace;
+} traceCacheEntry_t;
+
+typedef struct {
+	vec3_t	point;
+	int		passEntityNum;
+	int		generation;
+	int		contents;
+} contentsCacheEntry_t;
+
+static traceCacheEntry_t	traceCache[ TRACE_CACHE_SIZE ];
+static contentsCacheEntry_t	contentsCache[ CONTENTS_CACHE_SIZE ];
+static int		sv_traceGeneration = 1;	// cache entries with other values are invalid
+
+static int		traceCacheHits, traceCacheMisses;
+static int		contentsCacheHits, contentsCacheMisses;
+
+
 /*
 ==================
-SV_Trace
+SV_InvalidateTraceCache
+==================
+*/
+void SV_InvalidateTraceCache( void ) {
+	if ( ++sv_traceGeneration == 0 ) {
+		// wrapped around, make sure that no old entries will match
+		Com_Memset( traceCache, 0, sizeof( traceCache ) );
+		Com_Memset( contentsCache, 0, sizeof( contentsCache ) );
+		sv_traceGeneration = 1;
+	}
+}
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+
+/*
+==================
+SV_HashBytes
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
-	moveclip_t	clip;
-	int			i;
+static unsigned int SV_HashBytes( const void *data, int size ) {
+	const byte *p = (const byte *)data;
+	unsigned int hash = 2166136261U;
+	int i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
+	for ( i = 0; i < size; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619U;
 	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
+
+	return hash;
+}
+
+
+/*
+==================
+SV_TraceCache_f
+==================
+*/
+void SV_TraceCache_f( void ) {
+	int total;
+
+	if ( !sv_traceCache->integer ) {
+		Com_Printf( "trace cache is disabled, set sv_traceCache 1 to enable\n" );
+	}
+
+	total = traceCacheHits + traceCacheMisses;
+	Com_Printf( "traces: %i hits, %i misses, %.1f%% hit rate\n", traceCacheHits, traceCacheMisses,
+		total ? traceCacheHits * 100.0f / total : 0.0f );
+
+	total = contentsCacheHits + contentsCacheMisses;
+	Com_Printf( "point contents: %i hits, %i misses, %.1f%% hit rate\n", contentsCacheHits, contentsCacheMisses,
+		total ? contentsCacheHits * 100.0f / total : 0.0f );
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		traceCacheHits = traceCacheMisses = 0;
+		contentsCacheHits = contentsCacheMisses = 0;
 	}
+}
+
+
+/*
+===============================================================================
+
+TRACE BENCHMARK
+
+Records trace queries issued by the game and replays them with both
+spatial indexes to compare speed and results
+
+===============================================================================
+*/
+
+#define MAX_TRACE_RECORD	65536
+
+typedef struct {
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	int		passEntityNum;
+	int		contentmask;
+	int		capsule;
+} traceQuery_t;
+
+static traceQuery_t	*sv_traceRecord;
+static int			sv_traceRecordSize;
+static int			sv_traceRecordCount;
+
+
+/*
+==================
+SV_FreeTraceRecord
+==================
+*/
+void SV_FreeTraceRecord( void ) {
+	if ( sv_traceRecord ) {
+		Z_Free( sv_traceRecord );
+		sv_traceRecord = NULL;
+	}
+	sv_traceRecordSize = 0;
+	sv_traceRecordCount = 0;
+}
+
+
+/*
+==================
+SV_RecordTrace
+==================
+*/
+static void SV_RecordTrace( const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+	traceQuery_t *tq;
+
+	tq = &sv_traceRecord[ sv_traceRecordCount++ ];
+	VectorCopy( start, tq->start );
+	VectorCopy( end, tq->end );
+	VectorCopy( mins, tq->mins );
+	VectorCopy( maxs, tq->maxs );
+	tq->passEntityNum = passEntityNum;
+	tq->contentmask = contentmask;
+	tq->capsule = capsule;
+
+	if ( sv_traceRecordCount == sv_traceRecordSize ) {
+		Com_Printf( "recorded %i traces\n", sv_traceRecordCount );
+	}
+}
+
+
+/*
+==================
+SV_ReplayTraces
+==================
+*/
+static int SV_ReplayTraces( trace_t *results ) {
+	const traceQuery_t *tq;
+	int64_t start;
+	int i;
+
+	start = Sys_Microseconds();
+
+	for ( i = 0, tq = sv_traceRecord ; i < sv_traceRecordCount ; i++, tq++ ) {
+		SV_Trace( &results[i], tq->start, tq->mins, tq->maxs, tq->end, tq->passEntityNum, tq->contentmask, tq->capsule );
+	}
+
+	return (int)( Sys_Microseconds() - start );
+}
+
+
+/*
+==================
+SV_TraceBench_f
+==================
+*/
+void SV_TraceBench_f( void ) {
+	trace_t	*results[2];
+	int		usec[2];
+	int		i, count, mismatches, index;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "record" ) ) {
+		count = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 4096;
+		if ( count < 1 || count > MAX_TRACE_RECORD ) {
+			Com_Printf( "trace count should be in range 1..%i\n", MAX_TRACE_RECORD );
+			return;
+		}
+		SV_FreeTraceRecord();
+		sv_traceRecord = Z_Malloc( count * sizeof( sv_traceRecord[0] ) );
+		sv_traceRecordSize = count;
+		Com_Printf( "recording next %i game traces\n", count );
+		return;
+	}
+
+	if ( !sv_traceRecordCount || sv_traceRecordCount < sv_traceRecordSize ) {
+		Com_Printf( "usage: tracebench record [count], then tracebench when recording is complete\n" );
+		return;
+	}
+
+	count = sv_traceRecordCount;
+	results[0] = Z_Malloc( count * sizeof( trace_t ) );
+	results[1] = Z_Malloc( count * sizeof( trace_t ) );
+
+	index = sv_worldIndex;
+
+	SV_SetWorldIndex( 0 );
+	SV_InvalidateTraceCache();
+	usec[0] = SV_ReplayTraces( results[0] );
+
+	SV_SetWorldIndex( 1 );
+	SV_InvalidateTraceCache();
+	usec[1] = SV_ReplayTraces( results[1] );
+
+	SV_SetWorldIndex( index );
+
+	mismatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( results[0][i].fraction != results[1][i].fraction || results[0][i].entityNum != results[1][i].entityNum ) {
+			mismatches++;
+		}
+	}
+
+	Com_Printf( "%i traces: sectors %i usec, grid %i usec, %i mismatches\n", count, usec[0], usec[1], mismatches );
+
+	Z_Free( results[1] );
+	Z_Free( results[0] );
+}
+
+
+/*
+==================
+SV_ClipTrace
+==================
+*/
+static void SV_ClipTrace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+	moveclip_t	clip;
+	int			i;
 
 	Com_Memset ( &clip, 0, sizeof ( clip ) );
 
@@ -646,6 +1170,59 @@ void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const ve
 }
 
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+	traceCacheEntry_t *entry;
+	traceKey_t	key;
+
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	if ( sv_traceRecordCount < sv_traceRecordSize ) {
+		SV_RecordTrace( start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	}
+
+	if ( !sv_traceCache->integer ) {
+		SV_ClipTrace( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+		return;
+	}
+
+	VectorCopy( start, key.start );
+	VectorCopy( end, key.end );
+	VectorCopy( mins, key.mins );
+	VectorCopy( maxs, key.maxs );
+	key.passEntityNum = passEntityNum;
+	key.contentmask = contentmask;
+	key.capsule = capsule;
+
+	entry = &traceCache[ SV_HashBytes( &key, sizeof( key ) ) & ( TRACE_CACHE_SIZE - 1 ) ];
+	if ( entry->generation == sv_traceGeneration && !memcmp( &entry->key, &key, sizeof( key ) ) ) {
+		traceCacheHits++;
+		*results = entry->trace;
+		return;
+	}
+
+	traceCacheMisses++;
+
+	SV_ClipTrace( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+
+	entry->key = key;
+	entry->generation = sv_traceGeneration;
+	entry->trace = *results;
+}
+
+
 
 /*
 =============
@@ -659,6 +1236,20 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 	int			contents, c2;
 	clipHandle_t	clipHandle;
 	const float		*angles;
+	contentsCacheEntry_t *entry;
+
+	entry = NULL;
+	if ( sv_traceCache->integer ) {
+		contentsCacheEntry_t key;
+		VectorCopy( p, key.point );
+		key.passEntityNum = passEntityNum;
+		entry = &contentsCache[ SV_HashBytes( &key, sizeof( key.point ) + sizeof( key.passEntityNum ) ) & ( CONTENTS_CACHE_SIZE - 1 ) ];
+		if ( entry->generation == sv_traceGeneration && VectorCompare( entry->point, p ) && entry->passEntityNum == passEntityNum ) {
+			contentsCacheHits++;
+			return entry->contents;
+		}
+		contentsCacheMisses++;
+	}
 
 	// get base contents from world
 	contents = CM_PointContents( p, 0 );
@@ -683,6 +1274,13 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 		contents |= c2;
 	}
 
+	if ( entry ) {
+		VectorCopy( p, entry->point );
+		entry->passEntityNum = passEntityNum;
+		entry->generation = sv_traceGeneration;
+		entry->contents = contents;
+	}
+
 	return contents;
 }
 
@@ -799,7 +799,8 @@ void HandleEvents( void )
 			break; // case KeyRelease
 
 		case MotionNotify:
-			if ( IN_MouseActive() )
+			// deltas come from the input thread then
+			if ( IN_MouseActive() && !IN_RawInputRunning() )
 			{
 				t = Sys_XTimeToSysTime( event.xkey.time );
 #ifdef HAVE_XF86DGA
@@ -845,6 +846,9 @@ void HandleEvents( void )
 			if ( !IN_MouseActive() )
 				break;
 
+			if ( event.xbutton.button <= 5 && IN_RawInputRunning() )
+				break;
+
 			if ( event.type == ButtonPress )
 				btn_press = qtrue;
 			else
@@ -973,6 +977,7 @@ void IN_ActivateMouse( void )
 		install_mouse_grab();
 		install_kb_grab();
 		mouse_active = qtrue;
+		IN_SetRawInputActive( IN_MouseActive() );
 	}
 }
 
@@ -991,6 +996,7 @@ void IN_DeactivateMouse( void )
 
 	if ( mouse_active )
 	{
+		IN_SetRawInputActive( qfalse );
 		uninstall_mouse_grab();
 		uninstall_kb_grab();
 		if ( in_dgamouse->integer && in_nograb->integer ) // force dga mouse to 0 if using nograb
@@ -1936,6 +1942,20 @@ void GLimp_EndFrame( void )
 		qglXSwapBuffers( dpy, win );
 	}
 }
+
+
+/*
+** GLimp_MakeCurrent
+**
+** Moves the context between the main and the render thread
+*/
+qboolean GLimp_MakeCurrent( qboolean current )
+{
+	if ( current )
+		return qglXMakeCurrent( dpy, win, ctx ) ? qtrue : qfalse;
+	else
+		return qglXMakeCurrent( dpy, None, NULL ) ? qtrue : qfalse;
+}
 #endif // USE_OPENGL_API
 
 
@@ -2059,6 +2079,8 @@ void IN_Init( void )
 	IN_StartupJoystick(); // bk001130 - from cvs1.17 (mkv)
 #endif
 
+	IN_InitRawInput();
+
 	Cmd_AddCommand( "minimize", IN_Minimize );
 	Cmd_AddCommand( "in_restart", IN_Restart_f );
 
@@ -2068,6 +2090,8 @@ void IN_Init( void )
 
 void IN_Shutdown( void )
 {
+	IN_ShutdownRawInput();
+
 	mouse_avail = qfalse;
 
 	Cmd_RemoveCommand( "minimize" );
@@ -29,6 +29,12 @@ void IN_Frame (void);
 void IN_Shutdown (void);
 
 
+// raw input thread, x11_rawinput.c
+void IN_InitRawInput( void );
+void IN_ShutdownRawInput( void );
+qboolean IN_RawInputRunning( void );
+void IN_SetRawInputActive( qboolean active );
+
 void IN_JoyMove( void );
 void IN_StartupJoystick( void );
 
@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <dirent.h>
 #include <unistd.h>
@@ -32,6 +33,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <pwd.h>
 #include <dlfcn.h>
 #include <libgen.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <link.h>
+#include <sys/prctl.h>
+#endif
+#include <signal.h>
 
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
@@ -316,6 +323,85 @@ qboolean Sys_GetFileStats( const char *filename, fileOffset_t *size, fileTime_t
 }
 
 
+/*
+=============
+Sys_MapFile
+=============
+*/
+void *Sys_MapFile( FILE *f, int64_t offset, size_t length, void **base, size_t *baseLength ) {
+	const int64_t pageSize = sysconf( _SC_PAGESIZE );
+	const int64_t start = offset & ~( pageSize - 1 );
+	void *ptr;
+
+	length += offset - start;
+
+	ptr = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( f ), (off_t)start );
+	if ( ptr == MAP_FAILED ) {
+		return NULL;
+	}
+
+	*base = ptr;
+	*baseLength = length;
+
+	return (byte *)ptr + ( offset - start );
+}
+
+
+/*
+=============
+Sys_UnmapFile
+=============
+*/
+void Sys_UnmapFile( void *base, size_t baseLength ) {
+	munmap( base, baseLength );
+}
+
+
+/*
+=============
+Sys_AllocPages
+
+Zero filled, page aligned memory that is never released.
+*largePages is cleared if they were requested but are not available
+=============
+*/
+void *Sys_AllocPages( size_t size, qboolean *largePages ) {
+#if defined( MAP_HUGETLB ) || defined( MADV_HUGEPAGE )
+	const size_t hugeSize = 2 * 1024 * 1024;
+#endif
+	void *ptr;
+
+	if ( *largePages ) {
+#ifdef MAP_HUGETLB
+		// explicitly reserved pages, see /proc/sys/vm/nr_hugepages
+		ptr = mmap( NULL, PAD( size, hugeSize ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if ( ptr != MAP_FAILED ) {
+			return ptr;
+		}
+#endif
+#ifdef MADV_HUGEPAGE
+		// transparent huge pages, range must be 2M aligned
+		ptr = mmap( NULL, PAD( size, hugeSize ) + hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( ptr != MAP_FAILED ) {
+			ptr = PADP( ptr, hugeSize );
+			if ( madvise( ptr, PAD( size, hugeSize ), MADV_HUGEPAGE ) != 0 ) {
+				*largePages = qfalse;
+			}
+			return ptr;
+		}
+#endif
+		*largePages = qfalse;
+	}
+
+	ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( ptr == MAP_FAILED ) {
+		return NULL;
+	}
+
+	return ptr;
+}
+
+
 /*
 ==================
 Sys_Basename
@@ -375,6 +461,19 @@ FILE *Sys_FOpen( const char *ospath, const char *mode )
 }
 
 
+/*
+=================
+Sys_FSync
+
+Commits written data of a flushed file to disk
+=================
+*/
+void Sys_FSync( FILE *f )
+{
+	fsync( fileno( f ) );
+}
+
+
 /*
 ==============
 Sys_ResetReadOnlyAttribute
@@ -583,6 +682,325 @@ int Sys_LoadFunctionErrors( void )
 }
 
 
+#ifdef __linux__
+typedef struct {
+	uintptr_t	from, to;
+} addrRange_t;
+
+
+typedef struct {
+	const struct link_map *map;
+	qboolean	found;
+	addrRange_t	image;
+	addrRange_t	code;
+	addrRange_t	data;
+	addrRange_t	relro;
+	addrRange_t	dynamic;
+} libraryPhdrs_t;
+
+
+static void Sys_ExtendRange( addrRange_t *range, uintptr_t from, uintptr_t to )
+{
+	if ( range->from == range->to ) {
+		range->from = from;
+		range->to = to;
+	} else {
+		if ( from < range->from )
+			range->from = from;
+		if ( to > range->to )
+			range->to = to;
+	}
+}
+
+
+static int Sys_LibraryPhdrs( struct dl_phdr_info *info, size_t size, void *data )
+{
+	libraryPhdrs_t *lib = (libraryPhdrs_t *) data;
+	const ElfW(Phdr) *ph;
+	uintptr_t from, to;
+	int i;
+
+	if ( info->dlpi_addr != lib->map->l_addr || !info->dlpi_name || strcmp( info->dlpi_name, lib->map->l_name ) != 0 ) {
+		return 0;
+	}
+
+	for ( i = 0; i < info->dlpi_phnum; i++ ) {
+		ph = &info->dlpi_phdr[ i ];
+		from = info->dlpi_addr + ph->p_vaddr;
+		to = from + ph->p_memsz;
+		switch ( ph->p_type ) {
+			case PT_LOAD:
+				Sys_ExtendRange( &lib->image, from, to );
+				if ( ph->p_flags & PF_X )
+					Sys_ExtendRange( &lib->code, from, to );
+				// take the largest writable segment
+				if ( ( ph->p_flags & PF_W ) && to - from > lib->data.to - lib->data.from ) {
+					lib->data.from = from;
+					lib->data.to = to;
+				}
+				break;
+			case PT_GNU_RELRO:
+				Sys_ExtendRange( &lib->relro, from, to );
+				break;
+			case PT_DYNAMIC:
+				Sys_ExtendRange( &lib->dynamic, from, to );
+				break;
+		}
+	}
+
+	lib->found = qtrue;
+	return 1;
+}
+
+
+// skip relocation tables that precede .data in the writable segment
+static void Sys_SkipRange( addrRange_t *data, uintptr_t from, uintptr_t to )
+{
+	if ( from >= data->from && from < data->to && to > data->from ) {
+		data->from = ( to < data->to ) ? to : data->to;
+	}
+}
+
+
+// dynamic section entries are relocated by the dynamic linker on most targets
+static uintptr_t Sys_DynamicAddr( const struct link_map *map, ElfW(Addr) addr )
+{
+	if ( addr < map->l_addr )
+		return map->l_addr + addr;
+	else
+		return addr;
+}
+
+
+static uint32_t Sys_DynamicSymbolCount( const struct link_map *map, const uint32_t *hash, const uint32_t *gnuHash )
+{
+	const uint32_t *buckets, *chain;
+	uint32_t nbuckets, symoffset, bloomSize, last, i;
+
+	if ( hash ) {
+		return hash[1]; // nchain
+	}
+
+	if ( !gnuHash ) {
+		return 0;
+	}
+
+	nbuckets = gnuHash[0];
+	symoffset = gnuHash[1];
+	bloomSize = gnuHash[2];
+	buckets = gnuHash + 4 + bloomSize * ( sizeof( ElfW(Addr) ) / sizeof( uint32_t ) );
+	chain = buckets + nbuckets;
+
+	last = 0;
+	for ( i = 0; i < nbuckets; i++ ) {
+		if ( buckets[ i ] > last )
+			last = buckets[ i ];
+	}
+
+	if ( last < symoffset ) {
+		return symoffset;
+	}
+
+	while ( ( chain[ last - symoffset ] & 1 ) == 0 ) {
+		last++;
+	}
+
+	return last + 1;
+}
+
+
+/*
+=================
+Sys_LibraryLayout
+
+Describes mapped image of a loaded library. Layout hash covers size of the
+writable data and offset, size and name of every exported data object there
+=================
+*/
+qboolean Sys_LibraryLayout( void *handle, libraryLayout_t *layout )
+{
+	struct link_map *map;
+	libraryPhdrs_t lib;
+	const ElfW(Dyn) *dyn;
+	const ElfW(Sym) *symtab, *sym;
+	const char *strtab;
+	const uint32_t *hash, *gnuHash;
+	uintptr_t pltgot, addr;
+	uint32_t i, count, pltRelSize, pltRel;
+	char buf[ MAX_STRING_CHARS ];
+	int len;
+
+	Com_Memset( layout, 0, sizeof( *layout ) );
+
+	if ( !handle || dlinfo( handle, RTLD_DI_LINKMAP, &map ) != 0 || !map ) {
+		return qfalse;
+	}
+
+	Com_Memset( &lib, 0, sizeof( lib ) );
+	lib.map = map;
+	dl_iterate_phdr( Sys_LibraryPhdrs, &lib );
+
+	if ( !lib.found || lib.data.from == lib.data.to || lib.dynamic.from == lib.dynamic.to ) {
+		return qfalse;
+	}
+
+	symtab = NULL; strtab = NULL; hash = NULL; gnuHash = NULL;
+	pltgot = 0; pltRelSize = 0; pltRel = DT_RELA;
+
+	for ( dyn = (const ElfW(Dyn) *) lib.dynamic.from; dyn->d_tag != DT_NULL; dyn++ ) {
+		switch ( dyn->d_tag ) {
+			case DT_SYMTAB:   symtab = (const ElfW(Sym) *) Sys_DynamicAddr( map, dyn->d_un.d_ptr ); break;
+			case DT_STRTAB:   strtab = (const char *) Sys_DynamicAddr( map, dyn->d_un.d_ptr ); break;
+			case DT_HASH:     hash = (const uint32_t *) Sys_DynamicAddr( map, dyn->d_un.d_ptr ); break;
+			case DT_GNU_HASH: gnuHash = (const uint32_t *) Sys_DynamicAddr( map, dyn->d_un.d_ptr ); break;
+			case DT_PLTGOT:   pltgot = Sys_DynamicAddr( map, dyn->d_un.d_ptr ); break;
+			case DT_PLTRELSZ: pltRelSize = dyn->d_un.d_val; break;
+			case DT_PLTREL:   pltRel = dyn->d_un.d_val; break;
+		}
+	}
+
+	if ( !symtab || !strtab ) {
+		return qfalse;
+	}
+
+	// .dynamic, .got and .got.plt are bound to the image they belong to
+	Sys_SkipRange( &lib.data, lib.relro.from, lib.relro.to );
+	Sys_SkipRange( &lib.data, lib.dynamic.from, lib.dynamic.to );
+	if ( pltgot ) {
+		count = 3 + pltRelSize / ( pltRel == DT_RELA ? sizeof( ElfW(Rela) ) : sizeof( ElfW(Rel) ) );
+		Sys_SkipRange( &lib.data, pltgot, pltgot + count * sizeof( void * ) );
+	}
+
+	lib.data.from = PAD( lib.data.from, sizeof( void * ) );
+	if ( lib.data.from >= lib.data.to ) {
+		return qfalse;
+	}
+
+	layout->path = map->l_name;
+	layout->base = (byte *) lib.image.from;
+	layout->size = lib.image.to - lib.image.from;
+	layout->code = (byte *) lib.code.from;
+	layout->codeSize = lib.code.to - lib.code.from;
+	layout->data = (byte *) lib.data.from;
+	layout->dataSize = lib.data.to - lib.data.from;
+	layout->layout = (uint32_t) layout->dataSize;
+
+	count = Sys_DynamicSymbolCount( map, hash, gnuHash );
+	for ( i = 0; i < count; i++ ) {
+		sym = &symtab[ i ];
+		// ELF32_ST_TYPE is the same for both ELF classes
+		if ( ELF32_ST_TYPE( sym->st_info ) != STT_OBJECT || sym->st_shndx == SHN_UNDEF ) {
+			continue;
+		}
+		addr = map->l_addr + sym->st_value;
+		if ( addr < lib.data.from || addr >= lib.data.to ) {
+			continue;
+		}
+		len = Com_sprintf( buf, sizeof( buf ), "%s:%x:%x", strtab + sym->st_name,
+			(unsigned int)( addr - lib.data.from ), (unsigned int) sym->st_size );
+		// order-independent, symbol table order may change between builds
+		layout->layout += crc32_buffer( (const byte *) buf, len );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+Sys_LibrarySymbol
+
+Returns address of the same exported symbol in another library, NULL if
+addr is not a start of exported symbol
+=================
+*/
+void *Sys_LibrarySymbol( const void *addr, void *handle )
+{
+	Dl_info info;
+
+	if ( !dladdr( addr, &info ) || !info.dli_sname || info.dli_saddr != addr ) {
+		return NULL;
+	}
+
+	return dlsym( handle, info.dli_sname );
+}
+
+
+/*
+=================
+Sys_LoadLibraryCopy
+
+Loads a private copy of the library so it gets a separate image even if
+the same file is loaded already, the copy is removed right after loading
+=================
+*/
+void *Sys_LoadLibraryCopy( const char *path )
+{
+	char name[ MAX_OSPATH ];
+	char buf[ 16384 ];
+	const char *tmpdir;
+	qboolean ok;
+	void *handle;
+	size_t len;
+	FILE *f;
+	int fd;
+
+	f = Sys_FOpen( path, "rb" );
+	if ( !f ) {
+		return NULL;
+	}
+
+	tmpdir = getenv( "TMPDIR" );
+	if ( !tmpdir || !*tmpdir ) {
+		tmpdir = "/tmp";
+	}
+
+	Com_sprintf( name, sizeof( name ), "%s/q3dllXXXXXX" DLL_EXT, tmpdir );
+	fd = mkstemps( name, strlen( DLL_EXT ) );
+	if ( fd == -1 ) {
+		fclose( f );
+		return NULL;
+	}
+
+	ok = qtrue;
+	while ( ok && ( len = fread( buf, 1, sizeof( buf ), f ) ) > 0 ) {
+		if ( write( fd, buf, len ) != (ssize_t) len ) {
+			ok = qfalse;
+		}
+	}
+
+	fclose( f );
+	close( fd );
+
+	handle = ok ? dlopen( name, RTLD_NOW ) : NULL;
+	unlink( name );
+
+	return handle;
+}
+
+#else
+
+qboolean Sys_LibraryLayout( void *handle, libraryLayout_t *layout )
+{
+	Com_Memset( layout, 0, sizeof( *layout ) );
+	return qfalse;
+}
+
+
+void *Sys_LibrarySymbol( const void *addr, void *handle )
+{
+	return NULL;
+}
+
+
+void *Sys_LoadLibraryCopy( const char *path )
+{
+	return NULL;
+}
+
+#endif // __linux__
+
+
 #ifdef USE_AFFINITY_MASK
 /*
 =================
@@ -631,9 +1049,322 @@ qboolean Sys_SetAffinityMask( const uint64_t mask )
 		return qfalse;
 	}
 }
+
+#endif // USE_AFFINITY_MASK
+
+
+/*
+=============================================================================
+
+THREADING PRIMITIVES
+
+=============================================================================
+*/
+
+typedef struct {
+	pthread_t		thread;
+	void			(*func)( void *arg );
+	void			*arg;
+} unixThread_t;
+
+typedef struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				count;
+} unixSemaphore_t;
+
+
+static void *Sys_ThreadMain( void *arg )
+{
+	unixThread_t *t = (unixThread_t *)arg;
+
+	t->func( t->arg );
+
+	return NULL;
+}
+
+
+/*
+=================
+Sys_CreateThread
+=================
+*/
+void *Sys_CreateThread( void (*func)( void *arg ), void *arg )
+{
+	unixThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if ( t == NULL ) {
+		return NULL;
+	}
+
+	t->func = func;
+	t->arg = arg;
+
+	if ( pthread_create( &t->thread, NULL, Sys_ThreadMain, t ) != 0 ) {
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+
+/*
+=================
+Sys_JoinThread
+=================
+*/
+void Sys_JoinThread( void *thread )
+{
+	unixThread_t *t = (unixThread_t *)thread;
+
+	if ( t ) {
+		pthread_join( t->thread, NULL );
+		free( t );
+	}
+}
+
+
+#ifdef USE_AFFINITY_MASK
+/*
+=================
+Sys_SetThreadAffinityMask
+
+Same as Sys_SetAffinityMask for a thread from Sys_CreateThread
+=================
+*/
+qboolean Sys_SetThreadAffinityMask( void *thread, const uint64_t mask )
+{
+	const unixThread_t *t = (const unixThread_t *)thread;
+	cpu_set_t cpu_set;
+	int cpu;
+
+	CPU_ZERO( &cpu_set );
+	for ( cpu = 0; cpu < sizeof( mask ) * 8; cpu++ ) {
+		if ( mask & (1ULL << cpu) ) {
+			CPU_SET( cpu, &cpu_set );
+		}
+	}
+
+	if ( pthread_setaffinity_np( t->thread, sizeof( cpu_set ), &cpu_set ) == 0 ) {
+		return qtrue;
+	} else {
+		return qfalse;
+	}
+}
 #endif // USE_AFFINITY_MASK
 
 
+/*
+=================
+Sys_CreateMutex
+=================
+*/
+void *Sys_CreateMutex( void )
+{
+	pthread_mutex_t *mutex;
+
+	mutex = malloc( sizeof( *mutex ) );
+	if ( mutex ) {
+		pthread_mutex_init( mutex, NULL );
+	}
+
+	return mutex;
+}
+
+
+void Sys_DestroyMutex( void *mutex )
+{
+	if ( mutex ) {
+		pthread_mutex_destroy( (pthread_mutex_t *)mutex );
+		free( mutex );
+	}
+}
+
+
+void Sys_LockMutex( void *mutex )
+{
+	pthread_mutex_lock( (pthread_mutex_t *)mutex );
+}
+
+
+void Sys_UnlockMutex( void *mutex )
+{
+	pthread_mutex_unlock( (pthread_mutex_t *)mutex );
+}
+
+
+/*
+=================
+Sys_CreateSemaphore
+
+Unnamed POSIX semaphores are not available on macOS
+so emulate them with mutex and condition variable
+=================
+*/
+void *Sys_CreateSemaphore( void )
+{
+	unixSemaphore_t *sem;
+
+	sem = malloc( sizeof( *sem ) );
+	if ( sem ) {
+		pthread_mutex_init( &sem->mutex, NULL );
+		pthread_cond_init( &sem->cond, NULL );
+		sem->count = 0;
+	}
+
+	return sem;
+}
+
+
+void Sys_DestroySemaphore( void *sem )
+{
+	unixSemaphore_t *s = (unixSemaphore_t *)sem;
+
+	if ( s ) {
+		pthread_cond_destroy( &s->cond );
+		pthread_mutex_destroy( &s->mutex );
+		free( s );
+	}
+}
+
+
+void Sys_WaitSemaphore( void *sem )
+{
+	unixSemaphore_t *s = (unixSemaphore_t *)sem;
+
+	pthread_mutex_lock( &s->mutex );
+	while ( s->count <= 0 ) {
+		pthread_cond_wait( &s->cond, &s->mutex );
+	}
+	s->count--;
+	pthread_mutex_unlock( &s->mutex );
+}
+
+
+void Sys_PostSemaphore( void *sem, int count )
+{
+	unixSemaphore_t *s = (unixSemaphore_t *)sem;
+
+	pthread_mutex_lock( &s->mutex );
+	s->count += count;
+	if ( count > 1 ) {
+		pthread_cond_broadcast( &s->cond );
+	} else {
+		pthread_cond_signal( &s->cond );
+	}
+	pthread_mutex_unlock( &s->mutex );
+}
+
+
+/*
+=================
+Sys_NumProcessors
+=================
+*/
+int Sys_NumProcessors( void )
+{
+	long count;
+
+	count = sysconf( _SC_NPROCESSORS_ONLN );
+	if ( count < 1 ) {
+		return 1;
+	}
+
+	return (int)count;
+}
+
+
+/*
+=================
+Sys_ForkInstances
+
+Starts count-1 copies of the process which share memory pages
+with it until they are written to
+=================
+*/
+int Sys_ForkInstances( int count )
+{
+	pid_t pid;
+	int i;
+
+	// copies are not waited for
+	signal( SIGCHLD, SIG_IGN );
+
+	for ( i = 1; i < count; i++ ) {
+		pid = fork();
+		if ( pid < 0 ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: fork failed for instance %i: %s\n", i, strerror( errno ) );
+			break;
+		}
+		if ( pid == 0 ) {
+			int fd;
+
+			signal( SIGCHLD, SIG_DFL );
+
+			// only the first instance reads the console
+			fd = open( "/dev/null", O_RDONLY );
+			if ( fd != -1 ) {
+				dup2( fd, STDIN_FILENO );
+				close( fd );
+			}
+#ifdef __linux__
+			// don't outlive the first instance
+			prctl( PR_SET_PDEATHSIG, SIGTERM );
+#endif
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+=================
+Sys_AtomicAdd
+=================
+*/
+int Sys_AtomicAdd( volatile int *ptr, int value )
+{
+	return __atomic_add_fetch( ptr, value, __ATOMIC_SEQ_CST );
+}
+
+
+/*
+=================
+Sys_AtomicCompareSwap
+=================
+*/
+qboolean Sys_AtomicCompareSwap( volatile int *ptr, int expected, int value )
+{
+	return __atomic_compare_exchange_n( ptr, &expected, value, qfalse, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) ? qtrue : qfalse;
+}
+
+
+/*
+=================
+Sys_AtomicLoad
+=================
+*/
+int Sys_AtomicLoad( volatile int *ptr )
+{
+	return __atomic_load_n( ptr, __ATOMIC_ACQUIRE );
+}
+
+
+/*
+=================
+Sys_AtomicStore
+=================
+*/
+void Sys_AtomicStore( volatile int *ptr, int value )
+{
+	__atomic_store_n( ptr, value, __ATOMIC_RELEASE );
+}
+
+
 /*
 =================
 Sys_StripAppBundle
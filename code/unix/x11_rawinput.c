@@ -0,0 +1,429 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+/*
+** X11_RAWINPUT.C
+**
+** Mouse reader thread. It opens a private X connection, selects XInput2
+** raw events on the root window and pushes motion, button and wheel events
+** to the event queue as soon as they arrive, stamped with the time they
+** were read. Input no longer waits for the main thread to pump events once
+** per frame. libX11 and libXi are loaded at runtime so SDL builds don't
+** link against them.
+*/
+
+#include "../client/client.h"
+#include "linux_local.h"
+
+#if defined( __has_include )
+#if __has_include( <X11/Xlib.h> ) && __has_include( <X11/extensions/XI2.h> )
+#define HAVE_XI2_RAWINPUT
+#endif
+#endif
+
+#ifdef HAVE_XI2_RAWINPUT
+
+#include "unix_glw.h"
+
+#include <X11/extensions/XI2.h>
+#include <poll.h>
+#include <unistd.h>
+
+// from X11/extensions/XInput2.h which is not required to build
+typedef struct {
+	int				deviceid;
+	int				mask_len;
+	unsigned char	*mask;
+} xiEventMask_t;
+
+typedef struct {
+	int				mask_len;
+	unsigned char	*mask;
+	double			*values;
+} xiValuatorState_t;
+
+typedef struct {
+	int				type;
+	unsigned long	serial;
+	Bool			send_event;
+	Display			*display;
+	int				extension;
+	int				evtype;
+	Time			time;
+	int				deviceid;
+	int				sourceid;
+	int				detail;
+	int				flags;
+	xiValuatorState_t valuators;
+	double			*raw_values;
+} xiRawEvent_t;
+
+static Display *(*_XOpenDisplay)( const char *name );
+static int (*_XCloseDisplay)( Display *dpy );
+static Bool (*_XQueryExtension)( Display *dpy, const char *name, int *opcode, int *event, int *error );
+static int (*_XPending)( Display *dpy );
+static int (*_XNextEvent)( Display *dpy, XEvent *ev );
+static int (*_XFlush)( Display *dpy );
+static Bool (*_XGetEventData)( Display *dpy, XGenericEventCookie *cookie );
+static void (*_XFreeEventData)( Display *dpy, XGenericEventCookie *cookie );
+
+static Status (*_XIQueryVersion)( Display *dpy, int *major, int *minor );
+static Status (*_XISelectEvents)( Display *dpy, Window win, xiEventMask_t *masks, int num_masks );
+
+static sym_t x_list[] =
+{
+	{ (void**)&_XOpenDisplay, "XOpenDisplay" },
+	{ (void**)&_XCloseDisplay, "XCloseDisplay" },
+	{ (void**)&_XQueryExtension, "XQueryExtension" },
+	{ (void**)&_XPending, "XPending" },
+	{ (void**)&_XNextEvent, "XNextEvent" },
+	{ (void**)&_XFlush, "XFlush" },
+	{ (void**)&_XGetEventData, "XGetEventData" },
+	{ (void**)&_XFreeEventData, "XFreeEventData" }
+};
+
+static sym_t xi_list[] =
+{
+	{ (void**)&_XIQueryVersion, "XIQueryVersion" },
+	{ (void**)&_XISelectEvents, "XISelectEvents" }
+};
+
+static cvar_t *in_inputThread;
+
+static void *x_lib;
+static void *xi_lib;
+
+static struct {
+	Display		*dpy;
+	int			opcode;			// XInputExtension major opcode
+	void		*thread;
+	int			wakeFds[2];		// written to stop the thread
+	volatile int quit;
+	volatile int active;		// forward events only while the game owns the mouse
+	double		fracX, fracY;	// sub-unit remainders of raw motion
+} raw = { NULL, 0, NULL, { -1, -1 } };
+
+
+/*
+=================
+RawInput_LoadSymbols
+=================
+*/
+static qboolean RawInput_LoadSymbols( void **lib, const char *name, sym_t *list, int count )
+{
+	int i;
+
+	if ( *lib == NULL )
+	{
+		*lib = Sys_LoadLibrary( name );
+		if ( *lib == NULL )
+		{
+			Com_Printf( "...error loading %s\n", name );
+			return qfalse;
+		}
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		*list[ i ].symbol = Sys_LoadFunction( *lib, list[ i ].name );
+		if ( *list[ i ].symbol == NULL )
+		{
+			Com_Printf( "...couldn't find '%s' in %s\n", list[ i ].name, name );
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+RawInput_Motion
+=================
+*/
+static void RawInput_Motion( int t, const xiRawEvent_t *ev )
+{
+	const double *v = ev->raw_values;
+	double d[2] = { 0.0, 0.0 };
+	int i, dx, dy;
+
+	// values are packed, one for every valuator set in the mask
+	for ( i = 0; i < 2 && i < ev->valuators.mask_len * 8; i++ )
+	{
+		if ( XIMaskIsSet( ev->valuators.mask, i ) )
+		{
+			d[ i ] = *v++;
+		}
+	}
+
+	raw.fracX += d[0];
+	raw.fracY += d[1];
+	dx = (int)raw.fracX;
+	dy = (int)raw.fracY;
+	raw.fracX -= dx;
+	raw.fracY -= dy;
+
+	if ( dx || dy )
+	{
+		Sys_QueEvent( t, SE_MOUSE, dx, dy, 0, NULL );
+	}
+}
+
+
+/*
+=================
+RawInput_Button
+=================
+*/
+static void RawInput_Button( int t, const xiRawEvent_t *ev, qboolean down )
+{
+	switch ( ev->detail )
+	{
+		case 1: Sys_QueEvent( t, SE_KEY, K_MOUSE1, down, 0, NULL ); break;
+		case 2: Sys_QueEvent( t, SE_KEY, K_MOUSE3, down, 0, NULL ); break;
+		case 3: Sys_QueEvent( t, SE_KEY, K_MOUSE2, down, 0, NULL ); break;
+		case 4: Sys_QueEvent( t, SE_KEY, K_MWHEELUP, down, 0, NULL ); break;
+		case 5: Sys_QueEvent( t, SE_KEY, K_MWHEELDOWN, down, 0, NULL ); break;
+		default: break; // backend maps the others
+	}
+}
+
+
+/*
+=================
+RawInput_Thread
+=================
+*/
+static void RawInput_Thread( void *arg )
+{
+	XGenericEventCookie *cookie;
+	struct pollfd fds[2];
+	XEvent ev;
+	int t;
+
+	fds[0].fd = ConnectionNumber( raw.dpy );
+	fds[0].events = POLLIN;
+	fds[1].fd = raw.wakeFds[0];
+	fds[1].events = POLLIN;
+
+	while ( !Sys_AtomicLoad( &raw.quit ) )
+	{
+		while ( _XPending( raw.dpy ) )
+		{
+			_XNextEvent( raw.dpy, &ev );
+
+			cookie = &ev.xcookie;
+			if ( cookie->type != GenericEvent || cookie->extension != raw.opcode )
+				continue;
+
+			if ( !_XGetEventData( raw.dpy, cookie ) )
+				continue;
+
+			// raw events arrive regardless of focus and grabs
+			if ( Sys_AtomicLoad( &raw.active ) )
+			{
+				t = Sys_Milliseconds();
+				switch ( cookie->evtype )
+				{
+					case XI_RawMotion:
+						RawInput_Motion( t, (const xiRawEvent_t *)cookie->data );
+						break;
+					case XI_RawButtonPress:
+						RawInput_Button( t, (const xiRawEvent_t *)cookie->data, qtrue );
+						break;
+					case XI_RawButtonRelease:
+						RawInput_Button( t, (const xiRawEvent_t *)cookie->data, qfalse );
+						break;
+				}
+			}
+			else
+			{
+				raw.fracX = raw.fracY = 0.0;
+			}
+
+			_XFreeEventData( raw.dpy, cookie );
+		}
+
+		poll( fds, ARRAY_LEN( fds ), -1 );
+	}
+}
+
+
+/*
+=================
+IN_InitRawInput
+
+Starts the reader thread when \in_inputThread is set
+=================
+*/
+void IN_InitRawInput( void )
+{
+	unsigned char mask[ XIMaskLen( XI_RawButtonRelease ) ];
+	xiEventMask_t em;
+	int event, error;
+	int major = 2, minor = 0;
+
+	in_inputThread = Cvar_Get( "in_inputThread", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( in_inputThread, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( in_inputThread, "Read raw mouse motion, buttons and wheel on a separate thread as they arrive instead of once per frame. Needs X11 with XInput 2.\nRequires " S_COLOR_CYAN "\\in_restart." );
+
+	if ( raw.thread || !in_inputThread->integer )
+		return;
+
+	Com_Printf( "Initializing input thread...\n" );
+
+	if ( !RawInput_LoadSymbols( &x_lib, "libX11.so.6", x_list, ARRAY_LEN( x_list ) ) ||
+		!RawInput_LoadSymbols( &xi_lib, "libXi.so.6", xi_list, ARRAY_LEN( xi_list ) ) )
+	{
+		goto __fail;
+	}
+
+	raw.dpy = _XOpenDisplay( NULL );
+	if ( raw.dpy == NULL )
+	{
+		Com_Printf( "...couldn't open X display\n" );
+		goto __fail;
+	}
+
+	if ( !_XQueryExtension( raw.dpy, "XInputExtension", &raw.opcode, &event, &error ) ||
+		_XIQueryVersion( raw.dpy, &major, &minor ) != Success )
+	{
+		Com_Printf( "...XInput 2 extension is not available\n" );
+		goto __fail;
+	}
+
+	Com_Memset( mask, 0, sizeof( mask ) );
+	XISetMask( mask, XI_RawMotion );
+	XISetMask( mask, XI_RawButtonPress );
+	XISetMask( mask, XI_RawButtonRelease );
+
+	em.deviceid = XIAllMasterDevices;
+	em.mask_len = sizeof( mask );
+	em.mask = mask;
+
+	_XISelectEvents( raw.dpy, DefaultRootWindow( raw.dpy ), &em, 1 );
+	_XFlush( raw.dpy );
+
+	if ( pipe( raw.wakeFds ) != 0 )
+	{
+		raw.wakeFds[0] = raw.wakeFds[1] = -1;
+		goto __fail;
+	}
+
+	raw.quit = 0;
+	raw.active = 0;
+	raw.fracX = raw.fracY = 0.0;
+
+	raw.thread = Com_CreateThread( JOB_POOL_IO, "raw input", RawInput_Thread, NULL );
+	if ( raw.thread == NULL )
+	{
+		Com_Printf( "...couldn't create thread\n" );
+		goto __fail;
+	}
+
+	Com_Printf( "...XInput %i.%i raw mouse thread started\n", major, minor );
+	return;
+
+__fail:
+	IN_ShutdownRawInput();
+}
+
+
+/*
+=================
+IN_ShutdownRawInput
+=================
+*/
+void IN_ShutdownRawInput( void )
+{
+	if ( raw.thread )
+	{
+		Sys_AtomicStore( &raw.quit, 1 );
+		if ( write( raw.wakeFds[1], "", 1 ) != 1 )
+		{
+			// the thread still wakes on the next X event
+		}
+		Com_JoinThread( raw.thread );
+		raw.thread = NULL;
+	}
+
+	if ( raw.wakeFds[0] != -1 )
+	{
+		close( raw.wakeFds[0] );
+		close( raw.wakeFds[1] );
+		raw.wakeFds[0] = raw.wakeFds[1] = -1;
+	}
+
+	if ( raw.dpy )
+	{
+		_XCloseDisplay( raw.dpy );
+		raw.dpy = NULL;
+	}
+
+	if ( xi_lib )
+	{
+		Sys_UnloadLibrary( xi_lib );
+		xi_lib = NULL;
+	}
+
+	if ( x_lib )
+	{
+		Sys_UnloadLibrary( x_lib );
+		x_lib = NULL;
+	}
+}
+
+
+/*
+=================
+IN_RawInputRunning
+
+Backends skip motion, buttons 1-3 and wheel while this is true
+=================
+*/
+qboolean IN_RawInputRunning( void )
+{
+	return raw.thread != NULL ? qtrue : qfalse;
+}
+
+
+/*
+=================
+IN_SetRawInputActive
+=================
+*/
+void IN_SetRawInputActive( qboolean active )
+{
+	if ( raw.thread )
+	{
+		Sys_AtomicStore( &raw.active, active ? 1 : 0 );
+	}
+}
+
+#else // !HAVE_XI2_RAWINPUT
+
+void IN_InitRawInput( void ) { }
+void IN_ShutdownRawInput( void ) { }
+qboolean IN_RawInputRunning( void ) { return qfalse; }
+void IN_SetRawInputActive( qboolean active ) { }
+
+#endif // !HAVE_XI2_RAWINPUT
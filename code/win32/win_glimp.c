@@ -1307,6 +1307,20 @@ void GLimp_EndFrame( void )
 }
 
 
+/*
+** GLimp_MakeCurrent
+**
+** Moves the context between the main and the render thread
+*/
+qboolean GLimp_MakeCurrent( qboolean current )
+{
+	if ( current )
+		return qwglMakeCurrent( glw_state.hDC, glw_state.hGLRC ) ? qtrue : qfalse;
+	else
+		return qwglMakeCurrent( glw_state.hDC, NULL ) ? qtrue : qfalse;
+}
+
+
 static qboolean GLW_StartOpenGL( void )
 {
 	//
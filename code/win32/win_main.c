@@ -167,6 +167,19 @@ FILE *Sys_FOpen( const char *ospath, const char *mode )
 }
 
 
+/*
+==============
+Sys_FSync
+
+Commits written data of a flushed file to disk
+==============
+*/
+void Sys_FSync( FILE *f )
+{
+	_commit( _fileno( f ) );
+}
+
+
 /*
 ==============
 Sys_ResetReadOnlyAttribute
@@ -469,6 +482,113 @@ qboolean Sys_GetFileStats( const char *filename, fileOffset_t *size, fileTime_t
 }
 
 
+/*
+=============
+Sys_MapFile
+=============
+*/
+void *Sys_MapFile( FILE *f, int64_t offset, size_t length, void **base, size_t *baseLength ) {
+	SYSTEM_INFO info;
+	HANDLE mapping;
+	int64_t start;
+	void *ptr;
+
+	// views must start at allocation granularity, not just page size
+	GetSystemInfo( &info );
+	start = offset & ~( (int64_t)info.dwAllocationGranularity - 1 );
+	length += offset - start;
+
+	mapping = CreateFileMappingA( (HANDLE)_get_osfhandle( _fileno( f ) ), NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	if ( mapping == NULL ) {
+		return NULL;
+	}
+
+	ptr = MapViewOfFile( mapping, FILE_MAP_COPY, (DWORD)( start >> 32 ), (DWORD)start, length );
+
+	// view keeps the mapping object alive
+	CloseHandle( mapping );
+
+	if ( ptr == NULL ) {
+		return NULL;
+	}
+
+	*base = ptr;
+	*baseLength = length;
+
+	return (byte *)ptr + ( offset - start );
+}
+
+
+/*
+=============
+Sys_UnmapFile
+=============
+*/
+void Sys_UnmapFile( void *base, size_t baseLength ) {
+	UnmapViewOfFile( base );
+}
+
+
+/*
+=============
+Sys_AllocLargePages
+
+Needs "Lock pages in memory" user right, such pages are always resident
+=============
+*/
+static void *Sys_AllocLargePages( size_t size ) {
+	TOKEN_PRIVILEGES tp;
+	HANDLE token;
+	SIZE_T minimum;
+	BOOL enabled;
+
+	minimum = GetLargePageMinimum();
+	if ( minimum == 0 ) {
+		return NULL;
+	}
+
+	if ( !OpenProcessToken( GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token ) ) {
+		return NULL;
+	}
+
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	enabled = LookupPrivilegeValueA( NULL, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid )
+		&& AdjustTokenPrivileges( token, FALSE, &tp, 0, NULL, NULL )
+		&& GetLastError() == ERROR_SUCCESS;
+	CloseHandle( token );
+
+	if ( !enabled ) {
+		return NULL;
+	}
+
+	return VirtualAlloc( NULL, PAD( size, minimum ), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+}
+
+
+/*
+=============
+Sys_AllocPages
+
+Zero filled, page aligned memory that is never released.
+*largePages is cleared if they were requested but are not available
+=============
+*/
+void *Sys_AllocPages( size_t size, qboolean *largePages ) {
+	void *ptr;
+
+	if ( *largePages ) {
+		ptr = Sys_AllocLargePages( size );
+		if ( ptr ) {
+			return ptr;
+		}
+		*largePages = qfalse;
+	}
+
+	return VirtualAlloc( NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+}
+
+
 //========================================================
 
 /*
@@ -550,6 +670,33 @@ void Sys_UnloadLibrary( void *handle )
 }
 
 
+/*
+=================
+Sys_LibraryLayout
+
+Native module reloading is not supported here: PE images do not export
+data objects or internal functions, so module state can't be moved safely
+=================
+*/
+qboolean Sys_LibraryLayout( void *handle, libraryLayout_t *layout )
+{
+	Com_Memset( layout, 0, sizeof( *layout ) );
+	return qfalse;
+}
+
+
+void *Sys_LibrarySymbol( const void *addr, void *handle )
+{
+	return NULL;
+}
+
+
+void *Sys_LoadLibraryCopy( const char *path )
+{
+	return NULL;
+}
+
+
 /*
 =================
 Sys_SendKeyEvents
@@ -247,3 +247,239 @@ qboolean Sys_SetAffinityMask( const uint64_t mask )
 	return qfalse;
 }
 #endif // USE_AFFINITY_MASK
+
+
+/*
+=============================================================================
+
+THREADING PRIMITIVES
+
+=============================================================================
+*/
+
+typedef struct {
+	HANDLE			handle;
+	void			(*func)( void *arg );
+	void			*arg;
+} winThread_t;
+
+
+static DWORD WINAPI Sys_ThreadMain( LPVOID arg )
+{
+	winThread_t *t = (winThread_t *)arg;
+
+	t->func( t->arg );
+
+	return 0;
+}
+
+
+/*
+=================
+Sys_CreateThread
+=================
+*/
+void *Sys_CreateThread( void (*func)( void *arg ), void *arg )
+{
+	winThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if ( t == NULL ) {
+		return NULL;
+	}
+
+	t->func = func;
+	t->arg = arg;
+	t->handle = CreateThread( NULL, 0, Sys_ThreadMain, t, 0, NULL );
+
+	if ( t->handle == NULL ) {
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+
+/*
+=================
+Sys_JoinThread
+=================
+*/
+void Sys_JoinThread( void *thread )
+{
+	winThread_t *t = (winThread_t *)thread;
+
+	if ( t ) {
+		WaitForSingleObject( t->handle, INFINITE );
+		CloseHandle( t->handle );
+		free( t );
+	}
+}
+
+
+#ifdef USE_AFFINITY_MASK
+/*
+=================
+Sys_SetThreadAffinityMask
+
+Same as Sys_SetAffinityMask for a thread from Sys_CreateThread
+=================
+*/
+qboolean Sys_SetThreadAffinityMask( void *thread, const uint64_t mask )
+{
+	const winThread_t *t = (const winThread_t *)thread;
+
+	if ( SetThreadAffinityMask( t->handle, (DWORD_PTR)mask ) ) {
+		return qtrue;
+	}
+
+	return qfalse;
+}
+#endif // USE_AFFINITY_MASK
+
+
+/*
+=================
+Sys_CreateMutex
+=================
+*/
+void *Sys_CreateMutex( void )
+{
+	CRITICAL_SECTION *cs;
+
+	cs = malloc( sizeof( *cs ) );
+	if ( cs ) {
+		InitializeCriticalSection( cs );
+	}
+
+	return cs;
+}
+
+
+void Sys_DestroyMutex( void *mutex )
+{
+	if ( mutex ) {
+		DeleteCriticalSection( (CRITICAL_SECTION *)mutex );
+		free( mutex );
+	}
+}
+
+
+void Sys_LockMutex( void *mutex )
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+
+void Sys_UnlockMutex( void *mutex )
+{
+	LeaveCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+
+/*
+=================
+Sys_CreateSemaphore
+=================
+*/
+void *Sys_CreateSemaphore( void )
+{
+	return CreateSemaphore( NULL, 0, 0x7FFFFFFF, NULL );
+}
+
+
+void Sys_DestroySemaphore( void *sem )
+{
+	if ( sem ) {
+		CloseHandle( (HANDLE)sem );
+	}
+}
+
+
+void Sys_WaitSemaphore( void *sem )
+{
+	WaitForSingleObject( (HANDLE)sem, INFINITE );
+}
+
+
+void Sys_PostSemaphore( void *sem, int count )
+{
+	ReleaseSemaphore( (HANDLE)sem, count, NULL );
+}
+
+
+/*
+=================
+Sys_NumProcessors
+=================
+*/
+int Sys_NumProcessors( void )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+
+	if ( info.dwNumberOfProcessors < 1 ) {
+		return 1;
+	}
+
+	return (int)info.dwNumberOfProcessors;
+}
+
+
+/*
+=================
+Sys_ForkInstances
+=================
+*/
+int Sys_ForkInstances( int count )
+{
+	Com_Printf( S_COLOR_YELLOW "WARNING: server instances are not supported on this platform\n" );
+	return 0;
+}
+
+
+/*
+=================
+Sys_AtomicAdd
+=================
+*/
+int Sys_AtomicAdd( volatile int *ptr, int value )
+{
+	return InterlockedExchangeAdd( (volatile LONG *)ptr, value ) + value;
+}
+
+
+/*
+=================
+Sys_AtomicCompareSwap
+=================
+*/
+qboolean Sys_AtomicCompareSwap( volatile int *ptr, int expected, int value )
+{
+	return InterlockedCompareExchange( (volatile LONG *)ptr, value, expected ) == expected ? qtrue : qfalse;
+}
+
+
+/*
+=================
+Sys_AtomicLoad
+=================
+*/
+int Sys_AtomicLoad( volatile int *ptr )
+{
+	// interlocked operations are full barriers
+	return InterlockedCompareExchange( (volatile LONG *)ptr, 0, 0 );
+}
+
+
+/*
+=================
+Sys_AtomicStore
+=================
+*/
+void Sys_AtomicStore( volatile int *ptr, int value )
+{
+	InterlockedExchange( (volatile LONG *)ptr, value );
+}